@@ -0,0 +1,338 @@
+#!/bin/bash
+#
+# Copyright Red Hat
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+# 02110-1301, USA.
+#
+# The performance regression suite. It runs a fixed matrix and writes one
+# JSON object per measurement (JSON Lines), so runs can be stored, diffed
+# and compared against a baseline.
+#
+# The userspace stage always runs. It builds vdo/user and uds/user and runs
+# every vdoBench and udsBench test. These fail on their own if a pass finds
+# the wrong entries.
+#
+# The device stage runs only when it is given a device to destroy. It needs
+# root, the kvdo and uds modules, and the vdo and dmsetup tools. It creates
+# a vdo volume on the device and drives it with the "workload" dmsetup
+# message for the sequential and random write and read, dedupe-heavy,
+# compress-heavy and mixed cases. It uses dd with O_DSYNC for the
+# flush-heavy case and blkdiscard for the discard case, and times a clean
+# start, which includes loading the dedupe index, and a forced rebuild.
+# A loop device works, as does null_blk, though null_blk discards data and
+# so only suits the write cases:
+#
+#   truncate -s 20G /var/tmp/vdo.img && losetup -f --show /var/tmp/vdo.img
+#   modprobe null_blk gb=20 bs=4096
+#
+# Each record has "suite", "test" and "case" fields. Userspace records
+# carry "ops", "ms" and "ns_per_op". Device records carry "iops" and
+# "kib_per_sec", the latency percentiles in microseconds when the workload
+# message measured them, "cpu_s_per_gib" from /proc/stat (so run on an
+# otherwise idle machine), and the volume's "memory_bytes".
+#
+# With --compare, each record is checked against the record with the same
+# suite, test and case in the baseline. A ns_per_op rise, an iops fall, or
+# for the startup and rebuild cases an elapsed_us rise, of more than the
+# threshold is reported, and makes the script exit with 1.
+#
+# baseline-userspace.jsonl holds a userspace stage run from a single-CPU
+# x86-64 virtual machine. It is only meaningful as a baseline on similar
+# hardware; record a new one on the machine which will run the comparison.
+
+set -o pipefail
+
+TOP_DIR=$(cd "$(dirname "$0")/.." && pwd)
+VDO_NAME=vdoBenchmark
+OPERATIONS=200000
+SPAN=262144
+THRESHOLD=10
+BASELINE=
+DEVICE=
+OUTPUT=
+
+usage() {
+	cat <<EOF
+Usage: $0 [options]
+
+Options:
+  -d, --device=DEV      create a vdo volume on DEV, destroying its contents,
+                        and run the device stage on it
+  -n, --ops=N           requests per device workload (default $OPERATIONS)
+  -s, --span=N          logical blocks the device workloads address
+                        (default $SPAN)
+  -o, --output=FILE     write the records to FILE as well as stdout
+  -c, --compare=FILE    compare the records against a baseline run
+  -t, --threshold=P     the percentage change counted as a regression
+                        (default $THRESHOLD)
+  -h, --help            show this message
+EOF
+}
+
+OPTIONS=$(getopt -o d:n:s:o:c:t:h \
+	  -l device:,ops:,span:,output:,compare:,threshold:,help \
+	  -n "$0" -- "$@") || { usage >&2; exit 2; }
+eval set -- "$OPTIONS"
+while true; do
+	case "$1" in
+	-d|--device)	DEVICE=$2; shift 2;;
+	-n|--ops)	OPERATIONS=$2; shift 2;;
+	-s|--span)	SPAN=$2; shift 2;;
+	-o|--output)	OUTPUT=$2; shift 2;;
+	-c|--compare)	BASELINE=$2; shift 2;;
+	-t|--threshold)	THRESHOLD=$2; shift 2;;
+	-h|--help)	usage; exit 0;;
+	--)		shift; break;;
+	esac
+done
+
+RECORDS=$(mktemp)
+FAILURES=0
+trap 'rm -f "$RECORDS"' EXIT
+
+# Emit a record from "key=value" arguments. Numeric values are written as
+# JSON numbers, and everything else as strings.
+record() {
+	local json= pair key value
+	for pair in "$@"; do
+		key=${pair%%=*}
+		value=${pair#*=}
+		if ! [[ $value =~ ^-?[0-9]+(\.[0-9]+)?$ ]]; then
+			value="\"$value\""
+		fi
+		json+="${json:+,}\"$key\":$value"
+	done
+	echo "{$json}" | tee -a "$RECORDS"
+}
+
+fail() {
+	echo "$0: $*" >&2
+	FAILURES=$((FAILURES + 1))
+}
+
+# Turn the report lines of vdoBench and udsBench, which read
+# "<test> <case words> <n> ops <ms> ms <ns> ns/op", into records.
+run_microbenchmark() {
+	local suite=$1
+	shift
+	local line words
+	"$@" 2>/dev/null | while read -r line; do
+		read -ra words <<<"$line"
+		local count=${#words[@]}
+		if ((count < 7)) || [[ ${words[count - 1]} != ns/op ]]; then
+			continue
+		fi
+		record suite="$suite" test="${words[0]}" \
+		       case="${words[*]:1:count - 7}" \
+		       ops="${words[count - 6]}" ms="${words[count - 4]}" \
+		       ns_per_op="${words[count - 2]}"
+	done
+}
+
+run_userspace_stage() {
+	local image
+
+	make -s -C "$TOP_DIR/uds/user" >&2 || { fail "uds/user build"; return; }
+	make -s -C "$TOP_DIR/vdo/user" >&2 || { fail "vdo/user build"; return; }
+
+	run_microbenchmark vdoBench "$TOP_DIR/vdo/user/vdoBench" ||
+		fail "vdoBench failed"
+
+	image=$(mktemp)
+	run_microbenchmark udsBench "$TOP_DIR/uds/user/udsBench" "$image" ||
+		fail "udsBench failed"
+	rm -f "$image"
+}
+
+# The busy time of all CPUs, in clock ticks.
+cpu_ticks() {
+	awk '$1 == "cpu" { print $2 + $3 + $4 + $7 + $8; exit }' /proc/stat
+}
+
+memory_bytes() {
+	local minor
+	minor=$(dmsetup info -c --noheadings -o minor "$VDO_NAME")
+	cat "/sys/block/dm-$minor/vdo/statistics/memory_usage_bytes_used" \
+		2>/dev/null || echo 0
+}
+
+# Record the CPU and memory cost of a device case, which moved a given
+# number of bytes in a given time, followed by its other measurements.
+device_record() {
+	local test=$1 bytes=$2 start_ticks=$3
+	shift 3
+	local ticks=$(( $(cpu_ticks) - start_ticks ))
+	local cpu_per_gib
+	cpu_per_gib=$(awk -v t="$ticks" -v hz="$(getconf CLK_TCK)" \
+			  -v b="$bytes" \
+			  'BEGIN {
+				   gib = b / 1073741824;
+				   printf "%.3f", (gib > 0) ? t / hz / gib : 0;
+			   }')
+	record suite=device test="$test" case="vdo" \
+	       cpu_s_per_gib="$cpu_per_gib" memory_bytes="$(memory_bytes)" "$@"
+}
+
+# Run one case of the workload message, and record its report, which reads
+# "ops <n> blocks <n> ... latency_us p50 <n> p90 <n> ...".
+run_workload() {
+	local test=$1
+	shift
+	local start report words i blocks=0
+	local -a fields
+
+	start=$(cpu_ticks)
+	report=$(dmsetup message "$VDO_NAME" 0 workload ops="$OPERATIONS" \
+		 span="$SPAN" "$@") || { fail "workload $test"; return; }
+	read -ra words <<<"$report"
+	for ((i = 0; i + 1 < ${#words[@]}; i += 2)); do
+		case "${words[i]}" in
+		latency_us)
+			i=$((i - 1));;
+		p50|p90|p99|p999|max)
+			fields+=("latency_${words[i]}_us=${words[i + 1]}");;
+		blocks)
+			blocks=${words[i + 1]}
+			fields+=("blocks=$blocks");;
+		*)
+			fields+=("${words[i]}=${words[i + 1]}");;
+		esac
+	done
+	device_record "$test" $((blocks * 4096)) "$start" "${fields[@]}"
+}
+
+# Time a command which moves a given number of bytes.
+run_timed() {
+	local test=$1 bytes=$2
+	shift 2
+	local start_ticks start end elapsed_us
+
+	start_ticks=$(cpu_ticks)
+	start=$(date +%s%N)
+	"$@" >/dev/null 2>&1 || { fail "$test"; return; }
+	end=$(date +%s%N)
+	elapsed_us=$(( (end - start) / 1000 ))
+	elapsed_us=$(( elapsed_us > 0 ? elapsed_us : 1 ))
+	device_record "$test" "$bytes" "$start_ticks" \
+		      elapsed_us="$elapsed_us" \
+		      iops=$(( bytes / 4096 * 1000000 / elapsed_us )) \
+		      kib_per_sec=$(( bytes / 1024 * 1000000 / elapsed_us ))
+}
+
+run_device_stage() {
+	local volume=/dev/mapper/$VDO_NAME
+	local flush_blocks=$((OPERATIONS / 10))
+
+	if [[ $(id -u) != 0 ]]; then
+		fail "the device stage must be run as root"
+		return
+	fi
+
+	modprobe kvdo || { fail "cannot load kvdo"; return; }
+	vdo create --force --name="$VDO_NAME" --device="$DEVICE" \
+	    --vdoLogicalSize=$((SPAN * 4))K --compression=enabled \
+	    --deduplication=enabled >&2 ||
+		{ fail "cannot create a vdo volume on $DEVICE"; return; }
+
+	# Fill the span first so that the read cases read mapped blocks.
+	run_workload seq_write locality=100 sizes=32
+	run_workload rand_write locality=0 sizes=1 seed=2
+	run_workload seq_read reads=100 locality=100 sizes=32
+	run_workload rand_read reads=100 locality=0 sizes=1 seed=3
+	run_workload dedupe_heavy dedupe=90 sizes=1 seed=4
+	run_workload compress_heavy compress=70 sizes=1 seed=5
+	run_workload mixed reads=70 dedupe=50 compress=50 locality=50 \
+		     sizes=1,8,32 seed=6
+	run_timed flush_heavy $((flush_blocks * 4096)) \
+		  dd if=/dev/urandom of="$volume" bs=4096 \
+		  count="$flush_blocks" oflag=direct,dsync
+	run_timed discard $((SPAN * 4096)) \
+		  blkdiscard -o 0 -l $((SPAN * 4096)) "$volume"
+
+	vdo stop --name="$VDO_NAME" >&2
+	run_timed startup 0 vdo start --name="$VDO_NAME"
+	vdo stop --name="$VDO_NAME" >&2
+	run_timed rebuild 0 vdo start --name="$VDO_NAME" --forceRebuild
+
+	vdo remove --force --name="$VDO_NAME" >&2
+}
+
+# Report each record which is more than THRESHOLD percent worse than the
+# record for the same case in the baseline.
+compare_with_baseline() {
+	awk -v threshold="$THRESHOLD" '
+	function field(record, key,    value) {
+		if (!match(record, "\"" key "\":(\"[^\"]*\"|[-0-9.]+)")) {
+			return "";
+		}
+		value = substr(record, RSTART + length(key) + 3,
+			       RLENGTH - length(key) - 3);
+		gsub(/"/, "", value);
+		return value;
+	}
+	function name(record) {
+		return field(record, "suite") " " field(record, "test") " " \
+		       field(record, "case");
+	}
+	function check(record, key, higher_is_better,    old, new, change) {
+		old = baseline[name(record), key];
+		new = field(record, key);
+		if ((old == "") || (new == "") || (old == 0)) {
+			return;
+		}
+		change = (new - old) * 100 / old;
+		if (higher_is_better) {
+			change = -change;
+		}
+		if (change > threshold) {
+			printf("regression: %s %s %s -> %s (%+.1f%%)\n",
+			       name(record), key, old, new, change) \
+				> "/dev/stderr";
+			regressions++;
+		}
+	}
+	FNR == NR {
+		baseline[name($0), "ns_per_op"] = field($0, "ns_per_op");
+		baseline[name($0), "iops"] = field($0, "iops");
+		baseline[name($0), "elapsed_us"] = field($0, "elapsed_us");
+		next;
+	}
+	{
+		check($0, "ns_per_op", 0);
+		if (field($0, "iops") > 0) {
+			check($0, "iops", 1);
+		} else {
+			check($0, "elapsed_us", 0);
+		}
+	}
+	END { exit (regressions > 0); }
+	' "$BASELINE" "$RECORDS"
+}
+
+run_userspace_stage
+if [[ -n $DEVICE ]]; then
+	run_device_stage
+fi
+
+if [[ -n $OUTPUT ]]; then
+	cp "$RECORDS" "$OUTPUT"
+fi
+
+if [[ -n $BASELINE ]] && ! compare_with_baseline; then
+	FAILURES=$((FAILURES + 1))
+fi
+
+exit $((FAILURES > 0))
@@ -0,0 +1,172 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "bloomFilter.h"
+
+#include "compiler.h"
+#include "errors.h"
+#include "logger.h"
+#include "memoryAlloc.h"
+
+enum {
+	/* The size of a block, which is the smallest common cache line */
+	BLOOM_FILTER_BLOCK_BYTES = 64,
+	BLOOM_FILTER_BLOCK_WORDS = BLOOM_FILTER_BLOCK_BYTES / sizeof(uint64_t),
+	BLOOM_FILTER_BLOCK_BITS = BLOOM_FILTER_BLOCK_BYTES * CHAR_BIT,
+	/* The number of bits set for each key */
+	BLOOM_FILTER_PROBES = 4,
+	/* The number of hash bits needed to pick one bit of a block */
+	BLOOM_FILTER_PROBE_SHIFT = 9,
+};
+
+struct bloom_filter_block {
+	uint64_t words[BLOOM_FILTER_BLOCK_WORDS];
+} __attribute__((aligned(BLOOM_FILTER_BLOCK_BYTES)));
+
+struct bloom_filter {
+	unsigned int block_count;
+	struct bloom_filter_block *blocks;
+};
+
+/**
+ * Mix the bits of a key, using the MurmurHash3 finalizer.
+ *
+ * @param key  The key to mix
+ *
+ * @return The mixed key
+ **/
+static INLINE uint64_t mix_key(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+/**
+ * Get the filter block for a mixed key. The high half of the hash picks the
+ * block, and the low half picks the bits within it.
+ *
+ * @param filter  The filter
+ * @param hash    The mixed key
+ *
+ * @return The block holding the key's bits
+ **/
+static INLINE struct bloom_filter_block *
+get_block(const struct bloom_filter *filter, uint64_t hash)
+{
+	return &filter->blocks[((hash >> 32) * filter->block_count) >> 32];
+}
+
+/**********************************************************************/
+int make_bloom_filter(uint64_t entries,
+		      unsigned int bits_per_entry,
+		      struct bloom_filter **filter_ptr)
+{
+	uint64_t block_count = ((entries * bits_per_entry +
+				 BLOOM_FILTER_BLOCK_BITS - 1) /
+				BLOOM_FILTER_BLOCK_BITS);
+	struct bloom_filter *filter;
+	int result;
+
+	if ((block_count == 0) || (block_count > UINT_MAX)) {
+		return log_warning_strerror(UDS_INVALID_ARGUMENT,
+					    "cannot make a Bloom filter of %u bits for %llu entries",
+					    bits_per_entry,
+					    entries);
+	}
+
+	result = ALLOCATE(1, struct bloom_filter, "Bloom filter", &filter);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	filter->block_count = block_count;
+	result = ALLOCATE_HUGE(filter->block_count,
+			       struct bloom_filter_block,
+			       MEMORY_TAG_NONE,
+			       "Bloom filter blocks",
+			       &filter->blocks);
+	if (result != UDS_SUCCESS) {
+		free_bloom_filter(filter);
+		return result;
+	}
+
+	*filter_ptr = filter;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+void free_bloom_filter(struct bloom_filter *filter)
+{
+	if (filter == NULL) {
+		return;
+	}
+	FREE(filter->blocks);
+	FREE(filter);
+}
+
+/**********************************************************************/
+void clear_bloom_filter(struct bloom_filter *filter)
+{
+	memset(filter->blocks,
+	       0,
+	       filter->block_count * sizeof(struct bloom_filter_block));
+}
+
+/**********************************************************************/
+void add_to_bloom_filter(struct bloom_filter *filter, uint64_t key)
+{
+	uint64_t hash = mix_key(key);
+	struct bloom_filter_block *block = get_block(filter, hash);
+	unsigned int i;
+	for (i = 0; i < BLOOM_FILTER_PROBES; i++) {
+		unsigned int bit = hash % BLOOM_FILTER_BLOCK_BITS;
+		block->words[bit / 64] |= 1ULL << (bit % 64);
+		hash >>= BLOOM_FILTER_PROBE_SHIFT;
+	}
+}
+
+/**********************************************************************/
+bool bloom_filter_may_contain(const struct bloom_filter *filter, uint64_t key)
+{
+	uint64_t hash = mix_key(key);
+	const struct bloom_filter_block *block = get_block(filter, hash);
+	unsigned int i;
+	for (i = 0; i < BLOOM_FILTER_PROBES; i++) {
+		unsigned int bit = hash % BLOOM_FILTER_BLOCK_BITS;
+		if ((block->words[bit / 64] & (1ULL << (bit % 64))) == 0) {
+			return false;
+		}
+		hash >>= BLOOM_FILTER_PROBE_SHIFT;
+	}
+	return true;
+}
+
+/**********************************************************************/
+size_t get_bloom_filter_memory_size(const struct bloom_filter *filter)
+{
+	if (filter == NULL) {
+		return 0;
+	}
+	return (sizeof(struct bloom_filter) +
+		filter->block_count * sizeof(struct bloom_filter_block));
+}
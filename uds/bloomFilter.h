@@ -0,0 +1,93 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include "typeDefs.h"
+
+/**
+ * A bloom_filter is a blocked Bloom filter over 64-bit keys. Every key sets
+ * and tests bits in a single cache-line sized block, so a lookup costs one
+ * cache miss. A filter can answer that a key was never added, or that it may
+ * have been; keys cannot be removed, so a filter tracking a changing set must
+ * be cleared and refilled from time to time.
+ *
+ * A filter is not synchronized; each filter must be used by one thread at a
+ * time.
+ **/
+struct bloom_filter;
+
+/**
+ * Make a Bloom filter.
+ *
+ * @param [in]  entries         The number of keys the filter should hold
+ * @param [in]  bits_per_entry  The number of filter bits to spend on each key
+ * @param [out] filter_ptr      A pointer to hold the new filter
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check make_bloom_filter(uint64_t entries,
+				   unsigned int bits_per_entry,
+				   struct bloom_filter **filter_ptr);
+
+/**
+ * Free a Bloom filter.
+ *
+ * @param filter  The filter to free (may be NULL)
+ **/
+void free_bloom_filter(struct bloom_filter *filter);
+
+/**
+ * Remove every key from a Bloom filter.
+ *
+ * @param filter  The filter to clear
+ **/
+void clear_bloom_filter(struct bloom_filter *filter);
+
+/**
+ * Add a key to a Bloom filter.
+ *
+ * @param filter  The filter
+ * @param key     The key to add
+ **/
+void add_to_bloom_filter(struct bloom_filter *filter, uint64_t key);
+
+/**
+ * Check whether a key may have been added to a Bloom filter.
+ *
+ * @param filter  The filter
+ * @param key     The key to look for
+ *
+ * @return <code>false</code> if the key has certainly not been added since
+ *         the filter was last cleared
+ **/
+bool __must_check bloom_filter_may_contain(const struct bloom_filter *filter,
+					   uint64_t key);
+
+/**
+ * Get the number of bytes of memory used by a Bloom filter.
+ *
+ * @param filter  The filter (may be NULL)
+ *
+ * @return The size of the filter
+ **/
+size_t get_bloom_filter_memory_size(const struct bloom_filter *filter);
+
+#endif /* BLOOM_FILTER_H */
@@ -27,6 +27,12 @@
 #include "memoryAlloc.h"
 #include "numeric.h"
 
+enum {
+	// The number of blocks read ahead when a reader starts or seeks
+	MIN_READ_AHEAD = 4,
+};
+
+unsigned int buffered_reader_max_read_ahead = 1024;
 
 struct buffered_reader {
 	// IO factory owning the block device
@@ -39,20 +45,44 @@ struct buffered_reader {
 	sector_t br_limit;
 	// Number of the current block
 	sector_t br_block_number;
+	// The number of blocks to read ahead of the current block
+	sector_t br_read_ahead;
+	// The first block which has not been read ahead
+	sector_t br_read_ahead_end;
 	// Start of the buffer
 	byte *br_start;
 	// End of the data read from the buffer
 	byte *br_pointer;
 };
 
-/**********************************************************************/
+/**
+ * Read ahead of a reader which is about to read a block. While the reader
+ * keeps reading sequentially through the blocks already requested, the
+ * read-ahead window doubles each time it is extended, up to
+ * buffered_reader_max_read_ahead blocks, so that long sequential reads keep
+ * the device busy. More blocks are only requested once half of the window
+ * has been consumed.
+ *
+ * @param br            The buffered reader
+ * @param block_number  The block the reader will read next
+ **/
 static void read_ahead(struct buffered_reader *br, sector_t block_number)
 {
-	if (block_number < br->br_limit) {
-		enum { MAX_READ_AHEAD = 4 };
-		sector_t read_ahead = min((sector_t) MAX_READ_AHEAD,
-					  br->br_limit - block_number);
-		dm_bufio_prefetch(br->br_client, block_number, read_ahead);
+	if (block_number + br->br_read_ahead / 2 < br->br_read_ahead_end) {
+		return;
+	}
+
+	if (br->br_read_ahead_end > block_number) {
+		sector_t limit = max(READ_ONCE(buffered_reader_max_read_ahead),
+				     (unsigned int) MIN_READ_AHEAD);
+		br->br_read_ahead = min(br->br_read_ahead * 2, limit);
+	}
+
+	sector_t start = max(block_number, br->br_read_ahead_end);
+	sector_t end = min(block_number + br->br_read_ahead, br->br_limit);
+	if (end > start) {
+		dm_bufio_prefetch(br->br_client, start, end - start);
+		br->br_read_ahead_end = end;
 	}
 }
 
@@ -75,6 +105,8 @@ int make_buffered_reader(struct io_factory *factory,
 		.br_buffer = NULL,
 		.br_limit = block_limit,
 		.br_block_number = 0,
+		.br_read_ahead = MIN_READ_AHEAD,
+		.br_read_ahead_end = 0,
 		.br_start = NULL,
 		.br_pointer = NULL,
 	};
@@ -107,9 +139,22 @@ position_reader(struct buffered_reader *br, sector_t block_number, off_t offset)
 		if (block_number >= br->br_limit) {
 			return UDS_OUT_OF_RANGE;
 		}
+		bool sequential = (block_number == br->br_block_number + 1);
 		if (br->br_buffer != NULL) {
 			dm_bufio_release(br->br_buffer);
 			br->br_buffer = NULL;
+			if (sequential) {
+				// A sequential reader will not come back to
+				// the block it just finished, so don't let
+				// the blocks behind it pile up in the client.
+				dm_bufio_forget(br->br_client,
+						br->br_block_number);
+			}
+		}
+		if (!sequential && (block_number != br->br_block_number)) {
+			// Start again with a small window after a seek.
+			br->br_read_ahead = MIN_READ_AHEAD;
+			br->br_read_ahead_end = 0;
 		}
 		struct dm_buffer *buffer = NULL;
 		void *data =
@@ -119,7 +164,7 @@ position_reader(struct buffered_reader *br, sector_t block_number, off_t offset)
 		}
 		br->br_buffer = buffer;
 		br->br_start = data;
-		if (block_number == br->br_block_number + 1) {
+		if (sequential) {
 			read_ahead(br, block_number + 1);
 		}
 	}
@@ -207,3 +252,20 @@ int verify_buffered_data(struct buffered_reader *br,
 
 	return UDS_SUCCESS;
 }
+
+/**********************************************************************/
+off_t get_buffered_reader_offset(const struct buffered_reader *br)
+{
+	if (br->br_pointer == NULL) {
+		return 0;
+	}
+	return ((off_t) br->br_block_number * UDS_BLOCK_SIZE +
+		(br->br_pointer - br->br_start));
+}
+
+/**********************************************************************/
+int seek_buffered_reader(struct buffered_reader *br, off_t offset)
+{
+	return position_reader(br, offset / UDS_BLOCK_SIZE,
+			       offset % UDS_BLOCK_SIZE);
+}
@@ -34,6 +34,13 @@ struct io_factory;
  **/
 struct buffered_reader;
 
+/**
+ * The most blocks a buffered reader will read ahead of a sequential reader.
+ * The read-ahead window starts small and grows to this size as a reader
+ * keeps reading sequentially.
+ **/
+extern unsigned int buffered_reader_max_read_ahead;
+
 /**
  * Make a new buffered reader.
  *
@@ -86,4 +93,24 @@ int __must_check verify_buffered_data(struct buffered_reader *reader,
 				      const void *value,
 				      size_t length);
 
+/**
+ * Get the offset of the next byte to be read by a buffered reader.
+ *
+ * @param reader  The buffered reader
+ *
+ * @return The offset from the start of the region
+ **/
+off_t get_buffered_reader_offset(const struct buffered_reader *reader);
+
+/**
+ * Position a buffered reader so that the next byte read is at a given offset.
+ *
+ * @param reader  The buffered reader
+ * @param offset  The offset from the start of the region
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check seek_buffered_reader(struct buffered_reader *reader,
+				      off_t offset);
+
 #endif // BUFFERED_READER_H
@@ -28,16 +28,33 @@
 #include "memoryAlloc.h"
 #include "numeric.h"
 
+enum {
+	/*
+	 * The size of the blocks in which the bulk of a region is written.
+	 * Filling a large block and starting its write as soon as it is full
+	 * keeps several large writes in flight while the next blocks are being
+	 * filled, where single pages would each be written separately.
+	 */
+	WRITER_BLOCK_SIZE = 1024 * 1024,
+};
 
 struct buffered_writer {
 	// IO factory owning the block device
 	struct io_factory *bw_factory;
-	// The dm_bufio_client to write to
+	// The dm_bufio_client writing the whole large blocks of the region
+	struct dm_bufio_client *bw_bulk_client;
+	// The dm_bufio_client writing the pages after the last large block
+	struct dm_bufio_client *bw_tail_client;
+	// The dm_bufio_client currently being written to
 	struct dm_bufio_client *bw_client;
 	// The current dm_buffer
 	struct dm_buffer *bw_buffer;
-	// The number of blocks that can be written to
+	// The size of the blocks of the current client
+	size_t bw_block_size;
+	// The number of blocks of the current client that can be written to
 	sector_t bw_limit;
+	// The number of blocks of the tail client
+	sector_t bw_tail_limit;
 	// Number of the current block
 	sector_t bw_block_number;
 	// Start of the buffer
@@ -53,6 +70,16 @@ struct buffered_writer {
 /**********************************************************************/
 int __must_check prepare_next_buffer(struct buffered_writer *bw)
 {
+	if ((bw->bw_block_number >= bw->bw_limit) &&
+	    (bw->bw_client != bw->bw_tail_client) &&
+	    (bw->bw_tail_limit > 0)) {
+		// The large blocks are all written, so move on to the pages
+		// at the end of the region.
+		bw->bw_client = bw->bw_tail_client;
+		bw->bw_block_size = UDS_BLOCK_SIZE;
+		bw->bw_limit = bw->bw_tail_limit;
+		bw->bw_block_number = 0;
+	}
 	if (bw->bw_block_number >= bw->bw_limit) {
 		bw->bw_error = UDS_OUT_OF_RANGE;
 		return UDS_OUT_OF_RANGE;
@@ -86,14 +113,19 @@ int flush_previous_buffer(struct buffered_writer *bw)
 		bw->bw_start = NULL;
 		bw->bw_pointer = NULL;
 		bw->bw_block_number++;
+		if (bw->bw_client == bw->bw_bulk_client) {
+			// Start writing the large block now rather than
+			// leaving it for free_buffered_writer() to wait on.
+			dm_bufio_write_dirty_buffers_async(bw->bw_client);
+		}
 	}
 	return bw->bw_error;
 }
 
 /**********************************************************************/
 int make_buffered_writer(struct io_factory *factory,
-			 struct dm_bufio_client *client,
-			 sector_t block_limit,
+			 off_t offset,
+			 size_t size,
 			 struct buffered_writer **writer_ptr)
 {
 	struct buffered_writer *writer;
@@ -103,37 +135,75 @@ int make_buffered_writer(struct io_factory *factory,
 		return result;
 	}
 
+	sector_t bulk_limit = size / WRITER_BLOCK_SIZE;
+	size_t bulk_size = bulk_limit * WRITER_BLOCK_SIZE;
 	*writer = (struct buffered_writer){
 		.bw_factory = factory,
-		.bw_client = client,
+		.bw_bulk_client = NULL,
+		.bw_tail_client = NULL,
+		.bw_client = NULL,
 		.bw_buffer = NULL,
-		.bw_limit = block_limit,
+		.bw_block_size = WRITER_BLOCK_SIZE,
+		.bw_limit = bulk_limit,
+		.bw_tail_limit = (size - bulk_size) / UDS_BLOCK_SIZE,
 		.bw_start = NULL,
 		.bw_pointer = NULL,
 		.bw_block_number = 0,
 		.bw_error = UDS_SUCCESS,
 		.bw_used = false,
 	};
-
 	get_io_factory(factory);
+
+	if (writer->bw_limit > 0) {
+		result = make_bufio(factory, offset, WRITER_BLOCK_SIZE, 1,
+				    &writer->bw_bulk_client);
+		if (result != UDS_SUCCESS) {
+			free_buffered_writer(writer);
+			return result;
+		}
+	}
+	if (writer->bw_tail_limit > 0) {
+		result = make_bufio(factory, offset + bulk_size,
+				    UDS_BLOCK_SIZE, 1,
+				    &writer->bw_tail_client);
+		if (result != UDS_SUCCESS) {
+			free_buffered_writer(writer);
+			return result;
+		}
+	}
+	writer->bw_client = writer->bw_bulk_client;
+
 	*writer_ptr = writer;
 	return UDS_SUCCESS;
 }
 
-/**********************************************************************/
-void free_buffered_writer(struct buffered_writer *bw)
+/**
+ * Wait for the writes of a dm_bufio_client, and destroy it.
+ *
+ * @param client  The client to sync and destroy, which may be NULL
+ **/
+static void sync_and_destroy_client(struct dm_bufio_client *client)
 {
-	if (bw == NULL) {
+	if (client == NULL) {
 		return;
 	}
-	flush_previous_buffer(bw);
-	int result = -dm_bufio_write_dirty_buffers(bw->bw_client);
+	int result = -dm_bufio_write_dirty_buffers(client);
 	if (result != UDS_SUCCESS) {
 		log_warning_strerror(result,
 				     "%s cannot sync storage", __func__);
-			
 	}
-	dm_bufio_client_destroy(bw->bw_client);
+	dm_bufio_client_destroy(client);
+}
+
+/**********************************************************************/
+void free_buffered_writer(struct buffered_writer *bw)
+{
+	if (bw == NULL) {
+		return;
+	}
+	flush_previous_buffer(bw);
+	sync_and_destroy_client(bw->bw_bulk_client);
+	sync_and_destroy_client(bw->bw_tail_client);
 	put_io_factory(bw->bw_factory);
 	FREE(bw);
 }
@@ -147,7 +217,7 @@ static INLINE size_t space_used_in_buffer(struct buffered_writer *bw)
 /**********************************************************************/
 size_t space_remaining_in_write_buffer(struct buffered_writer *bw)
 {
-	return UDS_BLOCK_SIZE - space_used_in_buffer(bw);
+	return bw->bw_block_size - space_used_in_buffer(bw);
 }
 
 /**********************************************************************/
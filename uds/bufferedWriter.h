@@ -30,22 +30,26 @@ struct io_factory;
 struct buffered_writer;
 
 /**
- * Make a new buffered writer.
+ * Make a new buffered writer. The bulk of the region is written in large
+ * blocks, each of which starts writing as soon as it is filled, and only
+ * freeing the writer waits for the writes to finish.
  *
  * @param factory       The IO factory creating the buffered writer
- * @param client        The dm_bufio_client to write to.
- * @param block_limit   The number of blocks that may be written to.
+ * @param offset        The byte offset of the region to write.
+ * @param size          The size in bytes of the region, which must be a
+ *                      multiple of UDS_BLOCK_SIZE.
  * @param writer_ptr    The new buffered writer goes here.
  *
  * @return UDS_SUCCESS or an error code.
  **/
 int __must_check make_buffered_writer(struct io_factory *factory,
-				      struct dm_bufio_client *client,
-				      sector_t block_limit,
+				      off_t offset,
+				      size_t size,
 				      struct buffered_writer **writer_ptr);
 
 /**
- * Free a buffered writer, without flushing.
+ * Free a buffered writer, without flushing, waiting for the data already
+ * written to reach storage.
  *
  * @param [in] buffer   The buffered writer object.
  **/
@@ -29,18 +29,35 @@ int initialize_cached_chapter_index(struct cached_chapter_index *chapter,
 {
 	chapter->virtual_chapter = UINT64_MAX;
 	chapter->index_pages_count = geometry->index_pages_per_chapter;
+	return UDS_SUCCESS;
+}
 
-	int result = ALLOCATE(chapter->index_pages_count,
-			      struct delta_index_page,
-			      __func__,
+/**
+ * Allocate the array of ChapterIndexPages and the raw index page data for a
+ * cached_chapter_index.
+ *
+ * @param chapter   the chapter index cache entry
+ * @param geometry  the geometry governing the volume
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int __must_check
+allocate_chapter_pages(struct cached_chapter_index *chapter,
+		       const struct geometry *geometry)
+{
+	int result = ALLOCATE_TAGGED(chapter->index_pages_count,
+				     struct delta_index_page,
+				     MEMORY_TAG_SPARSE_CACHE,
+				     __func__,
 			      &chapter->index_pages);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
 
-	result = ALLOCATE(chapter->index_pages_count,
-			  struct volume_page,
-			  "sparse index volume pages",
+	result = ALLOCATE_TAGGED(chapter->index_pages_count,
+				 struct volume_page,
+				 MEMORY_TAG_SPARSE_CACHE,
+				 "sparse index volume pages",
 			  &chapter->volume_pages);
 	if (result != UDS_SUCCESS) {
 		return result;
@@ -60,14 +77,23 @@ int initialize_cached_chapter_index(struct cached_chapter_index *chapter,
 /**********************************************************************/
 void destroy_cached_chapter_index(struct cached_chapter_index *chapter)
 {
+	release_cached_chapter_index(chapter);
+}
+
+/**********************************************************************/
+void release_cached_chapter_index(struct cached_chapter_index *chapter)
+{
+	WRITE_ONCE(chapter->virtual_chapter, UINT64_MAX);
 	if (chapter->volume_pages != NULL) {
 		unsigned int i;
 		for (i = 0; i < chapter->index_pages_count; i++) {
 			destroy_volume_page(&chapter->volume_pages[i]);
 		}
 	}
-	FREE(chapter->index_pages);
-	FREE(chapter->volume_pages);
+	FREE_TAGGED(chapter->index_pages, MEMORY_TAG_SPARSE_CACHE);
+	FREE_TAGGED(chapter->volume_pages, MEMORY_TAG_SPARSE_CACHE);
+	chapter->index_pages = NULL;
+	chapter->volume_pages = NULL;
 }
 
 /**********************************************************************/
@@ -78,10 +104,19 @@ int cache_chapter_index(struct cached_chapter_index *chapter,
 	// Mark the cached chapter as unused in case the update fails midway.
 	chapter->virtual_chapter = UINT64_MAX;
 
+	int result;
+	if (chapter->index_pages == NULL) {
+		result = allocate_chapter_pages(chapter, volume->geometry);
+		if (result != UDS_SUCCESS) {
+			release_cached_chapter_index(chapter);
+			return result;
+		}
+	}
+
 	// Read all the page data and initialize the entire delta_index_page
 	// array. (It's not safe for the zone threads to do it lazily--they'll
 	// race.)
-	int result = read_chapter_index_from_volume(volume,
+	result = read_chapter_index_from_volume(volume,
 						    virtual_chapter,
 						    chapter->volume_pages,
 						    chapter->index_pages);
@@ -102,11 +137,11 @@ int cache_chapter_index(struct cached_chapter_index *chapter,
 }
 
 /**********************************************************************/
-int search_cached_chapter_index(struct cached_chapter_index *chapter,
-				const struct geometry *geometry,
-				const struct index_page_map *index_page_map,
-				const struct uds_chunk_name *name,
-				int *record_page_ptr)
+int find_cached_chapter_index_page(struct cached_chapter_index *chapter,
+				   const struct geometry *geometry,
+				   const struct index_page_map *index_page_map,
+				   const struct uds_chunk_name *name,
+				   struct delta_index_page **page_ptr)
 {
 	// Find the index_page_number in the chapter that would have the chunk
 	// name.
@@ -120,8 +155,25 @@ int search_cached_chapter_index(struct cached_chapter_index *chapter,
 		return result;
 	}
 
-	return search_chapter_index_page(&chapter->index_pages[index_page_number],
-				         geometry,
-				         name,
-				         record_page_ptr);
+	*page_ptr = &chapter->index_pages[index_page_number];
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int search_cached_chapter_index(struct cached_chapter_index *chapter,
+				const struct geometry *geometry,
+				const struct index_page_map *index_page_map,
+				const struct uds_chunk_name *name,
+				int *record_page_ptr)
+{
+	struct delta_index_page *page;
+	int result = find_cached_chapter_index_page(chapter, geometry,
+						    index_page_map, name,
+						    &page);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	return search_chapter_index_page(page, geometry, name,
+					 record_page_ptr);
 }
@@ -95,9 +95,10 @@ struct __attribute__((aligned(CACHE_LINE_BYTES))) cached_chapter_index {
 };
 
 /**
- * Initialize a struct cached_chapter_index, allocating the memory for the
- * array of ChapterIndexPages and the raw index page data. The chapter index
- * will be marked as unused (virtual_chapter == UINT64_MAX).
+ * Initialize a struct cached_chapter_index. The chapter index will be marked
+ * as unused (virtual_chapter == UINT64_MAX). The memory for the array of
+ * ChapterIndexPages and the raw index page data is allocated when a chapter
+ * is first cached in the entry.
  *
  * @param chapter   the chapter index cache entry to initialize
  * @param geometry  the geometry governing the volume
@@ -114,6 +115,15 @@ initialize_cached_chapter_index(struct cached_chapter_index *chapter,
  **/
 void destroy_cached_chapter_index(struct cached_chapter_index *chapter);
 
+/**
+ * Release the memory for the ChapterIndexPages and raw index page data of a
+ * cached_chapter_index, marking it unused. This must only be done once no
+ * zone can be searching the chapter.
+ *
+ * @param chapter   the chapter index cache entry to release
+ **/
+void release_cached_chapter_index(struct cached_chapter_index *chapter);
+
 /**
  * Assign a new value to the skip_search flag of a cached chapter index.
  *
@@ -182,6 +192,25 @@ int __must_check cache_chapter_index(struct cached_chapter_index *chapter,
 				     uint64_t virtual_chapter,
 				     const struct volume *volume);
 
+/**
+ * Find the page of a cached sparse chapter index which would contain a chunk
+ * name.
+ *
+ * @param [in]  chapter         the cache entry for the chapter
+ * @param [in]  geometry        the geometry governing the volume
+ * @param [in]  index_page_map  the index page number map for the volume
+ * @param [in]  name            the chunk name
+ * @param [out] page_ptr        the chapter index page for the name
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check
+find_cached_chapter_index_page(struct cached_chapter_index *chapter,
+			       const struct geometry *geometry,
+			       const struct index_page_map *index_page_map,
+			       const struct uds_chunk_name *name,
+			       struct delta_index_page **page_ptr);
+
 /**
  * Search a single cached sparse chapter index for a chunk name, returning the
  * record page number that may contain the name.
@@ -308,6 +308,23 @@ int validate_chapter_index_page(const struct delta_index_page *chapter_index_pag
 	return UDS_SUCCESS;
 }
 
+/**********************************************************************/
+void prefetch_chapter_index_page(struct delta_index_page *chapter_index_page,
+				 const struct geometry *geometry,
+				 const struct uds_chunk_name *name,
+				 bool list_data)
+{
+	struct delta_index *delta_index = &chapter_index_page->delta_index;
+	unsigned int sub_list_number =
+		(hash_to_chapter_delta_list(name, geometry) -
+		 chapter_index_page->lowest_list_number);
+	if (list_data) {
+		prefetch_delta_list_data(delta_index, sub_list_number);
+	} else {
+		prefetch_delta_list_header(delta_index, sub_list_number);
+	}
+}
+
 /**********************************************************************/
 int search_chapter_index_page(struct delta_index_page *chapter_index_page,
 			      const struct geometry *geometry,
@@ -167,6 +167,22 @@ int __must_check
 validate_chapter_index_page(const struct delta_index_page *chapter_index_page,
 			    const struct geometry *geometry);
 
+/**
+ * Prefetch the part of a chapter index page which a search for a chunk name
+ * will read. The header of the delta list is prefetched in the first stage,
+ * and the delta list itself in the second, which reads the header.
+ *
+ * @param chapter_index_page  The chapter index page
+ * @param geometry            The geometry of the volume
+ * @param name                The chunk name
+ * @param list_data           <code>false</code> for the first stage,
+ *                            <code>true</code> for the second
+ **/
+void prefetch_chapter_index_page(struct delta_index_page *chapter_index_page,
+				 const struct geometry *geometry,
+				 const struct uds_chunk_name *name,
+				 bool list_data);
+
 /**
  * Search a chapter index page for a chunk name, returning the record page
  * number that may contain the name.
@@ -29,8 +29,36 @@
 #include "memoryAlloc.h"
 #include "openChapter.h"
 #include "threads.h"
+#include "util/radixSort.h"
+#include "indexZone.h"
+#include "volume.h"
 
 
+/**
+ * A record page encoder sorts, encodes, and writes a fixed range of the
+ * record pages of each chapter, so that the record pages of a chapter are
+ * produced in parallel while the writer thread packs the chapter index
+ * pages.
+ **/
+struct record_page_encoder {
+	/* The chapter writer to which we belong */
+	struct chapter_writer *writer;
+	/* The thread to do the encoding */
+	struct thread *thread;
+	/* The sorter for the records of a page */
+	struct radix_sorter *sorter;
+	/* The record pointers to sort */
+	const struct uds_chunk_record **record_pointers;
+	/* The page used for writing */
+	struct volume_page page;
+	/* The first record page to encode */
+	unsigned int first_page;
+	/* The number of record pages to encode */
+	unsigned int page_count;
+	/* The result of encoding the most recent chapter */
+	int result;
+};
+
 struct chapter_writer {
 	/* The index to which we belong */
 	struct index *index;
@@ -46,16 +74,149 @@ struct chapter_writer {
 	int result;
 	/* The number of bytes allocated by the chapter writer */
 	size_t memory_allocated;
-	/* The number of zones which have submitted a chapter for writing */
-	unsigned int zones_to_write;
+	/* The number of chapters which may be waiting to be written */
+	unsigned int slot_count;
+	/* The number of zones which have submitted each waiting chapter */
+	unsigned int zones_to_write[MAX_OPEN_CHAPTERS - 1];
 	/* Open chapter index used by close_open_chapter() */
 	struct open_chapter_index *open_chapter_index;
 	/* Collated records used by close_open_chapter() */
 	struct uds_chunk_record *collated_records;
-	/* The chapters to write (one per zone) */
+	/* condition signalled when there is a chapter to encode */
+	struct cond_var encode_cond;
+	/* condition signalled when the encoders have finished a chapter */
+	struct cond_var encoded_cond;
+	/* Incremented each time a chapter is handed to the encoders */
+	uint64_t encode_generation;
+	/* The number of encoders still encoding the chapter */
+	unsigned int busy_encoders;
+	/* The physical page of the chapter being encoded */
+	int physical_page;
+	/* Set to true to stop the encoder threads */
+	bool stop_encoders;
+	/* The number of record page encoders */
+	unsigned int encoder_count;
+	/* The record page encoders */
+	struct record_page_encoder *encoders;
+	/* The chapters to write (one per zone for each slot) */
 	struct open_chapter_zone *chapters[];
 };
 
+/**
+ * Get the slot which holds the zones of a chapter waiting to be written.
+ *
+ * @param writer           The chapter writer
+ * @param virtual_chapter  The virtual chapter number of the chapter
+ *
+ * @return The slot for the chapter
+ **/
+static INLINE unsigned int get_chapter_slot(const struct chapter_writer *writer,
+					    uint64_t virtual_chapter)
+{
+	return virtual_chapter % writer->slot_count;
+}
+
+/**
+ * Check whether any zone has submitted a chapter which has not yet been
+ * written. The caller must hold the mutex.
+ *
+ * @param writer  The chapter writer
+ *
+ * @return <code>true</code> if no chapters are waiting to be written
+ **/
+static bool is_chapter_writer_idle(const struct chapter_writer *writer)
+{
+	unsigned int slot;
+	for (slot = 0; slot < writer->slot_count; slot++) {
+		if (writer->zones_to_write[slot] > 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * This is the driver function for a record page encoder thread. It loops
+ * until stopped, encoding its range of record pages each time the writer
+ * thread hands it a chapter.
+ **/
+static void encode_record_pages(void *arg)
+{
+	struct record_page_encoder *encoder = arg;
+	struct chapter_writer *writer = encoder->writer;
+	uint64_t generation = 0;
+	lock_mutex(&writer->mutex);
+	for (;;) {
+		while (!writer->stop_encoders &&
+		       (writer->encode_generation == generation)) {
+			wait_cond(&writer->encode_cond, &writer->mutex);
+		}
+		if (writer->stop_encoders) {
+			unlock_mutex(&writer->mutex);
+			return;
+		}
+		generation = writer->encode_generation;
+		unlock_mutex(&writer->mutex);
+
+		encoder->result =
+			write_record_page_range(writer->index->volume,
+						writer->physical_page,
+						writer->collated_records,
+						encoder->first_page,
+						encoder->page_count,
+						encoder->sorter,
+						encoder->record_pointers,
+						&encoder->page);
+
+		lock_mutex(&writer->mutex);
+		if (--writer->busy_encoders == 0) {
+			broadcast_cond(&writer->encoded_cond);
+		}
+	}
+}
+
+/**
+ * Write a collated chapter to the volume. The record pages are encoded by
+ * the encoder threads while this thread packs and writes the chapter index
+ * pages.
+ *
+ * @param writer  The chapter writer
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int write_collated_chapter(struct chapter_writer *writer)
+{
+	struct volume *volume = writer->index->volume;
+	int physical_page = get_chapter_physical_page(
+		volume, writer->open_chapter_index->virtual_chapter_number);
+
+	lock_mutex(&writer->mutex);
+	writer->physical_page = physical_page;
+	writer->busy_encoders = writer->encoder_count;
+	writer->encode_generation++;
+	broadcast_cond(&writer->encode_cond);
+	unlock_mutex(&writer->mutex);
+
+	int result = write_index_pages(volume, physical_page,
+				       writer->open_chapter_index, NULL);
+
+	lock_mutex(&writer->mutex);
+	while (writer->busy_encoders > 0) {
+		wait_cond(&writer->encoded_cond, &writer->mutex);
+	}
+	unlock_mutex(&writer->mutex);
+
+	unsigned int i;
+	for (i = 0; (i < writer->encoder_count) && (result == UDS_SUCCESS);
+	     i++) {
+		result = writer->encoders[i].result;
+	}
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	return finish_writing_chapter(volume);
+}
+
 /**
  * This is the driver function for the writer thread. It loops until
  * terminated, waiting for a chapter to provided to close.
@@ -66,8 +227,14 @@ static void close_chapters(void *arg)
 	log_debug("chapter writer starting");
 	lock_mutex(&writer->mutex);
 	for (;;) {
-		while (writer->zones_to_write < writer->index->zone_count) {
-			if (writer->stop && (writer->zones_to_write == 0)) {
+		// Chapters are written in order, so the next one to write is
+		// always the one after the newest chapter on the volume.
+		unsigned int slot =
+			get_chapter_slot(writer,
+					 writer->index->newest_virtual_chapter);
+		while (writer->zones_to_write[slot] <
+		       writer->index->zone_count) {
+			if (writer->stop && (writer->zones_to_write[slot] == 0)) {
 				// We've been told to stop, and all of the
 				// zones are in the same open chapter, so we
 				// can exit now.
@@ -104,12 +271,15 @@ static void close_chapters(void *arg)
 		}
 
 		int result =
-			close_open_chapter(writer->chapters,
-					   writer->index->zone_count,
-					   writer->index->volume,
-					   writer->open_chapter_index,
-					   writer->collated_records,
-					   writer->index->newest_virtual_chapter);
+			collate_open_chapter(&writer->chapters[slot *
+							       writer->index->zone_count],
+					     writer->index->zone_count,
+					     writer->open_chapter_index,
+					     writer->collated_records,
+					     writer->index->newest_virtual_chapter);
+		if (result == UDS_SUCCESS) {
+			result = write_collated_chapter(writer);
+		}
 
 		if (result == UDS_SUCCESS) {
 			result = process_chapter_writer_checkpoint_saves(writer->index);
@@ -120,12 +290,104 @@ static void close_chapters(void *arg)
 		// Note that the index is totally finished with the writing
 		// chapter
 		advance_active_chapters(writer->index);
-		writer->result = result;
-		writer->zones_to_write = 0;
+		// With several chapters in flight, a zone may not check the
+		// result until later chapters have been written, so keep the
+		// first failure.
+		if (writer->result == UDS_SUCCESS) {
+			writer->result = result;
+		}
+		writer->zones_to_write[slot] = 0;
 		broadcast_cond(&writer->cond);
 	}
 }
 
+/**
+ * Make the record page encoders of a chapter writer, dividing the record
+ * pages of a chapter evenly among them. One encoder is made for each zone,
+ * since each zone thread contributes a share of the records of a chapter.
+ *
+ * @param writer  The chapter writer
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int make_record_page_encoders(struct chapter_writer *writer)
+{
+	const struct geometry *geometry = writer->index->volume->geometry;
+	unsigned int pages = geometry->record_pages_per_chapter;
+	unsigned int count = min(writer->index->zone_count, pages);
+	int result = ALLOCATE(count, struct record_page_encoder,
+			      "record page encoders", &writer->encoders);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		struct record_page_encoder *encoder = &writer->encoders[i];
+		encoder->writer = writer;
+		encoder->first_page = (i * pages) / count;
+		encoder->page_count =
+			(((i + 1) * pages) / count) - encoder->first_page;
+		// Count the encoder now so that free_chapter_writer() will
+		// clean it up if any of the rest of this fails.
+		writer->encoder_count++;
+
+		result = initialize_volume_page(geometry, &encoder->page);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+		result = make_radix_sorter(geometry->records_per_page,
+					   &encoder->sorter);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+		result = ALLOCATE(geometry->records_per_page,
+				  const struct uds_chunk_record *,
+				  "record pointers",
+				  &encoder->record_pointers);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+		result = create_thread(encode_record_pages, encoder, "encoder",
+				       &encoder->thread);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
+	return UDS_SUCCESS;
+}
+
+/**
+ * Stop and free the record page encoders of a chapter writer.
+ *
+ * @param writer  The chapter writer
+ **/
+static void free_record_page_encoders(struct chapter_writer *writer)
+{
+	if (writer->encoders == NULL) {
+		return;
+	}
+
+	lock_mutex(&writer->mutex);
+	writer->stop_encoders = true;
+	broadcast_cond(&writer->encode_cond);
+	unlock_mutex(&writer->mutex);
+
+	unsigned int i;
+	for (i = 0; i < writer->encoder_count; i++) {
+		struct record_page_encoder *encoder = &writer->encoders[i];
+		if (encoder->thread != NULL) {
+			join_threads(encoder->thread);
+		}
+		destroy_volume_page(&encoder->page);
+		free_radix_sorter(encoder->sorter);
+		FREE(encoder->record_pointers);
+	}
+	FREE(writer->encoders);
+	writer->encoders = NULL;
+	writer->encoder_count = 0;
+}
+
 /**********************************************************************/
 int make_chapter_writer(struct index *index,
 			const struct index_version *index_version,
@@ -134,9 +396,10 @@ int make_chapter_writer(struct index *index,
 	size_t collated_records_size =
 		(sizeof(struct uds_chunk_record) *
 		 (1 + index->volume->geometry->records_per_chapter));
+	unsigned int slot_count = index->open_chapter_count - 1;
 	struct chapter_writer *writer;
 	int result = ALLOCATE_EXTENDED(struct chapter_writer,
-				       index->zone_count,
+				       slot_count * index->zone_count,
 				       struct open_chapter_zone *,
 				       "Chapter Writer",
 				       &writer);
@@ -144,6 +407,7 @@ int make_chapter_writer(struct index *index,
 		return result;
 	}
 	writer->index = index;
+	writer->slot_count = slot_count;
 
 	result = init_mutex(&writer->mutex);
 	if (result != UDS_SUCCESS) {
@@ -156,8 +420,23 @@ int make_chapter_writer(struct index *index,
 		FREE(writer);
 		return result;
 	}
+	result = init_cond(&writer->encode_cond);
+	if (result != UDS_SUCCESS) {
+		destroy_cond(&writer->cond);
+		destroy_mutex(&writer->mutex);
+		FREE(writer);
+		return result;
+	}
+	result = init_cond(&writer->encoded_cond);
+	if (result != UDS_SUCCESS) {
+		destroy_cond(&writer->encode_cond);
+		destroy_cond(&writer->cond);
+		destroy_mutex(&writer->mutex);
+		FREE(writer);
+		return result;
+	}
 
-	// Now that we have the mutex+cond, it is safe to call
+	// Now that we have the mutex+conds, it is safe to call
 	// free_chapter_writer.
 	result = allocate_cache_aligned(collated_records_size,
 					"collated records",
@@ -176,13 +455,26 @@ int make_chapter_writer(struct index *index,
 		return make_unrecoverable(result);
 	}
 
+	result = make_record_page_encoders(writer);
+	if (result != UDS_SUCCESS) {
+		free_chapter_writer(writer);
+		return make_unrecoverable(result);
+	}
+
 	size_t open_chapter_index_memory_allocated =
 		get_open_chapter_index_memory_allocated(
 			writer->open_chapter_index);
+	size_t encoders_memory_allocated =
+		(writer->encoder_count *
+		 (sizeof(struct record_page_encoder) +
+		  (index->volume->geometry->records_per_page *
+		   sizeof(const struct uds_chunk_record *))));
 	writer->memory_allocated =
 		(sizeof(struct chapter_writer) +
-		 index->zone_count * sizeof(struct open_chapter_zone *) +
-		 collated_records_size + open_chapter_index_memory_allocated);
+		 (slot_count * index->zone_count *
+		  sizeof(struct open_chapter_zone *)) +
+		 collated_records_size + open_chapter_index_memory_allocated +
+		 encoders_memory_allocated);
 
 	// We're initialized, so now it's safe to start the writer thread.
 	result = create_thread(close_chapters, writer, "writer",
@@ -204,8 +496,11 @@ void free_chapter_writer(struct chapter_writer *writer)
 	}
 
 	int result __always_unused = stop_chapter_writer(writer);
+	free_record_page_encoders(writer);
 	destroy_mutex(&writer->mutex);
 	destroy_cond(&writer->cond);
+	destroy_cond(&writer->encode_cond);
+	destroy_cond(&writer->encoded_cond);
 	free_open_chapter_index(writer->open_chapter_index);
 	FREE(writer->collated_records);
 	FREE(writer);
@@ -214,11 +509,14 @@ void free_chapter_writer(struct chapter_writer *writer)
 /**********************************************************************/
 unsigned int start_closing_chapter(struct chapter_writer *writer,
 				   unsigned int zone_number,
+				   uint64_t virtual_chapter,
 				   struct open_chapter_zone *chapter)
 {
+	unsigned int slot = get_chapter_slot(writer, virtual_chapter);
 	lock_mutex(&writer->mutex);
-	unsigned int finished_zones = ++writer->zones_to_write;
-	writer->chapters[zone_number] = chapter;
+	unsigned int finished_zones = ++writer->zones_to_write[slot];
+	writer->chapters[(slot * writer->index->zone_count) + zone_number] =
+		chapter;
 	broadcast_cond(&writer->cond);
 	unlock_mutex(&writer->mutex);
 
@@ -249,7 +547,7 @@ int finish_previous_chapter(struct chapter_writer *writer,
 void wait_for_idle_chapter_writer(struct chapter_writer *writer)
 {
 	lock_mutex(&writer->mutex);
-	while (writer->zones_to_write > 0) {
+	while (!is_chapter_writer_idle(writer)) {
 		// The chapter writer is probably writing a chapter.  If it is
 		// not, it will soon wake up and write a chapter.
 		wait_cond(&writer->cond, &writer->mutex);
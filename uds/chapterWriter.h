@@ -56,19 +56,21 @@ void free_chapter_writer(struct chapter_writer *writer);
  * Asychronously close and write a chapter by passing it to the writer
  * thread. Writing won't start until all zones have submitted a chapter.
  *
- * @param writer       the chapter writer
- * @param zone_number  the number of the zone submitting a chapter
- * @param chapter      the chapter to write
+ * @param writer           the chapter writer
+ * @param zone_number      the number of the zone submitting a chapter
+ * @param virtual_chapter  the virtual chapter number of the chapter
+ * @param chapter          the chapter to write
  *
- * @return The number of zones which have submitted the current chapter
+ * @return The number of zones which have submitted the chapter
  **/
 unsigned int __must_check
 start_closing_chapter(struct chapter_writer *writer,
 		      unsigned int zone_number,
+		      uint64_t virtual_chapter,
 		      struct open_chapter_zone *chapter);
 
 /**
- * Wait for the chapter writer thread to finish closing the chapter previous
+ * Wait for the chapter writer thread to finish closing every chapter previous
  * to the one specified.
  *
  * @param writer                  the chapter writer
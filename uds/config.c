@@ -90,6 +90,12 @@ bool are_uds_configurations_equal(struct uds_configuration *a,
 			      b->nonce);
 		result = false;
 	}
+	if (a->chapter_mean_delta_bits != b->chapter_mean_delta_bits) {
+		uds_log_error("Chapter mean delta bits (%u) does not match (%u)",
+			      a->chapter_mean_delta_bits,
+			      b->chapter_mean_delta_bits);
+		result = false;
+	}
 	return result;
 }
 
@@ -110,4 +116,6 @@ void log_uds_configuration(struct uds_configuration *conf)
 	log_debug("  Sparse sample rate:         %10u",
 		  conf->sparse_sample_rate);
 	log_debug("  Nonce:                      %llu", conf->nonce);
+	log_debug("  Chapter mean delta bits:    %10u",
+		  conf->chapter_mean_delta_bits);
 }
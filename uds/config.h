@@ -53,8 +53,12 @@ struct uds_configuration {
 	unsigned int bytes_per_page;
 	/** Sampling rate for sparse indexing */
 	unsigned int sparse_sample_rate;
+	/** Whether an existing index should change to this sample rate */
+	bool change_sparse_sample_rate;
 	/** Index Owner's nonce */
 	uds_nonce_t nonce;
+	/** The log2 of the mean delta of the chapter indexes */
+	unsigned int chapter_mean_delta_bits;
 };
 
 struct index_location {
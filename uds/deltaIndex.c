@@ -903,6 +903,16 @@ void set_delta_index_tag(struct delta_index *delta_index, byte tag)
 	}
 }
 
+/**********************************************************************/
+void set_delta_index_restoring_base(const struct delta_index *delta_index,
+				    bool restoring_base)
+{
+	unsigned int z;
+	for (z = 0; z < delta_index->num_zones; z++) {
+		delta_index->delta_zones[z].restoring_base = restoring_base;
+	}
+}
+
 /**********************************************************************/
 static int __must_check decode_delta_index_header(struct buffer *buffer,
 						  struct di_header *header)
@@ -1191,7 +1201,8 @@ static int __must_check encode_delta_index_header(struct buffer *buffer,
 /**********************************************************************/
 int start_saving_delta_index(const struct delta_index *delta_index,
 			     unsigned int zone_number,
-			     struct buffered_writer *buffered_writer)
+			     struct buffered_writer *buffered_writer,
+			     bool differential)
 {
 	struct delta_memory *delta_zone =
 		&delta_index->delta_zones[zone_number];
@@ -1237,7 +1248,7 @@ int start_saving_delta_index(const struct delta_index *delta_index,
 		}
 	}
 
-	start_saving_delta_memory(delta_zone, buffered_writer);
+	start_saving_delta_memory(delta_zone, buffered_writer, differential);
 	return UDS_SUCCESS;
 }
 
@@ -1319,6 +1330,57 @@ static void prefetch_delta_list(const struct delta_memory *delta_zone,
 	prefetch_range(addr, size, false);
 }
 
+/**********************************************************************/
+void prefetch_delta_list_header(const struct delta_index *delta_index,
+				unsigned int list_number)
+{
+	if (list_number >= delta_index->num_lists) {
+		return;
+	}
+	const struct delta_memory *delta_zone =
+		&delta_index->delta_zones[get_delta_index_zone(delta_index,
+							       list_number)];
+	list_number -= delta_zone->first_list;
+	if (delta_index->is_mutable) {
+		prefetch_address(&delta_zone->delta_lists[list_number + 1],
+				 false);
+	} else {
+		// The start of this list and the next one give its extent.
+		prefetch_range(&delta_zone->memory[get_immutable_header_offset(list_number) /
+						   CHAR_BIT],
+			       (2 * IMMUTABLE_HEADER_SIZE + CHAR_BIT - 1) /
+			       CHAR_BIT,
+			       false);
+	}
+}
+
+/**********************************************************************/
+void prefetch_delta_list_data(const struct delta_index *delta_index,
+			      unsigned int list_number)
+{
+	if (list_number >= delta_index->num_lists) {
+		return;
+	}
+	const struct delta_memory *delta_zone =
+		&delta_index->delta_zones[get_delta_index_zone(delta_index,
+							       list_number)];
+	list_number -= delta_zone->first_list;
+	if (delta_index->is_mutable) {
+		prefetch_delta_list(delta_zone,
+				    &delta_zone->delta_lists[list_number + 1]);
+		return;
+	}
+
+	struct delta_list delta_list = {
+		.start_offset = get_immutable_start(delta_zone->memory,
+						    list_number),
+	};
+	delta_list.size = (get_immutable_start(delta_zone->memory,
+					       list_number + 1) -
+			   delta_list.start_offset);
+	prefetch_delta_list(delta_zone, &delta_list);
+}
+
 /**********************************************************************/
 int start_delta_index_search(const struct delta_index *delta_index,
 			     unsigned int list_number,
@@ -1447,6 +1509,90 @@ int remember_delta_index_offset(const struct delta_index_entry *delta_entry)
 	return UDS_SUCCESS;
 }
 
+/**
+ * Skip over the entries of a delta list whose keys are less than a key,
+ * as a sequence of calls to next_delta_index_entry() would. All of the
+ * entries are decoded from a 64-bit window of the bit stream in one loop,
+ * without updating the delta_index_entry until the end. The loop stops short
+ * at the entry which reaches the key, at the end of the list, and at any
+ * entry which is too long for the window or looks corrupt, leaving those for
+ * next_delta_index_entry() to handle.
+ *
+ * @param delta_entry  The delta index entry, which is left describing the
+ *                     last entry skipped
+ * @param key          The key being searched for
+ **/
+static void skip_delta_index_entries(struct delta_index_entry *delta_entry,
+				     unsigned int key)
+{
+	const struct delta_memory *delta_zone = delta_entry->delta_zone;
+	const byte *memory = delta_zone->memory;
+	uint64_t list_start = get_delta_list_start(delta_entry->delta_list);
+	unsigned int size = get_delta_list_size(delta_entry->delta_list);
+	unsigned int value_bits = delta_entry->value_bits;
+	unsigned int min_bits = delta_zone->min_bits;
+	unsigned int min_keys = delta_zone->min_keys;
+	unsigned int incr_keys = delta_zone->incr_keys;
+	unsigned int offset = delta_entry->offset;
+	unsigned int entry_bits = delta_entry->entry_bits;
+	unsigned int entry_key = delta_entry->key;
+	unsigned int entry_delta = 0;
+	bool is_collision = false;
+	unsigned int skipped = 0;
+
+	if (delta_entry->at_end) {
+		return;
+	}
+
+	for (;;) {
+		unsigned int next_offset = offset + entry_bits;
+		if (next_offset >= size) {
+			break;
+		}
+
+		uint64_t delta_offset = list_start + next_offset + value_bits;
+		uint64_t data = (get_unaligned_le64(memory +
+						    delta_offset / CHAR_BIT) >>
+				 (delta_offset % CHAR_BIT));
+		unsigned int key_bits = min_bits;
+		unsigned int delta = data & ((1 << min_bits) - 1);
+		if (delta >= min_keys) {
+			data >>= min_bits;
+			if (data == 0) {
+				// The unary part continues past the window.
+				break;
+			}
+			key_bits += __ffs64(data) + 1;
+			delta += (key_bits - min_bits - 1) * incr_keys;
+		}
+
+		bool next_is_collision = ((delta == 0) && (next_offset > 0));
+		unsigned int next_bits = value_bits + key_bits;
+		if (next_is_collision) {
+			next_bits += COLLISION_BITS;
+		}
+		if ((entry_key + delta >= key) ||
+		    (next_offset + next_bits > size)) {
+			break;
+		}
+
+		offset = next_offset;
+		entry_bits = next_bits;
+		entry_key += delta;
+		entry_delta = delta;
+		is_collision = next_is_collision;
+		skipped++;
+	}
+
+	if (skipped > 0) {
+		delta_entry->offset = offset;
+		delta_entry->entry_bits = entry_bits;
+		delta_entry->key = entry_key;
+		delta_entry->delta = entry_delta;
+		delta_entry->is_collision = is_collision;
+	}
+}
+
 /**********************************************************************/
 int get_delta_index_entry(const struct delta_index *delta_index,
 			  unsigned int list_number,
@@ -1460,6 +1606,7 @@ int get_delta_index_entry(const struct delta_index *delta_index,
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
+	skip_delta_index_entries(delta_entry, key);
 	do {
 		result = next_delta_index_entry(delta_entry);
 		if (result != UDS_SUCCESS) {
@@ -1557,6 +1704,8 @@ int set_delta_entry_value(const struct delta_index_entry *delta_entry,
 		  delta_entry->delta_zone->memory,
 		  get_delta_entry_offset(delta_entry),
 		  delta_entry->value_bits);
+	mark_delta_list_dirty(delta_entry->delta_zone,
+			      delta_entry->list_number);
 	return UDS_SUCCESS;
 }
 
@@ -1659,6 +1808,7 @@ int put_delta_index_entry(struct delta_index_entry *delta_entry,
 	struct delta_memory *delta_zone = delta_entry->delta_zone;
 	delta_zone->record_count++;
 	delta_zone->collision_count += delta_entry->is_collision ? 1 : 0;
+	mark_delta_list_dirty(delta_zone, delta_entry->list_number);
 	return UDS_SUCCESS;
 }
 
@@ -1707,6 +1857,7 @@ int remove_delta_index_entry(struct delta_index_entry *delta_entry)
 	}
 	delta_zone->record_count--;
 	delta_zone->discard_count++;
+	mark_delta_list_dirty(delta_zone, delta_entry->list_number);
 	*delta_entry = next_entry;
 
 	struct delta_list *delta_list = delta_entry->delta_list;
@@ -222,6 +222,18 @@ int __must_check pack_delta_index_page(const struct delta_index *delta_index,
  **/
 void set_delta_index_tag(struct delta_index *delta_index, byte tag);
 
+/**
+ * Set whether a delta index is restoring the delta lists of the base save
+ * of a differential save. The lists which have already been restored from
+ * the differential save are then skipped instead of being treated as
+ * corrupt.
+ *
+ * @param delta_index     The delta index
+ * @param restoring_base  Whether the base save is being restored
+ **/
+void set_delta_index_restoring_base(const struct delta_index *delta_index,
+				    bool restoring_base);
+
 /**
  * Start restoring a delta index from an input stream.
  *
@@ -273,13 +285,16 @@ void abort_restoring_delta_index(const struct delta_index *delta_index);
  * @param delta_index      The delta index
  * @param zone_number      The zone number
  * @param buffered_writer  The index state component being written
+ * @param differential     If true, save only the delta lists which have
+ *                         changed since the last full save
  *
  * @return UDS_SUCCESS on success, or an error code on failure
  **/
 int __must_check
 start_saving_delta_index(const struct delta_index *delta_index,
 			 unsigned int zone_number,
-			 struct buffered_writer *buffered_writer);
+			 struct buffered_writer *buffered_writer,
+			 bool differential);
 
 /**
  * Have all the data been written while saving a delta index zone to an
@@ -339,6 +354,27 @@ size_t __must_check compute_delta_index_save_bytes(unsigned int num_lists,
  **/
 int __must_check validate_delta_index(const struct delta_index *delta_index);
 
+/**
+ * Prefetch the header of a delta list, in preparation for calling
+ * prefetch_delta_list_data() and then searching the list. Batching these
+ * calls across several delta indexes lets the memory accesses overlap.
+ *
+ * @param delta_index  The delta index
+ * @param list_number  The delta list number
+ **/
+void prefetch_delta_list_header(const struct delta_index *delta_index,
+				unsigned int list_number);
+
+/**
+ * Prefetch the bit stream of a delta list. This reads the list header, so it
+ * should follow a call to prefetch_delta_list_header().
+ *
+ * @param delta_index  The delta index
+ * @param list_number  The delta list number
+ **/
+void prefetch_delta_list_data(const struct delta_index *delta_index,
+			      unsigned int list_number);
+
 /**
  * Prepare to search for an entry in the specified delta list.
  *
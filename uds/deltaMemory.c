@@ -43,6 +43,10 @@
 // This is the number of guard bits that are needed in the tail guard list
 enum { GUARD_BITS = POST_FIELD_GUARD_BYTES * CHAR_BIT };
 
+// This is the most delta lists a local rebalance will move before giving up
+// and rebalancing the whole memory
+enum { MAX_LOCAL_REBALANCE_LISTS = 1024 };
+
 /**
  * Get the offset of the first byte that a delta list bit stream resides in
  *
@@ -146,9 +150,43 @@ static void flag_non_empty_delta_lists(struct delta_memory *delta_memory)
 	}
 }
 
+/**
+ * Set the transfer flags for delta lists that are not empty and have
+ * changed since the last full save, and count how many there are.
+ *
+ * @param delta_memory  The delta memory
+ **/
+static void flag_dirty_delta_lists(struct delta_memory *delta_memory)
+{
+	clear_transfer_flags(delta_memory);
+	unsigned int i;
+	for (i = 0; i < delta_memory->num_lists; i++) {
+		if ((get_field(delta_memory->dirty_flags, i, 1) != 0) &&
+		    (get_delta_list_size(&delta_memory->delta_lists[i + 1]) > 0)) {
+			set_one(delta_memory->flags, i, 1);
+			delta_memory->num_transfers++;
+		}
+	}
+}
+
+/**
+ * Mark every delta list as changed since the last full save.
+ *
+ * @param delta_memory  The delta memory
+ **/
+static void mark_all_delta_lists_dirty(struct delta_memory *delta_memory)
+{
+	memset(delta_memory->dirty_flags,
+	       0xFF,
+	       get_size_of_flags(delta_memory->num_lists));
+}
+
 /**********************************************************************/
 void empty_delta_lists(struct delta_memory *delta_memory)
 {
+	// An empty list is only clean if the last full save was empty too.
+	mark_all_delta_lists_dirty(delta_memory);
+
 	// Zero all the delta list headers
 	struct delta_list *delta_lists = delta_memory->delta_lists;
 	memset(delta_lists, 0,
@@ -181,6 +219,7 @@ void empty_delta_lists(struct delta_memory *delta_memory)
 	// so we just need to set the starting offsets.
 	uint64_t spacing = (num_bits - GUARD_BITS) / delta_memory->num_lists;
 	uint64_t offset = spacing / 2;
+	delta_memory->min_gap = spacing / CHAR_BIT / 2;
 	unsigned int i;
 	for (i = 1; i <= delta_memory->num_lists; i++) {
 		delta_lists[i].start_offset = offset;
@@ -267,6 +306,88 @@ static void rebalance_delta_memory(const struct delta_memory *delta_memory,
 	}
 }
 
+/**
+ * Rebalance only the delta lists near a growing list, if there is enough
+ * free space among them. The window of lists grows outward from the growing
+ * list until its free space leaves every list at least the minimum gap, and
+ * the free space is then handed out in proportion to the sizes of the lists
+ * beside each gap, since larger lists are the ones which grow fastest. This
+ * bounds the amount of memory moved by a single insertion, so that a zone is
+ * not stalled by moving all of its lists.
+ *
+ * @param delta_memory   A delta memory structure
+ * @param growing_index  Index of the delta list whose start needs space
+ * @param growing_size   The number of bytes it needs
+ *
+ * @return <code>true</code> if the lists were rebalanced
+ **/
+static bool rebalance_delta_memory_locally(struct delta_memory *delta_memory,
+					   unsigned int growing_index,
+					   size_t growing_size)
+{
+	const struct delta_list *delta_lists = delta_memory->delta_lists;
+	unsigned int num_lists = delta_memory->num_lists;
+	unsigned int half;
+	for (half = 1; half <= MAX_LOCAL_REBALANCE_LISTS / 2; half *= 2) {
+		// The window is the lists [first, last], which are moved within
+		// the bytes between the lists either side of it.
+		unsigned int first = ((growing_index > half) ?
+				      growing_index - half : 1);
+		unsigned int last = min(growing_index + half - 1, num_lists);
+
+		uint64_t region_start =
+			(get_delta_list_byte_start(&delta_lists[first - 1]) +
+			 get_delta_list_byte_size(&delta_lists[first - 1]));
+		uint64_t region_end =
+			get_delta_list_byte_start(&delta_lists[last + 1]);
+		uint64_t used = growing_size;
+		uint64_t weight = 0;
+		unsigned int i;
+		for (i = first; i <= last + 1; i++) {
+			uint16_t size =
+				get_delta_list_byte_size(&delta_lists[i]);
+			if (i <= last) {
+				used += size;
+			}
+			weight += 1 + size +
+				get_delta_list_byte_size(&delta_lists[i - 1]);
+		}
+
+		uint64_t gap_count = last - first + 2;
+		if (region_end < region_start + used +
+				 gap_count * delta_memory->min_gap) {
+			if ((first == 1) && (last == num_lists)) {
+				break;
+			}
+			continue;
+		}
+
+		// Lay out the window, giving each gap its share of the spare
+		// space, and the growing gap its extra bytes too.
+		uint64_t spare = region_end - region_start - used;
+		uint64_t offset = region_start;
+		for (i = first; i <= last; i++) {
+			const struct delta_list *delta_list = &delta_lists[i];
+			uint16_t size = get_delta_list_byte_size(delta_list);
+			offset += (spare *
+				   (1 + size +
+				    get_delta_list_byte_size(&delta_list[-1])) /
+				   weight);
+			if (i == growing_index) {
+				offset += growing_size;
+			}
+			delta_memory->temp_offsets[i] =
+				(offset * CHAR_BIT +
+				 get_delta_list_start(delta_list) % CHAR_BIT);
+			offset += size;
+		}
+
+		rebalance_delta_memory(delta_memory, first, last);
+		return true;
+	}
+	return false;
+}
+
 /**********************************************************************/
 int initialize_delta_memory(struct delta_memory *delta_memory,
 			    size_t size,
@@ -280,7 +401,8 @@ int initialize_delta_memory(struct delta_memory *delta_memory,
 					    "cannot initialize delta memory with 0 delta lists");
 	}
 	byte *memory = NULL;
-	int result = ALLOCATE(size, byte, "delta list", &memory);
+	int result = ALLOCATE_HUGE(size, byte, MEMORY_TAG_DELTA_MEMORY,
+				   "delta list", &memory);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
@@ -288,15 +410,24 @@ int initialize_delta_memory(struct delta_memory *delta_memory,
 	result = ALLOCATE(num_lists + 2, uint64_t, "delta list temp",
 			  &temp_offsets);
 	if (result != UDS_SUCCESS) {
-		FREE(memory);
+		FREE_TAGGED(memory, MEMORY_TAG_DELTA_MEMORY);
 		return result;
 	}
 	byte *flags = NULL;
 	result = ALLOCATE(get_size_of_flags(num_lists), byte,
 			  "delta list flags", &flags);
 	if (result != UDS_SUCCESS) {
-		FREE(memory);
+		FREE_TAGGED(memory, MEMORY_TAG_DELTA_MEMORY);
+		FREE(temp_offsets);
+		return result;
+	}
+	byte *dirty_flags = NULL;
+	result = ALLOCATE(get_size_of_flags(num_lists), byte,
+			  "delta list dirty flags", &dirty_flags);
+	if (result != UDS_SUCCESS) {
+		FREE_TAGGED(memory, MEMORY_TAG_DELTA_MEMORY);
 		FREE(temp_offsets);
+		FREE(flags);
 		return result;
 	}
 
@@ -309,8 +440,10 @@ int initialize_delta_memory(struct delta_memory *delta_memory,
 	delta_memory->delta_lists = NULL;
 	delta_memory->temp_offsets = temp_offsets;
 	delta_memory->flags = flags;
+	delta_memory->dirty_flags = dirty_flags;
 	delta_memory->buffered_writer = NULL;
 	delta_memory->size = size;
+	delta_memory->min_gap = 0;
 	delta_memory->rebalance_time = 0;
 	delta_memory->rebalance_count = 0;
 	delta_memory->record_count = 0;
@@ -322,6 +455,8 @@ int initialize_delta_memory(struct delta_memory *delta_memory,
 	delta_memory->num_transfers = 0;
 	delta_memory->transfer_status = UDS_SUCCESS;
 	delta_memory->tag = 'm';
+	delta_memory->differential_save = false;
+	delta_memory->restoring_base = false;
 
 	// Allocate the delta lists.
 	result = ALLOCATE(delta_memory->num_lists + 2, struct delta_list,
@@ -338,13 +473,15 @@ int initialize_delta_memory(struct delta_memory *delta_memory,
 /**********************************************************************/
 void uninitialize_delta_memory(struct delta_memory *delta_memory)
 {
+	FREE(delta_memory->dirty_flags);
+	delta_memory->dirty_flags = NULL;
 	FREE(delta_memory->flags);
 	delta_memory->flags = NULL;
 	FREE(delta_memory->temp_offsets);
 	delta_memory->temp_offsets = NULL;
 	FREE(delta_memory->delta_lists);
 	delta_memory->delta_lists = NULL;
-	FREE(delta_memory->memory);
+	FREE_TAGGED(delta_memory->memory, MEMORY_TAG_DELTA_MEMORY);
 	delta_memory->memory = NULL;
 }
 
@@ -365,8 +502,10 @@ void initialize_delta_memory_page(struct delta_memory *delta_memory,
 	delta_memory->delta_lists = NULL;
 	delta_memory->temp_offsets = NULL;
 	delta_memory->flags = NULL;
+	delta_memory->dirty_flags = NULL;
 	delta_memory->buffered_writer = NULL;
 	delta_memory->size = size;
+	delta_memory->min_gap = 0;
 	delta_memory->rebalance_time = 0;
 	delta_memory->rebalance_count = 0;
 	delta_memory->record_count = 0;
@@ -378,6 +517,8 @@ void initialize_delta_memory_page(struct delta_memory *delta_memory,
 	delta_memory->num_transfers = 0;
 	delta_memory->transfer_status = UDS_SUCCESS;
 	delta_memory->tag = 'p';
+	delta_memory->differential_save = false;
+	delta_memory->restoring_base = false;
 }
 
 /**********************************************************************/
@@ -469,6 +610,11 @@ int restore_delta_list(struct delta_memory *delta_memory,
 	}
 
 	if (get_field(delta_memory->flags, list_number, 1) == 0) {
+		if (delta_memory->restoring_base) {
+			// This list has changed since the base save, and was
+			// restored from the differential save.
+			return UDS_SUCCESS;
+		}
 		return log_warning_strerror(UDS_CORRUPT_COMPONENT,
 					    "unexpected delta list number %u",
 					    dlsi->index);
@@ -506,9 +652,24 @@ void abort_restoring_delta_memory(struct delta_memory *delta_memory)
 
 /**********************************************************************/
 void start_saving_delta_memory(struct delta_memory *delta_memory,
-			       struct buffered_writer *buffered_writer)
+			       struct buffered_writer *buffered_writer,
+			       bool differential)
 {
-	flag_non_empty_delta_lists(delta_memory);
+	delta_memory->differential_save = differential;
+	if (differential) {
+		flag_dirty_delta_lists(delta_memory);
+	} else {
+		// An empty list is saved by its size alone, so it is clean
+		// from the outset. Every other list becomes clean as it is
+		// written.
+		unsigned int i;
+		for (i = 0; i < delta_memory->num_lists; i++) {
+			if (get_delta_list_size(&delta_memory->delta_lists[i + 1]) == 0) {
+				set_zero(delta_memory->dirty_flags, i, 1);
+			}
+		}
+		flag_non_empty_delta_lists(delta_memory);
+	}
 	delta_memory->buffered_writer = buffered_writer;
 }
 
@@ -535,6 +696,11 @@ int finish_saving_delta_memory(struct delta_memory *delta_memory)
 /**********************************************************************/
 void abort_saving_delta_memory(struct delta_memory *delta_memory)
 {
+	if (!delta_memory->differential_save) {
+		// Part of the lists have been marked clean against a save
+		// which will never exist.
+		mark_all_delta_lists_dirty(delta_memory);
+	}
 	clear_transfer_flags(delta_memory);
 	delta_memory->buffered_writer = NULL;
 }
@@ -561,6 +727,9 @@ void flush_delta_list(struct delta_memory *delta_memory,
 			"flush bit is set");
 	set_zero(delta_memory->flags, flush_index, 1);
 	delta_memory->num_transfers--;
+	if (!delta_memory->differential_save) {
+		set_zero(delta_memory->dirty_flags, flush_index, 1);
+	}
 
 	struct delta_list *delta_list =
 		&delta_memory->delta_lists[flush_index + 1];
@@ -623,6 +792,17 @@ int extend_delta_memory(struct delta_memory *delta_memory,
 
 	ktime_t start_time = current_time_ns(CLOCK_MONOTONIC);
 
+	// Try to make room by moving only the lists near the growing one.
+	if (do_copy && (growing_index > 0) &&
+	    rebalance_delta_memory_locally(delta_memory, growing_index,
+					   growing_size)) {
+		ktime_t end_time = current_time_ns(CLOCK_MONOTONIC);
+		delta_memory->rebalance_count++;
+		delta_memory->rebalance_time +=
+			ktime_sub(end_time, start_time);
+		return UDS_SUCCESS;
+	}
+
 	// Calculate the amount of space that is in use.  Include the space
 	// that has a planned use.
 	struct delta_list *delta_lists = delta_memory->delta_lists;
@@ -639,6 +819,7 @@ int extend_delta_memory(struct delta_memory *delta_memory,
 	// Compute the new offsets of the delta lists
 	size_t spacing =
 		(delta_memory->size - used_space) / delta_memory->num_lists;
+	delta_memory->min_gap = spacing / 2;
 	delta_memory->temp_offsets[0] = 0;
 	for (i = 0; i <= delta_memory->num_lists; i++) {
 		delta_memory->temp_offsets[i + 1] =
@@ -756,7 +937,7 @@ size_t get_delta_memory_allocated(const struct delta_memory *delta_memory)
 {
 	return (delta_memory->size +
 		get_size_of_delta_lists(delta_memory->num_lists) +
-		get_size_of_flags(delta_memory->num_lists) +
+		2 * get_size_of_flags(delta_memory->num_lists) +
 		get_size_of_temp_offsets(delta_memory->num_lists));
 }
 
@@ -60,10 +60,14 @@ struct delta_memory {
 	uint64_t *temp_offsets;                   // Temporary starts of delta
 						  // lists
 	byte *flags;                              // Transfer flags
+	byte *dirty_flags;                        // Lists changed since the
+						  // last full save
 	struct buffered_writer *buffered_writer;  // Buffered writer for saving
 						  // an index
 	size_t size;                              // The size of delta list
 						  // memory
+	size_t min_gap;                           // Free bytes per list which
+						  // a local rebalance keeps
 	ktime_t rebalance_time;                   // Nanoseconds spent
 						  // rebalancing
 	int rebalance_count;                      // Number of memory
@@ -93,6 +97,10 @@ struct delta_memory {
 						  // progress
 	byte tag;                                 // Tag belonging to this
 						  // delta index
+	bool differential_save;                   // Only changed lists are
+						  // being saved
+	bool restoring_base;                      // Lists already restored
+						  // are being skipped
 } __attribute__((aligned(CACHE_LINE_BYTES)));
 
 struct delta_list_save_info {
@@ -219,9 +227,12 @@ void abort_restoring_delta_memory(struct delta_memory *delta_memory);
  *
  * @param delta_memory     A delta memory structure
  * @param buffered_writer  The index state component being written
+ * @param differential     If true, save only the delta lists which have
+ *                         changed since the last full save
  **/
 void start_saving_delta_memory(struct delta_memory *delta_memory,
-			       struct buffered_writer *buffered_writer);
+			       struct buffered_writer *buffered_writer,
+			       bool differential);
 
 /**
  * Finish saving delta list memory to an output stream.  Force the writing
@@ -382,6 +393,18 @@ static INLINE bool is_mutable(const struct delta_memory *delta_memory)
 	return delta_memory->delta_lists != NULL;
 }
 
+/**
+ * Note that a delta list has changed since the last full save.
+ *
+ * @param delta_memory  A delta memory structure
+ * @param list_number   Index of the delta list that has changed
+ **/
+static INLINE void mark_delta_list_dirty(struct delta_memory *delta_memory,
+					 unsigned int list_number)
+{
+	set_one(delta_memory->dirty_flags, list_number, 1);
+}
+
 /**
  * Lazily flush a delta list to an output stream
  *
@@ -81,7 +81,8 @@ static const struct error_info error_list[] = {
 	{ "UDS_NO_INDEXSESSION", "Index session not known" },
 	{ "UDS_CORRUPT_DATA", "Index data in memory is corrupt" },
 	{ "UDS_SHORT_READ", "Could not read requested number of bytes" },
-	{ "UDS_UNUSED_CODE_14", "Unused error code 14" },
+	{ "UDS_INDEX_NONCE_MISMATCH",
+	  "The index belongs to a different owner" },
 	{ "UDS_RESOURCE_LIMIT_EXCEEDED", "Internal resource limits exceeded" },
 	{ "UDS_VOLUME_OVERFLOW", "Memory overflow due to storage failure" },
 	{ "UDS_UNUSED_CODE_17", "Unused error code 17" },
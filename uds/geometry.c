@@ -34,7 +34,8 @@ static int initialize_geometry(struct geometry *geometry,
 			       size_t bytes_per_page,
 			       unsigned int record_pages_per_chapter,
 			       unsigned int chapters_per_volume,
-			       unsigned int sparse_chapters_per_volume)
+			       unsigned int sparse_chapters_per_volume,
+			       unsigned int chapter_mean_delta_bits)
 {
 	int result =
 		ASSERT_WITH_ERROR_CODE(bytes_per_page >= BYTES_PER_RECORD,
@@ -55,6 +56,17 @@ static int initialize_geometry(struct geometry *geometry,
 		return result;
 	}
 
+	result = ASSERT_WITH_ERROR_CODE(((chapter_mean_delta_bits >=
+					  COMPACT_CHAPTER_MEAN_DELTA_BITS) &&
+					 (chapter_mean_delta_bits <=
+					  DEFAULT_CHAPTER_MEAN_DELTA_BITS)),
+					UDS_INVALID_ARGUMENT,
+					"chapter mean delta bits (%u) out of range",
+					chapter_mean_delta_bits);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
 	geometry->bytes_per_page = bytes_per_page;
 	geometry->record_pages_per_chapter = record_pages_per_chapter;
 	geometry->chapters_per_volume = chapters_per_volume;
@@ -72,7 +84,7 @@ static int initialize_geometry(struct geometry *geometry,
 	geometry->open_chapter_load_ratio = DEFAULT_OPEN_CHAPTER_LOAD_RATIO;
 
 	// Initialize values for delta chapter indexes.
-	geometry->chapter_mean_delta = 1 << DEFAULT_CHAPTER_MEAN_DELTA_BITS;
+	geometry->chapter_mean_delta = 1 << chapter_mean_delta_bits;
 	geometry->chapter_payload_bits =
 		compute_bits(record_pages_per_chapter - 1);
 	// We want 1 delta list for every 64 records in the chapter.
@@ -84,7 +96,7 @@ static int initialize_geometry(struct geometry *geometry,
 		1 << geometry->chapter_delta_list_bits;
 	// We need enough address bits to achieve the desired mean delta.
 	geometry->chapter_address_bits =
-		(DEFAULT_CHAPTER_MEAN_DELTA_BITS -
+		(chapter_mean_delta_bits -
 		 geometry->chapter_delta_list_bits +
 		 compute_bits(geometry->records_per_chapter - 1));
 	// Let the delta index code determine how many pages are needed for the
@@ -117,6 +129,7 @@ int make_geometry(size_t bytes_per_page,
 		  unsigned int record_pages_per_chapter,
 		  unsigned int chapters_per_volume,
 		  unsigned int sparse_chapters_per_volume,
+		  unsigned int chapter_mean_delta_bits,
 		  struct geometry **geometry_ptr)
 {
 	struct geometry *geometry;
@@ -128,7 +141,8 @@ int make_geometry(size_t bytes_per_page,
 				     bytes_per_page,
 				     record_pages_per_chapter,
 				     chapters_per_volume,
-				     sparse_chapters_per_volume);
+				     sparse_chapters_per_volume,
+				     chapter_mean_delta_bits);
 	if (result != UDS_SUCCESS) {
 		free_geometry(geometry);
 		return result;
@@ -145,6 +159,7 @@ int copy_geometry(struct geometry *source, struct geometry **geometry_ptr)
 			     source->record_pages_per_chapter,
 			     source->chapters_per_volume,
 			     source->sparse_chapters_per_volume,
+			     compute_bits(source->chapter_mean_delta) - 1,
 			     geometry_ptr);
 }
 
@@ -139,6 +139,9 @@ enum {
 	/** The log2 of the default mean delta */
 	DEFAULT_CHAPTER_MEAN_DELTA_BITS = 16,
 
+	/** The log2 of the mean delta of a compact chapter index */
+	COMPACT_CHAPTER_MEAN_DELTA_BITS = 12,
+
 	/** The log2 of the number of delta lists in a large chapter */
 	DEFAULT_CHAPTER_DELTA_LIST_BITS = 12,
 
@@ -161,6 +164,8 @@ enum {
  * @param record_pages_per_chapter    The number of pages in a chapter
  * @param chapters_per_volume         The number of chapters in a volume
  * @param sparse_chapters_per_volume  The number of sparse chapters in a volume
+ * @param chapter_mean_delta_bits     The log2 of the mean delta of the
+ *                                    chapter indexes
  * @param geometry_ptr                A pointer to hold the new geometry
  *
  * @return UDS_SUCCESS or an error code
@@ -169,6 +174,7 @@ int __must_check make_geometry(size_t bytes_per_page,
 			       unsigned int record_pages_per_chapter,
 			       unsigned int chapters_per_volume,
 			       unsigned int sparse_chapters_per_volume,
+			       unsigned int chapter_mean_delta_bits,
 			       struct geometry **geometry_ptr);
 
 /**
@@ -21,13 +21,26 @@
 
 #include "index.h"
 
+#include "atomicDefs.h"
 #include "hashUtils.h"
 #include "indexCheckpoint.h"
 #include "indexInternals.h"
 #include "logger.h"
+#include "memoryAlloc.h"
+#include "stageLatency.h"
+#include "threads.h"
+#include "zone.h"
 
 static const uint64_t NO_LAST_CHECKPOINT = UINT_MAX;
 
+enum {
+	/** The number of requests whose volume searches are prefetched at once */
+	PREFETCH_BATCH_SIZE = 16,
+};
+
+unsigned int replay_chapters_total = 0;
+unsigned int replay_chapters_done = 0;
+
 
 /**
  * Replay an index which was loaded from a checkpoint.
@@ -302,6 +315,34 @@ void free_index(struct index *index)
 	release_index(index);
 }
 
+/**
+ * Check how well the volume index memory fits the records it actually
+ * holds, and suggest a smaller index if it is mostly empty. The delta list
+ * coding can not change without re-creating the index, since the saved
+ * delta lists are in that coding, so this is only a suggestion. An index
+ * which has not yet filled its volume is not judged.
+ *
+ * @param index  The index which was just saved
+ **/
+static void suggest_volume_index_fit(struct index *index)
+{
+	if (index->oldest_virtual_chapter == 0) {
+		return;
+	}
+
+	struct volume_index_stats stats;
+	get_volume_index_combined_stats(index->volume_index, &stats);
+	if ((stats.fitted_list_memory * 4) >= (stats.list_memory * 3)) {
+		return;
+	}
+
+	log_info("volume index holds %ld records (%ld collisions) in %zu bytes of delta list memory which %zu bytes would fit; a smaller index would free the difference",
+		 stats.record_count,
+		 stats.collision_count,
+		 stats.list_memory,
+		 stats.fitted_list_memory);
+}
+
 /**********************************************************************/
 int save_index(struct index *index)
 {
@@ -321,6 +362,7 @@ int save_index(struct index *index)
 		index->has_saved_open_chapter = true;
 		log_info("finished save (vcn %llu)",
 			 index->last_checkpoint);
+		suggest_volume_index_fit(index);
 	}
 	return result;
 }
@@ -350,8 +392,10 @@ static struct index_zone *get_request_zone(struct index *index,
 static int search_index_zone(struct index_zone *zone, Request *request)
 {
 	struct volume_index_record record;
+	ktime_t start = current_time_ns(CLOCK_MONOTONIC);
 	int result = get_volume_index_record(zone->index->volume_index,
 					     &request->chunk_name, &record);
+	record_stage_latency(LATENCY_VOLUME_INDEX, start);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
@@ -367,6 +411,8 @@ static int search_index_zone(struct index_zone *zone, Request *request)
 			request->location =
 				compute_index_region(zone,
 						     record.virtual_chapter);
+			request->chapter_age = (zone->newest_virtual_chapter -
+						record.virtual_chapter);
 		}
 	}
 
@@ -465,8 +511,10 @@ static int search_index_zone(struct index_zone *zone, Request *request)
 static int remove_from_index_zone(struct index_zone *zone, Request *request)
 {
 	struct volume_index_record record;
+	ktime_t start = current_time_ns(CLOCK_MONOTONIC);
 	int result = get_volume_index_record(zone->index->volume_index,
 					     &request->chunk_name, &record);
+	record_stage_latency(LATENCY_VOLUME_INDEX, start);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
@@ -567,6 +615,26 @@ static int simulate_index_zone_barrier_message(struct index_zone *zone,
 	return execute_sparse_cache_barrier_message(zone, &barrier);
 }
 
+/**********************************************************************/
+/**
+ * Count a finished search in the chapter age statistics of its zone. These
+ * are only written by the zone thread, so they need no locking.
+ *
+ * @param zone     The zone which searched
+ * @param request  The request which was searched for
+ **/
+static void count_index_zone_search(struct index_zone *zone,
+				    Request *request)
+{
+	WRITE_ONCE(zone->searches, zone->searches + 1);
+	if (request->location != LOC_UNAVAILABLE) {
+		unsigned int bucket =
+			get_chapter_age_bucket(request->chapter_age);
+		WRITE_ONCE(zone->hits_by_age[bucket],
+			   zone->hits_by_age[bucket] + 1);
+	}
+}
+
 /**********************************************************************/
 static int dispatch_index_zone_request(struct index_zone *zone,
 				       Request *request)
@@ -592,6 +660,9 @@ static int dispatch_index_zone_request(struct index_zone *zone,
 	case REQUEST_UPDATE:
 	case REQUEST_QUERY:
 		result = make_unrecoverable(search_index_zone(zone, request));
+		if (result == UDS_SUCCESS) {
+			count_index_zone_search(zone, request);
+		}
 		break;
 
 	case REQUEST_DELETE:
@@ -617,6 +688,71 @@ int dispatch_index_request(struct index *index, Request *request)
 					   request);
 }
 
+/**
+ * Check whether a request will search an index zone for its name.
+ *
+ * @param request  The request
+ *
+ * @return <code>true</code> if dispatching the request will search
+ **/
+static bool is_search_request(const Request *request)
+{
+	if (request->is_control_message || request->requeued) {
+		return false;
+	}
+
+	switch (request->action) {
+	case REQUEST_INDEX:
+	case REQUEST_UPDATE:
+	case REQUEST_QUERY:
+	case REQUEST_DELETE:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/**********************************************************************/
+void prefetch_index_requests(struct index *index,
+			     Request *requests[],
+			     unsigned int count)
+{
+	while (count > 0) {
+		uint64_t chapters[PREFETCH_BATCH_SIZE];
+		unsigned int batch_size =
+			min(count, (unsigned int) PREFETCH_BATCH_SIZE);
+		unsigned int i;
+		for (i = 0; i < batch_size; i++) {
+			chapters[i] = UINT64_MAX;
+			if (!is_search_request(requests[i])) {
+				continue;
+			}
+
+			struct volume_index_record record;
+			int result =
+				get_volume_index_record(index->volume_index,
+							&requests[i]->chunk_name,
+							&record);
+			if ((result == UDS_SUCCESS) && record.is_found) {
+				chapters[i] = record.virtual_chapter;
+			}
+		}
+
+		for (i = 0; i < batch_size; i++) {
+			if (chapters[i] != UINT64_MAX) {
+				prefetch_record_from_zone(get_request_zone(index,
+									   requests[i]),
+							  requests[i],
+							  chapters[i]);
+			}
+		}
+
+		requests += batch_size;
+		count -= batch_size;
+	}
+}
+
 /**********************************************************************/
 static int rebuild_index_page_map(struct index *index, uint64_t vcn)
 {
@@ -668,6 +804,7 @@ static int rebuild_index_page_map(struct index *index, uint64_t vcn)
  * Add an entry to the volume index when rebuilding.
  *
  * @param index			  The index to query.
+ * @param page_mutex		  The mutex serializing use of the page cache
  * @param name			  The block name of interest.
  * @param virtual_chapter	  The virtual chapter number to write to the
  *				  volume index
@@ -678,6 +815,7 @@ static int rebuild_index_page_map(struct index *index, uint64_t vcn)
  * @return UDS_SUCCESS or an error code
  **/
 static int replay_record(struct index *index,
+			 struct mutex *page_mutex,
 			 const struct uds_chunk_name *name,
 			 uint64_t virtual_chapter,
 			 bool will_be_sparse_chapter)
@@ -727,10 +865,12 @@ static int replay_record(struct index *index,
 			 * that chapter to determine if the volume index entry
 			 * was for the same record or a different one.
 			 */
+			lock_mutex(page_mutex);
 			result = search_volume_page_cache(index->volume,
 							  NULL, name,
 							  record.virtual_chapter,
 							  NULL, &update_record);
+			unlock_mutex(page_mutex);
 			if (result != UDS_SUCCESS) {
 				return result;
 			}
@@ -815,6 +955,342 @@ static bool check_for_suspend(struct index *index)
 	return ret_val;
 }
 
+/**
+ * The state of one zone thread of a replay.
+ **/
+struct replay_zone {
+	struct replay *replay;
+	unsigned int zone_number;
+	int result;
+	struct thread *thread;
+};
+
+/**
+ * The state of a replay. The loading thread reads the records of each
+ * chapter while the zone threads are replaying the records of the previous
+ * chapter into the volume index, each zone thread handling only the names
+ * which belong to its own zone of the volume index.
+ **/
+struct replay {
+	struct index *index;
+	/* Serializes use of the page cache, which assumes a single rebuild
+	 * thread */
+	struct mutex page_mutex;
+	/* Protects the handoff between the loading thread and the zone
+	 * threads */
+	struct mutex mutex;
+	struct cond_var work_cond;
+	struct cond_var done_cond;
+	/* Incremented each time a chapter is handed to the zone threads */
+	uint64_t generation;
+	/* The number of zone threads still replaying the chapter */
+	unsigned int busy_zones;
+	/* The record names of two chapters, one being read and one being
+	 * replayed */
+	struct uds_chunk_name *names[2];
+	unsigned int name_count;
+	/* The chapter being replayed by the zone threads */
+	const struct uds_chunk_name *chapter_names;
+	unsigned int chapter_name_count;
+	uint64_t chapter_vcn;
+	bool chapter_will_be_sparse;
+	/* Set to tell the zone threads to exit */
+	bool finished;
+	unsigned int zone_count;
+	struct replay_zone zones[MAX_ZONES];
+};
+
+/**
+ * Replay the names of a chapter which belong to one zone of the volume
+ * index.
+ *
+ * @param zone  The replay zone
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int replay_zone_chapter(struct replay_zone *zone)
+{
+	struct replay *replay = zone->replay;
+	struct index *index = replay->index;
+	unsigned int i;
+	for (i = 0; i < replay->chapter_name_count; i++) {
+		const struct uds_chunk_name *name = &replay->chapter_names[i];
+		if (get_volume_index_zone(index->volume_index, name) !=
+		    zone->zone_number) {
+			continue;
+		}
+
+		int result = replay_record(index, &replay->page_mutex, name,
+					   replay->chapter_vcn,
+					   replay->chapter_will_be_sparse);
+		if (result != UDS_SUCCESS) {
+			char hex_name[(2 * UDS_CHUNK_NAME_SIZE) + 1];
+			if (chunk_name_to_hex(name, hex_name,
+					      sizeof(hex_name)) !=
+			    UDS_SUCCESS) {
+				strncpy(hex_name, "<unknown>",
+					sizeof(hex_name));
+			}
+			return log_unrecoverable(result,
+						 "could not find block %s during rebuild",
+						 hex_name);
+		}
+	}
+	return UDS_SUCCESS;
+}
+
+/**
+ * The main loop of a replay zone thread.
+ *
+ * @param arg  The replay zone
+ **/
+static void replay_zone_thread(void *arg)
+{
+	struct replay_zone *zone = arg;
+	struct replay *replay = zone->replay;
+	uint64_t generation = 0;
+	for (;;) {
+		lock_mutex(&replay->mutex);
+		while (!replay->finished &&
+		       (replay->generation == generation)) {
+			wait_cond(&replay->work_cond, &replay->mutex);
+		}
+		generation = replay->generation;
+		bool finished = replay->finished;
+		unlock_mutex(&replay->mutex);
+		if (finished) {
+			return;
+		}
+
+		if (zone->result == UDS_SUCCESS) {
+			zone->result = replay_zone_chapter(zone);
+		}
+
+		lock_mutex(&replay->mutex);
+		if (--replay->busy_zones == 0) {
+			signal_cond(&replay->done_cond);
+		}
+		unlock_mutex(&replay->mutex);
+	}
+}
+
+/**
+ * Hand the chapter just read to the zone threads.
+ *
+ * @param replay               The replay
+ * @param vcn                  The virtual chapter to replay
+ * @param names                The names of the records of the chapter
+ * @param will_be_sparse       Whether the chapter will be sparse once the
+ *                             rebuild completes
+ **/
+static void start_replay_chapter(struct replay *replay,
+				 uint64_t vcn,
+				 const struct uds_chunk_name *names,
+				 bool will_be_sparse)
+{
+	lock_mutex(&replay->mutex);
+	replay->chapter_names = names;
+	replay->chapter_name_count = replay->name_count;
+	replay->chapter_vcn = vcn;
+	replay->chapter_will_be_sparse = will_be_sparse;
+	replay->busy_zones = replay->zone_count;
+	replay->generation++;
+	broadcast_cond(&replay->work_cond);
+	unlock_mutex(&replay->mutex);
+}
+
+/**
+ * Wait for the zone threads to finish replaying a chapter.
+ *
+ * @param replay  The replay
+ *
+ * @return UDS_SUCCESS or the first error from any zone thread
+ **/
+static int finish_replay_chapter(struct replay *replay)
+{
+	lock_mutex(&replay->mutex);
+	while (replay->busy_zones > 0) {
+		wait_cond(&replay->done_cond, &replay->mutex);
+	}
+	unlock_mutex(&replay->mutex);
+
+	unsigned int z;
+	for (z = 0; z < replay->zone_count; z++) {
+		if (replay->zones[z].result != UDS_SUCCESS) {
+			return replay->zones[z].result;
+		}
+	}
+	return UDS_SUCCESS;
+}
+
+/**
+ * Read the names of all the records of a chapter, using the page cache just
+ * as a lookup during the rebuild would.
+ *
+ * @param replay  The replay
+ * @param vcn     The virtual chapter to read
+ * @param names   The array to hold the names of the chapter
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int read_replay_chapter(struct replay *replay,
+			       uint64_t vcn,
+			       struct uds_chunk_name *names)
+{
+	struct volume *volume = replay->index->volume;
+	const struct geometry *geometry = volume->geometry;
+	unsigned int chapter = map_to_physical_chapter(geometry, vcn);
+	replay->name_count = 0;
+	unsigned int j;
+	for (j = 0; j < geometry->record_pages_per_chapter; j++) {
+		unsigned int record_page_number =
+			geometry->index_pages_per_chapter + j;
+		byte *record_page;
+		lock_mutex(&replay->page_mutex);
+		int result = get_volume_page(volume, chapter,
+					     record_page_number,
+					     CACHE_PROBE_RECORD_FIRST,
+					     &record_page, NULL);
+		if (result != UDS_SUCCESS) {
+			unlock_mutex(&replay->page_mutex);
+			return log_unrecoverable(result,
+						 "could not get page %d",
+						 record_page_number);
+		}
+		unsigned int k;
+		for (k = 0; k < geometry->records_per_page; k++) {
+			memcpy(&names[replay->name_count++].name,
+			       record_page + (k * BYTES_PER_RECORD),
+			       UDS_CHUNK_NAME_SIZE);
+		}
+		unlock_mutex(&replay->page_mutex);
+	}
+	return UDS_SUCCESS;
+}
+
+/**
+ * Free a replay, stopping its zone threads. The zone threads must not be
+ * replaying a chapter.
+ *
+ * @param replay  The replay to free (may be NULL)
+ **/
+static void free_replay(struct replay *replay)
+{
+	if (replay == NULL) {
+		return;
+	}
+
+	lock_mutex(&replay->mutex);
+	replay->finished = true;
+	broadcast_cond(&replay->work_cond);
+	unlock_mutex(&replay->mutex);
+
+	unsigned int z;
+	for (z = 0; z < replay->zone_count; z++) {
+		join_threads(replay->zones[z].thread);
+	}
+	destroy_cond(&replay->done_cond);
+	destroy_cond(&replay->work_cond);
+	destroy_mutex(&replay->mutex);
+	destroy_mutex(&replay->page_mutex);
+	FREE(replay->names[0]);
+	FREE(replay->names[1]);
+	FREE(replay);
+}
+
+/**
+ * Make a replay and start a thread for each zone of the volume index.
+ *
+ * @param index       The index to replay
+ * @param replay_ptr  A pointer to hold the new replay
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int make_replay(struct index *index, struct replay **replay_ptr)
+{
+	const struct geometry *geometry = index->volume->geometry;
+	struct replay *replay;
+	int result = ALLOCATE(1, struct replay, __func__, &replay);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	replay->index = index;
+
+	result = ALLOCATE(geometry->records_per_chapter,
+			  struct uds_chunk_name, "replay names",
+			  &replay->names[0]);
+	if (result != UDS_SUCCESS) {
+		FREE(replay);
+		return result;
+	}
+	result = ALLOCATE(geometry->records_per_chapter,
+			  struct uds_chunk_name, "replay names",
+			  &replay->names[1]);
+	if (result != UDS_SUCCESS) {
+		FREE(replay->names[0]);
+		FREE(replay);
+		return result;
+	}
+
+	result = init_mutex(&replay->page_mutex);
+	if (result != UDS_SUCCESS) {
+		FREE(replay->names[0]);
+		FREE(replay->names[1]);
+		FREE(replay);
+		return result;
+	}
+	result = init_mutex(&replay->mutex);
+	if (result != UDS_SUCCESS) {
+		destroy_mutex(&replay->page_mutex);
+		FREE(replay->names[0]);
+		FREE(replay->names[1]);
+		FREE(replay);
+		return result;
+	}
+	result = init_cond(&replay->work_cond);
+	if (result != UDS_SUCCESS) {
+		destroy_mutex(&replay->mutex);
+		destroy_mutex(&replay->page_mutex);
+		FREE(replay->names[0]);
+		FREE(replay->names[1]);
+		FREE(replay);
+		return result;
+	}
+	result = init_cond(&replay->done_cond);
+	if (result != UDS_SUCCESS) {
+		destroy_cond(&replay->work_cond);
+		destroy_mutex(&replay->mutex);
+		destroy_mutex(&replay->page_mutex);
+		FREE(replay->names[0]);
+		FREE(replay->names[1]);
+		FREE(replay);
+		return result;
+	}
+
+	unsigned int zone_count =
+		get_volume_index_zone_count(index->volume_index);
+	unsigned int z;
+	for (z = 0; z < zone_count; z++) {
+		char name[16];
+		replay->zones[z] = (struct replay_zone) {
+			.replay = replay,
+			.zone_number = z,
+			.result = UDS_SUCCESS,
+		};
+		snprintf(name, sizeof(name), "replay%u", z);
+		result = create_thread(replay_zone_thread, &replay->zones[z],
+				       name, &replay->zones[z].thread);
+		if (result != UDS_SUCCESS) {
+			free_replay(replay);
+			return result;
+		}
+		replay->zone_count++;
+	}
+
+	*replay_ptr = replay;
+	return UDS_SUCCESS;
+}
+
 /**********************************************************************/
 int replay_volume(struct index *index, uint64_t from_vcn)
 {
@@ -826,6 +1302,15 @@ int replay_volume(struct index *index, uint64_t from_vcn)
 	set_volume_index_open_chapter(index->volume_index, upto_vcn);
 	set_volume_index_open_chapter(index->volume_index, from_vcn);
 
+	struct replay *replay;
+	result = make_replay(index, &replay);
+	if (result != UDS_SUCCESS) {
+		return log_error_strerror(result,
+					  "could not start replay threads");
+	}
+	WRITE_ONCE(replay_chapters_total, upto_vcn - from_vcn);
+	WRITE_ONCE(replay_chapters_done, 0);
+
 	/*
 	 * At least two cases to deal with here!
 	 * - index loaded but replaying from last_checkpoint; maybe full, maybe
@@ -845,78 +1330,81 @@ int replay_volume(struct index *index, uint64_t from_vcn)
 	 *
 	 * Also, go through each index page for each chapter and rebuild the
 	 * index page map.
+	 *
+	 * The records of each chapter are read while the zone threads are
+	 * replaying the previous chapter, and the pages of the chapter after
+	 * that are prefetched, so that the rebuild is not waiting on the
+	 * storage and the volume index at the same time.
 	 */
 	const struct geometry *geometry = index->volume->geometry;
 	uint64_t old_ipm_update =
 		get_last_update(index->volume->index_page_map);
+	bool replaying = false;
+	if (from_vcn < upto_vcn) {
+		unsigned int chapter =
+			map_to_physical_chapter(geometry, from_vcn);
+		prefetch_volume_pages(&index->volume->volume_store,
+				      map_to_physical_page(geometry, chapter, 0),
+				      geometry->pages_per_chapter);
+	}
 	uint64_t vcn;
 	for (vcn = from_vcn; vcn < upto_vcn; ++vcn) {
+		struct uds_chunk_name *names = replay->names[vcn % 2];
+		result = read_replay_chapter(replay, vcn, names);
+		if ((result == UDS_SUCCESS) && (vcn + 1 < upto_vcn)) {
+			unsigned int next_chapter =
+				map_to_physical_chapter(geometry, vcn + 1);
+			prefetch_volume_pages(&index->volume->volume_store,
+					      map_to_physical_page(geometry,
+								   next_chapter,
+								   0),
+					      geometry->pages_per_chapter);
+		}
+
+		if (replaying) {
+			int zone_result = finish_replay_chapter(replay);
+			replaying = false;
+			WRITE_ONCE(replay_chapters_done, vcn - from_vcn);
+			if (result == UDS_SUCCESS) {
+				result = zone_result;
+			}
+		}
+		if (result != UDS_SUCCESS) {
+			break;
+		}
+
 		if (check_for_suspend(index)) {
 			log_info("Replay interrupted by index shutdown at chapter %llu",
 				 vcn);
-			return UDS_SHUTTINGDOWN;
+			result = UDS_SHUTTINGDOWN;
+			break;
 		}
 
-		bool will_be_sparse_chapter =
-			is_chapter_sparse(geometry, from_vcn, upto_vcn, vcn);
-		unsigned int chapter = map_to_physical_chapter(geometry, vcn);
-		prefetch_volume_pages(&index->volume->volume_store,
-				      map_to_physical_page(geometry, chapter, 0),
-				      geometry->pages_per_chapter);
 		set_volume_index_open_chapter(index->volume_index, vcn);
 		result = rebuild_index_page_map(index, vcn);
 		if (result != UDS_SUCCESS) {
-			index->volume->lookup_mode = old_lookup_mode;
-			return log_error_strerror(result,
-						  "could not rebuild index page map for chapter %u",
-						  chapter);
+			log_error_strerror(result,
+					   "could not rebuild index page map for chapter %u",
+					   map_to_physical_chapter(geometry,
+								   vcn));
+			break;
 		}
 
-		unsigned int j;
-		for (j = 0; j < geometry->record_pages_per_chapter; j++) {
-			unsigned int record_page_number =
-				geometry->index_pages_per_chapter + j;
-			byte *record_page;
-			result = get_volume_page(index->volume, chapter,
-						 record_page_number,
-						 CACHE_PROBE_RECORD_FIRST,
-						 &record_page, NULL);
-			if (result != UDS_SUCCESS) {
-				index->volume->lookup_mode = old_lookup_mode;
-				return log_unrecoverable(result,
-							 "could not get page %d",
-							 record_page_number);
-			}
-			unsigned int k;
-			for (k = 0; k < geometry->records_per_page; k++) {
-				const byte *name_bytes =
-					record_page + (k * BYTES_PER_RECORD);
-
-				struct uds_chunk_name name;
-				memcpy(&name.name, name_bytes,
-				       UDS_CHUNK_NAME_SIZE);
+		start_replay_chapter(replay, vcn, names,
+				     is_chapter_sparse(geometry, from_vcn,
+						       upto_vcn, vcn));
+		replaying = true;
+	}
 
-				result = replay_record(index, &name, vcn,
-						       will_be_sparse_chapter);
-				if (result != UDS_SUCCESS) {
-					char hex_name[(2 * UDS_CHUNK_NAME_SIZE) +
-						      1];
-					if (chunk_name_to_hex(&name, hex_name,
-							      sizeof(hex_name)) !=
-					    UDS_SUCCESS) {
-						strncpy(hex_name, "<unknown>",
-							sizeof(hex_name));
-					}
-					index->volume->lookup_mode =
-						old_lookup_mode;
-					return log_unrecoverable(result,
-								 "could not find block %s during rebuild",
-								 hex_name);
-				}
-			}
-		}
+	if (replaying) {
+		result = finish_replay_chapter(replay);
+		WRITE_ONCE(replay_chapters_done, upto_vcn - from_vcn);
 	}
+	free_replay(replay);
 	index->volume->lookup_mode = old_lookup_mode;
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
 
 	// We also need to reap the chapter being replaced by the open chapter
 	set_volume_index_open_chapter(index->volume_index, upto_vcn);
@@ -955,6 +1443,30 @@ void get_index_stats(struct index *index, struct uds_index_stats *counters)
 	counters->entries_discarded =
 		(dense_stats.discard_count + sparse_stats.discard_count);
 	counters->checkpoints = get_checkpoint_count(index->checkpoint);
+	get_page_cache_counts(index->volume->page_cache,
+			      &counters->page_cache_hits,
+			      &counters->page_cache_misses);
+}
+
+/**********************************************************************/
+void get_index_age_stats(struct index *index,
+			 struct uds_index_age_stats *counters)
+{
+	// The zone threads update these counters without locking, but a
+	// torn or stale read is acceptable for statistics.
+	counters->chapters = index->volume->geometry->chapters_per_volume;
+	counters->searches = 0;
+	memset(counters->hits_by_age, 0, sizeof(counters->hits_by_age));
+	unsigned int z;
+	for (z = 0; z < index->zone_count; z++) {
+		const struct index_zone *zone = index->zones[z];
+		unsigned int b;
+		counters->searches += READ_ONCE(zone->searches);
+		for (b = 0; b < UDS_CHAPTER_AGE_BUCKETS; b++) {
+			counters->hits_by_age[b] +=
+				READ_ONCE(zone->hits_by_age[b]);
+		}
+	}
 }
 
 /**********************************************************************/
@@ -30,6 +30,12 @@
 #include "masterIndexOps.h"
 #include "volume.h"
 
+/**
+ * The progress of the most recent replay of a volume, in chapters, for
+ * reporting in sysfs.
+ **/
+extern unsigned int replay_chapters_total;
+extern unsigned int replay_chapters_done;
 
 /**
  * Index checkpoint state private to indexCheckpoint.c.
@@ -47,6 +53,8 @@ struct index {
 	struct volume *volume;
 	unsigned int zone_count;
 	struct index_zone **zones;
+	/* The number of open chapter buffers of each zone */
+	unsigned int open_chapter_count;
 
 	/*
 	 * ATTENTION!!!
@@ -148,6 +156,21 @@ void free_index(struct index *index);
  **/
 int __must_check dispatch_index_request(struct index *index, Request *request);
 
+/**
+ * Prepare to dispatch a batch of requests to their zone by looking up each
+ * name in the volume index, and then prefetching the chapter index page each
+ * search of the volume will read. The volume index lookups and the page
+ * prefetches are done in separate passes so that the cache misses and page
+ * reads of the batch overlap. No request is modified.
+ *
+ * @param index     The index
+ * @param requests  The requests which will be dispatched, all in one zone
+ * @param count     The number of requests
+ **/
+void prefetch_index_requests(struct index *index,
+			     Request *requests[],
+			     unsigned int count);
+
 /**
  * Internal helper to prepare the index for saving.
  *
@@ -176,6 +199,15 @@ int __must_check replay_volume(struct index *index, uint64_t from_vcn);
  **/
 void get_index_stats(struct index *index, struct uds_index_stats *counters);
 
+/**
+ * Gather the hit age statistics from the zones of an index.
+ *
+ * @param index	    The index
+ * @param counters  the hit age counters for the index
+ **/
+void get_index_age_stats(struct index *index,
+			 struct uds_index_age_stats *counters);
+
 /**
  * Set lookup state for this index.  Disabling lookups means assume
  * all records queried are new (intended for debugging uses, e.g.,
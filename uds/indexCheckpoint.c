@@ -26,6 +26,7 @@
 #include "memoryAlloc.h"
 #include "permassert.h"
 #include "threads.h"
+#include "timeUtils.h"
 #include "typeDefs.h"
 
 /**
@@ -48,8 +49,12 @@ struct index_checkpoint {
 	uint64_t chapter;             // vcn of the starting chapter
 	enum checkpoint_state state;  // is checkpoint in progress or aborting
 	unsigned int zones_busy;      // count of zones not yet done
-	unsigned int frequency;       // number of chapters between checkpoints
+	unsigned int frequency;       // most chapters between checkpoints
 	uint64_t checkpoints;         // number of checkpoints this session
+	uint64_t newest_chapter;      // newest vcn any zone has opened
+	ktime_t chapter_time;         // when that chapter was opened
+	ktime_t last_interval;        // time to fill the previous chapter
+	ktime_t mean_interval;        // moving average of chapter fill time
 };
 
 /**
@@ -142,7 +147,73 @@ uint64_t get_checkpoint_count(struct index_checkpoint *checkpoint)
 	return checkpoint->checkpoints;
 }
 
-/**********************************************************************/
+/**
+ * Note that a zone has opened a new chapter, measuring how long the
+ * previous chapter took to fill if this is the first zone to open it. The
+ * rate at which chapters fill is the measure of how busy the index is.
+ *
+ * @param checkpoint       the checkpoint state of the index
+ * @param virtual_chapter  the chapter the zone has opened
+ **/
+static void note_new_chapter(struct index_checkpoint *checkpoint,
+			     uint64_t virtual_chapter)
+{
+	if (virtual_chapter <= checkpoint->newest_chapter) {
+		return;
+	}
+
+	ktime_t now = current_time_ns(CLOCK_MONOTONIC);
+	if (checkpoint->chapter_time == 0) {
+		// The budget for the first checkpoint starts now, not at
+		// the start of the volume.
+		checkpoint->chapter = virtual_chapter;
+	} else {
+		ktime_t interval = now - checkpoint->chapter_time;
+		checkpoint->last_interval = interval;
+		checkpoint->mean_interval =
+			((checkpoint->mean_interval == 0) ?
+				 interval :
+				 (((checkpoint->mean_interval * 7) + interval) /
+				  8));
+	}
+	checkpoint->newest_chapter = virtual_chapter;
+	checkpoint->chapter_time = now;
+}
+
+/**
+ * Check whether requests are arriving much more slowly than usual, making
+ * this a good time to start a checkpoint.
+ **/
+static bool is_index_quiet(const struct index_checkpoint *checkpoint)
+{
+	return ((checkpoint->mean_interval > 0) &&
+		(checkpoint->last_interval >= 2 * checkpoint->mean_interval));
+}
+
+/**
+ * Check whether requests are arriving much faster than usual, so that
+ * checkpoint I/O should be put off to leave the storage to them.
+ **/
+static bool is_index_busy(const struct index_checkpoint *checkpoint)
+{
+	return (checkpoint->last_interval < checkpoint->mean_interval / 2);
+}
+
+/**
+ * Decide what checkpoint work a zone should do on opening a new chapter.
+ * The frequency is a budget rather than a fixed schedule: a checkpoint
+ * starts at most that many chapters after the previous one started, so no
+ * more chapters need be replayed after a crash than with a fixed schedule,
+ * but it starts as early as halfway through the budget if the index has
+ * gone quiet. The incremental saving of a checkpoint is put off while the
+ * index is busy, and whatever remains is done when the checkpoint must
+ * finish.
+ *
+ * @param checkpoint       the checkpoint state of the index
+ * @param virtual_chapter  the chapter the zone has opened
+ *
+ * @return the checkpoint action for the zone to take
+ **/
 static enum index_checkpoint_trigger_value
 get_checkpoint_action(struct index_checkpoint *checkpoint,
 		      uint64_t virtual_chapter)
@@ -150,17 +221,21 @@ get_checkpoint_action(struct index_checkpoint *checkpoint,
 	if (checkpoint->frequency == 0) {
 		return ICTV_IDLE;
 	}
-	unsigned int value = virtual_chapter % checkpoint->frequency;
+	uint64_t chapters = virtual_chapter - checkpoint->chapter;
 	if (checkpoint->state == CHECKPOINT_ABORTING) {
 		return ICTV_ABORT;
 	} else if (checkpoint->state == CHECKPOINT_IN_PROGRESS) {
-		if (value == checkpoint->frequency - 1) {
+		if (chapters >= checkpoint->frequency - 1) {
 			return ICTV_FINISH;
+		} else if (is_index_busy(checkpoint)) {
+			return ICTV_IDLE;
 		} else {
 			return ICTV_CONTINUE;
 		}
 	} else {
-		if (value == 0) {
+		if ((chapters >= checkpoint->frequency) ||
+		    ((chapters >= (checkpoint->frequency + 1) / 2) &&
+		     is_index_quiet(checkpoint))) {
 			return ICTV_START;
 		} else {
 			return ICTV_IDLE;
@@ -176,6 +251,7 @@ int process_checkpointing(struct index *index,
 	struct index_checkpoint *checkpoint = index->checkpoint;
 	lock_mutex(&checkpoint->mutex);
 
+	note_new_chapter(checkpoint, new_virtual_chapter);
 	enum index_checkpoint_trigger_value ictv =
 		get_checkpoint_action(checkpoint, new_virtual_chapter);
 
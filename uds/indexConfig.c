@@ -26,11 +26,20 @@
 #include "memoryAlloc.h"
 
 static const byte INDEX_CONFIG_MAGIC[] = "ALBIC";
-static const byte INDEX_CONFIG_VERSION[] = "06.02";
+/*
+ * Version 06.03 adds the chapter index mean delta. It is only written for
+ * indexes which do not use the default chapter index format, so that an
+ * index in the default format can still be read by older versions.
+ */
+static const byte INDEX_CONFIG_VERSION[] = "06.03";
+static const byte INDEX_CONFIG_VERSION_6_02[] = "06.02";
 
 enum {
 	INDEX_CONFIG_MAGIC_LENGTH = sizeof(INDEX_CONFIG_MAGIC) - 1,
-	INDEX_CONFIG_VERSION_LENGTH = sizeof(INDEX_CONFIG_VERSION) - 1
+	INDEX_CONFIG_VERSION_LENGTH = sizeof(INDEX_CONFIG_VERSION) - 1,
+	// The encoded sizes of each version of the configuration
+	INDEX_CONFIG_6_02_SIZE = 8 * sizeof(uint32_t) + sizeof(uint64_t),
+	INDEX_CONFIG_6_03_SIZE = INDEX_CONFIG_6_02_SIZE + sizeof(uint32_t),
 };
 
 /**********************************************************************/
@@ -82,6 +91,16 @@ static int __must_check decode_index_config(struct buffer *buffer,
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
+	if (buffer_length(buffer) == INDEX_CONFIG_6_02_SIZE) {
+		config->chapter_mean_delta_bits =
+			DEFAULT_CHAPTER_MEAN_DELTA_BITS;
+	} else {
+		result = get_uint32_le_from_buffer(buffer,
+						   &config->chapter_mean_delta_bits);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
 	result =
 		ASSERT_LOG_ONLY(content_length(buffer) == 0,
 				"%zu bytes decoded of %zu expected",
@@ -105,10 +124,17 @@ static int read_version(struct buffered_reader *reader,
 		return log_error_strerror(result,
 					  "cannot read index config version");
 	}
+	size_t size = 0;
 	if (memcmp(INDEX_CONFIG_VERSION, buffer,
 		   INDEX_CONFIG_VERSION_LENGTH) == 0) {
+		size = INDEX_CONFIG_6_03_SIZE;
+	} else if (memcmp(INDEX_CONFIG_VERSION_6_02, buffer,
+			  INDEX_CONFIG_VERSION_LENGTH) == 0) {
+		size = INDEX_CONFIG_6_02_SIZE;
+	}
+	if (size > 0) {
 		struct buffer *buffer;
-		result = make_buffer(sizeof(*conf), &buffer);
+		result = make_buffer(size, &buffer);
 		if (result != UDS_SUCCESS) {
 			return result;
 		}
@@ -202,10 +228,18 @@ static int __must_check encode_index_config(struct buffer *buffer,
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
-	result = ASSERT_LOG_ONLY(content_length(buffer) == sizeof(*config),
+	if (buffer_length(buffer) == INDEX_CONFIG_6_03_SIZE) {
+		result = put_uint32_le_into_buffer(buffer,
+						   config->chapter_mean_delta_bits);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
+	result = ASSERT_LOG_ONLY(content_length(buffer) ==
+					buffer_length(buffer),
 				 "%zu bytes encoded, of %zu expected",
 				 content_length(buffer),
-				 sizeof(*config));
+				 buffer_length(buffer));
 	return result;
 }
 
@@ -218,13 +252,20 @@ int write_config_contents(struct buffered_writer *writer,
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
-	result = write_to_buffered_writer(writer, INDEX_CONFIG_VERSION,
+	bool is_default_format = (config->chapter_mean_delta_bits ==
+				  DEFAULT_CHAPTER_MEAN_DELTA_BITS);
+	result = write_to_buffered_writer(writer,
+					  (is_default_format ?
+						INDEX_CONFIG_VERSION_6_02 :
+						INDEX_CONFIG_VERSION),
 					  INDEX_CONFIG_VERSION_LENGTH);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
 	struct buffer *buffer;
-	result = make_buffer(sizeof(*config), &buffer);
+	result = make_buffer((is_default_format ? INDEX_CONFIG_6_02_SIZE :
+						  INDEX_CONFIG_6_03_SIZE),
+			     &buffer);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
@@ -260,6 +301,7 @@ int make_configuration(const struct uds_configuration *conf,
 			      conf->record_pages_per_chapter,
 			      conf->chapters_per_volume,
 			      conf->sparse_chapters_per_volume,
+			      conf->chapter_mean_delta_bits,
 			      &config->geometry);
 	if (result != UDS_SUCCESS) {
 		free_configuration(config);
@@ -103,6 +103,8 @@ int allocate_index(struct index_layout *layout,
 	}
 	index->volume->lookup_mode = LOOKUP_NORMAL;
 
+	index->open_chapter_count =
+		get_open_chapters_per_zone(config->geometry);
 	unsigned int i;
 	for (i = 0; i < index->zone_count; i++) {
 		result = make_index_zone(index, i);
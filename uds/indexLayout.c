@@ -1832,9 +1832,71 @@ int write_index_config(struct index_layout *layout,
 	return UDS_SUCCESS;
 }
 
+/**
+ * Change the sparse sample rate recorded for an index, if the volume index
+ * at the new rate would still fit in the space reserved to save it.
+ *
+ * @param layout     the generic index layout
+ * @param old_rate   the sparse sample rate the index was saved with
+ * @param config     the index configuration with the new rate
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int __must_check
+change_sparse_sample_rate(struct index_layout *layout,
+			  unsigned int old_rate,
+			  struct uds_configuration *config)
+{
+	if (config->sparse_sample_rate < 2) {
+		return log_error_strerror(UDS_INVALID_ARGUMENT,
+					  "sparse sample rate %u is too low",
+					  config->sparse_sample_rate);
+	}
+
+	struct configuration *index_config;
+	int result = make_configuration(config, &index_config);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	uint64_t needed_blocks;
+	result = compute_volume_index_save_blocks(index_config,
+						  layout->super.block_size,
+						  &needed_blocks);
+	free_configuration(index_config);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	// Each save holds a header, the page map, the open chapter, and the
+	// volume index.
+	uint64_t available_blocks =
+		(layout->index.saves[0].index_save.num_blocks - 1
+		 - layout->super.page_map_blocks
+		 - layout->super.open_chapter_blocks);
+	if (needed_blocks > available_blocks) {
+		return log_error_strerror(UDS_INVALID_ARGUMENT,
+					  "sparse sample rate %u needs %llu blocks to save the volume index, but only %llu are reserved",
+					  config->sparse_sample_rate,
+					  (unsigned long long) needed_blocks,
+					  (unsigned long long) available_blocks);
+	}
+
+	result = write_index_config(layout, config);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	uds_log_notice("changed sparse sample rate from %u to %u; the volume index will be rebuilt",
+		       old_rate,
+		       config->sparse_sample_rate);
+	return UDS_SUCCESS;
+}
+
 /**********************************************************************/
 int verify_index_config(struct index_layout *layout,
-			struct uds_configuration *config)
+			struct uds_configuration *config,
+			bool allow_rate_change)
 {
 	struct buffered_reader *reader = NULL;
 	int result = open_layout_reader(layout, &layout->config, &reader);
@@ -1852,8 +1914,32 @@ int verify_index_config(struct index_layout *layout,
 	}
 	free_buffered_reader(reader);
 
-	return (are_uds_configurations_equal(&stored_config, config) ?
+	// The chapter index format is chosen when the index is created, so
+	// load the index in whichever format it has.
+	config->chapter_mean_delta_bits = stored_config.chapter_mean_delta_bits;
+
+	// A sparse index may change its sample rate, since a rebuild can find
+	// the hooks at any rate in the chapter indexes of the volume. Unless a
+	// new rate was chosen, keep the rate the index was saved with.
+	unsigned int stored_rate = stored_config.sparse_sample_rate;
+	if (!config->change_sparse_sample_rate) {
+		config->sparse_sample_rate = stored_rate;
+	}
+	if (allow_rate_change &&
+	    (stored_config.sparse_chapters_per_volume > 0)) {
+		stored_config.sparse_sample_rate = config->sparse_sample_rate;
+	}
+
+	if (are_uds_configurations_equal(&stored_config, config)) {
+		return ((stored_rate == config->sparse_sample_rate) ?
 			UDS_SUCCESS :
+			change_sparse_sample_rate(layout, stored_rate, config));
+	}
+
+	// An index saved with a different nonce was made for some other user
+	// of the storage, which the caller may not want to overwrite.
+	return ((stored_config.nonce != config->nonce) ?
+			UDS_INDEX_NONCE_MISMATCH :
 			UDS_NO_INDEX);
 }
 
@@ -1928,14 +2014,19 @@ static int validate_index_save_layout(struct index_save_layout *isl,
 static int __must_check
 select_oldest_index_save_layout(struct sub_index_layout *sil,
 				unsigned int max_saves,
+				unsigned int keep_slot,
 				struct index_save_layout **isl_ptr)
 {
 	struct index_save_layout *oldest = NULL;
 	uint64_t oldest_time = 0;
 
-	// find the oldest valid or first invalid slot
+	// find the oldest valid or first invalid slot, other than the slot
+	// to keep
 	struct index_save_layout *isl;
 	for (isl = sil->saves; isl < sil->saves + max_saves; ++isl) {
+		if ((unsigned int) (isl - sil->saves) == keep_slot) {
+			continue;
+		}
 		uint64_t save_time = 0;
 		int result =
 			validate_index_save_layout(isl, sil->nonce, &save_time);
@@ -2065,6 +2156,7 @@ invalidate_old_save(struct index_layout *layout, struct index_save_layout *isl)
 int setup_index_save_slot(struct index_layout *layout,
 			  unsigned int num_zones,
 			  enum index_save_type save_type,
+			  unsigned int keep_slot,
 			  unsigned int *save_slot_ptr)
 {
 	struct sub_index_layout *sil = &layout->index;
@@ -2072,6 +2164,7 @@ int setup_index_save_slot(struct index_layout *layout,
 	struct index_save_layout *isl = NULL;
 	int result = select_oldest_index_save_layout(sil,
 						     layout->super.max_saves,
+						     keep_slot,
 						     &isl);
 	if (result != UDS_SUCCESS) {
 		return result;
@@ -2116,6 +2209,46 @@ int find_latest_index_save_slot(struct index_layout *layout,
 	return UDS_SUCCESS;
 }
 
+/**********************************************************************/
+int get_index_save_nonce(struct index_layout *layout,
+			 unsigned int slot,
+			 uint64_t *nonce_ptr)
+{
+	int result = ASSERT((slot < layout->super.max_saves),
+			    "save slot %u is valid", slot);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	*nonce_ptr = layout->index.saves[slot].save_data.nonce;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int find_index_save_slot(struct index_layout *layout,
+			 uint64_t nonce,
+			 unsigned int *num_zones_ptr,
+			 unsigned int *slot_ptr)
+{
+	struct sub_index_layout *sil = &layout->index;
+	struct index_save_layout *isl;
+	for (isl = sil->saves; isl < sil->saves + layout->super.max_saves;
+	     ++isl) {
+		if ((validate_index_save_layout(isl, sil->nonce, NULL) !=
+		     UDS_SUCCESS) ||
+		    (isl->save_data.nonce != nonce)) {
+			continue;
+		}
+		if (num_zones_ptr != NULL) {
+			*num_zones_ptr = isl->num_zones;
+		}
+		if (slot_ptr != NULL) {
+			*slot_ptr = isl - sil->saves;
+		}
+		return UDS_SUCCESS;
+	}
+	return UDS_INDEX_NOT_SAVED_CLEANLY;
+}
+
 /**********************************************************************/
 static int __must_check
 make_index_save_region_table(struct index_save_layout *isl,
@@ -2515,9 +2648,26 @@ int make_index_layout_from_factory(struct io_factory *factory,
 		size = named_size;
 	}
 
-	// Get the index size according the the config
+	// Get the index size according the the config. An existing index may
+	// have been created with compact chapter indexes whichever format the
+	// config asks for, so only require the space that format needs.
+	const struct uds_configuration *size_config = config;
+	struct uds_configuration *compact_config = NULL;
+	int result;
+	if (!new_layout) {
+		result = ALLOCATE(1, struct uds_configuration, __func__,
+				  &compact_config);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+		*compact_config = *config;
+		compact_config->chapter_mean_delta_bits =
+			COMPACT_CHAPTER_MEAN_DELTA_BITS;
+		size_config = compact_config;
+	}
 	uint64_t config_size;
-	int result = uds_compute_index_size(config, 0, &config_size);
+	result = uds_compute_index_size(size_config, 0, &config_size);
+	FREE(compact_config);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
@@ -109,6 +109,36 @@ int __must_check find_latest_index_save_slot(struct index_layout *layout,
 					     unsigned int *num_zones_ptr,
 					     unsigned int *slot_ptr);
 
+/**
+ * Find the valid index save slot which holds the save with a given nonce.
+ *
+ * @param [in]  layout          The single file layout.
+ * @param [in]  nonce           The nonce of the save to find.
+ * @param [out] num_zones_ptr   Where to store the actual number of zones
+ *                                that were saved.
+ * @param [out] slot_ptr        Where to store the slot number we found.
+ *
+ * @return UDS_SUCCESS or UDS_INDEX_NOT_SAVED_CLEANLY if there is no such
+ *         save
+ **/
+int __must_check find_index_save_slot(struct index_layout *layout,
+				      uint64_t nonce,
+				      unsigned int *num_zones_ptr,
+				      unsigned int *slot_ptr);
+
+/**
+ * Get the nonce which identifies the save in an index save slot.
+ *
+ * @param [in]  layout     The single file layout.
+ * @param [in]  slot       The save slot.
+ * @param [out] nonce_ptr  Where to store the nonce.
+ *
+ * @return UDS_SUCCESS or an error code.
+ **/
+int __must_check get_index_save_nonce(struct index_layout *layout,
+				      unsigned int slot,
+				      uint64_t *nonce_ptr);
+
 /**
  * Get another reference to an index layout, incrementing it's use count.
  *
@@ -181,15 +211,20 @@ int __must_check open_volume_bufio(struct index_layout *layout,
 
 /**
  * Read the index configuration, and verify that it matches the given
- * configuration.
+ * configuration. If allowed, a sparse index whose configuration differs only
+ * in its sparse sample rate is changed to the new rate; its saved volume
+ * index will then fail to load, so the volume index will be rebuilt.
  *
- * @param layout  the generic index layout
- * @param config  the index configuration
+ * @param layout              the generic index layout
+ * @param config              the index configuration
+ * @param allow_rate_change   whether the sparse sample rate may change
  *
- * @return UDS_SUCCESS or an error code
+ * @return UDS_SUCCESS, UDS_INDEX_NONCE_MISMATCH if the index was saved with
+ *         a different nonce, or another error code
  **/
 int __must_check verify_index_config(struct index_layout *layout,
-				     struct uds_configuration *config);
+				     struct uds_configuration *config,
+				     bool allow_rate_change);
 
 /**
  * Determine which index save slot to use for a new index save.
@@ -200,6 +235,8 @@ int __must_check verify_index_config(struct index_layout *layout,
  * @param [in]  layout          The index layout.
  * @param [in]  num_zones       Actual number of zones currently in use.
  * @param [in]  save_type       The index save type.
+ * @param [in]  keep_slot       A save slot which must not be reused, or
+ *                                UINT_MAX
  * @param [out] save_slot_ptr   Where to store the save slot number.
  *
  * @return UDS_SUCCESS or an error code
@@ -207,6 +244,7 @@ int __must_check verify_index_config(struct index_layout *layout,
 int __must_check setup_index_save_slot(struct index_layout *layout,
 				       unsigned int num_zones,
 				       enum index_save_type save_type,
+				       unsigned int keep_slot,
 				       unsigned int *save_slot_ptr);
 
 /**
@@ -185,14 +185,20 @@ int find_index_page_number(const struct index_page_map *map,
 
 	unsigned int delta_list_number =
 		hash_to_chapter_delta_list(name, geometry);
-	unsigned int slot =
-		(chapter_number * (geometry->index_pages_per_chapter - 1));
-	unsigned int limit = slot + (geometry->index_pages_per_chapter - 1);
+	unsigned int entry_count = geometry->index_pages_per_chapter - 1;
+	const index_page_map_entry_t *entries =
+		&map->entries[chapter_number * entry_count];
 	unsigned int index_page_number = 0;
-	for (; slot < limit; index_page_number++, slot++) {
-		if (delta_list_number <= map->entries[slot]) {
-			break;
-		}
+	unsigned int i;
+	/*
+	 * The entries of a chapter are sorted and there are only a few dozen
+	 * of them in one or two cache lines, so rather than searching for the
+	 * first entry not below the list number, count the entries below it.
+	 * This has no data-dependent branches to mispredict, and the compiler
+	 * can vectorize it.
+	 */
+	for (i = 0; i < entry_count; i++) {
+		index_page_number += (entries[i] < delta_list_number);
 	}
 
 	// This should be a clear post-condition of the loop above, but just in
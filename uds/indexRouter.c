@@ -26,6 +26,7 @@
 #include "logger.h"
 #include "memoryAlloc.h"
 #include "requestQueue.h"
+#include "stageLatency.h"
 #include "zone.h"
 
 /**
@@ -39,6 +40,18 @@ static void execute_zone_request(Request *request)
 	execute_index_router_request(request->router, request);
 }
 
+/**
+ * This is the batch preparation function invoked by the zone's RequestQueue
+ * worker thread before it processes each request in a batch.
+ *
+ * @param requests  the requests which the zone worker is about to process
+ * @param count     the number of requests
+ **/
+static void prepare_zone_requests(Request *requests[], unsigned int count)
+{
+	prefetch_index_requests(requests[0]->router->index, requests, count);
+}
+
 /**
  * Construct and enqueue asynchronous control messages to add the chapter
  * index for a given virtual chapter to the sparse chapter index cache.
@@ -89,6 +102,8 @@ static void triage_request(Request *request)
 					 sparse_virtual_chapter);
 	}
 
+	record_stage_latency(LATENCY_TRIAGE, request->stage_start);
+
 	enqueue_request(request, STAGE_INDEX);
 }
 
@@ -105,9 +120,11 @@ static int initialize_local_index_queues(struct index_router *router,
 {
 	unsigned int i;
 	for (i = 0; i < router->zone_count; i++) {
-		int result = make_request_queue("indexW",
-						&execute_zone_request,
-						&router->zone_queues[i]);
+		int result =
+			make_batching_request_queue("indexW",
+						    &prepare_zone_requests,
+						    &execute_zone_request,
+						    &router->zone_queues[i]);
 		if (result != UDS_SUCCESS) {
 			return result;
 		}
@@ -250,6 +267,7 @@ void execute_index_router_request(struct index_router *router,
 		return;
 	}
 
+	record_stage_latency(LATENCY_ZONE_QUEUE, request->stage_start);
 	router->need_to_save = true;
 	if (request->requeued && !is_successful(request->status)) {
 		request->status = make_unrecoverable(request->status);
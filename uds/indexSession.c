@@ -21,11 +21,13 @@
 
 #include "indexSession.h"
 
+#include "hashUtils.h"
 #include "indexCheckpoint.h"
 #include "indexRouter.h"
 #include "logger.h"
 #include "memoryAlloc.h"
 #include "requestQueue.h"
+#include "stageLatency.h"
 #include "timeUtils.h"
 
 /**********************************************************************/
@@ -56,6 +58,11 @@ static void collect_stats(const struct uds_index_session *index_session,
 /**********************************************************************/
 static void handle_callbacks(Request *request)
 {
+	if (!request->is_control_message) {
+		record_stage_latency(LATENCY_CALLBACK_QUEUE,
+				     request->stage_start);
+	}
+
 	if (request->status == UDS_SUCCESS) {
 		// Measure the turnaround time of this request and include that
 		// time, along with the rest of the request, in the context's
@@ -551,6 +558,51 @@ int uds_get_index_stats(struct uds_index_session *index_session,
 	return UDS_SUCCESS;
 }
 
+/**********************************************************************/
+int uds_get_index_zone_map(struct uds_index_session *index_session,
+			   struct uds_zone_map *map)
+{
+	if (map == NULL) {
+		return log_error_strerror(UDS_INVALID_ARGUMENT,
+					  "received a NULL zone map pointer");
+	}
+	int result = get_index_session(index_session);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	get_volume_index_zone_map(index_session->router->index->volume_index,
+				  map);
+	release_index_session(index_session);
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+unsigned int uds_get_chunk_name_zone(const struct uds_zone_map *map,
+				     const struct uds_chunk_name *name)
+{
+	// This must match get_volume_index_zone() for the mapped index.
+	bool sampled = ((map->sparse_sample_rate != 0) &&
+			((extract_sampling_bytes(name)
+			  % map->sparse_sample_rate) == 0));
+	unsigned int part = (sampled ? 1 : 0);
+	uint64_t bits = extract_volume_index_bytes(name);
+	unsigned int list = ((bits >> map->parts[part].address_bits)
+			     % map->parts[part].delta_lists);
+	return list / map->parts[part].lists_per_zone;
+}
+
+/**********************************************************************/
+int uds_get_index_age_stats(struct uds_index_session *index_session,
+			    struct uds_index_age_stats *stats)
+{
+	if (stats == NULL) {
+		return log_error_strerror(UDS_INDEX_STATS_PTR_REQUIRED,
+					  "received a NULL index stats pointer");
+	}
+	get_index_age_stats(index_session->router->index, stats);
+	return UDS_SUCCESS;
+}
+
 /**********************************************************************/
 int uds_get_index_session_stats(struct uds_index_session *index_session,
 				struct uds_context_stats *stats)
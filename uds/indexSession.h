@@ -224,7 +224,9 @@ int __must_check uds_save_index(struct uds_index_session *index_session);
 int save_and_free_index(struct uds_index_session *index_session);
 
 /**
- * Set the checkpoint frequency of the grid.
+ * Set the checkpoint frequency of the grid. The frequency is the most
+ * chapters which may be written between the starts of two checkpoints;
+ * checkpoints start sooner when the index is quiet.
  *
  * @param session    The index session to be modified.
  * @param frequency  New checkpoint frequency.
@@ -27,6 +27,7 @@
 #include "logger.h"
 #include "memoryAlloc.h"
 
+unsigned int full_checkpoint_interval = 0;
 
 /**********************************************************************/
 int make_index_state(struct index_layout *layout,
@@ -55,6 +56,9 @@ int make_index_state(struct index_layout *layout,
 	state->load_zones = 0;
 	state->load_slot = UINT_MAX;
 	state->save_slot = UINT_MAX;
+	state->base_slot = UINT_MAX;
+	state->differential_saves = 0;
+	state->differential = false;
 	state->saving = false;
 	state->zone_count = num_zones;
 
@@ -193,7 +197,8 @@ int prepare_to_save_index_state(struct index_state *state,
 			UDS_BAD_STATE, "already saving the index state");
 	}
 	int result = setup_index_save_slot(state->layout, state->zone_count,
-					   save_type, &state->save_slot);
+					   save_type, state->base_slot,
+					   &state->save_slot);
 	if (result != UDS_SUCCESS) {
 		return log_error_strerror(result,
 					  "cannot prepare index %s",
@@ -215,11 +220,19 @@ static int complete_index_saving(struct index_state *state)
 {
 	state->saving = false;
 	int result = commit_index_save(state->layout, state->save_slot);
-	state->save_slot = UINT_MAX;
 	if (result != UDS_SUCCESS) {
+		state->save_slot = UINT_MAX;
+		state->base_slot = UINT_MAX;
 		return log_error_strerror(result,
 					  "cannot commit index state");
 	}
+	if (state->differential) {
+		state->differential_saves++;
+	} else {
+		state->base_slot = state->save_slot;
+		state->differential_saves = 0;
+	}
+	state->save_slot = UINT_MAX;
 	return UDS_SUCCESS;
 }
 
@@ -228,6 +241,11 @@ static int cleanup_save(struct index_state *state)
 {
 	int result = cancel_index_save(state->layout, state->save_slot);
 	state->save_slot = UINT_MAX;
+	if (!state->differential) {
+		// The delta lists were marked dirty again, but the base slot may
+		// have been reused.
+		state->base_slot = UINT_MAX;
+	}
 	if (result != UDS_SUCCESS) {
 		return log_error_strerror(result,
 					  "cannot cancel index save");
@@ -238,6 +256,7 @@ static int cleanup_save(struct index_state *state)
 /**********************************************************************/
 int save_index_state(struct index_state *state)
 {
+	state->differential = false;
 	int result = prepare_to_save_index_state(state, IS_SAVE);
 	if (result != UDS_SUCCESS) {
 		return result;
@@ -257,6 +276,7 @@ int save_index_state(struct index_state *state)
 /**********************************************************************/
 int write_index_state_checkpoint(struct index_state *state)
 {
+	state->differential = false;
 	int result = prepare_to_save_index_state(state, IS_CHECKPOINT);
 	if (result != UDS_SUCCESS) {
 		return result;
@@ -281,6 +301,10 @@ int write_index_state_checkpoint(struct index_state *state)
 /**********************************************************************/
 int start_index_state_checkpoint(struct index_state *state)
 {
+	state->differential =
+		((full_checkpoint_interval > 1) &&
+		 (state->base_slot != UINT_MAX) &&
+		 (state->differential_saves < full_checkpoint_interval - 1));
 	int result = prepare_to_save_index_state(state, IS_CHECKPOINT);
 	if (result != UDS_SUCCESS) {
 		return result;
@@ -475,6 +499,7 @@ int discard_index_state_data(struct index_state *state)
 {
 	int result = discard_index_saves(state->layout, true);
 	state->save_slot = UINT_MAX;
+	state->base_slot = UINT_MAX;
 	if (result != UDS_SUCCESS) {
 		return log_error_strerror(result,
 					  "%s: cannot destroy all index saves",
@@ -488,6 +513,7 @@ int discard_last_index_state_save(struct index_state *state)
 {
 	int result = discard_index_saves(state->layout, false);
 	state->save_slot = UINT_MAX;
+	state->base_slot = UINT_MAX;
 	if (result != UDS_SUCCESS) {
 		return log_error_strerror(result,
 					  "%s: cannot destroy latest index save",
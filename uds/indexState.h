@@ -54,6 +54,9 @@ struct index_state {
 	unsigned int load_zones;
 	unsigned int load_slot;
 	unsigned int save_slot;
+	unsigned int base_slot;            // last full save, or UINT_MAX
+	unsigned int differential_saves;   // checkpoints since base_slot
+	bool differential;                 // save in progress is differential
 	unsigned int count;                // count of registered entries
 					   // (<= length)
 	unsigned int length;               // total span of array allocation
@@ -61,6 +64,13 @@ struct index_state {
 	struct index_component *entries[]; // array of index component entries
 };
 
+/**
+ * The number of checkpoints in each cycle which starts with a full save of
+ * the volume index, the others saving only the delta lists changed since
+ * that full save. Values of 0 and 1 make every checkpoint full.
+ **/
+extern unsigned int full_checkpoint_interval;
+
 /**
  * Make an index state object,
  *
@@ -25,7 +25,11 @@
 #include "errors.h"
 #include "index.h"
 #include "logger.h"
+#include "memoryAlloc.h"
+#include "pageCache.h"
+#include "sparseCache.h"
 #include "uds.h"
+#include "volume.h"
 
 /* The index state version header */
 struct index_state_version {
@@ -47,6 +51,135 @@ static const struct index_state_version INDEX_STATE_VERSION_301 = {
 	.version_id = 301,
 };
 
+/*
+ * The version 301 index state may be followed by a warm set naming the
+ * sparse chapters and volume pages which were cached when the index was
+ * saved, so that a load can start reading them back before they are needed.
+ * Loaders which predate the warm set ignore it, as they ignore any bytes
+ * after the state.
+ */
+enum {
+	INDEX_STATE_WARM_SIGNATURE = 0x4d524157, // "WARM"
+	MAX_WARM_CHAPTERS          = 16,
+};
+
+/**
+ * Prefetch the sparse chapter indexes and volume pages named by the warm set
+ * of a saved index state. The warm set is only a hint, so it is ignored if it
+ * is not intact, and any chapters or pages which are no longer in the index
+ * are skipped.
+ *
+ * @param buffer  the index state buffer, positioned after the state
+ * @param index   the index being loaded
+ **/
+static void read_warm_set(struct buffer *buffer, struct index *index)
+{
+	struct volume *volume = index->volume;
+	const struct geometry *geometry = volume->geometry;
+	uint32_t signature;
+	uint16_t chapter_count, page_count;
+	if ((content_length(buffer) < 8)
+	    || (get_uint32_le_from_buffer(buffer, &signature) != UDS_SUCCESS)
+	    || (signature != INDEX_STATE_WARM_SIGNATURE)
+	    || (get_uint16_le_from_buffer(buffer, &chapter_count)
+		!= UDS_SUCCESS)
+	    || (get_uint16_le_from_buffer(buffer, &page_count) != UDS_SUCCESS)
+	    || (chapter_count > MAX_WARM_CHAPTERS)
+	    || (content_length(buffer)
+		< (chapter_count * sizeof(uint64_t))
+		  + (page_count * sizeof(uint32_t)))) {
+		return;
+	}
+
+	unsigned int i;
+	for (i = 0; i < chapter_count; i++) {
+		uint64_t vcn;
+		if (get_uint64_le_from_buffer(buffer, &vcn) != UDS_SUCCESS) {
+			return;
+		}
+		if ((volume->sparse_cache == NULL)
+		    || (vcn < index->oldest_virtual_chapter)
+		    || (vcn >= index->newest_virtual_chapter)) {
+			continue;
+		}
+		unsigned int chapter = map_to_physical_chapter(geometry, vcn);
+		unsigned int first_page =
+			map_to_physical_page(geometry, chapter, 0);
+		prefetch_volume_pages(&volume->volume_store, first_page,
+				      geometry->index_pages_per_chapter);
+	}
+
+	for (i = 0; i < page_count; i++) {
+		uint32_t page;
+		if (get_uint32_le_from_buffer(buffer, &page) != UDS_SUCCESS) {
+			return;
+		}
+		if ((page > 0) && (page <= geometry->pages_per_volume)) {
+			prefetch_volume_pages(&volume->volume_store, page, 1);
+		}
+	}
+}
+
+/**
+ * Append the warm set of an index to its saved state, filling the rest of
+ * the state buffer. Since the warm set is only a hint, nothing is appended
+ * if it can not be gathered.
+ *
+ * @param buffer  the index state buffer, positioned after the state
+ * @param index   the index being saved
+ **/
+static void write_warm_set(struct buffer *buffer, struct index *index)
+{
+	struct volume *volume = index->volume;
+	size_t space = available_space(buffer);
+	if (space < 8) {
+		return;
+	}
+	space -= 8;
+
+	uint64_t chapters[MAX_WARM_CHAPTERS];
+	unsigned int chapter_count = 0;
+	if (volume->sparse_cache != NULL) {
+		unsigned int chapter_limit = min((size_t) MAX_WARM_CHAPTERS,
+						 space / sizeof(uint64_t));
+		chapter_count = get_sparse_cache_chapters(volume->sparse_cache,
+							  chapters,
+							  chapter_limit);
+		space -= chapter_count * sizeof(uint64_t);
+	}
+
+	unsigned int page_limit = min(space / sizeof(uint32_t),
+				      (size_t) UINT16_MAX);
+	unsigned int page_count = 0;
+	unsigned int *pages = NULL;
+	if ((page_limit > 0)
+	    && (ALLOCATE(page_limit, unsigned int, "warm pages", &pages)
+		== UDS_SUCCESS)) {
+		if (get_page_cache_hot_pages(volume->page_cache, page_limit,
+					     pages, &page_count)
+		    != UDS_SUCCESS) {
+			page_count = 0;
+		}
+	}
+
+	int result = put_uint32_le_into_buffer(buffer,
+					       INDEX_STATE_WARM_SIGNATURE);
+	if (result == UDS_SUCCESS) {
+		result = put_uint16_le_into_buffer(buffer, chapter_count);
+	}
+	if (result == UDS_SUCCESS) {
+		result = put_uint16_le_into_buffer(buffer, page_count);
+	}
+	unsigned int i;
+	for (i = 0; (result == UDS_SUCCESS) && (i < chapter_count); i++) {
+		result = put_uint64_le_into_buffer(buffer, chapters[i]);
+	}
+	for (i = 0; (result == UDS_SUCCESS) && (i < page_count); i++) {
+		result = put_uint32_le_into_buffer(buffer, pages[i]);
+	}
+	FREE(pages);
+}
+
 /**
  * The index state index component reader.
  *
@@ -111,6 +244,7 @@ static int read_index_state_data(struct read_portal *portal)
 	index->newest_virtual_chapter = state.newest_chapter;
 	index->oldest_virtual_chapter = state.oldest_chapter;
 	index->last_checkpoint = state.last_checkpoint;
+	read_warm_set(buffer, index);
 	return UDS_SUCCESS;
 }
 
@@ -172,6 +306,7 @@ write_index_state_data(struct index_component *component,
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
+	write_warm_set(buffer, index);
 	return UDS_SUCCESS;
 }
 
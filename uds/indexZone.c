@@ -30,8 +30,24 @@
 #include "permassert.h"
 #include "request.h"
 #include "sparseCache.h"
+#include "stageLatency.h"
 #include "uds.h"
 
+unsigned int open_chapters_per_zone = 2;
+
+/**********************************************************************/
+unsigned int get_open_chapters_per_zone(const struct geometry *geometry)
+{
+	unsigned int count =
+		min(max(open_chapters_per_zone, 2U),
+		    (unsigned int) MAX_OPEN_CHAPTERS);
+	// A chapter which has not been written must not become sparse.
+	if (count > geometry->dense_chapters_per_volume) {
+		count = max(geometry->dense_chapters_per_volume, 2U);
+	}
+	return count;
+}
+
 /**********************************************************************/
 int make_index_zone(struct index *index, unsigned int zone_number)
 {
@@ -41,22 +57,19 @@ int make_index_zone(struct index *index, unsigned int zone_number)
 		return result;
 	}
 
-	result = make_open_chapter(index->volume->geometry,
-				   index->zone_count,
-				   &zone->open_chapter);
-	if (result != UDS_SUCCESS) {
-		free_index_zone(zone);
-		return result;
-	}
-
-	result = make_open_chapter(index->volume->geometry,
-				   index->zone_count,
-				   &zone->writing_chapter);
-	if (result != UDS_SUCCESS) {
-		free_index_zone(zone);
-		return result;
+	unsigned int i;
+	for (i = 0; i < index->open_chapter_count; i++) {
+		result = make_open_chapter(index->volume->geometry,
+					   index->zone_count,
+					   &zone->chapters[i]);
+		if (result != UDS_SUCCESS) {
+			free_index_zone(zone);
+			return result;
+		}
+		zone->chapter_count++;
 	}
 
+	zone->open_chapter = zone->chapters[0];
 	zone->index = index;
 	zone->id = zone_number;
 	index->zones[zone_number] = zone;
@@ -71,8 +84,10 @@ void free_index_zone(struct index_zone *zone)
 		return;
 	}
 
-	free_open_chapter(zone->open_chapter);
-	free_open_chapter(zone->writing_chapter);
+	unsigned int i;
+	for (i = 0; i < zone->chapter_count; i++) {
+		free_open_chapter(zone->chapters[i]);
+	}
 	FREE(zone);
 }
 
@@ -94,8 +109,9 @@ void set_active_chapters(struct index_zone *zone)
 }
 
 /**
- * Swap the open and writing chapters after blocking until there are no active
- * chapter writers on the index.
+ * Rotate the open chapter buffers so that the oldest closed chapter becomes
+ * the new open chapter, after blocking until the chapter writer has finished
+ * writing that chapter.
  *
  * @param zone  The zone swapping chapters
  *
@@ -103,17 +119,26 @@ void set_active_chapters(struct index_zone *zone)
  **/
 static int swap_open_chapter(struct index_zone *zone)
 {
-	// Wait for any currently writing chapter to complete
+	// Wait for the oldest closed chapter to be written. The chapters
+	// between it and the open chapter may still be in progress.
+	unsigned int closed_count = zone->chapter_count - 1;
+	uint64_t first_unwritten =
+		((zone->newest_virtual_chapter >= closed_count) ?
+		 (zone->newest_virtual_chapter - closed_count + 1) : 0);
 	int result = finish_previous_chapter(zone->index->chapter_writer,
-					     zone->newest_virtual_chapter);
+					     first_unwritten);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
 
-	// Swap the writing and open chapters
-	struct open_chapter_zone *temp_chapter = zone->open_chapter;
-	zone->open_chapter = zone->writing_chapter;
-	zone->writing_chapter = temp_chapter;
+	struct open_chapter_zone *oldest_chapter =
+		zone->chapters[closed_count];
+	unsigned int i;
+	for (i = closed_count; i > 0; i--) {
+		zone->chapters[i] = zone->chapters[i - 1];
+	}
+	zone->chapters[0] = oldest_chapter;
+	zone->open_chapter = oldest_chapter;
 	return UDS_SUCCESS;
 }
 
@@ -152,8 +177,8 @@ int execute_sparse_cache_barrier_message(struct index_zone *zone,
 {
 	/*
 	 * Check if the chapter index for the virtual chapter is already in the
-	 * cache, and if it's not, rendezvous with the other zone threads to
-	 * add the chapter index to the sparse index cache.
+	 * cache, and if it's not, ask for the chapter index to be added to the
+	 * sparse index cache.
 	 */
 	return update_sparse_cache(zone, barrier->virtual_chapter);
 }
@@ -281,7 +306,7 @@ int open_next_chapter(struct index_zone *zone, Request *request)
 
 	unsigned int finished_zones =
 		start_closing_chapter(zone->index->chapter_writer, zone->id,
-				      zone->writing_chapter);
+				      closed_chapter, zone->chapters[1]);
 	if ((finished_zones == 1) && (zone->index->zone_count > 1)) {
 		// This is the first zone of a multi-zone index to close this
 		// chapter, so inform the other zones in order to control zone
@@ -329,6 +354,34 @@ enum index_region compute_index_region(const struct index_zone *zone,
 								LOC_IN_DENSE);
 }
 
+/**********************************************************************/
+void prefetch_record_from_zone(struct index_zone *zone,
+			       Request *request,
+			       uint64_t virtual_chapter)
+{
+	// Open chapters, whether being filled or written, are in memory.
+	if ((virtual_chapter <= zone->newest_virtual_chapter) &&
+	    (zone->newest_virtual_chapter - virtual_chapter <
+	     zone->chapter_count)) {
+		return;
+	}
+
+	if (request->sl_location_known) {
+		return;
+	}
+
+	struct volume *volume = zone->index->volume;
+	if (is_zone_chapter_sparse(zone, virtual_chapter) &&
+	    sparse_cache_contains(volume->sparse_cache,
+				  virtual_chapter,
+				  request->zone_number)) {
+		return;
+	}
+
+	prefetch_volume_page_cache(volume, request, &request->chunk_name,
+				   virtual_chapter);
+}
+
 /**********************************************************************/
 int get_record_from_zone(struct index_zone *zone,
 			 Request *request,
@@ -336,23 +389,32 @@ int get_record_from_zone(struct index_zone *zone,
 			 uint64_t virtual_chapter)
 {
 	if (virtual_chapter == zone->newest_virtual_chapter) {
+		ktime_t start = current_time_ns(CLOCK_MONOTONIC);
 		search_open_chapter(zone->open_chapter,
 				    &request->chunk_name,
 				    &request->old_metadata,
 				    found);
+		record_stage_latency(LATENCY_OPEN_CHAPTER, start);
 		return UDS_SUCCESS;
 	}
 
-	if ((zone->newest_virtual_chapter > 0) &&
-	    (virtual_chapter == (zone->newest_virtual_chapter - 1)) &&
-	    (zone->writing_chapter->size > 0)) {
-		// Only search the writing chapter if it is full, else look on
+	if ((virtual_chapter < zone->newest_virtual_chapter) &&
+	    (zone->newest_virtual_chapter - virtual_chapter <
+	     zone->chapter_count)) {
+		struct open_chapter_zone *chapter =
+			zone->chapters[zone->newest_virtual_chapter -
+				       virtual_chapter];
+		// Only search a closed chapter if it is full, else look on
 		// disk.
-		search_open_chapter(zone->writing_chapter,
-				    &request->chunk_name,
-				    &request->old_metadata,
-				    found);
-		return UDS_SUCCESS;
+		if (chapter->size > 0) {
+			ktime_t start = current_time_ns(CLOCK_MONOTONIC);
+			search_open_chapter(chapter,
+					    &request->chunk_name,
+					    &request->old_metadata,
+					    found);
+			record_stage_latency(LATENCY_OPEN_CHAPTER, start);
+			return UDS_SUCCESS;
+		}
 	}
 
 	// The slow lane thread has determined the location previously. We
@@ -406,10 +468,12 @@ int search_sparse_cache_in_zone(struct index_zone *zone,
 				bool *found)
 {
 	int record_page_number;
+	ktime_t start = current_time_ns(CLOCK_MONOTONIC);
 	int result = search_sparse_cache(zone,
 					 &request->chunk_name,
 					 &virtual_chapter,
 					 &record_page_number);
+	record_stage_latency(LATENCY_SPARSE_CACHE, start);
 	if ((result != UDS_SUCCESS) || (virtual_chapter == UINT64_MAX)) {
 		return result;
 	}
@@ -421,8 +485,13 @@ int search_sparse_cache_in_zone(struct index_zone *zone,
 	unsigned int chapter =
 		map_to_physical_chapter(volume->geometry, virtual_chapter);
 
-	return search_cached_record_page(volume,
-					 request, &request->chunk_name,
-					 chapter, record_page_number,
-					 &request->old_metadata, found);
+	result = search_cached_record_page(volume,
+					   request, &request->chunk_name,
+					   chapter, record_page_number,
+					   &request->old_metadata, found);
+	if ((result == UDS_SUCCESS) && *found) {
+		request->chapter_age =
+			zone->newest_virtual_chapter - virtual_chapter;
+	}
+	return result;
 }
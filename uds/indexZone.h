@@ -23,18 +23,48 @@
 #define INDEX_ZONE_H
 
 #include "common.h"
+#include "geometry.h"
 #include "openChapterZone.h"
 #include "request.h"
 
+enum {
+	/** The most open chapter buffers a zone may have */
+	MAX_OPEN_CHAPTERS = 8,
+};
+
+/**
+ * The number of open chapter buffers each zone of a new index should have.
+ * One buffer receives new records while the others hold the chapters which
+ * the chapter writer has not finished writing, so a zone only waits for the
+ * chapter writer when all of those buffers are still being written.
+ **/
+extern unsigned int open_chapters_per_zone;
+
 struct index_zone {
 	struct index *index;
 	struct open_chapter_zone *open_chapter;
-	struct open_chapter_zone *writing_chapter;
+	/* The open chapter followed by the closed chapters, newest first */
+	struct open_chapter_zone *chapters[MAX_OPEN_CHAPTERS];
+	unsigned int chapter_count;
 	uint64_t oldest_virtual_chapter;
 	uint64_t newest_virtual_chapter;
 	unsigned int id;
+	/* The number of searches, and of hits by chapter age, in this zone */
+	uint64_t searches;
+	uint64_t hits_by_age[UDS_CHAPTER_AGE_BUCKETS];
 };
 
+/**
+ * Get the number of open chapter buffers each zone of an index should have,
+ * limited so that every chapter still being written is a dense chapter.
+ *
+ * @param geometry  The geometry of the index
+ *
+ * @return The number of open chapter buffers per zone
+ **/
+unsigned int __must_check
+get_open_chapters_per_zone(const struct geometry *geometry);
+
 /**
  * Allocate an index zone.
  *
@@ -85,8 +115,8 @@ int __must_check dispatch_index_zone_control_request(Request *request);
 
 /**
  * Execute a sparse chapter index cache barrier control request on the zone
- * worker thread. This call into the sparse cache to coordinate the cache
- * update with the other zones.
+ * worker thread. This calls into the sparse cache to request the chapter
+ * index, without waiting for it or for the other zones.
  *
  * @param zone     The index zone receiving the barrier message
  * @param barrier  The barrier control message data
@@ -120,6 +150,19 @@ int __must_check open_next_chapter(struct index_zone *zone, Request *request);
 enum index_region compute_index_region(const struct index_zone *zone,
 				       uint64_t virtual_chapter);
 
+/**
+ * Prepare to get a record from a zone by prefetching what the search of the
+ * volume will need, if the chapter is neither open nor in the sparse cache.
+ * This never blocks.
+ *
+ * @param zone             The index zone which will be queried
+ * @param request          The request which will query the zone
+ * @param virtual_chapter  The chapter which will be searched
+ **/
+void prefetch_record_from_zone(struct index_zone *zone,
+			       Request *request,
+			       uint64_t virtual_chapter);
+
 /**
  * Get a record from either the volume or the open chapter in a zone.
  *
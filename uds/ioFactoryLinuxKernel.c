@@ -158,8 +158,6 @@ int open_buffered_writer(struct io_factory *factory,
 			 size_t size,
 			 struct buffered_writer **writer_ptr)
 {
-	int result;
-	struct dm_bufio_client *client = NULL;
 	if (size % UDS_BLOCK_SIZE != 0) {
 		return log_error_strerror(UDS_INCORRECT_ALIGNMENT,
 					  "region size %zd is not multiple of %d",
@@ -167,15 +165,5 @@ int open_buffered_writer(struct io_factory *factory,
 					  UDS_BLOCK_SIZE);
 	}
 
-	result = make_bufio(factory, offset, UDS_BLOCK_SIZE, 1, &client);
-	if (result != UDS_SUCCESS) {
-		return result;
-	}
-
-	result = make_buffered_writer(
-		factory, client, size / UDS_BLOCK_SIZE, writer_ptr);
-	if (result != UDS_SUCCESS) {
-		dm_bufio_client_destroy(client);
-	}
-	return result;
+	return make_buffered_writer(factory, offset, size, writer_ptr);
 }
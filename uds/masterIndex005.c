@@ -20,6 +20,8 @@
  */
 #include "masterIndex005.h"
 
+#include "atomicDefs.h"
+#include "bloomFilter.h"
 #include "buffer.h"
 #include "compiler.h"
 #include "errors.h"
@@ -27,6 +29,7 @@
 #include "hashUtils.h"
 #include "logger.h"
 #include "memoryAlloc.h"
+#include "permassert.h"
 #include "uds.h"
 #include "zone.h"
 
@@ -53,12 +56,22 @@
  * index chapter number around so that the smallest one we are using has
  * the representation 0.  See convert_index_to_virtual() or
  * flush_invalid_entries() for an example of this technique.
+ *
+ * Optionally, each zone keeps a Bloom filter of the delta list and address
+ * of every entry it holds, so that most names which have never been seen are
+ * rejected without searching a delta list.  Entries cannot be removed from
+ * the filter, so as chapters expire it is cleared and refilled from the
+ * delta lists of the zone.
  */
 
 struct volume_index_zone {
 	uint64_t virtual_chapter_low;   // The lowest virtual chapter indexed
 	uint64_t virtual_chapter_high;  // The highest virtual chapter indexed
 	long num_early_flushes;         // The number of early flushes
+	struct bloom_filter *filter;    // The filter of the zone's entries
+	bool filter_valid;              // Whether the filter holds every entry
+	uint64_t filter_chapter_low;    // The lowest virtual chapter when the
+					// filter was last filled
 } __attribute__((aligned(CACHE_LINE_BYTES)));
 
 struct volume_index5 {
@@ -97,6 +110,20 @@ static const byte bad_magic = 0;
  */
 unsigned int min_volume_index_delta_lists;
 
+/*
+ * The number of bits per entry to spend on the zone filters of a volume
+ * index when it is made.  Zero, the default, disables the filters.
+ */
+unsigned int volume_index_filter_bits;
+
+enum {
+	/*
+	 * The zone filter is refilled once the oldest chapter still indexed
+	 * has advanced by this fraction of the volume's chapters.
+	 */
+	VOLUME_INDEX_FILTER_REFILL_FRACTION = 4,
+};
+
 /**
  * Extract the address from a block name.
  *
@@ -328,6 +355,89 @@ static int get_volume_index_entry(struct volume_index_record *record,
 	return UDS_SUCCESS;
 }
 
+/**
+ * Get the zone filter key of a delta index entry.
+ *
+ * @param list_number  The delta list number
+ * @param address      The address of the entry within the delta list
+ *
+ * @return the filter key
+ **/
+static INLINE uint64_t get_filter_key(unsigned int list_number,
+				      unsigned int address)
+{
+	return ((uint64_t) list_number << 32) | address;
+}
+
+/**
+ * Clear the filter of a zone and fill it from the zone's delta lists.
+ *
+ * @param vi5          The volume index
+ * @param zone_number  The zone whose filter is to be filled
+ **/
+static void fill_zone_filter(struct volume_index5 *vi5,
+			     unsigned int zone_number)
+{
+	struct volume_index_zone *volume_index_zone =
+		&vi5->zones[zone_number];
+	unsigned int first_list =
+		get_delta_index_zone_first_list(&vi5->delta_index, zone_number);
+	unsigned int num_lists =
+		get_delta_index_zone_num_lists(&vi5->delta_index, zone_number);
+	unsigned int i;
+
+	volume_index_zone->filter_valid = false;
+	clear_bloom_filter(volume_index_zone->filter);
+	for (i = first_list; i < first_list + num_lists; i++) {
+		struct delta_index_entry entry;
+		int result = start_delta_index_search(&vi5->delta_index, i, 0,
+						      true, &entry);
+		while (result == UDS_SUCCESS) {
+			result = next_delta_index_entry(&entry);
+			if ((result != UDS_SUCCESS) || entry.at_end) {
+				break;
+			}
+			add_to_bloom_filter(volume_index_zone->filter,
+					    get_filter_key(i, entry.key));
+		}
+		if (result != UDS_SUCCESS) {
+			log_warning_strerror(result,
+					     "zone %u: cannot fill volume index filter",
+					     zone_number);
+			return;
+		}
+	}
+	volume_index_zone->filter_valid = true;
+	volume_index_zone->filter_chapter_low =
+		volume_index_zone->virtual_chapter_low;
+}
+
+/**
+ * Refill the filter of a zone if it is not valid, or if enough chapters have
+ * expired since it was filled that it is rejecting too few names.
+ *
+ * @param vi5          The volume index
+ * @param zone_number  The zone whose filter is to be checked
+ **/
+static void refresh_zone_filter(struct volume_index5 *vi5,
+				unsigned int zone_number)
+{
+	struct volume_index_zone *volume_index_zone =
+		&vi5->zones[zone_number];
+	uint64_t refill_chapters =
+		max(vi5->num_chapters / VOLUME_INDEX_FILTER_REFILL_FRACTION,
+		    1u);
+	if (volume_index_zone->filter == NULL) {
+		return;
+	}
+	if (volume_index_zone->filter_valid &&
+	    (volume_index_zone->virtual_chapter_low <
+	     volume_index_zone->filter_chapter_low + refill_chapters)) {
+		return;
+	}
+	fill_zone_filter(vi5, zone_number);
+}
+
 /**********************************************************************/
 /**
  * Terminate and clean up the volume index
@@ -342,6 +452,12 @@ static void free_volume_index_005(struct volume_index *volume_index)
 							 common);
 		FREE(vi5->flush_chapters);
 		vi5->flush_chapters = NULL;
+		if (vi5->zones != NULL) {
+			unsigned int z;
+			for (z = 0; z < vi5->num_zones; z++) {
+				free_bloom_filter(vi5->zones[z].filter);
+			}
+		}
 		FREE(vi5->zones);
 		vi5->zones = NULL;
 		uninitialize_delta_index(&vi5->delta_index);
@@ -383,6 +499,23 @@ static void set_volume_index_tag_005(struct volume_index *volume_index,
 	set_delta_index_tag(&vi5->delta_index, tag);
 }
 
+/**********************************************************************/
+/**
+ * Set whether a volume index is restoring the base save of a differential
+ * save.
+ *
+ * @param volume_index    The volume index
+ * @param restoring_base  Whether the base save is being restored
+ **/
+static void
+set_volume_index_restoring_base_005(struct volume_index *volume_index,
+				    bool restoring_base)
+{
+	struct volume_index5 *vi5 =
+		container_of(volume_index, struct volume_index5, common);
+	set_delta_index_restoring_base(&vi5->delta_index, restoring_base);
+}
+
 /**********************************************************************/
 static int __must_check encode_volume_index_header(struct buffer *buffer,
 						   struct vi005_data *header)
@@ -427,13 +560,16 @@ static int __must_check encode_volume_index_header(struct buffer *buffer,
  * @param volume_index     The volume index
  * @param zone_number      The number of the zone to save
  * @param buffered_writer  The index state component being written
+ * @param differential     If true, save only the delta lists which have
+ *                         changed since the last full save
  *
  * @return UDS_SUCCESS on success, or an error code on failure
  **/
 static int
 start_saving_volume_index_005(const struct volume_index *volume_index,
 			      unsigned int zone_number,
-			      struct buffered_writer *buffered_writer)
+			      struct buffered_writer *buffered_writer,
+			      bool differential)
 {
 	const struct volume_index5 *vi5 =
 		const_container_of(volume_index, struct volume_index5, common);
@@ -493,7 +629,7 @@ start_saving_volume_index_005(const struct volume_index *volume_index,
 	}
 
 	return start_saving_delta_index(&vi5->delta_index, zone_number,
-					buffered_writer);
+					buffered_writer, differential);
 }
 
 /**********************************************************************/
@@ -702,11 +838,13 @@ start_restoring_volume_index_005(struct volume_index *volume_index,
 
 	unsigned int z;
 	for (z = 0; z < vi5->num_zones; z++) {
-		memset(&vi5->zones[z],
-		       0,
-		       sizeof(struct volume_index_zone));
+		// Keep the filter; it is refilled when the open chapter is
+		// set.
 		vi5->zones[z].virtual_chapter_low = virtual_chapter_low;
 		vi5->zones[z].virtual_chapter_high = virtual_chapter_high;
+		vi5->zones[z].num_early_flushes = 0;
+		vi5->zones[z].filter_valid = false;
+		vi5->zones[z].filter_chapter_low = 0;
 	}
 
 	int result = start_restoring_delta_index(&vi5->delta_index,
@@ -859,6 +997,7 @@ set_volume_index_zone_open_chapter_005(struct volume_index *volume_index,
 		empty_delta_index_zone(&vi5->delta_index, zone_number);
 		volume_index_zone->virtual_chapter_low = virtual_chapter;
 		volume_index_zone->virtual_chapter_high = virtual_chapter;
+		volume_index_zone->filter_valid = false;
 	} else if (virtual_chapter <= volume_index_zone->virtual_chapter_high) {
 		// Moving backwards and the new range overlaps the old range.
 		// Note that moving to the same open chapter counts as
@@ -926,6 +1065,7 @@ set_volume_index_zone_open_chapter_005(struct volume_index *volume_index,
 			}
 		}
 	}
+	refresh_zone_filter(vi5, zone_number);
 }
 
 /**********************************************************************/
@@ -988,6 +1128,45 @@ get_volume_index_zone_005(const struct volume_index *volume_index,
 	return get_delta_index_zone(&vi5->delta_index, delta_list_number);
 }
 
+/**********************************************************************/
+/**
+ * Get the number of zones of the volume index.
+ *
+ * @param volume_index The volume index
+ *
+ * @return the number of zones
+ **/
+static unsigned int
+get_volume_index_zone_count_005(const struct volume_index *volume_index)
+{
+	const struct volume_index5 *vi5 =
+		const_container_of(volume_index, struct volume_index5, common);
+	return vi5->num_zones;
+}
+
+/**********************************************************************/
+/**
+ * Get the map of chunk names to zones of the volume index.
+ *
+ * @param volume_index The volume index
+ * @param map          The zone map to fill
+ **/
+static void
+get_volume_index_zone_map_005(const struct volume_index *volume_index,
+			      struct uds_zone_map *map)
+{
+	const struct volume_index5 *vi5 =
+		const_container_of(volume_index, struct volume_index5, common);
+	*map = (struct uds_zone_map) {
+		.zone_count = vi5->num_zones,
+		.sparse_sample_rate = 0,
+	};
+	map->parts[0].address_bits = vi5->address_bits;
+	map->parts[0].delta_lists = vi5->num_delta_lists;
+	map->parts[0].lists_per_zone = vi5->delta_index.lists_per_zone;
+	map->parts[1] = map->parts[0];
+}
+
 /**********************************************************************/
 /**
  * Do a quick read-only lookup of the chunk name and return information
@@ -1065,51 +1244,26 @@ lookup_volume_index_sampled_name_005(const struct volume_index *volume_index,
 	return UDS_SUCCESS;
 }
 
-/**********************************************************************/
 /**
- * Find the volume index record associated with a block name
- *
- * This is always the first routine to be called when dealing with a delta
- * volume index entry.  The fields of the record parameter should be
- * examined to determine the state of the record:
+ * Search the delta list of a volume index record for its block name,
+ * flushing any expired entries along the way.
  *
- * If is_found is false, then we did not find an entry for the block
- * name.  Information is saved in the volume_index_record so that
- * put_volume_index_record() will insert an entry for that block name at
- * the proper place.
- *
- * If is_found is true, then we did find an entry for the block name.
- * Information is saved in the volume_index_record so that the "chapter"
- * and "is_collision" fields reflect the entry found.
- * Calls to remove_volume_index_record() will remove the entry, calls to
- * set_volume_index_record_chapter() can modify the entry, and calls to
- * put_volume_index_record() can insert a collision record with this
- * entry.
- *
- * @param volume_index  The volume index to search
- * @param name          The chunk name
- * @param record        Set to the info about the record searched for
+ * @param vi5     The volume index
+ * @param record  The record, which has been set up by
+ *                get_volume_index_record_005()
  *
  * @return UDS_SUCCESS or an error code
  **/
-static int get_volume_index_record_005(struct volume_index *volume_index,
-				       const struct uds_chunk_name *name,
-				       struct volume_index_record *record)
+static int search_volume_index_record(struct volume_index5 *vi5,
+				      struct volume_index_record *record)
 {
-	struct volume_index5 *vi5 =
-		container_of(volume_index, struct volume_index5, common);
-	unsigned int address = extract_address(vi5, name);
-	unsigned int delta_list_number = extract_dlist_num(vi5, name);
+	unsigned int address = extract_address(vi5, record->name);
+	unsigned int delta_list_number = extract_dlist_num(vi5, record->name);
 	uint64_t flush_chapter = vi5->flush_chapters[delta_list_number];
-	record->magic = volume_index_record_magic;
-	record->volume_index = volume_index;
-	record->mutex = NULL;
-	record->name = name;
-	record->zone_number =
-		get_delta_index_zone(&vi5->delta_index, delta_list_number);
 	const struct volume_index_zone *volume_index_zone =
 	  get_zone_for_record(record);
 
+	record->search_deferred = false;
 	int result;
 	if (flush_chapter < volume_index_zone->virtual_chapter_low) {
 		struct chapter_range range;
@@ -1132,7 +1286,7 @@ static int get_volume_index_record_005(struct volume_index *volume_index,
 		result = get_delta_index_entry(&vi5->delta_index,
 					       delta_list_number,
 					       address,
-					       name->name,
+					       record->name->name,
 					       false,
 					       &record->delta_entry);
 	}
@@ -1151,6 +1305,65 @@ static int get_volume_index_record_005(struct volume_index *volume_index,
 	return UDS_SUCCESS;
 }
 
+/**********************************************************************/
+/**
+ * Find the volume index record associated with a block name
+ *
+ * This is always the first routine to be called when dealing with a delta
+ * volume index entry.  The fields of the record parameter should be
+ * examined to determine the state of the record:
+ *
+ * If is_found is false, then we did not find an entry for the block
+ * name.  Information is saved in the volume_index_record so that
+ * put_volume_index_record() will insert an entry for that block name at
+ * the proper place.
+ *
+ * If is_found is true, then we did find an entry for the block name.
+ * Information is saved in the volume_index_record so that the "chapter"
+ * and "is_collision" fields reflect the entry found.
+ * Calls to remove_volume_index_record() will remove the entry, calls to
+ * set_volume_index_record_chapter() can modify the entry, and calls to
+ * put_volume_index_record() can insert a collision record with this
+ * entry.
+ *
+ * @param volume_index  The volume index to search
+ * @param name          The chunk name
+ * @param record        Set to the info about the record searched for
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int get_volume_index_record_005(struct volume_index *volume_index,
+				       const struct uds_chunk_name *name,
+				       struct volume_index_record *record)
+{
+	struct volume_index5 *vi5 =
+		container_of(volume_index, struct volume_index5, common);
+	unsigned int delta_list_number = extract_dlist_num(vi5, name);
+	record->magic = volume_index_record_magic;
+	record->volume_index = volume_index;
+	record->mutex = NULL;
+	record->name = name;
+	record->zone_number =
+		get_delta_index_zone(&vi5->delta_index, delta_list_number);
+	const struct volume_index_zone *volume_index_zone =
+	  get_zone_for_record(record);
+
+	if (volume_index_zone->filter_valid &&
+	    !bloom_filter_may_contain(volume_index_zone->filter,
+				      get_filter_key(delta_list_number,
+						     extract_address(vi5,
+								     name)))) {
+		// The name is certainly not in the index.  Leave the search
+		// for the insertion point to put_volume_index_record().
+		record->search_deferred = true;
+		record->is_found = false;
+		record->is_collision = false;
+		return UDS_SUCCESS;
+	}
+
+	return search_volume_index_record(vi5, record);
+}
+
 /**********************************************************************/
 /**
  * Create a new record associated with a block name.
@@ -1163,9 +1376,9 @@ static int get_volume_index_record_005(struct volume_index *volume_index,
 int put_volume_index_record(struct volume_index_record *record,
 			    uint64_t virtual_chapter)
 {
-	const struct volume_index5 *vi5 = container_of(record->volume_index,
-						       struct volume_index5,
-						       common);
+	struct volume_index5 *vi5 = container_of(record->volume_index,
+						 struct volume_index5,
+						 common);
 	if (record->magic != volume_index_record_magic) {
 		return log_warning_strerror(UDS_BAD_STATE,
 					    "bad magic number in volume index record");
@@ -1179,6 +1392,25 @@ int put_volume_index_record(struct volume_index_record *record,
 					    volume_index_zone->virtual_chapter_low,
 					    volume_index_zone->virtual_chapter_high);
 	}
+	if (record->search_deferred) {
+		// Like get_volume_index_record(), the search may flush
+		// entries, so it must hold the mutex of a sampled index.
+		if (unlikely(record->mutex != NULL)) {
+			lock_mutex(record->mutex);
+		}
+		int result = search_volume_index_record(vi5, record);
+		if (unlikely(record->mutex != NULL)) {
+			unlock_mutex(record->mutex);
+		}
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+		result = ASSERT(!record->is_found,
+				"name rejected by the volume index filter is not in the index");
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
 	unsigned int address = extract_address(vi5, record->name);
 	if (unlikely(record->mutex != NULL)) {
 		lock_mutex(record->mutex);
@@ -1195,6 +1427,12 @@ int put_volume_index_record(struct volume_index_record *record,
 		record->virtual_chapter = virtual_chapter;
 		record->is_collision = record->delta_entry.is_collision;
 		record->is_found = true;
+		if (vi5->zones[record->zone_number].filter != NULL) {
+			add_to_bloom_filter(vi5->zones[record->zone_number].filter,
+					    get_filter_key(extract_dlist_num(vi5,
+									     record->name),
+							   address));
+		}
 		break;
 	case UDS_OVERFLOW:
 		log_ratelimit(log_warning_strerror,
@@ -1323,6 +1561,11 @@ static void get_volume_index_stats_005(const struct volume_index *volume_index,
 		(dis.memory_allocated + sizeof(struct volume_index5) +
 		 vi5->num_delta_lists * sizeof(uint64_t) +
 		 vi5->num_zones * sizeof(struct volume_index_zone));
+	unsigned int z;
+	for (z = 0; z < vi5->num_zones; z++) {
+		dense->memory_allocated +=
+			get_bloom_filter_memory_size(vi5->zones[z].filter);
+	}
 	dense->rebalance_time = dis.rebalance_time;
 	dense->rebalance_count = dis.rebalance_count;
 	dense->record_count = dis.record_count;
@@ -1331,10 +1574,27 @@ static void get_volume_index_stats_005(const struct volume_index *volume_index,
 	dense->overflow_count = dis.overflow_count;
 	dense->num_lists = dis.num_lists;
 	dense->early_flushes = 0;
-	unsigned int z;
 	for (z = 0; z < vi5->num_zones; z++) {
 		dense->early_flushes += vi5->zones[z].num_early_flushes;
 	}
+
+	// Size the memory the records would need if the delta coding were
+	// fitted to how many there are, with the same 6% of slack as
+	// compute_volume_index_parameters005() allows.
+	dense->list_memory =
+		get_delta_index_dlist_bits_allocated(&vi5->delta_index) /
+		CHAR_BIT;
+	unsigned long records = max(dis.record_count, 1L);
+	uint64_t address_span =
+		(uint64_t) vi5->num_delta_lists << vi5->address_bits;
+	unsigned int mean_delta =
+		min(max(address_span / records, (uint64_t) 1),
+		    (uint64_t) UINT_MAX);
+	size_t fitted_bits =
+		(get_delta_memory_size(records, mean_delta,
+				       vi5->chapter_bits) +
+		 (size_t) dis.collision_count * COLLISION_BITS);
+	dense->fitted_list_memory = fitted_bits / CHAR_BIT * 106 / 100;
 	memset(sparse, 0, sizeof(struct volume_index_stats));
 }
 
@@ -1365,6 +1625,7 @@ struct parameters005 {
 	size_t num_bits_per_chapter;   // Number of bits per chapter
 	size_t memory_size;            // Number of bytes of delta list memory
 	size_t target_free_size;       // Number of free bytes we desire
+	unsigned long num_entries;     // Number of entries expected
 };
 
 /**********************************************************************/
@@ -1452,6 +1713,7 @@ compute_volume_index_parameters005(const struct configuration *config,
 		params->num_chapters + invalid_chapters;
 	unsigned long entries_in_volume_index =
 		records_per_chapter * chapters_in_volume_index;
+	params->num_entries = entries_in_volume_index;
 	// Compute the mean delta
 	unsigned long address_span = params->num_delta_lists
 				     << params->address_bits;
@@ -1524,6 +1786,9 @@ int make_volume_index005(const struct configuration *config,
 	vi5->common.get_volume_index_record = get_volume_index_record_005;
 	vi5->common.get_volume_index_stats = get_volume_index_stats_005;
 	vi5->common.get_volume_index_zone = get_volume_index_zone_005;
+	vi5->common.get_volume_index_zone_count =
+		get_volume_index_zone_count_005;
+	vi5->common.get_volume_index_zone_map = get_volume_index_zone_map_005;
 	vi5->common.is_volume_index_sample = is_volume_index_sample_005;
 	vi5->common.is_restoring_volume_index_done =
 		is_restoring_volume_index_done_005;
@@ -1536,6 +1801,8 @@ int make_volume_index005(const struct configuration *config,
 		restore_delta_list_to_volume_index_005;
 	vi5->common.set_volume_index_open_chapter =
 		set_volume_index_open_chapter_005;
+	vi5->common.set_volume_index_restoring_base =
+		set_volume_index_restoring_base_005;
 	vi5->common.set_volume_index_tag = set_volume_index_tag_005;
 	vi5->common.set_volume_index_zone_open_chapter =
 		set_volume_index_zone_open_chapter_005;
@@ -1583,6 +1850,18 @@ int make_volume_index005(const struct configuration *config,
 				  &vi5->zones);
 	}
 
+	// An empty zone filter is valid, since the zone holds no entries.
+	unsigned int filter_bits = READ_ONCE(volume_index_filter_bits);
+	if (filter_bits > 0) {
+		unsigned int z;
+		for (z = 0; (z < num_zones) && (result == UDS_SUCCESS); z++) {
+			result = make_bloom_filter(params.num_entries / num_zones,
+						   filter_bits,
+						   &vi5->zones[z].filter);
+			vi5->zones[z].filter_valid = (result == UDS_SUCCESS);
+		}
+	}
+
 	if (result == UDS_SUCCESS) {
 		*volume_index = &vi5->common;
 	} else {
@@ -160,6 +160,24 @@ static void set_volume_index_tag_006(struct volume_index *volume_index
 {
 }
 
+/**********************************************************************/
+/**
+ * Set whether a volume index is restoring the base save of a differential
+ * save.
+ *
+ * @param volume_index    The volume index
+ * @param restoring_base  Whether the base save is being restored
+ **/
+static void
+set_volume_index_restoring_base_006(struct volume_index *volume_index,
+				    bool restoring_base)
+{
+	struct volume_index6 *vi6 =
+		container_of(volume_index, struct volume_index6, common);
+	set_volume_index_restoring_base(vi6->vi_non_hook, restoring_base);
+	set_volume_index_restoring_base(vi6->vi_hook, restoring_base);
+}
+
 /**********************************************************************/
 static int __must_check encode_volume_index_header(struct buffer *buffer,
 						   struct vi006_data *header)
@@ -186,13 +204,16 @@ static int __must_check encode_volume_index_header(struct buffer *buffer,
  * @param volume_index     The volume index
  * @param zone_number      The number of the zone to save
  * @param buffered_writer  The index state component being written
+ * @param differential     If true, save only the delta lists which have
+ *                         changed since the last full save
  *
  * @return UDS_SUCCESS on success, or an error code on failure
  **/
 static int
 start_saving_volume_index_006(const struct volume_index *volume_index,
 			      unsigned int zone_number,
-			      struct buffered_writer *buffered_writer)
+			      struct buffered_writer *buffered_writer,
+			      bool differential)
 {
 	const struct volume_index6 *vi6 =
 		const_container_of(volume_index, struct volume_index6, common);
@@ -221,13 +242,13 @@ start_saving_volume_index_006(const struct volume_index *volume_index,
 	}
 
 	result = start_saving_volume_index(vi6->vi_non_hook, zone_number,
-					   buffered_writer);
+					   buffered_writer, differential);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
 
 	result = start_saving_volume_index(vi6->vi_hook, zone_number,
-					   buffered_writer);
+					   buffered_writer, differential);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
@@ -382,8 +403,15 @@ start_restoring_volume_index_006(struct volume_index *volume_index,
 			return log_warning_strerror(UDS_CORRUPT_COMPONENT,
 						    "volume index file had bad magic number");
 		}
-		if (i == 0) {
-			vi6->sparse_sample_rate = header.sparse_sample_rate;
+		if ((i == 0) &&
+		    (vi6->sparse_sample_rate != header.sparse_sample_rate)) {
+			// The sample rate has been changed, so the volume
+			// index must be rebuilt from the chapters.
+			log_notice_strerror(UDS_CORRUPT_COMPONENT,
+					    "volume index was saved with sparse sample rate %u, not %u",
+					    header.sparse_sample_rate,
+					    vi6->sparse_sample_rate);
+			return UDS_CORRUPT_COMPONENT;
 		} else if (vi6->sparse_sample_rate !=
 			   header.sparse_sample_rate) {
 			log_warning_strerror(UDS_CORRUPT_COMPONENT,
@@ -530,6 +558,43 @@ get_volume_index_zone_006(const struct volume_index *volume_index,
 	return get_volume_index_zone(get_sub_index(volume_index, name), name);
 }
 
+/**********************************************************************/
+/**
+ * Get the number of zones of the volume index.
+ *
+ * @param volume_index  The volume index
+ *
+ * @return the number of zones
+ **/
+static unsigned int
+get_volume_index_zone_count_006(const struct volume_index *volume_index)
+{
+	const struct volume_index6 *vi6 =
+		const_container_of(volume_index, struct volume_index6, common);
+	return vi6->num_zones;
+}
+
+/**********************************************************************/
+/**
+ * Get the map of chunk names to zones of the volume index.
+ *
+ * @param volume_index  The volume index
+ * @param map           The zone map to fill
+ **/
+static void
+get_volume_index_zone_map_006(const struct volume_index *volume_index,
+			      struct uds_zone_map *map)
+{
+	const struct volume_index6 *vi6 =
+		const_container_of(volume_index, struct volume_index6, common);
+	struct uds_zone_map hook_map;
+	get_volume_index_zone_map(vi6->vi_non_hook, map);
+	get_volume_index_zone_map(vi6->vi_hook, &hook_map);
+	map->zone_count = vi6->num_zones;
+	map->sparse_sample_rate = vi6->sparse_sample_rate;
+	map->parts[1] = hook_map.parts[0];
+}
+
 /**********************************************************************/
 /**
  * Do a quick read-only lookup of the chunk name and return information
@@ -792,6 +857,9 @@ int make_volume_index006(const struct configuration *config,
 	vi6->common.get_volume_index_record = get_volume_index_record_006;
 	vi6->common.get_volume_index_stats = get_volume_index_stats_006;
 	vi6->common.get_volume_index_zone = get_volume_index_zone_006;
+	vi6->common.get_volume_index_zone_count =
+		get_volume_index_zone_count_006;
+	vi6->common.get_volume_index_zone_map = get_volume_index_zone_map_006;
 	vi6->common.is_volume_index_sample = is_volume_index_sample_006;
 	vi6->common.is_restoring_volume_index_done =
 		is_restoring_volume_index_done_006;
@@ -804,6 +872,8 @@ int make_volume_index006(const struct configuration *config,
 		restore_delta_list_to_volume_index_006;
 	vi6->common.set_volume_index_open_chapter =
 		set_volume_index_open_chapter_006;
+	vi6->common.set_volume_index_restoring_base =
+		set_volume_index_restoring_base_006;
 	vi6->common.set_volume_index_tag = set_volume_index_tag_006;
 	vi6->common.set_volume_index_zone_open_chapter =
 		set_volume_index_zone_open_chapter_006;
@@ -24,14 +24,27 @@
 #include "errors.h"
 #include "geometry.h"
 #include "indexComponent.h"
+#include "indexLayout.h"
+#include "indexState.h"
 #include "logger.h"
 #include "masterIndex005.h"
 #include "masterIndex006.h"
 #include "memoryAlloc.h"
+#include "numeric.h"
 #include "permassert.h"
+#include "threads.h"
 #include "uds.h"
 #include "zone.h"
 
+/*
+ * A zone of a differential save of the volume index starts with this magic
+ * number and the nonce of the full save it is based on, followed by a
+ * normal save of the zone holding only the delta lists which have changed
+ * since the full save.
+ */
+enum { DIFFERENTIAL_MAGIC_SIZE = 8 };
+static const char DIFFERENTIAL_MAGIC[] = "VID-0001";
+
 /**********************************************************************/
 static INLINE bool uses_sparse(const struct configuration *config)
 {
@@ -56,6 +69,9 @@ void get_volume_index_combined_stats(const struct volume_index *volume_index,
 	stats->overflow_count = dense.overflow_count + sparse.overflow_count;
 	stats->num_lists = dense.num_lists + sparse.num_lists;
 	stats->early_flushes = dense.early_flushes + sparse.early_flushes;
+	stats->list_memory = dense.list_memory + sparse.list_memory;
+	stats->fitted_list_memory =
+		dense.fitted_list_memory + sparse.fitted_list_memory;
 }
 
 /**********************************************************************/
@@ -92,6 +108,98 @@ int compute_volume_index_save_blocks(const struct configuration *config,
 	return UDS_SUCCESS;
 }
 
+/**
+ * Read the header which starts each zone of a differential save, if there
+ * is one.
+ *
+ * @param [in]  readers       The readers for the saved zones
+ * @param [in]  num_zones     The number of saved zones
+ * @param [out] differential  Set to true if the save is differential
+ * @param [out] base_nonce    The nonce of the base of a differential save
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int read_differential_header(struct buffered_reader **readers,
+				    unsigned int num_zones,
+				    bool *differential,
+				    uint64_t *base_nonce)
+{
+	unsigned int z;
+	for (z = 0; z < num_zones; ++z) {
+		bool zone_differential =
+			(verify_buffered_data(readers[z], DIFFERENTIAL_MAGIC,
+					      DIFFERENTIAL_MAGIC_SIZE) ==
+			 UDS_SUCCESS);
+		if ((z > 0) && (zone_differential != *differential)) {
+			return log_warning_strerror(UDS_CORRUPT_COMPONENT,
+						    "volume index zones mix full and differential saves");
+		}
+		*differential = zone_differential;
+		if (!zone_differential) {
+			continue;
+		}
+
+		byte data[sizeof(uint64_t)];
+		int result = read_from_buffered_reader(readers[z], data,
+						       sizeof(data));
+		if (result != UDS_SUCCESS) {
+			return log_warning_strerror(result,
+						    "failed to read volume index base nonce");
+		}
+		uint64_t nonce = get_unaligned_le64(data);
+		if ((z > 0) && (nonce != *base_nonce)) {
+			return log_warning_strerror(UDS_CORRUPT_COMPONENT,
+						    "volume index zones have different base saves");
+		}
+		*base_nonce = nonce;
+	}
+	return UDS_SUCCESS;
+}
+
+/**
+ * Open the readers for the zones of the full save on which a differential
+ * save of the volume index is based.
+ *
+ * @param layout        The index layout
+ * @param base_nonce    The nonce of the full save
+ * @param num_zones     The number of zones in the differential save
+ * @param base_readers  The array to hold the readers
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int open_base_readers(struct index_layout *layout,
+			     uint64_t base_nonce,
+			     unsigned int num_zones,
+			     struct buffered_reader **base_readers)
+{
+	unsigned int base_zones, base_slot;
+	int result = find_index_save_slot(layout, base_nonce, &base_zones,
+					  &base_slot);
+	if (result != UDS_SUCCESS) {
+		return log_error_strerror(result,
+					  "cannot find the base of the volume index save");
+	}
+	if (base_zones != num_zones) {
+		return log_error_strerror(UDS_CORRUPT_COMPONENT,
+					  "base volume index save has %u zones instead of %u",
+					  base_zones,
+					  num_zones);
+	}
+
+	unsigned int z;
+	for (z = 0; z < num_zones; ++z) {
+		result = open_index_buffered_reader(layout, base_slot,
+						    RL_KIND_VOLUME_INDEX, z,
+						    &base_readers[z]);
+		if (result != UDS_SUCCESS) {
+			return log_error_strerror(result,
+						  "cannot read base volume index zone %u",
+						  z);
+		}
+	}
+	return UDS_SUCCESS;
+}
+
 /**********************************************************************/
 static int read_volume_index(struct read_portal *portal)
 {
@@ -115,7 +223,70 @@ static int read_volume_index(struct read_portal *portal)
 						  z);
 		}
 	}
-	return restore_volume_index(readers, num_zones, volume_index);
+
+	bool differential = false;
+	uint64_t base_nonce = 0;
+	int result = read_differential_header(readers, num_zones,
+					      &differential, &base_nonce);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	if (!differential) {
+		return restore_volume_index(readers, num_zones, volume_index);
+	}
+
+	struct buffered_reader *base_readers[MAX_ZONES] = { NULL, };
+	result = open_base_readers(portal->component->state->layout,
+				   base_nonce, num_zones, base_readers);
+	if (result == UDS_SUCCESS) {
+		result = restore_differential_volume_index(readers,
+							   base_readers,
+							   num_zones,
+							   volume_index);
+	}
+	for (z = 0; z < num_zones; ++z) {
+		free_buffered_reader(base_readers[z]);
+	}
+	return result;
+}
+
+/**
+ * Write the header which starts each zone of a differential save, if the
+ * save in progress is differential.
+ *
+ * @param component  The volume index component
+ * @param writer     The writer for the zone
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int write_differential_header(struct index_component *component,
+				     struct buffered_writer *writer)
+{
+	struct index_state *state = component->state;
+	if (!state->differential) {
+		return UDS_SUCCESS;
+	}
+
+	uint64_t base_nonce;
+	int result = get_index_save_nonce(state->layout, state->base_slot,
+					  &base_nonce);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	result = write_to_buffered_writer(writer, DIFFERENTIAL_MAGIC,
+					  DIFFERENTIAL_MAGIC_SIZE);
+	if (result != UDS_SUCCESS) {
+		return log_warning_strerror(result,
+					    "failed to write volume index differential header");
+	}
+	byte data[sizeof(uint64_t)];
+	put_unaligned_le64(base_nonce, data);
+	result = write_to_buffered_writer(writer, data, sizeof(data));
+	if (result != UDS_SUCCESS) {
+		return log_warning_strerror(result,
+					    "failed to write volume index base nonce");
+	}
+	return UDS_SUCCESS;
 }
 
 /**********************************************************************/
@@ -132,7 +303,12 @@ static int write_volume_index(struct index_component *component,
 
 	switch (command) {
 	case IWC_START:
-		result = start_saving_volume_index(volume_index, zone, writer);
+		result = write_differential_header(component, writer);
+		if (result == UDS_SUCCESS) {
+			result = start_saving_volume_index(volume_index, zone,
+							   writer,
+							   component->state->differential);
+		}
 		is_complete = result != UDS_SUCCESS;
 		break;
 	case IWC_CONTINUE:
@@ -176,12 +352,199 @@ static const struct index_component_info VOLUME_INDEX_INFO_DATA = {
 const struct index_component_info *const VOLUME_INDEX_INFO =
 	&VOLUME_INDEX_INFO_DATA;
 
+/**
+ * The state of one thread restoring the delta lists saved by one zone.
+ **/
+struct zone_restorer {
+	struct volume_index *volume_index;
+	struct buffered_reader *reader;
+	byte *dl_data;
+	int result;
+	struct thread *thread;
+};
+
+/**
+ * Restore all of the delta lists from one saved zone.
+ *
+ * @param volume_index  The volume index to restore into
+ * @param reader        The reader for the saved zone
+ * @param dl_data       A buffer of DELTA_LIST_MAX_BYTE_COUNT bytes
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int restore_zone_delta_lists(struct volume_index *volume_index,
+				    struct buffered_reader *reader,
+				    byte dl_data[DELTA_LIST_MAX_BYTE_COUNT])
+{
+	for (;;) {
+		struct delta_list_save_info dlsi;
+		int result = read_saved_delta_list(&dlsi, dl_data, reader);
+		if (result == UDS_END_OF_FILE) {
+			return UDS_SUCCESS;
+		} else if (result != UDS_SUCCESS) {
+			return result;
+		}
+		result = restore_delta_list_to_volume_index(volume_index,
+							    &dlsi,
+							    dl_data);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
+}
+
+/**********************************************************************/
+static void restore_zone_thread(void *arg)
+{
+	struct zone_restorer *restorer = arg;
+	restorer->result = restore_zone_delta_lists(restorer->volume_index,
+						    restorer->reader,
+						    restorer->dl_data);
+}
+
+/**
+ * Restore the delta lists from every saved zone at once, with one thread
+ * per zone.  This is only safe if each saved zone holds exactly the delta
+ * lists of one zone of the volume index, since the threads must not share
+ * any delta memory.
+ *
+ * @param buffered_readers  The readers for the saved zones
+ * @param num_readers       The number of readers
+ * @param volume_index      The volume index to restore into
+ * @param dl_data           A buffer of DELTA_LIST_MAX_BYTE_COUNT bytes for
+ *                          each reader
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int restore_zones_in_parallel(struct buffered_reader **buffered_readers,
+				     unsigned int num_readers,
+				     struct volume_index *volume_index,
+				     byte *dl_data)
+{
+	struct zone_restorer *restorers;
+	unsigned int started = 0;
+	unsigned int z;
+	int result = ALLOCATE(num_readers, struct zone_restorer, __func__,
+			      &restorers);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	for (z = 0; z < num_readers; z++) {
+		char name[16];
+		restorers[z] = (struct zone_restorer) {
+			.volume_index = volume_index,
+			.reader = buffered_readers[z],
+			.dl_data = dl_data + z * DELTA_LIST_MAX_BYTE_COUNT,
+			.result = UDS_SUCCESS,
+		};
+		snprintf(name, sizeof(name), "restorer%u", z);
+		result = create_thread(restore_zone_thread, &restorers[z],
+				       name, &restorers[z].thread);
+		if (result != UDS_SUCCESS) {
+			break;
+		}
+		started++;
+	}
+
+	for (z = 0; z < started; z++) {
+		join_threads(restorers[z].thread);
+		if (result == UDS_SUCCESS) {
+			result = restorers[z].result;
+		}
+	}
+	FREE(restorers);
+	return result;
+}
+
+/**
+ * Restore the delta lists from every saved zone.
+ *
+ * @param buffered_readers  The readers for the saved zones
+ * @param num_readers       The number of readers
+ * @param volume_index      The volume index to restore into
+ * @param dl_data           A buffer of DELTA_LIST_MAX_BYTE_COUNT bytes for
+ *                          each reader
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int restore_delta_lists(struct buffered_reader **buffered_readers,
+			       unsigned int num_readers,
+			       struct volume_index *volume_index,
+			       byte *dl_data)
+{
+	// When the saved zones match the zones of the volume index, each
+	// saved zone can be restored by its own thread.
+	if ((num_readers > 1) &&
+	    (num_readers == get_volume_index_zone_count(volume_index))) {
+		return restore_zones_in_parallel(buffered_readers,
+						 num_readers,
+						 volume_index,
+						 dl_data);
+	}
+
+	int result = UDS_SUCCESS;
+	unsigned int z;
+	for (z = 0; (z < num_readers) && (result == UDS_SUCCESS); z++) {
+		result = restore_zone_delta_lists(volume_index,
+						  buffered_readers[z],
+						  dl_data);
+	}
+	return result;
+}
+
+/**
+ * Restore the delta lists of the full save on which a differential save is
+ * based, skipping the lists which were restored from the differential save.
+ * The base zones have the same layout as the differential zones, so the
+ * headers which precede their delta lists have the same sizes.
+ *
+ * @param base_readers  The readers for the zones of the base save
+ * @param header_sizes  The size of the headers of each zone
+ * @param num_readers   The number of readers
+ * @param volume_index  The volume index to restore into
+ * @param dl_data       A buffer of DELTA_LIST_MAX_BYTE_COUNT bytes for each
+ *                      reader
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int restore_base_delta_lists(struct buffered_reader **base_readers,
+				    const off_t *header_sizes,
+				    unsigned int num_readers,
+				    struct volume_index *volume_index,
+				    byte *dl_data)
+{
+	unsigned int z;
+	for (z = 0; z < num_readers; z++) {
+		int result = seek_buffered_reader(base_readers[z],
+						  header_sizes[z]);
+		if (result != UDS_SUCCESS) {
+			return log_warning_strerror(result,
+						    "cannot skip base volume index header");
+		}
+	}
+
+	set_volume_index_restoring_base(volume_index, true);
+	int result = restore_delta_lists(base_readers, num_readers,
+					 volume_index, dl_data);
+	set_volume_index_restoring_base(volume_index, false);
+	return result;
+}
+
 /**********************************************************************/
 static int restore_volume_index_body(struct buffered_reader **buffered_readers,
+				     struct buffered_reader **base_readers,
 				     unsigned int num_readers,
 				     struct volume_index *volume_index,
-				     byte dl_data[DELTA_LIST_MAX_BYTE_COUNT])
+				     byte *dl_data)
 {
+	off_t header_sizes[MAX_ZONES];
+	unsigned int z;
+	for (z = 0; z < num_readers; z++) {
+		header_sizes[z] =
+			get_buffered_reader_offset(buffered_readers[z]);
+	}
+
 	// Start by reading the "header" section of the stream
 	int result = start_restoring_volume_index(volume_index,
 						  buffered_readers,
@@ -189,28 +552,23 @@ static int restore_volume_index_body(struct buffered_reader **buffered_readers,
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
-	// Loop to read the delta lists, stopping when they have all been
-	// processed.
-	unsigned int z;
 	for (z = 0; z < num_readers; z++) {
-		for (;;) {
-			struct delta_list_save_info dlsi;
-			result = read_saved_delta_list(&dlsi, dl_data,
-						       buffered_readers[z]);
-			if (result == UDS_END_OF_FILE) {
-				break;
-			} else if (result != UDS_SUCCESS) {
-				abort_restoring_volume_index(volume_index);
-				return result;
-			}
-			result = restore_delta_list_to_volume_index(volume_index,
-								    &dlsi,
-								    dl_data);
-			if (result != UDS_SUCCESS) {
-				abort_restoring_volume_index(volume_index);
-				return result;
-			}
-		}
+		header_sizes[z] =
+			(get_buffered_reader_offset(buffered_readers[z]) -
+			 header_sizes[z]);
+	}
+
+	// Read the delta lists, stopping when they have all been processed.
+	result = restore_delta_lists(buffered_readers, num_readers,
+				     volume_index, dl_data);
+	if ((result == UDS_SUCCESS) && (base_readers != NULL)) {
+		result = restore_base_delta_lists(base_readers, header_sizes,
+						  num_readers, volume_index,
+						  dl_data);
+	}
+	if (result != UDS_SUCCESS) {
+		abort_restoring_volume_index(volume_index);
+		return result;
 	}
 	if (!is_restoring_volume_index_done(volume_index)) {
 		abort_restoring_volume_index(volume_index);
@@ -220,19 +578,52 @@ static int restore_volume_index_body(struct buffered_reader **buffered_readers,
 	return UDS_SUCCESS;
 }
 
-/**********************************************************************/
-int restore_volume_index(struct buffered_reader **buffered_readers,
-			 unsigned int num_readers,
-			 struct volume_index *volume_index)
+/**
+ * Restore a volume index, from either a full save or a differential save
+ * and the full save it is based on.
+ *
+ * @param buffered_readers  The readers for the saved zones
+ * @param base_readers      The readers for the zones of the base save, or
+ *                          NULL if the save is full
+ * @param num_readers       The number of readers
+ * @param volume_index      The volume index to restore into
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int restore_volume_index_from(struct buffered_reader **buffered_readers,
+				     struct buffered_reader **base_readers,
+				     unsigned int num_readers,
+				     struct volume_index *volume_index)
 {
 	byte *dl_data;
-	int result =
-		ALLOCATE(DELTA_LIST_MAX_BYTE_COUNT, byte, __func__, &dl_data);
+	int result = ALLOCATE(num_readers * DELTA_LIST_MAX_BYTE_COUNT,
+			      byte,
+			      __func__,
+			      &dl_data);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
-	result = restore_volume_index_body(buffered_readers, num_readers,
-					   volume_index, dl_data);
+	result = restore_volume_index_body(buffered_readers, base_readers,
+					   num_readers, volume_index, dl_data);
 	FREE(dl_data);
 	return result;
 }
+
+/**********************************************************************/
+int restore_volume_index(struct buffered_reader **buffered_readers,
+			 unsigned int num_readers,
+			 struct volume_index *volume_index)
+{
+	return restore_volume_index_from(buffered_readers, NULL, num_readers,
+					 volume_index);
+}
+
+/**********************************************************************/
+int restore_differential_volume_index(struct buffered_reader **buffered_readers,
+				      struct buffered_reader **base_readers,
+				      unsigned int num_readers,
+				      struct volume_index *volume_index)
+{
+	return restore_volume_index_from(buffered_readers, base_readers,
+					 num_readers, volume_index);
+}
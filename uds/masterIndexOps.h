@@ -31,6 +31,7 @@
 
 extern const struct index_component_info *const VOLUME_INDEX_INFO;
 extern unsigned int min_volume_index_delta_lists;
+extern unsigned int volume_index_filter_bits;
 
 struct volume_index_stats {
 	size_t memory_allocated;    // Number of bytes allocated
@@ -42,6 +43,10 @@ struct volume_index_stats {
 	long overflow_count;        // The number of UDS_OVERFLOWs detected
 	unsigned int num_lists;     // The number of delta lists
 	long early_flushes;         // Number of early flushes
+	size_t list_memory;         // Bytes of delta list memory
+	size_t fitted_list_memory;  // Bytes of delta list memory which would
+				    // hold the records with the mean delta
+				    // they actually have
 };
 
 /*
@@ -87,6 +92,9 @@ struct volume_index_record {
 					       // entry; used only for a
 					       // sampled index; otherwise is
 					       // NULL
+	bool search_deferred;                  // The name was rejected by the
+					       // zone filter, so the delta
+					       // list has not been searched
 	const struct uds_chunk_name *name;     // The blockname to which this
 					       // record refers
 	struct delta_index_entry delta_entry;  // The delta index entry for
@@ -109,6 +117,9 @@ struct volume_index {
 				       struct volume_index_stats *sparse);
 	unsigned int (*get_volume_index_zone)(const struct volume_index *volume_index,
 					      const struct uds_chunk_name *name);
+	unsigned int (*get_volume_index_zone_count)(const struct volume_index *volume_index);
+	void (*get_volume_index_zone_map)(const struct volume_index *volume_index,
+					  struct uds_zone_map *map);
 	bool (*is_volume_index_sample)(const struct volume_index *volume_index,
 				       const struct uds_chunk_name *name);
 	bool (*is_restoring_volume_index_done)(const struct volume_index *volume_index);
@@ -125,6 +136,8 @@ struct volume_index {
 						  const byte data[DELTA_LIST_MAX_BYTE_COUNT]);
 	void (*set_volume_index_open_chapter)(struct volume_index *volume_index,
 					      uint64_t virtual_chapter);
+	void (*set_volume_index_restoring_base)(struct volume_index *volume_index,
+						bool restoring_base);
 	void (*set_volume_index_tag)(struct volume_index *volume_index,
 				     byte tag);
 	void (*set_volume_index_zone_open_chapter)(struct volume_index *volume_index,
@@ -135,7 +148,8 @@ struct volume_index {
 					    int num_readers);
 	int (*start_saving_volume_index)(const struct volume_index *volume_index,
 					 unsigned int zone_number,
-					 struct buffered_writer *buffered_writer);
+					 struct buffered_writer *buffered_writer,
+					 bool differential);
 };
 
 /**
@@ -190,6 +204,23 @@ int __must_check restore_volume_index(struct buffered_reader **readers,
 				      unsigned int num_readers,
 				      struct volume_index *volume_index);
 
+/**
+ * Restore a volume index from a differential save and the full save on
+ * which it is based.
+ *
+ * @param readers       The readers for the differential save
+ * @param base_readers  The readers for the base save
+ * @param num_readers   The number of readers of each save
+ * @param volume_index  The volume index
+ *
+ * @return UDS_SUCCESS on success, or an error code on failure
+ **/
+int __must_check
+restore_differential_volume_index(struct buffered_reader **readers,
+				  struct buffered_reader **base_readers,
+				  unsigned int num_readers,
+				  struct volume_index *volume_index);
+
 /**
  * Abort restoring a volume index from an input stream.
  *
@@ -322,6 +353,32 @@ get_volume_index_zone(const struct volume_index *volume_index,
 	return volume_index->get_volume_index_zone(volume_index, name);
 }
 
+/**
+ * Get the number of zones of a volume index.
+ *
+ * @param volume_index  The volume index
+ *
+ * @return the number of zones
+ **/
+static INLINE unsigned int
+get_volume_index_zone_count(const struct volume_index *volume_index)
+{
+	return volume_index->get_volume_index_zone_count(volume_index);
+}
+
+/**
+ * Get the map of chunk names to zones of the volume index.
+ *
+ * @param volume_index  The volume index
+ * @param map           The zone map to fill
+ **/
+static INLINE void
+get_volume_index_zone_map(const struct volume_index *volume_index,
+			  struct uds_zone_map *map)
+{
+	volume_index->get_volume_index_zone_map(volume_index, map);
+}
+
 /**
  * Determine whether a given chunk name is a hook.
  *
@@ -490,6 +547,22 @@ int __must_check
 set_volume_index_record_chapter(struct volume_index_record *record,
 				uint64_t virtual_chapter);
 
+/**
+ * Set whether a volume index is restoring the base save of a differential
+ * save, in which case the delta lists already restored from the
+ * differential save are skipped.
+ *
+ * @param volume_index    The volume index
+ * @param restoring_base  Whether the base save is being restored
+ **/
+static INLINE void
+set_volume_index_restoring_base(struct volume_index *volume_index,
+				bool restoring_base)
+{
+	volume_index->set_volume_index_restoring_base(volume_index,
+						      restoring_base);
+}
+
 /**
  * Set the tag value used when saving and/or restoring a volume index.
  *
@@ -546,17 +619,21 @@ start_restoring_volume_index(struct volume_index *volume_index,
  * @param volume_index     The volume index
  * @param zone_number      The number of the zone to save
  * @param buffered_writer  The index state component being written
+ * @param differential     If true, save only the delta lists which have
+ *                         changed since the last full save
  *
  * @return UDS_SUCCESS on success, or an error code on failure
  **/
 static INLINE int
 start_saving_volume_index(const struct volume_index *volume_index,
 			  unsigned int zone_number,
-			  struct buffered_writer *buffered_writer)
+			  struct buffered_writer *buffered_writer,
+			  bool differential)
 {
 	return volume_index->start_saving_volume_index(volume_index,
 						       zone_number,
-						       buffered_writer);
+						       buffered_writer,
+						       differential);
 }
 
 #endif /* MASTERINDEXOPS_H */
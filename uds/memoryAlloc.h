@@ -32,6 +32,24 @@
 #include <linux/io.h> // for PAGE_SIZE
 #include "threadRegistry.h"
 
+/**
+ * The subsystems whose memory use is accounted separately, so that the share
+ * of memory each one takes can be reported. Untagged memory is only counted
+ * in the totals.
+ **/
+enum memory_tag {
+	MEMORY_TAG_NONE = 0,
+	MEMORY_TAG_VDO_PAGE_CACHE,
+	MEMORY_TAG_REF_COUNTS,
+	MEMORY_TAG_SLAB_JOURNALS,
+	MEMORY_TAG_DATA_VIOS,
+	MEMORY_TAG_HASH_LOCKS,
+	MEMORY_TAG_DELTA_MEMORY,
+	MEMORY_TAG_UDS_PAGE_CACHE,
+	MEMORY_TAG_SPARSE_CACHE,
+	MEMORY_TAG_COUNT,
+};
+
 /**
  * Allocate storage based on memory size and  alignment, logging an error if
  * the allocation fails. The memory will be zeroed.
@@ -48,6 +66,43 @@ int __must_check allocate_memory(size_t size,
 				 const char *what,
 				 void *ptr);
 
+/**
+ * Allocate storage as allocate_memory() does, accounting for it under a
+ * memory tag. The memory must be freed with free_tagged_memory() and the same
+ * tag.
+ *
+ * @param size   The size of an object
+ * @param align  The required alignment
+ * @param tag    The tag under which to account for the memory
+ * @param what   What is being allocated (for error logging)
+ * @param ptr    A pointer to hold the allocated memory
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check allocate_tagged_memory(size_t size,
+					size_t align,
+					enum memory_tag tag,
+					const char *what,
+					void *ptr);
+
+/**
+ * Allocate a large block of storage, preferring memory mapped with huge
+ * pages so that random accesses to it miss the TLB less often.  If huge
+ * pages cannot be used, this is the same as allocate_memory().  The memory
+ * will be zeroed, and must be freed with free_memory().
+ *
+ * @param size  The size of the block
+ * @param tag   The tag under which to account for the memory
+ * @param what  What is being allocated (for error logging)
+ * @param ptr   A pointer to hold the allocated memory
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check allocate_huge_memory(size_t size,
+				      enum memory_tag tag,
+				      const char *what,
+				      void *ptr);
+
 /**
  * Free storage
  *
@@ -55,6 +110,14 @@ int __must_check allocate_memory(size_t size,
  **/
 void free_memory(void *ptr);
 
+/**
+ * Free storage allocated under a memory tag.
+ *
+ * @param ptr  The memory to be freed
+ * @param tag  The tag under which the memory was allocated
+ **/
+void free_tagged_memory(void *ptr, enum memory_tag tag);
+
 /**
  * Allocate storage based on element counts, sizes, and alignment.
  *
@@ -75,6 +138,7 @@ void free_memory(void *ptr);
  * @param size    The size of an object
  * @param extra   The number of additional bytes to allocate
  * @param align   The required alignment
+ * @param tag     The tag under which to account for the memory
  * @param what    What is being allocated (for error logging)
  * @param ptr     A pointer to hold the allocated memory
  *
@@ -84,6 +148,7 @@ static INLINE int do_allocation(size_t count,
 				size_t size,
 				size_t extra,
 				size_t align,
+				enum memory_tag tag,
 				const char *what,
 				void *ptr)
 {
@@ -100,7 +165,7 @@ static INLINE int do_allocation(size_t count,
 		total_size = SIZE_MAX;
 	}
 
-	return allocate_memory(total_size, align, what, ptr);
+	return allocate_tagged_memory(total_size, align, tag, what, ptr);
 }
 
 /**
@@ -135,7 +200,48 @@ int __must_check reallocate_memory(void *ptr,
  * @return UDS_SUCCESS or an error code
  **/
 #define ALLOCATE(COUNT, TYPE, WHAT, PTR) \
-	do_allocation(COUNT, sizeof(TYPE), 0, __alignof__(TYPE), WHAT, PTR)
+	ALLOCATE_TAGGED(COUNT, TYPE, MEMORY_TAG_NONE, WHAT, PTR)
+
+/**
+ * Allocate one or more elements of the indicated type, accounting for them
+ * under a memory tag, logging an error if the allocation fails. The memory
+ * will be zeroed, and must be freed with FREE_TAGGED().
+ *
+ * @param COUNT  The number of objects to allocate
+ * @param TYPE   The type of objects to allocate.  This type determines the
+ *               alignment of the allocated memory.
+ * @param TAG    The tag under which to account for the memory
+ * @param WHAT   What is being allocated (for error logging)
+ * @param PTR    A pointer to hold the allocated memory
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+#define ALLOCATE_TAGGED(COUNT, TYPE, TAG, WHAT, PTR) \
+	do_allocation(COUNT, sizeof(TYPE), 0, __alignof__(TYPE), TAG, WHAT, PTR)
+
+/**
+ * Allocate one or more elements of the indicated type, preferring memory
+ * mapped with huge pages, logging an error if the allocation fails. The
+ * memory will be zeroed.
+ *
+ * @param COUNT  The number of objects to allocate
+ * @param TYPE   The type of objects to allocate
+ * @param TAG    The tag under which to account for the memory
+ * @param WHAT   What is being allocated (for error logging)
+ * @param PTR    A pointer to hold the allocated memory
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+#define ALLOCATE_HUGE(COUNT, TYPE, TAG, WHAT, PTR)                      \
+	__extension__({                                                 \
+		size_t _count = (COUNT);                                \
+		allocate_huge_memory(((_count > (SIZE_MAX / sizeof(TYPE))) \
+				      ? SIZE_MAX                        \
+				      : _count * sizeof(TYPE)),         \
+				     TAG,                               \
+				     WHAT,                              \
+				     PTR);                              \
+	})
 
 /**
  * Allocate one object of an indicated type, followed by one or more
@@ -151,7 +257,27 @@ int __must_check reallocate_memory(void *ptr,
  *
  * @return UDS_SUCCESS or an error code
  **/
-#define ALLOCATE_EXTENDED(TYPE1, COUNT, TYPE2, WHAT, PTR)                \
+#define ALLOCATE_EXTENDED(TYPE1, COUNT, TYPE2, WHAT, PTR)        \
+	ALLOCATE_EXTENDED_TAGGED(TYPE1, COUNT, TYPE2, MEMORY_TAG_NONE, \
+				 WHAT, PTR)
+
+/**
+ * Allocate one object of an indicated type, followed by one or more
+ * elements of a second type, accounting for them under a memory tag, logging
+ * an error if the allocation fails. The memory will be zeroed, and must be
+ * freed with FREE_TAGGED().
+ *
+ * @param TYPE1  The type of the primary object to allocate.  This type
+ *               determines the alignment of the allocated memory.
+ * @param COUNT  The number of objects to allocate
+ * @param TYPE2  The type of array objects to allocate
+ * @param TAG    The tag under which to account for the memory
+ * @param WHAT   What is being allocated (for error logging)
+ * @param PTR    A pointer to hold the allocated memory
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+#define ALLOCATE_EXTENDED_TAGGED(TYPE1, COUNT, TYPE2, TAG, WHAT, PTR)    \
 	__extension__({                                                  \
 		TYPE1 **_ptr = (PTR);                                    \
 		STATIC_ASSERT(__alignof__(TYPE1) >= __alignof__(TYPE2)); \
@@ -159,6 +285,7 @@ int __must_check reallocate_memory(void *ptr,
 					    sizeof(TYPE2),               \
 					    sizeof(TYPE1),               \
 					    __alignof__(TYPE1),          \
+					    TAG,                         \
 					    WHAT,                        \
 					    _ptr);                       \
 		_result;                                                 \
@@ -176,8 +303,9 @@ int __must_check reallocate_memory(void *ptr,
  *
  * @return UDS_SUCCESS or an error code
  **/
-#define ALLOCATE_IO_ALIGNED(COUNT, TYPE, WHAT, PTR) \
-	do_allocation(COUNT, sizeof(TYPE), 0, PAGE_SIZE, WHAT, PTR)
+#define ALLOCATE_IO_ALIGNED(COUNT, TYPE, WHAT, PTR)                      \
+	do_allocation(COUNT, sizeof(TYPE), 0, PAGE_SIZE, MEMORY_TAG_NONE, \
+		      WHAT, PTR)
 
 /**
  * Free memory allocated with ALLOCATE().
@@ -189,6 +317,17 @@ static INLINE void FREE(void *ptr)
 	free_memory(ptr);
 }
 
+/**
+ * Free memory allocated with ALLOCATE_TAGGED() or ALLOCATE_EXTENDED_TAGGED().
+ *
+ * @param ptr  Pointer to the memory to free
+ * @param tag  The tag under which the memory was allocated
+ **/
+static INLINE void FREE_TAGGED(void *ptr, enum memory_tag tag)
+{
+	free_tagged_memory(ptr, tag);
+}
+
 /**
  * Allocate memory starting on a cache line boundary, logging an error if the
  * allocation fails. The memory will be zeroed.
@@ -312,6 +451,31 @@ void unregister_allocating_thread(void);
  **/
 void get_memory_stats(uint64_t *bytes_used, uint64_t *peak_bytes_used);
 
+/**
+ * Get the number of tracked bytes which are mapped with huge pages.
+ *
+ * @return The number of bytes in huge page mappings
+ **/
+uint64_t get_huge_memory_bytes(void);
+
+/**
+ * Account for memory which a subsystem obtained from the kernel without going
+ * through this allocator, such as whole pages.
+ *
+ * @param tag    The tag under which to account for the memory
+ * @param bytes  The number of bytes obtained, or negative if released
+ **/
+void adjust_tagged_memory_bytes(enum memory_tag tag, int64_t bytes);
+
+/**
+ * Get the number of bytes currently accounted under a memory tag.
+ *
+ * @param tag  The tag to query
+ *
+ * @return The number of bytes in use under the tag
+ **/
+uint64_t get_tagged_memory_bytes(enum memory_tag tag);
+
 /**
  * Report stats on any allocated memory that we're tracking.
  *
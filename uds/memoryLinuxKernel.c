@@ -86,6 +86,8 @@ void unregister_allocating_thread(void)
 struct vmalloc_block_info {
 	void *ptr;
 	size_t size;
+	bool huge;
+	enum memory_tag tag;
 	struct vmalloc_block_info *next;
 };
 
@@ -95,10 +97,24 @@ static struct {
 	size_t kmalloc_bytes;
 	size_t vmalloc_blocks;
 	size_t vmalloc_bytes;
+	size_t huge_bytes;
 	size_t peak_bytes;
+	int64_t tagged_bytes[MEMORY_TAG_COUNT];
 	struct vmalloc_block_info *vmalloc_list;
 } memory_stats __cacheline_aligned;
 
+static const char *const memory_tag_names[] = {
+	[MEMORY_TAG_NONE] = "untagged",
+	[MEMORY_TAG_VDO_PAGE_CACHE] = "VDO page cache",
+	[MEMORY_TAG_REF_COUNTS] = "reference counts",
+	[MEMORY_TAG_SLAB_JOURNALS] = "slab journals",
+	[MEMORY_TAG_DATA_VIOS] = "data_vio pool",
+	[MEMORY_TAG_HASH_LOCKS] = "hash locks",
+	[MEMORY_TAG_DELTA_MEMORY] = "delta index memory",
+	[MEMORY_TAG_UDS_PAGE_CACHE] = "index page cache",
+	[MEMORY_TAG_SPARSE_CACHE] = "sparse cache",
+};
+
 /**********************************************************************/
 static void update_peak_usage(void)
 {
@@ -110,23 +126,25 @@ static void update_peak_usage(void)
 }
 
 /**********************************************************************/
-static void add_kmalloc_block(size_t size)
+static void add_kmalloc_block(size_t size, enum memory_tag tag)
 {
 	unsigned long flags;
 	spin_lock_irqsave(&memory_stats.lock, flags);
 	memory_stats.kmalloc_blocks++;
 	memory_stats.kmalloc_bytes += size;
+	memory_stats.tagged_bytes[tag] += size;
 	update_peak_usage();
 	spin_unlock_irqrestore(&memory_stats.lock, flags);
 }
 
 /**********************************************************************/
-static void remove_kmalloc_block(size_t size)
+static void remove_kmalloc_block(size_t size, enum memory_tag tag)
 {
 	unsigned long flags;
 	spin_lock_irqsave(&memory_stats.lock, flags);
 	memory_stats.kmalloc_blocks--;
 	memory_stats.kmalloc_bytes -= size;
+	memory_stats.tagged_bytes[tag] -= size;
 	spin_unlock_irqrestore(&memory_stats.lock, flags);
 }
 
@@ -139,6 +157,10 @@ static void add_vmalloc_block(struct vmalloc_block_info *block)
 	memory_stats.vmalloc_list = block;
 	memory_stats.vmalloc_blocks++;
 	memory_stats.vmalloc_bytes += block->size;
+	memory_stats.tagged_bytes[block->tag] += block->size;
+	if (block->huge) {
+		memory_stats.huge_bytes += block->size;
+	}
 	update_peak_usage();
 	spin_unlock_irqrestore(&memory_stats.lock, flags);
 }
@@ -156,6 +178,10 @@ static void remove_vmalloc_block(void *ptr)
 			*block_ptr = block->next;
 			memory_stats.vmalloc_blocks--;
 			memory_stats.vmalloc_bytes -= block->size;
+			memory_stats.tagged_bytes[block->tag] -= block->size;
+			if (block->huge) {
+				memory_stats.huge_bytes -= block->size;
+			}
 			break;
 		}
 	}
@@ -210,6 +236,16 @@ static INLINE bool use_kmalloc(size_t size)
 
 /**********************************************************************/
 int allocate_memory(size_t size, size_t align, const char *what, void *ptr)
+{
+	return allocate_tagged_memory(size, align, MEMORY_TAG_NONE, what, ptr);
+}
+
+/**********************************************************************/
+int allocate_tagged_memory(size_t size,
+			   size_t align,
+			   enum memory_tag tag,
+			   const char *what,
+			   void *ptr)
 {
 	/*
 	 * The __GFP_RETRY_MAYFAIL means: The VM implementation will retry
@@ -264,7 +300,7 @@ int allocate_memory(size_t size, size_t align, const char *what, void *ptr)
 			p = kmalloc(size, gfp_flags);
 		}
 		if (p != NULL) {
-			add_kmalloc_block(ksize(p));
+			add_kmalloc_block(ksize(p), tag);
 		}
 	} else {
 		struct vmalloc_block_info *block;
@@ -321,6 +357,7 @@ int allocate_memory(size_t size, size_t align, const char *what, void *ptr)
 			} else {
 				block->ptr = p;
 				block->size = PAGE_ALIGN(size);
+				block->tag = tag;
 				add_vmalloc_block(block);
 			}
 		}
@@ -342,26 +379,84 @@ int allocate_memory(size_t size, size_t align, const char *what, void *ptr)
 	return UDS_SUCCESS;
 }
 
+/**********************************************************************/
+int allocate_huge_memory(size_t size,
+			 enum memory_tag tag,
+			 const char *what,
+			 void *ptr)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	const gfp_t gfp_flags = GFP_KERNEL | __GFP_ZERO | __GFP_RETRY_MAYFAIL;
+	struct vmalloc_block_info *block;
+	unsigned int noio_flags;
+	bool allocations_restricted;
+	void *p;
+
+	// Smaller blocks could not use a huge mapping anyway.
+	if ((ptr == NULL) || (size < PMD_SIZE)) {
+		return allocate_tagged_memory(size, 0, tag, what, ptr);
+	}
+
+	if (ALLOCATE(1, struct vmalloc_block_info, __func__, &block) !=
+	    UDS_SUCCESS) {
+		return allocate_tagged_memory(size, 0, tag, what, ptr);
+	}
+
+	allocations_restricted = !allocations_allowed();
+	if (allocations_restricted) {
+		noio_flags = memalloc_noio_save();
+	}
+	p = vmalloc_huge(size, gfp_flags | __GFP_NOWARN);
+	if (allocations_restricted) {
+		memalloc_noio_restore(noio_flags);
+	}
+
+	if (p == NULL) {
+		// Let the normal path retry and report the failure.
+		FREE(block);
+		return allocate_tagged_memory(size, 0, tag, what, ptr);
+	}
+
+	block->ptr = p;
+	block->size = PAGE_ALIGN(size);
+	block->huge = is_vm_area_hugepages(p);
+	block->tag = tag;
+	add_vmalloc_block(block);
+	*((void **) ptr) = p;
+	return UDS_SUCCESS;
+#else
+	// Huge vmalloc mappings are not available to modules before 5.18.
+	return allocate_tagged_memory(size, 0, tag, what, ptr);
+#endif
+}
+
 /**********************************************************************/
 void *allocate_memory_nowait(size_t size,
 			     const char *what __attribute__((unused)))
 {
 	void *p = kmalloc(size, GFP_NOWAIT | __GFP_ZERO);
 	if (p != NULL) {
-		add_kmalloc_block(ksize(p));
+		add_kmalloc_block(ksize(p), MEMORY_TAG_NONE);
 	}
 	return p;
 }
 
 /**********************************************************************/
 void free_memory(void *ptr)
+{
+	free_tagged_memory(ptr, MEMORY_TAG_NONE);
+}
+
+/**********************************************************************/
+void free_tagged_memory(void *ptr, enum memory_tag tag)
 {
 	if (ptr != NULL) {
 		if (is_vmalloc_addr(ptr)) {
+			// The block records its own tag.
 			remove_vmalloc_block(ptr);
 			vfree(ptr);
 		} else {
-			remove_kmalloc_block(ksize(ptr));
+			remove_kmalloc_block(ksize(ptr), tag);
 			kfree(ptr);
 		}
 	}
@@ -432,28 +527,69 @@ void get_memory_stats(uint64_t *bytes_used, uint64_t *peak_bytes_used)
 	spin_unlock_irqrestore(&memory_stats.lock, flags);
 }
 
+/**********************************************************************/
+uint64_t get_huge_memory_bytes(void)
+{
+	unsigned long flags;
+	uint64_t huge_bytes;
+	spin_lock_irqsave(&memory_stats.lock, flags);
+	huge_bytes = memory_stats.huge_bytes;
+	spin_unlock_irqrestore(&memory_stats.lock, flags);
+	return huge_bytes;
+}
+
+/**********************************************************************/
+void adjust_tagged_memory_bytes(enum memory_tag tag, int64_t bytes)
+{
+	unsigned long flags;
+	spin_lock_irqsave(&memory_stats.lock, flags);
+	memory_stats.tagged_bytes[tag] += bytes;
+	spin_unlock_irqrestore(&memory_stats.lock, flags);
+}
+
+/**********************************************************************/
+uint64_t get_tagged_memory_bytes(enum memory_tag tag)
+{
+	unsigned long flags;
+	int64_t bytes;
+	spin_lock_irqsave(&memory_stats.lock, flags);
+	bytes = memory_stats.tagged_bytes[tag];
+	spin_unlock_irqrestore(&memory_stats.lock, flags);
+	return max_t(int64_t, bytes, 0);
+}
+
 /**********************************************************************/
 void report_memory_usage()
 {
 	unsigned long flags;
 	uint64_t kmalloc_blocks, kmalloc_bytes, vmalloc_blocks, vmalloc_bytes;
-	uint64_t peak_usage, total_bytes;
+	uint64_t huge_bytes, peak_usage, total_bytes;
+	int64_t tagged_bytes[MEMORY_TAG_COUNT];
+	enum memory_tag tag;
 	spin_lock_irqsave(&memory_stats.lock, flags);
 	kmalloc_blocks = memory_stats.kmalloc_blocks;
 	kmalloc_bytes = memory_stats.kmalloc_bytes;
 	vmalloc_blocks = memory_stats.vmalloc_blocks;
 	vmalloc_bytes = memory_stats.vmalloc_bytes;
+	huge_bytes = memory_stats.huge_bytes;
 	peak_usage = memory_stats.peak_bytes;
+	memcpy(tagged_bytes, memory_stats.tagged_bytes, sizeof(tagged_bytes));
 	spin_unlock_irqrestore(&memory_stats.lock, flags);
 	total_bytes = kmalloc_bytes + vmalloc_bytes;
 	log_info("current module memory tracking (actual allocation sizes, not requested):");
 	log_info("  %llu bytes in %llu kmalloc blocks",
 		 kmalloc_bytes,
 		 kmalloc_blocks);
-	log_info("  %llu bytes in %llu vmalloc blocks",
+	log_info("  %llu bytes in %llu vmalloc blocks (%llu bytes on huge pages)",
 		 vmalloc_bytes,
-		 vmalloc_blocks);
+		 vmalloc_blocks,
+		 huge_bytes);
 	log_info("  total %llu bytes, peak usage %llu bytes",
 		 total_bytes,
 		 peak_usage);
+	for (tag = MEMORY_TAG_NONE + 1; tag < MEMORY_TAG_COUNT; tag++) {
+		log_info("  %lld bytes for %s",
+			 tagged_bytes[tag],
+			 memory_tag_names[tag]);
+	}
 }
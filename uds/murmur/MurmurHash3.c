@@ -297,43 +297,19 @@ void MurmurHash3_x86_128 ( const void * key, const int len,
 
 //-----------------------------------------------------------------------------
 
-void MurmurHash3_x64_128 ( const void * key, const int len,
-                           const uint32_t seed, void * out )
-{
-  const uint8_t * data = (const uint8_t*)key;
-  const int nblocks = len / 16;
-
-  uint64_t h1 = seed;
-  uint64_t h2 = seed;
+// Tail and finalization of the x64 128-bit hash, shared by the single and
+// multi-buffer versions so that they always produce the same results.
 
+static FORCE_INLINE void finish_x64_128 ( const uint8_t * tail, const int len,
+                                          uint64_t h1, uint64_t h2,
+                                          void * out )
+{
   uint64_t c1 = BIG_CONSTANT(0x87c37b91114253d5);
   uint64_t c2 = BIG_CONSTANT(0x4cf5ad432745937f);
 
-  //----------
-  // body
-
-  const uint64_t * blocks = (const uint64_t *)(data);
-
-  int i;
-  for(i = 0; i < nblocks; i++)
-  {
-    uint64_t k1 = getblock64(blocks,i*2+0);
-    uint64_t k2 = getblock64(blocks,i*2+1);
-
-    k1 *= c1; k1  = ROTL64(k1,31); k1 *= c2; h1 ^= k1;
-
-    h1 = ROTL64(h1,27); h1 += h2; h1 = h1*5+0x52dce729;
-
-    k2 *= c2; k2  = ROTL64(k2,33); k2 *= c1; h2 ^= k2;
-
-    h2 = ROTL64(h2,31); h2 += h1; h2 = h2*5+0x38495ab5;
-  }
-
   //----------
   // tail
 
-  const uint8_t * tail = (const uint8_t*)(data + nblocks*16);
-
   uint64_t k1 = 0;
   uint64_t k2 = 0;
 
@@ -377,3 +353,101 @@ void MurmurHash3_x64_128 ( const void * key, const int len,
   putblock64((uint64_t*)out, 0, h1);
   putblock64((uint64_t*)out, 1, h2);
 }
+
+//-----------------------------------------------------------------------------
+
+void MurmurHash3_x64_128 ( const void * key, const int len,
+                           const uint32_t seed, void * out )
+{
+  const uint8_t * data = (const uint8_t*)key;
+  const int nblocks = len / 16;
+
+  uint64_t h1 = seed;
+  uint64_t h2 = seed;
+
+  uint64_t c1 = BIG_CONSTANT(0x87c37b91114253d5);
+  uint64_t c2 = BIG_CONSTANT(0x4cf5ad432745937f);
+
+  //----------
+  // body
+
+  const uint64_t * blocks = (const uint64_t *)(data);
+
+  int i;
+  for(i = 0; i < nblocks; i++)
+  {
+    uint64_t k1 = getblock64(blocks,i*2+0);
+    uint64_t k2 = getblock64(blocks,i*2+1);
+
+    k1 *= c1; k1  = ROTL64(k1,31); k1 *= c2; h1 ^= k1;
+
+    h1 = ROTL64(h1,27); h1 += h2; h1 = h1*5+0x52dce729;
+
+    k2 *= c2; k2  = ROTL64(k2,33); k2 *= c1; h2 ^= k2;
+
+    h2 = ROTL64(h2,31); h2 += h1; h2 = h2*5+0x38495ab5;
+  }
+
+  finish_x64_128(data + nblocks*16, len, h1, h2, out);
+}
+
+//-----------------------------------------------------------------------------
+// Hash MURMUR_X64_128_LANES keys of the same length at once. Each key's
+// multiply-rotate chain depends only on its own state, so interleaving the
+// lanes lets the chains of different keys overlap in the pipeline. The lane
+// state is kept in scalars so the compiler can hold it all in registers. The
+// results are identical to hashing each key with MurmurHash3_x64_128.
+
+#define X64_128_ROUND(blocks, i, h1, h2)                                \
+  {                                                                     \
+    uint64_t k1 = getblock64(blocks,i*2+0);                             \
+    uint64_t k2 = getblock64(blocks,i*2+1);                             \
+                                                                        \
+    k1 *= c1; k1  = ROTL64(k1,31); k1 *= c2; h1 ^= k1;                  \
+                                                                        \
+    h1 = ROTL64(h1,27); h1 += h2; h1 = h1*5+0x52dce729;                 \
+                                                                        \
+    k2 *= c2; k2  = ROTL64(k2,33); k2 *= c1; h2 ^= k2;                  \
+                                                                        \
+    h2 = ROTL64(h2,31); h2 += h1; h2 = h2*5+0x38495ab5;                 \
+  }
+
+void MurmurHash3_x64_128_multi ( const void * const keys[], const int len,
+                                 const uint32_t seed, void * const outs[] )
+{
+  const int nblocks = len / 16;
+
+  const uint64_t * blocks0 = (const uint64_t *)keys[0];
+  const uint64_t * blocks1 = (const uint64_t *)keys[1];
+  const uint64_t * blocks2 = (const uint64_t *)keys[2];
+  const uint64_t * blocks3 = (const uint64_t *)keys[3];
+
+  uint64_t h1_0 = seed, h2_0 = seed;
+  uint64_t h1_1 = seed, h2_1 = seed;
+  uint64_t h1_2 = seed, h2_2 = seed;
+  uint64_t h1_3 = seed, h2_3 = seed;
+
+  uint64_t c1 = BIG_CONSTANT(0x87c37b91114253d5);
+  uint64_t c2 = BIG_CONSTANT(0x4cf5ad432745937f);
+
+  //----------
+  // body
+
+  int i;
+  for(i = 0; i < nblocks; i++)
+  {
+    X64_128_ROUND(blocks0, i, h1_0, h2_0);
+    X64_128_ROUND(blocks1, i, h1_1, h2_1);
+    X64_128_ROUND(blocks2, i, h1_2, h2_2);
+    X64_128_ROUND(blocks3, i, h1_3, h2_3);
+  }
+
+  finish_x64_128((const uint8_t*)keys[0] + nblocks*16, len, h1_0, h2_0,
+                 outs[0]);
+  finish_x64_128((const uint8_t*)keys[1] + nblocks*16, len, h1_1, h2_1,
+                 outs[1]);
+  finish_x64_128((const uint8_t*)keys[2] + nblocks*16, len, h1_2, h2_2,
+                 outs[2]);
+  finish_x64_128((const uint8_t*)keys[3] + nblocks*16, len, h1_3, h2_3,
+                 outs[3]);
+}
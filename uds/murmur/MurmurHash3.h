@@ -23,6 +23,13 @@ void MurmurHash3_x86_128 ( const void * key, int len, uint32_t seed, void * out
 
 void MurmurHash3_x64_128 ( const void * key, int len, uint32_t seed, void * out );
 
+// MurmurHash3_x64_128_multi hashes exactly this many keys of the same
+// length at once, producing the same results as MurmurHash3_x64_128
+#define MURMUR_X64_128_LANES 4
+
+void MurmurHash3_x64_128_multi ( const void * const keys[], int len,
+                                 uint32_t seed, void * const outs[] );
+
 //-----------------------------------------------------------------------------
 
 #endif // _MURMURHASH3_H_
@@ -25,6 +25,7 @@
 #include "logger.h"
 #include "memoryAlloc.h"
 #include "numeric.h"
+#include "threads.h"
 #include "zone.h"
 
 static int read_open_chapters(struct read_portal *portal);
@@ -141,12 +142,11 @@ static int fill_delta_chapter_index(struct open_chapter_zone **chapter_zones,
 }
 
 /**********************************************************************/
-int close_open_chapter(struct open_chapter_zone **chapter_zones,
-		       unsigned int zone_count,
-		       struct volume *volume,
-		       struct open_chapter_index *chapter_index,
-		       struct uds_chunk_record *collated_records,
-		       uint64_t virtual_chapter_number)
+int collate_open_chapter(struct open_chapter_zone **chapter_zones,
+			 unsigned int zone_count,
+			 struct open_chapter_index *chapter_index,
+			 struct uds_chunk_record *collated_records,
+			 uint64_t virtual_chapter_number)
 {
 	// Empty the delta chapter index, and prepare it for the new virtual
 	// chapter.
@@ -154,8 +154,21 @@ int close_open_chapter(struct open_chapter_zone **chapter_zones,
 
 	// Map each non-deleted record name to its record page number in the
 	// delta chapter index.
-	int result = fill_delta_chapter_index(chapter_zones, zone_count,
-					      chapter_index, collated_records);
+	return fill_delta_chapter_index(chapter_zones, zone_count,
+					chapter_index, collated_records);
+}
+
+/**********************************************************************/
+int close_open_chapter(struct open_chapter_zone **chapter_zones,
+		       unsigned int zone_count,
+		       struct volume *volume,
+		       struct open_chapter_index *chapter_index,
+		       struct uds_chunk_record *collated_records,
+		       uint64_t virtual_chapter_number)
+{
+	int result = collate_open_chapter(chapter_zones, zone_count,
+					  chapter_index, collated_records,
+					  virtual_chapter_number);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
@@ -281,6 +294,133 @@ static int read_version(struct buffered_reader *reader, const byte **version)
 	return UDS_SUCCESS;
 }
 
+/**
+ * The state of one thread loading the saved records which belong to one zone
+ * of the open chapter.
+ **/
+struct open_chapter_loader {
+	/** The open chapter zone to fill */
+	struct open_chapter_zone *open_chapter;
+	/** The saved records of every zone */
+	const struct uds_chunk_record *records;
+	/** The zone to which each saved record belongs */
+	const byte *record_zones;
+	/** The number of saved records */
+	uint32_t record_count;
+	/** The zone this loader fills */
+	unsigned int zone;
+	/** The thread running this loader */
+	struct thread *thread;
+	/** The result of loading the zone */
+	int result;
+};
+
+/**
+ * Add the saved records which belong to one zone to that zone's open
+ * chapter, in the order they were saved.
+ *
+ * @param loader  The loader for the zone
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int load_open_chapter_zone(struct open_chapter_loader *loader)
+{
+	uint32_t i;
+	for (i = 0; i < loader->record_count; i++) {
+		if (loader->record_zones[i] != loader->zone) {
+			continue;
+		}
+
+		// Add records until the open chapter zone almost runs out of
+		// space. The chapter can't be closed here, so don't add the
+		// last record.
+		const struct uds_chunk_record *record = &loader->records[i];
+		unsigned int remaining;
+		int result = put_open_chapter(loader->open_chapter,
+					      &record->name,
+					      &record->data,
+					      &remaining);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+		if (remaining <= 1) {
+			break;
+		}
+	}
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+static void load_open_chapter_zone_thread(void *arg)
+{
+	struct open_chapter_loader *loader = arg;
+	loader->result = load_open_chapter_zone(loader);
+}
+
+/**
+ * Fill the zones of the open chapter from the saved records. When there is
+ * more than one zone, each zone is filled by its own thread, since the zones
+ * share nothing.
+ *
+ * @param index         The index whose open chapter is being loaded
+ * @param records       The saved records
+ * @param record_zones  The zone to which each saved record belongs
+ * @param record_count  The number of saved records
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int fill_open_chapter_zones(struct index *index,
+				   const struct uds_chunk_record *records,
+				   const byte *record_zones,
+				   uint32_t record_count)
+{
+	struct open_chapter_loader *loaders;
+	unsigned int started = 0;
+	unsigned int z;
+	int result = ALLOCATE(index->zone_count, struct open_chapter_loader,
+			      __func__, &loaders);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	for (z = 0; z < index->zone_count; z++) {
+		loaders[z] = (struct open_chapter_loader) {
+			.open_chapter = index->zones[z]->open_chapter,
+			.records = records,
+			.record_zones = record_zones,
+			.record_count = record_count,
+			.zone = z,
+			.result = UDS_SUCCESS,
+		};
+	}
+
+	if (index->zone_count == 1) {
+		result = load_open_chapter_zone(&loaders[0]);
+		FREE(loaders);
+		return result;
+	}
+
+	for (z = 0; z < index->zone_count; z++) {
+		char name[16];
+		snprintf(name, sizeof(name), "loadOC%u", z);
+		result = create_thread(load_open_chapter_zone_thread,
+				       &loaders[z], name, &loaders[z].thread);
+		if (result != UDS_SUCCESS) {
+			break;
+		}
+		started++;
+	}
+
+	for (z = 0; z < started; z++) {
+		join_threads(loaders[z].thread);
+		if (result == UDS_SUCCESS) {
+			result = loaders[z].result;
+		}
+	}
+	FREE(loaders);
+	return result;
+}
+
 /**********************************************************************/
 static int load_version20(struct index *index, struct buffered_reader *reader)
 {
@@ -291,46 +431,50 @@ static int load_version20(struct index *index, struct buffered_reader *reader)
 		return result;
 	}
 	uint32_t num_records = get_unaligned_le32(num_records_data);
+	if (num_records > index->volume->geometry->records_per_chapter) {
+		return log_error_strerror(UDS_CORRUPT_COMPONENT,
+					  "saved open chapter has %u records",
+					  num_records);
+	}
+	if (num_records == 0) {
+		return UDS_SUCCESS;
+	}
 
-	// Keep track of which zones cannot accept any more records.
-	bool full_flags[MAX_ZONES] = {
-		false,
-	};
-
-	// Assign records to the correct zones.
-	struct uds_chunk_record record;
-	uint32_t records;
-	for (records = 0; records < num_records; records++) {
-		result = read_from_buffered_reader(reader, &record,
-						   sizeof(struct uds_chunk_record));
-		if (result != UDS_SUCCESS) {
-			return result;
-		}
+	// Read all of the records at once, and work out which zone each
+	// record belongs to before filling the zones.
+	struct uds_chunk_record *records;
+	result = ALLOCATE(num_records, struct uds_chunk_record,
+			  "saved open chapter records", &records);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	byte *record_zones;
+	result = ALLOCATE(num_records, byte, "saved open chapter zones",
+			  &record_zones);
+	if (result != UDS_SUCCESS) {
+		FREE(records);
+		return result;
+	}
 
-		unsigned int zone = 0;
-		if (index->zone_count > 1) {
-			// A read-only index has no volume index, but it also
-			// has only one zone.
-			zone = get_volume_index_zone(index->volume_index,
-						     &record.name);
-		}
-		// Add records until the open chapter zone almost runs out of
-		// space. The chapter can't be closed here, so don't add the
-		// last record.
-		if (!full_flags[zone]) {
-			unsigned int remaining;
-			result = put_open_chapter(index->zones[zone]->open_chapter,
-						  &record.name,
-						  &record.data,
-						  &remaining);
-			full_flags[zone] = (remaining <= 1);
-			if (result != UDS_SUCCESS) {
-				return result;
-			}
+	result = read_from_buffered_reader(reader, records,
+					   num_records *
+					   	sizeof(struct uds_chunk_record));
+	if (result == UDS_SUCCESS) {
+		// A read-only index has no volume index, but it also has only
+		// one zone, and the zones were allocated zeroed.
+		uint32_t i;
+		for (i = 0; (index->zone_count > 1) && (i < num_records); i++) {
+			record_zones[i] =
+				get_volume_index_zone(index->volume_index,
+						      &records[i].name);
 		}
+		result = fill_open_chapter_zones(index, records, record_zones,
+						 num_records);
 	}
 
-	return UDS_SUCCESS;
+	FREE(record_zones);
+	FREE(records);
+	return result;
 }
 
 /**********************************************************************/
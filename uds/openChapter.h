@@ -46,6 +46,25 @@ extern const struct index_component_info OPEN_CHAPTER_INFO;
  * zones at load time.
  **/
 
+/**
+ * Collate the records of the zones of the open chapter and build its
+ * chapter index, without writing anything to disk.
+ *
+ * @param chapter_zones          The zones of the chapter to close
+ * @param zone_count             The number of zones
+ * @param chapter_index          The open_chapter_index to fill
+ * @param collated_records       The array to hold the collated records
+ * @param virtual_chapter_number The virtual chapter number of the open chapter
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check
+collate_open_chapter(struct open_chapter_zone **chapter_zones,
+		     unsigned int zone_count,
+		     struct open_chapter_index *chapter_index,
+		     struct uds_chunk_record *collated_records,
+		     uint64_t virtual_chapter_number);
+
 /**
  * Close the open chapter and write it to disk.
  *
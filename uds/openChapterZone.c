@@ -40,6 +40,20 @@ static INLINE size_t slots_size(size_t slot_count)
 	return (sizeof(struct open_chapter_zone_slot) * slot_count);
 }
 
+/**
+ * Compute the tag to store in a hash slot for a chunk name. The tag comes
+ * from the high byte of the chapter index bytes, which the hash slot number
+ * (taken from the low bits) does not depend on.
+ *
+ * @param name  the chunk name
+ *
+ * @return the slot tag for the name
+ **/
+static INLINE unsigned int name_to_slot_tag(const struct uds_chunk_name *name)
+{
+	return name->name[CHAPTER_INDEX_BYTES_OFFSET];
+}
+
 /**
  * Round up to the first power of two greater than or equal
  * to the supplied number.
@@ -143,6 +157,7 @@ probe_chapter_slots(struct open_chapter_zone *open_chapter,
 {
 	unsigned int slots = open_chapter->slot_count;
 	unsigned int probe = name_to_hash_slot(name, slots);
+	unsigned int tag = name_to_slot_tag(name);
 	unsigned int first_slot = 0;
 
 	struct uds_chunk_record *record;
@@ -163,10 +178,16 @@ probe_chapter_slots(struct open_chapter_zone *open_chapter,
 
 		// If the name of the record referenced by the slot matches and
 		// has not been deleted, then we've found the requested name.
-		record = &open_chapter->records[record_number];
-		if ((memcmp(&record->name, name, UDS_CHUNK_NAME_SIZE) == 0) &&
-		    !open_chapter->slots[record_number].record_deleted) {
-			break;
+		// Checking the tag first avoids reading most records which
+		// cannot match.
+		if (open_chapter->slots[probe_slot].tag == tag) {
+			record = &open_chapter->records[record_number];
+			if ((memcmp(&record->name, name,
+				    UDS_CHUNK_NAME_SIZE) == 0) &&
+			    !open_chapter->slots[record_number]
+				     .record_deleted) {
+				break;
+			}
 		}
 
 		// Quadratic probing: advance the probe by 1, 2, 3, etc. and
@@ -231,6 +252,7 @@ int put_open_chapter(struct open_chapter_zone *open_chapter,
 
 	unsigned int record_number = ++open_chapter->size;
 	open_chapter->slots[slot].record_number = record_number;
+	open_chapter->slots[slot].tag = name_to_slot_tag(name);
 	record = &open_chapter->records[record_number];
 	record->name = *name;
 	record->data = *metadata;
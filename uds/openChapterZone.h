@@ -54,12 +54,18 @@
  * flags, indexed by record number. This overlay is possible because the
  * number of hash slots always exceeds the number of records, and is done
  * simply to save on memory.
+ *
+ * <p>Each hash slot also holds a one byte tag taken from the name of the
+ * record it references. A probe compares the tag before reading the record,
+ * so a probe past a colliding slot usually costs no access to the records
+ * array, and a search generally touches only one record, the match.
  **/
 
 enum {
 	OPEN_CHAPTER_RECORD_NUMBER_BITS = 23,
 	OPEN_CHAPTER_MAX_RECORD_NUMBER =
-	       (1 << OPEN_CHAPTER_RECORD_NUMBER_BITS) - 1
+	       (1 << OPEN_CHAPTER_RECORD_NUMBER_BITS) - 1,
+	OPEN_CHAPTER_SLOT_TAG_BITS = 8
 };
 
 struct open_chapter_zone_slot {
@@ -67,6 +73,8 @@ struct open_chapter_zone_slot {
 	unsigned int record_number : OPEN_CHAPTER_RECORD_NUMBER_BITS;
 	/** If true, the record at the index of this hash slot was deleted */
 	bool record_deleted : 1;
+	/** The tag of the name of the record addressed by this hash slot */
+	unsigned int tag : OPEN_CHAPTER_SLOT_TAG_BITS;
 } __packed;
 
 struct open_chapter_zone {
@@ -37,6 +37,24 @@
 #include "threads.h"
 #include "zone.h"
 
+unsigned int page_cache_chapters = 0;
+
+/**
+ * Get the cache entry at a position in a cache.
+ *
+ * @param cache  the cache
+ * @param index  the position of the entry, which must be allocated
+ *
+ * @return the cache entry
+ **/
+static INLINE struct cached_page *get_cache_entry(struct page_cache *cache,
+						  unsigned int index)
+{
+	struct cached_page *block =
+		READ_ONCE(cache->blocks[index >> VOLUME_CACHE_BLOCK_SHIFT]);
+	return &block[index & (VOLUME_CACHE_BLOCK_ENTRIES - 1)];
+}
+
 /**********************************************************************/
 int assert_page_in_cache(struct page_cache *cache, struct cached_page *page)
 {
@@ -50,7 +68,7 @@ int assert_page_in_cache(struct page_cache *cache, struct cached_page *page)
 
 	uint16_t page_index = cache->index[page->cp_physical_page];
 	return ASSERT((page_index < cache->num_cache_entries) &&
-			      (&cache->cache[page_index] == page),
+			      (get_cache_entry(cache, page_index) == page),
 		      "page is at expected location in cache");
 }
 
@@ -72,6 +90,7 @@ static void clear_cache_page(struct page_cache *cache,
 {
 	page->cp_physical_page = cache->num_index_entries;
 	WRITE_ONCE(page->cp_last_used, 0);
+	WRITE_ONCE(page->cp_protected, false);
 }
 
 /**
@@ -116,7 +135,7 @@ static int __must_check get_page_no_stats(struct page_cache *cache,
 	uint16_t index = index_value & ~VOLUME_CACHE_QUEUED_FLAG;
 
 	if (!queued && (index < cache->num_cache_entries)) {
-		*page_ptr = &cache->cache[index];
+		*page_ptr = get_cache_entry(cache, index);
 		/*
 		 * We have acquired access to the cached page, but
 		 * unless we hold the readThreadsMutex, we need a read
@@ -263,10 +282,131 @@ int find_invalidate_and_make_least_recent(struct page_cache *cache,
 	// Move the cached page to the least recently used end of the list
 	// so it will be replaced before any page with valid data.
 	WRITE_ONCE(page->cp_last_used, 0);
+	WRITE_ONCE(page->cp_protected, false);
 
 	return UDS_SUCCESS;
 }
 
+/**
+ * Get the number of entries a cache should have.
+ *
+ * @param cache  the cache
+ *
+ * @return the number of entries for the current page_cache_chapters
+ **/
+static unsigned int get_target_cache_entries(const struct page_cache *cache)
+{
+	unsigned int pages_per_chapter =
+		cache->geometry->record_pages_per_chapter;
+	unsigned int chapters = READ_ONCE(page_cache_chapters);
+	if (chapters == 0) {
+		return cache->configured_entries;
+	}
+	return (min(chapters, VOLUME_CACHE_MAX_ENTRIES / pages_per_chapter)
+		* pages_per_chapter);
+}
+
+/**
+ * Allocate and initialize enough blocks of cache entries for a cache to hold
+ * a given number of entries. We hold the readThreadsMutex, or are
+ * initializing the cache.
+ *
+ * @param cache    the cache
+ * @param entries  the number of entries needed
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int __must_check grow_page_cache(struct page_cache *cache,
+					unsigned int entries)
+{
+	while (cache->allocated_entries < entries) {
+		unsigned int first = cache->allocated_entries;
+		struct cached_page *block;
+		int result = ALLOCATE_TAGGED(VOLUME_CACHE_BLOCK_ENTRIES,
+					     struct cached_page,
+					     MEMORY_TAG_UDS_PAGE_CACHE,
+					     "page cache block",
+					     &block);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+
+		unsigned int i;
+		for (i = 0; i < VOLUME_CACHE_BLOCK_ENTRIES; i++) {
+			struct cached_page *page = &block[i];
+			// initialize_volume_page() can not actually fail.
+			result = initialize_volume_page(cache->geometry,
+							&page->cp_page_data);
+			if (result != UDS_SUCCESS) {
+				FREE_TAGGED(block, MEMORY_TAG_UDS_PAGE_CACHE);
+				return result;
+			}
+			page->cp_cache_index = first + i;
+			clear_cache_page(cache, page);
+		}
+
+		// Readers which do not hold the mutex find the new entries
+		// through allocated_entries.
+		WRITE_ONCE(cache->blocks[first >> VOLUME_CACHE_BLOCK_SHIFT],
+			   block);
+		smp_store_release(&cache->allocated_entries,
+				  first + VOLUME_CACHE_BLOCK_ENTRIES);
+	}
+	return UDS_SUCCESS;
+}
+
+/**
+ * Grow or shrink a cache to the size set by page_cache_chapters. A cache
+ * grows by allocating more entries. It shrinks by no longer choosing victims
+ * from the entries beyond its new size, and releasing the pages they hold;
+ * the entries themselves are kept since threads which do not hold the mutex
+ * may still be looking at them. An entry with a read pending is trimmed once
+ * the read is done.
+ *
+ * @param cache  the cache
+ **/
+static void resize_page_cache(struct page_cache *cache)
+{
+	// We hold the readThreadsMutex.
+	unsigned int entries = get_target_cache_entries(cache);
+	if ((entries == cache->active_entries) && !cache->trim_pending) {
+		return;
+	}
+
+	int result = grow_page_cache(cache, entries);
+	if (result != UDS_SUCCESS) {
+		log_warning_strerror(result,
+				     "cannot grow page cache to %u entries",
+				     entries);
+		entries = cache->allocated_entries;
+	}
+	if (entries < cache->active_entries) {
+		cache->trim_pending = true;
+	}
+	WRITE_ONCE(cache->active_entries, entries);
+	if (!cache->trim_pending) {
+		return;
+	}
+
+	cache->trim_pending = false;
+	unsigned int i;
+	for (i = entries; i < cache->allocated_entries; i++) {
+		struct cached_page *page = get_cache_entry(cache, i);
+		if (page->cp_read_pending) {
+			cache->trim_pending = true;
+			continue;
+		}
+
+		result = invalidate_page_in_cache(cache, page,
+						  INVALIDATION_EVICT);
+		if (result != UDS_SUCCESS) {
+			cache->trim_pending = true;
+			continue;
+		}
+		release_volume_page(&page->cp_page_data);
+	}
+}
+
 /**********************************************************************/
 static int __must_check initialize_page_cache(struct page_cache *cache,
 					      const struct geometry *geometry,
@@ -276,7 +416,8 @@ static int __must_check initialize_page_cache(struct page_cache *cache,
 {
 	cache->geometry = geometry;
 	cache->num_index_entries = geometry->pages_per_volume + 1;
-	cache->num_cache_entries =
+	cache->num_cache_entries = VOLUME_CACHE_MAX_ENTRIES;
+	cache->configured_entries =
 		chapters_in_cache * geometry->record_pages_per_chapter;
 	cache->read_queue_max_size = read_queue_max_size;
 	cache->zone_count = zone_count;
@@ -298,17 +439,18 @@ static int __must_check initialize_page_cache(struct page_cache *cache,
 		return result;
 	}
 
-	result = ASSERT((cache->num_cache_entries <= VOLUME_CACHE_MAX_ENTRIES),
+	result = ASSERT((cache->configured_entries <= VOLUME_CACHE_MAX_ENTRIES),
 			"requested cache size, %u, within limit %u",
-			cache->num_cache_entries,
+			cache->configured_entries,
 			VOLUME_CACHE_MAX_ENTRIES);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
 
-	result = ALLOCATE(cache->num_index_entries,
-			  uint16_t,
-			  "page cache index",
+	result = ALLOCATE_TAGGED(cache->num_index_entries,
+				 uint16_t,
+				 MEMORY_TAG_UDS_PAGE_CACHE,
+				 "page cache index",
 			  &cache->index);
 	if (result != UDS_SUCCESS) {
 		return result;
@@ -320,24 +462,8 @@ static int __must_check initialize_page_cache(struct page_cache *cache,
 		cache->index[i] = cache->num_cache_entries;
 	}
 
-	result = ALLOCATE(cache->num_cache_entries,
-			  struct cached_page,
-			  "page cache cache",
-			  &cache->cache);
-	if (result != UDS_SUCCESS) {
-		return result;
-	}
-
-	for (i = 0; i < cache->num_cache_entries; i++) {
-		struct cached_page *page = &cache->cache[i];
-		result = initialize_volume_page(geometry, &page->cp_page_data);
-		if (result != UDS_SUCCESS) {
-			return result;
-		}
-		clear_cache_page(cache, page);
-	}
-
-	return UDS_SUCCESS;
+	cache->active_entries = get_target_cache_entries(cache);
+	return grow_page_cache(cache, cache->active_entries);
 }
 
 /**********************************************************************/
@@ -388,14 +514,14 @@ void free_page_cache(struct page_cache *cache)
 	if (cache == NULL) {
 		return;
 	}
-	if (cache->cache != NULL) {
-		unsigned int i;
-		for (i = 0; i < cache->num_cache_entries; i++) {
-			destroy_volume_page(&cache->cache[i].cp_page_data);
-		}
+	unsigned int i;
+	for (i = 0; i < cache->allocated_entries; i++) {
+		destroy_volume_page(&get_cache_entry(cache, i)->cp_page_data);
+	}
+	for (i = 0; i < VOLUME_CACHE_MAX_BLOCKS; i++) {
+		FREE_TAGGED(cache->blocks[i], MEMORY_TAG_UDS_PAGE_CACHE);
 	}
-	FREE(cache->index);
-	FREE(cache->cache);
+	FREE_TAGGED(cache->index, MEMORY_TAG_UDS_PAGE_CACHE);
 	FREE(cache->search_pending_counters);
 	FREE(cache->read_queue);
 	FREE(cache);
@@ -408,7 +534,7 @@ int invalidate_page_cache_for_chapter(struct page_cache *cache,
 				      enum invalidation_reason reason)
 {
 	// We hold the readThreadsMutex.
-	if ((cache == NULL) || (cache->cache == NULL)) {
+	if ((cache == NULL) || (cache->allocated_entries == 0)) {
 		return UDS_SUCCESS;
 	}
 
@@ -431,21 +557,98 @@ int invalidate_page_cache_for_chapter(struct page_cache *cache,
 	return UDS_SUCCESS;
 }
 
+static enum page_cache_policy page_cache_policy = PAGE_CACHE_POLICY_SLRU;
+
+static const char *const page_cache_policy_names[] = {
+	[PAGE_CACHE_POLICY_LRU] = "lru",
+	[PAGE_CACHE_POLICY_SLRU] = "slru",
+};
+
+/**********************************************************************/
+enum page_cache_policy get_page_cache_policy(void)
+{
+	return READ_ONCE(page_cache_policy);
+}
+
+/**********************************************************************/
+void set_page_cache_policy(enum page_cache_policy policy)
+{
+	WRITE_ONCE(page_cache_policy, policy);
+}
+
+/**********************************************************************/
+const char *get_page_cache_policy_name(enum page_cache_policy policy)
+{
+	if (policy >= COUNT_OF(page_cache_policy_names)) {
+		return "unknown";
+	}
+	return page_cache_policy_names[policy];
+}
+
+/**********************************************************************/
+int parse_page_cache_policy(const char *name,
+			    enum page_cache_policy *policy_ptr)
+{
+	unsigned int i;
+	for (i = 0; i < COUNT_OF(page_cache_policy_names); i++) {
+		if (strcmp(name, page_cache_policy_names[i]) == 0) {
+			*policy_ptr = i;
+			return UDS_SUCCESS;
+		}
+	}
+	return UDS_INVALID_ARGUMENT;
+}
+
+/**********************************************************************/
+void get_page_cache_counts(struct page_cache *cache,
+			   uint64_t *hits_ptr,
+			   uint64_t *misses_ptr)
+{
+	const struct cache_counts_by_page_type *counts =
+		&cache->counters.first_time;
+	*hits_ptr = (READ_ONCE(counts->index_page.hits) +
+		     READ_ONCE(counts->record_page.hits));
+	*misses_ptr = (READ_ONCE(counts->index_page.misses) +
+		       READ_ONCE(counts->index_page.queued) +
+		       READ_ONCE(counts->record_page.misses) +
+		       READ_ONCE(counts->record_page.queued));
+}
+
+/**
+ * Stamp a page with the current value of the cache clock.
+ *
+ * @param cache  the cache
+ * @param page   the page
+ **/
+static void stamp_page(struct page_cache *cache, struct cached_page *page)
+{
+	if (atomic64_read(&cache->clock) != READ_ONCE(page->cp_last_used)) {
+		WRITE_ONCE(page->cp_last_used,
+			   atomic64_inc_return(&cache->clock));
+	}
+}
+
 /**********************************************************************/
 void make_page_most_recent(struct page_cache *cache, struct cached_page *page)
 {
 	// ASSERTION: We are either a zone thread holding a
 	// search_pending_counter, or we are any thread holding the
 	// readThreadsMutex.
-	if (atomic64_read(&cache->clock) != READ_ONCE(page->cp_last_used)) {
-		WRITE_ONCE(page->cp_last_used,
-			   atomic64_inc_return(&cache->clock));
+	stamp_page(cache, page);
+	if (!READ_ONCE(page->cp_protected)) {
+		WRITE_ONCE(page->cp_protected, true);
 	}
 }
 
 /**
  * Get the least recent valid page from the cache.
  *
+ * Under the SLRU policy, the least recent probationary page is chosen. If
+ * protected pages fill more than their share of the cache, the least recent
+ * protected page is demoted to probation first, so that it competes with the
+ * probationary pages. If every page is protected, the least recent page is
+ * chosen as under LRU.
+ *
  * @param cache    the cache
  * @param page_ptr  a pointer to hold the new page (will be set to NULL
  *                 if the page was not found)
@@ -456,31 +659,61 @@ static int __must_check get_least_recent_page(struct page_cache *cache,
 					      struct cached_page **page_ptr)
 {
 	// We hold the readThreadsMutex.
-	int oldest_index = 0;
-	// Our first candidate is any page that does have a pending read.  We
-	// ensure above that there are more entries than read threads, so there
-	// must be one.
+	struct cached_page *oldest = NULL;
+	struct cached_page *oldest_probationary = NULL;
+	struct cached_page *oldest_protected = NULL;
+	unsigned int protected_count = 0;
 	unsigned int i;
-	for (i = 0;; i++) {
-		if (i >= cache->num_cache_entries) {
-			// This should never happen.
-			return ASSERT(false, "oldest page is not NULL");
+	// We ensure above that there are more entries than read threads, so
+	// there must be a page which does not have a pending read.
+	for (i = 0; i < cache->active_entries; i++) {
+		struct cached_page *page = get_cache_entry(cache, i);
+		int64_t last_used;
+		if (page->cp_read_pending) {
+			continue;
 		}
-		if (!cache->cache[i].cp_read_pending) {
-			oldest_index = i;
-			break;
+		last_used = READ_ONCE(page->cp_last_used);
+		if ((oldest == NULL) ||
+		    (last_used <= READ_ONCE(oldest->cp_last_used))) {
+			oldest = page;
+		}
+		if (!READ_ONCE(page->cp_protected)) {
+			if ((oldest_probationary == NULL) ||
+			    (last_used <=
+			     READ_ONCE(oldest_probationary->cp_last_used))) {
+				oldest_probationary = page;
+			}
+			continue;
+		}
+		protected_count++;
+		if ((oldest_protected == NULL) ||
+		    (last_used <= READ_ONCE(oldest_protected->cp_last_used))) {
+			oldest_protected = page;
 		}
 	}
-	// Now find the least recently used page that does not have a pending
-	// read.
-	for (i = 0; i < cache->num_cache_entries; i++) {
-		if (!cache->cache[i].cp_read_pending &&
-		    (READ_ONCE(cache->cache[i].cp_last_used) <=
-		     READ_ONCE(cache->cache[oldest_index].cp_last_used))) {
-			oldest_index = i;
+
+	if (oldest == NULL) {
+		// This should never happen.
+		return ASSERT(false, "oldest page is not NULL");
+	}
+
+	if (get_page_cache_policy() == PAGE_CACHE_POLICY_LRU) {
+		*page_ptr = oldest;
+		return UDS_SUCCESS;
+	}
+
+	if ((protected_count * 4) >
+	    (cache->active_entries * VOLUME_CACHE_PROTECTED_QUARTERS)) {
+		WRITE_ONCE(oldest_protected->cp_protected, false);
+		if ((oldest_probationary == NULL) ||
+		    (READ_ONCE(oldest_protected->cp_last_used) <
+		     READ_ONCE(oldest_probationary->cp_last_used))) {
+			oldest_probationary = oldest_protected;
 		}
 	}
-	*page_ptr = &cache->cache[oldest_index];
+
+	*page_ptr = ((oldest_probationary != NULL) ? oldest_probationary
+						    : oldest);
 	return UDS_SUCCESS;
 }
 
@@ -520,6 +753,26 @@ int get_page_from_cache(struct page_cache *cache,
 	return UDS_SUCCESS;
 }
 
+/**********************************************************************/
+int peek_page_in_cache(struct page_cache *cache,
+		       unsigned int physical_page,
+		       bool *queued_ptr,
+		       struct cached_page **page_ptr)
+{
+	// ASSERTION: We are in a zone thread.
+	// ASSERTION: We holding a search_pending_counter or the
+	// readThreadsMutex.
+	int queue_index = -1;
+	int result =
+		get_page_no_stats(cache, physical_page, &queue_index, page_ptr);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	*queued_ptr = (queue_index != -1);
+	return UDS_SUCCESS;
+}
+
 /**********************************************************************/
 int enqueue_read(struct page_cache *cache,
 		 Request *request,
@@ -541,6 +794,7 @@ int enqueue_read(struct page_cache *cache,
 		/* fill the read queue entry */
 		cache->read_queue[last].physical_page = physical_page;
 		cache->read_queue[last].invalid = false;
+		cache->read_queue[last].started = false;
 
 		/* point the cache index to it */
 		read_queue_pos = last;
@@ -618,6 +872,30 @@ bool reserve_read_queue_entry(struct page_cache *cache,
 	return true;
 }
 
+/**********************************************************************/
+unsigned int collect_unstarted_reads(struct page_cache *cache,
+				     unsigned int *pages,
+				     unsigned int max_pages)
+{
+	// We hold the readThreadsMutex.
+	unsigned int count = 0;
+	uint16_t pos;
+
+	for (pos = cache->read_queue_last_read;
+	     (pos != cache->read_queue_last) && (count < max_pages);
+	     pos = (pos + 1) % cache->read_queue_max_size) {
+		struct queued_read *entry = &cache->read_queue[pos];
+		if (entry->invalid || entry->started) {
+			continue;
+		}
+
+		entry->started = true;
+		pages[count++] = entry->physical_page;
+	}
+
+	return count;
+}
+
 /**********************************************************************/
 void release_read_queue_entry(struct page_cache *cache, unsigned int queue_pos)
 {
@@ -644,6 +922,8 @@ int select_victim_in_cache(struct page_cache *cache,
 					    "cannot put page in NULL cache");
 	}
 
+	resize_page_cache(cache);
+
 	struct cached_page *page = NULL;
 	int result = get_least_recent_page(cache, &page);
 	if (result != UDS_SUCCESS) {
@@ -697,15 +977,15 @@ int put_page_in_cache(struct page_cache *cache,
 
 	page->cp_physical_page = physical_page;
 
-	// Figure out the index into the cache array using pointer arithmetic
-	uint16_t value = page - cache->cache;
+	uint16_t value = page->cp_cache_index;
 	result = ASSERT((value < cache->num_cache_entries),
 			"cache index is valid");
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
 
-	make_page_most_recent(cache, page);
+	// A newly read page is probationary until it is used again.
+	stamp_page(cache, page);
 
 	page->cp_read_pending = false;
 
@@ -752,12 +1032,67 @@ void cancel_page_in_cache(struct page_cache *cache,
 	WRITE_ONCE(cache->index[physical_page], cache->num_cache_entries);
 }
 
+/**********************************************************************/
+int get_page_cache_hot_pages(struct page_cache *cache,
+			     unsigned int limit,
+			     unsigned int *pages,
+			     unsigned int *count_ptr)
+{
+	*count_ptr = 0;
+	if (limit == 0) {
+		return UDS_SUCCESS;
+	}
+
+	int64_t *heat;
+	int result = ALLOCATE(limit, int64_t, "page heat", &heat);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	// Keep the hottest pages seen so far in order by insertion; the
+	// clock leaves the top bit free to rank protected pages first.
+	unsigned int count = 0;
+	unsigned int entries = smp_load_acquire(&cache->allocated_entries);
+	unsigned int i;
+	for (i = 0; i < entries; i++) {
+		struct cached_page *page = get_cache_entry(cache, i);
+		unsigned int physical_page =
+			READ_ONCE(page->cp_physical_page);
+		if ((physical_page == cache->num_index_entries) ||
+		    READ_ONCE(page->cp_read_pending)) {
+			continue;
+		}
+
+		int64_t page_heat = READ_ONCE(page->cp_last_used);
+		if (READ_ONCE(page->cp_protected)) {
+			page_heat |= (1LL << 62);
+		}
+		if ((count == limit) && (page_heat <= heat[count - 1])) {
+			continue;
+		}
+
+		unsigned int slot = (count < limit) ? count++ : count - 1;
+		while ((slot > 0) && (heat[slot - 1] < page_heat)) {
+			heat[slot] = heat[slot - 1];
+			pages[slot] = pages[slot - 1];
+			slot--;
+		}
+		heat[slot] = page_heat;
+		pages[slot] = physical_page;
+	}
+
+	FREE(heat);
+	*count_ptr = count;
+	return UDS_SUCCESS;
+}
+
 /**********************************************************************/
 size_t get_page_cache_size(struct page_cache *cache)
 {
 	if (cache == NULL) {
 		return 0;
 	}
-	return sizeof(struct delta_index_page) * cache->num_cache_entries;
+	return (sizeof(struct delta_index_page)
+		* READ_ONCE(cache->active_entries));
 }
 
@@ -43,17 +43,48 @@ struct cached_page {
 	bool cp_read_pending;
 	/* if equal to num_cache_entries, the page is invalid */
 	unsigned int cp_physical_page;
+	/* the position of this page in the cache */
+	uint16_t cp_cache_index;
 	/* the value of the volume clock when this page was last used */
 	int64_t cp_last_used;
+	/* whether this page has been used again since it was read */
+	bool cp_protected;
 	/* the cache page data */
 	struct volume_page cp_page_data;
 	/* the chapter index page. This is here, even for record pages */
 	struct delta_index_page cp_index_page;
 };
 
+/**
+ * The policy for choosing which page to evict from the cache. Under LRU,
+ * the least recently used page is evicted. Under SLRU (segmented LRU), a
+ * page starts out probationary and becomes protected when it is used again;
+ * the least recently used probationary page is evicted, so a scan of pages
+ * which are each used only once cannot flush the pages which are used
+ * repeatedly.
+ **/
+enum page_cache_policy {
+	PAGE_CACHE_POLICY_LRU,
+	PAGE_CACHE_POLICY_SLRU,
+};
+
 enum {
+	/*
+	 * The largest share of the cache, in quarters, which may hold
+	 * protected pages under the SLRU policy.
+	 */
+	VOLUME_CACHE_PROTECTED_QUARTERS = 3,
 	VOLUME_CACHE_MAX_ENTRIES = (UINT16_MAX >> 1),
 	VOLUME_CACHE_QUEUED_FLAG = (1 << 15),
+	/*
+	 * The cache entries are allocated in blocks as the cache grows, so
+	 * that an entry never moves once it has been handed out.
+	 */
+	VOLUME_CACHE_BLOCK_SHIFT = 8,
+	VOLUME_CACHE_BLOCK_ENTRIES = (1 << VOLUME_CACHE_BLOCK_SHIFT),
+	VOLUME_CACHE_MAX_BLOCKS = ((VOLUME_CACHE_MAX_ENTRIES
+				    + VOLUME_CACHE_BLOCK_ENTRIES - 1)
+				   >> VOLUME_CACHE_BLOCK_SHIFT),
 	VOLUME_CACHE_DEFAULT_MAX_QUEUED_READS = 4096
 };
 
@@ -62,6 +93,8 @@ struct queued_read {
 	bool invalid;
 	/* whether this queue entry has a pending read on it */
 	bool reserved;
+	/* whether the read of this entry's page has been started early */
+	bool started;
 	/* physical page to read */
 	unsigned int physical_page;
 	/* list of requests waiting on a queued read */
@@ -106,11 +139,13 @@ struct page_cache {
 	unsigned int num_index_entries;
 	// The max number of cached entries
 	uint16_t num_cache_entries;
+	// The number of entries for the size the index was configured with
+	unsigned int configured_entries;
 	// The index used to quickly access page in cache - top bit is a
 	// 'queued' flag
 	uint16_t *index;
-	// The cache
-	struct cached_page *cache;
+	// The blocks of cache entries allocated so far
+	struct cached_page *blocks[VOLUME_CACHE_MAX_BLOCKS];
 	// A counter for each zone to keep track of when a search is occurring
 	// within that zone.
 	struct search_pending_counter *search_pending_counters;
@@ -120,6 +155,12 @@ struct page_cache {
 	// page_cache that is not constant after the struct is
 	// initialized.
 	struct cache_counters counters;
+	// The number of entries in the allocated blocks
+	unsigned int allocated_entries;
+	// The number of entries from which victims are chosen
+	unsigned int active_entries;
+	// Whether entries beyond the active ones may still hold pages
+	bool trim_pending;
 	/**
 	 * Entries are enqueued at read_queue_last.
 	 * To 'reserve' entries, we get the entry pointed to by
@@ -152,6 +193,13 @@ struct page_cache {
 	atomic64_t clock;
 };
 
+/**
+ * The size of every page cache, in chapters, or zero for each cache to have
+ * the size its index was configured with. A cache grows or shrinks to this
+ * size as it next chooses a page to evict.
+ **/
+extern unsigned int page_cache_chapters;
+
 /**
  * Allocate a cache for a volume.
  *
@@ -211,6 +259,73 @@ int find_invalidate_and_make_least_recent(struct page_cache *cache,
 					  enum invalidation_reason reason,
 					  bool must_find);
 
+/**
+ * Get the eviction policy used by all page caches.
+ *
+ * @return the current policy
+ **/
+enum page_cache_policy get_page_cache_policy(void);
+
+/**
+ * Set the eviction policy used by all page caches. The change takes effect
+ * at the next eviction.
+ *
+ * @param policy  the new policy
+ **/
+void set_page_cache_policy(enum page_cache_policy policy);
+
+/**
+ * Get the name of a page cache eviction policy.
+ *
+ * @param policy  the policy
+ *
+ * @return the name of the policy
+ **/
+const char *get_page_cache_policy_name(enum page_cache_policy policy);
+
+/**
+ * Parse the name of a page cache eviction policy.
+ *
+ * @param name        the name to parse
+ * @param policy_ptr  a pointer to hold the policy
+ *
+ * @return UDS_SUCCESS or UDS_INVALID_ARGUMENT
+ **/
+int __must_check parse_page_cache_policy(const char *name,
+					 enum page_cache_policy *policy_ptr);
+
+/**
+ * Get the number of first-time probes of a cache which found their page
+ * cached and which did not.
+ *
+ * @param [in]  cache       the cache
+ * @param [out] hits_ptr    a pointer to hold the number of hits
+ * @param [out] misses_ptr  a pointer to hold the number of misses, including
+ *                          probes of pages already queued for reading
+ **/
+void get_page_cache_counts(struct page_cache *cache,
+			   uint64_t *hits_ptr,
+			   uint64_t *misses_ptr);
+
+/**
+ * Find the cached pages which are most likely to be used again: the
+ * protected pages before the probationary ones, and the more recently used
+ * pages first within each group. The cache is not locked, so the result is
+ * only a hint while the cache is in use.
+ *
+ * @param [in]  cache      the cache
+ * @param [in]  limit      the maximum number of pages to find
+ * @param [out] pages      an array of limit entries to hold the physical
+ *                         page numbers of the pages, hottest first
+ * @param [out] count_ptr  a pointer to hold the number of pages found
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check get_page_cache_hot_pages(struct page_cache *cache,
+					  unsigned int limit,
+					  unsigned int *pages,
+					  unsigned int *count_ptr);
+
 /**
  * Make the page the most recent in the cache
  *
@@ -249,6 +364,22 @@ int __must_check get_page_from_cache(struct page_cache *cache,
 				     int probe_type,
 				     struct cached_page **page_ptr);
 
+/**
+ * Look up a page in the cache without counting the probe in the cache
+ * statistics, for a caller which only wants to prefetch the page.
+ *
+ * @param [in]  cache          the page cache
+ * @param [in]  physical_page  the page number
+ * @param [out] queued_ptr     set to true if a read of the page is queued
+ * @param [out] page_ptr       the found page, or NULL if it is not cached
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check peek_page_in_cache(struct page_cache *cache,
+				    unsigned int physical_page,
+				    bool *queued_ptr,
+				    struct cached_page **page_ptr);
+
 /**
  * Enqueue a read request
  *
@@ -282,6 +413,21 @@ bool reserve_read_queue_entry(struct page_cache *cache,
 			      unsigned int *physical_page,
 			      bool *invalid);
 
+/**
+ * Collect the pages of queued reads which no reader thread has reserved or
+ * started, marking them started, so that the caller can start reading them
+ * before a reader thread is free to wait for them.
+ *
+ * @param cache      the page cache
+ * @param pages      an array to hold the physical pages to read
+ * @param max_pages  the size of the pages array
+ *
+ * @return the number of pages collected
+ **/
+unsigned int collect_unstarted_reads(struct page_cache *cache,
+				     unsigned int *pages,
+				     unsigned int max_pages);
+
 /**
  * Releases a read from the queue, allowing it to be reused by future
  * enqueues
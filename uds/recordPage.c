@@ -21,8 +21,39 @@
 
 #include "recordPage.h"
 
+#include "cpu.h"
+#include "hashUtils.h"
 #include "permassert.h"
 
+enum {
+	/** The number of levels below a node to prefetch while searching */
+	PREFETCH_LEVELS = 2,
+	/** The number of nodes on the prefetched level below a node */
+	PREFETCH_NODES = 1 << PREFETCH_LEVELS,
+};
+
+/**
+ * Compare a chunk name with the name of a record in a record page. The
+ * first eight bytes of the names are compared as big-endian integers, which
+ * orders them the same way memcmp() would, and is nearly always enough to
+ * tell two names apart.
+ *
+ * @param name    the chunk name
+ * @param record  the record
+ *
+ * @return a negative, zero, or positive value as for memcmp()
+ **/
+static INLINE int compare_record_name(const struct uds_chunk_name *name,
+				      const struct uds_chunk_record *record)
+{
+	uint64_t name_key = extract_volume_index_bytes(name);
+	uint64_t record_key = extract_volume_index_bytes(&record->name);
+	if (name_key != record_key) {
+		return ((name_key < record_key) ? -1 : 1);
+	}
+	return memcmp(name, &record->name, UDS_CHUNK_NAME_SIZE);
+}
+
 /**********************************************************************/
 static unsigned int
 encode_tree(byte record_page[],
@@ -60,9 +91,21 @@ int encode_record_page(const struct volume *volume,
 		       const struct uds_chunk_record records[],
 		       byte record_page[])
 {
-	unsigned int records_per_page = volume->geometry->records_per_page;
-	const struct uds_chunk_record **record_pointers =
-		volume->record_pointers;
+	return encode_record_page_with_sorter(volume->geometry,
+					      volume->radix_sorter,
+					      volume->record_pointers,
+					      records,
+					      record_page);
+}
+
+/**********************************************************************/
+int encode_record_page_with_sorter(const struct geometry *geometry,
+				   struct radix_sorter *sorter,
+				   const struct uds_chunk_record **record_pointers,
+				   const struct uds_chunk_record records[],
+				   byte record_page[])
+{
+	unsigned int records_per_page = geometry->records_per_page;
 
 	// Build an array of record pointers. We'll sort the pointers by the
 	// block names in the records, which is less work than sorting the
@@ -73,10 +116,9 @@ int encode_record_page(const struct volume *volume,
 	}
 
 	STATIC_ASSERT(offsetof(struct uds_chunk_record, name) == 0);
-	int result = radix_sort(volume->radix_sorter,
-				(const byte **) record_pointers,
-				records_per_page,
-				UDS_CHUNK_NAME_SIZE);
+	int result = radix_sort_names(sorter,
+				      (const byte **) record_pointers,
+				      records_per_page);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
@@ -99,10 +141,23 @@ bool search_record_page(const byte record_page[],
 
 	// The array of records is sorted by name and stored as a binary tree
 	// in heap order, so the root of the tree is the first array element.
+	unsigned int records_per_page = geometry->records_per_page;
 	unsigned int node = 0;
-	while (node < geometry->records_per_page) {
+	while (node < records_per_page) {
+		// The descendants of node N two levels down are adjacent in
+		// the heap, starting at index 4N+3. Fetch them while this node
+		// is compared, so that each level of the search does not wait
+		// on a cache miss.
+		unsigned int descendant =
+			((node + 1) * PREFETCH_NODES) - 1;
+		if (descendant < records_per_page) {
+			prefetch_range(&records[descendant],
+				       PREFETCH_NODES * BYTES_PER_RECORD,
+				       false);
+		}
+
 		const struct uds_chunk_record *record = &records[node];
-		int result = memcmp(name, &record->name, UDS_CHUNK_NAME_SIZE);
+		int result = compare_record_name(name, record);
 		if (result == 0) {
 			if (metadata != NULL) {
 				*metadata = record->data;
@@ -39,6 +39,26 @@ int encode_record_page(const struct volume *volume,
 		       const struct uds_chunk_record records[],
 		       byte record_page[]);
 
+/**
+ * Generate the on-disk encoding of a record page using a caller-supplied
+ * sorter, so that several threads can encode the pages of a chapter at
+ * once.
+ *
+ * @param geometry         The geometry of the volume
+ * @param sorter           The radix sorter to use
+ * @param record_pointers  An array of records_per_page pointers to use
+ *                         while sorting
+ * @param records          The records to be encoded
+ * @param record_page      The record page
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int encode_record_page_with_sorter(const struct geometry *geometry,
+				   struct radix_sorter *sorter,
+				   const struct uds_chunk_record **record_pointers,
+				   const struct uds_chunk_record records[],
+				   byte record_page[]);
+
 /**
  * Find the metadata for a given block name in this page.
  *
@@ -28,8 +28,45 @@
 #include "permassert.h"
 #include "requestQueue.h"
 
-/**********************************************************************/
-int uds_start_chunk_operation(struct uds_request *uds_request)
+enum {
+	/** The number of requests routed together by a batched start */
+	CHUNK_BATCH_SIZE = 32,
+	/** The number of names a bulk query has in the index at once */
+	QUERY_WINDOW_SIZE = 256,
+};
+
+/**
+ * The state shared by the requests of a bulk query.
+ **/
+struct query_context {
+	/** Protects pending, and orders the statistics for the waiter */
+	struct mutex mutex;
+	/** Signalled when pending drops to zero */
+	struct cond_var cond;
+	/** The number of requests which have not finished */
+	unsigned int pending;
+	/** The first error returned by a request */
+	int result;
+	/** The statistics, updated only by the callback thread */
+	struct uds_query_stats *stats;
+};
+
+/**
+ * A request of a bulk query.
+ **/
+struct query_request {
+	struct uds_request request;
+	struct query_context *context;
+};
+
+/**
+ * Validate a chunk operation and prepare it to enter the request pipeline.
+ *
+ * @param uds_request  The operation to prepare
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int prepare_chunk_operation(struct uds_request *uds_request)
 {
 	if (uds_request->callback == NULL) {
 		return UDS_CALLBACK_REQUIRED;
@@ -56,11 +93,240 @@ int uds_start_chunk_operation(struct uds_request *uds_request)
 	request->is_control_message = false;
 	request->unbatched = false;
 	request->router = request->session->router;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int uds_start_chunk_operation(struct uds_request *uds_request)
+{
+	int result = prepare_chunk_operation(uds_request);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
 
-	enqueue_request(request, STAGE_TRIAGE);
+	enqueue_request((Request *) uds_request, STAGE_TRIAGE);
 	return UDS_SUCCESS;
 }
 
+/**
+ * Enqueue a batch of routed requests, handing each destination queue all of
+ * its requests at once so that it is woken at most once. The relative order
+ * of the requests bound for each queue is preserved. The requests are
+ * regrouped in place by their batch_queue.
+ *
+ * @param requests  The requests to enqueue
+ * @param count     The number of requests
+ **/
+static void enqueue_request_batch(Request *requests[], unsigned int count)
+{
+	ktime_t now = current_time_ns(CLOCK_MONOTONIC);
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		requests[i]->stage_start = now;
+	}
+
+	unsigned int run_end;
+	for (i = 0; i < count; i = run_end) {
+		RequestQueue *queue = requests[i]->batch_queue;
+		unsigned int j;
+		run_end = i + 1;
+		for (j = run_end; j < count; j++) {
+			Request *request = requests[j];
+			if (request->batch_queue != queue) {
+				continue;
+			}
+			// Slide the skipped requests up to keep their order.
+			memmove(&requests[run_end + 1], &requests[run_end],
+				(j - run_end) * sizeof(Request *));
+			requests[run_end++] = request;
+		}
+		request_queue_enqueue_batch(queue, &requests[i], run_end - i);
+	}
+}
+
+/**
+ * Start a batch of chunk operations.
+ *
+ * @param uds_requests  The operations
+ * @param count         The number of operations
+ * @param lookup_only   Whether the operations must leave cache recency alone
+ *
+ * @return UDS_SUCCESS or the error for the first operation not started
+ **/
+static int start_chunk_operations(struct uds_request *uds_requests[],
+				  unsigned int count,
+				  bool lookup_only)
+{
+	Request *requests[CHUNK_BATCH_SIZE];
+	unsigned int batched = 0;
+	int first_error = UDS_SUCCESS;
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		struct uds_request *uds_request = uds_requests[i];
+		int result = prepare_chunk_operation(uds_request);
+		if (result != UDS_SUCCESS) {
+			if (first_error == UDS_SUCCESS) {
+				first_error = result;
+			}
+			if (uds_request->callback != NULL) {
+				uds_request->status = result;
+				uds_request->callback(uds_request);
+			}
+			continue;
+		}
+
+		Request *request = (Request *) uds_request;
+		request->lookup_only = lookup_only;
+		RequestQueue *queue = select_index_router_queue(request->router,
+								request,
+								STAGE_TRIAGE);
+		if (queue == NULL) {
+			continue;
+		}
+
+		request->batch_queue = queue;
+		requests[batched] = request;
+		if (++batched == CHUNK_BATCH_SIZE) {
+			enqueue_request_batch(requests, batched);
+			batched = 0;
+		}
+	}
+
+	enqueue_request_batch(requests, batched);
+	return first_error;
+}
+
+/**********************************************************************/
+int uds_start_chunk_operations(struct uds_request *uds_requests[],
+			       unsigned int count)
+{
+	return start_chunk_operations(uds_requests, count, false);
+}
+
+/**
+ * Account for a finished bulk query request. This is the callback of each
+ * request started by uds_query_chunk_names(), so it runs on the session's
+ * callback thread.
+ *
+ * @param uds_request  The finished request
+ **/
+static void finish_query_request(struct uds_request *uds_request)
+{
+	struct query_request *query =
+		container_of(uds_request, struct query_request, request);
+	struct query_context *context = query->context;
+	Request *request = (Request *) uds_request;
+	struct uds_query_stats *stats = context->stats;
+
+	if (request->status == UDS_SUCCESS) {
+		stats->queries++;
+		if (request->found) {
+			stats->found++;
+			switch (request->location) {
+			case LOC_IN_OPEN_CHAPTER:
+				stats->found_in_memory++;
+				break;
+			case LOC_IN_DENSE:
+				stats->found_dense++;
+				break;
+			case LOC_IN_SPARSE:
+				stats->found_sparse++;
+				break;
+			default:
+				break;
+			}
+
+			stats->found_by_age[get_chapter_age_bucket(request->chapter_age)]++;
+		}
+	}
+
+	lock_mutex(&context->mutex);
+	if ((request->status != UDS_SUCCESS) &&
+	    (context->result == UDS_SUCCESS)) {
+		context->result = request->status;
+	}
+	if (--context->pending == 0) {
+		broadcast_cond(&context->cond);
+	}
+	unlock_mutex(&context->mutex);
+}
+
+/**********************************************************************/
+int uds_query_chunk_names(struct uds_index_session *session,
+			  const struct uds_chunk_name names[],
+			  unsigned int count,
+			  struct uds_query_stats *stats)
+{
+	if (stats == NULL) {
+		return log_error_strerror(UDS_INVALID_ARGUMENT,
+					  "received a NULL query stats pointer");
+	}
+	if (count == 0) {
+		return UDS_SUCCESS;
+	}
+
+	struct query_context context = {
+		.result = UDS_SUCCESS,
+		.stats = stats,
+	};
+	int result = init_mutex(&context.mutex);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	result = init_cond(&context.cond);
+	if (result != UDS_SUCCESS) {
+		destroy_mutex(&context.mutex);
+		return result;
+	}
+
+	struct query_request *queries = NULL;
+	struct uds_request **requests = NULL;
+	unsigned int window = min(count, (unsigned int) QUERY_WINDOW_SIZE);
+	result = ALLOCATE(window, struct query_request, __func__, &queries);
+	if (result == UDS_SUCCESS) {
+		result = ALLOCATE(window, struct uds_request *, __func__,
+				  &requests);
+	}
+
+	unsigned int done = 0;
+	while ((result == UDS_SUCCESS) && (done < count)) {
+		unsigned int batch_size = min(count - done, window);
+		unsigned int i;
+		for (i = 0; i < batch_size; i++) {
+			struct query_request *query = &queries[i];
+			query->request = (struct uds_request) {
+				.chunk_name = names[done + i],
+				.callback = finish_query_request,
+				.session = session,
+				.type = UDS_QUERY,
+				.update = false,
+			};
+			query->context = &context;
+			requests[i] = &query->request;
+		}
+
+		context.pending = batch_size;
+		// Every request finishes through its callback, even those
+		// which could not be started, so the result is collected
+		// there.
+		start_chunk_operations(requests, batch_size, true);
+
+		lock_mutex(&context.mutex);
+		while (context.pending > 0) {
+			wait_cond(&context.cond, &context.mutex);
+		}
+		result = context.result;
+		unlock_mutex(&context.mutex);
+		done += batch_size;
+	}
+
+	FREE(requests);
+	FREE(queries);
+	destroy_cond(&context.cond);
+	destroy_mutex(&context.mutex);
+	return result;
+}
+
 /**********************************************************************/
 int launch_zone_control_message(enum request_action action,
 				struct zone_message message,
@@ -105,6 +371,7 @@ void enqueue_request(Request *request, enum request_stage next_stage)
 		return;
 	}
 
+	request->stage_start = current_time_ns(CLOCK_MONOTONIC);
 	request_queue_enqueue(next_queue, request);
 }
 
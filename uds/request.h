@@ -25,6 +25,7 @@
 #include "cacheCounters.h"
 #include "common.h"
 #include "compiler.h"
+#include "hashUtils.h"
 #include "opaqueTypes.h"
 #include "threads.h"
 #include "timeUtils.h"
@@ -161,6 +162,13 @@ struct internal_request {
 	enum request_action action;    // the action for the index to perform
 	unsigned int zone_number;      // the zone for this request to use
 	enum index_region location;    // if and where the block was found
+	unsigned int chapter_age;      // chapters between the open chapter
+				       // and the one the block was found in
+	bool lookup_only;              // if true, leave cache recency alone
+	ktime_t stage_start;           // when the request entered its
+				       // current queue or page read
+	RequestQueue *batch_queue;     // the queue chosen for the request
+				       // while its batch is being routed
 
 	bool sl_location_known;        // slow lane has determined a location
 	enum index_region sl_location; // location determined by slowlane
@@ -247,4 +255,18 @@ static INLINE enum cache_probe_type cache_probe_type(Request *request,
 				       CACHE_PROBE_RECORD_FIRST;
 	}
 }
+
+/**
+ * Get the chapter age bucket which counts a found request.
+ *
+ * @param chapter_age  The age of the chapter the request was found in
+ *
+ * @return The index of the bucket, less than UDS_CHAPTER_AGE_BUCKETS
+ **/
+static INLINE unsigned int get_chapter_age_bucket(unsigned int chapter_age)
+{
+	unsigned int bucket =
+		((chapter_age == 0) ? 0 : compute_bits(chapter_age));
+	return min(bucket, (unsigned int) UDS_CHAPTER_AGE_BUCKETS - 1);
+}
 #endif /* REQUEST_H */
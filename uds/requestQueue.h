@@ -29,6 +29,9 @@
 /* void return value because this function will process its own errors */
 typedef void request_queue_processor_t(Request *);
 
+/* called on each batch of requests before any of them is processed */
+typedef void request_queue_preparer_t(Request *requests[], unsigned int count);
+
 /**
  * Allocate a new request processing queue and start a worker thread to
  * consume and service requests in the queue.
@@ -43,6 +46,26 @@ int __must_check make_request_queue(const char *queue_name,
 				    request_queue_processor_t *process_one,
 				    RequestQueue **queue_ptr);
 
+/**
+ * Allocate a new request processing queue whose worker thread takes the
+ * requests available in the queue in batches. Each batch is passed to a
+ * preparation function, and then each request in it is processed in order,
+ * so that the preparation can start work (such as memory or I/O prefetches)
+ * for all of the requests before the first is processed.
+ *
+ * @param queue_name     the name of the queue and the worker thread
+ * @param prepare_batch  the function the worker will invoke on each batch
+ * @param process_one    the function the worker will invoke on each request
+ * @param queue_ptr      a pointer to receive the new queue
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check
+make_batching_request_queue(const char *queue_name,
+			    request_queue_preparer_t *prepare_batch,
+			    request_queue_processor_t *process_one,
+			    RequestQueue **queue_ptr);
+
 /**
  * Add a request to the end of the queue for processing by the worker thread.
  * If the requeued flag is set on the request, it will be processed before
@@ -53,6 +76,19 @@ int __must_check make_request_queue(const char *queue_name,
  **/
 void request_queue_enqueue(RequestQueue *queue, Request *request);
 
+/**
+ * Add several requests to the end of the queue, waking the worker thread at
+ * most once for all of them. The requests are handled as if each had been
+ * passed to request_queue_enqueue in order.
+ *
+ * @param queue     the request queue that should process the requests
+ * @param requests  the requests to be processed on the queue's worker thread
+ * @param count     the number of requests
+ **/
+void request_queue_enqueue_batch(RequestQueue *queue,
+				 Request *requests[],
+				 unsigned int count);
+
 /**
  * Shut down the request queue worker thread, then destroy and free the queue.
  *
@@ -21,6 +21,7 @@
 
 #include "requestQueue.h"
 
+#include <linux/ktime.h>
 #include <linux/wait.h>
 
 #include "atomicDefs.h"
@@ -49,7 +50,9 @@
  * If requests are enqueued while the processing of another request is
  * happening, and the enqueuing operations complete while the request
  * processing is still in progress, then the retry request(s) *will*
- * get processed next.  (This is used for testing.)
+ * get processed next, after the rest of the batch of requests which the
+ * worker took from the queue along with the request being processed.
+ * (This is used for testing.)
  */
 
 /**
@@ -68,7 +71,10 @@ enum {
 	MINIMUM_WAIT_TIME = DEFAULT_WAIT_TIME / 2,
 
 	/** The maximimum time to wait when waiting with a timeout */
-	MAXIMUM_WAIT_TIME = ONE_MILLISECOND
+	MAXIMUM_WAIT_TIME = ONE_MILLISECOND,
+
+	/** The longest time to poll for a request before waiting */
+	MAXIMUM_SPIN_TIME = 5 * ONE_MICROSECOND
 };
 
 /**
@@ -80,11 +86,21 @@ enum {
 	MAXIMUM_BATCH = 64  // wait time decreases if batch larger than this
 };
 
+/**
+ * The largest number of requests the worker takes from the queue at once.
+ * This is also the largest batch passed to a queue's preparation function.
+ **/
+enum {
+	DEQUEUE_BATCH_SIZE = 16
+};
+
 struct uds_request_queue {
 	/* Wait queue for synchronizing producers and consumer */
 	struct wait_queue_head wqhead;
 	/* function to process 1 request */
 	request_queue_processor_t *process_one;
+	/* function to prepare a batch of requests, or NULL */
+	request_queue_preparer_t *prepare_batch;
 	/* new incoming requests */
 	struct funnel_queue *main_queue;
 	/* old requests to retry first */
@@ -127,6 +143,37 @@ static INLINE Request *poll_queues(RequestQueue *queue)
 	return NULL;
 }
 
+/**********************************************************************/
+/**
+ * Poll the underlying lock-free queues for up to a given number of requests
+ * to process, taking retry requests first. Must only be called by the worker
+ * thread.
+ *
+ * @param queue     the RequestQueue being serviced
+ * @param requests  an array to hold the dequeued requests
+ * @param max       the size of the requests array
+ *
+ * @return the number of requests dequeued
+ **/
+static unsigned int poll_queues_batch(RequestQueue *queue,
+				      Request *requests[],
+				      unsigned int max)
+{
+	struct funnel_queue_entry *entries[DEQUEUE_BATCH_SIZE];
+	max = min(max, (unsigned int) DEQUEUE_BATCH_SIZE);
+	unsigned int count =
+		funnel_queue_poll_batch(queue->retry_queue, entries, max);
+	count += funnel_queue_poll_batch(queue->main_queue, &entries[count],
+					 max - count);
+
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		requests[i] = container_of(entries[i], Request,
+					   request_queue_link);
+	}
+	return count;
+}
+
 /**********************************************************************/
 /**
  * Check if the underlying lock-free queues appear not just not to have any
@@ -179,6 +226,72 @@ dequeue_request(RequestQueue *queue, Request **request_ptr, bool *waited_ptr)
 	return false;
 }
 
+/**********************************************************************/
+/**
+ * Process a request just dequeued, along with any other requests already
+ * available in the queue. Must only be called by the worker thread.
+ *
+ * @param queue    the RequestQueue being serviced
+ * @param request  the request which was dequeued
+ *
+ * @return the number of requests processed
+ **/
+static unsigned int process_requests(RequestQueue *queue, Request *request)
+{
+	Request *batch[DEQUEUE_BATCH_SIZE];
+	batch[0] = request;
+	unsigned int count =
+		1 + poll_queues_batch(queue, &batch[1], DEQUEUE_BATCH_SIZE - 1);
+
+	if (queue->prepare_batch != NULL) {
+		queue->prepare_batch(batch, count);
+	}
+
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		queue->process_one(batch[i]);
+	}
+	return count;
+}
+
+/**********************************************************************/
+/**
+ * Poll for a request for a while before the worker thread waits for one.
+ * The time spent polling is twice the recent mean time the queue has been
+ * empty, so that a steady stream of requests can be taken without the cost
+ * of sleeping and being woken, but it is never more than MAXIMUM_SPIN_TIME,
+ * and there is no polling at all if requests have been arriving slowly.
+ * Must only be called by the worker thread.
+ *
+ * @param queue           the RequestQueue being serviced
+ * @param mean_idle_time  the recent mean time the queue was empty
+ * @param idle_start      the time the queue was found empty
+ *
+ * @return a dequeued request, or NULL if none arrived while polling
+ **/
+static Request *spin_for_request(RequestQueue *queue,
+				 u64 mean_idle_time,
+				 u64 idle_start)
+{
+	if (mean_idle_time >= MAXIMUM_SPIN_TIME) {
+		return NULL;
+	}
+
+	u64 spin_end =
+		idle_start + min(2 * mean_idle_time, (u64) MAXIMUM_SPIN_TIME);
+	while (READ_ONCE(queue->alive)) {
+		Request *request = poll_queues(queue);
+		if (request != NULL) {
+			return request;
+		}
+		if (ktime_get_ns() >= spin_end) {
+			break;
+		}
+		cpu_relax();
+	}
+	return NULL;
+}
+
 /**********************************************************************/
 static void request_queue_worker(void *arg)
 {
@@ -186,11 +299,26 @@ static void request_queue_worker(void *arg)
 	unsigned long time_batch = DEFAULT_WAIT_TIME;
 	bool dormant = atomic_read(&queue->dormant);
 	long current_batch = 0;
+	// Start as if requests were arriving too slowly to be worth polling.
+	u64 mean_idle_time = MAXIMUM_SPIN_TIME;
 
 	for (;;) {
-		Request *request;
+		Request *request = NULL;
 		bool waited = false;
-		if (dormant) {
+		u64 idle_start = 0;
+		if (!dormant) {
+			request = poll_queues(queue);
+			if (request == NULL) {
+				idle_start = ktime_get_ns();
+				request = spin_for_request(queue,
+							   mean_idle_time,
+							   idle_start);
+			}
+		}
+
+		if (request != NULL) {
+			// No need to wait.
+		} else if (dormant) {
 			/*
 			 * Sleep/wakeup protocol:
 			 *
@@ -228,9 +356,15 @@ static void request_queue_worker(void *arg)
 		}
 
 		if (likely(request != NULL)) {
-			// We got a request.
-			current_batch++;
-			queue->process_one(request);
+			// We got a request. If the queue was empty, fold the
+			// time it stayed empty into the mean which sets how
+			// long to poll next time.
+			if (idle_start != 0) {
+				s64 idle_time = ktime_get_ns() - idle_start;
+				mean_idle_time += ((idle_time -
+						    (s64) mean_idle_time) / 8);
+			}
+			current_batch += process_requests(queue, request);
 		} else if (!READ_ONCE(queue->alive)) {
 			// We got no request and we know we are shutting down.
 			break;
@@ -301,6 +435,16 @@ static void request_queue_worker(void *arg)
 int make_request_queue(const char *queue_name,
 		       request_queue_processor_t *process_one,
 		       RequestQueue **queue_ptr)
+{
+	return make_batching_request_queue(queue_name, NULL, process_one,
+					   queue_ptr);
+}
+
+/**********************************************************************/
+int make_batching_request_queue(const char *queue_name,
+				request_queue_preparer_t *prepare_batch,
+				request_queue_processor_t *process_one,
+				RequestQueue **queue_ptr)
 {
 	RequestQueue *queue;
 	int result = ALLOCATE(1, RequestQueue, __func__, &queue);
@@ -308,6 +452,7 @@ int make_request_queue(const char *queue_name,
 		return result;
 	}
 	queue->process_one = process_one;
+	queue->prepare_batch = prepare_batch;
 	queue->alive = true;
 	atomic_set(&queue->dormant, false);
 	init_waitqueue_head(&queue->wqhead);
@@ -365,6 +510,34 @@ void request_queue_enqueue(RequestQueue *queue, Request *request)
 	}
 }
 
+/**********************************************************************/
+void request_queue_enqueue_batch(RequestQueue *queue,
+				 Request *requests[],
+				 unsigned int count)
+{
+	bool unbatched = false;
+	unsigned int i;
+
+	if (count == 0) {
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		Request *request = requests[i];
+		// Once it's queued the request may already be finished, so
+		// examine it first.
+		unbatched |= request->unbatched;
+		funnel_queue_put(request->requeued ? queue->retry_queue :
+						     queue->main_queue,
+				 &request->request_queue_link);
+	}
+
+	// See request_queue_enqueue.
+	if (atomic_read(&queue->dormant) || unbatched) {
+		wake_up_worker(queue);
+	}
+}
+
 /**********************************************************************/
 void request_queue_finish(RequestQueue *queue)
 {
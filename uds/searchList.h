@@ -206,8 +206,8 @@ static INLINE uint8_t rotate_search_list(struct search_list *search_list,
  * skippable, and dead--while maintaining the LRU ordering that already
  * existed (a stable sort).
  *
- * This operation must only be called during the critical section in
- * update_sparse_cache() since it effectively changes cache membership.
+ * This operation must only be called on the sparse cache loader's own
+ * search list since it effectively changes cache membership.
  *
  * @param search_list             the chapter index search list to purge
  * @param chapters                the chapter index cache entries
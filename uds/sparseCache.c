@@ -27,45 +27,40 @@
  * allows the LRU order to be maintained by shifting entries in an array list.
  *
  * The most important property of this cache is the absence of synchronization
- * for read operations. Safe concurrent access to the cache by the zone
- * threads is controlled by the triage queue and the barrier requests it
- * issues to the zone queues. The set of cached chapters does not and must not
- * change between the carefully coordinated calls to update_sparse_cache() from
- * the zone threads.
+ * for read operations, and the absence of any rendezvous between the zone
+ * threads for updates. Each zone thread searches the cache through its own
+ * search list, which it never shares. The set of chapters a zone can see
+ * changes only when that zone adopts a newly published generation of the
+ * cache membership.
  *
- * The critical invariant for that coordination is the cache membership must
- * not change between those updates; the calls to sparse_cache_contains() from
- * the zone threads must all receive the same results for any virtual chapter
- * number. To ensure that critical invariant, state changes such as "that
- * virtual chapter is no longer in the volume" and "skip searching that
- * chapter because it has had too many cache misses" are represented
- * separately from the cache membership information (the virtual chapter
- * number).
+ * Chapters are added to the cache by a loader thread. When the zone zero
+ * thread is asked (by a barrier request from the triage queue) for a chapter
+ * which is not in the cache, it hands the loader the chapter number and a
+ * snapshot of its own search list, which decides which chapter to evict. It
+ * does not wait for the loader. The loader reads the chapter index into the
+ * single cache entry which is not in any published search list, and then
+ * publishes a new generation of the membership: a search list in which that
+ * entry has replaced the evicted one. The evicted entry becomes the free
+ * entry, but it may not be reused until every zone has adopted the new
+ * generation, since zones which have not may still be searching it. This is
+ * epoch-based reclamation with the membership generation as the epoch; it
+ * is the loader, never a zone thread, that waits for the zones to catch up.
  *
- * As a result of this invariant, we have the guarantee that every zone thread
- * will call update_sparse_cache() once and exactly once to request a chapter
- * that is not in the cache, and the serialization of the barrier requests
- * from the triage queue ensures they will all request the same chapter
- * number. This means the only synchronization we need can be provided by a
- * pair of thread barriers used only in the update_sparse_cache() call,
- * providing a critical section where a single zone thread can drive the cache
- * update while all the other zone threads are known to be blocked, waiting in
- * the second barrier. Outside that critical section, all the zone threads
- * implicitly hold a shared lock. Inside it, the "captain" (the thread that
- * was uniquely flagged when passing through the first barrier) holds an
- * exclusive lock. No other threads may access or modify the cache, except for
- * accessing cache statistics and similar queries.
+ * Because zones adopt new generations independently, sparse_cache_contains()
+ * may briefly give different answers in different zones. That only means a
+ * zone will look up a hook through the volume page cache rather than the
+ * sparse cache; the results are the same.
  *
  * Cache statistics must only be modified by a single thread, conventionally
- * the zone zero thread. All fields that might be frequently updated by that
+ * the zone zero thread; the eviction counts are kept by the loader thread. All fields that might be frequently updated by that
  * thread are kept in separate cache-aligned structures so they will not cause
  * cache contention via "false sharing" with the fields that are frequently
  * accessed by all of the zone threads.
  *
  * LRU order is kept independently by each zone thread, and each zone uses its
  * own list for searching and cache membership queries. The zone zero list is
- * used to decide which chapter to evict when the cache is updated, and its
- * search list is copied to the other threads at that time.
+ * used to decide which chapter to evict when the cache is updated, and the
+ * resulting search list is copied to each zone when it adopts the update.
  *
  * The virtual chapter number field of the cache entry is the single field
  * indicating whether a chapter is a member of the cache or not. The value
@@ -79,8 +74,7 @@
  * of the cache entries.
  *
  * A chapter index that is a member of the cache may be marked for different
- * treatment (disabling search) between calls to update_sparse_cache() in two
- * different ways. When a chapter falls off the end of the volume, its virtual
+ * treatment (disabling search) between updates in two different ways. When a chapter falls off the end of the volume, its virtual
  * chapter number will be less that the oldest virtual chapter number. Since
  * that chapter is no longer part of the volume, there's no point in continuing
  * to search that chapter index. Once invalidated, that virtual chapter will
@@ -97,16 +91,13 @@
  * regardless of the state of the skip_search flag, the virtual chapter must
  * still considered to be a member of the cache for sparse_cache_contains().
  *
- * Barrier requests and the sparse chapter index cache are also described in
- *
- * https://intranet.permabit.com/wiki/Chapter_Index_Cache_supports_concurrent_access
- *
- * and in a message to the albireo mailing list on 5/28/2011 titled "true
- * barriers with a hook resolution queue".
+ * Barrier requests are still used to tell the zone zero thread which chapter
+ * to load in the order the triage queue resolved the hooks.
  **/
 
 #include "sparseCache.h"
 
+#include "atomicDefs.h"
 #include "cachedChapterIndex.h"
 #include "chapterIndex.h"
 #include "common.h"
@@ -124,9 +115,17 @@ enum {
 	SKIP_SEARCH_THRESHOLD = 20000,
 
 	/** a named constant to use when identifying zone zero */
-	ZONE_ZERO = 0
+	ZONE_ZERO = 0,
+
+	/** the number of cached chapter indexes to probe together */
+	SEARCH_BATCH_SIZE = 4,
+
+	/** the most chapters a search list can order */
+	MAX_SPARSE_CACHE_CHAPTERS = UINT8_MAX,
 };
 
+unsigned int sparse_cache_chapters = 0;
+
 /**
  * These counter values are essentially fields of the sparse_cache, but are
  * segregated into this structure because they are frequently modified. We
@@ -161,6 +160,9 @@ struct sparse_cache {
 	 * array */
 	unsigned int capacity;
 
+	/** the number of chapters the index was configured to cache */
+	unsigned int configured_capacity;
+
 	/** the number of zone threads using the cache */
 	unsigned int zone_count;
 
@@ -174,10 +176,56 @@ struct sparse_cache {
 	/** pointers to the cache-aligned chapter search order for each zone */
 	struct search_list *search_lists[MAX_ZONES];
 
-	/** the thread barriers used to synchronize the zone threads for update
-	 */
-	struct barrier begin_cache_update;
-	struct barrier end_cache_update;
+	/** the generation of the membership adopted by each zone */
+	uint64_t zone_generations[MAX_ZONES];
+
+	/** the most recently published generation of the membership */
+	uint64_t generation;
+
+	/** the published search lists, alternating between generations */
+	struct search_list *published_lists[2];
+
+	/** the cache entry which is in no published search list */
+	uint8_t free_entry;
+
+	/** the generation which retired the free entry */
+	uint64_t free_generation;
+
+	/** the thread which loads chapter indexes into the cache */
+	struct thread *loader;
+
+	/** the search list being updated by the loader */
+	struct search_list *loader_list;
+
+	/** protects the load request and the zone generations */
+	struct mutex mutex;
+
+	/** signalled when a load is requested or a zone adopts an update */
+	struct cond_var cond;
+
+	/** set to stop the loader */
+	bool stop;
+
+	/** the chapter zone zero wants loaded, or UINT64_MAX */
+	uint64_t requested_chapter;
+
+	/** set when zone zero sees more chapters cached than the limit */
+	bool trim_requested;
+
+	/** set when dead entries may hold chapters no zone is searching */
+	bool release_pending;
+
+	/** the oldest chapter in zone zero's view when it asked for the load */
+	uint64_t requested_oldest_chapter;
+
+	/** the volume from which to load the requested chapter */
+	const struct volume *requested_volume;
+
+	/** the generation of the membership zone zero's snapshot is based on */
+	uint64_t request_generation;
+
+	/** a snapshot of zone zero's search list */
+	struct search_list *request_list;
 
 	/** frequently-updated counter fields (cache-aligned) */
 	struct sparse_cache_counters counters;
@@ -186,6 +234,8 @@ struct sparse_cache {
 	struct cached_chapter_index chapters[];
 };
 
+static void load_sparse_chapters(void *arg);
+
 /**
  * Initialize a sparse chapter index cache.
  *
@@ -209,17 +259,19 @@ static int __must_check initialize_sparse_cache(struct sparse_cache *cache,
 	// the chapter search misses only in zone zero.
 	cache->skip_search_threshold = (SKIP_SEARCH_THRESHOLD / zone_count);
 
-	int result =
-		initialize_barrier(&cache->begin_cache_update, zone_count);
+	int result = init_mutex(&cache->mutex);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
-	result = initialize_barrier(&cache->end_cache_update, zone_count);
+	result = init_cond(&cache->cond);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
+
+	// The extra entry is the free entry, into which the loader reads the
+	// next chapter to be cached.
 	unsigned int i;
-	for (i = 0; i < capacity; i++) {
+	for (i = 0; i <= capacity; i++) {
 		result = initialize_cached_chapter_index(&cache->chapters[i],
 							 geometry);
 		if (result != UDS_SUCCESS) {
@@ -227,6 +279,9 @@ static int __must_check initialize_sparse_cache(struct sparse_cache *cache,
 		}
 	}
 
+	cache->free_entry = capacity;
+	cache->free_generation = 0;
+
 	// Allocate each zone's independent LRU order.
 	for (i = 0; i < zone_count; i++) {
 		result = make_search_list(capacity, &cache->search_lists[i]);
@@ -234,7 +289,25 @@ static int __must_check initialize_sparse_cache(struct sparse_cache *cache,
 			return result;
 		}
 	}
-	return UDS_SUCCESS;
+	for (i = 0; i < 2; i++) {
+		result = make_search_list(capacity,
+					  &cache->published_lists[i]);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
+	result = make_search_list(capacity, &cache->request_list);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	result = make_search_list(capacity, &cache->loader_list);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	cache->requested_chapter = UINT64_MAX;
+	return create_thread(load_sparse_chapters, cache, "sparseW",
+			     &cache->loader);
 }
 
 /**********************************************************************/
@@ -243,18 +316,25 @@ int make_sparse_cache(const struct geometry *geometry,
 		      unsigned int zone_count,
 		      struct sparse_cache **cache_ptr)
 {
+	// Allocate the entries for the largest cache the search lists can
+	// order; an entry holds no chapter memory until it is used.
 	unsigned int bytes =
 		(sizeof(struct sparse_cache) +
-		 (capacity * sizeof(struct cached_chapter_index)));
+		 ((MAX_SPARSE_CACHE_CHAPTERS + 1)
+		  * sizeof(struct cached_chapter_index)));
 
 	struct sparse_cache *cache;
-	int result = allocate_cache_aligned(bytes, "sparse cache", &cache);
+	int result = allocate_tagged_memory(bytes, CACHE_LINE_BYTES,
+					    MEMORY_TAG_SPARSE_CACHE,
+					    "sparse cache", &cache);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
 
-	result =
-		initialize_sparse_cache(cache, geometry, capacity, zone_count);
+	cache->configured_capacity = capacity;
+	result = initialize_sparse_cache(cache, geometry,
+					 MAX_SPARSE_CACHE_CHAPTERS,
+					 zone_count);
 	if (result != UDS_SUCCESS) {
 		free_sparse_cache(cache);
 		return result;
@@ -264,6 +344,22 @@ int make_sparse_cache(const struct geometry *geometry,
 	return UDS_SUCCESS;
 }
 
+/**
+ * Get the number of chapters a sparse cache may currently hold.
+ *
+ * @param cache  the cache
+ *
+ * @return the limit set by sparse_cache_chapters, or the configured capacity
+ **/
+static unsigned int get_sparse_cache_limit(const struct sparse_cache *cache)
+{
+	unsigned int chapters = READ_ONCE(sparse_cache_chapters);
+	if (chapters == 0) {
+		chapters = cache->configured_capacity;
+	}
+	return max(1U, min(chapters, cache->capacity));
+}
+
 /**********************************************************************/
 size_t get_sparse_cache_memory_size(const struct sparse_cache *cache)
 {
@@ -273,7 +369,25 @@ size_t get_sparse_cache_memory_size(const struct sparse_cache *cache)
 			    cache->geometry->bytes_per_page);
 	size_t chapter_size =
 		(page_size * cache->geometry->index_pages_per_chapter);
-	return (cache->capacity * chapter_size);
+	return ((get_sparse_cache_limit(cache) + 1) * chapter_size);
+}
+
+/**********************************************************************/
+unsigned int get_sparse_cache_chapters(struct sparse_cache *cache,
+				       uint64_t *chapters,
+				       unsigned int limit)
+{
+	unsigned int count = 0;
+	struct search_list_iterator iterator =
+		iterate_search_list(cache->search_lists[0], cache->chapters);
+	while (has_next_chapter(&iterator) && (count < limit)) {
+		uint64_t virtual_chapter =
+			READ_ONCE(get_next_chapter(&iterator)->virtual_chapter);
+		if (virtual_chapter != UINT64_MAX) {
+			chapters[count++] = virtual_chapter;
+		}
+	}
+	return count;
 }
 
 /**
@@ -304,18 +418,18 @@ static void score_chapter_miss(struct sparse_cache *cache)
  * Check if the cache entry that is about to be replaced is already dead, and
  * if it's not, add to tally of evicted or invalidated cache entries.
  *
- * @param zone       the zone used to find the oldest chapter
- * @param cache      the cache to update
- * @param chapter    the cache entry about to be replaced
+ * @param cache           the cache to update
+ * @param chapter         the cache entry about to be replaced
+ * @param oldest_chapter  the oldest virtual chapter in the volume
  **/
-static void score_eviction(struct index_zone *zone,
-			   struct sparse_cache *cache,
-			   struct cached_chapter_index *chapter)
+static void score_eviction(struct sparse_cache *cache,
+			   struct cached_chapter_index *chapter,
+			   uint64_t oldest_chapter)
 {
 	if (chapter->virtual_chapter == UINT64_MAX) {
 		return;
 	}
-	if (chapter->virtual_chapter < zone->oldest_virtual_chapter) {
+	if (chapter->virtual_chapter < oldest_chapter) {
 		cache->counters.invalidations += 1;
 	} else {
 		cache->counters.evictions += 1;
@@ -358,6 +472,231 @@ static void score_search_miss(struct sparse_cache *cache,
 	}
 }
 
+/**
+ * Adopt the most recently published generation of the cache membership in a
+ * zone, if the zone has not already done so.
+ *
+ * @param cache        the cache
+ * @param zone_number  the zone number of the calling thread
+ **/
+static void adopt_published_list(struct sparse_cache *cache,
+				 unsigned int zone_number)
+{
+	uint64_t generation = smp_load_acquire(&cache->generation);
+	if (generation == cache->zone_generations[zone_number]) {
+		return;
+	}
+
+	copy_search_list(cache->published_lists[generation % 2],
+			 cache->search_lists[zone_number]);
+
+	// Tell the loader this zone has stopped using the entry which the
+	// new generation evicted.
+	lock_mutex(&cache->mutex);
+	cache->zone_generations[zone_number] = generation;
+	broadcast_cond(&cache->cond);
+	unlock_mutex(&cache->mutex);
+}
+
+/**
+ * Check whether every zone has adopted a generation of the membership. The
+ * caller must hold the mutex.
+ *
+ * @param cache       the cache
+ * @param generation  the generation to check for
+ *
+ * @return <code>true</code> if no zone is using an older generation
+ **/
+static bool all_zones_adopted(const struct sparse_cache *cache,
+			      uint64_t generation)
+{
+	unsigned int z;
+	for (z = 0; z < cache->zone_count; z++) {
+		if (cache->zone_generations[z] < generation) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Publish the loader's search list as a new generation of the membership.
+ *
+ * @param cache  the cache
+ **/
+static void publish_search_list(struct sparse_cache *cache)
+{
+	uint64_t generation = cache->generation + 1;
+	copy_search_list(cache->loader_list,
+			 cache->published_lists[generation % 2]);
+	cache->free_generation = generation;
+	smp_store_release(&cache->generation, generation);
+}
+
+/**
+ * Release the memory of the chapters in the dead entries of a search list.
+ * This is called only by the loader thread, and only once no zone can still
+ * be searching a generation in which those entries were live.
+ *
+ * @param cache           the cache
+ * @param list            a search list of the current membership
+ * @param oldest_chapter  the oldest virtual chapter in the volume
+ **/
+static void release_dead_chapters(struct sparse_cache *cache,
+				  const struct search_list *list,
+				  uint64_t oldest_chapter)
+{
+	unsigned int i;
+	for (i = list->first_dead_entry; i < list->capacity; i++) {
+		struct cached_chapter_index *chapter =
+			&cache->chapters[list->entries[i]];
+		score_eviction(cache, chapter, oldest_chapter);
+		release_cached_chapter_index(chapter);
+	}
+}
+
+/**
+ * Read a chapter index into the free cache entry and publish a new
+ * generation of the membership with that entry replacing the least recently
+ * used chapter in the loader's search list. Any chapters beyond the current
+ * limit on the size of the cache are dropped from the membership too. This
+ * is called only by the loader thread, and only once no zone can still be
+ * using the free entry.
+ *
+ * @param cache            the cache
+ * @param volume           the volume from which to read the chapter index
+ * @param virtual_chapter  the chapter to cache, or UINT64_MAX to only apply
+ *                         the limit
+ * @param oldest_chapter   the oldest virtual chapter in the volume
+ **/
+static void publish_sparse_chapter(struct sparse_cache *cache,
+				   const struct volume *volume,
+				   uint64_t virtual_chapter,
+				   uint64_t oldest_chapter)
+{
+	struct search_list *list = cache->loader_list;
+	purge_search_list(list, cache->chapters, oldest_chapter);
+
+	unsigned int limit = get_sparse_cache_limit(cache);
+	bool trimmed = (list->first_dead_entry > limit);
+	if (trimmed) {
+		list->first_dead_entry = limit;
+	}
+
+	// The hook may have fallen out of the index, or an earlier request
+	// may already have cached the chapter.
+	bool wanted = ((virtual_chapter != UINT64_MAX) &&
+		       (virtual_chapter >= oldest_chapter));
+	struct search_list_iterator iterator =
+		iterate_search_list(list, cache->chapters);
+	while (wanted && has_next_chapter(&iterator)) {
+		if (get_next_chapter(&iterator)->virtual_chapter ==
+		    virtual_chapter) {
+			wanted = false;
+		}
+	}
+
+	struct cached_chapter_index *chapter =
+		&cache->chapters[cache->free_entry];
+	int result = (wanted ? cache_chapter_index(chapter, virtual_chapter,
+						   volume)
+			     : UDS_SUCCESS);
+	if (result != UDS_SUCCESS) {
+		log_warning_strerror(result,
+				     "cannot cache sparse chapter %llu",
+				     virtual_chapter);
+		wanted = false;
+	}
+	if (!wanted) {
+		if (trimmed) {
+			publish_search_list(cache);
+		}
+		return;
+	}
+
+	// Evict the least recently used live chapter if the cache is full,
+	// or replace a dead cache entry, by rotating the last list entry to
+	// the front, and then put the newly loaded entry in its place.
+	if (list->first_dead_entry == limit) {
+		list->first_dead_entry--;
+	}
+	uint8_t victim = rotate_search_list(list, cache->capacity);
+	score_eviction(cache, &cache->chapters[victim], oldest_chapter);
+	list->entries[0] = cache->free_entry;
+
+	cache->free_entry = victim;
+	publish_search_list(cache);
+}
+
+/**
+ * This is the driver function for the loader thread. It loops until
+ * stopped, caching each chapter which zone zero asks for.
+ *
+ * @param arg  the sparse cache
+ **/
+static void load_sparse_chapters(void *arg)
+{
+	struct sparse_cache *cache = arg;
+	lock_mutex(&cache->mutex);
+	for (;;) {
+		while (!cache->stop &&
+		       (cache->requested_chapter == UINT64_MAX) &&
+		       !cache->trim_requested &&
+		       !(cache->release_pending &&
+			 all_zones_adopted(cache, cache->generation))) {
+			wait_cond(&cache->cond, &cache->mutex);
+		}
+		if (cache->stop) {
+			break;
+		}
+
+		uint64_t virtual_chapter = cache->requested_chapter;
+		uint64_t oldest_chapter = cache->requested_oldest_chapter;
+		const struct volume *volume = cache->requested_volume;
+		if ((virtual_chapter == UINT64_MAX) && !cache->trim_requested) {
+			// Every zone has adopted the latest membership, so
+			// none can be searching the chapters it dropped.
+			struct search_list *list =
+				cache->published_lists[cache->generation % 2];
+			cache->release_pending = false;
+			unlock_mutex(&cache->mutex);
+			release_dead_chapters(cache, list, oldest_chapter);
+			lock_mutex(&cache->mutex);
+			continue;
+		}
+		cache->requested_chapter = UINT64_MAX;
+		cache->trim_requested = false;
+
+		// Zone zero's search order is only useful if it reflects the
+		// current membership; otherwise keep the published order.
+		if (cache->request_generation == cache->generation) {
+			copy_search_list(cache->request_list,
+					 cache->loader_list);
+		} else {
+			copy_search_list(cache->published_lists[cache->generation % 2],
+					 cache->loader_list);
+		}
+
+		// Wait until no zone is searching the free entry.
+		while (!cache->stop &&
+		       !all_zones_adopted(cache, cache->free_generation)) {
+			wait_cond(&cache->cond, &cache->mutex);
+		}
+		if (cache->stop) {
+			break;
+		}
+
+		unlock_mutex(&cache->mutex);
+		release_dead_chapters(cache, cache->loader_list,
+				      oldest_chapter);
+		publish_sparse_chapter(cache, volume, virtual_chapter,
+				       oldest_chapter);
+		lock_mutex(&cache->mutex);
+		cache->release_pending = true;
+	}
+	unlock_mutex(&cache->mutex);
+}
+
 /**********************************************************************/
 void free_sparse_cache(struct sparse_cache *cache)
 {
@@ -365,19 +704,32 @@ void free_sparse_cache(struct sparse_cache *cache)
 		return;
 	}
 
+	if (cache->loader != NULL) {
+		lock_mutex(&cache->mutex);
+		cache->stop = true;
+		broadcast_cond(&cache->cond);
+		unlock_mutex(&cache->mutex);
+		join_threads(cache->loader);
+	}
+
 	unsigned int i;
 	for (i = 0; i < cache->zone_count; i++) {
 		free_search_list(&cache->search_lists[i]);
 	}
+	for (i = 0; i < 2; i++) {
+		free_search_list(&cache->published_lists[i]);
+	}
+	free_search_list(&cache->request_list);
+	free_search_list(&cache->loader_list);
 
-	for (i = 0; i < cache->capacity; i++) {
+	for (i = 0; i <= cache->capacity; i++) {
 		struct cached_chapter_index *chapter = &cache->chapters[i];
 		destroy_cached_chapter_index(chapter);
 	}
 
-	destroy_barrier(&cache->begin_cache_update);
-	destroy_barrier(&cache->end_cache_update);
-	FREE(cache);
+	destroy_cond(&cache->cond);
+	destroy_mutex(&cache->mutex);
+	FREE_TAGGED(cache, MEMORY_TAG_SPARSE_CACHE);
 }
 
 
@@ -386,14 +738,7 @@ bool sparse_cache_contains(struct sparse_cache *cache,
 			   uint64_t virtual_chapter,
 			   unsigned int zone_number)
 {
-	/*
-	 * The correctness of the barriers depends on the invariant that
-	 * between calls to update_sparse_cache(), the answers this function
-	 * returns must never vary--the result for a given chapter must be
-	 * identical across zones. That invariant must be maintained even if
-	 * the chapter falls off the end of the volume, or if searching it is
-	 * disabled because of too many search misses.
-	 */
+	adopt_published_list(cache, zone_number);
 
 	// Get the chapter search order for this zone thread.
 	struct search_list_iterator iterator =
@@ -426,72 +771,44 @@ int update_sparse_cache(struct index_zone *zone, uint64_t virtual_chapter)
 	const struct index *index = zone->index;
 	struct sparse_cache *cache = index->volume->sparse_cache;
 
+	// If the cache has been made smaller than the number of chapters it
+	// holds, ask the loader to drop the least recently used ones.
+	if ((zone->id == ZONE_ZERO) && !READ_ONCE(cache->trim_requested) &&
+	    (cache->search_lists[ZONE_ZERO]->first_dead_entry >
+	     get_sparse_cache_limit(cache))) {
+		lock_mutex(&cache->mutex);
+		cache->trim_requested = true;
+		cache->requested_oldest_chapter = zone->oldest_virtual_chapter;
+		cache->requested_volume = index->volume;
+		broadcast_cond(&cache->cond);
+		unlock_mutex(&cache->mutex);
+	}
+
 	// If the chapter is already in the cache, we don't need to do a thing
 	// except update the search list order, which this check does.
 	if (sparse_cache_contains(cache, virtual_chapter, zone->id)) {
 		return UDS_SUCCESS;
 	}
 
-	// Wait for every zone thread to have reached its corresponding barrier
-	// request and invoked this function before starting to modify the
-	// cache.
-	enter_barrier(&cache->begin_cache_update, NULL);
-
-	/*
-	 * This is the start of the critical section: the zone zero thread is
-	 * captain, effectively holding an exclusive lock on the sparse cache.
-	 * All the other zone threads must do nothing between the two barriers.
-	 * They will wait at the end_cache_update barrier for the captain to
-	 * finish the update.
-	 */
-
-	int result = UDS_SUCCESS;
-	if (zone->id == ZONE_ZERO) {
-		// Purge invalid chapters from the LRU search list.
-		struct search_list *zone_zero_list =
-			cache->search_lists[ZONE_ZERO];
-		purge_search_list(zone_zero_list,
-				  cache->chapters,
-				  zone->oldest_virtual_chapter);
-
-		// First check that the desired chapter is still in the volume.
-		// If it's not, the hook fell out of the index and there's
-		// nothing to do for it.
-		if (virtual_chapter >= index->oldest_virtual_chapter) {
-			// Evict the least recently used live chapter, or
-			// replace a dead cache entry, all by rotating the the
-			// last list entry to the front.
-			struct cached_chapter_index *victim =
-				&cache->chapters[rotate_search_list(zone_zero_list,
-								    cache->capacity)];
-
-			// Check if the victim is already dead, and if it's
-			// not, add to the tally of evicted or invalidated
-			// cache entries.
-			score_eviction(zone, cache, victim);
-
-			// Read the index page bytes and initialize the page
-			// array.
-			result = cache_chapter_index(victim, virtual_chapter,
-						     index->volume);
-		}
-
-		// Copy the new search list state to all the other zone threads
-		// so they'll get the result of pruning and see the new
-		// chapter.
-		unsigned int z;
-		for (z = 1; z < cache->zone_count; z++) {
-			copy_search_list(zone_zero_list,
-					 cache->search_lists[z]);
-		}
+	// Only zone zero, whose search order decides which chapter to evict,
+	// asks for chapters to be loaded. If the chapter is no longer in the
+	// volume, the hook fell out of the index and there's nothing to do.
+	if ((zone->id != ZONE_ZERO) ||
+	    (virtual_chapter < index->oldest_virtual_chapter)) {
+		return UDS_SUCCESS;
 	}
 
-	// This is the end of the critical section. All cache invariants must
-	// have been restored--it will be shared/read-only again beyond the
-	// barrier.
-
-	enter_barrier(&cache->end_cache_update, NULL);
-	return result;
+	// Hand the chapter to the loader without waiting for it. A request
+	// which has not been started yet is superseded by this one.
+	lock_mutex(&cache->mutex);
+	copy_search_list(cache->search_lists[ZONE_ZERO], cache->request_list);
+	cache->request_generation = cache->zone_generations[ZONE_ZERO];
+	cache->requested_chapter = virtual_chapter;
+	cache->requested_oldest_chapter = zone->oldest_virtual_chapter;
+	cache->requested_volume = index->volume;
+	broadcast_cond(&cache->cond);
+	unlock_mutex(&cache->mutex);
+	return UDS_SUCCESS;
 }
 
 
@@ -509,55 +826,98 @@ int search_sparse_cache(struct index_zone *zone,
 	bool search_all = (*virtual_chapter_ptr == UINT64_MAX);
 	unsigned int chapters_searched = 0;
 
+	adopt_published_list(cache, zone_number);
+
 	// Get the chapter search order for this zone thread, searching the
-	// chapters from most recently hit to least recently hit.
+	// chapters from most recently hit to least recently hit. The chapters
+	// are searched in batches so that the delta lists of a batch can be
+	// prefetched together, overlapping their cache misses.
 	struct search_list_iterator iterator =
 		iterate_search_list(cache->search_lists[zone_number],
 				    cache->chapters);
 	while (has_next_chapter(&iterator)) {
-		struct cached_chapter_index *chapter =
-			get_next_chapter(&iterator);
+		struct cached_chapter_index *batch[SEARCH_BATCH_SIZE];
+		struct delta_index_page *pages[SEARCH_BATCH_SIZE];
+		unsigned int positions[SEARCH_BATCH_SIZE];
+		unsigned int batch_size = 0;
+		while (has_next_chapter(&iterator) &&
+		       (batch_size < SEARCH_BATCH_SIZE)) {
+			struct cached_chapter_index *chapter =
+				get_next_chapter(&iterator);
+
+			// Skip chapters no longer cached, or that have too
+			// many search misses.
+			if (should_skip_chapter_index(zone, chapter,
+						      *virtual_chapter_ptr)) {
+				continue;
+			}
 
-		// Skip chapters no longer cached, or that have too many search
-		// misses.
-		if (should_skip_chapter_index(zone, chapter,
-					      *virtual_chapter_ptr)) {
-			continue;
+			int result =
+				find_cached_chapter_index_page(chapter,
+							       cache->geometry,
+							       volume->index_page_map,
+							       name,
+							       &pages[batch_size]);
+			if (result != UDS_SUCCESS) {
+				return result;
+			}
+			prefetch_chapter_index_page(pages[batch_size],
+						    cache->geometry, name,
+						    false);
+			batch[batch_size] = chapter;
+			positions[batch_size] = iterator.next_entry;
+			batch_size++;
+
+			if (!search_all) {
+				// Only the chapter the caller specified can
+				// match.
+				break;
+			}
 		}
 
-		int result =
-			search_cached_chapter_index(chapter,
-						    cache->geometry,
-						    volume->index_page_map,
-						    name,
-						    record_page_ptr);
-		if (result != UDS_SUCCESS) {
-			return result;
+		unsigned int i;
+		for (i = 0; i < batch_size; i++) {
+			prefetch_chapter_index_page(pages[i], cache->geometry,
+						    name, true);
 		}
-		chapters_searched += 1;
 
-		// Did we find an index entry for the name?
-		if (*record_page_ptr != NO_CHAPTER_INDEX_ENTRY) {
-			if (zone_number == ZONE_ZERO) {
-				score_search_hit(cache, chapter);
+		for (i = 0; i < batch_size; i++) {
+			struct cached_chapter_index *chapter = batch[i];
+			int result = search_chapter_index_page(pages[i],
+							       cache->geometry,
+							       name,
+							       record_page_ptr);
+			if (result != UDS_SUCCESS) {
+				return result;
+			}
+			chapters_searched += 1;
+
+			// Did we find an index entry for the name?
+			if (*record_page_ptr != NO_CHAPTER_INDEX_ENTRY) {
+				if (zone_number == ZONE_ZERO) {
+					score_search_hit(cache, chapter);
+				}
+
+				// Move the chapter to the front of the search
+				// list.
+				rotate_search_list(iterator.list,
+						   positions[i]);
+
+				// Return a matching entry as soon as it is
+				// found. It might be a false collision that
+				// has a true match in another chapter, but
+				// that's a very rare case and not worth the
+				// extra search cost or complexity.
+				*virtual_chapter_ptr = chapter->virtual_chapter;
+				return UDS_SUCCESS;
 			}
 
-			// Move the chapter to the front of the search list.
-			rotate_search_list(iterator.list, iterator.next_entry);
-
-			// Return a matching entry as soon as it is found. It
-			// might be a false collision that has a true match in
-			// another chapter, but that's a very rare case and not
-			// worth the extra search cost or complexity.
-			*virtual_chapter_ptr = chapter->virtual_chapter;
-			return UDS_SUCCESS;
-		}
-
-		if (zone_number == ZONE_ZERO) {
-			score_search_miss(cache, chapter);
+			if (zone_number == ZONE_ZERO) {
+				score_search_miss(cache, chapter);
+			}
 		}
 
-		if (!search_all) {
+		if (!search_all && (batch_size > 0)) {
 			// We just searched the virtual chapter the caller
 			// specified and there was no match, so we're done.
 			break;
@@ -44,6 +44,13 @@ struct sparse_cache;
 // Bare declaration to avoid include dependency loops.
 struct index;
 
+/**
+ * The number of chapters every sparse cache may hold, or zero for each cache
+ * to hold the number its index was configured with. A cache which holds more
+ * chapters drops the least recently used ones as zone zero next updates it.
+ **/
+extern unsigned int sparse_cache_chapters;
+
 /**
  * Allocate and initialize a sparse chapter index cache.
  *
@@ -73,6 +80,21 @@ void free_sparse_cache(struct sparse_cache *cache);
  **/
 size_t get_sparse_cache_memory_size(const struct sparse_cache *cache);
 
+/**
+ * Get the virtual chapter numbers of the chapter indexes in a sparse chapter
+ * cache, most recently used first by zone zero. The cache is not locked, so
+ * the result is only a hint while the cache is in use.
+ *
+ * @param cache     the cache
+ * @param chapters  an array of limit entries to hold the chapter numbers
+ * @param limit     the maximum number of chapters to get
+ *
+ * @return the number of chapters found
+ **/
+unsigned int get_sparse_cache_chapters(struct sparse_cache *cache,
+				       uint64_t *chapters,
+				       unsigned int limit);
+
 
 /**
  * Check whether a sparse chapter index is present in the chapter cache. This
@@ -89,17 +111,16 @@ bool sparse_cache_contains(struct sparse_cache *cache,
 			   unsigned int zone_number);
 
 /**
- * Update the sparse cache to contain a chapter index.
- *
- * This function must be called by all the zone threads with the same chapter
- * numbers to correctly enter the thread barriers used to synchronize the
- * cache updates.
+ * Update the sparse cache to contain a chapter index. This never waits for
+ * the chapter index to be read or for any other zone thread: when called
+ * from zone zero it asks the cache's loader thread to add the chapter, which
+ * each zone will see once it has adopted the update.
  *
  * @param zone             the index zone
  * @param virtual_chapter  the virtual chapter number of the chapter index
  *
- * @return UDS_SUCCESS or an error code if the chapter index could not be
- *         read or decoded
+ * @return UDS_SUCCESS; a chapter index which cannot be read is logged and
+ *         left out of the cache
  **/
 int __must_check update_sparse_cache(struct index_zone *zone,
 				     uint64_t virtual_chapter);
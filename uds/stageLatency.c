@@ -0,0 +1,115 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "stageLatency.h"
+
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+
+#include "permassert.h"
+
+struct stage_latency_counters {
+	uint64_t samples[LATENCY_STAGE_COUNT];
+	uint64_t total_ns[LATENCY_STAGE_COUNT];
+	uint64_t buckets[LATENCY_STAGE_COUNT][LATENCY_BUCKETS];
+};
+
+/*
+ * Each CPU keeps its own counters so that recording never bounces a cache
+ * line between the index threads; a reader sums them.
+ */
+static DEFINE_PER_CPU(struct stage_latency_counters, stage_latencies);
+
+static const char *const latency_stage_names[] = {
+	"triage",
+	"zone_queue",
+	"open_chapter",
+	"volume_index",
+	"sparse_cache",
+	"page_read",
+	"callback_queue",
+};
+
+/**********************************************************************/
+void record_stage_latency(enum latency_stage stage, ktime_t start)
+{
+	ktime_t now = current_time_ns(CLOCK_MONOTONIC);
+	uint64_t latency = (now > start) ? (now - start) : 0;
+	unsigned int bucket = min((unsigned int) fls64(latency),
+				  (unsigned int) LATENCY_BUCKETS - 1);
+	this_cpu_inc(stage_latencies.samples[stage]);
+	this_cpu_add(stage_latencies.total_ns[stage], latency);
+	this_cpu_inc(stage_latencies.buckets[stage][bucket]);
+}
+
+/**********************************************************************/
+const char *get_latency_stage_name(enum latency_stage stage)
+{
+	STATIC_ASSERT(ARRAY_SIZE(latency_stage_names) == LATENCY_STAGE_COUNT);
+	return latency_stage_names[stage];
+}
+
+/**
+ * Sum a counter over every CPU.
+ *
+ * @param counter  The offset of the counter in the per-CPU counters
+ *
+ * @return The total of the counter
+ **/
+static uint64_t sum_latency_counter(size_t counter)
+{
+	uint64_t total = 0;
+	int cpu;
+	for_each_possible_cpu(cpu) {
+		const char *counters =
+			(const char *) per_cpu_ptr(&stage_latencies, cpu);
+		total += READ_ONCE(*(const uint64_t *) (counters + counter));
+	}
+	return total;
+}
+
+/**********************************************************************/
+ssize_t format_stage_latency(enum latency_stage stage,
+			     char *buf,
+			     size_t length)
+{
+	uint64_t samples =
+		sum_latency_counter(offsetof(struct stage_latency_counters,
+					     samples[stage]));
+	uint64_t total_ns =
+		sum_latency_counter(offsetof(struct stage_latency_counters,
+					     total_ns[stage]));
+	ssize_t written = scnprintf(buf, length,
+				    "samples %llu\ntotal_ns %llu\n",
+				    samples, total_ns);
+	// Stop once every sample has been reported rather than printing the
+	// empty tail of the histogram.
+	uint64_t reported = 0;
+	unsigned int b;
+	for (b = 0; (b < LATENCY_BUCKETS) && (reported < samples); b++) {
+		uint64_t count =
+			sum_latency_counter(offsetof(struct stage_latency_counters,
+						     buckets[stage][b]));
+		written += scnprintf(buf + written, length - written,
+				     "%llu %llu\n", 1ULL << b, count);
+		reported += count;
+	}
+	return written;
+}
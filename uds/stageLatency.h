@@ -0,0 +1,94 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef STAGE_LATENCY_H
+#define STAGE_LATENCY_H
+
+#include "compiler.h"
+#include "timeUtils.h"
+#include "typeDefs.h"
+
+/**
+ * The stages of a request's trip through the index whose latencies are
+ * histogrammed. The queue stages measure from the time the request was
+ * enqueued until its worker picks it up; the search stages measure the
+ * search alone.
+ **/
+enum latency_stage {
+	/* Waiting on the triage queue and triaging */
+	LATENCY_TRIAGE,
+	/* Waiting on a zone queue */
+	LATENCY_ZONE_QUEUE,
+	/* Searching the open chapter and the unwritten closed chapters */
+	LATENCY_OPEN_CHAPTER,
+	/* Looking the name up in the volume index */
+	LATENCY_VOLUME_INDEX,
+	/* Searching the sparse chapter index cache */
+	LATENCY_SPARSE_CACHE,
+	/* Waiting for a volume page cache miss to be read */
+	LATENCY_PAGE_READ,
+	/* Waiting on the callback queue */
+	LATENCY_CALLBACK_QUEUE,
+	LATENCY_STAGE_COUNT,
+};
+
+enum {
+	/*
+	 * Bucket b counts latencies of fewer than 2^b nanoseconds which were
+	 * not counted by bucket b - 1; the last bucket counts everything
+	 * longer.
+	 */
+	LATENCY_BUCKETS = 40,
+};
+
+/**
+ * Record the latency of a stage of a request. The histograms are kept per
+ * CPU and are not reset, so this is cheap enough to be left on all the time.
+ *
+ * @param stage  The stage which finished
+ * @param start  The monotonic time, in nanoseconds, at which it started
+ **/
+void record_stage_latency(enum latency_stage stage, ktime_t start);
+
+/**
+ * Get the name of a stage, for reporting.
+ *
+ * @param stage  The stage
+ *
+ * @return The name of the stage
+ **/
+const char *get_latency_stage_name(enum latency_stage stage);
+
+/**
+ * Format the histogram of a stage for sysfs. The first two lines give the
+ * number of samples and their total latency in nanoseconds; each following
+ * line gives the exclusive upper bound, in nanoseconds, of a bucket and the
+ * number of samples it holds, up to the last non-empty bucket.
+ *
+ * @param stage   The stage
+ * @param buf     The buffer to format into
+ * @param length  The size of the buffer
+ *
+ * @return The number of characters written
+ **/
+ssize_t format_stage_latency(enum latency_stage stage,
+			     char *buf,
+			     size_t length);
+
+#endif /* STAGE_LATENCY_H */
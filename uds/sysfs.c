@@ -25,17 +25,29 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 
+#include "atomicDefs.h"
+#include "bufferedReader.h"
+#include "index.h"
+#include "indexState.h"
+#include "indexZone.h"
 #include "logger.h"
+#include "masterIndexOps.h"
 #include "memoryAlloc.h"
+#include "pageCache.h"
+#include "sparseCache.h"
+#include "stageLatency.h"
 #include "stringUtils.h"
 #include "uds.h"
+#include "volume.h"
 
 static struct {
 	struct kobject kobj; // /sys/uds
 	struct kobject parameter_kobj; // /sys/uds/parameter
+	struct kobject latency_kobj; // /sys/uds/latency
 	// These flags are used to ensure a clean shutdown
 	bool flag; // /sys/uds
 	bool parameter_flag; // /sys/uds/parameter
+	bool latency_flag; // /sys/uds/latency
 } object_root;
 
 /**********************************************************************/
@@ -99,7 +111,17 @@ static struct kobj_type empty_object_type = {
 /**********************************************************************/
 // This is the the code for the /sys/<module_name>/parameter directory.
 //
+// <dir>/full_checkpoint_interval  checkpoints per full volume index save
 // <dir>/log_level                 UDS_LOG_LEVEL
+// <dir>/max_read_ahead            blocks read ahead of sequential reads
+// <dir>/open_chapters_per_zone    open chapter buffers per zone for new indexes
+// <dir>/page_cache_chapters       page cache size in chapters (0: configured)
+// <dir>/page_cache_policy         lru or slru
+// <dir>/replay_chapters_done      chapters replayed by the latest rebuild
+// <dir>/replay_chapters_total     chapters to replay in the latest rebuild
+// <dir>/sparse_cache_chapters     sparse cache size in chapters (0: configured)
+// <dir>/volume_index_filter_bits  filter bits per entry for new indexes
+// <dir>/volume_read_threads       volume read threads (0: as opened)
 //
 /**********************************************************************/
 
@@ -107,6 +129,8 @@ struct parameter_attribute {
 	struct attribute attr;
 	const char *(*show_string)(void);
 	void (*store_string)(const char *);
+	// A numeric parameter, used if there are no string functions
+	unsigned int *value;
 };
 
 /**********************************************************************/
@@ -117,6 +141,8 @@ parameter_show(struct kobject *kobj, struct attribute *attr, char *buf)
 		container_of(attr, struct parameter_attribute, attr);
 	if (pa->show_string != NULL) {
 		return sprintf(buf, "%s\n", pa->show_string());
+	} else if (pa->value != NULL) {
+		return sprintf(buf, "%u\n", READ_ONCE(*pa->value));
 	} else {
 		return -EINVAL;
 	}
@@ -129,17 +155,28 @@ static ssize_t parameter_store(struct kobject *kobj,
 			       size_t length)
 {
 	char *string;
+	unsigned int value;
+	int result;
 	struct parameter_attribute *pa =
 		container_of(attr, struct parameter_attribute, attr);
-	if (pa->store_string == NULL) {
+	if ((pa->store_string == NULL) && (pa->value == NULL)) {
 		return -EINVAL;
 	}
 	string = buffer_to_string(buf, length);
 	if (string == NULL) {
 		return -ENOMEM;
 	}
-	pa->store_string(string);
+	if (pa->store_string != NULL) {
+		pa->store_string(string);
+		FREE(string);
+		return length;
+	}
+	result = string_to_unsigned_int(string, &value);
 	FREE(string);
+	if (result != UDS_SUCCESS) {
+		return -EINVAL;
+	}
+	WRITE_ONCE(*pa->value, value);
 	return length;
 }
 
@@ -165,8 +202,94 @@ static struct parameter_attribute log_level_attr = {
 	.store_string = parameter_store_log_level,
 };
 
+/**********************************************************************/
+
+static const char *parameter_show_page_cache_policy(void)
+{
+	return get_page_cache_policy_name(get_page_cache_policy());
+}
+
+/**********************************************************************/
+
+static void parameter_store_page_cache_policy(const char *string)
+{
+	enum page_cache_policy policy;
+	if (parse_page_cache_policy(string, &policy) != UDS_SUCCESS) {
+		log_warning("unknown page cache policy: %s", string);
+		return;
+	}
+	set_page_cache_policy(policy);
+}
+
+/**********************************************************************/
+
+static struct parameter_attribute page_cache_policy_attr = {
+	.attr = { .name = "page_cache_policy", .mode = 0600 },
+	.show_string = parameter_show_page_cache_policy,
+	.store_string = parameter_store_page_cache_policy,
+};
+
+/**********************************************************************/
+
+static struct parameter_attribute full_checkpoint_interval_attr = {
+	.attr = { .name = "full_checkpoint_interval", .mode = 0600 },
+	.value = &full_checkpoint_interval,
+};
+
+static struct parameter_attribute max_read_ahead_attr = {
+	.attr = { .name = "max_read_ahead", .mode = 0600 },
+	.value = &buffered_reader_max_read_ahead,
+};
+
+static struct parameter_attribute open_chapters_per_zone_attr = {
+	.attr = { .name = "open_chapters_per_zone", .mode = 0600 },
+	.value = &open_chapters_per_zone,
+};
+
+static struct parameter_attribute page_cache_chapters_attr = {
+	.attr = { .name = "page_cache_chapters", .mode = 0600 },
+	.value = &page_cache_chapters,
+};
+
+static struct parameter_attribute sparse_cache_chapters_attr = {
+	.attr = { .name = "sparse_cache_chapters", .mode = 0600 },
+	.value = &sparse_cache_chapters,
+};
+
+static struct parameter_attribute volume_index_filter_bits_attr = {
+	.attr = { .name = "volume_index_filter_bits", .mode = 0600 },
+	.value = &volume_index_filter_bits,
+};
+
+static struct parameter_attribute volume_read_threads_attr = {
+	.attr = { .name = "volume_read_threads", .mode = 0600 },
+	.value = &volume_read_threads,
+};
+
+
+static struct parameter_attribute replay_chapters_done_attr = {
+	.attr = { .name = "replay_chapters_done", .mode = 0400 },
+	.value = &replay_chapters_done,
+};
+
+
+static struct parameter_attribute replay_chapters_total_attr = {
+	.attr = { .name = "replay_chapters_total", .mode = 0400 },
+	.value = &replay_chapters_total,
+};
+
 static struct attribute *parameter_attrs[] = {
+	&full_checkpoint_interval_attr.attr,
 	&log_level_attr.attr,
+	&max_read_ahead_attr.attr,
+	&open_chapters_per_zone_attr.attr,
+	&page_cache_chapters_attr.attr,
+	&page_cache_policy_attr.attr,
+	&replay_chapters_done_attr.attr,
+	&replay_chapters_total_attr.attr,
+	&sparse_cache_chapters_attr.attr,
+	&volume_index_filter_bits_attr.attr,
+	&volume_read_threads_attr.attr,
 	NULL,
 };
 
@@ -181,6 +304,79 @@ static struct kobj_type parameter_object_type = {
 	.default_attrs = parameter_attrs,
 };
 
+/**********************************************************************/
+// This is the the code for the /sys/<module_name>/latency directory, which
+// holds a read-only histogram of the request latency of each index stage.
+//
+// <dir>/callback_queue  waiting for the callback thread
+// <dir>/open_chapter    searching open and unwritten chapters
+// <dir>/page_read       waiting for a page cache miss to be read
+// <dir>/sparse_cache    searching the sparse chapter index cache
+// <dir>/triage          waiting for and doing sparse triage
+// <dir>/volume_index    looking up names in the volume index
+// <dir>/zone_queue      waiting for a zone thread
+//
+/**********************************************************************/
+
+struct latency_attribute {
+	struct attribute attr;
+	enum latency_stage stage;
+};
+
+/**********************************************************************/
+static ssize_t
+latency_show(struct kobject *kobj, struct attribute *attr, char *buf)
+{
+	struct latency_attribute *la =
+		container_of(attr, struct latency_attribute, attr);
+	return format_stage_latency(la->stage, buf, PAGE_SIZE);
+}
+
+/**********************************************************************/
+static ssize_t latency_store(struct kobject *kobj,
+			     struct attribute *attr,
+			     const char *buf,
+			     size_t length)
+{
+	return -EINVAL;
+}
+
+#define LATENCY_ATTRIBUTE(NAME, STAGE)			\
+	static struct latency_attribute NAME##_attr = {	\
+		.attr = { .name = #NAME, .mode = 0444 },	\
+		.stage = STAGE,					\
+	}
+
+LATENCY_ATTRIBUTE(callback_queue, LATENCY_CALLBACK_QUEUE);
+LATENCY_ATTRIBUTE(open_chapter, LATENCY_OPEN_CHAPTER);
+LATENCY_ATTRIBUTE(page_read, LATENCY_PAGE_READ);
+LATENCY_ATTRIBUTE(sparse_cache, LATENCY_SPARSE_CACHE);
+LATENCY_ATTRIBUTE(triage, LATENCY_TRIAGE);
+LATENCY_ATTRIBUTE(volume_index, LATENCY_VOLUME_INDEX);
+LATENCY_ATTRIBUTE(zone_queue, LATENCY_ZONE_QUEUE);
+
+static struct attribute *latency_attrs[] = {
+	&callback_queue_attr.attr,
+	&open_chapter_attr.attr,
+	&page_read_attr.attr,
+	&sparse_cache_attr.attr,
+	&triage_attr.attr,
+	&volume_index_attr.attr,
+	&zone_queue_attr.attr,
+	NULL,
+};
+
+static struct sysfs_ops latency_ops = {
+	.show = latency_show,
+	.store = latency_store,
+};
+
+static struct kobj_type latency_object_type = {
+	.release = empty_release,
+	.sysfs_ops = &latency_ops,
+	.default_attrs = latency_attrs,
+};
+
 /**********************************************************************/
 int init_sysfs(void)
 {
@@ -197,6 +393,14 @@ int init_sysfs(void)
 				     "parameter");
 		if (result == 0) {
 			object_root.parameter_flag = true;
+			kobject_init(&object_root.latency_kobj,
+				     &latency_object_type);
+			result = kobject_add(&object_root.latency_kobj,
+					     &object_root.kobj,
+					     "latency");
+		}
+		if (result == 0) {
+			object_root.latency_flag = true;
 		}
 	}
 	if (result != 0) {
@@ -208,6 +412,9 @@ int init_sysfs(void)
 /**********************************************************************/
 void put_sysfs()
 {
+	if (object_root.latency_flag) {
+		kobject_put(&object_root.latency_kobj);
+	}
 	if (object_root.parameter_flag) {
 		kobject_put(&object_root.parameter_kobj);
 	}
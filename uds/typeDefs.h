@@ -33,6 +33,7 @@
 
 typedef unsigned char byte;
 
+#ifdef __KERNEL__
 #define CHAR_BIT 8
 
 #define INT64_MAX  (9223372036854775807L)
@@ -53,5 +54,10 @@ typedef unsigned char byte;
 
 typedef unsigned long uintmax_t;
 #define PRIuMAX "lu"
+#else
+// The userspace build gets these from the C library.
+#include <inttypes.h>
+#include <limits.h>
+#endif // __KERNEL__
 
 #endif /* TYPE_DEFS_H */
@@ -65,8 +65,8 @@ enum uds_status_codes {
 	UDS_CORRUPT_DATA = UDS_ERROR_CODE_BASE + 12,
 	/** Short read due to truncated file */
 	UDS_SHORT_READ = UDS_ERROR_CODE_BASE + 13,
-	/** Unused */
-	UDS_UNUSED_CODE_14 = UDS_ERROR_CODE_BASE + 14,
+	/** The index was saved with a different nonce */
+	UDS_INDEX_NONCE_MISMATCH = UDS_ERROR_CODE_BASE + 14,
 	/** Internal resource limits exceeded */
 	UDS_RESOURCE_LIMIT_EXCEEDED = UDS_ERROR_CODE_BASE + 15,
 	/** Memory overflow due to storage failure */
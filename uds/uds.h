@@ -126,6 +126,24 @@ struct uds_chunk_name {
 	unsigned char name[UDS_CHUNK_NAME_SIZE];
 };
 
+/**
+ * A description of how an index assigns chunk names to its zones, so that a
+ * client may arrange its own work to match. The fields are private to UDS;
+ * use #uds_get_chunk_name_zone to apply the map.
+ **/
+struct uds_zone_map {
+	/** The number of zones */
+	unsigned int zone_count;
+	/** The sparse sample rate, or 0 if no names are sampled */
+	unsigned int sparse_sample_rate;
+	/** How unsampled names (0) and sampled names (1) are assigned */
+	struct {
+		unsigned int address_bits;
+		unsigned int delta_lists;
+		unsigned int lists_per_zone;
+	} parts[2];
+};
+
 /**
  * Metadata to associate with a chunk name.
  **/
@@ -161,6 +179,15 @@ struct uds_parameters {
 		.checkpoint_frequency = 0,	\
 	}
 
+/**
+ * The number of chapter age buckets in #uds_index_stats and
+ * #uds_query_stats. The age of a chapter is the number of chapters which
+ * have been opened since it was. Bucket zero counts the open chapter, and
+ * bucket N counts chapters with ages from 2^(N-1) up to but not including
+ * 2^N. The last bucket also counts any older chapters.
+ **/
+enum { UDS_CHAPTER_AGE_BUCKETS = 32 };
+
 /**
  * Index statistics
  *
@@ -179,6 +206,30 @@ struct uds_index_stats {
 	uint64_t entries_discarded;
 	/** The number of checkpoints done this session */
 	uint64_t checkpoints;
+	/** The number of volume page lookups which found the page cached */
+	uint64_t page_cache_hits;
+	/** The number of volume page lookups which had to read the page */
+	uint64_t page_cache_misses;
+};
+
+/**
+ * Index hit age statistics
+ *
+ * These statistics describe how old the chapters which satisfy searches
+ * are, which shows how the hit rate depends on the size of the index.
+ **/
+struct uds_index_age_stats {
+	/** The number of chapters the index can hold */
+	uint64_t chapters;
+	/** The number of posts, updates, and queries which searched the index */
+	uint64_t searches;
+	/**
+	 * The number of searches which found the name, by the age of the
+	 * chapter it was found in. Since an index of 2^N chapters holds ages
+	 * below 2^N, the sum of the first N + 1 buckets is the number of
+	 * these hits an index of that size would have found.
+	 **/
+	uint64_t hits_by_age[UDS_CHAPTER_AGE_BUCKETS];
 };
 
 /**
@@ -256,6 +307,34 @@ struct uds_context_stats {
 	uint64_t requests;
 };
 
+/**
+ * Bulk query statistics
+ *
+ * These statistics describe the chunk names passed to
+ * #uds_query_chunk_names. Each call adds to them, so a caller can query a
+ * large dataset in many calls and read the totals at the end.
+ **/
+struct uds_query_stats {
+	/** The number of chunk names queried */
+	uint64_t queries;
+	/** The number of chunk names found in the index */
+	uint64_t found;
+	/**
+	 * The number of chunk names found in chapters which are still in
+	 * memory and have not been committed to disk
+	 **/
+	uint64_t found_in_memory;
+	/** The number of chunk names found in the dense part of the index */
+	uint64_t found_dense;
+	/** The number of chunk names found in the sparse part of the index */
+	uint64_t found_sparse;
+	/**
+	 * The number of chunk names found, by the age of the chapter they
+	 * were found in
+	 **/
+	uint64_t found_by_age[UDS_CHAPTER_AGE_BUCKETS];
+};
+
 struct uds_request;
 
 /**
@@ -361,6 +440,59 @@ void uds_configuration_set_sparse(struct uds_configuration *conf, bool sparse);
  **/
 bool __must_check uds_configuration_get_sparse(struct uds_configuration *conf);
 
+/**
+ * Sets the sparse sample rate of a sparse index configuration: one in this
+ * many chunk names is kept as a hook, by which the sparse chapters can be
+ * found. A lower rate finds more duplicates in old data but takes more index
+ * memory. An existing index is loaded with the rate it was saved with unless
+ * a rate is set here. It may then be loaded with a different rate if it is
+ * allowed to rebuild, in which case its volume index is rebuilt at the new
+ * rate, provided that it still fits in the space reserved to save it.
+ *
+ * @param [in,out] conf  The configuration to change
+ * @param [in] rate      The sparse sample rate
+ **/
+void uds_configuration_set_sparse_sample_rate(struct uds_configuration *conf,
+					      unsigned int rate);
+
+/**
+ * Gets the sparse sample rate of an index configuration.
+ *
+ * @param [in] conf  The configuration to check
+ *
+ * @return  The sparse sample rate, or 0 if the configuration is not sparse
+ **/
+unsigned int __must_check
+uds_configuration_get_sparse_sample_rate(struct uds_configuration *conf);
+
+/**
+ * Selects the chapter index page format of an index configuration. A compact
+ * chapter index uses fewer address bits for each entry, so it packs more
+ * entries into each index page and needs fewer index pages per chapter, at
+ * the cost of more record page reads for names which are not in a chapter.
+ * The format is fixed when the index is created, and an existing index is
+ * always loaded in the format it was created with.
+ *
+ * @param [in,out] conf   The configuration to change
+ * @param [in] compact    If <code>true</code>, request compact chapter
+ *                        index pages; if <code>false</code>, request the
+ *                        default format.
+ **/
+void uds_configuration_set_compact_chapter_index(struct uds_configuration *conf,
+						 bool compact);
+
+/**
+ * Tests whether an index configuration specifies compact chapter index
+ * pages.
+ *
+ * @param [in] conf  The configuration to check
+ *
+ * @return  Returns <code>true</code> if the configuration uses compact
+ *          chapter index pages
+ **/
+bool __must_check
+uds_configuration_get_compact_chapter_index(struct uds_configuration *conf);
+
 /**
  * Sets an index configuration's nonce.
  *
@@ -557,6 +689,43 @@ int __must_check uds_get_index_configuration(struct uds_index_session *session,
 int __must_check uds_get_index_stats(struct uds_index_session *session,
 				     struct uds_index_stats *stats);
 
+/**
+ * Fetches the map of chunk names to zones of the index of the given index
+ * session. The map does not change while the index is open.
+ *
+ * @param [in]  session The session
+ * @param [out] map     The zone map to fill
+ *
+ * @return              Either #UDS_SUCCESS or an error code
+ **/
+int __must_check uds_get_index_zone_map(struct uds_index_session *session,
+					struct uds_zone_map *map);
+
+/**
+ * Gets the zone of an index to which a chunk name is routed. This may be
+ * called from any thread, even when the index is not open.
+ *
+ * @param map   The zone map of the index
+ * @param name  The chunk name
+ *
+ * @return      The zone of the chunk name
+ **/
+unsigned int __must_check
+uds_get_chunk_name_zone(const struct uds_zone_map *map,
+			const struct uds_chunk_name *name);
+
+/**
+ * Fetches the hit age statistics for the given index session.
+ *
+ * @param [in]  session The session
+ * @param [out] stats   The hit age statistics structure to fill
+ *
+ * @return              Either #UDS_SUCCESS or an error code
+ **/
+int __must_check
+uds_get_index_age_stats(struct uds_index_session *session,
+			struct uds_index_age_stats *stats);
+
 /**
  * Fetches index session statistics for the given index session.
  *
@@ -632,6 +801,49 @@ enum { UDS_STRING_ERROR_BUFSIZE = 128 };
  * @return              Either #UDS_SUCCESS or an error code
  **/
 int __must_check uds_start_chunk_operation(struct uds_request *request);
+
+/**
+ * Start a batch of chunk operations. Each operation is handled exactly as if
+ * it had been passed to #uds_start_chunk_operation, but the whole batch is
+ * routed to the index zones in one pass, so each zone is handed its share of
+ * the batch and woken at most once.
+ *
+ * Unlike #uds_start_chunk_operation, an operation which cannot be started is
+ * completed through its callback (if it has one) with the error in its
+ * <code>status</code> field before this function returns.
+ *
+ * @param [in] requests  The operations, each prepared as for
+ *                       #uds_start_chunk_operation
+ * @param [in] count     The number of operations
+ *
+ * @return              #UDS_SUCCESS if every operation was started, or the
+ *                      error for the first one which was not
+ **/
+int uds_start_chunk_operations(struct uds_request *requests[],
+			       unsigned int count);
+
+/**
+ * Look up a batch of chunk names in an index without changing it, and add
+ * what was found to a set of query statistics. This is meant for estimating
+ * how well a dataset would deduplicate against an existing index. Each name
+ * is handled like a #UDS_QUERY operation without the <code>update</code>
+ * flag, except that the lookups also leave the recency of the volume page
+ * cache alone. The names are spread across the index zones and looked up
+ * concurrently, and this function returns when all of them have been looked
+ * up.
+ *
+ * @param [in]     session  The index session
+ * @param [in]     names    The chunk names to look up
+ * @param [in]     count    The number of chunk names
+ * @param [in,out] stats    The statistics to add the results to
+ *
+ * @return              #UDS_SUCCESS if every name was looked up, or the
+ *                      error for the first one which was not
+ **/
+int __must_check uds_query_chunk_names(struct uds_index_session *session,
+				       const struct uds_chunk_name names[],
+				       unsigned int count,
+				       struct uds_query_stats *stats);
 /** @} */
 
 #endif /* UDS_H */
@@ -120,6 +120,8 @@ int uds_initialize_configuration(struct uds_configuration **user_config,
 	(*user_config)->bytes_per_page = DEFAULT_BYTES_PER_PAGE;
 	(*user_config)->sparse_sample_rate = DEFAULT_SPARSE_SAMPLE_RATE;
 	(*user_config)->nonce = 0;
+	(*user_config)->chapter_mean_delta_bits =
+		DEFAULT_CHAPTER_MEAN_DELTA_BITS;
 	return UDS_SUCCESS;
 }
 
@@ -158,6 +160,42 @@ bool uds_configuration_get_sparse(struct uds_configuration *user_config)
 	return user_config->sparse_chapters_per_volume > 0;
 }
 
+/**********************************************************************/
+void
+uds_configuration_set_sparse_sample_rate(struct uds_configuration *user_config,
+					 unsigned int rate)
+{
+	if (uds_configuration_get_sparse(user_config)) {
+		user_config->sparse_sample_rate = rate;
+		user_config->change_sparse_sample_rate = true;
+	}
+}
+
+/**********************************************************************/
+unsigned int
+uds_configuration_get_sparse_sample_rate(struct uds_configuration *user_config)
+{
+	return user_config->sparse_sample_rate;
+}
+
+/**********************************************************************/
+void
+uds_configuration_set_compact_chapter_index(struct uds_configuration *user_config,
+					    bool compact)
+{
+	user_config->chapter_mean_delta_bits =
+		(compact ? COMPACT_CHAPTER_MEAN_DELTA_BITS :
+			   DEFAULT_CHAPTER_MEAN_DELTA_BITS);
+}
+
+/**********************************************************************/
+bool
+uds_configuration_get_compact_chapter_index(struct uds_configuration *user_config)
+{
+	return (user_config->chapter_mean_delta_bits <
+		DEFAULT_CHAPTER_MEAN_DELTA_BITS);
+}
+
 /**********************************************************************/
 void uds_configuration_set_nonce(struct uds_configuration *user_config,
 				 uds_nonce_t nonce)
@@ -254,7 +292,8 @@ initialize_index_session_with_layout(struct uds_index_session *index_session,
 			write_index_config(layout,
 					   &index_session->user_config) :
 			verify_index_config(layout,
-					    &index_session->user_config));
+					    &index_session->user_config,
+					    (load_type == LOAD_REBUILD)));
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
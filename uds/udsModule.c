@@ -70,6 +70,10 @@ EXPORT_SYMBOL_GPL(uds_configuration_set_nonce);
 EXPORT_SYMBOL_GPL(uds_configuration_get_nonce);
 EXPORT_SYMBOL_GPL(uds_configuration_set_sparse);
 EXPORT_SYMBOL_GPL(uds_configuration_get_sparse);
+EXPORT_SYMBOL_GPL(uds_configuration_set_sparse_sample_rate);
+EXPORT_SYMBOL_GPL(uds_configuration_get_sparse_sample_rate);
+EXPORT_SYMBOL_GPL(uds_configuration_set_compact_chapter_index);
+EXPORT_SYMBOL_GPL(uds_configuration_get_compact_chapter_index);
 EXPORT_SYMBOL_GPL(uds_configuration_get_memory);
 EXPORT_SYMBOL_GPL(uds_configuration_get_chapters_per_volume);
 EXPORT_SYMBOL_GPL(uds_free_configuration);
@@ -83,14 +87,21 @@ EXPORT_SYMBOL_GPL(uds_destroy_index_session);
 EXPORT_SYMBOL_GPL(uds_flush_index_session);
 EXPORT_SYMBOL_GPL(uds_get_index_configuration);
 EXPORT_SYMBOL_GPL(uds_get_index_stats);
+EXPORT_SYMBOL_GPL(uds_get_index_zone_map);
+EXPORT_SYMBOL_GPL(uds_get_chunk_name_zone);
+EXPORT_SYMBOL_GPL(uds_get_index_age_stats);
 EXPORT_SYMBOL_GPL(uds_get_index_session_stats);
 EXPORT_SYMBOL_GPL(uds_string_error);
 EXPORT_SYMBOL_GPL(uds_start_chunk_operation);
+EXPORT_SYMBOL_GPL(uds_start_chunk_operations);
+EXPORT_SYMBOL_GPL(uds_query_chunk_names);
 
 EXPORT_SYMBOL_GPL(__uds_log_message);
+EXPORT_SYMBOL_GPL(adjust_tagged_memory_bytes);
 EXPORT_SYMBOL_GPL(alloc_sprintf);
 EXPORT_SYMBOL_GPL(allocate_memory);
 EXPORT_SYMBOL_GPL(allocate_memory_nowait);
+EXPORT_SYMBOL_GPL(allocate_tagged_memory);
 EXPORT_SYMBOL_GPL(append_to_buffer);
 EXPORT_SYMBOL_GPL(available_space);
 EXPORT_SYMBOL_GPL(buffer_length);
@@ -107,6 +118,7 @@ EXPORT_SYMBOL_GPL(fixed_sprintf);
 EXPORT_SYMBOL_GPL(free_buffer);
 EXPORT_SYMBOL_GPL(free_funnel_queue);
 EXPORT_SYMBOL_GPL(free_memory);
+EXPORT_SYMBOL_GPL(free_tagged_memory);
 EXPORT_SYMBOL_GPL(funnel_queue_poll);
 EXPORT_SYMBOL_GPL(get_boolean);
 EXPORT_SYMBOL_GPL(get_buffer_contents);
@@ -114,6 +126,8 @@ EXPORT_SYMBOL_GPL(get_byte);
 EXPORT_SYMBOL_GPL(get_bytes_from_buffer);
 EXPORT_SYMBOL_GPL(get_log_level);
 EXPORT_SYMBOL_GPL(get_memory_stats);
+EXPORT_SYMBOL_GPL(get_huge_memory_bytes);
+EXPORT_SYMBOL_GPL(get_tagged_memory_bytes);
 EXPORT_SYMBOL_GPL(get_uint16_le_from_buffer);
 EXPORT_SYMBOL_GPL(get_uint16_les_from_buffer);
 EXPORT_SYMBOL_GPL(get_uint32_le_from_buffer);
@@ -129,6 +143,7 @@ EXPORT_SYMBOL_GPL(lookup_thread);
 EXPORT_SYMBOL_GPL(make_buffer);
 EXPORT_SYMBOL_GPL(make_funnel_queue);
 EXPORT_SYMBOL_GPL(MurmurHash3_x64_128);
+EXPORT_SYMBOL_GPL(MurmurHash3_x64_128_multi);
 EXPORT_SYMBOL_GPL(parse_uint64);
 EXPORT_SYMBOL_GPL(pause_for_logger);
 EXPORT_SYMBOL_GPL(perform_once);
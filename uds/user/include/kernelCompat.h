@@ -0,0 +1,674 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+
+#ifndef KERNEL_COMPAT_H
+#define KERNEL_COMPAT_H
+
+/*
+ * The kernel interfaces used by the platform-independent UDS sources,
+ * implemented for a userspace build on top of libc and pthreads. Every
+ * <linux/...> and <asm/...> header which those sources include is a one-line
+ * wrapper around this file, so the generic code compiles unmodified. Only
+ * what the generic code actually uses is provided, and the semantics are the
+ * simplest ones that preserve correctness: there is a single "cpu" for
+ * per-cpu data, jiffies are milliseconds, and RCU read sections exclude
+ * synchronize_rcu() with a reader/writer lock.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * Compiler attributes and memory ordering.
+ */
+#define __must_check __attribute__((warn_unused_result))
+#define __maybe_unused __attribute__((unused))
+#define __always_unused __attribute__((unused))
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif
+#define noinline __attribute__((noinline))
+#define __packed __attribute__((packed))
+#define __printf(a, b) __attribute__((format(printf, a, b)))
+#define __init
+#define __exit
+#define fallthrough __attribute__((fallthrough))
+
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define L1_CACHE_BYTES 64
+#define ____cacheline_aligned __attribute__((aligned(L1_CACHE_BYTES)))
+#define __cacheline_aligned ____cacheline_aligned
+
+#define barrier() __asm__ __volatile__("" : : : "memory")
+#define smp_mb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *) &(x))
+#define WRITE_ONCE(x, val) (*(volatile __typeof__(x) *) &(x) = (val))
+#define smp_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+#define xchg(p, v) __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+#define cmpxchg(p, old, new)						\
+	__extension__({							\
+		__typeof__(*(p)) __old = (old);				\
+		__atomic_compare_exchange_n(p, &__old, new, false,	\
+					    __ATOMIC_SEQ_CST,		\
+					    __ATOMIC_SEQ_CST);		\
+		__old;							\
+	})
+
+#ifndef container_of
+#define container_of(ptr, type, member)					\
+	__extension__({							\
+		const __typeof__(((type *) 0)->member) *__mptr = (ptr);	\
+		(type *) ((char *) __mptr - offsetof(type, member));	\
+	})
+#endif
+
+/*
+ * Types.
+ */
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef s64 ktime_t;
+typedef unsigned int gfp_t;
+typedef u64 sector_t;
+
+/*
+ * <linux/kernel.h>
+ */
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(type, a, b) min((type) (a), (type) (b))
+#define max_t(type, a, b) max((type) (a), (type) (b))
+
+#define BUG() __builtin_trap()
+#define BUG_ON(condition)			\
+	do {					\
+		if (unlikely(condition)) {	\
+			BUG();			\
+		}				\
+	} while (0)
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1UL << PAGE_SHIFT)
+#define SECTOR_SHIFT 9
+#define SECTOR_SIZE (1 << SECTOR_SHIFT)
+
+#define MAX_ERRNO 4095
+#define IS_ERR_VALUE(x) ((unsigned long) (x) >= (unsigned long) -MAX_ERRNO)
+
+static inline void *ERR_PTR(long error)
+{
+	return (void *) error;
+}
+
+static inline long PTR_ERR(const void *ptr)
+{
+	return (long) ptr;
+}
+
+static inline bool IS_ERR(const void *ptr)
+{
+	return IS_ERR_VALUE(ptr);
+}
+
+static inline int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+	va_list args;
+	int written;
+
+	if (size == 0) {
+		return 0;
+	}
+	va_start(args, fmt);
+	written = vsnprintf(buf, size, fmt, args);
+	va_end(args);
+	if (written < 0) {
+		return 0;
+	}
+	return ((size_t) written >= size) ? (int) (size - 1) : written;
+}
+
+static inline void cond_resched(void)
+{
+}
+
+/*
+ * <linux/bitops.h>
+ */
+static inline int fls64(u64 word)
+{
+	return (word == 0) ? 0 : 64 - __builtin_clzll(word);
+}
+
+static inline unsigned long __ffs64(u64 word)
+{
+	return __builtin_ctzll(word);
+}
+
+#define ffs(x) __builtin_ffs(x)
+
+/*
+ * <linux/atomic.h>
+ */
+typedef struct {
+	int counter;
+} atomic_t;
+
+typedef struct {
+	s64 counter;
+} atomic64_t;
+
+#define ATOMIC_INIT(i) { (i) }
+#define ATOMIC64_INIT(i) { (i) }
+
+#define DEFINE_ATOMIC_OPS(prefix, type, int_type)			\
+static inline int_type prefix##_read(const type *v)			\
+{									\
+	return __atomic_load_n(&v->counter, __ATOMIC_RELAXED);		\
+}									\
+static inline int_type prefix##_read_acquire(const type *v)		\
+{									\
+	return __atomic_load_n(&v->counter, __ATOMIC_ACQUIRE);		\
+}									\
+static inline void prefix##_set(type *v, int_type i)			\
+{									\
+	__atomic_store_n(&v->counter, i, __ATOMIC_RELAXED);		\
+}									\
+static inline void prefix##_set_release(type *v, int_type i)		\
+{									\
+	__atomic_store_n(&v->counter, i, __ATOMIC_RELEASE);		\
+}									\
+static inline void prefix##_add(int_type i, type *v)			\
+{									\
+	__atomic_fetch_add(&v->counter, i, __ATOMIC_RELAXED);		\
+}									\
+static inline void prefix##_sub(int_type i, type *v)			\
+{									\
+	__atomic_fetch_sub(&v->counter, i, __ATOMIC_RELAXED);		\
+}									\
+static inline void prefix##_inc(type *v)				\
+{									\
+	prefix##_add(1, v);						\
+}									\
+static inline void prefix##_dec(type *v)				\
+{									\
+	prefix##_sub(1, v);						\
+}									\
+static inline int_type prefix##_add_return(int_type i, type *v)	\
+{									\
+	return __atomic_add_fetch(&v->counter, i, __ATOMIC_SEQ_CST);	\
+}									\
+static inline int_type prefix##_sub_return(int_type i, type *v)	\
+{									\
+	return __atomic_sub_fetch(&v->counter, i, __ATOMIC_SEQ_CST);	\
+}									\
+static inline int_type prefix##_inc_return(type *v)			\
+{									\
+	return prefix##_add_return(1, v);				\
+}									\
+static inline int_type prefix##_dec_return(type *v)			\
+{									\
+	return prefix##_sub_return(1, v);				\
+}									\
+static inline bool prefix##_dec_and_test(type *v)			\
+{									\
+	return prefix##_dec_return(v) == 0;				\
+}									\
+static inline int_type prefix##_cmpxchg(type *v, int_type old,		\
+					int_type new)			\
+{									\
+	return cmpxchg(&v->counter, old, new);				\
+}									\
+static inline int_type prefix##_xchg(type *v, int_type new)		\
+{									\
+	return xchg(&v->counter, new);					\
+}
+
+DEFINE_ATOMIC_OPS(atomic, atomic_t, int)
+DEFINE_ATOMIC_OPS(atomic64, atomic64_t, s64)
+
+#undef DEFINE_ATOMIC_OPS
+
+/*
+ * <linux/percpu.h>: a single cpu whose counters are updated atomically.
+ */
+#define DEFINE_PER_CPU(type, name) type name
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+#define per_cpu_ptr(ptr, cpu) ((void) (cpu), (ptr))
+#define this_cpu_add(var, value)					\
+	((void) __atomic_fetch_add(&(var), value, __ATOMIC_RELAXED))
+#define this_cpu_inc(var) this_cpu_add(var, 1)
+
+/*
+ * <asm/unaligned.h>
+ */
+#define DEFINE_UNALIGNED_ACCESS(bits)					\
+static inline u##bits get_unaligned_le##bits(const void *p)		\
+{									\
+	u##bits value;							\
+	memcpy(&value, p, sizeof(value));				\
+	return value;							\
+}									\
+static inline void put_unaligned_le##bits(u##bits value, void *p)	\
+{									\
+	memcpy(p, &value, sizeof(value));				\
+}									\
+static inline u##bits get_unaligned_be##bits(const void *p)		\
+{									\
+	return __builtin_bswap##bits(get_unaligned_le##bits(p));	\
+}									\
+static inline void put_unaligned_be##bits(u##bits value, void *p)	\
+{									\
+	put_unaligned_le##bits(__builtin_bswap##bits(value), p);	\
+}
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the userspace UDS build assumes a little-endian host"
+#endif
+
+DEFINE_UNALIGNED_ACCESS(16)
+DEFINE_UNALIGNED_ACCESS(32)
+DEFINE_UNALIGNED_ACCESS(64)
+
+#undef DEFINE_UNALIGNED_ACCESS
+
+/*
+ * <linux/ktime.h>, <linux/jiffies.h> and <linux/delay.h>
+ */
+#define MSEC_PER_SEC 1000L
+#define USEC_PER_SEC 1000000L
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_USEC 1000L
+
+static inline u64 clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (u64) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline u64 ktime_get_ns(void)
+{
+	return clock_ns(CLOCK_MONOTONIC);
+}
+
+static inline u64 ktime_get_real_ns(void)
+{
+	return clock_ns(CLOCK_REALTIME);
+}
+
+#define ns_to_ktime(ns) ((ktime_t) (ns))
+#define ktime_to_ns(kt) ((s64) (kt))
+#define ktime_sub(a, b) ((a) - (b))
+#define ktime_to_ms(kt) ((s64) (kt) / NSEC_PER_MSEC)
+
+#define HZ 1000
+#define nsecs_to_jiffies(ns) ((unsigned long) ((ns) / NSEC_PER_MSEC))
+#define jiffies_to_msecs(j) ((unsigned int) (j))
+
+static inline void msleep(unsigned int msecs)
+{
+	struct timespec ts = {
+		.tv_sec = msecs / MSEC_PER_SEC,
+		.tv_nsec = (msecs % MSEC_PER_SEC) * NSEC_PER_MSEC,
+	};
+	while (nanosleep(&ts, &ts) != 0) {
+	}
+}
+
+/*
+ * <linux/sched.h>: each thread has its own task structure.
+ */
+#define TASK_COMM_LEN 16
+
+struct task_struct {
+	pid_t pid;
+	char comm[TASK_COMM_LEN];
+};
+
+struct task_struct *get_current(void);
+#define current get_current()
+
+/*
+ * <linux/mutex.h>, <linux/spinlock.h> and <linux/semaphore.h>
+ */
+struct mutex {
+	pthread_mutex_t mutex;
+};
+
+#define DEFINE_MUTEX(name) \
+	struct mutex name = { .mutex = PTHREAD_MUTEX_INITIALIZER }
+
+static inline void mutex_init(struct mutex *mutex)
+{
+	pthread_mutex_init(&mutex->mutex, NULL);
+}
+
+static inline void mutex_lock(struct mutex *mutex)
+{
+	pthread_mutex_lock(&mutex->mutex);
+}
+
+static inline void mutex_unlock(struct mutex *mutex)
+{
+	pthread_mutex_unlock(&mutex->mutex);
+}
+
+typedef struct {
+	pthread_mutex_t mutex;
+} spinlock_t;
+
+#define DEFINE_SPINLOCK(name) \
+	spinlock_t name = { .mutex = PTHREAD_MUTEX_INITIALIZER }
+
+static inline void spin_lock_init(spinlock_t *lock)
+{
+	pthread_mutex_init(&lock->mutex, NULL);
+}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+	pthread_mutex_lock(&lock->mutex);
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+	pthread_mutex_unlock(&lock->mutex);
+}
+
+#define spin_lock_irqsave(lock, flags) ((void) (flags), spin_lock(lock))
+#define spin_unlock_irqrestore(lock, flags) \
+	((void) (flags), spin_unlock(lock))
+
+struct semaphore {
+	sem_t sem;
+};
+
+static inline void sema_init(struct semaphore *semaphore, int value)
+{
+	sem_init(&semaphore->sem, 0, value);
+}
+
+static inline int down_interruptible(struct semaphore *semaphore)
+{
+	return (sem_wait(&semaphore->sem) == 0) ? 0 : -EINTR;
+}
+
+static inline int down_trylock(struct semaphore *semaphore)
+{
+	return (sem_trywait(&semaphore->sem) == 0) ? 0 : 1;
+}
+
+static inline int down_timeout(struct semaphore *semaphore,
+			       unsigned long jiffies_timeout)
+{
+	u64 deadline = clock_ns(CLOCK_REALTIME)
+		+ (u64) jiffies_timeout * NSEC_PER_MSEC;
+	struct timespec ts = {
+		.tv_sec = deadline / NSEC_PER_SEC,
+		.tv_nsec = deadline % NSEC_PER_SEC,
+	};
+	while (sem_timedwait(&semaphore->sem, &ts) != 0) {
+		if (errno != EINTR) {
+			return -ETIME;
+		}
+	}
+	return 0;
+}
+
+static inline void up(struct semaphore *semaphore)
+{
+	sem_post(&semaphore->sem);
+}
+
+/*
+ * <linux/rculist.h>: readers hold a process-wide read lock, so that
+ * synchronize_rcu() need only take and drop the write lock.
+ */
+extern pthread_rwlock_t rcu_compat_lock;
+
+static inline void rcu_read_lock(void)
+{
+	pthread_rwlock_rdlock(&rcu_compat_lock);
+}
+
+static inline void rcu_read_unlock(void)
+{
+	pthread_rwlock_unlock(&rcu_compat_lock);
+}
+
+static inline void synchronize_rcu(void)
+{
+	pthread_rwlock_wrlock(&rcu_compat_lock);
+	pthread_rwlock_unlock(&rcu_compat_lock);
+}
+
+/*
+ * <linux/list.h>
+ */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD(name) struct list_head name = { &(name), &(name) }
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void list_add_tail(struct list_head *entry,
+				 struct list_head *head)
+{
+	entry->prev = head->prev;
+	entry->next = head;
+	head->prev->next = entry;
+	WRITE_ONCE(head->prev, entry);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+}
+
+static inline void list_del_init(struct list_head *entry)
+{
+	list_del(entry);
+	INIT_LIST_HEAD(entry);
+}
+
+static inline bool list_empty(const struct list_head *head)
+{
+	return READ_ONCE(head->next) == head;
+}
+
+#define list_add_tail_rcu list_add_tail
+#define list_del_rcu list_del
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_for_each_entry(pos, head, member)				\
+	for (pos = list_entry((head)->next, __typeof__(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = list_entry(pos->member.next, __typeof__(*pos), member))
+#define list_for_each_entry_rcu list_for_each_entry
+
+/*
+ * <linux/wait.h>: the waiter count lets waitqueue_active() be checked
+ * without the lock, as the kernel allows after a full barrier.
+ */
+struct wait_queue_head {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int waiters;
+};
+
+typedef struct wait_queue_head wait_queue_head_t;
+
+static inline void init_waitqueue_head(wait_queue_head_t *wq)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&wq->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&wq->mutex, NULL);
+	wq->waiters = 0;
+}
+
+static inline bool waitqueue_active(wait_queue_head_t *wq)
+{
+	return __atomic_load_n(&wq->waiters, __ATOMIC_SEQ_CST) > 0;
+}
+
+static inline void wake_up(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&wq->mutex);
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->mutex);
+}
+
+#define wait_event_interruptible_hrtimeout(wq, condition, timeout)	\
+	__extension__({							\
+		u64 __deadline = ktime_get_ns() + (timeout);		\
+		struct timespec __ts = {				\
+			.tv_sec = __deadline / NSEC_PER_SEC,		\
+			.tv_nsec = __deadline % NSEC_PER_SEC,		\
+		};							\
+		int __ret = 0;						\
+		pthread_mutex_lock(&(wq).mutex);			\
+		__atomic_add_fetch(&(wq).waiters, 1, __ATOMIC_SEQ_CST);	\
+		while (!(condition)) {					\
+			if (pthread_cond_timedwait(&(wq).cond,		\
+						   &(wq).mutex,		\
+						   &__ts) != 0) {	\
+				__ret = -ETIME;				\
+				break;					\
+			}						\
+		}							\
+		__atomic_sub_fetch(&(wq).waiters, 1, __ATOMIC_SEQ_CST);	\
+		pthread_mutex_unlock(&(wq).mutex);			\
+		__ret;							\
+	})
+
+#define wait_event_interruptible(wq, condition)				\
+	__extension__({							\
+		pthread_mutex_lock(&(wq).mutex);			\
+		__atomic_add_fetch(&(wq).waiters, 1, __ATOMIC_SEQ_CST);	\
+		while (!(condition)) {					\
+			pthread_cond_wait(&(wq).cond, &(wq).mutex);	\
+		}							\
+		__atomic_sub_fetch(&(wq).waiters, 1, __ATOMIC_SEQ_CST);	\
+		pthread_mutex_unlock(&(wq).mutex);			\
+		0;							\
+	})
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__)
+	__builtin_ia32_pause();
+#else
+	barrier();
+#endif
+}
+
+/*
+ * <linux/random.h>
+ */
+void prandom_bytes(void *buffer, size_t length);
+
+/*
+ * <linux/ratelimit.h>: rate limiting is not needed by the tools which use
+ * the userspace build, so every message is emitted.
+ */
+#define DEFAULT_RATELIMIT_INTERVAL 0
+#define DEFAULT_RATELIMIT_BURST 0
+#define DEFINE_RATELIMIT_STATE(name, interval, burst) int name
+#define __ratelimit(state) ((void) (state), 1)
+
+/*
+ * <linux/module.h>
+ */
+struct module {
+	const char *name;
+};
+
+extern struct module __this_module;
+#define THIS_MODULE (&__this_module)
+
+#define EXPORT_SYMBOL(symbol)
+#define EXPORT_SYMBOL_GPL(symbol)
+
+/*
+ * <linux/version.h>
+ */
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE KERNEL_VERSION(5, 18, 0)
+
+/*
+ * <linux/dm-bufio.h>: a minimal buffered block client over a file.
+ */
+struct dm_bufio_client;
+struct dm_buffer;
+
+void *dm_bufio_read(struct dm_bufio_client *client,
+		    sector_t block,
+		    struct dm_buffer **buffer_ptr);
+void *dm_bufio_new(struct dm_bufio_client *client,
+		   sector_t block,
+		   struct dm_buffer **buffer_ptr);
+void dm_bufio_prefetch(struct dm_bufio_client *client,
+		       sector_t block,
+		       unsigned int count);
+void dm_bufio_release(struct dm_buffer *buffer);
+void dm_bufio_forget(struct dm_bufio_client *client, sector_t block);
+void dm_bufio_mark_buffer_dirty(struct dm_buffer *buffer);
+int dm_bufio_write_dirty_buffers(struct dm_bufio_client *client);
+void dm_bufio_write_dirty_buffers_async(struct dm_bufio_client *client);
+void *dm_bufio_get_block_data(struct dm_buffer *buffer);
+void dm_bufio_client_destroy(struct dm_bufio_client *client);
+
+#endif /* KERNEL_COMPAT_H */
@@ -0,0 +1,394 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <linux/fs.h>
+
+#include "atomicDefs.h"
+#include "ioFactory.h"
+#include "logger.h"
+#include "memoryAlloc.h"
+
+/*
+ * A userspace IO Factory object controls access to an index stored in a file
+ * or on a block device, through a file descriptor.
+ */
+struct io_factory {
+	int fd;
+	atomic_t ref_count;
+};
+
+/*
+ * A dm_bufio_client replacement which reads and writes whole blocks with
+ * pread() and pwrite(). Buffers are not cached once released: the index
+ * keeps its own caches, and the C library's page cache sits below this one.
+ * A dirty buffer is written when it is released, or when the dirty buffers
+ * are flushed while it is still held.
+ */
+struct dm_bufio_client {
+	int fd;
+	size_t block_size;
+	off_t start;
+	struct mutex mutex;
+	struct list_head buffers;
+};
+
+struct dm_buffer {
+	struct dm_bufio_client *client;
+	struct list_head links;
+	sector_t block;
+	bool dirty;
+	byte *data;
+};
+
+/**********************************************************************/
+void get_io_factory(struct io_factory *factory)
+{
+	atomic_inc(&factory->ref_count);
+}
+
+/**********************************************************************/
+int make_io_factory(const char *path, struct io_factory **factory_ptr)
+{
+	int result;
+	struct io_factory *factory;
+	int fd = open(path, O_RDWR);
+	if (fd < 0) {
+		return log_error_strerror(errno, "cannot open %s", path);
+	}
+
+	result = ALLOCATE(1, struct io_factory, __func__, &factory);
+	if (result != UDS_SUCCESS) {
+		close(fd);
+		return result;
+	}
+
+	factory->fd = fd;
+	atomic_set_release(&factory->ref_count, 1);
+
+	*factory_ptr = factory;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+void put_io_factory(struct io_factory *factory)
+{
+	if (atomic_add_return(-1, &factory->ref_count) <= 0) {
+		close(factory->fd);
+		FREE(factory);
+	}
+}
+
+/**********************************************************************/
+size_t get_writable_size(struct io_factory *factory)
+{
+	struct stat statbuf;
+	uint64_t size;
+	if (fstat(factory->fd, &statbuf) != 0) {
+		return 0;
+	}
+	if (!S_ISBLK(statbuf.st_mode)) {
+		return statbuf.st_size;
+	}
+	return (ioctl(factory->fd, BLKGETSIZE64, &size) == 0) ? size : 0;
+}
+
+/**********************************************************************/
+int make_bufio(struct io_factory *factory,
+	       off_t offset,
+	       size_t block_size,
+	       unsigned int reserved_buffers __maybe_unused,
+	       struct dm_bufio_client **client_ptr)
+{
+	struct dm_bufio_client *client;
+	int result;
+	if (offset % SECTOR_SIZE != 0) {
+		return log_error_strerror(UDS_INCORRECT_ALIGNMENT,
+					  "offset %zd not multiple of %d",
+					  offset,
+					  SECTOR_SIZE);
+	}
+	if (block_size % UDS_BLOCK_SIZE != 0) {
+		return log_error_strerror(
+			UDS_INCORRECT_ALIGNMENT,
+			"block_size %zd not multiple of %d",
+			block_size,
+			UDS_BLOCK_SIZE);
+	}
+
+	result = ALLOCATE(1, struct dm_bufio_client, __func__, &client);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	client->fd = factory->fd;
+	client->block_size = block_size;
+	client->start = offset;
+	mutex_init(&client->mutex);
+	INIT_LIST_HEAD(&client->buffers);
+	*client_ptr = client;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int open_buffered_reader(struct io_factory *factory,
+			 off_t offset,
+			 size_t size,
+			 struct buffered_reader **reader_ptr)
+{
+	int result;
+	struct dm_bufio_client *client = NULL;
+	if (size % UDS_BLOCK_SIZE != 0) {
+		return log_error_strerror(
+			UDS_INCORRECT_ALIGNMENT,
+			"region size %zd is not multiple of %d",
+			size,
+			UDS_BLOCK_SIZE);
+	}
+
+	result = make_bufio(factory, offset, UDS_BLOCK_SIZE, 1, &client);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	result = make_buffered_reader(
+		factory, client, size / UDS_BLOCK_SIZE, reader_ptr);
+	if (result != UDS_SUCCESS) {
+		dm_bufio_client_destroy(client);
+	}
+	return result;
+}
+
+/**********************************************************************/
+int open_buffered_writer(struct io_factory *factory,
+			 off_t offset,
+			 size_t size,
+			 struct buffered_writer **writer_ptr)
+{
+	if (size % UDS_BLOCK_SIZE != 0) {
+		return log_error_strerror(UDS_INCORRECT_ALIGNMENT,
+					  "region size %zd is not multiple of %d",
+					  size,
+					  UDS_BLOCK_SIZE);
+	}
+
+	return make_buffered_writer(factory, offset, size, writer_ptr);
+}
+
+/**********************************************************************/
+static off_t get_buffer_offset(const struct dm_buffer *buffer)
+{
+	struct dm_bufio_client *client = buffer->client;
+	return client->start + (off_t) buffer->block * client->block_size;
+}
+
+/**
+ * Make a buffer for a block and add it to the client's list of held buffers.
+ *
+ * @param client      The client
+ * @param block       The block number
+ * @param buffer_ptr  A pointer to hold the new buffer
+ *
+ * @return the data of the buffer, or an ERR_PTR
+ **/
+static void *new_buffer(struct dm_bufio_client *client,
+			sector_t block,
+			struct dm_buffer **buffer_ptr)
+{
+	struct dm_buffer *buffer;
+	int result = ALLOCATE(1, struct dm_buffer, __func__, &buffer);
+	if (result != UDS_SUCCESS) {
+		return ERR_PTR(-ENOMEM);
+	}
+	result = ALLOCATE_IO_ALIGNED(client->block_size, byte, __func__,
+				     &buffer->data);
+	if (result != UDS_SUCCESS) {
+		FREE(buffer);
+		return ERR_PTR(-ENOMEM);
+	}
+	buffer->client = client;
+	buffer->block = block;
+	mutex_lock(&client->mutex);
+	list_add_tail(&buffer->links, &client->buffers);
+	mutex_unlock(&client->mutex);
+	*buffer_ptr = buffer;
+	return buffer->data;
+}
+
+/**
+ * Write a buffer to its block. The caller must hold the client mutex.
+ *
+ * @param buffer  The buffer to write
+ *
+ * @return 0 or a negative error code
+ **/
+static int write_buffer(struct dm_buffer *buffer)
+{
+	size_t size = buffer->client->block_size;
+	ssize_t written = pwrite(buffer->client->fd, buffer->data, size,
+				 get_buffer_offset(buffer));
+	if (written != (ssize_t) size) {
+		return (written < 0) ? -errno : -EIO;
+	}
+	buffer->dirty = false;
+	return 0;
+}
+
+/**********************************************************************/
+void *dm_bufio_new(struct dm_bufio_client *client,
+		   sector_t block,
+		   struct dm_buffer **buffer_ptr)
+{
+	return new_buffer(client, block, buffer_ptr);
+}
+
+/**********************************************************************/
+void *dm_bufio_read(struct dm_bufio_client *client,
+		    sector_t block,
+		    struct dm_buffer **buffer_ptr)
+{
+	struct dm_buffer *buffer;
+	ssize_t bytes_read;
+	byte *data = new_buffer(client, block, &buffer);
+	if (IS_ERR(data)) {
+		return data;
+	}
+
+	bytes_read = pread(client->fd, data, client->block_size,
+			   get_buffer_offset(buffer));
+	if (bytes_read != (ssize_t) client->block_size) {
+		int error = (bytes_read < 0) ? -errno : -EIO;
+		dm_bufio_release(buffer);
+		return ERR_PTR(error);
+	}
+	*buffer_ptr = buffer;
+	return data;
+}
+
+/**********************************************************************/
+void dm_bufio_prefetch(struct dm_bufio_client *client,
+		       sector_t block,
+		       unsigned int count)
+{
+	posix_fadvise(client->fd,
+		      client->start + (off_t) block * client->block_size,
+		      (off_t) count * client->block_size,
+		      POSIX_FADV_WILLNEED);
+}
+
+/**********************************************************************/
+void dm_bufio_release(struct dm_buffer *buffer)
+{
+	struct dm_bufio_client *client = buffer->client;
+	int result = 0;
+	mutex_lock(&client->mutex);
+	if (buffer->dirty) {
+		result = write_buffer(buffer);
+	}
+	list_del(&buffer->links);
+	mutex_unlock(&client->mutex);
+	if (result != 0) {
+		log_error_strerror(-result, "cannot write block %llu",
+				   (unsigned long long) buffer->block);
+	}
+	FREE(buffer->data);
+	FREE(buffer);
+}
+
+/**********************************************************************/
+void dm_bufio_forget(struct dm_bufio_client *client __always_unused,
+		     sector_t block __always_unused)
+{
+	// Buffers are freed when they are released, so there is nothing
+	// cached to forget.
+}
+
+/**********************************************************************/
+void dm_bufio_mark_buffer_dirty(struct dm_buffer *buffer)
+{
+	buffer->dirty = true;
+}
+
+/**
+ * Write all the dirty buffers held by a client.
+ *
+ * @param client  The client
+ *
+ * @return 0 or the first negative error code encountered
+ **/
+static int write_held_dirty_buffers(struct dm_bufio_client *client)
+{
+	struct dm_buffer *buffer;
+	int result = 0;
+	mutex_lock(&client->mutex);
+	list_for_each_entry(buffer, &client->buffers, links) {
+		if (buffer->dirty) {
+			int write_result = write_buffer(buffer);
+			if (result == 0) {
+				result = write_result;
+			}
+		}
+	}
+	mutex_unlock(&client->mutex);
+	return result;
+}
+
+/**********************************************************************/
+int dm_bufio_write_dirty_buffers(struct dm_bufio_client *client)
+{
+	int result = write_held_dirty_buffers(client);
+	if ((fdatasync(client->fd) != 0) && (result == 0)) {
+		result = -errno;
+	}
+	return result;
+}
+
+/**********************************************************************/
+void dm_bufio_write_dirty_buffers_async(struct dm_bufio_client *client)
+{
+	// Released buffers have already been written, so only held ones are
+	// left to start, and there is no way to report an error from here.
+	int result = write_held_dirty_buffers(client);
+	if (result != 0) {
+		log_error_strerror(-result, "cannot write dirty buffers");
+	}
+}
+
+/**********************************************************************/
+void *dm_bufio_get_block_data(struct dm_buffer *buffer)
+{
+	return buffer->data;
+}
+
+/**********************************************************************/
+void dm_bufio_client_destroy(struct dm_bufio_client *client)
+{
+	struct dm_buffer *buffer;
+	mutex_lock(&client->mutex);
+	list_for_each_entry(buffer, &client->buffers, links) {
+		log_warning("block %llu still held when destroying bufio client",
+			    (unsigned long long) buffer->block);
+	}
+	mutex_unlock(&client->mutex);
+	FREE(client);
+}
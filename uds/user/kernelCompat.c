@@ -0,0 +1,76 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "kernelCompat.h"
+
+/*
+ * The out-of-line parts of the kernel interfaces emulated by kernelCompat.h.
+ */
+
+struct module __this_module = {
+	.name = "uds",
+};
+
+pthread_rwlock_t rcu_compat_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static __thread struct task_struct current_task;
+static __thread bool current_task_valid;
+static __thread u64 random_state;
+
+/**********************************************************************/
+struct task_struct *get_current(void)
+{
+	if (unlikely(!current_task_valid)) {
+		current_task.pid = gettid();
+		prctl(PR_GET_NAME, current_task.comm, 0, 0, 0);
+		current_task_valid = true;
+	}
+	return &current_task;
+}
+
+/**
+ * Get the next value from this thread's xorshift64* generator, seeding it on
+ * first use.
+ **/
+static u64 next_random(void)
+{
+	if (random_state == 0) {
+		random_state = (ktime_get_ns() ^ ((u64) gettid() << 32)) | 1;
+	}
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * 0x2545F4914F6CDD1DULL;
+}
+
+/**********************************************************************/
+void prandom_bytes(void *buffer, size_t length)
+{
+	u8 *bytes = buffer;
+	while (length > 0) {
+		u64 value = next_random();
+		size_t count = min(length, sizeof(value));
+		memcpy(bytes, &value, count);
+		bytes += count;
+		length -= count;
+	}
+}
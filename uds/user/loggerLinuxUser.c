@@ -0,0 +1,159 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include <execinfo.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "threadDevice.h"
+
+/**********************************************************************/
+static const char *priority_to_prefix(int priority)
+{
+	switch (priority) {
+	case LOG_EMERG:
+	case LOG_ALERT:
+	case LOG_CRIT:
+		return "CRITICAL: ";
+	case LOG_ERR:
+		return "ERROR: ";
+	case LOG_WARNING:
+		return "WARNING: ";
+	default:
+		return "";
+	}
+}
+
+/**
+ * Emit a log message to stderr, identifying the module and thread in the
+ * same way as the kernel logger:
+ *
+ * thread w/device id:  uds12:myprog: blah
+ * other thread:        uds: myprog: blah
+ *
+ * The message is formatted into one buffer and written with a single call so
+ * that messages from different threads do not interleave.
+ *
+ * @param priority  The priority of the log message
+ * @param module    The name of the module doing the logging
+ * @param prefix    The prefix of the log message
+ * @param fmt1      The format of the first part of the message
+ * @param args1     The arguments for the first part
+ * @param fmt2      The format of the second part of the message
+ * @param args2     The arguments for the second part
+ **/
+static void emit_log_message(int priority,
+			     const char *module,
+			     const char *prefix,
+			     const char *fmt1,
+			     va_list args1,
+			     const char *fmt2,
+			     va_list args2)
+{
+	char buffer[1024];
+	size_t length;
+	int device_instance = uds_get_thread_device_id();
+
+	if (device_instance >= 0) {
+		length = scnprintf(buffer, sizeof(buffer), "%s%u:%s: %s%s",
+				   module, device_instance, current->comm,
+				   priority_to_prefix(priority), prefix);
+	} else {
+		length = scnprintf(buffer, sizeof(buffer), "%s: %s: %s%s",
+				   module, current->comm,
+				   priority_to_prefix(priority), prefix);
+	}
+	if (length < sizeof(buffer) - 1) {
+		int written = vsnprintf(buffer + length,
+					sizeof(buffer) - length, fmt1, args1);
+		length = min(length + max(written, 0), sizeof(buffer) - 1);
+	}
+	if (length < sizeof(buffer) - 1) {
+		int written = vsnprintf(buffer + length,
+					sizeof(buffer) - length, fmt2, args2);
+		length = min(length + max(written, 0), sizeof(buffer) - 1);
+	}
+	buffer[length++] = '\n';
+	if (write(STDERR_FILENO, buffer, length) < 0) {
+		// There is nowhere else to report the failure.
+	}
+}
+
+/**********************************************************************/
+void uds_log_message_pack(int priority,
+			  const char *module,
+			  const char *prefix,
+			  const char *fmt1,
+			  va_list args1,
+			  const char *fmt2,
+			  va_list args2)
+{
+	va_list args1_copy, args2_copy;
+
+	if (priority > get_log_level()) {
+		return;
+	}
+
+	if (module == NULL) {
+		module = THIS_MODULE->name;
+	}
+	if (prefix == NULL) {
+		prefix = "";
+	}
+
+	va_copy(args1_copy, args1);
+	va_copy(args2_copy, args2);
+	emit_log_message(priority, module, prefix, fmt1, args1_copy, fmt2,
+			 args2_copy);
+	va_end(args1_copy);
+	va_end(args2_copy);
+}
+
+/**********************************************************************/
+void log_backtrace(int priority)
+{
+	void *trace[32];
+	int depth;
+
+	if (priority > get_log_level()) {
+		return;
+	}
+	depth = backtrace(trace, ARRAY_SIZE(trace));
+	backtrace_symbols_fd(trace, depth, STDERR_FILENO);
+}
+
+/**********************************************************************/
+void __uds_log_message(int priority,
+		       const char *module,
+		       const char *format,
+		       ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	uds_log_embedded_message(priority, module, NULL,
+				 format, args, "%s", "");
+	va_end(args);
+}
+
+/**********************************************************************/
+void pause_for_logger(void)
+{
+	// Messages are written to stderr synchronously.
+}
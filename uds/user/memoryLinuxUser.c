@@ -0,0 +1,348 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "compiler.h"
+#include "logger.h"
+#include "memoryAlloc.h"
+#include "permassert.h"
+
+/*
+ * Userspace memory comes from the C library. Every allocation is tracked by
+ * its usable size, as the kernel version tracks ksize(), so the statistics
+ * and the tagged byte counts mean the same thing in both builds. Huge
+ * allocations are aligned to a huge page and advised to use transparent huge
+ * pages; they are kept on a list so that freeing them can credit the huge
+ * page total.
+ */
+
+enum { HUGE_PAGE_SIZE = 2 * 1024 * 1024 };
+
+static struct thread_registry allocating_threads;
+
+struct huge_block_info {
+	void *ptr;
+	size_t size;
+	struct huge_block_info *next;
+};
+
+static struct {
+	spinlock_t lock;
+	size_t blocks;
+	size_t bytes;
+	size_t huge_bytes;
+	size_t peak_bytes;
+	int64_t tagged_bytes[MEMORY_TAG_COUNT];
+	struct huge_block_info *huge_list;
+} memory_stats __cacheline_aligned;
+
+static const char *const memory_tag_names[] = {
+	[MEMORY_TAG_NONE] = "untagged",
+	[MEMORY_TAG_VDO_PAGE_CACHE] = "VDO page cache",
+	[MEMORY_TAG_REF_COUNTS] = "reference counts",
+	[MEMORY_TAG_SLAB_JOURNALS] = "slab journals",
+	[MEMORY_TAG_DATA_VIOS] = "data_vio pool",
+	[MEMORY_TAG_HASH_LOCKS] = "hash locks",
+	[MEMORY_TAG_DELTA_MEMORY] = "delta index memory",
+	[MEMORY_TAG_UDS_PAGE_CACHE] = "index page cache",
+	[MEMORY_TAG_SPARSE_CACHE] = "sparse cache",
+};
+
+/**********************************************************************/
+void register_allocating_thread(struct registered_thread *new_thread,
+				const bool *flag_ptr)
+{
+	if (flag_ptr == NULL) {
+		static const bool allocation_always_allowed = true;
+		flag_ptr = &allocation_always_allowed;
+	}
+	register_thread(&allocating_threads, new_thread, flag_ptr);
+}
+
+/**********************************************************************/
+void unregister_allocating_thread(void)
+{
+	unregister_thread(&allocating_threads);
+}
+
+/**********************************************************************/
+static void add_block(size_t size, enum memory_tag tag)
+{
+	spin_lock(&memory_stats.lock);
+	memory_stats.blocks++;
+	memory_stats.bytes += size;
+	memory_stats.tagged_bytes[tag] += size;
+	if (memory_stats.bytes > memory_stats.peak_bytes) {
+		memory_stats.peak_bytes = memory_stats.bytes;
+	}
+	spin_unlock(&memory_stats.lock);
+}
+
+/**
+ * Remove a block from the statistics.
+ *
+ * @param ptr   The block being freed
+ * @param size  The usable size of the block
+ * @param tag   The tag the block was allocated with
+ *
+ * @return the record of the block if it was a huge allocation, which the
+ *         caller must free
+ **/
+static struct huge_block_info *
+remove_block(void *ptr, size_t size, enum memory_tag tag)
+{
+	struct huge_block_info *block = NULL;
+	spin_lock(&memory_stats.lock);
+	memory_stats.blocks--;
+	memory_stats.bytes -= size;
+	memory_stats.tagged_bytes[tag] -= size;
+	if (((uintptr_t) ptr % HUGE_PAGE_SIZE) == 0) {
+		struct huge_block_info **block_ptr;
+		for (block_ptr = &memory_stats.huge_list;
+		     (block = *block_ptr) != NULL;
+		     block_ptr = &block->next) {
+			if (block->ptr == ptr) {
+				*block_ptr = block->next;
+				memory_stats.huge_bytes -= block->size;
+				break;
+			}
+		}
+	}
+	spin_unlock(&memory_stats.lock);
+	return block;
+}
+
+/**********************************************************************/
+int allocate_memory(size_t size, size_t align, const char *what, void *ptr)
+{
+	return allocate_tagged_memory(size, align, MEMORY_TAG_NONE, what, ptr);
+}
+
+/**********************************************************************/
+int allocate_tagged_memory(size_t size,
+			   size_t align,
+			   enum memory_tag tag,
+			   const char *what,
+			   void *ptr)
+{
+	void *p = NULL;
+	int result;
+
+	if (ptr == NULL) {
+		return UDS_INVALID_ARGUMENT;
+	}
+	if (size == 0) {
+		*((void **) ptr) = NULL;
+		return UDS_SUCCESS;
+	}
+
+	result = posix_memalign(&p, max(align, sizeof(void *)), size);
+	if (result != 0) {
+		uds_log_error("Could not allocate %zu bytes for %s",
+			      size, what);
+		return ENOMEM;
+	}
+	memset(p, 0, size);
+	add_block(malloc_usable_size(p), tag);
+	*((void **) ptr) = p;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int allocate_huge_memory(size_t size,
+			 enum memory_tag tag,
+			 const char *what,
+			 void *ptr)
+{
+	struct huge_block_info *block;
+	void *p = NULL;
+
+	// Smaller blocks could not use a huge page anyway.
+	if ((ptr == NULL) || (size < HUGE_PAGE_SIZE)) {
+		return allocate_tagged_memory(size, 0, tag, what, ptr);
+	}
+
+	if (ALLOCATE(1, struct huge_block_info, __func__, &block) !=
+	    UDS_SUCCESS) {
+		return allocate_tagged_memory(size, 0, tag, what, ptr);
+	}
+
+	if (posix_memalign(&p, HUGE_PAGE_SIZE, size) != 0) {
+		// Let the normal path retry and report the failure.
+		FREE(block);
+		return allocate_tagged_memory(size, 0, tag, what, ptr);
+	}
+	madvise(p, size, MADV_HUGEPAGE);
+	memset(p, 0, size);
+
+	block->ptr = p;
+	block->size = malloc_usable_size(p);
+	add_block(block->size, tag);
+	spin_lock(&memory_stats.lock);
+	block->next = memory_stats.huge_list;
+	memory_stats.huge_list = block;
+	memory_stats.huge_bytes += block->size;
+	spin_unlock(&memory_stats.lock);
+	*((void **) ptr) = p;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+void *allocate_memory_nowait(size_t size,
+			     const char *what __attribute__((unused)))
+{
+	void *p = calloc(1, size);
+	if (p != NULL) {
+		add_block(malloc_usable_size(p), MEMORY_TAG_NONE);
+	}
+	return p;
+}
+
+/**********************************************************************/
+void free_memory(void *ptr)
+{
+	free_tagged_memory(ptr, MEMORY_TAG_NONE);
+}
+
+/**********************************************************************/
+void free_tagged_memory(void *ptr, enum memory_tag tag)
+{
+	if (ptr != NULL) {
+		struct huge_block_info *block =
+			remove_block(ptr, malloc_usable_size(ptr), tag);
+		free(ptr);
+		FREE(block);
+	}
+}
+
+/**********************************************************************/
+int reallocate_memory(void *ptr,
+		      size_t old_size,
+		      size_t size,
+		      const char *what,
+		      void *new_ptr)
+{
+	int result;
+	// Handle special case of zero sized result
+	if (size == 0) {
+		FREE(ptr);
+		*(void **) new_ptr = NULL;
+		return UDS_SUCCESS;
+	}
+
+	result = ALLOCATE(size, char, what, new_ptr);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	if (ptr != NULL) {
+		if (old_size < size) {
+			size = old_size;
+		}
+		memcpy(*((void **) new_ptr), ptr, size);
+		FREE(ptr);
+	}
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+void memory_init(void)
+{
+	spin_lock_init(&memory_stats.lock);
+	initialize_thread_registry(&allocating_threads);
+}
+
+/**********************************************************************/
+void memory_exit(void)
+{
+	ASSERT_LOG_ONLY(memory_stats.bytes == 0,
+			"memory used (%zd bytes in %zd blocks) is returned to the C library",
+			memory_stats.bytes,
+			memory_stats.blocks);
+	log_debug("%s peak usage %zd bytes",
+		  THIS_MODULE->name,
+		  memory_stats.peak_bytes);
+}
+
+/**********************************************************************/
+void get_memory_stats(uint64_t *bytes_used, uint64_t *peak_bytes_used)
+{
+	spin_lock(&memory_stats.lock);
+	*bytes_used = memory_stats.bytes;
+	*peak_bytes_used = memory_stats.peak_bytes;
+	spin_unlock(&memory_stats.lock);
+}
+
+/**********************************************************************/
+uint64_t get_huge_memory_bytes(void)
+{
+	uint64_t huge_bytes;
+	spin_lock(&memory_stats.lock);
+	huge_bytes = memory_stats.huge_bytes;
+	spin_unlock(&memory_stats.lock);
+	return huge_bytes;
+}
+
+/**********************************************************************/
+void adjust_tagged_memory_bytes(enum memory_tag tag, int64_t bytes)
+{
+	spin_lock(&memory_stats.lock);
+	memory_stats.tagged_bytes[tag] += bytes;
+	spin_unlock(&memory_stats.lock);
+}
+
+/**********************************************************************/
+uint64_t get_tagged_memory_bytes(enum memory_tag tag)
+{
+	int64_t bytes;
+	spin_lock(&memory_stats.lock);
+	bytes = memory_stats.tagged_bytes[tag];
+	spin_unlock(&memory_stats.lock);
+	return max_t(int64_t, bytes, 0);
+}
+
+/**********************************************************************/
+void report_memory_usage(void)
+{
+	uint64_t blocks, bytes, huge_bytes, peak_usage;
+	int64_t tagged_bytes[MEMORY_TAG_COUNT];
+	enum memory_tag tag;
+	spin_lock(&memory_stats.lock);
+	blocks = memory_stats.blocks;
+	bytes = memory_stats.bytes;
+	huge_bytes = memory_stats.huge_bytes;
+	peak_usage = memory_stats.peak_bytes;
+	memcpy(tagged_bytes, memory_stats.tagged_bytes, sizeof(tagged_bytes));
+	spin_unlock(&memory_stats.lock);
+	log_info("current memory tracking (actual allocation sizes, not requested):");
+	log_info("  %" PRIu64 " bytes in %" PRIu64 " blocks (%" PRIu64
+		 " bytes on huge pages)",
+		 bytes,
+		 blocks,
+		 huge_bytes);
+	log_info("  peak usage %" PRIu64 " bytes", peak_usage);
+	for (tag = MEMORY_TAG_NONE + 1; tag < MEMORY_TAG_COUNT; tag++) {
+		log_info("  %" PRId64 " bytes for %s",
+			 tagged_bytes[tag],
+			 memory_tag_names[tag]);
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include <stdlib.h>
+
+#include "errors.h"
+#include "logger.h"
+#include "stringUtils.h"
+
+/**********************************************************************/
+int string_to_signed_long(const char *nptr, long *num)
+{
+	char *endptr;
+	long value;
+
+	errno = 0;
+	value = strtol(nptr, &endptr, 10);
+	if ((errno != 0) || (endptr == nptr) || (*endptr != '\0')) {
+		return UDS_INVALID_ARGUMENT;
+	}
+	*num = value;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int string_to_unsigned_long(const char *nptr, unsigned long *num)
+{
+	char *endptr;
+	unsigned long value;
+
+	while (*nptr == ' ') {
+		nptr++;
+	}
+	// strtoul() would accept a negative number and negate it.
+	if (*nptr == '-') {
+		return UDS_INVALID_ARGUMENT;
+	}
+	errno = 0;
+	value = strtoul(nptr, &endptr, 10);
+	if ((errno != 0) || (endptr == nptr) || (*endptr != '\0')) {
+		return UDS_INVALID_ARGUMENT;
+	}
+	*num = value;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+char *next_token(char *str, const char *delims, char **state)
+{
+	return strtok_r(str, delims, state);
+}
+
+/**********************************************************************/
+int parse_uint64(const char *str, uint64_t *num)
+{
+	unsigned long value = *num;
+	int result = string_to_unsigned_long(str, &value);
+	*num = value;
+	return result;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include <sched.h>
+#include <unistd.h>
+
+#include "memoryAlloc.h"
+#include "logger.h"
+#include "threads.h"
+#include "uds-error.h"
+
+/*
+ * Userspace threads are pthreads. Each one keeps the task structure which
+ * current refers to, so that apply_to_threads() can hand it out just as the
+ * kernel version does.
+ */
+
+static LIST_HEAD(user_thread_list);
+static DEFINE_MUTEX(user_thread_mutex);
+
+struct thread {
+	void (*thread_func)(void *);
+	void *thread_data;
+	struct list_head thread_links;
+	struct task_struct *thread_task;
+	pthread_t thread;
+	char name[TASK_COMM_LEN];
+};
+
+/**********************************************************************/
+static void *thread_starter(void *arg)
+{
+	struct registered_thread allocating_thread;
+	struct thread *ut = arg;
+	ut->thread_task = current;
+	memcpy(ut->thread_task->comm, ut->name, TASK_COMM_LEN);
+	pthread_setname_np(pthread_self(), ut->name);
+	mutex_lock(&user_thread_mutex);
+	list_add_tail(&ut->thread_links, &user_thread_list);
+	mutex_unlock(&user_thread_mutex);
+	register_allocating_thread(&allocating_thread, NULL);
+	ut->thread_func(ut->thread_data);
+	unregister_allocating_thread();
+	return NULL;
+}
+
+/**********************************************************************/
+int create_thread(void (*thread_func)(void *),
+		  void *thread_data,
+		  const char *name,
+		  struct thread **new_thread)
+{
+	struct thread *ut;
+	int result = ALLOCATE(1, struct thread, __func__, &ut);
+	if (result != UDS_SUCCESS) {
+		log_warning("Error allocating memory for %s", name);
+		return result;
+	}
+	ut->thread_func = thread_func;
+	ut->thread_data = thread_data;
+	INIT_LIST_HEAD(&ut->thread_links);
+	// Thread names are limited to 15 characters, so keep the end of the
+	// name, which is the part which distinguishes the index threads.
+	if (strlen(name) >= TASK_COMM_LEN) {
+		name += strlen(name) - (TASK_COMM_LEN - 1);
+	}
+	strncpy(ut->name, name, TASK_COMM_LEN - 1);
+
+	result = pthread_create(&ut->thread, NULL, thread_starter, ut);
+	if (result != 0) {
+		log_error_strerror(result, "could not create %s thread", name);
+		FREE(ut);
+		return UDS_ENOTHREADS;
+	}
+	*new_thread = ut;
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int join_threads(struct thread *ut)
+{
+	int result = pthread_join(ut->thread, NULL);
+	if (result != 0) {
+		return log_warning_strerror(result, "thread join failed");
+	}
+	mutex_lock(&user_thread_mutex);
+	if (!list_empty(&ut->thread_links)) {
+		list_del(&ut->thread_links);
+	}
+	mutex_unlock(&user_thread_mutex);
+	FREE(ut);
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+void apply_to_threads(void apply_func(void *, struct task_struct *),
+		      void *argument)
+{
+	struct thread *ut;
+	mutex_lock(&user_thread_mutex);
+	list_for_each_entry(ut, &user_thread_list, thread_links) {
+		apply_func(argument, ut->thread_task);
+	}
+	mutex_unlock(&user_thread_mutex);
+}
+
+/**********************************************************************/
+void thread_exit(void)
+{
+	unregister_allocating_thread();
+	pthread_exit(NULL);
+}
+
+/**********************************************************************/
+pid_t get_thread_id(void)
+{
+	return current->pid;
+}
+
+/**********************************************************************/
+unsigned int get_num_cores(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return (cores > 0) ? cores : 1;
+}
+
+/**********************************************************************/
+int initialize_barrier(struct barrier *barrier, unsigned int thread_count)
+{
+	int result = initialize_semaphore(&barrier->mutex, 1);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	barrier->arrived = 0;
+	barrier->thread_count = thread_count;
+	return initialize_semaphore(&barrier->wait, 0);
+}
+
+/**********************************************************************/
+int destroy_barrier(struct barrier *barrier)
+{
+	sem_destroy(&barrier->mutex.sem);
+	sem_destroy(&barrier->wait.sem);
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int enter_barrier(struct barrier *barrier, bool *winner)
+{
+	bool last_thread;
+	acquire_semaphore(&barrier->mutex);
+	last_thread = ++barrier->arrived == barrier->thread_count;
+	if (last_thread) {
+		// This is the last thread to arrive, so wake up the others
+		int i;
+		for (i = 1; i < barrier->thread_count; i++) {
+			release_semaphore(&barrier->wait);
+		}
+		// Then reinitialize for the next cycle
+		barrier->arrived = 0;
+		release_semaphore(&barrier->mutex);
+	} else {
+		// This is NOT the last thread to arrive, so just wait
+		release_semaphore(&barrier->mutex);
+		acquire_semaphore(&barrier->wait);
+	}
+	if (winner != NULL) {
+		*winner = last_thread;
+	}
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int yield_scheduler(void)
+{
+	sched_yield();
+	return UDS_SUCCESS;
+}
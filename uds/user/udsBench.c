@@ -0,0 +1,984 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+/*
+ * Microbenchmarks for the index, run in userspace against a file or block
+ * device. Each test prints the number of operations it timed and the mean
+ * cost of one. The index on the target is overwritten.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chapterIndex.h"
+#include "config.h"
+#include "deltaIndex.h"
+#include "indexConfig.h"
+#include "indexLayout.h"
+#include "logger.h"
+#include "memoryAlloc.h"
+#include "murmur/MurmurHash3.h"
+#include "openChapter.h"
+#include "openChapterZone.h"
+#include "pageCache.h"
+#include "sparseCache.h"
+#include "util/radixSort.h"
+#include "threadDevice.h"
+#include "threads.h"
+#include "timeUtils.h"
+#include "uds.h"
+#include "volume.h"
+
+enum {
+	DEFAULT_CHAPTERS = 64,
+	DEFAULT_RECORD_PAGES = 16,
+	DEFAULT_SPARSE_CHAPTERS = 48,
+	DELTA_ADDRESS_BITS = 20,
+	DELTA_LIST_COUNT = 4096,
+	DELTA_PAYLOAD_BITS = 8,
+	DEFAULT_DELTA_RECORDS = 1 << 20,
+	MISS_SEED = 0x5eed,
+	NAME_SEED = 0x1d,
+	QUEUE_DEPTH = 256,
+	SEARCH_PASSES = 16,
+	SORT_PAGES = 4096,
+};
+
+struct bench_options {
+	const char *path;
+	unsigned int chapters;
+	unsigned int record_pages;
+	unsigned long delta_records;
+	bool compact;
+	struct uds_parameters params;
+};
+
+/**
+ * A fixed pool of requests which are kept in flight against an index
+ * session, with completed requests returned to a free stack by the callback.
+ **/
+struct request_pool {
+	struct mutex mutex;
+	struct cond_var cond;
+	struct uds_index_session *session;
+	unsigned int free_count;
+	struct uds_request *free[QUEUE_DEPTH];
+	uint64_t found;
+	int result;
+	struct uds_request requests[QUEUE_DEPTH];
+};
+
+static struct request_pool pool;
+
+/**********************************************************************/
+static void make_name(uint64_t counter,
+		      uint32_t seed,
+		      struct uds_chunk_name *name)
+{
+	MurmurHash3_x64_128(&counter, sizeof(counter), seed, name->name);
+}
+
+/**********************************************************************/
+static void report(const char *test,
+		   const char *what,
+		   unsigned long count,
+		   ktime_t elapsed)
+{
+	printf("%-8s %-24s %10lu ops %10.3f ms %10.1f ns/op\n",
+	       test,
+	       what,
+	       count,
+	       elapsed / 1000000.0,
+	       (count == 0) ? 0.0 : (double) elapsed / count);
+}
+
+/**********************************************************************/
+static int report_error(const char *what, int result)
+{
+	char buf[UDS_STRING_ERROR_BUFSIZE];
+	fprintf(stderr,
+		"%s: %s\n",
+		what,
+		uds_string_error(result, buf, sizeof(buf)));
+	return result;
+}
+
+/**
+ * Make a small index configuration, so that the tests exercise the same
+ * number of chapters as a full size index in much less time and space.
+ **/
+static int make_bench_configuration(const struct bench_options *options,
+				    bool sparse,
+				    struct uds_configuration **conf_ptr)
+{
+	struct uds_configuration *conf;
+	int result = uds_initialize_configuration(&conf,
+						  UDS_MEMORY_CONFIG_256MB);
+	if (result != UDS_SUCCESS) {
+		return report_error("uds_initialize_configuration", result);
+	}
+
+	uds_configuration_set_sparse(conf, sparse);
+	uds_configuration_set_compact_chapter_index(conf, options->compact);
+	conf->record_pages_per_chapter = options->record_pages;
+	conf->chapters_per_volume = options->chapters;
+	conf->sparse_chapters_per_volume =
+		(sparse ? options->chapters * DEFAULT_SPARSE_CHAPTERS /
+				  DEFAULT_CHAPTERS :
+			  0);
+	*conf_ptr = conf;
+	return UDS_SUCCESS;
+}
+
+/**
+ * Size the target for an index with the given configuration. Block devices
+ * are assumed to be large enough.
+ **/
+static int prepare_target(const struct bench_options *options,
+			  const struct uds_configuration *conf)
+{
+	uint64_t size;
+	int fd, result = uds_compute_index_size(conf, 0, &size);
+	if (result != UDS_SUCCESS) {
+		return report_error("uds_compute_index_size", result);
+	}
+
+	fd = open(options->path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		return report_error(options->path, errno);
+	}
+
+	struct stat st;
+	if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+	    (ftruncate(fd, size) != 0)) {
+		result = errno;
+	}
+	close(fd);
+	return ((result == UDS_SUCCESS) ? result :
+					  report_error(options->path, result));
+}
+
+/**
+ * Time lookups in a delta index like the volume index, for keys which are
+ * present and for keys which are not.
+ **/
+static int bench_delta(const struct bench_options *options)
+{
+	unsigned long count = options->delta_records;
+	unsigned int mean_delta =
+		((1ULL << DELTA_ADDRESS_BITS) * DELTA_LIST_COUNT) / count;
+	size_t memory_size =
+		get_delta_memory_size(count, mean_delta, DELTA_PAYLOAD_BITS) /
+		CHAR_BIT * 106 / 100;
+	struct delta_index delta_index;
+	struct delta_index_entry entry;
+	struct uds_chunk_name name;
+	unsigned long i, found;
+	ktime_t start;
+	int result;
+
+	result = initialize_delta_index(&delta_index,
+					1,
+					DELTA_LIST_COUNT,
+					mean_delta,
+					DELTA_PAYLOAD_BITS,
+					memory_size);
+	if (result != UDS_SUCCESS) {
+		return report_error("initialize_delta_index", result);
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < count; i++) {
+		unsigned int list, key;
+		make_name(i, NAME_SEED, &name);
+		list = get_unaligned_le32(&name.name[0]) % DELTA_LIST_COUNT;
+		key = get_unaligned_le32(&name.name[4]) &
+		      ((1 << DELTA_ADDRESS_BITS) - 1);
+		result = get_delta_index_entry(&delta_index, list, key,
+					       name.name, false, &entry);
+		if (result == UDS_SUCCESS) {
+			// A collision entry holds the whole name.
+			bool collision = (!entry.at_end && (entry.key == key));
+			result = put_delta_index_entry(&entry, key, i & 0xff,
+						       (collision ? name.name :
+								    NULL));
+		}
+		if (result != UDS_SUCCESS) {
+			uninitialize_delta_index(&delta_index);
+			return report_error("put_delta_index_entry", result);
+		}
+	}
+	report("delta", "insert", count,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	// Each rebalance stalls the inserting zone for its whole duration.
+	struct delta_index_stats stats;
+	get_delta_index_stats(&delta_index, &stats);
+	report("delta", "rebalance", stats.rebalance_count,
+	       stats.rebalance_time);
+	result = validate_delta_index(&delta_index);
+	if (result != UDS_SUCCESS) {
+		uninitialize_delta_index(&delta_index);
+		return report_error("validate_delta_index", result);
+	}
+
+	for (int pass = 0; pass < 2; pass++) {
+		uint32_t seed = (pass == 0) ? NAME_SEED : MISS_SEED;
+		found = 0;
+		start = current_time_ns(CLOCK_MONOTONIC);
+		for (i = 0; i < count; i++) {
+			unsigned int list, key;
+			make_name(i, seed, &name);
+			list = (get_unaligned_le32(&name.name[0]) %
+				DELTA_LIST_COUNT);
+			key = get_unaligned_le32(&name.name[4]) &
+			      ((1 << DELTA_ADDRESS_BITS) - 1);
+			result = get_delta_index_entry(&delta_index, list, key,
+						       name.name, true,
+						       &entry);
+			if (result != UDS_SUCCESS) {
+				uninitialize_delta_index(&delta_index);
+				return report_error("get_delta_index_entry",
+						    result);
+			}
+			if (!entry.at_end && (entry.key == key)) {
+				found++;
+			}
+		}
+		report("delta",
+		       (pass == 0) ? "lookup (present)" : "lookup (absent)",
+		       count,
+		       current_time_ns(CLOCK_MONOTONIC) - start);
+	}
+
+	uninitialize_delta_index(&delta_index);
+	return UDS_SUCCESS;
+}
+
+/**
+ * Fill an open chapter zone with consecutive names.
+ **/
+static int fill_open_chapter(struct open_chapter_zone *zone,
+			     uint64_t first_name)
+{
+	struct uds_chunk_data metadata = { .data = { 0 } };
+	unsigned int remaining = zone->capacity;
+	uint64_t counter = first_name;
+
+	while (remaining > 0) {
+		struct uds_chunk_name name;
+		int result;
+		make_name(counter++, NAME_SEED, &name);
+		result = put_open_chapter(zone, &name, &metadata, &remaining);
+		if (result != UDS_SUCCESS) {
+			return report_error("put_open_chapter", result);
+		}
+	}
+	return UDS_SUCCESS;
+}
+
+/**
+ * Time searches of a full open chapter zone, which every request makes
+ * before it consults the volume index.
+ **/
+static int bench_open_chapter(const struct bench_options *options,
+			      const struct configuration *config)
+{
+	struct open_chapter_zone *zone;
+	unsigned int capacity;
+	int result = make_open_chapter(config->geometry, 1, &zone);
+	if (result != UDS_SUCCESS) {
+		return report_error("make_open_chapter", result);
+	}
+
+	capacity = zone->capacity;
+	ktime_t start = current_time_ns(CLOCK_MONOTONIC);
+	result = fill_open_chapter(zone, 0);
+	if (result != UDS_SUCCESS) {
+		free_open_chapter(zone);
+		return result;
+	}
+	report("open", "put", capacity,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	for (int pass = 0; pass < 2; pass++) {
+		uint32_t seed = (pass == 0) ? NAME_SEED : MISS_SEED;
+		unsigned long searches = 0;
+		start = current_time_ns(CLOCK_MONOTONIC);
+		for (int i = 0; i < SEARCH_PASSES; i++) {
+			uint64_t counter;
+			for (counter = 0; counter < capacity; counter++) {
+				struct uds_chunk_name name;
+				bool found;
+				make_name(counter, seed, &name);
+				search_open_chapter(zone, &name, NULL, &found);
+				searches++;
+			}
+		}
+		report("open",
+		       (pass == 0) ? "search (present)" : "search (absent)",
+		       searches,
+		       current_time_ns(CLOCK_MONOTONIC) - start);
+	}
+
+	free_open_chapter(zone);
+	return UDS_SUCCESS;
+}
+
+/**
+ * Time sorting the names of a record page with the generic radix sort and
+ * with the sort specialized for chunk names, checking that they agree.
+ **/
+static int bench_sort(const struct configuration *config)
+{
+	unsigned int count = config->geometry->records_per_page;
+	struct uds_chunk_name *names = NULL;
+	const byte **generic = NULL;
+	const byte **special = NULL;
+	struct radix_sorter *sorter = NULL;
+	ktime_t generic_time = 0, special_time = 0;
+	unsigned int page, i;
+	int result;
+
+	result = ALLOCATE(count, struct uds_chunk_name, "names", &names);
+	if (result == UDS_SUCCESS) {
+		result = ALLOCATE(count, const byte *, "keys", &generic);
+	}
+	if (result == UDS_SUCCESS) {
+		result = ALLOCATE(count, const byte *, "keys", &special);
+	}
+	if (result == UDS_SUCCESS) {
+		result = make_radix_sorter(count, &sorter);
+	}
+
+	for (page = 0; (result == UDS_SUCCESS) && (page < SORT_PAGES);
+	     page++) {
+		for (i = 0; i < count; i++) {
+			make_name((uint64_t) page * count + i, NAME_SEED,
+				  &names[i]);
+			generic[i] = special[i] = names[i].name;
+		}
+
+		ktime_t start = current_time_ns(CLOCK_MONOTONIC);
+		result = radix_sort(sorter, generic, count,
+				    UDS_CHUNK_NAME_SIZE);
+		generic_time += current_time_ns(CLOCK_MONOTONIC) - start;
+		if (result != UDS_SUCCESS) {
+			report_error("radix_sort", result);
+			break;
+		}
+
+		start = current_time_ns(CLOCK_MONOTONIC);
+		result = radix_sort_names(sorter, special, count);
+		special_time += current_time_ns(CLOCK_MONOTONIC) - start;
+		if (result != UDS_SUCCESS) {
+			report_error("radix_sort_names", result);
+			break;
+		}
+
+		if (memcmp(generic, special, count * sizeof(*generic)) != 0) {
+			fprintf(stderr, "sort: name sort disagrees on page %u\n",
+				page);
+			result = UDS_CORRUPT_DATA;
+		}
+	}
+
+	if (result == UDS_SUCCESS) {
+		report("sort", "radix", SORT_PAGES, generic_time);
+		report("sort", "names", SORT_PAGES, special_time);
+	}
+	free_radix_sorter(sorter);
+	FREE(special);
+	FREE(generic);
+	FREE(names);
+	return result;
+}
+
+/**
+ * Time closing chapters: collating the open chapter, building its chapter
+ * index, and writing the index and record pages to the volume.
+ **/
+static int bench_close_chapter(const struct bench_options *options,
+			       const struct uds_configuration *conf,
+			       const struct configuration *config)
+{
+	const struct geometry *geometry = config->geometry;
+	struct open_chapter_index *chapter_index = NULL;
+	struct uds_chunk_record *collated = NULL;
+	struct open_chapter_zone *zone = NULL;
+	struct index_layout *layout = NULL;
+	struct volume *volume = NULL;
+	ktime_t elapsed = 0;
+	uint64_t chapter;
+	int result;
+
+	result = make_index_layout(options->path, true, conf, &layout);
+	if (result != UDS_SUCCESS) {
+		return report_error("make_index_layout", result);
+	}
+	result = make_volume(config, layout, NULL,
+			     VOLUME_CACHE_DEFAULT_MAX_QUEUED_READS, 1,
+			     &volume);
+	if (result != UDS_SUCCESS) {
+		report_error("make_volume", result);
+		goto out;
+	}
+	result = make_open_chapter_index(&chapter_index, geometry, false,
+					 volume->nonce);
+	if (result != UDS_SUCCESS) {
+		report_error("make_open_chapter_index", result);
+		goto out;
+	}
+	result = ALLOCATE(geometry->records_per_chapter + 1,
+			  struct uds_chunk_record, "collated records",
+			  &collated);
+	if (result != UDS_SUCCESS) {
+		report_error("collated records", result);
+		goto out;
+	}
+	result = make_open_chapter(geometry, 1, &zone);
+	if (result != UDS_SUCCESS) {
+		report_error("make_open_chapter", result);
+		goto out;
+	}
+
+	for (chapter = 0; chapter < geometry->chapters_per_volume; chapter++) {
+		ktime_t start;
+		reset_open_chapter(zone);
+		result = fill_open_chapter(zone,
+					   chapter * zone->capacity);
+		if (result != UDS_SUCCESS) {
+			goto out;
+		}
+
+		start = current_time_ns(CLOCK_MONOTONIC);
+		result = close_open_chapter(&zone, 1, volume, chapter_index,
+					    collated, chapter);
+		elapsed += current_time_ns(CLOCK_MONOTONIC) - start;
+		if (result != UDS_SUCCESS) {
+			report_error("close_open_chapter", result);
+			goto out;
+		}
+	}
+	report("close", "close chapter", geometry->chapters_per_volume,
+	       elapsed);
+
+out:
+	free_open_chapter(zone);
+	FREE(collated);
+	free_open_chapter_index(chapter_index);
+	free_volume(volume);
+	put_index_layout(&layout);
+	return result;
+}
+
+/**********************************************************************/
+static void pool_callback(struct uds_request *request)
+{
+	lock_mutex(&pool.mutex);
+	if (request->status != UDS_SUCCESS) {
+		pool.result = request->status;
+	} else if (request->found) {
+		pool.found++;
+	}
+	pool.free[pool.free_count++] = request;
+	signal_cond(&pool.cond);
+	unlock_mutex(&pool.mutex);
+}
+
+/**********************************************************************/
+static int init_pool(struct uds_index_session *session)
+{
+	int result = init_mutex(&pool.mutex);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	result = init_cond(&pool.cond);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+	pool.session = session;
+	pool.free_count = QUEUE_DEPTH;
+	for (unsigned int i = 0; i < QUEUE_DEPTH; i++) {
+		pool.free[i] = &pool.requests[i];
+	}
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+static void free_pool(void)
+{
+	destroy_cond(&pool.cond);
+	destroy_mutex(&pool.mutex);
+}
+
+/**
+ * Wait until every request in the pool has completed.
+ **/
+static int drain_pool(void)
+{
+	int result;
+	lock_mutex(&pool.mutex);
+	while (pool.free_count < QUEUE_DEPTH) {
+		wait_cond(&pool.cond, &pool.mutex);
+	}
+	result = pool.result;
+	unlock_mutex(&pool.mutex);
+	return result;
+}
+
+/**
+ * Run a range of consecutive names through the index, keeping up to
+ * QUEUE_DEPTH requests in flight.
+ *
+ * @param first  The first name to send
+ * @param count  The number of names to send
+ * @param type   The type of request
+ * @param found  A pointer to hold the number of names which were found
+ **/
+static int run_requests(uint64_t first,
+			uint64_t count,
+			enum uds_callback_type type,
+			uint64_t *found)
+{
+	uint64_t counter;
+	int result;
+
+	pool.found = 0;
+	for (counter = first; counter < first + count; counter++) {
+		struct uds_request *request;
+		lock_mutex(&pool.mutex);
+		while (pool.free_count == 0) {
+			wait_cond(&pool.cond, &pool.mutex);
+		}
+		request = pool.free[--pool.free_count];
+		unlock_mutex(&pool.mutex);
+
+		memset(request, 0, sizeof(*request));
+		make_name(counter, NAME_SEED, &request->chunk_name);
+		memcpy(request->new_metadata.data, &counter, sizeof(counter));
+		request->callback = pool_callback;
+		request->session = pool.session;
+		request->type = type;
+		result = uds_start_chunk_operation(request);
+		if (result != UDS_SUCCESS) {
+			pool_callback(request);
+			drain_pool();
+			return report_error("uds_start_chunk_operation",
+					    result);
+		}
+	}
+
+	result = drain_pool();
+	if (result != UDS_SUCCESS) {
+		return report_error("request", result);
+	}
+	*found = pool.found;
+	return UDS_SUCCESS;
+}
+
+/**
+ * Close an index after a failed test, returning the original error.
+ **/
+static int close_after_error(struct uds_index_session *session, int result)
+{
+	int close_result = uds_close_index(session);
+	if (close_result != UDS_SUCCESS) {
+		report_error("uds_close_index", close_result);
+	}
+	return result;
+}
+
+/**
+ * Time queries for names in the sparse chapters of a sparse index. The
+ * names are sent in the order they were posted, so that finding a sampled
+ * name loads its chapter into the sparse cache and the rest of the chapter
+ * is found there.
+ **/
+static int bench_sparse(const struct bench_options *options,
+			struct uds_configuration *conf,
+			const struct configuration *config,
+			struct uds_index_session *session)
+{
+	const struct geometry *geometry = config->geometry;
+	uint64_t sparse_records =
+		((uint64_t) geometry->sparse_chapters_per_volume *
+		 geometry->records_per_chapter);
+	uint64_t total = ((uint64_t) geometry->chapters_per_volume *
+			  geometry->records_per_chapter);
+	uint64_t found;
+	ktime_t start;
+	int result;
+
+	result = uds_open_index(UDS_CREATE, options->path, &options->params,
+				conf, session);
+	if (result != UDS_SUCCESS) {
+		return report_error("uds_open_index", result);
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	result = run_requests(0, total, UDS_POST, &found);
+	if (result != UDS_SUCCESS) {
+		return close_after_error(session, result);
+	}
+	report("sparse", "post", total,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	// Skip the oldest chapter, which the open chapter is about to expire.
+	start = current_time_ns(CLOCK_MONOTONIC);
+	result = run_requests(geometry->records_per_chapter,
+			      sparse_records - geometry->records_per_chapter,
+			      UDS_QUERY, &found);
+	if (result != UDS_SUCCESS) {
+		return close_after_error(session, result);
+	}
+	report("sparse", "query (sparse)",
+	       sparse_records - geometry->records_per_chapter,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	printf("sparse   %llu of %llu found\n",
+	       (unsigned long long) found,
+	       (unsigned long long) (sparse_records -
+				     geometry->records_per_chapter));
+
+	// Query again with the caches and read threads shrunk, and then
+	// grown, while the index stays open.
+	static const unsigned int sizes[][2] = { { 1, 1 }, { 14, 4 } };
+	unsigned int i;
+	for (i = 0; i < COUNT_OF(sizes); i++) {
+		page_cache_chapters = sizes[i][0];
+		sparse_cache_chapters = sizes[i][0];
+		volume_read_threads = sizes[i][1];
+		start = current_time_ns(CLOCK_MONOTONIC);
+		result = run_requests(geometry->records_per_chapter,
+				      sparse_records -
+				      geometry->records_per_chapter,
+				      UDS_QUERY, &found);
+		if (result != UDS_SUCCESS) {
+			break;
+		}
+		char what[32];
+		snprintf(what, sizeof(what), "query (%u ch, %u thr)",
+			 sizes[i][0], sizes[i][1]);
+		report("sparse", what,
+		       sparse_records - geometry->records_per_chapter,
+		       current_time_ns(CLOCK_MONOTONIC) - start);
+	}
+	page_cache_chapters = 0;
+	sparse_cache_chapters = 0;
+	volume_read_threads = 0;
+	if (result != UDS_SUCCESS) {
+		return close_after_error(session, result);
+	}
+
+	result = uds_close_index(session);
+	if (result != UDS_SUCCESS) {
+		return report_error("uds_close_index", result);
+	}
+	return UDS_SUCCESS;
+}
+
+/**
+ * Time saving a full dense index, and loading it again.
+ **/
+static int bench_save_load(const struct bench_options *options,
+			   struct uds_configuration *conf,
+			   const struct configuration *config,
+			   struct uds_index_session *session)
+{
+	const struct geometry *geometry = config->geometry;
+	uint64_t total = ((uint64_t) geometry->chapters_per_volume *
+			  geometry->records_per_chapter);
+	uint64_t found;
+	ktime_t start;
+	int result;
+
+	result = uds_open_index(UDS_CREATE, options->path, &options->params,
+				conf, session);
+	if (result != UDS_SUCCESS) {
+		return report_error("uds_open_index", result);
+	}
+
+	// Leave the open chapter half full so that it is saved too.
+	result = run_requests(0, total - geometry->records_per_chapter / 2,
+			      UDS_POST, &found);
+	if (result != UDS_SUCCESS) {
+		return close_after_error(session, result);
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	result = uds_close_index(session);
+	if (result != UDS_SUCCESS) {
+		return report_error("uds_close_index", result);
+	}
+	report("save", "save", 1, current_time_ns(CLOCK_MONOTONIC) - start);
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	result = uds_open_index(UDS_NO_REBUILD, options->path,
+				&options->params, conf, session);
+	if (result != UDS_SUCCESS) {
+		return report_error("uds_open_index", result);
+	}
+	report("save", "load", 1, current_time_ns(CLOCK_MONOTONIC) - start);
+
+	// The newest records were only in the saved open chapter.
+	uint64_t open_records = geometry->records_per_chapter / 2;
+	result = run_requests(total - geometry->records_per_chapter,
+			      open_records, UDS_QUERY, &found);
+	if (result != UDS_SUCCESS) {
+		return close_after_error(session, result);
+	}
+	if (found < open_records) {
+		fprintf(stderr, "save: %llu of %llu open chapter records lost\n",
+			(unsigned long long) (open_records - found),
+			(unsigned long long) open_records);
+	}
+
+	result = uds_close_index(session);
+	if (result != UDS_SUCCESS) {
+		return report_error("uds_close_index", result);
+	}
+	return UDS_SUCCESS;
+}
+
+/**
+ * Run the tests which need only the index internals.
+ **/
+static int run_internal_test(const char *test,
+			     const struct bench_options *options)
+{
+	struct uds_configuration *conf;
+	struct configuration *config;
+	int result = make_bench_configuration(options, false, &conf);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	result = make_configuration(conf, &config);
+	if (result != UDS_SUCCESS) {
+		uds_free_configuration(conf);
+		return report_error("make_configuration", result);
+	}
+
+	if (strcmp(test, "delta") == 0) {
+		result = bench_delta(options);
+	} else if (strcmp(test, "open") == 0) {
+		result = bench_open_chapter(options, config);
+	} else if (strcmp(test, "sort") == 0) {
+		result = bench_sort(config);
+	} else {
+		result = prepare_target(options, conf);
+		if (result == UDS_SUCCESS) {
+			result = bench_close_chapter(options, conf, config);
+		}
+	}
+
+	free_configuration(config);
+	uds_free_configuration(conf);
+	return result;
+}
+
+/**
+ * Run the tests which drive a whole index through an index session.
+ **/
+static int run_session_test(const char *test,
+			    const struct bench_options *options)
+{
+	bool sparse = (strcmp(test, "sparse") == 0);
+	struct uds_index_session *session = NULL;
+	struct uds_configuration *conf;
+	struct configuration *config;
+	int result = make_bench_configuration(options, sparse, &conf);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	result = make_configuration(conf, &config);
+	if (result != UDS_SUCCESS) {
+		uds_free_configuration(conf);
+		return report_error("make_configuration", result);
+	}
+
+	result = prepare_target(options, conf);
+	if (result == UDS_SUCCESS) {
+		result = uds_create_index_session(&session);
+		if (result != UDS_SUCCESS) {
+			report_error("uds_create_index_session", result);
+		}
+	}
+	if (result == UDS_SUCCESS) {
+		result = init_pool(session);
+	}
+	if (result == UDS_SUCCESS) {
+		result = (sparse ?
+			  bench_sparse(options, conf, config, session) :
+			  bench_save_load(options, conf, config, session));
+		free_pool();
+	}
+	if (session != NULL) {
+		uds_destroy_index_session(session);
+	}
+
+	free_configuration(config);
+	uds_free_configuration(conf);
+	return result;
+}
+
+static const struct {
+	const char *name;
+	int (*run)(const char *test, const struct bench_options *options);
+	const char *description;
+} tests[] = {
+	{ "delta", run_internal_test,
+	  "delta index insertion and lookup" },
+	{ "open", run_internal_test,
+	  "open chapter insertion and search" },
+	{ "sort", run_internal_test,
+	  "sorting the names of record pages" },
+	{ "close", run_internal_test,
+	  "closing and writing chapters" },
+	{ "sparse", run_session_test,
+	  "queries served by the sparse cache" },
+	{ "save", run_session_test,
+	  "saving and loading a full index" },
+};
+
+/**********************************************************************/
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <file> [test...]\n"
+		"\n"
+		"Options:\n"
+		"  -c, --chapters=N      chapters per volume (default %u)\n"
+		"  -p, --record-pages=N  record pages per chapter "
+		"(default %u)\n"
+		"  -r, --records=N       delta index entries (default %u)\n"
+		"  -C, --compact         use compact chapter index pages\n"
+		"  -z, --zones=N         index zones (default from cores)\n"
+		"  -k, --checkpoint=N    chapters between checkpoints "
+		"(default none)\n"
+		"  -h, --help            show this message\n"
+		"\n"
+		"Tests (default all):\n",
+		program,
+		DEFAULT_CHAPTERS,
+		DEFAULT_RECORD_PAGES,
+		DEFAULT_DELTA_RECORDS);
+	for (unsigned int i = 0; i < ARRAY_SIZE(tests); i++) {
+		fprintf(stderr,
+			"  %-8s %s\n",
+			tests[i].name,
+			tests[i].description);
+	}
+}
+
+/**********************************************************************/
+int main(int argc, char *argv[])
+{
+	static const struct option long_options[] = {
+		{ "chapters", required_argument, NULL, 'c' },
+		{ "record-pages", required_argument, NULL, 'p' },
+		{ "records", required_argument, NULL, 'r' },
+		{ "compact", no_argument, NULL, 'C' },
+		{ "zones", required_argument, NULL, 'z' },
+		{ "checkpoint", required_argument, NULL, 'k' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	struct bench_options options = {
+		.chapters = DEFAULT_CHAPTERS,
+		.record_pages = DEFAULT_RECORD_PAGES,
+		.delta_records = DEFAULT_DELTA_RECORDS,
+		.params = UDS_PARAMETERS_INITIALIZER,
+	};
+	struct registered_thread allocating_thread;
+	int opt, failures = 0;
+
+	while ((opt = getopt_long(argc, argv, "c:p:r:Cz:k:h", long_options,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 'c':
+			options.chapters = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			options.record_pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			options.delta_records = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			options.compact = true;
+			break;
+		case 'z':
+			options.params.zone_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			options.params.checkpoint_frequency =
+				strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if ((optind >= argc) || (options.chapters < 2) ||
+	    (options.record_pages == 0) || (options.delta_records == 0)) {
+		usage(argv[0]);
+		return 2;
+	}
+	options.path = argv[optind++];
+	for (int arg = optind; arg < argc; arg++) {
+		unsigned int i;
+		for (i = 0; i < ARRAY_SIZE(tests); i++) {
+			if (strcmp(argv[arg], tests[i].name) == 0) {
+				break;
+			}
+		}
+		if (i == ARRAY_SIZE(tests)) {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	uds_initialize_thread_device_registry();
+	memory_init();
+	register_allocating_thread(&allocating_thread, NULL);
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(tests); i++) {
+		bool selected = (optind == argc);
+		for (int arg = optind; arg < argc; arg++) {
+			selected |= (strcmp(argv[arg], tests[i].name) == 0);
+		}
+		if (selected &&
+		    (tests[i].run(tests[i].name, &options) != UDS_SUCCESS)) {
+			failures++;
+		}
+	}
+
+	unregister_allocating_thread();
+	memory_exit();
+	return (failures == 0) ? 0 : 1;
+}
@@ -107,20 +107,20 @@ static struct funnel_queue_entry *get_oldest(struct funnel_queue *queue)
 	return oldest;
 }
 
-/**********************************************************************/
-struct funnel_queue_entry *funnel_queue_poll(struct funnel_queue *queue)
+/**
+ * Remove an entry returned by get_oldest() from a queue.
+ *
+ * @param queue   the queue
+ * @param oldest  the oldest entry in the queue
+ **/
+static INLINE void remove_oldest(struct funnel_queue *queue,
+				 struct funnel_queue_entry *oldest)
 {
-	struct funnel_queue_entry *oldest = get_oldest(queue);
-	if (oldest == NULL) {
-		return oldest;
-	}
-
 	/*
-	 * Dequeue the oldest entry and return it. Only one consumer thread may
-	 * call this function, so no locking, atomic operations, or fences are
-	 * needed; queue->oldest is owned by the consumer and oldest->next is
-	 * never used by a producer thread after it is swung from NULL to
-	 * non-NULL.
+	 * Only one consumer thread may call this function, so no locking,
+	 * atomic operations, or fences are needed; queue->oldest is owned by
+	 * the consumer and oldest->next is never used by a producer thread
+	 * after it is swung from NULL to non-NULL.
 	 */
 	queue->oldest = oldest->next;
 	/*
@@ -131,15 +131,48 @@ struct funnel_queue_entry *funnel_queue_poll(struct funnel_queue *queue)
 	 * we'll properly see the dependent data.
 	 */
 	smp_rmb();
+	oldest->next = NULL;
+}
+
+/**********************************************************************/
+struct funnel_queue_entry *funnel_queue_poll(struct funnel_queue *queue)
+{
+	struct funnel_queue_entry *oldest = get_oldest(queue);
+	if (oldest == NULL) {
+		return oldest;
+	}
+
+	// Dequeue the oldest entry and return it.
+	remove_oldest(queue, oldest);
 	/*
 	 * If "oldest" is a very light-weight work item, we'll be looking
 	 * for the next one very soon, so prefetch it now.
 	 */
 	prefetch_address(queue->oldest, true);
-	oldest->next = NULL;
 	return oldest;
 }
 
+/**********************************************************************/
+unsigned int funnel_queue_poll_batch(struct funnel_queue *queue,
+				     struct funnel_queue_entry *entries[],
+				     unsigned int max)
+{
+	unsigned int count = 0;
+	while (count < max) {
+		struct funnel_queue_entry *oldest = get_oldest(queue);
+		if (oldest == NULL) {
+			break;
+		}
+
+		// Prefetch the entry after this one while it is dequeued, so
+		// that walking the batch does not miss on every link.
+		prefetch_address(oldest->next, true);
+		remove_oldest(queue, oldest);
+		entries[count++] = oldest;
+	}
+	return count;
+}
+
 /**********************************************************************/
 bool is_funnel_queue_empty(struct funnel_queue *queue)
 {
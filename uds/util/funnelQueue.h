@@ -156,6 +156,34 @@ static INLINE void funnel_queue_put(struct funnel_queue *queue,
 	previous->next = entry;
 }
 
+/**
+ * Put a chain of entries on the end of the queue with a single exchange. The
+ * entries must already be linked from first to last through their next
+ * fields, as with funnel_queue_put(); the last entry's next field will be
+ * cleared.
+ *
+ * @param queue  the queue on which to place the entries
+ * @param first  the first (oldest) entry of the chain
+ * @param last   the last (newest) entry of the chain
+ **/
+static INLINE void funnel_queue_put_chain(struct funnel_queue *queue,
+					  struct funnel_queue_entry *first,
+					  struct funnel_queue_entry *last)
+{
+	struct funnel_queue_entry *previous;
+
+	// The barrier requirements are those of funnel_queue_put(), applied
+	// to every entry of the chain.
+	last->next = NULL;
+#pragma GCC diagnostic push
+#if __GNUC__ >= 5
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+#endif
+	previous = xchg(&queue->newest, last);
+#pragma GCC diagnostic pop
+	previous->next = first;
+}
+
 /**
  * Poll a queue, removing the oldest entry if the queue is not empty. This
  * function must only be called from a single consumer thread.
@@ -167,6 +195,23 @@ static INLINE void funnel_queue_put(struct funnel_queue *queue,
 struct funnel_queue_entry *__must_check
 funnel_queue_poll(struct funnel_queue *queue);
 
+/**
+ * Poll a queue, removing up to a given number of the oldest entries. This
+ * is equivalent to calling funnel_queue_poll() until it returns NULL or the
+ * entries array is full, but it is cheaper. This function must only be
+ * called from a single consumer thread.
+ *
+ * @param queue    the queue from which to remove entries
+ * @param entries  an array to hold the removed entries, oldest first
+ * @param max      the size of the entries array
+ *
+ * @return the number of entries removed, which is zero if the queue is empty
+ **/
+unsigned int __must_check
+funnel_queue_poll_batch(struct funnel_queue *queue,
+			struct funnel_queue_entry *entries[],
+			unsigned int max);
+
 /**
  * Check whether the funnel queue is empty or not. This function must only be
  * called from a single consumer thread, as with funnel_queue_poll.
@@ -32,6 +32,7 @@
 
 #include "compiler.h"
 #include "memoryAlloc.h"
+#include "numeric.h"
 #include "stringUtils.h"
 #include "typeDefs.h"
 #include "uds.h"
@@ -69,8 +70,20 @@ struct task {
 	uint16_t length; // The number of bytes remaining in the sort keys.
 };
 
+/**
+ * A chunk name being sorted by radix_sort_names(), with its leading bytes
+ * loaded as an integer so that most comparisons need not touch the name.
+ **/
+struct name_entry {
+	uint64_t prefix;
+	sort_key_t key;
+};
+
 struct radix_sorter {
 	unsigned int count;
+	unsigned int name_bucket_bits;
+	uint32_t *name_buckets;
+	struct name_entry *name_entries;
 	struct histogram bins;
 	sort_key_t *pile[256];
 	struct task *end_of_stack;
@@ -278,6 +291,27 @@ int make_radix_sorter(unsigned int count, struct radix_sorter **sorter)
 	}
 	radix_sorter->count = count;
 	radix_sorter->end_of_stack = radix_sorter->stack + stack_size;
+
+	// Use at least as many name buckets as keys, so that each bucket
+	// holds about one name.
+	unsigned int bits = 1;
+	while ((bits < 24) && ((1U << bits) < count)) {
+		bits++;
+	}
+	radix_sorter->name_bucket_bits = bits;
+	result = ALLOCATE(1U << bits, uint32_t, "name sort buckets",
+			  &radix_sorter->name_buckets);
+	if (result != UDS_SUCCESS) {
+		free_radix_sorter(radix_sorter);
+		return result;
+	}
+	result = ALLOCATE(count, struct name_entry, "name sort entries",
+			  &radix_sorter->name_entries);
+	if (result != UDS_SUCCESS) {
+		free_radix_sorter(radix_sorter);
+		return result;
+	}
+
 	*sorter = radix_sorter;
 	return UDS_SUCCESS;
 }
@@ -285,6 +319,11 @@ int make_radix_sorter(unsigned int count, struct radix_sorter **sorter)
 /**********************************************************************/
 void free_radix_sorter(struct radix_sorter *sorter)
 {
+	if (sorter == NULL) {
+		return;
+	}
+	FREE(sorter->name_buckets);
+	FREE(sorter->name_entries);
 	FREE(sorter);
 }
 
@@ -381,3 +420,83 @@ int radix_sort(struct radix_sorter *sorter,
 	}
 	return UDS_SUCCESS;
 }
+
+/**
+ * Compare two chunk names being sorted by radix_sort_names().
+ *
+ * @param entry1  the first name
+ * @param entry2  the second name
+ *
+ * @return <code>true</code> if the first name sorts before the second
+ **/
+static INLINE bool name_precedes(const struct name_entry *entry1,
+				 const struct name_entry *entry2)
+{
+	if (entry1->prefix != entry2->prefix) {
+		return (entry1->prefix < entry2->prefix);
+	}
+	return (memcmp(&entry1->key[sizeof(uint64_t)],
+		       &entry2->key[sizeof(uint64_t)],
+		       UDS_CHUNK_NAME_SIZE - sizeof(uint64_t)) < 0);
+}
+
+/**********************************************************************/
+int radix_sort_names(struct radix_sorter *sorter,
+		     const unsigned char *keys[],
+		     unsigned int count)
+{
+	if (count <= 1) {
+		return UDS_SUCCESS;
+	}
+
+	if (count > sorter->count) {
+		return UDS_INVALID_ARGUMENT;
+	}
+
+	/*
+	 * Chunk names are uniformly distributed, so a single counting pass on
+	 * the leading bits of each name distributes the names into buckets
+	 * holding about one name each. Loading the first eight bytes of each
+	 * name as a big-endian integer orders the names as memcmp() would.
+	 */
+	unsigned int shift = 64 - sorter->name_bucket_bits;
+	uint32_t *buckets = sorter->name_buckets;
+	struct name_entry *entries = sorter->name_entries;
+	memset(buckets, 0, sizeof(uint32_t) << sorter->name_bucket_bits);
+
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		buckets[get_unaligned_be64(keys[i]) >> shift]++;
+	}
+
+	uint32_t start = 0;
+	for (i = 0; i < (1U << sorter->name_bucket_bits); i++) {
+		uint32_t size = buckets[i];
+		buckets[i] = start;
+		start += size;
+	}
+
+	for (i = 0; i < count; i++) {
+		uint64_t prefix = get_unaligned_be64(keys[i]);
+		struct name_entry *entry = &entries[buckets[prefix >> shift]++];
+		entry->prefix = prefix;
+		entry->key = keys[i];
+	}
+
+	// Each name is now in its bucket, so an insertion sort only moves
+	// names within their buckets, which are almost all tiny.
+	for (i = 1; i < count; i++) {
+		struct name_entry entry = entries[i];
+		unsigned int j = i;
+		while ((j > 0) && name_precedes(&entry, &entries[j - 1])) {
+			entries[j] = entries[j - 1];
+			j--;
+		}
+		entries[j] = entry;
+	}
+
+	for (i = 0; i < count; i++) {
+		keys[i] = entries[i].key;
+	}
+	return UDS_SUCCESS;
+}
@@ -25,9 +25,9 @@
 #include "compiler.h"
 
 /*
- * The implementation uses one large object allocated on the heap.  This
- * large object can be reused as many times as desired.  There is no
- * further heap usage by the sorting.
+ * The implementation uses a few objects allocated on the heap.  These
+ * objects can be reused as many times as desired.  There is no further heap
+ * usage by the sorting.
  */
 struct radix_sorter;
 
@@ -68,4 +68,20 @@ int __must_check radix_sort(struct radix_sorter *sorter,
 			    unsigned int count,
 			    unsigned short length);
 
+/**
+ * Sort pointers to chunk names. This is equivalent to radix_sort() with a
+ * length of UDS_CHUNK_NAME_SIZE, but it relies on the names being uniformly
+ * distributed, as hashes are, to sort them in a single distribution pass
+ * followed by an insertion sort within very small buckets.
+ *
+ * @param [in] sorter  the heap storage used by the sorting
+ * @param      keys    the array of name pointers to sort (modified in place)
+ * @param [in] count   the number of names
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check radix_sort_names(struct radix_sorter *sorter,
+				  const unsigned char *keys[],
+				  unsigned int count);
+
 #endif /* RADIX_SORT_H */
@@ -34,6 +34,7 @@
 #include "recordPage.h"
 #include "request.h"
 #include "sparseCache.h"
+#include "stageLatency.h"
 #include "stringUtils.h"
 #include "threads.h"
 
@@ -42,8 +43,13 @@ enum {
 					  // chapters
 	DEFAULT_VOLUME_READ_THREADS = 2,  // Default number of reader threads
 	MAX_VOLUME_READ_THREADS = 16,     // Maximum number of reader threads
+	MAX_STARTED_READS = 16,           // Maximum number of queued reads
+					  // started by a reader thread
+					  // before it waits for its own
 };
 
+unsigned int volume_read_threads = 0;
+
 /**********************************************************************/
 static unsigned int get_read_threads(const struct uds_parameters *user_params)
 {
@@ -87,6 +93,15 @@ static INLINE unsigned int get_zone_number(Request *request)
 	return (request == NULL) ? 0 : request->zone_number;
 }
 
+/**********************************************************************/
+static INLINE bool updates_page_recency(Request *request)
+{
+	// Only 1 zone is responsible for updating LRU, and lookup-only
+	// requests leave it alone.
+	return ((get_zone_number(request) == 0) &&
+		((request == NULL) || !request->lookup_only));
+}
+
 /**********************************************************************/
 int map_to_physical_page(const struct geometry *geometry,
 			 int chapter,
@@ -128,6 +143,62 @@ static void wait_for_read_queue_not_full(struct volume *volume,
 	}
 }
 
+static void read_thread_function(void *arg);
+
+/**
+ * Get the number of read threads a volume should have reading.
+ *
+ * @param volume  the volume
+ *
+ * @return the number of read threads for the current volume_read_threads
+ **/
+static unsigned int get_target_read_threads(const struct volume *volume)
+{
+	unsigned int read_threads = READ_ONCE(volume_read_threads);
+	if (read_threads == 0) {
+		return volume->configured_read_threads;
+	}
+	return min(read_threads, volume->max_read_threads);
+}
+
+/**
+ * Start more read threads, or let fewer of them read, to match the number
+ * volume_read_threads asks for. Threads are never stopped while the volume
+ * is in use; the ones beyond the number asked for just wait. We hold the
+ * readThreadsMutex.
+ *
+ * @param volume  the volume
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int adjust_read_threads(struct volume *volume)
+{
+	unsigned int read_threads = get_target_read_threads(volume);
+	if (read_threads == volume->active_read_threads) {
+		return UDS_SUCCESS;
+	}
+
+	int result = UDS_SUCCESS;
+	while (volume->num_read_threads < read_threads) {
+		struct thread **thread_ptr =
+			&volume->reader_threads[volume->num_read_threads];
+		result = create_thread(read_thread_function,
+				       (void *) volume,
+				       "reader",
+				       thread_ptr);
+		if (result != UDS_SUCCESS) {
+			break;
+		}
+		// We only stop as many threads as actually got started.
+		volume->num_read_threads++;
+	}
+
+	volume->active_read_threads = min(read_threads,
+					  volume->num_read_threads);
+	broadcast_cond(&volume->read_threads_cond);
+	return result;
+}
+
 /**********************************************************************/
 int enqueue_page_read(struct volume *volume,
 		      Request *request,
@@ -143,7 +214,13 @@ int enqueue_page_read(struct volume *volume,
 	// Mark the page as queued in the volume cache, for chapter
 	// invalidation to be able to cancel a read. If we are unable to do
 	// this because the queues are full, flush them first
-	int result;
+	int result = adjust_read_threads(volume);
+	if (result != UDS_SUCCESS) {
+		log_warning_strerror(result,
+				     "cannot start more read threads");
+	}
+
+	request->stage_start = current_time_ns(CLOCK_MONOTONIC);
 	while ((result = enqueue_read(volume->page_cache,
 				      request,
 				      physical_page)) == UDS_SUCCESS) {
@@ -169,6 +246,7 @@ wait_to_reserve_read_queue_entry(struct volume *volume,
 {
 	while (((volume->reader_state & READER_STATE_EXIT) == 0) &&
 	       (((volume->reader_state & READER_STATE_STOP) != 0) ||
+		(volume->busy_reader_threads >= volume->active_read_threads) ||
 		!reserve_read_queue_entry(volume->page_cache,
 					  queue_pos,
 					  request_list,
@@ -245,6 +323,25 @@ static int initialize_index_page(const struct volume *volume,
 	return result;
 }
 
+/**
+ * Start reading a set of pages without waiting for them. The reads complete
+ * asynchronously into the volume store's buffers, where the reader threads
+ * will find them when they come to wait for those pages.
+ *
+ * @param volume  the volume
+ * @param pages   the physical pages to read
+ * @param count   the number of pages
+ **/
+static void start_page_reads(struct volume *volume,
+			     const unsigned int *pages,
+			     unsigned int count)
+{
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		prefetch_volume_pages(&volume->volume_store, pages[i], 1);
+	}
+}
+
 /**********************************************************************/
 static void read_thread_function(void *arg)
 {
@@ -279,7 +376,24 @@ static void read_thread_function(void *arg)
 			result = select_victim_in_cache(volume->page_cache,
 							&page);
 			if (result == UDS_SUCCESS) {
+				// Before blocking on this read, start the reads
+				// other queued requests are waiting for, so that
+				// the number of reads in flight is not limited
+				// by the number of reader threads.
+				unsigned int pages[MAX_STARTED_READS + 1];
+				unsigned int count = 1;
+				pages[0] = physical_page;
+				volume->page_cache->read_queue[queue_pos].started =
+					true;
+				count += collect_unstarted_reads(volume->page_cache,
+								 &pages[1],
+								 MAX_STARTED_READS);
 				unlock_mutex(&volume->read_threads_mutex);
+				if (count > 1) {
+					// This page goes first since this thread
+					// is about to wait for it.
+					start_page_reads(volume, pages, count);
+				}
 				result =
 					read_volume_page(&volume->volume_store,
 							 physical_page,
@@ -373,6 +487,8 @@ static void read_thread_function(void *arg)
 
 			// reflect any read failures in the request status
 			request->status = result;
+			record_stage_latency(LATENCY_PAGE_READ,
+					     request->stage_start);
 			restart_request(request);
 		}
 
@@ -470,8 +586,7 @@ int get_volume_page_locked(struct volume *volume,
 		if (result != UDS_SUCCESS) {
 			return result;
 		}
-	} else if (get_zone_number(request) == 0) {
-		// Only 1 zone is responsible for updating LRU
+	} else if (updates_page_recency(request)) {
 		make_page_most_recent(volume->page_cache, page);
 	}
 
@@ -580,8 +695,7 @@ int get_volume_page_protected(struct volume *volume,
 				     zone_number);
 		unlock_mutex(&volume->read_threads_mutex);
 	} else {
-		if (get_zone_number(request) == 0) {
-			// Only 1 zone is responsible for updating LRU
+		if (updates_page_recency(request)) {
 			make_page_most_recent(volume->page_cache, page);
 		}
 	}
@@ -784,6 +898,49 @@ int read_chapter_index_from_volume(const struct volume *volume,
 	return result;
 }
 
+/**********************************************************************/
+void prefetch_volume_page_cache(struct volume *volume,
+				Request *request,
+				const struct uds_chunk_name *name,
+				uint64_t virtual_chapter)
+{
+	unsigned int physical_chapter =
+		map_to_physical_chapter(volume->geometry, virtual_chapter);
+	unsigned int index_page_number;
+	int result = find_index_page_number(volume->index_page_map,
+					    name,
+					    physical_chapter,
+					    &index_page_number);
+	if (result != UDS_SUCCESS) {
+		// The search itself will report the error.
+		return;
+	}
+
+	unsigned int zone_number = get_zone_number(request);
+	unsigned int physical_page = map_to_physical_page(volume->geometry,
+							  physical_chapter,
+							  index_page_number);
+
+	// See search_cached_index_page() for why the search must be pending
+	// before looking in the page cache.
+	begin_pending_search(volume->page_cache, physical_page, zone_number);
+	bool queued;
+	struct cached_page *page;
+	result = peek_page_in_cache(volume->page_cache, physical_page,
+				    &queued, &page);
+	if ((result == UDS_SUCCESS) && (page != NULL)) {
+		prefetch_chapter_index_page(&page->cp_index_page,
+					    volume->geometry, name, false);
+	}
+	end_pending_search(volume->page_cache, zone_number);
+
+	if ((result == UDS_SUCCESS) && (page == NULL) && !queued) {
+		// Start reading the page now, so that the read the search will
+		// queue (or do) finds it in the buffer cache.
+		prefetch_volume_pages(&volume->volume_store, physical_page, 1);
+	}
+}
+
 /**********************************************************************/
 int search_volume_page_cache(struct volume *volume,
 			     Request *request,
@@ -977,6 +1134,62 @@ int write_index_pages(struct volume *volume,
 	return UDS_SUCCESS;
 }
 
+/**
+ * Sort, encode, and write one record page of a chapter.
+ *
+ * @param volume              The volume containing the chapter
+ * @param physical_page       The page number in the volume of the first
+ *                            record page of the chapter
+ * @param records             A 1-based array of chunk records in the chapter
+ * @param record_page_number  The record page to write
+ * @param sorter              The radix sorter to use
+ * @param record_pointers     The record pointer array to use while sorting
+ * @param volume_page         The page to use to write the record page
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int write_record_page(struct volume *volume,
+			     int physical_page,
+			     const struct uds_chunk_record records[],
+			     unsigned int record_page_number,
+			     struct radix_sorter *sorter,
+			     const struct uds_chunk_record **record_pointers,
+			     struct volume_page *volume_page)
+{
+	struct geometry *geometry = volume->geometry;
+	int result = prepare_to_write_volume_page(&volume->volume_store,
+						  physical_page +
+							record_page_number,
+						  volume_page);
+	if (result != UDS_SUCCESS) {
+		return log_warning_strerror(result,
+					    "failed to prepare record page");
+	}
+
+	// Sort the page of records and copy them to the record page as a
+	// binary tree stored in heap order. The record array from the open
+	// chapter is 1-based.
+	const struct uds_chunk_record *page_records =
+		&records[1 + (record_page_number * geometry->records_per_page)];
+	result = encode_record_page_with_sorter(geometry, sorter,
+						record_pointers, page_records,
+						get_page_data(volume_page));
+	if (result != UDS_SUCCESS) {
+		return log_warning_strerror(result,
+					    "failed to encode record page %u",
+					    record_page_number);
+	}
+
+	result = write_volume_page(&volume->volume_store,
+				   physical_page + record_page_number,
+				   volume_page);
+	if (result != UDS_SUCCESS) {
+		return log_warning_strerror(result,
+					    "failed to write chapter record page");
+	}
+	return UDS_SUCCESS;
+}
+
 /**********************************************************************/
 int write_record_pages(struct volume *volume,
 		       int physical_page,
@@ -986,40 +1199,18 @@ int write_record_pages(struct volume *volume,
 	struct geometry *geometry = volume->geometry;
 	// Skip over the index pages, which come before the record pages
 	physical_page += geometry->index_pages_per_chapter;
-	// The record array from the open chapter is 1-based.
-	const struct uds_chunk_record *next_record = &records[1];
 
 	unsigned int record_page_number;
 	for (record_page_number = 0;
 	     record_page_number < geometry->record_pages_per_chapter;
 	     record_page_number++) {
-		int result =
-			prepare_to_write_volume_page(&volume->volume_store,
-						     physical_page +
-							record_page_number,
-						     &volume->scratch_page);
+		int result = write_record_page(volume, physical_page, records,
+					       record_page_number,
+					       volume->radix_sorter,
+					       volume->record_pointers,
+					       &volume->scratch_page);
 		if (result != UDS_SUCCESS) {
-			return log_warning_strerror(result,
-						    "failed to prepare record page");
-		}
-
-		// Sort the next page of records and copy them to the record
-		// page as a binary tree stored in heap order.
-		result = encode_record_page(volume, next_record,
-					    get_page_data(&volume->scratch_page));
-		if (result != UDS_SUCCESS) {
-			return log_warning_strerror(result,
-						    "failed to encode record page %u",
-						    record_page_number);
-		}
-		next_record += geometry->records_per_page;
-
-		result = write_volume_page(&volume->volume_store,
-					   physical_page + record_page_number,
-					   &volume->scratch_page);
-		if (result != UDS_SUCCESS) {
-			return log_warning_strerror(result,
-						    "failed to write chapter record page");
+			return result;
 		}
 
 		if (pages != NULL) {
@@ -1031,18 +1222,62 @@ int write_record_pages(struct volume *volume,
 	return UDS_SUCCESS;
 }
 
+/**********************************************************************/
+int write_record_page_range(struct volume *volume,
+			    int physical_page,
+			    const struct uds_chunk_record records[],
+			    unsigned int first_page,
+			    unsigned int page_count,
+			    struct radix_sorter *sorter,
+			    const struct uds_chunk_record **record_pointers,
+			    struct volume_page *volume_page)
+{
+	// Skip over the index pages, which come before the record pages
+	physical_page += volume->geometry->index_pages_per_chapter;
+
+	unsigned int record_page_number;
+	for (record_page_number = first_page;
+	     record_page_number < first_page + page_count;
+	     record_page_number++) {
+		int result = write_record_page(volume, physical_page, records,
+					       record_page_number, sorter,
+					       record_pointers, volume_page);
+		if (result != UDS_SUCCESS) {
+			release_volume_page(volume_page);
+			return result;
+		}
+	}
+	release_volume_page(volume_page);
+	return UDS_SUCCESS;
+}
+
+/**********************************************************************/
+int get_chapter_physical_page(const struct volume *volume,
+			      uint64_t virtual_chapter)
+{
+	struct geometry *geometry = volume->geometry;
+	unsigned int physical_chapter_number =
+		map_to_physical_chapter(geometry, virtual_chapter);
+	return map_to_physical_page(geometry, physical_chapter_number, 0);
+}
+
+/**********************************************************************/
+int finish_writing_chapter(struct volume *volume)
+{
+	release_volume_page(&volume->scratch_page);
+	// Flush the data to permanent storage.
+	return sync_volume_store(&volume->volume_store);
+}
+
 /**********************************************************************/
 int write_chapter(struct volume *volume,
 		  struct open_chapter_index *chapter_index,
 		  const struct uds_chunk_record records[])
 {
 	// Determine the position of the virtual chapter in the volume file.
-	struct geometry *geometry = volume->geometry;
-	unsigned int physical_chapter_number =
-		map_to_physical_chapter(geometry,
-					chapter_index->virtual_chapter_number);
 	int physical_page =
-		map_to_physical_page(geometry, physical_chapter_number, 0);
+		get_chapter_physical_page(volume,
+					  chapter_index->virtual_chapter_number);
 
 	// Pack and write the delta chapter index pages to the volume.
 	int result =
@@ -1055,9 +1290,7 @@ int write_chapter(struct volume *volume,
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
-	release_volume_page(&volume->scratch_page);
-	// Flush the data to permanent storage.
-	return sync_volume_store(&volume->volume_store);
+	return finish_writing_chapter(volume);
 }
 
 /**********************************************************************/
@@ -1445,9 +1678,9 @@ int make_volume(const struct configuration *config,
 		unsigned int zone_count,
 		struct volume **new_volume)
 {
-	unsigned int volume_read_threads = get_read_threads(user_params);
+	unsigned int read_threads = get_read_threads(user_params);
 
-	if (read_queue_max_size <= volume_read_threads) {
+	if (read_queue_max_size <= read_threads) {
 		uds_log_error("Number of read threads must be smaller than read queue");
 		return UDS_INVALID_ARGUMENT;
 	}
@@ -1475,8 +1708,12 @@ int make_volume(const struct configuration *config,
 	}
 
 	// Start the reader threads.  If this allocation succeeds, free_volume
-	// knows that it needs to try and stop those threads.
-	result = ALLOCATE(volume_read_threads,
+	// knows that it needs to try and stop those threads. There is room
+	// for as many threads as volume_read_threads may later ask for.
+	volume->configured_read_threads = read_threads;
+	volume->max_read_threads = min((unsigned int) MAX_VOLUME_READ_THREADS,
+				       read_queue_max_size - 1);
+	result = ALLOCATE(volume->max_read_threads,
 			  struct thread *,
 			  "reader threads",
 			  &volume->reader_threads);
@@ -1484,18 +1721,12 @@ int make_volume(const struct configuration *config,
 		free_volume(volume);
 		return result;
 	}
-	unsigned int i;
-	for (i = 0; i < volume_read_threads; i++) {
-		result = create_thread(read_thread_function,
-				       (void *) volume,
-				       "reader",
-				       &volume->reader_threads[i]);
-		if (result != UDS_SUCCESS) {
-			free_volume(volume);
-			return result;
-		}
-		// We only stop as many threads as actually got started.
-		volume->num_read_threads = i + 1;
+	lock_mutex(&volume->read_threads_mutex);
+	result = adjust_read_threads(volume);
+	unlock_mutex(&volume->read_threads_mutex);
+	if (result != UDS_SUCCESS) {
+		free_volume(volume);
+		return result;
 	}
 
 	*new_volume = volume;
@@ -94,10 +94,23 @@ struct volume {
 	enum reader_state reader_state;
 	/* The lookup mode for the index */
 	enum index_lookup_mode lookup_mode;
-	/* Number of read threads to use (run-time parameter) */
+	/* Number of read threads started */
 	unsigned int num_read_threads;
+	/* Number of read threads which may be reading at once */
+	unsigned int active_read_threads;
+	/* Number of read threads the index was opened with */
+	unsigned int configured_read_threads;
+	/* The most read threads the read queue allows */
+	unsigned int max_read_threads;
 };
 
+/**
+ * The number of read threads every volume should use, or zero for each
+ * volume to use the number its index was opened with. More threads are
+ * started, or some are left idle, as a volume next queues a page read.
+ **/
+extern unsigned int volume_read_threads;
+
 /**
  * Create a volume.
  *
@@ -167,6 +180,24 @@ int __must_check find_volume_chapter_boundaries(struct volume *volume,
 						uint64_t *highest_vcn,
 						bool *is_empty);
 
+/**
+ * Prepare to search the volume for a name by starting to fetch the chapter
+ * index page the search will read. If the page is cached, the part of it the
+ * search will read is prefetched into the CPU cache. If it is not cached and
+ * no read of it is queued, the page is prefetched from storage. This never
+ * blocks, so a zone thread can call it for a batch of requests before
+ * searching for any of them.
+ *
+ * @param volume           The volume
+ * @param request          The request which will search the volume
+ * @param name             The block name of interest
+ * @param virtual_chapter  The number of the chapter which will be searched
+ **/
+void prefetch_volume_page_cache(struct volume *volume,
+				Request *request,
+				const struct uds_chunk_name *name,
+				uint64_t virtual_chapter);
+
 /**
  * Find any matching metadata for the given name within a given physical
  * chapter.
@@ -265,6 +296,55 @@ int __must_check write_record_pages(struct volume *volume,
 				    const struct uds_chunk_record records[],
 				    byte **pages);
 
+/**
+ * Write a range of a chapter's record pages to a volume. Several threads
+ * may write disjoint ranges of the same chapter at once, provided that each
+ * uses its own sorter, record pointer array, and page.
+ *
+ * @param volume           the volume containing the chapter
+ * @param physical_page    the page number in the volume for the chapter
+ * @param records          a 1-based array of chunk records in the chapter
+ * @param first_page       the first record page of the range
+ * @param page_count       the number of record pages in the range
+ * @param sorter           the radix sorter to use
+ * @param record_pointers  an array of records_per_page pointers to use
+ *                         while sorting
+ * @param volume_page      the page to use for writing, which is released
+ *                         when the range has been written
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check
+write_record_page_range(struct volume *volume,
+			int physical_page,
+			const struct uds_chunk_record records[],
+			unsigned int first_page,
+			unsigned int page_count,
+			struct radix_sorter *sorter,
+			const struct uds_chunk_record **record_pointers,
+			struct volume_page *volume_page);
+
+/**
+ * Get the page number in the volume of the first page of a chapter.
+ *
+ * @param volume           the volume containing the chapter
+ * @param virtual_chapter  the virtual chapter number
+ *
+ * @return the physical page number of the chapter
+ **/
+int __must_check get_chapter_physical_page(const struct volume *volume,
+					   uint64_t virtual_chapter);
+
+/**
+ * Flush the pages of a chapter which have been written to the volume to
+ * permanent storage.
+ *
+ * @param volume  the volume containing the chapter
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check finish_writing_chapter(struct volume *volume);
+
 /**
  * Write the index and records from the most recently filled chapter to the
  * volume.
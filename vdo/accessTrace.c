@@ -0,0 +1,295 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "accessTrace.h"
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/hash.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+
+#include "memoryAlloc.h"
+
+#include "dataVIO.h"
+#include "vdoInit.h"
+
+#include "kernelLayer.h"
+
+enum {
+	/** The number of records the ring can hold */
+	ACCESS_TRACE_SIZE = 1 << 16,
+	/** The number of records copied out under the lock at a time */
+	ACCESS_TRACE_READ_BATCH = 16,
+	/** The number of bits of the location which hold the pbn */
+	ACCESS_TRACE_PBN_BITS = 40,
+	/** The shift of the operation in the location */
+	ACCESS_TRACE_OPERATION_SHIFT = 40,
+	/** The shift of the outcome in the location */
+	ACCESS_TRACE_OUTCOME_SHIFT = 44,
+	/** The shift of the sequence number in the location */
+	ACCESS_TRACE_SEQUENCE_SHIFT = 48,
+};
+
+struct access_trace {
+	/** Protects the ring */
+	spinlock_t lock;
+	/** The trace records one leaf page in this many, or none if 0 */
+	unsigned int rate;
+	/** The number of records ever added to the ring */
+	uint64_t sequence;
+	/** The sequence number of the oldest record not yet read */
+	uint64_t oldest;
+	/** The debugfs directory of the device */
+	struct dentry *directory;
+	/** The ring of records, or NULL if the trace has never been enabled */
+	struct access_trace_record *records;
+};
+
+/** The debugfs directory holding the directories of all devices */
+static struct dentry *access_trace_root;
+
+/**
+ * Read and consume the oldest records of a trace. This is the read
+ * operation of the access_trace file in debugfs.
+ **/
+static ssize_t read_access_trace(struct file *file,
+				 char __user *buffer,
+				 size_t count,
+				 loff_t *position __always_unused)
+{
+	struct access_trace *trace = file->private_data;
+	struct access_trace_record batch[ACCESS_TRACE_READ_BATCH];
+	size_t copied = 0;
+
+	while ((count - copied) >= sizeof(struct access_trace_record)) {
+		size_t wanted = min_t(size_t,
+				      ACCESS_TRACE_READ_BATCH,
+				      ((count - copied)
+				       / sizeof(struct access_trace_record)));
+		size_t i, found;
+
+		spin_lock(&trace->lock);
+		found = min_t(uint64_t, wanted,
+			      trace->sequence - trace->oldest);
+		for (i = 0; i < found; i++) {
+			batch[i] = trace->records[(trace->oldest + i)
+						  % ACCESS_TRACE_SIZE];
+		}
+		trace->oldest += found;
+		spin_unlock(&trace->lock);
+
+		if (found == 0) {
+			break;
+		}
+
+		if (copy_to_user(buffer + copied, batch,
+				 found * sizeof(struct access_trace_record))
+		    != 0) {
+			return ((copied > 0) ? copied : -EFAULT);
+		}
+
+		copied += found * sizeof(struct access_trace_record);
+	}
+
+	return copied;
+}
+
+static const struct file_operations access_trace_operations = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = read_access_trace,
+	.llseek = no_llseek,
+};
+
+/**********************************************************************/
+void create_access_trace_root(void)
+{
+	access_trace_root = debugfs_create_dir("vdo", NULL);
+}
+
+/**********************************************************************/
+void remove_access_trace_root(void)
+{
+	debugfs_remove_recursive(access_trace_root);
+	access_trace_root = NULL;
+}
+
+/**********************************************************************/
+int make_access_trace(struct kernel_layer *layer,
+		      struct access_trace **trace_ptr)
+{
+	const char *name =
+		get_vdo_device_name(layer->vdo.device_config->owning_target);
+	struct access_trace *trace;
+	int result = ALLOCATE(1, struct access_trace, __func__, &trace);
+
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	spin_lock_init(&trace->lock);
+	// Tracing works without debugfs, so failures here are ignored.
+	trace->directory = debugfs_create_dir(name, access_trace_root);
+	debugfs_create_file("access_trace", 0400, trace->directory, trace,
+			    &access_trace_operations);
+	*trace_ptr = trace;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_access_trace(struct access_trace **trace_ptr)
+{
+	struct access_trace *trace = *trace_ptr;
+
+	if (trace == NULL) {
+		return;
+	}
+
+	debugfs_remove_recursive(trace->directory);
+	FREE(trace->records);
+	FREE(trace);
+	*trace_ptr = NULL;
+}
+
+/**
+ * Get the operation and outcome of a finished data_vio, and the physical
+ * block it read or wrote.
+ *
+ * @param [in]  data_vio   The data_vio
+ * @param [out] operation  The kind of request
+ * @param [out] outcome    What became of the block
+ *
+ * @return The pbn read or written
+ **/
+static physical_block_number_t
+classify_data_vio(struct data_vio *data_vio,
+		  enum access_trace_operation *operation,
+		  enum access_trace_outcome *outcome)
+{
+	if (is_trim_data_vio(data_vio)) {
+		*operation = ACCESS_TRACE_DISCARD;
+		*outcome = ACCESS_TRACE_UNMAPPED;
+		return VDO_ZERO_BLOCK;
+	}
+
+	if (is_read_data_vio(data_vio)) {
+		*operation = ACCESS_TRACE_READ;
+		if (data_vio->mapped.pbn == VDO_ZERO_BLOCK) {
+			*outcome = ACCESS_TRACE_UNMAPPED;
+		} else if (is_compressed(data_vio->mapped.state)) {
+			*outcome = ACCESS_TRACE_COMPRESSED;
+		} else {
+			*outcome = ACCESS_TRACE_MAPPED;
+		}
+
+		return data_vio->mapped.pbn;
+	}
+
+	*operation = ACCESS_TRACE_WRITE;
+	if (data_vio->new_mapped.pbn == VDO_ZERO_BLOCK) {
+		*outcome = ACCESS_TRACE_UNMAPPED;
+	} else if (data_vio->is_duplicate &&
+		   (data_vio->duplicate.pbn == data_vio->new_mapped.pbn)) {
+		*outcome = ACCESS_TRACE_DEDUPED;
+	} else if (is_compressed(data_vio->new_mapped.state)) {
+		*outcome = ACCESS_TRACE_COMPRESSED;
+	} else {
+		*outcome = ACCESS_TRACE_WRITTEN;
+	}
+
+	return data_vio->new_mapped.pbn;
+}
+
+/**********************************************************************/
+void trace_data_vio_access(struct access_trace *trace,
+			   struct data_vio *data_vio)
+{
+	unsigned int rate = READ_ONCE(trace->rate);
+	logical_block_number_t lbn = data_vio->logical.lbn;
+	enum access_trace_operation operation;
+	enum access_trace_outcome outcome;
+	physical_block_number_t pbn;
+	uint64_t location;
+
+	// Reads launched by the post-process deduper are not user requests.
+	if ((rate == 0) || data_vio->is_rededupe ||
+	    ((hash_64(lbn / VDO_BLOCK_MAP_ENTRIES_PER_PAGE, 32) % rate) != 0)) {
+		return;
+	}
+
+	pbn = classify_data_vio(data_vio, &operation, &outcome);
+	location = ((pbn & ((1ULL << ACCESS_TRACE_PBN_BITS) - 1))
+		    | ((uint64_t) operation << ACCESS_TRACE_OPERATION_SHIFT)
+		    | ((uint64_t) outcome << ACCESS_TRACE_OUTCOME_SHIFT));
+
+	spin_lock(&trace->lock);
+	if (trace->records != NULL) {
+		uint64_t sequence = trace->sequence++;
+
+		location |= ((sequence & 0xFFFF)
+			     << ACCESS_TRACE_SEQUENCE_SHIFT);
+		trace->records[sequence % ACCESS_TRACE_SIZE] =
+			(struct access_trace_record) {
+				.time = __cpu_to_le64(ktime_get_ns()),
+				.lbn = __cpu_to_le64(lbn),
+				.location = __cpu_to_le64(location),
+			};
+		if ((trace->sequence - trace->oldest) > ACCESS_TRACE_SIZE) {
+			trace->oldest = trace->sequence - ACCESS_TRACE_SIZE;
+		}
+	}
+	spin_unlock(&trace->lock);
+}
+
+/**********************************************************************/
+unsigned int get_access_trace_rate(struct access_trace *trace)
+{
+	return READ_ONCE(trace->rate);
+}
+
+/**********************************************************************/
+int set_access_trace_rate(struct access_trace *trace, unsigned int rate)
+{
+	struct access_trace_record *records = NULL;
+
+	if ((rate > 0) && (READ_ONCE(trace->records) == NULL)) {
+		int result = ALLOCATE(ACCESS_TRACE_SIZE,
+				      struct access_trace_record,
+				      __func__,
+				      &records);
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
+	}
+
+	spin_lock(&trace->lock);
+	if (trace->records == NULL) {
+		trace->records = records;
+		records = NULL;
+	}
+	WRITE_ONCE(trace->rate, rate);
+	spin_unlock(&trace->lock);
+
+	// Another caller may have made the ring first.
+	FREE(records);
+	return VDO_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef ACCESS_TRACE_H
+#define ACCESS_TRACE_H
+
+#include "types.h"
+
+#include "kernelTypes.h"
+
+/**
+ * An access_trace records a sample of the requests completed by a device in
+ * a ring buffer, for replay through offline models of the block map page
+ * cache and the dedupe index when sizing them. The sample is of block map
+ * leaf pages rather than of requests: while tracing, every request for a
+ * block on a sampled page is recorded, so that the reuse of both pages and
+ * blocks in the sample is the same as in the full stream.
+ *
+ * The ring is read, oldest record first, from the access_trace file in the
+ * device's directory under vdo in debugfs. Reading consumes the records
+ * read. When the ring is full, new records replace the oldest ones; the
+ * sequence numbers of the records show where any were lost.
+ **/
+struct access_trace;
+
+/** The kinds of request in an access trace */
+enum access_trace_operation {
+	ACCESS_TRACE_READ = 0,
+	ACCESS_TRACE_WRITE = 1,
+	ACCESS_TRACE_DISCARD = 2,
+};
+
+/** What became of the block of a request in an access trace */
+enum access_trace_outcome {
+	/** A read or write of the zero block, or a discard */
+	ACCESS_TRACE_UNMAPPED = 0,
+	/** A read of an uncompressed block */
+	ACCESS_TRACE_MAPPED = 1,
+	/** A write to a newly allocated block */
+	ACCESS_TRACE_WRITTEN = 2,
+	/** A write which shared an existing copy of its data */
+	ACCESS_TRACE_DEDUPED = 3,
+	/** A read or write of a compressed block */
+	ACCESS_TRACE_COMPRESSED = 4,
+};
+
+/**
+ * The record of one request in an access trace, as it is read from debugfs.
+ * The location packs the pbn in its low 40 bits, then the operation and the
+ * outcome in 4 bits each, then the low 16 bits of the sequence number of the
+ * record in the trace.
+ **/
+struct access_trace_record {
+	/** The monotonic time at which the request finished, in nanoseconds */
+	__le64 time;
+	/** The logical block of the request */
+	__le64 lbn;
+	/** The packed location, operation, outcome, and sequence number */
+	__le64 location;
+} __packed;
+
+/**
+ * Create the debugfs directory which holds the traces of all devices. This
+ * is called when the module is loaded; tracing still works, but can not be
+ * read, if debugfs is not available.
+ **/
+void create_access_trace_root(void);
+
+/**
+ * Remove the debugfs directory which holds the traces of all devices.
+ **/
+void remove_access_trace_root(void);
+
+/**
+ * Make an access trace for a kernel layer. It is initially disabled, and
+ * takes no space for records until it is first enabled.
+ *
+ * @param [in]  layer      The kernel layer
+ * @param [out] trace_ptr  A pointer to hold the new trace
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check make_access_trace(struct kernel_layer *layer,
+				   struct access_trace **trace_ptr);
+
+/**
+ * Free an access trace and null out the reference to it.
+ *
+ * @param trace_ptr  A pointer to the trace to free
+ **/
+void free_access_trace(struct access_trace **trace_ptr);
+
+/**
+ * Record a finished data_vio if its block is in the sample.
+ *
+ * @param trace     The trace
+ * @param data_vio  The data_vio which has finished
+ **/
+void trace_data_vio_access(struct access_trace *trace,
+			   struct data_vio *data_vio);
+
+/**
+ * Get the sampling rate of an access trace.
+ *
+ * @param trace  The trace
+ *
+ * @return The trace records one block map leaf page in this many, or 0 if
+ *         it is disabled
+ **/
+unsigned int get_access_trace_rate(struct access_trace *trace);
+
+/**
+ * Set the sampling rate of an access trace, making space for its records if
+ * it is being enabled for the first time.
+ *
+ * @param trace  The trace
+ * @param rate   The trace should record one block map leaf page in this
+ *               many, or none if 0
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check set_access_trace_rate(struct access_trace *trace,
+				       unsigned int rate);
+
+#endif // ACCESS_TRACE_H
@@ -88,7 +88,20 @@ static int allocate_and_lock_block(struct allocating_vio *allocating_vio)
 	struct vio *vio = allocating_vio_as_vio(allocating_vio);
 	struct block_allocator *allocator =
 		get_block_allocator(allocating_vio->zone);
-	int result = allocate_vdo_block(allocator, &allocating_vio->allocation);
+	struct allocation_stream *stream = allocating_vio->stream;
+	logical_block_number_t lbn = allocating_vio->stream_lbn;
+	int result;
+
+	if (stream == NULL) {
+		result = allocate_vdo_block(allocator,
+					    &allocating_vio->allocation);
+	} else {
+		physical_block_number_t hint =
+			get_vdo_stream_allocation_hint(stream, lbn);
+		result = allocate_vdo_stream_block(allocator, hint,
+						   &allocating_vio->allocation);
+	}
+
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
@@ -98,6 +111,13 @@ static int allocate_and_lock_block(struct allocating_vio *allocating_vio)
 		return result;
 	}
 
+	if (stream != NULL) {
+		zone_count_t zone_number =
+			get_physical_zone_number(allocating_vio->zone);
+		record_vdo_stream_allocation(stream, lbn, zone_number,
+					     allocating_vio->allocation);
+	}
+
 	// We got a block!
 	vio->physical = allocating_vio->allocation;
 	allocating_vio->allocation_callback(allocating_vio);
@@ -152,6 +172,78 @@ static int wait_for_clean_slab(struct allocating_vio *allocating_vio)
 	return VDO_SUCCESS;
 }
 
+/**
+ * Check whether a physical zone is worth trying to allocate from, using the
+ * counts its allocator publishes. This avoids a thread hop to a zone which is
+ * known to be exhausted.
+ *
+ * @param vdo                  The vdo
+ * @param zone_number          The zone to check
+ * @param wait_for_clean_slab  Whether the allocation would wait for a slab
+ *                             to be scrubbed if the zone has no free blocks
+ *
+ * @return <code>true</code> if the zone may be able to supply a block
+ **/
+static bool zone_may_have_space(struct vdo *vdo,
+				zone_count_t zone_number,
+				bool wait_for_clean_slab)
+{
+	struct block_allocator *allocator =
+		get_block_allocator(vdo->physical_zones[zone_number]);
+	if (get_vdo_free_block_estimate(allocator) > 0) {
+		return true;
+	}
+
+	return (wait_for_clean_slab &&
+		(get_vdo_unrecovered_slab_count(allocator) > 0));
+}
+
+/**
+ * Choose the next zone in which an allocating_vio should try to allocate,
+ * skipping zones which are known to have no space. Once every zone has been
+ * tried, start over, this time waiting for slabs to be scrubbed.
+ *
+ * @param allocating_vio  The allocating_vio which needs an allocation
+ *
+ * @return <code>true</code> if a zone was chosen, <code>false</code> if
+ *         every zone has been tried twice
+ **/
+static bool choose_next_zone(struct allocating_vio *allocating_vio)
+{
+	struct vdo *vdo = get_vdo_from_allocating_vio(allocating_vio);
+	zone_count_t zone_count = get_thread_config(vdo)->physical_zone_count;
+	zone_count_t zone_number =
+		get_physical_zone_number(allocating_vio->zone);
+
+	for (;;) {
+		if (allocating_vio->allocation_attempts >= zone_count) {
+			if (allocating_vio->wait_for_clean_slab) {
+				// There were no free blocks in any zone, and
+				// no zone had slabs to scrub.
+				return false;
+			}
+
+			allocating_vio->wait_for_clean_slab = true;
+			allocating_vio->allocation_attempts = 0;
+		}
+
+		// Try the next zone, unless it is known to have no space.
+		zone_number++;
+		if (zone_number == zone_count) {
+			zone_number = 0;
+		}
+
+		if (zone_may_have_space(vdo, zone_number,
+					allocating_vio->wait_for_clean_slab)) {
+			allocating_vio->zone = vdo->physical_zones[zone_number];
+			return true;
+		}
+
+		// Count the skipped zone as if it had been tried.
+		allocating_vio->allocation_attempts++;
+	}
+}
+
 /**
  * Attempt to allocate a block in an allocating_vio's current allocation zone.
  *
@@ -161,10 +253,7 @@ static int wait_for_clean_slab(struct allocating_vio *allocating_vio)
  **/
 static int allocate_block_in_zone(struct allocating_vio *allocating_vio)
 {
-	zone_count_t zone_number;
 	int result;
-	struct vdo *vdo = get_vdo_from_allocating_vio(allocating_vio);
-	const struct thread_config *thread_config = get_thread_config(vdo);
 
 	allocating_vio->allocation_attempts++;
 	result = allocate_and_lock_block(allocating_vio);
@@ -179,25 +268,11 @@ static int allocate_block_in_zone(struct allocating_vio *allocating_vio)
 		}
 	}
 
-	if (allocating_vio->allocation_attempts >=
-	    thread_config->physical_zone_count) {
-		if (allocating_vio->wait_for_clean_slab) {
-			// There were no free blocks in any zone, and no zone
-			// had slabs to scrub.
-			allocating_vio->allocation_callback(allocating_vio);
-			return VDO_SUCCESS;
-		}
-
-		allocating_vio->wait_for_clean_slab = true;
-		allocating_vio->allocation_attempts = 0;
+	if (!choose_next_zone(allocating_vio)) {
+		allocating_vio->allocation_callback(allocating_vio);
+		return VDO_SUCCESS;
 	}
 
-	// Try the next zone
-	zone_number = get_physical_zone_number(allocating_vio->zone) + 1;
-	if (zone_number == thread_config->physical_zone_count) {
-		zone_number = 0;
-	}
-	allocating_vio->zone = vdo->physical_zones[zone_number];
 	launch_physical_zone_callback(allocating_vio,
 				      allocate_block_for_write);
 	return VDO_SUCCESS;
@@ -221,11 +296,21 @@ static void allocate_block_for_write(struct vdo_completion *completion)
 	}
 }
 
-/**********************************************************************/
-void allocate_data_block(struct allocating_vio *allocating_vio,
-			 struct allocation_selector *selector,
-			 enum pbn_lock_type write_lock_type,
-			 allocation_callback *callback)
+/**
+ * Start allocating a data block in a given physical zone.
+ *
+ * @param allocating_vio   The allocating_vio which needs an allocation
+ * @param zone_number      The physical zone in which to try first
+ * @param stream           The sequential stream the allocation is for, or
+ *                         NULL
+ * @param write_lock_type  The type of write lock to obtain on the block
+ * @param callback         The function to call once the allocation is complete
+ **/
+static void start_allocation(struct allocating_vio *allocating_vio,
+			     zone_count_t zone_number,
+			     struct allocation_stream *stream,
+			     enum pbn_lock_type write_lock_type,
+			     allocation_callback *callback)
 {
 	struct vio *vio = allocating_vio_as_vio(allocating_vio);
 
@@ -233,14 +318,61 @@ void allocate_data_block(struct allocating_vio *allocating_vio,
 	allocating_vio->allocation_callback = callback;
 	allocating_vio->allocation_attempts = 0;
 	allocating_vio->allocation = VDO_ZERO_BLOCK;
-
-	allocating_vio->zone =
-		vio->vdo->physical_zones[get_next_vdo_allocation_zone(selector)];
+	allocating_vio->stream = stream;
+
+	allocating_vio->zone = vio->vdo->physical_zones[zone_number];
+	if (!zone_may_have_space(vio->vdo, zone_number, false)) {
+		// Start in a zone which has space, if there is one, rather
+		// than hopping to a full zone only to be sent on.
+		zone_count_t zone_count =
+			get_thread_config(vio->vdo)->physical_zone_count;
+		zone_count_t i;
+		for (i = 1; i < zone_count; i++) {
+			zone_count_t zone = (zone_number + i) % zone_count;
+			if (zone_may_have_space(vio->vdo, zone, false)) {
+				allocating_vio->zone =
+					vio->vdo->physical_zones[zone];
+				break;
+			}
+		}
+	}
 
 	launch_physical_zone_callback(allocating_vio,
 				      allocate_block_for_write);
 }
 
+/**********************************************************************/
+void allocate_data_block(struct allocating_vio *allocating_vio,
+			 struct allocation_selector *selector,
+			 enum pbn_lock_type write_lock_type,
+			 allocation_callback *callback)
+{
+	start_allocation(allocating_vio,
+			 get_next_vdo_allocation_zone(selector),
+			 NULL,
+			 write_lock_type,
+			 callback);
+}
+
+/**********************************************************************/
+void allocate_data_block_for_lbn(struct allocating_vio *allocating_vio,
+				 struct allocation_selector *selector,
+				 logical_block_number_t lbn,
+				 enum pbn_lock_type write_lock_type,
+				 allocation_callback *callback)
+{
+	struct allocation_stream *stream;
+	zone_count_t zone_number =
+		get_vdo_allocation_zone_for_lbn(selector, lbn, &stream);
+
+	allocating_vio->stream_lbn = lbn;
+	start_allocation(allocating_vio,
+			 zone_number,
+			 stream,
+			 write_lock_type,
+			 callback);
+}
+
 /**********************************************************************/
 void release_allocation_lock(struct allocating_vio *allocating_vio)
 {
@@ -67,6 +67,12 @@ struct allocating_vio {
 	/** Whether this vio should wait for a clean slab */
 	bool wait_for_clean_slab;
 
+	/** The sequential write stream this allocation continues, if any */
+	struct allocation_stream *stream;
+
+	/** The logical block for which a stream block is being allocated */
+	logical_block_number_t stream_lbn;
+
 	/** The function to call once allocation is complete */
 	allocation_callback *allocation_callback;
 };
@@ -233,6 +239,23 @@ void allocate_data_block(struct allocating_vio *allocating_vio,
 			 enum pbn_lock_type write_lock_type,
 			 allocation_callback *callback);
 
+/**
+ * Allocate a data block to an allocating_vio which is writing a logical
+ * block, keeping logically sequential writes physically together.
+ *
+ * @param allocating_vio   The allocating_vio which needs an allocation
+ * @param selector         The allocation selector for deciding which physical
+ *                         zone to allocate from
+ * @param lbn              The logical block being written
+ * @param write_lock_type  The type of write lock to obtain on the block
+ * @param callback         The function to call once the allocation is complete
+ **/
+void allocate_data_block_for_lbn(struct allocating_vio *allocating_vio,
+				 struct allocation_selector *selector,
+				 logical_block_number_t lbn,
+				 enum pbn_lock_type write_lock_type,
+				 allocation_callback *callback);
+
 /**
  * Release the PBN lock on the allocated block. If the reference to the locked
  * block is still provisional, it will be released as well.
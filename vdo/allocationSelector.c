@@ -24,10 +24,17 @@
 
 #include "memoryAlloc.h"
 
+#include "constants.h"
 #include "types.h"
 
 enum {
 	ALLOCATIONS_PER_ZONE = 128,
+	/**
+	 * How far a write may be from the next expected logical block of a
+	 * stream and still continue it, allowing for writes which are
+	 * reordered on their way to the logical zone
+	 */
+	STREAM_LBN_WINDOW = 32,
 };
 
 /**********************************************************************/
@@ -84,3 +91,79 @@ zone_count_t get_next_vdo_allocation_zone(struct allocation_selector *selector)
 
 	return selector->next_allocation_zone;
 }
+
+/**
+ * Check whether a write continues a stream.
+ *
+ * @param stream  The stream to check
+ * @param lbn     The logical block being written
+ *
+ * @return <code>true</code> if the write is close to where the stream
+ *         expects its next write
+ **/
+static bool continues_stream(const struct allocation_stream *stream,
+			     logical_block_number_t lbn)
+{
+	return ((stream->length > 0) &&
+		(lbn + STREAM_LBN_WINDOW >= stream->next_lbn) &&
+		(lbn < stream->next_lbn + STREAM_LBN_WINDOW));
+}
+
+/**********************************************************************/
+zone_count_t
+get_vdo_allocation_zone_for_lbn(struct allocation_selector *selector,
+				logical_block_number_t lbn,
+				struct allocation_stream **stream_ptr)
+{
+	struct allocation_stream *oldest = &selector->streams[0];
+	zone_count_t zone;
+	unsigned int i;
+
+	selector->stream_clock++;
+	for (i = 0; i < ALLOCATION_STREAM_COUNT; i++) {
+		struct allocation_stream *stream = &selector->streams[i];
+		if (continues_stream(stream, lbn)) {
+			stream->next_lbn = max(stream->next_lbn, lbn + 1);
+			stream->length++;
+			stream->last_used = selector->stream_clock;
+			*stream_ptr = stream;
+			return READ_ONCE(stream->zone);
+		}
+
+		if (stream->last_used < oldest->last_used) {
+			oldest = stream;
+		}
+	}
+
+	/*
+	 * Start a new stream in place of the least recently used one. A
+	 * single write is not a stream yet, so it is allocated normally.
+	 */
+	zone = get_next_vdo_allocation_zone(selector);
+	oldest->next_lbn = lbn + 1;
+	oldest->length = 1;
+	oldest->last_used = selector->stream_clock;
+	WRITE_ONCE(oldest->pbn_offset, 0);
+	WRITE_ONCE(oldest->zone, zone);
+	*stream_ptr = NULL;
+	return zone;
+}
+
+/**********************************************************************/
+physical_block_number_t
+get_vdo_stream_allocation_hint(const struct allocation_stream *stream,
+			       logical_block_number_t lbn)
+{
+	physical_block_number_t offset = READ_ONCE(stream->pbn_offset);
+	return ((offset == 0) ? VDO_ZERO_BLOCK : (lbn + offset));
+}
+
+/**********************************************************************/
+void record_vdo_stream_allocation(struct allocation_stream *stream,
+				  logical_block_number_t lbn,
+				  zone_count_t zone,
+				  physical_block_number_t pbn)
+{
+	WRITE_ONCE(stream->zone, zone);
+	WRITE_ONCE(stream->pbn_offset, pbn - lbn);
+}
@@ -29,6 +29,10 @@
  * The selector is used to round-robin allocation requests to different
  * physical zones. Currently, 128 allocations will be made to a given physical
  * zone before switching to the next.
+ *
+ * Writes which continue a logically sequential stream are instead sent to the
+ * physical zone the stream has been allocating from, along with a hint that
+ * lets the zone place them right after the stream's previous block.
  **/
 
 /**
@@ -62,4 +66,48 @@ void free_vdo_allocation_selector(struct allocation_selector **selector_ptr);
 zone_count_t __must_check
 get_next_vdo_allocation_zone(struct allocation_selector *selector);
 
+/**
+ * Get the number of the physical zone from which to allocate a block for a
+ * logical block, keeping writes which continue a sequential stream in the
+ * stream's zone.
+ *
+ * @param [in]  selector    The selector to query
+ * @param [in]  lbn         The logical block which needs an allocation
+ * @param [out] stream_ptr  A pointer to receive the stream which the write
+ *                          continues, or NULL if it is not sequential
+ *
+ * @return The number of the physical zone from which to allocate
+ **/
+zone_count_t __must_check
+get_vdo_allocation_zone_for_lbn(struct allocation_selector *selector,
+				logical_block_number_t lbn,
+				struct allocation_stream **stream_ptr);
+
+/**
+ * Get the physical block near which to allocate the next block of a stream.
+ * This may be called from any thread.
+ *
+ * @param stream  The stream
+ * @param lbn     The logical block which needs an allocation
+ *
+ * @return The preferred physical block, or VDO_ZERO_BLOCK if there is none
+ **/
+physical_block_number_t __must_check
+get_vdo_stream_allocation_hint(const struct allocation_stream *stream,
+			       logical_block_number_t lbn);
+
+/**
+ * Record where a block of a stream was allocated so that the rest of the
+ * stream can follow it. This may be called from any thread.
+ *
+ * @param stream  The stream
+ * @param lbn     The logical block for which the block was allocated
+ * @param zone    The number of the physical zone which allocated the block
+ * @param pbn     The allocated block
+ **/
+void record_vdo_stream_allocation(struct allocation_stream *stream,
+				  logical_block_number_t lbn,
+				  zone_count_t zone,
+				  physical_block_number_t pbn);
+
 #endif /* ALLOCATION_SELECTOR_H */
@@ -24,6 +24,32 @@
 
 #include "types.h"
 
+enum {
+	/** The number of sequential write streams a selector tracks */
+	ALLOCATION_STREAM_COUNT = 8,
+};
+
+/** A run of logically sequential writes which should be kept together */
+struct allocation_stream {
+	/** The logical block number expected next in this stream */
+	logical_block_number_t next_lbn;
+	/** The number of writes seen in this stream */
+	block_count_t length;
+	/** The value of the selector's clock when this stream was last used */
+	uint64_t last_used;
+	/**
+	 * The difference between the last physical block allocated for this
+	 * stream and its logical block number, or 0 if unknown. This field is
+	 * set from physical zone threads.
+	 */
+	physical_block_number_t pbn_offset;
+	/**
+	 * The physical zone this stream allocates from. This field is set
+	 * from physical zone threads.
+	 */
+	zone_count_t zone;
+};
+
 /** Structure used to select which physical zone to allocate from */
 struct allocation_selector {
 	/** The number of allocations done in the current zone */
@@ -32,6 +58,10 @@ struct allocation_selector {
 	zone_count_t next_allocation_zone;
 	/** The number of the last physical zone */
 	zone_count_t last_physical_zone;
+	/** A counter for finding the least recently used stream */
+	uint64_t stream_clock;
+	/** The sequential write streams being tracked */
+	struct allocation_stream streams[ALLOCATION_STREAM_COUNT];
 };
 
 #endif /* ALLOCATION_SELECTOR_INTERNALS_H */
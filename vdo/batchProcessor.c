@@ -75,6 +75,8 @@ struct batch_processor {
 	spinlock_t consumer_lock;
 	struct funnel_queue *queue;
 	struct vdo_work_item work_item;
+	// The work queue to run in, or NULL for the CPU queues
+	struct vdo_work_queue *work_queue;
 	atomic_t state;
 	batch_processor_callback callback;
 	void *closure;
@@ -155,15 +157,23 @@ static void schedule_batch_processing(struct batch_processor *batch)
 				   BATCH_PROCESSOR_ENQUEUED);
 	do_schedule = (old_state == BATCH_PROCESSOR_IDLE);
 
-	if (do_schedule) {
+	if (!do_schedule) {
+		return;
+	}
+
+	if (batch->work_queue != NULL) {
+		enqueue_work_queue(batch->work_queue, &batch->work_item);
+	} else {
 		enqueue_cpu_work_queue(batch->layer, &batch->work_item);
 	}
 }
 
 /**********************************************************************/
 int make_batch_processor(struct kernel_layer *layer,
+			 struct vdo_work_queue *queue,
 			 batch_processor_callback callback,
 			 void *closure,
+			 unsigned int action,
 			 struct batch_processor **batch_ptr)
 {
 	struct batch_processor *batch;
@@ -183,11 +193,12 @@ int make_batch_processor(struct kernel_layer *layer,
 	setup_work_item(&batch->work_item,
 			batch_processor_work,
 			callback,
-			CPU_Q_ACTION_COMPLETE_VIO);
+			action);
 	atomic_set(&batch->state, BATCH_PROCESSOR_IDLE);
 	batch->callback = callback;
 	batch->closure = closure;
 	batch->layer = layer;
+	batch->work_queue = queue;
 
 	*batch_ptr = batch;
 	return UDS_SUCCESS;
@@ -201,6 +212,12 @@ void add_to_batch_processor(struct batch_processor *batch,
 	schedule_batch_processing(batch);
 }
 
+/**********************************************************************/
+bool is_batch_processor_busy(struct batch_processor *batch)
+{
+	return (atomic_read(&batch->state) == BATCH_PROCESSOR_ENQUEUED);
+}
+
 /**********************************************************************/
 struct vdo_work_item *next_batch_item(struct batch_processor *batch)
 {
@@ -31,8 +31,9 @@
  * to try to accumulate multiple objects and operate on them all at
  * once in one thread.
  *
- * The work function is run in one of the kernel layer's "CPU queues",
- * and care is taken to ensure that only one invocation can be running
+ * The work function is run in one of the kernel layer's "CPU queues", or
+ * in another work queue chosen when the batch processor is made, and care
+ * is taken to ensure that only one invocation can be running
  * or scheduled at any given time. It can loop calling next_batch_item
  * repeatedly until there are no more objects to operate on. It should
  * also call cond_resched_batch_processor now and then, to play nicely
@@ -46,19 +47,48 @@ struct batch_processor;
 typedef void (*batch_processor_callback)(struct batch_processor *batch,
 					 void *closure);
 
+enum {
+	/** The most data_vios hashed or compressed in one pass of a batch */
+	CPU_QUEUE_BATCH_SIZE = 16,
+};
+
+/**
+ * Select which of a set of batch processors, one per thread, should take
+ * the data_vio for a logical block. Each extent of CPU_QUEUE_BATCH_SIZE
+ * logically consecutive blocks goes to the same batch processor, so a
+ * sequential stream fills whole batches on one thread before moving on to
+ * the next, rather than dealing one block to each thread in turn and
+ * leaving every batch nearly empty.
+ *
+ * @param lbn    The logical block number of the data_vio
+ * @param count  The number of batch processors
+ *
+ * @return The index of the batch processor to use
+ **/
+static inline unsigned int
+select_batch_processor(logical_block_number_t lbn, unsigned int count)
+{
+	return (lbn / CPU_QUEUE_BATCH_SIZE) % count;
+}
+
 /**
  * Creates a batch-processor control structure.
  *
  * @param [in]  layer      The kernel layer data, used to enqueue work items
+ * @param [in]  queue      The work queue in which to run the callback, or
+ *                         NULL to use the CPU queues
  * @param [in]  callback   A function to process the accumulated objects
  * @param [in]  closure    A private data pointer for use by the callback
+ * @param [in]  action     The queue action code for the batch work item
  * @param [out] batch_ptr  Where to store the pointer to the new object
  *
  * @return UDS_SUCCESS or an error code
  **/
 int make_batch_processor(struct kernel_layer *layer,
+			 struct vdo_work_queue *queue,
 			 batch_processor_callback callback,
 			 void *closure,
+			 unsigned int action,
 			 struct batch_processor **batch_ptr);
 
 /**
@@ -73,6 +103,17 @@ int make_batch_processor(struct kernel_layer *layer,
 void add_to_batch_processor(struct batch_processor *batch,
                             struct vdo_work_item *item);
 
+/**
+ * Check whether the callback of a batch processor is already running or
+ * scheduled to run, in which case an object added now will be processed
+ * without waking another thread.
+ *
+ * @param [in] batch  The batch-processor data
+ *
+ * @return true if the batch processor has work pending
+ **/
+bool is_batch_processor_busy(struct batch_processor *batch);
+
 /**
  * Fetches the next object in the processing queue.
  *
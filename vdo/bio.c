@@ -30,6 +30,7 @@
 
 #include "kernelLayer.h"
 #include "kvio.h"
+#include "vdo.h"
 
 enum { INLINE_BVEC_COUNT = 2 };
 
@@ -129,6 +130,11 @@ void complete_async_bio(struct bio *bio)
 {
 	struct vio *vio = (struct vio *) bio->bi_private;
 	count_completed_bios(bio);
+	if (((bio->bi_opf & REQ_PREFLUSH) != 0) &&
+	    (bio->bi_status == BLK_STS_OK)) {
+		vdo_note_flush_completed(vio->vdo);
+	}
+
 	continue_vio(vio, get_bio_result(bio));
 }
 
@@ -139,14 +145,28 @@ int reset_bio_with_buffer(struct bio *bio,
 			  bio_end_io_t callback,
 			  unsigned int bi_opf,
 			  physical_block_number_t pbn)
+{
+	return reset_bio_with_sectors(bio, data, vio, callback, bi_opf, pbn,
+				      0, VDO_SECTORS_PER_BLOCK);
+}
+
+/**********************************************************************/
+int reset_bio_with_sectors(struct bio *bio,
+			   char *data,
+			   struct vio *vio,
+			   bio_end_io_t callback,
+			   unsigned int bi_opf,
+			   physical_block_number_t pbn,
+			   unsigned int first_sector,
+			   unsigned int sector_count)
 {
 	int bvec_count, result;
+	int len = sector_count * VDO_SECTOR_SIZE;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,1,0)
 	struct page *page;
 	int bytes_added;
 #else
-	int len = VDO_BLOCK_SIZE;
-	int offset = offset_in_page(data);
+	int offset;
 	unsigned int i;
 #endif // >= 5.1.0
 
@@ -154,17 +174,24 @@ int reset_bio_with_buffer(struct bio *bio,
 	bio->bi_private = vio;
 	bio->bi_end_io = callback;
 	bio->bi_opf = bi_opf;
-	bio->bi_iter.bi_sector = block_to_sector(pbn);
+	bio->bi_iter.bi_sector = block_to_sector(pbn) + first_sector;
 	if (data == NULL) {
 		return VDO_SUCCESS;
 	}
 
+	result = ASSERT((first_sector + sector_count) <= VDO_SECTORS_PER_BLOCK,
+			"bio sectors %u-%u lie within a block",
+			first_sector, first_sector + sector_count - 1);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
 	// Make sure we use our own inlined iovecs.
 	bio->bi_io_vec = bio->bi_inline_vecs;
 	bio->bi_max_vecs = INLINE_BVEC_COUNT;
 
-	bvec_count = (offset_in_page(data) + VDO_BLOCK_SIZE +
-		      PAGE_SIZE - 1) >> PAGE_SHIFT;
+	data += first_sector * VDO_SECTOR_SIZE;
+	bvec_count = (offset_in_page(data) + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
 	result = ASSERT(bvec_count <= INLINE_BVEC_COUNT,
 			"VDO-allocated buffers lie on max %d pages, not %d",
 			INLINE_BVEC_COUNT, bvec_count);
@@ -178,10 +205,9 @@ int reset_bio_with_buffer(struct bio *bio,
 	// pages and add it in one shot.
 	page = is_vmalloc_addr(data) ? vmalloc_to_page(data) :
 				       virt_to_page(data);
-	bytes_added = bio_add_page(bio, page, VDO_BLOCK_SIZE,
-				   offset_in_page(data));
+	bytes_added = bio_add_page(bio, page, len, offset_in_page(data));
 
-	if (bytes_added != VDO_BLOCK_SIZE) {
+	if (bytes_added != len) {
 		free_bio(bio);
 		return log_error_strerror(VDO_BIO_CREATION_FAILED,
 					  "Could only add %i bytes to bio",
@@ -189,6 +215,7 @@ int reset_bio_with_buffer(struct bio *bio,
 	}
 #else
 	// On pre-5.1 kernels, we have to add one page at a time to the bio.
+	offset = offset_in_page(data);
 	for (i = 0; (i < bvec_count) && (len > 0); i++) {
 		unsigned int bytes = PAGE_SIZE - offset;
 		struct page *page;
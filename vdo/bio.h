@@ -67,6 +67,33 @@ static inline void complete_bio(struct bio *bio, int error)
 	bio_endio(bio);
 }
 
+/**
+ * Check whether a bio asks for a range of blocks to be discarded or zeroed.
+ * Both are done by unmapping the blocks, since unmapped blocks read as
+ * zeros, so neither carries any data.
+ *
+ * @param bio  The bio to check
+ *
+ * @return <code>true</code> if the bio is a discard or write-zeroes
+ **/
+static inline bool is_discard_bio(struct bio *bio)
+{
+	return ((bio_op(bio) == REQ_OP_DISCARD) ||
+		(bio_op(bio) == REQ_OP_WRITE_ZEROES));
+}
+
+/**
+ * Check whether a bio is a write which carries data.
+ *
+ * @param bio  The bio to check
+ *
+ * @return <code>true</code> if the bio is a write but not a discard
+ **/
+static inline bool is_plain_write_bio(struct bio *bio)
+{
+	return ((bio_data_dir(bio) == WRITE) && !is_discard_bio(bio));
+}
+
 /**
  * Frees up a bio structure
  *
@@ -124,6 +151,31 @@ int reset_bio_with_buffer(struct bio *bio,
 			  unsigned int bi_opf,
 			  physical_block_number_t pbn);
 
+/**
+ * Reset a bio wholly, preparing it to perform an IO on a range of the sectors
+ * of a block. As with reset_bio_with_buffer(), the bio must be VDO-allocated.
+ *
+ * @param bio           The bio to reset
+ * @param data          The block-sized buffer holding the data of the whole
+ *                      block; only the range of sectors will be transferred
+ * @param vio           The vio to which this bio belongs (may be NULL)
+ * @param callback      The callback the bio should call when IO finishes
+ * @param bi_opf        The operation and flags for the bio
+ * @param pbn           The physical block number of the block
+ * @param first_sector  The first sector of the block to transfer
+ * @param sector_count  The number of sectors to transfer
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int reset_bio_with_sectors(struct bio *bio,
+			   char *data,
+			   struct vio *vio,
+			   bio_end_io_t callback,
+			   unsigned int bi_opf,
+			   physical_block_number_t pbn,
+			   unsigned int first_sector,
+			   unsigned int sector_count);
+
 /**
  * Create a new bio structure, which is guaranteed to be able to wrap any
  * contiguous buffer for IO.
@@ -45,6 +45,11 @@
 #include "vio.h"
 #include "vioPool.h"
 
+enum {
+	/** The most slabs of the best priority to consider when opening one */
+	SLAB_OPEN_CANDIDATES = 8,
+};
+
 /**
  * Assert that a block allocator function was called from the correct thread.
  *
@@ -182,7 +187,7 @@ make_vdo_block_allocator_pool_vios(struct vdo *vdo,
 				   struct vio **vio_ptr)
 {
 	return create_metadata_vio(vdo,
-				   VIO_TYPE_SLAB_JOURNAL,
+				   VIO_TYPE_BLOCK_ALLOCATOR,
 				   VIO_PRIORITY_METADATA,
 				   parent,
 				   buffer,
@@ -222,6 +227,8 @@ static int allocate_components(struct block_allocator *allocator,
 
 	initialize_vdo_completion(&allocator->completion, vdo,
 				  BLOCK_ALLOCATOR_COMPLETION);
+	initialize_vdo_completion(&allocator->reap_flush_completion, vdo,
+				  REAP_FLUSH_COMPLETION);
 	allocator->summary =
 		get_slab_summary_for_zone(depot, allocator->zone_number);
 
@@ -273,6 +280,20 @@ static int allocate_components(struct block_allocator *allocator,
 	return VDO_SUCCESS;
 }
 
+/**
+ * Bring the expiration of the reap flush timer to the allocator's thread.
+ * This is the timer function of the reap flush timer, so it runs in interrupt
+ * context.
+ *
+ * @param timer  The reap flush timer
+ **/
+static void reap_flush_timer_expired(struct timer_list *timer)
+{
+	struct block_allocator *allocator =
+		from_timer(allocator, timer, reap_flush_timer);
+	enqueue_vdo_completion(&allocator->reap_flush_completion);
+}
+
 /**********************************************************************/
 int make_vdo_block_allocator(struct slab_depot *depot,
 			     zone_count_t zone_number,
@@ -295,6 +316,9 @@ int make_vdo_block_allocator(struct slab_depot *depot,
 	allocator->nonce = nonce;
 	allocator->read_only_notifier = read_only_notifier;
 	INIT_LIST_HEAD(&allocator->dirty_slab_journals);
+	INIT_LIST_HEAD(&allocator->discard_slabs);
+	initialize_wait_queue(&allocator->reap_flush_waiters);
+	timer_setup(&allocator->reap_flush_timer, reap_flush_timer_expired, 0);
 
 	result = allocate_components(allocator, vdo, vio_pool_size);
 	if (result != VDO_SUCCESS) {
@@ -314,6 +338,7 @@ void free_vdo_block_allocator(struct block_allocator **block_allocator_ptr)
 		return;
 	}
 
+	del_timer_sync(&allocator->reap_flush_timer);
 	free_slab_scrubber(&allocator->slab_scrubber);
 	free_vio_pool(&allocator->vio_pool);
 	free_priority_table(&allocator->prioritized_slabs);
@@ -342,6 +367,15 @@ block_count_t get_vdo_allocated_blocks(const struct block_allocator *allocator)
 	return READ_ONCE(allocator->allocated_blocks);
 }
 
+/**********************************************************************/
+block_count_t
+get_vdo_free_block_estimate(const struct block_allocator *allocator)
+{
+	block_count_t data_blocks = get_data_block_count(allocator);
+	block_count_t allocated = get_vdo_allocated_blocks(allocator);
+	return ((allocated < data_blocks) ? (data_blocks - allocated) : 0);
+}
+
 /**********************************************************************/
 block_count_t
 get_vdo_unrecovered_slab_count(const struct block_allocator *allocator)
@@ -426,16 +460,26 @@ void adjust_vdo_free_block_count(struct vdo_slab *slab, bool increment)
  * or vacated with a subsequent decrement of the reference count.
  *
  * @param [in]  slab              The slab
+ * @param [in]  stream            Whether the block is for a sequential stream
+ * @param [in]  hint              The block the stream would like next, or
+ *                                VDO_ZERO_BLOCK
  * @param [out] block_number_ptr  A pointer to receive the allocated block
  *                                number
  *
  * @return UDS_SUCCESS or an error code
  **/
 static int allocate_slab_block(struct vdo_slab *slab,
+			       bool stream,
+			       physical_block_number_t hint,
 			       physical_block_number_t *block_number_ptr)
 {
 	physical_block_number_t pbn;
-	int result = allocate_unreferenced_block(slab->reference_counts, &pbn);
+	int result = (stream ?
+		      allocate_unreferenced_stream_block(slab->reference_counts,
+							 hint,
+							 &pbn) :
+		      allocate_unreferenced_block(slab->reference_counts,
+						  &pbn));
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
@@ -446,14 +490,59 @@ static int allocate_slab_block(struct vdo_slab *slab,
 	return VDO_SUCCESS;
 }
 
-/**********************************************************************/
-int allocate_vdo_block(struct block_allocator *allocator,
-		       physical_block_number_t *block_number_ptr)
+/**
+ * Rate a slab as the next slab to open. Every slab in the priority table has
+ * already been loaded and scrubbed, so the only metadata work which opening a
+ * slab can still require is allocating its counter array; slabs which already
+ * have one are preferred. Among those, the slab nearest after the one just
+ * closed is preferred so that consecutive writes stay physically close.
+ *
+ * @param entry    The allocq_entry of the slab to rate
+ * @param context  The slab which was just closed, or NULL
+ *
+ * @return the score of the slab
+ **/
+static int score_slab_for_opening(struct list_head *entry, void *context)
 {
+	struct vdo_slab *slab = slab_from_list_entry(entry);
+	struct vdo_slab *closed = context;
+	int score = (has_reference_counters(slab->reference_counts)
+		     ? (1 << 16) : 0);
+
+	if (closed != NULL) {
+		slab_count_t distance =
+			slab->slab_number - closed->slab_number - 1;
+		score -= distance;
+	}
+
+	return score;
+}
+
+/**
+ * Allocate a physical block, opening a new slab if the open slab is full.
+ *
+ * @param [in]  allocator         The block allocator
+ * @param [in]  stream            Whether the block is for a sequential stream
+ * @param [in]  hint              The block the stream would like next, or
+ *                                VDO_ZERO_BLOCK
+ * @param [out] block_number_ptr  A pointer to receive the allocated block
+ *                                number
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int allocate_block(struct block_allocator *allocator,
+			  bool stream,
+			  physical_block_number_t hint,
+			  physical_block_number_t *block_number_ptr)
+{
+	struct list_head *entry;
+	struct vdo_slab *slab;
+	int result;
+
 	if (allocator->open_slab != NULL) {
 		// Try to allocate the next block in the currently open slab.
-		int result =
-			allocate_slab_block(allocator->open_slab, block_number_ptr);
+		result = allocate_slab_block(allocator->open_slab, stream,
+					     hint, block_number_ptr);
 		if ((result == VDO_SUCCESS) || (result != VDO_NO_SPACE)) {
 			return result;
 		}
@@ -462,15 +551,47 @@ int allocate_vdo_block(struct block_allocator *allocator,
 		prioritize_slab(allocator->open_slab);
 	}
 
-	// Remove the highest priority slab from the priority table and make it
-	// the open slab.
-	allocator->open_slab =
-		slab_from_list_entry(priority_table_dequeue(allocator->prioritized_slabs));
-	open_slab(allocator->open_slab);
+	// Remove the best of the highest priority slabs from the priority table
+	// and make it the open slab.
+	entry = priority_table_dequeue_best(allocator->prioritized_slabs,
+					    SLAB_OPEN_CANDIDATES,
+					    score_slab_for_opening,
+					    allocator->open_slab);
+	slab = slab_from_list_entry(entry);
+	result = open_slab(slab);
+	if (result != VDO_SUCCESS) {
+		// Without memory for its counters the slab can't be used yet.
+		// Treat the zone as full, so that the write tries the other
+		// zones, and can still dedupe or compress if they are full
+		// too. A later allocation will try to open a slab again.
+		prioritize_slab(slab);
+		allocator->open_slab = NULL;
+		return VDO_NO_SPACE;
+	}
+
+	allocator->open_slab = slab;
 
 	// Try allocating again. If we're out of space immediately after
-	// opening a slab, then every slab must be fully allocated.
-	return allocate_slab_block(allocator->open_slab, block_number_ptr);
+	// opening a slab, then every slab must be fully allocated. The hint
+	// can't be in the new slab, so the stream starts over.
+	return allocate_slab_block(allocator->open_slab, stream,
+				   VDO_ZERO_BLOCK, block_number_ptr);
+}
+
+/**********************************************************************/
+int allocate_vdo_block(struct block_allocator *allocator,
+		       physical_block_number_t *block_number_ptr)
+{
+	return allocate_block(allocator, false, VDO_ZERO_BLOCK,
+			      block_number_ptr);
+}
+
+/**********************************************************************/
+int allocate_vdo_stream_block(struct block_allocator *allocator,
+			      physical_block_number_t hint,
+			      physical_block_number_t *block_number_ptr)
+{
+	return allocate_block(allocator, true, hint, block_number_ptr);
 }
 
 /**********************************************************************/
@@ -752,10 +873,15 @@ prepare_vdo_slabs_for_allocation(struct block_allocator *allocator)
 			continue;
 		}
 
+		/*
+		 * Clean slabs whose reference counts must be read are loaded
+		 * in the background, in the order of this heap, rather than
+		 * before the allocator can come online. A slab which is
+		 * modified or deduplicated against first gets a higher
+		 * priority.
+		 */
 		mark_slab_unrecovered(slab);
-		high_priority = ((current_slab_status.is_clean &&
-				 (depot->load_type == NORMAL_LOAD)) ||
-				 requires_scrubbing(slab->journal));
+		high_priority = requires_scrubbing(slab->journal);
 		register_slab_for_scrubbing(allocator->slab_scrubber,
 					    slab,
 					    high_priority);
@@ -793,12 +919,36 @@ void register_new_vdo_slabs_for_allocator(void *context,
 	struct block_allocator *allocator =
 		get_block_allocator_for_zone(context, zone_number);
 	struct slab_depot *depot = allocator->depot;
+	struct slab_summary_zone *summary = allocator->summary;
 	slab_count_t i;
 	for (i = depot->slab_count; i < depot->new_slab_count; i++) {
 		struct vdo_slab *slab = depot->new_slabs[i];
-		if (slab->allocator == allocator) {
-			register_vdo_slab_with_allocator(allocator, slab);
+		slab_count_t number;
+		int result;
+
+		if (slab->allocator != allocator) {
+			continue;
 		}
+
+		/*
+		 * Nothing is written to the new space when growing; a new
+		 * slab is usable because its summary entry says that its
+		 * reference counts need not be read and that its journal is
+		 * blank, so its metadata is written only as it is used.
+		 */
+		number = slab->slab_number;
+		result = ASSERT((!must_load_ref_counts(summary, number)
+				 && (get_summarized_tail_block_offset(summary,
+								      number)
+				     == 0)),
+				"new slab %u has a blank summary entry",
+				number);
+		if (result != VDO_SUCCESS) {
+			finish_vdo_completion(parent, result);
+			return;
+		}
+
+		register_vdo_slab_with_allocator(allocator, slab);
 	}
 	complete_vdo_completion(parent);
 }
@@ -944,9 +1094,14 @@ void release_vdo_tail_block_locks(void *context,
 {
 	struct block_allocator *allocator =
 		get_block_allocator_for_zone(context, zone_number);
-	struct list_head *list = &allocator->dirty_slab_journals;
-	while (!list_empty(list)) {
-		if (!release_recovery_journal_lock(slab_journal_from_dirty_entry(list->next),
+	struct list_head *entry, *next;
+
+	/*
+	 * Releasing a lock removes the journal from the dirty list, while a
+	 * journal which is left to gather more entries stays on it.
+	 */
+	list_for_each_safe(entry, next, &allocator->dirty_slab_journals) {
+		if (!release_recovery_journal_lock(slab_journal_from_dirty_entry(entry),
 						   allocator->depot->active_release_request)) {
 			break;
 		}
@@ -968,6 +1123,40 @@ int acquire_vdo_block_allocator_vio(struct block_allocator *allocator,
 	return acquire_vio_from_pool(allocator->vio_pool, waiter);
 }
 
+/**
+ * Let every slab journal waiting for a reap flush decide whether it has
+ * seen one or must now send its own. This is the callback of the reap flush
+ * completion.
+ *
+ * @param completion  The reap flush completion
+ **/
+static void release_reap_flush_waiters(struct vdo_completion *completion)
+{
+	struct block_allocator *allocator = completion->parent;
+
+	allocator->reap_flush_timer_armed = false;
+	notify_all_waiters(&allocator->reap_flush_waiters, NULL, allocator);
+}
+
+/**********************************************************************/
+int wait_for_vdo_reap_flush(struct block_allocator *allocator,
+			    struct waiter *waiter)
+{
+	int result = enqueue_waiter(&allocator->reap_flush_waiters, waiter);
+	if ((result != VDO_SUCCESS) || allocator->reap_flush_timer_armed) {
+		return result;
+	}
+
+	allocator->reap_flush_timer_armed = true;
+	prepare_vdo_completion(&allocator->reap_flush_completion,
+			       release_reap_flush_waiters,
+			       release_reap_flush_waiters,
+			       allocator->thread_id,
+			       allocator);
+	mod_timer(&allocator->reap_flush_timer, jiffies + 1);
+	return VDO_SUCCESS;
+}
+
 /**********************************************************************/
 void return_vdo_block_allocator_vio(struct block_allocator *allocator,
 				    struct vio_pool_entry *entry)
@@ -975,6 +1164,261 @@ void return_vdo_block_allocator_vio(struct block_allocator *allocator,
 	return_vio_to_pool(allocator->vio_pool, entry);
 }
 
+/**
+ * Check whether a block allocator should start a pass to discard the blocks
+ * which have been freed in its zone.
+ *
+ * @param allocator  The block allocator
+ *
+ * @return <code>true</code> if a discard pass should start
+ **/
+static bool should_discard_freed_blocks(struct block_allocator *allocator)
+{
+	block_count_t batch = get_slab_depot_discard_batch(allocator->depot);
+
+	return ((batch > 0) &&
+		(allocator->blocks_to_discard >= batch) &&
+		is_vdo_state_normal(&allocator->state) &&
+		!is_read_only(allocator->read_only_notifier) &&
+		vdo_backing_device_supports_discard(allocator->depot->vdo));
+}
+
+/**********************************************************************/
+static void discard_next_run(struct waiter *waiter, void *context);
+
+/**
+ * Acquire a vio with which to discard the next run of freed blocks.
+ *
+ * @param allocator  The block allocator which is discarding
+ **/
+static void continue_discarding(struct block_allocator *allocator)
+{
+	int result;
+
+	allocator->discard_waiter.callback = discard_next_run;
+	result = acquire_vdo_block_allocator_vio(allocator,
+						 &allocator->discard_waiter);
+	if (result != VDO_SUCCESS) {
+		allocator->discarding = false;
+		enter_read_only_mode(allocator->read_only_notifier, result);
+	}
+}
+
+/**
+ * Return the vio of the discard in progress to the pool and make the run it
+ * discarded free again. Then go on to the next run unless the allocator is
+ * no longer operating normally.
+ *
+ * @param allocator  The block allocator which is discarding
+ **/
+static void finish_discarding_run(struct block_allocator *allocator)
+{
+	struct vdo_slab *slab = allocator->discard_slab;
+	block_count_t i;
+
+	// The vio must be back in the pool before the slab may finish draining.
+	return_vdo_block_allocator_vio(allocator, allocator->discard_entry);
+	allocator->discard_entry = NULL;
+	allocator->discard_slab = NULL;
+
+	release_discarded_blocks(slab->reference_counts,
+				 allocator->discard_pbn);
+	for (i = 0; i < allocator->discard_count; i++) {
+		adjust_vdo_free_block_count(slab, true);
+	}
+
+	check_if_slab_drained(slab);
+	if (!is_vdo_state_normal(&allocator->state) ||
+	    is_read_only(allocator->read_only_notifier)) {
+		allocator->discarding = false;
+		return;
+	}
+
+	continue_discarding(allocator);
+}
+
+/**
+ * Count a run of blocks which has been discarded. This callback is
+ * registered in launch_discard().
+ *
+ * @param completion  The discard vio
+ **/
+static void finish_discard(struct vdo_completion *completion)
+{
+	struct vio_pool_entry *entry = completion->parent;
+	struct block_allocator *allocator = entry->parent;
+	struct block_allocator_statistics *stats = &allocator->statistics;
+
+	WRITE_ONCE(stats->discards, stats->discards + 1);
+	WRITE_ONCE(stats->blocks_discarded,
+		   stats->blocks_discarded + allocator->discard_count);
+	finish_discarding_run(allocator);
+}
+
+/**
+ * Handle an error flushing or discarding a run of freed blocks. The error
+ * has already been logged; since a discard is only advice to the backing
+ * device, the run is simply made free again.
+ *
+ * @param completion  The discard vio
+ **/
+static void handle_discard_error(struct vdo_completion *completion)
+{
+	struct vio_pool_entry *entry = completion->parent;
+
+	finish_discarding_run(entry->parent);
+}
+
+/**
+ * Send the discard of the reserved run of freed blocks.
+ *
+ * @param allocator  The block allocator which is discarding
+ **/
+static void launch_discard(struct block_allocator *allocator)
+{
+	struct vio *vio = allocator->discard_entry->vio;
+
+	vio->completion.callback_thread_id = allocator->thread_id;
+	launch_discard_vio(vio,
+			   allocator->discard_pbn,
+			   allocator->discard_count,
+			   finish_discard,
+			   handle_discard_error);
+}
+
+/**
+ * Discard the reserved run once a flush has finished. This callback is
+ * registered in check_for_discard_flush().
+ *
+ * @param completion  The flush vio
+ **/
+static void discard_after_flush(struct vdo_completion *completion)
+{
+	struct vio_pool_entry *entry = completion->parent;
+
+	launch_discard(entry->parent);
+}
+
+/**
+ * A waiter callback for a discard which has waited to see whether a flush
+ * sent by someone else would make it safe. If none has, send a flush for the
+ * discard after all.
+ *
+ * @param waiter   The allocator's discard waiter
+ * @param context  The block allocator
+ **/
+static void check_for_discard_flush(struct waiter *waiter __always_unused,
+				    void *context)
+{
+	struct block_allocator *allocator = context;
+	struct vio *vio = allocator->discard_entry->vio;
+
+	if (vdo_flushed_since(allocator->depot->vdo,
+			      allocator->discard_flush_mark)) {
+		launch_discard(allocator);
+		return;
+	}
+
+	vio->completion.callback_thread_id = allocator->thread_id;
+	launch_flush(vio, discard_after_flush, handle_discard_error);
+}
+
+/**
+ * Reserve the next run of freed blocks and discard it. This is the callback
+ * for acquiring a vio for the discard pass.
+ *
+ * @param waiter   The allocator's discard waiter
+ * @param context  The vio pool entry
+ **/
+static void discard_next_run(struct waiter *waiter, void *context)
+{
+	struct block_allocator *allocator =
+		container_of(waiter, struct block_allocator, discard_waiter);
+	struct vio_pool_entry *entry = context;
+	struct vdo_slab *slab = NULL;
+	block_count_t i;
+	int result;
+
+	if (is_vdo_state_normal(&allocator->state) &&
+	    !is_read_only(allocator->read_only_notifier)) {
+		while (!list_empty(&allocator->discard_slabs)) {
+			slab = list_first_entry(&allocator->discard_slabs,
+						struct vdo_slab,
+						discard_entry);
+			if (reserve_blocks_for_discard(
+				    slab->reference_counts,
+				    MAXIMUM_DISCARD_BLOCKS,
+				    &allocator->discard_pbn,
+				    &allocator->discard_count)) {
+				break;
+			}
+
+			list_del_init(&slab->discard_entry);
+			slab = NULL;
+		}
+	}
+
+	if (slab == NULL) {
+		return_vdo_block_allocator_vio(allocator, entry);
+		allocator->discarding = false;
+		return;
+	}
+
+	entry->parent = allocator;
+	allocator->discard_entry = entry;
+	allocator->discard_slab = slab;
+	for (i = 0; i < allocator->discard_count; i++) {
+		adjust_vdo_free_block_count(slab, false);
+	}
+
+	if (!vdo_has_volatile_write_cache(allocator->depot->vdo)) {
+		launch_discard(allocator);
+		return;
+	}
+
+	/*
+	 * Every block in the run was freed by a decrement whose recovery
+	 * journal entry had already been written, but that write may not be
+	 * durable yet. If the discard reached the device first and the vdo
+	 * crashed, the replayed journal would map the discarded block again.
+	 * Any flush sent after this point makes the entries durable, and the
+	 * recovery journal sends one with nearly every block it writes, so
+	 * wait until the next timer tick to see whether one has come and gone
+	 * before sending a flush just for this discard.
+	 */
+	allocator->discard_flush_mark =
+		get_vdo_flush_mark(allocator->depot->vdo);
+	waiter->callback = check_for_discard_flush;
+	result = wait_for_vdo_reap_flush(allocator, waiter);
+	if (result != VDO_SUCCESS) {
+		enter_read_only_mode(allocator->read_only_notifier, result);
+		finish_discarding_run(allocator);
+	}
+}
+
+/**********************************************************************/
+void note_vdo_block_freed(struct vdo_slab *slab)
+{
+	struct block_allocator *allocator = slab->allocator;
+
+	if (get_slab_depot_discard_batch(allocator->depot) == 0) {
+		return;
+	}
+
+	if (list_empty(&slab->discard_entry)) {
+		list_add_tail(&slab->discard_entry, &allocator->discard_slabs);
+	}
+
+	allocator->blocks_to_discard++;
+	if (allocator->discarding || !should_discard_freed_blocks(allocator)) {
+		return;
+	}
+
+	allocator->discarding = true;
+	allocator->blocks_to_discard = 0;
+	continue_discarding(allocator);
+}
+
 /**********************************************************************/
 void scrub_all_unrecovered_vdo_slabs_in_zone(void *context,
 					     zone_count_t zone_number,
@@ -1013,6 +1457,11 @@ get_vdo_block_allocator_statistics(const struct block_allocator *allocator)
 		.slab_count = allocator->slab_count,
 		.slabs_opened = READ_ONCE(stats->slabs_opened),
 		.slabs_reopened = READ_ONCE(stats->slabs_reopened),
+		.slabs_to_scrub = get_vdo_unrecovered_slab_count(allocator),
+		.slabs_scrubbed =
+			get_scrubber_slabs_scrubbed(allocator->slab_scrubber),
+		.discards = READ_ONCE(stats->discards),
+		.blocks_discarded = READ_ONCE(stats->blocks_discarded),
 	};
 }
 
@@ -1028,6 +1477,7 @@ get_vdo_slab_journal_statistics(const struct block_allocator *allocator)
 		.blocked_count = READ_ONCE(stats->blocked_count),
 		.blocks_written = READ_ONCE(stats->blocks_written),
 		.tail_busy_count = READ_ONCE(stats->tail_busy_count),
+		.piggybacked_reaps = READ_ONCE(stats->piggybacked_reaps),
 	};
 }
 
@@ -29,6 +29,16 @@
 #include "vioPool.h"
 #include "waitQueue.h"
 
+enum {
+	/**
+	 * The default number of blocks a physical zone frees before it
+	 * discards them; zero disables discarding freed blocks
+	 */
+	DEFAULT_DISCARD_BATCH = 0,
+	/** The largest run of free blocks a physical zone discards at once */
+	MAXIMUM_DISCARD_BLOCKS = 2048,
+};
+
 /**
  * Create a block allocator.
  *
@@ -94,6 +104,24 @@ void adjust_vdo_free_block_count(struct vdo_slab *slab, bool increment);
 int __must_check allocate_vdo_block(struct block_allocator *allocator,
 				    physical_block_number_t *block_number_ptr);
 
+/**
+ * Allocate a physical block for a sequential write stream, preferring the
+ * first free block at or after a hint if it is in the open slab, and keeping
+ * the blocks after the allocated one free for the rest of the stream.
+ *
+ * @param [in]  allocator         The block allocator
+ * @param [in]  hint              The block the stream would like next, or
+ *                                VDO_ZERO_BLOCK if it has no preference
+ * @param [out] block_number_ptr  A pointer to receive the allocated block
+ *                                number
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+int __must_check
+allocate_vdo_stream_block(struct block_allocator *allocator,
+			  physical_block_number_t hint,
+			  physical_block_number_t *block_number_ptr);
+
 /**
  * Release an unused provisional reference.
  *
@@ -116,6 +144,18 @@ void release_vdo_block_reference(struct block_allocator *allocator,
 block_count_t __must_check
 get_vdo_allocated_blocks(const struct block_allocator *allocator);
 
+/**
+ * Estimate the number of free blocks in an allocator. Blocks in unrecovered
+ * slabs are not counted as free. This may be called from any thread, in
+ * which case the estimate may be slightly stale.
+ *
+ * @param allocator  The block allocator
+ *
+ * @return The approximate number of blocks which could be allocated now
+ **/
+block_count_t __must_check
+get_vdo_free_block_estimate(const struct block_allocator *allocator);
+
 /**
  * Get the number of unrecovered slabs.
  *
@@ -164,7 +204,9 @@ void register_vdo_slab_with_allocator(struct block_allocator *allocator,
 				      struct vdo_slab *slab);
 
 /**
- * Register the new slabs belonging to this allocator.
+ * Register the new slabs belonging to this allocator. The new slabs are
+ * not formatted; their blank slab summary entries stand in for zeroed
+ * reference counts and empty slab journals.
  *
  * <p>Implements vdo_zone_action.
  **/
@@ -224,6 +266,21 @@ int __must_check
 acquire_vdo_block_allocator_vio(struct block_allocator *allocator,
 				struct waiter *waiter);
 
+/**
+ * Wait until the next timer tick to see whether a flush sent by someone else
+ * makes a slab journal reap or a discard of freed blocks safe (asynchronous).
+ * The waiter's callback will be invoked on the allocator's thread, with the
+ * allocator as its context.
+ *
+ * @param allocator  The allocator of the reaping slab journal
+ * @param waiter     The reaping slab journal's or the discard's waiter
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check
+wait_for_vdo_reap_flush(struct block_allocator *allocator,
+			struct waiter *waiter);
+
 /**
  * Return a VIO to a block allocator's VIO pool
  *
@@ -233,6 +290,16 @@ acquire_vdo_block_allocator_vio(struct block_allocator *allocator,
 void return_vdo_block_allocator_vio(struct block_allocator *allocator,
 				    struct vio_pool_entry *entry);
 
+/**
+ * Note that a block in a slab has become free so that it will eventually be
+ * discarded on the backing device, if discarding freed blocks is enabled.
+ * Once enough blocks have been freed in the zone, the allocator discards the
+ * runs of free blocks which contain them, one run at a time.
+ *
+ * @param slab  The slab containing the freed block
+ **/
+void note_vdo_block_freed(struct vdo_slab *slab);
+
 /**
  * Initiate scrubbing all unrecovered slabs.
  *
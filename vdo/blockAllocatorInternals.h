@@ -22,6 +22,8 @@
 #ifndef BLOCK_ALLOCATOR_INTERNALS_H
 #define BLOCK_ALLOCATOR_INTERNALS_H
 
+#include <linux/timer.h>
+
 #include "adminState.h"
 #include "blockAllocator.h"
 #include "priorityTable.h"
@@ -119,8 +121,39 @@ struct block_allocator {
 	 **/
 	struct list_head dirty_slab_journals;
 
+	/**
+	 * Slab journals which are reaping and waiting to see whether a flush
+	 * sent by someone else will make their reference blocks durable
+	 **/
+	struct wait_queue reap_flush_waiters;
+	/** Whether the reap flush timer is set */
+	bool reap_flush_timer_armed;
+	/** The timer which bounds how long reaps wait for another flush */
+	struct timer_list reap_flush_timer;
+	/** The completion which brings an expired timer to the zone thread */
+	struct vdo_completion reap_flush_completion;
+
 	/** The vio pool for reading and writing block allocator metadata */
 	struct vio_pool *vio_pool;
+
+	/** The slabs with blocks freed since they were last discarded */
+	struct list_head discard_slabs;
+	/** The number of blocks freed since the last discard pass started */
+	block_count_t blocks_to_discard;
+	/** Whether a discard pass is in progress */
+	bool discarding;
+	/** The waiter for the vio and the flush of the discard pass */
+	struct waiter discard_waiter;
+	/** The pooled vio of the discard in progress */
+	struct vio_pool_entry *discard_entry;
+	/** The slab containing the run of blocks being discarded */
+	struct vdo_slab *discard_slab;
+	/** The first block of the run being discarded */
+	physical_block_number_t discard_pbn;
+	/** The length of the run being discarded */
+	block_count_t discard_count;
+	/** The flush mark taken when the run was reserved */
+	uint64_t discard_flush_mark;
 };
 
 
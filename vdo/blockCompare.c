@@ -0,0 +1,377 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "blockCompare.h"
+
+#include <asm/timex.h>
+#include <asm/unaligned.h>
+#ifdef CONFIG_X86_64
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#endif
+
+#include "logger.h"
+#include "memoryAlloc.h"
+#include "permassert.h"
+
+#include "constants.h"
+#include "statusCodes.h"
+
+enum {
+	/** The number of timed repetitions of each implementation */
+	BLOCK_COMPARE_CALIBRATION_ROUNDS = 256,
+#ifdef CONFIG_X86_64
+	/** The number of bytes examined by one iteration of an AVX2 loop */
+	AVX2_CHUNK_BYTES = 128,
+#endif
+};
+
+typedef bool zero_check_function(const char *block);
+typedef bool compare_function(const char *block1, const char *block2);
+
+struct block_compare_implementation {
+	const char *name;
+	bool (*usable)(void);
+	zero_check_function *is_zero;
+	compare_function *equal;
+};
+
+/**
+ * Check whether a block is all zeros, 64 bytes at a time.
+ *
+ * Implements zero_check_function.
+ **/
+static bool is_zero_block_scalar(const char *buffer)
+{
+	unsigned int word_count = VDO_BLOCK_SIZE / sizeof(uint64_t);
+	unsigned int chunk_count = word_count / 8;
+	/*
+	 * Handle expected common case of even the first word being nonzero,
+	 * without getting into the more expensive (for one iteration) loop
+	 * below.
+	 */
+	if (get_unaligned((u64 *) buffer) != 0) {
+		return false;
+	}
+
+	STATIC_ASSERT(VDO_BLOCK_SIZE % sizeof(uint64_t) == 0);
+
+	// Unroll to process 64 bytes at a time
+	while (chunk_count-- > 0) {
+		uint64_t word0 = get_unaligned((u64 *) buffer);
+		uint64_t word1 =
+			get_unaligned((u64 *) (buffer + 1 * sizeof(uint64_t)));
+		uint64_t word2 =
+			get_unaligned((u64 *) (buffer + 2 * sizeof(uint64_t)));
+		uint64_t word3 =
+			get_unaligned((u64 *) (buffer + 3 * sizeof(uint64_t)));
+		uint64_t word4 =
+			get_unaligned((u64 *) (buffer + 4 * sizeof(uint64_t)));
+		uint64_t word5 =
+			get_unaligned((u64 *) (buffer + 5 * sizeof(uint64_t)));
+		uint64_t word6 =
+			get_unaligned((u64 *) (buffer + 6 * sizeof(uint64_t)));
+		uint64_t word7 =
+			get_unaligned((u64 *) (buffer + 7 * sizeof(uint64_t)));
+		uint64_t or = (word0 | word1 | word2 | word3 | word4 | word5 |
+			       word6 | word7);
+		// Prevent compiler from using 8*(cmp;jne).
+		__asm__ __volatile__("" : : "g"(or));
+		if (or != 0) {
+			return false;
+		}
+		buffer += 8 * sizeof(uint64_t);
+	}
+	word_count %= 8;
+
+	// Unroll to process 8 bytes at a time.
+	// (Is this still worthwhile?)
+	while (word_count-- > 0) {
+		if (get_unaligned((u64 *) buffer) != 0) {
+			return false;
+		}
+		buffer += sizeof(uint64_t);
+	}
+	return true;
+}
+
+/**
+ * Compare blocks of memory for equality, 8 bytes at a time.
+ *
+ * This is desirable because the Linux kernel memcmp() routine on x86 is not
+ * well optimized for large blocks, and the performance penalty turns out
+ * to be significant if you're doing lots of 4KB comparisons.
+ *
+ * Implements compare_function.
+ **/
+static bool blocks_equal_scalar(const char *pointer1, const char *pointer2)
+{
+	size_t length = VDO_BLOCK_SIZE;
+
+	while (length >= sizeof(uint64_t)) {
+		/*
+		 * get_unaligned is just for paranoia. (1) On x86_64 it is
+		 * treated the same as an aligned access. (2) In this use case,
+		 * one or both of the inputs will almost(?) always be aligned.
+		 */
+		if (get_unaligned((u64 *) pointer1) !=
+		    get_unaligned((u64 *) pointer2)) {
+			return false;
+		}
+		pointer1 += sizeof(uint64_t);
+		pointer2 += sizeof(uint64_t);
+		length -= sizeof(uint64_t);
+	}
+	return true;
+}
+
+/**
+ * The scalar implementations are always usable.
+ **/
+static bool always_usable(void)
+{
+	return true;
+}
+
+#ifdef CONFIG_X86_64
+/**
+ * Check whether the AVX2 implementations may be used on this CPU.
+ **/
+static bool avx2_usable(void)
+{
+	return boot_cpu_has(X86_FEATURE_AVX2);
+}
+
+/**
+ * Check whether a block is all zeros, 128 bytes at a time, using AVX2. The
+ * first word is checked before saving the FPU state, since most blocks which
+ * are not zero can be rejected there.
+ *
+ * Implements zero_check_function.
+ **/
+static bool is_zero_block_avx2(const char *block)
+{
+	unsigned int offset;
+	u8 nonzero = 0;
+
+	if (get_unaligned((u64 *) block) != 0) {
+		return false;
+	}
+
+	if (!irq_fpu_usable()) {
+		return is_zero_block_scalar(block);
+	}
+
+	STATIC_ASSERT(VDO_BLOCK_SIZE % AVX2_CHUNK_BYTES == 0);
+	kernel_fpu_begin();
+	for (offset = 0; offset < VDO_BLOCK_SIZE; offset += AVX2_CHUNK_BYTES) {
+		asm volatile("vmovdqu   0(%1), %%ymm0\n\t"
+			     "vpor     32(%1), %%ymm0, %%ymm0\n\t"
+			     "vpor     64(%1), %%ymm0, %%ymm0\n\t"
+			     "vpor     96(%1), %%ymm0, %%ymm0\n\t"
+			     "vptest   %%ymm0, %%ymm0\n\t"
+			     "setnz    %0\n\t"
+			     : "=q" (nonzero)
+			     : "r" (block + offset)
+			     : "memory", "cc");
+		if (nonzero) {
+			break;
+		}
+	}
+	kernel_fpu_end();
+	return !nonzero;
+}
+
+/**
+ * Compare blocks of memory for equality, 128 bytes at a time, using AVX2.
+ *
+ * Implements compare_function.
+ **/
+static bool blocks_equal_avx2(const char *block1, const char *block2)
+{
+	unsigned int offset;
+	u8 differ = 0;
+
+	if (!irq_fpu_usable()) {
+		return blocks_equal_scalar(block1, block2);
+	}
+
+	kernel_fpu_begin();
+	for (offset = 0; offset < VDO_BLOCK_SIZE; offset += AVX2_CHUNK_BYTES) {
+		asm volatile("vmovdqu   0(%1), %%ymm0\n\t"
+			     "vmovdqu  32(%1), %%ymm1\n\t"
+			     "vmovdqu  64(%1), %%ymm2\n\t"
+			     "vmovdqu  96(%1), %%ymm3\n\t"
+			     "vpxor     0(%2), %%ymm0, %%ymm0\n\t"
+			     "vpxor    32(%2), %%ymm1, %%ymm1\n\t"
+			     "vpxor    64(%2), %%ymm2, %%ymm2\n\t"
+			     "vpxor    96(%2), %%ymm3, %%ymm3\n\t"
+			     "vpor     %%ymm1, %%ymm0, %%ymm0\n\t"
+			     "vpor     %%ymm3, %%ymm2, %%ymm2\n\t"
+			     "vpor     %%ymm2, %%ymm0, %%ymm0\n\t"
+			     "vptest   %%ymm0, %%ymm0\n\t"
+			     "setnz    %0\n\t"
+			     : "=q" (differ)
+			     : "r" (block1 + offset), "r" (block2 + offset)
+			     : "memory", "cc");
+		if (differ) {
+			break;
+		}
+	}
+	kernel_fpu_end();
+	return !differ;
+}
+#endif /* CONFIG_X86_64 */
+
+static const struct block_compare_implementation implementations[] = {
+	{
+		.name = "scalar",
+		.usable = always_usable,
+		.is_zero = is_zero_block_scalar,
+		.equal = blocks_equal_scalar,
+	},
+#ifdef CONFIG_X86_64
+	{
+		.name = "avx2",
+		.usable = avx2_usable,
+		.is_zero = is_zero_block_avx2,
+		.equal = blocks_equal_avx2,
+	},
+#endif
+};
+
+static zero_check_function *zero_check = is_zero_block_scalar;
+static compare_function *compare = blocks_equal_scalar;
+
+/**********************************************************************/
+bool is_zero_vdo_block(const char *block)
+{
+	return zero_check(block);
+}
+
+/**********************************************************************/
+bool vdo_blocks_equal(const char *block1, const char *block2)
+{
+	return compare(block1, block2);
+}
+
+/**
+ * Measure the average cost of checking an all-zero block, which is the
+ * worst case for a zero check.
+ *
+ * @param is_zero  The implementation to time
+ * @param block    A zeroed block
+ *
+ * @return The average number of cycles per block
+ **/
+static cycles_t time_zero_check(zero_check_function *is_zero,
+				const char *block)
+{
+	cycles_t start = get_cycles();
+	unsigned int i;
+
+	for (i = 0; i < BLOCK_COMPARE_CALIBRATION_ROUNDS; i++) {
+		if (!is_zero(block)) {
+			uds_log_error("zero check calibration failed");
+		}
+	}
+
+	return (get_cycles() - start) / BLOCK_COMPARE_CALIBRATION_ROUNDS;
+}
+
+/**
+ * Measure the average cost of comparing two equal blocks, which is the worst
+ * case for a comparison.
+ *
+ * @param equal   The implementation to time
+ * @param block1  A block
+ * @param block2  A copy of block1
+ *
+ * @return The average number of cycles per block
+ **/
+static cycles_t time_compare(compare_function *equal,
+			     const char *block1,
+			     const char *block2)
+{
+	cycles_t start = get_cycles();
+	unsigned int i;
+
+	for (i = 0; i < BLOCK_COMPARE_CALIBRATION_ROUNDS; i++) {
+		if (!equal(block1, block2)) {
+			uds_log_error("block compare calibration failed");
+		}
+	}
+
+	return (get_cycles() - start) / BLOCK_COMPARE_CALIBRATION_ROUNDS;
+}
+
+/**********************************************************************/
+void select_block_compare_functions(void)
+{
+	cycles_t best_zero_cycles = 0, best_compare_cycles = 0;
+	const char *zero_name = implementations[0].name;
+	const char *compare_name = implementations[0].name;
+	char *block1, *block2;
+	unsigned int i;
+	int result;
+
+	result = ALLOCATE(2 * VDO_BLOCK_SIZE, char, __func__, &block1);
+	if (result != VDO_SUCCESS) {
+		uds_log_warning("cannot calibrate block comparison, using %s",
+				zero_name);
+		return;
+	}
+	block2 = block1 + VDO_BLOCK_SIZE;
+
+	for (i = 0; i < ARRAY_SIZE(implementations); i++) {
+		const struct block_compare_implementation *implementation =
+			&implementations[i];
+		cycles_t zero_cycles, compare_cycles;
+
+		if (!implementation->usable()) {
+			continue;
+		}
+
+		zero_cycles = time_zero_check(implementation->is_zero, block1);
+		compare_cycles = time_compare(implementation->equal,
+					      block1,
+					      block2);
+		log_info("block comparison %s: zero check %llu cycles/block, compare %llu cycles/block",
+			 implementation->name,
+			 (unsigned long long) zero_cycles,
+			 (unsigned long long) compare_cycles);
+
+		if ((i == 0) || (zero_cycles < best_zero_cycles)) {
+			best_zero_cycles = zero_cycles;
+			zero_check = implementation->is_zero;
+			zero_name = implementation->name;
+		}
+
+		if ((i == 0) || (compare_cycles < best_compare_cycles)) {
+			best_compare_cycles = compare_cycles;
+			compare = implementation->equal;
+			compare_name = implementation->name;
+		}
+	}
+
+	log_info("using %s zero check and %s block compare",
+		 zero_name,
+		 compare_name);
+	FREE(block1);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef BLOCK_COMPARE_H
+#define BLOCK_COMPARE_H
+
+#include "types.h"
+
+/**
+ * Check whether a block of VDO_BLOCK_SIZE bytes is entirely zero, using the
+ * fastest implementation selected by select_block_compare_functions().
+ *
+ * @param block  The block to check
+ *
+ * @return true if every byte of the block is zero
+ **/
+bool __must_check is_zero_vdo_block(const char *block);
+
+/**
+ * Check whether two blocks of VDO_BLOCK_SIZE bytes have the same contents,
+ * using the fastest implementation selected by
+ * select_block_compare_functions().
+ *
+ * @param block1  The first block
+ * @param block2  The second block
+ *
+ * @return true if the blocks are equal
+ **/
+bool __must_check vdo_blocks_equal(const char *block1, const char *block2);
+
+/**
+ * Time each available implementation of the block check and comparison
+ * functions, log the cost per block of each, and select the fastest. This
+ * must be called once at module load time, before any device is started.
+ **/
+void select_block_compare_functions(void);
+
+#endif /* BLOCK_COMPARE_H */
@@ -31,6 +31,7 @@
 #include "blockMapInternals.h"
 #include "blockMapPage.h"
 #include "blockMapTree.h"
+#include "blockMapTreeInternals.h"
 #include "constants.h"
 #include "dataVIO.h"
 #include "forest.h"
@@ -41,6 +42,14 @@
 #include "vdoInternal.h"
 #include "vdoPageCache.h"
 
+enum {
+	/**
+	 * The fewest lookups by which the busiest logical zone must lead the
+	 * idlest in an era before a tree is handed from one to the other
+	 */
+	MINIMUM_HANDOFF_EXCESS = 1024,
+};
+
 /**
  * State associated which each block map page while it is in the VDO page
  * cache.
@@ -141,6 +150,9 @@ initialize_block_map_zone(struct block_map *map,
 	zone->thread_id = get_logical_zone_thread(thread_config, zone_number);
 	zone->block_map = map;
 	zone->read_only_notifier = read_only_notifier;
+	initialize_vdo_completion(&zone->prefetch_completion, vdo,
+				  BLOCK_MAP_PREFETCH_COMPLETION);
+	atomic_set(&zone->prefetching, 0);
 	result = initialize_tree_zone(zone, vdo, maximum_age);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -174,6 +186,244 @@ static thread_id_t get_block_map_zone_thread_id(void *context,
 	return get_block_map_zone(context, zone_number)->thread_id;
 }
 
+/**
+ * Send a request to the zone which owns its tree, by way of the zone's
+ * logical block locking.
+ *
+ * @param data_vio  The data_vio to send
+ **/
+static void relaunch_in_owning_zone(struct data_vio *data_vio)
+{
+	struct vdo *vdo = get_vdo_from_data_vio(data_vio);
+	zone_count_t owner = READ_ONCE(
+		vdo->block_map->root_zones[data_vio->tree_lock.root_index]);
+
+	data_vio->logical.zone = get_logical_zone(vdo->logical_zones, owner);
+	data_vio_as_completion(data_vio)->requeue = true;
+	launch_logical_callback(data_vio, attempt_logical_block_lock);
+}
+
+/**
+ * Relaunch a request which was held while its tree was being handed off.
+ *
+ * <p>Implements waiter_callback.
+ **/
+static void relaunch_held_request(struct waiter *waiter,
+				  void *context __always_unused)
+{
+	relaunch_in_owning_zone(waiter_as_data_vio(waiter));
+}
+
+/**
+ * End the handoff of a tree from a zone, and release the requests which
+ * arrived for the tree in the meantime.
+ *
+ * @param zone       The zone handing off the tree
+ * @param completed  Whether the tree now belongs to the target zone
+ **/
+static void finish_tree_handoff(struct block_map_zone *zone, bool completed)
+{
+	struct block_map *map = zone->block_map;
+	struct tree_handoff *handoff = &zone->handoff;
+
+	if (completed) {
+		WRITE_ONCE(map->root_zones[handoff->root], handoff->target);
+		WRITE_ONCE(zone->tree_handoffs, zone->tree_handoffs + 1);
+	}
+
+	handoff->active = false;
+	WRITE_ONCE(map->handing_off, false);
+	notify_all_waiters(&handoff->held, relaunch_held_request, NULL);
+}
+
+/**
+ * Evict the leaf pages mapped by a height one tree page from a zone's page
+ * cache.
+ *
+ * @param zone       The zone
+ * @param tree_page  The tree page mapping the leaves
+ *
+ * @return true if none of the leaves are still cached in the zone
+ **/
+static bool evict_leaf_pages(struct block_map_zone *zone,
+			     struct tree_page *tree_page)
+{
+	struct block_map_page *page =
+		(struct block_map_page *) tree_page->page_buffer;
+	bool evicted = true;
+	slot_number_t slot;
+
+	if (!is_block_map_page_initialized(page)) {
+		return true;
+	}
+
+	for (slot = 0; slot < VDO_BLOCK_MAP_ENTRIES_PER_PAGE; slot++) {
+		struct data_location mapping =
+			unpack_block_map_entry(&page->entries[slot]);
+		if ((mapping.pbn == VDO_ZERO_BLOCK) ||
+		    !is_mapped_location(&mapping)) {
+			continue;
+		}
+
+		if (!evict_vdo_page(zone->page_cache, mapping.pbn)) {
+			evicted = false;
+		}
+	}
+
+	return evicted;
+}
+
+/**
+ * Write out the dirty pages of the tree being handed off from a zone, and
+ * evict its leaf pages from the zone's page cache.
+ *
+ * @param zone  The zone handing off the tree
+ *
+ * @return true if the zone no longer holds any of the tree's pages
+ **/
+static bool release_tree_pages(struct block_map_zone *zone)
+{
+	struct forest *forest = zone->block_map->forest;
+	root_count_t root = zone->handoff.root;
+	bool released = true;
+	height_t height;
+
+	for (height = 1; height <= VDO_BLOCK_MAP_TREE_HEIGHT; height++) {
+		page_count_t count = get_vdo_tree_page_count(forest, height);
+		page_number_t index;
+
+		for (index = 0; index < count; index++) {
+			struct tree_page *page =
+				get_vdo_tree_page_by_index(forest, root,
+							   height, index);
+			if (!flush_tree_page(&zone->tree_zone, page)) {
+				released = false;
+			}
+
+			if ((height == 1) && !evict_leaf_pages(zone, page)) {
+				released = false;
+			}
+		}
+	}
+
+	return released;
+}
+
+/**
+ * Check whether a zone handing off a tree has finished with it, and if so,
+ * give the tree to its new zone. A handoff which can't finish because the
+ * zone is draining or read-only is abandoned.
+ *
+ * @param zone  The zone handing off a tree
+ **/
+static void continue_tree_handoff(struct block_map_zone *zone)
+{
+	struct tree_handoff *handoff = &zone->handoff;
+
+	if (!handoff->active || handoff->checking ||
+	    (zone->root_locks[handoff->root] > 0)) {
+		return;
+	}
+
+	if (!is_vdo_state_normal(&zone->state) ||
+	    is_read_only(zone->read_only_notifier)) {
+		finish_tree_handoff(zone, false);
+		return;
+	}
+
+	handoff->checking = true;
+	if (release_tree_pages(zone)) {
+		finish_tree_handoff(zone, true);
+	}
+
+	handoff->checking = false;
+}
+
+/**
+ * Begin handing a tree from a zone to a less busy zone if the zone was chosen
+ * to do so at this era advance. The tree chosen is the busiest one which
+ * would not make the other zone busier than this one.
+ *
+ * @param zone  The zone
+ **/
+static void start_tree_handoff(struct block_map_zone *zone)
+{
+	struct block_map *map = zone->block_map;
+	struct handoff_request *request = &map->handoff_request;
+	struct tree_utilization *utilization = &zone->utilization;
+	uint32_t best = 0;
+	root_count_t chosen = 0;
+	block_count_t root;
+
+	if (!request->pending || (request->source != zone->zone_number) ||
+	    !is_vdo_state_normal(&zone->state)) {
+		return;
+	}
+
+	for (root = 0; root < map->root_count; root++) {
+		uint32_t lookups = utilization->root_lookups[root];
+		if ((map->root_zones[root] == zone->zone_number) &&
+		    (lookups > best) && (lookups < request->excess)) {
+			best = lookups;
+			chosen = root;
+		}
+	}
+
+	if (best == 0) {
+		return;
+	}
+
+	zone->handoff = (struct tree_handoff) {
+		.active = true,
+		.root = chosen,
+		.target = request->target,
+	};
+	WRITE_ONCE(map->handing_off, true);
+	continue_tree_handoff(zone);
+}
+
+/**
+ * Choose a zone to hand one of its trees to a less busy zone, based on the
+ * lookups in each zone during the last era. Only one tree is moved at a time.
+ *
+ * @param map  The block map
+ **/
+static void choose_tree_handoff(struct block_map *map)
+{
+	zone_count_t busiest = 0, idlest = 0, zone;
+	uint64_t most, least;
+
+	map->handoff_request.pending = false;
+	if (!READ_ONCE(map->rebalance_zones) || (map->zone_count < 2) ||
+	    READ_ONCE(map->handing_off)) {
+		return;
+	}
+
+	most = least = READ_ONCE(map->zones[0].era_lookups);
+	for (zone = 1; zone < map->zone_count; zone++) {
+		uint64_t lookups = READ_ONCE(map->zones[zone].era_lookups);
+		if (lookups > most) {
+			most = lookups;
+			busiest = zone;
+		} else if (lookups < least) {
+			least = lookups;
+			idlest = zone;
+		}
+	}
+
+	if ((most - least < MINIMUM_HANDOFF_EXCESS) ||
+	    (most < least + (least / 4))) {
+		return;
+	}
+
+	map->handoff_request = (struct handoff_request) {
+		.pending = true,
+		.source = busiest,
+		.target = idlest,
+		.excess = most - least,
+	};
+}
+
 /**
  * Prepare for an era advance.
  *
@@ -184,6 +434,7 @@ static void prepare_for_era_advance(void *context,
 {
 	struct block_map *map = context;
 	map->current_era_point = map->pending_era_point;
+	choose_tree_handoff(map);
 	complete_vdo_completion(parent);
 }
 
@@ -197,10 +448,21 @@ static void advance_block_map_zone_era(void *context,
 				       struct vdo_completion *parent)
 {
 	struct block_map_zone *zone = get_block_map_zone(context, zone_number);
+	block_count_t pace = get_block_map_writeback_pace(zone->block_map);
+	unsigned int share = get_block_map_compact_page_share(zone->block_map);
+
+	set_vdo_page_cache_writeback_pace(zone->page_cache, pace);
+	set_vdo_page_cache_compact_share(zone->page_cache, share);
 	advance_vdo_page_cache_period(zone->page_cache,
 				      zone->block_map->current_era_point);
+	set_zone_tree_writeback_pace(&zone->tree_zone, pace);
 	advance_zone_tree_period(&zone->tree_zone,
 				 zone->block_map->current_era_point);
+
+	start_tree_handoff(zone);
+	continue_tree_handoff(zone);
+	WRITE_ONCE(zone->era_lookups, zone->utilization.lookups);
+	memset(&zone->utilization, 0, sizeof(zone->utilization));
 	finish_vdo_completion(parent, VDO_SUCCESS);
 }
 
@@ -272,6 +534,7 @@ int decode_block_map(struct block_map_state_2_0 state,
 	struct block_map *map;
 	int result;
 	zone_count_t zone = 0;
+	block_count_t root;
 
 	STATIC_ASSERT(VDO_BLOCK_MAP_ENTRIES_PER_PAGE ==
 		      ((VDO_BLOCK_SIZE - sizeof(struct block_map_page)) /
@@ -294,6 +557,7 @@ int decode_block_map(struct block_map_state_2_0 state,
 	map->root_origin = state.root_origin;
 	map->root_count = state.root_count;
 	map->entry_count = logical_blocks;
+	map->read_ahead_window = VDO_DEFAULT_READ_AHEAD_WINDOW;
 	map->journal = journal;
 	map->nonce = nonce;
 
@@ -306,6 +570,10 @@ int decode_block_map(struct block_map_state_2_0 state,
 	replace_vdo_forest(map);
 
 	map->zone_count = thread_config->logical_zone_count;
+	for (root = 0; root < map->root_count; root++) {
+		map->root_zones[root] = root % map->zone_count;
+	}
+
 	for (zone = 0; zone < map->zone_count; zone++) {
 		result = initialize_block_map_zone(map,
 						   zone,
@@ -377,7 +645,7 @@ zone_count_t compute_logical_zone(struct data_vio *data_vio)
 	page_number_t page_number = compute_page_number(data_vio->logical.lbn);
 	tree_lock->tree_slots[0].page_index = page_number;
 	tree_lock->root_index = page_number % map->root_count;
-	return (tree_lock->root_index % map->zone_count);
+	return READ_ONCE(map->root_zones[tree_lock->root_index]);
 }
 
 /**********************************************************************/
@@ -388,12 +656,17 @@ void find_block_map_slot(struct data_vio *data_vio,
 	struct block_map *map = get_block_map(get_vdo_from_data_vio(data_vio));
 	struct tree_lock *tree_lock = &data_vio->tree_lock;
 	struct block_map_tree_slot *slot = &tree_lock->tree_slots[0];
+	struct tree_utilization *utilization =
+		&get_block_map_for_zone(data_vio->logical.zone)->utilization;
 
 	if (data_vio->logical.lbn >= map->entry_count) {
 		finish_data_vio(data_vio, VDO_OUT_OF_RANGE);
 		return;
 	}
 
+	utilization->lookups++;
+	utilization->root_lookups[tree_lock->root_index]++;
+
 	slot->block_map_slot.slot = compute_slot(data_vio->logical.lbn);
 	tree_lock->callback = callback;
 	tree_lock->thread_id = thread_id;
@@ -421,6 +694,12 @@ void advance_block_map_era(struct block_map *map,
 /**********************************************************************/
 void check_for_drain_complete(struct block_map_zone *zone)
 {
+	if (zone->handoff.active && !is_tree_zone_active(&zone->tree_zone) &&
+	    !is_page_cache_active(zone->page_cache)) {
+		// The writes of the pages of a tree being handed off are done.
+		continue_tree_handoff(zone);
+	}
+
 	if (is_vdo_state_draining(&zone->state) &&
 	    !is_tree_zone_active(&zone->tree_zone) &&
 	    !is_page_cache_active(zone->page_cache)) {
@@ -619,6 +898,7 @@ set_mapped_entry(struct data_vio *data_vio,
 	// Unpack the PBN for logging purposes even if the entry is invalid.
 	struct data_location mapped = unpack_block_map_entry(entry);
 
+	data_vio->has_invalid_mapping = false;
 	if (is_valid_location(&mapped)) {
 		int result = set_mapped_location(data_vio, mapped.pbn,
 						 mapped.state);
@@ -649,6 +929,7 @@ set_mapped_entry(struct data_vio *data_vio,
 	// A write VIO only reads this mapping to decref the old block. Treat
 	// this as an unmapped entry rather than fail the write.
 	clear_mapped_location(data_vio);
+	data_vio->has_invalid_mapping = true;
 	return VDO_SUCCESS;
 }
 
@@ -678,6 +959,8 @@ static void get_mapping_from_fetched_page(struct vdo_completion *completion)
 	tree_slot = &data_vio->tree_lock.tree_slots[0];
 	entry = &page->entries[tree_slot->block_map_slot.slot];
 
+	// Let later reads of this page look up their mappings locklessly.
+	publish_vdo_page(completion, tree_slot->page_index);
 	result = set_mapped_entry(data_vio, entry);
 	finish_processing_page(completion, result);
 }
@@ -728,15 +1011,47 @@ void update_block_map_page(struct block_map_page *page,
 	data_vio->recovery_sequence_number = 0;
 }
 
+/**
+ * Check whether every entry of a leaf block map page other than a given one
+ * is unmapped. The search starts just after the given slot, where a mapping
+ * is most likely to be found when a range is being trimmed in order.
+ *
+ * @param page  The leaf page
+ * @param slot  The slot to skip
+ *
+ * @return <code>true</code> if no other entry of the page is mapped
+ **/
+static bool are_other_entries_unmapped(const struct block_map_page *page,
+				       slot_number_t slot)
+{
+	slot_number_t i;
+
+	for (i = 1; i < VDO_BLOCK_MAP_ENTRIES_PER_PAGE; i++) {
+		slot_number_t other =
+			(slot + i) % VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
+		struct data_location mapping =
+			unpack_block_map_entry(&page->entries[other]);
+		if (is_mapped_location(&mapping)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /**
  * This callback is registered in put_mapped_block().
  **/
 static void put_mapping_in_fetched_page(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion->parent);
+	struct block_map_zone *zone =
+		get_block_map_for_zone(data_vio->logical.zone);
 	struct block_map_page *page;
 	struct block_map_page_context *context;
+	struct block_map_tree_slot *tree_slot;
 	sequence_number_t old_lock;
+	bool empty;
 	int result;
 
 	if (completion->result != VDO_SUCCESS) {
@@ -758,6 +1073,20 @@ static void put_mapping_in_fetched_page(struct vdo_completion *completion)
 			      data_vio->new_mapped.pbn,
 			      data_vio->new_mapped.state,
 			      &context->recovery_lock);
+
+
+	/*
+	 * Remember whether this update left the page without any mappings, so
+	 * that lookups in it may skip fetching it until something is mapped
+	 * there again.
+	 */
+	tree_slot = &data_vio->tree_lock.tree_slots[0];
+	empty = ((data_vio->new_mapped.state == MAPPING_STATE_UNMAPPED) &&
+		 are_other_entries_unmapped(page,
+					    tree_slot->block_map_slot.slot));
+	set_block_map_leaf_known_empty(zone->block_map, tree_slot->page_index,
+				       empty);
+	record_data_vio_milestone(data_vio, DATA_VIO_MAPPED);
 	mark_completed_vdo_page_dirty(completion, old_lock,
 				      context->recovery_lock);
 	finish_processing_page(completion, VDO_SUCCESS);
@@ -766,10 +1095,16 @@ static void put_mapping_in_fetched_page(struct vdo_completion *completion)
 /**********************************************************************/
 void get_mapped_block(struct data_vio *data_vio)
 {
-	if (data_vio->tree_lock.tree_slots[0].block_map_slot.pbn ==
-	    VDO_ZERO_BLOCK) {
-		// We know that the block map page for this LBN has not been
-		// allocated, so the block must be unmapped.
+	struct block_map_tree_slot *tree_slot =
+		&data_vio->tree_lock.tree_slots[0];
+	struct block_map *map =
+		get_block_map_for_zone(data_vio->logical.zone)->block_map;
+
+	// We know that the block must be unmapped if the block map page for
+	// this LBN has not been allocated, or if every mapping on it has been
+	// removed.
+	if ((tree_slot->block_map_slot.pbn == VDO_ZERO_BLOCK) ||
+	    is_block_map_leaf_known_empty(map, tree_slot->page_index)) {
 		clear_mapped_location(data_vio);
 		continue_data_vio(data_vio, VDO_SUCCESS);
 		return;
@@ -784,39 +1119,500 @@ void put_mapped_block(struct data_vio *data_vio)
 	setup_mapped_block(data_vio, true, put_mapping_in_fetched_page);
 }
 
+/**
+ * Get the update fence which covers the leaf page holding the mapping of a
+ * data_vio's logical block.
+ *
+ * @param data_vio  The data_vio
+ *
+ * @return The fence for the data_vio's leaf page
+ **/
+static struct update_fence *get_update_fence(struct data_vio *data_vio)
+{
+	struct block_map_zone *zone =
+		get_block_map_for_zone(data_vio->logical.zone);
+	page_number_t page_number =
+		data_vio->tree_lock.tree_slots[0].page_index;
+	return &zone->update_fences[page_number % UPDATE_FENCE_COUNT];
+}
+
+/**********************************************************************/
+bool lookup_lockless_mapping(struct data_vio *data_vio,
+			     struct data_location *mapping)
+{
+	struct block_map_zone *zone =
+		get_block_map_for_zone(data_vio->logical.zone);
+	struct update_fence *fence = get_update_fence(data_vio);
+	page_number_t page_number =
+		data_vio->tree_lock.tree_slots[0].page_index;
+	slot_number_t slot = compute_slot(data_vio->logical.lbn);
+	struct block_map_entry entry;
+
+	/*
+	 * The entry in the page may only be trusted if no update of any page
+	 * covered by the fence was in progress when the entry was copied, and
+	 * none began while it was being copied. The zone writes the count of
+	 * updates before the sequence number, so read them in reverse order.
+	 */
+	data_vio->lockless_update_sequence = READ_ONCE(fence->sequence);
+	smp_rmb();
+	if (READ_ONCE(fence->updates) > 0) {
+		return false;
+	}
+
+	if (!copy_from_published_vdo_page(zone->page_cache,
+					  page_number,
+					  offsetof(struct block_map_page,
+						   entries[slot]),
+					  sizeof(entry),
+					  &entry,
+					  &data_vio->lockless_page)) {
+		return false;
+	}
+
+	smp_rmb();
+	if (READ_ONCE(fence->sequence) != data_vio->lockless_update_sequence) {
+		return false;
+	}
+
+	*mapping = unpack_block_map_entry(&entry);
+	return is_valid_location(mapping);
+}
+
+/**********************************************************************/
+bool is_lockless_mapping_current(struct data_vio *data_vio)
+{
+	struct block_map_zone *zone =
+		get_block_map_for_zone(data_vio->logical.zone);
+	struct update_fence *fence = get_update_fence(data_vio);
+	page_number_t page_number =
+		data_vio->tree_lock.tree_slots[0].page_index;
+
+	smp_rmb();
+	return ((READ_ONCE(fence->sequence) ==
+		 data_vio->lockless_update_sequence) &&
+		is_vdo_page_snapshot_current(zone->page_cache, page_number,
+					     &data_vio->lockless_page));
+}
+
+/**********************************************************************/
+void begin_block_map_update(struct data_vio *data_vio)
+{
+	struct update_fence *fence = get_update_fence(data_vio);
+
+	assert_in_logical_zone(data_vio);
+	WRITE_ONCE(fence->updates, fence->updates + 1);
+	smp_wmb();
+	WRITE_ONCE(fence->sequence, fence->sequence + 1);
+}
+
+/**********************************************************************/
+void end_block_map_update(struct data_vio *data_vio)
+{
+	struct update_fence *fence = get_update_fence(data_vio);
+
+	assert_in_logical_zone(data_vio);
+	// Make sure the new mapping is visible before the fence is lowered.
+	smp_wmb();
+	WRITE_ONCE(fence->updates, fence->updates - 1);
+}
+
+/**********************************************************************/
+bool divert_for_tree_handoff(struct data_vio *data_vio)
+{
+	struct block_map_zone *zone =
+		get_block_map_for_zone(data_vio->logical.zone);
+	struct tree_handoff *handoff = &zone->handoff;
+	root_count_t root = data_vio->tree_lock.root_index;
+	int result;
+
+	if (READ_ONCE(zone->block_map->root_zones[root]) != zone->zone_number) {
+		// The tree was handed off after the request chose its zone.
+		relaunch_in_owning_zone(data_vio);
+		return true;
+	}
+
+	// A request for a block which is already locked waits for the lock
+	// holder, which the handoff is also waiting for.
+	if (!handoff->active || (handoff->root != root) ||
+	    (int_map_get(get_lbn_lock_map(data_vio->logical.zone),
+			 data_vio->logical.lbn) != NULL)) {
+		return false;
+	}
+
+	data_vio->last_async_operation = ACQUIRE_LOGICAL_BLOCK_LOCK;
+	result = enqueue_data_vio(&handoff->held, data_vio);
+	if (result != VDO_SUCCESS) {
+		finish_data_vio(data_vio, result);
+	}
+
+	return true;
+}
+
+/**********************************************************************/
+void note_logical_block_locked(struct data_vio *data_vio)
+{
+	struct block_map_zone *zone =
+		get_block_map_for_zone(data_vio->logical.zone);
+
+	zone->root_locks[data_vio->tree_lock.root_index]++;
+}
+
 /**********************************************************************/
-struct block_map_statistics get_block_map_statistics(struct block_map *map)
+void note_logical_block_unlocked(struct data_vio *data_vio)
+{
+	struct block_map_zone *zone =
+		get_block_map_for_zone(data_vio->logical.zone);
+	root_count_t root = data_vio->tree_lock.root_index;
+
+	if ((--zone->root_locks[root] == 0) && zone->handoff.active &&
+	    (zone->handoff.root == root)) {
+		continue_tree_handoff(zone);
+	}
+}
+
+/**
+ * Finish a read-ahead of a block map leaf page, releasing the page so that
+ * the cache may evict it if it goes unused. This is both the callback and
+ * the error handler registered in prefetch_leaf_page().
+ *
+ * @param completion  The page completion of the read-ahead
+ **/
+static void finish_prefetch(struct vdo_completion *completion)
+{
+	struct block_map_zone *zone = completion->parent;
+
+	if (completion->result == VDO_SUCCESS) {
+		publish_vdo_page(completion, zone->prefetch_page_number);
+	}
+
+	release_vdo_page_completion(completion);
+	atomic_set_release(&zone->prefetching, 0);
+}
+
+/**
+ * Look up the location of the leaf page to be read ahead and fetch it into
+ * the page cache. This callback is registered in prefetch_block_map_page().
+ *
+ * @param completion  The prefetch completion of the zone
+ **/
+static void prefetch_leaf_page(struct vdo_completion *completion)
+{
+	struct block_map_zone *zone = completion->parent;
+	struct block_map *map = zone->block_map;
+	root_count_t root = zone->prefetch_page_number % map->root_count;
+	physical_block_number_t pbn;
+
+	// Only the zone's own thread may examine its tree pages, and only
+	// while the tree is not being drained, grown, or handed off.
+	if (!is_vdo_state_normal(&zone->state) ||
+	    (READ_ONCE(map->root_zones[root]) != zone->zone_number) ||
+	    (zone->handoff.active && (zone->handoff.root == root))) {
+		atomic_set_release(&zone->prefetching, 0);
+		return;
+	}
+
+	pbn = find_block_map_page_pbn(zone->block_map,
+				      zone->prefetch_page_number);
+	if ((pbn == VDO_ZERO_BLOCK) ||
+	    is_block_map_leaf_known_empty(map, zone->prefetch_page_number)) {
+		// The page has not been allocated, the interior page which
+		// maps it has not been loaded, or it holds no mappings.
+		atomic_set_release(&zone->prefetching, 0);
+		return;
+	}
+
+	init_vdo_page_completion(&zone->prefetch_page,
+				 zone->page_cache,
+				 pbn,
+				 false,
+				 zone,
+				 finish_prefetch,
+				 finish_prefetch);
+	get_vdo_page(&zone->prefetch_page.completion);
+}
+
+/**********************************************************************/
+void prefetch_block_map_page(struct block_map *map,
+			     page_number_t page_number)
+{
+	struct block_map_zone *zone;
+
+	if (((block_count_t) page_number * VDO_BLOCK_MAP_ENTRIES_PER_PAGE) >=
+	    map->entry_count) {
+		return;
+	}
+
+	zone = &map->zones[READ_ONCE(map->root_zones[page_number %
+						     map->root_count])];
+	if (atomic_cmpxchg(&zone->prefetching, 0, 1) != 0) {
+		// A read-ahead is already in progress in the zone.
+		return;
+	}
+
+	zone->prefetch_page_number = page_number;
+	prepare_vdo_completion(&zone->prefetch_completion,
+			       prefetch_leaf_page,
+			       prefetch_leaf_page,
+			       zone->thread_id,
+			       zone);
+	invoke_vdo_completion_callback(&zone->prefetch_completion);
+}
+
+/**********************************************************************/
+int save_block_map_hot_set(struct block_map *map, struct buffer *buffer)
+{
+	zone_count_t zone;
+	page_count_t count = 0;
+
+	for (zone = 0; zone < map->zone_count; zone++) {
+		// Divide the room which is left among the remaining zones so
+		// that zones with few hot pages leave room for the others.
+		struct vdo_page_cache *cache = map->zones[zone].page_cache;
+		page_count_t share = ((VDO_BLOCK_MAP_HOT_SET_SIZE - count)
+				      / (map->zone_count - zone));
+		count += get_vdo_page_cache_hot_pages(cache,
+						      map->hot_set + count,
+						      share);
+	}
+
+	map->hot_set_size = count;
+	return encode_block_map_hot_set(map->hot_set, count, map->nonce,
+					buffer);
+}
+
+static void warm_next_page(struct vdo_completion *completion);
+
+/**
+ * Release a page read back from the hot set and move on to the next one on
+ * a fresh callback so that the zone's other work is not held up. This is
+ * both the callback and the error handler registered in warm_next_page().
+ *
+ * @param completion  The page completion of the zone's read-ahead
+ **/
+static void finish_warming_page(struct vdo_completion *completion)
+{
+	struct block_map_zone *zone = completion->parent;
+
+	release_vdo_page_completion(completion);
+	prepare_vdo_completion(&zone->prefetch_completion,
+			       warm_next_page,
+			       warm_next_page,
+			       zone->thread_id,
+			       zone);
+	zone->prefetch_completion.requeue = true;
+	invoke_vdo_completion_callback(&zone->prefetch_completion);
+}
+
+/**
+ * Read the next page of the hot set which belongs to a zone into the zone's
+ * page cache. The page is not published; the first lookup through the tree
+ * will do that. This callback is registered in warm_block_map() and
+ * finish_warming_page().
+ *
+ * @param completion  The prefetch completion of the zone
+ **/
+static void warm_next_page(struct vdo_completion *completion)
+{
+	struct block_map_zone *zone = completion->parent;
+	struct block_map *map = zone->block_map;
+
+	while (is_vdo_state_normal(&zone->state) &&
+	       (zone->warm_cursor < map->hot_set_size)) {
+		struct block_map_hot_page *page
+			= &map->hot_set[zone->warm_cursor++];
+		root_count_t root = page->page_number % map->root_count;
+
+		if ((page->pbn == VDO_ZERO_BLOCK) ||
+		    (((block_count_t) page->page_number
+		      * VDO_BLOCK_MAP_ENTRIES_PER_PAGE) >= map->entry_count) ||
+		    (READ_ONCE(map->root_zones[root]) != zone->zone_number)) {
+			continue;
+		}
+
+		init_vdo_page_completion(&zone->prefetch_page,
+					 zone->page_cache,
+					 page->pbn,
+					 false,
+					 zone,
+					 finish_warming_page,
+					 finish_warming_page);
+		get_vdo_page(&zone->prefetch_page.completion);
+		return;
+	}
+
+	atomic_set_release(&zone->prefetching, 0);
+}
+
+/**********************************************************************/
+void warm_block_map(struct block_map *map, struct buffer *buffer)
+{
+	zone_count_t zone;
+	int result = decode_block_map_hot_set(buffer, map->nonce, map->hot_set,
+					      &map->hot_set_size);
+	if (result != VDO_SUCCESS) {
+		log_warning_strerror(result, "ignoring block map hot set");
+		return;
+	}
+
+	if (map->hot_set_size == 0) {
+		return;
+	}
+
+	log_info("warming block map cache with %u pages", map->hot_set_size);
+	for (zone = 0; zone < map->zone_count; zone++) {
+		struct block_map_zone *map_zone = &map->zones[zone];
+
+		if (atomic_cmpxchg(&map_zone->prefetching, 0, 1) != 0) {
+			continue;
+		}
+
+		map_zone->warm_cursor = 0;
+		prepare_vdo_completion(&map_zone->prefetch_completion,
+				       warm_next_page,
+				       warm_next_page,
+				       map_zone->thread_id,
+				       map_zone);
+		invoke_vdo_completion_callback(&map_zone->prefetch_completion);
+	}
+}
+
+/**********************************************************************/
+block_count_t get_block_map_read_ahead_window(const struct block_map *map)
+{
+	return READ_ONCE(map->read_ahead_window);
+}
+
+/**********************************************************************/
+void set_block_map_read_ahead_window(struct block_map *map,
+				     block_count_t window)
+{
+	WRITE_ONCE(map->read_ahead_window,
+		   min_t(block_count_t, window, VDO_MAXIMUM_READ_AHEAD_WINDOW));
+}
+
+/**********************************************************************/
+block_count_t get_block_map_writeback_pace(const struct block_map *map)
+{
+	return READ_ONCE(map->writeback_pace);
+}
+
+/**********************************************************************/
+void set_block_map_writeback_pace(struct block_map *map, block_count_t pace)
+{
+	WRITE_ONCE(map->writeback_pace, pace);
+}
+
+/**********************************************************************/
+unsigned int get_block_map_compact_page_share(const struct block_map *map)
+{
+	return READ_ONCE(map->compact_page_share);
+}
+
+/**********************************************************************/
+void set_block_map_compact_page_share(struct block_map *map,
+				      unsigned int share)
+{
+	WRITE_ONCE(map->compact_page_share,
+		   min_t(unsigned int, share, VDO_MAXIMUM_COMPACT_PAGE_SHARE));
+}
+
+/**********************************************************************/
+bool get_block_map_rebalancing(const struct block_map *map)
+{
+	return READ_ONCE(map->rebalance_zones);
+}
+
+/**********************************************************************/
+void set_block_map_rebalancing(struct block_map *map, bool rebalance)
+{
+	WRITE_ONCE(map->rebalance_zones, rebalance);
+}
+
+/**********************************************************************/
+void get_block_map_statistics(struct block_map *map,
+			      struct block_map_statistics *totals)
 {
 	zone_count_t zone = 0;
-	struct block_map_statistics totals;
-	memset(&totals, 0, sizeof(struct block_map_statistics));
+	memset(totals, 0, sizeof(*totals));
 
 	for (zone = 0; zone < map->zone_count; zone++) {
 		struct vdo_page_cache *cache = map->zones[zone].page_cache;
-		struct block_map_statistics stats =
-			get_vdo_page_cache_statistics(cache);
-
-		totals.dirty_pages += stats.dirty_pages;
-		totals.clean_pages += stats.clean_pages;
-		totals.free_pages += stats.free_pages;
-		totals.failed_pages += stats.failed_pages;
-		totals.incoming_pages += stats.incoming_pages;
-		totals.outgoing_pages += stats.outgoing_pages;
-		totals.cache_pressure += stats.cache_pressure;
-		totals.read_count += stats.read_count;
-		totals.write_count += stats.write_count;
-		totals.failed_reads += stats.failed_reads;
-		totals.failed_writes += stats.failed_writes;
-		totals.reclaimed += stats.reclaimed;
-		totals.read_outgoing += stats.read_outgoing;
-		totals.found_in_cache += stats.found_in_cache;
-		totals.discard_required += stats.discard_required;
-		totals.wait_for_page += stats.wait_for_page;
-		totals.fetch_required += stats.fetch_required;
-		totals.pages_loaded += stats.pages_loaded;
-		totals.pages_saved += stats.pages_saved;
-		totals.flush_count += stats.flush_count;
-	}
-
-	return totals;
+		struct block_map_statistics stats;
+
+		get_vdo_page_cache_statistics(cache, &stats);
+
+		totals->dirty_pages += stats.dirty_pages;
+		totals->clean_pages += stats.clean_pages;
+		totals->free_pages += stats.free_pages;
+		totals->failed_pages += stats.failed_pages;
+		totals->incoming_pages += stats.incoming_pages;
+		totals->outgoing_pages += stats.outgoing_pages;
+		totals->cache_pressure += stats.cache_pressure;
+		totals->read_count += stats.read_count;
+		totals->write_count += stats.write_count;
+		totals->failed_reads += stats.failed_reads;
+		totals->failed_writes += stats.failed_writes;
+		totals->reclaimed += stats.reclaimed;
+		totals->read_outgoing += stats.read_outgoing;
+		totals->found_in_cache += stats.found_in_cache;
+		totals->discard_required += stats.discard_required;
+		totals->wait_for_page += stats.wait_for_page;
+		totals->fetch_required += stats.fetch_required;
+		totals->pages_loaded += stats.pages_loaded;
+		totals->pages_saved += stats.pages_saved;
+		totals->flush_count += stats.flush_count;
+		totals->protected_pages += stats.protected_pages;
+		totals->protected_hits += stats.protected_hits;
+		totals->promotions += stats.promotions;
+		totals->compact_pages += stats.compact_pages;
+		totals->compact_loads += stats.compact_loads;
+		totals->contiguous_pages += stats.contiguous_pages;
+		totals->simulated_gets += stats.simulated_gets;
+		totals->simulated_half_size_hits +=
+			stats.simulated_half_size_hits;
+		totals->simulated_same_size_hits +=
+			stats.simulated_same_size_hits;
+		totals->simulated_double_size_hits +=
+			stats.simulated_double_size_hits;
+		totals->simulated_quadruple_size_hits +=
+			stats.simulated_quadruple_size_hits;
+		totals->tree_handoffs +=
+			READ_ONCE(map->zones[zone].tree_handoffs);
+	}
+}
+
+/**********************************************************************/
+int prepare_to_resize_block_map_cache(struct block_map *map,
+				      page_count_t cache_size)
+{
+	zone_count_t zone;
+	for (zone = 0; zone < map->zone_count; zone++) {
+		int result =
+			prepare_to_resize_vdo_page_cache(map->zones[zone].page_cache,
+							 cache_size / map->zone_count);
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
+	}
+
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void resize_block_map_zone_cache(struct block_map_zone *zone)
+{
+	resize_vdo_page_cache(zone->page_cache);
+}
+
+/**********************************************************************/
+page_count_t get_block_map_cache_page_count(const struct block_map *map)
+{
+	zone_count_t zone;
+	page_count_t total = 0;
+	for (zone = 0; zone < map->zone_count; zone++) {
+		total += get_vdo_page_cache_size(map->zones[zone].page_cache);
+	}
+
+	return total;
 }
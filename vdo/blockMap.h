@@ -31,6 +31,21 @@
 #include "statistics.h"
 #include "types.h"
 
+enum {
+	/** The default read-ahead window, in block map entries */
+	VDO_DEFAULT_READ_AHEAD_WINDOW = 256,
+	/**
+	 * The largest read-ahead window, which leaves room for a read stream
+	 * to be recognized on each leaf page before the window is reached
+	 */
+	VDO_MAXIMUM_READ_AHEAD_WINDOW = VDO_BLOCK_MAP_ENTRIES_PER_PAGE / 2,
+	/**
+	 * The largest percentage of each zone's page cache which may hold
+	 * compacted copies of evicted pages
+	 */
+	VDO_MAXIMUM_COMPACT_PAGE_SHARE = 50,
+};
+
 /**
  * Make a block map and configure it with the state read from the super block.
  *
@@ -155,6 +170,127 @@ void initialize_block_map_from_journal(struct block_map *map,
 struct block_map_zone * __must_check
 get_block_map_zone(struct block_map *map, zone_count_t zone_number);
 
+/**
+ * Start loading a leaf page of the block map into the page cache of its zone
+ * in anticipation of reads it will map. Nothing is done if the zone already
+ * has a read-ahead in progress, or if the page has not been allocated. This
+ * may be called from any logical zone thread.
+ *
+ * @param map          The block map
+ * @param page_number  The number of the leaf page to read ahead
+ **/
+void prefetch_block_map_page(struct block_map *map,
+			     page_number_t page_number);
+
+/**
+ * Record the hottest leaf pages in the page caches of a drained block map and
+ * encode them into a buffer so that warm_block_map() can read them back in
+ * after the VDO is next loaded. This must be called from the admin thread.
+ *
+ * @param map     The block map
+ * @param buffer  The buffer to encode into
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check save_block_map_hot_set(struct block_map *map,
+					struct buffer *buffer);
+
+/**
+ * Decode a hot set encoded by save_block_map_hot_set() and start reading its
+ * pages back into the page cache of each zone in the background, one page at
+ * a time. A zone's read-ahead is held off while it warms, and warming stops
+ * if the zone is drained. A buffer which holds no hot set, or a corrupt one,
+ * is ignored. This must be called from the admin thread.
+ *
+ * @param map     The block map
+ * @param buffer  The buffer holding the encoded hot set
+ **/
+void warm_block_map(struct block_map *map, struct buffer *buffer);
+
+/**
+ * Get the read-ahead window of a block map.
+ *
+ * @param map  The block map
+ *
+ * @return The number of entries before the end of a leaf page at which a
+ *         sequential read stream reads the next leaf page ahead, or 0 if
+ *         read-ahead is disabled
+ **/
+block_count_t __must_check
+get_block_map_read_ahead_window(const struct block_map *map);
+
+/**
+ * Set the read-ahead window of a block map. The window is limited to
+ * VDO_MAXIMUM_READ_AHEAD_WINDOW.
+ *
+ * @param map     The block map
+ * @param window  The new window, or 0 to disable read-ahead
+ **/
+void set_block_map_read_ahead_window(struct block_map *map,
+				     block_count_t window);
+
+/**
+ * Get the writeback pace of a block map.
+ *
+ * @param map  The block map
+ *
+ * @return The number of dirty pages each zone writes out ahead of their
+ *         deadline each time the recovery journal advances, or 0 if pages
+ *         are only written when they reach the maximum age
+ **/
+block_count_t __must_check
+get_block_map_writeback_pace(const struct block_map *map);
+
+/**
+ * Set the writeback pace of a block map. The new pace takes effect at the
+ * next era advance.
+ *
+ * @param map   The block map
+ * @param pace  The new pace, or 0 to disable paced writeback
+ **/
+void set_block_map_writeback_pace(struct block_map *map, block_count_t pace);
+
+/**
+ * Get the compacted page share of a block map.
+ *
+ * @param map  The block map
+ *
+ * @return The percentage of each zone's page cache which may hold compacted
+ *         copies of evicted pages, or 0 if evicted pages are not kept
+ **/
+unsigned int __must_check
+get_block_map_compact_page_share(const struct block_map *map);
+
+/**
+ * Set the compacted page share of a block map. The share is limited to
+ * VDO_MAXIMUM_COMPACT_PAGE_SHARE and takes effect at the next era advance.
+ *
+ * @param map    The block map
+ * @param share  The new share, or 0 to stop keeping evicted pages
+ **/
+void set_block_map_compact_page_share(struct block_map *map,
+				      unsigned int share);
+
+/**
+ * Check whether a block map moves trees from busy logical zones to idle ones.
+ *
+ * @param map  The block map
+ *
+ * @return <code>true</code> if the zones are being rebalanced
+ **/
+bool __must_check get_block_map_rebalancing(const struct block_map *map);
+
+/**
+ * Set whether a block map moves trees from busy logical zones to idle ones.
+ * Each tree's zone is kept only in memory, so every tree returns to its
+ * original zone when the VDO is restarted. Rebalancing is considered at each
+ * era advance.
+ *
+ * @param map        The block map
+ * @param rebalance  Whether to rebalance the zones
+ **/
+void set_block_map_rebalancing(struct block_map *map, bool rebalance);
+
 /**
  * Compute the logical zone on which the entry for a data_vio
  * resides
@@ -177,6 +313,33 @@ void find_block_map_slot(struct data_vio *data_vio,
 			 vdo_action *callback,
 			 thread_id_t thread_id);
 
+/**
+ * Check whether a request which is about to lock its logical block must
+ * instead go to another zone, or wait for its tree to be handed to another
+ * zone. This must be called from the request's logical zone thread.
+ *
+ * @param data_vio  The data_vio about to lock its logical block
+ *
+ * @return <code>true</code> if the request has been redirected or is waiting
+ **/
+bool __must_check divert_for_tree_handoff(struct data_vio *data_vio);
+
+/**
+ * Note that a data_vio has locked its logical block, so that the tree holding
+ * the block's mapping will not be handed to another zone until it is done.
+ *
+ * @param data_vio  The data_vio which has locked its logical block
+ **/
+void note_logical_block_locked(struct data_vio *data_vio);
+
+/**
+ * Note that a data_vio registered with note_logical_block_locked() has
+ * released its logical block.
+ *
+ * @param data_vio  The data_vio which has released its logical block
+ **/
+void note_logical_block_unlocked(struct data_vio *data_vio);
+
 /**
  * Get number of block map entries.
  *
@@ -225,6 +388,49 @@ void update_block_map_page(struct block_map_page *page,
  **/
 void get_mapped_block(struct data_vio *data_vio);
 
+/**
+ * Look up the mapping of a data_vio's logical block without going to its
+ * zone's thread, using the leaf page which the zone most recently published
+ * for the block. The mapping must be checked with is_lockless_mapping_current()
+ * after the data it points to has been read. This may be called from any
+ * thread.
+ *
+ * @param [in]  data_vio  The data_vio of the block to map
+ * @param [out] mapping   The mapping of the block
+ *
+ * @return true if a consistent mapping was found, false if the lookup must
+ *         be done on the zone's thread
+ **/
+bool __must_check lookup_lockless_mapping(struct data_vio *data_vio,
+					  struct data_location *mapping);
+
+/**
+ * Check whether a mapping found by lookup_lockless_mapping() may have changed
+ * since it was looked up. This may be called from any thread.
+ *
+ * @param data_vio  The data_vio whose mapping was looked up
+ *
+ * @return true if the mapping has not changed
+ **/
+bool __must_check is_lockless_mapping_current(struct data_vio *data_vio);
+
+/**
+ * Note that a data_vio which may change the mapping of its logical block has
+ * locked that block, so that lockless lookups will not trust the leaf page
+ * holding the mapping until it is done.
+ *
+ * @param data_vio  The data_vio which has locked its logical block
+ **/
+void begin_block_map_update(struct data_vio *data_vio);
+
+/**
+ * Note that a data_vio registered with begin_block_map_update() is done with
+ * the mapping of its logical block.
+ *
+ * @param data_vio  The data_vio which is releasing its logical block
+ **/
+void end_block_map_update(struct data_vio *data_vio);
+
 /**
  * Associate the logical block number for a block represented by a data_vio
  * with the physical block number in its new_mapped field.
@@ -236,11 +442,41 @@ void put_mapped_block(struct data_vio *data_vio);
 /**
  * Get the stats for the block map page cache.
  *
- * @param map  The block map containing the cache
+ * @param [in]  map     The block map containing the cache
+ * @param [out] totals  The block map statistics
+ **/
+void get_block_map_statistics(struct block_map *map,
+			      struct block_map_statistics *totals);
+
+/**
+ * Prepare to change the size of the block map page cache by allocating the
+ * pages each zone will need. The size is divided evenly among the zones.
+ *
+ * @param map         The block map
+ * @param cache_size  The new size of the cache, in pages
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check prepare_to_resize_block_map_cache(struct block_map *map,
+						   page_count_t cache_size);
+
+/**
+ * Resize the page cache of one block map zone to the size given to
+ * prepare_to_resize_block_map_cache(). Must be called on the zone's thread.
+ *
+ * @param zone  The zone whose cache is to be resized
+ **/
+void resize_block_map_zone_cache(struct block_map_zone *zone);
+
+/**
+ * Get the current size of the block map page cache. This may be called from
+ * any thread.
+ *
+ * @param map  The block map
  *
- * @return The block map statistics
+ * @return The number of pages in the cache
  **/
-struct block_map_statistics __must_check
-get_block_map_statistics(struct block_map *map);
+page_count_t __must_check
+get_block_map_cache_page_count(const struct block_map *map);
 
 #endif // BLOCK_MAP_H
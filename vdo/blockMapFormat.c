@@ -22,8 +22,10 @@
 #include "blockMapFormat.h"
 
 #include "buffer.h"
+#include "logger.h"
 #include "permassert.h"
 
+#include "checksum.h"
 #include "constants.h"
 #include "header.h"
 #include "numUtils.h"
@@ -39,6 +41,21 @@ const struct header BLOCK_MAP_HEADER_2_0 = {
 	.size = sizeof(struct block_map_state_2_0),
 };
 
+enum {
+	HOT_PAGE_ENCODED_SIZE =
+		sizeof(page_number_t) + sizeof(physical_block_number_t),
+};
+
+static const struct header BLOCK_MAP_HOT_SET_HEADER_1_0 = {
+	.id = BLOCK_MAP_HOT_SET,
+	.version = {
+		.major_version = 1,
+		.minor_version = 0,
+	},
+	// This is the size of an empty hot set.
+	.size = sizeof(nonce_t) + sizeof(page_count_t) + CHECKSUM_SIZE,
+};
+
 /**
  * Decode block map component state version 2.0 from a buffer.
  *
@@ -162,6 +179,135 @@ int encode_block_map_state_2_0(struct block_map_state_2_0 state,
 		      "encoded block map component size must match header size");
 }
 
+/**********************************************************************/
+int encode_block_map_hot_set(const struct block_map_hot_page *pages,
+			     page_count_t count,
+			     nonce_t nonce,
+			     struct buffer *buffer)
+{
+	struct header header = BLOCK_MAP_HOT_SET_HEADER_1_0;
+	page_count_t i;
+	crc32_checksum_t checksum;
+	const byte *start
+		= get_buffer_contents(buffer) + content_length(buffer);
+	int result = ASSERT(count <= VDO_BLOCK_MAP_HOT_SET_SIZE,
+			    "hot set of %u pages must fit in %u entries",
+			    count, VDO_BLOCK_MAP_HOT_SET_SIZE);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	header.size += (size_t) count * HOT_PAGE_ENCODED_SIZE;
+	result = encode_vdo_header(&header, buffer);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	result = put_uint64_le_into_buffer(buffer, nonce);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	result = put_uint32_le_into_buffer(buffer, count);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; i < count; i++) {
+		result = put_uint32_le_into_buffer(buffer,
+						   pages[i].page_number);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+
+		result = put_uint64_le_into_buffer(buffer, pages[i].pbn);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
+
+	checksum = update_crc32(INITIAL_CHECKSUM, start,
+				get_buffer_contents(buffer)
+				+ content_length(buffer) - start);
+	return put_uint32_le_into_buffer(buffer, checksum);
+}
+
+/**********************************************************************/
+int decode_block_map_hot_set(struct buffer *buffer,
+			     nonce_t nonce,
+			     struct block_map_hot_page *pages,
+			     page_count_t *count_ptr)
+{
+	struct header header;
+	nonce_t saved_nonce;
+	page_count_t count, i;
+	crc32_checksum_t checksum, saved_checksum;
+	const byte *start = get_buffer_contents(buffer);
+	int result;
+
+	*count_ptr = 0;
+	result = decode_vdo_header(buffer, &header);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	// Anything else, including zeroes, is simply not a hot set.
+	if ((header.id != BLOCK_MAP_HOT_SET_HEADER_1_0.id) ||
+	    !are_same_vdo_version(BLOCK_MAP_HOT_SET_HEADER_1_0.version,
+				  header.version)) {
+		return VDO_SUCCESS;
+	}
+
+	result = get_uint64_le_from_buffer(buffer, &saved_nonce);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	if (saved_nonce != nonce) {
+		return VDO_SUCCESS;
+	}
+
+	result = get_uint32_le_from_buffer(buffer, &count);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	if ((count > VDO_BLOCK_MAP_HOT_SET_SIZE) ||
+	    (header.size != (BLOCK_MAP_HOT_SET_HEADER_1_0.size
+			     + (size_t) count * HOT_PAGE_ENCODED_SIZE))) {
+		return log_error_strerror(UDS_CORRUPT_COMPONENT,
+					  "hot set of %u pages has size %zu",
+					  count, header.size);
+	}
+
+	for (i = 0; i < count; i++) {
+		result = get_uint32_le_from_buffer(buffer,
+						   &pages[i].page_number);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+
+		result = get_uint64_le_from_buffer(buffer, &pages[i].pbn);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
+
+	checksum = update_crc32(INITIAL_CHECKSUM, start,
+				get_buffer_contents(buffer) - start);
+	result = get_uint32_le_from_buffer(buffer, &saved_checksum);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	if (checksum != saved_checksum) {
+		return VDO_CHECKSUM_MISMATCH;
+	}
+
+	*count_ptr = count;
+	return VDO_SUCCESS;
+}
+
 /**********************************************************************/
 page_count_t compute_block_map_page_count(block_count_t entries)
 {
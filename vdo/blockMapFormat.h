@@ -39,6 +39,23 @@ struct boundary {
 	page_number_t levels[VDO_BLOCK_MAP_TREE_HEIGHT];
 };
 
+enum {
+	/**
+	 * The most leaf pages recorded in a hot set, which must fit in the
+	 * spare sectors of the super block block
+	 */
+	VDO_BLOCK_MAP_HOT_SET_SIZE = 256,
+};
+
+/**
+ * A leaf page which was hot in the page cache when the block map was last
+ * saved. The page number routes the page to the zone which owns its tree.
+ **/
+struct block_map_hot_page {
+	page_number_t page_number;
+	physical_block_number_t pbn;
+};
+
 extern const struct header BLOCK_MAP_HEADER_2_0;
 
 /**
@@ -100,6 +117,42 @@ int __must_check
 encode_block_map_state_2_0(struct block_map_state_2_0 state,
 			   struct buffer *buffer);
 
+/**
+ * Encode a block map hot set into a buffer. The record is checksummed and
+ * tagged with the VDO's nonce so that a torn or foreign record will be
+ * ignored when it is decoded.
+ *
+ * @param pages   The hot pages to encode
+ * @param count   The number of hot pages
+ * @param nonce   The nonce of the VDO
+ * @param buffer  The buffer to encode into
+ *
+ * @return UDS_SUCCESS or an error
+ **/
+int __must_check
+encode_block_map_hot_set(const struct block_map_hot_page *pages,
+			 page_count_t count,
+			 nonce_t nonce,
+			 struct buffer *buffer);
+
+/**
+ * Decode a block map hot set from a buffer. A buffer which does not hold a
+ * hot set, such as the zeroed spare sectors of a super block written by an
+ * older version, decodes as an empty hot set.
+ *
+ * @param [in]  buffer     A buffer positioned at the start of the encoding
+ * @param [in]  nonce      The nonce of the VDO
+ * @param [out] pages      An array of VDO_BLOCK_MAP_HOT_SET_SIZE entries to
+ *                         hold the hot pages
+ * @param [out] count_ptr  A pointer to hold the number of hot pages
+ *
+ * @return VDO_SUCCESS or an error if the hot set is corrupt
+ **/
+int __must_check decode_block_map_hot_set(struct buffer *buffer,
+					  nonce_t nonce,
+					  struct block_map_hot_page *pages,
+					  page_count_t *count_ptr);
+
 /**
  * Compute the number of pages required for a block map with the specified
  * parameters.
@@ -22,8 +22,11 @@
 #ifndef BLOCK_MAP_INTERNALS_H
 #define BLOCK_MAP_INTERNALS_H
 
+#include "atomicDefs.h"
+
 #include "adminState.h"
 #include "blockMapEntry.h"
+#include "blockMapFormat.h"
 #include "blockMapTree.h"
 #include "completion.h"
 #include "dirtyLists.h"
@@ -36,6 +39,21 @@
 /**
  * The per-zone fields used by the block map tree.
  **/
+enum {
+	/** The number of resolved leaf page paths each tree zone remembers */
+	LEAF_PATH_CACHE_SIZE = 127,
+};
+
+/**
+ * A remembered resolution of a leaf page number to the location of the page.
+ **/
+struct leaf_path {
+	/** The number of the leaf page */
+	page_number_t page_number;
+	/** The pbn of the leaf page, or VDO_ZERO_BLOCK if the path is unused */
+	physical_block_number_t pbn;
+};
+
 struct block_map_tree_zone {
 	/** The struct block_map_zone which owns this tree zone */
 	struct block_map_zone *map_zone;
@@ -57,6 +75,55 @@ struct block_map_tree_zone {
 	uint8_t oldest_generation;
 	/** The counts of dirty pages in each generation */
 	uint32_t dirty_page_counts[256];
+	/** The most recently resolved leaf page paths */
+	struct leaf_path leaf_paths[LEAF_PATH_CACHE_SIZE];
+};
+
+enum {
+	/** The number of update fences in each zone */
+	UPDATE_FENCE_COUNT = 256,
+};
+
+/**
+ * A fence which keeps lockless reads from trusting the leaf pages it covers
+ * while mappings in those pages are being changed.
+ **/
+struct update_fence {
+	/** Incremented each time an update of a covered page begins */
+	unsigned int sequence;
+	/** The number of updates of covered pages in progress */
+	unsigned int updates;
+};
+
+enum {
+	/** The number of slots in the table of tree owners, one per root */
+	ROOT_ZONE_TABLE_SIZE = 1 << (8 * sizeof(root_count_t)),
+};
+
+/**
+ * The state of a zone which is handing one of its trees to another zone.
+ **/
+struct tree_handoff {
+	/** Whether a handoff is in progress */
+	bool active;
+	/** Set while the zone is checking on the progress of the handoff */
+	bool checking;
+	/** The tree being handed off */
+	root_count_t root;
+	/** The zone which will own the tree */
+	zone_count_t target;
+	/** The requests for the tree which arrived during the handoff */
+	struct wait_queue held;
+};
+
+/**
+ * A block map zone's share of the lookups since the last era advance.
+ **/
+struct tree_utilization {
+	/** The number of lookups in the zone */
+	uint64_t lookups;
+	/** The number of lookups in each tree the zone owns */
+	uint32_t root_lookups[ROOT_ZONE_TABLE_SIZE];
 };
 
 /**
@@ -77,6 +144,42 @@ struct block_map_zone {
 	struct block_map_tree_zone tree_zone;
 	/** The administrative state of the zone */
 	struct admin_state state;
+	/** The completion which carries read-ahead requests to this zone */
+	struct vdo_completion prefetch_completion;
+	/** The page completion holding the leaf page being read ahead */
+	struct vdo_page_completion prefetch_page;
+	/** The number of the leaf page to read ahead */
+	page_number_t prefetch_page_number;
+	/** Set while a read-ahead is in progress in this zone */
+	atomic_t prefetching;
+	/** The next entry of the hot set to examine while warming the cache */
+	page_count_t warm_cursor;
+	/** The fences for lockless reads of the leaf pages of this zone */
+	struct update_fence update_fences[UPDATE_FENCE_COUNT];
+	/** The number of logical block locks held in each tree */
+	uint32_t root_locks[ROOT_ZONE_TABLE_SIZE];
+	/** The lookups in this zone since the last era advance */
+	struct tree_utilization utilization;
+	/** The lookups in this zone during the previous era */
+	uint64_t era_lookups;
+	/** The handoff of a tree to another zone, if one is in progress */
+	struct tree_handoff handoff;
+	/** The number of trees this zone has handed to other zones */
+	uint64_t tree_handoffs;
+};
+
+/**
+ * A request for a zone to hand one of its trees to a less busy zone.
+ **/
+struct handoff_request {
+	/** Whether the request is for the current era advance */
+	bool pending;
+	/** The zone which should give up a tree */
+	zone_count_t source;
+	/** The zone which should take the tree */
+	zone_count_t target;
+	/** The difference between the lookups of the two zones */
+	uint64_t excess;
 };
 
 struct block_map {
@@ -108,6 +211,45 @@ struct block_map {
 	/** The number of entries after growth */
 	block_count_t next_entry_count;
 
+	/**
+	 * How many entries before the end of a leaf page a sequential read
+	 * stream starts reading the next leaf page ahead (0 to disable)
+	 */
+	block_count_t read_ahead_window;
+
+	/**
+	 * How many dirty pages each zone writes ahead of their deadline each
+	 * time the recovery journal advances (0 to disable)
+	 */
+	block_count_t writeback_pace;
+
+	/**
+	 * The percentage of each zone's page cache which may hold compacted
+	 * copies of evicted leaf pages (0 to disable)
+	 */
+	unsigned int compact_page_share;
+
+	/**
+	 * Whether trees are moved from busy logical zones to idle ones at
+	 * era advances
+	 */
+	bool rebalance_zones;
+	/** Set while a zone is handing a tree to another zone */
+	bool handing_off;
+	/** The handoff chosen at the current era advance */
+	struct handoff_request handoff_request;
+	/** The zone which owns each tree */
+	zone_count_t root_zones[ROOT_ZONE_TABLE_SIZE];
+
+	/**
+	 * The hot set being read back into the zone caches after a load, or
+	 * the one last recorded; it is only written while every zone is
+	 * drained
+	 */
+	struct block_map_hot_page hot_set[VDO_BLOCK_MAP_HOT_SET_SIZE];
+	/** The number of pages in the hot set */
+	page_count_t hot_set_size;
+
 	/** The number of logical zones */
 	zone_count_t zone_count;
 	/** The per zone block map structure */
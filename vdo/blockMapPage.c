@@ -82,3 +82,71 @@ validate_block_map_page(struct block_map_page *page,
 
 	return BLOCK_MAP_PAGE_VALID;
 }
+
+/**
+ * Get the location which the entry after a given one must map to continue a
+ * run.
+ *
+ * @param location  The location mapped by an entry
+ *
+ * @return The location the next entry of the run maps
+ **/
+static struct data_location next_in_run(struct data_location location)
+{
+	if ((location.state == MAPPING_STATE_UNCOMPRESSED) &&
+	    (location.pbn != VDO_ZERO_BLOCK)) {
+		location.pbn++;
+	}
+
+	return location;
+}
+
+/**********************************************************************/
+slot_number_t encode_block_map_page_runs(const struct block_map_page *page,
+					 struct block_map_run *runs,
+					 slot_number_t maximum_runs)
+{
+	struct data_location next = { .pbn = VDO_ZERO_BLOCK };
+	slot_number_t run_count = 0;
+	slot_number_t slot;
+
+	for (slot = 0; slot < VDO_BLOCK_MAP_ENTRIES_PER_PAGE; slot++) {
+		struct data_location location =
+			unpack_block_map_entry(&page->entries[slot]);
+		if ((run_count > 0) && (location.pbn == next.pbn) &&
+		    (location.state == next.state)) {
+			runs[run_count - 1].length++;
+		} else if (run_count == maximum_runs) {
+			return 0;
+		} else {
+			runs[run_count++] = (struct block_map_run) {
+				.first = page->entries[slot],
+				.length = 1,
+			};
+		}
+
+		next = next_in_run(location);
+	}
+
+	return run_count;
+}
+
+/**********************************************************************/
+void decode_block_map_page_runs(struct block_map_page *page,
+				const struct block_map_run *runs,
+				slot_number_t run_count)
+{
+	slot_number_t slot = 0;
+	const struct block_map_run *run;
+
+	for (run = runs; run < runs + run_count; run++) {
+		struct data_location location =
+			unpack_block_map_entry(&run->first);
+		slot_number_t i;
+		for (i = 0; i < run->length; i++) {
+			page->entries[slot++] =
+				pack_pbn(location.pbn, location.state);
+			location = next_in_run(location);
+		}
+	}
+}
@@ -72,6 +72,18 @@ struct block_map_page {
 	struct block_map_entry entries[];
 } __packed;
 
+/**
+ * A run of block map entries, each mapping the block after the one mapped by
+ * the previous entry if the entries are uncompressed mappings, or repeating
+ * the previous entry otherwise.
+ **/
+struct block_map_run {
+	/** The first entry of the run */
+	struct block_map_entry first;
+	/** The number of entries in the run */
+	slot_number_t length;
+} __packed;
+
 enum block_map_page_validity {
 	// A block map page is correctly initialized
 	BLOCK_MAP_PAGE_VALID,
@@ -166,4 +178,30 @@ validate_block_map_page(struct block_map_page *page,
 			nonce_t nonce,
 			physical_block_number_t pbn);
 
+/**
+ * Describe the entries of a block map page as a sequence of runs.
+ *
+ * @param [in]  page          The page to describe
+ * @param [out] runs          The array to hold the runs
+ * @param [in]  maximum_runs  The number of runs the array can hold
+ *
+ * @return The number of runs describing the page, or 0 if the page needs
+ *         more than maximum_runs of them
+ **/
+slot_number_t __must_check
+encode_block_map_page_runs(const struct block_map_page *page,
+			   struct block_map_run *runs,
+			   slot_number_t maximum_runs);
+
+/**
+ * Fill in the entries of a block map page from the runs which describe them.
+ *
+ * @param page       The page whose entries are to be filled in
+ * @param runs       The runs describing the entries
+ * @param run_count  The number of runs
+ **/
+void decode_block_map_page_runs(struct block_map_page *page,
+				const struct block_map_run *runs,
+				slot_number_t run_count);
+
 #endif // BLOCK_MAP_PAGE_H
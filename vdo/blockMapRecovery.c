@@ -37,9 +37,9 @@
 
 /**
  * A completion to manage recovering the block map from the recovery journal.
- * Note that the page completions kept in this structure are not immediately
- * freed, so the corresponding pages will be locked down in the page cache
- * until the recovery frees them.
+ * The journal entries are divided among the logical zones by block map page,
+ * and each zone replays its share through its own page cache on its own
+ * thread, so that page fetches and updates proceed in all zones at once.
  **/
 struct block_map_recovery_completion {
 	/** completion header */
@@ -48,10 +48,33 @@ struct block_map_recovery_completion {
 	struct vdo_completion sub_task_completion;
 	/** the thread from which the block map may be flushed */
 	thread_id_t admin_thread;
-	/** the thread on which all block map operations must be done */
+	/** the thread on which the zone recoveries are launched and finished */
 	thread_id_t logical_thread_id;
 	/** the block map */
 	struct block_map *block_map;
+	/** the number of zone recoveries which have not yet finished */
+	zone_count_t zones_remaining;
+	/** the zone whose page cache is being invalidated */
+	zone_count_t invalidating_zone;
+	/** the number of zone recoveries */
+	zone_count_t zone_count;
+	/** the recoveries of the individual logical zones */
+	struct block_map_zone_recovery *zones[];
+};
+
+/**
+ * A completion to manage replaying the journal entries for the block map
+ * pages assigned to one logical zone. Note that the page completions kept in
+ * this structure are not immediately freed, so the corresponding pages will
+ * be locked down in the zone's page cache until the recovery frees them.
+ **/
+struct block_map_zone_recovery {
+	/** completion header */
+	struct vdo_completion completion;
+	/** the thread on which all of this zone's page operations are done */
+	thread_id_t logical_thread_id;
+	/** the page cache of the zone */
+	struct vdo_page_cache *page_cache;
 	/** whether this recovery has been aborted */
 	bool aborted;
 	/** whether we are currently launching the initial round of requests */
@@ -60,6 +83,8 @@ struct block_map_recovery_completion {
 	// Fields for the journal entries.
 	/** the journal entries to apply */
 	struct numbered_block_mapping *journal_entries;
+	/** the number of journal entries assigned to this zone */
+	block_count_t entry_count;
 	/**
 	 * a heap wrapping journal_entries. It re-orders and sorts journal
 	 * entries in ascending LBN order, then original journal order. This
@@ -150,18 +175,41 @@ as_block_map_recovery_completion(struct vdo_completion *completion)
 }
 
 /**
- * Free a block_map_recovery_completion and null out the reference to it.
+ * Convert a vdo_completion to a block_map_zone_recovery.
+ *
+ * @param completion  The completion to convert
+ *
+ * @return The completion as a block_map_zone_recovery
+ **/
+static inline struct block_map_zone_recovery * __must_check
+as_block_map_zone_recovery(struct vdo_completion *completion)
+{
+	assert_vdo_completion_type(completion->type,
+				   BLOCK_MAP_ZONE_RECOVERY_COMPLETION);
+	return container_of(completion,
+			    struct block_map_zone_recovery,
+			    completion);
+}
+
+/**
+ * Free a block_map_recovery_completion and its zone recoveries, and null out
+ * the reference to it.
  *
  * @param recovery_ptr  a pointer to the completion to free
  **/
 static void
 free_recovery_completion(struct block_map_recovery_completion **recovery_ptr)
 {
+	zone_count_t zone;
 	struct block_map_recovery_completion *recovery = *recovery_ptr;
 	if (recovery == NULL) {
 		return;
 	}
 
+	for (zone = 0; zone < recovery->zone_count; zone++) {
+		FREE(recovery->zones[zone]);
+	}
+
 	FREE(recovery);
 	*recovery_ptr = NULL;
 }
@@ -183,6 +231,125 @@ static void finish_block_map_recovery(struct vdo_completion *completion)
 	finish_vdo_completion(parent, result);
 }
 
+/**
+ * Make the recovery for one logical zone of the block map.
+ *
+ * @param [in]  vdo                The vdo
+ * @param [in]  zone               The zone to recover
+ * @param [out] zone_recovery_ptr  The new zone recovery
+ *
+ * @return a success or error code
+ **/
+static int
+make_zone_recovery(struct vdo *vdo,
+		   struct block_map_zone *zone,
+		   struct block_map_zone_recovery **zone_recovery_ptr)
+{
+	struct block_map_zone_recovery *zone_recovery;
+	page_count_t page_count =
+		min(get_vdo_page_cache_size(zone->page_cache) >> 1,
+		    (page_count_t) MAXIMUM_SIMULTANEOUS_VDO_BLOCK_MAP_RESTORATION_READS);
+	int result = ALLOCATE_EXTENDED(struct block_map_zone_recovery,
+				       page_count,
+				       struct vdo_page_completion,
+				       __func__,
+				       &zone_recovery);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	initialize_vdo_completion(&zone_recovery->completion, vdo,
+				  BLOCK_MAP_ZONE_RECOVERY_COMPLETION);
+	zone_recovery->logical_thread_id = zone->thread_id;
+	zone_recovery->page_cache = zone->page_cache;
+	zone_recovery->page_count = page_count;
+	*zone_recovery_ptr = zone_recovery;
+	return VDO_SUCCESS;
+}
+
+/**
+ * Get the logical zone which will replay the journal entries for the block
+ * map page of a journal entry. Pages are spread across the zones by PBN
+ * since the journal entries do not record which tree a page belongs to.
+ *
+ * @param entry       The journal entry
+ * @param zone_count  The number of logical zones
+ *
+ * @return The number of the zone which will replay the entry
+ **/
+static inline zone_count_t
+get_recovery_zone(const struct numbered_block_mapping *entry,
+		  zone_count_t zone_count)
+{
+	return (entry->block_map_slot.pbn % zone_count);
+}
+
+/**
+ * Partition the journal entries in place so that the entries for each zone
+ * are contiguous, and give each zone recovery its share. The order of the
+ * entries within a share doesn't matter since each zone sorts its own.
+ *
+ * @param recovery         The recovery completion
+ * @param entry_count      The number of journal entries
+ * @param journal_entries  The journal entries to partition
+ *
+ * @return a success or error code
+ **/
+static int
+partition_journal_entries(struct block_map_recovery_completion *recovery,
+			  block_count_t entry_count,
+			  struct numbered_block_mapping *journal_entries)
+{
+	zone_count_t zone;
+	block_count_t i;
+	block_count_t start = 0;
+	block_count_t *next;
+	int result = ALLOCATE(recovery->zone_count, block_count_t, __func__,
+			      &next);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; i < entry_count; i++) {
+		zone = get_recovery_zone(&journal_entries[i],
+					 recovery->zone_count);
+		recovery->zones[zone]->entry_count++;
+	}
+
+	for (zone = 0; zone < recovery->zone_count; zone++) {
+		struct block_map_zone_recovery *zone_recovery =
+			recovery->zones[zone];
+		next[zone] = start;
+		zone_recovery->journal_entries = &journal_entries[start];
+		start += zone_recovery->entry_count;
+	}
+
+	/*
+	 * Fill each zone's share in turn, swapping each entry which belongs
+	 * to a later zone into the next unfilled position of that zone's
+	 * share. Each entry is moved at most once.
+	 */
+	for (zone = 0; zone < recovery->zone_count; zone++) {
+		block_count_t end =
+			next[zone] + recovery->zones[zone]->entry_count;
+		while (next[zone] < end) {
+			zone_count_t owner =
+				get_recovery_zone(&journal_entries[next[zone]],
+						  recovery->zone_count);
+			if (owner == zone) {
+				next[zone]++;
+				continue;
+			}
+
+			swap_mappings(&journal_entries[next[zone]],
+				      &journal_entries[next[owner]++]);
+		}
+	}
+
+	FREE(next);
+	return VDO_SUCCESS;
+}
+
 /**
  * Make a new block map recovery completion.
  *
@@ -203,14 +370,12 @@ make_recovery_completion(struct vdo *vdo,
 {
 	const struct thread_config *thread_config = get_thread_config(vdo);
 	struct block_map *block_map = get_block_map(vdo);
-	page_count_t page_count =
-		min(get_configured_cache_size(vdo) >> 1,
-		    (page_count_t) MAXIMUM_SIMULTANEOUS_VDO_BLOCK_MAP_RESTORATION_READS);
+	zone_count_t zone;
 
 	struct block_map_recovery_completion *recovery;
 	int result = ALLOCATE_EXTENDED(struct block_map_recovery_completion,
-				       page_count,
-				       struct vdo_page_completion,
+				       block_map->zone_count,
+				       struct block_map_zone_recovery *,
 				       __func__,
 				       &recovery);
 	if (result != UDS_SUCCESS) {
@@ -222,23 +387,47 @@ make_recovery_completion(struct vdo *vdo,
 	initialize_vdo_completion(&recovery->sub_task_completion, vdo,
 				  SUB_TASK_COMPLETION);
 	recovery->block_map = block_map;
-	recovery->journal_entries = journal_entries;
-	recovery->page_count = page_count;
-	recovery->current_entry = &recovery->journal_entries[entry_count - 1];
-
+	recovery->zone_count = block_map->zone_count;
 	recovery->admin_thread = get_admin_thread(thread_config);
 	recovery->logical_thread_id = get_logical_zone_thread(thread_config, 0);
 
-	// Organize the journal entries into a binary heap so we can iterate
-	// over them in sorted order incrementally, avoiding an expensive sort
-	// call.
-	initialize_heap(&recovery->replay_heap,
-			compare_mappings,
-			swap_mappings,
-			journal_entries,
-			entry_count,
-			sizeof(struct numbered_block_mapping));
-	build_heap(&recovery->replay_heap, entry_count);
+	for (zone = 0; zone < recovery->zone_count; zone++) {
+		result = make_zone_recovery(vdo, &block_map->zones[zone],
+					    &recovery->zones[zone]);
+		if (result != VDO_SUCCESS) {
+			free_recovery_completion(&recovery);
+			return result;
+		}
+	}
+
+	result = partition_journal_entries(recovery, entry_count,
+					   journal_entries);
+	if (result != VDO_SUCCESS) {
+		free_recovery_completion(&recovery);
+		return result;
+	}
+
+	for (zone = 0; zone < recovery->zone_count; zone++) {
+		struct block_map_zone_recovery *zone_recovery =
+			recovery->zones[zone];
+		block_count_t count = zone_recovery->entry_count;
+		if (count > 0) {
+			zone_recovery->current_entry =
+				&zone_recovery->journal_entries[count - 1];
+		}
+
+		// Organize the journal entries into a binary heap so we can
+		// iterate over them in sorted order incrementally, avoiding an
+		// expensive sort call.
+		initialize_heap(&zone_recovery->replay_heap,
+				compare_mappings,
+				swap_mappings,
+				zone_recovery->journal_entries,
+				zone_recovery->entry_count,
+				sizeof(struct numbered_block_mapping));
+		build_heap(&zone_recovery->replay_heap,
+			   zone_recovery->entry_count);
+	}
 
 	ASSERT_LOG_ONLY((get_callback_thread_id() ==
 			 recovery->logical_thread_id),
@@ -253,13 +442,42 @@ make_recovery_completion(struct vdo *vdo,
 			       parent);
 
 	// This message must be recognizable by VDOTest::RebuildBase.
-	log_info("Replaying %zu recovery entries into block map",
-		 recovery->replay_heap.count);
+	log_info("Replaying %llu recovery entries into block map",
+		 entry_count);
 
 	*recovery_ptr = recovery;
 	return VDO_SUCCESS;
 }
 
+/**
+ * Drop any pages cached by the recovery once the block map has been flushed.
+ * Every recovered page is clean by now, but a zone may hold pages of trees
+ * it does not own, and a zone only evicts the pages of trees it hands off,
+ * so a stale copy could otherwise be found if such a tree later moves to it.
+ * This callback is registered in flush_block_map(), and then re-registers
+ * itself for each subsequent zone.
+ *
+ * @param completion  The sub-task completion
+ **/
+static void invalidate_page_caches(struct vdo_completion *completion)
+{
+	struct block_map_recovery_completion *recovery =
+		as_block_map_recovery_completion(completion->parent);
+	struct block_map_zone_recovery *zone_recovery =
+		recovery->zones[recovery->invalidating_zone++];
+	int result = invalidate_vdo_page_cache(zone_recovery->page_cache);
+	if ((result != VDO_SUCCESS) ||
+	    (recovery->invalidating_zone == recovery->zone_count)) {
+		finish_vdo_completion(&recovery->completion, result);
+		return;
+	}
+
+	zone_recovery = recovery->zones[recovery->invalidating_zone];
+	launch_vdo_completion_callback(completion,
+				       invalidate_page_caches,
+				       zone_recovery->logical_thread_id);
+}
+
 /**********************************************************************/
 static void flush_block_map(struct vdo_completion *completion)
 {
@@ -270,22 +488,54 @@ static void flush_block_map(struct vdo_completion *completion)
 			 recovery->admin_thread),
 			"flush_block_map() called on admin thread");
 
-	prepare_vdo_completion_to_finish_parent(completion, completion->parent);
+	recovery->invalidating_zone = 0;
+	prepare_vdo_completion(completion,
+			       invalidate_page_caches,
+			       finish_vdo_completion_parent_callback,
+			       recovery->zones[0]->logical_thread_id,
+			       completion->parent);
 	drain_block_map(recovery->block_map,
 			ADMIN_STATE_RECOVERING,
 			completion);
 }
 
 /**
- * Check whether the recovery is done. If so, finish it by either flushing the
- * block map (if the recovery was successful), or by cleaning up (if it
- * wasn't).
+ * Note that a zone has finished its share of the recovery. Once all zones
+ * have finished, flush the block map if they all succeeded, or finish the
+ * recovery if any of them didn't. This callback is registered in
+ * launch_zone_recovery().
  *
- * @param recovery  The recovery completion
+ * @param completion  The block_map_zone_recovery which has finished
+ **/
+static void finish_zone_recovery(struct vdo_completion *completion)
+{
+	struct block_map_recovery_completion *recovery =
+		as_block_map_recovery_completion(completion->parent);
+	set_vdo_completion_result(&recovery->completion, completion->result);
+	if (--recovery->zones_remaining > 0) {
+		return;
+	}
+
+	if (recovery->completion.result != VDO_SUCCESS) {
+		complete_vdo_completion(&recovery->completion);
+		return;
+	}
+
+	launch_vdo_completion_callback_with_parent(&recovery->sub_task_completion,
+						   flush_block_map,
+						   recovery->admin_thread,
+						   &recovery->completion);
+}
+
+/**
+ * Check whether a zone's recovery is done. If so, report to the parent
+ * recovery, first cleaning up if the zone's recovery wasn't successful.
  *
- * @return <code>true</code> if the recovery or recovery is complete
+ * @param recovery  The zone recovery
+ *
+ * @return <code>true</code> if the zone's recovery is complete
  **/
-static bool finish_if_done(struct block_map_recovery_completion *recovery)
+static bool finish_if_done(struct block_map_zone_recovery *recovery)
 {
 	// Pages are still being launched or there is still work to do
 	if (recovery->launching || (recovery->outstanding > 0) ||
@@ -308,14 +558,9 @@ static bool finish_if_done(struct block_map_recovery_completion *recovery)
 				release_vdo_page_completion(&page_completion->completion);
 			}
 		}
-		complete_vdo_completion(&recovery->completion);
-	} else {
-		launch_vdo_completion_callback_with_parent(&recovery->sub_task_completion,
-							   flush_block_map,
-							   recovery->admin_thread,
-							   &recovery->completion);
 	}
 
+	complete_vdo_completion(&recovery->completion);
 	return true;
 }
 
@@ -323,10 +568,10 @@ static bool finish_if_done(struct block_map_recovery_completion *recovery)
  * Note that there has been an error during the recovery and finish it if there
  * is nothing else outstanding.
  *
- * @param recovery  The block_map_recovery_completion
+ * @param recovery  The block_map_zone_recovery
  * @param result    The error result to use, if one is not already saved
  **/
-static void abort_recovery(struct block_map_recovery_completion *recovery,
+static void abort_recovery(struct block_map_zone_recovery *recovery,
 			   int result)
 {
 	recovery->aborted = true;
@@ -338,7 +583,7 @@ static void abort_recovery(struct block_map_recovery_completion *recovery,
  * Find the first journal entry after a given entry which is not on the same
  * block map page.
  *
- * @param recovery       the block_map_recovery_completion
+ * @param recovery       the block_map_zone_recovery
  * @param current_entry  the entry to search from
  * @param needs_sort     Whether sorting is needed to proceed
  *
@@ -347,7 +592,7 @@ static void abort_recovery(struct block_map_recovery_completion *recovery,
  *         subsequent entry is on a different block map page.
  **/
 static struct numbered_block_mapping *
-find_entry_starting_next_page(struct block_map_recovery_completion *recovery,
+find_entry_starting_next_page(struct block_map_zone_recovery *recovery,
 			      struct numbered_block_mapping *current_entry,
 			      bool needs_sort)
 {
@@ -394,7 +639,7 @@ apply_journal_entries_to_page(struct block_map_page *page,
 }
 
 /**********************************************************************/
-static void recover_ready_pages(struct block_map_recovery_completion *recovery,
+static void recover_ready_pages(struct block_map_zone_recovery *recovery,
 				struct vdo_completion *completion);
 
 /**
@@ -405,8 +650,8 @@ static void recover_ready_pages(struct block_map_recovery_completion *recovery,
  **/
 static void page_loaded(struct vdo_completion *completion)
 {
-	struct block_map_recovery_completion *recovery =
-		as_block_map_recovery_completion(completion->parent);
+	struct block_map_zone_recovery *recovery =
+		as_block_map_zone_recovery(completion->parent);
 	recovery->outstanding--;
 	if (!recovery->launching) {
 		recover_ready_pages(recovery, completion);
@@ -420,8 +665,8 @@ static void page_loaded(struct vdo_completion *completion)
  **/
 static void handle_page_load_error(struct vdo_completion *completion)
 {
-	struct block_map_recovery_completion *recovery =
-		as_block_map_recovery_completion(completion->parent);
+	struct block_map_zone_recovery *recovery =
+		as_block_map_zone_recovery(completion->parent);
 	recovery->outstanding--;
 	abort_recovery(recovery, completion->result);
 }
@@ -429,10 +674,10 @@ static void handle_page_load_error(struct vdo_completion *completion)
 /**
  * Fetch a page from the block map.
  *
- * @param recovery    the block_map_recovery_completion
+ * @param recovery    the block_map_zone_recovery
  * @param completion  the page completion to use
  **/
-static void fetch_page(struct block_map_recovery_completion *recovery,
+static void fetch_page(struct block_map_zone_recovery *recovery,
 		       struct vdo_completion *completion)
 {
 	physical_block_number_t new_pbn;
@@ -448,7 +693,7 @@ static void fetch_page(struct block_map_recovery_completion *recovery,
 					      recovery->current_unfetched_entry,
 					      true);
 	init_vdo_page_completion(((struct vdo_page_completion *) completion),
-				 recovery->block_map->zones[0].page_cache,
+				 recovery->page_cache,
 				 new_pbn,
 				 true,
 				 &recovery->completion,
@@ -462,13 +707,13 @@ static void fetch_page(struct block_map_recovery_completion *recovery,
  * Get the next page completion to process. If it isn't ready, we'll try again
  * when it is.
  *
- * @param recovery    The recovery completion
+ * @param recovery    The zone recovery
  * @param completion  The current page completion
  *
  * @return The next page completion to process
  **/
 static struct vdo_page_completion *
-get_next_page_completion(struct block_map_recovery_completion *recovery,
+get_next_page_completion(struct block_map_zone_recovery *recovery,
 			 struct vdo_page_completion *completion)
 {
 	completion++;
@@ -481,10 +726,10 @@ get_next_page_completion(struct block_map_recovery_completion *recovery,
 /**
  * Recover from as many pages as possible.
  *
- * @param recovery    The recovery completion
+ * @param recovery    The zone recovery
  * @param completion  The first page completion to process
  **/
-static void recover_ready_pages(struct block_map_recovery_completion *recovery,
+static void recover_ready_pages(struct block_map_zone_recovery *recovery,
 				struct vdo_completion *completion)
 {
 	struct vdo_page_completion *page_completion =
@@ -531,26 +776,28 @@ static void recover_ready_pages(struct block_map_recovery_completion *recovery,
 	}
 }
 
-/**********************************************************************/
-void recover_block_map(struct vdo *vdo,
-		       block_count_t entry_count,
-		       struct numbered_block_mapping *journal_entries,
-		       struct vdo_completion *parent)
+/**
+ * Begin replaying a zone's share of the journal entries. This callback is
+ * registered in recover_block_map().
+ *
+ * @param completion  The block_map_zone_recovery
+ **/
+static void launch_zone_recovery(struct vdo_completion *completion)
 {
 	struct numbered_block_mapping *first_sorted_entry;
 	page_count_t i;
-	struct block_map_recovery_completion *recovery;
-
-	int result = make_recovery_completion(vdo, entry_count,
-					      journal_entries, parent,
-					      &recovery);
-	if (result != VDO_SUCCESS) {
-		finish_vdo_completion(parent, result);
-		return;
-	}
+	struct block_map_zone_recovery *recovery =
+		as_block_map_zone_recovery(completion);
+	struct block_map_recovery_completion *parent =
+		as_block_map_recovery_completion(completion->parent);
 
+	prepare_vdo_completion(completion,
+			       finish_zone_recovery,
+			       finish_zone_recovery,
+			       parent->logical_thread_id,
+			       &parent->completion);
 	if (is_heap_empty(&recovery->replay_heap)) {
-		finish_vdo_completion(&recovery->completion, VDO_SUCCESS);
+		complete_vdo_completion(completion);
 		return;
 	}
 
@@ -576,3 +823,40 @@ void recover_block_map(struct vdo *vdo,
 	// Process any ready pages.
 	recover_ready_pages(recovery, &recovery->page_completions[0].completion);
 }
+
+/**********************************************************************/
+void recover_block_map(struct vdo *vdo,
+		       block_count_t entry_count,
+		       struct numbered_block_mapping *journal_entries,
+		       struct vdo_completion *parent)
+{
+	zone_count_t zone;
+	struct block_map_recovery_completion *recovery;
+
+	int result = make_recovery_completion(vdo, entry_count,
+					      journal_entries, parent,
+					      &recovery);
+	if (result != VDO_SUCCESS) {
+		finish_vdo_completion(parent, result);
+		return;
+	}
+
+	if (entry_count == 0) {
+		finish_vdo_completion(&recovery->completion, VDO_SUCCESS);
+		return;
+	}
+
+	// Each zone recovery is enqueued rather than invoked so that none of
+	// them can finish the whole recovery while they are still launching.
+	recovery->zones_remaining = recovery->zone_count;
+	for (zone = 0; zone < recovery->zone_count; zone++) {
+		struct block_map_zone_recovery *zone_recovery =
+			recovery->zones[zone];
+		prepare_vdo_completion(&zone_recovery->completion,
+				       launch_zone_recovery,
+				       finish_zone_recovery,
+				       zone_recovery->logical_thread_id,
+				       &recovery->completion);
+		enqueue_vdo_completion(&zone_recovery->completion);
+	}
+}
@@ -619,6 +619,13 @@ static void write_dirty_pages_callback(struct list_head *expired, void *context)
 	}
 }
 
+/**********************************************************************/
+void set_zone_tree_writeback_pace(struct block_map_tree_zone *zone,
+				  block_count_t pace)
+{
+	set_dirty_lists_pace(zone->dirty_lists, pace);
+}
+
 /**********************************************************************/
 void advance_zone_tree_period(struct block_map_tree_zone *zone,
 			      sequence_number_t period)
@@ -626,16 +633,60 @@ void advance_zone_tree_period(struct block_map_tree_zone *zone,
 	advance_period(zone->dirty_lists, period);
 }
 
+/**
+ * Forget all the remembered leaf page paths of a tree zone.
+ *
+ * @param zone  The tree zone
+ **/
+static void forget_leaf_paths(struct block_map_tree_zone *zone)
+{
+	memset(zone->leaf_paths, 0, sizeof(zone->leaf_paths));
+}
+
 /**********************************************************************/
 void drain_zone_trees(struct block_map_tree_zone *zone)
 {
 	ASSERT_LOG_ONLY((zone->active_lookups == 0),
 			"drain_zone_trees() called with no active lookups");
+	// The tree may be rebuilt or replaced before the zone resumes.
+	forget_leaf_paths(zone);
 	if (!is_vdo_state_suspending(&zone->map_zone->state)) {
 		flush_dirty_lists(zone->dirty_lists);
 	}
 }
 
+/**********************************************************************/
+bool flush_tree_page(struct block_map_tree_zone *zone, struct tree_page *page)
+{
+	if (page->writing || is_waiting(&page->waiter)) {
+		return false;
+	}
+
+	if (page->recovery_lock == 0) {
+		return true;
+	}
+
+	// The page is on the dirty lists, so treat it as though it expired.
+	list_del_init(&page->entry);
+	set_generation(zone, page, zone->generation, false);
+	enqueue_page(page, zone);
+	return false;
+}
+
+/**
+ * Get the remembered path slot for a leaf page.
+ *
+ * @param zone         The tree zone
+ * @param page_number  The number of the leaf page
+ *
+ * @return The slot which remembers the path to the page, if any path does
+ **/
+static inline struct leaf_path *
+get_leaf_path(struct block_map_tree_zone *zone, page_number_t page_number)
+{
+	return &zone->leaf_paths[page_number % LEAF_PATH_CACHE_SIZE];
+}
+
 /**
  * Release a lock on a page which was being loaded or allocated.
  *
@@ -669,11 +720,21 @@ static void finish_lookup(struct data_vio *data_vio, int result)
 {
 	struct block_map_tree_zone *zone;
 	struct vdo_completion *completion = data_vio_as_completion(data_vio);
+	struct block_map_tree_slot *leaf = &data_vio->tree_lock.tree_slots[0];
 	data_vio->tree_lock.height = 0;
 
 	zone = get_block_map_tree_zone(data_vio);
 	--zone->active_lookups;
 
+	// Once allocated, a leaf page never moves, so its path can be reused.
+	if ((result == VDO_SUCCESS) &&
+	    (leaf->block_map_slot.pbn != VDO_ZERO_BLOCK)) {
+		*get_leaf_path(zone, leaf->page_index) = (struct leaf_path) {
+			.page_number = leaf->page_index,
+			.pbn = leaf->block_map_slot.pbn,
+		};
+	}
+
 	set_vdo_completion_result(completion, result);
 	launch_vdo_completion_callback(completion,
 				       data_vio->tree_lock.callback,
@@ -1246,6 +1307,7 @@ void lookup_block_map_pbn(struct data_vio *data_vio)
 	struct block_map_tree_slot tree_slot;
 	struct data_location mapping;
 
+	struct leaf_path *path;
 	struct block_map_page *page = NULL;
 	struct tree_lock *lock = &data_vio->tree_lock;
 	struct block_map_tree_zone *zone = get_block_map_tree_zone(data_vio);
@@ -1255,6 +1317,16 @@ void lookup_block_map_pbn(struct data_vio *data_vio)
 		return;
 	}
 
+	// The interior pages are always resident once loaded, but a recently
+	// resolved leaf page need not be looked up in them at all.
+	path = get_leaf_path(zone, lock->tree_slots[0].page_index);
+	if ((path->pbn != VDO_ZERO_BLOCK) &&
+	    (path->page_number == lock->tree_slots[0].page_index)) {
+		lock->tree_slots[0].block_map_slot.pbn = path->pbn;
+		finish_lookup(data_vio, VDO_SUCCESS);
+		return;
+	}
+
 	page_index = (lock->tree_slots[0].page_index /
 		      zone->map_zone->block_map->root_count);
 	tree_slot = (struct block_map_tree_slot) {
@@ -1342,6 +1414,55 @@ physical_block_number_t find_block_map_page_pbn(struct block_map *map,
 	return mapping.pbn;
 }
 
+/**
+ * Get the height one tree page which maps a leaf page.
+ *
+ * @param [in]  map          The block map containing the forest
+ * @param [in]  page_number  The page number of the leaf page
+ * @param [out] slot         The slot of the leaf page in the tree page
+ *
+ * @return The tree page which maps the leaf page
+ **/
+static struct tree_page *get_leaf_parent(struct block_map *map,
+					 page_number_t page_number,
+					 slot_number_t *slot)
+{
+	root_count_t root_index = page_number % map->root_count;
+	page_number_t page_index = page_number / map->root_count;
+
+	*slot = page_index % VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
+	page_index /= VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
+	return get_vdo_tree_page_by_index(map->forest, root_index, 1,
+					  page_index);
+}
+
+/**********************************************************************/
+bool is_block_map_leaf_known_empty(struct block_map *map,
+				   page_number_t page_number)
+{
+	slot_number_t slot;
+	struct tree_page *tree_page =
+		get_leaf_parent(map, page_number, &slot);
+
+	return test_bit(slot, tree_page->empty_leaves);
+}
+
+/**********************************************************************/
+void set_block_map_leaf_known_empty(struct block_map *map,
+				    page_number_t page_number,
+				    bool empty)
+{
+	slot_number_t slot;
+	struct tree_page *tree_page =
+		get_leaf_parent(map, page_number, &slot);
+
+	if (empty) {
+		__set_bit(slot, tree_page->empty_leaves);
+	} else {
+		__clear_bit(slot, tree_page->empty_leaves);
+	}
+}
+
 /**********************************************************************/
 void write_tree_page(struct tree_page *page, struct block_map_tree_zone *zone)
 {
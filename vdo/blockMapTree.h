@@ -67,6 +67,17 @@ void set_tree_zone_initial_period(struct block_map_tree_zone *tree_zone,
  **/
 bool __must_check is_tree_zone_active(struct block_map_tree_zone *zone);
 
+/**
+ * Set how many dirty tree pages a tree zone writes out ahead of their
+ * deadline each time its dirty period advances.
+ *
+ * @param zone  The block_map_tree_zone
+ * @param pace  The number of pages, or 0 to write pages only when they
+ *              reach the maximum age
+ **/
+void set_zone_tree_writeback_pace(struct block_map_tree_zone *zone,
+				  block_count_t pace);
+
 /**
  * Advance the dirty period for a tree zone.
  *
@@ -85,6 +96,17 @@ void advance_zone_tree_period(struct block_map_tree_zone *zone,
  **/
 void drain_zone_trees(struct block_map_tree_zone *zone);
 
+/**
+ * Write out a tree page now if it is dirty, rather than waiting for it to
+ * expire.
+ *
+ * @param zone  The tree zone whose dirty lists hold the page
+ * @param page  The page to write
+ *
+ * @return <code>true</code> if the page is clean and not being written
+ **/
+bool flush_tree_page(struct block_map_tree_zone *zone, struct tree_page *page);
+
 /**
  * Look up the PBN of the block map page for a data_vio's LBN in the arboreal
  * block map. If necessary, the block map page will be allocated. Also, the
@@ -107,6 +129,35 @@ void lookup_block_map_pbn(struct data_vio *data_vio);
 physical_block_number_t find_block_map_page_pbn(struct block_map *map,
 						page_number_t page_number);
 
+/**
+ * Check whether an allocated leaf block map page is known to hold no
+ * mappings, so that its entries may be treated as unmapped without fetching
+ * it. This method may only be called from the thread of the zone which owns
+ * the tree containing the page.
+ *
+ * @param map          The block map containing the forest
+ * @param page_number  The page number of the leaf page
+ *
+ * @return <code>true</code> if every entry of the page is unmapped
+ **/
+bool __must_check
+is_block_map_leaf_known_empty(struct block_map *map,
+			      page_number_t page_number);
+
+/**
+ * Record whether an allocated leaf block map page holds no mappings. The
+ * record is not persistent; a page which is not known to be empty must be
+ * fetched to find out. This method may only be called from the thread of the
+ * zone which owns the tree containing the page.
+ *
+ * @param map          The block map containing the forest
+ * @param page_number  The page number of the leaf page
+ * @param empty        Whether every entry of the page is unmapped
+ **/
+void set_block_map_leaf_known_empty(struct block_map *map,
+				    page_number_t page_number,
+				    bool empty);
+
 /**
  * Write a tree page or indicate that it has been re-dirtied if it is already
  * being written. This method is used when correcting errors in the tree during
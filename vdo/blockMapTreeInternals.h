@@ -62,6 +62,12 @@ struct tree_page {
 	 */
 	sequence_number_t writing_recovery_lock;
 
+	/**
+	 * For a height one page, a bit for each leaf page it maps which is
+	 * known to hold no mappings
+	 */
+	unsigned long empty_leaves[BITS_TO_LONGS(VDO_BLOCK_MAP_ENTRIES_PER_PAGE)];
+
 	/** The buffer to hold the on-disk representation of this page */
 	char page_buffer[VDO_BLOCK_SIZE];
 };
@@ -22,6 +22,7 @@
 #include "bufferPool.h"
 
 #include <linux/delay.h>
+#include <linux/percpu.h>
 #include <linux/sort.h>
 
 #include "logger.h"
@@ -45,6 +46,25 @@ struct buffer_element {
 	void *data;		// element data, if on free list
 };
 
+enum {
+	/** The most free buffers a CPU keeps for itself */
+	BUFFER_CACHE_SIZE = 16,
+	/** How many buffers move between a CPU's cache and the pool at once */
+	BUFFER_CACHE_BATCH = BUFFER_CACHE_SIZE / 2,
+};
+
+/*
+ * A per-CPU cache of free buffers, so that most allocations and frees touch
+ * only the current CPU's cache line and uncontended lock rather than the
+ * pool's. Buffers in a cache count as busy as far as the pool is concerned.
+ * The pool lock, when also needed, is always taken first.
+ */
+struct buffer_cache {
+	spinlock_t lock;
+	unsigned int count;
+	void *objects[BUFFER_CACHE_SIZE];
+};
+
 struct buffer_pool {
 	const char *name; // Pool name
 	spinlock_t lock; // Locks this object
@@ -58,8 +78,45 @@ struct buffer_pool {
 	buffer_dump_function *dump; // Dump function for buffer data
 	struct buffer_element *bhead; // Array of buffer_element
 	void **objects;
+	struct buffer_cache __percpu *caches; // Per-CPU free buffer caches
 };
 
+/*************************************************************************/
+static bool free_buffer_to_pool_internal(struct buffer_pool *pool, void *data);
+
+/**
+ * Return all the buffers in a CPU's cache to the pool. The pool lock must be
+ * held.
+ *
+ * @param pool   The pool
+ * @param cache  The cache to empty
+ **/
+static void drain_buffer_cache(struct buffer_pool *pool,
+			       struct buffer_cache *cache)
+{
+	spin_lock(&cache->lock);
+	while (cache->count > 0) {
+		free_buffer_to_pool_internal(pool,
+					     cache->objects[--cache->count]);
+	}
+	spin_unlock(&cache->lock);
+}
+
+/**
+ * Return the buffers in every CPU's cache to the pool, so that the pool's
+ * counts and free list are exact. The pool lock must be held.
+ *
+ * @param pool  The pool
+ **/
+static void drain_buffer_caches(struct buffer_pool *pool)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		drain_buffer_cache(pool, per_cpu_ptr(pool->caches, cpu));
+	}
+}
+
 /*************************************************************************/
 int make_buffer_pool(const char *pool_name,
 		     unsigned int size,
@@ -70,7 +127,7 @@ int make_buffer_pool(const char *pool_name,
 {
 	struct buffer_pool *pool;
 	struct buffer_element *bh;
-	int i;
+	int i, cpu;
 
 	int result = ALLOCATE(1, struct buffer_pool, "buffer pool", &pool);
 
@@ -96,6 +153,17 @@ int make_buffer_pool(const char *pool_name,
 		return result;
 	}
 
+	pool->caches = alloc_percpu(struct buffer_cache);
+	if (pool->caches == NULL) {
+		uds_log_error("buffer cache allocation failure");
+		free_buffer_pool(&pool);
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		spin_lock_init(&per_cpu_ptr(pool->caches, cpu)->lock);
+	}
+
 	pool->name = pool_name;
 	pool->alloc = allocate_function;
 	pool->free = free_function;
@@ -133,6 +201,13 @@ void free_buffer_pool(struct buffer_pool **pool_ptr)
 		return;
 	}
 
+	if (pool->caches != NULL) {
+		spin_lock(&pool->lock);
+		drain_buffer_caches(pool);
+		spin_unlock(&pool->lock);
+		free_percpu(pool->caches);
+	}
+
 	ASSERT_LOG_ONLY((pool->num_busy == 0),
 			"freeing busy buffer pool, num_busy=%d",
 			pool->num_busy);
@@ -179,6 +254,7 @@ void dump_buffer_pool(struct buffer_pool *pool, bool dump_elements)
 		return;
 	}
 	spin_lock(&pool->lock);
+	drain_buffer_caches(pool);
 	log_info("%s: %u of %u busy (max %u)", pool->name, pool->num_busy,
 		 pool->size, pool->max_busy);
 	if (dump_elements && (pool->dump != NULL)) {
@@ -200,19 +276,19 @@ void dump_buffer_pool(struct buffer_pool *pool, bool dump_elements)
 	spin_unlock(&pool->lock);
 }
 
-/*************************************************************************/
-int alloc_buffer_from_pool(struct buffer_pool *pool, void **data_ptr)
+/**
+ * Take a buffer from the pool's free list. The pool lock must be held.
+ *
+ * @param pool  The pool
+ *
+ * @return The buffer, or NULL if the free list is empty
+ **/
+static void *take_buffer_from_pool(struct buffer_pool *pool)
 {
 	struct buffer_element *bh;
-	if (pool == NULL) {
-		return UDS_INVALID_ARGUMENT;
-	}
 
-	spin_lock(&pool->lock);
 	if (unlikely(list_empty(&pool->free_object_list))) {
-		spin_unlock(&pool->lock);
-		uds_log_debug("no free buffers");
-		return -ENOMEM;
+		return NULL;
 	}
 
 	bh = list_first_entry(&pool->free_object_list,
@@ -222,8 +298,94 @@ int alloc_buffer_from_pool(struct buffer_pool *pool, void **data_ptr)
 	if (pool->num_busy > pool->max_busy) {
 		pool->max_busy = pool->num_busy;
 	}
-	*data_ptr = bh->data;
+	return bh->data;
+}
+
+/**
+ * Take a buffer from another CPU's cache, for when the pool itself has run
+ * out. The pool lock must be held.
+ *
+ * @param pool  The pool
+ *
+ * @return The buffer, or NULL if every cache is empty
+ **/
+static void *steal_cached_buffer(struct buffer_pool *pool)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct buffer_cache *cache = per_cpu_ptr(pool->caches, cpu);
+		void *data = NULL;
+
+		spin_lock(&cache->lock);
+		if (cache->count > 0) {
+			data = cache->objects[--cache->count];
+		}
+		spin_unlock(&cache->lock);
+
+		if (data != NULL) {
+			return data;
+		}
+	}
+
+	return NULL;
+}
+
+/*************************************************************************/
+int alloc_buffer_from_pool(struct buffer_pool *pool, void **data_ptr)
+{
+	struct buffer_cache *cache;
+	void *data = NULL;
+	unsigned int i;
+
+	if (pool == NULL) {
+		return UDS_INVALID_ARGUMENT;
+	}
+
+	cache = get_cpu_ptr(pool->caches);
+	spin_lock(&cache->lock);
+	if (likely(cache->count > 0)) {
+		data = cache->objects[--cache->count];
+	}
+	spin_unlock(&cache->lock);
+	put_cpu_ptr(pool->caches);
+	if (likely(data != NULL)) {
+		*data_ptr = data;
+		return VDO_SUCCESS;
+	}
+
+	// Take a buffer from the pool, and a batch more for this CPU's cache.
+	spin_lock(&pool->lock);
+	data = take_buffer_from_pool(pool);
+	if (data == NULL) {
+		data = steal_cached_buffer(pool);
+	} else {
+		cache = this_cpu_ptr(pool->caches);
+		spin_lock(&cache->lock);
+		for (i = 0; i < BUFFER_CACHE_BATCH; i++) {
+			void *extra;
+
+			if (cache->count == BUFFER_CACHE_SIZE) {
+				break;
+			}
+
+			extra = take_buffer_from_pool(pool);
+			if (extra == NULL) {
+				break;
+			}
+
+			cache->objects[cache->count++] = extra;
+		}
+		spin_unlock(&cache->lock);
+	}
 	spin_unlock(&pool->lock);
+
+	if (unlikely(data == NULL)) {
+		uds_log_debug("no free buffers");
+		return -ENOMEM;
+	}
+
+	*data_ptr = data;
 	return VDO_SUCCESS;
 }
 
@@ -245,26 +407,44 @@ static bool free_buffer_to_pool_internal(struct buffer_pool *pool, void *data)
 /*************************************************************************/
 void free_buffer_to_pool(struct buffer_pool *pool, void *data)
 {
-	bool success;
-	spin_lock(&pool->lock);
-	success = free_buffer_to_pool_internal(pool, data);
-
-	spin_unlock(&pool->lock);
-	if (!success) {
-		uds_log_debug("trying to add to free list when already full");
-	}
+	free_buffers_to_pool(pool, &data, 1);
 }
 
 /*************************************************************************/
 void free_buffers_to_pool(struct buffer_pool *pool, void **data, int count)
 {
+	struct buffer_cache *cache;
 	bool success = true;
-	int i;
-	spin_lock(&pool->lock);
+	int i = 0;
 
-	for (i = 0; (i < count) && success; i++) {
+	// Put as many as fit in this CPU's cache.
+	cache = get_cpu_ptr(pool->caches);
+	spin_lock(&cache->lock);
+	while ((i < count) && (cache->count < BUFFER_CACHE_SIZE)) {
+		cache->objects[cache->count++] = data[i++];
+	}
+	spin_unlock(&cache->lock);
+	put_cpu_ptr(pool->caches);
+	if (likely(i == count)) {
+		return;
+	}
+
+	// Return the rest to the pool, along with a batch from the cache to
+	// leave room for later frees.
+	spin_lock(&pool->lock);
+	for (; (i < count) && success; i++) {
 		success = free_buffer_to_pool_internal(pool, data[i]);
 	}
+
+	cache = this_cpu_ptr(pool->caches);
+	spin_lock(&cache->lock);
+	while (success && (cache->count > BUFFER_CACHE_SIZE -
+			   BUFFER_CACHE_BATCH)) {
+		success = free_buffer_to_pool_internal(pool,
+						       cache->objects[--cache
+								      ->count]);
+	}
+	spin_unlock(&cache->lock);
 	spin_unlock(&pool->lock);
 	if (!success) {
 		uds_log_debug("trying to add to free list when already full");
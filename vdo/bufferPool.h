@@ -81,7 +81,9 @@ void dump_buffer_pool(struct buffer_pool *pool, bool dump_elements);
 
 /**
  * Acquires a free buffer from the free list of the pool and
- * returns it's associated data.
+ * returns it's associated data. Buffers are taken from a cache local to
+ * the current CPU when possible, so the pool lock is only needed to refill
+ * that cache.
  *
  * @param [in]  pool      The buffer pool to allocate from
  * @param [out] data_ptr   A pointer to hold the buffer data
@@ -92,7 +94,8 @@ int __must_check
 alloc_buffer_from_pool(struct buffer_pool *pool, void **data_ptr);
 
 /**
- * Returns a buffer to the free list of a pool
+ * Returns a buffer to the free list of a pool, by way of the current
+ * CPU's cache of free buffers
  *
  * @param [in] pool   The buffer pool to return the buffer to
  * @param [in] data   The buffer data to return
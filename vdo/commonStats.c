@@ -19,14 +19,19 @@
  * $Id: //eng/vdo-releases/sulfur/src/c++/vdo/kernel/commonStats.c#1 $
  */
 
+#include "readCache.h"
 #include "releaseVersions.h"
 #include "statistics.h"
 #include "vdo.h"
 
+#include "compressibility.h"
+#include "compressor.h"
+#include "dedupeExemptions.h"
 #include "dedupeIndex.h"
 #include "ioSubmitter.h"
 #include "kernelStatistics.h"
 #include "memoryUsage.h"
+#include "postDedupe.h"
 #include "vdoCommon.h"
 
 /**********************************************************************/
@@ -72,6 +77,23 @@ void get_kernel_statistics(struct kernel_layer *layer,
 	stats->flush_out = atomic64_read(&layer->flush_out);
 	stats->logical_block_size =
 		layer->vdo.device_config->logical_block_size;
+	stats->compression_acceleration =
+		atomic_read(&layer->compression_acceleration);
+	get_read_cache_statistics(layer->vdo.read_cache,
+				  &stats->read_cache_hits,
+				  &stats->read_cache_misses);
+	get_post_dedupe_statistics(layer->post_deduper,
+				   &stats->post_dedupe_deferred,
+				   &stats->post_dedupe_checked,
+				   &stats->post_dedupe_shared,
+				   &stats->post_dedupe_pending);
+	stats->dedupe_exempt_writes =
+		get_dedupe_exempt_writes(layer->dedupe_exemptions);
+	stats->compression_region_skips =
+		get_compression_region_skips(layer->compressibility);
+	get_vdo_compressor_offload_statistics(layer->compressor,
+					      &stats->compression_offloads,
+					      &stats->compression_offload_fallbacks);
 	copy_bio_stat(&stats->bios_in, &layer->bios_in);
 	copy_bio_stat(&stats->bios_in_partial, &layer->bios_in_partial);
 	copy_bio_stat(&stats->bios_out, &layer->bios_out);
@@ -0,0 +1,404 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "compactJournalSector.h"
+
+#include "logger.h"
+
+#include "statusCodes.h"
+
+/*
+ * The tag byte of each coded item holds the operation of the entry in bits
+ * 0..1, the form of the item in bits 2..3, and, for a delta entry, the
+ * mapping state in bits 4..7.
+ */
+enum compact_entry_form {
+	COMPACT_ENTRY_FULL = 0,
+	COMPACT_ENTRY_DELTA = 1,
+	COMPACT_ENTRY_RUN = 2,
+};
+
+enum {
+	COMPACT_SLOT_LIMIT = 1 << 10,
+	COMPACT_PBN_LIMIT = 1ULL << 36,
+};
+
+/**
+ * Make the tag byte of a coded item.
+ *
+ * @param operation  The operation of the entry
+ * @param form       The form of the item
+ * @param state      The mapping state of the entry
+ *
+ * @return The tag byte
+ **/
+static inline uint8_t make_tag(enum journal_operation operation,
+			       enum compact_entry_form form,
+			       enum block_mapping_state state)
+{
+	return ((operation & 0x3) | ((form & 0x3) << 2) | ((state & 0xF) << 4));
+}
+
+/**
+ * Get the pbn which the entry after a given one in a run maps.
+ *
+ * @param pbn  The pbn mapped by the earlier entry
+ *
+ * @return The pbn mapped by the next entry
+ **/
+static inline physical_block_number_t
+next_run_pbn(physical_block_number_t pbn)
+{
+	return ((pbn == VDO_ZERO_BLOCK) ? VDO_ZERO_BLOCK : pbn + 1);
+}
+
+/**
+ * Check whether an entry follows on from another in a run.
+ *
+ * @param previous  The earlier entry
+ * @param entry     The entry to check
+ *
+ * @return <code>true</code> if the entry extends a run ending in previous
+ **/
+static bool follows(const struct recovery_journal_entry *previous,
+		    const struct recovery_journal_entry *entry)
+{
+	return ((entry->operation == previous->operation) &&
+		(entry->mapping.state == previous->mapping.state) &&
+		(entry->slot.pbn == previous->slot.pbn) &&
+		(entry->slot.slot == previous->slot.slot + 1) &&
+		(entry->mapping.pbn == next_run_pbn(previous->mapping.pbn)));
+}
+
+/**
+ * Zigzag code a signed difference so that small magnitudes of either sign
+ * code as small numbers.
+ *
+ * @param delta  The difference to code
+ *
+ * @return The coded difference
+ **/
+static inline uint64_t zigzag(int64_t delta)
+{
+	return (((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63));
+}
+
+/**
+ * Undo zigzag coding.
+ *
+ * @param value  The coded difference
+ *
+ * @return The difference
+ **/
+static inline int64_t unzigzag(uint64_t value)
+{
+	return (int64_t) ((value >> 1) ^ -(value & 1));
+}
+
+/**
+ * Append a byte to a sector being coded.
+ *
+ * @param encoder  The encoder of the sector
+ * @param byte     The byte to append
+ **/
+static inline void put_byte(struct compact_sector_encoder *encoder,
+			    uint8_t byte)
+{
+	if (encoder->sector != NULL) {
+		encoder->sector->data[encoder->size] = byte;
+	}
+
+	encoder->size++;
+}
+
+/**
+ * Append a varint to a sector being coded.
+ *
+ * @param encoder  The encoder of the sector
+ * @param value    The value to append
+ **/
+static void put_varint(struct compact_sector_encoder *encoder, uint64_t value)
+{
+	while (value >= 0x80) {
+		put_byte(encoder, (value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+
+	put_byte(encoder, value);
+}
+
+/**
+ * Read a varint from a coded sector.
+ *
+ * @param [in]     data    The coded entries
+ * @param [in]     size    The number of bytes of coded entries
+ * @param [in,out] offset  The offset of the varint, updated to the byte
+ *                         after it
+ * @param [out]    value   The value read
+ *
+ * @return <code>true</code> if a well-formed varint was read
+ **/
+static bool get_varint(const uint8_t *data,
+		       uint16_t size,
+		       uint16_t *offset,
+		       uint64_t *value)
+{
+	unsigned int shift;
+	*value = 0;
+	for (shift = 0; shift < 64; shift += 7) {
+		uint8_t byte;
+		if (*offset >= size) {
+			return false;
+		}
+
+		byte = data[(*offset)++];
+		*value |= ((uint64_t) (byte & 0x7F)) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**********************************************************************/
+void reset_compact_sector_encoder(struct compact_sector_encoder *encoder,
+				  struct packed_compact_journal_sector *sector)
+{
+	*encoder = (struct compact_sector_encoder) {
+		.sector = sector,
+	};
+
+	if (sector != NULL) {
+		sector->entry_count = 0;
+		sector->size = __cpu_to_le16(0);
+	}
+}
+
+/**
+ * Code an entry which does not extend a run.
+ *
+ * @param encoder  The encoder of the sector
+ * @param entry    The entry to code
+ **/
+static void code_entry(struct compact_sector_encoder *encoder,
+		       const struct recovery_journal_entry *entry)
+{
+	const struct recovery_journal_entry *base =
+		&encoder->last[entry->operation];
+	struct packed_recovery_journal_entry packed;
+	const uint8_t *bytes;
+	size_t i;
+
+	if (((encoder->coded_operations & (1 << entry->operation)) != 0) &&
+	    (base->slot.pbn == entry->slot.pbn)) {
+		put_byte(encoder, make_tag(entry->operation,
+					   COMPACT_ENTRY_DELTA,
+					   entry->mapping.state));
+		put_varint(encoder,
+			   zigzag((int64_t) entry->slot.slot
+				  - (int64_t) base->slot.slot));
+		put_varint(encoder,
+			   zigzag((int64_t) entry->mapping.pbn
+				  - (int64_t) base->mapping.pbn));
+		return;
+	}
+
+	put_byte(encoder, make_tag(entry->operation, COMPACT_ENTRY_FULL, 0));
+	packed = pack_recovery_journal_entry(entry);
+	bytes = (const uint8_t *) &packed;
+	for (i = 0; i < sizeof(packed); i++) {
+		put_byte(encoder, bytes[i]);
+	}
+}
+
+/**********************************************************************/
+void add_compact_journal_entry(struct compact_sector_encoder *encoder,
+			       const struct recovery_journal_entry *entry)
+{
+	if ((encoder->entry_count > 0) &&
+	    follows(&encoder->previous, entry)) {
+		if (encoder->run_length == 0) {
+			put_byte(encoder, make_tag(entry->operation,
+						   COMPACT_ENTRY_RUN,
+						   0));
+			encoder->run_offset = encoder->size;
+			put_byte(encoder, 0);
+		}
+
+		encoder->run_length++;
+		if (encoder->sector != NULL) {
+			encoder->sector->data[encoder->run_offset]
+				= encoder->run_length;
+		}
+	} else {
+		encoder->run_length = 0;
+		code_entry(encoder, entry);
+	}
+
+	encoder->entry_count++;
+	encoder->previous = *entry;
+	encoder->last[entry->operation] = *entry;
+	encoder->coded_operations |= (1 << entry->operation);
+	if (encoder->sector != NULL) {
+		encoder->sector->entry_count = encoder->entry_count;
+		encoder->sector->size = __cpu_to_le16(encoder->size);
+	}
+}
+
+/**********************************************************************/
+bool is_full_compact_journal_sector(const struct packed_compact_journal_sector *sector)
+{
+	return ((sector->entry_count == COMPACT_JOURNAL_ENTRIES_PER_SECTOR) ||
+		((__le16_to_cpu(sector->size) + COMPACT_JOURNAL_ENTRY_MAX_SIZE)
+		 > COMPACT_JOURNAL_SECTOR_DATA_SIZE));
+}
+
+/**
+ * Decode a delta entry.
+ *
+ * @param [in]     data    The coded entries
+ * @param [in]     size    The number of bytes of coded entries
+ * @param [in,out] offset  The offset of the differences, updated to the byte
+ *                         after them
+ * @param [in]     base    The entry the differences are from
+ * @param [out]    entry   The decoded entry
+ *
+ * @return <code>true</code> if the entry was well-formed
+ **/
+static bool decode_delta(const uint8_t *data,
+			 uint16_t size,
+			 uint16_t *offset,
+			 const struct recovery_journal_entry *base,
+			 struct recovery_journal_entry *entry)
+{
+	uint64_t slot_delta, pbn_delta;
+	int64_t slot, pbn;
+
+	if (!get_varint(data, size, offset, &slot_delta) ||
+	    !get_varint(data, size, offset, &pbn_delta)) {
+		return false;
+	}
+
+	slot = (int64_t) base->slot.slot + unzigzag(slot_delta);
+	pbn = (int64_t) base->mapping.pbn + unzigzag(pbn_delta);
+	if ((slot < 0) || (slot >= COMPACT_SLOT_LIMIT) ||
+	    (pbn < 0) || (pbn >= (int64_t) COMPACT_PBN_LIMIT)) {
+		return false;
+	}
+
+	entry->slot.pbn = base->slot.pbn;
+	entry->slot.slot = slot;
+	entry->mapping.pbn = pbn;
+	return true;
+}
+
+/**********************************************************************/
+int decode_compact_journal_sector(const struct packed_compact_journal_sector *sector,
+				  struct recovery_journal_entry *entries)
+{
+	const struct recovery_journal_entry *last[4] = { NULL };
+	uint16_t size = __le16_to_cpu(sector->size);
+	uint16_t offset = 0;
+	uint8_t count = 0;
+
+	if (size > COMPACT_JOURNAL_SECTOR_DATA_SIZE) {
+		return log_error_strerror(VDO_CORRUPT_JOURNAL,
+					  "compact journal sector size %u exceeds %u",
+					  size,
+					  COMPACT_JOURNAL_SECTOR_DATA_SIZE);
+	}
+
+	while (offset < size) {
+		uint8_t tag = sector->data[offset++];
+		enum journal_operation operation = tag & 0x3;
+		enum compact_entry_form form = (tag >> 2) & 0x3;
+		struct recovery_journal_entry *entry = &entries[count];
+
+		if (form == COMPACT_ENTRY_RUN) {
+			uint8_t length, i;
+
+			if ((count == 0) || (offset >= size)) {
+				break;
+			}
+
+			length = sector->data[offset++];
+			if ((length == 0) ||
+			    (length > sector->entry_count - count)) {
+				break;
+			}
+
+			for (i = 0; i < length; i++, count++) {
+				entry = &entries[count];
+				*entry = entries[count - 1];
+				entry->slot.slot++;
+				entry->mapping.pbn =
+					next_run_pbn(entry->mapping.pbn);
+			}
+
+			if ((entry->slot.slot >= COMPACT_SLOT_LIMIT) ||
+			    (entry->mapping.pbn >= COMPACT_PBN_LIMIT)) {
+				break;
+			}
+
+			last[entry->operation] = entry;
+			continue;
+		}
+
+		if (count == sector->entry_count) {
+			break;
+		}
+
+		if (form == COMPACT_ENTRY_DELTA) {
+			if ((last[operation] == NULL) ||
+			    !decode_delta(sector->data,
+					  size,
+					  &offset,
+					  last[operation],
+					  entry)) {
+				break;
+			}
+
+			entry->operation = operation;
+			entry->mapping.state = tag >> 4;
+		} else if (form == COMPACT_ENTRY_FULL) {
+			struct packed_recovery_journal_entry packed;
+
+			if ((size - offset) < sizeof(packed)) {
+				break;
+			}
+
+			memcpy(&packed, &sector->data[offset], sizeof(packed));
+			offset += sizeof(packed);
+			*entry = unpack_recovery_journal_entry(&packed);
+		} else {
+			break;
+		}
+
+		last[operation] = entry;
+		count++;
+	}
+
+	if ((offset != size) || (count != sector->entry_count)) {
+		return log_error_strerror(VDO_CORRUPT_JOURNAL,
+					  "malformed compact journal sector");
+	}
+
+	return VDO_SUCCESS;
+}
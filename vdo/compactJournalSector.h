@@ -0,0 +1,171 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef COMPACT_JOURNAL_SECTOR_H
+#define COMPACT_JOURNAL_SECTOR_H
+
+#include "numeric.h"
+
+#include "constants.h"
+#include "packedRecoveryJournalBlock.h"
+#include "recoveryJournalEntry.h"
+#include "types.h"
+
+/*
+ * A recovery journal block in the compact format (one whose header has the
+ * metadata type VDO_METADATA_COMPACT_RECOVERY_JOURNAL) codes each entry of a
+ * sector against the entries before it in the sector, so that the runs of
+ * adjacent mappings made by sequential writes take little space:
+ *
+ * - A full entry is a tag byte followed by the usual packed entry.
+ * - A delta entry has the same block map page as the last entry with the
+ *   same operation; it is a tag byte followed by the differences of its slot
+ *   and of its mapped pbn from those of that entry, as zigzag varints.
+ * - A run is a tag byte and a count of entries, each of which follows on
+ *   from the entry just before it: same operation, state and page, the next
+ *   slot, and the next pbn (or the zero block again).
+ *
+ * Each sector is coded on its own, so that a torn block can be read up to
+ * its last good sector. A sector is full once it has the most entries its
+ * count can record, or too little space left for a full entry.
+ */
+
+/** The packed, on-disk representation of a compact journal sector. */
+struct packed_compact_journal_sector {
+	/** The protection check byte */
+	uint8_t check_byte;
+
+	/** The number of recoveries completed */
+	uint8_t recovery_count;
+
+	/** The number of entries in this sector */
+	uint8_t entry_count;
+
+	/** The number of bytes of coded entries in this sector */
+	__le16 size;
+
+	/** The coded entries */
+	uint8_t data[];
+} __packed;
+
+enum {
+	/** The largest coding of an entry */
+	COMPACT_JOURNAL_ENTRY_MAX_SIZE =
+		1 + sizeof(struct packed_recovery_journal_entry),
+	/** The space for coded entries in each sector */
+	COMPACT_JOURNAL_SECTOR_DATA_SIZE =
+		(VDO_SECTOR_SIZE
+		 - sizeof(struct packed_compact_journal_sector)),
+	/** The most entries a sector can hold */
+	COMPACT_JOURNAL_ENTRIES_PER_SECTOR = UINT8_MAX,
+	/** The fewest entries a full sector can hold */
+	COMPACT_JOURNAL_MIN_ENTRIES_PER_SECTOR =
+		((COMPACT_JOURNAL_SECTOR_DATA_SIZE
+		  - COMPACT_JOURNAL_ENTRY_MAX_SIZE)
+		 / COMPACT_JOURNAL_ENTRY_MAX_SIZE) + 1,
+	/** The most entries a compact block can hold */
+	COMPACT_RECOVERY_JOURNAL_ENTRIES_PER_BLOCK =
+		((VDO_SECTORS_PER_BLOCK - 1)
+		 * COMPACT_JOURNAL_ENTRIES_PER_SECTOR),
+	/** The fewest entries a full compact block can hold */
+	COMPACT_RECOVERY_JOURNAL_MIN_ENTRIES_PER_BLOCK =
+		((VDO_SECTORS_PER_BLOCK - 1)
+		 * COMPACT_JOURNAL_MIN_ENTRIES_PER_SECTOR),
+};
+
+/**
+ * The state of the coding of a compact sector.
+ **/
+struct compact_sector_encoder {
+	/** The sector being coded, or NULL if only its size is tracked */
+	struct packed_compact_journal_sector *sector;
+	/** The number of bytes of coded entries */
+	uint16_t size;
+	/** The number of entries coded */
+	uint8_t entry_count;
+	/** The length of the run at the end of the sector, or 0 if none */
+	uint8_t run_length;
+	/** The offset of the count of the run at the end of the sector */
+	uint16_t run_offset;
+	/** A bit for each operation of which an entry has been coded */
+	uint8_t coded_operations;
+	/** The last entry coded */
+	struct recovery_journal_entry previous;
+	/** The last entry coded with each operation */
+	struct recovery_journal_entry last[4];
+};
+
+/**
+ * Prepare to code the entries of a compact sector.
+ *
+ * @param encoder  The encoder to reset
+ * @param sector   The sector to code into, or NULL to only track the size
+ *                 the entries would take
+ **/
+void reset_compact_sector_encoder(struct compact_sector_encoder *encoder,
+				  struct packed_compact_journal_sector *sector);
+
+/**
+ * Check whether a compact sector being coded is full.
+ *
+ * @param encoder  The encoder of the sector
+ *
+ * @return <code>true</code> if no more entries may be added to the sector
+ **/
+static inline bool __must_check
+is_compact_sector_full(const struct compact_sector_encoder *encoder)
+{
+	return ((encoder->entry_count == COMPACT_JOURNAL_ENTRIES_PER_SECTOR) ||
+		((encoder->size + COMPACT_JOURNAL_ENTRY_MAX_SIZE) >
+		 COMPACT_JOURNAL_SECTOR_DATA_SIZE));
+}
+
+/**
+ * Add an entry to a compact sector which is not full.
+ *
+ * @param encoder  The encoder of the sector
+ * @param entry    The entry to add
+ **/
+void add_compact_journal_entry(struct compact_sector_encoder *encoder,
+			       const struct recovery_journal_entry *entry);
+
+/**
+ * Check whether a compact sector read from disk was full when written.
+ *
+ * @param sector  The sector to check
+ *
+ * @return <code>true</code> if the sector is full
+ **/
+bool __must_check
+is_full_compact_journal_sector(const struct packed_compact_journal_sector *sector);
+
+/**
+ * Decode the entries of a compact sector.
+ *
+ * @param [in]  sector   The sector to decode
+ * @param [out] entries  An array of COMPACT_JOURNAL_ENTRIES_PER_SECTOR
+ *                       entries to hold the decoded entries
+ *
+ * @return VDO_SUCCESS or VDO_CORRUPT_JOURNAL if the sector is malformed
+ **/
+int __must_check
+decode_compact_journal_sector(const struct packed_compact_journal_sector *sector,
+			      struct recovery_journal_entry *entries);
+
+#endif // COMPACT_JOURNAL_SECTOR_H
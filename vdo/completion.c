@@ -25,6 +25,17 @@
 #include "permassert.h"
 #include "statusCodes.h"
 #include "vdo.h"
+#include "vdoInternal.h"
+#include "workQueue.h"
+
+enum {
+	/**
+	 * The deepest that callbacks may be nested by running them directly
+	 * on the current thread; deeper ones are enqueued to keep the stack
+	 * bounded
+	 **/
+	MAX_DIRECT_CALLBACK_DEPTH = 16,
+};
 
 static const char *VDO_COMPLETION_TYPE_NAMES[] = {
 	// Keep UNSET_COMPLETION_TYPE at the top.
@@ -35,19 +46,28 @@ static const char *VDO_COMPLETION_TYPE_NAMES[] = {
 	"ACTION_COMPLETION",
 	"ADMIN_COMPLETION",
 	"BLOCK_ALLOCATOR_COMPLETION",
+	"BLOCK_MAP_PREFETCH_COMPLETION",
 	"BLOCK_MAP_RECOVERY_COMPLETION",
+	"BLOCK_MAP_ZONE_RECOVERY_COMPLETION",
 	"FLUSH_NOTIFICATION_COMPLETION",
 	"GENERATION_FLUSHED_COMPLETION",
 	"LOCK_COUNTER_COMPLETION",
+	"PACKER_RESIDENCY_COMPLETION",
+	"PACKER_UNIT_COMPLETION",
 	"PARTITION_COPY_COMPLETION",
 	"READ_ONLY_MODE_COMPLETION",
 	"READ_ONLY_REBUILD_COMPLETION",
+	"REAP_FLUSH_COMPLETION",
 	"RECOVERY_COMPLETION",
+	"RECOVERY_JOURNAL_COMMIT_COMPLETION",
 	"REFERENCE_COUNT_REBUILD_COMPLETION",
+	"REFERENCE_COUNT_REBUILD_ZONE_COMPLETION",
 	"SLAB_SCRUBBER_COMPLETION",
+	"SLAB_SUMMARY_WRITE_COMPLETION",
 	"SUB_TASK_COMPLETION",
 	"SYNC_COMPLETION",
 	"VDO_EXTENT_COMPLETION",
+	"VDO_PAGE_CACHE_COMPLETION",
 	"VDO_PAGE_COMPLETION",
 	"VIO_COMPLETION",
 
@@ -96,31 +116,112 @@ void set_vdo_completion_result(struct vdo_completion *completion, int result)
  * so the caller MUST requeue if this returns true.
  *
  * @param completion  The completion whose callback is to be invoked
+ * @param thread      The current vdo thread, or NULL
  *
  * @return <code>false</code> if the callback must be run on this thread
  *         <code>true</code>  if the callback must be enqueued
  **/
 static inline bool __must_check
-requires_enqueue(struct vdo_completion *completion)
+requires_enqueue(struct vdo_completion *completion, struct vdo_thread *thread)
 {
-	thread_id_t callback_thread = completion->callback_thread_id;
 	if (completion->requeue) {
 		completion->requeue = false;
 		return true;
 	}
 
-	return (callback_thread != get_callback_thread_id());
+	return ((thread == NULL)
+		|| (thread->thread_id != completion->callback_thread_id)
+		|| (thread->callback_depth >= MAX_DIRECT_CALLBACK_DEPTH));
+}
+
+/**
+ * Enqueue the completions deferred by a thread's completion batch, grouping
+ * those for each destination thread (in order) into a single enqueue.
+ *
+ * @param thread  The current vdo thread
+ **/
+static void enqueue_batched_completions(struct vdo_thread *thread)
+{
+	struct vdo_completion **batched = thread->batched;
+	unsigned int count = thread->batched_count;
+	unsigned int start = 0;
+
+	thread->batched_count = 0;
+	while (start < count) {
+		thread_id_t thread_id = batched[start]->callback_thread_id;
+		unsigned int end = start + 1;
+		unsigned int i;
+
+		// Gather the rest of this thread's completions after the
+		// first, shifting the others down to keep them in order.
+		for (i = end; i < count; i++) {
+			struct vdo_completion *completion = batched[i];
+
+			if (completion->callback_thread_id != thread_id) {
+				continue;
+			}
+
+			memmove(&batched[end + 1],
+				&batched[end],
+				(i - end) * sizeof(*batched));
+			batched[end++] = completion;
+		}
+
+		enqueue_vdo_completions(&batched[start], end - start);
+		start = end;
+	}
+}
+
+/**********************************************************************/
+void start_vdo_completion_batch(void)
+{
+	struct vdo_thread *thread = get_current_vdo_thread();
+
+	if (thread != NULL) {
+		thread->batch_depth++;
+	}
+}
+
+/**********************************************************************/
+void finish_vdo_completion_batch(void)
+{
+	struct vdo_thread *thread = get_current_vdo_thread();
+
+	if ((thread != NULL) && (--thread->batch_depth == 0) &&
+	    (thread->batched_count > 0)) {
+		enqueue_batched_completions(thread);
+	}
 }
 
 /**********************************************************************/
 void invoke_vdo_completion_callback(struct vdo_completion *completion)
 {
-	if (requires_enqueue(completion)) {
-		enqueue_vdo_completion(completion);
+	struct vdo_thread *thread = get_current_vdo_thread();
+
+	if (requires_enqueue(completion, thread)) {
+		if (thread == NULL) {
+			enqueue_vdo_completion(completion);
+			return;
+		}
+
+		count_work_queue_dispatch(thread->request_queue, false);
+		if (thread->batch_depth == 0) {
+			enqueue_vdo_completion(completion);
+			return;
+		}
+
+		if (thread->batched_count == MAX_BATCHED_COMPLETIONS) {
+			enqueue_batched_completions(thread);
+		}
+
+		thread->batched[thread->batched_count++] = completion;
 		return;
 	}
 
+	count_work_queue_dispatch(thread->request_queue, true);
+	thread->callback_depth++;
 	run_vdo_completion_callback(completion);
+	thread->callback_depth--;
 }
 
 /**********************************************************************/
@@ -38,19 +38,28 @@ enum vdo_completion_type {
 	ACTION_COMPLETION,
 	ADMIN_COMPLETION,
 	BLOCK_ALLOCATOR_COMPLETION,
+	BLOCK_MAP_PREFETCH_COMPLETION,
 	BLOCK_MAP_RECOVERY_COMPLETION,
+	BLOCK_MAP_ZONE_RECOVERY_COMPLETION,
 	FLUSH_NOTIFICATION_COMPLETION,
 	GENERATION_FLUSHED_COMPLETION,
 	LOCK_COUNTER_COMPLETION,
+	PACKER_RESIDENCY_COMPLETION,
+	PACKER_UNIT_COMPLETION,
 	PARTITION_COPY_COMPLETION,
 	READ_ONLY_MODE_COMPLETION,
 	READ_ONLY_REBUILD_COMPLETION,
+	REAP_FLUSH_COMPLETION,
 	RECOVERY_COMPLETION,
+	RECOVERY_JOURNAL_COMMIT_COMPLETION,
 	REFERENCE_COUNT_REBUILD_COMPLETION,
+	REFERENCE_COUNT_REBUILD_ZONE_COMPLETION,
 	SLAB_SCRUBBER_COMPLETION,
+	SLAB_SUMMARY_WRITE_COMPLETION,
 	SUB_TASK_COMPLETION,
 	SYNC_COMPLETION,
 	VDO_EXTENT_COMPLETION,
+	VDO_PAGE_CACHE_COMPLETION,
 	VDO_PAGE_COMPLETION,
 	VIO_COMPLETION,
 
@@ -395,4 +404,28 @@ prepare_vdo_completion_to_finish_parent(struct vdo_completion *completion,
  **/
 void enqueue_vdo_completion(struct vdo_completion *completion);
 
+/**
+ * A function to enqueue several vdo_completions which all have the same
+ * callback thread, in order, as a single batch.
+ *
+ * @param completions  The completions to be enqueued
+ * @param count        The number of completions
+ **/
+void enqueue_vdo_completions(struct vdo_completion *completions[],
+			     unsigned int count);
+
+/**
+ * Start a completion batch on the current thread. Until the batch is
+ * finished, completions whose callbacks must be enqueued are held back, and
+ * then enqueued with one operation per destination thread. Batches may nest;
+ * only finishing the outermost one enqueues the completions. This does
+ * nothing if the current thread is not a vdo thread.
+ **/
+void start_vdo_completion_batch(void);
+
+/**
+ * Finish a completion batch on the current thread.
+ **/
+void finish_vdo_completion_batch(void);
+
 #endif // COMPLETION_H
@@ -27,24 +27,39 @@
 
 #include "statusCodes.h"
 
-static const struct version_number COMPRESSED_BLOCK_1_0 = {
-	.major_version = 1,
-	.minor_version = 0,
-};
-
+/**
+ * All compressed blocks have the 1.0 layout. Version 1.0 itself holds LZ4
+ * fragments; the minor version of any other compressed block is the
+ * vdo_compression_format of its fragments, which older releases will reject
+ * rather than misinterpret.
+ *
+ * A block with major version 2 may also hold compression units, fragments
+ * which decompress to several logically consecutive blocks. The first block
+ * of a unit is mapped to the slot holding the fragment, and each following
+ * block to the next slot, which is left empty. Older releases reject these
+ * blocks too, since they would find an empty fragment.
+ **/
 enum {
+	COMPRESSED_BLOCK_MAJOR_VERSION = 1,
+	COMPRESSED_BLOCK_UNIT_MAJOR_VERSION = 2,
 	COMPRESSED_BLOCK_1_0_SIZE = 4 + 4 + (2 * MAX_COMPRESSION_SLOTS),
 };
 
 /**********************************************************************/
-void reset_vdo_compressed_block_header(struct compressed_block_header *header)
+void reset_vdo_compressed_block_header(struct compressed_block_header *header,
+				       enum vdo_compression_format format)
 {
+	struct version_number version = {
+		.major_version = COMPRESSED_BLOCK_MAJOR_VERSION,
+		.minor_version = format,
+	};
+
 	// Make sure the block layout isn't accidentally changed by changing
 	// the length of the block header.
 	STATIC_ASSERT_SIZEOF(struct compressed_block_header,
 			     COMPRESSED_BLOCK_1_0_SIZE);
 
-	header->version = pack_vdo_version_number(COMPRESSED_BLOCK_1_0);
+	header->version = pack_vdo_version_number(version);
 	memset(header->sizes, 0, sizeof(header->sizes));
 }
 
@@ -61,7 +76,9 @@ int get_vdo_compressed_block_fragment(enum block_mapping_state mapping_state,
 				      char *buffer,
 				      block_size_t block_size,
 				      uint16_t *fragment_offset,
-				      uint16_t *fragment_size)
+				      uint16_t *fragment_size,
+				      enum vdo_compression_format *format,
+				      unsigned int *unit_block)
 {
 	uint16_t compressed_size, offset;
 	unsigned int i;
@@ -75,7 +92,9 @@ int get_vdo_compressed_block_fragment(enum block_mapping_state mapping_state,
 	}
 
 	version = unpack_vdo_version_number(header->version);
-	if (!are_same_vdo_version(version, COMPRESSED_BLOCK_1_0)) {
+	if (((version.major_version != COMPRESSED_BLOCK_MAJOR_VERSION) &&
+	     (version.major_version != COMPRESSED_BLOCK_UNIT_MAJOR_VERSION)) ||
+	    (version.minor_version >= VDO_COMPRESSION_FORMAT_COUNT)) {
 		return VDO_INVALID_FRAGMENT;
 	}
 
@@ -84,7 +103,26 @@ int get_vdo_compressed_block_fragment(enum block_mapping_state mapping_state,
 		return VDO_INVALID_FRAGMENT;
 	}
 
+	// An empty slot in a block with units names a later block of the
+	// unit whose fragment precedes it. The slots between them are empty,
+	// so the fragment offset is the same for either slot.
+	*unit_block = 0;
 	compressed_size = get_compressed_fragment_size(header, slot);
+	if (version.major_version == COMPRESSED_BLOCK_UNIT_MAJOR_VERSION) {
+		byte first = slot;
+
+		while ((compressed_size == 0) && (first > 0)) {
+			compressed_size
+				= get_compressed_fragment_size(header, --first);
+		}
+
+		*unit_block = slot - first;
+		if ((compressed_size == 0) ||
+		    (*unit_block >= VDO_MAX_COMPRESSION_UNIT_BLOCKS)) {
+			return VDO_INVALID_FRAGMENT;
+		}
+	}
+
 	offset = sizeof(struct compressed_block_header);
 	for (i = 0; i < slot; i++) {
 		offset += get_compressed_fragment_size(header, i);
@@ -99,6 +137,7 @@ int get_vdo_compressed_block_fragment(enum block_mapping_state mapping_state,
 
 	*fragment_offset = offset;
 	*fragment_size = compressed_size;
+	*format = version.minor_version;
 	return VDO_SUCCESS;
 }
 
@@ -112,3 +151,15 @@ void put_vdo_compressed_block_fragment(struct compressed_block *block,
 	block->header.sizes[fragment] = __cpu_to_le16(size);
 	memcpy(&block->data[offset], data, size);
 }
+
+/**********************************************************************/
+void put_vdo_compressed_block_unit_member(struct compressed_block *block,
+					  unsigned int fragment)
+{
+	struct version_number version
+		= unpack_vdo_version_number(block->header.version);
+
+	version.major_version = COMPRESSED_BLOCK_UNIT_MAJOR_VERSION;
+	block->header.version = pack_vdo_version_number(version);
+	block->header.sizes[fragment] = __cpu_to_le16(0);
+}
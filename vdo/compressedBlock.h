@@ -25,6 +25,28 @@
 #include "blockMappingState.h"
 #include "header.h"
 
+/**
+ * The formats in which the fragments of a compressed block may be encoded.
+ * The format is recorded as the minor version of the compressed block
+ * header, so these values must never be renumbered.
+ **/
+enum vdo_compression_format {
+	VDO_COMPRESSION_LZ4 = 0,
+	VDO_COMPRESSION_ZSTD = 1,
+	VDO_COMPRESSION_DEFLATE = 2,
+	/* LZ4 primed with the built-in dictionary of structured data */
+	VDO_COMPRESSION_LZ4_DICTIONARY = 3,
+	VDO_COMPRESSION_FORMAT_COUNT,
+};
+
+enum {
+	/**
+	 * The most logically consecutive blocks which may be compressed
+	 * together as one fragment
+	 **/
+	VDO_MAX_COMPRESSION_UNIT_BLOCKS = 4,
+};
+
 /**
  * The header of a compressed block.
  **/
@@ -54,11 +76,13 @@ struct compressed_block {
  * Initializes/resets a compressed block header.
  *
  * @param header        the header
+ * @param format        the format of the fragments to be put in the block
  *
- * When done, the version number is set to the current version, and all
+ * When done, the version number is set to the one for the format, and all
  * fragments are empty.
  **/
-void reset_vdo_compressed_block_header(struct compressed_block_header *header);
+void reset_vdo_compressed_block_header(struct compressed_block_header *header,
+				       enum vdo_compression_format format);
 
 /**
  * Get a reference to a compressed fragment from a compression block.
@@ -69,6 +93,10 @@ void reset_vdo_compressed_block_header(struct compressed_block_header *header);
  * @param [out] fragment_offset  the offset of the fragment within a
  *                               compressed block
  * @param [out] fragment_size    the size of the fragment
+ * @param [out] format           the format of the fragment
+ * @param [out] unit_block       the index of the mapped block within the
+ *                               blocks compressed together in the fragment,
+ *                               which is 0 for a fragment of one block
  *
  * @return If a valid compressed fragment is found, VDO_SUCCESS;
  *         otherwise, VDO_INVALID_FRAGMENT if the fragment is invalid.
@@ -77,7 +105,9 @@ int get_vdo_compressed_block_fragment(enum block_mapping_state mapping_state,
 				      char *buffer,
 				      block_size_t block_size,
 				      uint16_t *fragment_offset,
-				      uint16_t *fragment_size);
+				      uint16_t *fragment_size,
+				      enum vdo_compression_format *format,
+				      unsigned int *unit_block);
 
 /**
  * Copy a fragment into the compressed block.
@@ -94,4 +124,14 @@ void put_vdo_compressed_block_fragment(struct compressed_block *block,
 				       unsigned int fragment, uint16_t offset,
 				       const char *data, uint16_t size);
 
+/**
+ * Mark a slot of a compressed block as holding the next block of the
+ * compression unit whose fragment is in the nearest preceding non-empty slot.
+ *
+ * @param block     the compressed block
+ * @param fragment  the number of the slot
+ **/
+void put_vdo_compressed_block_unit_member(struct compressed_block *block,
+					  unsigned int fragment);
+
 #endif // COMPRESSED_BLOCK_H
@@ -0,0 +1,138 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "compressibility.h"
+
+#include "atomicDefs.h"
+#include "memoryAlloc.h"
+
+#include "statusCodes.h"
+
+enum {
+	/** The log of the number of blocks in a region (1 GiB of 4K blocks) */
+	COMPRESSIBILITY_REGION_SHIFT = 18,
+	/**
+	 * The number of regions tracked. Regions beyond this share slots,
+	 * which at worst costs a little compression until they relearn.
+	 **/
+	COMPRESSIBILITY_REGION_COUNT = 4096,
+	/** The run of incompressible blocks after which a region is skipped */
+	INCOMPRESSIBLE_RUN_LIMIT = 64,
+	/** One in this many writes to a skipped region is compressed anyway */
+	COMPRESSIBILITY_RESAMPLE_INTERVAL = 128,
+};
+
+struct compressibility_region {
+	/** The number of consecutive incompressible blocks, saturating */
+	uint8_t incompressible_run;
+	/** The writes to this region since the last resample */
+	uint8_t skips;
+};
+
+struct compressibility_tracker {
+	/** The writes which skipped compression because of their region */
+	atomic64_t skipped;
+	/** The state of each tracked region */
+	struct compressibility_region regions[COMPRESSIBILITY_REGION_COUNT];
+};
+
+/**
+ * Get the tracked state of the region which holds a logical block.
+ *
+ * @param tracker  The compressibility tracker
+ * @param lbn      The logical block
+ *
+ * @return The region's state
+ **/
+static inline struct compressibility_region *
+get_region(struct compressibility_tracker *tracker, logical_block_number_t lbn)
+{
+	return &tracker->regions[(lbn >> COMPRESSIBILITY_REGION_SHIFT)
+				 % COMPRESSIBILITY_REGION_COUNT];
+}
+
+/**********************************************************************/
+int make_compressibility_tracker(struct compressibility_tracker **tracker_ptr)
+{
+	struct compressibility_tracker *tracker;
+	int result = ALLOCATE(1, struct compressibility_tracker, __func__,
+			      &tracker);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	atomic64_set(&tracker->skipped, 0);
+	*tracker_ptr = tracker;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_compressibility_tracker(struct compressibility_tracker **tracker_ptr)
+{
+	FREE(*tracker_ptr);
+	*tracker_ptr = NULL;
+}
+
+/**********************************************************************/
+bool should_skip_compression(struct compressibility_tracker *tracker,
+			     logical_block_number_t lbn)
+{
+	struct compressibility_region *region = get_region(tracker, lbn);
+	uint8_t skips;
+
+	if (READ_ONCE(region->incompressible_run) < INCOMPRESSIBLE_RUN_LIMIT) {
+		return false;
+	}
+
+	skips = READ_ONCE(region->skips) + 1;
+	if (skips >= COMPRESSIBILITY_RESAMPLE_INTERVAL) {
+		WRITE_ONCE(region->skips, 0);
+		return false;
+	}
+
+	WRITE_ONCE(region->skips, skips);
+	atomic64_inc(&tracker->skipped);
+	return true;
+}
+
+/**********************************************************************/
+void record_compressibility(struct compressibility_tracker *tracker,
+			    logical_block_number_t lbn,
+			    bool compressible)
+{
+	struct compressibility_region *region = get_region(tracker, lbn);
+	uint8_t run = READ_ONCE(region->incompressible_run);
+
+	if (compressible) {
+		if (run != 0) {
+			WRITE_ONCE(region->incompressible_run, 0);
+		}
+		return;
+	}
+
+	if (run < INCOMPRESSIBLE_RUN_LIMIT) {
+		WRITE_ONCE(region->incompressible_run, run + 1);
+	}
+}
+
+/**********************************************************************/
+uint64_t get_compression_region_skips(struct compressibility_tracker *tracker)
+{
+	return atomic64_read(&tracker->skipped);
+}
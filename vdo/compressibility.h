@@ -0,0 +1,89 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef COMPRESSIBILITY_H
+#define COMPRESSIBILITY_H
+
+#include "types.h"
+
+/**
+ * A compressibility_tracker learns which regions of the logical address
+ * space hold data which does not compress, such as encrypted or media data.
+ * Once a region has produced a long enough run of incompressible blocks, new
+ * writes to it skip the compressor, except for an occasional write which is
+ * compressed anyway so that the region is noticed if its contents change.
+ *
+ * The tracker is a heuristic consulted and updated from many threads without
+ * a lock. A lost update only delays learning by one block.
+ **/
+struct compressibility_tracker;
+
+/**
+ * Make a compressibility tracker which has not yet seen any data.
+ *
+ * @param tracker_ptr  A pointer to hold the new tracker
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check
+make_compressibility_tracker(struct compressibility_tracker **tracker_ptr);
+
+/**
+ * Free a compressibility tracker and null out the reference to it.
+ *
+ * @param tracker_ptr  A pointer to the tracker to free
+ **/
+void free_compressibility_tracker(struct compressibility_tracker **tracker_ptr);
+
+/**
+ * Check whether a write should skip compression because its region has been
+ * consistently incompressible.
+ *
+ * @param tracker  The compressibility tracker
+ * @param lbn      The logical block being written
+ *
+ * @return true if the write should not be compressed
+ **/
+bool __must_check
+should_skip_compression(struct compressibility_tracker *tracker,
+			logical_block_number_t lbn);
+
+/**
+ * Record whether a block written to a region compressed.
+ *
+ * @param tracker       The compressibility tracker
+ * @param lbn           The logical block which was written
+ * @param compressible  Whether the block compressed
+ **/
+void record_compressibility(struct compressibility_tracker *tracker,
+			    logical_block_number_t lbn,
+			    bool compressible);
+
+/**
+ * Get the number of writes which skipped compression because of their
+ * region.
+ *
+ * @param tracker  The compressibility tracker
+ *
+ * @return The number of skipped writes
+ **/
+uint64_t __must_check
+get_compression_region_skips(struct compressibility_tracker *tracker);
+
+#endif // COMPRESSIBILITY_H
@@ -0,0 +1,850 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "compressor.h"
+
+#include <crypto/acompress.h>
+#include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/scatterlist.h>
+#include <linux/spinlock.h>
+
+#include "atomicDefs.h"
+#include "histogram.h"
+#include "logger.h"
+#include "memoryAlloc.h"
+
+#include "constants.h"
+#include "statusCodes.h"
+
+enum {
+	/** The number of decompression histogram buckets (up to 10^6 ns) */
+	DECOMPRESS_HISTOGRAM_LOG_SIZE = 6,
+	/** The most compressions which may be in flight on an offload device */
+	MAXIMUM_OFFLOAD_REQUESTS = 128,
+};
+
+/**
+ * The state of a block compression submitted to an asynchronous offload
+ * device.
+ **/
+struct vdo_offload_request {
+	/** The compressor which owns this request */
+	struct vdo_compressor *compressor;
+	/** The acomp request */
+	struct acomp_req *request;
+	/** The block being compressed */
+	struct scatterlist source;
+	/** The buffer for the compressed data */
+	struct scatterlist destination;
+	/** The function to call when the compression finishes */
+	vdo_offload_callback *callback;
+	/** The context for the callback */
+	void *context;
+};
+
+struct vdo_compressor {
+	/** The format in which blocks are compressed */
+	enum vdo_compression_format format;
+	/**
+	 * The synchronous acomp transforms used by the contexts, or NULL for
+	 * LZ4 and unavailable formats
+	 **/
+	struct crypto_acomp *transforms[VDO_COMPRESSION_FORMAT_COUNT];
+	/**
+	 * The transform of the asynchronous driver for the configured format,
+	 * if one is registered
+	 **/
+	struct crypto_acomp *offload_transform;
+	/** The time taken to decompress each fragment */
+	struct histogram *decompress_histogram;
+	/**
+	 * The lock protecting the idle offload requests, which are returned
+	 * from the offload device's completion context
+	 **/
+	spinlock_t offload_lock;
+	/** Whether blocks are compressed by an asynchronous offload device */
+	bool offload_enabled;
+	/** The number of idle offload requests */
+	unsigned int idle_offload_count;
+	/** The stack of idle offload requests */
+	struct vdo_offload_request *idle_offloads[MAXIMUM_OFFLOAD_REQUESTS];
+	/** The blocks compressed by the offload device */
+	atomic64_t offloaded;
+	/** The blocks compressed on the CPU because the device was busy */
+	atomic64_t offload_fallbacks;
+};
+
+struct vdo_compressor_context {
+	/** The compressor this context is for */
+	struct vdo_compressor *compressor;
+	/** Working memory for the LZ4 compressor */
+	char *lz4_context;
+	/**
+	 * An LZ4 stream primed with the dictionary, copied into lz4_context
+	 * before each block so the dictionary need not be hashed every time
+	 */
+	LZ4_stream_t *lz4_dictionary_stream;
+	/**
+	 * A buffer to hold the blocks of a compression unit, gathered for
+	 * compression or decompressed from a fragment
+	 */
+	char *unit_buffer;
+	/** A request for each synchronous acomp transform of the compressor */
+	struct acomp_req *requests[VDO_COMPRESSION_FORMAT_COUNT];
+};
+
+/**
+ * The names of the formats, which for formats other than LZ4 are also the
+ * names of their algorithms in the kernel crypto API.
+ **/
+static const char *FORMAT_NAMES[] = {
+	[VDO_COMPRESSION_LZ4] = "lz4",
+	[VDO_COMPRESSION_ZSTD] = "zstd",
+	[VDO_COMPRESSION_DEFLATE] = "deflate",
+	[VDO_COMPRESSION_LZ4_DICTIONARY] = "lz4dict",
+};
+
+/**
+ * The dictionary for VDO_COMPRESSION_LZ4_DICTIONARY. An isolated 4K block
+ * gives LZ4 little history to match against, so fragments in this format are
+ * compressed as if the block followed this text, which holds strings common
+ * in structured data such as JSON and XML documents, logs, and web content.
+ * LZ4 prefers the most recent matches, so the most common strings come last.
+ *
+ * The dictionary is part of the on-disk format: fragments already written
+ * can only be decompressed with exactly these bytes. It must never be
+ * changed; a different dictionary requires a new compression format.
+ **/
+static const char LZ4_DICTIONARY[] =
+	"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	"<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n<meta charset=\"utf-8\">"
+	"\n<meta name=\"viewport\" content=\"width=device-width, "
+	"initial-scale=1\">\n<title></title>\n<link rel=\"stylesheet\" "
+	"type=\"text/css\" href=\"\n<script type=\"text/javascript\" src=\""
+	"</script>\n</head>\n<body>\n<div class=\"</div>\n<span class=\""
+	"</span><a href=\"https://www.</a></li>\n<li><p></p>\n<br/>"
+	"<table><tr><td></td></tr></table><img src=\"\" alt=\"\" />"
+	"</body>\n</html>\n"
+	"xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
+	"Content-Type: application/json; charset=utf-8\r\n"
+	"HTTP/1.1 200 OK\r\nGET / HTTP/1.1\r\nPOST /api/v1/ HTTP/1.1\r\n"
+	"Host: User-Agent: Mozilla/5.0 Accept: */*\r\n"
+	"Content-Length: Connection: keep-alive\r\n"
+	" INFO  WARN  ERROR  DEBUG  TRACE [main] "
+	"Exception in thread \"main\" java.lang.NullPointerException\n"
+	"\tat java.base/java.lang.Thread.run(Thread.java:\n"
+	"Traceback (most recent call last):\n  File \"\", line \n"
+	"kernel: systemd[1]: Started Session of user root.\n"
+	"CREATE TABLE IF NOT EXISTS INSERT INTO VALUES ('', NULL, "
+	"SELECT * FROM WHERE AND ORDER BY LIMIT PRIMARY KEY NOT NULL "
+	"VARCHAR(255) INTEGER DEFAULT CURRENT_TIMESTAMP, "
+	"0000000000000000000000000000000000000000000000000000000000000000"
+	"                                                                "
+	"\"description\": \"\", \"status\": \"active\", "
+	"\"enabled\": true, \"deleted\": false, \"parent\": null, "
+	"\"created_at\": \"2026-01-01T00:00:00.000Z\", "
+	"\"updated_at\": \"2026-01-01T00:00:00Z\", "
+	"\"timestamp\": \"\", \"level\": \"info\", \"level\": \"error\", "
+	"\"message\": \"\", \"url\": \"https://\", \"email\": \"@gmail.com\", "
+	"\"count\": 0, \"total\": 0, \"price\": 0.00, \"value\": \"\", "
+	"\"data\": [{\"id\": \"\", \"name\": \"\", \"type\": \"\", "
+	"{\"id\":\"\",\"name\":\"\",\"type\":\"\",\"value\":\"\"},\n"
+	"{\"id\":1,\"name\":\"\",\"type\":null,\"value\":true},\n";
+
+/** The size of the dictionary, without the terminating null */
+static const int LZ4_DICTIONARY_SIZE = sizeof(LZ4_DICTIONARY) - 1;
+
+/**
+ * Check whether a compression format is provided by the kernel crypto API
+ * rather than by LZ4.
+ *
+ * @param format  The format to check
+ *
+ * @return <code>true</code> if the format is compressed through acomp
+ **/
+static bool is_acomp_format(enum vdo_compression_format format)
+{
+	return ((format != VDO_COMPRESSION_LZ4) &&
+		(format != VDO_COMPRESSION_LZ4_DICTIONARY));
+}
+
+/**********************************************************************/
+const char *get_vdo_compression_format_name(enum vdo_compression_format format)
+{
+	if (format >= VDO_COMPRESSION_FORMAT_COUNT) {
+		return "unknown";
+	}
+
+	return FORMAT_NAMES[format];
+}
+
+/**********************************************************************/
+int parse_vdo_compression_format(const char *name,
+				 enum vdo_compression_format *format_ptr)
+{
+	enum vdo_compression_format format;
+
+	for (format = 0; format < VDO_COMPRESSION_FORMAT_COUNT; format++) {
+		if (strcmp(name, FORMAT_NAMES[format]) == 0) {
+			*format_ptr = format;
+			return VDO_SUCCESS;
+		}
+	}
+
+	uds_log_error("optional parameter error: unknown compressor \"%s\"",
+		      name);
+	return VDO_BAD_CONFIGURATION;
+}
+
+/**
+ * Check whether a compression transform is provided by an asynchronous
+ * driver, such as a hardware offload device, rather than by software.
+ *
+ * @param transform  The transform to check
+ *
+ * @return <code>true</code> if the transform is asynchronous
+ **/
+static bool is_async_transform(struct crypto_acomp *transform)
+{
+	return ((crypto_acomp_tfm(transform)->__crt_alg->cra_flags
+		 & CRYPTO_ALG_ASYNC) != 0);
+}
+
+/**
+ * Make the offload requests for a compressor whose format is provided by an
+ * asynchronous driver.
+ *
+ * @param compressor  The compressor
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int make_offload_requests(struct vdo_compressor *compressor)
+{
+	struct crypto_acomp *transform = compressor->offload_transform;
+	unsigned int i;
+
+	for (i = 0; i < MAXIMUM_OFFLOAD_REQUESTS; i++) {
+		struct vdo_offload_request *offload;
+		int result = ALLOCATE(1, struct vdo_offload_request, __func__,
+				      &offload);
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
+
+		offload->compressor = compressor;
+		offload->request = acomp_request_alloc(transform);
+		if (offload->request == NULL) {
+			FREE(offload);
+			return -ENOMEM;
+		}
+
+		compressor->idle_offloads[compressor->idle_offload_count++] =
+			offload;
+	}
+
+	return VDO_SUCCESS;
+}
+
+/**
+ * Set up offloading for a compressor if the preferred driver for its format
+ * is asynchronous, such as a hardware offload device. The contexts never use
+ * that driver, so no CPU thread waits on it.
+ *
+ * @param compressor  The compressor
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int enable_offload(struct vdo_compressor *compressor)
+{
+	const char *name = FORMAT_NAMES[compressor->format];
+	struct crypto_acomp *transform = crypto_alloc_acomp(name, 0, 0);
+	int result;
+
+	if (IS_ERR(transform)) {
+		return VDO_SUCCESS;
+	}
+
+	if (!is_async_transform(transform)) {
+		crypto_free_acomp(transform);
+		return VDO_SUCCESS;
+	}
+
+	compressor->offload_transform = transform;
+	result = make_offload_requests(compressor);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	compressor->offload_enabled = true;
+	uds_log_info("%s compression is offloaded to %s", name,
+		     crypto_tfm_alg_driver_name(crypto_acomp_tfm(transform)));
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+int make_vdo_compressor(enum vdo_compression_format format,
+			struct kobject *parent,
+			struct vdo_compressor **compressor_ptr)
+{
+	enum vdo_compression_format other;
+	struct vdo_compressor *compressor;
+	int result = ALLOCATE(1, struct vdo_compressor, __func__, &compressor);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	compressor->format = format;
+	spin_lock_init(&compressor->offload_lock);
+	atomic64_set(&compressor->offloaded, 0);
+	atomic64_set(&compressor->offload_fallbacks, 0);
+	compressor->decompress_histogram =
+		make_logarithmic_histogram(parent,
+					   "decompress_time",
+					   "Fragment Decompression Time",
+					   "fragments",
+					   "time",
+					   "nanoseconds",
+					   DECOMPRESS_HISTOGRAM_LOG_SIZE);
+	if (compressor->decompress_histogram == NULL) {
+		free_vdo_compressor(compressor);
+		return -ENOMEM;
+	}
+
+	// Fragments in every format ever used may still be on disk, so
+	// decompressors are set up for all that are available, but only the
+	// configured format is required. Masking CRYPTO_ALG_ASYNC picks a
+	// synchronous implementation, which never waits on a device.
+	for (other = VDO_COMPRESSION_LZ4 + 1;
+	     other < VDO_COMPRESSION_FORMAT_COUNT;
+	     other++) {
+		struct crypto_acomp *transform;
+
+		if (!is_acomp_format(other)) {
+			continue;
+		}
+
+		transform = crypto_alloc_acomp(FORMAT_NAMES[other], 0,
+					       CRYPTO_ALG_ASYNC);
+		if (!IS_ERR(transform)) {
+			compressor->transforms[other] = transform;
+			continue;
+		}
+
+		if (other == format) {
+			free_vdo_compressor(compressor);
+			return log_error_strerror(PTR_ERR(transform),
+						  "cannot allocate %s compressor",
+						  FORMAT_NAMES[other]);
+		}
+
+		uds_log_info("%s decompression is not available",
+			     FORMAT_NAMES[other]);
+	}
+
+	if (is_acomp_format(format)) {
+		result = enable_offload(compressor);
+		if (result != VDO_SUCCESS) {
+			free_vdo_compressor(compressor);
+			return result;
+		}
+	}
+
+	*compressor_ptr = compressor;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_vdo_compressor(struct vdo_compressor *compressor)
+{
+	enum vdo_compression_format format;
+
+	if (compressor == NULL) {
+		return;
+	}
+
+	// Every offload request is idle once the device has been suspended.
+	while (compressor->idle_offload_count > 0) {
+		struct vdo_offload_request *offload =
+			compressor->idle_offloads[--compressor->idle_offload_count];
+		acomp_request_free(offload->request);
+		FREE(offload);
+	}
+
+	if (compressor->offload_transform != NULL) {
+		crypto_free_acomp(compressor->offload_transform);
+	}
+
+	for (format = 0; format < VDO_COMPRESSION_FORMAT_COUNT; format++) {
+		if (compressor->transforms[format] != NULL) {
+			crypto_free_acomp(compressor->transforms[format]);
+		}
+	}
+
+	free_histogram(&compressor->decompress_histogram);
+	FREE(compressor);
+}
+
+/**********************************************************************/
+int make_vdo_compressor_context(struct vdo_compressor *compressor,
+				struct vdo_compressor_context **context_ptr)
+{
+	enum vdo_compression_format format;
+	struct vdo_compressor_context *context;
+	int result = ALLOCATE(1, struct vdo_compressor_context, __func__,
+			      &context);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	context->compressor = compressor;
+	result = ALLOCATE(LZ4_MEM_COMPRESS, char, "LZ4 context",
+			  &context->lz4_context);
+	if (result != VDO_SUCCESS) {
+		free_vdo_compressor_context(context);
+		return result;
+	}
+
+	result = ALLOCATE(VDO_MAX_COMPRESSION_UNIT_BLOCKS * VDO_BLOCK_SIZE,
+			  char, "compression unit buffer",
+			  &context->unit_buffer);
+	if (result != VDO_SUCCESS) {
+		free_vdo_compressor_context(context);
+		return result;
+	}
+
+	if (compressor->format == VDO_COMPRESSION_LZ4_DICTIONARY) {
+		result = ALLOCATE(1, LZ4_stream_t, "LZ4 dictionary stream",
+				  &context->lz4_dictionary_stream);
+		if (result != VDO_SUCCESS) {
+			free_vdo_compressor_context(context);
+			return result;
+		}
+
+		LZ4_loadDict(context->lz4_dictionary_stream, LZ4_DICTIONARY,
+			     LZ4_DICTIONARY_SIZE);
+	}
+
+	for (format = 0; format < VDO_COMPRESSION_FORMAT_COUNT; format++) {
+		struct acomp_req *request;
+
+		if (compressor->transforms[format] == NULL) {
+			continue;
+		}
+
+		request = acomp_request_alloc(compressor->transforms[format]);
+		if (request == NULL) {
+			free_vdo_compressor_context(context);
+			return -ENOMEM;
+		}
+
+		context->requests[format] = request;
+	}
+
+	*context_ptr = context;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_vdo_compressor_context(struct vdo_compressor_context *context)
+{
+	enum vdo_compression_format format;
+
+	if (context == NULL) {
+		return;
+	}
+
+	for (format = 0; format < VDO_COMPRESSION_FORMAT_COUNT; format++) {
+		if (context->requests[format] != NULL) {
+			acomp_request_free(context->requests[format]);
+		}
+	}
+
+	FREE(context->unit_buffer);
+	FREE(context->lz4_dictionary_stream);
+	FREE(context->lz4_context);
+	FREE(context);
+}
+
+/**
+ * Run an acomp request on a synchronous transform, which finishes the request
+ * before returning.
+ *
+ * @param request           The request to run
+ * @param compress          <code>true</code> to compress, <code>false</code>
+ *                          to decompress
+ * @param source            The data to transform
+ * @param source_size       The size of the source data
+ * @param destination       The buffer for the result
+ * @param destination_size  The size of the destination buffer
+ * @param size_ptr          A pointer to hold the size of the result
+ *
+ * @return 0 or a negative error code
+ **/
+static int run_acomp_request(struct acomp_req *request,
+			     bool compress,
+			     const char *source,
+			     unsigned int source_size,
+			     char *destination,
+			     unsigned int destination_size,
+			     unsigned int *size_ptr)
+{
+	struct scatterlist source_list, destination_list;
+	int result;
+
+	sg_init_one(&source_list, source, source_size);
+	sg_init_one(&destination_list, destination, destination_size);
+	acomp_request_set_params(request, &source_list, &destination_list,
+				 source_size, destination_size);
+	result = (compress
+		  ? crypto_acomp_compress(request)
+		  : crypto_acomp_decompress(request));
+	if (result != 0) {
+		return result;
+	}
+
+	*size_ptr = request->dlen;
+	return 0;
+}
+
+/**
+ * Compress data in the configured format.
+ *
+ * @param context       The compressor context of the calling thread
+ * @param data          The data to compress
+ * @param data_size     The size of the data
+ * @param buffer        The buffer to hold the compressed data
+ * @param buffer_size   The size of the buffer
+ * @param acceleration  The LZ4 acceleration factor
+ *
+ * @return The compressed size, or 0 if the data did not compress to less
+ *         than the size of the buffer
+ **/
+static int compress_data(struct vdo_compressor_context *context,
+			 const char *data,
+			 unsigned int data_size,
+			 char *buffer,
+			 unsigned int buffer_size,
+			 int acceleration)
+{
+	enum vdo_compression_format format = context->compressor->format;
+	unsigned int size;
+	int result;
+
+	if (format == VDO_COMPRESSION_LZ4) {
+		return LZ4_compress_fast(data, buffer, data_size, buffer_size,
+					 acceleration, context->lz4_context);
+	}
+
+	if (format == VDO_COMPRESSION_LZ4_DICTIONARY) {
+		LZ4_stream_t *stream = (LZ4_stream_t *) context->lz4_context;
+
+		memcpy(stream, context->lz4_dictionary_stream,
+		       sizeof(LZ4_stream_t));
+		return LZ4_compress_fast_continue(stream, data, buffer,
+						  data_size, buffer_size,
+						  acceleration);
+	}
+
+	// Any failure, most likely a full destination buffer, just means the
+	// data will be written uncompressed.
+	result = run_acomp_request(context->requests[format], true, data,
+				   data_size, buffer, buffer_size, &size);
+	if ((result != 0) || (size >= buffer_size)) {
+		return 0;
+	}
+
+	return size;
+}
+
+/**********************************************************************/
+int vdo_compress_block(struct vdo_compressor_context *context,
+		       const char *block,
+		       char *buffer,
+		       int acceleration)
+{
+	return compress_data(context, block, VDO_BLOCK_SIZE, buffer,
+			     VDO_BLOCK_SIZE, acceleration);
+}
+
+/**********************************************************************/
+int vdo_compress_unit(struct vdo_compressor_context *context,
+		      const char *blocks[],
+		      unsigned int block_count,
+		      char *buffer,
+		      unsigned int buffer_size,
+		      int acceleration)
+{
+	unsigned int i;
+
+	for (i = 0; i < block_count; i++) {
+		memcpy(context->unit_buffer + (i * VDO_BLOCK_SIZE), blocks[i],
+		       VDO_BLOCK_SIZE);
+	}
+
+	return compress_data(context, context->unit_buffer,
+			     block_count * VDO_BLOCK_SIZE, buffer, buffer_size,
+			     acceleration);
+}
+
+/**
+ * Return an offload request to the idle stack.
+ *
+ * @param offload  The request which is no longer in use
+ **/
+static void release_offload_request(struct vdo_offload_request *offload)
+{
+	struct vdo_compressor *compressor = offload->compressor;
+	unsigned long flags;
+
+	spin_lock_irqsave(&compressor->offload_lock, flags);
+	compressor->idle_offloads[compressor->idle_offload_count++] = offload;
+	spin_unlock_irqrestore(&compressor->offload_lock, flags);
+}
+
+/**
+ * Finish an offloaded compression. This is the completion function of the
+ * acomp request, so it may run in interrupt context.
+ *
+ * @param base   The finished request
+ * @param error  The result of the compression
+ **/
+static void offload_done(struct crypto_async_request *base, int error)
+{
+	struct vdo_offload_request *offload = base->data;
+	unsigned int size = offload->request->dlen;
+	vdo_offload_callback *callback = offload->callback;
+	void *context = offload->context;
+
+	release_offload_request(offload);
+	// As with synchronous compression, any failure just means the block
+	// will be written uncompressed.
+	callback(context,
+		 (((error == 0) && (size < VDO_BLOCK_SIZE)) ? size : 0));
+}
+
+/**********************************************************************/
+bool vdo_offload_compression(struct vdo_compressor *compressor,
+			     const char *block,
+			     char *buffer,
+			     vdo_offload_callback *callback,
+			     void *context)
+{
+	struct vdo_offload_request *offload = NULL;
+	unsigned long flags;
+	int result;
+
+	if (!compressor->offload_enabled) {
+		return false;
+	}
+
+	spin_lock_irqsave(&compressor->offload_lock, flags);
+	if (compressor->idle_offload_count > 0) {
+		offload =
+			compressor->idle_offloads[--compressor->idle_offload_count];
+	}
+	spin_unlock_irqrestore(&compressor->offload_lock, flags);
+	if (offload == NULL) {
+		atomic64_inc(&compressor->offload_fallbacks);
+		return false;
+	}
+
+	offload->callback = callback;
+	offload->context = context;
+	sg_init_one(&offload->source, block, VDO_BLOCK_SIZE);
+	sg_init_one(&offload->destination, buffer, VDO_BLOCK_SIZE);
+	acomp_request_set_params(offload->request, &offload->source,
+				 &offload->destination, VDO_BLOCK_SIZE,
+				 VDO_BLOCK_SIZE);
+	// Without CRYPTO_TFM_REQ_MAY_BACKLOG, a full device queue rejects
+	// the request rather than holding it.
+	acomp_request_set_callback(offload->request, 0, offload_done,
+				   offload);
+	result = crypto_acomp_compress(offload->request);
+	if (result == -EINPROGRESS) {
+		atomic64_inc(&compressor->offloaded);
+		return true;
+	}
+
+	if (result == -EBUSY) {
+		release_offload_request(offload);
+		atomic64_inc(&compressor->offload_fallbacks);
+		return false;
+	}
+
+	// The driver finished synchronously; report the result without
+	// making the caller compress the block again.
+	atomic64_inc(&compressor->offloaded);
+	offload_done(&offload->request->base, result);
+	return true;
+}
+
+/**********************************************************************/
+void get_vdo_compressor_offload_statistics(struct vdo_compressor *compressor,
+					   uint64_t *offloaded_ptr,
+					   uint64_t *fallbacks_ptr)
+{
+	*offloaded_ptr = atomic64_read(&compressor->offloaded);
+	*fallbacks_ptr = atomic64_read(&compressor->offload_fallbacks);
+}
+
+/**
+ * Decompress a fragment of a compressed block with the decompressor for its
+ * format.
+ *
+ * @param [in]  context           The compressor context of the calling
+ *                                thread
+ * @param [in]  format            The format of the fragment
+ * @param [in]  fragment          The compressed fragment
+ * @param [in]  size              The size of the fragment
+ * @param [in]  destination       The buffer to hold the decompressed data
+ * @param [in]  destination_size  The size of the destination buffer
+ * @param [out] decompressed_ptr  A pointer to hold the decompressed size
+ *
+ * @return VDO_SUCCESS or VDO_INVALID_FRAGMENT
+ **/
+static int decompress_fragment(struct vdo_compressor_context *context,
+			       enum vdo_compression_format format,
+			       const char *fragment,
+			       uint16_t size,
+			       char *destination,
+			       unsigned int destination_size,
+			       unsigned int *decompressed_ptr)
+{
+	struct acomp_req *request;
+	int result;
+
+	if (format == VDO_COMPRESSION_LZ4) {
+		result = LZ4_decompress_safe(fragment, destination, size,
+					     destination_size);
+		if (result <= 0) {
+			uds_log_debug("%s: lz4 error", __func__);
+			return VDO_INVALID_FRAGMENT;
+		}
+
+		*decompressed_ptr = result;
+		return VDO_SUCCESS;
+	}
+
+	if (format == VDO_COMPRESSION_LZ4_DICTIONARY) {
+		result = LZ4_decompress_safe_usingDict(fragment, destination,
+						       size, destination_size,
+						       LZ4_DICTIONARY,
+						       LZ4_DICTIONARY_SIZE);
+		if (result <= 0) {
+			uds_log_debug("%s: lz4 dictionary error", __func__);
+			return VDO_INVALID_FRAGMENT;
+		}
+
+		*decompressed_ptr = result;
+		return VDO_SUCCESS;
+	}
+
+	request = context->requests[format];
+	if (request == NULL) {
+		uds_log_debug("%s: no %s decompressor", __func__,
+			      FORMAT_NAMES[format]);
+		return VDO_INVALID_FRAGMENT;
+	}
+
+	result = run_acomp_request(request, false, fragment, size,
+				   destination, destination_size,
+				   decompressed_ptr);
+	if (result != 0) {
+		uds_log_debug("%s: %s error %d", __func__,
+			      FORMAT_NAMES[format], result);
+		return VDO_INVALID_FRAGMENT;
+	}
+
+	return VDO_SUCCESS;
+}
+
+/**
+ * Decompress one block of a fragment. A fragment holding a single block is
+ * decompressed directly into the block; one holding a compression unit is
+ * decompressed into the context's unit buffer and the wanted block copied out.
+ *
+ * @param context     The compressor context of the calling thread
+ * @param format      The format of the fragment
+ * @param fragment    The compressed fragment
+ * @param size        The size of the fragment
+ * @param unit_block  The index of the wanted block in the fragment
+ * @param block       A block-sized buffer to hold the decompressed data
+ *
+ * @return VDO_SUCCESS or VDO_INVALID_FRAGMENT
+ **/
+static int decompress_block(struct vdo_compressor_context *context,
+			    enum vdo_compression_format format,
+			    const char *fragment,
+			    uint16_t size,
+			    unsigned int unit_block,
+			    char *block)
+{
+	unsigned int decompressed_size;
+	int result;
+
+	if (unit_block == 0) {
+		result = decompress_fragment(context, format, fragment, size,
+					     block, VDO_BLOCK_SIZE,
+					     &decompressed_size);
+		if ((result == VDO_SUCCESS)
+		    && (decompressed_size == VDO_BLOCK_SIZE)) {
+			return VDO_SUCCESS;
+		}
+	}
+
+	// The fragment is (or may be) a unit, which does not fit in a block.
+	result = decompress_fragment(context, format, fragment, size,
+				     context->unit_buffer,
+				     (VDO_MAX_COMPRESSION_UNIT_BLOCKS
+				      * VDO_BLOCK_SIZE),
+				     &decompressed_size);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	if (((decompressed_size % VDO_BLOCK_SIZE) != 0)
+	    || (decompressed_size <= (unit_block * VDO_BLOCK_SIZE))) {
+		uds_log_debug("%s: %u bytes has no block %u", __func__,
+			      decompressed_size, unit_block);
+		return VDO_INVALID_FRAGMENT;
+	}
+
+	memcpy(block, context->unit_buffer + (unit_block * VDO_BLOCK_SIZE),
+	       VDO_BLOCK_SIZE);
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+int vdo_decompress_fragment(struct vdo_compressor_context *context,
+			    enum vdo_compression_format format,
+			    const char *fragment,
+			    uint16_t size,
+			    unsigned int unit_block,
+			    char *block)
+{
+	uint64_t start_time = ktime_get_ns();
+	int result = decompress_block(context, format, fragment, size,
+				      unit_block, block);
+
+	enter_histogram_sample(context->compressor->decompress_histogram,
+			       ktime_get_ns() - start_time);
+	return result;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <linux/kobject.h>
+
+#include "compressedBlock.h"
+
+/**
+ * A vdo_compressor compresses data blocks in the format a device was
+ * configured with, and decompresses fragments in any format it has a
+ * decompressor for. LZ4 uses the vendored implementation; the other formats
+ * use the software implementations of the kernel's compression (acomp) API,
+ * so compressing or decompressing on a thread never waits. A hardware
+ * offload driver registered for the configured format is only used through
+ * vdo_offload_compression(), which calls back when the device is done.
+ **/
+struct vdo_compressor;
+
+/**
+ * The per-thread state for using a vdo_compressor. Each thread which
+ * compresses or decompresses must use its own context.
+ **/
+struct vdo_compressor_context;
+
+/**
+ * Get the name of a compression format, as used in the device table.
+ *
+ * @param format  The format
+ *
+ * @return The name of the format
+ **/
+const char * __must_check
+get_vdo_compression_format_name(enum vdo_compression_format format);
+
+/**
+ * Parse the name of a compression format.
+ *
+ * @param name        The name to parse
+ * @param format_ptr  A pointer to hold the format
+ *
+ * @return VDO_SUCCESS or VDO_BAD_CONFIGURATION
+ **/
+int __must_check
+parse_vdo_compression_format(const char *name,
+			     enum vdo_compression_format *format_ptr);
+
+/**
+ * Make a compressor.
+ *
+ * @param format          The format in which to compress
+ * @param parent          The kobject under which to publish the time taken
+ *                        by decompression
+ * @param compressor_ptr  A pointer to hold the new compressor
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check make_vdo_compressor(enum vdo_compression_format format,
+				     struct kobject *parent,
+				     struct vdo_compressor **compressor_ptr);
+
+/**
+ * Free a compressor. All of its contexts must already have been freed.
+ *
+ * @param compressor  The compressor to free (may be NULL)
+ **/
+void free_vdo_compressor(struct vdo_compressor *compressor);
+
+/**
+ * Make a per-thread context for a compressor.
+ *
+ * @param compressor   The compressor
+ * @param context_ptr  A pointer to hold the new context
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check
+make_vdo_compressor_context(struct vdo_compressor *compressor,
+			    struct vdo_compressor_context **context_ptr);
+
+/**
+ * Free a compressor context.
+ *
+ * @param context  The context to free (may be NULL)
+ **/
+void free_vdo_compressor_context(struct vdo_compressor_context *context);
+
+/**
+ * Compress a data block on the calling thread.
+ *
+ * @param context       The compressor context of the calling thread
+ * @param block         The data block to compress
+ * @param buffer        A block-sized buffer to hold the compressed data
+ * @param acceleration  The LZ4 acceleration factor (ignored by other
+ *                      formats)
+ *
+ * @return The compressed size, or 0 if the data did not compress to less
+ *         than a block
+ **/
+int __must_check vdo_compress_block(struct vdo_compressor_context *context,
+				    const char *block,
+				    char *buffer,
+				    int acceleration);
+
+/**
+ * Compress several logically consecutive blocks together as one fragment.
+ *
+ * @param context       The compressor context of the calling thread
+ * @param blocks        The data blocks, in logical order
+ * @param block_count   The number of blocks, at most
+ *                      VDO_MAX_COMPRESSION_UNIT_BLOCKS
+ * @param buffer        The buffer to hold the compressed data
+ * @param buffer_size   The size of the buffer
+ * @param acceleration  The LZ4 acceleration factor (ignored by other
+ *                      formats)
+ *
+ * @return The compressed size, or 0 if the data did not compress to less
+ *         than the size of the buffer
+ **/
+int __must_check vdo_compress_unit(struct vdo_compressor_context *context,
+				   const char *blocks[],
+				   unsigned int block_count,
+				   char *buffer,
+				   unsigned int buffer_size,
+				   int acceleration);
+
+/**
+ * The function called when an offloaded compression finishes. It may be
+ * called in interrupt context.
+ *
+ * @param context  The context passed to vdo_offload_compression()
+ * @param size     The compressed size, or 0 if the data did not compress to
+ *                 less than a block
+ **/
+typedef void vdo_offload_callback(void *context, int size);
+
+/**
+ * Submit a data block for compression by an asynchronous offload device. If
+ * the compression format is not offloaded, or the device cannot accept more
+ * work, nothing is submitted and the caller should compress the block with
+ * vdo_compress_block() instead; all fragments in a compressed block must
+ * share one format, so the fallback is the same format on the CPU.
+ *
+ * @param compressor  The compressor
+ * @param block       The data block to compress
+ * @param buffer      A block-sized buffer to hold the compressed data
+ * @param callback    The function to call when the compression finishes
+ * @param context     The context for the callback
+ *
+ * @return <code>true</code> if the block was submitted, in which case the
+ *         callback will be (or has already been) called
+ **/
+bool __must_check vdo_offload_compression(struct vdo_compressor *compressor,
+					  const char *block,
+					  char *buffer,
+					  vdo_offload_callback *callback,
+					  void *context);
+
+/**
+ * Get the offloaded compression counts of a compressor.
+ *
+ * @param [in]  compressor     The compressor
+ * @param [out] offloaded_ptr  A pointer to hold the number of blocks
+ *                             compressed by an offload device
+ * @param [out] fallbacks_ptr  A pointer to hold the number of blocks
+ *                             compressed on the CPU because the offload
+ *                             device was busy
+ **/
+void get_vdo_compressor_offload_statistics(struct vdo_compressor *compressor,
+					   uint64_t *offloaded_ptr,
+					   uint64_t *fallbacks_ptr);
+
+/**
+ * Decompress a fragment of a compressed block.
+ *
+ * @param context     The compressor context of the calling thread
+ * @param format      The format of the fragment
+ * @param fragment    The compressed fragment
+ * @param size        The size of the fragment
+ * @param unit_block  The index of the wanted block among those compressed
+ *                    together in the fragment
+ * @param block       A block-sized buffer to hold the decompressed data
+ *
+ * @return VDO_SUCCESS or VDO_INVALID_FRAGMENT
+ **/
+int __must_check
+vdo_decompress_fragment(struct vdo_compressor_context *context,
+			enum vdo_compression_format format,
+			const char *fragment,
+			uint16_t size,
+			unsigned int unit_block,
+			char *block);
+
+#endif // COMPRESSOR_H
@@ -78,6 +78,14 @@ enum {
 	/** The maximum number of VIOs in the system at once */
 	MAXIMUM_VDO_USER_VIOS = 2048,
 
+	/**
+	 * The maximum number of logical blocks which may be covered by a
+	 * single incoming bio. Larger bios are split by device-mapper before
+	 * they reach VDO; multi-block bios are split into one data_vio per
+	 * block when they are mapped.
+	 **/
+	MAXIMUM_VDO_BIO_BLOCKS = 256,
+
 	/**
 	 * The number of in-memory recovery journal blocks is determined by:
 	 * -- 311 journal entries in a 4k block
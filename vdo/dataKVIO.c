@@ -21,23 +21,39 @@
 
 #include "dataKVIO.h"
 
-#include <asm/unaligned.h>
-#include <linux/lz4.h>
+#include <crypto/hash.h>
+#include <linux/bitops.h>
+#include <linux/ktime.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,11,0)
+#include <crypto/sha2.h>
+#else
+#include <crypto/sha.h>
+#endif
 
 #include "logger.h"
 #include "memoryAlloc.h"
 #include "murmur/MurmurHash3.h"
 #include "permassert.h"
 
+#include "blockMap.h"
 #include "compressedBlock.h"
 #include "dataVIO.h"
 #include "hashLock.h"
 #include "physicalLayer.h"
+#include "readCache.h"
 
+#include "accessTrace.h"
 #include "bio.h"
+#include "blockCompare.h"
+#include "compressibility.h"
+#include "dedupeExemptions.h"
 #include "dedupeIndex.h"
 #include "kvio.h"
 #include "ioSubmitter.h"
+#include "postDedupe.h"
+#include "qosClasses.h"
+#include "requestGovernor.h"
 #include "vdoCommon.h"
 
 static void dump_pooled_data_vio(void *data);
@@ -77,6 +93,91 @@ static void dump_pooled_data_vio(void *data);
 static unsigned int PASSTHROUGH_FLAGS =
 	(REQ_PRIO | REQ_META | REQ_SYNC | REQ_RAHEAD);
 
+enum {
+	/**
+	 * A compression batch this small means the CPU queue is keeping up,
+	 * so any extra LZ4 acceleration can be backed off.
+	 **/
+	CPU_QUEUE_IDLE_BATCH_SIZE = CPU_QUEUE_BATCH_SIZE / 4,
+	/**
+	 * The stride, in bytes, between the bytes sampled when estimating
+	 * compressibility. It is odd so that the samples do not alias with
+	 * word-structured data.
+	 **/
+	COMPRESSIBILITY_SAMPLE_STRIDE = 7,
+	/**
+	 * The number of distinct sampled byte values above which a block is
+	 * assumed to be incompressible. Uniformly random data yields about 230
+	 * distinct values from the 586 samples taken; text and most structured
+	 * data yield far fewer.
+	 **/
+	INCOMPRESSIBLE_DISTINCT_BYTE_COUNT = 200,
+	/**
+	 * The number of bios per bio ack thread which may be waiting to be
+	 * acknowledged before the threads are considered to be falling
+	 * behind, and bios are instead acknowledged where they complete.
+	 **/
+	BIO_ACK_BACKLOG_PER_THREAD = 256,
+	/** The number of stage histogram buckets (up to 10^7 microseconds) */
+	STAGE_HISTOGRAM_LOG_SIZE = 7,
+};
+
+/**
+ * The sysfs names and labels of the data_vio stage latency histograms,
+ * indexed by the milestone which ends each stage.
+ **/
+static const struct {
+	const char *name;
+	const char *label;
+} STAGE_HISTOGRAMS[DATA_VIO_MILESTONE_COUNT] = {
+	[DATA_VIO_HASHED] = {
+		.name = "hash_latency",
+		.label = "Data VIO Hash Stage Latency",
+	},
+	[DATA_VIO_ADVISED] = {
+		.name = "dedupe_advice_latency",
+		.label = "Data VIO Dedupe Advice Stage Latency",
+	},
+	[DATA_VIO_ALLOCATED] = {
+		.name = "allocation_latency",
+		.label = "Data VIO Allocation Stage Latency",
+	},
+	[DATA_VIO_WRITTEN] = {
+		.name = "data_write_latency",
+		.label = "Data VIO Data Write Stage Latency",
+	},
+	[DATA_VIO_JOURNALED] = {
+		.name = "journal_commit_latency",
+		.label = "Data VIO Journal Commit Stage Latency",
+	},
+	[DATA_VIO_MAPPED] = {
+		.name = "block_map_update_latency",
+		.label = "Data VIO Block Map Update Stage Latency",
+	},
+	[DATA_VIO_ACKNOWLEDGED] = {
+		.name = "acknowledgment_latency",
+		.label = "Data VIO Acknowledgment Stage Latency",
+	},
+};
+
+/**
+ * The latency histograms of the stages of the data_vio lifecycle. Each stage
+ * ends at a milestone, and begins at the latest earlier milestone the
+ * data_vio reached (or at its launch).
+ **/
+struct data_vio_stage_histograms {
+	/** The sysfs directory holding the histograms */
+	struct kobject *directory;
+	/** The histograms, indexed by the milestone ending each stage */
+	struct histogram *histograms[DATA_VIO_MILESTONE_COUNT];
+};
+
+/** The flags recording which of a data_vio's buffers are pooled */
+enum {
+	POOLED_READ_BUFFER = 0x01,
+	POOLED_SCRATCH_BLOCK = 0x02,
+};
+
 enum {
 	WRITE_PROTECT_FREE_POOL = 0,
 	WP_DATA_VIO_SIZE =
@@ -117,6 +218,7 @@ static void vdo_acknowledge_data_vio(struct data_vio *data_vio)
 		return;
 	}
 	data_vio->user_bio = NULL;
+	record_data_vio_milestone(data_vio, DATA_VIO_ACKNOWLEDGED);
 
 	count_bios(&layer->bios_acknowledged, bio);
 	if (data_vio->is_partial) {
@@ -127,11 +229,75 @@ static void vdo_acknowledge_data_vio(struct data_vio *data_vio)
 	complete_bio(bio, error);
 }
 
+/**
+ * Get a block-sized buffer for a data_vio if it does not already have one.
+ * The buffer is taken from the layer's block buffer pool if possible, or else
+ * allocated without sleeping.
+ *
+ * @param data_vio    The data_vio needing the buffer
+ * @param buffer_ptr  The data_vio's pointer to the buffer
+ * @param flag        The flag marking this buffer as pooled
+ *
+ * @return VDO_SUCCESS or -ENOMEM
+ **/
+static int acquire_block_buffer(struct data_vio *data_vio,
+				char **buffer_ptr,
+				uint8_t flag)
+{
+	struct kernel_layer *layer
+		= vdo_as_kernel_layer(get_vdo_from_data_vio(data_vio));
+
+	if (*buffer_ptr != NULL) {
+		return VDO_SUCCESS;
+	}
+
+	if (alloc_buffer_from_pool(layer->block_buffer_pool,
+				   (void **) buffer_ptr) == VDO_SUCCESS) {
+		data_vio->pooled_buffers |= flag;
+		return VDO_SUCCESS;
+	}
+
+	*buffer_ptr = allocate_memory_nowait(VDO_BLOCK_SIZE, "vio block");
+	return ((*buffer_ptr == NULL) ? -ENOMEM : VDO_SUCCESS);
+}
+
+/**
+ * Give back a block-sized buffer taken by acquire_block_buffer().
+ *
+ * @param data_vio    The data_vio holding the buffer
+ * @param buffer_ptr  The data_vio's pointer to the buffer
+ * @param flag        The flag marking this buffer as pooled
+ **/
+static void release_block_buffer(struct data_vio *data_vio,
+				 char **buffer_ptr,
+				 uint8_t flag)
+{
+	struct kernel_layer *layer
+		= vdo_as_kernel_layer(get_vdo_from_data_vio(data_vio));
+
+	if (*buffer_ptr == NULL) {
+		return;
+	}
+
+	if ((data_vio->pooled_buffers & flag) != 0) {
+		free_buffer_to_pool(layer->block_buffer_pool, *buffer_ptr);
+	} else {
+		FREE(*buffer_ptr);
+	}
+
+	*buffer_ptr = NULL;
+	data_vio->pooled_buffers &= ~flag;
+}
+
 /**********************************************************************/
 static noinline void clean_data_vio(struct data_vio *data_vio,
 				    struct free_buffer_pointers *fbp)
 {
 	vdo_acknowledge_data_vio(data_vio);
+	release_block_buffer(data_vio, &data_vio->read_block.buffer,
+			     POOLED_READ_BUFFER);
+	release_block_buffer(data_vio, &data_vio->scratch_block,
+			     POOLED_SCRATCH_BLOCK);
 	add_free_buffer_pointer(fbp, data_vio);
 }
 
@@ -143,6 +309,7 @@ void return_data_vio_batch_to_pool(struct batch_processor *batch,
 	struct vdo_work_item *item;
 	struct kernel_layer *layer = closure;
 	uint32_t count = 0;
+	uint32_t writes = 0;
 
 	ASSERT_LOG_ONLY(batch != NULL, "batch not null");
 	ASSERT_LOG_ONLY(layer != NULL, "layer not null");
@@ -151,7 +318,19 @@ void return_data_vio_batch_to_pool(struct batch_processor *batch,
 	init_free_buffer_pointers(&fbp, layer->data_vio_pool);
 
 	while ((item = next_batch_item(batch)) != NULL) {
-		clean_data_vio(work_item_as_data_vio(item), &fbp);
+		struct data_vio *data_vio = work_item_as_data_vio(item);
+
+		record_request_latency(layer->vdo.request_governor,
+				       data_vio->launch_time);
+		record_data_vio_stages(layer->stage_histograms, data_vio);
+		trace_data_vio_access(layer->access_trace, data_vio);
+		if (data_vio->has_write_permit) {
+			writes++;
+		}
+		if (data_vio->qos_class != NULL) {
+			limiter_release(&data_vio->qos_class->limiter);
+		}
+		clean_data_vio(data_vio, &fbp);
 		cond_resched_batch_processor(batch);
 		count++;
 	}
@@ -160,9 +339,81 @@ void return_data_vio_batch_to_pool(struct batch_processor *batch,
 		free_buffer_pointers(&fbp);
 	}
 
+	if (writes > 0) {
+		limiter_release_many(&layer->vdo.write_limiter, writes);
+	}
+
+	update_request_governor(layer->vdo.request_governor);
+
 	complete_many_requests(&layer->vdo, count);
 }
 
+/**
+ * Acknowledge the bio of a data_vio on a bio ack thread. The bio ack threads
+ * take bios in batches, so a thread wakes only when the batch it serves is
+ * idle. If the threads are falling behind, the work is simply done on the
+ * current thread instead, as it would be without bio ack threads.
+ *
+ * @param data_vio  The data_vio whose bio is to be acknowledged
+ * @param work      The function which acknowledges the bio and continues
+ *                  the data_vio
+ **/
+static void launch_data_vio_ack(struct data_vio *data_vio,
+				vdo_work_function work)
+{
+	struct vio *vio = data_vio_as_vio(data_vio);
+	struct kernel_layer *layer = vdo_as_kernel_layer(vio->vdo);
+	unsigned int threads = layer->bio_ack_batcher_count;
+	struct vdo_work_item *item = work_item_from_data_vio(data_vio);
+	unsigned int batcher;
+
+	if (atomic_read(&layer->bio_acks_pending) >=
+	    (threads * BIO_ACK_BACKLOG_PER_THREAD)) {
+		work(item);
+		return;
+	}
+
+	setup_vio_work(vio, work, NULL, BIO_ACK_Q_ACTION_ACK);
+	atomic_inc(&layer->bio_acks_pending);
+	batcher = select_batch_processor(data_vio->logical.lbn, threads);
+	add_to_batch_processor(layer->bio_ack_batchers[batcher], item);
+}
+
+/**********************************************************************/
+void acknowledge_data_vio_batch(struct batch_processor *batch, void *closure)
+{
+	struct kernel_layer *layer = closure;
+	struct vdo_work_item *item;
+	int count = 0;
+
+	while ((item = next_batch_item(batch)) != NULL) {
+		item->work(item);
+		cond_resched_batch_processor(batch);
+		count++;
+	}
+
+	atomic_sub(count, &layer->bio_acks_pending);
+}
+
+/**********************************************************************/
+void acknowledge_shared_data_vio_batch(struct batch_processor *batch,
+				       void *closure __always_unused)
+{
+	struct vdo_work_item *item;
+
+	while ((item = next_batch_item(batch)) != NULL) {
+		struct data_vio *data_vio = work_item_as_data_vio(item);
+		struct kernel_layer *layer =
+			vdo_as_kernel_layer(get_vdo_from_data_vio(data_vio));
+
+		// Count the ack before doing it, since the layer may go away
+		// as soon as its last data_vio has been acknowledged.
+		atomic_dec(&layer->bio_acks_pending);
+		item->work(item);
+		cond_resched_batch_processor(batch);
+	}
+}
+
 /**********************************************************************/
 static void
 vdo_acknowledge_and_batch(struct vdo_work_item *item)
@@ -183,10 +434,7 @@ static void vdo_complete_data_vio(struct vdo_completion *completion)
 
 	if (use_bio_ack_queue(vdo) && USE_BIO_ACK_QUEUE_FOR_READ &&
 	    (data_vio->user_bio != NULL)) {
-		launch_data_vio_on_bio_ack_queue(data_vio,
-						 vdo_acknowledge_and_batch,
-						 NULL,
-						 BIO_ACK_Q_ACTION_ACK);
+		launch_data_vio_ack(data_vio, vdo_acknowledge_and_batch);
 	} else {
 		add_to_batch_processor(layer->data_vio_releaser,
 				       &completion->work_item);
@@ -194,7 +442,29 @@ static void vdo_complete_data_vio(struct vdo_completion *completion)
 }
 
 /**
- * For a read, dispatch the freshly uncompressed data to its destination:
+ * Get the address of the data of a full-block bio if that data is a single
+ * directly mapped page, so that it can be used without copying.
+ *
+ * @param bio  The bio
+ *
+ * @return The address of the bio's data, or NULL if it must be copied
+ **/
+static char *get_bio_block_data(struct bio *bio)
+{
+	struct bio_vec bvec = bio_iter_iovec(bio, bio->bi_iter);
+
+	if ((bvec.bv_offset != 0) ||
+	    (bvec.bv_len != VDO_BLOCK_SIZE) ||
+	    PageHighMem(bvec.bv_page)) {
+		return NULL;
+	}
+
+	return page_address(bvec.bv_page);
+}
+
+/**
+ * For a read, dispatch the freshly read or uncompressed data to its
+ * destination, caching it first if it is a widely shared uncompressed block:
  * - for a 4k read, copy it into the user bio for later acknowlegement;
  *
  * - for a partial read, invoke its callback; vdo_complete_partial_read will
@@ -212,6 +482,15 @@ static void vdo_complete_data_vio(struct vdo_completion *completion)
 static void copy_read_block_data(struct vdo_work_item *work_item)
 {
 	struct data_vio *data_vio = work_item_as_data_vio(work_item);
+	struct read_block *read_block = &data_vio->read_block;
+
+	// A compressed block was cached when it was uncompressed.
+	if (!is_compressed(read_block->mapping_state) &&
+	    !read_block->from_cache) {
+		read_cache_store(data_vio_as_vio(data_vio)->vdo->read_cache,
+				 read_block->pbn,
+				 read_block->data);
+	}
 
 	// For a read-modify-write, copy the data into the data_block buffer so
 	// it will be set up for the write phase.
@@ -229,8 +508,16 @@ static void copy_read_block_data(struct vdo_work_item *work_item)
 		return;
 	}
 
-	// For a 4k read, copy the data to the user bio and acknowledge.
-	bio_copy_data_out(data_vio->user_bio, data_vio->read_block.data);
+	// For a 4k read, copy the data to the user bio, unless it was
+	// uncompressed directly into it, and acknowledge.
+	if (data_vio->read_block.data ==
+	    get_bio_block_data(data_vio->user_bio)) {
+		flush_dcache_page(bio_page(data_vio->user_bio));
+	} else {
+		bio_copy_data_out(data_vio->user_bio,
+				  data_vio->read_block.data);
+	}
+
 	acknowledge_data_vio(data_vio);
 }
 
@@ -269,17 +556,40 @@ static void uncompress_read_block(struct vdo_work_item *work_item)
 							 work_item);
 	struct data_vio *data_vio = work_item_as_data_vio(work_item);
 	struct read_block *read_block = &data_vio->read_block;
-	int size;
+	struct cpu_queue_context *context = get_work_queue_private_data();
+	enum vdo_compression_format format;
 
-	// The data_vio's scratch block will be used to contain the
-	// uncompressed data.
+	// A 4k read is uncompressed directly into the user bio's page if
+	// possible; otherwise, the data_vio's scratch block will be used to
+	// contain the uncompressed data.
+	char *uncompressed_data = NULL;
 	uint16_t fragment_offset, fragment_size;
+	unsigned int unit_block;
 	char *compressed_data = read_block->data;
-	int result = get_vdo_compressed_block_fragment(read_block->mapping_state,
+	int result;
+
+	// Hand the block to the reads of its other fragments before
+	// uncompressing this one, whether or not the read succeeded.
+	if (read_block->filling) {
+		struct vdo *vdo = data_vio_as_vio(data_vio)->vdo;
+
+		read_cache_finish_fill(vdo->read_cache,
+				       read_block->pbn,
+				       ((read_block->status == VDO_SUCCESS) ?
+					compressed_data : NULL));
+		if (read_block->status != VDO_SUCCESS) {
+			read_block->callback(completion);
+			return;
+		}
+	}
+
+	result = get_vdo_compressed_block_fragment(read_block->mapping_state,
 						       compressed_data,
 						       VDO_BLOCK_SIZE,
 						       &fragment_offset,
-						       &fragment_size);
+						       &fragment_size,
+						       &format,
+						       &unit_block);
 	if (result != VDO_SUCCESS) {
 		uds_log_debug("%s: frag err %d", __func__, result);
 		read_block->status = result;
@@ -287,14 +597,46 @@ static void uncompress_read_block(struct vdo_work_item *work_item)
 		return;
 	}
 
-	size = LZ4_decompress_safe((compressed_data + fragment_offset),
-				   data_vio->scratch_block, fragment_size,
-				   VDO_BLOCK_SIZE);
-	if (size == VDO_BLOCK_SIZE) {
-		read_block->data = data_vio->scratch_block;
+	if (is_read_vio(data_vio_as_vio(data_vio)) && !data_vio->is_partial) {
+		char *bio_data = get_bio_block_data(data_vio->user_bio);
+
+		if (bio_data != NULL) {
+			uncompressed_data = bio_data;
+		}
+	}
+
+	if (uncompressed_data == NULL) {
+		result = acquire_block_buffer(data_vio,
+					      &data_vio->scratch_block,
+					      POOLED_SCRATCH_BLOCK);
+		if (result != VDO_SUCCESS) {
+			read_block->status = result;
+			read_block->callback(completion);
+			return;
+		}
+
+		uncompressed_data = data_vio->scratch_block;
+	}
+
+	// A block is only cached if all of it was read. A claimed block was
+	// cached before it was uncompressed.
+	if (!read_block->from_cache && !read_block->sectors_only &&
+	    !read_block->filling) {
+		read_cache_store(data_vio_as_vio(data_vio)->vdo->read_cache,
+				 read_block->pbn,
+				 compressed_data);
+	}
+
+	result = vdo_decompress_fragment(context->compressor_context,
+					 format,
+					 (compressed_data + fragment_offset),
+					 fragment_size,
+					 unit_block,
+					 uncompressed_data);
+	if (result == VDO_SUCCESS) {
+		read_block->data = uncompressed_data;
 	} else {
-		uds_log_debug("%s: lz4 error", __func__);
-		read_block->status = VDO_INVALID_FRAGMENT;
+		read_block->status = result;
 	}
 
 	read_block->callback(completion);
@@ -313,7 +655,9 @@ static void complete_read(struct data_vio *data_vio)
 
 	read_block->status = blk_status_to_errno(vio->bio->bi_status);
 
-	if ((read_block->status == VDO_SUCCESS) &&
+	// A claimed block must be released even if the read failed, which is
+	// done on the CPU queue since the cache can't be used from here.
+	if (((read_block->status == VDO_SUCCESS) || read_block->filling) &&
 	    is_compressed(read_block->mapping_state)) {
 		launch_data_vio_on_cpu_queue(data_vio,
 					     uncompress_read_block,
@@ -338,6 +682,157 @@ static void read_bio_callback(struct bio *bio)
 	complete_read(data_vio);
 }
 
+/**
+ * Read the sectors of a compressed block holding the fragment a data_vio
+ * needs, now that the sector holding the block header has been read. This
+ * work function is run on the CPU queue.
+ *
+ * @param work_item  The data_vio doing the read
+ **/
+static void read_fragment_sectors(struct vdo_work_item *work_item)
+{
+	struct vdo_completion *completion = container_of(work_item,
+							 struct vdo_completion,
+							 work_item);
+	struct data_vio *data_vio = work_item_as_data_vio(work_item);
+	struct vio *vio = data_vio_as_vio(data_vio);
+	struct read_block *read_block = &data_vio->read_block;
+	enum vdo_compression_format format;
+	uint16_t fragment_offset, fragment_size;
+	unsigned int first_sector, last_sector, unit_block;
+	int result;
+
+	result = get_vdo_compressed_block_fragment(read_block->mapping_state,
+						   read_block->buffer,
+						   VDO_BLOCK_SIZE,
+						   &fragment_offset,
+						   &fragment_size,
+						   &format,
+						   &unit_block);
+	if (result != VDO_SUCCESS) {
+		uds_log_debug("%s: frag err %d", __func__, result);
+		read_block->status = result;
+		read_block->callback(completion);
+		return;
+	}
+
+	first_sector = fragment_offset / VDO_SECTOR_SIZE;
+	last_sector = ((fragment_offset + max_t(uint16_t, fragment_size, 1) - 1)
+		       / VDO_SECTOR_SIZE);
+	if (last_sector == 0) {
+		// The whole fragment was in the header sector.
+		read_block->data = read_block->buffer;
+		uncompress_read_block(work_item);
+		return;
+	}
+
+	// The header sector has already been read.
+	first_sector = max(first_sector, 1U);
+	result = reset_bio_with_sectors(vio->bio, read_block->buffer, vio,
+					read_bio_callback, REQ_OP_READ,
+					read_block->pbn, first_sector,
+					last_sector - first_sector + 1);
+	if (result != VDO_SUCCESS) {
+		continue_vio(vio, result);
+		return;
+	}
+
+	vdo_submit_bio(vio->bio, read_block->action);
+}
+
+/**
+ * Callback for the bio reading the header sector of a compressed block.
+ *
+ * @param bio  The bio
+ **/
+static void read_header_bio_callback(struct bio *bio)
+{
+	struct data_vio *data_vio = (struct data_vio *) bio->bi_private;
+	struct read_block *read_block = &data_vio->read_block;
+
+	count_completed_bios(bio);
+	read_block->status = blk_status_to_errno(bio->bi_status);
+	if (read_block->status != VDO_SUCCESS) {
+		read_block->callback(data_vio_as_completion(data_vio));
+		return;
+	}
+
+	launch_data_vio_on_cpu_queue(data_vio,
+				     read_fragment_sectors,
+				     NULL,
+				     CPU_Q_ACTION_COMPRESS_BLOCK);
+}
+
+/**
+ * Read a block from storage, after the read cache has been searched for it.
+ *
+ * @param data_vio  The data_vio doing the read
+ **/
+static void submit_read_block(struct data_vio *data_vio)
+{
+	struct vio *vio = data_vio_as_vio(data_vio);
+	struct read_block *read_block = &data_vio->read_block;
+	int result;
+
+	if (read_block->sectors_only) {
+		result = reset_bio_with_sectors(vio->bio, read_block->buffer,
+						vio, read_header_bio_callback,
+						REQ_OP_READ, read_block->pbn,
+						0, 1);
+	} else {
+		result = reset_bio_with_buffer(vio->bio, read_block->buffer,
+					       vio, read_bio_callback,
+					       REQ_OP_READ, read_block->pbn);
+	}
+
+	if (result != VDO_SUCCESS) {
+		if (read_block->filling) {
+			read_block->filling = false;
+			read_cache_finish_fill(vio->vdo->read_cache,
+					       read_block->pbn,
+					       NULL);
+		}
+
+		continue_vio(vio, result);
+		return;
+	}
+
+	vdo_submit_bio(vio->bio, read_block->action);
+}
+
+/**
+ * Finish waiting for another read of the same compressed block. This is the
+ * read_cache_waiter_callback registered in vdo_read_block().
+ *
+ * @param waiter  The waiter of the data_vio which was waiting
+ * @param data    The contents of the block, or NULL if the other read failed
+ **/
+static void finish_waiting_for_block(struct read_cache_waiter *waiter,
+				     const char *data)
+{
+	struct read_block *read_block = container_of(waiter,
+						     struct read_block,
+						     fill_waiter);
+	struct data_vio *data_vio = container_of(read_block,
+						 struct data_vio,
+						 read_block);
+
+	if (data == NULL) {
+		// Whatever went wrong may have been particular to that read.
+		submit_read_block(data_vio);
+		return;
+	}
+
+	memcpy(read_block->buffer, data, VDO_BLOCK_SIZE);
+	read_block->from_cache = true;
+	read_block->sectors_only = false;
+	read_block->data = read_block->buffer;
+	launch_data_vio_on_cpu_queue(data_vio,
+				     uncompress_read_block,
+				     NULL,
+				     CPU_Q_ACTION_COMPRESS_BLOCK);
+}
+
 /**********************************************************************/
 void vdo_read_block(struct data_vio *data_vio,
 		    physical_block_number_t location,
@@ -346,23 +841,82 @@ void vdo_read_block(struct data_vio *data_vio,
 		    vdo_action *callback)
 {
 	struct vio *vio = data_vio_as_vio(data_vio);
+	struct kernel_layer *layer = vdo_as_kernel_layer(vio->vdo);
 	struct read_block *read_block = &data_vio->read_block;
 	int result;
 
 	read_block->callback = callback;
 	read_block->status = VDO_SUCCESS;
 	read_block->mapping_state = mapping_state;
-
-	// Read the data using the read block buffer.
-	result = reset_bio_with_buffer(vio->bio, read_block->buffer,
-				       vio, read_bio_callback, REQ_OP_READ,
-				       location);
+	read_block->pbn = location;
+	read_block->from_cache = false;
+	read_block->action = action;
+	read_block->filling = false;
+
+	// A compressed block may be read in two steps, first the sector
+	// holding its header, and then the sectors holding the fragment. This
+	// trades a second dependent read for moving less data.
+	read_block->sectors_only =
+		(is_compressed(mapping_state) &&
+		 READ_ONCE(layer->compressed_sector_reads));
+
+	result = acquire_block_buffer(data_vio, &read_block->buffer,
+				      POOLED_READ_BUFFER);
 	if (result != VDO_SUCCESS) {
 		continue_vio(vio, result);
 		return;
 	}
 
-	vdo_submit_bio(vio->bio, action);
+	if (!is_compressed(mapping_state)) {
+		// The candidate for a verify may have just been written, and
+		// a shared block may have been read through another logical
+		// address.
+		if (read_cache_lookup(vio->vdo->read_cache, location,
+				      read_block->buffer)) {
+			read_block->from_cache = true;
+			read_block->data = read_block->buffer;
+			read_block->callback(vio_as_completion(vio));
+			return;
+		}
+
+		submit_read_block(data_vio);
+		return;
+	}
+
+	// The other fragments of a compressed block are usually read close
+	// together, as by a sequential read, so a block is read only once for
+	// all of them: the first read of it claims it, and the rest wait for
+	// that read rather than going to storage themselves. A read of only
+	// some sectors of the block won't claim it, but can still wait for a
+	// read of all of it.
+	read_block->fill_waiter.callback = finish_waiting_for_block;
+	switch (read_cache_lookup_or_wait(vio->vdo->read_cache,
+					  location,
+					  read_block->buffer,
+					  !read_block->sectors_only,
+					  &read_block->fill_waiter)) {
+	case READ_CACHE_FILL_HIT:
+		read_block->from_cache = true;
+		read_block->sectors_only = false;
+		read_block->data = read_block->buffer;
+		launch_data_vio_on_cpu_queue(data_vio,
+					     uncompress_read_block,
+					     NULL,
+					     CPU_Q_ACTION_COMPRESS_BLOCK);
+		return;
+
+	case READ_CACHE_FILL_WAIT:
+		return;
+
+	case READ_CACHE_FILL_CLAIMED:
+		read_block->filling = true;
+		submit_read_block(data_vio);
+		return;
+
+	default:
+		submit_read_block(data_vio);
+		return;
+	}
 }
 
 /**********************************************************************/
@@ -380,14 +934,50 @@ static void acknowledge_user_bio(struct bio *bio)
 	continue_vio(vio, error);
 }
 
+/**********************************************************************/
+static void launch_data_vio_work(struct vdo_work_item *item);
+
+/**
+ * Finish a read which was done without locking its logical block. If the
+ * mapping may have changed while the data was being read, the data may
+ * belong to some other block, so the read is done again, this time with the
+ * lock. This is the bio callback registered in read_data_vio().
+ *
+ * @param bio  The bio which read the data into the user bio's pages
+ **/
+static void acknowledge_lockless_read(struct bio *bio)
+{
+	int error = get_bio_result(bio);
+	struct vio *vio = (struct vio *) bio->bi_private;
+	struct data_vio *data_vio = vio_as_data_vio(vio);
+
+	count_completed_bios(bio);
+	if (!is_lockless_mapping_current(data_vio)) {
+		data_vio->is_lockless = false;
+		prepare_data_vio(data_vio, data_vio->logical.lbn,
+				 vio->operation, false, vio->callback);
+		enqueue_vio(vio, launch_data_vio_work,
+			    vio_as_completion(vio)->callback,
+			    REQ_Q_ACTION_MAP_READ);
+		return;
+	}
+
+	if (error == 0) {
+		acknowledge_data_vio(data_vio);
+		return;
+	}
+
+	continue_vio(vio, error);
+}
+
 /**********************************************************************/
 void read_data_vio(struct data_vio *data_vio)
 {
 	struct vio *vio = data_vio_as_vio(data_vio);
 	struct bio *bio = vio->bio;
 	int result = VDO_SUCCESS;
-	int opf = (data_vio->user_bio->bi_opf &
-		   PASSTHROUGH_FLAGS);
+	int opf = ((data_vio->user_bio == NULL)
+		   ? 0 : (data_vio->user_bio->bi_opf & PASSTHROUGH_FLAGS));
 
 	ASSERT_LOG_ONLY(!is_write_vio(vio),
 			"operation set correctly for data read");
@@ -401,6 +991,21 @@ void read_data_vio(struct data_vio *data_vio)
 		return;
 	}
 
+	// A widely shared block is read through the read block buffer so that
+	// it can be served from, or added to, the read cache. A lockless read
+	// must not be, since its mapping has to be checked before the user bio
+	// is acknowledged.
+	if (!data_vio->is_lockless &&
+	    is_read_cache_candidate(vio->vdo->read_cache,
+				    data_vio->mapped.pbn)) {
+		vdo_read_block(data_vio,
+			       data_vio->mapped.pbn,
+			       data_vio->mapped.state,
+			       BIO_Q_ACTION_DATA,
+			       read_data_vio_read_block_callback);
+		return;
+	}
+
 	// Read directly into the user buffer (for a 4k read) or the data
 	// block (for a partial IO).
 	if (is_read_modify_write_vio(data_vio_as_vio(data_vio))) {
@@ -425,7 +1030,9 @@ void read_data_vio(struct data_vio *data_vio)
 		__bio_clone_fast(bio, data_vio->user_bio);
 		bio->bi_opf = REQ_OP_READ | opf;
 		bio->bi_private = vio;
-		bio->bi_end_io = acknowledge_user_bio;
+		bio->bi_end_io = (data_vio->is_lockless
+				  ? acknowledge_lockless_read
+				  : acknowledge_user_bio);
 		bio->bi_iter.bi_sector = block_to_sector(data_vio->mapped.pbn);
 	}
 
@@ -457,7 +1064,7 @@ void acknowledge_data_vio(struct data_vio *data_vio)
 	// If the remaining discard work is not completely processed by this
 	// data_vio, don't acknowledge it yet.
 	if ((data_vio->user_bio != NULL) &&
-	    (bio_op(data_vio->user_bio) == REQ_OP_DISCARD) &&
+	    is_discard_bio(data_vio->user_bio) &&
 	    (data_vio->remaining_discard >
 	     (VDO_BLOCK_SIZE - data_vio->offset))) {
 		invoke_vdo_completion_callback(data_vio_as_completion(data_vio));
@@ -467,10 +1074,7 @@ void acknowledge_data_vio(struct data_vio *data_vio)
 	// We've finished with the vio; acknowledge completion of the bio to
 	// the kernel.
 	if (use_bio_ack_queue(vdo)) {
-		launch_data_vio_on_bio_ack_queue(data_vio,
-						 vdo_acknowledge_and_enqueue,
-						 NULL,
-						 BIO_ACK_Q_ACTION_ACK);
+		launch_data_vio_ack(data_vio, vdo_acknowledge_and_enqueue);
 	} else {
 		vdo_acknowledge_and_enqueue(work_item_from_data_vio(data_vio));
 	}
@@ -486,6 +1090,15 @@ void write_data_vio(struct data_vio *data_vio)
 	ASSERT_LOG_ONLY(is_write_vio(vio),
 			"write_data_vio must be passed a write data_vio");
 
+	/*
+	 * Remember the data so that a data_vio verifying against this block
+	 * soon, as all the duplicates of a freshly written block will, need
+	 * not read it back. The block is write locked until the write is
+	 * done, so no verify can look for it sooner, and a failed write puts
+	 * the VDO in read-only mode.
+	 */
+	read_cache_store(vio->vdo->read_cache, data_vio->new_mapped.pbn,
+			 data_vio->data_block);
 
 	// Write the data from the data block buffer.
 	result = reset_bio_with_buffer(vio->bio, data_vio->data_block,
@@ -509,57 +1122,7 @@ void write_data_vio(struct data_vio *data_vio)
  **/
 static inline bool is_zero_block(struct data_vio *data_vio)
 {
-	unsigned int word_count = VDO_BLOCK_SIZE / sizeof(uint64_t);
-	unsigned int chunk_count = word_count / 8;
-	const char *buffer = data_vio->data_block;
-	/*
-	 * Handle expected common case of even the first word being nonzero,
-	 * without getting into the more expensive (for one iteration) loop
-	 * below.
-	 */
-	if (get_unaligned((u64 *) buffer) != 0) {
-		return false;
-	}
-
-	STATIC_ASSERT(VDO_BLOCK_SIZE % sizeof(uint64_t) == 0);
-
-	// Unroll to process 64 bytes at a time
-	while (chunk_count-- > 0) {
-		uint64_t word0 = get_unaligned((u64 *) buffer);
-		uint64_t word1 =
-			get_unaligned((u64 *) (buffer + 1 * sizeof(uint64_t)));
-		uint64_t word2 =
-			get_unaligned((u64 *) (buffer + 2 * sizeof(uint64_t)));
-		uint64_t word3 =
-			get_unaligned((u64 *) (buffer + 3 * sizeof(uint64_t)));
-		uint64_t word4 =
-			get_unaligned((u64 *) (buffer + 4 * sizeof(uint64_t)));
-		uint64_t word5 =
-			get_unaligned((u64 *) (buffer + 5 * sizeof(uint64_t)));
-		uint64_t word6 =
-			get_unaligned((u64 *) (buffer + 6 * sizeof(uint64_t)));
-		uint64_t word7 =
-			get_unaligned((u64 *) (buffer + 7 * sizeof(uint64_t)));
-		uint64_t or = (word0 | word1 | word2 | word3 | word4 | word5 |
-			       word6 | word7);
-		// Prevent compiler from using 8*(cmp;jne).
-		__asm__ __volatile__("" : : "g"(or));
-		if (or != 0) {
-			return false;
-		}
-		buffer += 8 * sizeof(uint64_t);
-	}
-	word_count %= 8;
-
-	// Unroll to process 8 bytes at a time.
-	// (Is this still worthwhile?)
-	while (word_count-- > 0) {
-		if (get_unaligned((u64 *) buffer) != 0) {
-			return false;
-		}
-		buffer += sizeof(uint64_t);
-	}
-	return true;
+	return is_zero_vdo_block(data_vio->data_block);
 }
 
 /**********************************************************************/
@@ -567,7 +1130,9 @@ void apply_partial_write(struct data_vio *data_vio)
 {
 	struct bio *bio = data_vio->user_bio;
 
-	if (bio_op(bio) != REQ_OP_DISCARD) {
+	if (bio == NULL) {
+		// A post-process dedupe read rewrites the block unchanged.
+	} else if (!is_discard_bio(bio)) {
 		bio_copy_data_in(bio, data_vio->data_block + data_vio->offset);
 	} else {
 		memset(data_vio->data_block + data_vio->offset, '\0',
@@ -579,6 +1144,15 @@ void apply_partial_write(struct data_vio *data_vio)
 	data_vio->is_zero_block = is_zero_block(data_vio);
 }
 
+/**********************************************************************/
+void apply_combined_partial_write(struct data_vio *data_vio,
+				  struct data_vio *combined)
+{
+	bio_copy_data_in(combined->user_bio,
+			 data_vio->data_block + combined->offset);
+	data_vio->is_zero_block = is_zero_block(data_vio);
+}
+
 /**********************************************************************/
 void zero_data_vio(struct data_vio *data_vio)
 {
@@ -591,52 +1165,232 @@ void zero_data_vio(struct data_vio *data_vio)
 	}
 }
 
-/**********************************************************************/
-void copy_data(struct data_vio *source, struct data_vio *destination)
+/**********************************************************************/
+void copy_data(struct data_vio *source, struct data_vio *destination)
+{
+	ASSERT_LOG_ONLY(is_read_vio(data_vio_as_vio(destination)),
+			"only copy to a pure read");
+	ASSERT_LOG_ONLY(is_write_vio(data_vio_as_vio(source)),
+			"only copy from a write");
+
+	if (destination->is_partial) {
+		memcpy(destination->data_block, source->data_block,
+		       VDO_BLOCK_SIZE);
+	} else {
+		bio_copy_data_out(destination->user_bio,
+				  source->data_block);
+	}
+}
+
+/**
+ * Add a data_vio to one of a set of per-CPU-thread batch processors. The
+ * batcher is chosen by the extent of the logical block, so that a stream of
+ * writes fills batches while still being spread across all of the CPU
+ * threads.
+ *
+ * @param data_vio  The data_vio to add
+ * @param batchers  The batch processors, one per CPU thread
+ **/
+static void add_to_cpu_batch(struct data_vio *data_vio,
+			     struct batch_processor **batchers)
+{
+	struct vdo *vdo = get_vdo_from_data_vio(data_vio);
+	unsigned int count = vdo->device_config->thread_counts.cpu_threads;
+	struct batch_processor *batch
+		= batchers[select_batch_processor(data_vio->logical.lbn,
+						  count)];
+
+	add_to_batch_processor(batch, work_item_from_data_vio(data_vio));
+}
+
+/**
+ * Take up to CPU_QUEUE_BATCH_SIZE data_vios from a batch processor.
+ *
+ * @param batch      The batch processor
+ * @param data_vios  The array to fill
+ *
+ * @return The number of data_vios taken
+ **/
+static unsigned int take_data_vio_batch(struct batch_processor *batch,
+					struct data_vio **data_vios)
+{
+	unsigned int count = 0;
+	struct vdo_work_item *item;
+
+	while ((count < CPU_QUEUE_BATCH_SIZE)
+	       && ((item = next_batch_item(batch)) != NULL)) {
+		data_vios[count++] = work_item_as_data_vio(item);
+	}
+
+	return count;
+}
+
+/**
+ * Adjust the LZ4 acceleration factor for the backlog seen by a compression
+ * batch. A full batch means more data_vios are waiting behind it, so the
+ * factor is doubled, trading compression ratio for throughput. A nearly
+ * empty batch means the CPU queue has caught up, so the factor is halved
+ * back toward the default. The factor never exceeds the configured maximum,
+ * which is the default unless adaptive compression has been enabled.
+ *
+ * @param layer  The kernel layer
+ * @param count  The number of data_vios in the batch
+ *
+ * @return The acceleration factor to use for the batch
+ **/
+static int adapt_compression_acceleration(struct kernel_layer *layer,
+					  unsigned int count)
+{
+	int maximum = READ_ONCE(layer->maximum_compression_acceleration);
+	int acceleration = atomic_read(&layer->compression_acceleration);
+	int adapted = acceleration;
+
+	if (count == CPU_QUEUE_BATCH_SIZE) {
+		adapted = acceleration * 2;
+	} else if (count <= CPU_QUEUE_IDLE_BATCH_SIZE) {
+		adapted = acceleration / 2;
+	}
+
+	adapted = max_t(int, min(adapted, maximum),
+			VDO_DEFAULT_LZ4_ACCELERATION);
+	if (adapted != acceleration) {
+		atomic_set(&layer->compression_acceleration, adapted);
+	}
+
+	return adapted;
+}
+
+/**
+ * Record the result of compressing a data_vio.
+ *
+ * @param data_vio  The data_vio which was compressed
+ * @param size      The compressed size, or 0 if the block did not compress
+ **/
+static void set_compressed_size(struct data_vio *data_vio, int size)
+{
+	struct kernel_layer *layer
+		= vdo_as_kernel_layer(get_vdo_from_data_vio(data_vio));
+
+	record_compressibility(layer->compressibility, data_vio->logical.lbn,
+			       (size > 0));
+	if (size > 0) {
+		// The scratch block will be used to contain the compressed
+		// data.
+		data_vio->compression.data = data_vio->scratch_block;
+		data_vio->compression.size = size;
+	} else {
+		// Use block size plus one as an indicator for uncompressible
+		// data.
+		data_vio->compression.size = VDO_BLOCK_SIZE + 1;
+	}
+}
+
+/**
+ * Compress a single data_vio, recording the compressed size.
+ *
+ * @param data_vio      The data_vio to compress
+ * @param acceleration  The LZ4 acceleration factor to use
+ **/
+static void compress_block(struct data_vio *data_vio, int acceleration)
+{
+	struct cpu_queue_context *context = get_work_queue_private_data();
+
+	set_compressed_size(data_vio,
+			    vdo_compress_block(context->compressor_context,
+					       data_vio->data_block,
+					       data_vio->scratch_block,
+					       acceleration));
+}
+
+/**
+ * Finish a compression done by an offload device. This callback may be
+ * called in interrupt context.
+ *
+ * @param context  The data_vio which was compressed
+ * @param size     The compressed size, or 0 if the block did not compress
+ **/
+static void offloaded_compression_done(void *context, int size)
+{
+	struct data_vio *data_vio = context;
+
+	set_compressed_size(data_vio, size);
+	enqueue_data_vio_callback(data_vio);
+}
+
+/**********************************************************************/
+void compress_data_vio_batch(struct batch_processor *batch, void *closure)
+{
+	struct kernel_layer *layer = closure;
+	struct data_vio *data_vios[CPU_QUEUE_BATCH_SIZE];
+	unsigned int count, i;
+
+	while ((count = take_data_vio_batch(batch, data_vios)) > 0) {
+		int acceleration
+			= adapt_compression_acceleration(layer, count);
+
+		for (i = 0; i < count; i++) {
+			compress_block(data_vios[i], acceleration);
+		}
+
+		for (i = 0; i < count; i++) {
+			enqueue_data_vio_callback(data_vios[i]);
+		}
+
+		cond_resched_batch_processor(batch);
+	}
+}
+
+/**
+ * Compress each unit of a batch, then return the units to the packer. This is
+ * the work item function of compress_data_vio_units(), run on the CPU queue.
+ *
+ * @param item  The work item of the units' completion
+ **/
+static void compress_units_work(struct vdo_work_item *item)
 {
-	ASSERT_LOG_ONLY(is_read_vio(data_vio_as_vio(destination)),
-			"only copy to a pure read");
-	ASSERT_LOG_ONLY(is_write_vio(data_vio_as_vio(source)),
-			"only copy from a write");
+	struct compression_units *units =
+		container_of(item, struct compression_units,
+			     completion.work_item);
+	struct kernel_layer *layer =
+		vdo_as_kernel_layer(units->completion.vdo);
+	struct cpu_queue_context *context = get_work_queue_private_data();
+	int acceleration = atomic_read(&layer->compression_acceleration);
+	unsigned int i, j;
+
+	for (i = 0; i < units->count; i++) {
+		struct compression_unit *unit = &units->units[i];
+		const char *blocks[VDO_MAX_COMPRESSION_UNIT_BLOCKS];
+
+		for (j = 0; j < unit->count; j++) {
+			blocks[j] = unit->data_vios[j]->data_block;
+		}
 
-	if (destination->is_partial) {
-		memcpy(destination->data_block, source->data_block,
-		       VDO_BLOCK_SIZE);
-	} else {
-		bio_copy_data_out(destination->user_bio,
-				  source->data_block);
+		unit->size = vdo_compress_unit(context->compressor_context,
+					       blocks, unit->count,
+					       unit->fragment,
+					       unit->buffer_size,
+					       acceleration);
 	}
+
+	enqueue_vdo_completion(&units->completion);
 }
 
 /**********************************************************************/
-static void vdo_compress_work(struct vdo_work_item *item)
+void compress_data_vio_units(struct compression_units *units)
 {
-	struct data_vio *data_vio = work_item_as_data_vio(item);
-	char *context = get_work_queue_private_data();
-	int size;
-
-	size = LZ4_compress_default(data_vio->data_block,
-				    data_vio->scratch_block,
-				    VDO_BLOCK_SIZE,
-				    VDO_BLOCK_SIZE,
-				    context);
-	if (size > 0) {
-		// The scratch block will be used to contain the compressed
-		// data.
-		data_vio->compression.data = data_vio->scratch_block;
-		data_vio->compression.size = size;
-	} else {
-		// Use block size plus one as an indicator for uncompressible
-		// data.
-		data_vio->compression.size = VDO_BLOCK_SIZE + 1;
-	}
+	struct kernel_layer *layer =
+		vdo_as_kernel_layer(units->completion.vdo);
 
-	enqueue_data_vio_callback(data_vio);
+	setup_work_item(&units->completion.work_item, compress_units_work,
+			NULL, CPU_Q_ACTION_COMPRESS_BLOCK);
+	enqueue_cpu_work_queue(layer, &units->completion.work_item);
 }
 
 /**********************************************************************/
 void compress_data_vio(struct data_vio *data_vio)
 {
+	struct kernel_layer *layer;
+
 	/*
 	 * If the orignal bio was a discard, but we got this far because the
 	 * discard was a partial one (r/m/w), and it is part of a larger
@@ -644,16 +1398,53 @@ void compress_data_vio(struct data_vio *data_vio)
 	 * completes ASAP.
 	 */
 	if ((data_vio->user_bio != NULL) &&
-	    (bio_op(data_vio->user_bio) == REQ_OP_DISCARD) &&
+	    is_discard_bio(data_vio->user_bio) &&
 	    (data_vio->remaining_discard > 0)) {
 		data_vio->compression.size = VDO_BLOCK_SIZE + 1;
 		enqueue_data_vio_callback(data_vio);
 		return;
 	}
 
-	launch_data_vio_on_cpu_queue(data_vio, vdo_compress_work,
-				      NULL,
-				      CPU_Q_ACTION_COMPRESS_BLOCK);
+	layer = vdo_as_kernel_layer(get_vdo_from_data_vio(data_vio));
+
+	// The estimate made while hashing says this block isn't worth the
+	// trip to the CPU queue.
+	if (data_vio->compression.likely_incompressible) {
+		record_compressibility(layer->compressibility,
+				       data_vio->logical.lbn, false);
+		data_vio->compression.size = VDO_BLOCK_SIZE + 1;
+		enqueue_data_vio_callback(data_vio);
+		return;
+	}
+
+	// Neither is a block in a region which has not been compressing.
+	if (should_skip_compression(layer->compressibility,
+				    data_vio->logical.lbn)) {
+		data_vio->compression.size = VDO_BLOCK_SIZE + 1;
+		enqueue_data_vio_callback(data_vio);
+		return;
+	}
+
+	// A block which can't get a scratch block to compress into is
+	// written uncompressed rather than waiting for one.
+	if (acquire_block_buffer(data_vio, &data_vio->scratch_block,
+				 POOLED_SCRATCH_BLOCK) != VDO_SUCCESS) {
+		data_vio->compression.size = VDO_BLOCK_SIZE + 1;
+		enqueue_data_vio_callback(data_vio);
+		return;
+	}
+
+	// Hand the block to an offload device if there is one with room,
+	// rather than tying up a CPU queue thread with it.
+	if (vdo_offload_compression(layer->compressor,
+				    data_vio->data_block,
+				    data_vio->scratch_block,
+				    offloaded_compression_done,
+				    data_vio)) {
+		return;
+	}
+
+	add_to_cpu_batch(data_vio, layer->compress_batchers);
 }
 
 /**
@@ -702,6 +1493,7 @@ static int vdo_create_vio_from_bio(struct kernel_layer *layer,
 
 
 	data_vio->user_bio = bio;
+	data_vio->launch_time = ktime_get_ns();
 	initialize_vio(vio,
 		       vio_bio,
 		       VIO_TYPE_DATA,
@@ -724,7 +1516,7 @@ static int vdo_create_vio_from_bio(struct kernel_layer *layer,
 		 * cases, but only once we're sure all such places are fixed to
 		 * check the is_zero_block flag first.
 		 */
-		if (bio_op(bio) == REQ_OP_DISCARD) {
+		if (is_discard_bio(bio)) {
 			/*
 			 * This is a discard/trim operation. This is treated
 			 * much like the zero block, but we keep differen
@@ -734,7 +1526,8 @@ static int vdo_create_vio_from_bio(struct kernel_layer *layer,
 		} else if (bio_data_dir(bio) == WRITE) {
 			// Copy the bio data to a char array so that we can
 			// continue to use the data after we acknowledge the
-			// bio.
+			// bio, and so that it can't change after it has been
+			// hashed or compared.
 			bio_copy_data_in(bio, data_vio->data_block);
 			data_vio->is_zero_block = is_zero_block(data_vio);
 		}
@@ -818,11 +1611,58 @@ static void vdo_complete_partial_read(struct vdo_completion *completion)
 	return;
 }
 
+/**
+ * Try to start a full block read without locking its logical block, using
+ * the mapping in a leaf page which the block map has published. This saves
+ * the trips through the logical zone's thread to lock and map the block.
+ *
+ * @param data_vio  The data_vio for the read, which has been prepared
+ *
+ * @return true if the read was launched, false if it must take the lock
+ **/
+static bool launch_lockless_read(struct data_vio *data_vio)
+{
+	struct vio *vio = data_vio_as_vio(data_vio);
+	struct vdo_completion *completion = vio_as_completion(vio);
+	struct vdo *vdo = vio->vdo;
+	struct data_location mapping;
+
+	if ((data_vio->logical.lbn >= vdo->states.vdo.config.logical_blocks) ||
+	    !lookup_lockless_mapping(data_vio, &mapping) ||
+	    is_compressed(mapping.state)) {
+		return false;
+	}
+
+	if (mapping.pbn == VDO_ZERO_BLOCK) {
+		// There is no data to read, so the lookup was the whole read.
+		data_vio->is_lockless = true;
+		clear_mapped_location(data_vio);
+		zero_data_vio(data_vio);
+		complete_data_vio(completion);
+		return true;
+	}
+
+	if (is_read_cache_candidate(vdo->read_cache, mapping.pbn) ||
+	    (set_mapped_location(data_vio, mapping.pbn, mapping.state)
+	     != VDO_SUCCESS)) {
+		return false;
+	}
+
+	data_vio->is_lockless = true;
+	completion->callback = complete_data_vio;
+	vio->physical = mapping.pbn;
+	data_vio->last_async_operation = READ_DATA;
+	read_data_vio(data_vio);
+	return true;
+}
+
 /**********************************************************************/
 int vdo_launch_data_vio_from_bio(struct vdo *vdo,
 				 struct bio *bio,
 				 uint64_t arrival_jiffies,
-				 bool has_discard_permit)
+				 bool has_discard_permit,
+				 bool has_write_permit,
+				 struct qos_class *qos_class)
 {
 	struct data_vio *data_vio = NULL;
 	struct kernel_layer *layer = vdo_as_kernel_layer(vdo);
@@ -843,6 +1683,12 @@ int vdo_launch_data_vio_from_bio(struct vdo *vdo,
 		if (has_discard_permit) {
 			limiter_release(&vdo->discard_limiter);
 		}
+		if (has_write_permit) {
+			limiter_release(&vdo->write_limiter);
+		}
+		if (qos_class != NULL) {
+			limiter_release(&qos_class->limiter);
+		}
 		limiter_release(&vdo->request_limiter);
 		return map_to_system_error(result);
 	}
@@ -852,7 +1698,7 @@ int vdo_launch_data_vio_from_bio(struct vdo *vdo,
 	 * from device-mapper. We have to be able to handle any size discards
 	 * and with various sector offsets within a block.
 	 */
-	if (bio_op(bio) == REQ_OP_DISCARD) {
+	if (is_discard_bio(bio)) {
 		data_vio->has_discard_permit = has_discard_permit;
 		data_vio->remaining_discard = bio->bi_iter.bi_size;
 		callback = vdo_continue_discard_vio;
@@ -876,38 +1722,242 @@ int vdo_launch_data_vio_from_bio(struct vdo *vdo,
 		operation |= VIO_FLUSH_AFTER;
 	}
 
+	data_vio->has_write_permit = has_write_permit;
+	data_vio->qos_class = qos_class;
 	prepare_data_vio(data_vio, lbn, operation, is_trim, callback);
+	if ((operation == VIO_READ) && !data_vio->is_partial &&
+	    launch_lockless_read(data_vio)) {
+		return VDO_SUCCESS;
+	}
 
+	// Reads are mapped ahead of newly arrived writes so that a burst of
+	// writes does not hold up reads sharing a logical zone.
 	vio = data_vio_as_vio(data_vio);
 	enqueue_vio(vio, launch_data_vio_work,
-		    vio_as_completion(vio)->callback, REQ_Q_ACTION_MAP_BIO);
+		    vio_as_completion(vio)->callback,
+		    (((operation & VIO_READ_WRITE_MASK) == VIO_READ)
+		     ? REQ_Q_ACTION_MAP_READ : REQ_Q_ACTION_MAP_BIO));
 
 	return VDO_SUCCESS;
 }
 
 /**
- * Hash a data_vio and set its chunk name.
+ * Finish a data_vio launched by the post-process deduper.
  *
- * @param item  The data_vio to be hashed
+ * @param completion  The data_vio
  **/
-static void vdo_hash_data_work(struct vdo_work_item *item)
+static void vdo_complete_post_dedupe(struct vdo_completion *completion)
 {
-	struct data_vio *data_vio = work_item_as_data_vio(item);
+	struct data_vio *data_vio = as_data_vio(completion);
+	struct kernel_layer *layer
+		= vdo_as_kernel_layer(get_vdo_from_data_vio(data_vio));
+
+	complete_post_dedupe(layer->post_deduper,
+			     (data_vio->is_duplicate &&
+			      (data_vio->duplicate.pbn != data_vio->mapped.pbn)));
+	vdo_complete_data_vio(completion);
+}
+
+/**********************************************************************/
+bool launch_post_dedupe_data_vio(struct kernel_layer *layer,
+				 logical_block_number_t lbn)
+{
+	struct data_vio *data_vio;
+	struct vio *vio;
+	struct bio *vio_bio;
+	int result;
+
+	if (!limiter_poll(&layer->vdo.request_limiter)) {
+		return false;
+	}
+
+	// A request permit guarantees that the pool has a free data_vio.
+	result = alloc_buffer_from_pool(layer->data_vio_pool,
+					(void **) &data_vio);
+	if (result != VDO_SUCCESS) {
+		log_error_strerror(result, "post dedupe vio allocation failure");
+		limiter_release(&layer->vdo.request_limiter);
+		return false;
+	}
+
+	if (WRITE_PROTECT_FREE_POOL) {
+		set_write_protect(data_vio, WP_DATA_VIO_SIZE, false);
+	}
+
+	vio = data_vio_as_vio(data_vio);
+	vio_bio = vio->bio;
+	memset(data_vio, 0, offsetof(struct data_vio, dedupe_context));
+	memset(&data_vio->dedupe_context.pending_list, 0,
+	       sizeof(struct list_head));
+
+	// The block is read and rewritten as if it were a partial write with
+	// nothing to apply, so that it takes the logical lock, reads the
+	// current data, and goes through the hash lock like any other write.
+	data_vio->is_rededupe = true;
+	data_vio->is_partial = true;
+	data_vio->read_block.data = data_vio->data_block;
+	data_vio->launch_time = ktime_get_ns();
+	initialize_vio(vio,
+		       vio_bio,
+		       VIO_TYPE_DATA,
+		       VIO_PRIORITY_DATA,
+		       NULL,
+		       &layer->vdo,
+		       NULL);
+	prepare_data_vio(data_vio, lbn, VIO_READ_MODIFY_WRITE, false,
+			 vdo_complete_post_dedupe);
+	enqueue_vio(vio, launch_data_vio_work,
+		    vio_as_completion(vio)->callback, REQ_Q_ACTION_MAP_BIO);
+	return true;
+}
+
+/**
+ * Estimate whether a block is worth compressing by counting the distinct byte
+ * values in a sample of it. This is cheap enough to run while the block is
+ * still in cache from being hashed.
+ *
+ * @param block  The block to examine
+ *
+ * @return true if the block appears to be incompressible
+ **/
+static bool is_likely_incompressible(const char *block)
+{
+	uint64_t seen[4] = { 0, 0, 0, 0 };
+	unsigned int i;
+
+	for (i = 0; i < VDO_BLOCK_SIZE; i += COMPRESSIBILITY_SAMPLE_STRIDE) {
+		uint8_t byte = block[i];
+
+		seen[byte >> 6] |= (1ULL << (byte & 63));
+	}
+
+	return ((hweight64(seen[0]) + hweight64(seen[1]) + hweight64(seen[2])
+		 + hweight64(seen[3]))
+		> INCOMPRESSIBLE_DISTINCT_BYTE_COUNT);
+}
 
-	MurmurHash3_x64_128(data_vio->data_block, VDO_BLOCK_SIZE, 0x62ea60be,
-			    &data_vio->chunk_name);
+/**
+ * Compute the chunk name of a data_vio with the hash algorithm the vdo was
+ * formatted with. A SHA-256 digest is truncated to the size of a chunk name.
+ *
+ * @param data_vio  The data_vio to hash
+ **/
+static void compute_chunk_name(struct data_vio *data_vio)
+{
+	struct cpu_queue_context *context = get_work_queue_private_data();
+	u8 digest[SHA256_DIGEST_SIZE];
+	int result;
+
+	if (context->hash_desc == NULL) {
+		MurmurHash3_x64_128(data_vio->data_block, VDO_BLOCK_SIZE,
+				    0x62ea60be, &data_vio->chunk_name);
+		return;
+	}
+
+	STATIC_ASSERT(sizeof(data_vio->chunk_name) <= SHA256_DIGEST_SIZE);
+	result = crypto_shash_digest(context->hash_desc, data_vio->data_block,
+				     VDO_BLOCK_SIZE, digest);
+	// The digest of an unkeyed hash can not fail, but if it somehow
+	// does, the resulting name will only ever cost a missed dedupe
+	// opportunity since advice is always verified.
+	ASSERT_LOG_ONLY(result == 0, "chunk name digest succeeded");
+	memcpy(&data_vio->chunk_name, digest, sizeof(data_vio->chunk_name));
+}
+
+/**
+ * Compute the MurmurHash3 chunk names of a group of data_vios together, so
+ * that the hash computations of the different blocks overlap.
+ *
+ * @param data_vios  The MURMUR_X64_128_LANES data_vios to hash
+ **/
+static void compute_murmur_chunk_names(struct data_vio **data_vios)
+{
+	const void *blocks[MURMUR_X64_128_LANES];
+	void *names[MURMUR_X64_128_LANES];
+	unsigned int i;
+
+	for (i = 0; i < MURMUR_X64_128_LANES; i++) {
+		blocks[i] = data_vios[i]->data_block;
+		names[i] = &data_vios[i]->chunk_name;
+	}
+
+	MurmurHash3_x64_128_multi(blocks, VDO_BLOCK_SIZE, 0x62ea60be, names);
+}
+
+/**
+ * Finish hashing a data_vio whose chunk name has been computed. If
+ * compression is enabled, also estimate the compressibility of the block
+ * while it is hot so that a hopeless block can skip the compressor later.
+ *
+ * @param data_vio     The data_vio which was hashed
+ * @param compressing  Whether compression is enabled
+ **/
+static void finish_hashing(struct data_vio *data_vio, bool compressing)
+{
 	data_vio->dedupe_context.chunk_name = &data_vio->chunk_name;
 
-	enqueue_data_vio_callback(data_vio);
+	if (compressing) {
+		data_vio->compression.likely_incompressible =
+			is_likely_incompressible(data_vio->data_block);
+	}
+}
+
+/**
+ * Hash a batch of data_vios and set their chunk names.
+ *
+ * @param data_vios    The data_vios to be hashed
+ * @param count        The number of data_vios
+ * @param compressing  Whether compression is enabled
+ **/
+static void hash_blocks(struct data_vio **data_vios,
+			unsigned int count,
+			bool compressing)
+{
+	struct cpu_queue_context *context = get_work_queue_private_data();
+	unsigned int i = 0;
+
+	if (context->hash_desc == NULL) {
+		for (; (i + MURMUR_X64_128_LANES) <= count;
+		     i += MURMUR_X64_128_LANES) {
+			compute_murmur_chunk_names(&data_vios[i]);
+		}
+	}
+
+	for (; i < count; i++) {
+		compute_chunk_name(data_vios[i]);
+	}
+
+	for (i = 0; i < count; i++) {
+		finish_hashing(data_vios[i], compressing);
+	}
+}
+
+/**********************************************************************/
+void hash_data_vio_batch(struct batch_processor *batch, void *closure)
+{
+	struct kernel_layer *layer = closure;
+	struct data_vio *data_vios[CPU_QUEUE_BATCH_SIZE];
+	unsigned int count, i;
+
+	while ((count = take_data_vio_batch(batch, data_vios)) > 0) {
+		hash_blocks(data_vios, count,
+			    get_vdo_compressing(&layer->vdo));
+
+		for (i = 0; i < count; i++) {
+			enqueue_data_vio_callback(data_vios[i]);
+		}
+
+		cond_resched_batch_processor(batch);
+	}
 }
 
 /**********************************************************************/
 void hash_data_vio(struct data_vio *data_vio)
 {
-	launch_data_vio_on_cpu_queue(data_vio,
-				     vdo_hash_data_work,
-				     NULL,
-				     CPU_Q_ACTION_HASH_BLOCK);
+	struct kernel_layer *layer
+		= vdo_as_kernel_layer(get_vdo_from_data_vio(data_vio));
+
+	add_to_cpu_batch(data_vio, layer->hash_batchers);
 }
 
 /**********************************************************************/
@@ -928,6 +1978,26 @@ void check_for_duplication(struct data_vio *data_vio)
 	}
 }
 
+/**********************************************************************/
+bool is_exempt_from_deduplication(struct data_vio *data_vio)
+{
+	struct kernel_layer *layer
+		= vdo_as_kernel_layer(get_vdo_from_data_vio(data_vio));
+
+	return is_dedupe_exempt(layer->dedupe_exemptions,
+				data_vio->logical.lbn);
+}
+
+/**********************************************************************/
+bool defer_deduplication(struct data_vio *data_vio)
+{
+	struct kernel_layer *layer
+		= vdo_as_kernel_layer(get_vdo_from_data_vio(data_vio));
+
+	return defer_post_dedupe(layer->post_deduper,
+				 data_vio->logical.lbn);
+}
+
 /**********************************************************************/
 void update_dedupe_index(struct data_vio *data_vio)
 {
@@ -957,10 +2027,12 @@ static void free_pooled_data_vio(void *data)
 		free_bio(vio->bio);
 	}
 
-	FREE(data_vio->read_block.buffer);
-	FREE(data_vio->data_block);
-	FREE(data_vio->scratch_block);
-	FREE(data_vio);
+	if (data_vio->speculative_bio != NULL) {
+		free_bio(data_vio->speculative_bio);
+	}
+
+	FREE_TAGGED(data_vio->data_block, MEMORY_TAG_DATA_VIOS);
+	FREE_TAGGED(data_vio, MEMORY_TAG_DATA_VIOS);
 }
 
 /**
@@ -979,13 +2051,16 @@ static int allocate_pooled_data_vio(struct data_vio **data_vio_ptr)
 
 	if (WRITE_PROTECT_FREE_POOL) {
 		STATIC_ASSERT(sizeof(struct data_vio) <= WP_DATA_VIO_SIZE);
-		result = allocate_memory(WP_DATA_VIO_SIZE, 0, __func__,
-					 &data_vio);
+		result = allocate_tagged_memory(WP_DATA_VIO_SIZE, 0,
+						MEMORY_TAG_DATA_VIOS, __func__,
+						&data_vio);
 		if (result == VDO_SUCCESS) {
 			BUG_ON((((size_t) data_vio) & (PAGE_SIZE - 1)) != 0);
 		}
 	} else {
-		result = ALLOCATE(1, struct data_vio, __func__, &data_vio);
+		result = ALLOCATE_TAGGED(1, struct data_vio,
+					 MEMORY_TAG_DATA_VIOS, __func__,
+					 &data_vio);
 	}
 
 	if (result != VDO_SUCCESS) {
@@ -994,8 +2069,9 @@ static int allocate_pooled_data_vio(struct data_vio **data_vio_ptr)
 	}
 
 	STATIC_ASSERT(VDO_BLOCK_SIZE <= PAGE_SIZE);
-	result = allocate_memory(VDO_BLOCK_SIZE, 0, "vio data",
-				 &data_vio->data_block);
+	result = allocate_tagged_memory(VDO_BLOCK_SIZE, 0,
+					MEMORY_TAG_DATA_VIOS, "vio data",
+					&data_vio->data_block);
 	if (result != VDO_SUCCESS) {
 		free_pooled_data_vio(data_vio);
 		return log_error_strerror(result,
@@ -1010,20 +2086,11 @@ static int allocate_pooled_data_vio(struct data_vio **data_vio_ptr)
 					  "data_vio data bio allocation failure");
 	}
 
-	result = allocate_memory(VDO_BLOCK_SIZE, 0, "vio read buffer",
-				 &data_vio->read_block.buffer);
-	if (result != VDO_SUCCESS) {
-		free_pooled_data_vio(data_vio);
-		return log_error_strerror(result,
-					  "data_vio read allocation failure");
-	}
-
-	result = allocate_memory(VDO_BLOCK_SIZE, 0, "vio scratch",
-				 &data_vio->scratch_block);
+	result = create_bio(&data_vio->speculative_bio);
 	if (result != VDO_SUCCESS) {
 		free_pooled_data_vio(data_vio);
 		return log_error_strerror(result,
-					  "data_vio scratch allocation failure");
+					  "data_vio speculative bio allocation failure");
 	}
 
 	*data_vio_ptr = data_vio;
@@ -1206,6 +2273,124 @@ int make_data_vio_buffer_pool(uint32_t pool_size,
 				buffer_pool_ptr);
 }
 
+/**
+ * Implements buffer_allocate_function.
+ **/
+static int make_pooled_block_buffer(void **data_ptr)
+{
+	return allocate_tagged_memory(VDO_BLOCK_SIZE, 0, MEMORY_TAG_DATA_VIOS,
+				      "vio block buffer", data_ptr);
+}
+
+/**
+ * Implements buffer_free_function.
+ **/
+static void free_pooled_block_buffer(void *data)
+{
+	FREE_TAGGED(data, MEMORY_TAG_DATA_VIOS);
+}
+
+/**********************************************************************/
+int make_block_buffer_pool(uint32_t pool_size,
+			   struct buffer_pool **buffer_pool_ptr)
+{
+	return make_buffer_pool("block buffer pool",
+				pool_size,
+				make_pooled_block_buffer,
+				free_pooled_block_buffer,
+				NULL,
+				buffer_pool_ptr);
+}
+
+/**********************************************************************/
+int make_data_vio_stage_histograms(struct kobject *parent,
+				   struct data_vio_stage_histograms **histograms_ptr)
+{
+	struct data_vio_stage_histograms *histograms;
+	enum data_vio_milestone milestone;
+	int result = ALLOCATE(1, struct data_vio_stage_histograms, __func__,
+			      &histograms);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	histograms->directory = kobject_create_and_add("data_vio_stages",
+						       parent);
+	if (histograms->directory == NULL) {
+		free_data_vio_stage_histograms(&histograms);
+		return -ENOMEM;
+	}
+
+	for (milestone = 0; milestone < DATA_VIO_MILESTONE_COUNT; milestone++) {
+		histograms->histograms[milestone] =
+			make_logarithmic_histogram(histograms->directory,
+						   STAGE_HISTOGRAMS[milestone].name,
+						   STAGE_HISTOGRAMS[milestone].label,
+						   "data_vios",
+						   "latency",
+						   "microseconds",
+						   STAGE_HISTOGRAM_LOG_SIZE);
+		if (histograms->histograms[milestone] == NULL) {
+			free_data_vio_stage_histograms(&histograms);
+			return -ENOMEM;
+		}
+	}
+
+	*histograms_ptr = histograms;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_data_vio_stage_histograms(struct data_vio_stage_histograms **histograms_ptr)
+{
+	struct data_vio_stage_histograms *histograms = *histograms_ptr;
+	enum data_vio_milestone milestone;
+
+	if (histograms == NULL) {
+		return;
+	}
+
+	for (milestone = 0; milestone < DATA_VIO_MILESTONE_COUNT; milestone++) {
+		free_histogram(&histograms->histograms[milestone]);
+	}
+
+	if (histograms->directory != NULL) {
+		kobject_put(histograms->directory);
+	}
+
+	FREE(histograms);
+	*histograms_ptr = NULL;
+}
+
+/**********************************************************************/
+void record_data_vio_stages(struct data_vio_stage_histograms *histograms,
+			    const struct data_vio *data_vio)
+{
+	enum data_vio_milestone milestone;
+
+	for (milestone = 0; milestone < DATA_VIO_MILESTONE_COUNT; milestone++) {
+		uint64_t end = data_vio->milestone_times[milestone];
+		uint64_t start = data_vio->launch_time;
+		enum data_vio_milestone other;
+
+		if (end == 0) {
+			continue;
+		}
+
+		// The stage began at the latest milestone reached before it.
+		for (other = 0; other < DATA_VIO_MILESTONE_COUNT; other++) {
+			uint64_t time = data_vio->milestone_times[other];
+
+			if ((time > start) && (time < end)) {
+				start = time;
+			}
+		}
+
+		enter_histogram_sample(histograms->histograms[milestone],
+				       (end - start) / NSEC_PER_USEC);
+	}
+}
+
 /**********************************************************************/
 struct data_location get_dedupe_advice(const struct dedupe_context *context)
 {
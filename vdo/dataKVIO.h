@@ -74,25 +74,6 @@ static inline void launch_data_vio_on_cpu_queue(struct data_vio *data_vio,
 		   vdo_as_kernel_layer(vio->vdo)->cpu_queue);
 }
 
-/**
- * Set up and enqueue a data_vio on the bio Ack queue.
- *
- * @param data_vio        The data_vio to set up
- * @param work            The function pointer to execute
- * @param stats_function  A function pointer to record for stats, or NULL
- * @param action          Action code, mapping to a relative priority
- **/
-static inline void
-launch_data_vio_on_bio_ack_queue(struct data_vio *data_vio,
-				 vdo_work_function work,
-				 void *stats_function,
-				 unsigned int action)
-{
-	struct vio *vio = data_vio_as_vio(data_vio);
-	struct kernel_layer *layer = vdo_as_kernel_layer(vio->vdo);
-	launch_vio(vio, work, stats_function, action, layer->bio_ack_queue);
-}
-
 /**
  * Move a data_vio back to the base threads.
  *
@@ -108,8 +89,8 @@ static inline void enqueue_data_vio_callback(struct data_vio *data_vio)
  * processing the vio.
  *
  * If setting up a vio fails, a message is logged, and the limiter permits
- * (request and maybe discard) released, but the caller is responsible for
- * disposing of the bio.
+ * (request and maybe discard or write) released, but the caller is
+ * responsible for disposing of the bio.
  *
  * @param vdo                 The vdo
  * @param bio                 The bio for which to create vio
@@ -117,13 +98,33 @@ static inline void enqueue_data_vio_callback(struct data_vio *data_vio)
  *                            entered the device mapbio function
  * @param has_discard_permit  Whether we got a permit from the discard
  *                            limiter of the kernel layer
+ * @param has_write_permit    Whether we got a permit from the write limiter
+ * @param qos_class           The QoS class from which we got a permit, or
+ *                            NULL if we did not get one
  *
  * @return VDO_SUCCESS or a system error code
  **/
 int __must_check vdo_launch_data_vio_from_bio(struct vdo *vdo,
 					      struct bio *bio,
 					      uint64_t arrival_jiffies,
-					      bool has_discard_permit);
+					      bool has_discard_permit,
+					      bool has_write_permit,
+					      struct qos_class *qos_class);
+
+/**
+ * Launch a data_vio to read back a block which was written without
+ * deduplication and share a duplicate of it if one is found. The data_vio
+ * takes a request permit, and reports to the post-process deduper when it
+ * completes.
+ *
+ * @param layer  The kernel layer
+ * @param lbn    The logical block to check
+ *
+ * @return <code>true</code> if the data_vio was launched, or
+ *         <code>false</code> if no request permit was available
+ **/
+bool launch_post_dedupe_data_vio(struct kernel_layer *layer,
+				 logical_block_number_t lbn);
 
 /**
  * Return a batch of data_vio objects to the pool.
@@ -136,6 +137,50 @@ int __must_check vdo_launch_data_vio_from_bio(struct vdo *vdo,
 void return_data_vio_batch_to_pool(struct batch_processor *batch,
 				   void *closure);
 
+/**
+ * Acknowledge a batch of bios on a bio ack thread, continuing each data_vio
+ * with the work function it was queued with.
+ *
+ * <p>Implements batch_processor_callback.
+ *
+ * @param batch    The batch processor
+ * @param closure  The kernel layer
+ **/
+void acknowledge_data_vio_batch(struct batch_processor *batch, void *closure);
+
+/**
+ * Acknowledge a batch of bios on a thread of the bio ack queue shared by all
+ * VDOs. Each data_vio may belong to a different VDO.
+ *
+ * <p>Implements batch_processor_callback.
+ *
+ * @param batch    The batch processor
+ * @param closure  Unused
+ **/
+void acknowledge_shared_data_vio_batch(struct batch_processor *batch,
+				       void *closure);
+
+/**
+ * Hash a batch of data_vio objects and send each back to the base threads.
+ *
+ * <p>Implements batch_processor_callback.
+ *
+ * @param batch    The batch processor
+ * @param closure  The kernel layer
+ **/
+void hash_data_vio_batch(struct batch_processor *batch, void *closure);
+
+/**
+ * Compress a batch of data_vio objects and send each back to the base
+ * threads.
+ *
+ * <p>Implements batch_processor_callback.
+ *
+ * @param batch    The batch processor
+ * @param closure  The kernel layer
+ **/
+void compress_data_vio_batch(struct batch_processor *batch, void *closure);
+
 /**
  * Fetch the data for a block from storage. The fetched data will be
  * uncompressed when the callback is called, and the result of the read
@@ -166,6 +211,51 @@ int __must_check
 make_data_vio_buffer_pool(uint32_t pool_size,
 			  struct buffer_pool **buffer_pool_ptr);
 
+/**
+ * Allocate a buffer pool of the block-sized read and scratch buffers which
+ * data_vios take only when they need them.
+ *
+ * @param [in]  pool_size        The number of blocks in the pool
+ * @param [out] buffer_pool_ptr  A pointer to hold the new buffer pool
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check
+make_block_buffer_pool(uint32_t pool_size,
+		       struct buffer_pool **buffer_pool_ptr);
+
+/**
+ * Create the latency histograms of the stages of the data_vio lifecycle, in
+ * a sysfs directory of their own.
+ *
+ * @param [in]  parent          The sysfs directory to hold the histograms
+ * @param [out] histograms_ptr  A pointer to hold the new histograms
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check
+make_data_vio_stage_histograms(struct kobject *parent,
+			       struct data_vio_stage_histograms **histograms_ptr);
+
+/**
+ * Free the data_vio stage latency histograms and null out the reference to
+ * them.
+ *
+ * @param histograms_ptr  A pointer to the histograms to free
+ **/
+void
+free_data_vio_stage_histograms(struct data_vio_stage_histograms **histograms_ptr);
+
+/**
+ * Enter the latency of each stage a finished data_vio went through into the
+ * stage histograms.
+ *
+ * @param histograms  The stage histograms
+ * @param data_vio    The finished data_vio
+ **/
+void record_data_vio_stages(struct data_vio_stage_histograms *histograms,
+			    const struct data_vio *data_vio);
+
 /**
  * Get the state needed to generate UDS metadata from the data_vio
  * associated with a dedupe_context.
@@ -46,6 +46,7 @@ static const char *ASYNC_OPERATION_NAMES[] = {
 	"findBlockMapSlot",
 	"getMappedBlock",
 	"getMappedBlockForDedupe",
+	"getMappedBlockForTrim",
 	"getMappedBlockForWrite",
 	"hashData",
 	"journalDecrementForDedupe",
@@ -83,6 +84,7 @@ static void initialize_lbn_lock(struct data_vio *data_vio,
 
 	lock->lbn = lbn;
 	lock->locked = false;
+	lock->updating = false;
 	initialize_wait_queue(&lock->waiters);
 
 	lock->zone = get_logical_zone(vdo->logical_zones,
@@ -227,6 +229,12 @@ static void launch_locked_request(struct data_vio *data_vio)
 {
 	data_vio->logical.locked = true;
 
+	// Anything other than a pure read may change the mapping.
+	if (!is_read_data_vio(data_vio)) {
+		begin_block_map_update(data_vio);
+		data_vio->logical.updating = true;
+	}
+
 	if (is_write_data_vio(data_vio)) {
 		launch_write_data_vio(data_vio);
 	} else {
@@ -250,6 +258,10 @@ void attempt_logical_block_lock(struct vdo_completion *completion)
 		return;
 	}
 
+	if (divert_for_tree_handoff(data_vio)) {
+		return;
+	}
+
 	result = int_map_put(get_lbn_lock_map(lock->zone), lock->lbn,
 			     data_vio, false, (void **) &lock_holder);
 	if (result != VDO_SUCCESS) {
@@ -259,6 +271,7 @@ void attempt_logical_block_lock(struct vdo_completion *completion)
 
 	if (lock_holder == NULL) {
 		// We got the lock
+		note_logical_block_locked(data_vio);
 		launch_locked_request(data_vio);
 		return;
 	}
@@ -305,6 +318,20 @@ void attempt_logical_block_lock(struct vdo_completion *completion)
 	}
 }
 
+/**
+ * Lower the block map update fence if a data_vio which is giving up its LBN
+ * lock raised it.
+ *
+ * @param data_vio  The data_vio releasing its lock
+ **/
+static void end_update(struct data_vio *data_vio)
+{
+	if (data_vio->logical.updating) {
+		end_block_map_update(data_vio);
+		data_vio->logical.updating = false;
+	}
+}
+
 /**
  * Release an uncontended LBN lock.
  *
@@ -327,12 +354,13 @@ static void release_lock(struct data_vio *data_vio)
 	}
 
 	// Remove the lock from the logical block lock map, releasing the lock.
+	end_update(data_vio);
 	lock_holder = int_map_remove(lock_map, lock->lbn);
 	ASSERT_LOG_ONLY((data_vio == lock_holder),
 			"logical block lock mismatch for block %llu",
 			lock->lbn);
 	lock->locked = false;
-	return;
+	note_logical_block_unlocked(data_vio);
 }
 
 /**********************************************************************/
@@ -369,6 +397,7 @@ void release_logical_block_lock(struct data_vio *data_vio)
 	ASSERT_LOG_ONLY((lock_holder == data_vio),
 			"logical block lock mismatch for block %llu",
 			lock->lbn);
+	end_update(data_vio);
 	lock->locked = false;
 
 	/*
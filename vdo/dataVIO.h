@@ -22,6 +22,7 @@
 #ifndef DATA_VIO_H
 #define DATA_VIO_H
 
+#include <linux/ktime.h>
 #include <linux/list.h>
 
 #include "atomicDefs.h"
@@ -34,6 +35,7 @@
 #include "hashZone.h"
 #include "journalPoint.h"
 #include "logicalZone.h"
+#include "readCache.h"
 #include "referenceOperation.h"
 #include "threadConfig.h"
 #include "types.h"
@@ -59,6 +61,7 @@ enum async_operation_number {
 	FIND_BLOCK_MAP_SLOT,
 	GET_MAPPED_BLOCK,
 	GET_MAPPED_BLOCK_FOR_DEDUPE,
+	GET_MAPPED_BLOCK_FOR_TRIM,
 	GET_MAPPED_BLOCK_FOR_WRITE,
 	HASH_DATA,
 	JOURNAL_DECREMENT_FOR_DEDUPE,
@@ -89,6 +92,8 @@ struct lbn_lock {
 	logical_block_number_t lbn;
 	/* Whether the lock is locked */
 	bool locked;
+	/* Whether the lock holder has raised the block map's update fence */
+	bool updating;
 	/* The queue of waiters for the lock */
 	struct wait_queue waiters;
 	/* The logical zone of the LBN */
@@ -143,6 +148,15 @@ struct compression_state {
 	/* The compressed size of this block */
 	uint16_t size;
 
+	/* The time (from ktime_get_ns()) at which this vio entered the packer */
+	uint64_t packer_arrival;
+
+	/*
+	 * Whether the estimate made while hashing this block judged it not
+	 * worth compressing
+	 */
+	bool likely_incompressible;
+
 	/*
 	 * The packer input or output bin slot which holds the enclosing
 	 * data_vio
@@ -173,6 +187,8 @@ struct dedupe_context {
 	atomic_t request_state;
 	int status;
 	bool is_pending;
+	/** Whether the last operation skipped an index which was backed up */
+	bool was_shed;
 	/** Hash of the associated VIO (NULL if not calculated) */
 	const struct uds_chunk_name *chunk_name;
 };
@@ -184,7 +200,8 @@ struct read_block {
 	 **/
 	char *data;
 	/**
-	 * Temporary storage for doing reads from the underlying device.
+	 * Temporary storage for doing reads from the underlying device, taken
+	 * by the first read and kept until the data_vio is released.
 	 **/
 	char *buffer;
 	/**
@@ -196,12 +213,64 @@ struct read_block {
 	 * the data must be uncompressed.
 	 **/
 	enum block_mapping_state mapping_state;
+	/**
+	 * The physical block being read.
+	 **/
+	physical_block_number_t pbn;
+	/**
+	 * Whether the data was copied from the read cache rather than read
+	 * from storage.
+	 **/
+	bool from_cache;
+	/**
+	 * Whether only the sectors holding the compressed block header and
+	 * the fragment were read, so the buffer does not hold the whole block.
+	 **/
+	bool sectors_only;
+	/**
+	 * Whether this read claimed its compressed block in the read cache, so
+	 * that other reads of the block wait for it.
+	 **/
+	bool filling;
+	/**
+	 * The waiter used to wait for another read of the same compressed
+	 * block.
+	 **/
+	struct read_cache_waiter fill_waiter;
+	/**
+	 * The bio queue action for the read, kept for the fragment read which
+	 * follows the header read of a sectors_only read.
+	 **/
+	unsigned int action;
 	/**
 	 * The result code of the read attempt.
 	 **/
 	int status;
 };
 
+/**
+ * The points in the life of a data_vio at which it records the time, so that
+ * its latency can be broken down by stage. Not every data_vio reaches every
+ * milestone; a read, for example, only reaches DATA_VIO_ACKNOWLEDGED.
+ **/
+enum data_vio_milestone {
+	/* The data has been hashed */
+	DATA_VIO_HASHED,
+	/* The dedupe index has answered the data_vio's query */
+	DATA_VIO_ADVISED,
+	/* The data_vio has been allocated a physical block */
+	DATA_VIO_ALLOCATED,
+	/* The data has been written to its physical block */
+	DATA_VIO_WRITTEN,
+	/* The data_vio's first recovery journal entry has been committed */
+	DATA_VIO_JOURNALED,
+	/* The block map has been updated with the new mapping */
+	DATA_VIO_MAPPED,
+	/* The user bio has been acknowledged */
+	DATA_VIO_ACKNOWLEDGED,
+	DATA_VIO_MILESTONE_COUNT,
+};
+
 /**
  * A vio for processing user data requests.
  **/
@@ -218,6 +287,15 @@ struct data_vio {
 	/* The current partition address of this block */
 	struct zoned_pbn mapped;
 
+	/*
+	 * Whether this read looked up its mapping without locking its
+	 * logical block, and the state needed to check that mapping once
+	 * the data has been read
+	 */
+	bool is_lockless;
+	unsigned int lockless_update_sequence;
+	struct vdo_page_snapshot lockless_page;
+
 	/** The hash of this vio (if not zero) */
 	struct uds_chunk_name chunk_name;
 
@@ -230,12 +308,54 @@ struct data_vio {
 	/* Whether this vio is a read-and-write vio */
 	bool is_partial_write;
 
+	/*
+	 * The partial writes to the same block which this read-modify-write
+	 * has absorbed, and which will be acknowledged along with it
+	 */
+	struct wait_queue combined_writes;
+
+	/*
+	 * Whether this vio was launched by the post-process deduper to check
+	 * a block which was written without deduplication
+	 */
+	bool is_rededupe;
+
+	/*
+	 * Whether this vio writes to a logical block which is exempt from
+	 * deduplication
+	 */
+	bool dedupe_exempt;
+
 	/* Whether this vio contains all zeros */
 	bool is_zero_block;
 
 	/* Whether this vio write is a duplicate */
 	bool is_duplicate;
 
+	/*
+	 * Whether this vio should write its data to its allocation while its
+	 * dedupe advice is being verified
+	 */
+	bool write_while_verifying;
+
+	/*
+	 * Whether this vio has already written its data to its allocation
+	 * while verifying its dedupe advice
+	 */
+	bool speculatively_written;
+
+	/*
+	 * The number of parts of a verify with a speculative write (the write
+	 * itself, and the read and compare of the candidate) not yet finished
+	 */
+	atomic_t verify_steps;
+
+	/*
+	 * Whether the block map entry last read for this vio was invalid and
+	 * treated as unmapped
+	 */
+	bool has_invalid_mapping;
+
 	/*
 	 * Whether this vio has received an allocation. This field is examined
 	 * from threads not in the allocation zone.
@@ -264,6 +384,12 @@ struct data_vio {
 	 */
 	struct list_head hash_lock_entry;
 
+	/*
+	 * The time (in nanoseconds) at which this vio began waiting on its
+	 * hash lock, or 0 if it is not waiting
+	 */
+	uint64_t hash_lock_wait_start;
+
 	/*
 	 * The block number in the partition of the UDS deduplication advice
 	 */
@@ -309,6 +435,20 @@ struct data_vio {
 	bool has_discard_permit;
 	uint32_t remaining_discard;
 
+	/* Whether this data_vio holds a permit from the write limiter */
+	bool has_write_permit;
+
+	/* The QoS class from which this data_vio holds a permit, if any */
+	struct qos_class *qos_class;
+
+	/* The time, in nanoseconds, at which this data_vio was launched */
+	uint64_t launch_time;
+	/*
+	 * The times, in nanoseconds, at which this data_vio first reached
+	 * each milestone, or 0 for milestones not yet reached
+	 */
+	uint64_t milestone_times[DATA_VIO_MILESTONE_COUNT];
+
 	// Fields beyond this point will not be reset when a pooled data_vio
 	// is reused.
 
@@ -324,10 +464,20 @@ struct data_vio {
 	 * emulating smaller-than-blockSize I/O operations.
 	 **/
 	char *data_block;
-	/** A block used as output during compression or uncompression */
+	/**
+	 * A block used as output during compression or uncompression, taken
+	 * only when needed and kept until the data_vio is released
+	 **/
 	char *scratch_block;
+	/**
+	 * Which of the scratch block and read block buffer came from the
+	 * layer's block buffer pool rather than a fallback allocation
+	 **/
+	uint8_t pooled_buffers;
 	/* For data and verification reads */
 	struct read_block read_block;
+	/* For writing the data while the verification read is in progress */
+	struct bio *speculative_bio;
 };
 
 /**
@@ -398,6 +548,21 @@ static inline struct data_vio *as_data_vio(struct vdo_completion *completion)
 	return vio_as_data_vio(as_vio(completion));
 }
 
+/**
+ * Record the time at which a data_vio reached a milestone, unless it has
+ * already reached it.
+ *
+ * @param data_vio   The data_vio
+ * @param milestone  The milestone reached
+ **/
+static inline void record_data_vio_milestone(struct data_vio *data_vio,
+					     enum data_vio_milestone milestone)
+{
+	if (data_vio->milestone_times[milestone] == 0) {
+		data_vio->milestone_times[milestone] = ktime_get_ns();
+	}
+}
+
 /**
  * Convert a data_vio to a generic completion.
  *
@@ -915,14 +1080,42 @@ launch_journal_callback(struct data_vio *data_vio,
 }
 
 /**
- * Check that a data_vio is running on the packer thread
+ * Get the number of the packer zone which handles a data_vio. Compressed
+ * writes are spread across the packers by the physical zone of their
+ * allocation, which does not change while a data_vio is compressing. A
+ * data_vio sent to the packer to cancel a lock holder is routed to the zone
+ * of that lock holder.
+ *
+ * @param data_vio  The data_vio
+ *
+ * @return The number of the data_vio's packer zone
+ **/
+static inline zone_count_t get_data_vio_packer_zone(struct data_vio *data_vio)
+{
+	const struct thread_config *thread_config =
+		get_thread_config_from_data_vio(data_vio);
+	struct data_vio *packing = ((data_vio->compression.lock_holder != NULL)
+				    ? data_vio->compression.lock_holder
+				    : data_vio);
+	struct physical_zone *zone = data_vio_as_allocating_vio(packing)->zone;
+	if ((thread_config->packer_zone_count == 1) || (zone == NULL)) {
+		return 0;
+	}
+
+	return (get_physical_zone_number(zone)
+		% thread_config->packer_zone_count);
+}
+
+/**
+ * Check that a data_vio is running on its packer zone thread
  *
  * @param data_vio The data_vio in question
  **/
 static inline void assert_in_packer_zone(struct data_vio *data_vio)
 {
 	thread_id_t expected =
-		get_packer_zone_thread(get_thread_config_from_data_vio(data_vio));
+		get_packer_zone_thread(get_thread_config_from_data_vio(data_vio),
+				       get_data_vio_packer_zone(data_vio));
 	thread_id_t thread_id = get_callback_thread_id();
 	ASSERT_LOG_ONLY((expected == thread_id),
 			"data_vio for logical block %llu on thread %u, should be on packer thread %u",
@@ -932,7 +1125,7 @@ static inline void assert_in_packer_zone(struct data_vio *data_vio)
 }
 
 /**
- * Set a callback as a packer operation.
+ * Set a callback as a packer operation in the data_vio's packer zone.
  *
  * @param data_vio  The data_vio with which to set the callback
  * @param callback  The callback to set
@@ -942,7 +1135,8 @@ static inline void set_packer_callback(struct data_vio *data_vio,
 {
 	set_vdo_completion_callback(data_vio_as_completion(data_vio),
 				    callback,
-				    get_packer_zone_thread(get_thread_config_from_data_vio(data_vio)));
+				    get_packer_zone_thread(get_thread_config_from_data_vio(data_vio),
+							   get_data_vio_packer_zone(data_vio)));
 }
 
 /**
@@ -1039,6 +1233,28 @@ void hash_data_vio(struct data_vio *data_vio);
  **/
 void check_for_duplication(struct data_vio *data_vio);
 
+/**
+ * Check whether a data_vio writes to a logical block which has been exempted
+ * from deduplication.
+ *
+ * @param data_vio  The data_vio containing the block
+ *
+ * @return <code>true</code> if the block should bypass hashing (unless it
+ *         may be compressed) and the dedupe index
+ **/
+bool is_exempt_from_deduplication(struct data_vio *data_vio);
+
+/**
+ * Check whether the deduplication of a newly written block should be left to
+ * the post-process deduper and, if so, log the block for it.
+ *
+ * @param data_vio  The data_vio containing the block
+ *
+ * @return <code>true</code> if the block should be written without checking
+ *         for duplicates
+ **/
+bool defer_deduplication(struct data_vio *data_vio);
+
 /**
  * A function to verify the duplication advice by examining an already-stored
  * data block. This function expects the 'physical' field of the data_vio to be
@@ -1047,6 +1263,12 @@ void check_for_duplication(struct data_vio *data_vio);
  * mapping state where a copy of the data may already exist. If the block is
  * not a duplicate, the data_vio's 'isDuplicate' field will be cleared.
  *
+ * If the data_vio's 'write_while_verifying' field is set, its data is also
+ * written to its allocation while the candidate is read, and its
+ * 'speculatively_written' field is set if that write succeeded. The two parts
+ * each count down the data_vio's 'verify_steps', and the callback is invoked
+ * again by the write if it is not the last to finish.
+ *
  * @param data_vio  The data_vio containing the block to check.
  **/
 void verify_duplication(struct data_vio *data_vio);
@@ -1082,6 +1304,17 @@ void copy_data(struct data_vio *source, struct data_vio *destination);
  **/
 void apply_partial_write(struct data_vio *data_vio);
 
+/**
+ * A function to apply the partial write of another data_vio to the same block
+ * to a data_vio which has already applied its own partial write, so that a
+ * single block write will carry both.
+ *
+ * @param data_vio  The data_vio to modify
+ * @param combined  The data_vio whose partial write is to be applied
+ **/
+void apply_combined_partial_write(struct data_vio *data_vio,
+				  struct data_vio *combined);
+
 /**
  * A function to inform the layer that a data_vio's related I/O request can be
  * safely acknowledged as complete, even though the data_vio itself may have
@@ -1098,6 +1331,51 @@ void acknowledge_data_vio(struct data_vio *data_vio);
  **/
 void compress_data_vio(struct data_vio *data_vio);
 
+/**
+ * A run of data_vios in a batch, writing logically consecutive blocks, to be
+ * compressed together as one fragment.
+ **/
+struct compression_unit {
+	/** The data_vios of the unit, in logical block order */
+	struct data_vio **data_vios;
+	/** The number of data_vios in the unit */
+	unsigned int count;
+	/** The buffer to hold the compressed fragment */
+	char *fragment;
+	/** The size of the fragment buffer */
+	unsigned int buffer_size;
+	/**
+	 * The compressed size, or 0 if the blocks did not compress to less
+	 * than the size of the buffer
+	 **/
+	unsigned int size;
+};
+
+/**
+ * The compression units of one batch. Every unit holds at least two
+ * data_vios, so a batch can have at most half as many units as slots.
+ **/
+struct compression_units {
+	/**
+	 * The completion to enqueue on its callback thread once every unit
+	 * has been compressed
+	 **/
+	struct vdo_completion completion;
+	/** The number of units */
+	unsigned int count;
+	/** The units */
+	struct compression_unit units[MAX_COMPRESSION_SLOTS / 2];
+};
+
+/**
+ * A function to compress the data of each unit of a batch together as one
+ * fragment. The work is done off the calling thread; the completion of the
+ * units is enqueued when it is finished.
+ *
+ * @param units  The units to compress
+ **/
+void compress_data_vio_units(struct compression_units *units);
+
 /**
  * A function to read a single data_vio from the layer.
  *
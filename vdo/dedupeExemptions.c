@@ -0,0 +1,139 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "dedupeExemptions.h"
+
+#include <linux/spinlock.h>
+
+#include "atomicDefs.h"
+#include "memoryAlloc.h"
+
+#include "statusCodes.h"
+
+enum {
+	/** The most ranges which may be exempt at once */
+	MAXIMUM_DEDUPE_EXEMPTIONS = 16,
+};
+
+/** A range of logical blocks, as [start, end) */
+struct lbn_range {
+	logical_block_number_t start;
+	logical_block_number_t end;
+};
+
+struct dedupe_exemptions {
+	/** Protects the ranges */
+	spinlock_t lock;
+	/** The number of ranges in the table */
+	unsigned int count;
+	/** The number of writes which were exempt */
+	atomic64_t exempt_writes;
+	/** The exempt ranges */
+	struct lbn_range ranges[MAXIMUM_DEDUPE_EXEMPTIONS];
+};
+
+/**********************************************************************/
+int make_dedupe_exemptions(struct dedupe_exemptions **exemptions_ptr)
+{
+	struct dedupe_exemptions *exemptions;
+	int result = ALLOCATE(1, struct dedupe_exemptions, __func__,
+			      &exemptions);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	spin_lock_init(&exemptions->lock);
+	atomic64_set(&exemptions->exempt_writes, 0);
+	*exemptions_ptr = exemptions;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_dedupe_exemptions(struct dedupe_exemptions **exemptions_ptr)
+{
+	FREE(*exemptions_ptr);
+	*exemptions_ptr = NULL;
+}
+
+/**********************************************************************/
+int add_dedupe_exemption(struct dedupe_exemptions *exemptions,
+			 logical_block_number_t start,
+			 block_count_t count)
+{
+	int result = VDO_SUCCESS;
+
+	if ((count == 0) || (start + count < start)) {
+		return VDO_OUT_OF_RANGE;
+	}
+
+	spin_lock(&exemptions->lock);
+	if (exemptions->count == MAXIMUM_DEDUPE_EXEMPTIONS) {
+		result = VDO_BAD_CONFIGURATION;
+	} else {
+		exemptions->ranges[exemptions->count] = (struct lbn_range) {
+			.start = start,
+			.end = start + count,
+		};
+		WRITE_ONCE(exemptions->count, exemptions->count + 1);
+	}
+	spin_unlock(&exemptions->lock);
+	return result;
+}
+
+/**********************************************************************/
+void clear_dedupe_exemptions(struct dedupe_exemptions *exemptions)
+{
+	spin_lock(&exemptions->lock);
+	WRITE_ONCE(exemptions->count, 0);
+	spin_unlock(&exemptions->lock);
+}
+
+/**********************************************************************/
+bool is_dedupe_exempt(struct dedupe_exemptions *exemptions,
+		      logical_block_number_t lbn)
+{
+	unsigned int i;
+	bool exempt = false;
+
+	if (READ_ONCE(exemptions->count) == 0) {
+		return false;
+	}
+
+	spin_lock(&exemptions->lock);
+	for (i = 0; i < exemptions->count; i++) {
+		if ((lbn >= exemptions->ranges[i].start) &&
+		    (lbn < exemptions->ranges[i].end)) {
+			exempt = true;
+			break;
+		}
+	}
+	spin_unlock(&exemptions->lock);
+
+	if (exempt) {
+		atomic64_inc(&exemptions->exempt_writes);
+	}
+
+	return exempt;
+}
+
+/**********************************************************************/
+uint64_t get_dedupe_exempt_writes(struct dedupe_exemptions *exemptions)
+{
+	return atomic64_read(&exemptions->exempt_writes);
+}
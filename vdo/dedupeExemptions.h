@@ -0,0 +1,99 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef DEDUPE_EXEMPTIONS_H
+#define DEDUPE_EXEMPTIONS_H
+
+#include "types.h"
+
+/**
+ * A dedupe_exemptions table holds the ranges of logical blocks whose writes
+ * bypass deduplication entirely. Writes to an exempt block are not hashed
+ * unless they may be compressed, and never consult or update the dedupe
+ * index, so data which is known never to deduplicate (such as encrypted
+ * data) does not load the index.
+ *
+ * Ranges are added and cleared with dmsetup messages, and are consulted by
+ * every write, so the table is small and a check of an empty table does not
+ * take its lock.
+ **/
+struct dedupe_exemptions;
+
+/**
+ * Make an empty table of dedupe exemptions.
+ *
+ * @param exemptions_ptr  A pointer to hold the new table
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check
+make_dedupe_exemptions(struct dedupe_exemptions **exemptions_ptr);
+
+/**
+ * Free a table of dedupe exemptions and null out the reference to it.
+ *
+ * @param exemptions_ptr  A pointer to the table to free
+ **/
+void free_dedupe_exemptions(struct dedupe_exemptions **exemptions_ptr);
+
+/**
+ * Exempt a range of logical blocks from deduplication.
+ *
+ * @param exemptions  The table of exemptions
+ * @param start       The first logical block of the range
+ * @param count       The number of logical blocks in the range
+ *
+ * @return VDO_SUCCESS, VDO_OUT_OF_RANGE if the range is empty or wraps, or
+ *         VDO_BAD_CONFIGURATION if the table is full
+ **/
+int __must_check add_dedupe_exemption(struct dedupe_exemptions *exemptions,
+				      logical_block_number_t start,
+				      block_count_t count);
+
+/**
+ * Remove all ranges from a table of dedupe exemptions.
+ *
+ * @param exemptions  The table of exemptions
+ **/
+void clear_dedupe_exemptions(struct dedupe_exemptions *exemptions);
+
+/**
+ * Check whether a logical block is exempt from deduplication, and count the
+ * write if it is.
+ *
+ * @param exemptions  The table of exemptions
+ * @param lbn         The logical block being written
+ *
+ * @return <code>true</code> if writes to the block should not be deduplicated
+ **/
+bool __must_check is_dedupe_exempt(struct dedupe_exemptions *exemptions,
+				   logical_block_number_t lbn);
+
+/**
+ * Get the number of writes which bypassed deduplication because of an
+ * exemption.
+ *
+ * @param exemptions  The table of exemptions
+ *
+ * @return The number of exempt writes
+ **/
+uint64_t __must_check
+get_dedupe_exempt_writes(struct dedupe_exemptions *exemptions);
+
+#endif // DEDUPE_EXEMPTIONS_H
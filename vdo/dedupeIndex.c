@@ -22,6 +22,8 @@
 #include "dedupeIndex.h"
 
 #include <asm/unaligned.h>
+#include <linux/delay.h>
+#include <linux/mutex.h>
 #include <linux/ratelimit.h>
 #include <linux/workqueue.h>
 
@@ -32,15 +34,39 @@
 #include "stringUtils.h"
 #include "uds.h"
 
+#include "batchProcessor.h"
+#include "hashZone.h"
 #include "kernelLayer.h"
+#include "threadConfig.h"
 
 struct uds_attribute {
 	struct attribute attr;
 	const char *(*show_string)(struct dedupe_index *);
+	ssize_t (*show)(struct dedupe_index *, char *);
+	ssize_t (*store)(struct dedupe_index *, const char *, size_t);
 };
 
 enum { UDS_Q_ACTION };
 
+enum {
+	/** The most index operations handed to UDS in one call */
+	UDS_REQUEST_BATCH_SIZE = 32,
+	/** The most index updates gathered from a hash zone at once */
+	UPDATE_BATCH_SIZE = UDS_REQUEST_BATCH_SIZE,
+	/** The default longest time, in milliseconds, an update is held */
+	DEFAULT_UPDATE_DELAY_MS = 10,
+	/**
+	 * The number of power-of-two buckets of response times, in jiffies,
+	 * used by the adaptive timeout. The last bucket covers everything
+	 * over the two minute limit on the timeout at any likely HZ.
+	 **/
+	TIMEOUT_HISTOGRAM_SIZE = 20,
+	/** The number of responses or timeouts per timeout adjustment */
+	TIMEOUT_WINDOW_SAMPLES = 1024,
+	/** The scale of the timeout percentile: tenths of a percent */
+	TIMEOUT_PERCENTILE_SCALE = 1000,
+};
+
 // These are the values in the atomic dedupe_context.request_state field
 enum {
 	// The uds_request object is not in use.
@@ -69,6 +95,57 @@ struct periodic_event_reporter {
 	struct kernel_layer *layer;
 };
 
+/**
+ * An index session shared by all the VDOs which name the same index device
+ * with the sharedIndex option. The first of them to open the index loads (or
+ * creates) it, and the last of them to close it saves and closes it. All the
+ * fields are protected by the shared_index_mutex.
+ **/
+struct shared_index {
+	struct list_head list_entry;
+	// The index device
+	dev_t device;
+	struct uds_index_session *session;
+	// The number of VDOs using the session
+	unsigned int users;
+	// The number of VDOs which have the index open
+	unsigned int opened;
+};
+
+struct update_buffer;
+
+/**
+ * An index update taken over from the data_vio which requested it, so that
+ * the data_vio need not wait for it.
+ **/
+struct index_update {
+	struct uds_request request;
+	struct update_buffer *buffer;
+};
+
+/**
+ * A batch of index updates started together, which is freed once all of its
+ * updates have called back.
+ **/
+struct update_buffer {
+	struct dedupe_index *index;
+	// The number of updates which have not called back
+	atomic_t pending;
+	unsigned int count;
+	struct index_update updates[UPDATE_BATCH_SIZE];
+};
+
+/**
+ * The index updates being gathered from one hash zone. The updates are
+ * started once the buffer is full, or when the delayed work fires.
+ **/
+struct update_batch {
+	struct dedupe_index *index;
+	spinlock_t lock;
+	struct update_buffer *buffer; // protected by lock
+	struct delayed_work work;
+};
+
 struct dedupe_index {
 	struct kobject dedupe_directory;
 	struct registered_thread allocating_thread;
@@ -76,20 +153,65 @@ struct dedupe_index {
 	struct uds_configuration *configuration;
 	struct uds_parameters uds_params;
 	struct uds_index_session *index_session;
+	// The session shared with other VDOs, or NULL if the index belongs to
+	// this VDO alone
+	struct shared_index *shared;
+	// Whether this VDO holds one of the opens of the shared index
+	bool shared_open;
+	// The tag marking the advice of this VDO in a shared index
+	uint32_t volume_tag;
 	atomic_t active;
+	// The number of requests handed to UDS and not yet called back
+	atomic_t uds_requests;
+	// The number of shared index hits on the advice of other VDOs
+	atomic64_t cross_volume_count;
 	// for reporting UDS timeouts
 	struct periodic_event_reporter timeout_reporter;
+	// The UDS response time percentile, in tenths of a percent, which the
+	// timeout tracks; 0 uses the module-wide timeout
+	unsigned int timeout_percentile;
+	// The current adaptive timeout, in jiffies
+	unsigned long timeout_jiffies;
+	// Timeouts per thousand requests in the last complete window
+	unsigned int timeout_rate;
+	// Response times seen in the current window
+	atomic_t latency_histogram[TIMEOUT_HISTOGRAM_SIZE];
+	atomic_t window_samples;
+	atomic_t window_timeouts;
+	// A moving average of response times, in eighths of a jiffy
+	unsigned long average_response;
+	// The number of outstanding requests at which to skip queries; 0 is
+	// no limit
+	unsigned int shed_depth;
+	// The average response time, in jiffies, at which to skip queries; 0
+	// is no limit
+	unsigned long shed_latency_jiffies;
+	// The number of queries and posts skipped because of backpressure
+	atomic64_t shed_count;
+	// The index updates being gathered from each hash zone
+	struct update_batch *update_batches;
+	zone_count_t update_batch_count;
+	// The longest time, in jiffies, an update is held to fill a batch; 0
+	// starts each update on its own
+	unsigned long update_delay_jiffies;
 	// This spinlock protects the state fields and the starting of dedupe
 	// requests.
 	spinlock_t state_lock;
 	struct vdo_work_item work_item; // protected by state_lock
 	struct vdo_work_queue *uds_queue; // protected by state_lock
+	// Gathers index operations to start on the uds_queue
+	struct batch_processor *uds_batcher;
 	unsigned int maximum; // protected by state_lock
 	enum index_state index_state; // protected by state_lock
 	enum index_state index_target; // protected by state_lock
 	bool changing; // protected by state_lock
 	bool create_flag; // protected by state_lock
+	// Whether the index lives on its own device rather than inside the
+	// VDO storage
+	bool separate_device;
 	bool dedupe_flag; // protected by state_lock
+	// The vdo whose hash zones should follow the index zones
+	struct vdo *vdo;
 	bool deduping; // protected by state_lock
 	bool error_flag; // protected by state_lock
 	bool suspended; // protected by state_lock
@@ -103,12 +225,26 @@ struct dedupe_index {
 
 // Version 1:  user space UDS index (limited to 32 bytes)
 // Version 2:  kernel space UDS index (limited to 16 bytes)
+// Version 3:  version 2 plus the tag of the VDO which wrote it, used in
+//             indexes shared by several VDOs
 enum {
 	UDS_ADVICE_VERSION = 2,
+	UDS_SHARED_ADVICE_VERSION = 3,
 	// version byte + state byte + 64-bit little-endian PBN
 	UDS_ADVICE_SIZE = 1 + 1 + sizeof(uint64_t),
+	// version 2 advice + 32-bit little-endian volume tag
+	UDS_SHARED_ADVICE_SIZE = UDS_ADVICE_SIZE + sizeof(uint32_t),
 };
 
+// A shared index belongs to no one VDO, so it has a nonce of its own. This
+// still keeps a VDO from loading a shared index as its private one, or the
+// reverse.
+static const uds_nonce_t SHARED_INDEX_NONCE = 0x5348415245444958;
+
+// The shared index sessions, protected by the shared_index_mutex
+static LIST_HEAD(shared_indexes);
+static DEFINE_MUTEX(shared_index_mutex);
+
 // We want to ensure that there is only one copy of the following constants.
 static const char *CLOSED = "closed";
 static const char *CLOSING = "closing";
@@ -153,44 +289,63 @@ static const char *index_state_to_string(struct dedupe_index *index,
 
 /**
  * Encode VDO duplicate advice into the new_metadata field of a UDS request.
+ * Advice in a shared index is tagged with the VDO which wrote it.
  *
+ * @param index    The dedupe index
  * @param request  The UDS request to receive the encoding
  * @param advice   The advice to encode
  **/
-static void encode_uds_advice(struct uds_request *request,
+static void encode_uds_advice(struct dedupe_index *index,
+			      struct uds_request *request,
 			      struct data_location advice)
 {
 	size_t offset = 0;
 	struct uds_chunk_data *encoding = &request->new_metadata;
 
-	encoding->data[offset++] = UDS_ADVICE_VERSION;
+	encoding->data[offset++] = ((index->shared == NULL) ?
+				    UDS_ADVICE_VERSION :
+				    UDS_SHARED_ADVICE_VERSION);
 	encoding->data[offset++] = advice.state;
 	put_unaligned_le64(advice.pbn, &encoding->data[offset]);
 	offset += sizeof(uint64_t);
 	BUG_ON(offset != UDS_ADVICE_SIZE);
+
+	if (index->shared != NULL) {
+		put_unaligned_le32(index->volume_tag,
+				   &encoding->data[offset]);
+		offset += sizeof(uint32_t);
+		BUG_ON(offset != UDS_SHARED_ADVICE_SIZE);
+	}
 }
 
 /**
  * Decode VDO duplicate advice from the old_metadata field of a UDS request.
+ * Advice in a shared index which was written by another VDO names a block in
+ * that VDO's storage, so it is counted and discarded.
  *
+ * @param index    The dedupe index
  * @param request  The UDS request containing the encoding
  * @param advice   The data_location to receive the decoded advice
  *
  * @return <code>true</code> if valid advice was found and decoded
  **/
-static bool decode_uds_advice(const struct uds_request *request,
+static bool decode_uds_advice(struct dedupe_index *index,
+			      const struct uds_request *request,
 			      struct data_location *advice)
 {
 	size_t offset = 0;
 	const struct uds_chunk_data *encoding = &request->old_metadata;
-	byte version;
+	byte version, expected_version;
 
 	if ((request->status != UDS_SUCCESS) || !request->found) {
 		return false;
 	}
 
+	expected_version = ((index->shared == NULL) ?
+			    UDS_ADVICE_VERSION :
+			    UDS_SHARED_ADVICE_VERSION);
 	version = encoding->data[offset++];
-	if (version != UDS_ADVICE_VERSION) {
+	if (version != expected_version) {
 		uds_log_error("invalid UDS advice version code %u", version);
 		return false;
 	}
@@ -198,25 +353,135 @@ static bool decode_uds_advice(const struct uds_request *request,
 	advice->state = encoding->data[offset++];
 	advice->pbn = get_unaligned_le64(&encoding->data[offset]);
 	offset += sizeof(uint64_t);
-
 	BUG_ON(offset != UDS_ADVICE_SIZE);
+
+	if (index->shared != NULL) {
+		uint32_t tag = get_unaligned_le32(&encoding->data[offset]);
+
+		offset += sizeof(uint32_t);
+		BUG_ON(offset != UDS_SHARED_ADVICE_SIZE);
+		if (tag != index->volume_tag) {
+			atomic64_inc(&index->cross_volume_count);
+			return false;
+		}
+	}
+
 	return true;
 }
 
+/**
+ * Get the interval after which a request to an index should time out.
+ *
+ * @param index  The dedupe index
+ *
+ * @return The timeout, in jiffies
+ **/
+static unsigned long get_index_timeout_jiffies(struct dedupe_index *index)
+{
+	if (READ_ONCE(index->timeout_percentile) == 0) {
+		return dedupe_index_timeout_jiffies;
+	}
+
+	return READ_ONCE(index->timeout_jiffies);
+}
+
 /**
  * Calculate the actual end of a timer, taking into account the absolute start
  * time and the present time.
  *
+ * @param index          The dedupe index
  * @param start_jiffies  The absolute start time, in jiffies
  *
  * @return the absolute end time for the timer, in jiffies
  **/
-static uint64_t get_dedupe_index_timeout(uint64_t start_jiffies)
+static uint64_t get_dedupe_index_timeout(struct dedupe_index *index,
+					 uint64_t start_jiffies)
 {
-	return max(start_jiffies + dedupe_index_timeout_jiffies,
+	return max(start_jiffies + get_index_timeout_jiffies(index),
 		   jiffies + min_dedupe_index_timer_jiffies);
 }
 
+/**
+ * Choose a new timeout from the response times seen in the window just
+ * completed: the upper bound of the bucket containing the target percentile,
+ * bounded by the minimum timer interval and the module-wide timeout.
+ *
+ * @param index  The dedupe index
+ **/
+static void adapt_index_timeout(struct dedupe_index *index)
+{
+	unsigned int percentile = READ_ONCE(index->timeout_percentile);
+	unsigned int counts[TIMEOUT_HISTOGRAM_SIZE];
+	unsigned long timeout;
+	unsigned int samples = 0, seen = 0, target, timeouts, bucket;
+
+	for (bucket = 0; bucket < TIMEOUT_HISTOGRAM_SIZE; bucket++) {
+		counts[bucket] = atomic_xchg(&index->latency_histogram[bucket],
+					     0);
+		samples += counts[bucket];
+	}
+
+	timeouts = atomic_xchg(&index->window_timeouts, 0);
+	atomic_set(&index->window_samples, 0);
+	if ((samples == 0) || (percentile == 0)) {
+		return;
+	}
+
+	WRITE_ONCE(index->timeout_rate,
+		   min(timeouts, samples) * 1000 / samples);
+
+	target = DIV_ROUND_UP(samples * percentile, TIMEOUT_PERCENTILE_SCALE);
+	for (bucket = 0; bucket < TIMEOUT_HISTOGRAM_SIZE - 1; bucket++) {
+		seen += counts[bucket];
+		if (seen >= target) {
+			break;
+		}
+	}
+
+	timeout = 1UL << bucket;
+	timeout = clamp_t(unsigned long, timeout,
+			  min_dedupe_index_timer_jiffies,
+			  dedupe_index_timeout_jiffies);
+	WRITE_ONCE(index->timeout_jiffies, timeout);
+}
+
+/**
+ * Record how long an index request took to be answered or to time out, and
+ * adjust the timeout at the end of each window of samples.
+ *
+ * @param index          The dedupe index
+ * @param start_jiffies  When the request was submitted
+ * @param timed_out      Whether the request timed out
+ **/
+static void record_index_response_time(struct dedupe_index *index,
+				       uint64_t start_jiffies,
+				       bool timed_out)
+{
+	unsigned long elapsed = jiffies - (unsigned long) start_jiffies;
+	unsigned long average = READ_ONCE(index->average_response);
+	unsigned int bucket;
+
+	// Racing updates may drop a sample, which the average can afford.
+	WRITE_ONCE(index->average_response, average - (average >> 3) + elapsed);
+
+	if (READ_ONCE(index->timeout_percentile) == 0) {
+		return;
+	}
+
+	bucket = min_t(unsigned int, fls_long(elapsed),
+		       TIMEOUT_HISTOGRAM_SIZE - 1);
+	atomic_inc(&index->latency_histogram[bucket]);
+	if (timed_out) {
+		atomic_inc(&index->window_timeouts);
+	}
+
+	// Only the sample which completes the window adapts the timeout.
+	if (atomic_inc_return(&index->window_samples) ==
+	    TIMEOUT_WINDOW_SAMPLES) {
+		adapt_index_timeout(index);
+	}
+}
+
 /**********************************************************************/
 void set_dedupe_index_timeout_interval(unsigned int value)
 {
@@ -280,12 +545,15 @@ static void finish_index_operation(struct uds_request *uds_request)
 		}
 		spin_unlock_bh(&index->pending_lock);
 
+		record_index_response_time(index,
+					   dedupe_context->submission_jiffies,
+					   false);
 		dedupe_context->status = uds_request->status;
 		if ((uds_request->type == UDS_POST) ||
 		    (uds_request->type == UDS_QUERY)) {
 			struct data_location advice;
 
-			if (decode_uds_advice(uds_request, &advice)) {
+			if (decode_uds_advice(index, uds_request, &advice)) {
 				set_dedupe_advice(dedupe_context, &advice);
 			} else {
 				set_dedupe_advice(dedupe_context, NULL);
@@ -294,10 +562,16 @@ static void finish_index_operation(struct uds_request *uds_request)
 
 		enqueue_data_vio_callback(data_vio);
 		atomic_dec(&index->active);
+		atomic_dec(&index->uds_requests);
 	} else {
+		struct vio *vio = data_vio_as_vio(data_vio);
+		struct dedupe_index *index =
+			vdo_as_kernel_layer(vio->vdo)->dedupe_index;
+
 		atomic_cmpxchg(&dedupe_context->request_state,
 			       UR_TIMED_OUT,
 			       UR_IDLE);
+		atomic_dec(&index->uds_requests);
 	}
 }
 
@@ -321,31 +595,239 @@ static void start_expiration_timer_for_vio(struct dedupe_index *index,
 {
 	struct dedupe_context *context = &data_vio->dedupe_context;
 	uint64_t start_time = context->submission_jiffies;
-	start_expiration_timer(index, get_dedupe_index_timeout(start_time));
+	start_expiration_timer(index,
+			       get_dedupe_index_timeout(index, start_time));
 }
 
-/**********************************************************************/
-static void start_index_operation(struct vdo_work_item *item)
+/**
+ * Record a batch of index operations as pending and start them all with a
+ * single call into UDS.
+ *
+ * @param index     The dedupe index
+ * @param requests  The UDS requests of the data_vios to start
+ * @param count     The number of requests
+ **/
+static void start_index_operations(struct dedupe_index *index,
+				   struct uds_request *requests[],
+				   unsigned int count)
 {
-	struct vio *vio = work_item_as_vio(item);
-	struct data_vio *data_vio = vio_as_data_vio(vio);
-	struct kernel_layer *layer = vdo_as_kernel_layer(vio->vdo);
-	struct dedupe_index *index = layer->dedupe_index;
-	struct dedupe_context *dedupe_context = &data_vio->dedupe_context;
-	struct uds_request *uds_request = &dedupe_context->uds_request;
-	int status;
+	unsigned int i;
 
 	spin_lock_bh(&index->pending_lock);
-	list_add_tail(&dedupe_context->pending_list, &index->pending_head);
-	dedupe_context->is_pending = true;
-	start_expiration_timer_for_vio(index, data_vio);
+	for (i = 0; i < count; i++) {
+		struct dedupe_context *dedupe_context =
+			container_of(requests[i],
+				     struct dedupe_context,
+				     uds_request);
+		struct data_vio *data_vio =
+			container_of(dedupe_context,
+				     struct data_vio,
+				     dedupe_context);
+
+		list_add_tail(&dedupe_context->pending_list,
+			      &index->pending_head);
+		dedupe_context->is_pending = true;
+		start_expiration_timer_for_vio(index, data_vio);
+	}
 	spin_unlock_bh(&index->pending_lock);
 
-	status = uds_start_chunk_operation(uds_request);
-	if (status != UDS_SUCCESS) {
-		uds_request->status = status;
-		finish_index_operation(uds_request);
+	// Any request which can't be started is finished by UDS with the
+	// error, so there's nothing more to do here on failure.
+	atomic_add(count, &index->uds_requests);
+	(void) uds_start_chunk_operations(requests, count);
+}
+
+/**
+ * Start the index operations accumulated in the UDS batch processor. This
+ * callback is registered in make_dedupe_index().
+ *
+ * @param batch    The batch processor
+ * @param closure  The dedupe index
+ **/
+static void start_index_operation_batch(struct batch_processor *batch,
+					void *closure)
+{
+	struct dedupe_index *index = closure;
+	struct uds_request *requests[UDS_REQUEST_BATCH_SIZE];
+	unsigned int count = 0;
+	struct vdo_work_item *item;
+
+	while ((item = next_batch_item(batch)) != NULL) {
+		struct data_vio *data_vio =
+			vio_as_data_vio(work_item_as_vio(item));
+
+		requests[count++] = &data_vio->dedupe_context.uds_request;
+		if (count == UDS_REQUEST_BATCH_SIZE) {
+			start_index_operations(index, requests, count);
+			count = 0;
+			cond_resched_batch_processor(batch);
+		}
+	}
+
+	if (count > 0) {
+		start_index_operations(index, requests, count);
+	}
+}
+
+/**
+ * Account for a finished batched index update. This is the callback of each
+ * update started by start_update_buffer().
+ *
+ * @param uds_request  The finished update
+ **/
+static void finish_batched_update(struct uds_request *uds_request)
+{
+	struct index_update *update =
+		container_of(uds_request, struct index_update, request);
+	struct update_buffer *buffer = update->buffer;
+	struct dedupe_index *index = buffer->index;
+
+	if (atomic_dec_and_test(&buffer->pending)) {
+		FREE(buffer);
+	}
+
+	atomic_dec(&index->uds_requests);
+}
+
+/**
+ * Start all the updates in a buffer with a single call into UDS. The buffer
+ * must not be used once this is called.
+ *
+ * @param buffer  The buffer of updates
+ **/
+static void start_update_buffer(struct update_buffer *buffer)
+{
+	struct dedupe_index *index = buffer->index;
+	struct uds_request *requests[UPDATE_BATCH_SIZE];
+	unsigned int count = buffer->count;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		requests[i] = &buffer->updates[i].request;
+	}
+
+	atomic_set(&buffer->pending, count);
+	atomic_add(count, &index->uds_requests);
+	// Any update which can't be started is finished by UDS with the
+	// error, which only means the advice is not recorded.
+	(void) uds_start_chunk_operations(requests, count);
+}
+
+/**
+ * Start whatever updates a hash zone has gathered.
+ *
+ * @param batch  The update batch of the hash zone
+ **/
+static void flush_update_batch(struct update_batch *batch)
+{
+	struct update_buffer *buffer;
+
+	spin_lock(&batch->lock);
+	buffer = batch->buffer;
+	batch->buffer = NULL;
+	spin_unlock(&batch->lock);
+
+	if (buffer != NULL) {
+		start_update_buffer(buffer);
+	}
+}
+
+/**
+ * Start the updates of a hash zone which have been held as long as allowed.
+ * This is the work function of each update batch.
+ *
+ * @param work  The delayed work of the update batch
+ **/
+static void flush_update_batch_work(struct work_struct *work)
+{
+	flush_update_batch(container_of(to_delayed_work(work),
+					struct update_batch,
+					work));
+}
+
+/**
+ * Start the updates gathered from all the hash zones.
+ *
+ * @param index  The dedupe index
+ **/
+static void flush_update_batches(struct dedupe_index *index)
+{
+	zone_count_t zone;
+
+	for (zone = 0; zone < index->update_batch_count; zone++) {
+		cancel_delayed_work_sync(&index->update_batches[zone].work);
+		flush_update_batch(&index->update_batches[zone]);
+	}
+}
+
+/**
+ * Add an index update to the batch of the hash zone of the data_vio
+ * requesting it. The update is copied into the batch, so the data_vio may
+ * continue at once rather than waiting for UDS, and the updates of the zone
+ * reach UDS together instead of each competing with the queries of other
+ * data_vios.
+ *
+ * @param index     The dedupe index
+ * @param data_vio  The data_vio requesting the update
+ *
+ * @return <code>true</code> if the update was added to a batch, or
+ *         <code>false</code> if it must be started on its own
+ **/
+static bool batch_index_update(struct dedupe_index *index,
+			       struct data_vio *data_vio)
+{
+	unsigned long delay = READ_ONCE(index->update_delay_jiffies);
+	struct dedupe_context *dedupe_context = &data_vio->dedupe_context;
+	struct update_batch *batch;
+	struct update_buffer *buffer, *full = NULL;
+	struct index_update *update;
+	zone_count_t zone;
+
+	if ((delay == 0) || (data_vio->hash_zone == NULL) ||
+	    !READ_ONCE(index->deduping)) {
+		return false;
+	}
+
+	zone = get_vdo_hash_zone_number(data_vio->hash_zone);
+	batch = &index->update_batches[zone];
+	spin_lock(&batch->lock);
+	buffer = batch->buffer;
+	if (buffer == NULL) {
+		buffer = allocate_memory_nowait(sizeof(struct update_buffer),
+						__func__);
+		if (buffer == NULL) {
+			spin_unlock(&batch->lock);
+			return false;
+		}
+
+		buffer->index = index;
+		batch->buffer = buffer;
+		schedule_delayed_work(&batch->work, delay);
 	}
+
+	update = &buffer->updates[buffer->count++];
+	update->buffer = buffer;
+	update->request = (struct uds_request) {
+		.chunk_name = *dedupe_context->chunk_name,
+		.callback = finish_batched_update,
+		.session = index->index_session,
+		.type = UDS_UPDATE,
+		.update = true,
+	};
+	encode_uds_advice(index,
+			  &update->request,
+			  get_dedupe_advice(dedupe_context));
+	if (buffer->count == UPDATE_BATCH_SIZE) {
+		full = buffer;
+		batch->buffer = NULL;
+	}
+	spin_unlock(&batch->lock);
+
+	if (full != NULL) {
+		start_update_buffer(full);
+	}
+
+	return true;
 }
 
 /**********************************************************************/
@@ -438,8 +920,7 @@ static void timeout_index_operations(struct timer_list *t)
 {
 	struct dedupe_index *index = from_timer(index, t, pending_timer);
 	LIST_HEAD(expired_head);
-	uint64_t timeout_jiffies =
-		msecs_to_jiffies(dedupe_index_timeout_interval);
+	uint64_t timeout_jiffies = get_index_timeout_jiffies(index);
 	unsigned long earliest_submission_allowed = jiffies - timeout_jiffies;
 	unsigned int timed_out = 0;
 
@@ -472,6 +953,8 @@ static void timeout_index_operations(struct timer_list *t)
 		list_del(&dedupe_context->pending_list);
 		if (atomic_cmpxchg(&dedupe_context->request_state,
 				   UR_BUSY, UR_TIMED_OUT) == UR_BUSY) {
+			record_index_response_time(
+				index, dedupe_context->submission_jiffies, true);
 			dedupe_context->status = ETIMEDOUT;
 			enqueue_data_vio_callback(data_vio);
 			atomic_dec(&index->active);
@@ -481,6 +964,42 @@ static void timeout_index_operations(struct timer_list *t)
 	report_dedupe_timeouts(&index->timeout_reporter, timed_out);
 }
 
+/**
+ * Check whether a query or post should skip the index because the index is
+ * backed up, either by too many outstanding requests or by slow responses.
+ * Skipping is never done when nothing is outstanding, which also ensures that
+ * the average response time keeps being refreshed while shedding for
+ * latency.
+ *
+ * @param index      The dedupe index
+ * @param operation  The type of the operation
+ *
+ * @return <code>true</code> if the operation should not be sent to the index
+ **/
+static bool should_shed_index_load(struct dedupe_index *index,
+				   enum uds_callback_type operation)
+{
+	unsigned int depth = READ_ONCE(index->shed_depth);
+	unsigned long latency = READ_ONCE(index->shed_latency_jiffies);
+	unsigned int active;
+
+	if ((operation != UDS_QUERY) && (operation != UDS_POST)) {
+		return false;
+	}
+
+	active = atomic_read(&index->active);
+	if (active == 0) {
+		return false;
+	}
+
+	if ((depth > 0) && (active >= depth)) {
+		return true;
+	}
+
+	return ((latency > 0) &&
+		((READ_ONCE(index->average_response) >> 3) >= latency));
+}
+
 /**********************************************************************/
 void enqueue_index_operation(struct data_vio *data_vio,
 			     enum uds_callback_type operation)
@@ -492,8 +1011,17 @@ void enqueue_index_operation(struct data_vio *data_vio,
 
 	dedupe_context->status = UDS_SUCCESS;
 	dedupe_context->submission_jiffies = jiffies;
-	if (atomic_cmpxchg(&dedupe_context->request_state,
-			   UR_IDLE, UR_BUSY) == UR_IDLE) {
+	dedupe_context->was_shed = should_shed_index_load(index, operation);
+	if (dedupe_context->was_shed) {
+		// Treat the block as unique; the hash lock will update the
+		// index with its location once it has been written.
+		atomic64_inc(&index->shed_count);
+	} else if ((operation == UDS_UPDATE) &&
+		   batch_index_update(index, data_vio)) {
+		// The batch has taken over the update, and nothing in the
+		// result of an update is needed.
+	} else if (atomic_cmpxchg(&dedupe_context->request_state,
+				  UR_IDLE, UR_BUSY) == UR_IDLE) {
 		struct uds_request *uds_request =
 			&data_vio->dedupe_context.uds_request;
 
@@ -503,21 +1031,17 @@ void enqueue_index_operation(struct data_vio *data_vio,
 		uds_request->type = operation;
 		uds_request->update = true;
 		if ((operation == UDS_POST) || (operation == UDS_UPDATE)) {
-			encode_uds_advice(uds_request,
+			encode_uds_advice(index,
+					  uds_request,
 					  get_dedupe_advice(dedupe_context));
 		}
 
-		setup_work_item(work_item_from_vio(vio),
-				start_index_operation,
-				NULL,
-				UDS_Q_ACTION);
-
 		spin_lock(&index->state_lock);
 		if (index->deduping) {
 			unsigned int active;
 
-			enqueue_work_queue(index->uds_queue,
-					   work_item_from_vio(vio));
+			add_to_batch_processor(index->uds_batcher,
+					       work_item_from_vio(vio));
 
 			active = atomic_inc_return(&index->active);
 			if (active > index->maximum) {
@@ -539,6 +1063,180 @@ void enqueue_index_operation(struct data_vio *data_vio,
 	}
 }
 
+/**
+ * Find the shared index session for an index device. Must be called holding
+ * the shared_index_mutex.
+ *
+ * @param device  The index device
+ *
+ * @return The shared index, or NULL if no VDO is sharing the device
+ **/
+static struct shared_index *find_shared_index(dev_t device)
+{
+	struct shared_index *shared;
+
+	list_for_each_entry(shared, &shared_indexes, list_entry) {
+		if (shared->device == device) {
+			return shared;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Join the session shared by the VDOs using an index device, creating it if
+ * this is the first such VDO.
+ *
+ * @param index   The dedupe index
+ * @param device  The index device
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int get_shared_index(struct dedupe_index *index, dev_t device)
+{
+	struct shared_index *shared;
+	int result;
+
+	mutex_lock(&shared_index_mutex);
+	shared = find_shared_index(device);
+	if (shared == NULL) {
+		result = ALLOCATE(1, struct shared_index, "shared index",
+				  &shared);
+		if (result != UDS_SUCCESS) {
+			mutex_unlock(&shared_index_mutex);
+			return result;
+		}
+
+		result = uds_create_index_session(&shared->session);
+		if (result != UDS_SUCCESS) {
+			FREE(shared);
+			mutex_unlock(&shared_index_mutex);
+			return result;
+		}
+
+		shared->device = device;
+		list_add_tail(&shared->list_entry, &shared_indexes);
+	}
+
+	shared->users++;
+	mutex_unlock(&shared_index_mutex);
+
+	index->shared = shared;
+	index->index_session = shared->session;
+	return UDS_SUCCESS;
+}
+
+/**
+ * Open a shared index for a VDO. Only the first VDO to open it actually opens
+ * the index; the rest join the open session, and in particular do not
+ * recreate the index out from under the others.
+ *
+ * @param index        The dedupe index
+ * @param create_flag  Whether to create a new index if it must be opened
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int open_shared_index(struct dedupe_index *index, bool create_flag)
+{
+	struct shared_index *shared = index->shared;
+	int result = UDS_SUCCESS;
+
+	mutex_lock(&shared_index_mutex);
+	if (shared->opened == 0) {
+		result = uds_open_index(create_flag ? UDS_CREATE : UDS_LOAD,
+					index->index_name, &index->uds_params,
+					index->configuration, shared->session);
+	}
+	if (result == UDS_SUCCESS) {
+		shared->opened++;
+		index->shared_open = true;
+	}
+	mutex_unlock(&shared_index_mutex);
+	return result;
+}
+
+/**
+ * Drop a VDO's open of a shared index, closing the index if no other VDO has
+ * it open. Must be called holding the shared_index_mutex.
+ *
+ * @param index  The dedupe index
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int release_shared_open(struct dedupe_index *index)
+{
+	if (!index->shared_open) {
+		return UDS_SUCCESS;
+	}
+
+	index->shared_open = false;
+	if (--index->shared->opened > 0) {
+		return UDS_SUCCESS;
+	}
+	return uds_close_index(index->shared->session);
+}
+
+/**
+ * Close a shared index for a VDO.
+ *
+ * @param index  The dedupe index
+ *
+ * @return UDS_SUCCESS or an error code
+ **/
+static int close_shared_index(struct dedupe_index *index)
+{
+	int result;
+
+	mutex_lock(&shared_index_mutex);
+	result = release_shared_open(index);
+	mutex_unlock(&shared_index_mutex);
+	return result;
+}
+
+/**
+ * Leave a shared index session, closing the index and destroying the session
+ * if this was the last VDO using it.
+ *
+ * @param index  The dedupe index
+ **/
+static void put_shared_index(struct dedupe_index *index)
+{
+	struct shared_index *shared = index->shared;
+	int result;
+
+	mutex_lock(&shared_index_mutex);
+	result = release_shared_open(index);
+	if (result != UDS_SUCCESS) {
+		log_error_strerror(result,
+				   "Error closing index %s",
+				   index->index_name);
+	}
+
+	if (--shared->users == 0) {
+		list_del(&shared->list_entry);
+		uds_destroy_index_session(shared->session);
+		FREE(shared);
+	}
+	mutex_unlock(&shared_index_mutex);
+
+	index->shared = NULL;
+	index->index_session = NULL;
+}
+
+/**
+ * Release the index session of a dedupe index.
+ *
+ * @param index  The dedupe index
+ **/
+static void release_index_session(struct dedupe_index *index)
+{
+	if (index->shared != NULL) {
+		put_shared_index(index);
+	} else {
+		uds_destroy_index_session(index->index_session);
+	}
+}
+
 /**********************************************************************/
 static void close_index(struct dedupe_index *index)
 {
@@ -549,7 +1247,11 @@ static void close_index(struct dedupe_index *index)
 	index->index_state = IS_CHANGING;
 	// Close the index session, while not holding the state_lock.
 	spin_unlock(&index->state_lock);
-	result = uds_close_index(index->index_session);
+	if (index->shared != NULL) {
+		result = close_shared_index(index);
+	} else {
+		result = uds_close_index(index->index_session);
+	}
 
 	if (result != UDS_SUCCESS) {
 		log_error_strerror(result,
@@ -562,6 +1264,24 @@ static void close_index(struct dedupe_index *index)
 	// ASSERTION: We leave in IS_CLOSED state.
 }
 
+/**
+ * Give the vdo the zone map of the newly opened index so that its hash zones
+ * can follow the index zones.
+ *
+ * @param index  The dedupe index
+ **/
+static void learn_index_zone_map(struct dedupe_index *index)
+{
+	struct uds_zone_map map;
+	int result = uds_get_index_zone_map(index->index_session, &map);
+	if (result != UDS_SUCCESS) {
+		log_warning_strerror(result, "Error getting index zone map");
+		return;
+	}
+
+	set_vdo_index_zone_map(index->vdo, &map);
+}
+
 /**********************************************************************/
 static void open_index(struct dedupe_index *index)
 {
@@ -576,9 +1296,14 @@ static void open_index(struct dedupe_index *index)
 	index->error_flag = false;
 	// Open the index session, while not holding the state_lock
 	spin_unlock(&index->state_lock);
-	result = uds_open_index(create_flag ? UDS_CREATE : UDS_LOAD,
-				index->index_name, &index->uds_params,
-				index->configuration, index->index_session);
+	if (index->shared != NULL) {
+		result = open_shared_index(index, create_flag);
+	} else {
+		result = uds_open_index(create_flag ? UDS_CREATE : UDS_LOAD,
+					index->index_name, &index->uds_params,
+					index->configuration,
+					index->index_session);
+	}
 	if (result != UDS_SUCCESS) {
 		log_error_strerror(result,
 				   "Error opening index %s",
@@ -587,6 +1312,19 @@ static void open_index(struct dedupe_index *index)
 	spin_lock(&index->state_lock);
 	if (!create_flag) {
 		switch (result) {
+		case UDS_INDEX_NONCE_MISMATCH:
+			if (index->separate_device) {
+				// The index device was paired with another
+				// VDO; never overwrite it.
+				spin_unlock(&index->state_lock);
+				uds_log_error("Index device %s does not belong to this VDO",
+					      index->index_name);
+				spin_lock(&index->state_lock);
+				break;
+			}
+			// An index inside our own storage with a stale nonce
+			// can simply be recreated.
+			// fall through
 		case UDS_CORRUPT_COMPONENT:
 		case UDS_NO_INDEX:
 			// Either there is no index, or there is no way we can
@@ -601,6 +1339,9 @@ static void open_index(struct dedupe_index *index)
 	}
 	if (result == UDS_SUCCESS) {
 		index->index_state = IS_OPENED;
+		spin_unlock(&index->state_lock);
+		learn_index_zone_map(index);
+		spin_lock(&index->state_lock);
 	} else {
 		index->index_state = IS_CLOSED;
 		index->index_target = IS_CLOSED;
@@ -704,7 +1445,12 @@ void suspend_dedupe_index(struct dedupe_index *index, bool save_flag)
 	state = index->index_state;
 	spin_unlock(&index->state_lock);
 
-	if (state != IS_CLOSED) {
+	// Include the held updates in the save.
+	flush_update_batches(index);
+
+	// Other VDOs may still be using a shared index, so it is only saved
+	// when the last of them closes it.
+	if ((state != IS_CLOSED) && (index->shared == NULL)) {
 		int result = uds_suspend_index_session(index->index_session,
 						       save_flag);
 		if (result != UDS_SUCCESS) {
@@ -717,9 +1463,12 @@ void suspend_dedupe_index(struct dedupe_index *index, bool save_flag)
 /**********************************************************************/
 void resume_dedupe_index(struct dedupe_index *index)
 {
-	int result = uds_resume_index_session(index->index_session);
-	if (result != UDS_SUCCESS) {
-		log_error_strerror(result, "Error resuming dedupe index");
+	if (index->shared == NULL) {
+		int result = uds_resume_index_session(index->index_session);
+		if (result != UDS_SUCCESS) {
+			log_error_strerror(result,
+					   "Error resuming dedupe index");
+		}
 	}
 
 	spin_lock(&index->state_lock);
@@ -753,22 +1502,45 @@ void dump_dedupe_index(struct dedupe_index *index, bool show_queue)
 /**********************************************************************/
 void finish_dedupe_index(struct dedupe_index *index)
 {
+	flush_update_batches(index);
 	set_target_state(index, IS_CLOSED, false, false, false);
-	uds_destroy_index_session(index->index_session);
+	if (index->shared == NULL) {
+		uds_destroy_index_session(index->index_session);
+		finish_work_queue(index->uds_queue);
+		return;
+	}
+
+	// Other VDOs may still be using a shared session, so rather than
+	// destroying it, wait for the requests made by this VDO.
+	while (atomic_read(&index->uds_requests) > 0) {
+		msleep(1);
+	}
 	finish_work_queue(index->uds_queue);
+	put_shared_index(index);
 }
 
 /**********************************************************************/
 void free_dedupe_index(struct dedupe_index **index_ptr)
 {
 	struct dedupe_index *index;
+	zone_count_t zone;
+
 	if (*index_ptr == NULL) {
 		return;
 	}
 	index = *index_ptr;
 	*index_ptr = NULL;
 
+	for (zone = 0; zone < index->update_batch_count; zone++) {
+		struct update_batch *batch = &index->update_batches[zone];
+
+		// Any updates still held can no longer be started.
+		cancel_delayed_work_sync(&batch->work);
+		FREE(batch->buffer);
+	}
+
 	free_work_queue(&index->uds_queue);
+	free_batch_processor(&index->uds_batcher);
 	stop_periodic_event_reporter(&index->timeout_reporter);
 	spin_lock_bh(&index->pending_lock);
 	if (index->started_timer) {
@@ -809,6 +1581,9 @@ void get_index_statistics(struct dedupe_index *index,
 						 &index_stats);
 		if (result == UDS_SUCCESS) {
 			stats->entries_indexed = index_stats.entries_indexed;
+			stats->page_cache_hits = index_stats.page_cache_hits;
+			stats->page_cache_misses =
+				index_stats.page_cache_misses;
 		} else {
 			log_error_strerror(result,
 					   "Error reading index stats");
@@ -871,6 +1646,7 @@ static void dedupe_kobj_release(struct kobject *directory)
 						  struct dedupe_index,
 						  dedupe_directory);
 	uds_free_configuration(index->configuration);
+	FREE(index->update_batches);
 	FREE(index->index_name);
 	FREE(index);
 }
@@ -886,6 +1662,8 @@ static ssize_t dedupe_status_show(struct kobject *directory,
 		container_of(directory, struct dedupe_index, dedupe_directory);
 	if (ua->show_string != NULL) {
 		return sprintf(buf, "%s\n", ua->show_string(index));
+	} else if (ua->show != NULL) {
+		return ua->show(index, buf);
 	} else {
 		return -EINVAL;
 	}
@@ -897,9 +1675,268 @@ static ssize_t dedupe_status_store(struct kobject *kobj,
 				   const char *buf,
 				   size_t length)
 {
+	struct uds_attribute *ua =
+		container_of(attr, struct uds_attribute, attr);
+	struct dedupe_index *index =
+		container_of(kobj, struct dedupe_index, dedupe_directory);
+	if (ua->store != NULL) {
+		return ua->store(index, buf, length);
+	}
 	return -EINVAL;
 }
 
+/**********************************************************************/
+static ssize_t timeout_percentile_show(struct dedupe_index *index, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(index->timeout_percentile));
+}
+
+/**********************************************************************/
+static ssize_t timeout_percentile_store(struct dedupe_index *index,
+					const char *buf,
+					size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > TIMEOUT_PERCENTILE_SCALE)) {
+		return -EINVAL;
+	}
+
+	// Start adapting from the module-wide timeout.
+	WRITE_ONCE(index->timeout_jiffies, dedupe_index_timeout_jiffies);
+	WRITE_ONCE(index->timeout_rate, 0);
+	WRITE_ONCE(index->timeout_percentile, value);
+	return length;
+}
+
+/**
+ * Show the sparse sample rate of the open index, or if the index is not open,
+ * the rate it will be opened with.
+ **/
+static ssize_t sparse_sample_rate_show(struct dedupe_index *index, char *buf)
+{
+	struct uds_configuration *configuration;
+	unsigned int rate;
+	bool opened;
+	int result;
+
+	spin_lock(&index->state_lock);
+	opened = (index->index_state == IS_OPENED);
+	rate = uds_configuration_get_sparse_sample_rate(index->configuration);
+	spin_unlock(&index->state_lock);
+	if (!opened) {
+		return sprintf(buf, "%u\n", rate);
+	}
+
+	result = uds_get_index_configuration(index->index_session,
+					     &configuration);
+	if (result != UDS_SUCCESS) {
+		return -EIO;
+	}
+
+	rate = uds_configuration_get_sparse_sample_rate(configuration);
+	uds_free_configuration(configuration);
+	return sprintf(buf, "%u\n", rate);
+}
+
+/**
+ * Set the sparse sample rate of a sparse index. The new rate takes effect
+ * the next time the index is opened, when the volume index is rebuilt from
+ * the chapters at the new rate.
+ **/
+static ssize_t sparse_sample_rate_store(struct dedupe_index *index,
+					const char *buf,
+					size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value < 2) || (value > UINT16_MAX)) {
+		return -EINVAL;
+	}
+
+	spin_lock(&index->state_lock);
+	if (!uds_configuration_get_sparse(index->configuration)) {
+		spin_unlock(&index->state_lock);
+		return -EINVAL;
+	}
+
+	uds_configuration_set_sparse_sample_rate(index->configuration, value);
+	spin_unlock(&index->state_lock);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t timeout_interval_show(struct dedupe_index *index, char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       jiffies_to_msecs(get_index_timeout_jiffies(index)));
+}
+
+/**********************************************************************/
+static ssize_t timeout_rate_show(struct dedupe_index *index, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(index->timeout_rate));
+}
+
+/**********************************************************************/
+static ssize_t shed_depth_show(struct dedupe_index *index, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(index->shed_depth));
+}
+
+/**********************************************************************/
+static ssize_t shed_depth_store(struct dedupe_index *index,
+				const char *buf,
+				size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(index->shed_depth, value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t shed_latency_show(struct dedupe_index *index, char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       jiffies_to_msecs(READ_ONCE(index->shed_latency_jiffies)));
+}
+
+/**********************************************************************/
+static ssize_t shed_latency_store(struct dedupe_index *index,
+				  const char *buf,
+				  size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(index->shed_latency_jiffies, msecs_to_jiffies(value));
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t update_delay_show(struct dedupe_index *index, char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       jiffies_to_msecs(READ_ONCE(index->update_delay_jiffies)));
+}
+
+/**********************************************************************/
+static ssize_t update_delay_store(struct dedupe_index *index,
+				  const char *buf,
+				  size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(index->update_delay_jiffies, msecs_to_jiffies(value));
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t cross_volume_hits_show(struct dedupe_index *index, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       (unsigned long long)
+		       atomic64_read(&index->cross_volume_count));
+}
+
+/**********************************************************************/
+static ssize_t shed_requests_show(struct dedupe_index *index, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       (unsigned long long) atomic64_read(&index->shed_count));
+}
+
+/**
+ * Show how many of the index's hits an index of each power-of-two number of
+ * chapters would have found, to help size the index. The first line gives
+ * the number of searches and the number of chapters the index holds; each
+ * following line gives a chapter count, the hits an index of that many
+ * chapters would have found, and the resulting hit rate in tenths of a
+ * percent. The last line, marked as an estimate, extrapolates to an index
+ * twice as large by assuming that the hits gained by each doubling keep
+ * shrinking at the rate of the last two doublings.
+ **/
+static ssize_t hit_ages_show(struct dedupe_index *index, char *buf)
+{
+	struct uds_index_age_stats *stats;
+	uint64_t hits = 0;
+	uint64_t last_gain = 0;
+	uint64_t previous_gain = 0;
+	uint64_t estimate;
+	unsigned int bucket;
+	ssize_t written;
+	int result;
+
+	spin_lock(&index->state_lock);
+	if (index->index_state != IS_OPENED) {
+		spin_unlock(&index->state_lock);
+		return -ENODEV;
+	}
+	spin_unlock(&index->state_lock);
+
+	result = ALLOCATE(1, struct uds_index_age_stats, __func__, &stats);
+	if (result != UDS_SUCCESS) {
+		return -ENOMEM;
+	}
+
+	result = uds_get_index_age_stats(index->index_session, stats);
+	if (result != UDS_SUCCESS) {
+		FREE(stats);
+		return -EIO;
+	}
+
+	written = sprintf(buf, "searches %llu chapters %llu\n",
+			  (unsigned long long) stats->searches,
+			  (unsigned long long) stats->chapters);
+	for (bucket = 0; bucket < UDS_CHAPTER_AGE_BUCKETS; bucket++) {
+		uint64_t chapters = min(1ULL << bucket,
+					(unsigned long long) stats->chapters);
+		previous_gain = last_gain;
+		last_gain = stats->hits_by_age[bucket];
+		hits += last_gain;
+		written += sprintf(buf + written, "%llu %llu %llu\n",
+				   (unsigned long long) chapters,
+				   (unsigned long long) hits,
+				   (unsigned long long)
+				   ((stats->searches == 0) ?
+				    0 :
+				    (hits * 1000) / stats->searches));
+		if (chapters == stats->chapters) {
+			break;
+		}
+	}
+
+	if ((previous_gain == 0) || (last_gain >= previous_gain)) {
+		estimate = hits + last_gain;
+	} else {
+		estimate = hits + (last_gain * last_gain) / previous_gain;
+	}
+	estimate = min(estimate, (uint64_t) stats->searches);
+	written += sprintf(buf + written, "estimate %llu %llu %llu\n",
+			   (unsigned long long) stats->chapters * 2,
+			   (unsigned long long) estimate,
+			   (unsigned long long)
+			   ((stats->searches == 0) ?
+			    0 :
+			    (estimate * 1000) / stats->searches));
+	FREE(stats);
+	return written;
+}
+
 /**********************************************************************/
 
 static struct sysfs_ops dedupe_sysfs_ops = {
@@ -907,13 +1944,78 @@ static struct sysfs_ops dedupe_sysfs_ops = {
 	.store = dedupe_status_store,
 };
 
+static struct uds_attribute dedupe_cross_volume_hits_attribute = {
+	.attr = {.name = "cross_volume_hits", .mode = 0444, },
+	.show = cross_volume_hits_show,
+};
+
+static struct uds_attribute dedupe_hit_ages_attribute = {
+	.attr = {.name = "hit_ages", .mode = 0444, },
+	.show = hit_ages_show,
+};
+
+static struct uds_attribute dedupe_shed_depth_attribute = {
+	.attr = {.name = "shed_depth", .mode = 0644, },
+	.show = shed_depth_show,
+	.store = shed_depth_store,
+};
+
+static struct uds_attribute dedupe_shed_latency_attribute = {
+	.attr = {.name = "shed_latency", .mode = 0644, },
+	.show = shed_latency_show,
+	.store = shed_latency_store,
+};
+
+static struct uds_attribute dedupe_shed_requests_attribute = {
+	.attr = {.name = "shed_requests", .mode = 0444, },
+	.show = shed_requests_show,
+};
+
+static struct uds_attribute dedupe_sparse_sample_rate_attribute = {
+	.attr = {.name = "sparse_sample_rate", .mode = 0644, },
+	.show = sparse_sample_rate_show,
+	.store = sparse_sample_rate_store,
+};
+
 static struct uds_attribute dedupe_status_attribute = {
 	.attr = {.name = "status", .mode = 0444, },
 	.show_string = get_dedupe_state_name,
 };
 
+static struct uds_attribute dedupe_timeout_interval_attribute = {
+	.attr = {.name = "timeout_interval", .mode = 0444, },
+	.show = timeout_interval_show,
+};
+
+static struct uds_attribute dedupe_timeout_percentile_attribute = {
+	.attr = {.name = "timeout_percentile", .mode = 0644, },
+	.show = timeout_percentile_show,
+	.store = timeout_percentile_store,
+};
+
+static struct uds_attribute dedupe_timeout_rate_attribute = {
+	.attr = {.name = "timeout_rate", .mode = 0444, },
+	.show = timeout_rate_show,
+};
+
+static struct uds_attribute dedupe_update_delay_attribute = {
+	.attr = {.name = "update_delay", .mode = 0644, },
+	.show = update_delay_show,
+	.store = update_delay_store,
+};
+
 static struct attribute *dedupe_attributes[] = {
+	&dedupe_cross_volume_hits_attribute.attr,
+	&dedupe_hit_ages_attribute.attr,
+	&dedupe_shed_depth_attribute.attr,
+	&dedupe_shed_latency_attribute.attr,
+	&dedupe_shed_requests_attribute.attr,
+	&dedupe_sparse_sample_rate_attribute.attr,
 	&dedupe_status_attribute.attr,
+	&dedupe_timeout_interval_attribute.attr,
+	&dedupe_timeout_percentile_attribute.attr,
+	&dedupe_timeout_rate_attribute.attr,
+	&dedupe_update_delay_attribute.attr,
 	NULL,
 };
 
@@ -951,6 +2053,7 @@ int make_dedupe_index(struct dedupe_index **index_ptr, struct vdo *vdo)
 	struct dedupe_index *index;
 	struct index_config *index_config;
 	struct kernel_layer *layer = vdo_as_kernel_layer(vdo);
+	zone_count_t zone;
 	static const struct vdo_work_queue_type uds_queue_type = {
 		.start = start_uds_queue,
 		.finish = finish_uds_queue,
@@ -969,11 +2072,22 @@ int make_dedupe_index(struct dedupe_index **index_ptr, struct vdo *vdo)
 		return result;
 	}
 
-	result = alloc_sprintf("index name", &index->index_name,
-			       "dev=%s offset=4096 size=%llu",
-			       vdo->device_config->parent_device_name,
-			       (get_index_region_size(vdo->geometry) *
-				VDO_BLOCK_SIZE));
+	index->vdo = vdo;
+	index->separate_device =
+		(vdo->device_config->index_device_name != NULL);
+	if (index->separate_device) {
+		result = alloc_sprintf("index name", &index->index_name,
+				       "dev=%s offset=0 size=%llu",
+				       vdo->device_config->index_device_name,
+				       (get_index_region_size(vdo->geometry) *
+					VDO_BLOCK_SIZE));
+	} else {
+		result = alloc_sprintf("index name", &index->index_name,
+				       "dev=%s offset=4096 size=%llu",
+				       vdo->device_config->parent_device_name,
+				       (get_index_region_size(vdo->geometry) *
+					VDO_BLOCK_SIZE));
+	}
 	if (result != UDS_SUCCESS) {
 		uds_log_error("Creating index name failed (%d)", result);
 		FREE(index);
@@ -990,10 +2104,20 @@ int make_dedupe_index(struct dedupe_index **index_ptr, struct vdo *vdo)
 		FREE(index);
 		return result;
 	}
-	uds_configuration_set_nonce(index->configuration,
-				    (uds_nonce_t) vdo->geometry.nonce);
-
-	result = uds_create_index_session(&index->index_session);
+	if (vdo->device_config->shared_index) {
+		struct block_device *bdev =
+			vdo->device_config->owned_index_device->bdev;
+
+		uds_configuration_set_nonce(index->configuration,
+					    SHARED_INDEX_NONCE);
+		index->volume_tag = (uint32_t) (vdo->geometry.nonce ^
+						(vdo->geometry.nonce >> 32));
+		result = get_shared_index(index, bdev->bd_dev);
+	} else {
+		uds_configuration_set_nonce(index->configuration,
+					    (uds_nonce_t) vdo->geometry.nonce);
+		result = uds_create_index_session(&index->index_session);
+	}
 	if (result != UDS_SUCCESS) {
 		uds_free_configuration(index->configuration);
 		FREE(index->index_name);
@@ -1013,21 +2137,63 @@ int make_dedupe_index(struct dedupe_index **index_ptr, struct vdo *vdo)
 	if (result != VDO_SUCCESS) {
 		uds_log_error("UDS index queue initialization failed (%d)",
 			  result);
-		uds_destroy_index_session(index->index_session);
+		release_index_session(index);
+		uds_free_configuration(index->configuration);
+		FREE(index->index_name);
+		FREE(index);
+		return result;
+	}
+
+	result = make_batch_processor(layer,
+				      index->uds_queue,
+				      start_index_operation_batch,
+				      index,
+				      UDS_Q_ACTION,
+				      &index->uds_batcher);
+	if (result != VDO_SUCCESS) {
+		uds_log_error("UDS index batcher initialization failed (%d)",
+			      result);
+		free_work_queue(&index->uds_queue);
+		release_index_session(index);
+		uds_free_configuration(index->configuration);
+		FREE(index->index_name);
+		FREE(index);
+		return result;
+	}
+
+	index->update_batch_count = get_thread_config(vdo)->hash_zone_count;
+	result = ALLOCATE(index->update_batch_count,
+			  struct update_batch,
+			  "index update batches",
+			  &index->update_batches);
+	if (result != VDO_SUCCESS) {
+		free_batch_processor(&index->uds_batcher);
+		free_work_queue(&index->uds_queue);
+		release_index_session(index);
 		uds_free_configuration(index->configuration);
 		FREE(index->index_name);
 		FREE(index);
 		return result;
 	}
 
+	for (zone = 0; zone < index->update_batch_count; zone++) {
+		struct update_batch *batch = &index->update_batches[zone];
+
+		batch->index = index;
+		spin_lock_init(&batch->lock);
+		INIT_DELAYED_WORK(&batch->work, flush_update_batch_work);
+	}
+
 	kobject_init(&index->dedupe_directory, &dedupe_directory_type);
 	result = kobject_add(&index->dedupe_directory,
 			     &vdo->vdo_directory,
 			     "dedupe");
 	if (result != VDO_SUCCESS) {
+		free_batch_processor(&index->uds_batcher);
 		free_work_queue(&index->uds_queue);
-		uds_destroy_index_session(index->index_session);
+		release_index_session(index);
 		uds_free_configuration(index->configuration);
+		FREE(index->update_batches);
 		FREE(index->index_name);
 		FREE(index);
 		return result;
@@ -1037,6 +2203,8 @@ int make_dedupe_index(struct dedupe_index **index_ptr, struct vdo *vdo)
 	spin_lock_init(&index->pending_lock);
 	spin_lock_init(&index->state_lock);
 	timer_setup(&index->pending_timer, timeout_index_operations, 0);
+	index->timeout_jiffies = dedupe_index_timeout_jiffies;
+	index->update_delay_jiffies = msecs_to_jiffies(DEFAULT_UPDATE_DELAY_MS);
 
 	// UDS Timeout Reporter
 	init_periodic_event_reporter(&index->timeout_reporter, layer);
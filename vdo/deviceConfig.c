@@ -28,10 +28,13 @@
 #include "stringUtils.h"
 
 #include "types.h"
+#include "vdoComponent.h"
 #include "vdoInternal.h"
 
 #include "vdoStringUtils.h"
 
+#include "compressor.h"
+
 #include "constants.h"
 
 enum {
@@ -41,6 +44,7 @@ enum {
 	BIO_ROTATION_INTERVAL_LIMIT = 1024,
 	LOGICAL_THREAD_COUNT_LIMIT = 60,
 	PHYSICAL_THREAD_COUNT_LIMIT = 16,
+	PACKER_THREAD_COUNT_LIMIT = 16,
 	THREAD_COUNT_LIMIT = 100,
 	// XXX The bio-submission queue configuration defaults are temporarily
 	// still being defined here until the new runtime-based thread
@@ -137,6 +141,75 @@ parse_bool(const char *bool_str,
 	return VDO_SUCCESS;
 }
 
+/**
+ * Parse the name of a chunk-name hash algorithm.
+ *
+ * @param name           The algorithm name
+ * @param algorithm_ptr  A pointer to return the algorithm
+ *
+ * @return VDO_SUCCESS or VDO_BAD_CONFIGURATION
+ **/
+static int parse_hash_algorithm(const char *name,
+				enum vdo_hash_algorithm *algorithm_ptr)
+{
+	enum vdo_hash_algorithm algorithm;
+
+	for (algorithm = 0; algorithm < VDO_HASH_ALGORITHM_COUNT; algorithm++) {
+		if (strcmp(name, get_vdo_hash_algorithm_name(algorithm)) == 0) {
+			*algorithm_ptr = algorithm;
+			return VDO_SUCCESS;
+		}
+	}
+
+	uds_log_error("optional parameter error: unknown hash algorithm \"%s\"",
+		      name);
+	return VDO_BAD_CONFIGURATION;
+}
+
+/**********************************************************************/
+const char *get_vdo_write_cache_mode_name(enum vdo_write_cache_mode mode)
+{
+	switch (mode) {
+	case VDO_WRITE_CACHE_AUTO:
+		return "auto";
+
+	case VDO_WRITE_CACHE_VOLATILE:
+		return "volatile";
+
+	case VDO_WRITE_CACHE_PROTECTED:
+		return "protected";
+
+	default:
+		return "unknown";
+	}
+}
+
+/**
+ * Parse the name of a write cache mode.
+ *
+ * @param name      The mode name
+ * @param mode_ptr  A pointer to return the mode
+ *
+ * @return VDO_SUCCESS or VDO_BAD_CONFIGURATION
+ **/
+static int parse_write_cache_mode(const char *name,
+				  enum vdo_write_cache_mode *mode_ptr)
+{
+	enum vdo_write_cache_mode mode;
+
+	for (mode = VDO_WRITE_CACHE_AUTO; mode <= VDO_WRITE_CACHE_PROTECTED;
+	     mode++) {
+		if (strcmp(name, get_vdo_write_cache_mode_name(mode)) == 0) {
+			*mode_ptr = mode;
+			return VDO_SUCCESS;
+		}
+	}
+
+	uds_log_error("optional parameter error: unknown write cache mode \"%s\"",
+		      name);
+	return VDO_BAD_CONFIGURATION;
+}
+
 /**
  * Process one component of a thread parameter configuration string and
  * update the configuration data structure.
@@ -183,6 +256,14 @@ static int process_one_thread_config_spec(const char *thread_param_type,
 		}
 		config->physical_zones = count;
 		return VDO_SUCCESS;
+	} else if (strcmp(thread_param_type, "packer") == 0) {
+		if (count > PACKER_THREAD_COUNT_LIMIT) {
+			uds_log_error("thread config string error: at most %d 'packer' threads are allowed",
+				      PACKER_THREAD_COUNT_LIMIT);
+			return -EINVAL;
+		}
+		config->packer_zones = count;
+		return VDO_SUCCESS;
 	} else {
 		// Handle other thread count parameters
 		if (count > THREAD_COUNT_LIMIT) {
@@ -205,6 +286,9 @@ static int process_one_thread_config_spec(const char *thread_param_type,
 		} else if (strcmp(thread_param_type, "ack") == 0) {
 			config->bio_ack_threads = count;
 			return VDO_SUCCESS;
+		} else if (strcmp(thread_param_type, "zone") == 0) {
+			config->zone_threads = count;
+			return VDO_SUCCESS;
 		} else if (strcmp(thread_param_type, "bio") == 0) {
 			if (count == 0) {
 				uds_log_error("thread config string error: at least one 'bio' thread required");
@@ -264,7 +348,8 @@ static int parse_one_thread_config_spec(const char *spec,
  *
  * The configuration string should contain one or more comma-separated specs
  * of the form "typename=number"; the supported type names are "cpu", "ack",
- * "bio", "bioRotationInterval", "logical", "physical", and "hash".
+ * "bio", "bioRotationInterval", "logical", "physical", "hash", "packer",
+ * and "zone".
  *
  * If an error occurs during parsing of a single key/value pair, we deem
  * it serious enough to stop further parsing.
@@ -304,6 +389,130 @@ static int parse_thread_config_string(const char *string,
 	return result;
 }
 
+/**
+ * Parse the fields of a QoS class specification of the form
+ * "first-last:limit".
+ *
+ * @param [in]  spec   The class specification string
+ * @param [out] class  The class specified
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int parse_qos_class_fields(const char *spec,
+				  struct qos_class_config *class)
+{
+	char **fields, **range;
+	int result = split_string(spec, ':', &fields);
+
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	if ((fields[0] == NULL) || (fields[1] == NULL) ||
+	    (fields[2] != NULL) ||
+	    (kstrtouint(fields[1], 10, &class->limit) != 0)) {
+		free_string_array(fields);
+		return -EINVAL;
+	}
+
+	result = split_string(fields[0], '-', &range);
+	free_string_array(fields);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	if ((range[0] == NULL) || (range[1] == NULL) || (range[2] != NULL) ||
+	    (kstrtoull(range[0], 10, &class->first) != 0) ||
+	    (kstrtoull(range[1], 10, &class->last) != 0)) {
+		result = -EINVAL;
+	}
+
+	free_string_array(range);
+	return result;
+}
+
+/**
+ * Parse one QoS class specification and add the class to the
+ * configuration.
+ *
+ * @param spec    The class specification string
+ * @param config  The configuration data to be updated
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int parse_one_qos_class_spec(const char *spec,
+				    struct device_config *config)
+{
+	struct qos_class_config class;
+	unsigned int i;
+	int result;
+
+	if (config->qos_class_count == VDO_MAX_QOS_CLASSES) {
+		uds_log_error("optional parameter error: at most %u QoS classes are allowed",
+			      VDO_MAX_QOS_CLASSES);
+		return -EINVAL;
+	}
+
+	result = parse_qos_class_fields(spec, &class);
+	if (result != UDS_SUCCESS) {
+		uds_log_error("optional parameter error: expected QoS class of the form first-last:limit, saw \"%s\"",
+			      spec);
+		return result;
+	}
+
+	if ((class.first > class.last) || (class.limit == 0) ||
+	    (class.limit > MAXIMUM_VDO_USER_VIOS)) {
+		uds_log_error("optional parameter error: QoS class \"%s\" must have a non-empty range and a limit of 1 to %u requests",
+			      spec, MAXIMUM_VDO_USER_VIOS);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < config->qos_class_count; i++) {
+		const struct qos_class_config *other = &config->qos_classes[i];
+
+		if ((class.first <= other->last) &&
+		    (other->first <= class.last)) {
+			uds_log_error("optional parameter error: QoS class \"%s\" overlaps another class",
+				      spec);
+			return -EINVAL;
+		}
+	}
+
+	config->qos_classes[config->qos_class_count++] = class;
+	return VDO_SUCCESS;
+}
+
+/**
+ * Parse a comma-separated list of QoS class specifications and add the
+ * classes to the configuration.
+ *
+ * @param string  The QoS class configuration string
+ * @param config  The configuration data to be updated
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int parse_qos_classes_string(const char *string,
+				    struct device_config *config)
+{
+	char **specs;
+	unsigned int i;
+	int result = split_string(string, ',', &specs);
+
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; specs[i] != NULL; i++) {
+		result = parse_one_qos_class_spec(specs[i], config);
+		if (result != VDO_SUCCESS) {
+			break;
+		}
+	}
+
+	free_string_array(specs);
+	return result;
+}
+
 /**
  * Process one component of an optional parameter string and update
  * the configuration data structure.
@@ -337,6 +546,16 @@ static int process_one_key_value_pair(const char *key,
 		config->max_discard_blocks = value;
 		return VDO_SUCCESS;
 	}
+
+	if (strcmp(key, "compressionUnit") == 0) {
+		if ((value == 0) || (value > VDO_MAX_COMPRESSION_UNIT_BLOCKS)) {
+			uds_log_error("optional parameter error: compression unit must be 1 to %d blocks",
+				      VDO_MAX_COMPRESSION_UNIT_BLOCKS);
+			return -EINVAL;
+		}
+		config->compression_unit_blocks = value;
+		return VDO_SUCCESS;
+	}
 	// Handles unknown key names
 	return process_one_thread_config_spec(key, value,
 					      &config->thread_counts);
@@ -363,6 +582,59 @@ static int parse_one_key_value_pair(const char *key,
 		return parse_bool(value, "on", "off", &config->deduplication);
 	}
 
+	if (strcmp(key, "compressor") == 0) {
+		return parse_vdo_compression_format(value,
+						    &config->compression_format);
+	}
+
+	if (strcmp(key, "hash") == 0) {
+		return parse_hash_algorithm(value, &config->hash_algorithm);
+	}
+
+	if (strcmp(key, "numa") == 0) {
+		return parse_bool(value, "on", "off", &config->numa_aware);
+	}
+
+	if (strcmp(key, "bioHardwareQueues") == 0) {
+		return parse_bool(value, "on", "off",
+				  &config->bio_hardware_queues);
+	}
+
+	if (strcmp(key, "compactJournal") == 0) {
+		return parse_bool(value, "on", "off",
+				  &config->compact_journal_entries);
+	}
+
+	if (strcmp(key, "qosClasses") == 0) {
+		return parse_qos_classes_string(value, config);
+	}
+
+	if (strcmp(key, "writeCache") == 0) {
+		return parse_write_cache_mode(value, &config->write_cache);
+	}
+
+	if (strcmp(key, "indexDevice") == 0) {
+		if (config->index_device_name != NULL) {
+			uds_log_error("optional parameter error: only one index device may be given");
+			return VDO_BAD_CONFIGURATION;
+		}
+		return duplicate_string(value, "index device name",
+					&config->index_device_name);
+	}
+
+	if (strcmp(key, "sharedIndex") == 0) {
+		return parse_bool(value, "on", "off", &config->shared_index);
+	}
+
+	if (strcmp(key, "journalDevice") == 0) {
+		if (config->journal_device_name != NULL) {
+			uds_log_error("optional parameter error: only one journal device may be given");
+			return VDO_BAD_CONFIGURATION;
+		}
+		return duplicate_string(value, "journal device name",
+					&config->journal_device_name);
+	}
+
 	// The remaining arguments must have integral values.
 	result = string_to_uint(value, &count);
 	if (result != UDS_SUCCESS) {
@@ -416,7 +688,7 @@ static int parse_key_value_pairs(int argc,
  * the thread configuration. The configuration string should contain
  * one or more comma-separated specs of the form "typename=number"; the
  * supported type names are "cpu", "ack", "bio", "bioRotationInterval",
- * "logical", "physical", and "hash".
+ * "logical", "physical", "hash", "packer", and "zone".
  *
  * For V2 configurations and beyond, there could be any number of
  * arguments. They should contain one or more key/value pairs
@@ -522,9 +794,19 @@ int parse_device_config(int argc,
 		.logical_zones = 0,
 		.physical_zones = 0,
 		.hash_zones = 0,
+		.packer_zones = 0,
+		.zone_threads = 0,
 	};
 	config->max_discard_blocks = 1;
 	config->deduplication = true;
+	config->hash_algorithm = VDO_HASH_MURMUR3_128;
+	config->compression_format = VDO_COMPRESSION_LZ4;
+	config->compression_unit_blocks = 1;
+	config->numa_aware = false;
+	config->bio_hardware_queues = false;
+	config->compact_journal_entries = false;
+	config->qos_class_count = 0;
+	config->write_cache = VDO_WRITE_CACHE_AUTO;
 
 	arg_set.argc = argc;
 	arg_set.argv = argv;
@@ -647,6 +929,15 @@ int parse_device_config(int argc,
 		return VDO_BAD_CONFIGURATION;
 	}
 
+	// Multiple packer zones need the zones they are routed from.
+	if ((config->thread_counts.packer_zones > 1) &&
+	    (config->thread_counts.physical_zones == 0)) {
+		handle_parse_error(&config,
+				   error_ptr,
+				   "Multiple packer zones require non-zero zone counts");
+		return VDO_BAD_CONFIGURATION;
+	}
+
 	if (config->cache_size <
 	    (2 * MAXIMUM_VDO_USER_VIOS * config->thread_counts.logical_zones)) {
 		handle_parse_error(&config,
@@ -669,6 +960,62 @@ int parse_device_config(int argc,
 		return VDO_BAD_CONFIGURATION;
 	}
 
+	if (config->index_device_name != NULL) {
+		result = dm_get_device(ti,
+				       config->index_device_name,
+				       dm_table_get_mode(ti->table),
+				       &config->owned_index_device);
+		if (result != 0) {
+			uds_log_error("couldn't open index device \"%s\": error %d",
+				      config->index_device_name,
+				      result);
+			handle_parse_error(&config,
+					   error_ptr,
+					   "Unable to open index device");
+			return VDO_BAD_CONFIGURATION;
+		}
+
+		if (config->owned_index_device->bdev ==
+		    config->owned_device->bdev) {
+			handle_parse_error(&config,
+					   error_ptr,
+					   "Index device must not be the storage device");
+			return VDO_BAD_CONFIGURATION;
+		}
+	} else if (config->shared_index) {
+		handle_parse_error(&config,
+				   error_ptr,
+				   "A shared index requires an index device");
+		return VDO_BAD_CONFIGURATION;
+	}
+
+	if (config->journal_device_name != NULL) {
+		result = dm_get_device(ti,
+				       config->journal_device_name,
+				       dm_table_get_mode(ti->table),
+				       &config->owned_journal_device);
+		if (result != 0) {
+			uds_log_error("couldn't open journal device \"%s\": error %d",
+				      config->journal_device_name,
+				      result);
+			handle_parse_error(&config,
+					   error_ptr,
+					   "Unable to open journal device");
+			return VDO_BAD_CONFIGURATION;
+		}
+
+		if ((config->owned_journal_device->bdev ==
+		     config->owned_device->bdev) ||
+		    ((config->owned_index_device != NULL) &&
+		     (config->owned_journal_device->bdev ==
+		      config->owned_index_device->bdev))) {
+			handle_parse_error(&config,
+					   error_ptr,
+					   "Journal device must not be the storage or index device");
+			return VDO_BAD_CONFIGURATION;
+		}
+	}
+
 	if (config->version == 0) {
 		uint64_t device_size =
 			i_size_read(config->owned_device->bdev->bd_inode);
@@ -699,7 +1046,19 @@ void free_device_config(struct device_config **config_ptr)
 		dm_put_device(config->owning_target, config->owned_device);
 	}
 
+	if (config->owned_index_device != NULL) {
+		dm_put_device(config->owning_target,
+			      config->owned_index_device);
+	}
+
+	if (config->owned_journal_device != NULL) {
+		dm_put_device(config->owning_target,
+			      config->owned_journal_device);
+	}
+
 	FREE(config->parent_device_name);
+	FREE(config->index_device_name);
+	FREE(config->journal_device_name);
 	FREE(config->original_string);
 
 	// Reduce the chance a use-after-free (as in BZ 1669960) happens to work.
@@ -24,6 +24,7 @@
 #include <linux/device-mapper.h>
 #include <linux/list.h>
 
+#include "compressedBlock.h"
 #include "types.h"
 
 #include "kernelTypes.h"
@@ -40,8 +41,40 @@ struct thread_count_config {
 	int logical_zones;
 	int physical_zones;
 	int hash_zones;
+	int packer_zones;
+	int zone_threads;
 } __packed;
 
+enum {
+	/** The most QoS classes a device may have */
+	VDO_MAX_QOS_CLASSES = 16,
+};
+
+/**
+ * A range of logical blocks which shares one budget of requests in progress.
+ **/
+struct qos_class_config {
+	/** The first logical block of the class */
+	logical_block_number_t first;
+	/** The last logical block of the class */
+	logical_block_number_t last;
+	/** The most requests in the class which may be in progress at once */
+	uint32_t limit;
+};
+
+/**
+ * How the durability of completed writes to the backing device is
+ * established.
+ **/
+enum vdo_write_cache_mode {
+	/** Follow the backing device's advertised write cache */
+	VDO_WRITE_CACHE_AUTO,
+	/** Assume a volatile write cache, and always issue flushes */
+	VDO_WRITE_CACHE_VOLATILE,
+	/** Assume completed writes are durable, and elide metadata flushes */
+	VDO_WRITE_CACHE_PROTECTED,
+};
+
 struct device_config {
 	struct dm_target *owning_target;
 	struct dm_dev *owned_device;
@@ -51,15 +84,56 @@ struct device_config {
 	char *original_string;
 	unsigned int version;
 	char *parent_device_name;
+	/** The device holding the dedupe index, if not the parent device */
+	char *index_device_name;
+	struct dm_dev *owned_index_device;
+	/**
+	 * Whether the index on the index device is shared with the other
+	 * VDOs which name it
+	 */
+	bool shared_index;
+	/** The device holding the recovery journal, if not the parent device */
+	char *journal_device_name;
+	struct dm_dev *owned_journal_device;
 	block_count_t physical_blocks;
 	unsigned int logical_block_size;
 	unsigned int cache_size;
 	unsigned int block_map_maximum_age;
 	bool deduplication;
+	enum vdo_hash_algorithm hash_algorithm;
+	enum vdo_compression_format compression_format;
+	/**
+	 * The most logically consecutive blocks to compress together as one
+	 * fragment, or 1 to compress each block alone
+	 **/
+	unsigned int compression_unit_blocks;
+	bool numa_aware;
+	/**
+	 * Whether each bio thread submits from the CPUs of its own hardware
+	 * queues of the backing device
+	 **/
+	bool bio_hardware_queues;
+	/** Whether recovery journal blocks are written with compact entries */
+	bool compact_journal_entries;
+	/** The number of QoS classes */
+	unsigned int qos_class_count;
+	/** The QoS classes, which do not overlap */
+	struct qos_class_config qos_classes[VDO_MAX_QOS_CLASSES];
+	enum vdo_write_cache_mode write_cache;
 	struct thread_count_config thread_counts;
 	block_count_t max_discard_blocks;
 };
 
+/**
+ * Get the name of a write cache mode.
+ *
+ * @param mode  The write cache mode
+ *
+ * @return The name of the mode as used in the table line
+ **/
+const char * __must_check
+get_vdo_write_cache_mode_name(enum vdo_write_cache_mode mode);
+
 /**
  * Convert a list entry to the device_config that contains it. If non-NULL,
  * the list must not be empty.
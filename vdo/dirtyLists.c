@@ -41,6 +41,10 @@ struct dirty_lists {
 	void *context;
 	/** The offset in the array of lists of the oldest period */
 	block_count_t offset;
+	/** The number of elements to expire early each period, or 0 */
+	block_count_t pace;
+	/** The oldest period which may have elements to expire early */
+	sequence_number_t paced_period;
 	/** The list of elements which are being expired */
 	struct list_head expired;
 	/** The lists of dirty elements */
@@ -116,6 +120,39 @@ static void expire_oldest_list(struct dirty_lists *dirty_lists)
 	}
 }
 
+/**
+ * Expire up to the pace's worth of the oldest elements ahead of their
+ * deadline, so that writeback is spread across the periods instead of
+ * arriving all at once when a heavily dirtied period expires. Elements of
+ * the newest period are left alone since they are the most likely to be
+ * dirtied again.
+ *
+ * @param dirty_lists  The dirty_lists
+ **/
+static void expire_paced_elements(struct dirty_lists *dirty_lists)
+{
+	block_count_t remaining = dirty_lists->pace;
+	sequence_number_t period = max(dirty_lists->paced_period,
+				       dirty_lists->oldest_period);
+
+	for (; (remaining > 0) && ((period + 1) < dirty_lists->next_period);
+	     period++) {
+		struct list_head *dirty_list =
+			&dirty_lists->lists[period % dirty_lists->maximum_age];
+		while ((remaining > 0) && !list_empty(dirty_list)) {
+			list_move_tail(dirty_list->next,
+				       &dirty_lists->expired);
+			remaining--;
+		}
+
+		if (!list_empty(dirty_list)) {
+			break;
+		}
+	}
+
+	dirty_lists->paced_period = period;
+}
+
 /**
  * Update the period if necessary.
  *
@@ -131,6 +168,9 @@ static void update_period(struct dirty_lists *dirty_lists,
 			expire_oldest_list(dirty_lists);
 		}
 		dirty_lists->next_period++;
+		if (dirty_lists->pace > 0) {
+			expire_paced_elements(dirty_lists);
+		}
 	}
 }
 
@@ -168,11 +208,19 @@ void add_to_dirty_lists(struct dirty_lists *dirty_lists,
 		list_move_tail(entry,
 			       &dirty_lists->lists[new_period %
 						   dirty_lists->maximum_age]);
+		dirty_lists->paced_period = min(dirty_lists->paced_period,
+						new_period);
 	}
 
 	write_expired_elements(dirty_lists);
 }
 
+/**********************************************************************/
+void set_dirty_lists_pace(struct dirty_lists *dirty_lists, block_count_t pace)
+{
+	dirty_lists->pace = pace;
+}
+
 /**********************************************************************/
 void advance_period(struct dirty_lists *dirty_lists, sequence_number_t period)
 {
@@ -92,6 +92,19 @@ void add_to_dirty_lists(struct dirty_lists *dirty_lists,
 			sequence_number_t old_period,
 			sequence_number_t new_period);
 
+/**
+ * Set the number of elements to expire ahead of their deadline each time the
+ * period advances. Elements are taken from the oldest lists first, so that
+ * writeback is spread evenly across periods rather than arriving in bursts.
+ * Elements still expire when they reach the maximum age regardless of the
+ * pace.
+ *
+ * @param dirty_lists  The dirty_lists
+ * @param pace         The number of elements to expire early each period,
+ *                     or 0 to expire elements only at the maximum age
+ **/
+void set_dirty_lists_pace(struct dirty_lists *dirty_lists, block_count_t pace);
+
 /**
  * Advance the current period. If the current period is greater than the number
  * of lists, expire the oldest lists.
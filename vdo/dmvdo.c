@@ -29,9 +29,13 @@
 #include "threadRegistry.h"
 
 #include "constants.h"
+#include "hashZone.h"
 #include "threadConfig.h"
 #include "vdo.h"
 
+#include "accessTrace.h"
+#include "blockCompare.h"
+#include "dedupeExemptions.h"
 #include "dedupeIndex.h"
 #include "deviceRegistry.h"
 #include "dump.h"
@@ -43,6 +47,7 @@
 #include "stringUtils.h"
 #include "vdo.h"
 #include "vdoInit.h"
+#include "workload.h"
 
 enum vdo_module_status vdo_module_status;
 
@@ -118,7 +123,7 @@ static void vdo_io_hints(struct dm_target *ti, struct queue_limits *limits)
 	// The minimum io size for random io
 	blk_limits_io_min(limits, VDO_BLOCK_SIZE);
 	// The optimal io size for streamed/sequential io
-	blk_limits_io_opt(limits, VDO_BLOCK_SIZE);
+	blk_limits_io_opt(limits, MAXIMUM_VDO_BIO_BLOCKS * VDO_BLOCK_SIZE);
 
 	/*
 	 * Sets the maximum discard size that will be passed into VDO. This
@@ -144,6 +149,9 @@ static void vdo_io_hints(struct dm_target *ti, struct queue_limits *limits)
 	// Force discards to not begin or end with a partial block by stating
 	// the granularity is 4k.
 	limits->discard_granularity = VDO_BLOCK_SIZE;
+
+	// Write-zeroes is carried out exactly as a discard.
+	limits->max_write_zeroes_sectors = limits->max_discard_sectors;
 }
 
 /**********************************************************************/
@@ -186,7 +194,7 @@ static void vdo_status(struct dm_target *ti,
 		get_kvdo_statistics(&layer->vdo, &layer->vdo_stats_storage);
 		stats = &layer->vdo_stats_storage;
 
-		DMEMIT("/dev/%s %s %s %s %s %llu %llu",
+		DMEMIT("/dev/%s %s %s %s %s %llu %llu %s",
 		       bdevname(get_vdo_backing_device(&layer->vdo),
 				name_buffer),
 		       stats->mode,
@@ -194,7 +202,9 @@ static void vdo_status(struct dm_target *ti,
 		       get_dedupe_state_name(layer->dedupe_index),
 		       get_vdo_compressing(&layer->vdo) ? "online" : "offline",
 		       stats->data_blocks_used + stats->overhead_blocks_used,
-		       stats->physical_blocks);
+		       stats->physical_blocks,
+		       (vdo_has_volatile_write_cache(&layer->vdo) ?
+			"volatile" : "protected"));
 		mutex_unlock(&layer->stats_mutex);
 		break;
 
@@ -244,6 +254,143 @@ vdo_prepare_to_grow_logical(struct kernel_layer *layer, char *size_string)
 	return prepare_to_resize_logical(layer, logical_count);
 }
 
+/**
+ * Change the size of the block map cache while the vdo is running. The new
+ * size lasts until the device is next started, when the size in the table
+ * line applies again.
+ *
+ * @param layer        The layer to which the message was sent
+ * @param size_string  The new size of the cache, in blocks
+ *
+ * @return 0 or an error code
+ **/
+static int vdo_resize_block_map_cache(struct kernel_layer *layer,
+				      char *size_string)
+{
+	unsigned int cache_size;
+	zone_count_t logical_zones =
+		get_thread_config(&layer->vdo)->logical_zone_count;
+	int result;
+
+	if (sscanf(size_string, "%u", &cache_size) != 1) {
+		uds_log_warning("Block map cache size \"%s\" is not a number",
+				size_string);
+		return -EINVAL;
+	}
+
+	if (cache_size < (2 * MAXIMUM_VDO_USER_VIOS * logical_zones)) {
+		uds_log_warning("Block map cache size %u is too small for %u logical zones",
+				cache_size, logical_zones);
+		return -EINVAL;
+	}
+
+	result = resize_kvdo_block_map_cache(&layer->vdo, cache_size);
+	if (result != VDO_SUCCESS) {
+		return log_error_strerror(result,
+					  "cannot resize block map cache to %u blocks",
+					  cache_size);
+	}
+
+	log_info("block map cache resized to %u blocks", cache_size);
+	return 0;
+}
+
+/**
+ * Exempt a range of logical blocks from deduplication.
+ *
+ * @param layer         The layer to which the message was sent
+ * @param start_string  The first logical block of the range
+ * @param count_string  The number of logical blocks in the range
+ *
+ * @return 0 or an error code
+ **/
+static int vdo_add_dedupe_exemption(struct kernel_layer *layer,
+				    char *start_string,
+				    char *count_string)
+{
+	logical_block_number_t start;
+	block_count_t count;
+	int result;
+
+	if ((sscanf(start_string, "%llu", &start) != 1) ||
+	    (sscanf(count_string, "%llu", &count) != 1)) {
+		uds_log_warning("Dedupe exemption \"%s %s\" is not a block range",
+				start_string, count_string);
+		return -EINVAL;
+	}
+
+	result = add_dedupe_exemption(layer->dedupe_exemptions, start, count);
+	if (result != VDO_SUCCESS) {
+		return log_error_strerror(result,
+					  "cannot exempt %llu blocks at %llu from deduplication",
+					  count, start);
+	}
+
+	return 0;
+}
+
+/**
+ * Change the number of threads of one kind which are given work while the vdo
+ * is running, up to the number in the table line. Spare CPU and bio ack
+ * threads finish the work they have and then sit idle; since bio threads are
+ * chosen by physical block number, their count may only change while the
+ * device is suspended. The new count lasts until the device is next started.
+ *
+ * @param layer         The layer to which the message was sent
+ * @param type          The kind of thread: "cpu", "ack", or "bio"
+ * @param count_string  The number of threads to use
+ *
+ * @return 0 or an error code
+ **/
+static int vdo_set_thread_count(struct kernel_layer *layer,
+				char *type,
+				char *count_string)
+{
+	unsigned int count;
+	int result;
+
+	if (sscanf(count_string, "%u", &count) != 1) {
+		uds_log_warning("Thread count \"%s\" is not a number",
+				count_string);
+		return -EINVAL;
+	}
+
+	if (strcasecmp(type, "cpu") == 0) {
+		result = set_work_queue_thread_count(layer->cpu_queue, count);
+	} else if (strcasecmp(type, "ack") == 0) {
+		if (layer->bio_ack_queue == NULL) {
+			uds_log_warning("vdo has no bio ack threads");
+			return -EINVAL;
+		}
+		if (layer->shared_bio_ack_queue) {
+			uds_log_warning("vdo bio ack threads are shared by all vdos");
+			return -EINVAL;
+		}
+		result = set_work_queue_thread_count(layer->bio_ack_queue,
+						     count);
+	} else if (strcasecmp(type, "bio") == 0) {
+		if (get_kernel_layer_state(layer) != LAYER_SUSPENDED) {
+			uds_log_warning("bio thread count can only change while suspended");
+			return -EINVAL;
+		}
+		result = set_io_submitter_thread_count(layer->vdo.io_submitter,
+						       count);
+	} else {
+		uds_log_warning("invalid thread type '%s' to dmsetup threads message",
+				type);
+		return -EINVAL;
+	}
+
+	if (result != VDO_SUCCESS) {
+		uds_log_warning("cannot use %u '%s' threads; at most the number in the table line may be used",
+				count, type);
+		return result;
+	}
+
+	log_info("now using %u '%s' threads", count, type);
+	return 0;
+}
+
 /**********************************************************************/
 static int vdo_grow_physical(struct vdo *vdo)
 {
@@ -324,6 +471,28 @@ process_vdo_message_locked(struct kernel_layer *layer,
 			return vdo_prepare_to_grow_logical(layer, argv[1]);
 		}
 
+		if (strcasecmp(argv[0], "cache-size") == 0) {
+			return vdo_resize_block_map_cache(layer, argv[1]);
+		}
+
+		if ((strcasecmp(argv[0], "dedupe-exempt") == 0) &&
+		    (strcasecmp(argv[1], "clear") == 0)) {
+			clear_dedupe_exemptions(layer->dedupe_exemptions);
+			return 0;
+		}
+
+		break;
+
+	case 3:
+		if (strcasecmp(argv[0], "dedupe-exempt") == 0) {
+			return vdo_add_dedupe_exemption(layer, argv[1],
+							argv[2]);
+		}
+
+		if (strcasecmp(argv[0], "threads") == 0) {
+			return vdo_set_thread_count(layer, argv[1], argv[2]);
+		}
+
 		break;
 
 
@@ -449,6 +618,24 @@ static int vdo_message(struct dm_target *ti,
 		}
 	}
 
+	// A workload reports its results in the buffer, and must not overlap
+	// other exclusive messages.
+	if (strcasecmp(argv[0], "workload") == 0) {
+		if (atomic_cmpxchg(&layer->processing_message, 0, 1) != 0) {
+			result = -EBUSY;
+		} else {
+			result = run_vdo_workload(layer, argc - 1, argv + 1,
+						  result_buffer, maxlen);
+			smp_wmb();
+			atomic_set(&layer->processing_message, 0);
+		}
+
+		uds_unregister_thread_device_id();
+		unregister_allocating_thread();
+		return ((result == VDO_SUCCESS) ?
+			1 : map_to_system_error(result));
+	}
+
 	result = process_vdo_message(layer, argc, argv);
 
 	uds_unregister_thread_device_id();
@@ -469,10 +656,13 @@ static void configure_target_capabilities(struct dm_target *ti,
 	ti->flush_supported = true;
 	ti->num_discard_bios = 1;
 	ti->num_flush_bios = 1;
+	ti->num_write_zeroes_bios = 1;
 
 	// If this value changes, please make sure to update the
 	// value for max_discard_sectors accordingly.
-	BUG_ON(dm_set_target_max_io_len(ti, VDO_SECTORS_PER_BLOCK) != 0);
+	BUG_ON(dm_set_target_max_io_len(ti,
+					(MAXIMUM_VDO_BIO_BLOCKS *
+					 VDO_SECTORS_PER_BLOCK)) != 0);
 }
 
 /**
@@ -519,6 +709,25 @@ static int vdo_initialize(struct dm_target *ti,
 		      config->block_map_maximum_age);
 	uds_log_debug("Deduplication          = %s",
 		      (config->deduplication ? "on" : "off"));
+	uds_log_debug("Compressor             = %s",
+		      get_vdo_compression_format_name(config->compression_format));
+	uds_log_debug("Compression unit       = %u",
+		      config->compression_unit_blocks);
+	uds_log_debug("Hash algorithm         = %s",
+		      get_vdo_hash_algorithm_name(config->hash_algorithm));
+	uds_log_debug("NUMA placement         = %s",
+		      (config->numa_aware ? "on" : "off"));
+	uds_log_debug("Bio hardware queues    = %s",
+		      (config->bio_hardware_queues ? "on" : "off"));
+	uds_log_debug("Compact journal        = %s",
+		      (config->compact_journal_entries ? "on" : "off"));
+	uds_log_debug("QoS classes            = %u",
+		      config->qos_class_count);
+	uds_log_debug("Write cache            = %s",
+		      get_vdo_write_cache_mode_name(config->write_cache));
+	uds_log_debug("Journal device         = %s",
+		      ((config->journal_device_name == NULL) ?
+		       "-" : config->journal_device_name));
 
 	vdo = find_vdo_matching(vdo_uses_device, config);
 	if (vdo != NULL) {
@@ -684,6 +893,34 @@ static void vdo_dtr(struct dm_target *ti)
 	ti->private = NULL;
 }
 
+/**
+ * Check whether a suspend is only to swap in a newly loaded table which
+ * leaves the geometry and backing device of a VDO alone. Such a suspend need
+ * not write out the block map, slab depot, or dedupe index, since the data
+ * flush which every suspend does already makes acknowledged writes durable
+ * through the recovery journal, and the caches can be kept warm across the
+ * reload.
+ *
+ * @param vdo  The vdo being suspended
+ *
+ * @return <code>true</code> if the suspend is for a compatible table reload
+ **/
+static bool is_table_reload_suspend(struct vdo *vdo)
+{
+	struct device_config *active = vdo->device_config;
+	struct device_config *pending =
+		as_device_config(vdo->device_config_list.prev);
+
+	// A version 0 table is an old-style grow physical, so it is never
+	// a simple reload.
+	return ((pending != active) &&
+		(pending->version != 0) &&
+		(pending->owning_target->len == active->owning_target->len) &&
+		(pending->physical_blocks == active->physical_blocks) &&
+		(strcmp(pending->parent_device_name,
+			active->parent_device_name) == 0));
+}
+
 /**********************************************************************/
 static void vdo_presuspend(struct dm_target *ti)
 {
@@ -693,6 +930,10 @@ static void vdo_presuspend(struct dm_target *ti)
 	uds_register_thread_device_id(&instance_thread, &vdo->instance);
 	if (dm_noflush_suspending(ti)) {
 		vdo->no_flush_suspend = true;
+	} else if (is_table_reload_suspend(vdo)) {
+		log_info("suspending device '%s' for table reload without saving metadata",
+			 get_vdo_device_name(ti));
+		vdo->no_flush_suspend = true;
 	}
 	uds_unregister_thread_device_id();
 }
@@ -841,6 +1082,8 @@ static void vdo_destroy(void)
 	}
 
 	clean_up_vdo_instance_number_tracking();
+	free_hash_lock_cache();
+	remove_access_trace_root();
 
 	log_info("unloaded version %s", CURRENT_VERSION);
 }
@@ -852,6 +1095,8 @@ static int __init vdo_init(void)
 
 	initialize_device_registry_once();
 	log_info("loaded version %s", CURRENT_VERSION);
+	select_block_compare_functions();
+	create_access_trace_root();
 
 	// Add VDO errors to the already existing set of errors in UDS.
 	result = register_status_codes();
@@ -861,6 +1106,13 @@ static int __init vdo_init(void)
 		return result;
 	}
 
+	result = make_hash_lock_cache();
+	if (result != VDO_SUCCESS) {
+		uds_log_error("make_hash_lock_cache failed %d", result);
+		vdo_destroy();
+		return result;
+	}
+
 	result = dm_register_target(&vdo_target_bio);
 	if (result < 0) {
 		uds_log_error("dm_register_target failed %d", result);
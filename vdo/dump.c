@@ -121,6 +121,7 @@ static void do_dump(struct kernel_layer *layer,
 				  0);
 	dump_buffer_pool(layer->data_vio_pool,
 			 (dump_options_requested & FLAG_SHOW_VIO_POOL) != 0);
+	dump_buffer_pool(layer->block_buffer_pool, false);
 	if ((dump_options_requested & FLAG_SHOW_VDO_STATUS) != 0) {
 		// Options should become more fine-grained when we have more to
 		// display here.
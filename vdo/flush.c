@@ -53,6 +53,8 @@ struct flusher {
 	sequence_number_t notify_generation;
 	/** The logical zone to notify next */
 	struct logical_zone *logical_zone_to_notify;
+	/** The packer zone to notify next */
+	zone_count_t packer_zone_to_notify;
 	/** The ID of the thread on which flush requests should be made */
 	thread_id_t thread_id;
 	/** A flush request to ensure we always have at least one */
@@ -101,7 +103,7 @@ int make_vdo_flusher(struct vdo *vdo)
 
 	vdo->flusher->vdo = vdo;
 	vdo->flusher->thread_id
-		= get_packer_zone_thread(get_thread_config(vdo));
+		= get_packer_zone_thread(get_thread_config(vdo), 0);
 	initialize_vdo_completion(&vdo->flusher->completion, vdo,
 				  FLUSH_NOTIFICATION_COMPLETION);
 
@@ -134,6 +136,9 @@ thread_id_t get_vdo_flusher_thread_id(struct flusher *flusher)
 /**********************************************************************/
 static void notify_flush(struct flusher *flusher);
 
+/**********************************************************************/
+static void release_flush(struct vdo_flush *flush);
+
 /**
  * Finish the notification process by checking if any flushes have completed
  * and then starting the notification of the next flush request if one came in
@@ -167,18 +172,32 @@ static void finish_notification(struct vdo_completion *completion)
 }
 
 /**
- * Flush the packer now that all of the logical and physical zones have been
- * notified of the new flush request. This callback is registered in
- * increment_generation().
+ * Flush a packer zone now that all of the logical and physical zones have
+ * been notified of the new flush request. If there are more packer zones, go
+ * on to the next one, otherwise, finish the notification. This callback is
+ * registered both in increment_generation() and in itself.
  *
  * @param completion  The flusher completion
  **/
 static void flush_packer_callback(struct vdo_completion *completion)
 {
 	struct flusher *flusher = as_flusher(completion);
-	increment_packer_flush_generation(flusher->vdo->packer);
-	launch_vdo_completion_callback(completion, finish_notification,
-				       flusher->thread_id);
+	const struct thread_config *thread_config =
+		get_thread_config(flusher->vdo);
+
+	increment_packer_flush_generation(get_packer_zone(flusher->vdo->packer_zones,
+							  flusher->packer_zone_to_notify));
+	flusher->packer_zone_to_notify++;
+	if (flusher->packer_zone_to_notify ==
+	    thread_config->packer_zone_count) {
+		launch_vdo_completion_callback(completion, finish_notification,
+					       flusher->thread_id);
+		return;
+	}
+
+	launch_vdo_completion_callback(completion, flush_packer_callback,
+				       get_packer_zone_thread(thread_config,
+							      flusher->packer_zone_to_notify));
 }
 
 /**
@@ -196,6 +215,7 @@ static void increment_generation(struct vdo_completion *completion)
 	flusher->logical_zone_to_notify =
 		get_next_logical_zone(flusher->logical_zone_to_notify);
 	if (flusher->logical_zone_to_notify == NULL) {
+		flusher->packer_zone_to_notify = 0;
 		launch_vdo_completion_callback(completion,
 					       flush_packer_callback,
 					       flusher->thread_id);
@@ -237,6 +257,22 @@ void flush_vdo(struct vdo_work_item *item)
 	ASSERT_LOG_ONLY((get_callback_thread_id() == flusher->thread_id),
 			"flush_vdo() called from flusher thread");
 
+	if (count_waiters(&flusher->notifiers) > 1) {
+		/*
+		 * A notification is in progress and another flush is already
+		 * waiting for it. No zone has seen the waiting flush's
+		 * generation yet, so it will cover everything this one must,
+		 * and the two can be completed together.
+		 */
+		struct vdo_flush *waiting =
+			waiter_as_flush(flusher->notifiers.last_waiter);
+
+		bio_list_merge(&waiting->bios, &flush->bios);
+		bio_list_init(&flush->bios);
+		release_flush(flush);
+		return;
+	}
+
 	flush->flush_generation = flusher->flush_generation++;
 	may_notify = !has_waiters(&flusher->notifiers);
 
@@ -326,7 +362,7 @@ static void enqueue_flush(struct vdo_flush *flush)
 			REQ_Q_ACTION_FLUSH);
 	enqueue_vdo_work(vdo,
 			 &flush->work_item,
-			 get_packer_zone_thread(get_thread_config(vdo)));
+			 get_vdo_flusher_thread_id(vdo->flusher));
 }
 
 /**********************************************************************/
@@ -413,6 +449,113 @@ static void release_flush(struct vdo_flush *flush)
 	}
 }
 
+/**
+ * Release a flush request from a bio queue thread. This is used by
+ * finish_coalesced_flush(), which may run in interrupt context where the
+ * flusher lock can't be taken.
+ *
+ * @param item  The flush-request work item
+ **/
+static void release_flush_work(struct vdo_work_item *item)
+{
+	release_flush(container_of(item, struct vdo_flush, work_item));
+}
+
+/**
+ * Complete the bios of a flush request once the one flush sent to the
+ * backing device on behalf of all of them is done. This is the bi_end_io of
+ * the bio sent by submit_coalesced_flush().
+ *
+ * @param bio  The bio which was sent to the backing device
+ **/
+static void finish_coalesced_flush(struct bio *bio)
+{
+	struct vdo_flush *flush = bio->bi_private;
+	struct bio *waiting_bio;
+
+	while ((waiting_bio = bio_list_pop(&flush->bios)) != NULL) {
+		waiting_bio->bi_status = bio->bi_status;
+		bio_endio(waiting_bio);
+	}
+
+	bio->bi_end_io = flush->saved_end_io;
+	bio->bi_private = flush->saved_private;
+
+	setup_work_item(&flush->work_item,
+			release_flush_work,
+			NULL,
+			BIO_Q_ACTION_FLUSH);
+	enqueue_bio_work_item(flush->vdo->io_submitter, &flush->work_item);
+	bio_endio(bio);
+}
+
+/**
+ * Send a flush bio on to the backing device.
+ *
+ * @param vdo  The vdo
+ * @param bio  The flush bio
+ **/
+static void submit_flush_bio(struct vdo *vdo, struct bio *bio)
+{
+	bio_set_dev(bio, get_vdo_backing_device(vdo));
+	atomic64_inc(&vdo_as_kernel_layer(vdo)->flush_out);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,9,0)
+	generic_make_request(bio);
+#else
+	submit_bio_noacct(bio);
+#endif
+}
+
+/**
+ * Check whether the bios of a flush request can all be satisfied by a single
+ * flush of the backing device, which is the case when there are several of
+ * them and none carries data.
+ *
+ * @param flush  The flush request
+ *
+ * @return <code>true</code> if the bios can share one flush
+ **/
+static bool can_coalesce_flush_bios(struct vdo_flush *flush)
+{
+	struct bio *bio;
+
+	if (bio_list_size(&flush->bios) < 2) {
+		return false;
+	}
+
+	bio_list_for_each(bio, &flush->bios) {
+		if (bio_sectors(bio) != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Send one of the bios of a flush request to the backing device, borrowing
+ * its completion to complete all the others with it. The flush request is
+ * held until then.
+ *
+ * @param flush  The flush request
+ **/
+static void submit_coalesced_flush(struct vdo_flush *flush)
+{
+	struct kernel_layer *layer = vdo_as_kernel_layer(flush->vdo);
+	struct bio *bio;
+
+	bio_list_for_each(bio, &flush->bios) {
+		count_bios(&layer->bios_acknowledged, bio);
+	}
+
+	bio = bio_list_pop(&flush->bios);
+	flush->saved_end_io = bio->bi_end_io;
+	flush->saved_private = bio->bi_private;
+	bio->bi_end_io = finish_coalesced_flush;
+	bio->bi_private = flush;
+	submit_flush_bio(flush->vdo, bio);
+}
+
 /**
  * Function called to complete and free a flush request
  *
@@ -426,19 +569,18 @@ static void vdo_complete_flush_work(struct vdo_work_item *item)
 	struct kernel_layer *layer = vdo_as_kernel_layer(flush->vdo);
 	struct bio *bio;
 
+	if (can_coalesce_flush_bios(flush)) {
+		submit_coalesced_flush(flush);
+		return;
+	}
+
 	while ((bio = bio_list_pop(&flush->bios)) != NULL) {
 		// We're not acknowledging this bio now, but we'll never touch
 		// it again, so this is the last chance to account for it.
 		count_bios(&layer->bios_acknowledged, bio);
 
 		// Update the device, and send it on down...
-		bio_set_dev(bio, get_vdo_backing_device(flush->vdo));
-		atomic64_inc(&layer->flush_out);
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5,9,0)
-		generic_make_request(bio);
-#else
-		submit_bio_noacct(bio);
-#endif
+		submit_flush_bio(flush->vdo, bio);
 	}
 
 
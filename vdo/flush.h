@@ -44,6 +44,12 @@ struct vdo_flush {
 	struct waiter waiter;
 	/** Which flush this struct represents */
 	sequence_number_t flush_generation;
+	/**
+	 * The completion of the bio sent to the backing device for all the
+	 * bios of the request, saved while it is borrowed
+	 */
+	bio_end_io_t *saved_end_io;
+	void *saved_private;
 };
 
 /**
@@ -110,6 +110,12 @@ struct tree_page *get_vdo_tree_page_by_index(struct forest *forest,
 	return NULL;
 }
 
+/**********************************************************************/
+page_count_t get_vdo_tree_page_count(struct forest *forest, height_t height)
+{
+	return forest->boundaries[forest->segments - 1].levels[height - 1];
+}
+
 /**********************************************************************/
 static int make_segment(struct forest *old_forest,
 			block_count_t new_pages,
@@ -52,6 +52,17 @@ get_vdo_tree_page_by_index(struct forest *forest,
 			   height_t height,
 			   page_number_t page_index);
 
+/**
+ * Get the number of pages at a given height in each tree of a forest.
+ *
+ * @param forest  The forest
+ * @param height  The height of the pages to count
+ *
+ * @return The number of pages at that height in each tree
+ **/
+page_count_t __must_check
+get_vdo_tree_page_count(struct forest *forest, height_t height);
+
 /**
  * Make a collection of trees for a block_map, expanding the existing forest if
  * there is one.
@@ -104,6 +104,7 @@
 #include "hashLock.h"
 #include "hashLockInternals.h"
 
+#include <linux/ktime.h>
 #include <linux/list.h>
 
 #include "logger.h"
@@ -120,6 +121,7 @@
 #include "slabDepot.h"
 #include "types.h"
 #include "vdoInternal.h"
+#include "vdoTrace.h"
 #include "vioWrite.h"
 #include "waitQueue.h"
 
@@ -171,12 +173,7 @@ const char *get_hash_lock_state_name(enum hash_lock_state state)
 static void set_hash_lock_state(struct hash_lock *lock,
 				enum hash_lock_state new_state)
 {
-	if (false) {
-		uds_log_warning("XXX %px %s -> %s",
-				(void *) lock,
-				get_hash_lock_state_name(lock->state),
-				get_hash_lock_state_name(new_state));
-	}
+	trace_vdo_hash_lock_state(lock, lock->agent, lock->state, new_state);
 	lock->state = new_state;
 }
 
@@ -195,6 +192,55 @@ static void assert_hash_lock_agent(struct data_vio *data_vio, const char *where)
 			"%s must be for the hash lock agent", where);
 }
 
+/**
+ * Note that the agent of a hash lock is starting to query, lock, or verify
+ * on behalf of the lock, so that the latency of the stage can be recorded.
+ *
+ * @param lock  The hash lock
+ **/
+static void start_stage(struct hash_lock *lock)
+{
+	lock->stage_start = ktime_get_ns();
+}
+
+/**
+ * Record the latency of a stage begun with start_stage() in the hash zone
+ * of the lock agent.
+ *
+ * @param lock   The hash lock
+ * @param agent  The agent of the lock
+ * @param stage  The stage which the agent has finished
+ **/
+static void finish_stage(struct hash_lock *lock, struct data_vio *agent,
+			 enum hash_zone_stage stage)
+{
+	if (lock->stage_start == 0) {
+		return;
+	}
+
+	record_vdo_hash_zone_latency(agent->hash_zone, stage,
+				     lock->stage_start);
+	lock->stage_start = 0;
+}
+
+/**
+ * Record how long a data_vio waited on its hash lock, if it was waiting,
+ * now that it is resuming.
+ *
+ * @param data_vio  The data_vio which is done waiting
+ **/
+static void finish_waiting(struct data_vio *data_vio)
+{
+	if (data_vio->hash_lock_wait_start == 0) {
+		return;
+	}
+
+	record_vdo_hash_zone_latency(data_vio->hash_zone,
+				     HASH_ZONE_LOCK_WAIT_STAGE,
+				     data_vio->hash_lock_wait_start);
+	data_vio->hash_lock_wait_start = 0;
+}
+
 /**
  * Set or clear the lock agent.
  *
@@ -204,6 +250,9 @@ static void assert_hash_lock_agent(struct data_vio *data_vio, const char *where)
 static void set_agent(struct hash_lock *lock, struct data_vio *new_agent)
 {
 	lock->agent = new_agent;
+	if (new_agent != NULL) {
+		finish_waiting(new_agent);
+	}
 }
 
 /**
@@ -386,6 +435,11 @@ static void wait_on_hash_lock(struct hash_lock *lock, struct data_vio *data_vio)
 		return;
 	}
 
+	// A data_vio moved to a forked lock keeps its original start time.
+	if (data_vio->hash_lock_wait_start == 0) {
+		data_vio->hash_lock_wait_start = ktime_get_ns();
+	}
+
 	// Make sure the agent doesn't block indefinitely in the packer since it
 	// now has at least one other data_vio waiting on it.
 	if ((lock->state == HASH_LOCK_WRITING)
@@ -413,6 +467,7 @@ static void compress_waiter(struct waiter *waiter,
 			    void *context __always_unused)
 {
 	struct data_vio *data_vio = waiter_as_data_vio(waiter);
+	finish_waiting(data_vio);
 	data_vio->is_duplicate = false;
 	compress_data(data_vio);
 }
@@ -801,6 +856,7 @@ static void fork_hash_lock(struct hash_lock *old_lock,
 static void launch_dedupe(struct hash_lock *lock, struct data_vio *data_vio,
 			  bool has_claim)
 {
+	finish_waiting(data_vio);
 	if (!has_claim && !claim_pbn_lock_increment(lock->duplicate_lock)) {
 		// Out of increments, so must roll over to a new lock.
 		fork_hash_lock(lock, data_vio);
@@ -885,6 +941,17 @@ static void finish_verifying(struct vdo_completion *completion)
 	struct hash_lock *lock = agent->hash_lock;
 	assert_hash_lock_agent(agent, __func__);
 
+	if (agent->write_while_verifying) {
+		// Whichever of the verify and the speculative write finishes
+		// last continues here.
+		agent->write_while_verifying = false;
+		if (!atomic_dec_and_test(&agent->verify_steps)) {
+			return;
+		}
+	}
+
+	finish_stage(lock, agent, HASH_ZONE_VERIFY_STAGE);
+
 	if (completion->result != VDO_SUCCESS) {
 		// XXX VDOSTORY-190 should convert verify IO errors to
 		// verification failure
@@ -901,8 +968,15 @@ static void finish_verifying(struct vdo_completion *completion)
 		lock->verify_counted = true;
 		if (lock->verified) {
 			bump_vdo_hash_zone_valid_advice_count(agent->hash_zone);
+			cache_vdo_hash_zone_advice(agent->hash_zone,
+						   &lock->hash,
+						   &lock->duplicate);
 		} else {
 			bump_vdo_hash_zone_stale_advice_count(agent->hash_zone);
+			if (lock->cached_advice) {
+				discard_vdo_hash_zone_cached_advice(
+					agent->hash_zone, &lock->hash);
+			}
 		}
 	}
 
@@ -959,7 +1033,20 @@ static void start_verifying(struct hash_lock *lock, struct data_vio *agent)
 	 * cases (assuming we're willing to delay visibility of the the hash
 	 * lock state change).
 	 */
+	/*
+	 * If the advice was slow to arrive, the verify probably will be too,
+	 * so write the data to the agent's allocation at the same time. If
+	 * the advice is stale, the write path can then skip straight to
+	 * journaling, and the waiters get their location to dedupe against
+	 * sooner. If the advice is valid, the allocation is released as
+	 * usual.
+	 */
+	agent->write_while_verifying = (lock->late_advice &&
+					has_allocation(agent) &&
+					!agent->is_rededupe &&
+					!agent->speculatively_written);
 	agent->last_async_operation = VERIFY_DEDUPLICATION;
+	start_stage(lock);
 	set_hash_zone_callback(agent, finish_verifying);
 	verify_duplication(agent);
 }
@@ -977,6 +1064,7 @@ static void finish_locking(struct vdo_completion *completion)
 	struct data_vio *agent = as_data_vio(completion);
 	struct hash_lock *lock = agent->hash_lock;
 	assert_hash_lock_agent(agent, __func__);
+	finish_stage(lock, agent, HASH_ZONE_PBN_LOCK_STAGE);
 
 	if (completion->result != VDO_SUCCESS) {
 		// XXX clearDuplicateLocation()?
@@ -996,6 +1084,10 @@ static void finish_locking(struct vdo_completion *completion)
 		 * new advice.
 		 */
 		bump_vdo_hash_zone_stale_advice_count(agent->hash_zone);
+		if (lock->cached_advice) {
+			discard_vdo_hash_zone_cached_advice(agent->hash_zone,
+							    &lock->hash);
+		}
 		lock->update_advice = true;
 		start_writing(lock, agent);
 		return;
@@ -1192,6 +1284,7 @@ static void start_locking(struct hash_lock *lock, struct data_vio *agent)
 	 * atomic), we can avoid a thread transition here.
 	 */
 	agent->last_async_operation = ACQUIRE_PBN_READ_LOCK;
+	start_stage(lock);
 	launch_duplicate_zone_callback(agent, lock_duplicate_pbn);
 }
 
@@ -1216,6 +1309,8 @@ static void finish_writing(struct hash_lock *lock, struct data_vio *agent)
 	// it.
 	lock->duplicate = agent->new_mapped;
 	lock->verified = true;
+	cache_vdo_hash_zone_advice(agent->hash_zone, &lock->hash,
+				   &lock->duplicate);
 
 	if (is_compressed(lock->duplicate.state) && lock->registered) {
 		// Compression means the location we gave in the UDS query is
@@ -1377,6 +1472,25 @@ static void start_writing(struct hash_lock *lock, struct data_vio *agent)
 	compress_data(agent);
 }
 
+/**
+ * Check whether the UDS query of the agent for a hash lock took long enough
+ * that the agent should write its data while verifying any advice it got.
+ *
+ * @param lock   The hash lock
+ * @param agent  The agent which has finished querying
+ *
+ * @return <code>true</code> if the advice is late
+ **/
+static bool is_advice_late(struct hash_lock *lock, struct data_vio *agent)
+{
+	unsigned int threshold
+		= READ_ONCE(get_vdo_from_data_vio(agent)->optimistic_verify_us);
+
+	return ((threshold > 0) && (lock->stage_start != 0) &&
+		((ktime_get_ns() - lock->stage_start)
+		 >= ((uint64_t) threshold * NSEC_PER_USEC)));
+}
+
 /**
  * Process the result of a UDS query performed by the agent for the lock. This
  * continuation is registered in start_querying().
@@ -1389,6 +1503,9 @@ static void finish_querying(struct vdo_completion *completion)
 	struct hash_lock *lock = agent->hash_lock;
 
 	assert_hash_lock_agent(agent, __func__);
+	lock->late_advice = is_advice_late(lock, agent);
+	finish_stage(lock, agent, HASH_ZONE_QUERY_STAGE);
+	record_data_vio_milestone(agent, DATA_VIO_ADVISED);
 
 	if (completion->result != VDO_SUCCESS) {
 		abort_hash_lock(lock, agent);
@@ -1404,11 +1521,26 @@ static void finish_querying(struct vdo_completion *completion)
 		 * used.
 		 */
 		start_locking(lock, agent);
+	} else if (agent->is_rededupe) {
+		/*
+		 * QUERYING -> LOCKING transition: UDS knows of no copy of a
+		 * block which was written without deduplication, so offer the
+		 * block itself as the duplicate and record it in UDS. The
+		 * agent just read its data from that block, which its logical
+		 * lock keeps referenced, so there is nothing to verify.
+		 */
+		set_duplicate_location(agent, agent->mapped);
+		lock->duplicate = agent->duplicate;
+		lock->verified = true;
+		lock->update_advice = true;
+		start_locking(lock, agent);
 	} else {
 		// The agent will be used as the duplicate if has an
 		// allocation; if it does, that location was posted to UDS, so
-		// no update will be needed.
-		lock->update_advice = !has_allocation(agent);
+		// no update will be needed unless the post was shed because
+		// the index was backed up.
+		lock->update_advice = (!has_allocation(agent) ||
+				       agent->dedupe_context.was_shed);
 		/*
 		 * QUERYING -> WRITING transition: There was no advice or the
 		 * advice wasn't valid, so try to write or compress the data.
@@ -1427,11 +1559,52 @@ static void finish_querying(struct vdo_completion *completion)
  **/
 static void start_querying(struct hash_lock *lock, struct data_vio *data_vio)
 {
+	struct zoned_pbn advice;
+
 	set_agent(lock, data_vio);
 	set_hash_lock_state(lock, HASH_LOCK_QUERYING);
 
 	data_vio->last_async_operation = CHECK_FOR_DEDUPLICATION;
 	set_hash_zone_callback(data_vio, finish_querying);
+
+	if (data_vio->dedupe_exempt) {
+		/*
+		 * QUERYING -> WRITING transition: The block is exempt from
+		 * deduplication, so just write or compress it without
+		 * consulting or updating the index.
+		 */
+		lock->update_advice = false;
+		start_writing(lock, data_vio);
+		return;
+	}
+
+	if (get_vdo_hash_zone_cached_advice(data_vio->hash_zone, &lock->hash,
+					    &advice)) {
+		/*
+		 * The block was verified or written recently enough to still
+		 * be cached, so skip the trip to UDS. The advice will be
+		 * verified like any other, and if it proves stale the lock
+		 * will update UDS after writing.
+		 */
+		lock->cached_advice = true;
+		set_duplicate_location(data_vio, advice);
+		finish_querying(data_vio_as_completion(data_vio));
+		return;
+	}
+
+	if (has_allocation(data_vio) && !data_vio->is_rededupe &&
+	    defer_deduplication(data_vio)) {
+		/*
+		 * QUERYING -> WRITING transition: The post-process deduper
+		 * will read the block back and query UDS for it later, so
+		 * just write it.
+		 */
+		lock->update_advice = false;
+		start_writing(lock, data_vio);
+		return;
+	}
+
+	start_stage(lock);
 	check_for_duplication(data_vio);
 }
 
@@ -1603,6 +1776,12 @@ int acquire_vdo_hash_lock(struct data_vio *data_vio)
 						 &data_vio->chunk_name,
 						 NULL,
 						 &lock);
+	if (result == VDO_LOCK_ERROR) {
+		// The zone's lock pool is exhausted and can't grow, so write
+		// this block without trying to deduplicate it.
+		return VDO_SUCCESS;
+	}
+
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
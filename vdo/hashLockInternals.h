@@ -68,6 +68,9 @@ struct hash_lock {
 	 */
 	struct list_head pool_node;
 
+	/** The index of this lock in its zone's lock pool */
+	vio_count_t pool_index;
+
 	/**
 	 * A list containing the data VIOs sharing this lock, all having the
 	 * same chunk name and data block contents, linked by their
@@ -100,6 +103,18 @@ struct hash_lock {
 	 */
 	bool registered;
 
+	/**
+	 * True if the duplicate candidate came from the hash zone advice cache
+	 * rather than from UDS
+	 */
+	bool cached_advice;
+
+	/**
+	 * True if the advice took long enough to arrive that the agent should
+	 * write its data while verifying the advice
+	 */
+	bool late_advice;
+
 	/**
 	 * If verified is false, this is the location of a possible duplicate.
 	 * If verified is true, is is the verified location of a true duplicate.
@@ -109,6 +124,13 @@ struct hash_lock {
 	/** The PBN lock on the block containing the duplicate data */
 	struct pbn_lock *duplicate_lock;
 
+	/**
+	 * The time (in nanoseconds) at which the agent began querying,
+	 * locking, or verifying on behalf of the lock, or 0 if it is doing
+	 * none of those
+	 **/
+	uint64_t stage_start;
+
 	/** The data_vio designated to act on behalf of the lock */
 	struct data_vio *agent;
 
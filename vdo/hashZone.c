@@ -21,7 +21,11 @@
 
 #include "hashZone.h"
 
+#include <linux/cache.h>
+#include <linux/kobject.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
+#include <linux/slab.h>
 
 #include "logger.h"
 #include "memoryAlloc.h"
@@ -32,7 +36,7 @@
 #include "dataVIO.h"
 #include "hashLock.h"
 #include "hashLockInternals.h"
-#include "pointerMap.h"
+#include "histogram.h"
 #include "statistics.h"
 #include "threadConfig.h"
 #include "types.h"
@@ -40,8 +44,86 @@
 
 enum {
 	LOCK_POOL_CAPACITY = MAXIMUM_VDO_USER_VIOS,
+	/**
+	 * The number of hash locks preallocated for each zone. A zone which
+	 * has all of them in use grows its pool from a slab cache, up to
+	 * LOCK_POOL_CAPACITY.
+	 **/
+	LOCK_POOL_RESERVE = LOCK_POOL_CAPACITY / 8,
+	/** The number of hash locks which fit in a lock table bucket */
+	LOCK_TABLE_BUCKET_SLOTS = 10,
+	/**
+	 * The number of buckets in each zone's lock table (a power of 2),
+	 * chosen so that even with every lock in use, buckets are well under
+	 * half full on average.
+	 **/
+	LOCK_TABLE_BUCKETS = 512,
+	/** The number of entries in each zone's advice cache (a power of 2) */
+	ADVICE_CACHE_CAPACITY = 4096,
+	/** The number of latency histogram buckets (up to 10^7 microseconds) */
+	STAGE_HISTOGRAM_LOG_SIZE = 7,
 };
 
+/**
+ * The sysfs names and labels of the per-zone dedupe stage latency
+ * histograms, indexed by hash_zone_stage.
+ **/
+static const struct {
+	const char *name;
+	const char *label;
+} STAGE_HISTOGRAMS[HASH_ZONE_STAGE_COUNT] = {
+	[HASH_ZONE_QUERY_STAGE] = {
+		.name = "query_latency",
+		.label = "Dedupe Query Latency",
+	},
+	[HASH_ZONE_PBN_LOCK_STAGE] = {
+		.name = "pbn_lock_latency",
+		.label = "Duplicate PBN Lock Latency",
+	},
+	[HASH_ZONE_VERIFY_STAGE] = {
+		.name = "verify_latency",
+		.label = "Dedupe Verify Latency",
+	},
+	[HASH_ZONE_LOCK_WAIT_STAGE] = {
+		.name = "lock_wait_latency",
+		.label = "Hash Lock Wait Latency",
+	},
+};
+
+/**
+ * An entry in the advice cache, remembering where the data with a given
+ * chunk name was most recently known to be.
+ **/
+struct cached_advice {
+	/** The chunk name of the cached block */
+	struct uds_chunk_name hash;
+	/** The last known location of the block */
+	struct zoned_pbn location;
+	/** Whether this entry holds advice */
+	bool valid;
+};
+
+/**
+ * A bucket of the hash lock table, sized to fill one cache line. Each slot
+ * holds a fragment of the chunk name of a lock (its tag) and the index of
+ * the lock in the zone's lock array, biased by one so that zero marks an
+ * empty slot. A lock's full chunk name is only compared when its tag
+ * matches, so a lookup usually touches one line of the table and, if the
+ * lock is there, the lock itself.
+ **/
+struct lock_table_bucket {
+	/** The tags of the locks in the bucket */
+	uint32_t tags[LOCK_TABLE_BUCKET_SLOTS];
+	/** The biased lock array indexes of the locks in the bucket */
+	uint16_t locks[LOCK_TABLE_BUCKET_SLOTS];
+	/**
+	 * The number of locks stored in later buckets because this one was
+	 * full when they were added, so that a lookup which misses here may
+	 * stop if it is zero
+	 **/
+	uint16_t overflow;
+} __aligned(L1_CACHE_BYTES);
+
 struct hash_zone {
 	/** Which hash zone this is */
 	zone_count_t zone_number;
@@ -50,42 +132,256 @@ struct hash_zone {
 	thread_id_t thread_id;
 
 	/** Mapping from chunk_name fields to hash_locks */
-	struct pointer_map *hash_lock_map;
+	struct lock_table_bucket *lock_table;
 
-	/** List containing all unused hash_locks */
+	/** The number of hash_locks in the lock table */
+	vio_count_t lock_table_size;
+
+	/** List containing all unused reserved hash_locks */
 	struct list_head lock_pool;
 
+	/** List containing all unused hash_locks taken from the slab cache */
+	struct list_head grown_lock_pool;
+
+	/** The number of hash_locks currently borrowed from the pools */
+	vio_count_t borrowed;
+
 	/**
 	 * Statistics shared by all hash locks in this zone. Only modified on
 	 * the hash zone thread, but queried by other threads.
 	 **/
 	struct hash_lock_statistics statistics;
 
-	/** Array of all hash_locks */
+	/** Array of the reserved hash_locks */
 	struct hash_lock *lock_array;
+
+	/**
+	 * The hash_locks taken from the slab cache, indexed by pool index
+	 * less LOCK_POOL_RESERVE, with NULL marking unused indexes
+	 **/
+	struct hash_lock **grown_locks;
+
+	/**
+	 * A direct-mapped cache of recent advice, consulted before querying
+	 * UDS so that hot duplicates don't need a trip to the index.
+	 **/
+	struct cached_advice *advice_cache;
+
+	/** The sysfs directory holding the zone's histograms */
+	struct kobject *directory;
+
+	/** The latency histograms of the dedupe stages, by hash_zone_stage */
+	struct histogram *stage_histograms[HASH_ZONE_STAGE_COUNT];
 };
 
-/**
- * Implements pointer_key_comparator.
- **/
-static bool compare_keys(const void *this_key, const void *that_key)
+/** The slab cache from which all hash zones grow their lock pools */
+static struct kmem_cache *hash_lock_cache;
+
+/**********************************************************************/
+int make_hash_lock_cache(void)
 {
-	// Null keys are not supported.
-	return (memcmp(this_key, that_key, sizeof(struct uds_chunk_name)) == 0);
+	hash_lock_cache = kmem_cache_create("vdo_hash_lock",
+					    sizeof(struct hash_lock),
+					    0, 0, NULL);
+	return ((hash_lock_cache == NULL) ? -ENOMEM : VDO_SUCCESS);
+}
+
+/**********************************************************************/
+void free_hash_lock_cache(void)
+{
+	if (hash_lock_cache != NULL) {
+		kmem_cache_destroy(hash_lock_cache);
+		hash_lock_cache = NULL;
+	}
 }
 
 /**
- * Implements pointer_key_comparator.
+ * Get the lock table tag for a chunk name.
+ *
+ * @param hash  The chunk name
+ *
+ * @return The tag stored with the lock for the chunk name
  **/
-static uint32_t hash_key(const void *key)
+static inline uint32_t get_lock_tag(const struct uds_chunk_name *hash)
 {
-	const struct uds_chunk_name *name = key;
 	/*
-	 * Use a fragment of the chunk name as a hash code. It must not overlap
-	 * with fragments used elsewhere to ensure uniform distributions.
+	 * Use fragments of the chunk name for the tag and the bucket. They
+	 * must not overlap with fragments used elsewhere to ensure uniform
+	 * distributions.
 	 */
-	// XXX pick an offset in the chunk name that isn't used elsewhere
-	return get_unaligned_le32(&name->name[4]);
+	return get_unaligned_le32(&hash->name[4]);
+}
+
+/**
+ * Get the first lock table bucket to search for a chunk name.
+ *
+ * @param hash  The chunk name
+ *
+ * @return The index of the bucket
+ **/
+static inline unsigned int get_home_bucket(const struct uds_chunk_name *hash)
+{
+	return (get_unaligned_le32(&hash->name[8]) & (LOCK_TABLE_BUCKETS - 1));
+}
+
+/**
+ * Get the lock held in a lock table slot.
+ *
+ * @param zone    The zone
+ * @param bucket  The bucket
+ * @param slot    The slot in the bucket, which must not be empty
+ *
+ * @return The lock in the slot
+ **/
+static inline struct hash_lock *
+get_table_lock(struct hash_zone *zone,
+	       const struct lock_table_bucket *bucket,
+	       unsigned int slot)
+{
+	vio_count_t index = bucket->locks[slot] - 1;
+
+	return ((index < LOCK_POOL_RESERVE)
+		? &zone->lock_array[index]
+		: zone->grown_locks[index - LOCK_POOL_RESERVE]);
+}
+
+/**
+ * Find the lock table slot holding the lock for a chunk name.
+ *
+ * @param [in]  zone        The zone
+ * @param [in]  hash        The chunk name
+ * @param [out] bucket_ptr  The index of the bucket holding the lock
+ * @param [out] slot_ptr    The slot holding the lock
+ *
+ * @return <code>true</code> if the table holds a lock for the chunk name
+ **/
+static bool find_lock_slot(struct hash_zone *zone,
+			   const struct uds_chunk_name *hash,
+			   unsigned int *bucket_ptr,
+			   unsigned int *slot_ptr)
+{
+	uint32_t tag = get_lock_tag(hash);
+	unsigned int index = get_home_bucket(hash);
+	unsigned int probes;
+
+	for (probes = 0; probes < LOCK_TABLE_BUCKETS; probes++) {
+		struct lock_table_bucket *bucket = &zone->lock_table[index];
+		unsigned int slot;
+
+		for (slot = 0; slot < LOCK_TABLE_BUCKET_SLOTS; slot++) {
+			if ((bucket->locks[slot] == 0) ||
+			    (bucket->tags[slot] != tag)) {
+				continue;
+			}
+
+			if (memcmp(&get_table_lock(zone, bucket, slot)->hash,
+				   hash, sizeof(*hash)) == 0) {
+				*bucket_ptr = index;
+				*slot_ptr = slot;
+				return true;
+			}
+		}
+
+		if (bucket->overflow == 0) {
+			return false;
+		}
+
+		index = (index + 1) & (LOCK_TABLE_BUCKETS - 1);
+	}
+
+	return false;
+}
+
+/**
+ * Add a lock to the lock table. The table must not already hold a lock for
+ * the same chunk name. The table can hold every lock in the pool, so this
+ * can not fail.
+ *
+ * @param zone  The zone
+ * @param lock  The lock to add, whose hash has been set
+ **/
+static void add_lock_to_table(struct hash_zone *zone, struct hash_lock *lock)
+{
+	unsigned int index = get_home_bucket(&lock->hash);
+
+	for (;;) {
+		struct lock_table_bucket *bucket = &zone->lock_table[index];
+		unsigned int slot;
+
+		for (slot = 0; slot < LOCK_TABLE_BUCKET_SLOTS; slot++) {
+			if (bucket->locks[slot] == 0) {
+				bucket->tags[slot] = get_lock_tag(&lock->hash);
+				bucket->locks[slot] = lock->pool_index + 1;
+				zone->lock_table_size++;
+				return;
+			}
+		}
+
+		bucket->overflow++;
+		index = (index + 1) & (LOCK_TABLE_BUCKETS - 1);
+	}
+}
+
+/**
+ * Remove a lock from the lock table.
+ *
+ * @param zone        The zone
+ * @param hash        The chunk name of the lock
+ * @param end_bucket  The index of the bucket holding the lock
+ * @param slot        The slot holding the lock
+ **/
+static void remove_lock_from_table(struct hash_zone *zone,
+				   const struct uds_chunk_name *hash,
+				   unsigned int end_bucket,
+				   unsigned int slot)
+{
+	unsigned int index;
+
+	// Every bucket the lock was pushed past counted it as overflow.
+	for (index = get_home_bucket(hash); index != end_bucket;
+	     index = (index + 1) & (LOCK_TABLE_BUCKETS - 1)) {
+		zone->lock_table[index].overflow--;
+	}
+
+	zone->lock_table[end_bucket].locks[slot] = 0;
+	zone->lock_table_size--;
+}
+
+/**
+ * Create the sysfs directory of a hash zone and the latency histograms of
+ * the dedupe stages within it.
+ *
+ * @param vdo   The vdo to which the zone belongs
+ * @param zone  The zone
+ *
+ * @return VDO_SUCCESS or an error code
+ **/
+static int make_stage_histograms(struct vdo *vdo, struct hash_zone *zone)
+{
+	enum hash_zone_stage stage;
+	char name[16];
+
+	snprintf(name, sizeof(name), "hash_zone%u", zone->zone_number);
+	zone->directory = kobject_create_and_add(name, &vdo->vdo_directory);
+	if (zone->directory == NULL) {
+		return -ENOMEM;
+	}
+
+	for (stage = 0; stage < HASH_ZONE_STAGE_COUNT; stage++) {
+		zone->stage_histograms[stage] =
+			make_logarithmic_histogram(zone->directory,
+						   STAGE_HISTOGRAMS[stage].name,
+						   STAGE_HISTOGRAMS[stage].label,
+						   "data_vios",
+						   "latency",
+						   "microseconds",
+						   STAGE_HISTOGRAM_LOG_SIZE);
+		if (zone->stage_histograms[stage] == NULL) {
+			return -ENOMEM;
+		}
+	}
+
+	return VDO_SUCCESS;
 }
 
 /**********************************************************************/
@@ -99,8 +395,10 @@ int make_vdo_hash_zone(struct vdo *vdo, zone_count_t zone_number,
 		return result;
 	}
 
-	result = make_pointer_map(VDO_LOCK_MAP_CAPACITY, 0, compare_keys,
-				  hash_key, &zone->hash_lock_map);
+	STATIC_ASSERT(LOCK_POOL_CAPACITY < U16_MAX);
+	result = ALLOCATE_TAGGED(LOCK_TABLE_BUCKETS, struct lock_table_bucket,
+				 MEMORY_TAG_HASH_LOCKS, "hash lock table",
+				 &zone->lock_table);
 	if (result != VDO_SUCCESS) {
 		free_vdo_hash_zone(&zone);
 		return result;
@@ -110,20 +408,44 @@ int make_vdo_hash_zone(struct vdo *vdo, zone_count_t zone_number,
 	zone->thread_id = get_hash_zone_thread(get_thread_config(vdo),
 					       zone_number);
 	INIT_LIST_HEAD(&zone->lock_pool);
+	INIT_LIST_HEAD(&zone->grown_lock_pool);
 
-	result = ALLOCATE(LOCK_POOL_CAPACITY, struct hash_lock,
-			  "hash_lock array", &zone->lock_array);
+	result = ALLOCATE_TAGGED(LOCK_POOL_RESERVE, struct hash_lock,
+				 MEMORY_TAG_HASH_LOCKS, "hash_lock array",
+				 &zone->lock_array);
 	if (result != VDO_SUCCESS) {
 		free_vdo_hash_zone(&zone);
 		return result;
 	}
 
-	for (i = 0; i < LOCK_POOL_CAPACITY; i++) {
+	result = ALLOCATE_TAGGED(LOCK_POOL_CAPACITY - LOCK_POOL_RESERVE,
+				 struct hash_lock *, MEMORY_TAG_HASH_LOCKS,
+				 "grown hash_locks", &zone->grown_locks);
+	if (result != VDO_SUCCESS) {
+		free_vdo_hash_zone(&zone);
+		return result;
+	}
+
+	for (i = 0; i < LOCK_POOL_RESERVE; i++) {
 		struct hash_lock *lock = &zone->lock_array[i];
 		initialize_hash_lock(lock);
+		lock->pool_index = i;
 		list_add_tail(&lock->pool_node, &zone->lock_pool);
 	}
 
+	result = ALLOCATE(ADVICE_CACHE_CAPACITY, struct cached_advice,
+			  "hash zone advice cache", &zone->advice_cache);
+	if (result != VDO_SUCCESS) {
+		free_vdo_hash_zone(&zone);
+		return result;
+	}
+
+	result = make_stage_histograms(vdo, zone);
+	if (result != VDO_SUCCESS) {
+		free_vdo_hash_zone(&zone);
+		return result;
+	}
+
 	*zone_ptr = zone;
 	return VDO_SUCCESS;
 }
@@ -131,14 +453,40 @@ int make_vdo_hash_zone(struct vdo *vdo, zone_count_t zone_number,
 /**********************************************************************/
 void free_vdo_hash_zone(struct hash_zone **zone_ptr)
 {
+	enum hash_zone_stage stage;
 	struct hash_zone *zone;
 	if (*zone_ptr == NULL) {
 		return;
 	}
 
 	zone = *zone_ptr;
-	free_pointer_map(&zone->hash_lock_map);
-	FREE(zone->lock_array);
+	for (stage = 0; stage < HASH_ZONE_STAGE_COUNT; stage++) {
+		free_histogram(&zone->stage_histograms[stage]);
+	}
+
+	if (zone->directory != NULL) {
+		kobject_put(zone->directory);
+	}
+
+	if (zone->grown_locks != NULL) {
+		int64_t lock_bytes = sizeof(struct hash_lock);
+		vio_count_t i;
+
+		for (i = 0; i < LOCK_POOL_CAPACITY - LOCK_POOL_RESERVE; i++) {
+			if (zone->grown_locks[i] != NULL) {
+				kmem_cache_free(hash_lock_cache,
+						zone->grown_locks[i]);
+				adjust_tagged_memory_bytes(MEMORY_TAG_HASH_LOCKS,
+							   -lock_bytes);
+			}
+		}
+
+		FREE_TAGGED(zone->grown_locks, MEMORY_TAG_HASH_LOCKS);
+	}
+
+	FREE_TAGGED(zone->lock_table, MEMORY_TAG_HASH_LOCKS);
+	FREE_TAGGED(zone->lock_array, MEMORY_TAG_HASH_LOCKS);
+	FREE(zone->advice_cache);
 	FREE(zone);
 	*zone_ptr = NULL;
 }
@@ -169,9 +517,65 @@ get_vdo_hash_zone_statistics(const struct hash_zone *zone)
 			READ_ONCE(stats->concurrent_data_matches),
 		.concurrent_hash_collisions =
 			READ_ONCE(stats->concurrent_hash_collisions),
+		.cached_advice_hits = READ_ONCE(stats->cached_advice_hits),
+		.cached_advice_misses = READ_ONCE(stats->cached_advice_misses),
+		.cached_advice_stale = READ_ONCE(stats->cached_advice_stale),
+		.lock_pool_exhaustions =
+			READ_ONCE(stats->lock_pool_exhaustions),
 	};
 }
 
+/**
+ * Allocate a hash lock from the slab cache and give it an unused index in the
+ * zone's pool. This runs on the zone thread, so it must not sleep.
+ *
+ * @param zone  The zone whose pool is growing
+ *
+ * @return The new lock, or NULL if the pool is at capacity or memory is short
+ **/
+static struct hash_lock *grow_hash_lock_pool(struct hash_zone *zone)
+{
+	struct hash_lock *lock;
+	vio_count_t slot;
+
+	for (slot = 0; slot < LOCK_POOL_CAPACITY - LOCK_POOL_RESERVE; slot++) {
+		if (zone->grown_locks[slot] == NULL) {
+			break;
+		}
+	}
+
+	if (slot == LOCK_POOL_CAPACITY - LOCK_POOL_RESERVE) {
+		return NULL;
+	}
+
+	lock = kmem_cache_zalloc(hash_lock_cache, GFP_NOWAIT | __GFP_NOWARN);
+	if (lock == NULL) {
+		return NULL;
+	}
+
+	adjust_tagged_memory_bytes(MEMORY_TAG_HASH_LOCKS,
+				   sizeof(struct hash_lock));
+	initialize_hash_lock(lock);
+	lock->pool_index = LOCK_POOL_RESERVE + slot;
+	zone->grown_locks[slot] = lock;
+	return lock;
+}
+
+/**
+ * Give a hash lock taken from the slab cache back to it.
+ *
+ * @param zone  The zone whose pool grew the lock
+ * @param lock  The lock, which must not be in use or on a pool list
+ **/
+static void shrink_hash_lock_pool(struct hash_zone *zone,
+				  struct hash_lock *lock)
+{
+	zone->grown_locks[lock->pool_index - LOCK_POOL_RESERVE] = NULL;
+	kmem_cache_free(hash_lock_cache, lock);
+	adjust_tagged_memory_bytes(MEMORY_TAG_HASH_LOCKS,
+				   -((int64_t) sizeof(struct hash_lock)));
+}
+
 /**
  * Return a hash lock to the zone's pool and null out the reference to it.
  *
@@ -182,11 +586,70 @@ static void return_hash_lock_to_pool(struct hash_zone *zone,
 				     struct hash_lock **lock_ptr)
 {
 	struct hash_lock *lock = *lock_ptr;
+	vio_count_t index = lock->pool_index;
+	bool idling;
 	*lock_ptr = NULL;
 
 	memset(lock, 0, sizeof(*lock));
 	initialize_hash_lock(lock);
+	lock->pool_index = index;
+
+	zone->borrowed--;
+	idling = (zone->borrowed < LOCK_POOL_RESERVE / 2);
+	if (index >= LOCK_POOL_RESERVE) {
+		if (idling) {
+			shrink_hash_lock_pool(zone, lock);
+			return;
+		}
+
+		list_add_tail(&lock->pool_node, &zone->grown_lock_pool);
+		return;
+	}
+
 	list_add_tail(&lock->pool_node, &zone->lock_pool);
+
+	// Shed one grown lock for each reserved lock returned while idle.
+	if (idling && !list_empty(&zone->grown_lock_pool)) {
+		struct hash_lock *grown =
+			list_first_entry(&zone->grown_lock_pool,
+					 struct hash_lock, pool_node);
+		list_del_init(&grown->pool_node);
+		shrink_hash_lock_pool(zone, grown);
+	}
+}
+
+/**
+ * Take a hash lock from the zone's pools, growing them from the slab cache
+ * if every lock is in use.
+ *
+ * @param zone  The zone from which to borrow
+ *
+ * @return The lock, or NULL if the pool is at capacity or memory is short
+ **/
+static struct hash_lock *borrow_hash_lock_from_pool(struct hash_zone *zone)
+{
+	struct list_head *pool = &zone->lock_pool;
+	struct hash_lock *lock;
+
+	if (list_empty(pool)) {
+		pool = &zone->grown_lock_pool;
+	}
+
+	if (!list_empty(pool)) {
+		lock = list_entry(pool->prev, struct hash_lock, pool_node);
+		list_del_init(&lock->pool_node);
+		zone->borrowed++;
+		return lock;
+	}
+
+	WRITE_ONCE(zone->statistics.lock_pool_exhaustions,
+		   zone->statistics.lock_pool_exhaustions + 1);
+	lock = grow_hash_lock_pool(zone);
+	if (lock != NULL) {
+		zone->borrowed++;
+	}
+
+	return lock;
 }
 
 /**********************************************************************/
@@ -195,28 +658,21 @@ int acquire_lock_from_vdo_hash_zone(struct hash_zone *zone,
 				    struct hash_lock *replace_lock,
 				    struct hash_lock **lock_ptr)
 {
-	struct hash_lock *lock, *new_lock;
+	struct hash_lock *lock = NULL, *new_lock = NULL;
+	unsigned int bucket, slot;
+	bool found = find_lock_slot(zone, hash, &bucket, &slot);
 
-	// Borrow and prepare a lock from the pool so we don't have to do two
-	// pointer_map accesses in the common case of no lock contention.
-	int result = ASSERT(!list_empty(&zone->lock_pool),
-			    "never need to wait for a free hash lock");
-	if (result != VDO_SUCCESS) {
-		return result;
+	if (found) {
+		lock = get_table_lock(zone, &zone->lock_table[bucket], slot);
 	}
-	new_lock = list_entry(zone->lock_pool.prev, struct hash_lock,
-			      pool_node);
-	list_del_init(&new_lock->pool_node);
-
-	// Fill in the hash of the new lock so we can map it, since we have to
-	// use the hash as the map key.
-	new_lock->hash = *hash;
 
-	result = pointer_map_put(zone->hash_lock_map, &new_lock->hash, new_lock,
-				 (replace_lock != NULL), (void **) &lock);
-	if (result != VDO_SUCCESS) {
-		return_hash_lock_to_pool(zone, &new_lock);
-		return result;
+	// Take the new lock before changing the old one, so that failing to
+	// get one leaves the old lock as it was.
+	if (lock == replace_lock) {
+		new_lock = borrow_hash_lock_from_pool(zone);
+		if (new_lock == NULL) {
+			return VDO_LOCK_ERROR;
+		}
 	}
 
 	if (replace_lock != NULL) {
@@ -231,12 +687,17 @@ int acquire_lock_from_vdo_hash_zone(struct hash_zone *zone,
 	}
 
 	if (lock == replace_lock) {
+		new_lock->hash = *hash;
+		if (found) {
+			// The tag is unchanged, since the hash is the same.
+			zone->lock_table[bucket].locks[slot]
+				= new_lock->pool_index + 1;
+		} else {
+			add_lock_to_table(zone, new_lock);
+		}
+
 		lock = new_lock;
 		lock->registered = true;
-	} else {
-		// There's already a lock for the hash, so we don't need the
-		// borrowed lock.
-		return_hash_lock_to_pool(zone, &new_lock);
 	}
 
 	*lock_ptr = lock;
@@ -248,16 +709,22 @@ void return_lock_to_vdo_hash_zone(struct hash_zone *zone,
 				  struct hash_lock **lock_ptr)
 {
 	struct hash_lock *lock = *lock_ptr;
+	unsigned int bucket, slot;
+	bool found = find_lock_slot(zone, &lock->hash, &bucket, &slot);
+	struct hash_lock *mapped
+		= (found ? get_table_lock(zone, &zone->lock_table[bucket], slot)
+			 : NULL);
 	*lock_ptr = NULL;
 
 	if (lock->registered) {
-		struct hash_lock *removed =
-			pointer_map_remove(zone->hash_lock_map, &lock->hash);
-		ASSERT_LOG_ONLY(lock == removed,
+		ASSERT_LOG_ONLY(lock == mapped,
 				"hash lock being released must have been mapped");
+		if (lock == mapped) {
+			remove_lock_from_table(zone, &lock->hash, bucket,
+					       slot);
+		}
 	} else {
-		ASSERT_LOG_ONLY(lock != pointer_map_get(zone->hash_lock_map,
-							&lock->hash),
+		ASSERT_LOG_ONLY(lock != mapped,
 				"unregistered hash lock must not be in the lock map");
 	}
 
@@ -276,6 +743,40 @@ void return_lock_to_vdo_hash_zone(struct hash_zone *zone,
 	return_hash_lock_to_pool(zone, &lock);
 }
 
+/**
+ * Find the advice cache slot for a hash.
+ *
+ * @param zone  The zone responsible for the hash
+ * @param hash  The hash
+ *
+ * @return The only cache entry which may hold advice for the hash
+ **/
+static struct cached_advice *
+get_advice_cache_slot(struct hash_zone *zone,
+		      const struct uds_chunk_name *hash)
+{
+	// Use a fragment of the chunk name which doesn't overlap the one used
+	// by the lock map, so the two don't correlate.
+	uint32_t index = get_unaligned_le32(&hash->name[12]);
+
+	return &zone->advice_cache[index & (ADVICE_CACHE_CAPACITY - 1)];
+}
+
+/**
+ * Check whether an advice cache entry holds advice for a hash.
+ *
+ * @param entry  The cache entry
+ * @param hash   The hash
+ *
+ * @return <code>true</code> if the entry is valid and for the hash
+ **/
+static bool is_cached_advice_for(const struct cached_advice *entry,
+				 const struct uds_chunk_name *hash)
+{
+	return (entry->valid &&
+		(memcmp(&entry->hash, hash, sizeof(*hash)) == 0));
+}
+
 /**
  * Dump a compact description of hash_lock to the log if the lock is not on the
  * free list.
@@ -338,18 +839,79 @@ void bump_vdo_hash_zone_collision_count(struct hash_zone *zone)
 	increment_stat(&zone->statistics.concurrent_hash_collisions);
 }
 
+/**********************************************************************/
+bool get_vdo_hash_zone_cached_advice(struct hash_zone *zone,
+				     const struct uds_chunk_name *hash,
+				     struct zoned_pbn *advice_ptr)
+{
+	struct cached_advice *entry = get_advice_cache_slot(zone, hash);
+
+	if (!is_cached_advice_for(entry, hash)) {
+		increment_stat(&zone->statistics.cached_advice_misses);
+		return false;
+	}
+
+	increment_stat(&zone->statistics.cached_advice_hits);
+	*advice_ptr = entry->location;
+	return true;
+}
+
+/**********************************************************************/
+void cache_vdo_hash_zone_advice(struct hash_zone *zone,
+				const struct uds_chunk_name *hash,
+				const struct zoned_pbn *advice)
+{
+	struct cached_advice *entry;
+
+	if (advice->pbn == VDO_ZERO_BLOCK) {
+		return;
+	}
+
+	entry = get_advice_cache_slot(zone, hash);
+	entry->hash = *hash;
+	entry->location = *advice;
+	entry->valid = true;
+}
+
+/**********************************************************************/
+void discard_vdo_hash_zone_cached_advice(struct hash_zone *zone,
+					 const struct uds_chunk_name *hash)
+{
+	struct cached_advice *entry = get_advice_cache_slot(zone, hash);
+
+	increment_stat(&zone->statistics.cached_advice_stale);
+	if (is_cached_advice_for(entry, hash)) {
+		entry->valid = false;
+	}
+}
+
+/**********************************************************************/
+void record_vdo_hash_zone_latency(struct hash_zone *zone,
+				  enum hash_zone_stage stage,
+				  uint64_t start_time)
+{
+	enter_histogram_sample(zone->stage_histograms[stage],
+			       (ktime_get_ns() - start_time) / NSEC_PER_USEC);
+}
+
 /**********************************************************************/
 void dump_vdo_hash_zone(const struct hash_zone *zone)
 {
 	vio_count_t i;
-	if (zone->hash_lock_map == NULL) {
+	if (zone->lock_table == NULL) {
 		log_info("struct hash_zone %u: NULL map", zone->zone_number);
 		return;
 	}
 
-	log_info("struct hash_zone %u: mapSize=%zu", zone->zone_number,
-		 pointer_map_size(zone->hash_lock_map));
-	for (i = 0; i < LOCK_POOL_CAPACITY; i++) {
+	log_info("struct hash_zone %u: mapSize=%u", zone->zone_number,
+		 (unsigned int) zone->lock_table_size);
+	for (i = 0; i < LOCK_POOL_RESERVE; i++) {
 		dump_hash_lock(&zone->lock_array[i]);
 	}
+
+	for (i = 0; i < LOCK_POOL_CAPACITY - LOCK_POOL_RESERVE; i++) {
+		if (zone->grown_locks[i] != NULL) {
+			dump_hash_lock(zone->grown_locks[i]);
+		}
+	}
 }
@@ -27,6 +27,36 @@
 #include "statistics.h"
 #include "types.h"
 
+/**
+ * The stages of deduplication whose latencies are recorded in per-zone
+ * histograms.
+ **/
+enum hash_zone_stage {
+	/** The UDS query made by the agent of a new hash lock */
+	HASH_ZONE_QUERY_STAGE,
+	/** Acquiring the PBN read lock on a candidate duplicate */
+	HASH_ZONE_PBN_LOCK_STAGE,
+	/** Reading and comparing a candidate duplicate */
+	HASH_ZONE_VERIFY_STAGE,
+	/** Waiting on a hash lock for its agent */
+	HASH_ZONE_LOCK_WAIT_STAGE,
+	HASH_ZONE_STAGE_COUNT,
+};
+
+/**
+ * Create the slab cache from which hash zones grow their lock pools. This
+ * must be called once, when the module is loaded, before any zone is made.
+ *
+ * @return VDO_SUCCESS or an error code
+ **/
+int __must_check make_hash_lock_cache(void);
+
+/**
+ * Destroy the slab cache from which hash zones grow their lock pools, once
+ * all zones have been freed.
+ **/
+void free_hash_lock_cache(void);
+
 /**
  * Create a hash zone.
  *
@@ -89,7 +119,8 @@ get_vdo_hash_zone_statistics(const struct hash_zone *zone);
  *                            hash which should be replaced by the new lock
  * @param [out] lock_ptr      A pointer to receive the hash lock
  *
- * @return VDO_SUCCESS or an error code
+ * @return VDO_SUCCESS, VDO_LOCK_ERROR if a new lock was needed but the zone's
+ *         lock pool could not supply one, or another error code
  **/
 int __must_check
 acquire_lock_from_vdo_hash_zone(struct hash_zone *zone,
@@ -109,6 +140,46 @@ acquire_lock_from_vdo_hash_zone(struct hash_zone *zone,
 void return_lock_to_vdo_hash_zone(struct hash_zone *zone,
 				  struct hash_lock **lock_ptr);
 
+/**
+ * Look up a hash in the zone's advice cache of recently verified or written
+ * blocks. A hit or miss is counted in the zone statistics. This must only be
+ * called in the correct thread for the zone.
+ *
+ * @param [in]  zone        The zone responsible for the hash
+ * @param [in]  hash        The hash to look up
+ * @param [out] advice_ptr  A pointer to receive the cached location on a hit
+ *
+ * @return <code>true</code> if the cache held advice for the hash
+ **/
+bool __must_check
+get_vdo_hash_zone_cached_advice(struct hash_zone *zone,
+				const struct uds_chunk_name *hash,
+				struct zoned_pbn *advice_ptr);
+
+/**
+ * Record the location of a block as cached advice for its hash, replacing
+ * whatever entry previously occupied its cache slot. This must only be called
+ * in the correct thread for the zone.
+ *
+ * @param zone    The zone responsible for the hash
+ * @param hash    The hash of the block
+ * @param advice  The verified location of the block
+ **/
+void cache_vdo_hash_zone_advice(struct hash_zone *zone,
+				const struct uds_chunk_name *hash,
+				const struct zoned_pbn *advice);
+
+/**
+ * Drop cached advice for a hash which has proven to be stale, and count it in
+ * the zone statistics. This must only be called in the correct thread for the
+ * zone.
+ *
+ * @param zone  The zone responsible for the hash
+ * @param hash  The hash whose cached advice was stale
+ **/
+void discard_vdo_hash_zone_cached_advice(struct hash_zone *zone,
+					 const struct uds_chunk_name *hash);
+
 /**
  * Increment the valid advice count in the hash zone statistics.
  * Must only be called from the hash zone thread.
@@ -141,6 +212,19 @@ void bump_vdo_hash_zone_data_match_count(struct hash_zone *zone);
  **/
 void bump_vdo_hash_zone_collision_count(struct hash_zone *zone);
 
+/**
+ * Record the latency of a deduplication stage in the hash zone's histogram
+ * for that stage. Must only be called from the hash zone thread.
+ *
+ * @param zone        The hash zone of the lock whose data_vio finished the
+ *                    stage
+ * @param stage       The stage which finished
+ * @param start_time  The time (from ktime_get_ns()) at which the stage began
+ **/
+void record_vdo_hash_zone_latency(struct hash_zone *zone,
+				  enum hash_zone_stage stage,
+				  uint64_t start_time);
+
 /**
  * Dump information about a hash zone to the log for debugging.
  *
@@ -63,6 +63,7 @@ enum component_id {
 	SLAB_DEPOT = 3,
 	BLOCK_MAP = 4,
 	GEOMETRY_BLOCK = 5,
+	BLOCK_MAP_HOT_SET = 6,
 };
 
 /**
@@ -501,6 +501,61 @@ static ssize_t histogram_show_mean(struct histogram *h, char *buf)
 		       mean_times1000 % 1000);
 }
 
+/***********************************************************************/
+static uint64_t bucket_upper_bound(struct histogram *h, int bucket)
+{
+	if (bucket == h->num_buckets) {
+		// The "bigger" bucket is bounded only by the largest sample.
+		return (h->conversion_factor * atomic64_read(&h->maximum));
+	}
+
+	if (h->log_flag) {
+		return (h->conversion_factor * bottom_value[bucket + 1] - 1);
+	}
+
+	return (h->conversion_factor * bucket);
+}
+
+/***********************************************************************/
+static ssize_t histogram_show_percentiles(struct histogram *h, char *buf)
+{
+	// Percentiles are in tenths of a percent, to allow for the 99.9th.
+	static const unsigned int percentiles[] = { 500, 900, 990, 999 };
+	uint64_t total = 0;
+	uint64_t seen = 0;
+	ssize_t length = 0;
+	int max = max_bucket(h);
+	int bucket = 0;
+	unsigned int p;
+	int i;
+
+	for (i = 0; i <= max; i++) {
+		total += atomic64_read(&h->counters[i]);
+	}
+
+	for (p = 0; p < ARRAY_SIZE(percentiles); p++) {
+		// The rank of the sample at this percentile, counting from 1.
+		uint64_t rank = DIV_ROUND_UP(total * percentiles[p], 1000);
+		uint64_t value = 0;
+
+		if (total > 0) {
+			while ((bucket < max) &&
+			       ((seen + atomic64_read(&h->counters[bucket]))
+				< rank)) {
+				seen += atomic64_read(&h->counters[bucket]);
+				bucket++;
+			}
+			value = bucket_upper_bound(h, bucket);
+		}
+
+		length += scnprintf(buf + length, PAGE_SIZE - length,
+				    "%u.%u%% : %llu\n", percentiles[p] / 10,
+				    percentiles[p] % 10, value);
+	}
+
+	return length;
+}
+
 /***********************************************************************/
 static ssize_t histogram_show_unacceptable(struct histogram *h, char *buf)
 {
@@ -590,6 +645,14 @@ static struct histogram_attribute mean_attribute = {
 	.show = histogram_show_mean,
 };
 
+static struct histogram_attribute percentiles_attribute = {
+	.attr = {
+			.name = "percentiles",
+			.mode = 0444,
+		},
+	.show = histogram_show_percentiles,
+};
+
 static struct histogram_attribute unacceptable_attribute = {
 	.attr = {
 			.name = "unacceptable",
@@ -615,6 +678,7 @@ static struct attribute *histogram_attributes[] = {
 	&maximum_attribute.attr,
 	&mean_attribute.attr,
 	&minimum_attribute.attr,
+	&percentiles_attribute.attr,
 	&unacceptable_attribute.attr,
 	&unit_attribute.attr,
 	NULL,
@@ -868,6 +932,17 @@ void enter_histogram_sample(struct histogram *h, uint64_t sample)
 	}
 }
 
+/***********************************************************************/
+void get_histogram_totals(struct histogram *h,
+			  uint64_t *count,
+			  uint64_t *sum)
+{
+	// A sample entered concurrently may be reflected in only one of the
+	// two, which is harmless when computing a mean over many samples.
+	*count = atomic64_read(&h->count);
+	*sum = atomic64_read(&h->sum);
+}
+
 /***********************************************************************/
 void free_histogram(struct histogram **hp)
 {
@@ -122,6 +122,17 @@ struct histogram *make_logarithmic_jiffies_histogram(struct kobject *parent,
  **/
 void enter_histogram_sample(struct histogram *h, uint64_t sample);
 
+/**
+ * Get the number and the sum of the samples entered into a histogram.
+ *
+ * @param [in]  h      The histogram
+ * @param [out] count  A pointer to hold the number of samples
+ * @param [out] sum    A pointer to hold the sum of the samples
+ **/
+void get_histogram_totals(struct histogram *h,
+			  uint64_t *count,
+			  uint64_t *sum);
+
 /**
  * Free a histogram and null out the reference to it.
  *
@@ -20,48 +20,24 @@
  */
 
 /**
- * Hash table implementation of a map from integers to pointers, implemented
- * using the Hopscotch Hashing algorithm by Herlihy, Shavit, and Tzafrir (see
- * http://en.wikipedia.org/wiki/Hopscotch_hashing). This implementation does
- * not contain any of the locking/concurrency features of the algorithm, just
- * the collision resolution scheme.
+ * Hash table implementation of a map from integers to pointers. The table is
+ * an array of groups of GROUP_SLOTS slots each. A group holds a one-byte tag
+ * for each of its slots, taken from the hash of the key in the slot, with
+ * zero marking an empty slot. The keys and values themselves are kept in
+ * separate arrays indexed by slot. A group is 16 bytes, and the array of
+ * groups is aligned, so all the tags of a group share one cache line. The
+ * tags are compared against the tag of a search key two words at a time,
+ * rather than one slot at a time, and only the slots whose tags match need
+ * their keys examined, so a lookup usually touches the group, one key, and
+ * one value.
  *
- * Hopscotch Hashing is based on hashing with open addressing and linear
- * probing. All the entries are stored in a fixed array of buckets, with no
- * dynamic allocation for collisions. Unlike linear probing, all the entries
- * that hash to a given bucket are stored within a fixed neighborhood starting
- * at that bucket. Chaining is effectively represented as a bit vector
- * relative to each bucket instead of as pointers or explicit offsets.
- *
- * When an empty bucket cannot be found within a given neighborhood,
- * subsequent neighborhoods are searched, and one or more entries will "hop"
- * into those neighborhoods. When this process works, an empty bucket will
- * move into the desired neighborhood, allowing the entry to be added. When
- * that process fails (typically when the buckets are around 90% full), the
- * table must be resized and the all entries rehashed and added to the
- * expanded table.
- *
- * Unlike linear probing, the number of buckets that must be searched in the
- * worst case has a fixed upper bound (the size of the neighborhood). Those
- * entries occupy a small number of memory cache lines, leading to improved
- * use of the cache (fewer misses on both successful and unsuccessful
- * searches). Hopscotch hashing outperforms linear probing at much higher load
- * factors, so even with the increased memory burden for maintaining the hop
- * vectors, less memory is needed to achieve that performance. Hopscotch is
- * also immune to "contamination" from deleting entries since entries are
- * genuinely removed instead of being replaced by a placeholder.
- *
- * The published description of the algorithm used a bit vector, but the paper
- * alludes to an offset scheme which is used by this implementation. Since the
- * entries in the neighborhood are within N entries of the hash bucket at the
- * start of the neighborhood, a pair of small offset fields each log2(N) bits
- * wide is all that's needed to maintain the hops as a linked list. In order
- * to encode "no next hop" (i.e. NULL) as the natural initial value of zero,
- * the offsets are biased by one (i.e. 0 => NULL, 1 => offset=0, 2 =>
- * offset=1, etc.) We can represent neighborhoods of up to 255 entries with
- * just 8+8=16 bits per entry. The hop list is sorted by hop offset so the
- * first entry in the list is always the bucket closest to the start of the
- * neighborhood.
+ * A new entry is stored in the first group with a free slot, starting from
+ * the group selected by the hash of its key (its home group) and probing
+ * linearly. Each group counts the entries which were pushed past it because
+ * it was full when they were added. A search which does not find its key in
+ * a group may stop if that count is zero, and removing an entry decrements
+ * the counts of the groups it was pushed past, so removals leave no
+ * tombstones behind to contaminate the table.
  *
  * While individual accesses tend to be very fast, the table resize operations
  * are very very expensive. If an upper bound on the latency of adding an
@@ -72,48 +48,42 @@
 
 #include "intMap.h"
 
+#include <linux/bitops.h>
+#include <linux/log2.h>
+
 #include "errors.h"
 #include "logger.h"
 #include "memoryAlloc.h"
 #include "numeric.h"
-#include "permassert.h"
 
 enum {
-	DEFAULT_CAPACITY = 16, // the number of neighborhoods in a new table
-	NEIGHBORHOOD = 255,    // the number of buckets in each neighborhood
-	MAX_PROBES = 1024,     // limit on the number of probes for a free bucket
-	NULL_HOP_OFFSET = 0,   // the hop offset value terminating the hop list
-	DEFAULT_LOAD = 75      // a compromise between memory use and performance
+	DEFAULT_CAPACITY = 16, // the number of entries in a new table
+	GROUP_SLOTS = 12,      // the number of slots in each group
+	MINIMUM_GROUPS = 4,    // the fewest groups, filling one cache line
+	EMPTY_TAG = 0,         // the tag value marking an empty slot
+	DEFAULT_LOAD = 75,     // balances memory use against performance
+	MAXIMUM_LOAD = 90      // the fullest the table gets before it grows
 };
 
 /**
- * Buckets are packed together to reduce memory usage and improve cache
- * efficiency. It would be tempting to encode the hop offsets separately and
- * maintain alignment of key/value pairs, but it's crucial to keep the hop
- * fields near the buckets that they use them so they'll tend to share cache
- * lines.
+ * A group of slots. The tags and the overflow count together fill exactly
+ * two little-endian words, so the tags can be matched a word at a time.
  **/
-struct __packed bucket {
-	uint8_t first_hop; // the biased offset of the first entry in the hop
-			   // list of the neighborhood that hashes to this bucket
-	uint8_t next_hop;  // the biased offset of the next bucket in the
-			   // hop list
-
-	uint64_t key;	   // the key stored in this bucket
-	void *value;	   // the value stored in this bucket (NULL if empty)
-};
+struct group {
+	uint8_t tags[GROUP_SLOTS]; // the slot tags (EMPTY_TAG if free)
+	uint32_t overflow;         // the count of entries pushed past
+} __aligned(16);
 
 /**
- * The concrete definition of the opaque int_map type. To avoid having to wrap
- * the neighborhoods of the last entries back around to the start of the
- * bucket array, we allocate a few more buckets at the end of the array
- * instead, which is why capacity and bucket_count are different.
+ * The concrete definition of the opaque int_map type.
  **/
 struct int_map {
-	size_t size;		 // the number of entries stored in the map
-	size_t capacity;	 // the number of neighborhoods in the map
-	size_t bucket_count;     // the number of buckets in the bucket array
-	struct bucket *buckets;  // the array of hash buckets
+	size_t size;             // the number of entries stored in the map
+	size_t group_count;      // the number of groups (a power of two)
+	size_t limit;            // the number of entries at which to grow
+	struct group *groups;    // the array of groups
+	uint64_t *keys;          // the keys, indexed by slot
+	void **values;           // the values, indexed by slot (NULL if empty)
 };
 
 /**
@@ -158,24 +128,123 @@ static uint64_t hash_key(uint64_t key)
 	return mix(sizeof(key) + (((uint64_t) pun.u32[0]) << 3), pun.u32[1]);
 }
 
+/**
+ * Get the tag stored for a key. The home group is chosen by the low bits of
+ * the hash, so the tag is taken from the high bits.
+ *
+ * @param hash  the hash of the key
+ *
+ * @return the tag, which is never EMPTY_TAG
+ **/
+static inline uint8_t get_tag(uint64_t hash)
+{
+	uint8_t tag = hash >> 56;
+
+	return ((tag == EMPTY_TAG) ? 1 : tag);
+}
+
+/**
+ * Find the bytes of a word which equal a given byte, without any false
+ * matches.
+ *
+ * @param word  the word to search
+ * @param byte  the byte to look for
+ *
+ * @return the word with the high bit of each matching byte set, and all
+ *         other bits clear
+ **/
+static inline uint64_t match_bytes(uint64_t word, uint8_t byte)
+{
+	static const uint64_t LOW_BITS = 0x7f7f7f7f7f7f7f7fULL;
+	uint64_t x = word ^ (0x0101010101010101ULL * byte);
+
+	return ~(((x & LOW_BITS) + LOW_BITS) | x | LOW_BITS);
+}
+
+/**
+ * Gather the high bit of each byte of a word into a byte.
+ *
+ * @param bits  a word with no bits set other than the high bit of each byte
+ *
+ * @return a byte with bit n set if the high bit of byte n was set
+ **/
+static inline unsigned int gather_high_bits(uint64_t bits)
+{
+	return ((bits >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+/**
+ * Find the slots of a group whose tags equal a given tag.
+ *
+ * @param group  the group to search
+ * @param tag    the tag to look for
+ *
+ * @return a mask with bit n set if slot n of the group has the tag
+ **/
+static inline unsigned int match_group(const struct group *group,
+				       uint8_t tag)
+{
+	uint64_t low_word = get_unaligned_le64(&group->tags[0]);
+	uint64_t high_word = get_unaligned_le64(&group->tags[8]);
+	unsigned int low = gather_high_bits(match_bytes(low_word, tag));
+	unsigned int high = gather_high_bits(match_bytes(high_word, tag));
+
+	// Drop the bytes of the overflow count.
+	return (low | (high << 8)) & ((1U << GROUP_SLOTS) - 1);
+}
+
 /**
  * Initialize an int_map.
  *
  * @param map       the map to initialize
- * @param capacity  the initial capacity of the map
+ * @param capacity  the number of entries the map must hold without growing
+ * @param load      the load factor at which to size the map
  *
  * @return UDS_SUCCESS or an error code
  **/
-static int allocate_buckets(struct int_map *map, size_t capacity)
+static int allocate_groups(struct int_map *map, size_t capacity,
+			   unsigned int load)
 {
+	size_t slots;
+	int result;
+
 	map->size = 0;
-	map->capacity = capacity;
+	map->group_count =
+		roundup_pow_of_two(max_t(size_t, MINIMUM_GROUPS,
+					 DIV_ROUND_UP(capacity * 100 / load,
+						      GROUP_SLOTS)));
+	slots = map->group_count * GROUP_SLOTS;
+	map->limit = clamp_t(size_t, slots * MAXIMUM_LOAD / 100, capacity,
+			     slots);
+
+	// A power-of-two count of 16-byte groups is naturally aligned.
+	result = ALLOCATE(map->group_count, struct group,
+			  "struct int_map groups", &map->groups);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	result = ALLOCATE(slots, uint64_t, "struct int_map keys", &map->keys);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
 
-	// Allocate NEIGHBORHOOD - 1 extra buckets so the last bucket can have a
-	// full neighborhood without have to wrap back around to element zero.
-	map->bucket_count = capacity + (NEIGHBORHOOD - 1);
-	return ALLOCATE(map->bucket_count, struct bucket,
-			"struct int_map buckets", &map->buckets);
+	return ALLOCATE(slots, void *, "struct int_map values", &map->values);
+}
+
+/**
+ * Free the arrays of the map.
+ *
+ * @param map  the map whose arrays are to be freed
+ **/
+static void free_groups(struct int_map *map)
+{
+	FREE(map->groups);
+	map->groups = NULL;
+	FREE(map->keys);
+	map->keys = NULL;
+	FREE(map->values);
+	map->values = NULL;
 }
 
 /**********************************************************************/
@@ -202,11 +271,7 @@ int make_int_map(size_t initial_capacity, unsigned int initial_load,
 	// Use the default capacity if the caller did not specify one.
 	capacity = (initial_capacity > 0) ? initial_capacity : DEFAULT_CAPACITY;
 
-	// Scale up the capacity by the specified initial load factor.
-	// (i.e to hold 1000 entries at 80% load we need a capacity of 1250)
-	capacity = capacity * 100 / initial_load;
-
-	result = allocate_buckets(map, capacity);
+	result = allocate_groups(map, capacity, initial_load);
 	if (result != UDS_SUCCESS) {
 		free_int_map(&map);
 		return result;
@@ -216,22 +281,11 @@ int make_int_map(size_t initial_capacity, unsigned int initial_load,
 	return UDS_SUCCESS;
 }
 
-/**
- * Free the bucket array for the map.
- *
- * @param map  the map whose bucket array is to be freed
- **/
-static void free_buckets(struct int_map *map)
-{
-	FREE(map->buckets);
-	map->buckets = NULL;
-}
-
 /**********************************************************************/
 void free_int_map(struct int_map **map_ptr)
 {
 	if (*map_ptr != NULL) {
-		free_buckets(*map_ptr);
+		free_groups(*map_ptr);
 		FREE(*map_ptr);
 		*map_ptr = NULL;
 	}
@@ -244,403 +298,169 @@ size_t int_map_size(const struct int_map *map)
 }
 
 /**
- * Convert a biased hop offset within a neighborhood to a pointer to the
- * bucket it references.
+ * Search the map for the slot holding a key.
  *
- * @param neighborhood   the first bucket in the neighborhood
- * @param hop_offset     the biased hop offset to the desired bucket
+ * @param [in]  map       the map to search
+ * @param [in]  key       the mapping key
+ * @param [in]  hash      the hash of the key
+ * @param [out] slot_ptr  a pointer to hold the slot holding the key
  *
- * @return <code>NULL</code> if hop_offset is zero, otherwise a pointer to
- *         the bucket in the neighborhood at <code>hop_offset - 1</code>
+ * @return <code>true</code> if the key was found
  **/
-static struct bucket *dereference_hop(struct bucket *neighborhood,
-				      unsigned int hop_offset)
+static bool find_slot(const struct int_map *map, uint64_t key,
+		      uint64_t hash, size_t *slot_ptr)
 {
-	if (hop_offset == NULL_HOP_OFFSET) {
-		return NULL;
-	}
+	uint8_t tag = get_tag(hash);
+	size_t mask = map->group_count - 1;
+	size_t index = hash & mask;
+	size_t probes;
 
-	STATIC_ASSERT(NULL_HOP_OFFSET == 0);
-	return &neighborhood[hop_offset - 1];
-}
+	for (probes = 0; probes < map->group_count; probes++) {
+		const struct group *group = &map->groups[index];
+		unsigned int matches = match_group(group, tag);
 
-/**
- * Add a bucket into the hop list for the neighborhood, inserting it into the
- * list so the hop list remains sorted by hop offset.
- *
- * @param neighborhood   the first bucket in the neighborhood
- * @param new_bucket     the bucket to add to the hop list
- **/
-static void insert_in_hop_list(struct bucket *neighborhood,
-			       struct bucket *new_bucket)
-{
-	// Zero indicates a NULL hop offset, so bias the hop offset by one.
-	int hop_offset = 1 + (new_bucket - neighborhood);
-
-	// Handle the special case of adding a bucket at the start of the list.
-	int next_hop = neighborhood->first_hop;
-	if ((next_hop == NULL_HOP_OFFSET) || (next_hop > hop_offset)) {
-		new_bucket->next_hop = next_hop;
-		neighborhood->first_hop = hop_offset;
-		return;
-	}
+		while (matches != 0) {
+			size_t slot = index * GROUP_SLOTS + __ffs(matches);
 
-	// Search the hop list for the insertion point that maintains the sort
-	// order.
-	for (;;) {
-		struct bucket *bucket = dereference_hop(neighborhood, next_hop);
-		next_hop = bucket->next_hop;
+			if (map->keys[slot] == key) {
+				*slot_ptr = slot;
+				return true;
+			}
 
-		if ((next_hop == NULL_HOP_OFFSET) || (next_hop > hop_offset)) {
-			new_bucket->next_hop = next_hop;
-			bucket->next_hop = hop_offset;
-			return;
+			matches &= matches - 1;
+		}
+
+		// No entry for the key was pushed past this group.
+		if (group->overflow == 0) {
+			return false;
 		}
+
+		index = (index + 1) & mask;
 	}
+
+	return false;
 }
 
-/**
- * Select and return the hash bucket for a given search key.
- *
- * @param map  the map to search
- * @param key  the mapping key
- **/
-static struct bucket *select_bucket(const struct int_map *map, uint64_t key)
+/**********************************************************************/
+void *int_map_get(struct int_map *map, uint64_t key)
 {
-	// Calculate a good hash value for the provided key. We want exactly 32
-	// bits, so mask the result.
-	uint64_t hash = hash_key(key) & 0xFFFFFFFF;
+	size_t slot;
 
-	/*
-	 * Scale the 32-bit hash to a bucket index by treating it as a binary
-	 * fraction and multiplying that by the capacity. If the hash is
-	 * uniformly distributed over [0 .. 2^32-1], then (hash * capacity /
-	 * 2^32) should be uniformly distributed over [0 .. capacity-1]. The
-	 * multiply and shift is much faster than a divide (modulus) on X86
-	 * CPUs.
-	 */
-	return &map->buckets[(hash * map->capacity) >> 32];
+	return (find_slot(map, key, hash_key(key), &slot)
+		? map->values[slot] : NULL);
 }
 
 /**
- * Search the hop list associated with given hash bucket for a given search
- * key. If the key is found, returns a pointer to the entry (bucket or
- * collision), otherwise returns <code>NULL</code>.
- *
- * @param [in]  map           the map being searched
- * @param [in]  bucket        the map bucket to search for the key
- * @param [in]  key           the mapping key
- * @param [out] previous_ptr  if not <code>NULL</code>, a pointer in which to
- *                            store the bucket in the list preceding the one
- *                            that had the matching key
+ * Add an entry for a key which is not in the map. The map must have room for
+ * the entry.
  *
- * @return an entry that matches the key, or <code>NULL</code> if not found
+ * @param map    the map
+ * @param key    the key of the new entry
+ * @param hash   the hash of the key
+ * @param value  the value of the new entry
  **/
-static struct bucket *
-search_hop_list(struct int_map *map __attribute__((unused)),
-		struct bucket *bucket, uint64_t key,
-		struct bucket **previous_ptr)
+static void add_entry(struct int_map *map, uint64_t key, uint64_t hash,
+		      void *value)
 {
-	struct bucket *previous = NULL;
-	unsigned int next_hop = bucket->first_hop;
-	while (next_hop != NULL_HOP_OFFSET) {
-		// Check the neighboring bucket indexed by the offset for the
-		// desired key.
-		struct bucket *entry = dereference_hop(bucket, next_hop);
-		if ((key == entry->key) && (entry->value != NULL)) {
-			if (previous_ptr != NULL) {
-				*previous_ptr = previous;
-			}
-			return entry;
+	size_t mask = map->group_count - 1;
+	size_t index = hash & mask;
+
+	for (;;) {
+		struct group *group = &map->groups[index];
+		unsigned int empty = match_group(group, EMPTY_TAG);
+
+		if (empty != 0) {
+			unsigned int offset = __ffs(empty);
+			size_t slot = index * GROUP_SLOTS + offset;
+
+			group->tags[offset] = get_tag(hash);
+			map->keys[slot] = key;
+			map->values[slot] = value;
+			map->size += 1;
+			return;
 		}
-		next_hop = entry->next_hop;
-		previous = entry;
-	}
-	return NULL;
-}
 
-/**********************************************************************/
-void *int_map_get(struct int_map *map, uint64_t key)
-{
-	struct bucket *match =
-		search_hop_list(map, select_bucket(map, key), key, NULL);
-	return ((match != NULL) ? match->value : NULL);
+		group->overflow += 1;
+		index = (index + 1) & mask;
+	}
 }
 
 /**
- * Increase the number of hash buckets and rehash all the existing entries,
- * storing them in the new buckets.
+ * Double the number of groups and rehash all the existing entries, storing
+ * them in the new groups.
  *
  * @param map  the map to resize
  **/
-static int resize_buckets(struct int_map *map)
+static int resize_groups(struct int_map *map)
 {
 	int result;
 	size_t i;
 
 	// Copy the top-level map data to the stack.
 	struct int_map old_map = *map;
+	size_t old_slots = old_map.group_count * GROUP_SLOTS;
 
-	// Re-initialize the map to be empty and 50% larger.
-	size_t new_capacity = map->capacity / 2 * 3;
+	// Re-initialize the map to be empty and twice as large.
 	log_info("%s: attempting resize from %zu to %zu, current size=%zu",
-		 __func__, map->capacity, new_capacity, map->size);
-	result = allocate_buckets(map, new_capacity);
+		 __func__, old_slots, 2 * old_slots, map->size);
+	result = allocate_groups(map, map->limit * 2, MAXIMUM_LOAD);
 	if (result != UDS_SUCCESS) {
+		free_groups(map);
 		*map = old_map;
 		return result;
 	}
 
-	// Populate the new hash table from the entries in the old bucket array.
-	for (i = 0; i < old_map.bucket_count; i++) {
-		struct bucket *entry = &old_map.buckets[i];
-		if (entry->value == NULL) {
-			continue;
-		}
+	// Populate the new table from the entries in the old one.
+	for (i = 0; i < old_slots; i++) {
+		uint64_t key = old_map.keys[i];
 
-		result = int_map_put(map, entry->key, entry->value, true, NULL);
-		if (result != UDS_SUCCESS) {
-			// Destroy the new partial map and restore the map from
-			// the stack.
-			free_buckets(map);
-			*map = old_map;
-			return result;
+		if (old_map.values[i] != NULL) {
+			add_entry(map, key, hash_key(key), old_map.values[i]);
 		}
 	}
 
-	// Destroy the old bucket array.
-	free_buckets(&old_map);
+	// Destroy the old arrays.
+	free_groups(&old_map);
 	return UDS_SUCCESS;
 }
 
-/**
- * Probe the bucket array starting at the given bucket for the next empty
- * bucket, returning a pointer to it. <code>NULL</code> will be returned if
- * the search reaches the end of the bucket array or if the number of linear
- * probes exceeds a specified limit.
- *
- * @param map         the map containing the buckets to search
- * @param bucket      the bucket at which to start probing
- * @param max_probes  the maximum number of buckets to search
- *
- * @return the next empty bucket, or <code>NULL</code> if the search failed
- **/
-static struct bucket *find_empty_bucket(struct int_map *map,
-					struct bucket *bucket,
-					unsigned int max_probes)
-{
-	// Limit the search to either the nearer of the end of the bucket array
-	// or a fixed distance beyond the initial bucket.
-	ptrdiff_t remaining = &map->buckets[map->bucket_count] - bucket;
-	struct bucket *sentinel =
-		&bucket[min(remaining, (ptrdiff_t) max_probes)];
-
-	struct bucket *entry;
-	for (entry = bucket; entry < sentinel; entry++) {
-		if (entry->value == NULL) {
-			return entry;
-		}
-	}
-	return NULL;
-}
-
-/**
- * Move an empty bucket closer to the start of the bucket array. This searches
- * the neighborhoods that contain the empty bucket for a non-empty bucket
- * closer to the start of the array. If such a bucket is found, this swaps the
- * two buckets by moving the entry to the empty bucket.
- *
- * @param map   the map containing the bucket
- * @param hole  the empty bucket to fill with an entry that precedes it in one
- *              of its enclosing neighborhoods
- *
- * @return the bucket that was vacated by moving its entry to the provided
- *         hole, or <code>NULL</code> if no entry could be moved
- **/
-static struct bucket *
-move_empty_bucket(struct int_map *map __attribute__((unused)),
-		  struct bucket *hole)
-{
-	/*
-	 * Examine every neighborhood that the empty bucket is part of, starting
-	 * with the one in which it is the last bucket. No boundary check is
-	 * needed for the negative array arithmetic since this function is only
-	 * called when hole is at least NEIGHBORHOOD cells deeper into the array
-	 * than a valid bucket.
-	 */
-	struct bucket *bucket;
-	for (bucket = &hole[1 - NEIGHBORHOOD]; bucket < hole; bucket++) {
-		// Find the entry that is nearest to the bucket, which means it
-		// will be nearest to the hash bucket whose neighborhood is
-		// full.
-		struct bucket *new_hole =
-			dereference_hop(bucket, bucket->first_hop);
-		if (new_hole == NULL) {
-			// There are no buckets in this neighborhood that are in
-			// use by this one (they must all be owned by
-			// overlapping neighborhoods).
-			continue;
-		}
-
-		// Skip this bucket if its first entry is actually further away
-		// than the hole that we're already trying to fill.
-		if (hole < new_hole) {
-			continue;
-		}
-
-		/*
-		 * We've found an entry in this neighborhood that we can "hop"
-		 * further away, moving the hole closer to the hash bucket, if
-		 * not all the way into its neighborhood.
-		 */
-
-		// The entry that will be the new hole is the first bucket in
-		// the list, so setting first_hop is all that's needed remove it
-		// from the list.
-		bucket->first_hop = new_hole->next_hop;
-		new_hole->next_hop = NULL_HOP_OFFSET;
-
-		// Move the entry into the original hole.
-		hole->key = new_hole->key;
-		hole->value = new_hole->value;
-		new_hole->value = NULL;
-
-		// Insert the filled hole into the hop list for the
-		// neighborhood.
-		insert_in_hop_list(bucket, hole);
-		return new_hole;
-	}
-
-	// We couldn't find an entry to relocate to the hole.
-	return NULL;
-}
-
-/**
- * Find and update any existing mapping for a given key, returning the value
- * associated with the key in the provided pointer.
- *
- * @param [in]  map            the int_map to attempt to modify
- * @param [in]  neighborhood   the first bucket in the neighborhood that
- *                             would contain the search key
- * @param [in]  key            the key with which to associate the new value
- * @param [in]  new_value      the value to be associated with the key
- * @param [in]  update          whether to overwrite an existing value
- * @param [out] old_value_ptr   a pointer in which to store the old value
- *                              (unmodified if no mapping was found)
- *
- * @return <code>true</code> if the map contains a mapping for the key
- *         <code>false</code> if it does not
- **/
-static bool update_mapping(struct int_map *map, struct bucket *neighborhood,
-			   uint64_t key, void *new_value, bool update,
-			   void **old_value_ptr)
-{
-	struct bucket *bucket = search_hop_list(map, neighborhood, key, NULL);
-	if (bucket == NULL) {
-		// There is no bucket containing the key in the neighborhood.
-		return false;
-	}
-
-	// Return the value of the current mapping (if desired) and update the
-	// mapping with the new value (if desired).
-	if (old_value_ptr != NULL) {
-		*old_value_ptr = bucket->value;
-	}
-	if (update) {
-		bucket->value = new_value;
-	}
-	return true;
-}
-
-/**
- * Find an empty bucket in a specified neighborhood for a new mapping or
- * attempt to re-arrange mappings so there is such a bucket. This operation
- * may fail (returning NULL) if an empty bucket is not available or could not
- * be relocated to the neighborhood.
- *
- * @param map           the int_map to search or modify
- * @param neighborhood  the first bucket in the neighborhood in which
- *                      an empty bucket is needed for a new mapping
- *
- * @return a pointer to an empty bucket in the desired neighborhood, or
- *         <code>NULL</code> if a vacancy could not be found or arranged
- **/
-static struct bucket *find_or_make_vacancy(struct int_map *map,
-					   struct bucket *neighborhood)
-{
-	// Probe within and beyond the neighborhood for the first empty bucket.
-	struct bucket *hole = find_empty_bucket(map, neighborhood, MAX_PROBES);
-
-	// Keep trying until the empty bucket is in the bucket's neighborhood or
-	// we are unable to move it any closer by swapping it with a filled
-	// bucket.
-	while (hole != NULL) {
-		int distance = hole - neighborhood;
-		if (distance < NEIGHBORHOOD) {
-			// We've found or relocated an empty bucket close enough
-			// to the initial hash bucket to be referenced by its
-			// hop vector.
-			return hole;
-		}
-
-		// The nearest empty bucket isn't within the neighborhood that
-		// must contain the new entry, so try to swap it with bucket
-		// that is closer.
-		hole = move_empty_bucket(map, hole);
-	}
-
-	return NULL;
-}
-
 /**********************************************************************/
 int int_map_put(struct int_map *map, uint64_t key, void *new_value, bool update,
 		void **old_value_ptr)
 {
-	struct bucket *neighborhood, *bucket;
+	uint64_t hash;
+	size_t slot;
+
 	if (new_value == NULL) {
 		return UDS_INVALID_ARGUMENT;
 	}
 
-	// Select the bucket at the start of the neighborhood that must contain
-	// any entry for the provided key.
-	neighborhood = select_bucket(map, key);
-
-	// Check whether the neighborhood already contains an entry for the key,
-	// in which case we optionally update it, returning the old value.
-	if (update_mapping(map, neighborhood, key, new_value, update,
-			  old_value_ptr)) {
+	// Check whether the map already contains an entry for the key, in
+	// which case we optionally update it, returning the old value.
+	hash = hash_key(key);
+	if (find_slot(map, key, hash, &slot)) {
+		if (old_value_ptr != NULL) {
+			*old_value_ptr = map->values[slot];
+		}
+		if (update) {
+			map->values[slot] = new_value;
+		}
 		return UDS_SUCCESS;
 	}
 
 	/*
-	 * Find an empty bucket in the desired neighborhood for the new entry or
-	 * re-arrange entries in the map so there is such a bucket. This
-	 * operation will usually succeed; the loop body will only be executed
-	 * on the rare occasions that we have to resize the map.
+	 * If the map is as full as it should get, we're forced to allocate
+	 * larger arrays, re-hash all the entries into them, and try again (a
+	 * very expensive operation for large maps).
 	 */
-	while ((bucket = find_or_make_vacancy(map, neighborhood)) == NULL) {
-		/*
-		 * There is no empty bucket in which to put the new entry in the
-		 * current map, so we're forced to allocate a new bucket array
-		 * with a larger capacity, re-hash all the entries into those
-		 * buckets, and try again (a very expensive operation for large
-		 * maps).
-		 */
-		int result = resize_buckets(map);
+	if (map->size >= map->limit) {
+		int result = resize_groups(map);
 		if (result != UDS_SUCCESS) {
 			return result;
 		}
-
-		// Resizing the map invalidates all pointers to buckets, so
-		// recalculate the neighborhood pointer.
-		neighborhood = select_bucket(map, key);
 	}
 
-	// Put the new entry in the empty bucket, adding it to the neighborhood.
-	bucket->key = key;
-	bucket->value = new_value;
-	insert_in_hop_list(neighborhood, bucket);
-	map->size += 1;
+	add_entry(map, key, hash, new_value);
 
 	// There was no existing entry, so there was no old value to be
 	// returned.
@@ -653,34 +473,29 @@ int int_map_put(struct int_map *map, uint64_t key, void *new_value, bool update,
 /**********************************************************************/
 void *int_map_remove(struct int_map *map, uint64_t key)
 {
+	uint64_t hash = hash_key(key);
+	size_t mask = map->group_count - 1;
+	size_t index, slot, end;
 	void *value;
 
-	// Select the bucket to search and search it for an existing entry.
-	struct bucket *bucket = select_bucket(map, key);
-	struct bucket *previous;
-	struct bucket *victim = search_hop_list(map, bucket, key, &previous);
-
-	if (victim == NULL) {
+	if (!find_slot(map, key, hash, &slot)) {
 		// There is no matching entry to remove.
 		return NULL;
 	}
 
 	// We found an entry to remove. Save the mapped value to return later
-	// and empty the bucket.
+	// and empty the slot.
 	map->size -= 1;
-	value = victim->value;
-	victim->value = NULL;
-	victim->key = 0;
-
-	// The victim bucket is now empty, but it still needs to be spliced out
-	// of the hop list.
-	if (previous == NULL) {
-		// The victim is the head of the list, so swing first_hop.
-		bucket->first_hop = victim->next_hop;
-	} else {
-		previous->next_hop = victim->next_hop;
+	value = map->values[slot];
+	map->values[slot] = NULL;
+	map->keys[slot] = 0;
+	end = slot / GROUP_SLOTS;
+	map->groups[end].tags[slot % GROUP_SLOTS] = EMPTY_TAG;
+
+	// Every group the entry was pushed past counted it as overflow.
+	for (index = hash & mask; index != end; index = (index + 1) & mask) {
+		map->groups[index].overflow -= 1;
 	}
-	victim->next_hop = NULL_HOP_OFFSET;
 
 	return value;
 }
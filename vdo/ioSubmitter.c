@@ -21,6 +21,8 @@
 
 #include "ioSubmitter.h"
 
+#include <linux/blk-mq.h>
+#include <linux/cpumask.h>
 #include <linux/version.h>
 
 #include "memoryAlloc.h"
@@ -30,13 +32,31 @@
 #include "dataKVIO.h"
 #include "kernelLayer.h"
 #include "logger.h"
+#include "recoveryJournal.h"
+#include "vdoInternal.h"
+
+enum {
+	/** The most segments a bio combining adjacent bios may have */
+	MAX_MERGED_BIO_VECS = 128,
+};
+
+/*
+ * Polled completion relies on the cookies returned by bio submission to find
+ * the hardware queue to poll; newer kernels poll through the bio instead,
+ * which would require it to outlive its completion.
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,16,0)
+#define VDO_BIO_POLLING
+#endif
 
 /*
  * Submission of bio operations to the underlying storage device will
  * go through a separate work queue thread (or more than one) to
  * prevent blocking in other threads if the storage device has a full
  * queue. The plug structure allows that thread to do better batching
- * of requests to make the I/O more efficient.
+ * of requests to make the I/O more efficient. The plug is flushed each
+ * time the thread drains its queue, so that everything submitted in one
+ * pass reaches the device together.
  *
  * When multiple worker threads are used, a thread is chosen for a
  * I/O operation submission based on the PBN, so a given PBN will
@@ -45,7 +65,9 @@
  *
  * The map (protected by the mutex) collects pending I/O operations so
  * that the worker thread can reorder them to try to encourage I/O
- * request merging in the request queue underneath.
+ * request merging in the request queue underneath. Runs of adjacent data or
+ * block map bios collected this way are submitted as single multi-page
+ * bios, up to the maximum request size of the device.
  */
 struct bio_queue_data {
 	struct vdo_work_queue *queue;
@@ -53,12 +75,33 @@ struct bio_queue_data {
 	struct int_map *map;
 	struct mutex lock;
 	unsigned int queue_number;
+	/**
+	 * The CPUs served by the backing device hardware queues assigned to
+	 * this bio queue, if bio queues are mapped to hardware queues
+	 **/
+	cpumask_var_t cpus;
+	/** The number of bios submitted for polling which have not completed */
+	atomic_t polled_in_flight;
+	/** The request queue of the backing device, if it supports polling */
+	struct request_queue *poll_queue;
+	/**
+	 * The latest polling cookie submitted to each hardware queue of the
+	 * backing device, if it supports polling
+	 **/
+	blk_qc_t *poll_cookies;
+	unsigned int poll_cookie_count;
 };
 
 struct io_submitter {
+	/* For allocating the bios which combine runs of adjacent bios */
+	struct bio_set merged_bio_set;
 	unsigned int num_bio_queues_used;
+	/* The number of bio queues to which bios are distributed */
+	unsigned int active_bio_queues;
 	unsigned int bio_queue_rotation_interval;
 	unsigned int bio_queue_rotor;
+	/* Whether bio queues poll for the completion of their bios */
+	bool polling;
 	struct bio_queue_data bio_queue_data[];
 };
 
@@ -67,6 +110,18 @@ static void start_bio_queue(void *ptr)
 {
 	struct bio_queue_data *bio_queue_data = (struct bio_queue_data *) ptr;
 
+	// Submitting from these CPUs sends bios to our hardware queues.
+	if (cpumask_available(bio_queue_data->cpus) &&
+	    !cpumask_empty(bio_queue_data->cpus)) {
+		int result = set_cpus_allowed_ptr(current, bio_queue_data->cpus);
+
+		if (result != 0) {
+			uds_log_warning("cannot bind thread %s to its hardware queue CPUs: %d",
+					current->comm,
+					result);
+		}
+	}
+
 	blk_start_plug(&bio_queue_data->plug);
 }
 
@@ -78,9 +133,63 @@ static void finish_bio_queue(void *ptr)
 	blk_finish_plug(&bio_queue_data->plug);
 }
 
+/**********************************************************************/
+static void idle_bio_queue(void *ptr)
+{
+	struct bio_queue_data *bio_queue_data = (struct bio_queue_data *) ptr;
+
+	blk_finish_plug(&bio_queue_data->plug);
+	blk_start_plug(&bio_queue_data->plug);
+}
+
+#ifdef VDO_BIO_POLLING
+/**
+ * Poll the hardware queues to which a bio queue has submitted bios for
+ * polling. This is the poll hook of the bio queue type.
+ *
+ * @param ptr  The bio queue
+ *
+ * @return <code>true</code> if polled bios are still outstanding
+ **/
+static bool poll_bio_queue(void *ptr)
+{
+	struct bio_queue_data *bio_queue_data = (struct bio_queue_data *) ptr;
+	unsigned int i;
+
+	if (atomic_read(&bio_queue_data->polled_in_flight) == 0) {
+		return false;
+	}
+
+	// Bios held in the plug can not complete until they are issued.
+	idle_bio_queue(bio_queue_data);
+	for (i = 0; i < bio_queue_data->poll_cookie_count; i++) {
+		blk_qc_t cookie = bio_queue_data->poll_cookies[i];
+
+		if (blk_qc_t_valid(cookie)) {
+			blk_poll(bio_queue_data->poll_queue, cookie, false);
+		}
+	}
+
+	if (atomic_read(&bio_queue_data->polled_in_flight) > 0) {
+		return true;
+	}
+
+	for (i = 0; i < bio_queue_data->poll_cookie_count; i++) {
+		bio_queue_data->poll_cookies[i] = BLK_QC_T_NONE;
+	}
+
+	return false;
+}
+#endif // VDO_BIO_POLLING
+
 static const struct vdo_work_queue_type bio_queue_type = {
 	.start = start_bio_queue,
 	.finish = finish_bio_queue,
+	.idle = idle_bio_queue,
+#ifdef VDO_BIO_POLLING
+	.poll = poll_bio_queue,
+#endif
+	.thread_class = VDO_THREAD_CLASS_BIO,
 	.action_table = {
 
 			{ .name = "bio_compressed_data",
@@ -156,7 +265,7 @@ static unsigned int bio_queue_number_for_pbn(struct io_submitter *io_submitter,
 					     physical_block_number_t pbn)
 {
 	unsigned int bio_queue_index =
-		((pbn % (io_submitter->num_bio_queues_used *
+		((pbn % (READ_ONCE(io_submitter->active_bio_queues) *
 			 io_submitter->bio_queue_rotation_interval)) /
 		 io_submitter->bio_queue_rotation_interval);
 
@@ -213,14 +322,54 @@ static void count_all_bios(struct vio *vio, struct bio *bio)
 }
 
 /**
- * Update stats and tracing info, then submit the supplied bio to the
- * OS for processing.
+ * Check whether a bio is for a recovery journal block which lives on a
+ * separate journal device. Empty flushes from the journal are meant for the
+ * backing device and are not redirected.
+ *
+ * @param vio  The vio associated with the bio
+ * @param bio  The bio to check
+ *
+ * @return <code>true</code> if the bio belongs on the journal device
+ **/
+static bool is_journal_device_bio(struct vio *vio, struct bio *bio)
+{
+	return ((vio->type == VIO_TYPE_RECOVERY_JOURNAL) &&
+		bio_has_data(bio) &&
+		(get_vdo_journal_device(vio->vdo) != NULL));
+}
+
+/**
+ * Point a recovery journal bio at the journal device. The journal partition
+ * keeps its place in the layout of the backing device, but its blocks are
+ * stored from the start of the journal device.
+ *
+ * Journal writes are issued with FUA so that each one is durable when it
+ * completes. This keeps user flushes, which only go to the backing device,
+ * sufficient to make the journal durable.
+ *
+ * @param vio  The recovery journal vio
+ * @param bio  The bio to redirect
+ **/
+static void redirect_to_journal_device(struct vio *vio, struct bio *bio)
+{
+	physical_block_number_t origin =
+		get_recovery_journal_origin(vio->vdo->recovery_journal);
+
+	bio_set_dev(bio, get_vdo_journal_device(vio->vdo));
+	bio->bi_iter.bi_sector -= block_to_sector(origin);
+	if (bio_op(bio) == REQ_OP_WRITE) {
+		bio->bi_opf |= REQ_FUA;
+	}
+}
+
+/**
+ * Update stats and tracing info for a bio about to be sent to the OS, and
+ * point it at the backing device (or the journal device).
  *
  * @param vio       The vio associated with the bio
- * @param bio       The bio to submit to the OS
+ * @param bio       The bio to be submitted
  **/
-static void send_bio_to_device(struct vio *vio,
-			       struct bio *bio)
+static void prepare_bio_for_device(struct vio *vio, struct bio *bio)
 {
 	struct kernel_layer *layer = vdo_as_kernel_layer(vio->vdo);
 
@@ -228,7 +377,25 @@ static void send_bio_to_device(struct vio *vio,
 	atomic64_inc(&layer->bios_submitted);
 	count_all_bios(vio, bio);
 
+	if (is_journal_device_bio(vio, bio)) {
+		redirect_to_journal_device(vio, bio);
+		return;
+	}
+
+	if ((bio->bi_opf & REQ_PREFLUSH) != 0) {
+		vdo_note_flush_started(vio->vdo);
+	}
+
 	bio_set_dev(bio, get_vdo_backing_device(vio->vdo));
+}
+
+/**
+ * Submit a prepared bio to the OS for processing.
+ *
+ * @param bio  The bio to submit
+ **/
+static void submit_bio_to_device(struct bio *bio)
+{
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5,9,0)
 	generic_make_request(bio);
 #else
@@ -236,18 +403,334 @@ static void send_bio_to_device(struct vio *vio,
 #endif
 }
 
+#ifdef VDO_BIO_POLLING
+/**
+ * Restore and call the end_io of a bio which was submitted for polling. This
+ * is the bi_end_io of such bios.
+ *
+ * @param bio  The completed bio
+ **/
+static void complete_polled_bio(struct bio *bio)
+{
+	struct vio *vio = bio->bi_private;
+	struct bio_queue_data *poller = vio->poller;
+
+	vio->poller = NULL;
+	bio->bi_opf &= ~REQ_HIPRI;
+	bio->bi_end_io = vio->polled_end_io;
+	bio->bi_end_io(bio);
+	atomic_dec(&poller->polled_in_flight);
+}
+
+/**
+ * Check whether the current bio queue should poll for the completion of a
+ * bio. Only single block reads and writes to the backing device are polled;
+ * flushes and journal device I/O complete by interrupt as usual.
+ *
+ * @param bio_queue_data  The current bio queue
+ * @param vio             The vio associated with the bio
+ * @param bio             The prepared bio
+ *
+ * @return <code>true</code> if the bio should be polled
+ **/
+static bool should_poll_bio(struct bio_queue_data *bio_queue_data,
+			    struct vio *vio,
+			    struct bio *bio)
+{
+	struct io_submitter *submitter =
+		bio_queue_to_submitter(bio_queue_data);
+
+	return (READ_ONCE(submitter->polling) &&
+		(bio_queue_data->poll_cookies != NULL) &&
+		(bio->bi_private == vio) &&
+		((bio_op(bio) == REQ_OP_READ) ||
+		 (bio_op(bio) == REQ_OP_WRITE)) &&
+		((bio->bi_opf & REQ_PREFLUSH) == 0) &&
+		!is_journal_device_bio(vio, bio));
+}
+
+/**
+ * Submit a prepared bio for polling, and note the hardware queue it went to
+ * so that the current bio queue will poll that queue.
+ *
+ * @param bio_queue_data  The current bio queue
+ * @param vio             The vio associated with the bio
+ * @param bio             The bio to submit
+ **/
+static void submit_polled_bio(struct bio_queue_data *bio_queue_data,
+			      struct vio *vio,
+			      struct bio *bio)
+{
+	blk_qc_t cookie;
+	unsigned int queue_number;
+
+	vio->poller = bio_queue_data;
+	vio->polled_end_io = bio->bi_end_io;
+	bio->bi_end_io = complete_polled_bio;
+	bio->bi_opf |= REQ_HIPRI;
+	atomic_inc(&bio_queue_data->polled_in_flight);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,9,0)
+	cookie = generic_make_request(bio);
+#else
+	cookie = submit_bio_noacct(bio);
+#endif
+	if (!blk_qc_t_valid(cookie)) {
+		return;
+	}
+
+	queue_number = blk_qc_t_to_queue_num(cookie);
+	if (queue_number < bio_queue_data->poll_cookie_count) {
+		bio_queue_data->poll_cookies[queue_number] = cookie;
+	}
+}
+#endif // VDO_BIO_POLLING
+
+/**
+ * Submit a prepared bio of a vio to the OS, for polling if the current bio
+ * queue is polling for completions.
+ *
+ * @param vio  The vio associated with the bio
+ * @param bio  The bio to submit
+ **/
+static void submit_vio_bio(struct vio *vio, struct bio *bio)
+{
+#ifdef VDO_BIO_POLLING
+	struct bio_queue_data *bio_queue_data = get_current_bio_queue_data();
+
+	if (should_poll_bio(bio_queue_data, vio, bio)) {
+		submit_polled_bio(bio_queue_data, vio, bio);
+		return;
+	}
+#endif // VDO_BIO_POLLING
+
+	submit_bio_to_device(bio);
+}
+
+/**
+ * Submit a journal bio once the backing device flush which must precede it
+ * has completed. This is the bi_end_io for that flush.
+ *
+ * @param flush  The completed flush bio
+ **/
+static void submit_after_backing_flush(struct bio *flush)
+{
+	struct bio *bio = flush->bi_private;
+	blk_status_t status = flush->bi_status;
+
+	bio_put(flush);
+	if (status != BLK_STS_OK) {
+		bio->bi_status = status;
+		bio_endio(bio);
+		return;
+	}
+
+	vdo_note_flush_completed(((struct vio *) bio->bi_private)->vdo);
+
+	submit_bio_to_device(bio);
+}
+
+/**
+ * Flush the backing device before submitting a journal bio to the journal
+ * device. A journal preflush exists to make the data writes covered by the
+ * journal block durable, and those writes went to the backing device.
+ *
+ * @param vio  The recovery journal vio
+ * @param bio  The journal bio, already redirected to the journal device
+ **/
+static void flush_backing_device_before(struct vio *vio, struct bio *bio)
+{
+	struct bio *flush = bio_alloc(GFP_NOIO, 0);
+
+	bio->bi_opf &= ~REQ_PREFLUSH;
+	bio_set_dev(flush, get_vdo_backing_device(vio->vdo));
+	flush->bi_opf = REQ_OP_WRITE | REQ_PREFLUSH;
+	flush->bi_private = bio;
+	flush->bi_end_io = submit_after_backing_flush;
+	vdo_note_flush_started(vio->vdo);
+	submit_bio_to_device(flush);
+}
+
+/**
+ * Update stats and tracing info, then submit the supplied bio to the
+ * OS for processing.
+ *
+ * @param vio       The vio associated with the bio
+ * @param bio       The bio to submit to the OS
+ **/
+static void send_bio_to_device(struct vio *vio,
+			       struct bio *bio)
+{
+	prepare_bio_for_device(vio, bio);
+	if (is_journal_device_bio(vio, bio) &&
+	    ((bio->bi_opf & REQ_PREFLUSH) != 0)) {
+		flush_backing_device_before(vio, bio);
+		return;
+	}
+
+	submit_vio_bio(vio, bio);
+}
+
 /**********************************************************************/
 static sector_t get_bio_sector(struct bio *bio)
 {
 	return bio->bi_iter.bi_sector;
 }
 
+/**
+ * Complete each of the bios combined into a merged bio.
+ *
+ * @param merged  The merged bio, whose private field is the list of the bios
+ *                it was made from
+ **/
+static void complete_merged_bio(struct bio *merged)
+{
+	struct bio *bio = merged->bi_private;
+	blk_status_t status = merged->bi_status;
+
+	bio_put(merged);
+	while (bio != NULL) {
+		struct bio *next = bio->bi_next;
+
+		bio->bi_next = NULL;
+		bio->bi_status = status;
+		bio_endio(bio);
+		bio = next;
+	}
+}
+
+/**
+ * Build a single bio carrying the data of a list of adjacent bios.
+ *
+ * @param submitter  The I/O submitter
+ * @param head       The first of the bios to combine
+ * @param vec_count  The total number of segments in the bios
+ *
+ * @return The merged bio, or NULL if the bios could not be combined
+ **/
+static struct bio *make_merged_bio(struct io_submitter *submitter,
+				   struct bio *head,
+				   unsigned int vec_count)
+{
+	struct bio *merged = bio_alloc_bioset(GFP_NOIO,
+					      vec_count,
+					      &submitter->merged_bio_set);
+	struct bio *bio;
+
+	if (merged == NULL) {
+		return NULL;
+	}
+
+	bio_copy_dev(merged, head);
+	merged->bi_opf = head->bi_opf;
+	merged->bi_iter.bi_sector = get_bio_sector(head);
+	merged->bi_end_io = complete_merged_bio;
+	merged->bi_private = head;
+	for (bio = head; bio != NULL; bio = bio->bi_next) {
+		struct bio_vec bvec;
+		struct bvec_iter iter;
+
+		bio_for_each_segment(bvec, bio, iter) {
+			if (bio_add_page(merged, bvec.bv_page, bvec.bv_len,
+					 bvec.bv_offset) != bvec.bv_len) {
+				bio_put(merged);
+				return NULL;
+			}
+		}
+	}
+
+	return merged;
+}
+
+/**
+ * Submit the longest run of bios from the head of a list which can be
+ * combined into one bio: they must be physically adjacent, have the same
+ * operation and flags, and together fit in one request to the device.
+ *
+ * @param submitter  The I/O submitter
+ * @param head       The first bio of the list
+ *
+ * @return The first bio not submitted
+ **/
+static struct bio *submit_bio_run(struct io_submitter *submitter,
+				  struct bio *head)
+{
+	struct vio *vio = head->bi_private;
+	struct request_queue *queue =
+		bdev_get_queue(get_vdo_backing_device(vio->vdo));
+	unsigned int max_sectors = queue_max_sectors(queue);
+	unsigned int sectors = bio_sectors(head);
+	unsigned int vec_count = bio_segments(head);
+	unsigned int bio_count = 1;
+	struct bio *last = head;
+	struct bio *rest, *bio, *merged;
+
+	while ((last->bi_next != NULL) &&
+	       (last->bi_next->bi_opf == head->bi_opf) &&
+	       (get_bio_sector(last->bi_next) == bio_end_sector(last)) &&
+	       ((sectors + bio_sectors(last->bi_next)) <= max_sectors) &&
+	       ((vec_count + bio_segments(last->bi_next)) <=
+		MAX_MERGED_BIO_VECS)) {
+		last = last->bi_next;
+		sectors += bio_sectors(last);
+		vec_count += bio_segments(last);
+		bio_count++;
+	}
+
+	rest = last->bi_next;
+	last->bi_next = NULL;
+	for (bio = head; bio != NULL; bio = bio->bi_next) {
+		prepare_bio_for_device(bio->bi_private, bio);
+	}
+
+	merged = ((bio_count > 1)
+		  ? make_merged_bio(submitter, head, vec_count)
+		  : NULL);
+	if (merged != NULL) {
+		submit_bio_to_device(merged);
+		return rest;
+	}
+
+	while (head != NULL) {
+		struct bio *next = head->bi_next;
+
+		head->bi_next = NULL;
+		submit_vio_bio(head->bi_private, head);
+		head = next;
+	}
+
+	return rest;
+}
+
+/**
+ * Check whether the bio of a vio may be combined with the bios of adjacent
+ * blocks. Besides data, this includes block map pages, which are written
+ * back in pbn order so that runs of adjacent pages can be combined, and the
+ * block allocators' reference blocks and the slab summary blocks, which are
+ * likewise written in order.
+ *
+ * @param vio  The vio to check
+ *
+ * @return <code>true</code> if the vio's bio may be merged
+ **/
+static bool is_mergeable_vio(struct vio *vio)
+{
+	if (is_data_vio(vio)) {
+		return true;
+	}
+
+	return (((vio->type == VIO_TYPE_BLOCK_MAP) ||
+		 (vio->type == VIO_TYPE_BLOCK_MAP_INTERIOR) ||
+		 (vio->type == VIO_TYPE_BLOCK_ALLOCATOR) ||
+		 (vio->type == VIO_TYPE_SLAB_SUMMARY)) &&
+		bio_has_data(vio->bio));
+}
+
 /**
  * Submits a bio to the underlying block device.  May block if the
  * device is busy.
  *
- * For normal data, vio->bios_merged is the list of all bios collected
- * together in this group; all of them get submitted.
+ * For normal data and block map pages, vio->bios_merged is the list of all
+ * bios collected together in this group; all of them get submitted.
  *
  * @param item  The work item in the vio "owning" the head of the
  *		bio_list to be submitted.
@@ -258,7 +741,7 @@ static void process_bio_map(struct vdo_work_item *item)
 	assert_running_in_bio_queue();
 	// XXX Should we call finish_bio_queue for the biomap case on old
 	// kernels?
-	if (is_data_vio(vio)) {
+	if (is_mergeable_vio(vio)) {
 		// We need to make sure to do two things here:
 		// 1. Use each bio's vio when submitting. Any other vio is
 		// not safe
@@ -267,6 +750,8 @@ static void process_bio_map(struct vdo_work_item *item)
 		// are submitted.
 		struct bio_queue_data *bio_queue_data =
 			get_work_queue_private_data();
+		struct io_submitter *submitter =
+			bio_queue_to_submitter(bio_queue_data);
 		struct bio *bio = NULL;
 
 		mutex_lock(&bio_queue_data->lock);
@@ -285,13 +770,7 @@ static void process_bio_map(struct vdo_work_item *item)
 		vio = NULL;
 
 		while (bio != NULL) {
-			struct vio *vio_bio = bio->bi_private;
-			struct bio *next = bio->bi_next;
-
-			bio->bi_next = NULL;
-			send_bio_to_device(vio_bio,
-					   bio);
-			bio = next;
+			bio = submit_bio_run(submitter, bio);
 		}
 	} else {
 		send_bio_to_device(vio,
@@ -370,7 +849,7 @@ static struct vio *get_mergeable_locked(struct int_map *map,
 static inline unsigned int advance_bio_rotor(struct io_submitter *bio_data)
 {
 	unsigned int index = bio_data->bio_queue_rotor++ %
-			     (bio_data->num_bio_queues_used *
+			     (READ_ONCE(bio_data->active_bio_queues) *
 			      bio_data->bio_queue_rotation_interval);
 	index /= bio_data->bio_queue_rotation_interval;
 	return index;
@@ -490,7 +969,7 @@ void vdo_submit_bio(struct bio *bio, enum bio_q_action action)
 	 * appropriate to the indicated physical block number.
 	 */
 
-	if (is_data_vio(vio)) {
+	if (is_mergeable_vio(vio)) {
 		merged = try_bio_map_merge(bio_queue_data, vio, bio);
 	}
 	if (!merged) {
@@ -498,14 +977,120 @@ void vdo_submit_bio(struct bio *bio, enum bio_q_action action)
 	}
 }
 
+/**********************************************************************/
+void vdo_submit_companion_bio(struct bio *bio)
+{
+	struct vio *vio = bio->bi_private;
+	struct kernel_layer *layer = vdo_as_kernel_layer(vio->vdo);
+
+	atomic64_inc(&layer->bios_submitted);
+	count_all_bios(vio, bio);
+	bio_set_dev(bio, get_vdo_backing_device(vio->vdo));
+	submit_bio_to_device(bio);
+}
+
+/**
+ * Assign hardware queues of the backing device to a bio queue, and record the
+ * CPUs they serve so that the bio queue thread can submit from them. The
+ * hardware queues are dealt out to the bio queues round-robin; if there are
+ * fewer hardware queues than bio queues, the bio queues share them.
+ *
+ * @param bio_queue_data  The bio queue
+ * @param thread_count    The number of bio queues
+ * @param queue           The request queue of the backing device
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int map_hardware_queues(struct bio_queue_data *bio_queue_data,
+			       unsigned int thread_count,
+			       struct request_queue *queue)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	if (!zalloc_cpumask_var(&bio_queue_data->cpus, GFP_KERNEL)) {
+		return -ENOMEM;
+	}
+
+	queue_for_each_hw_ctx(queue, hctx, i) {
+		if (((i % thread_count) == bio_queue_data->queue_number) ||
+		    ((queue->nr_hw_queues < thread_count) &&
+		     ((bio_queue_data->queue_number % queue->nr_hw_queues)
+		      == i))) {
+			cpumask_or(bio_queue_data->cpus, bio_queue_data->cpus,
+				   hctx->cpumask);
+		}
+	}
+
+	return VDO_SUCCESS;
+}
+
+/**
+ * Prepare a bio queue to poll the hardware queues of the backing device, if
+ * the device supports polling.
+ *
+ * @param bio_queue_data  The bio queue
+ * @param queue           The request queue of the backing device
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int initialize_bio_polling(struct bio_queue_data *bio_queue_data,
+				  struct request_queue *queue)
+{
+#ifdef VDO_BIO_POLLING
+	unsigned int i;
+	int result;
+
+	atomic_set(&bio_queue_data->polled_in_flight, 0);
+	if (!queue_is_mq(queue) ||
+	    !test_bit(QUEUE_FLAG_POLL, &queue->queue_flags)) {
+		return VDO_SUCCESS;
+	}
+
+	result = ALLOCATE(queue->nr_hw_queues,
+			  blk_qc_t,
+			  "bio queue poll cookies",
+			  &bio_queue_data->poll_cookies);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; i < queue->nr_hw_queues; i++) {
+		bio_queue_data->poll_cookies[i] = BLK_QC_T_NONE;
+	}
+
+	bio_queue_data->poll_cookie_count = queue->nr_hw_queues;
+	bio_queue_data->poll_queue = queue;
+#endif // VDO_BIO_POLLING
+	return VDO_SUCCESS;
+}
+
 /**********************************************************************/
 static int initialize_bio_queue(struct bio_queue_data *bio_queue_data,
 				const char *thread_name_prefix,
 				const char *queue_name,
 				unsigned int queue_number,
+				unsigned int thread_count,
 				struct kernel_layer *layer)
 {
+	struct request_queue *queue
+		= bdev_get_queue(get_vdo_backing_device(&layer->vdo));
+	int result;
+
 	bio_queue_data->queue_number = queue_number;
+	if (layer->vdo.device_config->bio_hardware_queues &&
+	    queue_is_mq(queue)) {
+		result = map_hardware_queues(bio_queue_data, thread_count,
+					     queue);
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
+	}
+
+	result = initialize_bio_polling(bio_queue_data, queue);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 
 	return make_work_queue(thread_name_prefix,
 			       queue_name,
@@ -538,6 +1123,12 @@ int make_io_submitter(const char *thread_name_prefix,
 		return result;
 	}
 
+	result = bioset_init(&io_submitter->merged_bio_set, thread_count, 0,
+			     BIOSET_NEED_BVECS);
+	if (result != 0) {
+		FREE(io_submitter);
+		return result;
+	}
 
 	io_submitter->bio_queue_rotation_interval = rotation_interval;
 
@@ -575,10 +1166,13 @@ int make_io_submitter(const char *thread_name_prefix,
 					      thread_name_prefix,
 					      queue_name,
 					      i,
+					      thread_count,
 					      layer);
 		if (result != VDO_SUCCESS) {
 			// Clean up the partially initialized bio-queue
 			// entirely and indicate that initialization failed.
+			free_cpumask_var(bio_queue_data->cpus);
+			FREE(bio_queue_data->poll_cookies);
 			free_int_map(&bio_queue_data->map);
 			uds_log_error("bio queue initialization failed %d",
 				      result);
@@ -590,11 +1184,51 @@ int make_io_submitter(const char *thread_name_prefix,
 		io_submitter->num_bio_queues_used++;
 	}
 
+	io_submitter->active_bio_queues = io_submitter->num_bio_queues_used;
+
 	*io_submitter_ptr = io_submitter;
 
 	return VDO_SUCCESS;
 }
 
+/**********************************************************************/
+int set_io_submitter_thread_count(struct io_submitter *io_submitter,
+				  unsigned int count)
+{
+	if ((count == 0) || (count > io_submitter->num_bio_queues_used)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(io_submitter->active_bio_queues, count);
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+int set_io_submitter_polling(struct io_submitter *io_submitter, bool polling)
+{
+	unsigned int i;
+
+	if (!polling) {
+		WRITE_ONCE(io_submitter->polling, false);
+		return VDO_SUCCESS;
+	}
+
+	for (i = 0; i < io_submitter->num_bio_queues_used; i++) {
+		if (io_submitter->bio_queue_data[i].poll_cookies != NULL) {
+			WRITE_ONCE(io_submitter->polling, true);
+			return VDO_SUCCESS;
+		}
+	}
+
+	return -EOPNOTSUPP;
+}
+
+/**********************************************************************/
+bool get_io_submitter_polling(struct io_submitter *io_submitter)
+{
+	return READ_ONCE(io_submitter->polling);
+}
+
 /**********************************************************************/
 void cleanup_io_submitter(struct io_submitter *io_submitter)
 {
@@ -614,7 +1248,10 @@ void free_io_submitter(struct io_submitter *io_submitter)
 		io_submitter->num_bio_queues_used--;
 		free_work_queue(&io_submitter->bio_queue_data[i].queue);
 		free_int_map(&io_submitter->bio_queue_data[i].map);
+		free_cpumask_var(io_submitter->bio_queue_data[i].cpus);
+		FREE(io_submitter->bio_queue_data[i].poll_cookies);
 	}
+	bioset_exit(&io_submitter->merged_bio_set);
 	FREE(io_submitter);
 }
 
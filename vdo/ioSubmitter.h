@@ -47,6 +47,45 @@ int make_io_submitter(const char *thread_name_prefix,
 		      struct kernel_layer *layer,
 		      struct io_submitter **io_submitter);
 
+/**
+ * Change the number of bio submission threads to which bios are distributed.
+ * The count may not exceed the number of threads the io_submitter was made
+ * with. Since the thread for a bio is chosen by its physical block number,
+ * this must only be done while no bios are being submitted.
+ *
+ * @param io_submitter  The I/O submitter data
+ * @param count         The number of threads to use
+ *
+ * @return VDO_SUCCESS or -EINVAL if the count is out of range
+ **/
+int __must_check
+set_io_submitter_thread_count(struct io_submitter *io_submitter,
+			      unsigned int count);
+
+/**
+ * Set whether the bio submission threads poll for the completion of the
+ * reads and writes they submit instead of waiting for interrupts. Polling
+ * trades CPU time in those threads for lower I/O latency; it requires a
+ * backing device with polled queues (e.g. nvme with poll_queues set) and a
+ * kernel which supports polling by submission cookie.
+ *
+ * @param io_submitter  The I/O submitter data
+ * @param polling       Whether to poll
+ *
+ * @return VDO_SUCCESS or -EOPNOTSUPP if polling is not supported
+ **/
+int __must_check
+set_io_submitter_polling(struct io_submitter *io_submitter, bool polling);
+
+/**
+ * Check whether the bio submission threads poll for I/O completion.
+ *
+ * @param io_submitter  The I/O submitter data
+ *
+ * @return <code>true</code> if the threads poll
+ **/
+bool get_io_submitter_polling(struct io_submitter *io_submitter);
+
 /**
  * Tear down the io_submitter fields as needed for a physical layer.
  *
@@ -104,4 +143,17 @@ void enqueue_bio_work_item(struct io_submitter *io_submitter,
  **/
 void vdo_submit_bio(struct bio *bio, enum bio_q_action action);
 
+/**
+ * Submit a bio of a vio which already has another bio in flight, from the
+ * calling thread. Since the vio's work item is in use by the other bio, this
+ * bio can not be handed to a bio submission thread, nor merged with other
+ * bios.
+ *
+ * The bi_private field of the bio must point to the vio, and the bi_end_io
+ * callback must count the completed bio.
+ *
+ * @param bio  the block I/O operation descriptor to submit
+ **/
+void vdo_submit_companion_bio(struct bio *bio);
+
 #endif // IOSUBMITTER_H
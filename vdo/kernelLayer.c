@@ -25,7 +25,7 @@
 #include <linux/blkdev.h>
 #include <linux/delay.h>
 #include <linux/module.h>
-#include <linux/lz4.h>
+#include <linux/mutex.h>
 #include <linux/ratelimit.h>
 
 #include "logger.h"
@@ -35,16 +35,23 @@
 
 #include "adminCompletion.h"
 #include "flush.h"
+#include "hashZone.h"
+#include "packer.h"
+#include "recoveryJournal.h"
 #include "releaseVersions.h"
 #include "statistics.h"
+#include "threadConfig.h"
 #include "vdo.h"
 #include "vdoLoad.h"
 #include "vdoResize.h"
 #include "vdoResizeLogical.h"
 #include "volumeGeometry.h"
 
+#include "accessTrace.h"
 #include "bio.h"
+#include "compressibility.h"
 #include "dataKVIO.h"
+#include "dedupeExemptions.h"
 #include "dedupeIndex.h"
 #include "deviceConfig.h"
 #include "deviceRegistry.h"
@@ -52,10 +59,15 @@
 #include "ioSubmitter.h"
 #include "kvio.h"
 #include "poolSysfs.h"
+#include "postDedupe.h"
+#include "qosClasses.h"
+#include "rateStats.h"
+#include "requestGovernor.h"
 #include "stringUtils.h"
 #include "vdoInit.h"
 
 static const struct vdo_work_queue_type bio_ack_q_type = {
+	.thread_class = VDO_THREAD_CLASS_ACK,
 	.action_table = {
 		{
 			.name = "bio_ack",
@@ -65,7 +77,23 @@ static const struct vdo_work_queue_type bio_ack_q_type = {
 	},
 };
 
+unsigned int shared_ack_threads = 0;
+
+/*
+ * The bio ack queue shared by the VDOs on the host when shared_ack_threads is
+ * set, and the batch processors which feed it. The first VDO to use them
+ * makes them and the last one frees them. All of these are protected by the
+ * shared_ack_mutex.
+ */
+static struct vdo_work_queue *shared_ack_queue;
+static struct batch_processor **shared_ack_batchers;
+static unsigned int shared_ack_batcher_count;
+static unsigned int shared_ack_users;
+static DEFINE_MUTEX(shared_ack_mutex);
+
 static const struct vdo_work_queue_type cpu_q_type = {
+	.allow_stealing = true,
+	.thread_class = VDO_THREAD_CLASS_CPU,
 	.action_table = {
 		{
 			.name = "cpu_complete_vio",
@@ -141,9 +169,9 @@ static void set_kernel_layer_state(struct kernel_layer *layer,
  * processing other requests.
  *
  * If a request permit can be acquired immediately,
- * vdo_launch_data_vio_from_bio will be called. (If the bio is a discard
- * operation, a permit from the discard limiter will be requested but the call
- * will be made with or without it.) If the request permit is not available,
+ * vdo_launch_data_vio_from_bio will be called. (If the bio is a discard or a
+ * write, a permit from the discard or write limiter will be requested but the
+ * call will be made with or without it.) If the request permit is not available,
  * the bio will be saved on a list to be launched later. Either way, this
  * function will not block, and will take responsibility for processing the
  * bio.
@@ -158,7 +186,7 @@ static int launch_data_vio_from_vdo_thread(struct vdo *vdo,
 					   struct bio *bio,
 					   uint64_t arrival_jiffies)
 {
-	bool has_discard_permit;
+	bool has_discard_permit, has_write_permit;
 	int result;
 
 	uds_log_warning("kvdo_map_bio called from within a VDO thread!");
@@ -196,12 +224,18 @@ static int launch_data_vio_from_vdo_thread(struct vdo *vdo,
 	}
 
 	has_discard_permit =
-		((bio_op(bio) == REQ_OP_DISCARD) &&
+		(is_discard_bio(bio) &&
 		 limiter_poll(&vdo->discard_limiter));
+	has_write_permit =
+		(is_plain_write_bio(bio) &&
+		 limiter_poll(&vdo->write_limiter));
+	// For the same reason, the request can not wait for its QoS class.
 	result = vdo_launch_data_vio_from_bio(vdo,
 					      bio,
 					      arrival_jiffies,
-					      has_discard_permit);
+					      has_discard_permit,
+					      has_write_permit,
+					      NULL);
 	// Succeed or fail, vdo_launch_data_vio_from_bio owns the permit(s)
 	// now.
 	if (result != VDO_SUCCESS) {
@@ -212,6 +246,130 @@ static int launch_data_vio_from_vdo_thread(struct vdo *vdo,
 }
 
 
+/**
+ * Get the number of logical blocks touched by a bio.
+ *
+ * @param bio  The bio, which must not be empty
+ *
+ * @return The number of blocks the bio spans
+ **/
+static block_count_t get_bio_block_count(struct bio *bio)
+{
+	return (sector_to_block(bio_end_sector(bio) - 1)
+		- sector_to_block(bio->bi_iter.bi_sector) + 1);
+}
+
+/**
+ * Get the number of sectors from the start of a bio to the end of the block
+ * containing its first sector.
+ *
+ * @param bio  The bio, which must span more than one block
+ *
+ * @return The number of sectors of the bio in its first block
+ **/
+static unsigned int get_sectors_in_first_block(struct bio *bio)
+{
+	unsigned int sectors_per_block_mask = VDO_SECTORS_PER_BLOCK - 1;
+	return (VDO_SECTORS_PER_BLOCK
+		- (bio->bi_iter.bi_sector & sectors_per_block_mask));
+}
+
+/**
+ * Start processing a bio which may span several logical blocks. Each block
+ * is split off into its own bio, chained to the original, and given its own
+ * data_vio. Request permits are taken as many at a time as the limiter will
+ * grant, so that a large sequential bio does not pay for a limiter round
+ * trip per block. A bio in a QoS class must first get permits from its
+ * class, so that it can not take more than the class's share of the request
+ * permits. Writes must then get permits from the write limiter, so that they
+ * can not take all of the request permits away from reads.
+ *
+ * @param layer            The kernel layer
+ * @param bio              The bio to launch, which must not be a discard
+ * @param arrival_jiffies  The arrival time of the bio
+ * @param qos_class        The QoS class of the first block of the bio, or
+ *                         NULL if it is in no class
+ *
+ * @return DM_MAPIO_SUBMITTED or a system error code
+ **/
+static int launch_data_vios_for_bio(struct kernel_layer *layer,
+				    struct bio *bio,
+				    uint64_t arrival_jiffies,
+				    struct qos_class *qos_class)
+{
+	struct vdo *vdo = &layer->vdo;
+	block_count_t remaining = get_bio_block_count(bio);
+	bool split = (remaining > 1);
+	bool is_write = is_plain_write_bio(bio);
+
+	while (remaining > 0) {
+		uint32_t admitted = remaining;
+		uint32_t writes = 0;
+		uint32_t permits;
+
+		if (qos_class != NULL) {
+			admitted =
+				limiter_wait_for_some_free(&qos_class->limiter,
+							   remaining);
+		}
+
+		if (is_write) {
+			writes = limiter_wait_for_some_free(&vdo->write_limiter,
+							    admitted);
+		}
+
+		permits = limiter_wait_for_some_free(&vdo->request_limiter,
+						     (is_write ? writes
+							       : admitted));
+		if (writes > permits) {
+			limiter_release_many(&vdo->write_limiter,
+					     writes - permits);
+		}
+
+		if ((qos_class != NULL) && (admitted > permits)) {
+			limiter_release_many(&qos_class->limiter,
+					     admitted - permits);
+		}
+
+		for (; permits > 0; permits--, remaining--) {
+			struct bio *block_bio = bio;
+			int result;
+
+			if (remaining > 1) {
+				block_bio =
+					bio_split(bio,
+						  get_sectors_in_first_block(bio),
+						  GFP_NOIO,
+						  &layer->bio_split_set);
+				bio_chain(block_bio, bio);
+			}
+
+			count_bios(&layer->bios_in, block_bio);
+			result = vdo_launch_data_vio_from_bio(vdo,
+							      block_bio,
+							      arrival_jiffies,
+							      false,
+							      is_write,
+							      qos_class);
+			// Succeed or fail, vdo_launch_data_vio_from_bio owns
+			// the permit now.
+			if (result == VDO_SUCCESS) {
+				continue;
+			}
+
+			if (!split) {
+				return result;
+			}
+
+			// The error will be propagated to the original bio
+			// once all of the blocks split from it are done.
+			complete_bio(block_bio, result);
+		}
+	}
+
+	return DM_MAPIO_SUBMITTED;
+}
+
 /**********************************************************************/
 int kvdo_map_bio(struct kernel_layer *layer, struct bio *bio)
 {
@@ -219,19 +377,17 @@ int kvdo_map_bio(struct kernel_layer *layer, struct bio *bio)
 	uint64_t arrival_jiffies = jiffies;
 	enum kernel_layer_state state = get_kernel_layer_state(layer);
 	struct vdo_work_queue *current_work_queue;
-	bool has_discard_permit = false;
+	struct qos_class *qos_class;
+	logical_block_number_t lbn;
 
 	ASSERT_LOG_ONLY(state == LAYER_RUNNING,
 			"kvdo_map_bio should not be called while in state %d",
 			state);
 
-	// Count all incoming bios.
-	count_bios(&layer->bios_in, bio);
-
-
 	// Handle empty bios.  Empty flush bios are not associated with a vio.
 	if ((bio_op(bio) == REQ_OP_FLUSH) ||
 	    ((bio->bi_opf & REQ_PREFLUSH) != 0)) {
+		count_bios(&layer->bios_in, bio);
 		launch_vdo_flush(&layer->vdo, bio);
 		return DM_MAPIO_SUBMITTED;
 	}
@@ -242,23 +398,44 @@ int kvdo_map_bio(struct kernel_layer *layer, struct bio *bio)
 	    (layer == get_work_queue_owner(current_work_queue))) {
 		/*
 		 * This prohibits sleeping during I/O submission to VDO from
-		 * its own thread.
+		 * its own thread. Only take the first block of a multi-block
+		 * bio; device-mapper will resubmit the rest.
 		 */
+		if (!is_discard_bio(bio) &&
+		    (get_bio_block_count(bio) > 1)) {
+			dm_accept_partial_bio(bio,
+					      get_sectors_in_first_block(bio));
+		}
+
+		count_bios(&layer->bios_in, bio);
 		return launch_data_vio_from_vdo_thread(&layer->vdo,
 						       bio,
 						       arrival_jiffies);
 	}
 
-	if (bio_op(bio) == REQ_OP_DISCARD) {
-		limiter_wait_for_one_free(&layer->vdo.discard_limiter);
-		has_discard_permit = true;
+	// A bio is charged to the QoS class of its first block.
+	lbn = sector_to_block(bio->bi_iter.bi_sector -
+			      layer->vdo.starting_sector_offset);
+	qos_class = get_qos_class(layer->vdo.qos_classes, lbn);
+	if (!is_discard_bio(bio)) {
+		return launch_data_vios_for_bio(layer, bio, arrival_jiffies,
+						qos_class);
+	}
+
+	// Discards spanning several blocks are handled by a single data_vio.
+	count_bios(&layer->bios_in, bio);
+	if (qos_class != NULL) {
+		limiter_wait_for_one_free(&qos_class->limiter);
 	}
+	limiter_wait_for_one_free(&layer->vdo.discard_limiter);
 	limiter_wait_for_one_free(&layer->vdo.request_limiter);
 
 	result = vdo_launch_data_vio_from_bio(&layer->vdo,
 					      bio,
 					      arrival_jiffies,
-					      has_discard_permit);
+					      true,
+					      false,
+					      qos_class);
 	// Succeed or fail, vdo_launch_data_vio_from_bio owns the permit(s)
 	// now.
 	if (result != VDO_SUCCESS) {
@@ -274,7 +451,7 @@ void complete_many_requests(struct vdo *vdo, uint32_t count)
 	// If we had to buffer some requests to avoid deadlock, release them
 	// now.
 	while (count > 0) {
-		bool has_discard_permit;
+		bool has_discard_permit, has_write_permit;
 		int result;
 		uint64_t arrival_jiffies = 0;
 		struct bio *bio = poll_deadlock_queue(&vdo->deadlock_queue,
@@ -284,12 +461,17 @@ void complete_many_requests(struct vdo *vdo, uint32_t count)
 		}
 
 		has_discard_permit =
-			((bio_op(bio) == REQ_OP_DISCARD) &&
+			(is_discard_bio(bio) &&
 			 limiter_poll(&vdo->discard_limiter));
+		has_write_permit =
+			(is_plain_write_bio(bio) &&
+			 limiter_poll(&vdo->write_limiter));
 		result = vdo_launch_data_vio_from_bio(vdo,
 						      bio,
 						      arrival_jiffies,
-						      has_discard_permit);
+						      has_discard_permit,
+						      has_write_permit,
+						      NULL);
 		if (result != VDO_SUCCESS) {
 			complete_bio(bio, result);
 		}
@@ -303,6 +485,304 @@ void complete_many_requests(struct vdo *vdo, uint32_t count)
 	}
 }
 
+/**
+ * Make one batch processor per thread of a work queue, so that batches of the
+ * same kind of work can still proceed in parallel on every thread.
+ *
+ * @param layer         The kernel layer
+ * @param queue         The work queue, or NULL for the CPU queues
+ * @param count         The number of threads in the work queue
+ * @param callback      The function to process each batch
+ * @param action        The queue action code for the batches
+ * @param batchers_ptr  A pointer to hold the array of batch processors
+ *
+ * @return UDS_SUCCESS or an error
+ **/
+static int __must_check
+make_batchers(struct kernel_layer *layer,
+	      struct vdo_work_queue *queue,
+	      unsigned int count,
+	      batch_processor_callback callback,
+	      unsigned int action,
+	      struct batch_processor ***batchers_ptr)
+{
+	unsigned int i;
+	int result = ALLOCATE(count,
+			      struct batch_processor *,
+			      __func__,
+			      batchers_ptr);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; i < count; i++) {
+		result = make_batch_processor(layer,
+					      queue,
+					      callback,
+					      layer,
+					      action,
+					      &(*batchers_ptr)[i]);
+		if (result != UDS_SUCCESS) {
+			return result;
+		}
+	}
+
+	return UDS_SUCCESS;
+}
+
+/**
+ * Make one batch processor per CPU queue thread.
+ *
+ * @param layer         The kernel layer
+ * @param callback      The function to process each batch
+ * @param action        The CPU queue action code for the batches
+ * @param batchers_ptr  A pointer to hold the array of batch processors
+ *
+ * @return UDS_SUCCESS or an error
+ **/
+static int __must_check
+make_cpu_batchers(struct kernel_layer *layer,
+		  batch_processor_callback callback,
+		  unsigned int action,
+		  struct batch_processor ***batchers_ptr)
+{
+	struct device_config *config = layer->vdo.device_config;
+
+	return make_batchers(layer,
+			     NULL,
+			     config->thread_counts.cpu_threads,
+			     callback,
+			     action,
+			     batchers_ptr);
+}
+
+/**
+ * Free an array of per-thread batch processors.
+ *
+ * @param count         The number of batch processors in the array
+ * @param batchers_ptr  A pointer to the array to free
+ **/
+static void free_batchers(unsigned int count,
+			  struct batch_processor ***batchers_ptr)
+{
+	unsigned int i;
+	struct batch_processor **batchers = *batchers_ptr;
+
+	if (batchers == NULL) {
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		free_batch_processor(&batchers[i]);
+	}
+	FREE(batchers);
+	*batchers_ptr = NULL;
+}
+
+/**
+ * Free the shared bio ack queue and its batch processors. Must be called
+ * holding the shared_ack_mutex.
+ **/
+static void free_shared_ack_queue(void)
+{
+	if (shared_ack_queue != NULL) {
+		finish_work_queue(shared_ack_queue);
+	}
+	free_batchers(shared_ack_batcher_count, &shared_ack_batchers);
+	free_work_queue(&shared_ack_queue);
+}
+
+/**
+ * Make the shared bio ack queue and its batch processors. Must be called
+ * holding the shared_ack_mutex.
+ *
+ * @param count  The number of threads in the queue
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int make_shared_ack_queue(unsigned int count)
+{
+	unsigned int i;
+	int result = make_work_queue(THIS_MODULE->name,
+				     "ackQ",
+				     &THIS_MODULE->mkobj.kobj,
+				     NULL,
+				     NULL,
+				     &bio_ack_q_type,
+				     count,
+				     NULL,
+				     &shared_ack_queue);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	shared_ack_batcher_count = count;
+	result = ALLOCATE(count,
+			  struct batch_processor *,
+			  __func__,
+			  &shared_ack_batchers);
+	if (result != VDO_SUCCESS) {
+		free_shared_ack_queue();
+		return result;
+	}
+
+	for (i = 0; i < count; i++) {
+		result = make_batch_processor(NULL,
+					      shared_ack_queue,
+					      acknowledge_shared_data_vio_batch,
+					      NULL,
+					      BIO_ACK_Q_ACTION_ACK,
+					      &shared_ack_batchers[i]);
+		if (result != VDO_SUCCESS) {
+			free_shared_ack_queue();
+			return result;
+		}
+	}
+
+	return VDO_SUCCESS;
+}
+
+/**
+ * Start using the bio ack queue shared by all VDOs, making it if this is the
+ * first VDO to use it.
+ *
+ * @param layer  The kernel layer
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int get_shared_ack_queue(struct kernel_layer *layer)
+{
+	int result = VDO_SUCCESS;
+
+	mutex_lock(&shared_ack_mutex);
+	if (shared_ack_users == 0) {
+		result = make_shared_ack_queue(READ_ONCE(shared_ack_threads));
+	}
+	if (result == VDO_SUCCESS) {
+		shared_ack_users++;
+		layer->bio_ack_queue = shared_ack_queue;
+		layer->bio_ack_batchers = shared_ack_batchers;
+		layer->bio_ack_batcher_count = shared_ack_batcher_count;
+		layer->shared_bio_ack_queue = true;
+	}
+	mutex_unlock(&shared_ack_mutex);
+	return result;
+}
+
+/**
+ * Stop using the shared bio ack queue, freeing it if this is the last VDO
+ * using it. The VDO must have no bios waiting to be acknowledged.
+ *
+ * @param layer  The kernel layer
+ **/
+static void put_shared_ack_queue(struct kernel_layer *layer)
+{
+	mutex_lock(&shared_ack_mutex);
+	if (--shared_ack_users == 0) {
+		free_shared_ack_queue();
+	}
+	mutex_unlock(&shared_ack_mutex);
+
+	layer->bio_ack_queue = NULL;
+	layer->bio_ack_batchers = NULL;
+	layer->shared_bio_ack_queue = false;
+}
+
+/**
+ * Free the private data of one CPU queue thread.
+ *
+ * @param context  The context to free
+ **/
+static void free_cpu_queue_context(struct cpu_queue_context *context)
+{
+	if (context == NULL) {
+		return;
+	}
+
+	free_vdo_compressor_context(context->compressor_context);
+	FREE(context->hash_desc);
+	FREE(context);
+}
+
+/**
+ * Allocate the private data for one CPU queue thread.
+ *
+ * @param layer        The kernel layer
+ * @param context_ptr  A pointer to hold the new context
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int __must_check
+make_cpu_queue_context(struct kernel_layer *layer,
+		       struct cpu_queue_context **context_ptr)
+{
+	struct cpu_queue_context *context;
+	int result = ALLOCATE(1, struct cpu_queue_context, __func__, &context);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	result = make_vdo_compressor_context(layer->compressor,
+					     &context->compressor_context);
+	if (result != VDO_SUCCESS) {
+		free_cpu_queue_context(context);
+		return result;
+	}
+
+	if (layer->hash_transform != NULL) {
+		result = ALLOCATE_EXTENDED(struct shash_desc,
+					   crypto_shash_descsize(layer->hash_transform),
+					   char,
+					   "chunk name hash descriptor",
+					   &context->hash_desc);
+		if (result != VDO_SUCCESS) {
+			free_cpu_queue_context(context);
+			return result;
+		}
+		context->hash_desc->tfm = layer->hash_transform;
+	}
+
+	*context_ptr = context;
+	return VDO_SUCCESS;
+}
+
+/**
+ * Read the counters whose rates are tracked for monitoring. Implements
+ * rate_sampler. Every source is an atomic or a statistic its owning thread
+ * publishes for lock-free readers, so nothing here waits on a zone thread.
+ *
+ * @param context  The kernel layer
+ * @param counts   An array to hold the counter values
+ **/
+static void sample_layer_rates(void *context,
+			       uint64_t counts[RATE_COUNTER_COUNT])
+{
+	struct kernel_layer *layer = context;
+	struct vdo *vdo = &layer->vdo;
+	const struct thread_config *thread_config = get_thread_config(vdo);
+	struct packer_statistics packer_stats;
+	struct recovery_journal_statistics journal_stats;
+	uint64_t dedupe_hits = 0;
+	zone_count_t zone;
+
+	for (zone = 0; zone < thread_config->hash_zone_count; zone++) {
+		struct hash_lock_statistics stats =
+			get_vdo_hash_zone_statistics(vdo->hash_zones[zone]);
+		dedupe_hits += (stats.dedupe_advice_valid
+				+ stats.concurrent_data_matches);
+	}
+
+	counts[RATE_READS] = atomic64_read(&layer->bios_in.read);
+	counts[RATE_WRITES] = atomic64_read(&layer->bios_in.write);
+	counts[RATE_DISCARDS] = atomic64_read(&layer->bios_in.discard);
+	counts[RATE_DEDUPE_HITS] = dedupe_hits;
+	get_packer_statistics(vdo->packer_zones, &packer_stats);
+	counts[RATE_COMPRESSED_FRAGMENTS] =
+		packer_stats.compressed_fragments_written;
+	get_recovery_journal_statistics(vdo->recovery_journal, &journal_stats);
+	counts[RATE_JOURNAL_BLOCKS] = journal_stats.blocks.committed;
+}
+
 /**********************************************************************/
 int make_kernel_layer(unsigned int instance,
 		      struct device_config *config,
@@ -328,6 +808,8 @@ int make_kernel_layer(unsigned int instance,
 		return result;
 	}
 
+	layer->next_thread_node = first_online_node;
+
 	result = initialize_vdo(&layer->vdo,
 				&layer->common,
 				config,
@@ -360,6 +842,19 @@ int make_kernel_layer(unsigned int instance,
 	set_kernel_layer_state(layer, LAYER_SIMPLE_THINGS_INITIALIZED);
 
 	mutex_init(&layer->stats_mutex);
+	atomic_set(&layer->compression_acceleration,
+		   VDO_DEFAULT_LZ4_ACCELERATION);
+	layer->maximum_compression_acceleration = VDO_DEFAULT_LZ4_ACCELERATION;
+
+	result = bioset_init(&layer->bio_split_set,
+			     MAXIMUM_VDO_BIO_BLOCKS,
+			     0,
+			     0);
+	if (result != 0) {
+		*reason = "Cannot allocate bio split set";
+		free_kernel_layer(layer);
+		return result;
+	}
 
 	result = register_vdo(&layer->vdo);
 	if (result != VDO_SUCCESS) {
@@ -375,8 +870,10 @@ int make_kernel_layer(unsigned int instance,
 		 instance);
 
 	result = make_batch_processor(layer,
+				      NULL,
 				      return_data_vio_batch_to_pool,
 				      layer,
+				      CPU_Q_ACTION_COMPLETE_VIO,
 				      &layer->data_vio_releaser);
 	if (result != UDS_SUCCESS) {
 		*reason = "Cannot allocate vio-freeing batch processor";
@@ -384,6 +881,26 @@ int make_kernel_layer(unsigned int instance,
 		return result;
 	}
 
+	result = make_cpu_batchers(layer,
+				   hash_data_vio_batch,
+				   CPU_Q_ACTION_HASH_BLOCK,
+				   &layer->hash_batchers);
+	if (result != UDS_SUCCESS) {
+		*reason = "Cannot allocate hashing batch processors";
+		free_kernel_layer(layer);
+		return result;
+	}
+
+	result = make_cpu_batchers(layer,
+				   compress_data_vio_batch,
+				   CPU_Q_ACTION_COMPRESS_BLOCK,
+				   &layer->compress_batchers);
+	if (result != UDS_SUCCESS) {
+		*reason = "Cannot allocate compression batch processors";
+		free_kernel_layer(layer);
+		return result;
+	}
+
 	// Spare kvdo_flush, so that we will always have at least one available
 
 	// Dedupe Index
@@ -395,24 +912,81 @@ int make_kernel_layer(unsigned int instance,
 		return result;
 	}
 
-	// Compression context storage
+	result = make_post_deduper(layer, &layer->post_deduper);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate post-process deduper";
+		free_kernel_layer(layer);
+		return result;
+	}
+
+	result = make_access_trace(layer, &layer->access_trace);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate access trace";
+		free_kernel_layer(layer);
+		return result;
+	}
+
+	result = make_dedupe_exemptions(&layer->dedupe_exemptions);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate dedupe exemptions";
+		free_kernel_layer(layer);
+		return result;
+	}
+
+	result = make_compressibility_tracker(&layer->compressibility);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate compressibility tracker";
+		free_kernel_layer(layer);
+		return result;
+	}
+
+	result = make_rate_tracker(sample_layer_rates, layer, &layer->rates);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate rate tracker";
+		free_kernel_layer(layer);
+		return result;
+	}
+
+	// Chunk name hash transform
+	if (config->hash_algorithm == VDO_HASH_SHA256) {
+		// The crypto API picks the fastest registered implementation,
+		// such as SHA-NI or the ARMv8 crypto extensions.
+		struct crypto_shash *transform = crypto_alloc_shash("sha256",
+								    0, 0);
+		if (IS_ERR(transform)) {
+			*reason = "Cannot allocate sha256 transform";
+			free_kernel_layer(layer);
+			return PTR_ERR(transform);
+		}
+		layer->hash_transform = transform;
+	}
+
+	// Compression engine
+	result = make_vdo_compressor(config->compression_format,
+				     &layer->vdo.vdo_directory,
+				     &layer->compressor);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot initialize compressor";
+		free_kernel_layer(layer);
+		return result;
+	}
+
+	// CPU queue context storage
 	result = ALLOCATE(config->thread_counts.cpu_threads,
-			  char *,
-			  "LZ4 context",
-			  &layer->compression_context);
+			  struct cpu_queue_context *,
+			  "CPU queue contexts",
+			  &layer->cpu_queue_contexts);
 	if (result != VDO_SUCCESS) {
-		*reason = "cannot allocate LZ4 context";
+		*reason = "cannot allocate CPU queue contexts";
 		free_kernel_layer(layer);
 		return result;
 	}
 
 	for (i = 0; i < config->thread_counts.cpu_threads; i++) {
-		result = ALLOCATE(LZ4_MEM_COMPRESS,
-				  char,
-				  "LZ4 context",
-				  &layer->compression_context[i]);
+		result = make_cpu_queue_context(layer,
+						&layer->cpu_queue_contexts[i]);
 		if (result != VDO_SUCCESS) {
-			*reason = "cannot allocate LZ4 context";
+			*reason = "cannot allocate CPU queue context";
 			free_kernel_layer(layer);
 			return result;
 		}
@@ -429,9 +1003,9 @@ int make_kernel_layer(unsigned int instance,
 
 	// Data vio pool
 	BUG_ON(layer->vdo.device_config->logical_block_size <= 0);
-	BUG_ON(layer->vdo.request_limiter.limit <= 0);
+	BUG_ON(get_limiter_limit(&layer->vdo.request_limiter) <= 0);
 	BUG_ON(layer->vdo.device_config->owned_device == NULL);
-	result = make_data_vio_buffer_pool(layer->vdo.request_limiter.limit,
+	result = make_data_vio_buffer_pool(get_limiter_limit(&layer->vdo.request_limiter),
 					   &layer->data_vio_pool);
 	if (result != VDO_SUCCESS) {
 		*reason = "Cannot allocate vio data";
@@ -439,6 +1013,33 @@ int make_kernel_layer(unsigned int instance,
 		return result;
 	}
 
+	// Most data_vios need at most one of their read and scratch blocks
+	// at a time, so the pool holds one block per data_vio.
+	result = make_block_buffer_pool(get_limiter_limit(&layer->vdo.request_limiter),
+					&layer->block_buffer_pool);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate vio block buffers";
+		free_kernel_layer(layer);
+		return result;
+	}
+
+	result = make_request_governor(&layer->vdo.request_limiter,
+				       &layer->vdo.vdo_directory,
+				       &layer->vdo.request_governor);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate request governor";
+		free_kernel_layer(layer);
+		return result;
+	}
+
+	result = make_data_vio_stage_histograms(&layer->vdo.vdo_directory,
+						&layer->stage_histograms);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate data_vio stage histograms";
+		free_kernel_layer(layer);
+		return result;
+	}
+
 	/*
 	 * Part 4 - Do initializations that depend upon other previous
 	 * initialization, that may have order dependencies at freeing time.
@@ -458,7 +1059,7 @@ int make_kernel_layer(unsigned int instance,
 	result = make_io_submitter(layer->thread_name_prefix,
 				   config->thread_counts.bio_threads,
 				   config->thread_counts.bio_rotation_interval,
-				   layer->vdo.request_limiter.limit,
+				   get_limiter_limit(&layer->vdo.request_limiter),
 				   layer,
 				   &layer->vdo.io_submitter);
 	if (result != VDO_SUCCESS) {
@@ -471,7 +1072,15 @@ int make_kernel_layer(unsigned int instance,
 	set_kernel_layer_state(layer, LAYER_BIO_DATA_INITIALIZED);
 
 	// Bio ack queue
-	if (use_bio_ack_queue(&layer->vdo)) {
+	if (use_bio_ack_queue(&layer->vdo) &&
+	    (READ_ONCE(shared_ack_threads) > 0)) {
+		result = get_shared_ack_queue(layer);
+		if (result != VDO_SUCCESS) {
+			*reason = "shared bio ack queue initialization failed";
+			free_kernel_layer(layer);
+			return result;
+		}
+	} else if (use_bio_ack_queue(&layer->vdo)) {
 		result = make_work_queue(layer->thread_name_prefix,
 					 "ackQ",
 					 &layer->vdo.work_queue_directory,
@@ -486,6 +1095,20 @@ int make_kernel_layer(unsigned int instance,
 			free_kernel_layer(layer);
 			return result;
 		}
+
+		result = make_batchers(layer,
+				       layer->bio_ack_queue,
+				       config->thread_counts.bio_ack_threads,
+				       acknowledge_data_vio_batch,
+				       BIO_ACK_Q_ACTION_ACK,
+				       &layer->bio_ack_batchers);
+		if (result != UDS_SUCCESS) {
+			*reason = "Cannot allocate bio ack batch processors";
+			free_kernel_layer(layer);
+			return result;
+		}
+		layer->bio_ack_batcher_count =
+			config->thread_counts.bio_ack_threads;
 	}
 
 	set_kernel_layer_state(layer, LAYER_BIO_ACK_QUEUE_INITIALIZED);
@@ -498,7 +1121,7 @@ int make_kernel_layer(unsigned int instance,
 				 layer,
 				 &cpu_q_type,
 				 config->thread_counts.cpu_threads,
-				 (void **) layer->compression_context,
+				 (void **) layer->cpu_queue_contexts,
 				 &layer->cpu_queue);
 	if (result != VDO_SUCCESS) {
 		*reason = "CPU queue initialization failed";
@@ -512,6 +1135,38 @@ int make_kernel_layer(unsigned int instance,
 	return VDO_SUCCESS;
 }
 
+/**
+ * Check whether two device configurations have the same QoS classes.
+ *
+ * @param config         One configuration
+ * @param other_config   The other configuration
+ *
+ * @return true if the classes are the same
+ **/
+static bool are_same_qos_classes(const struct device_config *config,
+				 const struct device_config *other_config)
+{
+	unsigned int i;
+
+	if (config->qos_class_count != other_config->qos_class_count) {
+		return false;
+	}
+
+	for (i = 0; i < config->qos_class_count; i++) {
+		const struct qos_class_config *class = &config->qos_classes[i];
+		const struct qos_class_config *other =
+			&other_config->qos_classes[i];
+
+		if ((class->first != other->first) ||
+		    (class->last != other->last) ||
+		    (class->limit != other->limit)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /**********************************************************************/
 int prepare_to_modify_kernel_layer(struct kernel_layer *layer,
 				   struct device_config *config,
@@ -541,6 +1196,67 @@ int prepare_to_modify_kernel_layer(struct kernel_layer *layer,
 		return VDO_PARAMETER_MISMATCH;
 	}
 
+	if (config->compression_format != extant_config->compression_format) {
+		*error_ptr = "Compressor cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if (config->compression_unit_blocks !=
+	    extant_config->compression_unit_blocks) {
+		*error_ptr = "Compression unit cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if (config->hash_algorithm != extant_config->hash_algorithm) {
+		*error_ptr = "Hash algorithm cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if (config->numa_aware != extant_config->numa_aware) {
+		*error_ptr = "NUMA placement cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if (config->bio_hardware_queues !=
+	    extant_config->bio_hardware_queues) {
+		*error_ptr = "Bio hardware queue mapping cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if (config->compact_journal_entries !=
+	    extant_config->compact_journal_entries) {
+		*error_ptr = "Compact journal entries cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if (!are_same_qos_classes(config, extant_config)) {
+		*error_ptr = "QoS classes cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if ((config->index_device_name == NULL) !=
+	    (extant_config->index_device_name == NULL) ||
+	    ((config->index_device_name != NULL) &&
+	     (strcmp(config->index_device_name,
+		     extant_config->index_device_name) != 0))) {
+		*error_ptr = "Index device cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if (config->shared_index != extant_config->shared_index) {
+		*error_ptr = "Index sharing cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
+	if ((config->journal_device_name == NULL) !=
+	    (extant_config->journal_device_name == NULL) ||
+	    ((config->journal_device_name != NULL) &&
+	     (strcmp(config->journal_device_name,
+		     extant_config->journal_device_name) != 0))) {
+		*error_ptr = "Journal device cannot change";
+		return VDO_PARAMETER_MISMATCH;
+	}
+
 	if (memcmp(&config->thread_counts, &extant_config->thread_counts,
 		   sizeof(struct thread_count_config)) != 0) {
 		*error_ptr = "Thread configuration cannot change";
@@ -634,15 +1350,38 @@ int modify_kernel_layer(struct kernel_layer *layer,
 }
 
 /**********************************************************************/
-static void free_compression_context(struct kernel_layer *layer)
+static void free_cpu_queue_contexts(struct kernel_layer *layer)
 {
 	int i;
 	for (i = 0;
 	     i < layer->vdo.device_config->thread_counts.cpu_threads;
 	     i++) {
-		FREE(layer->compression_context[i]);
+		free_cpu_queue_context(layer->cpu_queue_contexts[i]);
+	}
+	FREE(layer->cpu_queue_contexts);
+}
+
+/**********************************************************************/
+int get_next_vdo_thread_node(struct kernel_layer *layer)
+{
+	int node;
+
+	if ((layer == NULL) || !layer->vdo.device_config->numa_aware) {
+		return NUMA_NO_NODE;
 	}
-	FREE(layer->compression_context);
+
+	// Threads are only created during construction, so no lock is needed.
+	node = layer->next_thread_node;
+	if (!node_online(node)) {
+		node = first_online_node;
+	}
+
+	layer->next_thread_node = next_online_node(node);
+	if (layer->next_thread_node >= MAX_NUMNODES) {
+		layer->next_thread_node = first_online_node;
+	}
+
+	return node;
 }
 
 /**********************************************************************/
@@ -656,6 +1395,7 @@ void free_kernel_layer(struct kernel_layer *layer)
 	 */
 	bool used_bio_ack_queue = false;
 	bool used_cpu_queue = false;
+	struct device_config *config = layer->vdo.device_config;
 
 	enum kernel_layer_state state = get_kernel_layer_state(layer);
 
@@ -681,7 +1421,9 @@ void free_kernel_layer(struct kernel_layer *layer)
 		// fall through
 
 	case LAYER_BIO_ACK_QUEUE_INITIALIZED:
-		if (use_bio_ack_queue(&layer->vdo)) {
+		if (layer->shared_bio_ack_queue) {
+			put_shared_ack_queue(layer);
+		} else if (use_bio_ack_queue(&layer->vdo)) {
 			finish_work_queue(layer->bio_ack_queue);
 			used_bio_ack_queue = true;
 		}
@@ -696,18 +1438,30 @@ void free_kernel_layer(struct kernel_layer *layer)
 		// fall through
 
 	case LAYER_BUFFER_POOLS_INITIALIZED:
+		free_data_vio_stage_histograms(&layer->stage_histograms);
+		free_request_governor(&layer->vdo.request_governor);
+		free_buffer_pool(&layer->block_buffer_pool);
 		free_buffer_pool(&layer->data_vio_pool);
 		// fall through
 
 	case LAYER_SIMPLE_THINGS_INITIALIZED:
-		if (layer->compression_context != NULL) {
-			free_compression_context(layer);
+		if (layer->cpu_queue_contexts != NULL) {
+			free_cpu_queue_contexts(layer);
 		}
+		if (layer->hash_transform != NULL) {
+			crypto_free_shash(layer->hash_transform);
+		}
+		free_vdo_compressor(layer->compressor);
 		if (layer->dedupe_index != NULL) {
 			finish_dedupe_index(layer->dedupe_index);
 		}
 		free_batch_processor(&layer->data_vio_releaser);
+		free_batchers(config->thread_counts.cpu_threads,
+			      &layer->hash_batchers);
+		free_batchers(config->thread_counts.cpu_threads,
+			      &layer->compress_batchers);
 		unregister_vdo(&layer->vdo);
+		bioset_exit(&layer->bio_split_set);
 		break;
 
 	default:
@@ -721,10 +1475,17 @@ void free_kernel_layer(struct kernel_layer *layer)
 	if (used_bio_ack_queue) {
 		free_work_queue(&layer->bio_ack_queue);
 	}
+	free_batchers(config->thread_counts.bio_ack_threads,
+		      &layer->bio_ack_batchers);
 	if (layer->vdo.io_submitter) {
 		free_io_submitter(layer->vdo.io_submitter);
 	}
 
+	free_rate_tracker(&layer->rates);
+	free_compressibility_tracker(&layer->compressibility);
+	free_dedupe_exemptions(&layer->dedupe_exemptions);
+	free_post_deduper(&layer->post_deduper);
+	free_access_trace(&layer->access_trace);
 	free_dedupe_index(&layer->dedupe_index);
 	destroy_vdo(&layer->vdo);
 }
@@ -790,6 +1551,7 @@ int start_kernel_layer(struct kernel_layer *layer, char **reason)
 		return result;
 	}
 	layer->stats_added = true;
+	start_rate_tracker(layer->rates);
 
 	if (layer->vdo.device_config->deduplication) {
 		// Don't try to load or rebuild the index first (and log
@@ -798,6 +1560,8 @@ int start_kernel_layer(struct kernel_layer *layer, char **reason)
 		start_dedupe_index(layer->dedupe_index, was_new(&layer->vdo));
 	}
 
+	start_post_deduper(layer->post_deduper);
+
 	layer->vdo.allocations_allowed = false;
 	return VDO_SUCCESS;
 }
@@ -810,6 +1574,7 @@ void stop_kernel_layer(struct kernel_layer *layer)
 	// Stop services that need to gather VDO statistics from the worker
 	// threads.
 	if (layer->stats_added) {
+		stop_rate_tracker(layer->rates);
 		layer->stats_added = false;
 		init_completion(&layer->stats_shutdown);
 		kobject_put(&layer->vdo.stats_directory);
@@ -884,7 +1649,10 @@ int suspend_kernel_layer(struct kernel_layer *layer)
 	 * Attempt to flush all I/O before completing post suspend work. We
 	 * believe a suspended device is expected to have persisted all data
 	 * written before the suspend, even if it hasn't been flushed yet.
+	 * The post-process deduper must stop launching reads first, or the
+	 * device might never go idle.
 	 */
+	stop_post_deduper(layer->post_deduper);
 	vdo_wait_for_no_requests_active(&layer->vdo);
 	result = synchronous_flush(layer);
 	if (result != VDO_SUCCESS) {
@@ -892,9 +1660,10 @@ int suspend_kernel_layer(struct kernel_layer *layer)
 	}
 
 	/*
-	 * Suspend the VDO, writing out all dirty metadata if the no-flush flag
-	 * was not set on the dmsetup suspend call. This will ensure that we
-	 * don't have cause to write while suspended [VDO-4402].
+	 * Suspend the VDO, writing out all dirty metadata unless the no-flush
+	 * flag was set on the dmsetup suspend call or the suspend is only to
+	 * reload a compatible table. This will ensure that we don't have
+	 * cause to write while suspended [VDO-4402].
 	 */
 	suspend_result = suspend_vdo(&layer->vdo);
 
@@ -925,6 +1694,7 @@ int resume_kernel_layer(struct kernel_layer *layer)
 	}
 
 	set_kernel_layer_state(layer, LAYER_RUNNING);
+	start_post_deduper(layer->post_deduper);
 	return VDO_SUCCESS;
 }
 
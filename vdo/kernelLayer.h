@@ -22,6 +22,7 @@
 #ifndef KERNELLAYER_H
 #define KERNELLAYER_H
 
+#include <crypto/hash.h>
 #include <linux/device-mapper.h>
 #include <linux/list.h>
 
@@ -38,6 +39,7 @@
 
 #include "batchProcessor.h"
 #include "bufferPool.h"
+#include "compressor.h"
 #include "deadlockQueue.h"
 #include "deviceConfig.h"
 #include "histogram.h"
@@ -72,6 +74,23 @@ struct atomic_bio_stats {
 	atomic64_t fua; // Number of REQ_FUA bios
 };
 
+enum {
+	/** The acceleration factor of LZ4_compress_default() */
+	VDO_DEFAULT_LZ4_ACCELERATION = 1,
+	/** Beyond this factor LZ4 finds almost no matches in a 4K block */
+	VDO_MAXIMUM_LZ4_ACCELERATION = 64,
+};
+
+/**
+ * The private data of each thread of the CPU queue.
+ **/
+struct cpu_queue_context {
+	/** The compressor state of the thread */
+	struct vdo_compressor_context *compressor_context;
+	/** The descriptor for computing chunk names, if not MurmurHash3 */
+	struct shash_desc *hash_desc;
+};
+
 /**
  * The VDO representation of the target device
  **/
@@ -82,6 +101,8 @@ struct kernel_layer {
 	/** Accessed from multiple threads */
 	enum kernel_layer_state state;
 	atomic_t processing_message;
+	/** The NUMA node on which to place the next VDO thread, if any */
+	int next_thread_node;
 
 	struct vdo vdo;
 
@@ -90,14 +111,47 @@ struct kernel_layer {
 	 * CPU-intensive, non-blocking work.
 	 **/
 	struct vdo_work_queue *cpu_queue;
-	/** N blobs of context data for LZ4 code, one per CPU thread. */
-	char **compression_context;
+	/** N blobs of context data for the CPU queue, one per CPU thread. */
+	struct cpu_queue_context **cpu_queue_contexts;
+	/** The compression engine configured for this device */
+	struct vdo_compressor *compressor;
+	/** The crypto transform for chunk names, if not MurmurHash3 */
+	struct crypto_shash *hash_transform;
+	/** The LZ4 acceleration factor currently used by the CPU queue */
+	atomic_t compression_acceleration;
+	/** The largest acceleration factor the CPU queue may adapt up to */
+	unsigned int maximum_compression_acceleration;
+	/**
+	 * Whether compressed reads fetch only the sectors holding the
+	 * requested fragment rather than the whole block
+	 **/
+	bool compressed_sector_reads;
 	/** Optional work queue for calling bio_endio. */
 	struct vdo_work_queue *bio_ack_queue;
+	/** Whether the bio ack queue is the one shared by all VDOs */
+	bool shared_bio_ack_queue;
+	/** The number of bios waiting for a bio ack thread */
+	atomic_t bio_acks_pending;
 	// Memory allocation
 	struct buffer_pool *data_vio_pool;
+	/** The read and scratch blocks data_vios take only when needed */
+	struct buffer_pool *block_buffer_pool;
+	/** The latency histograms of the stages data_vios go through */
+	struct data_vio_stage_histograms *stage_histograms;
+	/** For splitting multi-block bios into one bio per data_vio */
+	struct bio_set bio_split_set;
 	// UDS index info
 	struct dedupe_index *dedupe_index;
+	/** The deferred deduplication of newly written blocks */
+	struct post_deduper *post_deduper;
+	/** The sampled trace of completed requests */
+	struct access_trace *access_trace;
+	/** The logical blocks whose writes bypass deduplication */
+	struct dedupe_exemptions *dedupe_exemptions;
+	/** The regions of logical space which have not been compressing */
+	struct compressibility_tracker *compressibility;
+	/** The per-second rates sampled for cheap monitoring */
+	struct rate_tracker *rates;
 	// Statistics
 	atomic64_t bios_submitted;
 	atomic64_t bios_completed;
@@ -121,6 +175,14 @@ struct kernel_layer {
 
 	/* For returning batches of data_vios to their pool */
 	struct batch_processor *data_vio_releaser;
+	/* For hashing data_vios in batches, one batcher per CPU thread */
+	struct batch_processor **hash_batchers;
+	/* For compressing data_vios in batches, one batcher per CPU thread */
+	struct batch_processor **compress_batchers;
+	/* For acknowledging bios in batches, one batcher per bio ack thread */
+	struct batch_processor **bio_ack_batchers;
+	/* The number of bio ack batchers */
+	unsigned int bio_ack_batcher_count;
 
 	// Statistics reporting
 	/* Protects the *_stats_storage structs */
@@ -196,6 +258,17 @@ prepare_to_modify_kernel_layer(struct kernel_layer *layer,
 int __must_check
 modify_kernel_layer(struct kernel_layer *layer, struct device_config *config);
 
+/**
+ * Choose the NUMA node for a new VDO thread. When NUMA placement is enabled,
+ * successive threads are spread across the online nodes in turn.
+ *
+ * @param layer  The kernel layer which will own the thread
+ *
+ * @return The node to bind the thread to, or NUMA_NO_NODE if the thread
+ *         should not be bound
+ **/
+int get_next_vdo_thread_node(struct kernel_layer *layer);
+
 /**
  * Free a kernel physical layer.
  *
@@ -430,5 +503,9 @@ int resize_logical(struct kernel_layer *layer, block_count_t logical_count);
  **/
 void complete_many_requests(struct vdo *vdo, uint32_t count);
 
+// The number of bio ack threads shared by all the VDOs on the host which
+// use bio ack threads; zero gives each VDO threads of its own.
+extern unsigned int shared_ack_threads;
+
 
 #endif /* KERNELLAYER_H */
@@ -41,6 +41,24 @@ struct memory_usage {
 	uint64_t bytes_used;
 	/** Maximum tracked bytes allocated. */
 	uint64_t peak_bytes_used;
+	/** Tracked bytes currently mapped with huge pages. */
+	uint64_t huge_page_bytes_used;
+	/** Tracked bytes currently used for reference counts. */
+	uint64_t ref_counts_bytes_used;
+	/** Tracked bytes currently used by the block map page caches. */
+	uint64_t page_cache_bytes_used;
+	/** Tracked bytes currently used by slab journals. */
+	uint64_t slab_journal_bytes_used;
+	/** Tracked bytes currently used by the data_vio pools. */
+	uint64_t data_vio_bytes_used;
+	/** Tracked bytes currently used for hash locks. */
+	uint64_t hash_lock_bytes_used;
+	/** Tracked bytes currently used by index delta lists. */
+	uint64_t index_delta_memory_bytes_used;
+	/** Tracked bytes currently used by index page caches. */
+	uint64_t index_page_cache_bytes_used;
+	/** Tracked bytes currently used by sparse chapter caches. */
+	uint64_t sparse_cache_bytes_used;
 };
 
 /** UDS index statistics */
@@ -59,6 +77,10 @@ struct index_statistics {
 	uint64_t updates_found;
 	/** Number of update calls that added a new entry */
 	uint64_t updates_not_found;
+	/** Number of volume page lookups which found the page cached */
+	uint64_t page_cache_hits;
+	/** Number of volume page lookups which had to read the page */
+	uint64_t page_cache_misses;
 	/** Current number of dedupe queries that are in flight */
 	uint32_t curr_dedupe_queries;
 	/** Maximum number of dedupe queries that have been in flight */
@@ -80,6 +102,28 @@ struct kernel_statistics {
 	uint64_t flush_out;
 	/** Logical block size */
 	uint64_t logical_block_size;
+	/** The LZ4 acceleration factor currently used for compression */
+	uint64_t compression_acceleration;
+	/** Compressed reads and verifies served from the read cache */
+	uint64_t read_cache_hits;
+	/** Compressed reads and verifies which went to storage */
+	uint64_t read_cache_misses;
+	/** Writes logged for post-process deduplication */
+	uint64_t post_dedupe_deferred;
+	/** Logged blocks read back and checked for duplicates */
+	uint64_t post_dedupe_checked;
+	/** Checked blocks remapped to share an existing copy */
+	uint64_t post_dedupe_shared;
+	/** Logged blocks not yet checked */
+	uint64_t post_dedupe_pending;
+	/** Writes which bypassed deduplication because of an exemption */
+	uint64_t dedupe_exempt_writes;
+	/** Writes not compressed because their region has been incompressible */
+	uint64_t compression_region_skips;
+	/** Blocks compressed by an offload device */
+	uint64_t compression_offloads;
+	/** Blocks compressed on the CPU because the offload device was busy */
+	uint64_t compression_offload_fallbacks;
 	/** Bios submitted into VDO from above */
 	struct bio_stats bios_in;
 	struct bio_stats bios_in_partial;
@@ -24,10 +24,13 @@
 
 #include "types.h"
 
+struct access_trace;
 struct atomic_bio_stats;
+struct data_vio_stage_histograms;
 struct dedupe_context;
 struct dedupe_index;
 struct kernel_layer;
+struct rate_tracker;
 struct vdo_work_item;
 struct vdo_work_queue;
 
@@ -32,6 +32,8 @@
 #include "memoryAlloc.h"
 #include "permassert.h"
 
+#include "blockMap.h"
+#include "packer.h"
 #include "physicalLayer.h"
 #include "readOnlyNotifier.h"
 #include "statistics.h"
@@ -54,8 +56,15 @@ static void start_vdo_request_queue(void *ptr)
 {
 	struct vdo_thread *thread = ptr;
 	struct vdo *vdo = thread->vdo;
+	// The admin thread is the journal thread.
+	bool is_journal = (thread->thread_id ==
+			   get_journal_zone_thread(get_thread_config(vdo)));
+
 	register_allocating_thread(&thread->allocating_thread,
 				   &vdo->allocations_allowed);
+	bind_to_vdo_thread_class_cpus(is_journal ?
+				      VDO_THREAD_CLASS_JOURNAL :
+				      VDO_THREAD_CLASS_ZONE);
 }
 
 /**********************************************************************/
@@ -76,9 +85,15 @@ static const struct vdo_work_queue_type request_queue_type = {
 			{ .name = "req_flush",
 			  .code = REQ_Q_ACTION_FLUSH,
 			  .priority = 2 },
+			{ .name = "req_high",
+			  .code = REQ_Q_ACTION_HIGH,
+			  .priority = 2 },
 			{ .name = "req_map_bio",
 			  .code = REQ_Q_ACTION_MAP_BIO,
 			  .priority = 0 },
+			{ .name = "req_map_read",
+			  .code = REQ_Q_ACTION_MAP_READ,
+			  .priority = 1 },
 			{ .name = "req_sync",
 			  .code = REQ_Q_ACTION_SYNC,
 			  .priority = 2 },
@@ -277,19 +292,83 @@ static void set_compressing_callback(struct vdo_completion *completion)
 	complete(&sync->completion);
 }
 
+/**
+ * Flush one packer zone, then tell the function waiting on completion to go
+ * ahead.
+ *
+ * @param completion  The completion
+ **/
+static void flush_packer_zone_callback(struct vdo_completion *completion)
+{
+	struct sync_completion *sync = as_sync_completion(completion);
+	flush_packer((struct packer *) sync->data);
+	complete(&sync->completion);
+}
+
 /***********************************************************************/
 bool set_kvdo_compressing(struct vdo *vdo, bool enable_compression)
 {
 	struct vdo_compress_data data;
+	const struct thread_config *thread_config = get_thread_config(vdo);
+	zone_count_t zone;
 
 	data.enable = enable_compression;
 	perform_vdo_operation(vdo,
 			      set_compressing_callback,
 			      &data,
-			      get_packer_zone_thread(get_thread_config(vdo)));
+			      get_packer_zone_thread(thread_config, 0));
+	if (!data.was_enabled || enable_compression) {
+		return data.was_enabled;
+	}
+
+	// Zone 0 was flushed by set_vdo_compressing(); do the rest.
+	for (zone = 1; zone < thread_config->packer_zone_count; zone++) {
+		perform_vdo_operation(vdo,
+				      flush_packer_zone_callback,
+				      get_packer_zone(vdo->packer_zones, zone),
+				      get_packer_zone_thread(thread_config,
+							     zone));
+	}
+
 	return data.was_enabled;
 }
 
+/**
+ * Resize the page cache of one block map zone, then tell the function waiting
+ * on completion to go ahead.
+ *
+ * @param completion  The completion
+ **/
+static void resize_block_map_cache_callback(struct vdo_completion *completion)
+{
+	struct sync_completion *sync = as_sync_completion(completion);
+	resize_block_map_zone_cache((struct block_map_zone *) sync->data);
+	complete(&sync->completion);
+}
+
+/***********************************************************************/
+int resize_kvdo_block_map_cache(struct vdo *vdo, page_count_t cache_size)
+{
+	struct block_map *map = get_block_map(vdo);
+	const struct thread_config *thread_config = get_thread_config(vdo);
+	zone_count_t zone;
+
+	int result = prepare_to_resize_block_map_cache(map, cache_size);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	for (zone = 0; zone < thread_config->logical_zone_count; zone++) {
+		perform_vdo_operation(vdo,
+				      resize_block_map_cache_callback,
+				      get_block_map_zone(map, zone),
+				      get_logical_zone_thread(thread_config,
+							      zone));
+	}
+
+	return VDO_SUCCESS;
+}
+
 /**********************************************************************/
 struct vdo_read_only_data {
 	int result;
@@ -317,28 +396,13 @@ void set_vdo_read_only(struct vdo *vdo, int result)
 			      get_admin_thread(get_thread_config(vdo)));
 }
 
-/**
- * Does the work of calling the vdo statistics gathering tool
- *
- * @param completion  The sync completion
- **/
-static void get_vdo_statistics_callback(struct vdo_completion *completion)
-{
-	struct sync_completion *sync = as_sync_completion(completion);
-	struct vdo_statistics *stats = (struct vdo_statistics *) sync->data;
-
-	get_vdo_statistics(sync->vdo, stats);
-	complete(&sync->completion);
-}
-
 /***********************************************************************/
 void get_kvdo_statistics(struct vdo *vdo, struct vdo_statistics *stats)
 {
+	// Every component publishes its statistics for lock-free readers, so
+	// there is no need to gather them on the admin thread.
 	memset(stats, 0, sizeof(struct vdo_statistics));
-	perform_vdo_operation(vdo,
-			      get_vdo_statistics_callback,
-			      stats,
-			      get_admin_thread(get_thread_config(vdo)));
+	get_vdo_statistics(vdo, stats);
 }
 
 /**********************************************************************/
@@ -374,6 +438,12 @@ void enqueue_vdo_thread_work(struct vdo_thread *thread,
 	enqueue_work_queue(thread->request_queue, item);
 }
 
+/**********************************************************************/
+int get_vdo_thread_node(struct vdo *vdo, thread_id_t thread_id)
+{
+	return get_work_queue_node(vdo->threads[thread_id].request_queue);
+}
+
 /**********************************************************************/
 void enqueue_vdo_work(struct vdo *vdo,
 		      struct vdo_work_item *item,
@@ -405,6 +475,29 @@ static void vdo_enqueue_work(struct vdo_work_item *work_item)
 				    work_item));
 }
 
+/**
+ * Check whether a completion's callback should run ahead of the data_vio
+ * steps queued on its thread. These are the completions which flushes and
+ * journal commits wait on, so delaying them delays every waiting request.
+ *
+ * @param completion  The completion to check
+ *
+ * @return <code>true</code> if the callback should be enqueued at high
+ *         priority
+ **/
+static bool is_high_priority_completion(struct vdo_completion *completion)
+{
+	switch (completion->type) {
+	case FLUSH_NOTIFICATION_COMPLETION:
+	case GENERATION_FLUSHED_COMPLETION:
+	case RECOVERY_JOURNAL_COMMIT_COMPLETION:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
 /**********************************************************************/
 void enqueue_vdo_completion(struct vdo_completion *completion)
 {
@@ -421,30 +514,64 @@ void enqueue_vdo_completion(struct vdo_completion *completion)
 
 	setup_work_item(&completion->work_item, vdo_enqueue_work,
 			completion->callback,
-			REQ_Q_ACTION_COMPLETION);
+			(is_high_priority_completion(completion) ?
+			 REQ_Q_ACTION_HIGH : REQ_Q_ACTION_COMPLETION));
 	enqueue_vdo_thread_work(&vdo->threads[thread_id],
 				&completion->work_item);
 }
 
 /**********************************************************************/
-thread_id_t get_callback_thread_id(void)
+void enqueue_vdo_completions(struct vdo_completion *completions[],
+			     unsigned int count)
 {
-	struct vdo_thread *thread = get_work_queue_private_data();
-	thread_id_t thread_id;
+	struct vdo *vdo = completions[0]->vdo;
+	thread_id_t thread_id = completions[0]->callback_thread_id;
+	struct vdo_work_item *items[MAX_BATCHED_COMPLETIONS];
+	unsigned int i;
+
+	if (count == 1) {
+		enqueue_vdo_completion(completions[0]);
+		return;
+	}
 
-	if (thread == NULL) {
-		return INVALID_THREAD_ID;
+	BUG_ON(count > MAX_BATCHED_COMPLETIONS);
+	BUG_ON(thread_id >= vdo->initialized_thread_count);
+	for (i = 0; i < count; i++) {
+		struct vdo_completion *completion = completions[i];
+
+		setup_work_item(&completion->work_item,
+				vdo_enqueue_work,
+				completion->callback,
+				(is_high_priority_completion(completion) ?
+				 REQ_Q_ACTION_HIGH : REQ_Q_ACTION_COMPLETION));
+		items[i] = &completion->work_item;
 	}
 
-	thread_id = thread->thread_id;
+	enqueue_work_queue_batch(vdo->threads[thread_id].request_queue,
+				 items,
+				 count);
+}
+
+/**********************************************************************/
+struct vdo_thread *get_current_vdo_thread(void)
+{
+	struct vdo_thread *thread = get_work_queue_private_data();
 
-	if (PARANOID_THREAD_CONSISTENCY_CHECKS) {
+	if (PARANOID_THREAD_CONSISTENCY_CHECKS && (thread != NULL)) {
 		struct vdo *vdo = thread->vdo;
 		struct kernel_layer *kernel_layer = vdo_as_kernel_layer(vdo);
 		BUG_ON(&kernel_layer->vdo != vdo);
-		BUG_ON(thread_id >= vdo->initialized_thread_count);
-		BUG_ON(thread != &vdo->threads[thread_id]);
+		BUG_ON(thread->thread_id >= vdo->initialized_thread_count);
+		BUG_ON(thread != &vdo->threads[thread->thread_id]);
 	}
 
-	return thread_id;
+	return thread;
+}
+
+/**********************************************************************/
+thread_id_t get_callback_thread_id(void)
+{
+	struct vdo_thread *thread = get_current_vdo_thread();
+
+	return ((thread == NULL) ? INVALID_THREAD_ID : thread->thread_id);
 }
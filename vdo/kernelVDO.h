@@ -33,7 +33,9 @@
 enum {
 	REQ_Q_ACTION_COMPLETION,
 	REQ_Q_ACTION_FLUSH,
+	REQ_Q_ACTION_HIGH,
 	REQ_Q_ACTION_MAP_BIO,
+	REQ_Q_ACTION_MAP_READ,
 	REQ_Q_ACTION_SYNC,
 	REQ_Q_ACTION_VIO_CALLBACK
 };
@@ -103,7 +105,18 @@ void dump_vdo_work_queue(struct vdo *vdo);
 bool set_kvdo_compressing(struct vdo *vdo, bool enable_compression);
 
 /**
- * Gets the latest statistics gathered by the base code.
+ * Change the size of the block map page cache while the vdo is running.
+ *
+ * @param vdo         The vdo object
+ * @param cache_size  The new size of the cache, in pages
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int resize_kvdo_block_map_cache(struct vdo *vdo, page_count_t cache_size);
+
+/**
+ * Gets the latest statistics gathered by the base code. This may be called
+ * from any thread, and does not wait on any of the vdo's threads.
  *
  * @param vdo    the vdo object
  * @param stats  the statistics struct to fill in
@@ -140,6 +153,16 @@ int vdo_resize_logical(struct vdo *vdo, block_count_t logical_count);
 void set_vdo_read_only(struct vdo *vdo, int result);
 
 
+/**
+ * Get the NUMA node on which a base code thread runs.
+ *
+ * @param vdo        The vdo
+ * @param thread_id  The ID of the thread
+ *
+ * @return The node, or NUMA_NO_NODE if the thread is not bound to a node
+ **/
+int __must_check get_vdo_thread_node(struct vdo *vdo, thread_id_t thread_id);
+
 /**
  * Enqueue a work item to be processed in the base code context.
  *
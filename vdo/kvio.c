@@ -50,10 +50,15 @@ static void vdo_handle_vio_callback(struct vdo_work_item *item)
 /**********************************************************************/
 void enqueue_vio_callback(struct vio *vio)
 {
+	/*
+	 * Metadata I/O, such as journal and block map page writes, is what
+	 * flushes and waiting data_vios depend on, so finish it first.
+	 */
 	enqueue_vio(vio,
 		    vdo_handle_vio_callback,
 		    vio_as_completion(vio)->callback,
-		    REQ_Q_ACTION_VIO_CALLBACK);
+		    (is_metadata_vio(vio) ?
+		     REQ_Q_ACTION_HIGH : REQ_Q_ACTION_VIO_CALLBACK));
 }
 
 /**********************************************************************/
@@ -130,6 +135,18 @@ void submit_metadata_vio(struct vio *vio)
 	struct bio *bio = vio->bio;
 	unsigned int bi_opf;
 	struct kernel_layer *layer = vdo_as_kernel_layer(vio->vdo);
+	bool volatile_cache = vdo_has_volatile_write_cache(vio->vdo);
+
+	if (is_empty_flush_vio(vio) && !volatile_cache) {
+		/*
+		 * Every write we have seen complete is already durable, so
+		 * there is nothing for the flush to do. Skip the round trip
+		 * to the device.
+		 */
+		continue_vio(vio, VDO_SUCCESS);
+		return;
+	}
+
 	if (is_read_vio(vio)) {
 		ASSERT_LOG_ONLY(!vio_requires_flush_before(vio),
 				"read vio does not require flush before");
@@ -140,7 +157,7 @@ void submit_metadata_vio(struct vio *vio)
 				 || (state == LAYER_RESUMING)
 				 || (state = LAYER_STARTING)),
 				"write metadata in allowed state %d", state);
-		if (vio_requires_flush_before(vio)) {
+		if (vio_requires_flush_before(vio) && volatile_cache) {
 			bi_opf = REQ_OP_WRITE | REQ_PREFLUSH;
 		} else {
 			bi_opf = REQ_OP_WRITE;
@@ -188,3 +205,19 @@ void submit_metadata_vio(struct vio *vio)
 	// Perform the metadata IO, using the metadata vio's own bio.
 	vdo_submit_bio(bio, get_metadata_action(vio));
 }
+
+/**********************************************************************/
+void submit_discard_vio(struct vio *vio, block_count_t count)
+{
+	struct bio *bio = vio->bio;
+	int result = reset_bio_with_buffer(bio, NULL, vio, complete_async_bio,
+					   REQ_OP_DISCARD, vio->physical);
+	if (result != VDO_SUCCESS) {
+		continue_vio(vio, result);
+		return;
+	}
+
+	// A discard carries no data, so its size must be set explicitly.
+	bio->bi_iter.bi_size = count * VDO_BLOCK_SIZE;
+	vdo_submit_bio(bio, BIO_Q_ACTION_METADATA);
+}
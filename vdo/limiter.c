@@ -21,27 +21,160 @@
 
 #include "limiter.h"
 
+#include <linux/cpumask.h>
 #include <linux/sched.h>
 
+#include "statusCodes.h"
+
+enum {
+	// The most free permits a single CPU will cache
+	LIMITER_MAXIMUM_BATCH = 32,
+};
+
+/**
+ * Compute how many free permits each CPU may cache, keeping the total which
+ * could be stranded on idle CPUs a small fraction of the limit.
+ *
+ * @param limit  The limit of the limiter
+ *
+ * @return The per-CPU batch size
+ **/
+static uint32_t compute_batch(uint32_t limit)
+{
+	return min_t(uint32_t,
+		     LIMITER_MAXIMUM_BATCH,
+		     limit / (4 * num_possible_cpus()));
+}
+
+/**
+ * Sum the permits cached on all CPUs.
+ *
+ * @param limiter  The limiter
+ *
+ * @return The number of cached permits
+ **/
+static uint32_t count_cached_permits(struct limiter *limiter)
+{
+	uint32_t cached = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		cached += atomic_read(per_cpu_ptr(limiter->cached, cpu));
+	}
+	return cached;
+}
+
+/**
+ * Return the permits cached on every CPU to the shared pool.
+ *
+ * The limiter's lock must already be locked.
+ *
+ * @param limiter  The limiter
+ **/
+static void reclaim_cached_permits_locked(struct limiter *limiter)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		limiter->issued -=
+			atomic_xchg(per_cpu_ptr(limiter->cached, cpu), 0);
+	}
+}
+
+/**
+ * Return permits to the shared pool, waking waiters if there are any.
+ *
+ * @param limiter  The limiter
+ * @param count    The number of permits to return
+ **/
+static void return_permits(struct limiter *limiter, uint32_t count)
+{
+	spin_lock(&limiter->lock);
+	limiter->issued -= count;
+	spin_unlock(&limiter->lock);
+	if (waitqueue_active(&limiter->waiter_queue)) {
+		wake_up_nr(&limiter->waiter_queue, count);
+	}
+}
+
+/**
+ * Take up to count permits from the current CPU's cache without locking.
+ *
+ * @param limiter  The limiter
+ * @param count    The maximum number of permits wanted
+ *
+ * @return The number of permits taken, possibly zero
+ **/
+static uint32_t take_cached_permits(struct limiter *limiter, uint32_t count)
+{
+	// Any CPU's cache may be used safely, so preemption need not be
+	// disabled.
+	atomic_t *cached = raw_cpu_ptr(limiter->cached);
+	int available = atomic_read(cached);
+
+	while (available > 0) {
+		int taken = min_t(int, available, count);
+
+		if (atomic_try_cmpxchg(cached, &available,
+				       available - taken)) {
+			return taken;
+		}
+	}
+	return 0;
+}
+
 /**********************************************************************/
 void get_limiter_values_atomically(struct limiter *limiter,
 				   uint32_t *active,
 				   uint32_t *maximum)
 {
+	uint32_t cached;
+
 	spin_lock(&limiter->lock);
-	*active = limiter->active;
+	// A permit moving between the caches of two CPUs while they are read
+	// may be counted twice, so don't let the estimate go negative.
+	cached = count_cached_permits(limiter);
+	*active = ((limiter->issued > cached) ? limiter->issued - cached : 0);
+	if (*active > limiter->maximum) {
+		limiter->maximum = *active;
+	}
 	*maximum = limiter->maximum;
 	spin_unlock(&limiter->lock);
 }
 
 /**********************************************************************/
-void initialize_limiter(struct limiter *limiter, uint32_t limit)
+int initialize_limiter(struct limiter *limiter, uint32_t limit)
 {
-	limiter->active = 0;
+	limiter->cached = alloc_percpu(atomic_t);
+	if (limiter->cached == NULL) {
+		return -ENOMEM;
+	}
+
+	limiter->issued = 0;
 	limiter->limit = limit;
+	limiter->batch = compute_batch(limit);
 	limiter->maximum = 0;
 	init_waitqueue_head(&limiter->waiter_queue);
 	spin_lock_init(&limiter->lock);
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void uninitialize_limiter(struct limiter *limiter)
+{
+	free_percpu(limiter->cached);
+	limiter->cached = NULL;
+}
+
+/**********************************************************************/
+void set_limiter_limit(struct limiter *limiter, uint32_t limit)
+{
+	spin_lock(&limiter->lock);
+	WRITE_ONCE(limiter->limit, limit);
+	WRITE_ONCE(limiter->batch, compute_batch(limit));
+	reclaim_cached_permits_locked(limiter);
+	spin_unlock(&limiter->lock);
+	wake_up_all(&limiter->waiter_queue);
 }
 
 /**********************************************************************/
@@ -49,7 +182,8 @@ bool limiter_is_idle(struct limiter *limiter)
 {
 	bool idle;
 	spin_lock(&limiter->lock);
-	idle = limiter->active == 0;
+	reclaim_cached_permits_locked(limiter);
+	idle = limiter->issued == 0;
 
 	spin_unlock(&limiter->lock);
 	return idle;
@@ -58,79 +192,127 @@ bool limiter_is_idle(struct limiter *limiter)
 /**********************************************************************/
 void limiter_release_many(struct limiter *limiter, uint32_t count)
 {
-	spin_lock(&limiter->lock);
-	limiter->active -= count;
-	spin_unlock(&limiter->lock);
+	atomic_t *cached = raw_cpu_ptr(limiter->cached);
+	uint32_t batch = READ_ONCE(limiter->batch);
+	int value;
+
+	atomic_add(count, cached);
+	// Pairs with the barrier in prepare_to_wait_exclusive(): either a
+	// waiter reclaiming the caches will see these permits, or we will see
+	// the waiter and hand them over directly.
+	smp_mb__after_atomic();
 	if (waitqueue_active(&limiter->waiter_queue)) {
-		wake_up_nr(&limiter->waiter_queue, count);
+		batch = 0;
+	}
+
+	value = atomic_read(cached);
+	while (value > (int) batch) {
+		if (atomic_try_cmpxchg(cached, &value, batch)) {
+			return_permits(limiter, value - batch);
+			return;
+		}
 	}
 }
 
+/**
+ * Take permits from the shared pool, reclaiming the permits cached on all
+ * CPUs if the pool is empty. If nobody is waiting, additional permits are
+ * taken to refill the current CPU's cache.
+ *
+ * @param limiter  The limiter
+ * @param count    The maximum number of permits wanted
+ *
+ * @return The number of permits granted, possibly zero
+ **/
+static uint32_t take_pooled_permits(struct limiter *limiter, uint32_t count)
+{
+	uint32_t wanted = count;
+	uint32_t granted;
+	uint32_t active;
+
+	spin_lock(&limiter->lock);
+	if (!waitqueue_active(&limiter->waiter_queue)) {
+		wanted += limiter->batch;
+	}
+
+	if (limiter->issued >= limiter->limit) {
+		reclaim_cached_permits_locked(limiter);
+	}
+
+	granted = ((limiter->issued < limiter->limit)
+		   ? min(wanted, limiter->limit - limiter->issued)
+		   : 0);
+	limiter->issued += granted;
+	if (granted > count) {
+		atomic_add(granted - count, raw_cpu_ptr(limiter->cached));
+		granted = count;
+	}
+
+	// Permits cached on other CPUs are not subtracted here, so this
+	// slightly overstates the number in use.
+	active = limiter->issued - atomic_read(raw_cpu_ptr(limiter->cached));
+	if (active > limiter->maximum) {
+		limiter->maximum = active;
+	}
+	spin_unlock(&limiter->lock);
+	return granted;
+}
+
 /**********************************************************************/
 void limiter_wait_for_idle(struct limiter *limiter)
 {
-	spin_lock(&limiter->lock);
-	while (limiter->active > 0) {
+	for (;;) {
 		DEFINE_WAIT(wait);
 
 		prepare_to_wait_exclusive(&limiter->waiter_queue,
 					  &wait,
 					  TASK_UNINTERRUPTIBLE);
-		spin_unlock(&limiter->lock);
+		if (limiter_is_idle(limiter)) {
+			finish_wait(&limiter->waiter_queue, &wait);
+			return;
+		}
 		io_schedule();
-		spin_lock(&limiter->lock);
 		finish_wait(&limiter->waiter_queue, &wait);
-	};
-	spin_unlock(&limiter->lock);
+	}
 }
 
-/**
- * Take one permit from the limiter, if one is available, and update
- * the maximum active count if appropriate.
- *
- * The limiter's lock must already be locked.
- *
- * @param limiter  The limiter to update
- *
- * @return true iff the permit was acquired
- **/
-static bool take_permit_locked(struct limiter *limiter)
+/**********************************************************************/
+void limiter_wait_for_one_free(struct limiter *limiter)
 {
-	if (limiter->active >= limiter->limit) {
-		return false;
-	}
-	limiter->active += 1;
-	if (limiter->active > limiter->maximum) {
-		limiter->maximum = limiter->active;
-	}
-	return true;
+	limiter_wait_for_some_free(limiter, 1);
 }
 
 /**********************************************************************/
-void limiter_wait_for_one_free(struct limiter *limiter)
+uint32_t limiter_wait_for_some_free(struct limiter *limiter, uint32_t count)
 {
-	spin_lock(&limiter->lock);
-	while (!take_permit_locked(limiter)) {
+	uint32_t granted = take_cached_permits(limiter, count);
+
+	if (granted > 0) {
+		return granted;
+	}
+
+	granted = take_pooled_permits(limiter, count);
+	while (granted == 0) {
 		DEFINE_WAIT(wait);
 
+		// Get on the queue before looking again so that a release
+		// which misses the reclaim will see us and wake us.
 		prepare_to_wait_exclusive(&limiter->waiter_queue,
 					  &wait,
 					  TASK_UNINTERRUPTIBLE);
-		spin_unlock(&limiter->lock);
-		io_schedule();
-		spin_lock(&limiter->lock);
+		granted = take_pooled_permits(limiter, count);
+		if (granted == 0) {
+			io_schedule();
+		}
 		finish_wait(&limiter->waiter_queue, &wait);
-	};
-	spin_unlock(&limiter->lock);
+	}
+
+	return granted;
 }
 
 /**********************************************************************/
 bool limiter_poll(struct limiter *limiter)
 {
-	bool acquired;
-	spin_lock(&limiter->lock);
-	acquired = take_permit_locked(limiter);
-
-	spin_unlock(&limiter->lock);
-	return acquired;
+	return ((take_cached_permits(limiter, 1) > 0) ||
+		(take_pooled_permits(limiter, 1) > 0));
 }
@@ -22,12 +22,21 @@
 #ifndef LIMITER_H
 #define LIMITER_H
 
+#include <linux/percpu.h>
 #include <linux/wait.h>
 
+#include "atomicDefs.h"
+
 /*
  * A limiter is a fancy counter used to limit resource usage.  We have a
  * limit to number of resources that we are willing to use, and a limiter
  * holds us to that limit.
+ *
+ * Permits are issued from a shared pool in batches, and each CPU caches the
+ * unused part of its batch, as well as permits released on that CPU, so that
+ * most acquisitions and releases touch only a per-CPU counter. The lock is
+ * taken only to refill or spill a CPU's cache, or when the pool runs dry and
+ * the permits cached on other CPUs must be reclaimed.
  */
 
 struct limiter {
@@ -35,16 +44,22 @@ struct limiter {
 	spinlock_t lock;
 	// The queue of threads waiting for a resource to become available
 	wait_queue_head_t waiter_queue;
-	// The number of resources in use
-	uint32_t active;
+	// The number of resources either in use or cached on some CPU
+	uint32_t issued;
 	// The maximum number number of resources that have ever been in use
 	uint32_t maximum;
 	// The limit to the number of resources that are allowed to be used
 	uint32_t limit;
+	// The number of free permits each CPU may cache
+	uint32_t batch;
+	// The free permits cached on each CPU
+	atomic_t __percpu *cached;
 };
 
 /**
- * Get the limiter variable values (atomically under the lock)
+ * Get the limiter variable values (atomically under the lock). Permits move
+ * between the per-CPU caches without the lock, so the active count is a
+ * close estimate rather than an exact snapshot.
  *
  * @param limiter  The limiter
  * @param active   The number of requests in progress
@@ -59,8 +74,38 @@ void get_limiter_values_atomically(struct limiter *limiter,
  *
  * @param limiter  The limiter
  * @param limit    The limit to the number of active resources
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check initialize_limiter(struct limiter *limiter, uint32_t limit);
+
+/**
+ * Release the resources of a limiter structure. The limiter must be idle.
+ *
+ * @param limiter  The limiter
  **/
-void initialize_limiter(struct limiter *limiter, uint32_t limit);
+void uninitialize_limiter(struct limiter *limiter);
+
+/**
+ * Get the limit of a limiter.
+ *
+ * @param limiter  The limiter
+ *
+ * @return The limit to the number of active resources
+ **/
+static inline uint32_t get_limiter_limit(struct limiter *limiter)
+{
+	return READ_ONCE(limiter->limit);
+}
+
+/**
+ * Change the limit of a limiter. If the limit is lowered below the number of
+ * resources in use, no more will be granted until enough are released.
+ *
+ * @param limiter  The limiter
+ * @param limit    The new limit to the number of active resources
+ **/
+void set_limiter_limit(struct limiter *limiter, uint32_t limit);
 
 /**
  * Determine whether there are any active resources
@@ -105,6 +150,19 @@ void limiter_wait_for_idle(struct limiter *limiter);
  **/
 void limiter_wait_for_one_free(struct limiter *limiter);
 
+/**
+ * Prepare to start using up to count resources, waiting only until at least
+ * one is available. As many permits as can be granted at once (but no more
+ * than count) are taken under a single acquisition of the lock. The caller
+ * must call limiter_release once for each permit granted.
+ *
+ * @param limiter  The limiter
+ * @param count    The maximum number of resources wanted
+ *
+ * @return The number of resources granted, which is at least one
+ **/
+uint32_t limiter_wait_for_some_free(struct limiter *limiter, uint32_t count);
+
 /**
  * Attempt to reserve one resource, without waiting. After returning from this
  * routine, if allocation was successful, the caller may use the resource, and
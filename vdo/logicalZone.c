@@ -36,6 +36,13 @@
 #include "intMap.h"
 #include "vdoInternal.h"
 
+enum {
+	/** The number of sequential accesses which make a stream */
+	STREAM_MINIMUM_LENGTH = 16,
+	/** The largest step between accesses which continue a stream */
+	STREAM_MAXIMUM_GAP = 4,
+};
+
 struct logical_zone {
 	/** The completion for flush notifications */
 	struct vdo_completion completion;
@@ -68,6 +75,10 @@ struct logical_zone {
 	struct admin_state state;
 	/** The selector for determining which physical zone to allocate from */
 	struct allocation_selector *selector;
+	/** The most recent logical block read or written in this zone */
+	logical_block_number_t last_lbn;
+	/** The number of sequential accesses ending with last_lbn */
+	block_count_t sequential_accesses;
 };
 
 struct logical_zones {
@@ -444,6 +455,38 @@ void release_flush_generation_lock(struct data_vio *data_vio)
 	attempt_generation_complete_notification(&zone->completion);
 }
 
+/**********************************************************************/
+void note_logical_zone_access(struct logical_zone *zone,
+			      logical_block_number_t lbn)
+{
+	struct block_map *map = get_block_map(zone->zones->vdo);
+	block_count_t window = get_block_map_read_ahead_window(map);
+	logical_block_number_t last_lbn = zone->last_lbn;
+	slot_number_t trigger;
+
+	zone->last_lbn = lbn;
+	if ((lbn <= last_lbn) ||
+	    ((lbn - last_lbn) > STREAM_MAXIMUM_GAP) ||
+	    (compute_page_number(lbn) != compute_page_number(last_lbn))) {
+		zone->sequential_accesses = 1;
+		return;
+	}
+
+	zone->sequential_accesses++;
+	if ((window == 0) ||
+	    (zone->sequential_accesses < STREAM_MINIMUM_LENGTH)) {
+		return;
+	}
+
+	// Start reading the next leaf page once, as the stream enters the
+	// window at the end of the current one.
+	trigger = VDO_BLOCK_MAP_ENTRIES_PER_PAGE - window;
+	if ((compute_slot(last_lbn) < trigger) &&
+	    (compute_slot(lbn) >= trigger)) {
+		prefetch_block_map_page(map, compute_page_number(lbn) + 1);
+	}
+}
+
 /**********************************************************************/
 struct allocation_selector *get_allocation_selector(struct logical_zone *zone)
 {
@@ -155,6 +155,17 @@ int __must_check acquire_flush_generation_lock(struct data_vio *data_vio);
  **/
 void release_flush_generation_lock(struct data_vio *data_vio);
 
+/**
+ * Note a read or write in a logical zone. If the access continues an
+ * ascending stream which is nearing the end of a block map page, the next
+ * page will be read ahead. This must be called from the zone's thread.
+ *
+ * @param zone  The zone
+ * @param lbn   The logical block being accessed
+ **/
+void note_logical_zone_access(struct logical_zone *zone,
+			      logical_block_number_t lbn);
+
 /**
  * Get the selector for deciding which physical zone should be allocated from
  * next for activities in a logical zone.
@@ -32,5 +32,22 @@ struct memory_usage get_memory_usage(void)
 
 	get_memory_stats(&memory_usage.bytes_used,
 			 &memory_usage.peak_bytes_used);
+	memory_usage.huge_page_bytes_used = get_huge_memory_bytes();
+	memory_usage.ref_counts_bytes_used =
+		get_tagged_memory_bytes(MEMORY_TAG_REF_COUNTS);
+	memory_usage.page_cache_bytes_used =
+		get_tagged_memory_bytes(MEMORY_TAG_VDO_PAGE_CACHE);
+	memory_usage.slab_journal_bytes_used =
+		get_tagged_memory_bytes(MEMORY_TAG_SLAB_JOURNALS);
+	memory_usage.data_vio_bytes_used =
+		get_tagged_memory_bytes(MEMORY_TAG_DATA_VIOS);
+	memory_usage.hash_lock_bytes_used =
+		get_tagged_memory_bytes(MEMORY_TAG_HASH_LOCKS);
+	memory_usage.index_delta_memory_bytes_used =
+		get_tagged_memory_bytes(MEMORY_TAG_DELTA_MEMORY);
+	memory_usage.index_page_cache_bytes_used =
+		get_tagged_memory_bytes(MEMORY_TAG_UDS_PAGE_CACHE);
+	memory_usage.sparse_cache_bytes_used =
+		get_tagged_memory_bytes(MEMORY_TAG_SPARSE_CACHE);
 	return memory_usage;
 }
@@ -178,6 +178,42 @@ int write_block_allocator_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/** The number of slabs which are unrecovered or being scrubbed */
+	result = write_uint64_t("slabsToScrub : ",
+				stats->slabs_to_scrub,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** The number of slabs which have been scrubbed since loading */
+	result = write_uint64_t("slabsScrubbed : ",
+				stats->slabs_scrubbed,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** The number of discards of freed blocks sent to the backing device */
+	result = write_uint64_t("discards : ",
+				stats->discards,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** The number of freed blocks discarded on the backing device */
+	result = write_uint64_t("blocksDiscarded : ",
+				stats->blocks_discarded,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	result = write_string(NULL, "}", suffix, buf, maxlen);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -259,6 +295,15 @@ int write_recovery_journal_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/** Number of partial block commits held for more entries */
+	result = write_uint64_t("delayedCommits : ",
+				stats->delayed_commits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	/** Write/Commit totals for individual journal entries */
 	result = write_commit_statistics("entries : ",
 					 &stats->entries,
@@ -322,6 +367,114 @@ int write_packer_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/** Number of data blocks which have been considered for compression */
+	result = write_uint64_t("compressionCandidates : ",
+				stats->compression_candidates,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of candidates not compressed since they sampled as incompressible */
+	result = write_uint64_t("incompressibleCandidatesSkipped : ",
+				stats->incompressible_candidates_skipped,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of compressed blocks written less than half full */
+	result = write_uint64_t("blocksFilledUnder50 : ",
+				stats->blocks_filled_under_50,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of compressed blocks written at least half but under 75% full */
+	result = write_uint64_t("blocksFilled50To75 : ",
+				stats->blocks_filled_50_to_75,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of compressed blocks written at least 75% but under 90% full */
+	result = write_uint64_t("blocksFilled75To90 : ",
+				stats->blocks_filled_75_to_90,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of compressed blocks written at least 90% full */
+	result = write_uint64_t("blocksFilledOver90 : ",
+				stats->blocks_filled_over_90,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of compressed blocks which ran out of slots before space */
+	result = write_uint64_t("blocksSlotLimited : ",
+				stats->blocks_slot_limited,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of data_vios waiting in input bins */
+	result = write_uint64_t("fragmentsInInputBins : ",
+				stats->fragments_in_input_bins,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of batched data_vios waiting for an idle output bin */
+	result = write_uint64_t("fragmentsAwaitingOutput : ",
+				stats->fragments_awaiting_output,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of output bins writing a compressed block */
+	result = write_uint64_t("outputBinsBusy : ",
+				stats->output_bins_busy,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of output bins idle */
+	result = write_uint64_t("outputBinsIdle : ",
+				stats->output_bins_idle,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of times batched data_vios found every output bin busy */
+	result = write_uint64_t("outputBinStalls : ",
+				stats->output_bin_stalls,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	result = write_string(NULL, "}", suffix, buf, maxlen);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -385,6 +538,15 @@ int write_slab_journal_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/** Number of reaps made safe by a flush sent for another purpose */
+	result = write_uint64_t("piggybackedReaps : ",
+				stats->piggybacked_reaps,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	result = write_string(NULL, "}", suffix, buf, maxlen);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -637,6 +799,114 @@ int write_block_map_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/** number of pages protected from eviction by reuse */
+	result = write_uint32_t("protectedPages : ",
+				stats->protected_pages,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of gets which found a protected page */
+	result = write_uint64_t("protectedHits : ",
+				stats->protected_hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of pages protected after being reused */
+	result = write_uint64_t("promotions : ",
+				stats->promotions,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of evicted pages kept compacted */
+	result = write_uint32_t("compactPages : ",
+				stats->compact_pages,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of pages loaded by expanding a compacted copy */
+	result = write_uint64_t("compactLoads : ",
+				stats->compact_loads,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of cache pages in physically contiguous memory */
+	result = write_uint32_t("contiguousPages : ",
+				stats->contiguous_pages,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of trees handed from one logical zone to another */
+	result = write_uint64_t("treeHandoffs : ",
+				stats->tree_handoffs,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of gets sampled by the cache size simulator */
+	result = write_uint64_t("simulatedGets : ",
+				stats->simulated_gets,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of sampled gets which would hit in a cache half the size */
+	result = write_uint64_t("simulatedHalfSizeHits : ",
+				stats->simulated_half_size_hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of sampled gets which would hit in an LRU cache this size */
+	result = write_uint64_t("simulatedSameSizeHits : ",
+				stats->simulated_same_size_hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of sampled gets which would hit in a cache double the size */
+	result = write_uint64_t("simulatedDoubleSizeHits : ",
+				stats->simulated_double_size_hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** number of sampled gets which would hit in a cache 4 times the size */
+	result = write_uint64_t("simulatedQuadrupleSizeHits : ",
+				stats->simulated_quadruple_size_hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	result = write_string(NULL, "}", suffix, buf, maxlen);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -691,6 +961,42 @@ int write_hash_lock_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/** Number of queries answered by the hash zone advice cache */
+	result = write_uint64_t("cachedAdviceHits : ",
+				stats->cached_advice_hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of queries which missed the advice cache and went to UDS */
+	result = write_uint64_t("cachedAdviceMisses : ",
+				stats->cached_advice_misses,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of times advice from the advice cache proved incorrect */
+	result = write_uint64_t("cachedAdviceStale : ",
+				stats->cached_advice_stale,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of times a hash zone found all its hash locks in use */
+	result = write_uint64_t("lockPoolExhaustions : ",
+				stats->lock_pool_exhaustions,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	result = write_string(NULL, "}", suffix, buf, maxlen);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -1075,6 +1381,87 @@ int write_memory_usage(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/** Tracked bytes currently mapped with huge pages. */
+	result = write_uint64_t("hugePageBytesUsed : ",
+				stats->huge_page_bytes_used,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Tracked bytes currently used for reference counts. */
+	result = write_uint64_t("refCountsBytesUsed : ",
+				stats->ref_counts_bytes_used,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Tracked bytes currently used by the block map page caches. */
+	result = write_uint64_t("pageCacheBytesUsed : ",
+				stats->page_cache_bytes_used,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Tracked bytes currently used by slab journals. */
+	result = write_uint64_t("slabJournalBytesUsed : ",
+				stats->slab_journal_bytes_used,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Tracked bytes currently used by the data_vio pools. */
+	result = write_uint64_t("dataVIOBytesUsed : ",
+				stats->data_vio_bytes_used,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Tracked bytes currently used for hash locks. */
+	result = write_uint64_t("hashLockBytesUsed : ",
+				stats->hash_lock_bytes_used,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Tracked bytes currently used by index delta lists. */
+	result = write_uint64_t("indexDeltaMemoryBytesUsed : ",
+				stats->index_delta_memory_bytes_used,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Tracked bytes currently used by index page caches. */
+	result = write_uint64_t("indexPageCacheBytesUsed : ",
+				stats->index_page_cache_bytes_used,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Tracked bytes currently used by sparse chapter caches. */
+	result = write_uint64_t("sparseCacheBytesUsed : ",
+				stats->sparse_cache_bytes_used,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	result = write_string(NULL, "}", suffix, buf, maxlen);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -1156,6 +1543,24 @@ int write_index_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/** Number of volume page lookups which found the page cached */
+	result = write_uint64_t("pageCacheHits : ",
+				stats->page_cache_hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Number of volume page lookups which had to read the page */
+	result = write_uint64_t("pageCacheMisses : ",
+				stats->page_cache_misses,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	/** Current number of dedupe queries that are in flight */
 	result = write_uint32_t("currDedupeQueries : ",
 				stats->curr_dedupe_queries,
@@ -1262,6 +1667,105 @@ int write_kernel_statistics(char *prefix,
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
+	/** The LZ4 acceleration factor currently used for compression */
+	result = write_uint64_t("compressionAcceleration : ",
+				stats->compression_acceleration,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Compressed reads and verifies served from the read cache */
+	result = write_uint64_t("readCacheHits : ",
+				stats->read_cache_hits,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Compressed reads and verifies which went to storage */
+	result = write_uint64_t("readCacheMisses : ",
+				stats->read_cache_misses,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Writes logged for post-process deduplication */
+	result = write_uint64_t("postDedupeDeferred : ",
+				stats->post_dedupe_deferred,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Logged blocks read back and checked for duplicates */
+	result = write_uint64_t("postDedupeChecked : ",
+				stats->post_dedupe_checked,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Checked blocks remapped to share an existing copy */
+	result = write_uint64_t("postDedupeShared : ",
+				stats->post_dedupe_shared,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Logged blocks not yet checked */
+	result = write_uint64_t("postDedupePending : ",
+				stats->post_dedupe_pending,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Writes which bypassed deduplication because of an exemption */
+	result = write_uint64_t("dedupeExemptWrites : ",
+				stats->dedupe_exempt_writes,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Writes not compressed because their region has been incompressible */
+	result = write_uint64_t("compressionRegionSkips : ",
+				stats->compression_region_skips,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Blocks compressed by an offload device */
+	result = write_uint64_t("compressionOffloads : ",
+				stats->compression_offloads,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+	/** Blocks compressed on the CPU because the offload device was busy */
+	result = write_uint64_t("compressionOffloadFallbacks : ",
+				stats->compression_offload_fallbacks,
+				", ",
+				buf,
+				maxlen);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 	/** Bios submitted into VDO from above */
 	result = write_bio_stats("biosIn : ",
 				 &stats->bios_in,
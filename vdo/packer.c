@@ -21,10 +21,15 @@
 
 #include "packerInternals.h"
 
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+
+#include "histogram.h"
 #include "logger.h"
 #include "memoryAlloc.h"
 #include "permassert.h"
 
+#include "actionManager.h"
 #include "adminState.h"
 #include "allocatingVIO.h"
 #include "allocationSelector.h"
@@ -32,8 +37,29 @@
 #include "dataVIO.h"
 #include "hashLock.h"
 #include "pbnLock.h"
+#include "readCache.h"
 #include "vdo.h"
 #include "vdoInternal.h"
+#include "vdoTrace.h"
+
+enum {
+	/**
+	 * The most fragments moved from other input bins to fill the tail
+	 * space of a bin whose batch is being started
+	 **/
+	MAXIMUM_REPACKED_FRAGMENTS = 4,
+	/** The number of residency histogram buckets (up to 10^7 us) */
+	RESIDENCY_HISTOGRAM_LOG_SIZE = 7,
+	/**
+	 * The number of compressed size histogram buckets, one for each
+	 * percent of a block; larger samples are blocks which did not compress
+	 **/
+	COMPRESSED_SIZE_HISTOGRAM_SIZE = 101,
+	/** The space for a packer histogram name */
+	PACKER_HISTOGRAM_NAME_SIZE = 32,
+};
+
+static void expire_overdue_bins(struct vdo_completion *completion);
 
 /**
  * Check that we are on the packer thread.
@@ -173,6 +199,7 @@ make_output_bin(struct packer *packer, struct vdo *vdo)
 	// will be freed even if we fail to initialize it below.
 	INIT_LIST_HEAD(&output->list);
 	list_add_tail(&output->list, &packer->output_bins);
+	output->packer = packer;
 	push_output_bin(packer, output);
 
 	result = ALLOCATE_EXTENDED(struct compressed_block,
@@ -183,6 +210,18 @@ make_output_bin(struct packer *packer, struct vdo *vdo)
 		return result;
 	}
 
+	if (packer->max_unit_blocks > 1) {
+		result = ALLOCATE(packer->bin_data_size, char,
+				  "compression unit fragments",
+				  &output->unit_fragments);
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
+
+		initialize_vdo_completion(&output->units.completion, vdo,
+					  PACKER_UNIT_COMPLETION);
+	}
+
 	return create_compressed_write_vio(vdo,
 					   output,
 					   (char *) output->block,
@@ -206,18 +245,81 @@ static void free_output_bin(struct output_bin **bin_ptr)
 
 	vio = allocating_vio_as_vio(bin->writer);
 	free_vio(&vio);
+	FREE(bin->unit_fragments);
 	FREE(bin->block);
 	FREE(bin);
 	*bin_ptr = NULL;
 }
 
-/**********************************************************************/
-int make_packer(struct vdo *vdo,
-		block_count_t input_bin_count,
-		block_count_t output_bin_count,
-		struct packer **packer_ptr)
+/**
+ * Bring the expiration of the residency timer to the packer thread. This is
+ * the timer function of the residency timer, so it runs in interrupt context.
+ *
+ * @param timer  The residency timer
+ **/
+static void residency_timer_expired(struct timer_list *timer)
+{
+	struct packer *packer = from_timer(packer, timer, residency_timer);
+	enqueue_vdo_completion(&packer->residency_completion);
+}
+
+/**
+ * Free a block packer and null out the reference to it.
+ *
+ * @param packer_ptr  A pointer to the packer to free
+ **/
+static void free_packer(struct packer **packer_ptr)
+{
+	struct packer *packer = *packer_ptr;
+	struct input_bin *input;
+	struct output_bin *output;
+
+	if (packer == NULL) {
+		return;
+	}
+
+	del_timer_sync(&packer->residency_timer);
+	free_histogram(&packer->residency_histogram);
+	free_histogram(&packer->compressed_size_histogram);
+	free_histogram(&packer->packing_histogram);
+
+	while ((input = get_fullest_bin(packer)) != NULL) {
+		list_del_init(&input->list);
+		FREE(input);
+	}
+
+	FREE(packer->canceled_bin);
+
+	while ((output = pop_output_bin(packer)) != NULL) {
+		free_output_bin(&output);
+	}
+
+	free_vdo_allocation_selector(&packer->selector);
+	FREE(packer);
+	*packer_ptr = NULL;
+}
+
+/**
+ * Make a new block packer.
+ *
+ * @param [in]  vdo               The vdo to which this packer belongs
+ * @param [in]  zone_number       The number of the packer's zone
+ * @param [in]  input_bin_count   The number of partial bins to keep in memory
+ * @param [in]  output_bin_count  The number of compressed blocks that can be
+ *                                written concurrently
+ * @param [out] packer_ptr        A pointer to hold the new packer
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int __must_check make_packer(struct vdo *vdo,
+				    zone_count_t zone_number,
+				    block_count_t input_bin_count,
+				    block_count_t output_bin_count,
+				    struct packer **packer_ptr)
 {
 	const struct thread_config *thread_config = get_thread_config(vdo);
+	char prefix[PACKER_HISTOGRAM_NAME_SIZE];
+	char histogram_name[PACKER_HISTOGRAM_NAME_SIZE];
 
 	struct packer *packer;
 	block_count_t i;
@@ -228,14 +330,72 @@ int make_packer(struct vdo *vdo,
 		return result;
 	}
 
-	packer->thread_id = get_packer_zone_thread(thread_config);
+	packer->zone_number = zone_number;
+	packer->thread_id = get_packer_zone_thread(thread_config, zone_number);
 	packer->bin_data_size = (VDO_BLOCK_SIZE
 				 - sizeof(struct compressed_block_header));
 	packer->size = input_bin_count;
 	packer->max_slots = MAX_COMPRESSION_SLOTS;
+	packer->format = vdo->device_config->compression_format;
+	packer->max_unit_blocks = vdo->device_config->compression_unit_blocks;
 	packer->output_bin_count = output_bin_count;
 	INIT_LIST_HEAD(&packer->input_bins);
 	INIT_LIST_HEAD(&packer->output_bins);
+	timer_setup(&packer->residency_timer, residency_timer_expired, 0);
+	initialize_vdo_completion(&packer->residency_completion, vdo,
+				  PACKER_RESIDENCY_COMPLETION);
+
+	// A lone packer keeps the names it had before there were zones.
+	if (thread_config->packer_zone_count == 1) {
+		snprintf(prefix, sizeof(prefix), "packer");
+	} else {
+		snprintf(prefix, sizeof(prefix), "packer%u", zone_number);
+	}
+
+	snprintf(histogram_name, sizeof(histogram_name), "%s_residency",
+		 prefix);
+	packer->residency_histogram =
+		make_logarithmic_histogram(&vdo->vdo_directory,
+					   histogram_name,
+					   "Packer Residency",
+					   "data_vios",
+					   "residency",
+					   "microseconds",
+					   RESIDENCY_HISTOGRAM_LOG_SIZE);
+	if (packer->residency_histogram == NULL) {
+		free_packer(&packer);
+		return -ENOMEM;
+	}
+
+	snprintf(histogram_name, sizeof(histogram_name), "%s_compressed_size",
+		 prefix);
+	packer->compressed_size_histogram =
+		make_linear_histogram(&vdo->vdo_directory,
+				      histogram_name,
+				      "Compressed Size",
+				      "data_vios",
+				      "compressed size",
+				      "percent of a block",
+				      COMPRESSED_SIZE_HISTOGRAM_SIZE);
+	if (packer->compressed_size_histogram == NULL) {
+		free_packer(&packer);
+		return -ENOMEM;
+	}
+
+	snprintf(histogram_name, sizeof(histogram_name), "%s_packing_latency",
+		 prefix);
+	packer->packing_histogram =
+		make_logarithmic_histogram(&vdo->vdo_directory,
+					   histogram_name,
+					   "Packing Latency",
+					   "data_vios",
+					   "time to be packed",
+					   "microseconds",
+					   RESIDENCY_HISTOGRAM_LOG_SIZE);
+	if (packer->packing_histogram == NULL) {
+		free_packer(&packer);
+		return -ENOMEM;
+	}
 
 	result = make_vdo_allocation_selector(thread_config->physical_zone_count,
 					      packer->thread_id, &packer->selector);
@@ -273,35 +433,87 @@ int make_packer(struct vdo *vdo,
 		}
 	}
 
+	packer->statistics.output_bins_idle = output_bin_count;
 	*packer_ptr = packer;
 	return VDO_SUCCESS;
 }
 
+/**
+ * Implements vdo_zone_thread_getter
+ **/
+static thread_id_t get_thread_id_for_zone(void *context,
+					  zone_count_t zone_number)
+{
+	return get_packer_thread_id(get_packer_zone(context, zone_number));
+}
+
 /**********************************************************************/
-void free_packer(struct packer **packer_ptr)
+int make_packer_zones(struct vdo *vdo,
+		      block_count_t input_bin_count,
+		      block_count_t output_bin_count,
+		      struct packer_zones **zones_ptr)
 {
-	struct packer *packer = *packer_ptr;
-	struct input_bin *input;
-	struct output_bin *output;
+	struct packer_zones *zones;
+	zone_count_t zone;
+	const struct thread_config *thread_config = get_thread_config(vdo);
+	int result = ALLOCATE_EXTENDED(struct packer_zones,
+				       thread_config->packer_zone_count,
+				       struct packer *, __func__, &zones);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
 
-	if (packer == NULL) {
-		return;
+	zones->zone_count = thread_config->packer_zone_count;
+	for (zone = 0; zone < zones->zone_count; zone++) {
+		result = make_packer(vdo, zone, input_bin_count,
+				     output_bin_count, &zones->packers[zone]);
+		if (result != VDO_SUCCESS) {
+			free_packer_zones(&zones);
+			return result;
+		}
 	}
 
-	while ((input = get_fullest_bin(packer)) != NULL) {
-		list_del_init(&input->list);
-		FREE(input);
+	result = make_vdo_action_manager(zones->zone_count,
+					 get_thread_id_for_zone,
+					 get_admin_thread(thread_config),
+					 zones,
+					 NULL,
+					 vdo,
+					 &zones->manager);
+	if (result != VDO_SUCCESS) {
+		free_packer_zones(&zones);
+		return result;
 	}
 
-	FREE(packer->canceled_bin);
+	*zones_ptr = zones;
+	return VDO_SUCCESS;
+}
 
-	while ((output = pop_output_bin(packer)) != NULL) {
-		free_output_bin(&output);
+/**********************************************************************/
+void free_packer_zones(struct packer_zones **zones_ptr)
+{
+	zone_count_t zone;
+	struct packer_zones *zones = *zones_ptr;
+	if (zones == NULL) {
+		return;
 	}
 
-	free_vdo_allocation_selector(&packer->selector);
-	FREE(packer);
-	*packer_ptr = NULL;
+	free_vdo_action_manager(&zones->manager);
+	for (zone = 0; zone < zones->zone_count; zone++) {
+		free_packer(&zones->packers[zone]);
+	}
+
+	FREE(zones);
+	*zones_ptr = NULL;
+}
+
+/**********************************************************************/
+struct packer *get_packer_zone(struct packer_zones *zones,
+			       zone_count_t zone_number)
+{
+	ASSERT_LOG_ONLY((zone_number < zones->zone_count),
+			"packer zone %u valid", zone_number);
+	return zones->packers[zone_number];
 }
 
 /**
@@ -309,11 +521,12 @@ void free_packer(struct packer **packer_ptr)
  *
  * @param data_vio  The data_vio
  *
- * @return The packer from the VDO to which the data_vio belongs
+ * @return The packer of the zone which handles the data_vio
  **/
 static inline struct packer *get_packer_from_data_vio(struct data_vio *data_vio)
 {
-	return get_vdo_from_data_vio(data_vio)->packer;
+	return get_packer_zone(get_vdo_from_data_vio(data_vio)->packer_zones,
+			       get_data_vio_packer_zone(data_vio));
 }
 
 /**********************************************************************/
@@ -330,17 +543,79 @@ thread_id_t get_packer_thread_id(struct packer *packer)
 }
 
 /**********************************************************************/
-struct packer_statistics get_packer_statistics(const struct packer *packer)
-{
-	const struct packer_statistics *stats = &packer->statistics;
-	return (struct packer_statistics) {
-		.compressed_fragments_written =
-			READ_ONCE(stats->compressed_fragments_written),
-		.compressed_blocks_written =
-			READ_ONCE(stats->compressed_blocks_written),
-		.compressed_fragments_in_packer =
-			READ_ONCE(stats->compressed_fragments_in_packer),
-	};
+unsigned int get_packer_max_residency(struct packer_zones *zones)
+{
+	return READ_ONCE(zones->packers[0]->max_residency_ms);
+}
+
+/**********************************************************************/
+void set_packer_max_residency(struct packer_zones *zones,
+			      unsigned int residency_ms)
+{
+	zone_count_t zone;
+	for (zone = 0; zone < zones->zone_count; zone++) {
+		WRITE_ONCE(zones->packers[zone]->max_residency_ms,
+			   residency_ms);
+	}
+}
+
+/**********************************************************************/
+void get_packer_statistics(const struct packer_zones *zones,
+			   struct packer_statistics *totals)
+{
+	zone_count_t zone;
+
+	memset(totals, 0, sizeof(*totals));
+	for (zone = 0; zone < zones->zone_count; zone++) {
+		const struct packer_statistics *stats =
+			&zones->packers[zone]->statistics;
+		totals->compressed_fragments_written +=
+			READ_ONCE(stats->compressed_fragments_written);
+		totals->compressed_blocks_written +=
+			READ_ONCE(stats->compressed_blocks_written);
+		totals->compressed_fragments_in_packer +=
+			READ_ONCE(stats->compressed_fragments_in_packer);
+		totals->compression_candidates +=
+			READ_ONCE(stats->compression_candidates);
+		totals->incompressible_candidates_skipped +=
+			READ_ONCE(stats->incompressible_candidates_skipped);
+		totals->blocks_filled_under_50 +=
+			READ_ONCE(stats->blocks_filled_under_50);
+		totals->blocks_filled_50_to_75 +=
+			READ_ONCE(stats->blocks_filled_50_to_75);
+		totals->blocks_filled_75_to_90 +=
+			READ_ONCE(stats->blocks_filled_75_to_90);
+		totals->blocks_filled_over_90 +=
+			READ_ONCE(stats->blocks_filled_over_90);
+		totals->blocks_slot_limited +=
+			READ_ONCE(stats->blocks_slot_limited);
+		totals->fragments_in_input_bins +=
+			READ_ONCE(stats->fragments_in_input_bins);
+		totals->fragments_awaiting_output +=
+			READ_ONCE(stats->fragments_awaiting_output);
+		totals->output_bins_busy += READ_ONCE(stats->output_bins_busy);
+		totals->output_bins_idle += READ_ONCE(stats->output_bins_idle);
+		totals->output_bin_stalls +=
+			READ_ONCE(stats->output_bin_stalls);
+	}
+}
+
+/**********************************************************************/
+void record_compression_candidate(struct data_vio *data_vio)
+{
+	struct packer *packer = get_packer_from_data_vio(data_vio);
+	struct packer_statistics *stats = &packer->statistics;
+	assert_on_packer_thread(packer, __func__);
+
+	WRITE_ONCE(stats->compression_candidates,
+		   stats->compression_candidates + 1);
+	enter_histogram_sample(packer->compressed_size_histogram,
+			       DIV_ROUND_UP(data_vio->compression.size * 100,
+					    VDO_BLOCK_SIZE));
+	if (data_vio->compression.likely_incompressible) {
+		WRITE_ONCE(stats->incompressible_candidates_skipped,
+			   stats->incompressible_candidates_skipped + 1);
+	}
 }
 
 /**
@@ -400,8 +675,8 @@ static void write_pending_batches(struct packer *packer);
 static bool __must_check
 switch_to_packer_thread(struct vdo_completion *completion)
 {
-	struct vio *vio = as_vio(completion);
-	thread_id_t thread_id = vio->vdo->packer->thread_id;
+	struct output_bin *bin = completion->parent;
+	thread_id_t thread_id = bin->packer->thread_id;
 	if (completion->callback_thread_id == thread_id) {
 		return true;
 	}
@@ -411,6 +686,44 @@ switch_to_packer_thread(struct vdo_completion *completion)
 	return false;
 }
 
+/**
+ * Count a written compressed block in the fill ratio distribution. A block
+ * which used every slot while it still had room for another fragment of its
+ * average size is also counted as slot limited. The slot count is bounded by
+ * the mapping states a block map entry can hold, so these blocks measure
+ * what a format with more slots would have gained.
+ *
+ * @param packer  The packer which wrote the block
+ * @param bin     The output bin holding the block
+ **/
+static void record_block_fill(struct packer *packer,
+			      const struct output_bin *bin)
+{
+	struct packer_statistics *stats = &packer->statistics;
+	size_t percent_full = (bin->space_used * 100) / packer->bin_data_size;
+
+	if (percent_full < 50) {
+		WRITE_ONCE(stats->blocks_filled_under_50,
+			   stats->blocks_filled_under_50 + 1);
+	} else if (percent_full < 75) {
+		WRITE_ONCE(stats->blocks_filled_50_to_75,
+			   stats->blocks_filled_50_to_75 + 1);
+	} else if (percent_full < 90) {
+		WRITE_ONCE(stats->blocks_filled_75_to_90,
+			   stats->blocks_filled_75_to_90 + 1);
+	} else {
+		WRITE_ONCE(stats->blocks_filled_over_90,
+			   stats->blocks_filled_over_90 + 1);
+	}
+
+	if ((bin->slots_used == packer->max_slots) &&
+	    ((packer->bin_data_size - bin->space_used)
+	     >= (bin->space_used / bin->slots_used))) {
+		WRITE_ONCE(stats->blocks_slot_limited,
+			   stats->blocks_slot_limited + 1);
+	}
+}
+
 /**
  * Finish processing an output bin whose write has completed. If there was
  * an error, any data_vios waiting on the bin write will be notified.
@@ -435,9 +748,11 @@ static void finish_output_bin(struct packer *packer, struct output_bin *bin)
 			   + bin->slots_used);
 		WRITE_ONCE(stats->compressed_blocks_written,
 			   stats->compressed_blocks_written + 1);
+		record_block_fill(packer, bin);
 	}
 
 	bin->slots_used = 0;
+	bin->space_used = 0;
 	push_output_bin(packer, bin);
 }
 
@@ -450,7 +765,8 @@ static void finish_output_bin(struct packer *packer, struct output_bin *bin)
 static void complete_output_bin(struct vdo_completion *completion)
 {
 	struct vio *vio = as_vio(completion);
-	struct packer *packer = vio->vdo->packer;
+	struct output_bin *bin = completion->parent;
+	struct packer *packer = bin->packer;
 
 	if (!switch_to_packer_thread(completion)) {
 		return;
@@ -513,6 +829,7 @@ static void share_compressed_block(struct waiter *waiter, void *context)
 static void finish_compressed_write(struct vdo_completion *completion)
 {
 	struct output_bin *bin = completion->parent;
+	struct vdo *vdo = get_vdo_from_allocating_vio(bin->writer);
 	assert_in_physical_zone(bin->writer);
 
 	if (completion->result != VDO_SUCCESS) {
@@ -523,6 +840,14 @@ static void finish_compressed_write(struct vdo_completion *completion)
 		return;
 	}
 
+	trace_vdo_packer_write(bin->writer->allocation,
+			       bin->slots_used,
+			       bin->space_used);
+
+	// The block may have been read as an earlier compressed block before
+	// it was freed, so make sure no copy of that is served for it.
+	invalidate_read_cache_entry(vdo->read_cache, bin->writer->allocation);
+
 	// First give every data_vio/hash_lock a share of the PBN lock to
 	// ensure it can't be released until they've all done their incRefs.
 	notify_all_waiters(&bin->outgoing, share_compressed_block, bin);
@@ -619,26 +944,241 @@ static void get_next_batch(struct packer *packer, struct output_batch *batch)
 	}
 }
 
+/**
+ * Sort a batch by logical block number so that the data_vios writing
+ * logically consecutive blocks are adjacent.
+ *
+ * @param batch  The batch to sort
+ **/
+static void sort_batch_by_lbn(struct output_batch *batch)
+{
+	size_t i, j;
+
+	for (i = 1; i < batch->slots_used; i++) {
+		struct data_vio *data_vio = batch->slots[i];
+
+		for (j = i;
+		     (j > 0) && (batch->slots[j - 1]->logical.lbn
+				 > data_vio->logical.lbn);
+		     j--) {
+			batch->slots[j] = batch->slots[j - 1];
+		}
+
+		batch->slots[j] = data_vio;
+	}
+}
+
+/**
+ * Get the number of data_vios, starting at a given one in a sorted batch,
+ * which write logically consecutive blocks and so may be compressed together.
+ *
+ * @param packer  The packer
+ * @param batch   The batch, sorted by logical block number
+ * @param start   The index in the batch of the first data_vio
+ *
+ * @return The number of data_vios in the unit starting at start
+ **/
+static size_t get_unit_length(struct packer *packer,
+			      struct output_batch *batch,
+			      size_t start)
+{
+	size_t length = 1;
+
+	while ((length < packer->max_unit_blocks) &&
+	       ((start + length) < batch->slots_used) &&
+	       (batch->slots[start + length]->logical.lbn
+		== batch->slots[start + length - 1]->logical.lbn + 1)) {
+		length++;
+	}
+
+	return length;
+}
+
+/**
+ * Gather the units of a batch: the runs of data_vios writing logically
+ * consecutive blocks, which may compress better together than separately. The
+ * fragment buffer of each unit is one byte smaller than the separate fragments
+ * of its data_vios, so a unit fragment only fits if it beats them, and the
+ * buffers of all the units of a batch fit in the bin's unit fragment buffer.
+ *
+ * @param packer  The packer
+ * @param output  The output bin holding the batch, sorted by logical block
+ *                number
+ *
+ * @return <code>true</code> if the batch has any units
+ **/
+static bool gather_units(struct packer *packer, struct output_bin *output)
+{
+	struct output_batch *batch = &output->batch;
+	struct compression_units *units = &output->units;
+	size_t offset = 0;
+	size_t slot = 0;
+
+	units->count = 0;
+	while (slot < batch->slots_used) {
+		size_t length = get_unit_length(packer, batch, slot);
+		struct compression_unit *unit;
+		size_t separate_size = 0;
+		size_t i;
+
+		if (length == 1) {
+			slot++;
+			continue;
+		}
+
+		for (i = slot; i < slot + length; i++) {
+			separate_size += batch->slots[i]->compression.size;
+		}
+
+		unit = &units->units[units->count++];
+		*unit = (struct compression_unit) {
+			.data_vios = &batch->slots[slot],
+			.count = length,
+			.fragment = output->unit_fragments + offset,
+			.buffer_size = separate_size - 1,
+		};
+		offset += unit->buffer_size;
+		slot += length;
+	}
+
+	return (units->count > 0);
+}
+
+/**
+ * Put the fragment for a data_vio of a batch into an output bin. If the
+ * data_vio starts a unit which compressed well together, the unit fragment is
+ * used instead of the data_vio's own.
+ *
+ * @param [in]  output          The output bin being filled
+ * @param [in]  slot            The slot of the data_vio in the batch
+ * @param [in]  offset          The offset at which to put the fragment
+ * @param [in]  unit            The unit starting with the data_vio, if any
+ * @param [out] unit_remaining  A pointer to hold the number of following
+ *                              data_vios which are in the packed unit
+ *
+ * @return The size of the fragment
+ **/
+static uint16_t pack_fragment(struct output_bin *output,
+			      slot_number_t slot,
+			      size_t offset,
+			      const struct compression_unit *unit,
+			      size_t *unit_remaining)
+{
+	struct data_vio *data_vio = output->batch.slots[slot];
+
+	if ((unit != NULL) && (unit->size > 0)) {
+		put_vdo_compressed_block_fragment(output->block, slot, offset,
+						  unit->fragment, unit->size);
+		*unit_remaining = unit->count - 1;
+		return unit->size;
+	}
+
+	put_vdo_compressed_block_fragment(output->block, slot, offset,
+					  data_vio->compression.data,
+					  data_vio->compression.size);
+	return data_vio->compression.size;
+}
+
+/**
+ * Pack the batch of an output bin into its compressed block and write the
+ * block. A unit which beat its separate fragments is packed as one fragment,
+ * with the following blocks of the unit mapped to the empty slots after it.
+ *
+ * @param packer  The packer
+ * @param output  The output bin to pack
+ **/
+static void pack_output_bin(struct packer *packer, struct output_bin *output)
+{
+	struct output_batch *batch = &output->batch;
+	struct compression_units *units = &output->units;
+	unsigned int next_unit = 0;
+	size_t space_used = 0;
+	size_t unit_remaining = 0;
+	slot_number_t slot;
+	int result;
+
+	reset_vdo_compressed_block_header(&output->block->header,
+					  packer->format);
+	for (slot = 0; slot < batch->slots_used; slot++) {
+		struct data_vio *data_vio = batch->slots[slot];
+		uint16_t fragment_size = 0;
+
+		if (unit_remaining > 0) {
+			// Map this block to the unit packed before it.
+			put_vdo_compressed_block_unit_member(output->block,
+							     slot);
+			unit_remaining--;
+		} else {
+			const struct compression_unit *unit = NULL;
+
+			if ((next_unit < units->count) &&
+			    (units->units[next_unit].data_vios
+			     == &batch->slots[slot])) {
+				unit = &units->units[next_unit++];
+			}
+
+			fragment_size = pack_fragment(output, slot, space_used,
+						      unit, &unit_remaining);
+		}
+
+		data_vio->compression.slot = slot;
+		space_used += fragment_size;
+
+		result = enqueue_data_vio(&output->outgoing, data_vio);
+		if (result != VDO_SUCCESS) {
+			abort_packing(data_vio);
+			continue;
+		}
+
+		output->slots_used += 1;
+		output->space_used += fragment_size;
+		enter_histogram_sample(packer->packing_histogram,
+				       (ktime_get_ns()
+					- data_vio->compression.packer_arrival)
+				       / NSEC_PER_USEC);
+	}
+
+	launch_compressed_write(packer, output);
+}
+
+/**
+ * Pack and write an output bin once the units of its batch have been
+ * compressed. This callback is registered in write_next_batch().
+ *
+ * @param completion  The completion of the bin's compression units
+ **/
+static void finish_unit_compression(struct vdo_completion *completion)
+{
+	struct output_bin *output = completion->parent;
+	struct packer *packer = output->packer;
+
+	assert_on_packer_thread(packer, __func__);
+	pack_output_bin(packer, output);
+	write_pending_batches(packer);
+	check_for_drain_complete(packer);
+}
+
 /**
  * Pack the next batch of compressed vios from the batched queue into an
- * output bin and write the output bin.
+ * output bin and write the output bin. If compression units are enabled,
+ * data_vios of the batch writing logically consecutive blocks are first
+ * compressed again together. That is done on the CPU queue rather than on the
+ * packer thread; the bin stays busy until the units come back to
+ * finish_unit_compression() to be packed.
  *
  * @param packer  The packer
  * @param output  The output bin to fill
  *
- * @return <code>true</code> if a write was issued for the output bin
+ * @return <code>true</code> if the output bin is in use
  **/
 static bool __must_check
 write_next_batch(struct packer *packer, struct output_bin *output)
 {
-	size_t space_used = 0;
-	struct output_batch batch;
-	slot_number_t slot;
-	int result;
+	struct output_batch *batch = &output->batch;
 
-	get_next_batch(packer, &batch);
+	get_next_batch(packer, batch);
 
-	if (batch.slots_used == 0) {
+	if (batch->slots_used == 0) {
 		// The pending queue must now be empty (there may have been
 		// mooted vios).
 		return false;
@@ -647,32 +1187,24 @@ write_next_batch(struct packer *packer, struct output_bin *output)
 	// If the batch contains only a single vio, then we save nothing by
 	// saving the compressed form. Continue processing the single vio in
 	// the batch.
-	if (batch.slots_used == 1) {
-		abort_packing(batch.slots[0]);
+	if (batch->slots_used == 1) {
+		abort_packing(batch->slots[0]);
 		return false;
 	}
 
-	reset_vdo_compressed_block_header(&output->block->header);
-
-	for (slot = 0; slot < batch.slots_used; slot++) {
-		struct data_vio *data_vio = batch.slots[slot];
-		data_vio->compression.slot = slot;
-		put_vdo_compressed_block_fragment(output->block, slot,
-						  space_used,
-						  data_vio->compression.data,
-						  data_vio->compression.size);
-		space_used += data_vio->compression.size;
-
-		result = enqueue_data_vio(&output->outgoing, data_vio);
-		if (result != VDO_SUCCESS) {
-			abort_packing(data_vio);
-			continue;
+	if (packer->max_unit_blocks > 1) {
+		sort_batch_by_lbn(batch);
+		if (gather_units(packer, output)) {
+			prepare_vdo_completion(&output->units.completion,
+					       finish_unit_compression,
+					       finish_unit_compression,
+					       packer->thread_id, output);
+			compress_data_vio_units(&output->units);
+			return true;
 		}
-
-		output->slots_used += 1;
 	}
 
-	launch_compressed_write(packer, output);
+	pack_output_bin(packer, output);
 	return true;
 }
 
@@ -684,14 +1216,87 @@ write_next_batch(struct packer *packer, struct output_bin *output)
  **/
 static void add_to_input_bin(struct input_bin *bin, struct data_vio *data_vio)
 {
+	if ((bin->slots_used == 0) ||
+	    (data_vio->compression.packer_arrival < bin->oldest_arrival)) {
+		bin->oldest_arrival = data_vio->compression.packer_arrival;
+	}
+
 	data_vio->compression.bin = bin;
 	data_vio->compression.slot = bin->slots_used;
 	bin->incoming[bin->slots_used++] = data_vio;
+	trace_vdo_packer_add(data_vio,
+			     data_vio->logical.lbn,
+			     data_vio->compression.size,
+			     bin->slots_used);
+}
+
+/**
+ * Fill as much as possible of the free space left in an input bin whose
+ * batch is about to be started by moving fragments into it from the other
+ * input bins. Each move takes the largest fragment which fits, so the bin is
+ * filled best-fit, and the number of moves is bounded so that starting a
+ * batch stays cheap. The bins which give up fragments are re-sorted, but the
+ * bin being filled is not.
+ *
+ * @param packer  The packer
+ * @param bin     The bin to fill
+ **/
+static void repack_input_bin(struct packer *packer, struct input_bin *bin)
+{
+	unsigned int moves;
+
+	for (moves = 0;
+	     (moves < MAXIMUM_REPACKED_FRAGMENTS) &&
+	     (bin->slots_used < packer->max_slots) && (bin->free_space > 0);
+	     moves++) {
+		struct input_bin *donor = NULL;
+		struct input_bin *candidate;
+		struct data_vio *data_vio;
+		slot_number_t best_slot = 0;
+		size_t best_size = 0;
+		slot_number_t slot;
+
+		for (candidate = get_fullest_bin(packer); candidate != NULL;
+		     candidate = next_bin(packer, candidate)) {
+			if (candidate == bin) {
+				continue;
+			}
+
+			for (slot = 0; slot < candidate->slots_used; slot++) {
+				size_t size = candidate->incoming[slot]
+					->compression.size;
+				if ((size <= bin->free_space) &&
+				    (size > best_size)) {
+					donor = candidate;
+					best_slot = slot;
+					best_size = size;
+				}
+			}
+		}
+
+		if (donor == NULL) {
+			return;
+		}
+
+		data_vio = donor->incoming[best_slot];
+		donor->slots_used--;
+		if (best_slot < donor->slots_used) {
+			donor->incoming[best_slot] =
+				donor->incoming[donor->slots_used];
+			donor->incoming[best_slot]->compression.slot = best_slot;
+		}
+		donor->free_space += best_size;
+		insert_in_sorted_list(packer, donor);
+
+		add_to_input_bin(bin, data_vio);
+		bin->free_space -= best_size;
+	}
 }
 
 /**
  * Start a new batch of vios in an input_bin, moving the existing batch, if
- * any, to the queue of pending batched vios in the packer.
+ * any, to the queue of pending batched vios in the packer. The tail space of
+ * the batch is first filled, if possible, from the other input bins.
  *
  * @param packer  The packer
  * @param bin     The bin to prepare
@@ -700,11 +1305,20 @@ static void start_new_batch(struct packer *packer, struct input_bin *bin)
 {
 	slot_number_t slot;
 	int result;
+
+	if (bin->slots_used > 0) {
+		repack_input_bin(packer, bin);
+	}
+
 	// Move all the data_vios in the current batch to the batched queue so
 	// they will get packed into the next free output bin.
 	for (slot = 0; slot < bin->slots_used; slot++) {
 		struct data_vio *data_vio = bin->incoming[slot];
 		data_vio->compression.bin = NULL;
+		enter_histogram_sample(packer->residency_histogram,
+				       (ktime_get_ns()
+					- data_vio->compression.packer_arrival)
+				       / NSEC_PER_USEC);
 
 		if (!may_write_compressed_data_vio(data_vio)) {
 			/*
@@ -726,6 +1340,9 @@ static void start_new_batch(struct packer *packer, struct input_bin *bin)
 	}
 
 	// The bin is now empty.
+	WRITE_ONCE(packer->statistics.fragments_in_input_bins,
+		   packer->statistics.fragments_in_input_bins
+		   - bin->slots_used);
 	bin->slots_used = 0;
 	bin->free_space = packer->bin_data_size;
 }
@@ -750,6 +1367,8 @@ static void add_data_vio_to_input_bin(struct packer *packer,
 
 	add_to_input_bin(bin, data_vio);
 	bin->free_space -= data_vio->compression.size;
+	WRITE_ONCE(packer->statistics.fragments_in_input_bins,
+		   packer->statistics.fragments_in_input_bins + 1);
 
 	// If we happen to exactly fill the bin, start a new input batch.
 	if ((bin->slots_used == packer->max_slots) || (bin->free_space == 0)) {
@@ -761,6 +1380,120 @@ static void add_data_vio_to_input_bin(struct packer *packer,
 	insert_in_sorted_list(packer, bin);
 }
 
+/**
+ * Set the residency timer to expire when the oldest data_vio in an input bin
+ * has waited for the maximum residency, unless the timer is already set, or
+ * there is no limit, or no data_vio is waiting.
+ *
+ * @param packer  The packer
+ **/
+static void arm_residency_timer(struct packer *packer)
+{
+	struct input_bin *bin;
+	uint64_t oldest = U64_MAX;
+	uint64_t deadline, now;
+	unsigned long delay = 0;
+	unsigned int residency_ms = READ_ONCE(packer->max_residency_ms);
+
+	if (packer->residency_timer_armed || (residency_ms == 0)) {
+		return;
+	}
+
+	for (bin = get_fullest_bin(packer); bin != NULL;
+	     bin = next_bin(packer, bin)) {
+		if ((bin->slots_used > 0) && (bin->oldest_arrival < oldest)) {
+			oldest = bin->oldest_arrival;
+		}
+	}
+
+	if (oldest == U64_MAX) {
+		return;
+	}
+
+	deadline = oldest + ((uint64_t) residency_ms * NSEC_PER_MSEC);
+	now = ktime_get_ns();
+	if (deadline > now) {
+		delay = nsecs_to_jiffies(deadline - now);
+	}
+
+	packer->residency_timer_armed = true;
+	prepare_vdo_completion(&packer->residency_completion,
+			       expire_overdue_bins,
+			       expire_overdue_bins,
+			       packer->thread_id,
+			       packer);
+	// Round up so that the timer never expires before the deadline.
+	mod_timer(&packer->residency_timer, jiffies + delay + 1);
+}
+
+/**
+ * Start a batch in every input bin whose oldest data_vio has waited for the
+ * maximum residency, and set the timer for the next such deadline. This is
+ * the callback of the residency completion, which is enqueued on the packer
+ * thread when the residency timer expires.
+ *
+ * @param completion  The residency completion
+ **/
+static void expire_overdue_bins(struct vdo_completion *completion)
+{
+	struct packer *packer = completion->parent;
+	unsigned int residency_ms = READ_ONCE(packer->max_residency_ms);
+	uint64_t cutoff;
+	struct input_bin *bin;
+	bool expired;
+
+	assert_on_packer_thread(packer, __func__);
+	packer->residency_timer_armed = false;
+	if (!is_vdo_state_normal(&packer->state) || (residency_ms == 0)) {
+		return;
+	}
+
+	cutoff = ktime_get_ns() - ((uint64_t) residency_ms * NSEC_PER_MSEC);
+	do {
+		// Starting a batch re-sorts the bins, so rescan after each.
+		expired = false;
+		for (bin = get_fullest_bin(packer); bin != NULL;
+		     bin = next_bin(packer, bin)) {
+			if ((bin->slots_used > 0) &&
+			    (bin->oldest_arrival <= cutoff)) {
+				start_new_batch(packer, bin);
+				insert_in_sorted_list(packer, bin);
+				expired = true;
+				break;
+			}
+		}
+	} while (expired);
+
+	write_pending_batches(packer);
+	arm_residency_timer(packer);
+}
+
+/**
+ * Update the statistics describing the data_vios waiting for output bins and
+ * the state of the output bins. These are gauges, written only on the packer
+ * thread, so that a reader can tell whether the packer is waiting on its
+ * output bins or on compression.
+ *
+ * @param packer  The packer
+ **/
+static void update_output_statistics(struct packer *packer)
+{
+	struct packer_statistics *stats = &packer->statistics;
+	bool stalled = has_waiters(&packer->batched_data_vios);
+
+	if (stalled && !packer->output_stalled) {
+		WRITE_ONCE(stats->output_bin_stalls,
+			   stats->output_bin_stalls + 1);
+	}
+
+	packer->output_stalled = stalled;
+	WRITE_ONCE(stats->fragments_awaiting_output,
+		   count_waiters(&packer->batched_data_vios));
+	WRITE_ONCE(stats->output_bins_busy,
+		   packer->output_bin_count - packer->idle_output_bin_count);
+	WRITE_ONCE(stats->output_bins_idle, packer->idle_output_bin_count);
+}
+
 /**
  * Move data_vios in pending batches from the batched_data_vios to all free
  * output bins, issuing writes for the output bins as they are packed. This
@@ -797,18 +1530,13 @@ static void write_pending_batches(struct packer *packer)
 		}
 	}
 
+	update_output_statistics(packer);
 	packer->writing_batches = false;
 }
 
-/**
- * Select the input bin that should be used to pack the compressed data in a
- * data_vio with other data_vios.
- *
- * @param packer    The packer
- * @param data_vio  The data_vio
- **/
-static struct input_bin * __must_check
-select_input_bin(struct packer *packer, struct data_vio *data_vio)
+/**********************************************************************/
+struct input_bin *select_input_bin(struct packer *packer,
+				   struct data_vio *data_vio)
 {
 	// First best fit: select the bin with the least free space that has
 	// enough room for the compressed data in the data_vio.
@@ -892,8 +1620,10 @@ void attempt_packing(struct data_vio *data_vio)
 		return;
 	}
 
+	data_vio->compression.packer_arrival = ktime_get_ns();
 	add_data_vio_to_input_bin(packer, bin, data_vio);
 	write_pending_batches(packer);
+	arm_residency_timer(packer);
 }
 
 /**
@@ -905,12 +1635,13 @@ void attempt_packing(struct data_vio *data_vio)
 static void write_all_non_empty_bins(struct packer *packer)
 {
 	struct input_bin *bin;
-	for (bin = get_fullest_bin(packer); bin != NULL;
-	     bin = next_bin(packer, bin)) {
+
+	// Starting a batch may move fragments out of other bins, so always
+	// write the fullest bin next; emptied bins sort to the end of the list.
+	while (((bin = get_fullest_bin(packer)) != NULL) &&
+	       (bin->slots_used > 0)) {
 		start_new_batch(packer, bin);
-		// We don't need to re-sort the bin here since this loop will
-		// make every bin have the same amount of free space, so every
-		// ordering is sorted.
+		insert_in_sorted_list(packer, bin);
 	}
 
 	write_pending_batches(packer);
@@ -949,6 +1680,8 @@ static void remove_from_packer(struct data_vio *data_vio)
 	if (bin != packer->canceled_bin) {
 		bin->free_space += data_vio->compression.size;
 		insert_in_sorted_list(packer, bin);
+		WRITE_ONCE(packer->statistics.fragments_in_input_bins,
+			   packer->statistics.fragments_in_input_bins - 1);
 	}
 
 	abort_packing(data_vio);
@@ -983,25 +1716,60 @@ void increment_packer_flush_generation(struct packer *packer)
 static void initiate_drain(struct admin_state *state)
 {
 	struct packer *packer = container_of(state, struct packer, state);
+
+	// Every bin is about to be written, so no deadline will be left to
+	// enforce. A timer which has already expired will find nothing to do.
+	if (del_timer_sync(&packer->residency_timer)) {
+		packer->residency_timer_armed = false;
+	}
+
 	write_all_non_empty_bins(packer);
 	check_for_drain_complete(packer);
 }
 
-/**********************************************************************/
-void drain_packer(struct packer *packer, struct vdo_completion *completion)
+/**
+ * Drain a packer zone.
+ *
+ * <p>Implements vdo_zone_action.
+ **/
+static void drain_packer_zone(void *context, zone_count_t zone_number,
+			      struct vdo_completion *parent)
 {
+	struct packer *packer = get_packer_zone(context, zone_number);
 	assert_on_packer_thread(packer, __func__);
-	start_vdo_draining(&packer->state, ADMIN_STATE_SUSPENDING, completion,
+	start_vdo_draining(&packer->state, ADMIN_STATE_SUSPENDING, parent,
 			   initiate_drain);
 }
 
 /**********************************************************************/
-void resume_packer(struct packer *packer, struct vdo_completion *parent)
+void drain_packer_zones(struct packer_zones *zones,
+			struct vdo_completion *completion)
+{
+	schedule_vdo_operation(zones->manager, ADMIN_STATE_SUSPENDING, NULL,
+			       drain_packer_zone, NULL, completion);
+}
+
+/**
+ * Resume a packer zone.
+ *
+ * <p>Implements vdo_zone_action.
+ **/
+static void resume_packer_zone(void *context, zone_count_t zone_number,
+			       struct vdo_completion *parent)
 {
+	struct packer *packer = get_packer_zone(context, zone_number);
 	assert_on_packer_thread(packer, __func__);
 	finish_vdo_completion(parent, resume_vdo_if_quiescent(&packer->state));
 }
 
+/**********************************************************************/
+void resume_packer_zones(struct packer_zones *zones,
+			 struct vdo_completion *parent)
+{
+	schedule_vdo_operation(zones->manager, ADMIN_STATE_RESUMING, NULL,
+			       resume_packer_zone, NULL, parent);
+}
+
 
 /**********************************************************************/
 static void dump_input_bin(const struct input_bin *bin, bool canceled)
@@ -1039,12 +1807,12 @@ static void dump_output_bin(const struct output_bin *bin)
 }
 
 /**********************************************************************/
-void dump_packer(const struct packer *packer)
+static void dump_packer(const struct packer *packer)
 {
 	struct input_bin *input;
 	struct output_bin *output;
 
-	log_info("packer");
+	log_info("packer %u", packer->zone_number);
 	log_info("  flushGeneration=%llu state %s writing_batches=%s",
 		 packer->flush_generation,
 		 get_vdo_admin_state_name(&packer->state),
@@ -1064,3 +1832,12 @@ void dump_packer(const struct packer *packer)
 		dump_output_bin(output);
 	}
 }
+
+/**********************************************************************/
+void dump_packer_zones(const struct packer_zones *zones)
+{
+	zone_count_t zone;
+	for (zone = 0; zone < zones->zone_count; zone++) {
+		dump_packer(zones->packers[zone]);
+	}
+}
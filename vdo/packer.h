@@ -31,32 +31,47 @@
 enum {
 	DEFAULT_PACKER_INPUT_BINS = 16,
 	DEFAULT_PACKER_OUTPUT_BINS = 256,
+	/** The largest settable bound on input bin residency, in ms */
+	MAXIMUM_PACKER_RESIDENCY_MS = 60 * 1000,
 };
 
 struct packer;
+struct packer_zones;
 
 /**
- * Make a new block packer.
+ * Make the block packers, one for each packer zone.
  *
- * @param [in]  vdo               The vdo to which this packer belongs
- * @param [in]  input_bin_count   The number of partial bins to keep in memory
- * @param [in]  output_bin_count  The number of compressed blocks that can be
- *                                written concurrently
- * @param [out] packer_ptr        A pointer to hold the new packer
+ * @param [in]  vdo               The vdo to which the packers belong
+ * @param [in]  input_bin_count   The number of partial bins each packer keeps
+ *                                in memory
+ * @param [in]  output_bin_count  The number of compressed blocks each packer
+ *                                can write concurrently
+ * @param [out] zones_ptr         A pointer to hold the new packer zones
  *
  * @return VDO_SUCCESS or an error
  **/
-int __must_check make_packer(struct vdo *vdo,
-			     block_count_t input_bin_count,
-			     block_count_t output_bin_count,
-			     struct packer **packer_ptr);
+int __must_check make_packer_zones(struct vdo *vdo,
+				   block_count_t input_bin_count,
+				   block_count_t output_bin_count,
+				   struct packer_zones **zones_ptr);
 
 /**
- * Free a block packer and null out the reference to it.
+ * Free the block packers and null out the reference to them.
  *
- * @param packer_ptr  A pointer to the packer to free
+ * @param zones_ptr  A pointer to the packer zones to free
  **/
-void free_packer(struct packer **packer_ptr);
+void free_packer_zones(struct packer_zones **zones_ptr);
+
+/**
+ * Get the packer for a zone.
+ *
+ * @param zones        The packer zones
+ * @param zone_number  The number of the zone
+ *
+ * @return The packer for the zone
+ **/
+struct packer * __must_check
+get_packer_zone(struct packer_zones *zones, zone_count_t zone_number);
 
 /**
  * Check whether the compressed data in a data_vio will fit in a packer bin.
@@ -77,14 +92,46 @@ bool __must_check is_sufficiently_compressible(struct data_vio *data_vio);
 thread_id_t get_packer_thread_id(struct packer *packer);
 
 /**
- * Get the current statistics from the packer.
+ * Get the longest time a data_vio may wait in an input bin before the bin is
+ * written even though it is not full.
  *
- * @param packer  The packer to query
+ * @param zones  The packer zones
  *
- * @return a copy of the current statistics for the packer
+ * @return The maximum residency in milliseconds, or 0 if there is no limit
  **/
-struct packer_statistics __must_check
-get_packer_statistics(const struct packer *packer);
+unsigned int __must_check
+get_packer_max_residency(struct packer_zones *zones);
+
+/**
+ * Set the longest time a data_vio may wait in an input bin before the bin is
+ * written even though it is not full. The new limit applies from the next
+ * expiration of the residency timer, or from the next data_vio to enter an
+ * input bin if the timer is not set.
+ *
+ * @param zones         The packer zones
+ * @param residency_ms  The maximum residency in milliseconds, or 0 for no
+ *                      limit
+ **/
+void set_packer_max_residency(struct packer_zones *zones,
+			      unsigned int residency_ms);
+
+/**
+ * Get the current statistics from the packers, summed over all zones.
+ *
+ * @param [in]  zones   The packer zones to query
+ * @param [out] totals  A copy of the current statistics for the packers
+ **/
+void get_packer_statistics(const struct packer_zones *zones,
+			   struct packer_statistics *totals);
+
+/**
+ * Count a data_vio which has returned from the compression step, noting
+ * its compressed size and whether the compressor was skipped because its
+ * data sampled as incompressible.
+ *
+ * @param data_vio  The data_vio which was considered for compression
+ **/
+void record_compression_candidate(struct data_vio *data_vio);
 
 /**
  * Attempt to rewrite the data in this data_vio as part of a compressed block.
@@ -123,27 +170,30 @@ void remove_lock_holder_from_packer(struct vdo_completion *completion);
 void increment_packer_flush_generation(struct packer *packer);
 
 /**
- * Drain the packer by preventing any more VIOs from entering the packer and
- * then flushing.
+ * Drain the packers by preventing any more VIOs from entering them and then
+ * flushing. This must be called on the admin thread.
  *
- * @param packer      The packer to drain
- * @param completion  The completion to finish when the packer has drained
+ * @param zones       The packer zones to drain
+ * @param completion  The completion to finish when the packers have drained
  **/
-void drain_packer(struct packer *packer, struct vdo_completion *completion);
+void drain_packer_zones(struct packer_zones *zones,
+			struct vdo_completion *completion);
 
 /**
- * Resume a packer which has been suspended.
+ * Resume packers which have been suspended. This must be called on the admin
+ * thread.
  *
- * @param packer  The packer to resume
- * @param parent  The completion to finish when the packer has resumed
+ * @param zones   The packer zones to resume
+ * @param parent  The completion to finish when the packers have resumed
  **/
-void resume_packer(struct packer *packer, struct vdo_completion *parent);
+void resume_packer_zones(struct packer_zones *zones,
+			 struct vdo_completion *parent);
 
 /**
- * Dump the packer, in a thread-unsafe fashion.
+ * Dump the packers, in a thread-unsafe fashion.
  *
- * @param packer  The packer
+ * @param zones  The packer zones
  **/
-void dump_packer(const struct packer *packer);
+void dump_packer_zones(const struct packer_zones *zones);
 
 #endif /* PACKER_H */
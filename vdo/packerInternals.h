@@ -23,11 +23,14 @@
 #define PACKER_INTERNALS_H
 
 #include <linux/list.h>
+#include <linux/timer.h>
 
 #include "packer.h"
 
 #include "adminState.h"
+#include "completion.h"
 #include "compressedBlock.h"
+#include "dataVIO.h"
 #include "header.h"
 #include "statistics.h"
 #include "types.h"
@@ -55,19 +58,35 @@ struct input_bin {
 	 * The number of compressed block bytes remaining in the current batch
 	 */
 	size_t free_space;
+	/**
+	 * The arrival time of the oldest data_vio in the current batch, valid
+	 * only when slots_used is not zero
+	 */
+	uint64_t oldest_arrival;
 	/** The current partial batch of data_vios, waiting for more */
 	struct data_vio *incoming[];
 };
 
+/**
+ * A counted array holding a batch of data_vios that should be packed into an
+ * output bin.
+ **/
+struct output_batch {
+	size_t slots_used;
+	struct data_vio *slots[MAX_COMPRESSION_SLOTS];
+};
+
 /**
  * Each output_bin allows a single compressed block to be packed and written.
- * When it is not idle, it holds a batch of data_vios that have been packed
- * into the compressed block, written asynchronously, and are waiting for the
- * write to complete.
+ * When it is not idle, it holds a batch of data_vios whose compression units
+ * are being compressed, or which have been packed into the compressed block,
+ * written asynchronously, and are waiting for the write to complete.
  **/
 struct output_bin {
 	/** List links for packer.output_bins */
 	struct list_head list;
+	/** The packer which owns this bin */
+	struct packer *packer;
 	/** The storage for encoding the compressed block representation */
 	struct compressed_block *block;
 	/**
@@ -76,23 +95,27 @@ struct output_bin {
 	struct allocating_vio *writer;
 	/** The number of compression slots used in the compressed block */
 	slot_number_t slots_used;
+	/** The number of fragment bytes packed into the compressed block */
+	size_t space_used;
 	/** The data_vios packed into the block, waiting for the write to
 	 * complete */
 	struct wait_queue outgoing;
-};
-
-/**
- * A counted array holding a batch of data_vios that should be packed into an
- * output bin.
- **/
-struct output_batch {
-	size_t slots_used;
-	struct data_vio *slots[MAX_COMPRESSION_SLOTS];
+	/** The batch being packed into the block */
+	struct output_batch batch;
+	/**
+	 * The compression units of the batch, while they are being compressed
+	 * off the packer thread
+	 **/
+	struct compression_units units;
+	/** The buffer for the fragments of the units, if units are enabled */
+	char *unit_fragments;
 };
 
 struct packer {
 	/** The ID of the packer's callback thread */
 	thread_id_t thread_id;
+	/** The number of this packer's zone */
+	zone_count_t zone_number;
 	/** The selector determining which physical zone to allocate from */
 	struct allocation_selector *selector;
 	/** The number of input bins */
@@ -101,6 +124,13 @@ struct packer {
 	size_t bin_data_size;
 	/** The number of compression slots */
 	size_t max_slots;
+	/** The format of the compressed fragments being packed */
+	enum vdo_compression_format format;
+	/**
+	 * The most logically consecutive data_vios of a batch to compress
+	 * together as one fragment
+	 **/
+	unsigned int max_unit_blocks;
 	/** A list of all input_bins, kept sorted by free_space */
 	struct list_head input_bins;
 	/** A list of all output_bins */
@@ -118,6 +148,32 @@ struct packer {
 	struct admin_state state;
 	/** True when writing batched data_vios */
 	bool writing_batches;
+	/** True while batched data_vios are waiting for an idle output bin */
+	bool output_stalled;
+
+	/**
+	 * The longest a data_vio may wait in an input bin, in milliseconds,
+	 * or 0 for no limit
+	 **/
+	unsigned int max_residency_ms;
+	/**
+	 * True from when the residency timer is set until its completion
+	 * runs on the packer thread
+	 **/
+	bool residency_timer_armed;
+	/** The timer which bounds the residency of data_vios in input bins */
+	struct timer_list residency_timer;
+	/** The completion which brings an expired timer to the packer thread */
+	struct vdo_completion residency_completion;
+	/** The time data_vios spent in input bins */
+	struct histogram *residency_histogram;
+	/** The compressed sizes of compression candidates */
+	struct histogram *compressed_size_histogram;
+	/**
+	 * The time from data_vios entering the packer to being packed into
+	 * an output bin
+	 **/
+	struct histogram *packing_histogram;
 
 	/**
 	 * Statistics are only updated on the packer thread, but are
@@ -136,5 +192,25 @@ struct packer {
 	struct output_bin *idle_output_bins[];
 };
 
+struct packer_zones {
+	/** The manager for administrative actions */
+	struct action_manager *manager;
+	/** The number of zones */
+	zone_count_t zone_count;
+	/** The packers, one per zone */
+	struct packer *packers[];
+};
+
+/**
+ * Select the input bin that should be used to pack the compressed data in a
+ * data_vio with other data_vios. Exposed for unit testing.
+ *
+ * @param packer    The packer
+ * @param data_vio  The data_vio
+ *
+ * @return The selected bin, or NULL if the data_vio should not be packed
+ **/
+struct input_bin * __must_check
+select_input_bin(struct packer *packer, struct data_vio *data_vio);
 
 #endif /* PACKER_INTERNALS_H */
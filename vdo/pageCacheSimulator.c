@@ -0,0 +1,203 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "pageCacheSimulator.h"
+
+#include <linux/hash.h>
+#include <linux/list.h>
+
+#include "memoryAlloc.h"
+
+#include "intMap.h"
+#include "statusCodes.h"
+
+enum {
+	/** The fewest pages to simulate in the smallest simulated cache */
+	SIMULATOR_MINIMUM_PAGES = 256,
+	/** The log of the lowest sampling rate */
+	SIMULATOR_MAXIMUM_SAMPLE_SHIFT = 16,
+};
+
+/** A page in a simulated cache. */
+struct simulated_page {
+	/** The entry on the LRU list of the simulated cache */
+	struct list_head entry;
+	/** The pbn of the page */
+	physical_block_number_t pbn;
+};
+
+/** An LRU cache holding only the pbns of its pages. */
+struct simulated_cache {
+	/** The number of pages the cache may hold */
+	page_count_t capacity;
+	/** The number of pages which have been used */
+	page_count_t count;
+	/** The map of pbn to page */
+	struct int_map *map;
+	/** The pages, least recently used first */
+	struct list_head lru;
+	/** The pages */
+	struct simulated_page *pages;
+};
+
+struct page_cache_simulator {
+	/** The log of the sampling rate */
+	unsigned int sample_shift;
+	/** The simulated caches, indexed by simulated_cache_size */
+	struct simulated_cache caches[SIMULATED_CACHE_COUNT];
+};
+
+/**
+ * Get the size of a simulated cache in half multiples of the real cache size.
+ *
+ * @param size  The simulated cache size
+ *
+ * @return The number of halves of the real cache size
+ **/
+static inline page_count_t get_halves(enum simulated_cache_size size)
+{
+	return 1 << size;
+}
+
+/**********************************************************************/
+int make_page_cache_simulator(page_count_t page_count,
+			      struct page_cache_simulator **simulator_ptr)
+{
+	struct page_cache_simulator *simulator;
+	enum simulated_cache_size size;
+	page_count_t half = page_count / 2;
+	int result = ALLOCATE(1, struct page_cache_simulator,
+			      __func__, &simulator);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	// Sample as sparsely as the smallest simulated cache allows.
+	while ((simulator->sample_shift < SIMULATOR_MAXIMUM_SAMPLE_SHIFT) &&
+	       ((half >> (simulator->sample_shift + 1)) >=
+		SIMULATOR_MINIMUM_PAGES)) {
+		simulator->sample_shift++;
+	}
+
+	for (size = 0; size < SIMULATED_CACHE_COUNT; size++) {
+		struct simulated_cache *cache = &simulator->caches[size];
+
+		INIT_LIST_HEAD(&cache->lru);
+		cache->capacity =
+			max_t(page_count_t,
+			      ((uint64_t) half * get_halves(size))
+			      >> simulator->sample_shift,
+			      1);
+		result = make_int_map(cache->capacity, 0, &cache->map);
+		if (result != VDO_SUCCESS) {
+			free_page_cache_simulator(&simulator);
+			return result;
+		}
+
+		result = ALLOCATE(cache->capacity, struct simulated_page,
+				  "simulated pages", &cache->pages);
+		if (result != VDO_SUCCESS) {
+			free_page_cache_simulator(&simulator);
+			return result;
+		}
+	}
+
+	*simulator_ptr = simulator;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_page_cache_simulator(struct page_cache_simulator **simulator_ptr)
+{
+	enum simulated_cache_size size;
+	struct page_cache_simulator *simulator = *simulator_ptr;
+	if (simulator == NULL) {
+		return;
+	}
+
+	for (size = 0; size < SIMULATED_CACHE_COUNT; size++) {
+		free_int_map(&simulator->caches[size].map);
+		FREE(simulator->caches[size].pages);
+	}
+
+	FREE(simulator);
+	*simulator_ptr = NULL;
+}
+
+/**
+ * Get a page from a simulated cache, replacing the least recently used page
+ * if it is not there.
+ *
+ * @param cache  The simulated cache
+ * @param pbn    The pbn of the page
+ *
+ * @return <code>true</code> if the page was in the cache
+ **/
+static bool get_simulated_page(struct simulated_cache *cache,
+			       physical_block_number_t pbn)
+{
+	struct simulated_page *page = int_map_get(cache->map, pbn);
+	if (page != NULL) {
+		list_move_tail(&page->entry, &cache->lru);
+		return true;
+	}
+
+	if (cache->count < cache->capacity) {
+		page = &cache->pages[cache->count++];
+	} else {
+		page = list_first_entry(&cache->lru, struct simulated_page,
+					entry);
+		list_del(&page->entry);
+		// A page may have been left unmapped by a failed put.
+		if (int_map_get(cache->map, page->pbn) == page) {
+			int_map_remove(cache->map, page->pbn);
+		}
+	}
+
+	page->pbn = pbn;
+	if (int_map_put(cache->map, pbn, page, true, NULL) != VDO_SUCCESS) {
+		// Leave the page unmapped, to be reused first.
+		list_add(&page->entry, &cache->lru);
+		return false;
+	}
+
+	list_add_tail(&page->entry, &cache->lru);
+	return false;
+}
+
+/**********************************************************************/
+bool simulate_page_cache_get(struct page_cache_simulator *simulator,
+			     physical_block_number_t pbn,
+			     unsigned int *hits)
+{
+	enum simulated_cache_size size;
+	uint32_t sample_mask = (1U << simulator->sample_shift) - 1;
+	if ((hash_64(pbn, 32) & sample_mask) != 0) {
+		return false;
+	}
+
+	*hits = 0;
+	for (size = 0; size < SIMULATED_CACHE_COUNT; size++) {
+		if (get_simulated_page(&simulator->caches[size], pbn)) {
+			*hits |= (1 << size);
+		}
+	}
+
+	return true;
+}
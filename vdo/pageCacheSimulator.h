@@ -0,0 +1,79 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PAGE_CACHE_SIMULATOR_H
+#define PAGE_CACHE_SIMULATOR_H
+
+#include "types.h"
+
+/**
+ * A page cache simulator runs a sample of the pages fetched through a block
+ * map page cache through LRU caches of several sizes relative to the real
+ * cache, so that the hit ratio each size would achieve can be reported
+ * without resizing the cache. Only the pages whose pbns hash into the sample
+ * are simulated, and each simulated cache is scaled down by the sampling
+ * rate, so the simulator is small and cheap next to the cache it models.
+ **/
+struct page_cache_simulator;
+
+/**
+ * The sizes of the simulated caches, as multiples of the real cache size.
+ **/
+enum simulated_cache_size {
+	SIMULATED_HALF_SIZE = 0,
+	SIMULATED_SAME_SIZE,
+	SIMULATED_DOUBLE_SIZE,
+	SIMULATED_QUADRUPLE_SIZE,
+	SIMULATED_CACHE_COUNT,
+};
+
+/**
+ * Make a page cache simulator.
+ *
+ * @param [in]  page_count     The number of pages in the real cache
+ * @param [out] simulator_ptr  A pointer to hold the new simulator
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check
+make_page_cache_simulator(page_count_t page_count,
+			  struct page_cache_simulator **simulator_ptr);
+
+/**
+ * Free a page cache simulator and null out the reference to it.
+ *
+ * @param simulator_ptr  A pointer to the simulator to free
+ **/
+void free_page_cache_simulator(struct page_cache_simulator **simulator_ptr);
+
+/**
+ * Simulate a get of a page.
+ *
+ * @param [in]  simulator  The simulator
+ * @param [in]  pbn        The pbn of the page
+ * @param [out] hits       A bit for each simulated_cache_size whose cache
+ *                         held the page
+ *
+ * @return <code>true</code> if the page is in the sample
+ **/
+bool simulate_page_cache_get(struct page_cache_simulator *simulator,
+			     physical_block_number_t pbn,
+			     unsigned int *hits);
+
+#endif // PAGE_CACHE_SIMULATOR_H
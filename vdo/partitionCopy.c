@@ -21,6 +21,7 @@
 
 #include "partitionCopy.h"
 
+#include "logger.h"
 #include "memoryAlloc.h"
 #include "permassert.h"
 
@@ -30,7 +31,33 @@
 #include "numUtils.h"
 
 enum {
-	STRIDE_LENGTH = 2048
+	/*
+	 * The copy keeps several strides in flight, so that the device always
+	 * has a read or a write to work on, while still using the same 8MB
+	 * of buffer space as a single 2048 block stride did.
+	 */
+	COPY_STRIDE_COUNT = 4,
+	STRIDE_LENGTH = 512,
+	/* The number of times the progress of a copy is logged */
+	PROGRESS_REPORTS = 4,
+};
+
+struct copy_completion;
+
+/**
+ * One of the strides in flight during a partition copy.
+ **/
+struct copy_stride {
+	/** the copy this stride belongs to */
+	struct copy_completion *copy;
+	/** the in-partition PBN the stride begins at */
+	physical_block_number_t index;
+	/** the number of blocks in the stride */
+	block_count_t length;
+	/** the backing data used by the extent */
+	char *data;
+	/** the extent used to copy the stride */
+	struct vdo_extent *extent;
 };
 
 /**
@@ -43,14 +70,20 @@ struct copy_completion {
 	struct partition *source;
 	/** the target partition to copy to */
 	struct partition *target;
-	/** the current in-partition PBN the copy is beginning at */
-	physical_block_number_t current_index;
+	/** the in-partition PBN the next stride will begin at */
+	physical_block_number_t next_index;
 	/** the last block to copy */
 	physical_block_number_t ending_index;
-	/** the backing data used by the extent */
-	char *data;
-	/** the extent being used to copy */
-	struct vdo_extent *extent;
+	/** the number of blocks which have been copied */
+	block_count_t blocks_copied;
+	/** the number of blocks copied when progress is next logged */
+	block_count_t next_report;
+	/** the number of strides in flight */
+	unsigned int active_strides;
+	/** the first error encountered by any stride */
+	int result;
+	/** the strides */
+	struct copy_stride strides[COPY_STRIDE_COUNT];
 };
 
 /**
@@ -67,11 +100,36 @@ as_copy_completion(struct vdo_completion *completion)
 	return container_of(completion, struct copy_completion, completion);
 }
 
+/**
+ * Get the stride an extent completion belongs to.
+ *
+ * @param completion  The completion of the stride's extent
+ *
+ * @return The stride
+ **/
+static struct copy_stride * __must_check
+as_copy_stride(struct vdo_completion *completion)
+{
+	struct copy_completion *copy = as_copy_completion(completion->parent);
+	struct vdo_extent *extent = vdo_completion_as_extent(completion);
+	unsigned int i;
+
+	for (i = 0; i < COPY_STRIDE_COUNT; i++) {
+		if (copy->strides[i].extent == extent) {
+			return &copy->strides[i];
+		}
+	}
+
+	ASSERT_LOG_ONLY(false, "extent belongs to a stride of its copy");
+	return NULL;
+}
+
 /**********************************************************************/
 int make_copy_completion(struct vdo *vdo,
 			 struct vdo_completion **completion_ptr)
 {
 	struct copy_completion *copy;
+	unsigned int i;
 	int result = ALLOCATE(1, struct copy_completion, __func__, &copy);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -79,26 +137,31 @@ int make_copy_completion(struct vdo *vdo,
 	initialize_vdo_completion(&copy->completion, vdo,
 				  PARTITION_COPY_COMPLETION);
 
-	result = ALLOCATE((VDO_BLOCK_SIZE * STRIDE_LENGTH),
-			  char,
-			  "partition copy extent",
-			  &copy->data);
-	if (result != VDO_SUCCESS) {
-		struct vdo_completion *completion = &copy->completion;
-		free_copy_completion(&completion);
-		return result;
-	}
+	for (i = 0; i < COPY_STRIDE_COUNT; i++) {
+		struct copy_stride *stride = &copy->strides[i];
 
-	result = create_vdo_extent(vdo,
-				   VIO_TYPE_PARTITION_COPY,
-				   VIO_PRIORITY_HIGH,
-				   STRIDE_LENGTH,
-				   copy->data,
-				   &copy->extent);
-	if (result != VDO_SUCCESS) {
-		struct vdo_completion *completion = &copy->completion;
-		free_copy_completion(&completion);
-		return result;
+		stride->copy = copy;
+		result = ALLOCATE((VDO_BLOCK_SIZE * STRIDE_LENGTH),
+				  char,
+				  "partition copy extent",
+				  &stride->data);
+		if (result != VDO_SUCCESS) {
+			struct vdo_completion *completion = &copy->completion;
+			free_copy_completion(&completion);
+			return result;
+		}
+
+		result = create_vdo_extent(vdo,
+					   VIO_TYPE_PARTITION_COPY,
+					   VIO_PRIORITY_HIGH,
+					   STRIDE_LENGTH,
+					   stride->data,
+					   &stride->extent);
+		if (result != VDO_SUCCESS) {
+			struct vdo_completion *completion = &copy->completion;
+			free_copy_completion(&completion);
+			return result;
+		}
 	}
 
 	*completion_ptr = &copy->completion;
@@ -109,32 +172,80 @@ int make_copy_completion(struct vdo *vdo,
 void free_copy_completion(struct vdo_completion **completion_ptr)
 {
 	struct copy_completion *copy;
+	unsigned int i;
 
 	if (*completion_ptr == NULL) {
 		return;
 	}
 
 	copy = as_copy_completion(*completion_ptr);
-	free_vdo_extent(&copy->extent);
-	FREE(copy->data);
+	for (i = 0; i < COPY_STRIDE_COUNT; i++) {
+		free_vdo_extent(&copy->strides[i].extent);
+		FREE(copy->strides[i].data);
+	}
+
 	FREE(copy);
 	*completion_ptr = NULL;
 }
 
 /**********************************************************************/
-static void copy_partition_stride(struct copy_completion *copy);
+static void copy_partition_stride(struct copy_stride *stride);
 
 /**
- * Determine the number of blocks to copy in the current stride.
+ * Note that a stride has finished, successfully or not. If the copy is still
+ * good and there is more to copy, the stride is reused for the next part of
+ * the partition. Otherwise, once no strides remain in flight, the copy is
+ * finished with the first error any stride encountered.
  *
- * @param copy  The copy completion
+ * @param stride  The stride which has finished
+ * @param result  The result of the stride
+ **/
+static void finish_stride(struct copy_stride *stride, int result)
+{
+	struct copy_completion *copy = stride->copy;
+
+	copy->active_strides--;
+	if (copy->result == VDO_SUCCESS) {
+		copy->result = result;
+	}
+
+	if ((copy->result == VDO_SUCCESS) &&
+	    (copy->next_index < copy->ending_index)) {
+		copy_partition_stride(stride);
+		return;
+	}
+
+	if (copy->active_strides == 0) {
+		finish_vdo_completion(&copy->completion, copy->result);
+	}
+}
+
+/**
+ * Handle an error reading or writing a stride.
  *
- * @return The number of blocks to copy in the current stride
+ * @param completion  The extent of the stride which failed
  **/
-static inline block_count_t get_stride_size(struct copy_completion *copy)
+static void handle_stride_error(struct vdo_completion *completion)
 {
-	return min((block_count_t) STRIDE_LENGTH,
-		   copy->ending_index - copy->current_index);
+	finish_stride(as_copy_stride(completion), completion->result);
+}
+
+/**
+ * Log the progress of a copy each time another part of it has been done.
+ *
+ * @param copy  The copy completion
+ **/
+static void report_copy_progress(struct copy_completion *copy)
+{
+	if (copy->blocks_copied < copy->next_report) {
+		return;
+	}
+
+	log_info("partition copy has copied %llu of %llu blocks",
+		 (unsigned long long) copy->blocks_copied,
+		 (unsigned long long) copy->ending_index);
+	copy->next_report += max((block_count_t) 1,
+				 copy->ending_index / PROGRESS_REPORTS);
 }
 
 /**
@@ -144,14 +255,11 @@ static inline block_count_t get_stride_size(struct copy_completion *copy)
  **/
 static void complete_write_for_copy(struct vdo_completion *completion)
 {
-	struct copy_completion *copy = as_copy_completion(completion->parent);
-	copy->current_index += get_stride_size(copy);
-	if (copy->current_index >= copy->ending_index) {
-		// We're done.
-		finish_vdo_completion(completion->parent, VDO_SUCCESS);
-		return;
-	}
-	copy_partition_stride(copy);
+	struct copy_stride *stride = as_copy_stride(completion);
+
+	stride->copy->blocks_copied += stride->length;
+	report_copy_progress(stride->copy);
+	finish_stride(stride, VDO_SUCCESS);
 }
 
 /**
@@ -162,43 +270,53 @@ static void complete_write_for_copy(struct vdo_completion *completion)
  **/
 static void complete_read_for_copy(struct vdo_completion *completion)
 {
-	struct copy_completion *copy = as_copy_completion(completion->parent);
+	struct copy_stride *stride = as_copy_stride(completion);
 	physical_block_number_t layer_start_block;
-	int result = translate_to_pbn(copy->target, copy->current_index,
+	int result = translate_to_pbn(stride->copy->target, stride->index,
 				      &layer_start_block);
 	if (result != VDO_SUCCESS) {
-		finish_vdo_completion(completion->parent, result);
+		finish_stride(stride, result);
 		return;
 	}
 
 	completion->callback = complete_write_for_copy;
-	write_partial_vdo_metadata_extent(vdo_completion_as_extent(completion),
+	write_partial_vdo_metadata_extent(stride->extent,
 					  layer_start_block,
-					  get_stride_size(copy));
+					  stride->length);
 }
 
 /**
- * Copy a stride from one partition to the new partition.
+ * Claim the next unclaimed part of the partition for a stride and launch the
+ * read of it from the source partition.
  *
- * @param copy  The copy_completion
+ * @param stride  The stride to launch
  **/
-static void copy_partition_stride(struct copy_completion *copy)
+static void copy_partition_stride(struct copy_stride *stride)
 {
+	struct copy_completion *copy = stride->copy;
 	physical_block_number_t layer_start_block;
-	int result = translate_to_pbn(copy->source, copy->current_index,
-				      &layer_start_block);
+	int result;
+
+	stride->index = copy->next_index;
+	stride->length = min((block_count_t) STRIDE_LENGTH,
+			     copy->ending_index - copy->next_index);
+	copy->next_index += stride->length;
+	copy->active_strides++;
+
+	result = translate_to_pbn(copy->source, stride->index,
+				  &layer_start_block);
 	if (result != VDO_SUCCESS) {
-		finish_vdo_completion(&copy->completion, result);
+		finish_stride(stride, result);
 		return;
 	}
 
-	prepare_vdo_completion(&copy->extent->completion,
+	prepare_vdo_completion(&stride->extent->completion,
 			       complete_read_for_copy,
-			       finish_vdo_completion_parent_callback,
+			       handle_stride_error,
 			       copy->completion.callback_thread_id,
 			       &copy->completion);
-	read_partial_vdo_metadata_extent(copy->extent, layer_start_block,
-					 get_stride_size(copy));
+	read_partial_vdo_metadata_extent(stride->extent, layer_start_block,
+					 stride->length);
 }
 
 /**
@@ -240,6 +358,7 @@ void copy_partition(struct vdo_completion *completion,
 		    struct vdo_completion *parent)
 {
 	struct copy_completion *copy = as_copy_completion(completion);
+	unsigned int i;
 
 	int result = validate_partition_copy(source, target);
 	if (result != VDO_SUCCESS) {
@@ -250,7 +369,24 @@ void copy_partition(struct vdo_completion *completion,
 	prepare_vdo_completion_to_finish_parent(&copy->completion, parent);
 	copy->source = source;
 	copy->target = target;
-	copy->current_index = 0;
+	copy->next_index = 0;
 	copy->ending_index = get_fixed_layout_partition_size(source);
-	copy_partition_stride(copy);
+	copy->blocks_copied = 0;
+	copy->next_report = max((block_count_t) 1,
+				copy->ending_index / PROGRESS_REPORTS);
+	copy->active_strides = 0;
+	copy->result = VDO_SUCCESS;
+	if (copy->ending_index == 0) {
+		finish_vdo_completion(&copy->completion, VDO_SUCCESS);
+		return;
+	}
+
+	for (i = 0; i < COPY_STRIDE_COUNT; i++) {
+		if ((copy->result != VDO_SUCCESS) ||
+		    (copy->next_index >= copy->ending_index)) {
+			break;
+		}
+
+		copy_partition_stride(&copy->strides[i]);
+	}
 }
@@ -23,9 +23,22 @@
 
 #include "memoryAlloc.h"
 
+#include "blockMap.h"
+#include "packedReferenceBlock.h"
+#include "packer.h"
+#include "readCache.h"
+#include "recoveryJournal.h"
+#include "slabDepot.h"
+#include "slabScrubber.h"
 #include "vdo.h"
 
+#include "accessTrace.h"
 #include "dedupeIndex.h"
+#include "ioSubmitter.h"
+#include "kernelLayer.h"
+#include "postDedupe.h"
+#include "rateStats.h"
+#include "requestGovernor.h"
 
 struct pool_attribute {
 	struct attribute attr;
@@ -69,6 +82,86 @@ static struct sysfs_ops vdo_pool_sysfs_ops = {
 	.store = vdo_pool_attr_store,
 };
 
+/**********************************************************************/
+static ssize_t pool_access_trace_rate_show(struct vdo *vdo, char *buf)
+{
+	struct access_trace *trace = vdo_as_kernel_layer(vdo)->access_trace;
+
+	return sprintf(buf, "%u\n", get_access_trace_rate(trace));
+}
+
+/**********************************************************************/
+static ssize_t pool_access_trace_rate_store(struct vdo *vdo,
+					    const char *buf,
+					    size_t length)
+{
+	unsigned int value;
+	int result;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	result = set_access_trace_rate(vdo_as_kernel_layer(vdo)->access_trace,
+				       value);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_bio_polling_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%s\n",
+		       (get_io_submitter_polling(vdo->io_submitter)
+			? "1" : "0"));
+}
+
+/**********************************************************************/
+static ssize_t pool_bio_polling_store(struct vdo *vdo,
+				      const char *buf,
+				      size_t length)
+{
+	unsigned int value;
+	int result;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > 1)) {
+		return -EINVAL;
+	}
+
+	result = set_io_submitter_polling(vdo->io_submitter, (value == 1));
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_compact_page_share_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       get_block_map_compact_page_share(get_block_map(vdo)));
+}
+
+/**********************************************************************/
+static ssize_t pool_compact_page_share_store(struct vdo *vdo,
+					     const char *buf,
+					     size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > VDO_MAXIMUM_COMPACT_PAGE_SHARE)) {
+		return -EINVAL;
+	}
+	set_block_map_compact_page_share(get_block_map(vdo), value);
+	return length;
+}
+
 /**********************************************************************/
 static ssize_t pool_compressing_show(struct vdo *vdo, char *buf)
 {
@@ -76,16 +169,76 @@ static ssize_t pool_compressing_show(struct vdo *vdo, char *buf)
 		       (get_vdo_compressing(vdo) ? "1" : "0"));
 }
 
+/**********************************************************************/
+static ssize_t pool_compression_acceleration_maximum_show(struct vdo *vdo,
+							  char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       vdo_as_kernel_layer(vdo)->maximum_compression_acceleration);
+}
+
+/**********************************************************************/
+static ssize_t pool_compression_acceleration_maximum_store(struct vdo *vdo,
+							   const char *buf,
+							   size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value < VDO_DEFAULT_LZ4_ACCELERATION) ||
+	    (value > VDO_MAXIMUM_LZ4_ACCELERATION)) {
+		return -EINVAL;
+	}
+	WRITE_ONCE(vdo_as_kernel_layer(vdo)->maximum_compression_acceleration,
+		   value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_compressed_sector_reads_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%s\n",
+		       (READ_ONCE(vdo_as_kernel_layer(vdo)->compressed_sector_reads)
+			? "1" : "0"));
+}
+
+/**********************************************************************/
+static ssize_t pool_compressed_sector_reads_store(struct vdo *vdo,
+						  const char *buf,
+						  size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > 1)) {
+		return -EINVAL;
+	}
+
+	// Reading single sectors requires a device which allows them.
+	if ((value == 1) &&
+	    (bdev_logical_block_size(get_vdo_backing_device(vdo))
+	     > VDO_SECTOR_SIZE)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(vdo_as_kernel_layer(vdo)->compressed_sector_reads,
+		   (value == 1));
+	return length;
+}
+
 /**********************************************************************/
 static ssize_t pool_discards_active_show(struct vdo *vdo, char *buf)
 {
-	return sprintf(buf, "%u\n", vdo->discard_limiter.active);
+	uint32_t active, maximum;
+
+	get_limiter_values_atomically(&vdo->discard_limiter, &active, &maximum);
+	return sprintf(buf, "%u\n", active);
 }
 
 /**********************************************************************/
 static ssize_t pool_discards_limit_show(struct vdo *vdo, char *buf)
 {
-	return sprintf(buf, "%u\n", vdo->discard_limiter.limit);
+	return sprintf(buf, "%u\n", get_limiter_limit(&vdo->discard_limiter));
 }
 
 /**********************************************************************/
@@ -98,14 +251,38 @@ static ssize_t pool_discards_limit_store(struct vdo *vdo,
 	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) || (value < 1)) {
 		return -EINVAL;
 	}
-	vdo->discard_limiter.limit = value;
+	set_limiter_limit(&vdo->discard_limiter, value);
 	return length;
 }
 
 /**********************************************************************/
 static ssize_t pool_discards_maximum_show(struct vdo *vdo, char *buf)
 {
-	return sprintf(buf, "%u\n", vdo->discard_limiter.maximum);
+	uint32_t active, maximum;
+
+	get_limiter_values_atomically(&vdo->discard_limiter, &active, &maximum);
+	return sprintf(buf, "%u\n", maximum);
+}
+
+/**********************************************************************/
+static ssize_t pool_freed_discard_batch_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       get_slab_depot_discard_batch(vdo->depot));
+}
+
+/**********************************************************************/
+static ssize_t pool_freed_discard_batch_store(struct vdo *vdo,
+					      const char *buf,
+					      size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+	set_slab_depot_discard_batch(vdo->depot, value);
+	return length;
 }
 
 /**********************************************************************/
@@ -114,22 +291,326 @@ static ssize_t pool_instance_show(struct vdo *vdo, char *buf)
 	return sprintf(buf, "%u\n", vdo->instance);
 }
 
+/**********************************************************************/
+static ssize_t pool_journal_max_commit_delay_us_show(struct vdo *vdo,
+						     char *buf)
+{
+	struct recovery_journal *journal = vdo->recovery_journal;
+
+	return sprintf(buf, "%u\n",
+		       get_recovery_journal_max_commit_delay(journal));
+}
+
+/**********************************************************************/
+static ssize_t pool_journal_max_commit_delay_us_store(struct vdo *vdo,
+						      const char *buf,
+						      size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > MAXIMUM_JOURNAL_COMMIT_DELAY_US)) {
+		return -EINVAL;
+	}
+	set_recovery_journal_max_commit_delay(vdo->recovery_journal, value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_optimistic_verify_us_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(vdo->optimistic_verify_us));
+}
+
+/**********************************************************************/
+static ssize_t pool_optimistic_verify_us_store(struct vdo *vdo,
+					       const char *buf,
+					       size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(vdo->optimistic_verify_us, value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_packer_max_residency_ms_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", get_packer_max_residency(vdo->packer_zones));
+}
+
+/**********************************************************************/
+static ssize_t pool_packer_max_residency_ms_store(struct vdo *vdo,
+						  const char *buf,
+						  size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > MAXIMUM_PACKER_RESIDENCY_MS)) {
+		return -EINVAL;
+	}
+	set_packer_max_residency(vdo->packer_zones, value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_post_dedupe_show(struct vdo *vdo, char *buf)
+{
+	struct post_deduper *deduper = vdo_as_kernel_layer(vdo)->post_deduper;
+
+	return sprintf(buf, "%s\n",
+		       (get_post_dedupe_enabled(deduper) ? "1" : "0"));
+}
+
+/**********************************************************************/
+static ssize_t pool_post_dedupe_store(struct vdo *vdo,
+				      const char *buf,
+				      size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > 1)) {
+		return -EINVAL;
+	}
+	set_post_dedupe_enabled(vdo_as_kernel_layer(vdo)->post_deduper,
+				(value == 1));
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_post_dedupe_budget_show(struct vdo *vdo, char *buf)
+{
+	struct post_deduper *deduper = vdo_as_kernel_layer(vdo)->post_deduper;
+
+	return sprintf(buf, "%u\n", get_post_dedupe_budget(deduper));
+}
+
+/**********************************************************************/
+static ssize_t pool_post_dedupe_budget_store(struct vdo *vdo,
+					     const char *buf,
+					     size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+	set_post_dedupe_budget(vdo_as_kernel_layer(vdo)->post_deduper, value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_rates_show(struct vdo *vdo, char *buf)
+{
+	return format_rates(vdo_as_kernel_layer(vdo)->rates, buf, PAGE_SIZE);
+}
+
+/**********************************************************************/
+static ssize_t pool_read_ahead_window_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       get_block_map_read_ahead_window(get_block_map(vdo)));
+}
+
+/**********************************************************************/
+static ssize_t pool_read_ahead_window_store(struct vdo *vdo,
+					    const char *buf,
+					    size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > VDO_MAXIMUM_READ_AHEAD_WINDOW)) {
+		return -EINVAL;
+	}
+	set_block_map_read_ahead_window(get_block_map(vdo), value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_read_cache_share_threshold_show(struct vdo *vdo,
+						    char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       get_read_cache_share_threshold(vdo->read_cache));
+}
+
+/**********************************************************************/
+static ssize_t pool_read_cache_share_threshold_store(struct vdo *vdo,
+						     const char *buf,
+						     size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > MAXIMUM_REFERENCE_COUNT)) {
+		return -EINVAL;
+	}
+	set_read_cache_share_threshold(vdo->read_cache, value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_rebalance_zones_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%s\n",
+		       (get_block_map_rebalancing(get_block_map(vdo)) ?
+			"1" : "0"));
+}
+
+/**********************************************************************/
+static ssize_t pool_rebalance_zones_store(struct vdo *vdo,
+					  const char *buf,
+					  size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value > 1)) {
+		return -EINVAL;
+	}
+	set_block_map_rebalancing(get_block_map(vdo), (value == 1));
+	return length;
+}
+
 /**********************************************************************/
 static ssize_t pool_requests_active_show(struct vdo *vdo, char *buf)
 {
-	return sprintf(buf, "%u\n", vdo->request_limiter.active);
+	uint32_t active, maximum;
+
+	get_limiter_values_atomically(&vdo->request_limiter, &active, &maximum);
+	return sprintf(buf, "%u\n", active);
 }
 
 /**********************************************************************/
 static ssize_t pool_requests_limit_show(struct vdo *vdo, char *buf)
 {
-	return sprintf(buf, "%u\n", vdo->request_limiter.limit);
+	return sprintf(buf, "%u\n", get_limiter_limit(&vdo->request_limiter));
 }
 
 /**********************************************************************/
 static ssize_t pool_requests_maximum_show(struct vdo *vdo, char *buf)
 {
-	return sprintf(buf, "%u\n", vdo->request_limiter.maximum);
+	uint32_t active, maximum;
+
+	get_limiter_values_atomically(&vdo->request_limiter, &active, &maximum);
+	return sprintf(buf, "%u\n", maximum);
+}
+
+/**********************************************************************/
+static ssize_t pool_requests_target_latency_show(struct vdo *vdo, char *buf)
+{
+	if (vdo->request_governor == NULL) {
+		return -ENODEV;
+	}
+
+	return sprintf(buf, "%u\n",
+		       get_request_governor_target(vdo->request_governor));
+}
+
+/**********************************************************************/
+static ssize_t pool_requests_target_latency_store(struct vdo *vdo,
+						  const char *buf,
+						  size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+
+	if (vdo->request_governor == NULL) {
+		return -ENODEV;
+	}
+
+	set_request_governor_target(vdo->request_governor, value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_slab_scrub_budget_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", get_slab_depot_scrub_budget(vdo->depot));
+}
+
+/**********************************************************************/
+static ssize_t pool_slab_scrub_budget_store(struct vdo *vdo,
+					    const char *buf,
+					    size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) ||
+	    (value < 1) || (value > MAXIMUM_CONCURRENT_SLAB_SCRUBS)) {
+		return -EINVAL;
+	}
+	set_slab_depot_scrub_budget(vdo->depot, value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_writeback_pace_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       get_block_map_writeback_pace(get_block_map(vdo)));
+}
+
+/**********************************************************************/
+static ssize_t pool_writeback_pace_store(struct vdo *vdo,
+					 const char *buf,
+					 size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1)) {
+		return -EINVAL;
+	}
+	set_block_map_writeback_pace(get_block_map(vdo), value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_writes_active_show(struct vdo *vdo, char *buf)
+{
+	uint32_t active, maximum;
+
+	get_limiter_values_atomically(&vdo->write_limiter, &active, &maximum);
+	return sprintf(buf, "%u\n", active);
+}
+
+/**********************************************************************/
+static ssize_t pool_writes_limit_show(struct vdo *vdo, char *buf)
+{
+	return sprintf(buf, "%u\n", get_limiter_limit(&vdo->write_limiter));
+}
+
+/**********************************************************************/
+static ssize_t pool_writes_limit_store(struct vdo *vdo,
+				       const char *buf,
+				       size_t length)
+{
+	unsigned int value;
+
+	if ((length > 12) || (sscanf(buf, "%u", &value) != 1) || (value < 1)) {
+		return -EINVAL;
+	}
+	set_limiter_limit(&vdo->write_limiter, value);
+	return length;
+}
+
+/**********************************************************************/
+static ssize_t pool_writes_maximum_show(struct vdo *vdo, char *buf)
+{
+	uint32_t active, maximum;
+
+	get_limiter_values_atomically(&vdo->write_limiter, &active, &maximum);
+	return sprintf(buf, "%u\n", maximum);
 }
 
 /**********************************************************************/
@@ -140,6 +621,33 @@ static void vdo_pool_release(struct kobject *directory)
 	FREE(layer);
 }
 
+static struct pool_attribute vdo_pool_access_trace_rate_attr = {
+	.attr = {
+			.name = "access_trace_rate",
+			.mode = 0644,
+		},
+	.show = pool_access_trace_rate_show,
+	.store = pool_access_trace_rate_store,
+};
+
+static struct pool_attribute vdo_pool_bio_polling_attr = {
+	.attr = {
+			.name = "bio_polling",
+			.mode = 0644,
+		},
+	.show = pool_bio_polling_show,
+	.store = pool_bio_polling_store,
+};
+
+static struct pool_attribute vdo_pool_compact_page_share_attr = {
+	.attr = {
+			.name = "compact_page_share",
+			.mode = 0644,
+		},
+	.show = pool_compact_page_share_show,
+	.store = pool_compact_page_share_store,
+};
+
 static struct pool_attribute vdo_pool_compressing_attr = {
 	.attr = {
 			.name = "compressing",
@@ -148,6 +656,24 @@ static struct pool_attribute vdo_pool_compressing_attr = {
 	.show = pool_compressing_show,
 };
 
+static struct pool_attribute vdo_pool_compression_acceleration_maximum_attr = {
+	.attr = {
+			.name = "compression_acceleration_maximum",
+			.mode = 0644,
+		},
+	.show = pool_compression_acceleration_maximum_show,
+	.store = pool_compression_acceleration_maximum_store,
+};
+
+static struct pool_attribute vdo_pool_compressed_sector_reads_attr = {
+	.attr = {
+			.name = "compressed_sector_reads",
+			.mode = 0644,
+		},
+	.show = pool_compressed_sector_reads_show,
+	.store = pool_compressed_sector_reads_store,
+};
+
 static struct pool_attribute vdo_pool_discards_active_attr = {
 	.attr = {
 			.name = "discards_active",
@@ -173,6 +699,15 @@ static struct pool_attribute vdo_pool_discards_maximum_attr = {
 	.show = pool_discards_maximum_show,
 };
 
+static struct pool_attribute vdo_pool_freed_discard_batch_attr = {
+	.attr = {
+			.name = "freed_discard_batch",
+			.mode = 0644,
+		},
+	.show = pool_freed_discard_batch_show,
+	.store = pool_freed_discard_batch_store,
+};
+
 static struct pool_attribute vdo_pool_instance_attr = {
 	.attr = {
 			.name = "instance",
@@ -181,6 +716,86 @@ static struct pool_attribute vdo_pool_instance_attr = {
 	.show = pool_instance_show,
 };
 
+static struct pool_attribute vdo_pool_journal_max_commit_delay_us_attr = {
+	.attr = {
+			.name = "journal_max_commit_delay_us",
+			.mode = 0644,
+		},
+	.show = pool_journal_max_commit_delay_us_show,
+	.store = pool_journal_max_commit_delay_us_store,
+};
+
+static struct pool_attribute vdo_pool_optimistic_verify_us_attr = {
+	.attr = {
+			.name = "optimistic_verify_us",
+			.mode = 0644,
+		},
+	.show = pool_optimistic_verify_us_show,
+	.store = pool_optimistic_verify_us_store,
+};
+
+static struct pool_attribute vdo_pool_packer_max_residency_ms_attr = {
+	.attr = {
+			.name = "packer_max_residency_ms",
+			.mode = 0644,
+		},
+	.show = pool_packer_max_residency_ms_show,
+	.store = pool_packer_max_residency_ms_store,
+};
+
+static struct pool_attribute vdo_pool_post_dedupe_attr = {
+	.attr = {
+			.name = "post_dedupe",
+			.mode = 0644,
+		},
+	.show = pool_post_dedupe_show,
+	.store = pool_post_dedupe_store,
+};
+
+static struct pool_attribute vdo_pool_post_dedupe_budget_attr = {
+	.attr = {
+			.name = "post_dedupe_budget",
+			.mode = 0644,
+		},
+	.show = pool_post_dedupe_budget_show,
+	.store = pool_post_dedupe_budget_store,
+};
+
+static struct pool_attribute vdo_pool_rates_attr = {
+	.attr = {
+			.name = "rates",
+			.mode = 0444,
+		},
+	.show = pool_rates_show,
+};
+
+static struct pool_attribute vdo_pool_read_ahead_window_attr = {
+	.attr = {
+			.name = "read_ahead_window",
+			.mode = 0644,
+		},
+	.show = pool_read_ahead_window_show,
+	.store = pool_read_ahead_window_store,
+};
+
+static struct pool_attribute vdo_pool_read_cache_share_threshold_attr = {
+	.attr = {
+			.name = "read_cache_share_threshold",
+			.mode = 0644,
+		},
+	.show = pool_read_cache_share_threshold_show,
+	.store = pool_read_cache_share_threshold_store,
+};
+
+static struct pool_attribute vdo_pool_rebalance_zones_attr = {
+	.attr = {
+			.name = "rebalance_zones",
+			.mode = 0644,
+		},
+	.show = pool_rebalance_zones_show,
+	.store = pool_rebalance_zones_store,
+};
+
 static struct pool_attribute vdo_pool_requests_active_attr = {
 	.attr = {
 			.name = "requests_active",
@@ -205,15 +820,88 @@ static struct pool_attribute vdo_pool_requests_maximum_attr = {
 	.show = pool_requests_maximum_show,
 };
 
+static struct pool_attribute vdo_pool_requests_target_latency_attr = {
+	.attr = {
+			.name = "requests_target_latency",
+			.mode = 0644,
+		},
+	.show = pool_requests_target_latency_show,
+	.store = pool_requests_target_latency_store,
+};
+
+static struct pool_attribute vdo_pool_slab_scrub_budget_attr = {
+	.attr = {
+			.name = "slab_scrub_budget",
+			.mode = 0644,
+		},
+	.show = pool_slab_scrub_budget_show,
+	.store = pool_slab_scrub_budget_store,
+};
+
+static struct pool_attribute vdo_pool_writeback_pace_attr = {
+	.attr = {
+			.name = "writeback_pace",
+			.mode = 0644,
+		},
+	.show = pool_writeback_pace_show,
+	.store = pool_writeback_pace_store,
+};
+
+static struct pool_attribute vdo_pool_writes_active_attr = {
+	.attr = {
+			.name = "writes_active",
+			.mode = 0444,
+		},
+	.show = pool_writes_active_show,
+};
+
+static struct pool_attribute vdo_pool_writes_limit_attr = {
+	.attr = {
+			.name = "writes_limit",
+			.mode = 0644,
+		},
+	.show = pool_writes_limit_show,
+	.store = pool_writes_limit_store,
+};
+
+static struct pool_attribute vdo_pool_writes_maximum_attr = {
+	.attr = {
+			.name = "writes_maximum",
+			.mode = 0444,
+		},
+	.show = pool_writes_maximum_show,
+};
+
 static struct attribute *pool_attrs[] = {
+	&vdo_pool_access_trace_rate_attr.attr,
+	&vdo_pool_bio_polling_attr.attr,
+	&vdo_pool_compact_page_share_attr.attr,
+	&vdo_pool_compressed_sector_reads_attr.attr,
 	&vdo_pool_compressing_attr.attr,
+	&vdo_pool_compression_acceleration_maximum_attr.attr,
 	&vdo_pool_discards_active_attr.attr,
 	&vdo_pool_discards_limit_attr.attr,
 	&vdo_pool_discards_maximum_attr.attr,
+	&vdo_pool_freed_discard_batch_attr.attr,
 	&vdo_pool_instance_attr.attr,
+	&vdo_pool_journal_max_commit_delay_us_attr.attr,
+	&vdo_pool_optimistic_verify_us_attr.attr,
+	&vdo_pool_packer_max_residency_ms_attr.attr,
+	&vdo_pool_post_dedupe_attr.attr,
+	&vdo_pool_post_dedupe_budget_attr.attr,
+	&vdo_pool_rates_attr.attr,
+	&vdo_pool_read_ahead_window_attr.attr,
+	&vdo_pool_read_cache_share_threshold_attr.attr,
+	&vdo_pool_rebalance_zones_attr.attr,
 	&vdo_pool_requests_active_attr.attr,
 	&vdo_pool_requests_limit_attr.attr,
 	&vdo_pool_requests_maximum_attr.attr,
+	&vdo_pool_requests_target_latency_attr.attr,
+	&vdo_pool_slab_scrub_budget_attr.attr,
+	&vdo_pool_writeback_pace_attr.attr,
+	&vdo_pool_writes_active_attr.attr,
+	&vdo_pool_writes_limit_attr.attr,
+	&vdo_pool_writes_maximum_attr.attr,
 	NULL,
 };
 
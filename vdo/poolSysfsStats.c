@@ -258,6 +258,162 @@ static struct pool_stats_attribute pool_stats_attr_packer_compressed_fragments_i
 	.print = pool_stats_print_packer_compressed_fragments_in_packer,
 };
 
+/**********************************************************************/
+/** Number of data blocks which have been considered for compression */
+static ssize_t pool_stats_print_packer_compression_candidates(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.compression_candidates);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_compression_candidates = {
+	.attr = { .name = "packer_compression_candidates", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_compression_candidates,
+};
+
+/**********************************************************************/
+/** Number of candidates not compressed since they sampled as incompressible */
+static ssize_t pool_stats_print_packer_incompressible_candidates_skipped(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.incompressible_candidates_skipped);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_incompressible_candidates_skipped = {
+	.attr = { .name = "packer_incompressible_candidates_skipped", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_incompressible_candidates_skipped,
+};
+
+/**********************************************************************/
+/** Number of compressed blocks written less than half full */
+static ssize_t pool_stats_print_packer_blocks_filled_under_50(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.blocks_filled_under_50);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_blocks_filled_under_50 = {
+	.attr = { .name = "packer_blocks_filled_under_50", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_blocks_filled_under_50,
+};
+
+/**********************************************************************/
+/** Number of compressed blocks written at least half but under 75% full */
+static ssize_t pool_stats_print_packer_blocks_filled_50_to_75(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.blocks_filled_50_to_75);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_blocks_filled_50_to_75 = {
+	.attr = { .name = "packer_blocks_filled_50_to_75", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_blocks_filled_50_to_75,
+};
+
+/**********************************************************************/
+/** Number of compressed blocks written at least 75% but under 90% full */
+static ssize_t pool_stats_print_packer_blocks_filled_75_to_90(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.blocks_filled_75_to_90);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_blocks_filled_75_to_90 = {
+	.attr = { .name = "packer_blocks_filled_75_to_90", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_blocks_filled_75_to_90,
+};
+
+/**********************************************************************/
+/** Number of compressed blocks written at least 90% full */
+static ssize_t pool_stats_print_packer_blocks_filled_over_90(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.blocks_filled_over_90);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_blocks_filled_over_90 = {
+	.attr = { .name = "packer_blocks_filled_over_90", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_blocks_filled_over_90,
+};
+
+/**********************************************************************/
+/** Number of compressed blocks which ran out of slots before space */
+static ssize_t pool_stats_print_packer_blocks_slot_limited(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.blocks_slot_limited);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_blocks_slot_limited = {
+	.attr = { .name = "packer_blocks_slot_limited", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_blocks_slot_limited,
+};
+
+/**********************************************************************/
+/** Number of data_vios waiting in input bins */
+static ssize_t pool_stats_print_packer_fragments_in_input_bins(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.fragments_in_input_bins);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_fragments_in_input_bins = {
+	.attr = { .name = "packer_fragments_in_input_bins", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_fragments_in_input_bins,
+};
+
+/**********************************************************************/
+/** Number of batched data_vios waiting for an idle output bin */
+static ssize_t pool_stats_print_packer_fragments_awaiting_output(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.fragments_awaiting_output);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_fragments_awaiting_output = {
+	.attr = { .name = "packer_fragments_awaiting_output", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_fragments_awaiting_output,
+};
+
+/**********************************************************************/
+/** Number of output bins writing a compressed block */
+static ssize_t pool_stats_print_packer_output_bins_busy(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.output_bins_busy);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_output_bins_busy = {
+	.attr = { .name = "packer_output_bins_busy", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_output_bins_busy,
+};
+
+/**********************************************************************/
+/** Number of output bins idle */
+static ssize_t pool_stats_print_packer_output_bins_idle(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.output_bins_idle);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_output_bins_idle = {
+	.attr = { .name = "packer_output_bins_idle", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_output_bins_idle,
+};
+
+/**********************************************************************/
+/** Number of times batched data_vios found every output bin busy */
+static ssize_t pool_stats_print_packer_output_bin_stalls(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.packer.output_bin_stalls);
+}
+
+static struct pool_stats_attribute pool_stats_attr_packer_output_bin_stalls = {
+	.attr = { .name = "packer_output_bin_stalls", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_packer_output_bin_stalls,
+};
+
 /**********************************************************************/
 /** The total number of slabs from which blocks may be allocated */
 static ssize_t pool_stats_print_allocator_slab_count(struct kernel_layer *layer, char *buf)
@@ -297,6 +453,58 @@ static struct pool_stats_attribute pool_stats_attr_allocator_slabs_reopened = {
 	.print = pool_stats_print_allocator_slabs_reopened,
 };
 
+/**********************************************************************/
+/** The number of slabs which are unrecovered or being scrubbed */
+static ssize_t pool_stats_print_allocator_slabs_to_scrub(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.allocator.slabs_to_scrub);
+}
+
+static struct pool_stats_attribute pool_stats_attr_allocator_slabs_to_scrub = {
+	.attr = { .name = "allocator_slabs_to_scrub", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_allocator_slabs_to_scrub,
+};
+
+/**********************************************************************/
+/** The number of slabs which have been scrubbed since loading */
+static ssize_t pool_stats_print_allocator_slabs_scrubbed(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.allocator.slabs_scrubbed);
+}
+
+static struct pool_stats_attribute pool_stats_attr_allocator_slabs_scrubbed = {
+	.attr = { .name = "allocator_slabs_scrubbed", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_allocator_slabs_scrubbed,
+};
+
+/**********************************************************************/
+/** The number of discards of freed blocks sent to the backing device */
+static ssize_t pool_stats_print_allocator_discards(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.allocator.discards);
+}
+
+static struct pool_stats_attribute pool_stats_attr_allocator_discards = {
+	.attr = { .name = "allocator_discards", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_allocator_discards,
+};
+
+/**********************************************************************/
+/** The number of freed blocks discarded on the backing device */
+static ssize_t pool_stats_print_allocator_blocks_discarded(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.allocator.blocks_discarded);
+}
+
+static struct pool_stats_attribute pool_stats_attr_allocator_blocks_discarded = {
+	.attr = { .name = "allocator_blocks_discarded", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_allocator_blocks_discarded,
+};
+
 /**********************************************************************/
 /** Number of times the on-disk journal was full */
 static ssize_t pool_stats_print_journal_disk_full(struct kernel_layer *layer, char *buf)
@@ -323,6 +531,19 @@ static struct pool_stats_attribute pool_stats_attr_journal_slab_journal_commits_
 	.print = pool_stats_print_journal_slab_journal_commits_requested,
 };
 
+/**********************************************************************/
+/** Number of partial block commits held for more entries */
+static ssize_t pool_stats_print_journal_delayed_commits(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.journal.delayed_commits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_journal_delayed_commits = {
+	.attr = { .name = "journal_delayed_commits", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_journal_delayed_commits,
+};
+
 /**********************************************************************/
 /** The total number of items on which processing has started */
 static ssize_t pool_stats_print_journal_entries_started(struct kernel_layer *layer, char *buf)
@@ -466,6 +687,19 @@ static struct pool_stats_attribute pool_stats_attr_slab_journal_tail_busy_count
 	.print = pool_stats_print_slab_journal_tail_busy_count,
 };
 
+/**********************************************************************/
+/** Number of reaps made safe by a flush sent for another purpose */
+static ssize_t pool_stats_print_slab_journal_piggybacked_reaps(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.slab_journal.piggybacked_reaps);
+}
+
+static struct pool_stats_attribute pool_stats_attr_slab_journal_piggybacked_reaps = {
+	.attr = { .name = "slab_journal_piggybacked_reaps", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_slab_journal_piggybacked_reaps,
+};
+
 /**********************************************************************/
 /** Number of blocks written */
 static ssize_t pool_stats_print_slab_summary_blocks_written(struct kernel_layer *layer, char *buf)
@@ -752,6 +986,162 @@ static struct pool_stats_attribute pool_stats_attr_block_map_flush_count = {
 	.print = pool_stats_print_block_map_flush_count,
 };
 
+/**********************************************************************/
+/** number of pages protected from eviction by reuse */
+static ssize_t pool_stats_print_block_map_protected_pages(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%" PRIu32 "\n", layer->vdo_stats_storage.block_map.protected_pages);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_protected_pages = {
+	.attr = { .name = "block_map_protected_pages", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_protected_pages,
+};
+
+/**********************************************************************/
+/** number of gets which found a protected page */
+static ssize_t pool_stats_print_block_map_protected_hits(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.block_map.protected_hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_protected_hits = {
+	.attr = { .name = "block_map_protected_hits", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_protected_hits,
+};
+
+/**********************************************************************/
+/** number of pages protected after being reused */
+static ssize_t pool_stats_print_block_map_promotions(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.block_map.promotions);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_promotions = {
+	.attr = { .name = "block_map_promotions", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_promotions,
+};
+
+/**********************************************************************/
+/** number of evicted pages kept compacted */
+static ssize_t pool_stats_print_block_map_compact_pages(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%" PRIu32 "\n", layer->vdo_stats_storage.block_map.compact_pages);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_compact_pages = {
+	.attr = { .name = "block_map_compact_pages", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_compact_pages,
+};
+
+/**********************************************************************/
+/** number of pages loaded by expanding a compacted copy */
+static ssize_t pool_stats_print_block_map_compact_loads(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.block_map.compact_loads);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_compact_loads = {
+	.attr = { .name = "block_map_compact_loads", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_compact_loads,
+};
+
+/**********************************************************************/
+/** number of cache pages in physically contiguous memory */
+static ssize_t pool_stats_print_block_map_contiguous_pages(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%" PRIu32 "\n", layer->vdo_stats_storage.block_map.contiguous_pages);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_contiguous_pages = {
+	.attr = { .name = "block_map_contiguous_pages", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_contiguous_pages,
+};
+
+/**********************************************************************/
+/** number of trees handed from one logical zone to another */
+static ssize_t pool_stats_print_block_map_tree_handoffs(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.block_map.tree_handoffs);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_tree_handoffs = {
+	.attr = { .name = "block_map_tree_handoffs", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_tree_handoffs,
+};
+
+/**********************************************************************/
+/** number of gets sampled by the cache size simulator */
+static ssize_t pool_stats_print_block_map_simulated_gets(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.block_map.simulated_gets);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_simulated_gets = {
+	.attr = { .name = "block_map_simulated_gets", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_simulated_gets,
+};
+
+/**********************************************************************/
+/** number of sampled gets which would hit in a cache half the size */
+static ssize_t pool_stats_print_block_map_simulated_half_size_hits(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.block_map.simulated_half_size_hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_simulated_half_size_hits = {
+	.attr = { .name = "block_map_simulated_half_size_hits", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_simulated_half_size_hits,
+};
+
+/**********************************************************************/
+/** number of sampled gets which would hit in an LRU cache this size */
+static ssize_t pool_stats_print_block_map_simulated_same_size_hits(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.block_map.simulated_same_size_hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_simulated_same_size_hits = {
+	.attr = { .name = "block_map_simulated_same_size_hits", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_simulated_same_size_hits,
+};
+
+/**********************************************************************/
+/** number of sampled gets which would hit in a cache double the size */
+static ssize_t pool_stats_print_block_map_simulated_double_size_hits(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.block_map.simulated_double_size_hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_simulated_double_size_hits = {
+	.attr = { .name = "block_map_simulated_double_size_hits", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_simulated_double_size_hits,
+};
+
+/**********************************************************************/
+/** number of sampled gets which would hit in a cache 4 times the size */
+static ssize_t pool_stats_print_block_map_simulated_quadruple_size_hits(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.block_map.simulated_quadruple_size_hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_block_map_simulated_quadruple_size_hits = {
+	.attr = { .name = "block_map_simulated_quadruple_size_hits", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_block_map_simulated_quadruple_size_hits,
+};
+
 /**********************************************************************/
 /** Number of times the UDS advice proved correct */
 static ssize_t pool_stats_print_hash_lock_dedupe_advice_valid(struct kernel_layer *layer, char *buf)
@@ -804,6 +1194,58 @@ static struct pool_stats_attribute pool_stats_attr_hash_lock_concurrent_hash_col
 	.print = pool_stats_print_hash_lock_concurrent_hash_collisions,
 };
 
+/**********************************************************************/
+/** Number of queries answered by the hash zone advice cache */
+static ssize_t pool_stats_print_hash_lock_cached_advice_hits(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.hash_lock.cached_advice_hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_hash_lock_cached_advice_hits = {
+	.attr = { .name = "hash_lock_cached_advice_hits", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_hash_lock_cached_advice_hits,
+};
+
+/**********************************************************************/
+/** Number of queries which missed the advice cache and went to UDS */
+static ssize_t pool_stats_print_hash_lock_cached_advice_misses(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.hash_lock.cached_advice_misses);
+}
+
+static struct pool_stats_attribute pool_stats_attr_hash_lock_cached_advice_misses = {
+	.attr = { .name = "hash_lock_cached_advice_misses", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_hash_lock_cached_advice_misses,
+};
+
+/**********************************************************************/
+/** Number of times advice from the advice cache proved incorrect */
+static ssize_t pool_stats_print_hash_lock_cached_advice_stale(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.hash_lock.cached_advice_stale);
+}
+
+static struct pool_stats_attribute pool_stats_attr_hash_lock_cached_advice_stale = {
+	.attr = { .name = "hash_lock_cached_advice_stale", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_hash_lock_cached_advice_stale,
+};
+
+/**********************************************************************/
+/** Number of times a hash zone found all its hash locks in use */
+static ssize_t pool_stats_print_hash_lock_lock_pool_exhaustions(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->vdo_stats_storage.hash_lock.lock_pool_exhaustions);
+}
+
+static struct pool_stats_attribute pool_stats_attr_hash_lock_lock_pool_exhaustions = {
+	.attr = { .name = "hash_lock_lock_pool_exhaustions", .mode = 0444, },
+	.from_vdo = true,
+	.print = pool_stats_print_hash_lock_lock_pool_exhaustions,
+};
+
 /**********************************************************************/
 /** number of times VDO got an invalid dedupe advice PBN from UDS */
 static ssize_t pool_stats_print_errors_invalid_advice_pbn_count(struct kernel_layer *layer, char *buf)
@@ -921,6 +1363,149 @@ static struct pool_stats_attribute pool_stats_attr_logical_block_size = {
 	.print = pool_stats_print_logical_block_size,
 };
 
+/**********************************************************************/
+/** The LZ4 acceleration factor currently used for compression */
+static ssize_t pool_stats_print_compression_acceleration(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.compression_acceleration);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_acceleration = {
+	.attr = { .name = "compression_acceleration", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_compression_acceleration,
+};
+
+/**********************************************************************/
+/** Compressed reads and verifies served from the read cache */
+static ssize_t pool_stats_print_read_cache_hits(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.read_cache_hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_read_cache_hits = {
+	.attr = { .name = "read_cache_hits", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_read_cache_hits,
+};
+
+/**********************************************************************/
+/** Compressed reads and verifies which went to storage */
+static ssize_t pool_stats_print_read_cache_misses(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.read_cache_misses);
+}
+
+static struct pool_stats_attribute pool_stats_attr_read_cache_misses = {
+	.attr = { .name = "read_cache_misses", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_read_cache_misses,
+};
+
+/**********************************************************************/
+/** Writes logged for post-process deduplication */
+static ssize_t pool_stats_print_post_dedupe_deferred(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.post_dedupe_deferred);
+}
+
+static struct pool_stats_attribute pool_stats_attr_post_dedupe_deferred = {
+	.attr = { .name = "post_dedupe_deferred", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_post_dedupe_deferred,
+};
+
+/**********************************************************************/
+/** Logged blocks read back and checked for duplicates */
+static ssize_t pool_stats_print_post_dedupe_checked(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.post_dedupe_checked);
+}
+
+static struct pool_stats_attribute pool_stats_attr_post_dedupe_checked = {
+	.attr = { .name = "post_dedupe_checked", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_post_dedupe_checked,
+};
+
+/**********************************************************************/
+/** Checked blocks remapped to share an existing copy */
+static ssize_t pool_stats_print_post_dedupe_shared(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.post_dedupe_shared);
+}
+
+static struct pool_stats_attribute pool_stats_attr_post_dedupe_shared = {
+	.attr = { .name = "post_dedupe_shared", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_post_dedupe_shared,
+};
+
+/**********************************************************************/
+/** Logged blocks not yet checked */
+static ssize_t pool_stats_print_post_dedupe_pending(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.post_dedupe_pending);
+}
+
+static struct pool_stats_attribute pool_stats_attr_post_dedupe_pending = {
+	.attr = { .name = "post_dedupe_pending", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_post_dedupe_pending,
+};
+
+/**********************************************************************/
+/** Writes which bypassed deduplication because of an exemption */
+static ssize_t pool_stats_print_dedupe_exempt_writes(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.dedupe_exempt_writes);
+}
+
+static struct pool_stats_attribute pool_stats_attr_dedupe_exempt_writes = {
+	.attr = { .name = "dedupe_exempt_writes", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_dedupe_exempt_writes,
+};
+
+/**********************************************************************/
+/** Writes not compressed because their region has been incompressible */
+static ssize_t pool_stats_print_compression_region_skips(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.compression_region_skips);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_region_skips = {
+	.attr = { .name = "compression_region_skips", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_compression_region_skips,
+};
+
+/**********************************************************************/
+/** Blocks compressed by an offload device */
+static ssize_t pool_stats_print_compression_offloads(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.compression_offloads);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_offloads = {
+	.attr = { .name = "compression_offloads", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_compression_offloads,
+};
+
+/**********************************************************************/
+/** Blocks compressed on the CPU because the offload device was busy */
+static ssize_t pool_stats_print_compression_offload_fallbacks(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.compression_offload_fallbacks);
+}
+
+static struct pool_stats_attribute pool_stats_attr_compression_offload_fallbacks = {
+	.attr = { .name = "compression_offload_fallbacks", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_compression_offload_fallbacks,
+};
+
 /**********************************************************************/
 /** Number of not REQ_WRITE bios */
 static ssize_t pool_stats_print_bios_in_read(struct kernel_layer *layer, char *buf)
@@ -1792,6 +2377,123 @@ static struct pool_stats_attribute pool_stats_attr_memory_usage_peak_bytes_used
 	.print = pool_stats_print_memory_usage_peak_bytes_used,
 };
 
+/**********************************************************************/
+/** Tracked bytes currently mapped with huge pages. */
+static ssize_t pool_stats_print_memory_usage_huge_page_bytes_used(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.memory_usage.huge_page_bytes_used);
+}
+
+static struct pool_stats_attribute pool_stats_attr_memory_usage_huge_page_bytes_used = {
+	.attr = { .name = "memory_usage_huge_page_bytes_used", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_memory_usage_huge_page_bytes_used,
+};
+
+/**********************************************************************/
+/** Tracked bytes currently used for reference counts. */
+static ssize_t pool_stats_print_memory_usage_ref_counts_bytes_used(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.memory_usage.ref_counts_bytes_used);
+}
+
+static struct pool_stats_attribute pool_stats_attr_memory_usage_ref_counts_bytes_used = {
+	.attr = { .name = "memory_usage_ref_counts_bytes_used", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_memory_usage_ref_counts_bytes_used,
+};
+
+/**********************************************************************/
+/** Tracked bytes currently used by the block map page caches. */
+static ssize_t pool_stats_print_memory_usage_page_cache_bytes_used(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.memory_usage.page_cache_bytes_used);
+}
+
+static struct pool_stats_attribute pool_stats_attr_memory_usage_page_cache_bytes_used = {
+	.attr = { .name = "memory_usage_page_cache_bytes_used", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_memory_usage_page_cache_bytes_used,
+};
+
+/**********************************************************************/
+/** Tracked bytes currently used by slab journals. */
+static ssize_t pool_stats_print_memory_usage_slab_journal_bytes_used(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.memory_usage.slab_journal_bytes_used);
+}
+
+static struct pool_stats_attribute pool_stats_attr_memory_usage_slab_journal_bytes_used = {
+	.attr = { .name = "memory_usage_slab_journal_bytes_used", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_memory_usage_slab_journal_bytes_used,
+};
+
+/**********************************************************************/
+/** Tracked bytes currently used by the data_vio pools. */
+static ssize_t pool_stats_print_memory_usage_data_vio_bytes_used(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.memory_usage.data_vio_bytes_used);
+}
+
+static struct pool_stats_attribute pool_stats_attr_memory_usage_data_vio_bytes_used = {
+	.attr = { .name = "memory_usage_data_vio_bytes_used", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_memory_usage_data_vio_bytes_used,
+};
+
+/**********************************************************************/
+/** Tracked bytes currently used for hash locks. */
+static ssize_t pool_stats_print_memory_usage_hash_lock_bytes_used(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.memory_usage.hash_lock_bytes_used);
+}
+
+static struct pool_stats_attribute pool_stats_attr_memory_usage_hash_lock_bytes_used = {
+	.attr = { .name = "memory_usage_hash_lock_bytes_used", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_memory_usage_hash_lock_bytes_used,
+};
+
+/**********************************************************************/
+/** Tracked bytes currently used by index delta lists. */
+static ssize_t pool_stats_print_memory_usage_index_delta_memory_bytes_used(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.memory_usage.index_delta_memory_bytes_used);
+}
+
+static struct pool_stats_attribute pool_stats_attr_memory_usage_index_delta_memory_bytes_used = {
+	.attr = { .name = "memory_usage_index_delta_memory_bytes_used", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_memory_usage_index_delta_memory_bytes_used,
+};
+
+/**********************************************************************/
+/** Tracked bytes currently used by index page caches. */
+static ssize_t pool_stats_print_memory_usage_index_page_cache_bytes_used(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.memory_usage.index_page_cache_bytes_used);
+}
+
+static struct pool_stats_attribute pool_stats_attr_memory_usage_index_page_cache_bytes_used = {
+	.attr = { .name = "memory_usage_index_page_cache_bytes_used", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_memory_usage_index_page_cache_bytes_used,
+};
+
+/**********************************************************************/
+/** Tracked bytes currently used by sparse chapter caches. */
+static ssize_t pool_stats_print_memory_usage_sparse_cache_bytes_used(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.memory_usage.sparse_cache_bytes_used);
+}
+
+static struct pool_stats_attribute pool_stats_attr_memory_usage_sparse_cache_bytes_used = {
+	.attr = { .name = "memory_usage_sparse_cache_bytes_used", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_memory_usage_sparse_cache_bytes_used,
+};
+
 /**********************************************************************/
 /** Number of chunk names stored in the index */
 static ssize_t pool_stats_print_index_entries_indexed(struct kernel_layer *layer, char *buf)
@@ -1883,6 +2585,32 @@ static struct pool_stats_attribute pool_stats_attr_index_updates_not_found = {
 	.print = pool_stats_print_index_updates_not_found,
 };
 
+/**********************************************************************/
+/** Number of volume page lookups which found the page cached */
+static ssize_t pool_stats_print_index_page_cache_hits(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.index.page_cache_hits);
+}
+
+static struct pool_stats_attribute pool_stats_attr_index_page_cache_hits = {
+	.attr = { .name = "index_page_cache_hits", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_index_page_cache_hits,
+};
+
+/**********************************************************************/
+/** Number of volume page lookups which had to read the page */
+static ssize_t pool_stats_print_index_page_cache_misses(struct kernel_layer *layer, char *buf)
+{
+	return sprintf(buf, "%llu\n", layer->kernel_stats_storage.index.page_cache_misses);
+}
+
+static struct pool_stats_attribute pool_stats_attr_index_page_cache_misses = {
+	.attr = { .name = "index_page_cache_misses", .mode = 0444, },
+	.from_vdo = false,
+	.print = pool_stats_print_index_page_cache_misses,
+};
+
 /**********************************************************************/
 /** Current number of dedupe queries that are in flight */
 static ssize_t pool_stats_print_index_curr_dedupe_queries(struct kernel_layer *layer, char *buf)
@@ -1925,11 +2653,28 @@ struct attribute *pool_stats_attrs[] = {
 	&pool_stats_attr_packer_compressed_fragments_written.attr,
 	&pool_stats_attr_packer_compressed_blocks_written.attr,
 	&pool_stats_attr_packer_compressed_fragments_in_packer.attr,
+	&pool_stats_attr_packer_compression_candidates.attr,
+	&pool_stats_attr_packer_incompressible_candidates_skipped.attr,
+	&pool_stats_attr_packer_blocks_filled_under_50.attr,
+	&pool_stats_attr_packer_blocks_filled_50_to_75.attr,
+	&pool_stats_attr_packer_blocks_filled_75_to_90.attr,
+	&pool_stats_attr_packer_blocks_filled_over_90.attr,
+	&pool_stats_attr_packer_blocks_slot_limited.attr,
+	&pool_stats_attr_packer_fragments_in_input_bins.attr,
+	&pool_stats_attr_packer_fragments_awaiting_output.attr,
+	&pool_stats_attr_packer_output_bins_busy.attr,
+	&pool_stats_attr_packer_output_bins_idle.attr,
+	&pool_stats_attr_packer_output_bin_stalls.attr,
 	&pool_stats_attr_allocator_slab_count.attr,
 	&pool_stats_attr_allocator_slabs_opened.attr,
 	&pool_stats_attr_allocator_slabs_reopened.attr,
+	&pool_stats_attr_allocator_slabs_to_scrub.attr,
+	&pool_stats_attr_allocator_slabs_scrubbed.attr,
+	&pool_stats_attr_allocator_discards.attr,
+	&pool_stats_attr_allocator_blocks_discarded.attr,
 	&pool_stats_attr_journal_disk_full.attr,
 	&pool_stats_attr_journal_slab_journal_commits_requested.attr,
+	&pool_stats_attr_journal_delayed_commits.attr,
 	&pool_stats_attr_journal_entries_started.attr,
 	&pool_stats_attr_journal_entries_written.attr,
 	&pool_stats_attr_journal_entries_committed.attr,
@@ -1941,6 +2686,7 @@ struct attribute *pool_stats_attrs[] = {
 	&pool_stats_attr_slab_journal_blocked_count.attr,
 	&pool_stats_attr_slab_journal_blocks_written.attr,
 	&pool_stats_attr_slab_journal_tail_busy_count.attr,
+	&pool_stats_attr_slab_journal_piggybacked_reaps.attr,
 	&pool_stats_attr_slab_summary_blocks_written.attr,
 	&pool_stats_attr_ref_counts_blocks_written.attr,
 	&pool_stats_attr_block_map_dirty_pages.attr,
@@ -1963,10 +2709,26 @@ struct attribute *pool_stats_attrs[] = {
 	&pool_stats_attr_block_map_pages_loaded.attr,
 	&pool_stats_attr_block_map_pages_saved.attr,
 	&pool_stats_attr_block_map_flush_count.attr,
+	&pool_stats_attr_block_map_protected_pages.attr,
+	&pool_stats_attr_block_map_protected_hits.attr,
+	&pool_stats_attr_block_map_promotions.attr,
+	&pool_stats_attr_block_map_compact_pages.attr,
+	&pool_stats_attr_block_map_compact_loads.attr,
+	&pool_stats_attr_block_map_contiguous_pages.attr,
+	&pool_stats_attr_block_map_tree_handoffs.attr,
+	&pool_stats_attr_block_map_simulated_gets.attr,
+	&pool_stats_attr_block_map_simulated_half_size_hits.attr,
+	&pool_stats_attr_block_map_simulated_same_size_hits.attr,
+	&pool_stats_attr_block_map_simulated_double_size_hits.attr,
+	&pool_stats_attr_block_map_simulated_quadruple_size_hits.attr,
 	&pool_stats_attr_hash_lock_dedupe_advice_valid.attr,
 	&pool_stats_attr_hash_lock_dedupe_advice_stale.attr,
 	&pool_stats_attr_hash_lock_concurrent_data_matches.attr,
 	&pool_stats_attr_hash_lock_concurrent_hash_collisions.attr,
+	&pool_stats_attr_hash_lock_cached_advice_hits.attr,
+	&pool_stats_attr_hash_lock_cached_advice_misses.attr,
+	&pool_stats_attr_hash_lock_cached_advice_stale.attr,
+	&pool_stats_attr_hash_lock_lock_pool_exhaustions.attr,
 	&pool_stats_attr_errors_invalid_advice_pbn_count.attr,
 	&pool_stats_attr_errors_no_space_error_count.attr,
 	&pool_stats_attr_errors_read_only_error_count.attr,
@@ -1976,6 +2738,17 @@ struct attribute *pool_stats_attrs[] = {
 	&pool_stats_attr_dedupe_advice_timeouts.attr,
 	&pool_stats_attr_flush_out.attr,
 	&pool_stats_attr_logical_block_size.attr,
+	&pool_stats_attr_compression_acceleration.attr,
+	&pool_stats_attr_read_cache_hits.attr,
+	&pool_stats_attr_read_cache_misses.attr,
+	&pool_stats_attr_post_dedupe_deferred.attr,
+	&pool_stats_attr_post_dedupe_checked.attr,
+	&pool_stats_attr_post_dedupe_shared.attr,
+	&pool_stats_attr_post_dedupe_pending.attr,
+	&pool_stats_attr_dedupe_exempt_writes.attr,
+	&pool_stats_attr_compression_region_skips.attr,
+	&pool_stats_attr_compression_offloads.attr,
+	&pool_stats_attr_compression_offload_fallbacks.attr,
 	&pool_stats_attr_bios_in_read.attr,
 	&pool_stats_attr_bios_in_write.attr,
 	&pool_stats_attr_bios_in_discard.attr,
@@ -2043,6 +2816,15 @@ struct attribute *pool_stats_attrs[] = {
 	&pool_stats_attr_bios_in_progress_fua.attr,
 	&pool_stats_attr_memory_usage_bytes_used.attr,
 	&pool_stats_attr_memory_usage_peak_bytes_used.attr,
+	&pool_stats_attr_memory_usage_huge_page_bytes_used.attr,
+	&pool_stats_attr_memory_usage_ref_counts_bytes_used.attr,
+	&pool_stats_attr_memory_usage_page_cache_bytes_used.attr,
+	&pool_stats_attr_memory_usage_slab_journal_bytes_used.attr,
+	&pool_stats_attr_memory_usage_data_vio_bytes_used.attr,
+	&pool_stats_attr_memory_usage_hash_lock_bytes_used.attr,
+	&pool_stats_attr_memory_usage_index_delta_memory_bytes_used.attr,
+	&pool_stats_attr_memory_usage_index_page_cache_bytes_used.attr,
+	&pool_stats_attr_memory_usage_sparse_cache_bytes_used.attr,
 	&pool_stats_attr_index_entries_indexed.attr,
 	&pool_stats_attr_index_posts_found.attr,
 	&pool_stats_attr_index_posts_not_found.attr,
@@ -2050,6 +2832,8 @@ struct attribute *pool_stats_attrs[] = {
 	&pool_stats_attr_index_queries_not_found.attr,
 	&pool_stats_attr_index_updates_found.attr,
 	&pool_stats_attr_index_updates_not_found.attr,
+	&pool_stats_attr_index_page_cache_hits.attr,
+	&pool_stats_attr_index_page_cache_misses.attr,
 	&pool_stats_attr_index_curr_dedupe_queries.attr,
 	&pool_stats_attr_index_max_dedupe_queries.attr,
 	NULL,
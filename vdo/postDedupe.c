@@ -0,0 +1,308 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "postDedupe.h"
+
+#include <linux/jiffies.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#include "atomicDefs.h"
+#include "memoryAlloc.h"
+
+#include "dataKVIO.h"
+#include "kernelLayer.h"
+
+enum {
+	/** The number of logical blocks the log can hold */
+	POST_DEDUPE_LOG_SIZE = 1 << 16,
+	/** The interval between checks for idleness, in milliseconds */
+	POST_DEDUPE_INTERVAL_MS = 100,
+	/** The default number of blocks to read back per second */
+	DEFAULT_POST_DEDUPE_BUDGET = 2048,
+};
+
+struct post_deduper {
+	/** The layer whose blocks are deduplicated */
+	struct kernel_layer *layer;
+	/** Protects the log */
+	spinlock_t lock;
+	/** The index of the oldest entry in the log */
+	unsigned int head;
+	/** The number of entries in the log */
+	unsigned int count;
+	/** Whether the background work should keep rescheduling itself */
+	bool running;
+	/** Whether new writes are being deferred */
+	bool enabled;
+	/** The number of blocks per second which may be read back */
+	unsigned int budget;
+	/** The number of bios which had arrived at the previous check */
+	uint64_t last_bios_in;
+	/** The number of logged blocks which are being checked */
+	atomic_t in_flight;
+	/** The number of writes logged instead of deduplicated */
+	atomic64_t deferred;
+	/** The number of logged blocks which have been checked */
+	atomic64_t checked;
+	/** The number of checked blocks which were remapped */
+	atomic64_t shared;
+	/** The periodic background work */
+	struct delayed_work work;
+	/** The logical blocks whose deduplication was deferred */
+	logical_block_number_t log[];
+};
+
+/**
+ * Get the number of bios which have been submitted to a layer from above.
+ *
+ * @param layer  The layer
+ *
+ * @return The number of reads and writes which have arrived
+ **/
+static uint64_t get_bios_in(struct kernel_layer *layer)
+{
+	return (atomic64_read(&layer->bios_in.read)
+		+ atomic64_read(&layer->bios_in.write));
+}
+
+/**
+ * Take the oldest entry from the log.
+ *
+ * @param [in]  deduper  The deduper
+ * @param [out] lbn      The logical block number of the entry
+ *
+ * @return <code>true</code> if the log was not empty
+ **/
+static bool take_log_entry(struct post_deduper *deduper,
+			   logical_block_number_t *lbn)
+{
+	bool found = false;
+
+	spin_lock(&deduper->lock);
+	if (deduper->count > 0) {
+		*lbn = deduper->log[deduper->head];
+		deduper->head = ((deduper->head + 1) % POST_DEDUPE_LOG_SIZE);
+		deduper->count--;
+		found = true;
+	}
+	spin_unlock(&deduper->lock);
+	return found;
+}
+
+/**
+ * Put an entry which could not be launched back at the head of the log.
+ *
+ * @param deduper  The deduper
+ * @param lbn      The logical block number of the entry
+ **/
+static void restore_log_entry(struct post_deduper *deduper,
+			      logical_block_number_t lbn)
+{
+	spin_lock(&deduper->lock);
+	// Only the background work takes entries, so a new write can not have
+	// filled the slot it freed unless the log has since filled up.
+	if (deduper->count < POST_DEDUPE_LOG_SIZE) {
+		deduper->head = ((deduper->head + POST_DEDUPE_LOG_SIZE - 1)
+				 % POST_DEDUPE_LOG_SIZE);
+		deduper->log[deduper->head] = lbn;
+		deduper->count++;
+	}
+	spin_unlock(&deduper->lock);
+}
+
+/**
+ * Read back logged blocks if no new requests have arrived since the previous
+ * check, then schedule the next check.
+ *
+ * @param work  The work_struct of the deduper's delayed_work
+ **/
+static void run_post_deduper(struct work_struct *work)
+{
+	struct post_deduper *deduper = container_of(to_delayed_work(work),
+						    struct post_deduper,
+						    work);
+	struct kernel_layer *layer = deduper->layer;
+	uint64_t bios_in = get_bios_in(layer);
+	bool idle = (bios_in == deduper->last_bios_in);
+	uint64_t quota
+		= DIV_ROUND_UP((uint64_t) READ_ONCE(deduper->budget)
+			       * POST_DEDUPE_INTERVAL_MS,
+			       MSEC_PER_SEC);
+	unsigned int in_flight = atomic_read(&deduper->in_flight);
+	logical_block_number_t lbn;
+
+	deduper->last_bios_in = bios_in;
+	if (idle && (get_kernel_layer_state(layer) == LAYER_RUNNING)) {
+		// Reads still in flight from the previous check count against
+		// this one, so a slow device is not given an ever growing
+		// backlog.
+		quota = ((quota > in_flight) ? (quota - in_flight) : 0);
+		while ((quota > 0) && take_log_entry(deduper, &lbn)) {
+			atomic_inc(&deduper->in_flight);
+			if (!launch_post_dedupe_data_vio(layer, lbn)) {
+				atomic_dec(&deduper->in_flight);
+				restore_log_entry(deduper, lbn);
+				break;
+			}
+			quota--;
+		}
+	}
+
+	spin_lock(&deduper->lock);
+	if (deduper->running) {
+		schedule_delayed_work(&deduper->work,
+				      msecs_to_jiffies(POST_DEDUPE_INTERVAL_MS));
+	}
+	spin_unlock(&deduper->lock);
+}
+
+/**********************************************************************/
+int make_post_deduper(struct kernel_layer *layer,
+		      struct post_deduper **deduper_ptr)
+{
+	struct post_deduper *deduper;
+	int result = ALLOCATE_EXTENDED(struct post_deduper,
+				       POST_DEDUPE_LOG_SIZE,
+				       logical_block_number_t,
+				       __func__,
+				       &deduper);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	deduper->layer = layer;
+	deduper->budget = DEFAULT_POST_DEDUPE_BUDGET;
+	spin_lock_init(&deduper->lock);
+	INIT_DELAYED_WORK(&deduper->work, run_post_deduper);
+	*deduper_ptr = deduper;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_post_deduper(struct post_deduper **deduper_ptr)
+{
+	struct post_deduper *deduper = *deduper_ptr;
+
+	if (deduper == NULL) {
+		return;
+	}
+
+	stop_post_deduper(deduper);
+	FREE(deduper);
+	*deduper_ptr = NULL;
+}
+
+/**********************************************************************/
+void start_post_deduper(struct post_deduper *deduper)
+{
+	spin_lock(&deduper->lock);
+	if (!deduper->running) {
+		deduper->running = true;
+		deduper->last_bios_in = get_bios_in(deduper->layer);
+		schedule_delayed_work(&deduper->work,
+				      msecs_to_jiffies(POST_DEDUPE_INTERVAL_MS));
+	}
+	spin_unlock(&deduper->lock);
+}
+
+/**********************************************************************/
+void stop_post_deduper(struct post_deduper *deduper)
+{
+	spin_lock(&deduper->lock);
+	deduper->running = false;
+	spin_unlock(&deduper->lock);
+	cancel_delayed_work_sync(&deduper->work);
+}
+
+/**********************************************************************/
+bool defer_post_dedupe(struct post_deduper *deduper,
+		       logical_block_number_t lbn)
+{
+	bool deferred = false;
+
+	if (!READ_ONCE(deduper->enabled)) {
+		return false;
+	}
+
+	// If the log is full, this block is simply deduplicated inline.
+	spin_lock(&deduper->lock);
+	if (deduper->count < POST_DEDUPE_LOG_SIZE) {
+		deduper->log[(deduper->head + deduper->count)
+			     % POST_DEDUPE_LOG_SIZE] = lbn;
+		deduper->count++;
+		deferred = true;
+	}
+	spin_unlock(&deduper->lock);
+
+	if (deferred) {
+		atomic64_inc(&deduper->deferred);
+	}
+	return deferred;
+}
+
+/**********************************************************************/
+void complete_post_dedupe(struct post_deduper *deduper, bool shared)
+{
+	atomic64_inc(&deduper->checked);
+	if (shared) {
+		atomic64_inc(&deduper->shared);
+	}
+	atomic_dec(&deduper->in_flight);
+}
+
+/**********************************************************************/
+bool get_post_dedupe_enabled(struct post_deduper *deduper)
+{
+	return READ_ONCE(deduper->enabled);
+}
+
+/**********************************************************************/
+void set_post_dedupe_enabled(struct post_deduper *deduper, bool enabled)
+{
+	WRITE_ONCE(deduper->enabled, enabled);
+}
+
+/**********************************************************************/
+unsigned int get_post_dedupe_budget(struct post_deduper *deduper)
+{
+	return READ_ONCE(deduper->budget);
+}
+
+/**********************************************************************/
+void set_post_dedupe_budget(struct post_deduper *deduper,
+			    unsigned int budget)
+{
+	WRITE_ONCE(deduper->budget, budget);
+}
+
+/**********************************************************************/
+void get_post_dedupe_statistics(struct post_deduper *deduper,
+				uint64_t *deferred,
+				uint64_t *checked,
+				uint64_t *shared,
+				uint64_t *pending)
+{
+	*deferred = atomic64_read(&deduper->deferred);
+	*checked = atomic64_read(&deduper->checked);
+	*shared = atomic64_read(&deduper->shared);
+	spin_lock(&deduper->lock);
+	*pending = deduper->count;
+	spin_unlock(&deduper->lock);
+}
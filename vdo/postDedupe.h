@@ -0,0 +1,149 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef POST_DEDUPE_H
+#define POST_DEDUPE_H
+
+#include "types.h"
+
+#include "kernelTypes.h"
+
+/**
+ * A post_deduper implements post-process deduplication. While it is enabled,
+ * newly written blocks which have an allocation are written without
+ * consulting the dedupe index, and their logical block numbers are recorded
+ * in a bounded in-memory log. Whenever no new requests have arrived since the
+ * previous check, a background work item reads back logged blocks, within a
+ * budget of blocks per second, and sends them through the normal hash lock
+ * path to share any duplicate they find.
+ *
+ * The log is only a hint: an entry which is lost (on shutdown, or because the
+ * log was full) costs only a missed deduplication, and an entry for a block
+ * which has since been overwritten or discarded just finds nothing to do.
+ **/
+struct post_deduper;
+
+/**
+ * Make a post-process deduper for a kernel layer. It is initially disabled.
+ *
+ * @param [in]  layer         The kernel layer
+ * @param [out] deduper_ptr   A pointer to hold the new deduper
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check make_post_deduper(struct kernel_layer *layer,
+				   struct post_deduper **deduper_ptr);
+
+/**
+ * Free a post-process deduper and null out the reference to it.
+ *
+ * @param deduper_ptr  A pointer to the deduper to free
+ **/
+void free_post_deduper(struct post_deduper **deduper_ptr);
+
+/**
+ * Start the background work of a post-process deduper. This is called when
+ * the layer starts running or resumes.
+ *
+ * @param deduper  The deduper
+ **/
+void start_post_deduper(struct post_deduper *deduper);
+
+/**
+ * Stop the background work of a post-process deduper so that it will not
+ * launch any more reads. Reads already launched hold request permits, so
+ * waiting for the device to go idle will also wait for them.
+ *
+ * @param deduper  The deduper
+ **/
+void stop_post_deduper(struct post_deduper *deduper);
+
+/**
+ * Check whether the deduplication of a block should be deferred and, if so,
+ * record its logical block number so that it will be checked later.
+ *
+ * @param deduper  The deduper
+ * @param lbn      The logical block being written
+ *
+ * @return <code>true</code> if the block should be written without
+ *         consulting the dedupe index
+ **/
+bool defer_post_dedupe(struct post_deduper *deduper,
+		       logical_block_number_t lbn);
+
+/**
+ * Note that a block launched by the post-process deduper has finished.
+ *
+ * @param deduper  The deduper
+ * @param shared   Whether the block was remapped to share another copy
+ **/
+void complete_post_dedupe(struct post_deduper *deduper, bool shared);
+
+/**
+ * Check whether a post-process deduper is deferring new writes.
+ *
+ * @param deduper  The deduper
+ *
+ * @return <code>true</code> if post-process deduplication is enabled
+ **/
+bool get_post_dedupe_enabled(struct post_deduper *deduper);
+
+/**
+ * Enable or disable deferring new writes. Blocks which are already logged
+ * will still be checked after the deduper is disabled.
+ *
+ * @param deduper  The deduper
+ * @param enabled  Whether new writes should be deferred
+ **/
+void set_post_dedupe_enabled(struct post_deduper *deduper, bool enabled);
+
+/**
+ * Get the number of blocks per second the deduper may read back.
+ *
+ * @param deduper  The deduper
+ *
+ * @return The budget in blocks per second
+ **/
+unsigned int get_post_dedupe_budget(struct post_deduper *deduper);
+
+/**
+ * Set the number of blocks per second the deduper may read back.
+ *
+ * @param deduper  The deduper
+ * @param budget   The budget in blocks per second
+ **/
+void set_post_dedupe_budget(struct post_deduper *deduper,
+			    unsigned int budget);
+
+/**
+ * Get the statistics of a post-process deduper.
+ *
+ * @param [in]  deduper   The deduper
+ * @param [out] deferred  The number of writes logged instead of deduplicated
+ * @param [out] checked   The number of logged blocks read back and checked
+ * @param [out] shared    The number of checked blocks which were remapped
+ * @param [out] pending   The number of logged blocks not yet checked
+ **/
+void get_post_dedupe_statistics(struct post_deduper *deduper,
+				uint64_t *deferred,
+				uint64_t *checked,
+				uint64_t *shared,
+				uint64_t *pending);
+
+#endif // POST_DEDUPE_H
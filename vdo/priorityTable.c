@@ -168,6 +168,41 @@ struct list_head *priority_table_dequeue(struct priority_table *table)
 	return entry;
 }
 
+/**********************************************************************/
+struct list_head *priority_table_dequeue_best(struct priority_table *table,
+					      unsigned int max_candidates,
+					      priority_table_scorer *scorer,
+					      void *context)
+{
+	struct bucket *bucket;
+	struct list_head *entry, *best = NULL;
+	int best_score = 0;
+	unsigned int candidates = 0;
+	int top_priority = log_base_two(table->search_vector);
+
+	if (top_priority < 0) {
+		// All buckets are empty.
+		return NULL;
+	}
+
+	bucket = &table->buckets[top_priority];
+	list_for_each(entry, &bucket->queue) {
+		int score = scorer(entry, context);
+
+		if ((best == NULL) || (score > best_score)) {
+			best = entry;
+			best_score = score;
+		}
+
+		if (++candidates >= max_candidates) {
+			break;
+		}
+	}
+
+	priority_table_remove(table, best);
+	return best;
+}
+
 /**********************************************************************/
 void priority_table_remove(struct priority_table *table,
 			   struct list_head *entry)
@@ -100,6 +100,37 @@ void reset_priority_table(struct priority_table *table);
 struct list_head * __must_check
 priority_table_dequeue(struct priority_table *table);
 
+/**
+ * A function which rates an entry being considered by
+ * priority_table_dequeue_best(). Higher scores are better.
+ *
+ * @param entry    The entry to rate
+ * @param context  The context supplied to priority_table_dequeue_best()
+ *
+ * @return the score of the entry
+ **/
+typedef int priority_table_scorer(struct list_head *entry, void *context);
+
+/**
+ * Remove and return the best of the first few entries with the highest
+ * priority in the table. Only the highest-priority entries are ever
+ * considered, and at most max_candidates of them, so this costs no more than
+ * a bounded walk of one bucket. Among entries with equal scores, the one
+ * which has been in the table longest is chosen.
+ *
+ * @param table           The priority table from which to remove an entry
+ * @param max_candidates  The most entries to consider
+ * @param scorer          The function with which to rate each candidate
+ * @param context         The context to pass to the scorer
+ *
+ * @return the dequeued entry, or NULL if the table is currently empty
+ **/
+struct list_head * __must_check
+priority_table_dequeue_best(struct priority_table *table,
+			    unsigned int max_candidates,
+			    priority_table_scorer *scorer,
+			    void *context);
+
 /**
  * Remove a specified entry from its priority table.
  *
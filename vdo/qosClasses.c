@@ -0,0 +1,106 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include "qosClasses.h"
+
+#include "memoryAlloc.h"
+
+#include "statusCodes.h"
+
+/**********************************************************************/
+int make_qos_classes(const struct device_config *config,
+		     struct qos_classes **classes_ptr)
+{
+	struct qos_classes *classes;
+	unsigned int i;
+	int result;
+
+	if (config->qos_class_count == 0) {
+		*classes_ptr = NULL;
+		return VDO_SUCCESS;
+	}
+
+	result = ALLOCATE_EXTENDED(struct qos_classes,
+				   config->qos_class_count,
+				   struct qos_class,
+				   __func__,
+				   &classes);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; i < config->qos_class_count; i++) {
+		const struct qos_class_config *class_config =
+			&config->qos_classes[i];
+		struct qos_class *class = &classes->classes[i];
+
+		result = initialize_limiter(&class->limiter,
+					    class_config->limit);
+		if (result != VDO_SUCCESS) {
+			free_qos_classes(&classes);
+			return result;
+		}
+
+		class->first = class_config->first;
+		class->last = class_config->last;
+		classes->count++;
+	}
+
+	*classes_ptr = classes;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_qos_classes(struct qos_classes **classes_ptr)
+{
+	struct qos_classes *classes = *classes_ptr;
+	unsigned int i;
+
+	if (classes == NULL) {
+		return;
+	}
+
+	for (i = 0; i < classes->count; i++) {
+		uninitialize_limiter(&classes->classes[i].limiter);
+	}
+
+	FREE(classes);
+	*classes_ptr = NULL;
+}
+
+/**********************************************************************/
+struct qos_class *get_qos_class(struct qos_classes *classes,
+				logical_block_number_t lbn)
+{
+	unsigned int i;
+
+	if (classes == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; i < classes->count; i++) {
+		struct qos_class *class = &classes->classes[i];
+
+		if ((lbn >= class->first) && (lbn <= class->last)) {
+			return class;
+		}
+	}
+
+	return NULL;
+}
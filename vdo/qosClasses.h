@@ -0,0 +1,92 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef QOS_CLASSES_H
+#define QOS_CLASSES_H
+
+#include "deviceConfig.h"
+#include "limiter.h"
+#include "types.h"
+
+/*
+ * A QoS class is a range of logical blocks, such as the partition or
+ * logical volume of one tenant, which has its own budget of requests in
+ * progress. A request for a block in a class must get a permit from the
+ * class before it may compete for the permits of the request limiter, so a
+ * storm of requests in one class can hold at most the class's budget of
+ * data_vios, leaving the rest for the other classes and for blocks in no
+ * class. Since each logical zone can only be handed the data_vios which have
+ * been admitted, the budgets also weight each class's share of the work
+ * queued on the zones.
+ */
+
+/**
+ * A range of logical blocks with its own admission budget.
+ **/
+struct qos_class {
+	/** The first logical block of the class */
+	logical_block_number_t first;
+	/** The last logical block of the class */
+	logical_block_number_t last;
+	/** The limiter of requests in progress in the class */
+	struct limiter limiter;
+};
+
+/**
+ * The QoS classes of a vdo.
+ **/
+struct qos_classes {
+	/** The number of classes */
+	unsigned int count;
+	/** The classes */
+	struct qos_class classes[];
+};
+
+/**
+ * Make the QoS classes described by a device configuration.
+ *
+ * @param [in]  config       The device configuration
+ * @param [out] classes_ptr  A pointer to hold the classes, which will be
+ *                           NULL if the configuration has no classes
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check make_qos_classes(const struct device_config *config,
+				  struct qos_classes **classes_ptr);
+
+/**
+ * Free a set of QoS classes and null out the reference to them. The limiters
+ * of the classes must be idle.
+ *
+ * @param classes_ptr  A pointer to the classes to free
+ **/
+void free_qos_classes(struct qos_classes **classes_ptr);
+
+/**
+ * Find the QoS class of a logical block.
+ *
+ * @param classes  The QoS classes, which may be NULL
+ * @param lbn      The logical block
+ *
+ * @return The class containing the block, or NULL if it is in no class
+ **/
+struct qos_class * __must_check
+get_qos_class(struct qos_classes *classes, logical_block_number_t lbn);
+
+#endif // QOS_CLASSES_H
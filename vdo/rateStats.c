@@ -0,0 +1,216 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+
+#include "rateStats.h"
+
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/workqueue.h>
+
+#include "memoryAlloc.h"
+#include "permassert.h"
+
+#include "statusCodes.h"
+
+enum {
+	/** The number of fractional bits kept in the averages */
+	RATE_AVERAGE_SHIFT = 8,
+	/** The log of the weight of the short term average (about 8 s) */
+	SHORT_AVERAGE_LOG_WEIGHT = 3,
+	/** The log of the weight of the long term average (about 1 min) */
+	LONG_AVERAGE_LOG_WEIGHT = 6,
+};
+
+static const char *RATE_COUNTER_NAMES[] = {
+	[RATE_READS] = "reads",
+	[RATE_WRITES] = "writes",
+	[RATE_DISCARDS] = "discards",
+	[RATE_DEDUPE_HITS] = "dedupe_hits",
+	[RATE_COMPRESSED_FRAGMENTS] = "compressed_fragments",
+	[RATE_JOURNAL_BLOCKS] = "journal_blocks",
+};
+
+struct counter_rate {
+	/** The counter value at the previous sample */
+	uint64_t last_count;
+	/** The rate over the last sample interval, in events per second */
+	uint64_t rate;
+	/** The short term average, scaled by 2^RATE_AVERAGE_SHIFT */
+	uint64_t short_average;
+	/** The long term average, scaled by 2^RATE_AVERAGE_SHIFT */
+	uint64_t long_average;
+};
+
+struct rate_tracker {
+	/** The work which takes the samples */
+	struct delayed_work work;
+	/** The function which reads the counters */
+	rate_sampler *sampler;
+	/** The context for the sampler */
+	void *context;
+	/** Whether the work should requeue itself */
+	bool running;
+	/** The time of the previous sample */
+	unsigned long last_sample;
+	/** The rates of each counter */
+	struct counter_rate rates[RATE_COUNTER_COUNT];
+};
+
+/**
+ * Move an average a fraction of the way towards a new sample.
+ *
+ * @param average     The scaled average
+ * @param rate        The new unscaled sample
+ * @param log_weight  The log of the inverse of the fraction to move
+ *
+ * @return The new scaled average
+ **/
+static inline uint64_t decay_average(uint64_t average,
+				     uint64_t rate,
+				     unsigned int log_weight)
+{
+	uint64_t scaled = rate << RATE_AVERAGE_SHIFT;
+	if (scaled >= average) {
+		return average + ((scaled - average) >> log_weight);
+	}
+
+	return average - ((average - scaled) >> log_weight);
+}
+
+/**
+ * Sample the counters and update the rates. This is the work function of the
+ * tracker's delayed work.
+ *
+ * @param work  The tracker's work
+ **/
+static void sample_rates(struct work_struct *work)
+{
+	struct rate_tracker *tracker = container_of(to_delayed_work(work),
+						    struct rate_tracker,
+						    work);
+	uint64_t counts[RATE_COUNTER_COUNT];
+	unsigned long now = jiffies;
+	unsigned long elapsed = max(now - tracker->last_sample, 1UL);
+	enum rate_counter counter;
+
+	tracker->sampler(tracker->context, counts);
+	for (counter = 0; counter < RATE_COUNTER_COUNT; counter++) {
+		struct counter_rate *rate = &tracker->rates[counter];
+		uint64_t delta = counts[counter] - rate->last_count;
+		uint64_t per_second = div64_u64(delta * HZ, elapsed);
+
+		rate->last_count = counts[counter];
+		WRITE_ONCE(rate->rate, per_second);
+		WRITE_ONCE(rate->short_average,
+			   decay_average(rate->short_average, per_second,
+					 SHORT_AVERAGE_LOG_WEIGHT));
+		WRITE_ONCE(rate->long_average,
+			   decay_average(rate->long_average, per_second,
+					 LONG_AVERAGE_LOG_WEIGHT));
+	}
+
+	tracker->last_sample = now;
+	if (READ_ONCE(tracker->running)) {
+		schedule_delayed_work(&tracker->work, HZ);
+	}
+}
+
+/**********************************************************************/
+int make_rate_tracker(rate_sampler *sampler,
+		      void *context,
+		      struct rate_tracker **tracker_ptr)
+{
+	struct rate_tracker *tracker;
+	int result = ALLOCATE(1, struct rate_tracker, __func__, &tracker);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	tracker->sampler = sampler;
+	tracker->context = context;
+	INIT_DELAYED_WORK(&tracker->work, sample_rates);
+	*tracker_ptr = tracker;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_rate_tracker(struct rate_tracker **tracker_ptr)
+{
+	struct rate_tracker *tracker = *tracker_ptr;
+	if (tracker == NULL) {
+		return;
+	}
+
+	stop_rate_tracker(tracker);
+	FREE(tracker);
+	*tracker_ptr = NULL;
+}
+
+/**********************************************************************/
+void start_rate_tracker(struct rate_tracker *tracker)
+{
+	uint64_t counts[RATE_COUNTER_COUNT];
+	enum rate_counter counter;
+
+	if (tracker->running) {
+		return;
+	}
+
+	tracker->sampler(tracker->context, counts);
+	for (counter = 0; counter < RATE_COUNTER_COUNT; counter++) {
+		tracker->rates[counter] = (struct counter_rate) {
+			.last_count = counts[counter],
+		};
+	}
+
+	tracker->last_sample = jiffies;
+	WRITE_ONCE(tracker->running, true);
+	schedule_delayed_work(&tracker->work, HZ);
+}
+
+/**********************************************************************/
+void stop_rate_tracker(struct rate_tracker *tracker)
+{
+	WRITE_ONCE(tracker->running, false);
+	cancel_delayed_work_sync(&tracker->work);
+}
+
+/**********************************************************************/
+ssize_t format_rates(struct rate_tracker *tracker, char *buf, size_t size)
+{
+	enum rate_counter counter;
+	ssize_t length = 0;
+
+	STATIC_ASSERT(COUNT_OF(RATE_COUNTER_NAMES) == RATE_COUNTER_COUNT);
+	for (counter = 0; counter < RATE_COUNTER_COUNT; counter++) {
+		const struct counter_rate *rate = &tracker->rates[counter];
+		length += scnprintf(buf + length, size - length,
+				    "%s %llu %llu %llu\n",
+				    RATE_COUNTER_NAMES[counter],
+				    READ_ONCE(rate->rate),
+				    (READ_ONCE(rate->short_average)
+				     >> RATE_AVERAGE_SHIFT),
+				    (READ_ONCE(rate->long_average)
+				     >> RATE_AVERAGE_SHIFT));
+	}
+
+	return length;
+}
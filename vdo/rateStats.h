@@ -0,0 +1,107 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+
+#ifndef RATE_STATS_H
+#define RATE_STATS_H
+
+#include "types.h"
+
+/**
+ * A rate_tracker samples a set of monotonic counters once a second from a
+ * work queue and keeps, for each counter, the rate over the last second and two
+ * exponentially weighted moving averages of that rate. The results are
+ * published with single word stores, so they can be read from any thread
+ * without a lock and without disturbing the zone threads, which makes them
+ * cheap enough for monitoring agents to poll every second.
+ **/
+struct rate_tracker;
+
+/** The counters whose rates are tracked */
+enum rate_counter {
+	RATE_READS = 0,
+	RATE_WRITES,
+	RATE_DISCARDS,
+	RATE_DEDUPE_HITS,
+	RATE_COMPRESSED_FRAGMENTS,
+	RATE_JOURNAL_BLOCKS,
+	RATE_COUNTER_COUNT,
+};
+
+/**
+ * A function which reads the current value of every tracked counter. It is
+ * called from the system work queue, so it should not block for long.
+ *
+ * @param context  The context supplied when the tracker was made
+ * @param counts   An array to hold the current counter values
+ **/
+typedef void rate_sampler(void *context,
+			  uint64_t counts[RATE_COUNTER_COUNT]);
+
+/**
+ * Make a rate tracker. The tracker does not sample until it is started.
+ *
+ * @param sampler      The function which reads the counters
+ * @param context      The context for the sampler
+ * @param tracker_ptr  A pointer to hold the new tracker
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check make_rate_tracker(rate_sampler *sampler,
+				   void *context,
+				   struct rate_tracker **tracker_ptr);
+
+/**
+ * Stop a rate tracker if necessary, free it, and null out the reference to
+ * it.
+ *
+ * @param tracker_ptr  A pointer to the tracker to free
+ **/
+void free_rate_tracker(struct rate_tracker **tracker_ptr);
+
+/**
+ * Start sampling. The rates are measured from the counter values at the
+ * time the tracker is started, and the averages restart from zero.
+ *
+ * @param tracker  The tracker to start
+ **/
+void start_rate_tracker(struct rate_tracker *tracker);
+
+/**
+ * Stop sampling and wait for any sample in progress to finish. The sampler
+ * will not be called again until the tracker is restarted.
+ *
+ * @param tracker  The tracker to stop
+ **/
+void stop_rate_tracker(struct rate_tracker *tracker);
+
+/**
+ * Format the current rates, one counter per line, as the counter name
+ * followed by its rate over the last second and its short and long term
+ * averages, all in events per second.
+ *
+ * @param tracker  The tracker to read
+ * @param buf      The buffer to fill
+ * @param size     The size of the buffer
+ *
+ * @return The number of characters written
+ **/
+ssize_t format_rates(struct rate_tracker *tracker, char *buf, size_t size);
+
+#endif // RATE_STATS_H
@@ -0,0 +1,322 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "readCache.h"
+
+#include <linux/hash.h>
+#include <linux/spinlock.h>
+
+#include "atomicDefs.h"
+#include "memoryAlloc.h"
+
+#include "constants.h"
+#include "statusCodes.h"
+
+enum {
+	/** log2 of the number of blocks held by each cache */
+	READ_CACHE_BITS = 9,
+	READ_CACHE_ENTRIES = 1 << READ_CACHE_BITS,
+};
+
+struct read_cache_entry {
+	/** Protects the other fields of this entry */
+	spinlock_t lock;
+	/** Whether the entry holds the contents of a block */
+	bool valid;
+	/** Whether the block should be cached when next read */
+	bool candidate;
+	/** Whether a read claimed by read_cache_lookup_or_wait() is pending */
+	bool filling;
+	/** Whether the block was invalidated while it was being read */
+	bool fill_invalidated;
+	/** The reads waiting for the pending read of the block */
+	struct list_head waiters;
+	/** The block whose contents are held */
+	physical_block_number_t pbn;
+	/** The contents of the block */
+	char *data;
+};
+
+struct read_cache {
+	/** The number of lookups which found their block */
+	atomic64_t hits;
+	/** The number of lookups which did not */
+	atomic64_t misses;
+	/** The reference count which makes a data block worth caching */
+	unsigned int share_threshold;
+	/** The slots, indexed by a hash of the PBN */
+	struct read_cache_entry entries[];
+};
+
+/**********************************************************************/
+int make_read_cache(struct read_cache **cache_ptr)
+{
+	struct read_cache *cache;
+	unsigned int i;
+	int result = ALLOCATE_EXTENDED(struct read_cache,
+				       READ_CACHE_ENTRIES,
+				       struct read_cache_entry,
+				       __func__,
+				       &cache);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	for (i = 0; i < READ_CACHE_ENTRIES; i++) {
+		struct read_cache_entry *entry = &cache->entries[i];
+
+		spin_lock_init(&entry->lock);
+		INIT_LIST_HEAD(&entry->waiters);
+		result = ALLOCATE(VDO_BLOCK_SIZE, char, "read cache block",
+				  &entry->data);
+		if (result != VDO_SUCCESS) {
+			free_read_cache(&cache);
+			return result;
+		}
+	}
+
+	*cache_ptr = cache;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_read_cache(struct read_cache **cache_ptr)
+{
+	struct read_cache *cache = *cache_ptr;
+	unsigned int i;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	for (i = 0; i < READ_CACHE_ENTRIES; i++) {
+		FREE(cache->entries[i].data);
+	}
+
+	FREE(cache);
+	*cache_ptr = NULL;
+}
+
+/**
+ * Get the slot which may hold a given block.
+ *
+ * @param cache  The cache
+ * @param pbn    The block
+ *
+ * @return The entry for the block's slot
+ **/
+static inline struct read_cache_entry *
+get_entry(struct read_cache *cache, physical_block_number_t pbn)
+{
+	return &cache->entries[hash_64(pbn, READ_CACHE_BITS)];
+}
+
+/**********************************************************************/
+bool read_cache_lookup(struct read_cache *cache,
+		       physical_block_number_t pbn,
+		       char *buffer)
+{
+	struct read_cache_entry *entry = get_entry(cache, pbn);
+	bool found;
+
+	spin_lock(&entry->lock);
+	found = (entry->valid && (entry->pbn == pbn));
+	if (found) {
+		memcpy(buffer, entry->data, VDO_BLOCK_SIZE);
+	}
+	spin_unlock(&entry->lock);
+
+	atomic64_inc(found ? &cache->hits : &cache->misses);
+	return found;
+}
+
+/**********************************************************************/
+enum read_cache_fill_result
+read_cache_lookup_or_wait(struct read_cache *cache,
+			  physical_block_number_t pbn,
+			  char *buffer,
+			  bool claim,
+			  struct read_cache_waiter *waiter)
+{
+	struct read_cache_entry *entry = get_entry(cache, pbn);
+	enum read_cache_fill_result fill_result = READ_CACHE_FILL_MISS;
+
+	spin_lock(&entry->lock);
+	if (entry->pbn != pbn) {
+		if (claim && !entry->filling) {
+			fill_result = READ_CACHE_FILL_CLAIMED;
+		}
+	} else if (entry->valid) {
+		memcpy(buffer, entry->data, VDO_BLOCK_SIZE);
+		fill_result = READ_CACHE_FILL_HIT;
+	} else if (entry->filling) {
+		list_add_tail(&waiter->entry, &entry->waiters);
+		fill_result = READ_CACHE_FILL_WAIT;
+	} else if (claim) {
+		fill_result = READ_CACHE_FILL_CLAIMED;
+	}
+
+	if (fill_result == READ_CACHE_FILL_CLAIMED) {
+		entry->pbn = pbn;
+		entry->valid = false;
+		entry->candidate = false;
+		entry->filling = true;
+		entry->fill_invalidated = false;
+	}
+	spin_unlock(&entry->lock);
+
+	// A read which waits for another is as good as a hit.
+	atomic64_inc(((fill_result == READ_CACHE_FILL_HIT) ||
+		      (fill_result == READ_CACHE_FILL_WAIT)) ?
+		     &cache->hits : &cache->misses);
+	return fill_result;
+}
+
+/**********************************************************************/
+void read_cache_finish_fill(struct read_cache *cache,
+			    physical_block_number_t pbn,
+			    const char *data)
+{
+	struct read_cache_entry *entry = get_entry(cache, pbn);
+	struct read_cache_waiter *waiter, *tmp;
+	LIST_HEAD(waiters);
+
+	spin_lock(&entry->lock);
+	list_splice_init(&entry->waiters, &waiters);
+	entry->filling = false;
+	if ((data != NULL) && !entry->fill_invalidated) {
+		memcpy(entry->data, data, VDO_BLOCK_SIZE);
+		entry->valid = true;
+	}
+	spin_unlock(&entry->lock);
+
+	list_for_each_entry_safe(waiter, tmp, &waiters, entry) {
+		list_del_init(&waiter->entry);
+		waiter->callback(waiter, data);
+	}
+}
+
+/**********************************************************************/
+void read_cache_store(struct read_cache *cache,
+		      physical_block_number_t pbn,
+		      const char *data)
+{
+	struct read_cache_entry *entry = get_entry(cache, pbn);
+
+	spin_lock(&entry->lock);
+	if (entry->filling) {
+		// The slot belongs to the pending read until it is done.
+		spin_unlock(&entry->lock);
+		return;
+	}
+
+	memcpy(entry->data, data, VDO_BLOCK_SIZE);
+	entry->pbn = pbn;
+	entry->valid = true;
+	entry->candidate = false;
+	spin_unlock(&entry->lock);
+}
+
+/**********************************************************************/
+void note_read_cache_shared_block(struct read_cache *cache,
+				  physical_block_number_t pbn,
+				  uint8_t reference_count)
+{
+	unsigned int threshold;
+	struct read_cache_entry *entry;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	threshold = READ_ONCE(cache->share_threshold);
+	if ((threshold == 0) || (reference_count < threshold)) {
+		return;
+	}
+
+	entry = get_entry(cache, pbn);
+	spin_lock(&entry->lock);
+	if (!entry->filling &&
+	    ((entry->pbn != pbn) || !(entry->valid || entry->candidate))) {
+		entry->pbn = pbn;
+		entry->valid = false;
+		entry->candidate = true;
+	}
+	spin_unlock(&entry->lock);
+}
+
+/**********************************************************************/
+bool is_read_cache_candidate(struct read_cache *cache,
+			     physical_block_number_t pbn)
+{
+	struct read_cache_entry *entry;
+	bool candidate;
+
+	if (READ_ONCE(cache->share_threshold) == 0) {
+		return false;
+	}
+
+	entry = get_entry(cache, pbn);
+	spin_lock(&entry->lock);
+	candidate = ((entry->pbn == pbn) && (entry->valid || entry->candidate));
+	spin_unlock(&entry->lock);
+	return candidate;
+}
+
+/**********************************************************************/
+unsigned int get_read_cache_share_threshold(struct read_cache *cache)
+{
+	return READ_ONCE(cache->share_threshold);
+}
+
+/**********************************************************************/
+void set_read_cache_share_threshold(struct read_cache *cache,
+				    unsigned int threshold)
+{
+	WRITE_ONCE(cache->share_threshold, threshold);
+}
+
+/**********************************************************************/
+void invalidate_read_cache_entry(struct read_cache *cache,
+				 physical_block_number_t pbn)
+{
+	struct read_cache_entry *entry;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	entry = get_entry(cache, pbn);
+	spin_lock(&entry->lock);
+	if (entry->pbn == pbn) {
+		entry->valid = false;
+		entry->candidate = false;
+		entry->fill_invalidated = entry->filling;
+	}
+	spin_unlock(&entry->lock);
+}
+
+/**********************************************************************/
+void get_read_cache_statistics(struct read_cache *cache,
+			       uint64_t *hits,
+			       uint64_t *misses)
+{
+	*hits = atomic64_read(&cache->hits);
+	*misses = atomic64_read(&cache->misses);
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef READ_CACHE_H
+#define READ_CACHE_H
+
+#include <linux/list.h>
+
+#include "types.h"
+
+/**
+ * A read_cache holds the contents of recently read compressed physical
+ * blocks so that reads of the other fragments in a block need not go back
+ * to storage, and of recently written data blocks so that verifying dedupe
+ * advice against them need not either. Optionally, it also holds data blocks
+ * with many references, such as those of a base image shared by many
+ * clones, so that reads through each of their logical addresses need not go
+ * to storage. A block's contents can only
+ * change after it has been freed, so an entry is dropped whenever the
+ * reference count of its block is decremented, including in a slab which
+ * has not yet been scrubbed, and again when a new compressed block is
+ * written to it.
+ **/
+struct read_cache;
+
+/**
+ * The outcome of looking up a compressed block which other reads may also
+ * be waiting for.
+ **/
+enum read_cache_fill_result {
+	/** The block was copied from the cache */
+	READ_CACHE_FILL_HIT,
+	/** Another read of the block is in progress and will call the waiter */
+	READ_CACHE_FILL_WAIT,
+	/**
+	 * The caller must read the block and then pass it to
+	 * read_cache_finish_fill()
+	 **/
+	READ_CACHE_FILL_CLAIMED,
+	/** The caller must read the block on its own */
+	READ_CACHE_FILL_MISS,
+};
+
+struct read_cache_waiter;
+
+/**
+ * The function called when a read which a waiter was waiting for is done.
+ *
+ * @param waiter  The waiter
+ * @param data    The VDO_BLOCK_SIZE bytes of the block, or NULL if the read
+ *                failed
+ **/
+typedef void read_cache_waiter_callback(struct read_cache_waiter *waiter,
+					const char *data);
+
+/**
+ * A read waiting for another read of the same compressed block.
+ **/
+struct read_cache_waiter {
+	/** The entry in the list of waiters for the block */
+	struct list_head entry;
+	/** The function to call when the block has been read */
+	read_cache_waiter_callback *callback;
+};
+
+/**
+ * Make a read cache.
+ *
+ * @param [out] cache_ptr  A pointer to hold the new cache
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check make_read_cache(struct read_cache **cache_ptr);
+
+/**
+ * Free a read cache and null out the reference to it.
+ *
+ * @param cache_ptr  A pointer to the cache to free
+ **/
+void free_read_cache(struct read_cache **cache_ptr);
+
+/**
+ * Copy the cached contents of a physical block, if present.
+ *
+ * @param cache   The cache to search
+ * @param pbn     The physical block to look up
+ * @param buffer  A buffer of VDO_BLOCK_SIZE bytes to receive the contents
+ *
+ * @return <code>true</code> if the block was found in the cache
+ **/
+bool __must_check read_cache_lookup(struct read_cache *cache,
+				    physical_block_number_t pbn,
+				    char *buffer);
+
+/**
+ * Look up a compressed block which is about to be read, and if it is not
+ * cached, either wait for a read of it already in progress, or claim the
+ * block so that other reads of it wait for the caller's read. A read which
+ * claims the block must always pass it to read_cache_finish_fill(), even if
+ * the read fails.
+ *
+ * @param cache   The cache
+ * @param pbn     The physical block to look up
+ * @param buffer  A buffer of VDO_BLOCK_SIZE bytes to receive the contents
+ * @param claim   Whether the caller will read the whole block, and so may
+ *                claim it
+ * @param waiter  The waiter to queue if a read is in progress; its callback
+ *                must be set
+ *
+ * @return The outcome of the lookup
+ **/
+enum read_cache_fill_result __must_check
+read_cache_lookup_or_wait(struct read_cache *cache,
+			  physical_block_number_t pbn,
+			  char *buffer,
+			  bool claim,
+			  struct read_cache_waiter *waiter);
+
+/**
+ * Finish a read of a compressed block claimed by
+ * read_cache_lookup_or_wait(), caching the block if it was read and calling
+ * each read which was waiting for it.
+ *
+ * @param cache  The cache
+ * @param pbn    The physical block which was read
+ * @param data   The VDO_BLOCK_SIZE bytes of the block, or NULL if the read
+ *               failed
+ **/
+void read_cache_finish_fill(struct read_cache *cache,
+			    physical_block_number_t pbn,
+			    const char *data);
+
+/**
+ * Record the contents of a physical block which has just been read or is
+ * being written, replacing whatever entry occupied its slot.
+ *
+ * @param cache  The cache
+ * @param pbn    The physical block which was read
+ * @param data   The VDO_BLOCK_SIZE bytes of the block
+ **/
+void read_cache_store(struct read_cache *cache,
+		      physical_block_number_t pbn,
+		      const char *data);
+
+/**
+ * Note that a data block has gained a reference. If its reference count has
+ * reached the sharing threshold, the block becomes a candidate for caching
+ * the next time it is read.
+ *
+ * @param cache            The cache (may be NULL)
+ * @param pbn              The physical block which was referenced
+ * @param reference_count  The new reference count of the block
+ **/
+void note_read_cache_shared_block(struct read_cache *cache,
+				  physical_block_number_t pbn,
+				  uint8_t reference_count);
+
+/**
+ * Check whether a read of an uncompressed block should go through the cache,
+ * either because the cache holds the block or because it is shared widely
+ * enough to be worth caching.
+ *
+ * @param cache  The cache
+ * @param pbn    The physical block to be read
+ *
+ * @return <code>true</code> if the read should use the cache
+ **/
+bool __must_check is_read_cache_candidate(struct read_cache *cache,
+					  physical_block_number_t pbn);
+
+/**
+ * Get the reference count at which data blocks become candidates for
+ * caching.
+ *
+ * @param cache  The cache
+ *
+ * @return The threshold, or 0 if shared blocks are not cached
+ **/
+unsigned int get_read_cache_share_threshold(struct read_cache *cache);
+
+/**
+ * Set the reference count at which data blocks become candidates for
+ * caching.
+ *
+ * @param cache      The cache
+ * @param threshold  The threshold, or 0 to stop caching shared blocks
+ **/
+void set_read_cache_share_threshold(struct read_cache *cache,
+				    unsigned int threshold);
+
+/**
+ * Drop any cached contents of a physical block.
+ *
+ * @param cache  The cache (may be NULL)
+ * @param pbn    The physical block which may be rewritten
+ **/
+void invalidate_read_cache_entry(struct read_cache *cache,
+				 physical_block_number_t pbn);
+
+/**
+ * Get the numbers of lookups which did and did not find their block.
+ *
+ * @param [in]  cache   The cache
+ * @param [out] hits    The number of successful lookups
+ * @param [out] misses  The number of unsuccessful lookups
+ **/
+void get_read_cache_statistics(struct read_cache *cache,
+			       uint64_t *hits,
+			       uint64_t *misses);
+
+#endif // READ_CACHE_H
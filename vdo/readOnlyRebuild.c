@@ -26,6 +26,7 @@
 
 #include "blockMapInternals.h"
 #include "blockMapRecovery.h"
+#include "compactJournalSector.h"
 #include "completion.h"
 #include "numUtils.h"
 #include "packedRecoveryJournalBlock.h"
@@ -65,6 +66,9 @@ struct read_only_rebuild_completion {
 	block_count_t logical_blocks_used;
 	/** The number of allocated block map pages */
 	block_count_t block_map_data_blocks;
+	/** The entries of the compact sector being extracted */
+	struct recovery_journal_entry
+		decoded_entries[COMPACT_JOURNAL_ENTRIES_PER_SECTOR];
 };
 
 /**
@@ -130,6 +134,25 @@ make_rebuild_completion(struct vdo *vdo,
 	return VDO_SUCCESS;
 }
 
+/**
+ * Switch the page caches of all the logical zones into or out of read-only
+ * rebuild mode, since the journal is replayed into the block map through the
+ * caches of every zone.
+ *
+ * @param vdo         The vdo
+ * @param rebuilding  <code>true</code> if the caches should be put into
+ *                    read-only rebuild mode, <code>false</code> otherwise
+ **/
+static void set_rebuild_mode(struct vdo *vdo, bool rebuilding)
+{
+	struct block_map *map = get_block_map(vdo);
+	zone_count_t zone;
+	for (zone = 0; zone < map->zone_count; zone++) {
+		set_vdo_page_cache_rebuild_mode(map->zones[zone].page_cache,
+						rebuilding);
+	}
+}
+
 /**
  * Clean up the rebuild process, whether or not it succeeded, by freeing the
  * rebuild completion and notifying the parent of the outcome.
@@ -143,8 +166,7 @@ static void complete_rebuild(struct vdo_completion *completion)
 	struct read_only_rebuild_completion *rebuild =
 		as_read_only_rebuild_completion(completion);
 	struct vdo *vdo = rebuild->vdo;
-	set_vdo_page_cache_rebuild_mode(get_block_map(vdo)->zones[0].page_cache,
-					false);
+	set_rebuild_mode(vdo, false);
 	free_rebuild_completion(&rebuild);
 	finish_vdo_completion(parent, result);
 }
@@ -249,10 +271,38 @@ static void launch_reference_count_rebuild(struct vdo_completion *completion)
 				 &rebuild->block_map_data_blocks);
 }
 
+/**
+ * Append a recovery journal entry to the array of numbered mappings in the
+ * rebuild completion, numbering each entry in the order it is appended.
+ *
+ * @param rebuild  The journal rebuild completion
+ * @param entry    The entry to append
+ **/
+static void append_entry(struct read_only_rebuild_completion *rebuild,
+			 const struct recovery_journal_entry *entry)
+{
+	int result = validate_recovery_journal_entry(rebuild->vdo, entry);
+	if (result != VDO_SUCCESS) {
+		// When recovering from read-only mode, ignore damaged entries.
+		return;
+	}
+
+	if (is_increment_operation(entry->operation)) {
+		rebuild->entries[rebuild->entry_count] =
+			(struct numbered_block_mapping) {
+				.block_map_slot = entry->slot,
+				.block_map_entry =
+					pack_pbn(entry->mapping.pbn,
+						 entry->mapping.state),
+				.number = rebuild->entry_count,
+			};
+		rebuild->entry_count++;
+	}
+}
+
 /**
  * Append an array of recovery journal entries from a journal block sector to
- * the array of numbered mappings in the rebuild completion, numbering each
- * entry in the order they are appended.
+ * the array of numbered mappings in the rebuild completion.
  *
  * @param rebuild      The journal rebuild completion
  * @param sector       The recovery journal sector with entries
@@ -266,25 +316,53 @@ static void append_sector_entries(struct read_only_rebuild_completion *rebuild,
 	for (i = 0; i < entry_count; i++) {
 		struct recovery_journal_entry entry =
 			unpack_recovery_journal_entry(&sector->entries[i]);
-		int result = validate_recovery_journal_entry(rebuild->vdo,
-							     &entry);
+		append_entry(rebuild, &entry);
+	}
+}
+
+/**
+ * Append the entries of the valid sectors of a compact journal block to the
+ * array of numbered mappings in the rebuild completion.
+ *
+ * @param rebuild        The journal rebuild completion
+ * @param packed_header  The packed header of the block
+ * @param header         The unpacked header of the block
+ **/
+static void
+append_compact_block_entries(struct read_only_rebuild_completion *rebuild,
+			     struct packed_journal_header *packed_header,
+			     const struct recovery_block_header *header)
+{
+	journal_entry_count_t block_entries = header->entry_count;
+	uint8_t j;
+
+	for (j = 1; (j < VDO_SECTORS_PER_BLOCK) && (block_entries > 0); j++) {
+		struct packed_journal_sector *sector =
+			get_journal_block_sector(packed_header, j);
+		struct packed_compact_journal_sector *compact_sector =
+			(struct packed_compact_journal_sector *) sector;
+		journal_entry_count_t sector_entries, i;
+		int result;
+
+		if (!is_valid_recovery_journal_sector(header, sector)) {
+			continue;
+		}
+
+		result = decode_compact_journal_sector(compact_sector,
+						       rebuild->decoded_entries);
 		if (result != VDO_SUCCESS) {
-			// When recovering from read-only mode, ignore damaged
-			// entries.
+			// Like a torn sector, a damaged one is skipped.
 			continue;
 		}
 
-		if (is_increment_operation(entry.operation)) {
-			rebuild->entries[rebuild->entry_count] =
-				(struct numbered_block_mapping) {
-					.block_map_slot = entry.slot,
-					.block_map_entry =
-						pack_pbn(entry.mapping.pbn,
-							 entry.mapping.state),
-					.number = rebuild->entry_count,
-				};
-			rebuild->entry_count++;
+		// Only extract as many as the block header calls for.
+		sector_entries = min((journal_entry_count_t) sector->entry_count,
+				     block_entries);
+		for (i = 0; i < sector_entries; i++) {
+			append_entry(rebuild, &rebuild->decoded_entries[i]);
 		}
+
+		block_entries -= sector_entries;
 	}
 }
 
@@ -304,15 +382,29 @@ static int extract_journal_entries(struct read_only_rebuild_completion *rebuild)
 	struct recovery_journal *journal = vdo->recovery_journal;
 	sequence_number_t first = rebuild->head;
 	sequence_number_t last = rebuild->tail;
-	block_count_t max_count = ((last - first + 1) *
-				   journal->entries_per_block);
+	block_count_t max_count = 0;
+	int result;
+
+	for (i = first; i <= last; i++) {
+		struct packed_journal_header *packed_header =
+			get_journal_block_header(journal,
+						 rebuild->journal_data,
+						 i);
+		struct recovery_block_header header;
+
+		unpack_recovery_block_header(packed_header, &header);
+		if (is_exact_recovery_journal_block(journal, &header, i)) {
+			max_count += min(get_recovery_block_capacity(&header),
+					 header.entry_count);
+		}
+	}
 
 	/*
 	 * Allocate an array of numbered_block_mapping structures large
 	 * enough to transcribe every packed_recovery_journal_entry from every
 	 * valid journal block.
 	 */
-	int result = ALLOCATE(max_count,
+	result = ALLOCATE(max_count,
 			      struct numbered_block_mapping,
 			      __func__,
 			      &rebuild->entries);
@@ -336,9 +428,16 @@ static int extract_journal_entries(struct read_only_rebuild_completion *rebuild)
 			continue;
 		}
 
+		if (is_compact_recovery_journal_block(&header)) {
+			append_compact_block_entries(rebuild, packed_header,
+						     &header);
+			continue;
+		}
+
 		// Don't extract more than the expected maximum entries per
 		// block.
-		block_entries = min(journal->entries_per_block,
+		block_entries = min((journal_entry_count_t)
+				    RECOVERY_JOURNAL_ENTRIES_PER_BLOCK,
 				    header.entry_count);
 		for (j = 1; j < VDO_SECTORS_PER_BLOCK; j++) {
 			journal_entry_count_t sector_entries;
@@ -409,8 +508,7 @@ static void apply_journal_entries(struct vdo_completion *completion)
 	}
 
 	// Suppress block map errors.
-	set_vdo_page_cache_rebuild_mode(get_block_map(vdo)->zones[0].page_cache,
-					true);
+	set_rebuild_mode(vdo, true);
 
 	// Play the recovery journal into the block map.
 	prepare_vdo_completion(completion,
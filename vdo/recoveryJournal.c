@@ -22,6 +22,8 @@
 #include "recoveryJournal.h"
 #include "recoveryJournalInternals.h"
 
+#include <linux/ktime.h>
+
 #include "logger.h"
 #include "memoryAlloc.h"
 #include "permassert.h"
@@ -30,6 +32,7 @@
 #include "constants.h"
 #include "dataVIO.h"
 #include "extent.h"
+#include "fixedLayout.h"
 #include "header.h"
 #include "numUtils.h"
 #include "packedRecoveryJournalBlock.h"
@@ -39,6 +42,7 @@
 #include "slabJournal.h"
 #include "vdo.h"
 #include "vdoInternal.h"
+#include "vdoTrace.h"
 #include "waitQueue.h"
 
 static const uint64_t RECOVERY_COUNT_MASK = 0xff;
@@ -51,6 +55,13 @@ enum {
 	 * that means reserving enough space for all 2048 VIOs, or 8 blocks.
 	 */
 	RECOVERY_JOURNAL_RESERVED_BLOCKS = 8,
+	/*
+	 * A gap between entries longer than this multiple of the maximum
+	 * commit delay is recorded as though it were this long, so that one
+	 * idle period stops the journal from delaying commits without
+	 * dominating the average for long after.
+	 */
+	IDLE_ENTRY_GAP_FACTOR = 8,
 };
 
 /**
@@ -272,7 +283,9 @@ check_slab_journal_commit_threshold(struct recovery_journal *journal)
 	block_count_t current_length = journal->tail -
 		journal->slab_journal_head;
 	if (current_length > journal->slab_journal_commit_threshold) {
+		begin_journal_events_update(journal);
 		journal->events.slab_journal_commits_requested++;
+		end_journal_events_update(journal);
 		commit_oldest_slab_journal_tail_blocks(journal->depot,
 						       journal->slab_journal_head);
 	}
@@ -294,7 +307,8 @@ static void finish_reaping(struct recovery_journal *journal)
 	journal->block_map_head = journal->block_map_reap_head;
 	journal->slab_journal_head = journal->slab_journal_reap_head;
 	blocks_reaped = get_recovery_journal_head(journal) - old_head;
-	journal->available_space += blocks_reaped * journal->entries_per_block;
+	journal->available_space +=
+		blocks_reaped * journal->min_entries_per_block;
 	journal->reaping = false;
 	check_slab_journal_commit_threshold(journal);
 	assign_entries(journal);
@@ -410,6 +424,22 @@ static void set_journal_tail(struct recovery_journal *journal,
 	journal->tail = tail;
 }
 
+/**
+ * Bring the expiration of the commit timer to the journal thread. This is
+ * the function of the commit timer, so it runs in softirq context.
+ *
+ * @param timer  The commit timer
+ *
+ * @return HRTIMER_NORESTART
+ **/
+static enum hrtimer_restart commit_timer_expired(struct hrtimer *timer)
+{
+	struct recovery_journal *journal =
+		container_of(timer, struct recovery_journal, commit_timer);
+	enqueue_vdo_completion(&journal->commit_completion);
+	return HRTIMER_NORESTART;
+}
+
 /**********************************************************************/
 int decode_recovery_journal(struct recovery_journal_state_7_0 state,
 			    nonce_t nonce,
@@ -430,6 +460,7 @@ int decode_recovery_journal(struct recovery_journal_state_7_0 state,
 		return result;
 	}
 
+	seqcount_init(&journal->events_sequence);
 	INIT_LIST_HEAD(&journal->free_tail_blocks);
 	INIT_LIST_HEAD(&journal->active_tail_blocks);
 	initialize_wait_queue(&journal->pending_writes);
@@ -450,9 +481,32 @@ int decode_recovery_journal(struct recovery_journal_state_7_0 state,
 	// resume
 	journal->state.current_state = ADMIN_STATE_SUSPENDED;
 
-	journal->entries_per_block = RECOVERY_JOURNAL_ENTRIES_PER_BLOCK;
+	journal->max_commit_delay_us = DEFAULT_JOURNAL_MAX_COMMIT_DELAY_US;
+	hrtimer_init(&journal->commit_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL_SOFT);
+	journal->commit_timer.function = commit_timer_expired;
+	initialize_vdo_completion(&journal->commit_completion, vdo,
+				  RECOVERY_JOURNAL_COMMIT_COMPLETION);
+
+	journal->compact_entries = vdo->device_config->compact_journal_entries;
+	if (journal->compact_entries) {
+		journal->entries_per_block =
+			COMPACT_RECOVERY_JOURNAL_ENTRIES_PER_BLOCK;
+		journal->min_entries_per_block =
+			COMPACT_RECOVERY_JOURNAL_MIN_ENTRIES_PER_BLOCK;
+	} else {
+		journal->entries_per_block =
+			RECOVERY_JOURNAL_ENTRIES_PER_BLOCK;
+		journal->min_entries_per_block =
+			RECOVERY_JOURNAL_ENTRIES_PER_BLOCK;
+	}
+
+	// A compact block is only sure to hold the fewest entries it can, so
+	// space is reserved at that rate and any more is credited back as
+	// each block fills.
 	journal_length = get_recovery_journal_length(journal_size);
-	journal->available_space = journal->entries_per_block * journal_length;
+	journal->available_space =
+		journal->min_entries_per_block * journal_length;
 
 	for (i = 0; i < tail_buffer_size; i++) {
 		struct recovery_journal_block *block;
@@ -513,6 +567,7 @@ void free_recovery_journal(struct recovery_journal **journal_ptr)
 		return;
 	}
 
+	hrtimer_cancel(&journal->commit_timer);
 	free_vdo_lock_counter(&journal->lock_counter);
 	free_vio(&journal->flush_vio);
 
@@ -584,6 +639,13 @@ void set_journal_block_map_data_blocks_used(struct recovery_journal *journal,
 	journal->block_map_data_blocks = pages;
 }
 
+/**********************************************************************/
+physical_block_number_t
+get_recovery_journal_origin(const struct recovery_journal *journal)
+{
+	return get_fixed_layout_partition_offset(journal->partition);
+}
+
 /**********************************************************************/
 thread_id_t get_recovery_journal_thread_id(struct recovery_journal *journal)
 {
@@ -703,7 +765,9 @@ static bool prepare_to_assign_entry(struct recovery_journal *journal,
 	if ((journal->tail - get_recovery_journal_head(journal)) >
 	    journal->size) {
 		// Cannot use this block since the journal is full.
+		begin_journal_events_update(journal);
 		journal->events.disk_full++;
+		end_journal_events_update(journal);
 		return false;
 	}
 
@@ -721,6 +785,106 @@ static bool prepare_to_assign_entry(struct recovery_journal *journal,
 }
 
 static void write_blocks(struct recovery_journal *journal);
+static void commit_delayed_block(struct vdo_completion *completion);
+
+/**
+ * Fold a sample into an exponentially weighted moving average.
+ *
+ * @param average  The current average, or 0 if there have been no samples
+ * @param sample   The new sample
+ *
+ * @return The new average
+ **/
+static inline uint64_t update_average(uint64_t average, uint64_t sample)
+{
+	return ((average == 0) ? sample : (((average * 7) + sample) / 8));
+}
+
+/**
+ * Record the arrival of an entry, updating the average time between entries.
+ *
+ * @param journal  The journal
+ **/
+static void note_entry_arrival(struct recovery_journal *journal)
+{
+	uint64_t now = ktime_get_ns();
+	uint64_t idle_gap = ((uint64_t) READ_ONCE(journal->max_commit_delay_us)
+			     * NSEC_PER_USEC * IDLE_ENTRY_GAP_FACTOR);
+	uint64_t gap = min(now - journal->last_entry_time, idle_gap);
+
+	journal->last_entry_time = now;
+	journal->entry_interval = update_average(journal->entry_interval, gap);
+}
+
+/**
+ * Compute how long to hold the partially filled active block for more
+ * entries before committing it. The block is held for no more than half the
+ * time a commit takes, since a longer wait would cost more than the extra
+ * commit it saves, and not at all unless entries are arriving quickly enough
+ * that another one is expected in that time.
+ *
+ * @param journal  The journal
+ *
+ * @return The delay in ns, or 0 if the block should be committed now
+ **/
+static uint64_t compute_commit_delay(struct recovery_journal *journal)
+{
+	struct recovery_journal_block *block = journal->active_block;
+	uint64_t delay = ((uint64_t) READ_ONCE(journal->max_commit_delay_us)
+			  * NSEC_PER_USEC);
+	uint64_t room = journal->entries_per_block - block->entry_count;
+
+	delay = min(delay, journal->commit_latency / 2);
+	if ((journal->entry_interval == 0) ||
+	    (journal->entry_interval >= delay)) {
+		return 0;
+	}
+
+	// There is no point waiting for more entries than the block can hold.
+	return min(delay, room * journal->entry_interval);
+}
+
+/**
+ * Decide whether to hold the partially filled active block for more entries
+ * rather than committing it now, and if so, set the commit timer to commit
+ * it when the delay is up.
+ *
+ * @param journal  The journal
+ *
+ * @return true if the commit of the active block is delayed
+ **/
+static bool delay_partial_commit(struct recovery_journal *journal)
+{
+	uint64_t delay;
+
+	if (journal->commit_timer_armed) {
+		return true;
+	}
+
+	if (journal->commit_delay_expired ||
+	    !is_vdo_state_normal(&journal->state) ||
+	    is_recovery_block_full(journal->active_block)) {
+		return false;
+	}
+
+	delay = compute_commit_delay(journal);
+	if (delay == 0) {
+		return false;
+	}
+
+	journal->commit_timer_armed = true;
+	begin_journal_events_update(journal);
+	journal->events.delayed_commits++;
+	end_journal_events_update(journal);
+	prepare_vdo_completion(&journal->commit_completion,
+			       commit_delayed_block,
+			       commit_delayed_block,
+			       journal->thread_id,
+			       journal);
+	hrtimer_start(&journal->commit_timer, ns_to_ktime(delay),
+		      HRTIMER_MODE_REL_SOFT);
+	return true;
+}
 
 /**
  * Queue a block for writing. The block is expected to be full. If the block
@@ -826,11 +990,10 @@ static void assign_entry(struct waiter *waiter, void *context)
 		// The block is full, so we can write it anytime henceforth. If
 		// it is already committing, we'll queue it for writing when it
 		// comes back.
+		journal->available_space +=
+			block->entry_count - journal->min_entries_per_block;
 		schedule_block_write(journal, block);
 	}
-
-	// Force out slab journal tail blocks when threshold is reached.
-	check_slab_journal_commit_threshold(journal);
 }
 
 /**********************************************************************/
@@ -851,6 +1014,8 @@ static bool assign_entries_from_queue(struct recovery_journal *journal,
 /**********************************************************************/
 static void assign_entries(struct recovery_journal *journal)
 {
+	uint64_t available_space = journal->available_space;
+
 	if (journal->adding_entries) {
 		// Protect against re-entrancy.
 		return;
@@ -863,6 +1028,13 @@ static void assign_entries(struct recovery_journal *journal)
 					  true);
 	}
 
+	// Force out slab journal tail blocks when threshold is reached. This
+	// is checked once per batch of entries rather than once per entry to
+	// keep the journal thread's per-entry work to a minimum.
+	if (journal->available_space != available_space) {
+		check_slab_journal_commit_threshold(journal);
+	}
+
 	// Now that we've finished with entries, see if we have a batch of
 	// blocks to write.
 	write_blocks(journal);
@@ -915,6 +1087,7 @@ static void continue_committed_waiter(struct waiter *waiter, void *context)
 			data_vio->recovery_journal_point.sequence_number,
 			data_vio->recovery_journal_point.entry_count);
 	journal->commit_point = data_vio->recovery_journal_point;
+	record_data_vio_milestone(data_vio, DATA_VIO_JOURNALED);
 
 	continue_waiter(waiter, &result);
 }
@@ -994,11 +1167,20 @@ static void complete_write(struct vdo_completion *completion)
 	struct recovery_journal_block *block = completion->parent;
 	struct recovery_journal *journal = block->journal;
 	struct recovery_journal_block *last_active_block;
+	uint64_t latency;
 	assert_on_journal_thread(journal, __func__);
 
+	latency = ktime_get_ns() - block->commit_time;
+	trace_vdo_journal_commit(block->sequence_number,
+				 block->entries_in_commit,
+				 latency);
+	journal->commit_latency = update_average(journal->commit_latency,
+						 latency);
 	journal->pending_write_count -= 1;
+	begin_journal_events_update(journal);
 	journal->events.blocks.committed += 1;
 	journal->events.entries.committed += block->entries_in_commit;
+	end_journal_events_update(journal);
 	block->uncommitted_entry_count -= block->entries_in_commit;
 	block->entries_in_commit = 0;
 	block->committing = false;
@@ -1055,6 +1237,7 @@ static void write_block(struct waiter *waiter, void *context __always_unused)
 		return;
 	}
 
+	block->commit_time = ktime_get_ns();
 	result = commit_recovery_block(block, complete_write,
 				       handle_write_error);
 	if (result != VDO_SUCCESS) {
@@ -1089,13 +1272,34 @@ static void write_blocks(struct recovery_journal *journal)
 	notify_all_waiters(&journal->pending_writes, write_block, NULL);
 
 	// Do we need to write the active block? Only if we have no outstanding
-	// writes, even after issuing all of the full writes.
+	// writes, even after issuing all of the full writes, and more entries
+	// aren't expected soon.
 	if ((journal->pending_write_count == 0)
-	    && can_commit_recovery_block(journal->active_block)) {
+	    && can_commit_recovery_block(journal->active_block)
+	    && !delay_partial_commit(journal)) {
 		write_block(&journal->active_block->write_waiter, NULL);
 	}
 }
 
+/**
+ * Write the partial block held by the commit timer, now that the timer has
+ * expired. This is the callback of the commit completion, which is enqueued
+ * on the journal thread when the commit timer expires.
+ *
+ * @param completion  The commit completion
+ **/
+static void commit_delayed_block(struct vdo_completion *completion)
+{
+	struct recovery_journal *journal = completion->parent;
+
+	assert_on_journal_thread(journal, __func__);
+	journal->commit_timer_armed = false;
+	journal->commit_delay_expired = true;
+	write_blocks(journal);
+	journal->commit_delay_expired = false;
+	check_for_drain_complete(journal);
+}
+
 /**********************************************************************/
 void add_recovery_journal_entry(struct recovery_journal *journal,
 				struct data_vio *data_vio)
@@ -1119,6 +1323,7 @@ void add_recovery_journal_entry(struct recovery_journal *journal,
 			 (data_vio->recovery_sequence_number == 0)),
 			"journal lock not held for increment");
 
+	note_entry_arrival(journal);
 	advance_vdo_journal_point(&journal->append_point,
 				  journal->entries_per_block);
 	result = enqueue_data_vio((increment ? &journal->increment_waiters
@@ -1247,9 +1452,17 @@ void release_per_entry_lock_from_other_zone(struct recovery_journal *journal,
  **/
 static void initiate_drain(struct admin_state *state)
 {
-	check_for_drain_complete(container_of(state,
-					      struct recovery_journal,
-					      state));
+	struct recovery_journal *journal =
+		container_of(state, struct recovery_journal, state);
+
+	// Don't make the drain wait out the delay of a held block. A timer
+	// which has already expired will write the block itself.
+	if (hrtimer_cancel(&journal->commit_timer)) {
+		journal->commit_timer_armed = false;
+		write_blocks(journal);
+	}
+
+	check_for_drain_complete(journal);
 }
 
 /**********************************************************************/
@@ -1296,10 +1509,31 @@ get_journal_logical_blocks_used(const struct recovery_journal *journal)
 }
 
 /**********************************************************************/
-struct recovery_journal_statistics
-get_recovery_journal_statistics(const struct recovery_journal *journal)
+void get_recovery_journal_statistics(const struct recovery_journal *journal,
+				     struct recovery_journal_statistics *stats)
+{
+	unsigned int sequence;
+
+	do {
+		sequence = read_seqcount_begin(&journal->events_sequence);
+		*stats = journal->events;
+	} while (read_seqcount_retry(&journal->events_sequence, sequence));
+}
+
+/**********************************************************************/
+unsigned int
+get_recovery_journal_max_commit_delay(const struct recovery_journal *journal)
 {
-	return journal->events;
+	return READ_ONCE(journal->max_commit_delay_us);
+}
+
+/**********************************************************************/
+void set_recovery_journal_max_commit_delay(struct recovery_journal *journal,
+					   unsigned int delay_us)
+{
+	WRITE_ONCE(journal->max_commit_delay_us,
+		   min_t(unsigned int, delay_us,
+			 MAXIMUM_JOURNAL_COMMIT_DELAY_US));
 }
 
 /**********************************************************************/
@@ -1308,8 +1542,9 @@ void dump_recovery_journal_statistics(const struct recovery_journal *journal)
 	const struct list_head *head;
 	struct list_head *entry;
 
-	struct recovery_journal_statistics stats =
-		get_recovery_journal_statistics(journal);
+	struct recovery_journal_statistics stats;
+
+	get_recovery_journal_statistics(journal, &stats);
 	log_info("Recovery Journal");
 	log_info("  block_map_head=%llu slab_journal_head=%llu last_write_acknowledged=%llu tail=%llu block_map_reap_head=%llu slab_journal_reap_head=%llu disk_full=%llu slab_journal_commits_requested=%llu increment_waiters=%zu decrement_waiters=%zu",
 		 journal->block_map_head, journal->slab_journal_head,
@@ -31,6 +31,13 @@
 #include "statistics.h"
 #include "types.h"
 
+enum {
+	/** The default bound on the delay of a partial block commit, in us */
+	DEFAULT_JOURNAL_MAX_COMMIT_DELAY_US = 200,
+	/** The largest settable bound on the delay of a partial block commit */
+	MAXIMUM_JOURNAL_COMMIT_DELAY_US = 10 * 1000,
+};
+
 /**
  * The recovery_journal provides a log of all block mapping and reference count
  * changes which have not yet been stably written to the block map or slab
@@ -214,6 +221,17 @@ get_journal_block_map_data_blocks_used(struct recovery_journal *journal);
 void set_journal_block_map_data_blocks_used(struct recovery_journal *journal,
 					    block_count_t pages);
 
+/**
+ * Get the physical block number of the start of a recovery journal's
+ * partition.
+ *
+ * @param journal  The journal to query
+ *
+ * @return The first physical block of the journal
+ **/
+physical_block_number_t __must_check
+get_recovery_journal_origin(const struct recovery_journal *journal);
+
 /**
  * Get the ID of a recovery journal's thread.
  *
@@ -355,12 +373,37 @@ get_journal_logical_blocks_used(const struct recovery_journal *journal);
 /**
  * Get the current statistics from the recovery journal.
  *
- * @param journal   The recovery journal to query
+ * @param [in]  journal  The recovery journal to query
+ * @param [out] stats    A copy of the current statistics for the journal
+ **/
+void get_recovery_journal_statistics(const struct recovery_journal *journal,
+				     struct recovery_journal_statistics *stats);
+
+/**
+ * Get the longest time the journal will hold a partially filled block for
+ * more entries before committing it.
+ *
+ * @param journal  The recovery journal
  *
- * @return a copy of the current statistics for the journal
+ * @return The maximum commit delay in microseconds, or 0 if partial blocks
+ *         are committed as soon as possible
+ **/
+unsigned int __must_check
+get_recovery_journal_max_commit_delay(const struct recovery_journal *journal);
+
+/**
+ * Set the longest time the journal will hold a partially filled block for
+ * more entries before committing it. The journal only holds a block when
+ * entries are arriving quickly enough to add to it before the delay is up,
+ * and never for more than half the time a commit takes. The delay is limited
+ * to MAXIMUM_JOURNAL_COMMIT_DELAY_US.
+ *
+ * @param journal   The recovery journal
+ * @param delay_us  The maximum commit delay in microseconds, or 0 to commit
+ *                  partial blocks as soon as possible
  **/
-struct recovery_journal_statistics __must_check
-get_recovery_journal_statistics(const struct recovery_journal *journal);
+void set_recovery_journal_max_commit_delay(struct recovery_journal *journal,
+					   unsigned int delay_us);
 
 /**
  * Dump some current statistics and other debug info from the recovery
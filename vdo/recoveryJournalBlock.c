@@ -121,6 +121,10 @@ static void set_active_sector(struct recovery_journal_block *block,
 	block->sector->check_byte = get_block_header(block)->check_byte;
 	block->sector->recovery_count = block->journal->recovery_count;
 	block->sector->entry_count = 0;
+	if (block->journal->compact_entries) {
+		struct packed_compact_journal_sector *compact_sector = sector;
+		reset_compact_sector_encoder(&block->encoder, compact_sector);
+	}
 }
 
 /**********************************************************************/
@@ -128,7 +132,9 @@ void initialize_recovery_block(struct recovery_journal_block *block)
 {
 	struct recovery_journal *journal = block->journal;
 	struct recovery_block_header unpacked = {
-		.metadata_type = VDO_METADATA_RECOVERY_JOURNAL,
+		.metadata_type = (journal->compact_entries
+				  ? VDO_METADATA_COMPACT_RECOVERY_JOURNAL
+				  : VDO_METADATA_RECOVERY_JOURNAL),
 		.block_map_data_blocks = journal->block_map_data_blocks,
 		.logical_blocks_used = journal->logical_blocks_used,
 		.nonce = journal->nonce,
@@ -150,6 +156,30 @@ void initialize_recovery_block(struct recovery_journal_block *block)
 	pack_recovery_block_header(&unpacked, header);
 
 	set_active_sector(block, get_journal_block_sector(header, 1));
+	reset_compact_sector_encoder(&block->sizer, NULL);
+	block->sizer_sector = 1;
+}
+
+/**
+ * Compose the recovery journal entry a data_vio is to make.
+ *
+ * @param data_vio  The data_vio
+ *
+ * @return The entry
+ **/
+static struct recovery_journal_entry
+get_data_vio_entry(struct data_vio *data_vio)
+{
+	struct tree_lock *lock = &data_vio->tree_lock;
+	return (struct recovery_journal_entry) {
+		.mapping =
+			{
+				.pbn = data_vio->operation.pbn,
+				.state = data_vio->operation.state,
+			},
+		.operation = data_vio->operation.type,
+		.slot = lock->tree_slots[lock->height].block_map_slot,
+	};
 }
 
 /**********************************************************************/
@@ -169,12 +199,26 @@ int enqueue_recovery_block_entry(struct recovery_journal_block *block,
 
 	block->entry_count++;
 	block->uncommitted_entry_count++;
+	if (block->journal->compact_entries) {
+		// Track where the entry will be coded so that the block is
+		// known to be full before its entries are actually coded.
+		struct recovery_journal_entry entry =
+			get_data_vio_entry(data_vio);
+		add_compact_journal_entry(&block->sizer, &entry);
+		if (is_compact_sector_full(&block->sizer)
+		    && (block->sizer_sector < (VDO_SECTORS_PER_BLOCK - 1))) {
+			reset_compact_sector_encoder(&block->sizer, NULL);
+			block->sizer_sector++;
+		}
+	}
 
 	// Update stats to reflect the journal entry we're going to write.
+	begin_journal_events_update(block->journal);
 	if (new_batch) {
 		block->journal->events.blocks.started++;
 	}
 	block->journal->events.entries.started++;
+	end_journal_events_update(block->journal);
 
 	return VDO_SUCCESS;
 }
@@ -189,6 +233,10 @@ int enqueue_recovery_block_entry(struct recovery_journal_block *block,
 static bool __must_check
 is_sector_full(const struct recovery_journal_block *block)
 {
+	if (block->journal->compact_entries) {
+		return is_compact_sector_full(&block->encoder);
+	}
+
 	return (block->sector->entry_count ==
 		RECOVERY_JOURNAL_ENTRIES_PER_SECTOR);
 }
@@ -206,8 +254,6 @@ add_queued_recovery_entries(struct recovery_journal_block *block)
 	while (has_waiters(&block->entry_waiters)) {
 		struct data_vio *data_vio =
 			waiter_as_data_vio(dequeue_next_waiter(&block->entry_waiters));
-		struct tree_lock *lock = &data_vio->tree_lock;
-		struct packed_recovery_journal_entry *packed_entry;
 		struct recovery_journal_entry new_entry;
 		int result;
 
@@ -223,18 +269,13 @@ add_queued_recovery_entries(struct recovery_journal_block *block)
 		}
 
 		// Compose and encode the entry.
-		packed_entry =
-			&block->sector->entries[block->sector->entry_count++];
-		new_entry = (struct recovery_journal_entry) {
-			.mapping =
-				{
-					.pbn = data_vio->operation.pbn,
-					.state = data_vio->operation.state,
-				},
-			.operation = data_vio->operation.type,
-			.slot = lock->tree_slots[lock->height].block_map_slot,
-		};
-		*packed_entry = pack_recovery_journal_entry(&new_entry);
+		new_entry = get_data_vio_entry(data_vio);
+		if (block->journal->compact_entries) {
+			add_compact_journal_entry(&block->encoder, &new_entry);
+		} else {
+			block->sector->entries[block->sector->entry_count++] =
+				pack_recovery_journal_entry(&new_entry);
+		}
 
 		if (is_increment_operation(data_vio->operation.type)) {
 			data_vio->recovery_sequence_number =
@@ -248,7 +289,10 @@ add_queued_recovery_entries(struct recovery_journal_block *block)
 			return result;
 		}
 
-		if (is_sector_full(block)) {
+		if (is_sector_full(block)
+		    && (get_journal_block_sector(get_block_header(block),
+						 VDO_SECTORS_PER_BLOCK - 1)
+			!= block->sector)) {
 			set_active_sector(block, (char *) block->sector
 						       + VDO_SECTOR_SIZE);
 		}
@@ -313,8 +357,10 @@ int commit_recovery_block(struct recovery_journal_block *block,
 
 	// Update stats to reflect the block and entries we're about to write.
 	journal->pending_write_count += 1;
+	begin_journal_events_update(journal);
 	journal->events.blocks.written += 1;
 	journal->events.entries.written += block->entries_in_commit;
+	end_journal_events_update(journal);
 
 	header->block_map_head = __cpu_to_le64(journal->block_map_head);
 	header->slab_journal_head = __cpu_to_le64(journal->slab_journal_head);
@@ -24,6 +24,7 @@
 
 #include "permassert.h"
 
+#include "compactJournalSector.h"
 #include "packedRecoveryJournalBlock.h"
 #include "recoveryJournalInternals.h"
 #include "types.h"
@@ -58,10 +59,21 @@ struct recovery_journal_block {
 	journal_entry_count_t uncommitted_entry_count;
 	/** The number of new entries in the current commit */
 	journal_entry_count_t entries_in_commit;
+	/** The time at which the current commit was issued, in ns */
+	uint64_t commit_time;
 	/** The queue of vios which will make entries for the next commit */
 	struct wait_queue entry_waiters;
 	/** The queue of vios waiting for the current commit */
 	struct wait_queue commit_waiters;
+	/** The coder of the current sector, if entries are compacted */
+	struct compact_sector_encoder encoder;
+	/**
+	 * The sizes of the entries assigned to the block, were they coded,
+	 * which tells when a compact block is full before its entries are
+	 */
+	struct compact_sector_encoder sizer;
+	/** The sector in which the sizer's entries will be coded */
+	uint8_t sizer_sector;
 };
 
 /**
@@ -115,8 +127,16 @@ is_recovery_block_empty(const struct recovery_journal_block *block)
 static inline bool __must_check
 is_recovery_block_full(const struct recovery_journal_block *block)
 {
-	return ((block == NULL)
-		|| (block->journal->entries_per_block == block->entry_count));
+	if (block == NULL) {
+		return true;
+	}
+
+	if (block->journal->compact_entries) {
+		return ((block->sizer_sector == (VDO_SECTORS_PER_BLOCK - 1))
+			&& is_compact_sector_full(&block->sizer));
+	}
+
+	return (block->journal->entries_per_block == block->entry_count);
 }
 
 /**
@@ -22,7 +22,9 @@
 #ifndef RECOVERY_JOURNAL_INTERNALS_H
 #define RECOVERY_JOURNAL_INTERNALS_H
 
+#include <linux/hrtimer.h>
 #include <linux/list.h>
+#include <linux/seqlock.h>
 
 #include "numeric.h"
 
@@ -85,8 +87,12 @@ struct recovery_journal {
 	nonce_t nonce;
 	/** The number of recoveries completed by the VDO */
 	uint8_t recovery_count;
+	/** Whether blocks are written with compacted entries */
+	bool compact_entries;
 	/** The number of entries which fit in a single block */
 	journal_entry_count_t entries_per_block;
+	/** The number of entries which are sure to fit in a single block */
+	journal_entry_count_t min_entries_per_block;
 	/** Unused in-memory journal blocks */
 	struct list_head free_tail_blocks;
 	/** In-memory journal blocks with records */
@@ -117,11 +123,38 @@ struct recovery_journal {
 	/** The threshold at which slab journal tail blocks will be written out
 	 */
 	block_count_t slab_journal_commit_threshold;
+	/**
+	 * Guards events so that other threads can take a consistent snapshot
+	 * of them. It and the events get their own cache lines so that readers
+	 * do not disturb the journal thread's use of the rest of the journal.
+	 */
+	seqcount_t events_sequence ____cacheline_aligned;
 	/** Counters for events in the journal that are reported as statistics
 	 */
 	struct recovery_journal_statistics events;
 	/** The locks for each on-disk block */
-	struct lock_counter *lock_counter;
+	struct lock_counter *lock_counter ____cacheline_aligned;
+	/**
+	 * The longest a partially filled block may be held for more entries,
+	 * in microseconds
+	 */
+	unsigned int max_commit_delay_us;
+	/** The time at which the most recent entry arrived, in ns */
+	uint64_t last_entry_time;
+	/** The moving average of the time between entries, in ns */
+	uint64_t entry_interval;
+	/** The moving average of the time to commit a block, in ns */
+	uint64_t commit_latency;
+	/**
+	 * True from when the commit timer is set until its completion has run
+	 */
+	bool commit_timer_armed;
+	/** Set while the commit completion writes the block it was holding */
+	bool commit_delay_expired;
+	/** The timer which bounds the delay of a partial block commit */
+	struct hrtimer commit_timer;
+	/** The completion which runs the commit timer on the journal thread */
+	struct vdo_completion commit_completion;
 };
 
 /**
@@ -141,6 +174,31 @@ get_recovery_journal_block_number(const struct recovery_journal *journal,
 	return compute_recovery_journal_block_number(journal->size, sequence);
 }
 
+/**
+ * Begin an update of the journal's event counters. Preemption is disabled for
+ * the duration of the update so that a reader never spins waiting for a
+ * writer which has been scheduled out.
+ *
+ * @param journal  The journal whose events are being updated
+ **/
+static inline void
+begin_journal_events_update(struct recovery_journal *journal)
+{
+	preempt_disable();
+	write_seqcount_begin(&journal->events_sequence);
+}
+
+/**
+ * Finish an update of the journal's event counters.
+ *
+ * @param journal  The journal whose events were updated
+ **/
+static inline void end_journal_events_update(struct recovery_journal *journal)
+{
+	write_seqcount_end(&journal->events_sequence);
+	preempt_enable();
+}
+
 /**
  * Compute the check byte for a given sequence number.
  *
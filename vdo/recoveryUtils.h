@@ -22,6 +22,7 @@
 #ifndef RECOVERY_UTILS_H
 #define RECOVERY_UTILS_H
 
+#include "compactJournalSector.h"
 #include "constants.h"
 #include "packedRecoveryJournalBlock.h"
 #include "recoveryJournalEntry.h"
@@ -48,6 +49,35 @@ get_journal_block_header(struct recovery_journal *journal,
 	return (struct packed_journal_header *) &journal_data[block_offset];
 }
 
+/**
+ * Check whether a recovery journal block header is for a block in the
+ * compact format.
+ *
+ * @param header  The unpacked block header to check
+ *
+ * @return <code>true</code> if the block's entries are compacted
+ **/
+static inline bool __must_check
+is_compact_recovery_journal_block(const struct recovery_block_header *header)
+{
+	return (header->metadata_type == VDO_METADATA_COMPACT_RECOVERY_JOURNAL);
+}
+
+/**
+ * Get the largest number of entries a recovery journal block can hold.
+ *
+ * @param header  The unpacked header of the block
+ *
+ * @return The number of entries a full block in the header's format holds
+ **/
+static inline journal_entry_count_t __must_check
+get_recovery_block_capacity(const struct recovery_block_header *header)
+{
+	return (is_compact_recovery_journal_block(header)
+		? COMPACT_RECOVERY_JOURNAL_ENTRIES_PER_BLOCK
+		: RECOVERY_JOURNAL_ENTRIES_PER_BLOCK);
+}
+
 /**
  * Determine whether the given header describes a valid block for the
  * given journal. A block is not valid if it is unformatted, or if it
@@ -62,7 +92,8 @@ static inline bool __must_check
 is_valid_recovery_journal_block(const struct recovery_journal *journal,
 				const struct recovery_block_header *header)
 {
-	return ((header->metadata_type == VDO_METADATA_RECOVERY_JOURNAL)
+	return (((header->metadata_type == VDO_METADATA_RECOVERY_JOURNAL)
+		 || is_compact_recovery_journal_block(header))
 		&& (header->nonce == journal->nonce)
 		&& (header->recovery_count == journal->recovery_count));
 }
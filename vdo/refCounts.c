@@ -22,6 +22,7 @@
 #include "refCounts.h"
 #include "refCountsInternals.h"
 
+#include "atomicDefs.h"
 #include "logger.h"
 #include "memoryAlloc.h"
 #include "numeric.h"
@@ -40,6 +41,7 @@
 #include "referenceOperation.h"
 #include "slab.h"
 #include "slabDepotFormat.h"
+#include "slabDepotInternals.h"
 #include "slabJournal.h"
 #include "slabJournalInternals.h"
 #include "slabSummary.h"
@@ -50,6 +52,12 @@
 #include "waitQueue.h"
 
 static const uint64_t BYTES_PER_WORD = sizeof(uint64_t);
+/** The number of counters summarized by each bit of the free_groups bitmap */
+static const slab_block_number COUNTS_PER_GROUP = 64;
+/** The number of blocks after a stream's block which are left for it */
+static const slab_block_number STREAM_RESERVATION = 128;
+/** The most stripes examined when looking for an empty one */
+static const unsigned int MAXIMUM_STRIPE_PROBES = 16;
 static const bool NORMAL_OPERATION = true;
 
 /**
@@ -173,26 +181,42 @@ int make_ref_counts(block_count_t block_count,
 		    struct read_only_notifier *read_only_notifier,
 		    struct ref_counts **ref_counts_ptr)
 {
-	size_t index, bytes;
+	size_t index, group_count;
 	block_count_t ref_block_count =
 		get_saved_reference_count_size(block_count);
 	struct ref_counts *ref_counts;
-	int result = ALLOCATE_EXTENDED(struct ref_counts,
-				       ref_block_count,
-				       struct reference_block,
-				       "ref counts structure",
+	int result = ALLOCATE_EXTENDED_TAGGED(struct ref_counts,
+					      ref_block_count,
+					      struct reference_block,
+					      MEMORY_TAG_REF_COUNTS,
+					      "ref counts structure",
 				       &ref_counts);
 	if (result != UDS_SUCCESS) {
 		return result;
 	}
 
-	// Allocate such that the runt slab has a full-length memory array,
-	// plus a little padding so we can word-search even at the very end.
-	bytes = ((ref_block_count * COUNTS_PER_BLOCK) + (2 * BYTES_PER_WORD));
-	result = ALLOCATE(bytes,
-			  vdo_refcount_t,
-			  "ref counts array",
-			  &ref_counts->counters);
+	// The counter array is not allocated until a counter becomes non-zero.
+	group_count = DIV_ROUND_UP(ref_block_count * COUNTS_PER_BLOCK,
+				   COUNTS_PER_GROUP);
+	result = ALLOCATE_TAGGED(BITS_TO_LONGS(group_count),
+				 unsigned long,
+				 MEMORY_TAG_REF_COUNTS,
+				 "ref counts free groups",
+			  &ref_counts->free_groups);
+	if (result != UDS_SUCCESS) {
+		free_ref_counts(&ref_counts);
+		return result;
+	}
+
+	// Every counter starts out free.
+	bitmap_set(ref_counts->free_groups, 0,
+		   DIV_ROUND_UP(block_count, COUNTS_PER_GROUP));
+
+	result = ALLOCATE_TAGGED(BITS_TO_LONGS(group_count),
+				 unsigned long,
+				 MEMORY_TAG_REF_COUNTS,
+				 "ref counts discard groups",
+			  &ref_counts->discard_groups);
 	if (result != UDS_SUCCESS) {
 		free_ref_counts(&ref_counts);
 		return result;
@@ -205,6 +229,11 @@ int make_ref_counts(block_count_t block_count,
 	ref_counts->reference_block_count = ref_block_count;
 	ref_counts->read_only_notifier = read_only_notifier;
 	ref_counts->statistics = &slab->allocator->ref_counts_statistics;
+	ref_counts->stripe_blocks = slab->allocator->depot->stripe_blocks;
+	if (ref_counts->stripe_blocks > 1) {
+		ref_counts->stripe_phase
+			= slab->start % ref_counts->stripe_blocks;
+	}
 	ref_counts->search_cursor.first_block = &ref_counts->blocks[0];
 	ref_counts->search_cursor.last_block =
 		&ref_counts->blocks[ref_block_count - 1];
@@ -220,6 +249,57 @@ int make_ref_counts(block_count_t block_count,
 	return VDO_SUCCESS;
 }
 
+/**
+ * Get the size of the counter array of a ref_counts.
+ *
+ * @param ref_counts  The ref_counts
+ *
+ * @return The size of the array in bytes
+ **/
+static size_t get_counter_array_size(const struct ref_counts *ref_counts)
+{
+	// Allocate such that the runt slab has a full-length memory array,
+	// plus a little padding so we can word-search even at the very end.
+	return ((ref_counts->reference_block_count * COUNTS_PER_BLOCK)
+		+ (2 * BYTES_PER_WORD));
+}
+
+/**********************************************************************/
+int allocate_reference_counters(struct ref_counts *ref_counts)
+{
+	if (ref_counts->counters != NULL) {
+		return VDO_SUCCESS;
+	}
+
+	return ALLOCATE_TAGGED(get_counter_array_size(ref_counts),
+			       vdo_refcount_t,
+			       MEMORY_TAG_REF_COUNTS,
+			       "ref counts array",
+			       &ref_counts->counters);
+}
+
+/**
+ * Check that a ref_counts has its counter array, as it must before any of
+ * its blocks is allocated or referenced during normal operation.
+ *
+ * @param ref_counts  The ref_counts
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static inline int __must_check
+assert_has_counters(const struct ref_counts *ref_counts)
+{
+	return ASSERT(ref_counts->counters != NULL,
+		      "slab %u has reference counters",
+		      ref_counts->slab->slab_number);
+}
+
+/**********************************************************************/
+bool has_reference_counters(const struct ref_counts *ref_counts)
+{
+	return (ref_counts->counters != NULL);
+}
+
 /**********************************************************************/
 void free_ref_counts(struct ref_counts **ref_counts_ptr)
 {
@@ -228,8 +308,10 @@ void free_ref_counts(struct ref_counts **ref_counts_ptr)
 		return;
 	}
 
-	FREE(ref_counts->counters);
-	FREE(ref_counts);
+	FREE_TAGGED(ref_counts->discard_groups, MEMORY_TAG_REF_COUNTS);
+	FREE_TAGGED(ref_counts->free_groups, MEMORY_TAG_REF_COUNTS);
+	FREE_TAGGED(ref_counts->counters, MEMORY_TAG_REF_COUNTS);
+	FREE_TAGGED(ref_counts, MEMORY_TAG_REF_COUNTS);
 	*ref_counts_ptr = NULL;
 }
 
@@ -252,7 +334,7 @@ bool are_ref_counts_active(struct ref_counts *ref_counts)
 {
 	enum admin_state_code code;
 
-	if (has_active_io(ref_counts)) {
+	if (has_active_io(ref_counts) || (ref_counts->discarding > 0)) {
 		return true;
 	}
 
@@ -332,7 +414,8 @@ get_reference_block(struct ref_counts *ref_counts,
  *
  * @param [in]  ref_counts       The refcounts object
  * @param [in]  pbn              The physical block number
- * @param [out] counter_ptr      A pointer to the reference counter
+ * @param [out] counter_ptr      A pointer to the reference counter, or
+ *                               NULL if the ref_counts has no counter array
 
  **/
 static int get_reference_counter(struct ref_counts *ref_counts,
@@ -345,7 +428,9 @@ static int get_reference_counter(struct ref_counts *ref_counts,
 		return result;
 	}
 
-	*counter_ptr = &ref_counts->counters[index];
+	*counter_ptr = ((ref_counts->counters == NULL)
+			? NULL
+			: &ref_counts->counters[index]);
 
 	return VDO_SUCCESS;
 }
@@ -360,6 +445,10 @@ uint8_t get_available_references(struct ref_counts *ref_counts,
 		return 0;
 	}
 
+	if (counter_ptr == NULL) {
+		return MAXIMUM_REFERENCE_COUNT;
+	}
+
 	if (*counter_ptr == PROVISIONAL_REFERENCE_COUNT) {
 		return (MAXIMUM_REFERENCE_COUNT - 1);
 	}
@@ -367,6 +456,30 @@ uint8_t get_available_references(struct ref_counts *ref_counts,
 	return (MAXIMUM_REFERENCE_COUNT - *counter_ptr);
 }
 
+/**********************************************************************/
+uint8_t get_reference_count(struct ref_counts *ref_counts,
+			    physical_block_number_t pbn)
+{
+	return (MAXIMUM_REFERENCE_COUNT
+		- get_available_references(ref_counts, pbn));
+}
+
+/**
+ * Note that a counter has become free in the free_groups summary.
+ *
+ * @param ref_counts  The ref_counts
+ * @param index       The array index of the counter which is now zero
+ **/
+static inline void mark_free_group(struct ref_counts *ref_counts,
+				   slab_block_number index)
+{
+	__set_bit(index / COUNTS_PER_GROUP, ref_counts->free_groups);
+}
+
+/**********************************************************************/
+static void update_free_group(struct ref_counts *ref_counts,
+			      slab_block_number index);
+
 /**
  * Increment the reference count for a data block.
  *
@@ -400,6 +513,7 @@ static int increment_for_data(struct ref_counts *ref_counts,
 		*counter_ptr = 1;
 		block->allocated_count++;
 		ref_counts->free_blocks--;
+		update_free_group(ref_counts, block_number);
 		*free_status_changed = true;
 		break;
 
@@ -473,6 +587,9 @@ static int decrement_for_data(struct ref_counts *ref_counts,
 			*counter_ptr = EMPTY_REFERENCE_COUNT;
 			block->allocated_count--;
 			ref_counts->free_blocks++;
+			mark_free_group(ref_counts, block_number);
+			__set_bit(block_number / COUNTS_PER_GROUP,
+				  ref_counts->discard_groups);
 			*free_status_changed = true;
 		}
 		break;
@@ -532,6 +649,7 @@ static int increment_for_block_map(struct ref_counts *ref_counts,
 		*counter_ptr = MAXIMUM_REFERENCE_COUNT;
 		block->allocated_count++;
 		ref_counts->free_blocks--;
+		update_free_group(ref_counts, block_number);
 		*free_status_changed = true;
 		return VDO_SUCCESS;
 
@@ -591,10 +709,16 @@ update_reference_count(struct ref_counts *ref_counts,
 		       bool *free_status_changed,
 		       bool *provisional_decrement_ptr)
 {
-	vdo_refcount_t *counter_ptr = &ref_counts->counters[block_number];
-	enum reference_status old_status = reference_count_to_status(*counter_ptr);
+	vdo_refcount_t *counter_ptr;
+	enum reference_status old_status;
 	struct pbn_lock *lock = get_reference_operation_pbn_lock(operation);
-	int result;
+	int result = assert_has_counters(ref_counts);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	counter_ptr = &ref_counts->counters[block_number];
+	old_status = reference_count_to_status(*counter_ptr);
 
 	switch (operation.type) {
 	case DATA_INCREMENT:
@@ -719,6 +843,23 @@ int adjust_reference_count(struct ref_counts *ref_counts,
 	return VDO_SUCCESS;
 }
 
+/**********************************************************************/
+bool withdraw_slab_journal_point(struct ref_counts *ref_counts,
+				 const struct journal_point *point,
+				 const struct journal_point *previous)
+{
+	// Once a reference block has been written with this point as its
+	// commit point, replay would skip any new entry made at it.
+	if (!are_equivalent_vdo_journal_points(&ref_counts->slab_journal_point,
+					       point) ||
+	    !before_vdo_journal_point(&ref_counts->packed_point, point)) {
+		return false;
+	}
+
+	ref_counts->slab_journal_point = *previous;
+	return true;
+}
+
 /**********************************************************************/
 int adjust_reference_count_for_rebuild(struct ref_counts *ref_counts,
 				       physical_block_number_t pbn,
@@ -738,6 +879,11 @@ int adjust_reference_count_for_rebuild(struct ref_counts *ref_counts,
 		return result;
 	}
 
+	result = allocate_reference_counters(ref_counts);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
 	block = get_reference_block(ref_counts, block_number);
 	result = update_reference_count(ref_counts, block, block_number,
 					NULL, physical_operation,
@@ -771,6 +917,11 @@ int replay_reference_count_change(struct ref_counts *ref_counts,
 	}
 
 	// This entry is not yet counted in the reference counts.
+	result = allocate_reference_counters(ref_counts);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
 	result = update_reference_count(ref_counts, block, entry.sbn,
 					entry_point, operation,
 					!NORMAL_OPERATION,
@@ -805,6 +956,16 @@ bool are_equivalent_reference_counters(struct ref_counts *counter_a,
 		}
 	}
 
+	if ((counter_a->counters == NULL) || (counter_b->counters == NULL)) {
+		// A missing array is equivalent to one of all zeros.
+		vdo_refcount_t *counters = ((counter_a->counters == NULL)
+					    ? counter_b->counters
+					    : counter_a->counters);
+		return ((counters == NULL) ||
+			(memchr_inv(counters, EMPTY_REFERENCE_COUNT,
+				    counter_a->block_count) == NULL));
+	}
+
 	return (memcmp(counter_a->counters,
 		       counter_b->counters,
 		       sizeof(vdo_refcount_t) * counter_a->block_count) == 0);
@@ -829,25 +990,40 @@ find_zero_byte_in_word(const byte *word_ptr,
 {
 	uint64_t word = get_unaligned_le64(word_ptr);
 
-	// This looks like a loop, but GCC will unroll the eight iterations for
-	// us.
-	unsigned int offset;
-	for (offset = 0; offset < BYTES_PER_WORD; offset++) {
-		// Assumes little-endian byte order, which we have on X86.
-		if ((word & 0xFF) == 0) {
-			return (start_index + offset);
-		}
-		word >>= 8;
+	/*
+	 * Test all eight bytes at once: subtracting one from each byte borrows
+	 * into the high bit of every zero byte. A borrow may also flag the
+	 * bytes above a zero byte, but never a byte below the first zero
+	 * byte, so the lowest flag is always exact. Since the word was loaded
+	 * little-endian, the lowest flag is at the lowest array index.
+	 */
+	uint64_t zero_flags = ((word - 0x0101010101010101ULL) & ~word &
+			       0x8080808080808080ULL);
+	if (zero_flags == 0) {
+		return fail_index;
 	}
 
-	return fail_index;
+	return (start_index + (__ffs64(zero_flags) / 8));
 }
 
-/**********************************************************************/
-bool find_free_block(const struct ref_counts *ref_counts,
-		     slab_block_number start_index,
-		     slab_block_number end_index,
-		     slab_block_number *index_ptr)
+/**
+ * Scan a range of reference counters a word at a time for a reference count
+ * of zero, without consulting the free_groups summary.
+ *
+ * @param [in]  ref_counts   The reference counters to scan
+ * @param [in]  start_index  The array index at which to start scanning
+ *                           (included in the scan)
+ * @param [in]  end_index    The array index at which to stop scanning
+ *                           (excluded from the scan)
+ * @param [out] index_ptr    A pointer to hold the array index of the free
+ *                           block
+ *
+ * @return true if a free block was found in the specified range
+ **/
+static bool scan_for_free_block(const struct ref_counts *ref_counts,
+				slab_block_number start_index,
+				slab_block_number end_index,
+				slab_block_number *index_ptr)
 {
 	slab_block_number zero_index;
 	slab_block_number next_index = start_index;
@@ -892,6 +1068,81 @@ bool find_free_block(const struct ref_counts *ref_counts,
 	return false;
 }
 
+/**********************************************************************/
+bool find_free_block(const struct ref_counts *ref_counts,
+		     slab_block_number start_index,
+		     slab_block_number end_index,
+		     slab_block_number *index_ptr)
+{
+	slab_block_number group_count =
+		DIV_ROUND_UP(end_index, COUNTS_PER_GROUP);
+	slab_block_number group =
+		find_next_bit(ref_counts->free_groups, group_count,
+			      start_index / COUNTS_PER_GROUP);
+
+	// Only scan the groups which the summary says contain a free block.
+	while (group < group_count) {
+		slab_block_number group_start = group * COUNTS_PER_GROUP;
+		slab_block_number group_end = group_start + COUNTS_PER_GROUP;
+		if (scan_for_free_block(ref_counts,
+					max(start_index, group_start),
+					min(end_index, group_end),
+					index_ptr)) {
+			return true;
+		}
+
+		group = find_next_bit(ref_counts->free_groups, group_count,
+				      group + 1);
+	}
+
+	return false;
+}
+
+/**
+ * Recompute the free_groups bit for the group containing a counter.
+ *
+ * @param ref_counts  The ref_counts
+ * @param index       The array index of a counter in the group to update
+ **/
+static void update_free_group(struct ref_counts *ref_counts,
+			      slab_block_number index)
+{
+	slab_block_number free_index;
+	slab_block_number group = index / COUNTS_PER_GROUP;
+	slab_block_number start = group * COUNTS_PER_GROUP;
+	slab_block_number end = min(start + COUNTS_PER_GROUP,
+				    ref_counts->block_count);
+	if (scan_for_free_block(ref_counts, start, end, &free_index)) {
+		__set_bit(group, ref_counts->free_groups);
+	} else {
+		__clear_bit(group, ref_counts->free_groups);
+	}
+}
+
+/**
+ * Recompute the free_groups bits for all of the groups in a reference block.
+ *
+ * @param block  The reference block whose counters have been replaced
+ **/
+static void update_free_groups_for_block(struct reference_block *block)
+{
+	struct ref_counts *ref_counts = block->ref_counts;
+	slab_block_number start =
+		(block - ref_counts->blocks) * COUNTS_PER_BLOCK;
+	slab_block_number end = min(start + COUNTS_PER_BLOCK,
+				    ref_counts->block_count);
+	slab_block_number index;
+
+	if (ref_counts->counters == NULL) {
+		// Every counter is free, as the summary was made.
+		return;
+	}
+
+	for (index = start; index < end; index += COUNTS_PER_GROUP) {
+		update_free_group(ref_counts, index);
+	}
+}
+
 /**
  * Search the reference block currently saved in the search cursor for a
  * reference count of zero, starting at the saved counter index.
@@ -961,22 +1212,113 @@ static void make_provisional_reference(struct ref_counts *ref_counts,
 	// Account for the allocation.
 	block->allocated_count++;
 	ref_counts->free_blocks--;
+	update_free_group(ref_counts, block_number);
+}
+
+/**
+ * Get the position of a block within its stripe of the backing device.
+ *
+ * @param ref_counts  The ref_counts
+ * @param index       The array index of the block's counter
+ *
+ * @return The offset of the block from the start of its stripe
+ **/
+static slab_block_number get_stripe_offset(const struct ref_counts *ref_counts,
+					   slab_block_number index)
+{
+	return (ref_counts->stripe_phase + index) % ref_counts->stripe_blocks;
+}
+
+/**
+ * Look for an empty stripe of the backing device after the stripe holding a
+ * given block, within the reference block at the search cursor. Only a
+ * bounded number of stripes are examined.
+ *
+ * @param [in]  ref_counts  The ref_counts
+ * @param [in]  index       The array index of the block
+ * @param [out] start_ptr   A pointer to hold the array index of the first
+ *                          block of the empty stripe
+ *
+ * @return <code>true</code> if an empty stripe was found
+ **/
+static bool find_empty_stripe(const struct ref_counts *ref_counts,
+			      slab_block_number index,
+			      slab_block_number *start_ptr)
+{
+	block_count_t stripe_blocks = ref_counts->stripe_blocks;
+	slab_block_number end = ref_counts->search_cursor.end_index;
+	slab_block_number start
+		= index + stripe_blocks - get_stripe_offset(ref_counts, index);
+	unsigned int probes;
+
+	for (probes = 0;
+	     (probes < MAXIMUM_STRIPE_PROBES) && (start + stripe_blocks <= end);
+	     probes++, start += stripe_blocks) {
+		if (memchr_inv(&ref_counts->counters[start],
+			       EMPTY_REFERENCE_COUNT, stripe_blocks) == NULL) {
+			*start_ptr = start;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Choose the block to allocate when the backing device has stripes. A free
+ * block which continues the previous allocation or starts a stripe is taken
+ * as found. Otherwise it is a hole in a stripe which already holds data, and
+ * filling it would make the device read the rest of the stripe back to
+ * update its parity, so an empty stripe nearby is preferred. Skipped holes
+ * are found again once the search cursor wraps.
+ *
+ * @param ref_counts  The ref_counts
+ * @param previous    The array index the search started from
+ * @param free_index  The array index of the free block which was found
+ *
+ * @return The array index of the block to allocate
+ **/
+static slab_block_number choose_stripe_block(struct ref_counts *ref_counts,
+					     slab_block_number previous,
+					     slab_block_number free_index)
+{
+	slab_block_number stripe_start;
+
+	if ((free_index == previous) ||
+	    (get_stripe_offset(ref_counts, free_index) == 0) ||
+	    !find_empty_stripe(ref_counts, free_index, &stripe_start)) {
+		return free_index;
+	}
+
+	return stripe_start;
 }
 
 /**********************************************************************/
 int allocate_unreferenced_block(struct ref_counts *ref_counts,
 				physical_block_number_t *allocated_ptr)
 {
+	slab_block_number previous = ref_counts->search_cursor.index;
 	slab_block_number free_index;
+	int result;
 
 	if (!is_slab_open(ref_counts->slab)) {
 		return VDO_INVALID_ADMIN_STATE;
 	}
 
+	result = assert_has_counters(ref_counts);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
 	if (!search_reference_blocks(ref_counts, &free_index)) {
 		return VDO_NO_SPACE;
 	}
 
+	if (ref_counts->stripe_blocks > 1) {
+		free_index = choose_stripe_block(ref_counts, previous,
+						 free_index);
+	}
+
 	ASSERT_LOG_ONLY((ref_counts->counters[free_index] ==
 			 EMPTY_REFERENCE_COUNT),
 			"free block must have ref count of zero");
@@ -990,6 +1332,73 @@ int allocate_unreferenced_block(struct ref_counts *ref_counts,
 	return VDO_SUCCESS;
 }
 
+/**
+ * Move the search cursor past the blocks following a block allocated to a
+ * sequential stream, if the cursor is near enough to take them first. Free
+ * blocks which the cursor skips are found again once it wraps.
+ *
+ * @param ref_counts  The ref_counts
+ * @param index       The array index of the block allocated to the stream
+ **/
+static void reserve_stream_blocks(struct ref_counts *ref_counts,
+				  slab_block_number index)
+{
+	struct search_cursor *cursor = &ref_counts->search_cursor;
+	slab_block_number reserved_end = index + 1 + STREAM_RESERVATION;
+
+	if ((cursor->block != get_reference_block(ref_counts, index)) ||
+	    (cursor->index >= reserved_end) ||
+	    (cursor->index + STREAM_RESERVATION < index)) {
+		return;
+	}
+
+	cursor->index = min(reserved_end, cursor->end_index);
+}
+
+/**********************************************************************/
+int allocate_unreferenced_stream_block(struct ref_counts *ref_counts,
+				       physical_block_number_t hint,
+				       physical_block_number_t *allocated_ptr)
+{
+	slab_block_number hint_index, end_index, free_index;
+	int result;
+
+	if (!is_slab_open(ref_counts->slab)) {
+		return VDO_INVALID_ADMIN_STATE;
+	}
+
+	result = assert_has_counters(ref_counts);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	if ((hint != VDO_ZERO_BLOCK) &&
+	    (slab_block_number_from_pbn(ref_counts->slab, hint,
+					&hint_index) == VDO_SUCCESS)) {
+		// Stay within the hint's reference block so the stream doesn't
+		// jump far ahead.
+		end_index = ((hint_index / COUNTS_PER_BLOCK) + 1) *
+			COUNTS_PER_BLOCK;
+		end_index = min(end_index, ref_counts->block_count);
+		if (find_free_block(ref_counts, hint_index, end_index,
+				    &free_index)) {
+			make_provisional_reference(ref_counts, free_index);
+			reserve_stream_blocks(ref_counts, free_index);
+			*allocated_ptr = index_to_pbn(ref_counts, free_index);
+			return VDO_SUCCESS;
+		}
+	}
+
+	result = allocate_unreferenced_block(ref_counts, allocated_ptr);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	reserve_stream_blocks(ref_counts,
+			      pbn_to_index(ref_counts, *allocated_ptr));
+	return VDO_SUCCESS;
+}
+
 /**********************************************************************/
 int provisionally_reference_block(struct ref_counts *ref_counts,
 				  physical_block_number_t pbn,
@@ -1008,6 +1417,11 @@ int provisionally_reference_block(struct ref_counts *ref_counts,
 		return result;
 	}
 
+	result = assert_has_counters(ref_counts);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
 	if (ref_counts->counters[block_number] == EMPTY_REFERENCE_COUNT) {
 		make_provisional_reference(ref_counts, block_number);
 		if (lock != NULL) {
@@ -1018,6 +1432,110 @@ int provisionally_reference_block(struct ref_counts *ref_counts,
 	return VDO_SUCCESS;
 }
 
+/**********************************************************************/
+bool reserve_blocks_for_discard(struct ref_counts *ref_counts,
+				block_count_t max_blocks,
+				physical_block_number_t *pbn_ptr,
+				block_count_t *count_ptr)
+{
+	unsigned long group_count =
+		DIV_ROUND_UP(ref_counts->block_count, COUNTS_PER_GROUP);
+	unsigned long group =
+		ref_counts->discard_cursor / COUNTS_PER_GROUP;
+	slab_block_number start, end, index;
+	unsigned long passed;
+
+	if (!is_slab_open(ref_counts->slab)
+	    || (ref_counts->counters == NULL)
+	    || (ref_counts->discarding > 0)) {
+		return false;
+	}
+
+	for (group = find_next_bit(ref_counts->discard_groups, group_count,
+				   group);
+	     group < group_count;
+	     group = find_next_bit(ref_counts->discard_groups, group_count,
+				   group + 1)) {
+		start = max_t(slab_block_number, group * COUNTS_PER_GROUP,
+			      ref_counts->discard_cursor);
+		end = min_t(slab_block_number,
+			    (group + 1) * COUNTS_PER_GROUP,
+			    ref_counts->block_count);
+		while ((start < end) &&
+		       (ref_counts->counters[start] != EMPTY_REFERENCE_COUNT)) {
+			start++;
+		}
+
+		if (start < end) {
+			break;
+		}
+
+		// A group scanned from its start has nothing left to discard.
+		if (ref_counts->discard_cursor <= group * COUNTS_PER_GROUP) {
+			__clear_bit(group, ref_counts->discard_groups);
+		}
+	}
+
+	if (group >= group_count) {
+		// Blocks freed behind the cursor wait for the next pass.
+		ref_counts->discard_cursor = 0;
+		return false;
+	}
+
+	/*
+	 * Extend the range across every following free block, whether or not
+	 * it was freed recently, so that the discard is as large as possible.
+	 * Holding provisional references keeps the blocks from being
+	 * allocated and written until the discard is done.
+	 */
+	end = min_t(slab_block_number, start + max_blocks,
+		    ref_counts->block_count);
+	for (index = start;
+	     (index < end) &&
+	     (ref_counts->counters[index] == EMPTY_REFERENCE_COUNT);
+	     index++) {
+		make_provisional_reference(ref_counts, index);
+	}
+
+	// Forget the groups which the range covered entirely.
+	passed = ((index == ref_counts->block_count)
+		  ? group_count
+		  : (index / COUNTS_PER_GROUP));
+	if (passed > group) {
+		bitmap_clear(ref_counts->discard_groups, group,
+			     passed - group);
+	}
+
+	ref_counts->discard_cursor = index;
+	ref_counts->discarding = index - start;
+	*pbn_ptr = index_to_pbn(ref_counts, start);
+	*count_ptr = index - start;
+	return true;
+}
+
+/**********************************************************************/
+void release_discarded_blocks(struct ref_counts *ref_counts,
+			      physical_block_number_t pbn)
+{
+	slab_block_number start = pbn_to_index(ref_counts, pbn);
+	slab_block_number index;
+
+	for (index = start; index < start + ref_counts->discarding; index++) {
+		struct reference_block *block =
+			get_reference_block(ref_counts, index);
+
+		ASSERT_LOG_ONLY((ref_counts->counters[index] ==
+				 PROVISIONAL_REFERENCE_COUNT),
+				"discarded block must still be provisional");
+		ref_counts->counters[index] = EMPTY_REFERENCE_COUNT;
+		block->allocated_count--;
+		ref_counts->free_blocks++;
+		mark_free_group(ref_counts, index);
+	}
+
+	ref_counts->discarding = 0;
+}
+
 /**********************************************************************/
 block_count_t count_unreferenced_blocks(struct ref_counts *ref_counts,
 					physical_block_number_t start_pbn,
@@ -1027,6 +1545,11 @@ block_count_t count_unreferenced_blocks(struct ref_counts *ref_counts,
 	slab_block_number start_index = pbn_to_index(ref_counts, start_pbn);
 	slab_block_number end_index = pbn_to_index(ref_counts, end_pbn);
 	slab_block_number index;
+
+	if (ref_counts->counters == NULL) {
+		return (end_index - start_index);
+	}
+
 	for (index = start_index; index < end_index; index++) {
 		if (ref_counts->counters[index] == EMPTY_REFERENCE_COUNT) {
 			free_blocks++;
@@ -1066,13 +1589,22 @@ static void clear_dirty_reference_blocks(struct waiter *block_waiter,
 void reset_reference_counts(struct ref_counts *ref_counts)
 {
 	size_t i;
-	memset(ref_counts->counters, 0,
-	       ref_counts->block_count * sizeof(vdo_refcount_t));
+	if (ref_counts->counters != NULL) {
+		memset(ref_counts->counters, 0,
+		       ref_counts->block_count * sizeof(vdo_refcount_t));
+	}
+
+	bitmap_set(ref_counts->free_groups, 0,
+		   DIV_ROUND_UP(ref_counts->block_count, COUNTS_PER_GROUP));
+	bitmap_zero(ref_counts->discard_groups,
+		    DIV_ROUND_UP(ref_counts->block_count, COUNTS_PER_GROUP));
+	ref_counts->discard_cursor = 0;
 	ref_counts->free_blocks = ref_counts->block_count;
 	ref_counts->slab_journal_point = (struct journal_point) {
 		.sequence_number = 0,
 		.entry_count = 0,
 	};
+	ref_counts->packed_point = ref_counts->slab_journal_point;
 
 	for (i = 0; i < ref_counts->reference_block_count; i++) {
 		ref_counts->blocks[i].allocated_count = 0;
@@ -1202,12 +1734,17 @@ static void finish_reference_block_write(struct vdo_completion *completion)
  *
  * @param block  The reference_block in question
  *
- * @return A pointer to the reference counters for this block
+ * @return A pointer to the reference counters for this block, or NULL if the
+ *         ref_counts has no counter array
  **/
 static vdo_refcount_t * __must_check
 get_reference_counters_for_block(struct reference_block *block)
 {
 	size_t block_index = block - block->ref_counts->blocks;
+	if (block->ref_counts->counters == NULL) {
+		return NULL;
+	}
+
 	return &block->ref_counts->counters[block_index * COUNTS_PER_BLOCK];
 }
 
@@ -1226,9 +1763,17 @@ pack_reference_block(struct reference_block *block, void *buffer)
 	struct packed_journal_point commit_point;
 	pack_vdo_journal_point(&block->ref_counts->slab_journal_point,
 			       &commit_point);
+	block->ref_counts->packed_point = block->ref_counts->slab_journal_point;
 
 	for (i = 0; i < VDO_SECTORS_PER_BLOCK; i++) {
 		packed->sectors[i].commit_point = commit_point;
+		if (counters == NULL) {
+			memset(packed->sectors[i].counts,
+			       EMPTY_REFERENCE_COUNT,
+			       (sizeof(vdo_refcount_t) * COUNTS_PER_SECTOR));
+			continue;
+		}
+
 		memcpy(packed->sectors[i].counts,
 		       counters + (i * COUNTS_PER_SECTOR),
 		       (sizeof(vdo_refcount_t) * COUNTS_PER_SECTOR));
@@ -1318,6 +1863,40 @@ void save_oldest_reference_block(struct ref_counts *ref_counts)
 			   ref_counts);
 }
 
+/**
+ * Launch the writes of all the dirty blocks which have been removed from the
+ * dirty queue, in block order. Since a slab's reference blocks are
+ * contiguous, issuing the writes in order lets the I/O submitter combine runs
+ * of adjacent blocks into single bios.
+ *
+ * @param ref_counts  The ref_counts whose blocks are to be written
+ **/
+static void launch_dequeued_block_writes(struct ref_counts *ref_counts)
+{
+	block_count_t i;
+	for (i = 0; i < ref_counts->reference_block_count; i++) {
+		struct reference_block *block = &ref_counts->blocks[i];
+		// Any other dirty block which is not writing is still queued.
+		if (block->is_dirty && !block->is_writing &&
+		    !is_waiting(&block->waiter)) {
+			launch_reference_block_write(&block->waiter,
+						     ref_counts);
+		}
+	}
+}
+
+/**
+ * A waiter callback which does nothing, for removing dirty blocks from the
+ * dirty queue before launching their writes in block order.
+ *
+ * @param block_waiter  The dirty block's waiter
+ * @param context       Unused
+ **/
+static void dequeue_dirty_block(struct waiter *block_waiter __always_unused,
+				void *context __always_unused)
+{
+}
+
 /**********************************************************************/
 void save_several_reference_blocks(struct ref_counts *ref_counts,
 				   size_t flush_divisor)
@@ -1335,17 +1914,23 @@ void save_several_reference_blocks(struct ref_counts *ref_counts,
 		blocks_to_write = 1;
 	}
 
+	// Choose the oldest blocks, but write them in block order.
 	for (written = 0; written < blocks_to_write; written++) {
-		save_oldest_reference_block(ref_counts);
+		notify_next_waiter(&ref_counts->dirty_blocks,
+				   dequeue_dirty_block,
+				   NULL);
 	}
+
+	launch_dequeued_block_writes(ref_counts);
 }
 
 /**********************************************************************/
 void save_dirty_reference_blocks(struct ref_counts *ref_counts)
 {
 	notify_all_waiters(&ref_counts->dirty_blocks,
-			   launch_reference_block_write,
-			   ref_counts);
+			   dequeue_dirty_block,
+			   NULL);
+	launch_dequeued_block_writes(ref_counts);
 	check_if_slab_drained(ref_counts->slab);
 }
 
@@ -1367,6 +1952,10 @@ static void clear_provisional_references(struct reference_block *block)
 {
 	vdo_refcount_t *counters = get_reference_counters_for_block(block);
 	block_count_t j;
+	if (counters == NULL) {
+		return;
+	}
+
 	for (j = 0; j < COUNTS_PER_BLOCK; j++) {
 		if (counters[j] == PROVISIONAL_REFERENCE_COUNT) {
 			counters[j] = EMPTY_REFERENCE_COUNT;
@@ -1376,25 +1965,63 @@ static void clear_provisional_references(struct reference_block *block)
 }
 
 /**
- * Unpack reference counts blocks into the internal memory structure.
+ * Check whether a packed reference block has any non-zero counts.
+ *
+ * @param packed  The packed reference block
+ *
+ * @return <code>true</code> if every count in the block is zero
+ **/
+static bool is_packed_block_empty(struct packed_reference_block *packed)
+{
+	sector_count_t i;
+	for (i = 0; i < VDO_SECTORS_PER_BLOCK; i++) {
+		if (memchr_inv(packed->sectors[i].counts,
+			       EMPTY_REFERENCE_COUNT,
+			       (sizeof(vdo_refcount_t) * COUNTS_PER_SECTOR))
+		    != NULL) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Unpack reference counts blocks into the internal memory structure. The
+ * counter array is only allocated once a block with non-zero counts is
+ * loaded.
  *
  * @param packed  The written reference block to be unpacked
  * @param block   The internal reference block to be loaded
+ *
+ * @return VDO_SUCCESS or an error
  **/
-static void unpack_reference_block(struct packed_reference_block *packed,
-				   struct reference_block *block)
+static int __must_check
+unpack_reference_block(struct packed_reference_block *packed,
+		       struct reference_block *block)
 {
 	block_count_t index;
 	sector_count_t i;
 	struct ref_counts *ref_counts = block->ref_counts;
-	vdo_refcount_t *counters = get_reference_counters_for_block(block);
+	vdo_refcount_t *counters;
+
+	if ((ref_counts->counters != NULL) || !is_packed_block_empty(packed)) {
+		int result = allocate_reference_counters(ref_counts);
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
+	}
+
+	counters = get_reference_counters_for_block(block);
 	for (i = 0; i < VDO_SECTORS_PER_BLOCK; i++) {
 		struct packed_reference_sector *sector = &packed->sectors[i];
 		unpack_vdo_journal_point(&sector->commit_point,
 					 &block->commit_points[i]);
-		memcpy(counters + (i * COUNTS_PER_SECTOR),
-		       sector->counts,
-		       (sizeof(vdo_refcount_t) * COUNTS_PER_SECTOR));
+		if (counters != NULL) {
+			memcpy(counters + (i * COUNTS_PER_SECTOR),
+			       sector->counts,
+			       (sizeof(vdo_refcount_t) * COUNTS_PER_SECTOR));
+		}
 		// The slab_journal_point must be the latest point found in any
 		// sector.
 		if (before_vdo_journal_point(&ref_counts->slab_journal_point,
@@ -1415,11 +2042,17 @@ static void unpack_reference_block(struct packed_reference_block *packed,
 	}
 
 	block->allocated_count = 0;
+	if (counters == NULL) {
+		return VDO_SUCCESS;
+	}
+
 	for (index = 0; index < COUNTS_PER_BLOCK; index++) {
 		if (counters[index] != EMPTY_REFERENCE_COUNT) {
 			block->allocated_count++;
 		}
 	}
+
+	return VDO_SUCCESS;
 }
 
 /**
@@ -1432,12 +2065,20 @@ static void finish_reference_block_load(struct vdo_completion *completion)
 	struct vio_pool_entry *entry = completion->parent;
 	struct reference_block *block = entry->parent;
 	struct ref_counts *ref_counts = block->ref_counts;
-	unpack_reference_block((struct packed_reference_block *)entry->buffer,
-			       block);
+	int result =
+		unpack_reference_block((struct packed_reference_block *)
+				       entry->buffer,
+				       block);
 
 	return_vdo_block_allocator_vio(ref_counts->slab->allocator, entry);
 	ref_counts->active_count--;
+	if (result != VDO_SUCCESS) {
+		enter_ref_counts_read_only_mode(ref_counts, result);
+		return;
+	}
+
 	clear_provisional_references(block);
+	update_free_groups_for_block(block);
 
 	ref_counts->free_blocks -= block->allocated_count;
 	check_if_slab_drained(block->ref_counts->slab);
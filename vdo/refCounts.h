@@ -57,6 +57,29 @@ int __must_check make_ref_counts(block_count_t block_count,
  **/
 void free_ref_counts(struct ref_counts **ref_counts_ptr);
 
+/**
+ * Check whether a ref_counts has a counter array, so that referencing a block
+ * in it will not need to allocate one.
+ *
+ * @param ref_counts  The ref_counts to check
+ *
+ * @return <code>true</code> if the counter array is allocated
+ **/
+bool __must_check has_reference_counters(const struct ref_counts *ref_counts);
+
+/**
+ * Allocate the counter array of a ref_counts if it does not have one yet.
+ * Until then, every counter is implicitly zero, so a slab which has never had
+ * a block referenced costs no counter memory. This is done when a slab is
+ * loaded, recovered or opened for allocation, so that no reference count
+ * change made on the write path has to allocate.
+ *
+ * @param ref_counts  The ref_counts
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check allocate_reference_counters(struct ref_counts *ref_counts);
+
 /**
  * Check whether a ref_counts is active.
  *
@@ -95,6 +118,18 @@ uint8_t __must_check
 get_available_references(struct ref_counts *ref_counts,
 			 physical_block_number_t pbn);
 
+/**
+ * Get the number of references to a block. A provisional reference counts
+ * as one.
+ *
+ * @param ref_counts  The ref_counts object
+ * @param pbn         The physical block number
+ *
+ * @return The reference count of the block
+ **/
+uint8_t __must_check get_reference_count(struct ref_counts *ref_counts,
+					 physical_block_number_t pbn);
+
 /**
  * Adjust the reference count of a block.
  *
@@ -117,6 +152,22 @@ adjust_reference_count(struct ref_counts *ref_counts,
 		       const struct journal_point *slab_journal_point,
 		       bool *free_status_changed);
 
+/**
+ * Withdraw the slab journal point of the latest reference count adjustment so
+ * that the slab journal may give that point to its next entry. This is only
+ * possible if no reference block has been written since the adjustment.
+ *
+ * @param ref_counts  The refcounts object
+ * @param point       The point of the latest adjustment
+ * @param previous    The point of the adjustment before it
+ *
+ * @return <code>true</code> if the point was withdrawn
+ **/
+bool __must_check
+withdraw_slab_journal_point(struct ref_counts *ref_counts,
+			    const struct journal_point *point,
+			    const struct journal_point *previous);
+
 /**
  * Adjust the reference count of a block during rebuild.
  *
@@ -178,6 +229,29 @@ int __must_check
 allocate_unreferenced_block(struct ref_counts *ref_counts,
 			    physical_block_number_t *allocated_ptr);
 
+/**
+ * Allocate a block for a sequential write stream. If the stream has a hint,
+ * the first free block at or after the hint in the hint's reference block is
+ * allocated. Otherwise, or if there is no such block, a block is allocated
+ * as by allocate_unreferenced_block(). Either way, the search cursor is moved
+ * past the blocks just after the allocated one so that the stream can use
+ * them for its following writes.
+ *
+ * @param [in]  ref_counts     The reference counters to scan
+ * @param [in]  hint           The block the stream would like next, or
+ *                             VDO_ZERO_BLOCK if it has no preference
+ * @param [out] allocated_ptr  A pointer to hold the physical block number of
+ *                             the block that was found and allocated
+ *
+ * @return VDO_SUCCESS if a free block was found and allocated;
+ *         VDO_NO_SPACE if there are no unreferenced blocks;
+ *         otherwise an error code
+ **/
+int __must_check
+allocate_unreferenced_stream_block(struct ref_counts *ref_counts,
+				   physical_block_number_t hint,
+				   physical_block_number_t *allocated_ptr);
+
 /**
  * Provisionally reference a block if it is unreferenced.
  *
@@ -192,6 +266,35 @@ provisionally_reference_block(struct ref_counts *ref_counts,
 			      physical_block_number_t pbn,
 			      struct pbn_lock *lock);
 
+/**
+ * Find the next run of free blocks which includes a block freed since it was
+ * last discarded, and provisionally reference the run so that it can not be
+ * allocated while it is being discarded. Only one run may be reserved at a
+ * time.
+ *
+ * @param [in]  ref_counts  The reference counters
+ * @param [in]  max_blocks  The largest run to reserve
+ * @param [out] pbn_ptr     A pointer to hold the first block of the run
+ * @param [out] count_ptr   A pointer to hold the length of the run
+ *
+ * @return <code>true</code> if a run was reserved
+ **/
+bool __must_check reserve_blocks_for_discard(struct ref_counts *ref_counts,
+					     block_count_t max_blocks,
+					     physical_block_number_t *pbn_ptr,
+					     block_count_t *count_ptr);
+
+/**
+ * Release the provisional references on a run of blocks reserved by
+ * reserve_blocks_for_discard() once the discard is done, making the blocks
+ * free again.
+ *
+ * @param ref_counts  The reference counters
+ * @param pbn         The first block of the run
+ **/
+void release_discarded_blocks(struct ref_counts *ref_counts,
+			      physical_block_number_t pbn);
+
 /**
  * Count all unreferenced blocks in a range [start_block, end_block) of
  * physical block numbers.
@@ -107,16 +107,43 @@ struct ref_counts {
 	uint32_t free_blocks;
 	/** The array of reference counts */
 	vdo_refcount_t *counters; // use ALLOCATE to align data ptr
+	/**
+	 * A bit per group of COUNTS_PER_GROUP counters which is set if the
+	 * group contains a free block; together with the allocated_count of
+	 * each reference block, this lets searches skip over full regions
+	 */
+	unsigned long *free_groups;
+	/**
+	 * A bit per group of COUNTS_PER_GROUP counters which is set if a
+	 * block in the group has been freed since the group was last
+	 * discarded
+	 */
+	unsigned long *discard_groups;
 
 	/**
 	 * The saved block pointer and array indexes for the free block search
 	 */
 	struct search_cursor search_cursor;
 
+	/**
+	 * The stripe width of the backing device in blocks, or 0 or 1 if
+	 * allocation need not fill stripes
+	 */
+	block_count_t stripe_blocks;
+	/** The position in its stripe of the block counted by counters[0] */
+	slab_block_number stripe_phase;
+
 	/** A list of the dirty blocks waiting to be written out */
 	struct wait_queue dirty_blocks;
 	/** The number of blocks which are currently writing */
 	size_t active_count;
+	/**
+	 * The number of free blocks which have been provisionally referenced
+	 * while they are discarded
+	 */
+	block_count_t discarding;
+	/** The counter at which to continue looking for blocks to discard */
+	slab_block_number discard_cursor;
 
 	/** A waiter object for updating the slab summary */
 	struct waiter slab_summary_waiter;
@@ -136,6 +163,11 @@ struct ref_counts {
 	 * The latest slab journal entry this ref_counts has been updated with
 	 */
 	struct journal_point slab_journal_point;
+	/**
+	 * The slab journal point most recently written out as the commit point
+	 * of a reference block
+	 */
+	struct journal_point packed_point;
 
 	/** The number of reference count blocks */
 	uint32_t reference_block_count;
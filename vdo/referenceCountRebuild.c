@@ -37,17 +37,19 @@
 #include "vdoPageCache.h"
 
 /**
- * A reference count rebuild completion.
- * Note that the page completions kept in this structure are not immediately
- * freed, so the corresponding pages will be locked down in the page cache
- * until the rebuild frees them.
+ * A reference count rebuild completion. The interior tree pages are traversed
+ * from logical zone 0, and then the leaf pages are divided among the logical
+ * zones, each of which reads its pages through its own page cache on its own
+ * thread. The reference count increments for each leaf page are then applied
+ * by the rebuild's own thread, so that the slabs are only ever modified from
+ * one thread.
  **/
 struct rebuild_completion {
 	/** completion header */
 	struct vdo_completion completion;
 	/** the completion for flushing the block map */
 	struct vdo_completion sub_task_completion;
-	/** the thread on which all block map operations must be done */
+	/** the thread on which the reference counts are adjusted */
 	thread_id_t logical_thread_id;
 	/** the admin thread */
 	thread_id_t admin_thread_id;
@@ -55,26 +57,68 @@ struct rebuild_completion {
 	struct block_map *block_map;
 	/** the slab depot */
 	struct slab_depot *depot;
-	/** whether this recovery has been aborted */
-	bool aborted;
-	/** whether we are currently launching the initial round of requests */
-	bool launching;
 	/** The number of logical blocks observed used */
 	block_count_t *logical_blocks_used;
 	/** The number of block map data blocks */
 	block_count_t *block_map_data_blocks;
-	/** the next page to fetch */
-	page_count_t page_to_fetch;
 	/** the number of leaf pages in the block map */
 	page_count_t leaf_pages;
 	/** the last slot of the block map */
 	struct block_map_slot last_slot;
-	/** number of pending (non-ready) requests*/
+	/** the number of zone rebuilds which have not yet finished */
+	zone_count_t zones_remaining;
+	/** the zone whose page cache is being invalidated */
+	zone_count_t invalidating_zone;
+	/** the number of zone rebuilds */
+	zone_count_t zone_count;
+	/** the rebuilds of the leaf pages of the individual logical zones */
+	struct rebuild_zone *zones[];
+};
+
+/**
+ * A leaf page being read by a zone rebuild. The page is held in the zone's
+ * page cache while its reference count increments are applied.
+ **/
+struct rebuild_page {
+	/** the completion for fetching and holding the page */
+	struct vdo_page_completion page_completion;
+	/** the completion for applying the page's reference count increments */
+	struct vdo_completion count_completion;
+	/** the zone rebuild reading the page */
+	struct rebuild_zone *zone;
+	/** the page, once it has been loaded */
+	struct block_map_page *page;
+	/** whether any entry of the page has been changed */
+	bool needs_write;
+};
+
+/**
+ * The rebuild of the leaf pages assigned to one logical zone.
+ * Note that the page completions kept in this structure are not immediately
+ * freed, so the corresponding pages will be locked down in the page cache
+ * until the rebuild frees them.
+ **/
+struct rebuild_zone {
+	/** completion header */
+	struct vdo_completion completion;
+	/** the rebuild of which this is a part */
+	struct rebuild_completion *rebuild;
+	/** the thread on which all of this zone's page operations are done */
+	thread_id_t thread_id;
+	/** the page cache of the zone */
+	struct vdo_page_cache *page_cache;
+	/** whether this zone's rebuild has been aborted */
+	bool aborted;
+	/** whether we are currently launching the initial round of requests */
+	bool launching;
+	/** the next page to fetch */
+	page_count_t page_to_fetch;
+	/** number of pages requested and not yet released */
 	page_count_t outstanding;
-	/** number of page completions */
+	/** number of leaf pages which may be in progress at once */
 	page_count_t page_count;
-	/** array of requested, potentially ready page completions */
-	struct vdo_page_completion page_completions[];
+	/** array of leaf pages in progress */
+	struct rebuild_page pages[];
 };
 
 /**
@@ -93,19 +137,57 @@ as_rebuild_completion(struct vdo_completion *completion)
 }
 
 /**
- * Free a rebuild_completion and null out the reference to it.
+ * Convert a vdo_completion to a rebuild_zone.
+ *
+ * @param completion  The completion to convert
+ *
+ * @return The completion as a rebuild_zone
+ **/
+static inline struct rebuild_zone * __must_check
+as_rebuild_zone(struct vdo_completion *completion)
+{
+	assert_vdo_completion_type(completion->type,
+				   REFERENCE_COUNT_REBUILD_ZONE_COMPLETION);
+	return container_of(completion, struct rebuild_zone, completion);
+}
+
+/**
+ * Convert a vdo_completion to a rebuild_page.
+ *
+ * @param completion  The page completion of the rebuild_page
+ *
+ * @return The rebuild_page
+ **/
+static inline struct rebuild_page * __must_check
+as_rebuild_page(struct vdo_completion *completion)
+{
+	return container_of(container_of(completion,
+					 struct vdo_page_completion,
+					 completion),
+			    struct rebuild_page,
+			    page_completion);
+}
+
+/**
+ * Free a rebuild_completion and its zone rebuilds, and null out the reference
+ * to it.
  *
  * @param completion_ptr  a pointer to the completion to free
  **/
 static void free_rebuild_completion(struct vdo_completion **completion_ptr)
 {
 	struct rebuild_completion *rebuild;
+	zone_count_t zone;
 	struct vdo_completion *completion = *completion_ptr;
 	if (completion == NULL) {
 		return;
 	}
 
 	rebuild = as_rebuild_completion(completion);
+	for (zone = 0; zone < rebuild->zone_count; zone++) {
+		FREE(rebuild->zones[zone]);
+	}
+
 	FREE(rebuild);
 	*completion_ptr = NULL;
 }
@@ -124,6 +206,50 @@ static void finish_rebuild(struct vdo_completion *completion)
 	finish_vdo_completion(parent, result);
 }
 
+/**
+ * Make the rebuild of the leaf pages for one logical zone.
+ *
+ * @param [in]  rebuild   The rebuild completion
+ * @param [in]  vdo       The vdo
+ * @param [in]  zone      The zone whose pages are to be rebuilt
+ * @param [out] zone_ptr  The new zone rebuild
+ *
+ * @return a success or error code
+ **/
+static int make_rebuild_zone(struct rebuild_completion *rebuild,
+			     struct vdo *vdo,
+			     struct block_map_zone *zone,
+			     struct rebuild_zone **zone_ptr)
+{
+	page_count_t i;
+	struct rebuild_zone *rebuild_zone;
+	page_count_t page_count =
+		min(get_vdo_page_cache_size(zone->page_cache) >> 1,
+		    (page_count_t) MAXIMUM_SIMULTANEOUS_VDO_BLOCK_MAP_RESTORATION_READS);
+	int result = ALLOCATE_EXTENDED(struct rebuild_zone, page_count,
+				       struct rebuild_page, __func__,
+				       &rebuild_zone);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	initialize_vdo_completion(&rebuild_zone->completion, vdo,
+				  REFERENCE_COUNT_REBUILD_ZONE_COMPLETION);
+	rebuild_zone->rebuild = rebuild;
+	rebuild_zone->thread_id = zone->thread_id;
+	rebuild_zone->page_cache = zone->page_cache;
+	rebuild_zone->page_count = page_count;
+	for (i = 0; i < page_count; i++) {
+		struct rebuild_page *page = &rebuild_zone->pages[i];
+		page->zone = rebuild_zone;
+		initialize_vdo_completion(&page->count_completion, vdo,
+					  SUB_TASK_COMPLETION);
+	}
+
+	*zone_ptr = rebuild_zone;
+	return VDO_SUCCESS;
+}
+
 /**
  * Make a new rebuild completion.
  *
@@ -144,13 +270,12 @@ static int make_rebuild_completion(struct vdo *vdo,
 {
 	const struct thread_config *thread_config = get_thread_config(vdo);
 	struct block_map *block_map = get_block_map(vdo);
-	page_count_t page_count =
-		min(get_configured_cache_size(vdo) >> 1,
-		    (page_count_t) MAXIMUM_SIMULTANEOUS_VDO_BLOCK_MAP_RESTORATION_READS);
+	zone_count_t zone;
 
 	struct rebuild_completion *rebuild;
-	int result = ALLOCATE_EXTENDED(struct rebuild_completion, page_count,
-				       struct vdo_page_completion, __func__,
+	int result = ALLOCATE_EXTENDED(struct rebuild_completion,
+				       block_map->zone_count,
+				       struct rebuild_zone *, __func__,
 				       &rebuild);
 	if (result != UDS_SUCCESS) {
 		return result;
@@ -160,17 +285,23 @@ static int make_rebuild_completion(struct vdo *vdo,
 				  REFERENCE_COUNT_REBUILD_COMPLETION);
 	initialize_vdo_completion(&rebuild->sub_task_completion, vdo,
 				  SUB_TASK_COMPLETION);
-	if (result != VDO_SUCCESS) {
-		struct vdo_completion *completion = &rebuild->completion;
-		free_rebuild_completion(&completion);
-		return result;
+	rebuild->zone_count = block_map->zone_count;
+	for (zone = 0; zone < rebuild->zone_count; zone++) {
+		result = make_rebuild_zone(rebuild, vdo,
+					   &block_map->zones[zone],
+					   &rebuild->zones[zone]);
+		if (result != VDO_SUCCESS) {
+			struct vdo_completion *completion =
+				&rebuild->completion;
+			free_rebuild_completion(&completion);
+			return result;
+		}
 	}
 
 	rebuild->block_map = block_map;
 	rebuild->depot = vdo->depot;
 	rebuild->logical_blocks_used = logical_blocks_used;
 	rebuild->block_map_data_blocks = block_map_data_blocks;
-	rebuild->page_count = page_count;
 	rebuild->leaf_pages =
 		compute_block_map_page_count(block_map->entry_count);
 
@@ -190,41 +321,72 @@ static int make_rebuild_completion(struct vdo *vdo,
 	return VDO_SUCCESS;
 }
 
+/**
+ * Drop the pages cached by the rebuild once the block map has been flushed,
+ * since a zone may hold pages of trees it does not own. This callback is
+ * registered in flush_block_map_updates(), and then re-registers itself for
+ * each subsequent zone.
+ *
+ * @param completion  The sub-task completion
+ **/
+static void invalidate_page_caches(struct vdo_completion *completion)
+{
+	struct rebuild_completion *rebuild =
+		as_rebuild_completion(completion->parent);
+	struct rebuild_zone *zone =
+		rebuild->zones[rebuild->invalidating_zone++];
+	int result = invalidate_vdo_page_cache(zone->page_cache);
+	if ((result != VDO_SUCCESS) ||
+	    (rebuild->invalidating_zone == rebuild->zone_count)) {
+		finish_vdo_completion(&rebuild->completion, result);
+		return;
+	}
+
+	zone = rebuild->zones[rebuild->invalidating_zone];
+	launch_vdo_completion_callback(completion, invalidate_page_caches,
+				       zone->thread_id);
+}
+
 /**
  * Flush the block map now that all the reference counts are rebuilt. This
- * callback is registered in finish_if_done().
+ * callback is registered in finish_rebuild_zone().
  *
  * @param completion  The sub-task completion
  **/
 static void flush_block_map_updates(struct vdo_completion *completion)
 {
+	struct rebuild_completion *rebuild =
+		as_rebuild_completion(completion->parent);
 	log_info("Flushing block map changes");
-	prepare_vdo_completion_to_finish_parent(completion, completion->parent);
-	drain_block_map(as_rebuild_completion(completion->parent)->block_map,
-			ADMIN_STATE_RECOVERING, completion);
+	rebuild->invalidating_zone = 0;
+	prepare_vdo_completion(completion, invalidate_page_caches,
+			       finish_vdo_completion_parent_callback,
+			       rebuild->zones[0]->thread_id,
+			       completion->parent);
+	drain_block_map(rebuild->block_map, ADMIN_STATE_RECOVERING,
+			completion);
 }
 
 /**
- * Check whether the rebuild is done. If it succeeded, continue by flushing the
- * block map.
+ * Note that a zone has finished rebuilding from its leaf pages. Once all
+ * zones have finished, flush the block map if they all succeeded, or finish
+ * the rebuild if any of them didn't. This callback is registered in
+ * launch_rebuild_zone().
  *
- * @param rebuild  The rebuild completion
- *
- * @return <code>true</code> if the rebuild is complete
+ * @param completion  The rebuild_zone which has finished
  **/
-static bool finish_if_done(struct rebuild_completion *rebuild)
+static void finish_rebuild_zone(struct vdo_completion *completion)
 {
-	if (rebuild->launching || (rebuild->outstanding > 0)) {
-		return false;
+	struct rebuild_completion *rebuild =
+		as_rebuild_completion(completion->parent);
+	set_vdo_completion_result(&rebuild->completion, completion->result);
+	if (--rebuild->zones_remaining > 0) {
+		return;
 	}
 
-	if (rebuild->aborted) {
+	if (rebuild->completion.result != VDO_SUCCESS) {
 		complete_vdo_completion(&rebuild->completion);
-		return true;
-	}
-
-	if (rebuild->page_to_fetch < rebuild->leaf_pages) {
-		return false;
+		return;
 	}
 
 	prepare_vdo_completion(&rebuild->sub_task_completion,
@@ -233,129 +395,188 @@ static bool finish_if_done(struct rebuild_completion *rebuild)
 			       rebuild->admin_thread_id,
 			       &rebuild->completion);
 	invoke_vdo_completion_callback(&rebuild->sub_task_completion);
+}
+
+/**
+ * Check whether a zone's rebuild is done. If so, report to the rebuild.
+ *
+ * @param zone  The zone rebuild
+ *
+ * @return <code>true</code> if the zone's rebuild is complete
+ **/
+static bool finish_if_done(struct rebuild_zone *zone)
+{
+	if (zone->launching || (zone->outstanding > 0)) {
+		return false;
+	}
+
+	if (!zone->aborted &&
+	    (zone->page_to_fetch < zone->rebuild->leaf_pages)) {
+		return false;
+	}
+
+	complete_vdo_completion(&zone->completion);
 	return true;
 }
 
 /**
- * Record that there has been an error during the rebuild.
+ * Record that there has been an error during a zone's rebuild.
  *
- * @param rebuild  The rebuild completion
- * @param result   The error result to use, if one is not already saved
+ * @param zone    The zone rebuild
+ * @param result  The error result to use, if one is not already saved
  **/
-static void abort_rebuild(struct rebuild_completion *rebuild, int result)
+static void abort_rebuild_zone(struct rebuild_zone *zone, int result)
 {
-	rebuild->aborted = true;
-	set_vdo_completion_result(&rebuild->completion, result);
+	zone->aborted = true;
+	set_vdo_completion_result(&zone->completion, result);
 }
 
+/**********************************************************************/
+static void fetch_page(struct rebuild_zone *zone, struct rebuild_page *page);
+
 /**
- * Handle an error loading a page.
+ * Release a leaf page which is done, and fetch the next one.
  *
- * @param completion  The vdo_page_completion
+ * @param zone  The zone rebuild
+ * @param page  The page which is done
  **/
-static void handle_page_load_error(struct vdo_completion *completion)
+static void release_page(struct rebuild_zone *zone, struct rebuild_page *page)
 {
-	struct rebuild_completion *rebuild =
-		as_rebuild_completion(completion->parent);
-	rebuild->outstanding--;
-	abort_rebuild(rebuild, completion->result);
+	struct vdo_completion *completion = &page->page_completion.completion;
+	if (page->needs_write) {
+		request_vdo_page_write(completion);
+	}
+
 	release_vdo_page_completion(completion);
-	finish_if_done(rebuild);
+	zone->outstanding--;
+	if (finish_if_done(zone)) {
+		return;
+	}
+
+	// Advance progress to the next page, and fetch the next page we
+	// haven't yet requested.
+	fetch_page(zone, page);
 }
 
 /**
- * Rebuild reference counts from a block map page.
+ * Release a leaf page once its reference count increments have been applied.
+ * This callback is registered in count_page_references().
  *
- * @param rebuild     The rebuild completion
- * @param completion  The page completion holding the page
+ * @param completion  The count completion of the page
+ **/
+static void finish_page(struct vdo_completion *completion)
+{
+	struct rebuild_page *page =
+		container_of(completion, struct rebuild_page, count_completion);
+	release_page(page->zone, page);
+}
+
+/**
+ * Apply the reference count increments for the mappings on a leaf page. This
+ * is done on the rebuild's thread while the zone reading the page holds it.
+ * This callback is registered in page_loaded().
  *
- * @return VDO_SUCCESS or an error
+ * @param completion  The count completion of the page
  **/
-static int
-rebuild_reference_counts_from_page(struct rebuild_completion *rebuild,
-				   struct vdo_completion *completion)
+static void count_page_references(struct vdo_completion *completion)
 {
 	slot_number_t slot;
-	struct block_map_page *page = dereference_writable_vdo_page(completion);
-	int result = ASSERT(page != NULL, "page available");
-	if (result != VDO_SUCCESS) {
-		return result;
-	}
+	struct rebuild_page *page =
+		container_of(completion, struct rebuild_page, count_completion);
+	struct rebuild_zone *zone = page->zone;
+	struct rebuild_completion *rebuild = zone->rebuild;
+
+	for (slot = 0; slot < VDO_BLOCK_MAP_ENTRIES_PER_PAGE; slot++) {
+		struct vdo_slab *slab;
+		int result;
+		struct data_location mapping =
+			unpack_block_map_entry(&page->page->entries[slot]);
+		if (!is_mapped_location(&mapping)) {
+			continue;
+		}
 
-	if (!is_block_map_page_initialized(page)) {
-		return VDO_SUCCESS;
+		(*rebuild->logical_blocks_used)++;
+		if (mapping.pbn == VDO_ZERO_BLOCK) {
+			continue;
+		}
+
+		slab = get_slab(rebuild->depot, mapping.pbn);
+		result = adjust_reference_count_for_rebuild(
+			slab->reference_counts, mapping.pbn, DATA_INCREMENT);
+		if (result != VDO_SUCCESS) {
+			log_error_strerror(result,
+					   "Could not adjust reference count for PBN %llu, slot %u mapped to PBN %llu",
+					   get_block_map_page_pbn(page->page),
+					   slot,
+					   mapping.pbn);
+			page->page->entries[slot] =
+				pack_pbn(VDO_ZERO_BLOCK,
+					 MAPPING_STATE_UNMAPPED);
+			page->needs_write = true;
+		}
 	}
 
+	prepare_vdo_completion(completion, finish_page, finish_page,
+			       zone->thread_id, NULL);
+	invoke_vdo_completion_callback(completion);
+}
+
+/**
+ * Remove the entries of a leaf page which can't be valid, so that only
+ * plausible mappings are left for the reference count increments.
+ *
+ * @param zone  The zone rebuild
+ * @param page  The leaf page
+ **/
+static void remove_invalid_entries(struct rebuild_zone *zone,
+				   struct rebuild_page *page)
+{
+	slot_number_t slot;
+	struct block_map_page *block_map_page = page->page;
+	struct block_map_entry *entries = block_map_page->entries;
+	struct rebuild_completion *rebuild = zone->rebuild;
+
 	// Remove any bogus entries which exist beyond the end of the logical
 	// space.
-	if (get_block_map_page_pbn(page) == rebuild->last_slot.pbn) {
-		slot_number_t slot;
+	if (get_block_map_page_pbn(block_map_page) == rebuild->last_slot.pbn) {
 		for (slot = rebuild->last_slot.slot;
 		     slot < VDO_BLOCK_MAP_ENTRIES_PER_PAGE; slot++) {
 			struct data_location mapping =
-				unpack_block_map_entry(&page->entries[slot]);
+				unpack_block_map_entry(&entries[slot]);
 			if (is_mapped_location(&mapping)) {
-				page->entries[slot] =
-					pack_pbn(VDO_ZERO_BLOCK,
-						 MAPPING_STATE_UNMAPPED);
-				request_vdo_page_write(completion);
+				entries[slot] = pack_pbn(VDO_ZERO_BLOCK,
+							 MAPPING_STATE_UNMAPPED);
+				page->needs_write = true;
 			}
 		}
 	}
 
-	// Inform the slab depot of all entries on this page.
 	for (slot = 0; slot < VDO_BLOCK_MAP_ENTRIES_PER_PAGE; slot++) {
-		struct vdo_slab *slab;
-		int result;
 		struct data_location mapping =
-			unpack_block_map_entry(&page->entries[slot]);
+			unpack_block_map_entry(&entries[slot]);
 		if (!is_valid_location(&mapping)) {
 			// This entry is invalid, so remove it from the page.
-			page->entries[slot] = pack_pbn(VDO_ZERO_BLOCK,
-						       MAPPING_STATE_UNMAPPED);
-			request_vdo_page_write(completion);
-			continue;
-		}
-
-		if (!is_mapped_location(&mapping)) {
+			entries[slot] = pack_pbn(VDO_ZERO_BLOCK,
+						 MAPPING_STATE_UNMAPPED);
+			page->needs_write = true;
 			continue;
 		}
 
-		(*rebuild->logical_blocks_used)++;
-		if (mapping.pbn == VDO_ZERO_BLOCK) {
+		if (!is_mapped_location(&mapping) ||
+		    (mapping.pbn == VDO_ZERO_BLOCK)) {
 			continue;
 		}
 
 		if (!is_physical_data_block(rebuild->depot, mapping.pbn)) {
 			// This is a nonsense mapping. Remove it from the map so
 			// we're at least consistent and mark the page dirty.
-			page->entries[slot] = pack_pbn(VDO_ZERO_BLOCK,
-						       MAPPING_STATE_UNMAPPED);
-			request_vdo_page_write(completion);
-			continue;
-		}
-
-		slab = get_slab(rebuild->depot, mapping.pbn);
-		result = adjust_reference_count_for_rebuild(
-			slab->reference_counts, mapping.pbn, DATA_INCREMENT);
-		if (result != VDO_SUCCESS) {
-			log_error_strerror(result,
-					   "Could not adjust reference count for PBN %llu, slot %u mapped to PBN %llu",
-					   get_block_map_page_pbn(page),
-					   slot,
-					   mapping.pbn);
-			page->entries[slot] = pack_pbn(VDO_ZERO_BLOCK,
-						       MAPPING_STATE_UNMAPPED);
-			request_vdo_page_write(completion);
+			entries[slot] = pack_pbn(VDO_ZERO_BLOCK,
+						 MAPPING_STATE_UNMAPPED);
+			page->needs_write = true;
 		}
 	}
-	return VDO_SUCCESS;
 }
 
-/**********************************************************************/
-static void fetch_page(struct rebuild_completion *rebuild,
-		       struct vdo_completion *completion);
-
 /**
  * Process a page which has just been loaded. This callback is registered by
  * fetch_page().
@@ -364,61 +585,123 @@ static void fetch_page(struct rebuild_completion *rebuild,
  **/
 static void page_loaded(struct vdo_completion *completion)
 {
+	struct rebuild_page *page = as_rebuild_page(completion);
+	struct rebuild_zone *zone = page->zone;
 	int result;
 
-	struct rebuild_completion *rebuild =
-		as_rebuild_completion(completion->parent);
-	rebuild->outstanding--;
-
-	result = rebuild_reference_counts_from_page(rebuild, completion);
+	page->page = dereference_writable_vdo_page(completion);
+	result = ASSERT(page->page != NULL, "page available");
 	if (result != VDO_SUCCESS) {
-		abort_rebuild(rebuild, result);
+		abort_rebuild_zone(zone, result);
+		release_page(zone, page);
+		return;
 	}
 
-	release_vdo_page_completion(completion);
-	if (finish_if_done(rebuild)) {
+	if (!is_block_map_page_initialized(page->page)) {
+		release_page(zone, page);
 		return;
 	}
 
-	// Advance progress to the next page, and fetch the next page we
-	// haven't yet requested.
-	fetch_page(rebuild, completion);
+	/*
+	 * Page writes are only requested once the increments have been
+	 * applied, since the page must not be written out while the
+	 * rebuild's thread may still be changing it.
+	 */
+	remove_invalid_entries(zone, page);
+	prepare_vdo_completion(&page->count_completion,
+			       count_page_references,
+			       count_page_references,
+			       zone->rebuild->logical_thread_id,
+			       NULL);
+	invoke_vdo_completion_callback(&page->count_completion);
 }
 
 /**
- * Fetch a page from the block map.
+ * Handle an error loading a page.
  *
- * @param rebuild     the rebuild_completion
- * @param completion  the page completion to use
+ * @param completion  The vdo_page_completion
+ **/
+static void handle_page_load_error(struct vdo_completion *completion)
+{
+	struct rebuild_page *page = as_rebuild_page(completion);
+	struct rebuild_zone *zone = page->zone;
+	zone->outstanding--;
+	abort_rebuild_zone(zone, completion->result);
+	release_vdo_page_completion(completion);
+	finish_if_done(zone);
+}
+
+/**
+ * Fetch the next leaf page assigned to a zone from the block map. Each zone
+ * takes every zone_count'th leaf page.
+ *
+ * @param zone  the zone rebuild
+ * @param page  the page to use
  **/
-static void fetch_page(struct rebuild_completion *rebuild,
-		       struct vdo_completion *completion)
+static void fetch_page(struct rebuild_zone *zone, struct rebuild_page *page)
 {
-	while (rebuild->page_to_fetch < rebuild->leaf_pages) {
+	struct rebuild_completion *rebuild = zone->rebuild;
+	while (!zone->aborted && (zone->page_to_fetch < rebuild->leaf_pages)) {
 		physical_block_number_t pbn =
 			find_block_map_page_pbn(rebuild->block_map,
-						rebuild->page_to_fetch++);
+						zone->page_to_fetch);
+		zone->page_to_fetch += rebuild->zone_count;
 		if (pbn == VDO_ZERO_BLOCK) {
 			continue;
 		}
 
 		if (!is_physical_data_block(rebuild->depot, pbn)) {
-			abort_rebuild(rebuild, VDO_BAD_MAPPING);
-			if (finish_if_done(rebuild)) {
-				return;
-			}
-			continue;
+			abort_rebuild_zone(zone, VDO_BAD_MAPPING);
+			break;
 		}
 
-		init_vdo_page_completion(((struct vdo_page_completion *) completion),
-					 rebuild->block_map->zones[0].page_cache,
+		page->needs_write = false;
+		init_vdo_page_completion(&page->page_completion,
+					 zone->page_cache,
 					 pbn, true,
-					 &rebuild->completion, page_loaded,
+					 &zone->completion, page_loaded,
 					 handle_page_load_error);
-		rebuild->outstanding++;
-		get_vdo_page(completion);
+		zone->outstanding++;
+		get_vdo_page(&page->page_completion.completion);
+		return;
+	}
+
+	finish_if_done(zone);
+}
+
+/**
+ * Start a zone's rebuild from its leaf pages. This callback is registered in
+ * rebuild_from_leaves().
+ *
+ * @param completion  The rebuild_zone
+ **/
+static void launch_rebuild_zone(struct vdo_completion *completion)
+{
+	page_count_t i;
+	struct rebuild_zone *zone = as_rebuild_zone(completion);
+	struct rebuild_completion *rebuild = zone->rebuild;
+	int result;
+
+	prepare_vdo_completion(completion, finish_rebuild_zone,
+			       finish_rebuild_zone, rebuild->logical_thread_id,
+			       &rebuild->completion);
+
+	// Completion chaining from page cache hits can lead to stack overflow
+	// during the rebuild, so clear out the cache before this rebuild phase.
+	result = invalidate_vdo_page_cache(zone->page_cache);
+	if (result != VDO_SUCCESS) {
+		finish_vdo_completion(completion, result);
 		return;
 	}
+
+	// Prevent any page from being processed until all pages have been
+	// launched.
+	zone->launching = true;
+	for (i = 0; i < zone->page_count; i++) {
+		fetch_page(zone, &zone->pages[i]);
+	}
+	zone->launching = false;
+	finish_if_done(zone);
 }
 
 /**
@@ -431,7 +714,7 @@ static void fetch_page(struct rebuild_completion *rebuild,
  **/
 static void rebuild_from_leaves(struct vdo_completion *completion)
 {
-	page_count_t i;
+	zone_count_t zone;
 	struct rebuild_completion *rebuild =
 		as_rebuild_completion(completion->parent);
 	*rebuild->logical_blocks_used = 0;
@@ -445,16 +728,20 @@ static void rebuild_from_leaves(struct vdo_completion *completion)
 					       rebuild->leaf_pages - 1),
 	};
 
-	// Prevent any page from being processed until all pages have been
-	// launched.
-	rebuild->launching = true;
-	for (i = 0; i < rebuild->page_count; i++) {
-		fetch_page(rebuild, &rebuild->page_completions[i].completion);
+	// Each zone rebuild is enqueued rather than invoked so that none of
+	// them can finish the whole rebuild while they are still launching.
+	rebuild->zones_remaining = rebuild->zone_count;
+	for (zone = 0; zone < rebuild->zone_count; zone++) {
+		struct rebuild_zone *rebuild_zone = rebuild->zones[zone];
+		rebuild_zone->page_to_fetch = zone;
+		prepare_vdo_completion(&rebuild_zone->completion,
+				       launch_rebuild_zone,
+				       finish_rebuild_zone,
+				       rebuild_zone->thread_id,
+				       &rebuild->completion);
+		enqueue_vdo_completion(&rebuild_zone->completion);
 	}
-	rebuild->launching = false;
-	finish_if_done(rebuild);
 }
-
 /**
  * Process a single entry from the block map tree.
  *
@@ -510,15 +797,6 @@ void rebuild_reference_counts(struct vdo *vdo,
 		return;
 	}
 
-	// Completion chaining from page cache hits can lead to stack overflow
-	// during the rebuild, so clear out the cache before this rebuild phase.
-	result =
-		invalidate_vdo_page_cache(rebuild->block_map->zones[0].page_cache);
-	if (result != VDO_SUCCESS) {
-		finish_vdo_completion(parent, result);
-		return;
-	}
-
 	// First traverse the block map trees.
 	*rebuild->block_map_data_blocks = 0;
 	completion = &rebuild->sub_task_completion;
@@ -0,0 +1,207 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "requestGovernor.h"
+
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+
+#include "memoryAlloc.h"
+
+#include "histogram.h"
+#include "statusCodes.h"
+
+enum {
+	// The number of adjustments per second
+	GOVERNOR_UPDATES_PER_SECOND = 10,
+	// The fewest samples in an interval worth adjusting for
+	GOVERNOR_MINIMUM_SAMPLES = 16,
+	// The limit will never be lowered below this
+	GOVERNOR_MINIMUM_LIMIT = 32,
+	// The amount by which the limit grows when under the target
+	GOVERNOR_INCREMENT = 16,
+	// The limit shrinks by 1/GOVERNOR_DECREMENT_DIVISOR when over target
+	GOVERNOR_DECREMENT_DIVISOR = 8,
+	// The number of histogram buckets (up to 10^7 microseconds)
+	GOVERNOR_HISTOGRAM_LOG_SIZE = 7,
+};
+
+struct request_governor {
+	// The limiter being governed
+	struct limiter *limiter;
+	// The lifetimes of data_vios, in microseconds
+	struct histogram *latency_histogram;
+	// Serializes adjustments
+	spinlock_t lock;
+	// The jiffy at or after which the next adjustment is due
+	unsigned long next_update;
+	// The histogram sample count at the last adjustment
+	uint64_t last_count;
+	// The histogram sample sum at the last adjustment
+	uint64_t last_sum;
+	// The target mean latency in microseconds, or zero if disabled
+	uint32_t target;
+	// The limit the limiter was created with
+	uint32_t maximum_limit;
+};
+
+/**********************************************************************/
+int make_request_governor(struct limiter *limiter,
+			  struct kobject *parent,
+			  struct request_governor **governor_ptr)
+{
+	struct request_governor *governor;
+	int result = ALLOCATE(1, struct request_governor, __func__, &governor);
+
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	governor->latency_histogram =
+		make_logarithmic_histogram(parent,
+					   "data_vio_latency",
+					   "Data VIO Latency",
+					   "data_vios",
+					   "latency",
+					   "microseconds",
+					   GOVERNOR_HISTOGRAM_LOG_SIZE);
+	if (governor->latency_histogram == NULL) {
+		FREE(governor);
+		return -ENOMEM;
+	}
+
+	governor->limiter = limiter;
+	governor->maximum_limit = get_limiter_limit(limiter);
+	governor->next_update = jiffies;
+	spin_lock_init(&governor->lock);
+	*governor_ptr = governor;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_request_governor(struct request_governor **governor_ptr)
+{
+	struct request_governor *governor = *governor_ptr;
+
+	if (governor == NULL) {
+		return;
+	}
+
+	free_histogram(&governor->latency_histogram);
+	FREE(governor);
+	*governor_ptr = NULL;
+}
+
+/**********************************************************************/
+void record_request_latency(struct request_governor *governor,
+			    uint64_t launch_time)
+{
+	enter_histogram_sample(governor->latency_histogram,
+			       (ktime_get_ns() - launch_time) / NSEC_PER_USEC);
+}
+
+/**
+ * Compute the next limit from the mean latency over the last interval.
+ *
+ * @param governor  The governor
+ * @param limit     The current limit
+ * @param mean      The mean latency in microseconds
+ *
+ * @return The new limit
+ **/
+static uint32_t compute_limit(struct request_governor *governor,
+			      uint32_t limit,
+			      uint64_t mean)
+{
+	if (mean > governor->target) {
+		limit -= limit / GOVERNOR_DECREMENT_DIVISOR;
+		return max_t(uint32_t, limit, GOVERNOR_MINIMUM_LIMIT);
+	}
+
+	return min_t(uint32_t,
+		     limit + GOVERNOR_INCREMENT,
+		     governor->maximum_limit);
+}
+
+/**********************************************************************/
+void update_request_governor(struct request_governor *governor)
+{
+	uint64_t count, sum, samples;
+	uint32_t limit, new_limit;
+
+	if ((READ_ONCE(governor->target) == 0) ||
+	    time_before(jiffies, READ_ONCE(governor->next_update)) ||
+	    !spin_trylock(&governor->lock)) {
+		return;
+	}
+
+	if ((governor->target == 0) ||
+	    time_before(jiffies, governor->next_update)) {
+		spin_unlock(&governor->lock);
+		return;
+	}
+
+	get_histogram_totals(governor->latency_histogram, &count, &sum);
+	samples = count - governor->last_count;
+	if (samples < GOVERNOR_MINIMUM_SAMPLES) {
+		spin_unlock(&governor->lock);
+		return;
+	}
+
+	limit = get_limiter_limit(governor->limiter);
+	new_limit = compute_limit(governor,
+				  limit,
+				  div64_u64(sum - governor->last_sum,
+					    samples));
+	governor->last_count = count;
+	governor->last_sum = sum;
+	WRITE_ONCE(governor->next_update,
+		   jiffies + HZ / GOVERNOR_UPDATES_PER_SECOND);
+	spin_unlock(&governor->lock);
+
+	if (new_limit != limit) {
+		set_limiter_limit(governor->limiter, new_limit);
+	}
+}
+
+/**********************************************************************/
+uint32_t get_request_governor_target(struct request_governor *governor)
+{
+	return READ_ONCE(governor->target);
+}
+
+/**********************************************************************/
+void set_request_governor_target(struct request_governor *governor,
+				 uint32_t target)
+{
+	uint64_t count, sum;
+
+	spin_lock(&governor->lock);
+	get_histogram_totals(governor->latency_histogram, &count, &sum);
+	governor->last_count = count;
+	governor->last_sum = sum;
+	governor->next_update = jiffies + HZ / GOVERNOR_UPDATES_PER_SECOND;
+	WRITE_ONCE(governor->target, target);
+	spin_unlock(&governor->lock);
+
+	if (target == 0) {
+		set_limiter_limit(governor->limiter, governor->maximum_limit);
+	}
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef REQUEST_GOVERNOR_H
+#define REQUEST_GOVERNOR_H
+
+#include <linux/kobject.h>
+
+#include "limiter.h"
+
+/**
+ * A request_governor adjusts the limit of a request limiter to hold the
+ * mean lifetime of data_vios near a target latency. Each interval in which
+ * the mean exceeds the target shrinks the limit by a fraction; each interval
+ * in which it does not grows the limit by a fixed step, up to the limit the
+ * limiter was created with. A target of zero turns the governor off and
+ * restores the original limit.
+ **/
+struct request_governor;
+
+/**
+ * Make a request governor.
+ *
+ * @param [in]  limiter       The limiter to govern
+ * @param [in]  parent        The sysfs node under which to report latencies
+ * @param [out] governor_ptr  A pointer to hold the new governor
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check make_request_governor(struct limiter *limiter,
+				       struct kobject *parent,
+				       struct request_governor **governor_ptr);
+
+/**
+ * Free a request governor and null out the reference to it.
+ *
+ * @param governor_ptr  The reference to the governor to free
+ **/
+void free_request_governor(struct request_governor **governor_ptr);
+
+/**
+ * Record the lifetime of a finished request.
+ *
+ * @param governor     The governor
+ * @param launch_time  The time, in nanoseconds, at which the request started
+ **/
+void record_request_latency(struct request_governor *governor,
+			    uint64_t launch_time);
+
+/**
+ * Adjust the governed limit if an interval has passed since the last
+ * adjustment. This may be called from any thread.
+ *
+ * @param governor  The governor
+ **/
+void update_request_governor(struct request_governor *governor);
+
+/**
+ * Get the target latency of a request governor.
+ *
+ * @param governor  The governor
+ *
+ * @return The target latency in microseconds, or zero if disabled
+ **/
+uint32_t get_request_governor_target(struct request_governor *governor);
+
+/**
+ * Set the target latency of a request governor.
+ *
+ * @param governor  The governor
+ * @param target    The target latency in microseconds, or zero to disable
+ **/
+void set_request_governor_target(struct request_governor *governor,
+				 uint32_t target);
+
+#endif // REQUEST_GOVERNOR_H
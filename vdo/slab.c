@@ -31,13 +31,16 @@
 #include "constants.h"
 #include "numUtils.h"
 #include "pbnLock.h"
+#include "readCache.h"
 #include "recoveryJournal.h"
 #include "refCounts.h"
 #include "slabDepot.h"
+#include "slabDepotInternals.h"
 #include "slabJournal.h"
 #include "slabJournalFormat.h"
 #include "slabJournalInternals.h"
 #include "slabSummary.h"
+#include "vdoInternal.h"
 
 /**********************************************************************/
 int make_slab(physical_block_number_t slab_origin,
@@ -62,6 +65,7 @@ int make_slab(physical_block_number_t slab_origin,
 	slab->end = slab->start + slab_config->slab_blocks;
 	slab->slab_number = slab_number;
 	INIT_LIST_HEAD(&slab->allocq_entry);
+	INIT_LIST_HEAD(&slab->discard_entry);
 
 	slab->ref_counts_origin =
 		slab_origin + slab_config->data_blocks + translation;
@@ -163,6 +167,19 @@ int modify_slab_reference_count(struct vdo_slab *slab,
 		return VDO_SUCCESS;
 	}
 
+	/*
+	 * A decremented block may become free and be rewritten, so drop any
+	 * cached copy of it. This is done before the unrecovered check, as
+	 * the decrement of an unrecovered slab only reaches its reference
+	 * counts when the slab is scrubbed, and the block can be reused as
+	 * soon as that happens.
+	 */
+	if (!is_increment_operation(operation.type)) {
+		struct vdo *vdo = slab->allocator->depot->vdo;
+
+		invalidate_read_cache_entry(vdo->read_cache, operation.pbn);
+	}
+
 	/*
 	 * If the slab is unrecovered, preserve the refCount state and let
 	 * scrubbing correct the refCount. Note that the slab journal has
@@ -185,14 +202,29 @@ int modify_slab_reference_count(struct vdo_slab *slab,
 	if (free_status_changed) {
 		adjust_vdo_free_block_count(slab,
 					    !is_increment_operation(operation.type));
+		if (!is_increment_operation(operation.type)) {
+			note_vdo_block_freed(slab);
+		}
+	} else if (operation.type == DATA_INCREMENT) {
+		struct vdo *vdo = slab->allocator->depot->vdo;
+		uint8_t count = get_reference_count(slab->reference_counts,
+						    operation.pbn);
+
+		note_read_cache_shared_block(vdo->read_cache, operation.pbn,
+					     count);
 	}
 
 	return VDO_SUCCESS;
 }
 
 /**********************************************************************/
-void open_slab(struct vdo_slab *slab)
+int open_slab(struct vdo_slab *slab)
 {
+	int result = allocate_reference_counters(slab->reference_counts);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
 	reset_search_cursor(slab->reference_counts);
 	if (is_slab_journal_blank(slab->journal)) {
 		WRITE_ONCE(slab->allocator->statistics.slabs_opened,
@@ -202,6 +234,8 @@ void open_slab(struct vdo_slab *slab)
 		WRITE_ONCE(slab->allocator->statistics.slabs_reopened,
 			   slab->allocator->statistics.slabs_reopened + 1);
 	}
+
+	return VDO_SUCCESS;
 }
 
 /**********************************************************************/
@@ -49,6 +49,11 @@ enum slab_rebuild_status {
 struct vdo_slab {
 	/** A list entry to queue this slab in a block_allocator list */
 	struct list_head allocq_entry;
+	/**
+	 * A list entry to queue this slab in its block_allocator's list of
+	 * slabs with freed blocks to discard
+	 */
+	struct list_head discard_entry;
 
 	/** The struct block_allocator that owns this slab */
 	struct block_allocator *allocator;
@@ -199,8 +204,11 @@ void mark_slab_unrecovered(struct vdo_slab *slab);
  * Perform all necessary initialization of a slab necessary for allocations.
  *
  * @param slab  The slab
+ *
+ * @return VDO_SUCCESS or an error if the slab's reference counters could not
+ *         be allocated
  **/
-void open_slab(struct vdo_slab *slab);
+int __must_check open_slab(struct vdo_slab *slab);
 
 /**
  * Get the current number of free blocks in a slab.
@@ -40,6 +40,7 @@
 #include "slabDepotInternals.h"
 #include "slabJournal.h"
 #include "slabIterator.h"
+#include "slabScrubber.h"
 #include "slabSummary.h"
 #include "statusCodes.h"
 #include "threadConfig.h"
@@ -316,6 +317,15 @@ int decode_slab_depot(struct slab_depot_state_2_0 state,
 	depot->first_block = state.first_block;
 	depot->last_block = state.last_block;
 	depot->slab_size_shift = slab_size_shift;
+	depot->scrub_budget = DEFAULT_SLAB_SCRUB_BUDGET;
+	depot->discard_batch = DEFAULT_DISCARD_BATCH;
+	depot->stripe_blocks = get_vdo_stripe_blocks(vdo);
+	if ((depot->stripe_blocks > 1) &&
+	    (((depot->first_block % depot->stripe_blocks) != 0) ||
+	     ((slab_size % depot->stripe_blocks) != 0))) {
+		uds_log_info("slabs are not aligned to the %llu block stripes of the backing device",
+			     (unsigned long long) depot->stripe_blocks);
+	}
 
 	result = allocate_components(depot, summary_partition);
 	if (result != VDO_SUCCESS) {
@@ -455,7 +465,21 @@ uint8_t get_increment_limit(struct slab_depot *depot,
 			    physical_block_number_t pbn)
 {
 	struct vdo_slab *slab = get_slab(depot, pbn);
-	if ((slab == NULL) || is_unrecovered_slab(slab)) {
+	if (slab == NULL) {
+		return 0;
+	}
+
+	if (is_unrecovered_slab(slab)) {
+		// Someone wants to deduplicate against this slab, so load its
+		// reference counts soon.
+		increase_vdo_slab_scrubbing_priority(slab);
+		return 0;
+	}
+
+	if (!has_reference_counters(slab->reference_counts)) {
+		// None of the slab's blocks is referenced, so the advice is
+		// stale, and the block can't be referenced provisionally
+		// until the slab is opened.
 		return 0;
 	}
 
@@ -728,6 +752,45 @@ get_slab_summary_for_zone(const struct slab_depot *depot, zone_count_t zone)
 	return get_summary_for_zone(depot->slab_summary, zone);
 }
 
+/**********************************************************************/
+bool is_slab_depot_scrubbing(struct slab_depot *depot)
+{
+	return (atomic_read(&depot->zones_to_scrub) > 0);
+}
+
+/**********************************************************************/
+unsigned int get_slab_depot_scrub_budget(const struct slab_depot *depot)
+{
+	return READ_ONCE(depot->scrub_budget);
+}
+
+/**********************************************************************/
+void set_slab_depot_scrub_budget(struct slab_depot *depot,
+				 unsigned int budget)
+{
+	zone_count_t zone;
+
+	WRITE_ONCE(depot->scrub_budget, budget);
+	for (zone = 0; zone < depot->zone_count; zone++) {
+		// The scrubbers are responsible for thread safety.
+		set_slab_scrubber_budget(depot->allocators[zone]->slab_scrubber,
+					 budget);
+	}
+}
+
+/**********************************************************************/
+block_count_t get_slab_depot_discard_batch(const struct slab_depot *depot)
+{
+	return READ_ONCE(depot->discard_batch);
+}
+
+/**********************************************************************/
+void set_slab_depot_discard_batch(struct slab_depot *depot,
+				  block_count_t batch)
+{
+	WRITE_ONCE(depot->discard_batch, batch);
+}
+
 /**********************************************************************/
 void scrub_all_unrecovered_slabs(struct slab_depot *depot,
 				 struct vdo_completion *parent)
@@ -777,63 +840,60 @@ block_count_t get_new_depot_size(const struct slab_depot *depot)
 
 
 /**********************************************************************/
-struct block_allocator_statistics
-get_depot_block_allocator_statistics(const struct slab_depot *depot)
+void
+get_depot_block_allocator_statistics(const struct slab_depot *depot,
+				     struct block_allocator_statistics *totals)
 {
-	struct block_allocator_statistics totals;
 	zone_count_t zone;
-	memset(&totals, 0, sizeof(totals));
+	memset(totals, 0, sizeof(*totals));
 
 	for (zone = 0; zone < depot->zone_count; zone++) {
 		struct block_allocator *allocator = depot->allocators[zone];
 		struct block_allocator_statistics stats =
 			get_vdo_block_allocator_statistics(allocator);
-		totals.slab_count += stats.slab_count;
-		totals.slabs_opened += stats.slabs_opened;
-		totals.slabs_reopened += stats.slabs_reopened;
+		totals->slab_count += stats.slab_count;
+		totals->slabs_opened += stats.slabs_opened;
+		totals->slabs_reopened += stats.slabs_reopened;
+		totals->slabs_to_scrub += stats.slabs_to_scrub;
+		totals->slabs_scrubbed += stats.slabs_scrubbed;
+		totals->discards += stats.discards;
+		totals->blocks_discarded += stats.blocks_discarded;
 	}
-
-	return totals;
 }
 
 /**********************************************************************/
-struct ref_counts_statistics
-get_depot_ref_counts_statistics(const struct slab_depot *depot)
+void get_depot_ref_counts_statistics(const struct slab_depot *depot,
+				     struct ref_counts_statistics *totals)
 {
-	struct ref_counts_statistics depot_stats;
 	zone_count_t zone;
-	memset(&depot_stats, 0, sizeof(depot_stats));
+	memset(totals, 0, sizeof(*totals));
 
 	for (zone = 0; zone < depot->zone_count; zone++) {
 		struct block_allocator *allocator = depot->allocators[zone];
 		struct ref_counts_statistics stats =
 			get_vdo_ref_counts_statistics(allocator);
-		depot_stats.blocks_written += stats.blocks_written;
+		totals->blocks_written += stats.blocks_written;
 	}
-
-	return depot_stats;
 }
 
 /**********************************************************************/
-struct slab_journal_statistics
-get_depot_slab_journal_statistics(const struct slab_depot *depot)
+void get_depot_slab_journal_statistics(const struct slab_depot *depot,
+				       struct slab_journal_statistics *totals)
 {
-	struct slab_journal_statistics depot_stats;
 	zone_count_t zone;
-	memset(&depot_stats, 0, sizeof(depot_stats));
+	memset(totals, 0, sizeof(*totals));
 
 	for (zone = 0; zone < depot->zone_count; zone++) {
 		struct block_allocator *allocator = depot->allocators[zone];
 		struct slab_journal_statistics stats =
 			get_vdo_slab_journal_statistics(allocator);
-		depot_stats.disk_full_count += stats.disk_full_count;
-		depot_stats.flush_count += stats.flush_count;
-		depot_stats.blocked_count += stats.blocked_count;
-		depot_stats.blocks_written += stats.blocks_written;
-		depot_stats.tail_busy_count += stats.tail_busy_count;
+		totals->disk_full_count += stats.disk_full_count;
+		totals->flush_count += stats.flush_count;
+		totals->blocked_count += stats.blocked_count;
+		totals->blocks_written += stats.blocks_written;
+		totals->tail_busy_count += stats.tail_busy_count;
+		totals->piggybacked_reaps += stats.piggybacked_reaps;
 	}
-
-	return depot_stats;
 }
 
 /**********************************************************************/
@@ -154,7 +154,9 @@ get_slab_journal(const struct slab_depot *depot, physical_block_number_t pbn);
 
 /**
  * Determine how many new references a block can acquire. This method must be
- * called from the the physical zone thread of the PBN.
+ * called from the the physical zone thread of the PBN. If the reference
+ * counts of the block's slab have not been loaded yet, no references are
+ * available, and the slab's loading is given a higher priority.
  *
  * @param depot  The slab depot
  * @param pbn    The physical block number that is being queried
@@ -191,12 +193,12 @@ get_depot_allocated_blocks(const struct slab_depot *depot);
 /**
  * Get the total of the statistics from all the block allocators in the depot.
  *
- * @param depot  The slab depot
- *
- * @return The statistics from all block allocators in the depot
+ * @param [in]  depot   The slab depot
+ * @param [out] totals  The statistics from all block allocators in the depot
  **/
-struct block_allocator_statistics __must_check
-get_depot_block_allocator_statistics(const struct slab_depot *depot);
+void
+get_depot_block_allocator_statistics(const struct slab_depot *depot,
+				     struct block_allocator_statistics *totals);
 
 /**
  * Get the total number of data blocks in all the slabs in the depot. This may
@@ -245,22 +247,22 @@ get_depot_unrecovered_slab_count(const struct slab_depot *depot);
 /**
  * Get the aggregated slab journal statistics for the depot.
  *
- * @param depot  The slab depot
- *
- * @return The aggregated statistics for all slab journals in the depot
+ * @param [in]  depot   The slab depot
+ * @param [out] totals  The aggregated statistics for all slab journals in the
+ *                      depot
  **/
-struct slab_journal_statistics __must_check
-get_depot_slab_journal_statistics(const struct slab_depot *depot);
+void get_depot_slab_journal_statistics(const struct slab_depot *depot,
+				       struct slab_journal_statistics *totals);
 
 /**
  * Get the cumulative ref_counts statistics for the depot.
  *
- * @param depot  The slab depot
- *
- * @return The cumulative statistics for all ref_counts in the depot
+ * @param [in]  depot   The slab depot
+ * @param [out] totals  The cumulative statistics for all ref_counts in the
+ *                      depot
  **/
-struct ref_counts_statistics __must_check
-get_depot_ref_counts_statistics(const struct slab_depot *depot);
+void get_depot_ref_counts_statistics(const struct slab_depot *depot,
+				     struct ref_counts_statistics *totals);
 
 /**
  * Asynchronously load any slab depot state that isn't included in the
@@ -388,6 +390,60 @@ get_slab_summary(const struct slab_depot *depot);
 struct slab_summary_zone * __must_check
 get_slab_summary_for_zone(const struct slab_depot *depot, zone_count_t zone);
 
+/**
+ * Check whether any zone of a depot is still scrubbing or loading the
+ * reference counts of its slabs. This may be called from any thread.
+ *
+ * @param depot  The depot
+ *
+ * @return <code>true</code> if any zone has not finished scrubbing
+ **/
+bool __must_check is_slab_depot_scrubbing(struct slab_depot *depot);
+
+/**
+ * Get the number of slabs each physical zone may scrub concurrently when
+ * nothing is waiting for a clean slab. This may be called from any thread.
+ *
+ * @param depot  The slab depot
+ *
+ * @return The background scrub budget
+ **/
+unsigned int __must_check
+get_slab_depot_scrub_budget(const struct slab_depot *depot);
+
+/**
+ * Set the number of slabs each physical zone may scrub concurrently when
+ * nothing is waiting for a clean slab. Zones scrub as many slabs as they can
+ * whenever a clean slab is needed to make progress. This may be called from
+ * any thread.
+ *
+ * @param depot   The slab depot
+ * @param budget  The new budget, from 1 to MAXIMUM_CONCURRENT_SLAB_SCRUBS
+ **/
+void set_slab_depot_scrub_budget(struct slab_depot *depot,
+				 unsigned int budget);
+
+/**
+ * Get the number of blocks each physical zone frees before discarding them on
+ * the backing device.
+ *
+ * @param depot  The slab depot
+ *
+ * @return The discard batch size, or 0 if freed blocks are not discarded
+ **/
+block_count_t __must_check
+get_slab_depot_discard_batch(const struct slab_depot *depot);
+
+/**
+ * Set the number of blocks each physical zone frees before discarding them on
+ * the backing device. This may be called from any thread.
+ *
+ * @param depot  The slab depot
+ * @param batch  The new batch size, or 0 to stop discarding freed blocks
+ **/
+void set_slab_depot_discard_batch(struct slab_depot *depot,
+				  block_count_t batch);
+
 /**
  * Scrub all unrecovered slabs.
  *
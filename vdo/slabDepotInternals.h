@@ -52,6 +52,18 @@ struct slab_depot {
 
 	/** State variables for scrubbing complete handling */
 	atomic_t zones_to_scrub;
+	/** The number of slabs each zone may scrub at once in the background */
+	unsigned int scrub_budget;
+	/**
+	 * The number of blocks each zone frees before discarding them, or 0
+	 * if freed blocks are not discarded
+	 */
+	block_count_t discard_batch;
+	/**
+	 * The stripe width of the backing device in blocks, which allocation
+	 * tries to fill a stripe at a time, or 0 or 1 if it has no stripes
+	 */
+	block_count_t stripe_blocks;
 
 	/** Array of pointers to individually allocated slabs */
 	struct vdo_slab **slabs;
@@ -36,6 +36,15 @@
 #include "slabSummary.h"
 #include "vdo.h"
 
+enum {
+	/**
+	 * How many recovery journal blocks past the one being released a
+	 * slab journal's lock may be and still have a well-filled tail
+	 * committed early.
+	 **/
+	SLAB_JOURNAL_RELEASE_LOOKAHEAD = 16,
+};
+
 /**********************************************************************/
 struct slab_journal *slab_journal_from_dirty_entry(struct list_head *entry)
 {
@@ -181,10 +190,11 @@ int make_slab_journal(struct block_allocator *allocator,
 	struct slab_journal *journal;
 	const struct slab_config *slab_config =
 		get_slab_config(allocator->depot);
-	int result = ALLOCATE_EXTENDED(struct slab_journal,
-				       slab_config->slab_journal_blocks,
-				       struct journal_lock,
-				       __func__,
+	int result = ALLOCATE_EXTENDED_TAGGED(struct slab_journal,
+					      slab_config->slab_journal_blocks,
+					      struct journal_lock,
+					      MEMORY_TAG_SLAB_JOURNALS,
+					      __func__,
 				       &journal);
 	if (result != VDO_SUCCESS) {
 		return result;
@@ -215,9 +225,10 @@ int make_slab_journal(struct block_allocator *allocator,
 
 	journal->slab_summary_waiter.callback = release_journal_locks;
 
-	result = ALLOCATE(VDO_BLOCK_SIZE,
-			  char,
-			  "struct packed_slab_journal_block",
+	result = ALLOCATE_TAGGED(VDO_BLOCK_SIZE,
+				 char,
+				 MEMORY_TAG_SLAB_JOURNALS,
+				 "struct packed_slab_journal_block",
 			  (char **)&journal->block);
 	if (result != VDO_SUCCESS) {
 		free_slab_journal(&journal);
@@ -243,8 +254,8 @@ void free_slab_journal(struct slab_journal **journal_ptr)
 		return;
 	}
 
-	FREE(journal->block);
-	FREE(journal);
+	FREE_TAGGED(journal->block, MEMORY_TAG_SLAB_JOURNALS);
+	FREE_TAGGED(journal, MEMORY_TAG_SLAB_JOURNALS);
 	*journal_ptr = NULL;
 }
 
@@ -346,6 +357,7 @@ static void finish_reaping(struct slab_journal *journal)
 
 /**********************************************************************/
 static void reap_slab_journal(struct slab_journal *journal);
+static bool requires_reaping(const struct slab_journal *journal);
 
 /**
  * Finish reaping now that we have flushed the lower layer and then try
@@ -395,6 +407,57 @@ static void flush_for_reaping(struct waiter *waiter, void *vio_context)
 	launch_flush(vio, complete_reaping, handle_flush_error);
 }
 
+/**
+ * A waiter callback for a reap which has waited to see whether a flush sent
+ * by someone else, most often the preflush of a recovery journal write,
+ * would make it safe. If none has, send a flush for the reap after all.
+ *
+ * @param waiter   The journal as a flush waiter
+ * @param context  The journal's block allocator
+ **/
+static void check_for_reap_flush(struct waiter *waiter, void *context)
+{
+	struct slab_journal *journal =
+		container_of(waiter, struct slab_journal, flush_waiter);
+	struct block_allocator *allocator = context;
+	int result;
+
+	if (vdo_flushed_since(allocator->depot->vdo,
+			      journal->reap_flush_mark)) {
+		WRITE_ONCE(journal->events->piggybacked_reaps,
+			   journal->events->piggybacked_reaps + 1);
+		finish_reaping(journal);
+		reap_slab_journal(journal);
+		return;
+	}
+
+	journal->flush_waiter.callback = flush_for_reaping;
+	result = acquire_vdo_block_allocator_vio(allocator,
+						 &journal->flush_waiter);
+	if (result != VDO_SUCCESS) {
+		enter_journal_read_only_mode(journal, result);
+	}
+}
+
+/**
+ * Check whether a reap may wait briefly for someone else's flush rather than
+ * sending one of its own. It may not if the backing device needs no flushes
+ * (the flush would cost nothing), if the slab is draining, or if entries are
+ * blocked until the journal is reaped.
+ *
+ * @param journal  The journal which is reaping
+ *
+ * @return <code>true</code> if the reap may wait for another flush
+ **/
+static bool can_piggyback_reap_flush(struct slab_journal *journal)
+{
+	struct vdo *vdo = journal->slab->allocator->depot->vdo;
+
+	return (vdo_has_volatile_write_cache(vdo) &&
+		!is_slab_draining(journal->slab) &&
+		!requires_reaping(journal));
+}
+
 /**
  * Conduct a reap on a slab journal to reclaim unreferenced blocks.
  *
@@ -402,6 +465,8 @@ static void flush_for_reaping(struct waiter *waiter, void *vio_context)
  **/
 static void reap_slab_journal(struct slab_journal *journal)
 {
+	struct block_allocator *allocator;
+	struct waiter *waiter = &journal->flush_waiter;
 	bool reaped = false;
 	int result;
 
@@ -450,10 +515,23 @@ static void reap_slab_journal(struct slab_journal *journal)
 	 * update is not persisted, they may still overwrite the to-be-reaped
 	 * slab journal block resulting in a loss of reference count updates
 	 * (VDO-2912).
+	 *
+	 * Any flush sent after this point will do, though, and the recovery
+	 * journal sends one with nearly every block it writes. So unless the
+	 * reap is urgent, wait until the next timer tick to see whether one
+	 * has come and gone before sending a flush just for this reap.
 	 */
-	journal->flush_waiter.callback = flush_for_reaping;
-	result = acquire_vdo_block_allocator_vio(journal->slab->allocator,
-						 &journal->flush_waiter);
+	allocator = journal->slab->allocator;
+	if (can_piggyback_reap_flush(journal)) {
+		journal->reap_flush_mark =
+			get_vdo_flush_mark(allocator->depot->vdo);
+		waiter->callback = check_for_reap_flush;
+		result = wait_for_vdo_reap_flush(allocator, waiter);
+	} else {
+		waiter->callback = flush_for_reaping;
+		result = acquire_vdo_block_allocator_vio(allocator, waiter);
+	}
+
 	if (result != VDO_SUCCESS) {
 		enter_journal_read_only_mode(journal, result);
 		return;
@@ -814,6 +892,92 @@ static void add_entry(struct slab_journal *journal,
 	}
 }
 
+/**
+ * Check whether the last entry in the tail block is a data increment of a
+ * given block.
+ *
+ * @param journal  The slab journal
+ * @param sbn      The slab block number of the block
+ *
+ * @return <code>true</code> if the last entry increments the block
+ **/
+static bool last_entry_increments(struct slab_journal *journal,
+				  slab_block_number sbn)
+{
+	struct slab_journal_block_header *header = &journal->tail_header;
+	slab_journal_payload *payload = &journal->block->payload;
+	journal_entry_count_t last = header->entry_count - 1;
+	struct slab_journal_entry entry =
+		unpack_slab_journal_entry(&payload->entries[last]);
+
+	if (header->has_block_map_increments &&
+	    ((payload->full_entries.entry_types[last / 8] &
+	      ((byte) 1 << (last % 8))) != 0)) {
+		return false;
+	}
+
+	return ((entry.sbn == sbn) && (entry.operation == DATA_INCREMENT));
+}
+
+/**
+ * Attempt to coalesce a data decrement with a data increment of the same
+ * block which is the last entry in the tail block. Since the two cancel, the
+ * increment is withdrawn from the tail block and neither takes up an entry,
+ * though both still adjust the reference count. The increment's slab journal
+ * point will be given to the next entry, so this is only done if no
+ * reference block has been written since the increment was counted.
+ * Recovery remains correct: if the tail block is written, its recovery point
+ * covers both recovery journal entries, so neither is replayed; if it is
+ * not, both are.
+ *
+ * @param journal   The slab journal
+ * @param data_vio  The data_vio making the decrement
+ *
+ * @return <code>true</code> if the decrement was coalesced and the data_vio
+ *         continued
+ **/
+static bool coalesce_decrement(struct slab_journal *journal,
+			       struct data_vio *data_vio)
+{
+	int result;
+	struct slab_journal_block_header *header = &journal->tail_header;
+	struct vdo_slab *slab = journal->slab;
+	struct journal_point increment_point = {
+		.sequence_number = header->sequence_number,
+		.entry_count = header->entry_count - 1,
+	};
+	struct journal_point previous_point = {
+		.sequence_number = header->sequence_number,
+		.entry_count = header->entry_count - 2,
+	};
+
+	// The first entry of the tail block holds its recovery journal lock.
+	if ((data_vio->operation.type != DATA_DECREMENT) ||
+	    (header->entry_count < 2) ||
+	    !last_entry_increments(journal,
+				   data_vio->operation.pbn - slab->start) ||
+	    !withdraw_slab_journal_point(slab->reference_counts,
+					 &increment_point,
+					 &previous_point)) {
+		return false;
+	}
+
+	header->entry_count--;
+	header->recovery_point = data_vio->recovery_journal_point;
+
+	// Each reference count adjustment consumes a per-entry lock, and the
+	// withdrawn entry's lock will be released again as unused when the
+	// tail block is written.
+	adjust_slab_journal_block_reference(journal,
+					    header->sequence_number,
+					    2);
+	result = modify_slab_reference_count(slab,
+					     &previous_point,
+					     data_vio->operation);
+	continue_data_vio(data_vio, result);
+	return true;
+}
+
 /**********************************************************************/
 bool attempt_replay_into_slab_journal(struct slab_journal *journal,
 				      physical_block_number_t pbn,
@@ -950,6 +1114,10 @@ static void add_entry_from_waiter(struct waiter *waiter, void *context)
 		}
 	}
 
+	if (coalesce_decrement(journal, data_vio)) {
+		return;
+	}
+
 	add_entry(journal,
 		  data_vio->operation.pbn,
 		  data_vio->operation.type,
@@ -1123,7 +1291,9 @@ void add_slab_journal_entry(struct slab_journal *journal,
 		return;
 	}
 
-	if (is_unrecovered_slab(journal->slab) && requires_reaping(journal)) {
+	if (is_unrecovered_slab(journal->slab)) {
+		// The slab is being modified, so load its reference counts
+		// before those of slabs which are not being used.
 		increase_vdo_slab_scrubbing_priority(journal->slab);
 	}
 
@@ -1170,11 +1340,26 @@ bool release_recovery_journal_lock(struct slab_journal *journal,
 		return false;
 	}
 
-	if ((recovery_lock < journal->recovery_lock) ||
-	    is_vdo_read_only(journal)) {
+	if (is_vdo_read_only(journal) ||
+	    (journal->recovery_lock >
+	     (recovery_lock + SLAB_JOURNAL_RELEASE_LOOKAHEAD))) {
 		return false;
 	}
 
+	if (recovery_lock < journal->recovery_lock) {
+		/*
+		 * This tail does not have to be written yet. If it is at least
+		 * half full, write it along with the tails which do, since it
+		 * will need writing soon and the writes can then go out as
+		 * one batch. Otherwise, leave it to gather more entries until
+		 * the recovery journal actually needs its lock.
+		 */
+		if ((journal->tail_header.entry_count * 2) <
+		    journal->entries_per_block) {
+			return true;
+		}
+	}
+
 	// All locks are held by the block which is in progress; write it.
 	commit_slab_journal_tail(journal);
 	return true;
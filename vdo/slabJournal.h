@@ -163,14 +163,16 @@ void adjust_slab_journal_block_reference(struct slab_journal *journal,
 
 /**
  * Request the slab journal to release the recovery journal lock it may hold on
- * a specified recovery journal block.
+ * a specified recovery journal block. A journal whose lock is on one of the
+ * next few blocks will also commit its tail if the tail is at least half
+ * full, so that tails which will soon need writing are written in one batch.
  *
  * @param journal        The slab journal
  * @param recovery_lock  The sequence number of the recovery journal block
  *                       whose locks should be released
  *
- * @return <code>true</code> if the journal does hold a lock on the specified
- *         block (which it will release)
+ * @return <code>true</code> if journals holding newer locks should also be
+ *         asked to release them
  **/
 bool __must_check
 release_recovery_journal_lock(struct slab_journal *journal,
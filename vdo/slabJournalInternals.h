@@ -76,6 +76,8 @@ struct slab_journal {
 
 	/** The sequence number of the recovery journal lock */
 	sequence_number_t recovery_lock;
+	/** The flush mark taken when a reap began waiting for a flush */
+	uint64_t reap_flush_mark;
 
 	/**
 	 * The number of entries which fit in a single block. Can't use the
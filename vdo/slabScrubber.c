@@ -28,6 +28,7 @@
 #include "adminState.h"
 #include "blockAllocator.h"
 #include "constants.h"
+#include "readCache.h"
 #include "readOnlyNotifier.h"
 #include "recoveryJournal.h"
 #include "refCounts.h"
@@ -35,35 +36,33 @@
 #include "slab.h"
 #include "slabJournalInternals.h"
 #include "vdo.h"
+#include "vdoInternal.h"
 
 /**
  * Allocate the buffer and extent used for reading the slab journal when
  * scrubbing a slab.
  *
- * @param scrubber           The slab scrubber for which to allocate
- * @param vdo                The VDO in which the scrubber resides
- * @param slab_journal_size  The size of a slab journal
+ * @param scrub  The slab scrub for which to allocate
  *
  * @return VDO_SUCCESS or an error
  **/
-static int __must_check
-allocate_extent_and_buffer(struct slab_scrubber *scrubber,
-			   struct vdo *vdo,
-			   block_count_t slab_journal_size)
+static int __must_check allocate_extent_and_buffer(struct slab_scrub *scrub)
 {
+	struct slab_scrubber *scrubber = scrub->scrubber;
+	block_count_t slab_journal_size = scrubber->slab_journal_size;
 	size_t buffer_size = VDO_BLOCK_SIZE * slab_journal_size;
 	int result =
-		ALLOCATE(buffer_size, char, __func__, &scrubber->journal_data);
+		ALLOCATE(buffer_size, char, __func__, &scrub->journal_data);
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
 
-	return create_vdo_extent(vdo,
+	return create_vdo_extent(scrubber->vdo,
 				 VIO_TYPE_SLAB_JOURNAL,
 				 VIO_PRIORITY_METADATA,
 				 slab_journal_size,
-				 scrubber->journal_data,
-				 &scrubber->extent);
+				 scrub->journal_data,
+				 &scrub->extent);
 }
 
 /**********************************************************************/
@@ -73,12 +72,21 @@ int make_slab_scrubber(struct vdo *vdo,
 		       struct slab_scrubber **scrubber_ptr)
 {
 	struct slab_scrubber *scrubber;
+	unsigned int i;
 	int result = ALLOCATE(1, struct slab_scrubber, __func__, &scrubber);
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
 
-	result = allocate_extent_and_buffer(scrubber, vdo, slab_journal_size);
+	scrubber->vdo = vdo;
+	scrubber->slab_journal_size = slab_journal_size;
+	scrubber->budget = DEFAULT_SLAB_SCRUB_BUDGET;
+	for (i = 0; i < MAXIMUM_CONCURRENT_SLAB_SCRUBS; i++) {
+		scrubber->scrubs[i].scrubber = scrubber;
+	}
+
+	// The buffers of any further scrubs are allocated when needed.
+	result = allocate_extent_and_buffer(&scrubber->scrubs[0]);
 	if (result != VDO_SUCCESS) {
 		free_slab_scrubber(&scrubber);
 		return result;
@@ -97,14 +105,27 @@ int make_slab_scrubber(struct vdo *vdo,
 /**
  * Free the extent and buffer used for reading slab journals.
  *
+ * @param scrub  The scrub whose extent and buffer are to be freed
+ **/
+static void free_extent_and_buffer(struct slab_scrub *scrub)
+{
+	free_vdo_extent(&scrub->extent);
+	if (scrub->journal_data != NULL) {
+		FREE(scrub->journal_data);
+		scrub->journal_data = NULL;
+	}
+}
+
+/**
+ * Free the extents and buffers of all of a scrubber's scrubs.
+ *
  * @param scrubber  The scrubber
  **/
-static void free_extent_and_buffer(struct slab_scrubber *scrubber)
+static void free_extents_and_buffers(struct slab_scrubber *scrubber)
 {
-	free_vdo_extent(&scrubber->extent);
-	if (scrubber->journal_data != NULL) {
-		FREE(scrubber->journal_data);
-		scrubber->journal_data = NULL;
+	unsigned int i;
+	for (i = 0; i < MAXIMUM_CONCURRENT_SLAB_SCRUBS; i++) {
+		free_extent_and_buffer(&scrubber->scrubs[i]);
 	}
 }
 
@@ -117,7 +138,7 @@ void free_slab_scrubber(struct slab_scrubber **scrubber_ptr)
 	}
 
 	scrubber = *scrubber_ptr;
-	free_extent_and_buffer(scrubber);
+	free_extents_and_buffers(scrubber);
 	FREE(scrubber);
 	*scrubber_ptr = NULL;
 }
@@ -154,6 +175,19 @@ slab_count_t get_scrubber_slab_count(const struct slab_scrubber *scrubber)
 	return READ_ONCE(scrubber->slab_count);
 }
 
+/**********************************************************************/
+uint64_t get_scrubber_slabs_scrubbed(const struct slab_scrubber *scrubber)
+{
+	return READ_ONCE(scrubber->slabs_scrubbed);
+}
+
+/**********************************************************************/
+void set_slab_scrubber_budget(struct slab_scrubber *scrubber,
+			      unsigned int budget)
+{
+	WRITE_ONCE(scrubber->budget, budget);
+}
+
 /**********************************************************************/
 void register_slab_for_scrubbing(struct slab_scrubber *scrubber,
 				 struct vdo_slab *slab,
@@ -193,7 +227,7 @@ static void finish_scrubbing(struct slab_scrubber *scrubber)
 	bool notify;
 
 	if (!has_slabs_to_scrub(scrubber)) {
-		free_extent_and_buffer(scrubber);
+		free_extents_and_buffers(scrubber);
 	}
 
 	// Inform whoever is waiting that scrubbing has completed.
@@ -219,7 +253,7 @@ static void finish_scrubbing(struct slab_scrubber *scrubber)
 }
 
 /**********************************************************************/
-static void scrub_next_slab(struct slab_scrubber *scrubber);
+static void scrub_next_slabs(struct slab_scrubber *scrubber);
 
 /**
  * Notify the scrubber that a slab has been scrubbed. This callback is
@@ -229,23 +263,30 @@ static void scrub_next_slab(struct slab_scrubber *scrubber);
  **/
 static void slab_scrubbed(struct vdo_completion *completion)
 {
-	struct slab_scrubber *scrubber = completion->parent;
-	finish_scrubbing_slab(scrubber->slab);
+	struct slab_scrub *scrub = completion->parent;
+	struct slab_scrubber *scrubber = scrub->scrubber;
+	finish_scrubbing_slab(scrub->slab);
+	scrub->slab = NULL;
+	scrubber->active_scrubs--;
 	WRITE_ONCE(scrubber->slab_count, scrubber->slab_count - 1);
-	scrub_next_slab(scrubber);
+	WRITE_ONCE(scrubber->slabs_scrubbed, scrubber->slabs_scrubbed + 1);
+	scrub_next_slabs(scrubber);
 }
 
 /**
  * Abort scrubbing due to an error.
  *
- * @param scrubber  The slab scrubber
- * @param result    The error
+ * @param scrub   The slab scrub which failed
+ * @param result  The error
  **/
-static void abort_scrubbing(struct slab_scrubber *scrubber, int result)
+static void abort_scrubbing(struct slab_scrub *scrub, int result)
 {
+	struct slab_scrubber *scrubber = scrub->scrubber;
 	enter_read_only_mode(scrubber->read_only_notifier, result);
 	set_vdo_completion_result(&scrubber->completion, result);
-	scrub_next_slab(scrubber);
+	scrub->slab = NULL;
+	scrubber->active_scrubs--;
+	scrub_next_slabs(scrubber);
 }
 
 /**
@@ -265,13 +306,15 @@ static void handle_scrubber_error(struct vdo_completion *completion)
  * @param entry_count   The number of entries to apply
  * @param block_number  The sequence number of the block
  * @param slab          The slab to apply the entries to
+ * @param read_cache    The cache of compressed blocks to invalidate
  *
  * @return VDO_SUCCESS or an error code
  **/
 static int apply_block_entries(struct packed_slab_journal_block *block,
 			       journal_entry_count_t entry_count,
 			       sequence_number_t block_number,
-			       struct vdo_slab *slab)
+			       struct vdo_slab *slab,
+			       struct read_cache *read_cache)
 {
 	struct journal_point entry_point = {
 		.sequence_number = block_number,
@@ -294,6 +337,16 @@ static int apply_block_entries(struct packed_slab_journal_block *block,
 						  max_sbn);
 		}
 
+		/*
+		 * The block of a replayed decrement may be free once the slab
+		 * is scrubbed, so drop any cached copy of it before it can be
+		 * reused.
+		 */
+		if (!is_increment_operation(entry.operation)) {
+			invalidate_read_cache_entry(read_cache,
+						    slab->start + entry.sbn);
+		}
+
 		result = replay_reference_count_change(slab->reference_counts,
 						       &entry_point, entry);
 		if (result != VDO_SUCCESS) {
@@ -321,8 +374,8 @@ static int apply_block_entries(struct packed_slab_journal_block *block,
 static void apply_journal_entries(struct vdo_completion *completion)
 {
 	int result;
-	struct slab_scrubber *scrubber = completion->parent;
-	struct vdo_slab *slab = scrubber->slab;
+	struct slab_scrub *scrub = completion->parent;
+	struct vdo_slab *slab = scrub->slab;
 	struct slab_journal *journal = slab->journal;
 	struct ref_counts *reference_counts = slab->reference_counts;
 
@@ -330,7 +383,7 @@ static void apply_journal_entries(struct vdo_completion *completion)
 	sequence_number_t tail = journal->tail;
 	tail_block_offset_t end_index =
 		get_slab_journal_block_offset(journal, tail - 1);
-	char *end_data = scrubber->journal_data + (end_index * VDO_BLOCK_SIZE);
+	char *end_data = scrub->journal_data + (end_index * VDO_BLOCK_SIZE);
 	struct packed_slab_journal_block *end_block =
 		(struct packed_slab_journal_block *) end_data;
 
@@ -345,7 +398,7 @@ static void apply_journal_entries(struct vdo_completion *completion)
 	sequence_number_t sequence;
 	for (sequence = head; sequence < tail; sequence++) {
 		char *block_data =
-			scrubber->journal_data + (index * VDO_BLOCK_SIZE);
+			scrub->journal_data + (index * VDO_BLOCK_SIZE);
 		struct packed_slab_journal_block *block =
 			(struct packed_slab_journal_block *) block_data;
 		struct slab_journal_block_header header;
@@ -360,14 +413,15 @@ static void apply_journal_entries(struct vdo_completion *completion)
 			// The block is not what we expect it to be.
 			uds_log_error("vdo_slab journal block for slab %u was invalid",
 				      slab->slab_number);
-			abort_scrubbing(scrubber, VDO_CORRUPT_JOURNAL);
+			abort_scrubbing(scrub, VDO_CORRUPT_JOURNAL);
 			return;
 		}
 
 		result = apply_block_entries(block, header.entry_count,
-					     sequence, slab);
+					     sequence, slab,
+					     scrub->scrubber->vdo->read_cache);
 		if (result != VDO_SUCCESS) {
-			abort_scrubbing(scrubber, result);
+			abort_scrubbing(scrub, result);
 			return;
 		}
 
@@ -385,7 +439,7 @@ static void apply_journal_entries(struct vdo_completion *completion)
 						  &ref_counts_point),
 			"Refcounts are not more accurate than the slab journal");
 	if (result != VDO_SUCCESS) {
-		abort_scrubbing(scrubber, result);
+		abort_scrubbing(scrub, result);
 		return;
 	}
 
@@ -394,42 +448,133 @@ static void apply_journal_entries(struct vdo_completion *completion)
 			       slab_scrubbed,
 			       handle_scrubber_error,
 			       completion->callback_thread_id,
-			       scrubber);
+			       scrub);
 	start_slab_action(slab, ADMIN_STATE_SAVE_FOR_SCRUBBING, completion);
 }
 
 /**
  * Read the current slab's journal from disk now that it has been flushed.
- * This callback is registered in scrub_next_slab().
+ * This callback is registered in start_scrub().
  *
- * @param completion  The scrubber's extent completion
+ * @param completion  The scrub's extent completion
  **/
 static void start_scrubbing(struct vdo_completion *completion)
 {
-	struct slab_scrubber *scrubber = completion->parent;
-	struct vdo_slab *slab = scrubber->slab;
+	struct slab_scrub *scrub = completion->parent;
+	struct vdo_slab *slab = scrub->slab;
 	if (get_summarized_cleanliness(slab->allocator->summary,
 				     slab->slab_number)) {
 		slab_scrubbed(completion);
 		return;
 	}
 
-	prepare_vdo_completion(&scrubber->extent->completion,
+	prepare_vdo_completion(&scrub->extent->completion,
 			       apply_journal_entries,
 			       handle_scrubber_error,
 			       completion->callback_thread_id,
 			       completion->parent);
-	read_vdo_metadata_extent(scrubber->extent, slab->journal_origin);
+	read_vdo_metadata_extent(scrub->extent, slab->journal_origin);
+}
+
+/**
+ * Get the number of slabs which may be scrubbed concurrently right now. The
+ * budget only applies to background scrubbing; when anyone needs a clean slab
+ * to proceed, scrub as many as possible.
+ *
+ * @param scrubber  The scrubber
+ *
+ * @return The number of scrubs which may be in progress
+ **/
+static unsigned int get_scrub_limit(struct slab_scrubber *scrubber)
+{
+	if (scrubber->high_priority_only ||
+	    has_waiters(&scrubber->waiters) ||
+	    !list_empty(&scrubber->high_priority_slabs)) {
+		return MAXIMUM_CONCURRENT_SLAB_SCRUBS;
+	}
+
+	return READ_ONCE(scrubber->budget);
+}
+
+/**
+ * Get an idle scrub, allocating its extent and buffer if necessary.
+ *
+ * @param scrubber  The scrubber
+ *
+ * @return An idle scrub or <code>NULL</code> if none is available
+ **/
+static struct slab_scrub *get_idle_scrub(struct slab_scrubber *scrubber)
+{
+	unsigned int i;
+	for (i = 0; i < MAXIMUM_CONCURRENT_SLAB_SCRUBS; i++) {
+		struct slab_scrub *scrub = &scrubber->scrubs[i];
+		if (scrub->slab != NULL) {
+			continue;
+		}
+
+		if ((scrub->extent == NULL) &&
+		    (allocate_extent_and_buffer(scrub) != VDO_SUCCESS)) {
+			// Make do with the scrubs which already have buffers.
+			free_extent_and_buffer(scrub);
+			return NULL;
+		}
+
+		return scrub;
+	}
+
+	return NULL;
 }
 
 /**
- * Scrub the next slab if there is one.
+ * Start scrubbing a slab.
+ *
+ * @param scrub  The idle scrub to use
+ * @param slab   The slab to scrub
+ **/
+static void start_scrub(struct slab_scrub *scrub, struct vdo_slab *slab)
+{
+	struct slab_scrubber *scrubber = scrub->scrubber;
+	struct vdo_completion *completion =
+		vdo_extent_as_completion(scrub->extent);
+
+	list_del_init(&slab->allocq_entry);
+	scrub->slab = slab;
+	scrubber->active_scrubs++;
+	prepare_vdo_completion(completion,
+			       start_scrubbing,
+			       handle_scrubber_error,
+			       scrubber->completion.callback_thread_id,
+			       scrub);
+	start_slab_action(slab, ADMIN_STATE_SCRUBBING, completion);
+}
+
+/**
+ * Check whether there are slabs the scrubber should scrub now.
  *
  * @param scrubber  The scrubber
+ *
+ * @return The next slab to scrub or <code>NULL</code> if scrubbing is done
  **/
-static void scrub_next_slab(struct slab_scrubber *scrubber)
+static struct vdo_slab *get_slab_to_scrub(struct slab_scrubber *scrubber)
+{
+	struct vdo_slab *slab = get_next_slab(scrubber);
+	if ((slab == NULL) || (scrubber->high_priority_only &&
+			       list_empty(&scrubber->high_priority_slabs))) {
+		return NULL;
+	}
+
+	return slab;
+}
+
+/**
+ * Start scrubbing as many of the next slabs as the scrub limit allows. Once
+ * no scrubs are in progress, finish scrubbing if there is nothing left to
+ * scrub, or finish draining if the scrubber is being stopped.
+ *
+ * @param scrubber  The scrubber
+ **/
+static void scrub_next_slabs(struct slab_scrubber *scrubber)
 {
-	struct vdo_completion *completion;
 	struct vdo_slab *slab;
 
 	// Note: this notify call is always safe only because scrubbing can
@@ -437,13 +582,34 @@ static void scrub_next_slab(struct slab_scrubber *scrubber)
 	notify_all_waiters(&scrubber->waiters, NULL, NULL);
 	if (is_read_only(scrubber->read_only_notifier)) {
 		set_vdo_completion_result(&scrubber->completion, VDO_READ_ONLY);
-		finish_scrubbing(scrubber);
+		if (scrubber->active_scrubs == 0) {
+			finish_scrubbing(scrubber);
+		}
 		return;
 	}
 
-	slab = get_next_slab(scrubber);
-	if ((slab == NULL) || (scrubber->high_priority_only &&
-			       list_empty(&scrubber->high_priority_slabs))) {
+	while (!is_vdo_state_draining(&scrubber->admin_state) &&
+	       (scrubber->active_scrubs < get_scrub_limit(scrubber))) {
+		struct slab_scrub *scrub;
+
+		slab = get_slab_to_scrub(scrubber);
+		if (slab == NULL) {
+			break;
+		}
+
+		scrub = get_idle_scrub(scrubber);
+		if (scrub == NULL) {
+			break;
+		}
+
+		start_scrub(scrub, slab);
+	}
+
+	if (scrubber->active_scrubs > 0) {
+		return;
+	}
+
+	if (get_slab_to_scrub(scrubber) == NULL) {
 		scrubber->high_priority_only = false;
 		finish_scrubbing(scrubber);
 		return;
@@ -453,15 +619,10 @@ static void scrub_next_slab(struct slab_scrubber *scrubber)
 		return;
 	}
 
-	list_del_init(&slab->allocq_entry);
-	scrubber->slab = slab;
-	completion = vdo_extent_as_completion(scrubber->extent);
-	prepare_vdo_completion(completion,
-			       start_scrubbing,
-			       handle_scrubber_error,
-			       scrubber->completion.callback_thread_id,
-			       scrubber);
-	start_slab_action(slab, ADMIN_STATE_SCRUBBING, completion);
+	// There is a slab to scrub, but no scrub could be given buffers.
+	enter_read_only_mode(scrubber->read_only_notifier, -ENOMEM);
+	set_vdo_completion_result(&scrubber->completion, -ENOMEM);
+	finish_scrubbing(scrubber);
 }
 
 /**********************************************************************/
@@ -482,7 +643,7 @@ void scrub_slabs(struct slab_scrubber *scrubber,
 		return;
 	}
 
-	scrub_next_slab(scrubber);
+	scrub_next_slabs(scrubber);
 }
 
 /**********************************************************************/
@@ -533,7 +694,7 @@ void resume_scrubbing(struct slab_scrubber *scrubber,
 		return;
 	}
 
-	scrub_next_slab(scrubber);
+	scrub_next_slabs(scrubber);
 	complete_vdo_completion(parent);
 }
 
@@ -555,8 +716,9 @@ int enqueue_clean_slab_waiter(struct slab_scrubber *scrubber,
 /**********************************************************************/
 void dump_slab_scrubber(const struct slab_scrubber *scrubber)
 {
-	log_info("slab_scrubber slab_count %u waiters %zu %s%s",
+	log_info("slab_scrubber slab_count %u active %u waiters %zu %s%s",
 		 get_scrubber_slab_count(scrubber),
+		 scrubber->active_scrubs,
 		 count_waiters(&scrubber->waiters),
 		 get_vdo_admin_state_name(&scrubber->admin_state),
 		 scrubber->high_priority_only ? ", high_priority_only " : "");
@@ -26,6 +26,16 @@
 #include "types.h"
 #include "waitQueue.h"
 
+enum {
+	/** The most slabs a scrubber will scrub concurrently */
+	MAXIMUM_CONCURRENT_SLAB_SCRUBS = 4,
+	/**
+	 * The default number of slabs a scrubber will scrub concurrently
+	 * when no one is waiting for a clean slab
+	 */
+	DEFAULT_SLAB_SCRUB_BUDGET = 1,
+};
+
 /**
  * Create a slab scrubber
  *
@@ -103,7 +113,7 @@ void scrub_high_priority_slabs(struct slab_scrubber *scrubber,
 			       vdo_action *error_handler);
 
 /**
- * Tell the scrubber to stop scrubbing after it finishes the slab it is
+ * Tell the scrubber to stop scrubbing after it finishes the slabs it is
  * currently working on.
  *
  * @param scrubber  The scrubber to stop
@@ -143,6 +153,27 @@ int enqueue_clean_slab_waiter(struct slab_scrubber *scrubber,
 slab_count_t __must_check
 get_scrubber_slab_count(const struct slab_scrubber *scrubber);
 
+/**
+ * Get the number of slabs a scrubber has scrubbed.
+ *
+ * @param scrubber  The scrubber to query
+ *
+ * @return the number of slabs scrubbed since the scrubber was made
+ **/
+uint64_t __must_check
+get_scrubber_slabs_scrubbed(const struct slab_scrubber *scrubber);
+
+/**
+ * Set the number of slabs a scrubber may scrub concurrently when nothing is
+ * waiting for a clean slab. Scrubs which are already running are not
+ * affected. This may be called from any thread.
+ *
+ * @param scrubber  The scrubber
+ * @param budget    The new budget, from 1 to MAXIMUM_CONCURRENT_SLAB_SCRUBS
+ **/
+void set_slab_scrubber_budget(struct slab_scrubber *scrubber,
+			      unsigned int budget);
+
 /**
  * Dump information about a slab scrubber to the log for debugging.
  *
@@ -29,6 +29,22 @@
 #include "adminState.h"
 #include "extent.h"
 
+struct slab_scrubber;
+
+/**
+ * The state of one of a scrubber's concurrent slab scrubs.
+ **/
+struct slab_scrub {
+	/** The scrubber to which this scrub belongs */
+	struct slab_scrubber *scrubber;
+	/** The slab being scrubbed, or NULL if this scrub is idle */
+	struct vdo_slab *slab;
+	/** The extent for loading slab journal blocks */
+	struct vdo_extent *extent;
+	/** A buffer to store the slab journal blocks */
+	char *journal_data;
+};
+
 struct slab_scrubber {
 	struct vdo_completion completion;
 	/** The queue of slabs to scrub first */
@@ -44,6 +60,12 @@ struct slab_scrubber {
 	 * other threads.
 	 */
 	slab_count_t slab_count;
+	/*
+	 * The number of slabs scrubbed since the scrubber was made. This field
+	 * is modified by the physical zone thread, but is queried by other
+	 * threads.
+	 */
+	uint64_t slabs_scrubbed;
 
 	/** The administrative state of the scrubber */
 	struct admin_state admin_state;
@@ -51,12 +73,19 @@ struct slab_scrubber {
 	bool high_priority_only;
 	/** The context for entering read-only mode */
 	struct read_only_notifier *read_only_notifier;
-	/** The slab currently being scrubbed */
-	struct vdo_slab *slab;
-	/** The extent for loading slab journal blocks */
-	struct vdo_extent *extent;
-	/** A buffer to store the slab journal blocks */
-	char *journal_data;
+	/** The VDO, for allocating the buffers of additional scrubs */
+	struct vdo *vdo;
+	/** The size of a slab journal in blocks */
+	block_count_t slab_journal_size;
+	/*
+	 * The number of slabs to scrub at once when no one needs a clean slab.
+	 * This field is set from any thread.
+	 */
+	unsigned int budget;
+	/** The number of scrubs in progress */
+	unsigned int active_scrubs;
+	/** The scrubs, only the first of which always has buffers */
+	struct slab_scrub scrubs[MAXIMUM_CONCURRENT_SLAB_SCRUBS];
 };
 
 #endif // SLAB_SCRUBBER_INTERNALS_H
@@ -91,6 +91,7 @@ get_approximate_free_blocks(struct slab_summary *summary,
 
 /**********************************************************************/
 static void launch_write(struct slab_summary_block *summary_block);
+static void write_timer_expired(struct timer_list *timer);
 
 /**
  * Initialize a slab_summary_block.
@@ -166,7 +167,11 @@ static int make_slab_summary_zone(struct slab_summary *summary,
 	summary_zone = summary->zones[zone_number];
 	summary_zone->summary = summary;
 	summary_zone->zone_number = zone_number;
+	summary_zone->thread_id = thread_id;
 	summary_zone->entries = entries;
+	initialize_vdo_completion(&summary_zone->write_completion, vdo,
+				  SLAB_SUMMARY_WRITE_COMPLETION);
+	timer_setup(&summary_zone->write_timer, write_timer_expired, 0);
 
 	// Initialize each block.
 	for (i = 0; i < summary->blocks_per_zone; i++) {
@@ -279,6 +284,7 @@ void free_slab_summary(struct slab_summary **slab_summary_ptr)
 		struct slab_summary_zone *summary_zone = summary->zones[zone];
 		if (summary_zone != NULL) {
 			block_count_t i;
+			del_timer_sync(&summary_zone->write_timer);
 			for (i = 0; i < summary->blocks_per_zone; i++) {
 				free_vio(&summary_zone->summary_blocks[i].vio);
 				FREE(summary_zone->summary_blocks[i]
@@ -309,7 +315,8 @@ struct slab_summary_zone *get_summary_for_zone(struct slab_summary *summary,
 static void check_for_drain_complete(struct slab_summary_zone *summary_zone)
 {
 	if (!is_vdo_state_draining(&summary_zone->state)
-	    || (summary_zone->write_count > 0)) {
+	    || (summary_zone->write_count > 0)
+	    || summary_zone->write_timer_armed) {
 		return;
 	}
 
@@ -416,15 +423,88 @@ static void launch_write(struct slab_summary_block *block)
 }
 
 /**
- * Initiate a drain.
+ * Write every block of a zone which has updates waiting. The blocks are
+ * written in order so that the I/O submitter can combine adjacent ones into
+ * a single bio.
+ *
+ * @param summary_zone  The zone whose blocks should be written
+ **/
+static void launch_pending_writes(struct slab_summary_zone *summary_zone)
+{
+	block_count_t i;
+
+	for (i = 0; i < summary_zone->summary->blocks_per_zone; i++) {
+		struct slab_summary_block *block =
+			&summary_zone->summary_blocks[i];
+		if (has_waiters(&block->next_update_waiters)) {
+			launch_write(block);
+		}
+	}
+}
+
+/**
+ * Bring the expiration of the write timer to the zone's thread. This is the
+ * timer function of the write timer, so it runs in interrupt context.
+ *
+ * @param timer  The write timer
+ **/
+static void write_timer_expired(struct timer_list *timer)
+{
+	struct slab_summary_zone *summary_zone =
+		from_timer(summary_zone, timer, write_timer);
+	enqueue_vdo_completion(&summary_zone->write_completion);
+}
+
+/**
+ * Write all the blocks updated since the write timer was set. This is the
+ * callback of the write completion.
+ *
+ * @param completion  The write completion
+ **/
+static void write_updated_blocks(struct vdo_completion *completion)
+{
+	struct slab_summary_zone *summary_zone = completion->parent;
+
+	summary_zone->write_timer_armed = false;
+	launch_pending_writes(summary_zone);
+	check_for_drain_complete(summary_zone);
+}
+
+/**
+ * Arrange for the updated blocks of a zone to be written after a short
+ * delay, during which further updates to the same blocks will be combined
+ * into the same writes.
+ *
+ * @param summary_zone  The zone which has been updated
+ **/
+static void schedule_writes(struct slab_summary_zone *summary_zone)
+{
+	if (summary_zone->write_timer_armed) {
+		return;
+	}
+
+	summary_zone->write_timer_armed = true;
+	prepare_vdo_completion(&summary_zone->write_completion,
+			       write_updated_blocks,
+			       write_updated_blocks,
+			       summary_zone->thread_id,
+			       summary_zone);
+	mod_timer(&summary_zone->write_timer, jiffies + 1);
+}
+
+/**
+ * Initiate a drain. Any updates still waiting for the write timer are
+ * written immediately.
  *
  * Implements vdo_admin_initiator.
  **/
 static void initiate_drain(struct admin_state *state)
 {
-	check_for_drain_complete(container_of(state,
-					      struct slab_summary_zone,
-					      state));
+	struct slab_summary_zone *summary_zone =
+		container_of(state, struct slab_summary_zone, state);
+
+	launch_pending_writes(summary_zone);
+	check_for_drain_complete(summary_zone);
 }
 
 /**********************************************************************/
@@ -500,7 +580,9 @@ void update_slab_summary_entry(struct slab_summary_zone *summary_zone,
 		return;
 	}
 
-	launch_write(block);
+	if (!block->writing) {
+		schedule_writes(summary_zone);
+	}
 }
 
 /**********************************************************************/
@@ -678,12 +760,12 @@ void load_slab_summary(struct slab_summary *summary,
 }
 
 /**********************************************************************/
-struct slab_summary_statistics
-get_slab_summary_statistics(const struct slab_summary *summary)
+void get_slab_summary_statistics(const struct slab_summary *summary,
+				 struct slab_summary_statistics *stats)
 {
 	const struct atomic_slab_summary_statistics *atoms =
 		&summary->statistics;
-	return (struct slab_summary_statistics) {
+	*stats = (struct slab_summary_statistics) {
 		.blocks_written = atomic64_read(&atoms->blocks_written),
 	};
 }
@@ -246,11 +246,10 @@ void load_slab_summary(struct slab_summary *summary,
 /**
  * Fetch the cumulative statistics for all slab summary zones in a summary.
  *
- * @param summary       The summary in question
- *
- * @return the cumulative slab summary statistics for the summary
+ * @param [in]  summary  The summary in question
+ * @param [out] stats    The cumulative slab summary statistics for the summary
  **/
-struct slab_summary_statistics __must_check
-get_slab_summary_statistics(const struct slab_summary *summary);
+void get_slab_summary_statistics(const struct slab_summary *summary,
+				 struct slab_summary_statistics *stats);
 
 #endif // SLAB_SUMMARY_H
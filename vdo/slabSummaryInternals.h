@@ -22,6 +22,8 @@
 #ifndef SLAB_SUMMARY_INTERNALS_H
 #define SLAB_SUMMARY_INTERNALS_H
 
+#include <linux/timer.h>
+
 #include "slabSummary.h"
 
 #include "atomicDefs.h"
@@ -63,10 +65,21 @@ struct slab_summary_zone {
 	struct slab_summary *summary;
 	/** The number of this zone */
 	zone_count_t zone_number;
+	/** The ID of the physical zone thread of this zone */
+	thread_id_t thread_id;
 	/** Count of the number of blocks currently out for writing */
 	block_count_t write_count;
 	/** The state of this zone */
 	struct admin_state state;
+	/** Whether the write timer is set */
+	bool write_timer_armed;
+	/**
+	 * The timer which delays the writing of updated blocks so that more
+	 * updates can be combined into each write
+	 */
+	struct timer_list write_timer;
+	/** The completion which brings an expired timer to the zone thread */
+	struct vdo_completion write_completion;
 	/** The array (owned by the blocks) of all entries */
 	struct slab_summary_entry *entries;
 	/** The array of slab_summary_blocks */
@@ -24,7 +24,7 @@
 #include "types.h"
 
 enum {
-	STATISTICS_VERSION = 32,
+	STATISTICS_VERSION = 57,
 };
 
 struct block_allocator_statistics {
@@ -34,6 +34,14 @@ struct block_allocator_statistics {
 	uint64_t slabs_opened;
 	/** The number of times since loading that a slab has been re-opened */
 	uint64_t slabs_reopened;
+	/** The number of slabs which are unrecovered or being scrubbed */
+	uint64_t slabs_to_scrub;
+	/** The number of slabs which have been scrubbed since loading */
+	uint64_t slabs_scrubbed;
+	/** The number of discards of freed blocks sent to the backing device */
+	uint64_t discards;
+	/** The number of freed blocks discarded on the backing device */
+	uint64_t blocks_discarded;
 };
 
 /**
@@ -58,6 +66,8 @@ struct recovery_journal_statistics {
 	uint64_t disk_full;
 	/** Number of times the recovery journal requested slab journal commits. */
 	uint64_t slab_journal_commits_requested;
+	/** Number of partial block commits held for more entries */
+	uint64_t delayed_commits;
 	/** Write/Commit totals for individual journal entries */
 	struct commit_statistics entries;
 	/** Write/Commit totals for journal blocks */
@@ -72,6 +82,30 @@ struct packer_statistics {
 	uint64_t compressed_blocks_written;
 	/** Number of VIOs that are pending in the packer */
 	uint64_t compressed_fragments_in_packer;
+	/** Number of data blocks which have been considered for compression */
+	uint64_t compression_candidates;
+	/** Number of candidates not compressed since they sampled as incompressible */
+	uint64_t incompressible_candidates_skipped;
+	/** Number of compressed blocks written less than half full */
+	uint64_t blocks_filled_under_50;
+	/** Number of compressed blocks written at least half but under 75% full */
+	uint64_t blocks_filled_50_to_75;
+	/** Number of compressed blocks written at least 75% but under 90% full */
+	uint64_t blocks_filled_75_to_90;
+	/** Number of compressed blocks written at least 90% full */
+	uint64_t blocks_filled_over_90;
+	/** Number of compressed blocks which ran out of slots before space */
+	uint64_t blocks_slot_limited;
+	/** Number of data_vios waiting in input bins */
+	uint64_t fragments_in_input_bins;
+	/** Number of batched data_vios waiting for an idle output bin */
+	uint64_t fragments_awaiting_output;
+	/** Number of output bins writing a compressed block */
+	uint64_t output_bins_busy;
+	/** Number of output bins idle */
+	uint64_t output_bins_idle;
+	/** Number of times batched data_vios found every output bin busy */
+	uint64_t output_bin_stalls;
 };
 
 /** The statistics for the slab journals. */
@@ -86,6 +120,8 @@ struct slab_journal_statistics {
 	uint64_t blocks_written;
 	/** Number of times we had to wait for the tail to write */
 	uint64_t tail_busy_count;
+	/** Number of reaps made safe by a flush sent for another purpose */
+	uint64_t piggybacked_reaps;
 };
 
 /** The statistics for the slab summary. */
@@ -142,6 +178,30 @@ struct block_map_statistics {
 	uint64_t pages_saved;
 	/** the number of flushes issued */
 	uint64_t flush_count;
+	/** number of pages protected from eviction by reuse */
+	uint32_t protected_pages;
+	/** number of gets which found a protected page */
+	uint64_t protected_hits;
+	/** number of pages protected after being reused */
+	uint64_t promotions;
+	/** number of evicted pages kept compacted */
+	uint32_t compact_pages;
+	/** number of pages loaded by expanding a compacted copy */
+	uint64_t compact_loads;
+	/** number of cache pages in physically contiguous memory */
+	uint32_t contiguous_pages;
+	/** number of trees handed from one logical zone to another */
+	uint64_t tree_handoffs;
+	/** number of gets sampled by the cache size simulator */
+	uint64_t simulated_gets;
+	/** number of sampled gets which would hit in a cache half the size */
+	uint64_t simulated_half_size_hits;
+	/** number of sampled gets which would hit in an LRU cache this size */
+	uint64_t simulated_same_size_hits;
+	/** number of sampled gets which would hit in a cache double the size */
+	uint64_t simulated_double_size_hits;
+	/** number of sampled gets which would hit in a cache 4 times the size */
+	uint64_t simulated_quadruple_size_hits;
 };
 
 /** The dedupe statistics from hash locks */
@@ -154,6 +214,14 @@ struct hash_lock_statistics {
 	uint64_t concurrent_data_matches;
 	/** Number of writes whose hash collided with an in-flight write */
 	uint64_t concurrent_hash_collisions;
+	/** Number of queries answered by the hash zone advice cache */
+	uint64_t cached_advice_hits;
+	/** Number of queries which missed the advice cache and went to UDS */
+	uint64_t cached_advice_misses;
+	/** Number of times advice from the advice cache proved incorrect */
+	uint64_t cached_advice_stale;
+	/** Number of times a hash zone found all its hash locks in use */
+	uint64_t lock_pool_exhaustions;
 };
 
 /** Counts of error conditions in VDO. */
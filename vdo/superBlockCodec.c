@@ -67,15 +67,24 @@ int initialize_super_block_codec(struct super_block_codec *codec)
 	// Even though the buffer is a full block, to avoid the potential
 	// corruption from a torn write, the entire encoding must fit in the
 	// first sector.
-	return wrap_buffer(codec->encoded_super_block,
-			   VDO_SECTOR_SIZE,
-			   0,
-			   &codec->block_buffer);
+	result = wrap_buffer(codec->encoded_super_block,
+			     VDO_SECTOR_SIZE,
+			     0,
+			     &codec->block_buffer);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	return wrap_buffer(codec->encoded_super_block + VDO_SECTOR_SIZE,
+			   VDO_BLOCK_SIZE - VDO_SECTOR_SIZE,
+			   VDO_BLOCK_SIZE - VDO_SECTOR_SIZE,
+			   &codec->spare_buffer);
 }
 
 /**********************************************************************/
 void destroy_super_block_codec(struct super_block_codec *codec)
 {
+	free_buffer(&codec->spare_buffer);
 	free_buffer(&codec->block_buffer);
 	free_buffer(&codec->component_buffer);
 	FREE(codec->encoded_super_block);
@@ -39,6 +39,12 @@ struct super_block_codec {
 	 * block.
 	 **/
 	struct buffer *block_buffer;
+	/**
+	 * A buffer wrapping the remaining sectors of encoded_super_block,
+	 * which hold advisory data that is not covered by the super block
+	 * checksum and which older versions ignore.
+	 **/
+	struct buffer *spare_buffer;
 	/** A 1-block buffer holding the encoded on-disk super block */
 	byte *encoded_super_block;
 };
@@ -25,8 +25,10 @@
 
 #include "dedupeIndex.h"
 #include "dmvdo.h"
+#include "kernelLayer.h"
 #include "logger.h"
 #include "vdoInit.h"
+#include "workQueue.h"
 
 static char *status_strings[] = {
 	"UNINITIALIZED",
@@ -93,6 +95,44 @@ static int vdo_min_dedupe_timer_interval_store(const char *buf,
 	return 0;
 }
 
+/**********************************************************************/
+static int vdo_work_queue_spin_budget_store(const char *buf,
+					    const struct kernel_param *kp)
+{
+	int result = param_set_uint(buf, kp);
+	if (result != 0) {
+		return result;
+	}
+	set_work_queue_spin_budget(*(uint *)kp->arg);
+	return 0;
+}
+
+/*
+ * The thread class of each CPU placement parameter, for use as the
+ * parameter's argument.
+ */
+static enum vdo_thread_class ack_thread_class = VDO_THREAD_CLASS_ACK;
+static enum vdo_thread_class bio_thread_class = VDO_THREAD_CLASS_BIO;
+static enum vdo_thread_class cpu_thread_class = VDO_THREAD_CLASS_CPU;
+static enum vdo_thread_class journal_thread_class = VDO_THREAD_CLASS_JOURNAL;
+static enum vdo_thread_class zone_thread_class = VDO_THREAD_CLASS_ZONE;
+
+/**********************************************************************/
+static int vdo_thread_cpus_show(char *buf,
+				const struct kernel_param *kp)
+{
+	return format_vdo_thread_class_cpus(*(enum vdo_thread_class *)kp->arg,
+					    buf);
+}
+
+/**********************************************************************/
+static int vdo_thread_cpus_store(const char *buf,
+				 const struct kernel_param *kp)
+{
+	return set_vdo_thread_class_cpus(*(enum vdo_thread_class *)kp->arg,
+					 buf);
+}
+
 static const struct kernel_param_ops status_ops = {
 	.get = vdo_status_show,
 };
@@ -113,6 +153,16 @@ static const struct kernel_param_ops dedupe_timer_ops = {
 	.get = param_get_uint,
 };
 
+static const struct kernel_param_ops thread_cpus_ops = {
+	.set = vdo_thread_cpus_store,
+	.get = vdo_thread_cpus_show,
+};
+
+static const struct kernel_param_ops work_queue_spin_budget_ops = {
+	.set = vdo_work_queue_spin_budget_store,
+	.get = param_get_uint,
+};
+
 module_param_cb(status, &status_ops, NULL, 0444);
 
 module_param_cb(log_level, &log_level_ops, NULL, 0644);
@@ -123,3 +173,17 @@ module_param_cb(deduplication_timeout_interval, &dedupe_timeout_ops,
 
 module_param_cb(min_deduplication_timer_interval, &dedupe_timer_ops,
 		&min_dedupe_index_timer_interval, 0644);
+
+module_param_cb(work_queue_spin_budget, &work_queue_spin_budget_ops,
+		&work_queue_spin_budget, 0644);
+
+module_param_cb(shared_ack_threads, &param_ops_uint, &shared_ack_threads,
+		0644);
+
+module_param_cb(ack_thread_cpus, &thread_cpus_ops, &ack_thread_class, 0644);
+module_param_cb(bio_thread_cpus, &thread_cpus_ops, &bio_thread_class, 0644);
+module_param_cb(cpu_thread_cpus, &thread_cpus_ops, &cpu_thread_class, 0644);
+module_param_cb(journal_thread_cpus, &thread_cpus_ops, &journal_thread_class,
+		0644);
+module_param_cb(zone_thread_cpus, &thread_cpus_ops, &zone_thread_class,
+		0644);
@@ -33,6 +33,7 @@
 static int allocate_thread_config(zone_count_t logical_zone_count,
 				  zone_count_t physical_zone_count,
 				  zone_count_t hash_zone_count,
+				  zone_count_t packer_zone_count,
 				  zone_count_t base_thread_count,
 				  struct thread_config **config_ptr)
 {
@@ -70,9 +71,19 @@ static int allocate_thread_config(zone_count_t logical_zone_count,
 		return result;
 	}
 
+	result = ALLOCATE(packer_zone_count,
+			  thread_id_t,
+			  "packer thread array",
+			  &config->packer_threads);
+	if (result != VDO_SUCCESS) {
+		free_thread_config(&config);
+		return result;
+	}
+
 	config->logical_zone_count = logical_zone_count;
 	config->physical_zone_count = physical_zone_count;
 	config->hash_zone_count = hash_zone_count;
+	config->packer_zone_count = packer_zone_count;
 	config->base_thread_count = base_thread_count;
 
 	*config_ptr = config;
@@ -90,10 +101,32 @@ assign_thread_ids(thread_id_t thread_ids[], zone_count_t count,
 	}
 }
 
+/**
+ * Assign the zones of one type round-robin across a set of shared zone
+ * threads.
+ *
+ * @param thread_ids         The array of thread ids to fill in
+ * @param count              The number of zones of the type
+ * @param first_id           The id of the first shared thread
+ * @param zone_thread_count  The number of shared threads
+ **/
+static void share_thread_ids(thread_id_t thread_ids[],
+			     zone_count_t count,
+			     thread_id_t first_id,
+			     thread_count_t zone_thread_count)
+{
+	zone_count_t zone;
+	for (zone = 0; zone < count; zone++) {
+		thread_ids[zone] = first_id + (zone % zone_thread_count);
+	}
+}
+
 /**********************************************************************/
 int make_thread_config(zone_count_t logical_zone_count,
 		       zone_count_t physical_zone_count,
 		       zone_count_t hash_zone_count,
+		       zone_count_t packer_zone_count,
+		       thread_count_t zone_thread_count,
 		       struct thread_config **config_ptr)
 {
 	struct thread_config *config;
@@ -120,19 +153,59 @@ int make_thread_config(zone_count_t logical_zone_count,
 					  MAX_VDO_LOGICAL_ZONES);
 	}
 
-	total = logical_zone_count + physical_zone_count + hash_zone_count + 2;
+	if (packer_zone_count == 0) {
+		packer_zone_count = 1;
+	}
+
+	total = (logical_zone_count + physical_zone_count + hash_zone_count
+		 + packer_zone_count + 1);
+	if ((zone_thread_count > 0) && (zone_thread_count + 1 < total)) {
+		/*
+		 * Consolidated mode: the zones keep their separate identities
+		 * (and so their locks and ordering), but zone i of each type
+		 * runs on shared thread i % zone_thread_count, so that hops
+		 * between zones on the same thread become direct calls.
+		 */
+		total = zone_thread_count + 1;
+	} else {
+		zone_thread_count = 0;
+	}
+
 	result = allocate_thread_config(logical_zone_count,
 					physical_zone_count,
 					hash_zone_count,
+					packer_zone_count,
 					total,
 					&config);
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
 
+	config->zone_thread_count = zone_thread_count;
 	config->admin_thread = id;
 	config->journal_thread = id++;
-	config->packer_thread = id++;
+	if (zone_thread_count > 0) {
+		share_thread_ids(config->packer_threads,
+				 packer_zone_count,
+				 id,
+				 zone_thread_count);
+		share_thread_ids(config->logical_threads,
+				 logical_zone_count,
+				 id,
+				 zone_thread_count);
+		share_thread_ids(config->physical_threads,
+				 physical_zone_count,
+				 id,
+				 zone_thread_count);
+		share_thread_ids(config->hash_zone_threads,
+				 hash_zone_count,
+				 id,
+				 zone_thread_count);
+		*config_ptr = config;
+		return VDO_SUCCESS;
+	}
+
+	assign_thread_ids(config->packer_threads, packer_zone_count, &id);
 	assign_thread_ids(config->logical_threads, logical_zone_count, &id);
 	assign_thread_ids(config->physical_threads, physical_zone_count, &id);
 	assign_thread_ids(config->hash_zone_threads, hash_zone_count, &id);
@@ -147,7 +220,7 @@ int make_thread_config(zone_count_t logical_zone_count,
 int make_one_thread_config(struct thread_config **config_ptr)
 {
 	struct thread_config *config;
-	int result = allocate_thread_config(1, 1, 1, 1, &config);
+	int result = allocate_thread_config(1, 1, 1, 1, 1, &config);
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
@@ -155,6 +228,7 @@ int make_one_thread_config(struct thread_config **config_ptr)
 	config->logical_threads[0] = 0;
 	config->physical_threads[0] = 0;
 	config->hash_zone_threads[0] = 0;
+	config->packer_threads[0] = 0;
 	*config_ptr = config;
 	return VDO_SUCCESS;
 }
@@ -168,15 +242,16 @@ int copy_thread_config(const struct thread_config *old_config,
 	int result = allocate_thread_config(old_config->logical_zone_count,
 					    old_config->physical_zone_count,
 					    old_config->hash_zone_count,
+					    old_config->packer_zone_count,
 					    old_config->base_thread_count,
 					    &config);
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
 
+	config->zone_thread_count = old_config->zone_thread_count;
 	config->admin_thread = old_config->admin_thread;
 	config->journal_thread = old_config->journal_thread;
-	config->packer_thread = old_config->packer_thread;
 	for (i = 0; i < config->logical_zone_count; i++) {
 		config->logical_threads[i] = old_config->logical_threads[i];
 	}
@@ -186,6 +261,9 @@ int copy_thread_config(const struct thread_config *old_config,
 	for (i = 0; i < config->hash_zone_count; i++) {
 		config->hash_zone_threads[i] = old_config->hash_zone_threads[i];
 	}
+	for (i = 0; i < config->packer_zone_count; i++) {
+		config->packer_threads[i] = old_config->packer_threads[i];
+	}
 
 	*config_ptr = config;
 	return VDO_SUCCESS;
@@ -205,6 +283,7 @@ void free_thread_config(struct thread_config **config_ptr)
 	FREE(config->logical_threads);
 	FREE(config->physical_threads);
 	FREE(config->hash_zone_threads);
+	FREE(config->packer_threads);
 	FREE(config);
 }
 
@@ -245,10 +324,26 @@ void get_vdo_thread_name(const struct thread_config *thread_config,
 		// thread.
 		snprintf(buffer, buffer_length, "adminQ");
 		return;
-	} else if (thread_id == thread_config->packer_thread) {
+	} else if (thread_config->zone_thread_count > 0) {
+		// Each shared thread serves zones of several types.
+		snprintf(buffer,
+			 buffer_length,
+			 "zoneQ%d",
+			 thread_id - thread_config->packer_threads[0]);
+		return;
+	} else if ((thread_config->packer_zone_count == 1) &&
+		   (thread_id == thread_config->packer_threads[0])) {
 		snprintf(buffer, buffer_length, "packerQ");
 		return;
 	}
+	if (get_zone_thread_name(thread_config->packer_threads,
+				 thread_config->packer_zone_count,
+				 thread_id,
+				 "packerQ",
+				 buffer,
+				 buffer_length)) {
+		return;
+	}
 	if (get_zone_thread_name(thread_config->logical_threads,
 				 thread_config->logical_zone_count,
 				 thread_id,
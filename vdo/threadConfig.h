@@ -30,23 +30,31 @@ struct thread_config {
 	zone_count_t logical_zone_count;
 	zone_count_t physical_zone_count;
 	zone_count_t hash_zone_count;
+	zone_count_t packer_zone_count;
 	thread_count_t base_thread_count;
+	/** The number of threads shared by the zones, or 0 if not shared */
+	thread_count_t zone_thread_count;
 	thread_id_t admin_thread;
 	thread_id_t journal_thread;
-	thread_id_t packer_thread;
 	thread_id_t *logical_threads;
 	thread_id_t *physical_threads;
 	thread_id_t *hash_zone_threads;
+	thread_id_t *packer_threads;
 };
 
 /**
  * Make a thread configuration. If both the logical zone count and the
  * physical zone count are set to 0, a one thread configuration will be
- * made.
+ * made. If the zone thread count is non-zero and smaller than the number of
+ * zones, the logical, physical, hash, and packer zones will share that many
+ * threads rather than each getting a thread of its own.
  *
  * @param [in]  logical_zone_count    The number of logical zones
  * @param [in]  physical_zone_count   The number of physical zones
  * @param [in]  hash_zone_count       The number of hash zones
+ * @param [in]  packer_zone_count     The number of packer zones (0 for one)
+ * @param [in]  zone_thread_count     The number of threads for the zones to
+ *                                    share (0 for one thread per zone)
  * @param [out] config_ptr            A pointer to hold the new thread
  *                                    configuration
  *
@@ -55,6 +63,8 @@ struct thread_config {
 int __must_check make_thread_config(zone_count_t logical_zone_count,
 				    zone_count_t physical_zone_count,
 				    zone_count_t hash_zone_count,
+				    zone_count_t packer_zone_count,
+				    thread_count_t zone_thread_count,
 				    struct thread_config **config_ptr);
 
 /**
@@ -150,17 +160,20 @@ get_journal_zone_thread(const struct thread_config *thread_config)
 }
 
 /**
- * Get the thread id for the packer zone.
+ * Get the thread id for a given packer zone.
  *
  * @param thread_config  the thread config
+ * @param packer_zone    the number of the packer zone
  *
- * @return the thread id for the packer zone
+ * @return the thread id for the given zone
  **/
-static inline
-thread_id_t __must_check
-get_packer_zone_thread(const struct thread_config *thread_config)
+static inline thread_id_t __must_check
+get_packer_zone_thread(const struct thread_config *thread_config,
+		       zone_count_t packer_zone)
 {
-	return thread_config->packer_thread;
+	ASSERT_LOG_ONLY((packer_zone < thread_config->packer_zone_count),
+			"packer zone valid");
+	return thread_config->packer_threads[packer_zone];
 }
 
 /**
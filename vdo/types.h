@@ -250,6 +250,7 @@ enum vio_priority {
 enum vdo_metadata_type {
 	VDO_METADATA_RECOVERY_JOURNAL = 1,
 	VDO_METADATA_SLAB_JOURNAL,
+	VDO_METADATA_COMPACT_RECOVERY_JOURNAL,
 } __packed;
 
 enum vdo_zone_type {
@@ -297,6 +298,17 @@ struct slab_config {
 	block_count_t slab_journal_scrubbing_threshold;
 } __packed;
 
+/**
+ * The algorithms which may be used to compute the chunk names by which data
+ * blocks are deduplicated. These values are recorded in the super block, so
+ * they must never be renumbered.
+ **/
+enum vdo_hash_algorithm {
+	VDO_HASH_MURMUR3_128 = 0,
+	VDO_HASH_SHA256 = 1,
+	VDO_HASH_ALGORITHM_COUNT,
+};
+
 /**
  * The configuration of the VDO service.
  **/
@@ -314,6 +326,7 @@ struct vdo_config {
 struct action_manager;
 struct allocating_vio;
 struct allocation_selector;
+struct allocation_stream;
 struct block_allocator;
 struct block_map;
 struct block_map_tree_zone;
@@ -333,9 +346,13 @@ struct logical_zones;
 struct pbn_lock;
 typedef struct physicalLayer PhysicalLayer;
 struct physical_zone;
+struct qos_class;
+struct qos_classes;
+struct read_cache;
 struct recovery_journal;
 struct read_only_notifier;
 struct ref_counts;
+struct request_governor;
 struct vdo_slab;
 struct slab_depot;
 struct slab_journal;
@@ -0,0 +1,149 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "permassert.h"
+
+#include "dataVIO.h"
+#include "kvio.h"
+#include "vio.h"
+
+/*
+ * The userspace replacements for the data path parts of dataKVIO.c. The
+ * harness drives the base components directly rather than through data_vios
+ * carrying user data, so there is no data to read, write, hash, compress or
+ * compare. The operations which would need data fail the data_vio.
+ */
+
+/**
+ * Fail a data_vio which has reached an operation the harness does not
+ * provide.
+ **/
+static void fail_data_vio(struct data_vio *data_vio, const char *operation)
+{
+	ASSERT_LOG_ONLY(false, "%s is not supported in userspace", operation);
+	continue_data_vio(data_vio, VDO_NOT_IMPLEMENTED);
+}
+
+/**********************************************************************/
+void hash_data_vio(struct data_vio *data_vio)
+{
+	fail_data_vio(data_vio, __func__);
+}
+
+/**********************************************************************/
+void check_for_duplication(struct data_vio *data_vio)
+{
+	fail_data_vio(data_vio, __func__);
+}
+
+/**********************************************************************/
+bool is_exempt_from_deduplication(struct data_vio *data_vio)
+{
+	return true;
+}
+
+/**********************************************************************/
+bool defer_deduplication(struct data_vio *data_vio)
+{
+	return false;
+}
+
+/**********************************************************************/
+void verify_duplication(struct data_vio *data_vio)
+{
+	fail_data_vio(data_vio, __func__);
+}
+
+/**********************************************************************/
+void update_dedupe_index(struct data_vio *data_vio)
+{
+	fail_data_vio(data_vio, __func__);
+}
+
+/**********************************************************************/
+void zero_data_vio(struct data_vio *data_vio)
+{
+}
+
+/**********************************************************************/
+void copy_data(struct data_vio *source, struct data_vio *destination)
+{
+	ASSERT_LOG_ONLY(false, "%s is not supported in userspace", __func__);
+}
+
+/**********************************************************************/
+void apply_partial_write(struct data_vio *data_vio)
+{
+	fail_data_vio(data_vio, __func__);
+}
+
+/**********************************************************************/
+void apply_combined_partial_write(struct data_vio *data_vio,
+				  struct data_vio *combined)
+{
+	fail_data_vio(data_vio, __func__);
+}
+
+/**********************************************************************/
+void acknowledge_data_vio(struct data_vio *data_vio)
+{
+}
+
+/**********************************************************************/
+void compress_data_vio(struct data_vio *data_vio)
+{
+	fail_data_vio(data_vio, __func__);
+}
+
+/**********************************************************************/
+void compress_data_vio_units(struct compression_units *units)
+{
+	unsigned int i;
+
+	for (i = 0; i < units->count; i++) {
+		units->units[i].size = 0;
+	}
+
+	enqueue_vdo_completion(&units->completion);
+}
+
+/**********************************************************************/
+void read_data_vio(struct data_vio *data_vio)
+{
+	fail_data_vio(data_vio, __func__);
+}
+
+/**********************************************************************/
+void write_data_vio(struct data_vio *data_vio)
+{
+	fail_data_vio(data_vio, __func__);
+}
+
+/**********************************************************************/
+bool compare_data_vios(struct data_vio *first, struct data_vio *second)
+{
+	return false;
+}
+
+/**********************************************************************/
+void write_compressed_block(struct vio *vio)
+{
+	ASSERT_LOG_ONLY(false, "%s is not supported in userspace", __func__);
+	continue_vio(vio, VDO_NOT_IMPLEMENTED);
+}
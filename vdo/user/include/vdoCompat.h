@@ -0,0 +1,900 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef VDO_COMPAT_H
+#define VDO_COMPAT_H
+
+/*
+ * The further kernel interfaces used by the VDO base sources, on top of the
+ * UDS userspace emulation in uds/user/include. The block layer, sysfs and
+ * device-mapper types exist only so that the shared headers compile; the
+ * harness never submits a bio or registers a kobject. Timers are not driven
+ * by a clock: they are queued, and the harness fires them when it has no
+ * other work, as if the timeout had just expired.
+ */
+
+#include <stdlib.h>
+
+#include "kernelCompat.h"
+
+#define __percpu
+#define __rcu
+#define __user
+#define __force
+#define __iomem
+#define __read_mostly
+#define __aligned(x) __attribute__((aligned(x)))
+#define ____cacheline_internodealigned_in_smp ____cacheline_aligned
+#define __cacheline_aligned_in_smp ____cacheline_aligned
+#define __same_type(a, b) \
+	__builtin_types_compatible_p(__typeof__(a), __typeof__(b))
+#define BUILD_BUG_ON(condition) \
+	((void) sizeof(char[1 - 2 * !!(condition)]))
+#define STATIC_ASSERT_COMPAT(condition) BUILD_BUG_ON(!(condition))
+#define WARN_ON(condition) unlikely(condition)
+#define WARN_ON_ONCE(condition) unlikely(condition)
+#define might_sleep()
+#define in_interrupt() 0
+#define preempt_disable() barrier()
+#define preempt_enable() barrier()
+#define local_irq_save(flags) ((void) (flags))
+#define local_irq_restore(flags) ((void) (flags))
+#define raw_smp_processor_id() 0
+#define smp_processor_id() 0
+#define num_online_cpus() 1
+#define get_cycles() ktime_get_ns()
+#define numa_node_id() 0
+#define NUMA_NO_NODE (-1)
+#define smp_mb__before_atomic() smp_mb()
+#define smp_mb__after_atomic() smp_mb()
+#define BITS_PER_LONG 64
+#define U8_MAX ((u8) ~0U)
+#define U16_MAX ((u16) ~0U)
+#define U32_MAX ((u32) ~0U)
+#define U64_MAX ((u64) ~0ULL)
+#define S64_MAX ((s64) (U64_MAX >> 1))
+#define clamp(val, lo, hi) min(max(val, lo), hi)
+#define clamp_t(type, val, lo, hi) \
+	min_t(type, max_t(type, val, lo), hi)
+#define __stringify_1(x) #x
+#define __stringify(x) __stringify_1(x)
+
+/*
+ * Memory allocation.
+ */
+#define GFP_KERNEL 0x01u
+#define GFP_NOIO 0x02u
+#define GFP_NOWAIT 0x04u
+#define GFP_ATOMIC 0x08u
+#define __GFP_NOWARN 0x10u
+#define __GFP_ZERO 0x20u
+#define __GFP_NORETRY 0x40u
+#define __GFP_RETRY_MAYFAIL 0x80u
+
+#define PAGE_SHIFT 12
+
+static inline int ilog2(uint64_t n);
+
+#define PAGE_ALIGN(size) (((size) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+static inline unsigned int get_order(size_t size)
+{
+	return (size <= PAGE_SIZE) ? 0 : ilog2((size - 1) >> PAGE_SHIFT) + 1;
+}
+
+/*
+ * There are no physically contiguous pages in userspace, so page
+ * allocation always fails and callers fall back to ordinary memory.
+ */
+struct page {
+	unsigned long flags;
+};
+
+static inline struct page *alloc_pages_node(int node __always_unused,
+					    gfp_t flags __always_unused,
+					    unsigned int order __always_unused)
+{
+	return NULL;
+}
+
+static inline void *page_address(const struct page *page __always_unused)
+{
+	return NULL;
+}
+
+static inline void split_page(struct page *page __always_unused,
+			      unsigned int order __always_unused)
+{
+}
+
+static inline void __free_page(struct page *page __always_unused)
+{
+}
+
+static inline void free_pages_exact(void *address __always_unused,
+				    size_t size __always_unused)
+{
+}
+
+static inline void *memchr_inv(const void *start, int c, size_t bytes)
+{
+	const unsigned char *p = start;
+	for (; bytes > 0; p++, bytes--) {
+		if (*p != (unsigned char) c) {
+			return (void *) p;
+		}
+	}
+	return NULL;
+}
+
+#define mutex_destroy(lock) pthread_mutex_destroy(&(lock)->mutex)
+
+struct kmem_cache {
+	size_t size;
+};
+
+static inline void *kmem_cache_zalloc(struct kmem_cache *cache,
+				      gfp_t flags __always_unused)
+{
+	return calloc(1, cache->size);
+}
+
+static inline void *kmem_cache_alloc(struct kmem_cache *cache,
+				     gfp_t flags __always_unused)
+{
+	return malloc(cache->size);
+}
+
+static inline void kmem_cache_free(struct kmem_cache *cache __always_unused,
+				   void *object)
+{
+	free(object);
+}
+
+static inline struct kmem_cache *
+kmem_cache_create(const char *name __always_unused,
+		  size_t size,
+		  size_t align __always_unused,
+		  unsigned long flags __always_unused,
+		  void (*ctor)(void *) __always_unused)
+{
+	struct kmem_cache *cache = malloc(sizeof(*cache));
+	if (cache != NULL) {
+		cache->size = size;
+	}
+	return cache;
+}
+
+static inline void kmem_cache_destroy(struct kmem_cache *cache)
+{
+	free(cache);
+}
+
+#define KMEM_CACHE(type, flags) \
+	kmem_cache_create(#type, sizeof(struct type), 0, flags, NULL)
+#define SLAB_HWCACHE_ALIGN 0
+
+/*
+ * Byte order; kernelCompat.h has already refused big-endian hosts.
+ */
+#define __cpu_to_le16(x) ((__u16) (x))
+#define __cpu_to_le32(x) ((__u32) (x))
+#define __cpu_to_le64(x) ((__u64) (x))
+#define __le16_to_cpu(x) ((__u16) (x))
+#define __le32_to_cpu(x) ((__u32) (x))
+#define __le64_to_cpu(x) ((__u64) (x))
+#define cpu_to_le16 __cpu_to_le16
+#define cpu_to_le32 __cpu_to_le32
+#define cpu_to_le64 __cpu_to_le64
+#define le16_to_cpu __le16_to_cpu
+#define le32_to_cpu __le32_to_cpu
+#define le64_to_cpu __le64_to_cpu
+
+/*
+ * Bitmaps, without atomicity.
+ */
+#define BITS_TO_LONGS(bits) DIV_ROUND_UP(bits, BITS_PER_LONG)
+#define BIT_WORD(bit) ((bit) / BITS_PER_LONG)
+#define BIT_MASK(bit) (1UL << ((bit) % BITS_PER_LONG))
+
+static inline bool test_bit(unsigned long bit, const unsigned long *map)
+{
+	return (map[BIT_WORD(bit)] & BIT_MASK(bit)) != 0;
+}
+
+static inline void __set_bit(unsigned long bit, unsigned long *map)
+{
+	map[BIT_WORD(bit)] |= BIT_MASK(bit);
+}
+
+static inline void __clear_bit(unsigned long bit, unsigned long *map)
+{
+	map[BIT_WORD(bit)] &= ~BIT_MASK(bit);
+}
+
+static inline unsigned long __ffs(unsigned long word)
+{
+	return __builtin_ctzl(word);
+}
+
+static inline unsigned long __fls(unsigned long word)
+{
+	return BITS_PER_LONG - 1 - __builtin_clzl(word);
+}
+
+static inline unsigned long find_next_bit_invert(const unsigned long *map,
+						 unsigned long size,
+						 unsigned long offset,
+						 unsigned long invert)
+{
+	while (offset < size) {
+		unsigned long word =
+			(map[BIT_WORD(offset)] ^ invert) &
+			(~0UL << (offset % BITS_PER_LONG));
+		if (word != 0) {
+			offset = (offset & ~(BITS_PER_LONG - 1UL)) +
+				 __ffs(word);
+			return min(offset, size);
+		}
+		offset = (offset | (BITS_PER_LONG - 1UL)) + 1;
+	}
+	return size;
+}
+
+#define find_next_bit(map, size, offset) \
+	find_next_bit_invert(map, size, offset, 0)
+#define find_next_zero_bit(map, size, offset) \
+	find_next_bit_invert(map, size, offset, ~0UL)
+#define find_first_bit(map, size) find_next_bit(map, size, 0)
+#define find_first_zero_bit(map, size) find_next_zero_bit(map, size, 0)
+
+static inline void bitmap_zero(unsigned long *map, unsigned long bits)
+{
+	memset(map, 0, BITS_TO_LONGS(bits) * sizeof(unsigned long));
+}
+
+static inline void bitmap_set(unsigned long *map,
+			      unsigned long start,
+			      unsigned long count)
+{
+	while (count-- > 0) {
+		__set_bit(start++, map);
+	}
+}
+
+static inline void bitmap_clear(unsigned long *map,
+				unsigned long start,
+				unsigned long count)
+{
+	while (count-- > 0) {
+		__clear_bit(start++, map);
+	}
+}
+
+/*
+ * Arithmetic.
+ */
+static inline bool is_power_of_2(unsigned long n)
+{
+	return ((n != 0) && ((n & (n - 1)) == 0));
+}
+
+static inline int ilog2(uint64_t n)
+{
+	return 63 - __builtin_clzll(n);
+}
+
+static inline unsigned long roundup_pow_of_two(unsigned long n)
+{
+	return (n <= 1) ? 1 : 1UL << (ilog2(n - 1) + 1);
+}
+
+static inline unsigned long rounddown_pow_of_two(unsigned long n)
+{
+	return 1UL << ilog2(n);
+}
+
+#define order_base_2(n) (((n) <= 1) ? 0 : ilog2((n) - 1) + 1)
+
+static inline uint64_t div_u64(uint64_t dividend, uint32_t divisor)
+{
+	return dividend / divisor;
+}
+
+static inline uint64_t div64_u64(uint64_t dividend, uint64_t divisor)
+{
+	return dividend / divisor;
+}
+
+static inline uint64_t div_u64_rem(uint64_t dividend,
+				   uint32_t divisor,
+				   uint32_t *remainder)
+{
+	*remainder = dividend % divisor;
+	return dividend / divisor;
+}
+
+#define do_div(n, base)						\
+	({							\
+		uint32_t __rem = (n) % (base);			\
+		(n) /= (base);					\
+		__rem;						\
+	})
+
+static inline uint64_t hash_64(uint64_t value, unsigned int bits)
+{
+	return (value * 0x61c8864680b583ebull) >> (64 - bits);
+}
+
+static inline uint32_t hash_32(uint32_t value, unsigned int bits)
+{
+	return (value * 0x61c88647u) >> (32 - bits);
+}
+
+uint32_t crc32(uint32_t crc, const void *buffer, size_t length);
+
+void list_sort(void *priv,
+	       struct list_head *head,
+	       int (*cmp)(void *priv,
+			  const struct list_head *a,
+			  const struct list_head *b));
+
+/*
+ * More list operations.
+ */
+static inline void list_add(struct list_head *entry, struct list_head *head)
+{
+	entry->next = head->next;
+	entry->prev = head;
+	head->next->prev = entry;
+	head->next = entry;
+}
+
+static inline void list_move_tail(struct list_head *entry,
+				  struct list_head *head)
+{
+	list_del(entry);
+	list_add_tail(entry, head);
+}
+
+static inline void list_move(struct list_head *entry, struct list_head *head)
+{
+	list_del(entry);
+	list_add(entry, head);
+}
+
+static inline bool list_is_singular(const struct list_head *head)
+{
+	return !list_empty(head) && (head->next == head->prev);
+}
+
+static inline void list_splice_tail_init(struct list_head *list,
+					 struct list_head *head)
+{
+	if (!list_empty(list)) {
+		struct list_head *first = list->next;
+		struct list_head *last = list->prev;
+		first->prev = head->prev;
+		head->prev->next = first;
+		last->next = head;
+		head->prev = last;
+		INIT_LIST_HEAD(list);
+	}
+}
+
+static inline void list_splice_tail(struct list_head *list,
+				    struct list_head *head)
+{
+	if (!list_empty(list)) {
+		struct list_head *first = list->next;
+		struct list_head *last = list->prev;
+		first->prev = head->prev;
+		head->prev->next = first;
+		last->next = head;
+		head->prev = last;
+	}
+}
+
+static inline void list_splice_init(struct list_head *list,
+				    struct list_head *head)
+{
+	if (!list_empty(list)) {
+		struct list_head *first = list->next;
+		struct list_head *last = list->prev;
+		last->next = head->next;
+		head->next->prev = last;
+		head->next = first;
+		first->prev = head;
+		INIT_LIST_HEAD(list);
+	}
+}
+
+#define list_first_entry(head, type, member) \
+	list_entry((head)->next, type, member)
+#define list_last_entry(head, type, member) \
+	list_entry((head)->prev, type, member)
+#define list_first_entry_or_null(head, type, member) \
+	(list_empty(head) ? NULL : list_first_entry(head, type, member))
+#define list_next_entry(pos, member) \
+	list_entry((pos)->member.next, __typeof__(*(pos)), member)
+#define list_for_each(pos, head) \
+	for (pos = (head)->next; pos != (head); pos = pos->next)
+#define list_for_each_prev(pos, head) \
+	for (pos = (head)->prev; pos != (head); pos = pos->prev)
+#define list_prev_entry(pos, member) \
+	list_entry((pos)->member.prev, __typeof__(*(pos)), member)
+#define list_for_each_entry_reverse(pos, head, member)			\
+	for (pos = list_last_entry(head, __typeof__(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = list_prev_entry(pos, member))
+#define list_for_each_safe(pos, n, head)				\
+	for (pos = (head)->next, n = pos->next; pos != (head);		\
+	     pos = n, n = pos->next)
+#define list_for_each_entry_safe(pos, n, head, member)			\
+	for (pos = list_first_entry(head, __typeof__(*pos), member),	\
+	     n = list_next_entry(pos, member);				\
+	     &pos->member != (head);					\
+	     pos = n, n = list_next_entry(n, member))
+
+/*
+ * Sequence counts, for a single-threaded harness or for readers which
+ * tolerate retries.
+ */
+typedef struct {
+	unsigned int sequence;
+} seqcount_t;
+
+static inline void seqcount_init(seqcount_t *s)
+{
+	s->sequence = 0;
+}
+
+static inline unsigned int read_seqcount_begin(const seqcount_t *s)
+{
+	unsigned int sequence;
+	while ((sequence = smp_load_acquire(&s->sequence)) & 1) {
+		cpu_relax();
+	}
+	return sequence;
+}
+
+static inline bool read_seqcount_retry(const seqcount_t *s,
+				       unsigned int start)
+{
+	smp_rmb();
+	return READ_ONCE(s->sequence) != start;
+}
+
+static inline void write_seqcount_begin(seqcount_t *s)
+{
+	WRITE_ONCE(s->sequence, s->sequence + 1);
+	smp_wmb();
+}
+
+static inline void write_seqcount_end(seqcount_t *s)
+{
+	smp_wmb();
+	WRITE_ONCE(s->sequence, s->sequence + 1);
+}
+
+#define raw_write_seqcount_begin write_seqcount_begin
+#define raw_write_seqcount_end write_seqcount_end
+
+static inline unsigned int raw_read_seqcount(const seqcount_t *s)
+{
+	return smp_load_acquire(&s->sequence);
+}
+
+/*
+ * Completions, for the admin thread to wait on the vdo threads.
+ */
+struct completion {
+	struct semaphore wait;
+};
+
+static inline void init_completion(struct completion *completion)
+{
+	sema_init(&completion->wait, 0);
+}
+
+static inline void reinit_completion(struct completion *completion)
+{
+	sema_init(&completion->wait, 0);
+}
+
+static inline void complete(struct completion *completion)
+{
+	up(&completion->wait);
+}
+
+static inline int
+wait_for_completion_interruptible(struct completion *completion)
+{
+	return down_interruptible(&completion->wait);
+}
+
+static inline void wait_for_completion(struct completion *completion)
+{
+	while (down_interruptible(&completion->wait) != 0) {
+	}
+}
+
+/*
+ * Timers. A timer is queued when it is armed, and fired by the harness
+ * (see vdo_user_fire_timer()) when it runs out of other work.
+ */
+struct timer_list {
+	struct list_head entry;
+	void (*function)(struct timer_list *timer);
+	unsigned long expires;
+	bool pending;
+};
+
+#define from_timer(var, timer, field) \
+	container_of(timer, __typeof__(*var), field)
+
+void timer_setup(struct timer_list *timer,
+		 void (*function)(struct timer_list *timer),
+		 unsigned int flags);
+int mod_timer(struct timer_list *timer, unsigned long expires);
+int del_timer_sync(struct timer_list *timer);
+#define del_timer(timer) del_timer_sync(timer)
+#define timer_pending(timer) ((timer)->pending)
+
+// Advanced by the harness as it runs; milliseconds, like HZ.
+extern unsigned long jiffies;
+#define time_after(a, b) ((long) ((b) - (a)) < 0)
+#define time_before(a, b) time_after(b, a)
+#define msecs_to_jiffies(msecs) ((unsigned long) (msecs))
+#define usecs_to_jiffies(usecs) ((unsigned long) (usecs) / 1000)
+
+enum hrtimer_restart {
+	HRTIMER_NORESTART,
+	HRTIMER_RESTART,
+};
+
+enum hrtimer_mode {
+	HRTIMER_MODE_REL,
+	HRTIMER_MODE_REL_SOFT,
+};
+
+struct hrtimer {
+	struct timer_list timer;
+	enum hrtimer_restart (*function)(struct hrtimer *timer);
+};
+
+void hrtimer_init(struct hrtimer *timer,
+		  clockid_t clock,
+		  enum hrtimer_mode mode);
+void hrtimer_start(struct hrtimer *timer,
+		   ktime_t delay,
+		   enum hrtimer_mode mode);
+int hrtimer_cancel(struct hrtimer *timer);
+
+/*
+ * Sysfs, which the harness does not populate.
+ */
+struct attribute {
+	const char *name;
+	unsigned short mode;
+};
+
+struct kobject;
+
+struct sysfs_ops {
+	ssize_t (*show)(struct kobject *kobj,
+			struct attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct kobject *kobj,
+			 struct attribute *attr,
+			 const char *buf,
+			 size_t length);
+};
+
+struct kobj_type {
+	void (*release)(struct kobject *kobj);
+	const struct sysfs_ops *sysfs_ops;
+	struct attribute **default_attrs;
+};
+
+struct kobject {
+	const char *name;
+	struct kobject *parent;
+	struct kobj_type *ktype;
+};
+
+static inline void kobject_init(struct kobject *kobj, struct kobj_type *ktype)
+{
+	memset(kobj, 0, sizeof(*kobj));
+	kobj->ktype = ktype;
+}
+
+static inline int kobject_add(struct kobject *kobj,
+			      struct kobject *parent,
+			      const char *fmt __always_unused,
+			      ...)
+{
+	kobj->parent = parent;
+	return 0;
+}
+
+static inline void kobject_put(struct kobject *kobj)
+{
+	if ((kobj != NULL) && (kobj->ktype != NULL) &&
+	    (kobj->ktype->release != NULL)) {
+		kobj->ktype->release(kobj);
+	}
+}
+
+static inline struct kobject *
+kobject_create_and_add(const char *name __always_unused,
+		       struct kobject *parent __always_unused)
+{
+	return NULL;
+}
+
+/*
+ * Block layer types. The harness does no block I/O, so these carry only
+ * the fields which the shared headers and inline functions touch.
+ */
+typedef uint8_t blk_status_t;
+typedef uint8_t uuid_t[16];
+
+#define BLK_STS_OK 0
+#define BLK_STS_IOERR 10
+#define READ 0
+#define WRITE 1
+
+enum req_opf {
+	REQ_OP_READ = 0,
+	REQ_OP_WRITE = 1,
+	REQ_OP_FLUSH = 2,
+	REQ_OP_DISCARD = 3,
+	REQ_OP_WRITE_ZEROES = 9,
+};
+
+#define REQ_OP_BITS 8
+#define REQ_OP_MASK ((1 << REQ_OP_BITS) - 1)
+#define REQ_FAILFAST_DEV (1u << 8)
+#define REQ_SYNC (1u << 11)
+#define REQ_META (1u << 12)
+#define REQ_PRIO (1u << 13)
+#define REQ_NOMERGE (1u << 14)
+#define REQ_IDLE (1u << 15)
+#define REQ_FUA (1u << 17)
+#define REQ_PREFLUSH (1u << 18)
+#define REQ_RAHEAD (1u << 19)
+#define REQ_BACKGROUND (1u << 20)
+
+struct bio;
+typedef void bio_end_io_t(struct bio *bio);
+
+struct bvec_iter {
+	sector_t bi_sector;
+	unsigned int bi_size;
+	unsigned int bi_idx;
+	unsigned int bi_bvec_done;
+};
+
+struct bio_vec {
+	struct page *bv_page;
+	unsigned int bv_len;
+	unsigned int bv_offset;
+};
+
+struct block_device;
+
+struct bio {
+	struct bio *bi_next;
+	struct block_device *bi_bdev;
+	unsigned int bi_opf;
+	blk_status_t bi_status;
+	struct bvec_iter bi_iter;
+	bio_end_io_t *bi_end_io;
+	void *bi_private;
+	unsigned short bi_vcnt;
+	unsigned short bi_max_vecs;
+	struct bio_vec *bi_io_vec;
+	struct bio_vec bi_inline_vecs[];
+};
+
+struct bio_list {
+	struct bio *head;
+	struct bio *tail;
+};
+
+struct bio_set {
+	void *unused;
+};
+
+static inline unsigned int bio_op(const struct bio *bio)
+{
+	return bio->bi_opf & REQ_OP_MASK;
+}
+
+static inline int bio_data_dir(const struct bio *bio)
+{
+	return (bio_op(bio) & 1) ? WRITE : READ;
+}
+
+static inline void bio_list_init(struct bio_list *list)
+{
+	list->head = list->tail = NULL;
+}
+
+static inline bool bio_list_empty(const struct bio_list *list)
+{
+	return list->head == NULL;
+}
+
+static inline void bio_list_add(struct bio_list *list, struct bio *bio)
+{
+	bio->bi_next = NULL;
+	if (list->tail != NULL) {
+		list->tail->bi_next = bio;
+	} else {
+		list->head = bio;
+	}
+	list->tail = bio;
+}
+
+static inline struct bio *bio_list_pop(struct bio_list *list)
+{
+	struct bio *bio = list->head;
+	if (bio != NULL) {
+		list->head = bio->bi_next;
+		if (list->head == NULL) {
+			list->tail = NULL;
+		}
+		bio->bi_next = NULL;
+	}
+	return bio;
+}
+
+static inline void bio_list_merge(struct bio_list *list,
+				  struct bio_list *other)
+{
+	if (other->head == NULL) {
+		return;
+	}
+	if (list->tail != NULL) {
+		list->tail->bi_next = other->head;
+	} else {
+		list->head = other->head;
+	}
+	list->tail = other->tail;
+}
+
+static inline void bio_list_merge_head(struct bio_list *list,
+				       struct bio_list *other)
+{
+	if (other->head == NULL) {
+		return;
+	}
+	if (list->head != NULL) {
+		other->tail->bi_next = list->head;
+	} else {
+		list->tail = other->tail;
+	}
+	list->head = other->head;
+}
+
+#define bio_list_for_each(bio, bl) \
+	for (bio = (bl)->head; bio != NULL; bio = bio->bi_next)
+
+static inline unsigned int bio_list_size(const struct bio_list *list)
+{
+	unsigned int size = 0;
+	struct bio *bio;
+
+	bio_list_for_each(bio, list) {
+		size++;
+	}
+	return size;
+}
+
+static inline unsigned int bio_sectors(const struct bio *bio)
+{
+	return bio->bi_iter.bi_size >> 9;
+}
+
+static inline int blk_status_to_errno(blk_status_t status)
+{
+	return (status == BLK_STS_OK) ? 0 : -EIO;
+}
+
+static inline blk_status_t errno_to_blk_status(int error)
+{
+	return (error == 0) ? BLK_STS_OK : BLK_STS_IOERR;
+}
+
+#define SECTOR_TO_BYTES_SHIFT 9
+#define to_bytes(sectors) ((uint64_t) (sectors) << SECTOR_TO_BYTES_SHIFT)
+
+void bio_endio(struct bio *bio);
+void submit_bio_noacct(struct bio *bio);
+int submit_bio_wait(struct bio *bio);
+
+static inline void bio_set_dev(struct bio *bio, struct block_device *bdev)
+{
+	bio->bi_bdev = bdev;
+}
+
+#define QUEUE_FLAG_DISCARD 14
+#define QUEUE_FLAG_WC 17
+
+struct queue_limits {
+	unsigned int io_opt;
+};
+
+struct request_queue {
+	unsigned long queue_flags;
+	struct queue_limits limits;
+};
+
+struct inode {
+	loff_t i_size;
+};
+
+struct block_device {
+	struct request_queue *bd_queue;
+	struct inode *bd_inode;
+};
+
+struct dm_dev {
+	struct block_device *bdev;
+	char name[16];
+};
+
+static inline struct request_queue *bdev_get_queue(struct block_device *bdev)
+{
+	return bdev->bd_queue;
+}
+
+static inline unsigned int bdev_io_opt(struct block_device *bdev)
+{
+	return bdev_get_queue(bdev)->limits.io_opt;
+}
+
+static inline loff_t i_size_read(const struct inode *inode)
+{
+	return inode->i_size;
+}
+
+#define blk_queue_discard(q) test_bit(QUEUE_FLAG_DISCARD, &(q)->queue_flags)
+
+struct gendisk;
+struct dm_target;
+struct dm_table;
+struct mapped_device;
+struct crypto_shash;
+struct shash_desc;
+
+/*
+ * Static tracepoints compile to nothing.
+ */
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...) args
+#define DECLARE_EVENT_CLASS(name, proto, args, tstruct, assign, print)
+#define DEFINE_EVENT(class, name, proto, args) \
+	static inline void trace_##name(proto) {}
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+	static inline void trace_##name(proto) {}
+
+#endif // VDO_COMPAT_H
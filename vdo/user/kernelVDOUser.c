@@ -0,0 +1,301 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "userVDO.h"
+
+#include "memoryAlloc.h"
+#include "permassert.h"
+
+#include "completion.h"
+#include "deviceConfig.h"
+#include "kernelVDO.h"
+#include "readOnlyNotifier.h"
+#include "threadConfig.h"
+#include "vdoInternal.h"
+#include "workQueue.h"
+
+/*
+ * The userspace replacements for the thread and work queue parts of
+ * kernelVDO.c and workQueue.c.
+ */
+
+/**
+ * The work queued to one vdo thread, in the order in which it was queued,
+ * linked through the work items' funnel queue entries.
+ **/
+struct vdo_work_queue {
+	struct funnel_queue_entry *oldest;
+	struct funnel_queue_entry *newest;
+};
+
+// The thread whose work is being run, if any.
+static struct vdo_thread *current_thread;
+
+/**********************************************************************/
+void setup_work_item(struct vdo_work_item *item,
+		     vdo_work_function work,
+		     void *stats_function,
+		     unsigned int action)
+{
+	ASSERT_LOG_ONLY(item->my_queue == NULL,
+			"setup_work_item not called on enqueued work item");
+	item->work = work;
+	item->stats_function =
+		((stats_function == NULL) ? work : stats_function);
+	item->stat_table_index = 0;
+	item->action = action;
+	item->my_queue = NULL;
+}
+
+/**********************************************************************/
+void count_work_queue_dispatch(struct vdo_work_queue *queue, bool direct)
+{
+}
+
+/**
+ * Add a work item to the end of a thread's queue.
+ *
+ * @param thread  The thread
+ * @param item    The work item to enqueue
+ **/
+static void enqueue_user_work(struct vdo_thread *thread,
+			      struct vdo_work_item *item)
+{
+	struct vdo_work_queue *queue = thread->request_queue;
+
+	BUG_ON(item->my_queue != NULL);
+	item->my_queue = queue;
+	item->work_queue_entry_link.next = NULL;
+	if (queue->newest == NULL) {
+		queue->oldest = &item->work_queue_entry_link;
+	} else {
+		queue->newest->next = &item->work_queue_entry_link;
+	}
+	queue->newest = &item->work_queue_entry_link;
+}
+
+/**
+ * Remove the oldest work item from a thread's queue.
+ *
+ * @param thread  The thread
+ *
+ * @return The work item, or NULL if the queue is empty
+ **/
+static struct vdo_work_item *dequeue_user_work(struct vdo_thread *thread)
+{
+	struct vdo_work_queue *queue = thread->request_queue;
+	struct vdo_work_item *item;
+
+	if (queue->oldest == NULL) {
+		return NULL;
+	}
+
+	item = container_of(queue->oldest, struct vdo_work_item,
+			    work_queue_entry_link);
+	queue->oldest = queue->oldest->next;
+	if (queue->oldest == NULL) {
+		queue->newest = NULL;
+	}
+
+	item->my_queue = NULL;
+	return item;
+}
+
+/**********************************************************************/
+int get_vdo_thread_node(struct vdo *vdo, thread_id_t thread_id)
+{
+	return NUMA_NO_NODE;
+}
+
+/**********************************************************************/
+void enqueue_vdo_work(struct vdo *vdo,
+		      struct vdo_work_item *item,
+		      thread_id_t thread_id)
+{
+	BUG_ON(thread_id >= vdo->initialized_thread_count);
+	enqueue_user_work(&vdo->threads[thread_id], item);
+}
+
+/**********************************************************************/
+static void vdo_enqueue_work(struct vdo_work_item *work_item)
+{
+	run_vdo_completion_callback(container_of(work_item,
+				    struct vdo_completion,
+				    work_item));
+}
+
+/**********************************************************************/
+void enqueue_vdo_completion(struct vdo_completion *completion)
+{
+	struct vdo *vdo = completion->vdo;
+	thread_id_t thread_id = completion->callback_thread_id;
+
+	if (ASSERT(thread_id < vdo->initialized_thread_count,
+		   "thread_id %u (completion type %d) is less than thread count %u",
+		   thread_id,
+		   completion->type,
+		   vdo->initialized_thread_count) != UDS_SUCCESS) {
+		BUG();
+	}
+
+	setup_work_item(&completion->work_item, vdo_enqueue_work,
+			completion->callback, REQ_Q_ACTION_COMPLETION);
+	enqueue_user_work(&vdo->threads[thread_id], &completion->work_item);
+}
+
+/**********************************************************************/
+void enqueue_vdo_completions(struct vdo_completion *completions[],
+			     unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		enqueue_vdo_completion(completions[i]);
+	}
+}
+
+/**********************************************************************/
+struct vdo_thread *get_current_vdo_thread(void)
+{
+	return current_thread;
+}
+
+/**********************************************************************/
+thread_id_t get_callback_thread_id(void)
+{
+	struct vdo_thread *thread = get_current_vdo_thread();
+
+	return ((thread == NULL) ? INVALID_THREAD_ID : thread->thread_id);
+}
+
+/**********************************************************************/
+uint64_t run_user_vdo(struct vdo *vdo)
+{
+	uint64_t count = 0;
+
+	for (;;) {
+		bool ran = false;
+		thread_id_t id;
+
+		for (id = 0; id < vdo->initialized_thread_count; id++) {
+			struct vdo_thread *thread = &vdo->threads[id];
+			struct vdo_work_item *item = dequeue_user_work(thread);
+			if (item == NULL) {
+				continue;
+			}
+
+			current_thread = thread;
+			item->work(item);
+			current_thread = NULL;
+			ran = true;
+			count++;
+		}
+
+		if (!ran && !vdo_user_fire_timer()) {
+			return count;
+		}
+	}
+}
+
+/**********************************************************************/
+int make_user_vdo(block_count_t block_count, struct vdo **vdo_ptr)
+{
+	struct vdo *vdo;
+	thread_id_t id;
+	int result = ALLOCATE(1, struct vdo, __func__, &vdo);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	result = make_one_thread_config(&vdo->thread_config);
+	if (result != VDO_SUCCESS) {
+		free_user_vdo(&vdo);
+		return result;
+	}
+
+	result = ALLOCATE(vdo->thread_config->base_thread_count,
+			  struct vdo_thread, "vdo threads", &vdo->threads);
+	if (result != VDO_SUCCESS) {
+		free_user_vdo(&vdo);
+		return result;
+	}
+
+	for (id = 0; id < vdo->thread_config->base_thread_count; id++) {
+		struct vdo_thread *thread = &vdo->threads[id];
+		thread->vdo = vdo;
+		thread->thread_id = id;
+		result = ALLOCATE(1, struct vdo_work_queue, "vdo work queue",
+				  &thread->request_queue);
+		if (result != VDO_SUCCESS) {
+			free_user_vdo(&vdo);
+			return result;
+		}
+		vdo->initialized_thread_count++;
+	}
+
+	result = ALLOCATE(1, struct device_config, "device config",
+			  &vdo->device_config);
+	if (result != VDO_SUCCESS) {
+		free_user_vdo(&vdo);
+		return result;
+	}
+
+	vdo->device_config->compression_format = VDO_COMPRESSION_LZ4;
+	result = make_read_only_notifier(false, vdo->thread_config, vdo,
+					 &vdo->read_only_notifier);
+	if (result != VDO_SUCCESS) {
+		free_user_vdo(&vdo);
+		return result;
+	}
+
+	result = make_user_layer(block_count, &vdo->layer);
+	if (result != VDO_SUCCESS) {
+		free_user_vdo(&vdo);
+		return result;
+	}
+
+	*vdo_ptr = vdo;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void free_user_vdo(struct vdo **vdo_ptr)
+{
+	struct vdo *vdo = *vdo_ptr;
+	thread_id_t id;
+
+	if (vdo == NULL) {
+		return;
+	}
+
+	if (vdo->layer != NULL) {
+		vdo->layer->destroy(&vdo->layer);
+	}
+
+	free_read_only_notifier(&vdo->read_only_notifier);
+	FREE(vdo->device_config);
+	for (id = 0; id < vdo->initialized_thread_count; id++) {
+		FREE(vdo->threads[id].request_queue);
+	}
+
+	FREE(vdo->threads);
+	free_thread_config(&vdo->thread_config);
+	FREE(vdo);
+	*vdo_ptr = NULL;
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "userVDO.h"
+
+#include "memoryAlloc.h"
+#include "permassert.h"
+
+#include "bio.h"
+#include "completion.h"
+#include "ioSubmitter.h"
+#include "kvio.h"
+#include "statusCodes.h"
+#include "vdoInternal.h"
+#include "vio.h"
+
+/*
+ * The in-memory physical layer, and the userspace replacements for the parts
+ * of kvio.c and bio.c which submit metadata vios to it.
+ */
+
+struct user_layer {
+	PhysicalLayer common;
+	block_count_t block_count;
+	char *blocks;
+	uint64_t reads;
+	uint64_t writes;
+};
+
+/**********************************************************************/
+static inline struct user_layer *as_user_layer(PhysicalLayer *layer)
+{
+	return container_of(layer, struct user_layer, common);
+}
+
+/**
+ * Implements layer_destructor.
+ **/
+static void destroy_user_layer(PhysicalLayer **layer_ptr)
+{
+	struct user_layer *layer = as_user_layer(*layer_ptr);
+
+	FREE(layer->blocks);
+	FREE(layer);
+	*layer_ptr = NULL;
+}
+
+/**
+ * Implements block_count_getter.
+ **/
+static block_count_t get_user_layer_block_count(PhysicalLayer *header)
+{
+	return as_user_layer(header)->block_count;
+}
+
+/**
+ * Implements buffer_allocator.
+ **/
+static int allocate_user_io_buffer(PhysicalLayer *header,
+				   size_t bytes,
+				   const char *why,
+				   char **buffer_ptr)
+{
+	return ALLOCATE(bytes, char, why, buffer_ptr);
+}
+
+/**
+ * Get the address of a range of blocks in a user layer, checking that the
+ * range is in the layer.
+ *
+ * @param layer        The layer
+ * @param start_block  The first block of the range
+ * @param block_count  The number of blocks in the range
+ *
+ * @return The address of the first block, or NULL if the range is not in
+ *         the layer
+ **/
+static char *get_user_blocks(struct user_layer *layer,
+			     physical_block_number_t start_block,
+			     size_t block_count)
+{
+	if ((start_block > layer->block_count) ||
+	    (block_count > (layer->block_count - start_block))) {
+		return NULL;
+	}
+
+	return layer->blocks + (start_block * VDO_BLOCK_SIZE);
+}
+
+/**
+ * Implements extent_reader.
+ **/
+static int user_reader(PhysicalLayer *header,
+		       physical_block_number_t start_block,
+		       size_t block_count,
+		       char *buffer)
+{
+	struct user_layer *layer = as_user_layer(header);
+	char *blocks = get_user_blocks(layer, start_block, block_count);
+
+	if (blocks == NULL) {
+		return VDO_OUT_OF_RANGE;
+	}
+
+	memcpy(buffer, blocks, block_count * VDO_BLOCK_SIZE);
+	layer->reads += block_count;
+	return VDO_SUCCESS;
+}
+
+/**
+ * Implements extent_writer.
+ **/
+static int user_writer(PhysicalLayer *header,
+		       physical_block_number_t start_block,
+		       size_t block_count,
+		       char *buffer)
+{
+	struct user_layer *layer = as_user_layer(header);
+	char *blocks = get_user_blocks(layer, start_block, block_count);
+
+	if (blocks == NULL) {
+		return VDO_OUT_OF_RANGE;
+	}
+
+	memcpy(blocks, buffer, block_count * VDO_BLOCK_SIZE);
+	layer->writes += block_count;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+int make_user_layer(block_count_t block_count, PhysicalLayer **layer_ptr)
+{
+	struct user_layer *layer;
+	int result = ALLOCATE(1, struct user_layer, __func__, &layer);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	result = ALLOCATE(block_count * VDO_BLOCK_SIZE, char, "layer blocks",
+			  &layer->blocks);
+	if (result != VDO_SUCCESS) {
+		FREE(layer);
+		return result;
+	}
+
+	layer->block_count = block_count;
+	layer->common.destroy = destroy_user_layer;
+	layer->common.getBlockCount = get_user_layer_block_count;
+	layer->common.allocateIOBuffer = allocate_user_io_buffer;
+	layer->common.reader = user_reader;
+	layer->common.writer = user_writer;
+	*layer_ptr = &layer->common;
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+void get_user_layer_io_counts(PhysicalLayer *header,
+			      uint64_t *reads_ptr,
+			      uint64_t *writes_ptr)
+{
+	struct user_layer *layer = as_user_layer(header);
+
+	*reads_ptr = layer->reads;
+	*writes_ptr = layer->writes;
+}
+
+/**********************************************************************/
+void count_bios(struct atomic_bio_stats *bio_stats, struct bio *bio)
+{
+}
+
+/**
+ * There are no bio threads, so bio work is done as soon as it is queued.
+ **/
+void enqueue_bio_work_item(struct io_submitter *io_submitter,
+			   struct vdo_work_item *work_item)
+{
+	work_item->work(work_item);
+}
+
+/**********************************************************************/
+int create_bio(struct bio **bio_ptr)
+{
+	return ALLOCATE(1, struct bio, "bio", bio_ptr);
+}
+
+/**********************************************************************/
+void destroy_vio(struct vio **vio_ptr)
+{
+	struct vio *vio = *vio_ptr;
+
+	if (vio == NULL) {
+		return;
+	}
+
+	BUG_ON(is_data_vio(vio));
+	FREE(vio->bio);
+	FREE(vio);
+	*vio_ptr = NULL;
+}
+
+/**
+ * Finish the I/O of a vio. As when a bio completes, the vio's callback is
+ * always enqueued, never run from the submitter's stack.
+ **/
+void continue_vio(struct vio *vio, int error)
+{
+	if (unlikely(error != VDO_SUCCESS)) {
+		set_vdo_completion_result(vio_as_completion(vio), error);
+	}
+
+	enqueue_vdo_completion(vio_as_completion(vio));
+}
+
+/**********************************************************************/
+void submit_metadata_vio(struct vio *vio)
+{
+	struct user_layer *layer = as_user_layer(vio->vdo->layer);
+	int result;
+
+	if (is_empty_flush_vio(vio)) {
+		continue_vio(vio, VDO_SUCCESS);
+		return;
+	}
+
+	if (is_read_vio(vio)) {
+		result = user_reader(&layer->common, vio->physical, 1,
+				     vio->data);
+	} else {
+		result = user_writer(&layer->common, vio->physical, 1,
+				     vio->data);
+	}
+
+	continue_vio(vio, result);
+}
+
+/**********************************************************************/
+void submit_discard_vio(struct vio *vio, block_count_t count)
+{
+	struct user_layer *layer = as_user_layer(vio->vdo->layer);
+	char *blocks = get_user_blocks(layer, vio->physical, count);
+
+	if (blocks == NULL) {
+		continue_vio(vio, VDO_OUT_OF_RANGE);
+		return;
+	}
+
+	memset(blocks, 0, count * VDO_BLOCK_SIZE);
+	continue_vio(vio, VDO_SUCCESS);
+}
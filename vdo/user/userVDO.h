@@ -0,0 +1,99 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#ifndef USER_VDO_H
+#define USER_VDO_H
+
+#include "physicalLayer.h"
+#include "types.h"
+
+/*
+ * The userspace harness for the VDO base code. A user vdo has the threads,
+ * thread configuration, read-only notifier and physical layer which the base
+ * components expect of a vdo, and nothing else; callers construct the
+ * components they want to exercise on top of it.
+ *
+ * There are no real threads. Each vdo thread has a queue of work, and
+ * run_user_vdo() runs the queued work of all the threads in turn on the
+ * calling thread, which stands in for whichever vdo thread the work was
+ * queued to. Timers fire only when there is no other work to do.
+ */
+
+/**
+ * Make an in-memory physical layer. Metadata vios submitted for a vdo whose
+ * layer this is read and write the memory when they are submitted, and
+ * their callbacks are enqueued as if the I/O had completed on a bio thread.
+ *
+ * @param [in]  block_count  The size of the layer in blocks
+ * @param [out] layer_ptr    A pointer to hold the new layer
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check make_user_layer(block_count_t block_count,
+				 PhysicalLayer **layer_ptr);
+
+/**
+ * Get the number of metadata reads and writes an in-memory layer has done.
+ *
+ * @param [in]  layer       The layer
+ * @param [out] reads_ptr   A pointer to hold the number of reads
+ * @param [out] writes_ptr  A pointer to hold the number of writes
+ **/
+void get_user_layer_io_counts(PhysicalLayer *layer,
+			      uint64_t *reads_ptr,
+			      uint64_t *writes_ptr);
+
+/**
+ * Make a vdo with a one thread configuration and an in-memory layer.
+ *
+ * @param [in]  block_count  The size of the layer in blocks
+ * @param [out] vdo_ptr      A pointer to hold the new vdo
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check make_user_vdo(block_count_t block_count,
+			       struct vdo **vdo_ptr);
+
+/**
+ * Free a vdo made by make_user_vdo(), and its layer, and null out the
+ * reference to it. The components built on it must already be freed.
+ *
+ * @param vdo_ptr  The reference to the vdo to free
+ **/
+void free_user_vdo(struct vdo **vdo_ptr);
+
+/**
+ * Run the work queued to the threads of a vdo, and any timers, until there
+ * is none left.
+ *
+ * @param vdo  The vdo
+ *
+ * @return The number of work items run
+ **/
+uint64_t run_user_vdo(struct vdo *vdo);
+
+/**
+ * Fire the armed timer which expires first, advancing jiffies to its expiry
+ * if it is in the future.
+ *
+ * @return <code>true</code> if there was an armed timer
+ **/
+bool vdo_user_fire_timer(void);
+
+#endif // USER_VDO_H
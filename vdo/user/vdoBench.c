@@ -0,0 +1,1856 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+/*
+ * Microbenchmarks for the VDO base data structures, run in userspace on an
+ * in-memory physical layer. Each test prints the number of operations it
+ * timed and the mean cost of one. The asynchronous tests keep a fixed number
+ * of operations in flight, and their times include the metadata I/O to the
+ * in-memory layer and the work run on the emulated vdo thread.
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+
+#include "logger.h"
+#include "memoryAlloc.h"
+#include "numUtils.h"
+#include "threadDevice.h"
+#include "threads.h"
+#include "timeUtils.h"
+#include "util/funnelQueue.h"
+
+#include "batchProcessor.h"
+#include "blockAllocatorInternals.h"
+#include "blockMap.h"
+#include "blockMapInternals.h"
+#include "completion.h"
+#include "dataVIO.h"
+#include "fixedLayout.h"
+#include "heap.h"
+#include "intMap.h"
+#include "logicalZone.h"
+#include "packerInternals.h"
+#include "pointerMap.h"
+#include "priorityTable.h"
+#include "readCache.h"
+#include "recoveryJournal.h"
+#include "refCountsInternals.h"
+#include "slab.h"
+#include "slabDepotInternals.h"
+#include "slabSummary.h"
+#include "statusCodes.h"
+#include "threadConfig.h"
+#include "vdoInternal.h"
+#include "vdoPageCache.h"
+#include "waitQueue.h"
+
+#include "userVDO.h"
+
+enum {
+	DEFAULT_CACHE_PAGES = 1024,
+	DEFAULT_FILL_PERCENT = 90,
+	DEFAULT_OPERATIONS = 1 << 20,
+	DEFAULT_SLAB_BLOCKS = 1 << 19,
+	DEFAULT_THREADS = 4,
+	BLOCK_MAP_MAXIMUM_AGE = 128,
+	BIN_SHUFFLE_INTERVAL = 4096,
+	JOURNAL_BLOCKS = 1024,
+	MISS_FACTOR = 4,
+	QUEUE_DEPTH = 64,
+	RANDOM_SEED = 0x5eed,
+	VDO_NONCE = 0xdecaf,
+};
+
+struct bench_options {
+	unsigned long operations;
+	block_count_t slab_blocks;
+	unsigned int fill_percent;
+	page_count_t cache_pages;
+	block_count_t input_bins;
+	unsigned int threads;
+};
+
+/**
+ * A user vdo with a recovery journal, a block map and logical zones, which
+ * are the components needed to journal and map writes.
+ **/
+struct mapping_harness {
+	struct vdo *vdo;
+	struct fixed_layout *layout;
+	/** The first block map leaf page */
+	physical_block_number_t leaf_origin;
+	/** The number of block map leaf pages */
+	page_count_t leaf_pages;
+};
+
+/**
+ * The state of the block map page cache test, whose clients each fetch a
+ * page, release it, and fetch another.
+ **/
+struct page_bench {
+	struct vdo_page_cache *cache;
+	physical_block_number_t origin;
+	page_count_t pages;
+	bool sequential;
+	page_count_t next_page;
+	unsigned long remaining;
+	int result;
+	struct vdo_page_completion clients[QUEUE_DEPTH];
+};
+
+/**
+ * The state of the journal and block map tests, whose data_vios each make an
+ * increment and a decrement journal entry for a random logical block, and
+ * optionally put the new mapping in the block map.
+ **/
+struct mapping_bench {
+	struct mapping_harness *harness;
+	bool put_mappings;
+	unsigned long remaining;
+	int result;
+	struct data_vio *data_vios;
+};
+
+static uint64_t random_state = RANDOM_SEED;
+static struct page_bench page_bench;
+static struct mapping_bench mapping_bench;
+
+/**
+ * Get the next value from a fixed sequence of pseudo-random numbers, so that
+ * runs are comparable.
+ **/
+static uint64_t next_random(void)
+{
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * 0x2545f4914f6cdd1dULL;
+}
+
+/**********************************************************************/
+static void report(const char *test,
+		   const char *what,
+		   unsigned long count,
+		   ktime_t elapsed)
+{
+	printf("%-8s %-24s %10lu ops %10.3f ms %10.1f ns/op\n",
+	       test,
+	       what,
+	       count,
+	       elapsed / 1000000.0,
+	       (count == 0) ? 0.0 : (double) elapsed / count);
+}
+
+/**********************************************************************/
+static int report_error(const char *what, int result)
+{
+	char buf[UDS_STRING_ERROR_BUFSIZE];
+	fprintf(stderr,
+		"%s: %s\n",
+		what,
+		uds_string_error(result, buf, sizeof(buf)));
+	return result;
+}
+
+/**
+ * Check that a timed pass found exactly the entries it should have, so that
+ * a broken structure can not pass for a fast one.
+ *
+ * @param test      The name of the test
+ * @param what      The description of the pass
+ * @param found     The number of entries the pass found
+ * @param expected  The number of entries the pass should have found
+ *
+ * @return VDO_SUCCESS or UDS_ASSERTION_FAILED
+ **/
+static int check_found(const char *test,
+		       const char *what,
+		       unsigned long found,
+		       unsigned long expected)
+{
+	if (found == expected) {
+		return VDO_SUCCESS;
+	}
+
+	fprintf(stderr,
+		"%s %s: found %lu entries, expected %lu\n",
+		test,
+		what,
+		found,
+		expected);
+	return UDS_ASSERTION_FAILED;
+}
+
+/**
+ * Record the result of an action run by perform_action().
+ **/
+static void record_result(struct vdo_completion *completion)
+{
+	int *result_ptr = completion->parent;
+	*result_ptr = completion->result;
+}
+
+/**
+ * Run an action on the admin thread of a user vdo, and all the work which
+ * it queues. An action which finishes asynchronously must reset the
+ * completion's callback to record_result().
+ *
+ * @param vdo     The vdo
+ * @param action  The action to run
+ *
+ * @return The result recorded by the action, or VDO_SUCCESS
+ **/
+static int perform_action(struct vdo *vdo, vdo_action *action)
+{
+	struct vdo_completion completion;
+	thread_id_t admin_thread = get_admin_thread(vdo->thread_config);
+	int result = VDO_SUCCESS;
+
+	initialize_vdo_completion(&completion, vdo, SYNC_COMPLETION);
+	launch_vdo_completion_callback_with_parent(&completion,
+						   action,
+						   admin_thread,
+						   &result);
+	run_user_vdo(vdo);
+	return result;
+}
+
+/**
+ * Fill a set of reference counts so that a given percentage of the blocks,
+ * chosen at random, are referenced, and move the search cursor back to the
+ * start.
+ **/
+static int fill_ref_counts(struct ref_counts *ref_counts,
+			   unsigned int fill_percent)
+{
+	slab_block_number i;
+	int result;
+
+	result = allocate_reference_counters(ref_counts);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	reset_reference_counts(ref_counts);
+	for (i = 0; i < ref_counts->block_count; i++) {
+		if ((next_random() % 100) >= fill_percent) {
+			continue;
+		}
+
+		result = provisionally_reference_block(ref_counts,
+						       ref_counts->slab->start
+						       + i,
+						       NULL);
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
+	}
+
+	reset_search_cursor(ref_counts);
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+static int bench_ref_counts(const char *test,
+			    const struct bench_options *options)
+{
+	struct slab_depot *depot = NULL;
+	struct block_allocator *allocator = NULL;
+	struct ref_counts *ref_counts;
+	struct vdo *vdo;
+	struct vdo_slab slab;
+	unsigned long count = 0, found = 0;
+	ktime_t start, elapsed = 0;
+	int result;
+
+	result = make_user_vdo(1, &vdo);
+	if (result != VDO_SUCCESS) {
+		return report_error("make_user_vdo", result);
+	}
+
+	// The slab only needs its depot for the slab configuration.
+	result = ALLOCATE(1, struct slab_depot, __func__, &depot);
+	if (result == VDO_SUCCESS) {
+		result = ALLOCATE(1, struct block_allocator, __func__,
+				  &allocator);
+	}
+
+	if (result != VDO_SUCCESS) {
+		FREE(depot);
+		free_user_vdo(&vdo);
+		return report_error("ALLOCATE", result);
+	}
+
+	depot->slab_config.data_blocks = options->slab_blocks;
+	allocator->depot = depot;
+	slab = (struct vdo_slab) {
+		.allocator = allocator,
+		.start = 1,
+		.end = 1 + options->slab_blocks,
+	};
+	result = make_ref_counts(options->slab_blocks,
+				 &slab,
+				 slab.end,
+				 vdo->read_only_notifier,
+				 &ref_counts);
+	if (result != VDO_SUCCESS) {
+		FREE(allocator);
+		FREE(depot);
+		free_user_vdo(&vdo);
+		return report_error("make_ref_counts", result);
+	}
+
+	result = fill_ref_counts(ref_counts, options->fill_percent);
+	if (result == VDO_SUCCESS) {
+		uint64_t seed = random_state;
+		slab_block_number free_end = ref_counts->block_count;
+		unsigned long expected = 0;
+		unsigned long i;
+
+		start = current_time_ns(CLOCK_MONOTONIC);
+		for (i = 0; i < options->operations; i++) {
+			slab_block_number index =
+				next_random() % ref_counts->block_count;
+			if (find_free_block(ref_counts,
+					    index,
+					    ref_counts->block_count,
+					    &index)) {
+				found++;
+			}
+		}
+		report(test, "find_free_block", options->operations,
+		       current_time_ns(CLOCK_MONOTONIC) - start);
+
+		// A search finds a block exactly when it starts at or before
+		// the last free one, so replay the starts to count the hits.
+		while ((free_end > 0) &&
+		       (ref_counts->counters[free_end - 1] !=
+			EMPTY_REFERENCE_COUNT)) {
+			free_end--;
+		}
+		random_state = seed;
+		for (i = 0; i < options->operations; i++) {
+			expected += ((next_random() % ref_counts->block_count)
+				     < free_end);
+		}
+		result = check_found(test, "find_free_block", found, expected);
+	}
+
+	// Allocate until the slab is full, then refill it and start over.
+	while ((result == VDO_SUCCESS) && (count < options->operations)) {
+		unsigned long allocated = 0;
+		physical_block_number_t pbn;
+
+		start = current_time_ns(CLOCK_MONOTONIC);
+		while (count < options->operations) {
+			result = allocate_unreferenced_block(ref_counts, &pbn);
+			if (result != VDO_SUCCESS) {
+				break;
+			}
+
+			allocated++;
+			count++;
+		}
+		elapsed += current_time_ns(CLOCK_MONOTONIC) - start;
+
+		if (result == VDO_NO_SPACE) {
+			result = ((allocated == 0)
+				  ? VDO_NO_SPACE
+				  : fill_ref_counts(ref_counts,
+						    options->fill_percent));
+		}
+	}
+
+	if (result == VDO_SUCCESS) {
+		report(test, "allocate", count, elapsed);
+	} else {
+		report_error("allocate_unreferenced_block", result);
+	}
+
+	free_ref_counts(&ref_counts);
+	FREE(allocator);
+	FREE(depot);
+	free_user_vdo(&vdo);
+	return result;
+}
+
+/**
+ * Free a mapping harness and null out the reference to it.
+ **/
+static void free_mapping_harness(struct mapping_harness **harness_ptr)
+{
+	struct mapping_harness *harness = *harness_ptr;
+	struct vdo *vdo;
+
+	if (harness == NULL) {
+		return;
+	}
+
+	vdo = harness->vdo;
+	free_logical_zones(&vdo->logical_zones);
+	free_block_map(&vdo->block_map);
+	free_recovery_journal(&vdo->recovery_journal);
+	free_fixed_layout(&harness->layout);
+	free_user_vdo(&harness->vdo);
+	FREE(harness);
+	*harness_ptr = NULL;
+}
+
+/**
+ * Make a user vdo with a recovery journal, and a block map whose leaf pages
+ * follow the journal and the tree root on the layer, and open them as a
+ * load would.
+ *
+ * @param [in]  leaf_pages   The number of block map leaf pages
+ * @param [in]  cache_pages  The size of the block map page cache
+ * @param [out] harness_ptr  A pointer to hold the new harness
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int make_mapping_harness(page_count_t leaf_pages,
+				page_count_t cache_pages,
+				struct mapping_harness **harness_ptr)
+{
+	struct mapping_harness *harness;
+	struct partition *partition;
+	struct vdo *vdo;
+	block_count_t block_count = JOURNAL_BLOCKS + 1 + leaf_pages;
+	struct recovery_journal_state_7_0 journal_state = {
+		// Sequence number 0 means "no lock", so journals start at 1.
+		.journal_start = 1,
+	};
+	struct block_map_state_2_0 map_state = {
+		.flat_page_origin = VDO_BLOCK_MAP_FLAT_PAGE_ORIGIN,
+		.root_origin = JOURNAL_BLOCKS,
+		.root_count = 1,
+	};
+	int result;
+
+	result = ALLOCATE(1, struct mapping_harness, __func__, &harness);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	harness->leaf_origin = JOURNAL_BLOCKS + 1;
+	harness->leaf_pages = leaf_pages;
+	result = make_user_vdo(block_count, &harness->vdo);
+	if (result != VDO_SUCCESS) {
+		FREE(harness);
+		return result;
+	}
+
+	vdo = harness->vdo;
+	result = make_fixed_layout(block_count, 0, &harness->layout);
+	if (result == VDO_SUCCESS) {
+		result = make_fixed_layout_partition(harness->layout,
+						     RECOVERY_JOURNAL_PARTITION,
+						     JOURNAL_BLOCKS,
+						     FROM_BEGINNING,
+						     0);
+	}
+
+	if (result == VDO_SUCCESS) {
+		result = get_partition(harness->layout,
+				       RECOVERY_JOURNAL_PARTITION,
+				       &partition);
+	}
+
+	if (result == VDO_SUCCESS) {
+		result = decode_recovery_journal(journal_state,
+						 VDO_NONCE,
+						 vdo,
+						 partition,
+						 0,
+						 JOURNAL_BLOCKS,
+						 VDO_RECOVERY_JOURNAL_TAIL_BUFFER_SIZE,
+						 vdo->read_only_notifier,
+						 vdo->thread_config,
+						 &vdo->recovery_journal);
+	}
+
+	if (result == VDO_SUCCESS) {
+		result = decode_block_map(map_state,
+					  (leaf_pages *
+					   VDO_BLOCK_MAP_ENTRIES_PER_PAGE),
+					  vdo->thread_config,
+					  vdo,
+					  vdo->read_only_notifier,
+					  vdo->recovery_journal,
+					  VDO_NONCE,
+					  cache_pages,
+					  BLOCK_MAP_MAXIMUM_AGE,
+					  &vdo->block_map);
+	}
+
+	if (result == VDO_SUCCESS) {
+		result = make_logical_zones(vdo, &vdo->logical_zones);
+	}
+
+	if (result != VDO_SUCCESS) {
+		free_mapping_harness(&harness);
+		return result;
+	}
+
+	initialize_block_map_from_journal(vdo->block_map,
+					  vdo->recovery_journal);
+	open_recovery_journal(vdo->recovery_journal, NULL, vdo->block_map);
+	*harness_ptr = harness;
+	return VDO_SUCCESS;
+}
+
+/**
+ * Save the recovery journal once the block map has been saved. This is the
+ * callback registered in save_mapping().
+ **/
+static void save_journal(struct vdo_completion *completion)
+{
+	if (completion->result != VDO_SUCCESS) {
+		record_result(completion);
+		return;
+	}
+
+	prepare_vdo_completion(completion,
+			       record_result,
+			       record_result,
+			       completion->callback_thread_id,
+			       completion->parent);
+	drain_recovery_journal(completion->vdo->recovery_journal,
+			       ADMIN_STATE_SAVING,
+			       completion);
+}
+
+/**
+ * Save the block map and then the recovery journal, in the order a suspend
+ * would, so that they are quiescent when they are freed.
+ **/
+static void save_mapping(struct vdo_completion *completion)
+{
+	prepare_vdo_completion(completion,
+			       save_journal,
+			       save_journal,
+			       completion->callback_thread_id,
+			       completion->parent);
+	drain_block_map(completion->vdo->block_map,
+			ADMIN_STATE_SAVING,
+			completion);
+}
+
+/**
+ * Fetch a block map page for a page cache test client.
+ **/
+static void fetch_page(struct vdo_page_completion *client);
+
+/**
+ * Release a page and fetch the next. This is the callback registered in
+ * fetch_page().
+ **/
+static void page_fetched(struct vdo_completion *completion)
+{
+	struct vdo_page_completion *client = completion->parent;
+
+	if (completion->result != VDO_SUCCESS) {
+		page_bench.result = completion->result;
+	}
+
+	release_vdo_page_completion(completion);
+	fetch_page(client);
+}
+
+/**********************************************************************/
+static void fetch_page(struct vdo_page_completion *client)
+{
+	page_count_t page;
+
+	if ((page_bench.remaining == 0) ||
+	    (page_bench.result != VDO_SUCCESS)) {
+		return;
+	}
+
+	page_bench.remaining--;
+	page = (page_bench.sequential
+		? page_bench.next_page++ % page_bench.pages
+		: next_random() % page_bench.pages);
+	init_vdo_page_completion(client,
+				 page_bench.cache,
+				 page_bench.origin + page,
+				 false,
+				 client,
+				 page_fetched,
+				 page_fetched);
+	get_vdo_page(&client->completion);
+}
+
+/**
+ * Start all the page cache test clients. This action is run by
+ * perform_action().
+ **/
+static void start_page_clients(struct vdo_completion *completion)
+{
+	unsigned int i;
+
+	for (i = 0; i < QUEUE_DEPTH; i++) {
+		fetch_page(&page_bench.clients[i]);
+	}
+}
+
+/**
+ * Fetch pages from the block map page cache.
+ *
+ * @param harness     The harness of the block map
+ * @param pages       The number of pages to fetch from
+ * @param count       The number of fetches
+ * @param sequential  Whether to fetch the pages in order, rather than at
+ *                    random
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int fetch_pages(struct mapping_harness *harness,
+		       page_count_t pages,
+		       unsigned long count,
+		       bool sequential)
+{
+	page_bench.cache = harness->vdo->block_map->zones[0].page_cache;
+	page_bench.origin = harness->leaf_origin;
+	page_bench.pages = pages;
+	page_bench.sequential = sequential;
+	page_bench.next_page = 0;
+	page_bench.remaining = count;
+	page_bench.result = VDO_SUCCESS;
+	perform_action(harness->vdo, start_page_clients);
+	return page_bench.result;
+}
+
+/**********************************************************************/
+static int bench_page_cache(const char *test,
+			    const struct bench_options *options)
+{
+	struct mapping_harness *harness;
+	page_count_t cached_pages = options->cache_pages / 2;
+	page_count_t leaf_pages = options->cache_pages * MISS_FACTOR;
+	uint64_t reads, writes, start_reads;
+	ktime_t start;
+	int result;
+
+	result = make_mapping_harness(leaf_pages,
+				      options->cache_pages,
+				      &harness);
+	if (result != VDO_SUCCESS) {
+		return report_error("make_mapping_harness", result);
+	}
+
+	// Load the pages which will be fetched from the cache.
+	result = fetch_pages(harness, cached_pages, cached_pages, true);
+	if (result == VDO_SUCCESS) {
+		start = current_time_ns(CLOCK_MONOTONIC);
+		result = fetch_pages(harness,
+				     cached_pages,
+				     options->operations,
+				     false);
+		report(test, "fetch (cached)", options->operations,
+		       current_time_ns(CLOCK_MONOTONIC) - start);
+	}
+
+	if (result == VDO_SUCCESS) {
+		get_user_layer_io_counts(harness->vdo->layer,
+					 &start_reads,
+					 &writes);
+		start = current_time_ns(CLOCK_MONOTONIC);
+		result = fetch_pages(harness,
+				     leaf_pages,
+				     options->operations,
+				     false);
+		report(test, "fetch (uncached)", options->operations,
+		       current_time_ns(CLOCK_MONOTONIC) - start);
+		get_user_layer_io_counts(harness->vdo->layer, &reads, &writes);
+		printf("%-8s %-24s %10llu reads\n",
+		       test,
+		       "fetch (uncached)",
+		       (unsigned long long) (reads - start_reads));
+	}
+
+	if (result != VDO_SUCCESS) {
+		report_error("get_vdo_page", result);
+	}
+
+	perform_action(harness->vdo, save_mapping);
+	free_mapping_harness(&harness);
+	return result;
+}
+
+/**
+ * Make the journal entries for a new mapping of a random logical block.
+ **/
+static void start_mapping_update(struct vdo_completion *completion);
+
+/**
+ * Finish a mapping update and start the next one, if any. This is the
+ * callback registered in update_mapping() once the entries have committed.
+ **/
+static void finish_mapping_update(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+	struct recovery_journal *journal =
+		mapping_bench.harness->vdo->recovery_journal;
+
+	if (completion->result != VDO_SUCCESS) {
+		mapping_bench.result = completion->result;
+		return;
+	}
+
+	if (!mapping_bench.put_mappings) {
+		// The block map would release the increment's journal lock.
+		release_per_entry_lock_from_other_zone(journal,
+						       data_vio->recovery_sequence_number);
+		data_vio->recovery_sequence_number = 0;
+	}
+
+	launch_journal_callback(data_vio, start_mapping_update);
+}
+
+/**
+ * Put the new mapping in the block map once both journal entries have
+ * committed.
+ **/
+static void update_mapping(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+
+	if ((completion->result != VDO_SUCCESS) ||
+	    !mapping_bench.put_mappings) {
+		finish_mapping_update(completion);
+		return;
+	}
+
+	set_logical_callback(data_vio, finish_mapping_update);
+	put_mapped_block(data_vio);
+}
+
+/**
+ * Make the decrement journal entry once the increment has committed.
+ **/
+static void add_decrement_entry(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+
+	if (completion->result != VDO_SUCCESS) {
+		finish_mapping_update(completion);
+		return;
+	}
+
+	data_vio->operation = (struct reference_operation) {
+		.type = DATA_DECREMENT,
+		.pbn = VDO_ZERO_BLOCK,
+		.state = MAPPING_STATE_UNMAPPED,
+	};
+	set_journal_callback(data_vio, update_mapping);
+	add_recovery_journal_entry(mapping_bench.harness->vdo->recovery_journal,
+				   data_vio);
+}
+
+/**********************************************************************/
+static void start_mapping_update(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+	struct mapping_harness *harness = mapping_bench.harness;
+	struct tree_lock *lock = &data_vio->tree_lock;
+	logical_block_number_t lbn;
+
+	if ((mapping_bench.remaining == 0) ||
+	    (mapping_bench.result != VDO_SUCCESS)) {
+		return;
+	}
+
+	mapping_bench.remaining--;
+	lbn = next_random() %
+	      (harness->leaf_pages * VDO_BLOCK_MAP_ENTRIES_PER_PAGE);
+	data_vio->logical.lbn = lbn;
+	lock->height = 0;
+	lock->tree_slots[0].page_index = lbn / VDO_BLOCK_MAP_ENTRIES_PER_PAGE;
+	lock->tree_slots[0].block_map_slot = (struct block_map_slot) {
+		.pbn = harness->leaf_origin + lock->tree_slots[0].page_index,
+		.slot = lbn % VDO_BLOCK_MAP_ENTRIES_PER_PAGE,
+	};
+	data_vio->new_mapped = (struct zoned_pbn) {
+		.pbn = 1 + (next_random() % (1ULL << 32)),
+		.state = MAPPING_STATE_UNCOMPRESSED,
+	};
+	data_vio->operation = (struct reference_operation) {
+		.type = DATA_INCREMENT,
+		.pbn = data_vio->new_mapped.pbn,
+		.state = data_vio->new_mapped.state,
+	};
+
+	reset_vdo_completion(completion);
+	set_journal_callback(data_vio, add_decrement_entry);
+	add_recovery_journal_entry(harness->vdo->recovery_journal, data_vio);
+}
+
+/**
+ * Journal, and optionally map, writes of random logical blocks.
+ *
+ * @param test          The name of the test
+ * @param what          The description of the timed operation
+ * @param options       The benchmark options
+ * @param put_mappings  Whether to update the block map
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int bench_mapping(const char *test,
+			 const char *what,
+			 const struct bench_options *options,
+			 bool put_mappings)
+{
+	struct mapping_harness *harness;
+	ktime_t start;
+	unsigned int i;
+	int result;
+
+	result = make_mapping_harness(options->cache_pages * MISS_FACTOR,
+				      options->cache_pages,
+				      &harness);
+	if (result != VDO_SUCCESS) {
+		return report_error("make_mapping_harness", result);
+	}
+
+	result = ALLOCATE(QUEUE_DEPTH,
+			  struct data_vio,
+			  __func__,
+			  &mapping_bench.data_vios);
+	if (result != VDO_SUCCESS) {
+		free_mapping_harness(&harness);
+		return report_error("ALLOCATE", result);
+	}
+
+	mapping_bench.harness = harness;
+	mapping_bench.put_mappings = put_mappings;
+	mapping_bench.remaining = options->operations;
+	mapping_bench.result = VDO_SUCCESS;
+	for (i = 0; i < QUEUE_DEPTH; i++) {
+		struct data_vio *data_vio = &mapping_bench.data_vios[i];
+		initialize_vio(data_vio_as_vio(data_vio),
+			       NULL,
+			       VIO_TYPE_DATA,
+			       VIO_PRIORITY_DATA,
+			       NULL,
+			       harness->vdo,
+			       NULL);
+		data_vio->logical.zone =
+			get_logical_zone(harness->vdo->logical_zones, 0);
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < QUEUE_DEPTH; i++) {
+		launch_journal_callback(&mapping_bench.data_vios[i],
+					start_mapping_update);
+	}
+	run_user_vdo(harness->vdo);
+	report(test, what, options->operations,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	result = mapping_bench.result;
+	if (result != VDO_SUCCESS) {
+		report_error(what, result);
+	}
+
+	if (result == VDO_SUCCESS) {
+		result = perform_action(harness->vdo, save_mapping);
+		if (result != VDO_SUCCESS) {
+			report_error("save", result);
+		}
+	}
+
+	FREE(mapping_bench.data_vios);
+	free_mapping_harness(&harness);
+	return result;
+}
+
+/**********************************************************************/
+static int bench_journal(const char *test,
+			 const struct bench_options *options)
+{
+	return bench_mapping(test, "add entry pair", options, false);
+}
+
+/**********************************************************************/
+static int bench_block_map(const char *test,
+			   const struct bench_options *options)
+{
+	return bench_mapping(test, "journal and map", options, true);
+}
+
+/**
+ * Order input bins by free space, as the packer keeps them.
+ **/
+static int compare_bins(void *priv,
+			const struct list_head *a,
+			const struct list_head *b)
+{
+	size_t free_a = list_entry(a, struct input_bin, list)->free_space;
+	size_t free_b = list_entry(b, struct input_bin, list)->free_space;
+
+	return ((free_a > free_b) ? 1 : ((free_a < free_b) ? -1 : 0));
+}
+
+/**
+ * Give the input bins of a packer random amounts of free space.
+ **/
+static void shuffle_bins(struct packer *packer)
+{
+	struct input_bin *bin;
+
+	list_for_each_entry(bin, &packer->input_bins, list) {
+		bin->free_space = next_random() % (packer->bin_data_size + 1);
+	}
+
+	list_sort(NULL, &packer->input_bins, compare_bins);
+}
+
+/**********************************************************************/
+static int bench_packer(const char *test, const struct bench_options *options)
+{
+	struct packer_zones *zones;
+	struct packer *packer;
+	struct data_vio *data_vio;
+	struct vdo *vdo;
+	unsigned long i, selected = 0;
+	ktime_t start, elapsed = 0;
+	int result;
+
+	result = make_user_vdo(1, &vdo);
+	if (result != VDO_SUCCESS) {
+		return report_error("make_user_vdo", result);
+	}
+
+	result = ALLOCATE(1, struct data_vio, __func__, &data_vio);
+	if (result != VDO_SUCCESS) {
+		free_user_vdo(&vdo);
+		return report_error("ALLOCATE", result);
+	}
+
+	result = make_packer_zones(vdo,
+				   options->input_bins,
+				   DEFAULT_PACKER_OUTPUT_BINS,
+				   &zones);
+	if (result != VDO_SUCCESS) {
+		FREE(data_vio);
+		free_user_vdo(&vdo);
+		return report_error("make_packer_zones", result);
+	}
+
+	packer = get_packer_zone(zones, 0);
+	shuffle_bins(packer);
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < options->operations; i++) {
+		if ((i > 0) && ((i % BIN_SHUFFLE_INTERVAL) == 0)) {
+			elapsed += current_time_ns(CLOCK_MONOTONIC) - start;
+			shuffle_bins(packer);
+			start = current_time_ns(CLOCK_MONOTONIC);
+		}
+
+		data_vio->compression.size =
+			1 + (next_random() % (packer->bin_data_size / 2));
+		if (select_input_bin(packer, data_vio) != NULL) {
+			selected++;
+		}
+	}
+	elapsed += current_time_ns(CLOCK_MONOTONIC) - start;
+	report(test, "select_input_bin", options->operations, elapsed);
+
+	free_packer_zones(&zones);
+	FREE(data_vio);
+	free_user_vdo(&vdo);
+	return VDO_SUCCESS;
+}
+
+/**
+ * Check that a compressed block which is freed while its slab is unrecovered
+ * is not served from the read cache once the block is reused. Each
+ * operation caches the old contents of a block as a compressed read would,
+ * decrements the block in the unrecovered slab, and then reads it as a new
+ * compressed block, which must miss, claim the block, and cache the new
+ * contents.
+ **/
+static int bench_read_cache(const char *test,
+			    const struct bench_options *options)
+{
+	struct slab_depot *depot = NULL;
+	struct block_allocator *allocator = NULL;
+	struct read_cache_waiter waiter = { .callback = NULL };
+	struct journal_point point = { .sequence_number = 0 };
+	struct read_cache *cache;
+	struct vdo *vdo;
+	struct vdo_slab slab;
+	char *old_data = NULL, *new_data = NULL, *buffer = NULL;
+	unsigned long i, stale = 0, fresh = 0;
+	ktime_t start;
+	int result;
+
+	result = make_user_vdo(1, &vdo);
+	if (result != VDO_SUCCESS) {
+		return report_error("make_user_vdo", result);
+	}
+
+	result = make_read_cache(&vdo->read_cache);
+	if (result != VDO_SUCCESS) {
+		free_user_vdo(&vdo);
+		return report_error("make_read_cache", result);
+	}
+
+	cache = vdo->read_cache;
+	result = ALLOCATE(1, struct slab_depot, __func__, &depot);
+	if (result == VDO_SUCCESS) {
+		result = ALLOCATE(1, struct block_allocator, __func__,
+				  &allocator);
+	}
+
+	if (result == VDO_SUCCESS) {
+		result = ALLOCATE(VDO_BLOCK_SIZE * 3, char, __func__,
+				  &old_data);
+	}
+
+	if (result != VDO_SUCCESS) {
+		FREE(allocator);
+		FREE(depot);
+		free_read_cache(&vdo->read_cache);
+		free_user_vdo(&vdo);
+		return report_error("ALLOCATE", result);
+	}
+
+	new_data = old_data + VDO_BLOCK_SIZE;
+	buffer = new_data + VDO_BLOCK_SIZE;
+	memset(old_data, 'o', VDO_BLOCK_SIZE);
+	memset(new_data, 'n', VDO_BLOCK_SIZE);
+
+	// An unrecovered slab only journals its decrements, so it needs no
+	// reference counts; with no journal point, it takes no journal locks.
+	depot->vdo = vdo;
+	allocator->depot = depot;
+	slab = (struct vdo_slab) {
+		.allocator = allocator,
+		.start = 1,
+		.end = 1 + options->slab_blocks,
+		.status = SLAB_REQUIRES_SCRUBBING,
+	};
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < options->operations; i++) {
+		struct reference_operation operation = {
+			.type = DATA_DECREMENT,
+			.pbn = slab.start + (i % options->slab_blocks),
+		};
+
+		read_cache_store(cache, operation.pbn, old_data);
+		result = modify_slab_reference_count(&slab, &point,
+						     operation);
+		if (result != VDO_SUCCESS) {
+			break;
+		}
+
+		if (read_cache_lookup_or_wait(cache, operation.pbn, buffer,
+					      true, &waiter)
+		    != READ_CACHE_FILL_CLAIMED) {
+			stale++;
+			continue;
+		}
+
+		read_cache_finish_fill(cache, operation.pbn, new_data);
+		if (read_cache_lookup(cache, operation.pbn, buffer) &&
+		    (memcmp(buffer, new_data, VDO_BLOCK_SIZE) == 0)) {
+			fresh++;
+		}
+	}
+
+	if (result == VDO_SUCCESS) {
+		report(test, "unrecovered reuse", options->operations,
+		       current_time_ns(CLOCK_MONOTONIC) - start);
+		result = check_found(test, "stale blocks", stale, 0);
+	} else {
+		report_error("modify_slab_reference_count", result);
+	}
+
+	if (result == VDO_SUCCESS) {
+		result = check_found(test, "reused blocks", fresh,
+				     options->operations);
+	}
+
+	FREE(old_data);
+	FREE(allocator);
+	FREE(depot);
+	free_read_cache(&vdo->read_cache);
+	free_user_vdo(&vdo);
+	return result;
+}
+
+/**
+ * Time int_map insertions, lookups of present and absent keys, and removals
+ * of a set of keys.
+ *
+ * @param test   The name of the test
+ * @param what   The description of the key distribution
+ * @param keys   The keys, which must be distinct
+ * @param count  The number of keys
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int time_int_map(const char *test,
+			const char *what,
+			const uint64_t *keys,
+			unsigned long count)
+{
+	struct int_map *map;
+	char description[32];
+	unsigned long i, found;
+	ktime_t start;
+	int result;
+
+	result = make_int_map(count, 0, &map);
+	if (result != VDO_SUCCESS) {
+		return report_error("make_int_map", result);
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < count; i++) {
+		result = int_map_put(map, keys[i], (void *) &keys[i], true,
+				     NULL);
+		if (result != VDO_SUCCESS) {
+			free_int_map(&map);
+			return report_error("int_map_put", result);
+		}
+	}
+	snprintf(description, sizeof(description), "put (%s)", what);
+	report(test, description, count,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	found = 0;
+	for (i = 0; i < count; i++) {
+		uint64_t key = keys[next_random() % count];
+		found += (int_map_get(map, key) != NULL);
+	}
+	snprintf(description, sizeof(description), "get (%s)", what);
+	report(test, description, count,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+	result = check_found(test, description, found, count);
+	if (result != VDO_SUCCESS) {
+		free_int_map(&map);
+		return result;
+	}
+
+	// Keys with the top bit set are not in either distribution.
+	start = current_time_ns(CLOCK_MONOTONIC);
+	found = 0;
+	for (i = 0; i < count; i++) {
+		found += (int_map_get(map, next_random() | (1ULL << 63))
+			  != NULL);
+	}
+	snprintf(description, sizeof(description), "miss (%s)", what);
+	report(test, description, count,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+	result = check_found(test, description, found, 0);
+	if (result != VDO_SUCCESS) {
+		free_int_map(&map);
+		return result;
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	found = 0;
+	for (i = 0; i < count; i++) {
+		found += (int_map_remove(map, keys[i]) != NULL);
+	}
+	snprintf(description, sizeof(description), "remove (%s)", what);
+	report(test, description, count,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	free_int_map(&map);
+	return check_found(test, description, found, count);
+}
+
+/**
+ * Benchmark the int_map with the two kinds of keys it is used with: runs of
+ * consecutive block numbers, as written by sequential I/O, and scattered
+ * block numbers, as written by random I/O.
+ **/
+static int bench_int_map(const char *test,
+			 const struct bench_options *options)
+{
+	unsigned long count = options->operations;
+	uint64_t *keys;
+	unsigned long i;
+	int result;
+
+	result = ALLOCATE(count, uint64_t, __func__, &keys);
+	if (result != VDO_SUCCESS) {
+		return report_error("ALLOCATE", result);
+	}
+
+	for (i = 0; i < count; i++) {
+		keys[i] = (1ULL << 32) + i;
+	}
+	result = time_int_map(test, "sequential", keys, count);
+
+	if (result == VDO_SUCCESS) {
+		// Scatter the keys while keeping them distinct.
+		for (i = 0; i < count; i++) {
+			keys[i] = ((next_random() & ~((1ULL << 63) |
+						      0xfffffULL)) |
+				   (i & 0xfffff));
+		}
+		result = time_int_map(test, "random", keys, count);
+	}
+
+	FREE(keys);
+	return result;
+}
+
+/**********************************************************************/
+static bool compare_chunk_names(const void *this_key, const void *that_key)
+{
+	return (memcmp(this_key, that_key, sizeof(struct uds_chunk_name)) ==
+		0);
+}
+
+/**********************************************************************/
+static uint32_t hash_chunk_name(const void *key)
+{
+	const struct uds_chunk_name *name = key;
+
+	return get_unaligned_le32(&name->name[4]);
+}
+
+/**
+ * Benchmark the pointer_map keyed by chunk names, which are uniformly
+ * distributed.
+ **/
+static int bench_pointer_map(const char *test,
+			     const struct bench_options *options)
+{
+	unsigned long count = options->operations;
+	struct uds_chunk_name *names;
+	struct pointer_map *map;
+	unsigned long i, found = 0;
+	ktime_t start;
+	int result;
+
+	result = ALLOCATE(count, struct uds_chunk_name, __func__, &names);
+	if (result != VDO_SUCCESS) {
+		return report_error("ALLOCATE", result);
+	}
+
+	for (i = 0; i < count; i++) {
+		uint64_t high = next_random(), low = next_random();
+		memcpy(&names[i].name[0], &high, sizeof(high));
+		memcpy(&names[i].name[8], &low, sizeof(low));
+	}
+
+	result = make_pointer_map(count,
+				  0,
+				  compare_chunk_names,
+				  hash_chunk_name,
+				  &map);
+	if (result != VDO_SUCCESS) {
+		FREE(names);
+		return report_error("make_pointer_map", result);
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < count; i++) {
+		result = pointer_map_put(map, &names[i], &names[i], true,
+					 NULL);
+		if (result != VDO_SUCCESS) {
+			break;
+		}
+	}
+	if (result != VDO_SUCCESS) {
+		free_pointer_map(&map);
+		FREE(names);
+		return report_error("pointer_map_put", result);
+	}
+	report(test, "put", count, current_time_ns(CLOCK_MONOTONIC) - start);
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < count; i++) {
+		found += (pointer_map_get(map, &names[next_random() % count])
+			  != NULL);
+	}
+	report(test, "get", count, current_time_ns(CLOCK_MONOTONIC) - start);
+	result = check_found(test, "get", found, count);
+	if (result != VDO_SUCCESS) {
+		free_pointer_map(&map);
+		FREE(names);
+		return result;
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	found = 0;
+	for (i = 0; i < count; i++) {
+		found += (pointer_map_remove(map, &names[i]) != NULL);
+	}
+	report(test, "remove", count,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	free_pointer_map(&map);
+	FREE(names);
+	return check_found(test, "remove", found, count);
+}
+
+/**
+ * The state of a funnel queue producer thread.
+ **/
+struct funnel_producer {
+	struct funnel_queue *queue;
+	struct funnel_queue_entry *entries;
+	unsigned long count;
+};
+
+/**********************************************************************/
+static void produce_entries(void *arg)
+{
+	struct funnel_producer *producer = arg;
+	unsigned long i;
+
+	for (i = 0; i < producer->count; i++) {
+		funnel_queue_put(producer->queue, &producer->entries[i]);
+	}
+}
+
+/**
+ * Time a funnel queue with a number of producer threads and the calling
+ * thread consuming, as a work queue is used.
+ *
+ * @param test       The name of the test
+ * @param queue      The queue
+ * @param entries    The entries to put, at least count
+ * @param count      The number of entries to put and poll
+ * @param producers  The number of producer threads
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int time_funnel_queue(const char *test,
+			     struct funnel_queue *queue,
+			     struct funnel_queue_entry *entries,
+			     unsigned long count,
+			     unsigned int producers)
+{
+	struct funnel_producer producer[producers];
+	struct thread *threads[producers];
+	char description[32];
+	unsigned long polled = 0;
+	unsigned int i, started;
+	ktime_t start;
+	int result = VDO_SUCCESS;
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (started = 0; started < producers; started++) {
+		unsigned long first = count * started / producers;
+		producer[started] = (struct funnel_producer) {
+			.queue = queue,
+			.entries = &entries[first],
+			.count = (count * (started + 1) / producers) - first,
+		};
+		result = create_thread(produce_entries,
+				       &producer[started],
+				       "producer",
+				       &threads[started]);
+		if (result != UDS_SUCCESS) {
+			report_error("create_thread", result);
+			break;
+		}
+	}
+
+	// The consumer stops once the producers it started have finished.
+	count = (count * started) / producers;
+	while (polled < count) {
+		if (funnel_queue_poll(queue) != NULL) {
+			polled++;
+		} else {
+			cpu_relax();
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		join_threads(threads[i]);
+	}
+
+	snprintf(description, sizeof(description), "put+poll (%u to 1)",
+		 producers);
+	report(test, description, polled,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+	return result;
+}
+
+/**********************************************************************/
+static int bench_funnel_queue(const char *test,
+			      const struct bench_options *options)
+{
+	unsigned long count = options->operations;
+	struct funnel_queue_entry *entries;
+	struct funnel_queue *queue;
+	unsigned long i;
+	ktime_t start;
+	int result;
+
+	result = ALLOCATE(count, struct funnel_queue_entry, __func__,
+			  &entries);
+	if (result != VDO_SUCCESS) {
+		return report_error("ALLOCATE", result);
+	}
+
+	result = make_funnel_queue(&queue);
+	if (result != UDS_SUCCESS) {
+		FREE(entries);
+		return report_error("make_funnel_queue", result);
+	}
+
+	// The uncontended cost of passing one entry through the queue.
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < count; i++) {
+		funnel_queue_put(queue, &entries[i % QUEUE_DEPTH]);
+		if (funnel_queue_poll(queue) == NULL) {
+			result = UDS_BAD_STATE;
+			break;
+		}
+	}
+	report(test, "put+poll (1 thread)", count,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	if (result == UDS_SUCCESS) {
+		result = time_funnel_queue(test, queue, entries, count, 1);
+	}
+
+	if ((result == UDS_SUCCESS) && (options->threads > 1)) {
+		result = time_funnel_queue(test, queue, entries, count,
+					   options->threads);
+	}
+
+	free_funnel_queue(queue);
+	FREE(entries);
+	return result;
+}
+
+/**
+ * Check that a sequential write stream fills the batches of the CPU queues.
+ * Each window of CPU_QUEUE_BATCH_SIZE writes is dealt to the batch
+ * processors, one per thread, before any of them takes a batch, as when the
+ * threads are busy; each then takes what it was dealt in one pass. Every
+ * batch must be full.
+ **/
+static int bench_batch(const char *test, const struct bench_options *options)
+{
+	unsigned long count = options->operations;
+	unsigned int threads = options->threads;
+	unsigned long batches = 0;
+	unsigned int *pending;
+	logical_block_number_t lbn;
+	unsigned int i;
+	ktime_t start;
+	int result;
+
+	result = ALLOCATE(threads, unsigned int, __func__, &pending);
+	if (result != VDO_SUCCESS) {
+		return report_error("ALLOCATE", result);
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (lbn = 0; lbn < count; lbn++) {
+		pending[select_batch_processor(lbn, threads)]++;
+		if ((((lbn + 1) % CPU_QUEUE_BATCH_SIZE) != 0) &&
+		    ((lbn + 1) < count)) {
+			continue;
+		}
+
+		for (i = 0; i < threads; i++) {
+			batches += DIV_ROUND_UP(pending[i],
+						CPU_QUEUE_BATCH_SIZE);
+			pending[i] = 0;
+		}
+	}
+	report(test, "sequential select", count,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+	printf("%-8s %-24s %10lu batches %7.1f%% full\n",
+	       test,
+	       "sequential",
+	       batches,
+	       (batches == 0) ? 0.0
+	       : (count * 100.0) / (batches * CPU_QUEUE_BATCH_SIZE));
+
+	FREE(pending);
+	return check_found(test, "sequential batches", batches,
+			   DIV_ROUND_UP(count, CPU_QUEUE_BATCH_SIZE));
+}
+
+/**********************************************************************/
+static void count_waiter(struct waiter *waiter, void *context)
+{
+	(*((unsigned long *) context))++;
+}
+
+/**
+ * Benchmark a wait queue with a fixed number of waiters cycling through it,
+ * as data_vios wait on locks and journal blocks.
+ **/
+static int bench_wait_queue(const char *test,
+			    const struct bench_options *options)
+{
+	struct waiter waiters[QUEUE_DEPTH];
+	struct wait_queue queue;
+	unsigned long i, notified = 0;
+	ktime_t start;
+	int result;
+
+	memset(waiters, 0, sizeof(waiters));
+	initialize_wait_queue(&queue);
+	for (i = 0; i < QUEUE_DEPTH; i++) {
+		result = enqueue_waiter(&queue, &waiters[i]);
+		if (result != VDO_SUCCESS) {
+			return report_error("enqueue_waiter", result);
+		}
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < options->operations; i++) {
+		struct waiter *waiter = dequeue_next_waiter(&queue);
+		result = enqueue_waiter(&queue, waiter);
+		if (result != VDO_SUCCESS) {
+			return report_error("enqueue_waiter", result);
+		}
+	}
+	report(test, "dequeue+enqueue", options->operations,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < options->operations; i += QUEUE_DEPTH) {
+		unsigned int j;
+		notify_all_waiters(&queue, count_waiter, &notified);
+		for (j = 0; j < QUEUE_DEPTH; j++) {
+			result = enqueue_waiter(&queue, &waiters[j]);
+			if (result != VDO_SUCCESS) {
+				return report_error("enqueue_waiter", result);
+			}
+		}
+	}
+	report(test, "notify all+enqueue", notified,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	notify_all_waiters(&queue, count_waiter, &notified);
+	return VDO_SUCCESS;
+}
+
+/**
+ * Order slab statuses as the block allocator does when it loads its slabs.
+ **/
+static int compare_slab_statuses(const void *item1, const void *item2)
+{
+	const struct slab_status *info1 = item1;
+	const struct slab_status *info2 = item2;
+
+	if (info1->is_clean != info2->is_clean) {
+		return (info1->is_clean ? 1 : -1);
+	}
+	if (info1->emptiness != info2->emptiness) {
+		return ((info1->emptiness > info2->emptiness) ? 1 : -1);
+	}
+	return ((info1->slab_number < info2->slab_number) ? 1 : -1);
+}
+
+/**********************************************************************/
+static void swap_slab_statuses(void *item1, void *item2)
+{
+	struct slab_status *info1 = item1;
+	struct slab_status *info2 = item2;
+	struct slab_status temp = *info1;
+	*info1 = *info2;
+	*info2 = temp;
+}
+
+/**
+ * Benchmark building a heap of slab statuses and popping them all, as the
+ * block allocator does for each of its slabs.
+ **/
+static int bench_heap(const char *test, const struct bench_options *options)
+{
+	unsigned long count = options->operations;
+	struct slab_status *statuses;
+	struct slab_status status;
+	struct heap heap;
+	unsigned long i, popped = 0;
+	ktime_t start;
+	int result;
+
+	result = ALLOCATE(count, struct slab_status, __func__, &statuses);
+	if (result != VDO_SUCCESS) {
+		return report_error("ALLOCATE", result);
+	}
+
+	for (i = 0; i < count; i++) {
+		uint64_t random = next_random();
+		statuses[i] = (struct slab_status) {
+			.slab_number = i,
+			.is_clean = ((random & 1) == 0),
+			.emptiness = random >> 56,
+		};
+	}
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	initialize_heap(&heap,
+			compare_slab_statuses,
+			swap_slab_statuses,
+			statuses,
+			count,
+			sizeof(struct slab_status));
+	build_heap(&heap, count);
+	report(test, "build", count, current_time_ns(CLOCK_MONOTONIC) - start);
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	while (pop_max_heap_element(&heap, &status)) {
+		popped++;
+	}
+	report(test, "pop", popped, current_time_ns(CLOCK_MONOTONIC) - start);
+
+	FREE(statuses);
+	return VDO_SUCCESS;
+}
+
+/**
+ * Benchmark a priority table with as many priorities as a block allocator
+ * uses for slabs of the configured size, with entries of random priority.
+ **/
+static int bench_priority_table(const char *test,
+				const struct bench_options *options)
+{
+	unsigned int max_priority = 2 + log_base_two(options->slab_blocks);
+	struct priority_table *table;
+	struct list_head *entries;
+	unsigned long i, dequeued = 0;
+	ktime_t start;
+	int result;
+
+	result = ALLOCATE(QUEUE_DEPTH, struct list_head, __func__, &entries);
+	if (result != VDO_SUCCESS) {
+		return report_error("ALLOCATE", result);
+	}
+
+	result = make_priority_table(max_priority, &table);
+	if (result != VDO_SUCCESS) {
+		FREE(entries);
+		return report_error("make_priority_table", result);
+	}
+
+	for (i = 0; i < QUEUE_DEPTH; i++) {
+		INIT_LIST_HEAD(&entries[i]);
+		priority_table_enqueue(table,
+				       next_random() % (max_priority + 1),
+				       &entries[i]);
+	}
+
+	// Keep the table at a steady size, as the allocator's slabs cycle.
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < options->operations; i++) {
+		struct list_head *entry = priority_table_dequeue(table);
+		if (entry == NULL) {
+			break;
+		}
+
+		dequeued++;
+		priority_table_enqueue(table,
+				       next_random() % (max_priority + 1),
+				       entry);
+	}
+	report(test, "dequeue+enqueue", dequeued,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	start = current_time_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < options->operations; i++) {
+		struct list_head *entry = &entries[next_random() % QUEUE_DEPTH];
+		priority_table_remove(table, entry);
+		priority_table_enqueue(table,
+				       next_random() % (max_priority + 1),
+				       entry);
+	}
+	report(test, "remove+enqueue", options->operations,
+	       current_time_ns(CLOCK_MONOTONIC) - start);
+
+	free_priority_table(&table);
+	FREE(entries);
+	return VDO_SUCCESS;
+}
+
+static const struct {
+	const char *name;
+	int (*run)(const char *test, const struct bench_options *options);
+	const char *description;
+} tests[] = {
+	{ "refcount", bench_ref_counts,
+	  "free block search and allocation in a slab" },
+	{ "cache", bench_page_cache,
+	  "block map page cache hits and misses" },
+	{ "journal", bench_journal,
+	  "recovery journal increment and decrement entries" },
+	{ "blockmap", bench_block_map,
+	  "journaled block map updates" },
+	{ "packer", bench_packer,
+	  "packer input bin selection" },
+	{ "readcache", bench_read_cache,
+	  "read cache reuse of blocks freed in unrecovered slabs" },
+	{ "intmap", bench_int_map,
+	  "int_map with sequential and random keys" },
+	{ "ptrmap", bench_pointer_map,
+	  "pointer_map keyed by chunk names" },
+	{ "funnel", bench_funnel_queue,
+	  "funnel queue with one and several producers" },
+	{ "batch", bench_batch,
+	  "CPU queue batch fill for sequential writes" },
+	{ "waitq", bench_wait_queue,
+	  "wait queue cycling" },
+	{ "heap", bench_heap,
+	  "building and draining a heap of slab statuses" },
+	{ "priority", bench_priority_table,
+	  "priority table of slabs" },
+};
+
+/**********************************************************************/
+static void usage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [test...]\n"
+		"\n"
+		"Options:\n"
+		"  -n, --operations=N    operations per test (default %u)\n"
+		"  -s, --slab-blocks=N   blocks in the refcount slab "
+		"(default %u)\n"
+		"  -f, --fill=N          percent of the slab in use "
+		"(default %u)\n"
+		"  -c, --cache-pages=N   block map cache pages (default %u)\n"
+		"  -b, --input-bins=N    packer input bins (default %u)\n"
+		"  -t, --threads=N       funnel queue producers and CPU "
+		"threads (default %u)\n"
+		"  -h, --help            show this message\n"
+		"\n"
+		"Tests (default all):\n",
+		program,
+		DEFAULT_OPERATIONS,
+		DEFAULT_SLAB_BLOCKS,
+		DEFAULT_FILL_PERCENT,
+		DEFAULT_CACHE_PAGES,
+		DEFAULT_PACKER_INPUT_BINS,
+		DEFAULT_THREADS);
+	for (unsigned int i = 0; i < ARRAY_SIZE(tests); i++) {
+		fprintf(stderr,
+			"  %-8s %s\n",
+			tests[i].name,
+			tests[i].description);
+	}
+}
+
+/**********************************************************************/
+int main(int argc, char *argv[])
+{
+	static const struct option long_options[] = {
+		{ "operations", required_argument, NULL, 'n' },
+		{ "slab-blocks", required_argument, NULL, 's' },
+		{ "fill", required_argument, NULL, 'f' },
+		{ "cache-pages", required_argument, NULL, 'c' },
+		{ "input-bins", required_argument, NULL, 'b' },
+		{ "threads", required_argument, NULL, 't' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	struct bench_options options = {
+		.operations = DEFAULT_OPERATIONS,
+		.slab_blocks = DEFAULT_SLAB_BLOCKS,
+		.fill_percent = DEFAULT_FILL_PERCENT,
+		.cache_pages = DEFAULT_CACHE_PAGES,
+		.input_bins = DEFAULT_PACKER_INPUT_BINS,
+		.threads = DEFAULT_THREADS,
+	};
+	struct registered_thread allocating_thread;
+	int opt, result, failures = 0;
+
+	while ((opt = getopt_long(argc, argv, "n:s:f:c:b:t:h", long_options,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 'n':
+			options.operations = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			options.slab_blocks = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			options.fill_percent = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			options.cache_pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			options.input_bins = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			options.threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if ((options.operations == 0) || (options.slab_blocks == 0) ||
+	    (options.fill_percent > 100) ||
+	    (options.cache_pages < 2 * QUEUE_DEPTH) ||
+	    (options.input_bins == 0) || (options.threads == 0)) {
+		usage(argv[0]);
+		return 2;
+	}
+	for (int arg = optind; arg < argc; arg++) {
+		unsigned int i;
+		for (i = 0; i < ARRAY_SIZE(tests); i++) {
+			if (strcmp(argv[arg], tests[i].name) == 0) {
+				break;
+			}
+		}
+		if (i == ARRAY_SIZE(tests)) {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	uds_initialize_thread_device_registry();
+	memory_init();
+	register_allocating_thread(&allocating_thread, NULL);
+	result = register_status_codes();
+	if (result != VDO_SUCCESS) {
+		return report_error("register_status_codes", result);
+	}
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(tests); i++) {
+		bool selected = (optind == argc);
+		for (int arg = optind; arg < argc; arg++) {
+			selected |= (strcmp(argv[arg], tests[i].name) == 0);
+		}
+		if (selected &&
+		    (tests[i].run(tests[i].name, &options) != VDO_SUCCESS)) {
+			failures++;
+		}
+	}
+
+	unregister_allocating_thread();
+	memory_exit();
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+#include "vdoCompat.h"
+
+#include "userVDO.h"
+
+/*
+ * The out-of-line parts of the kernel interfaces emulated by vdoCompat.h.
+ */
+
+unsigned long jiffies;
+
+// The armed timers, in the order in which they expire.
+static LIST_HEAD(pending_timers);
+
+static uint32_t crc32_table[256];
+
+/**********************************************************************/
+uint32_t crc32(uint32_t crc, const void *buffer, size_t length)
+{
+	const uint8_t *bytes = buffer;
+
+	if (unlikely(crc32_table[1] == 0)) {
+		uint32_t i;
+		for (i = 0; i < 256; i++) {
+			uint32_t value = i;
+			int bit;
+			for (bit = 0; bit < 8; bit++) {
+				value = ((value >> 1)
+					 ^ ((value & 1) ? 0xEDB88320 : 0));
+			}
+			crc32_table[i] = value;
+		}
+	}
+
+	while (length-- > 0) {
+		crc = (crc >> 8) ^ crc32_table[(crc ^ *bytes++) & 0xff];
+	}
+	return crc;
+}
+
+/**
+ * Merge two null-terminated chains of list entries, each already sorted,
+ * keeping entries from the first chain ahead of equal ones from the second.
+ **/
+static struct list_head *
+merge_chains(void *priv,
+	     struct list_head *a,
+	     struct list_head *b,
+	     int (*cmp)(void *priv,
+			const struct list_head *a,
+			const struct list_head *b))
+{
+	struct list_head *head = NULL;
+	struct list_head **tail = &head;
+
+	while ((a != NULL) && (b != NULL)) {
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			a = a->next;
+		} else {
+			*tail = b;
+			b = b->next;
+		}
+		tail = &(*tail)->next;
+	}
+
+	*tail = ((a != NULL) ? a : b);
+	return head;
+}
+
+/**********************************************************************/
+void list_sort(void *priv,
+	       struct list_head *head,
+	       int (*cmp)(void *priv,
+			  const struct list_head *a,
+			  const struct list_head *b))
+{
+	// Bottom-up merge sort: pending[i] is a sorted chain of 2^i entries.
+	struct list_head *pending[64] = { NULL };
+	struct list_head *entry, *sorted = NULL, *prev;
+	unsigned int i;
+
+	if (list_empty(head)) {
+		return;
+	}
+
+	head->prev->next = NULL;
+	entry = head->next;
+	while (entry != NULL) {
+		struct list_head *chain = entry;
+		entry = entry->next;
+		chain->next = NULL;
+		for (i = 0; pending[i] != NULL; i++) {
+			chain = merge_chains(priv, pending[i], chain, cmp);
+			pending[i] = NULL;
+		}
+		pending[i] = chain;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(pending); i++) {
+		if (pending[i] != NULL) {
+			sorted = merge_chains(priv, pending[i], sorted, cmp);
+		}
+	}
+
+	// Restore the back links.
+	prev = head;
+	for (entry = sorted; entry != NULL; entry = entry->next) {
+		entry->prev = prev;
+		prev->next = entry;
+		prev = entry;
+	}
+	prev->next = head;
+	head->prev = prev;
+}
+
+/**********************************************************************/
+void bio_endio(struct bio *bio)
+{
+	if (bio->bi_end_io != NULL) {
+		bio->bi_end_io(bio);
+	}
+}
+
+/**
+ * There are no block devices, so bios submitted to one fail.
+ **/
+void submit_bio_noacct(struct bio *bio)
+{
+	bio->bi_status = BLK_STS_IOERR;
+	bio_endio(bio);
+}
+
+/**********************************************************************/
+int submit_bio_wait(struct bio *bio)
+{
+	return -EIO;
+}
+
+/**********************************************************************/
+void timer_setup(struct timer_list *timer,
+		 void (*function)(struct timer_list *timer),
+		 unsigned int flags)
+{
+	INIT_LIST_HEAD(&timer->entry);
+	timer->function = function;
+	timer->expires = 0;
+	timer->pending = false;
+}
+
+/**********************************************************************/
+int mod_timer(struct timer_list *timer, unsigned long expires)
+{
+	struct timer_list *next;
+	bool was_pending = timer->pending;
+
+	list_del_init(&timer->entry);
+	timer->expires = expires;
+	timer->pending = true;
+	list_for_each_entry(next, &pending_timers, entry) {
+		if (time_before(expires, next->expires)) {
+			break;
+		}
+	}
+	list_add_tail(&timer->entry, &next->entry);
+	return was_pending;
+}
+
+/**********************************************************************/
+int del_timer_sync(struct timer_list *timer)
+{
+	bool was_pending = timer->pending;
+
+	list_del_init(&timer->entry);
+	timer->pending = false;
+	return was_pending;
+}
+
+/**
+ * Fire an expired hrtimer, re-arming it if its function asks.
+ **/
+static void hrtimer_expired(struct timer_list *timer)
+{
+	struct hrtimer *hrtimer = container_of(timer, struct hrtimer, timer);
+
+	if (hrtimer->function(hrtimer) == HRTIMER_RESTART) {
+		mod_timer(timer, jiffies);
+	}
+}
+
+/**********************************************************************/
+void hrtimer_init(struct hrtimer *timer,
+		  clockid_t clock,
+		  enum hrtimer_mode mode)
+{
+	timer_setup(&timer->timer, hrtimer_expired, 0);
+	timer->function = NULL;
+}
+
+/**********************************************************************/
+void hrtimer_start(struct hrtimer *timer,
+		   ktime_t delay,
+		   enum hrtimer_mode mode)
+{
+	mod_timer(&timer->timer, jiffies + nsecs_to_jiffies(delay));
+}
+
+/**********************************************************************/
+int hrtimer_cancel(struct hrtimer *timer)
+{
+	return del_timer_sync(&timer->timer);
+}
+
+/**********************************************************************/
+bool vdo_user_fire_timer(void)
+{
+	struct timer_list *timer;
+
+	if (list_empty(&pending_timers)) {
+		return false;
+	}
+
+	timer = list_first_entry(&pending_timers, struct timer_list, entry);
+	if (time_after(timer->expires, jiffies)) {
+		jiffies = timer->expires;
+	}
+
+	del_timer_sync(timer);
+	timer->function(timer);
+	return true;
+}
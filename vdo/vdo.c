@@ -38,6 +38,8 @@
 #include "numUtils.h"
 #include "packer.h"
 #include "physicalZone.h"
+#include "qosClasses.h"
+#include "readCache.h"
 #include "readOnlyNotifier.h"
 #include "recoveryJournal.h"
 #include "releaseVersions.h"
@@ -61,7 +63,8 @@ void destroy_vdo(struct vdo *vdo)
 	const struct thread_config *thread_config = get_thread_config(vdo);
 
 	free_vdo_flusher(&vdo->flusher);
-	free_packer(&vdo->packer);
+	free_packer_zones(&vdo->packer_zones);
+	free_read_cache(&vdo->read_cache);
 	free_recovery_journal(&vdo->recovery_journal);
 	free_slab_depot(&vdo->depot);
 	free_vdo_layout(&vdo->layout);
@@ -97,6 +100,10 @@ void destroy_vdo(struct vdo *vdo)
 	FREE(vdo->threads);
 	vdo->threads = NULL;
 
+	uninitialize_limiter(&vdo->request_limiter);
+	uninitialize_limiter(&vdo->discard_limiter);
+	uninitialize_limiter(&vdo->write_limiter);
+	free_qos_classes(&vdo->qos_classes);
 	release_vdo_instance(vdo->instance);
 
 	/*
@@ -140,6 +147,81 @@ struct block_device *get_vdo_backing_device(const struct vdo *vdo)
 	return vdo->device_config->owned_device->bdev;
 }
 
+/**********************************************************************/
+struct block_device *get_vdo_journal_device(const struct vdo *vdo)
+{
+	struct dm_dev *device = vdo->device_config->owned_journal_device;
+
+	return ((device == NULL) ? NULL : device->bdev);
+}
+
+/**********************************************************************/
+void vdo_note_flush_started(struct vdo *vdo)
+{
+	atomic64_inc(&vdo->flushes_started);
+	smp_mb__after_atomic();
+}
+
+/**********************************************************************/
+void vdo_note_flush_completed(struct vdo *vdo)
+{
+	atomic64_inc(&vdo->flushes_completed);
+}
+
+/**********************************************************************/
+uint64_t get_vdo_flush_mark(struct vdo *vdo)
+{
+	/*
+	 * Once more flushes have completed than had been started when the
+	 * mark was taken, at least one of them must have been started after
+	 * it.
+	 */
+	smp_mb();
+	return atomic64_read(&vdo->flushes_started) + 1;
+}
+
+/**********************************************************************/
+bool vdo_flushed_since(struct vdo *vdo, uint64_t mark)
+{
+	return (atomic64_read(&vdo->flushes_completed) >= mark);
+}
+
+/**********************************************************************/
+bool vdo_has_volatile_write_cache(const struct vdo *vdo)
+{
+	struct request_queue *queue;
+
+	switch (vdo->device_config->write_cache) {
+	case VDO_WRITE_CACHE_VOLATILE:
+		return true;
+
+	case VDO_WRITE_CACHE_PROTECTED:
+		return false;
+
+	default:
+		queue = bdev_get_queue(get_vdo_backing_device(vdo));
+		return test_bit(QUEUE_FLAG_WC, &queue->queue_flags);
+	}
+}
+
+/**********************************************************************/
+bool vdo_backing_device_supports_discard(const struct vdo *vdo)
+{
+	return blk_queue_discard(bdev_get_queue(get_vdo_backing_device(vdo)));
+}
+
+/**********************************************************************/
+block_count_t get_vdo_stripe_blocks(const struct vdo *vdo)
+{
+	unsigned int io_opt = bdev_io_opt(get_vdo_backing_device(vdo));
+
+	if ((io_opt <= VDO_BLOCK_SIZE) || ((io_opt % VDO_BLOCK_SIZE) != 0)) {
+		return 1;
+	}
+
+	return io_opt / VDO_BLOCK_SIZE;
+}
+
 /**********************************************************************/
 enum vdo_state get_vdo_state(const struct vdo *vdo)
 {
@@ -292,8 +374,8 @@ bool set_vdo_compressing(struct vdo *vdo, bool enable_compression)
 	WRITE_ONCE(vdo->compressing, enable_compression);
 	if (was_enabled && !enable_compression) {
 		// Flushing the packer is asynchronous, but we don't care when
-		// it finishes.
-		flush_packer(vdo->packer);
+		// it finishes. The caller flushes any other packer zones.
+		flush_packer(get_packer_zone(vdo->packer_zones, 0));
 	}
 
 	log_info("compression is %s",
@@ -310,46 +392,48 @@ bool get_vdo_compressing(struct vdo *vdo)
 /**********************************************************************/
 static size_t get_block_map_cache_size(const struct vdo *vdo)
 {
-	return ((size_t) vdo->device_config->cache_size) * VDO_BLOCK_SIZE;
+	// The cache may have been resized since the device was configured.
+	return (((size_t) get_block_map_cache_page_count(vdo->block_map))
+		* VDO_BLOCK_SIZE);
 }
 
 /**
  * Tally the hash lock statistics from all the hash zones.
  *
- * @param vdo  The vdo to query
- *
- * @return The sum of the hash lock statistics from all hash zones
+ * @param [in]  vdo     The vdo to query
+ * @param [out] totals  The sum of the hash lock statistics from all hash zones
  **/
-static struct hash_lock_statistics
-get_hash_lock_statistics(const struct vdo *vdo)
+static void get_hash_lock_statistics(const struct vdo *vdo,
+				     struct hash_lock_statistics *totals)
 {
 	const struct thread_config *thread_config = get_thread_config(vdo);
 	zone_count_t zone;
-	struct hash_lock_statistics totals;
-	memset(&totals, 0, sizeof(totals));
+	memset(totals, 0, sizeof(*totals));
 
 	for (zone = 0; zone < thread_config->hash_zone_count; zone++) {
 		struct hash_lock_statistics stats =
 			get_vdo_hash_zone_statistics(vdo->hash_zones[zone]);
-		totals.dedupe_advice_valid += stats.dedupe_advice_valid;
-		totals.dedupe_advice_stale += stats.dedupe_advice_stale;
-		totals.concurrent_data_matches +=
+		totals->dedupe_advice_valid += stats.dedupe_advice_valid;
+		totals->dedupe_advice_stale += stats.dedupe_advice_stale;
+		totals->concurrent_data_matches +=
 			stats.concurrent_data_matches;
-		totals.concurrent_hash_collisions +=
+		totals->concurrent_hash_collisions +=
 			stats.concurrent_hash_collisions;
+		totals->cached_advice_hits += stats.cached_advice_hits;
+		totals->cached_advice_misses += stats.cached_advice_misses;
+		totals->cached_advice_stale += stats.cached_advice_stale;
+		totals->lock_pool_exhaustions += stats.lock_pool_exhaustions;
 	}
-
-	return totals;
 }
 
 /**
  * Get the current error statistics from a vdo.
  *
- * @param vdo  The vdo to query
- *
- * @return a copy of the current vdo error counters
+ * @param [in]  vdo    The vdo to query
+ * @param [out] stats  A copy of the current vdo error counters
  **/
-static struct error_statistics get_vdo_error_statistics(const struct vdo *vdo)
+static void get_vdo_error_statistics(const struct vdo *vdo,
+				     struct error_statistics *stats)
 {
 	/*
 	 * The error counts can be incremented from arbitrary threads and so
@@ -358,7 +442,7 @@ static struct error_statistics get_vdo_error_statistics(const struct vdo *vdo)
 	 * sufficient.
 	 */
 	const struct atomic_error_statistics *atoms = &vdo->error_stats;
-	return (struct error_statistics) {
+	*stats = (struct error_statistics) {
 		.invalid_advice_pbn_count =
 			atomic64_read(&atoms->invalid_advice_pbn_count),
 		.no_space_error_count =
@@ -395,16 +479,16 @@ void get_vdo_statistics(const struct vdo *vdo,
 	stats->data_blocks_used = get_physical_blocks_allocated(vdo);
 	stats->overhead_blocks_used = get_physical_blocks_overhead(vdo);
 	stats->logical_blocks_used = get_journal_logical_blocks_used(journal);
-	stats->allocator = get_depot_block_allocator_statistics(depot);
-	stats->journal = get_recovery_journal_statistics(journal);
-	stats->packer = get_packer_statistics(vdo->packer);
-	stats->slab_journal = get_depot_slab_journal_statistics(depot);
-	stats->slab_summary =
-		get_slab_summary_statistics(get_slab_summary(depot));
-	stats->ref_counts = get_depot_ref_counts_statistics(depot);
-	stats->block_map = get_block_map_statistics(vdo->block_map);
-	stats->hash_lock = get_hash_lock_statistics(vdo);
-	stats->errors = get_vdo_error_statistics(vdo);
+	get_depot_block_allocator_statistics(depot, &stats->allocator);
+	get_recovery_journal_statistics(journal, &stats->journal);
+	get_packer_statistics(vdo->packer_zones, &stats->packer);
+	get_depot_slab_journal_statistics(depot, &stats->slab_journal);
+	get_slab_summary_statistics(get_slab_summary(depot),
+				    &stats->slab_summary);
+	get_depot_ref_counts_statistics(depot, &stats->ref_counts);
+	get_block_map_statistics(vdo->block_map, &stats->block_map);
+	get_hash_lock_statistics(vdo, &stats->hash_lock);
+	get_vdo_error_statistics(vdo, &stats->errors);
 	slab_total = get_depot_slab_count(depot);
 	stats->recovery_percentage =
 		(slab_total - get_depot_unrecovered_slab_count(depot)) * 100 /
@@ -504,7 +588,7 @@ void dump_vdo_status(const struct vdo *vdo)
 
 	dump_vdo_flusher(vdo->flusher);
 	dump_recovery_journal_statistics(vdo->recovery_journal);
-	dump_packer(vdo->packer);
+	dump_packer_zones(vdo->packer_zones);
 	dump_slab_depot(vdo->depot);
 
 	for (zone = 0; zone < thread_config->logical_zone_count; zone++) {
@@ -557,6 +641,20 @@ void assert_on_physical_zone_thread(const struct vdo *vdo,
 struct hash_zone *select_hash_zone(const struct vdo *vdo,
 				   const struct uds_chunk_name *name)
 {
+	zone_count_t zone_count = get_thread_config(vdo)->hash_zone_count;
+	uint32_t hash;
+
+	/*
+	 * Once the index zone map is known, send every name to the hash zone
+	 * which matches its index zone, so that each hash zone only talks to
+	 * one index zone when the zone counts are the same.
+	 */
+	if (smp_load_acquire(&vdo->has_index_zone_map)) {
+		unsigned int index_zone =
+			uds_get_chunk_name_zone(&vdo->index_zone_map, name);
+		return vdo->hash_zones[index_zone % zone_count];
+	}
+
 	/*
 	 * Use a fragment of the chunk name as a hash code. To ensure uniform
 	 * distributions, it must not overlap with fragments used elsewhere.
@@ -565,7 +663,7 @@ struct hash_zone *select_hash_zone(const struct vdo *vdo,
 	 */
 	// XXX Make a central repository for these offsets ala hashUtils.
 	// XXX Verify that the first byte is independent enough.
-	uint32_t hash = name->name[0];
+	hash = name->name[0];
 
 	/*
 	 * Scale the 8-bit hash fragment to a zone index by treating it as a
@@ -574,7 +672,20 @@ struct hash_zone *select_hash_zone(const struct vdo *vdo,
 	 * should be uniformly distributed over [0 .. count-1]. The multiply and
 	 * shift is much faster than a divide (modulus) on X86 CPUs.
 	 */
-	return vdo->hash_zones[(hash * get_thread_config(vdo)->hash_zone_count) >> 8];
+	return vdo->hash_zones[(hash * zone_count) >> 8];
+}
+
+/**********************************************************************/
+void set_vdo_index_zone_map(struct vdo *vdo, const struct uds_zone_map *map)
+{
+	if (READ_ONCE(vdo->has_index_zone_map) || (map->zone_count == 0)) {
+		return;
+	}
+
+	vdo->index_zone_map = *map;
+	smp_store_release(&vdo->has_index_zone_map, true);
+	log_info("hash zones now follow the %u zones of the dedupe index",
+		 map->zone_count);
 }
 
 /**********************************************************************/
@@ -50,6 +50,86 @@ void vdo_wait_for_no_requests_active(struct vdo *vdo);
 struct block_device * __must_check
 get_vdo_backing_device(const struct vdo *vdo);
 
+/**
+ * Get the block device holding a vdo's recovery journal, if the journal has
+ * been placed on a device of its own.
+ *
+ * @param vdo  The vdo
+ *
+ * @return The journal device, or NULL if the journal is on the backing device
+ **/
+struct block_device * __must_check
+get_vdo_journal_device(const struct vdo *vdo);
+
+/**
+ * Note that a flush is about to be sent to a vdo's backing device.
+ *
+ * @param vdo  The vdo
+ **/
+void vdo_note_flush_started(struct vdo *vdo);
+
+/**
+ * Note that a flush counted by vdo_note_flush_started() has succeeded.
+ *
+ * @param vdo  The vdo
+ **/
+void vdo_note_flush_completed(struct vdo *vdo);
+
+/**
+ * Get a mark with which to check whether a flush sent to a vdo's backing
+ * device after this call has completed. Every write which has completed
+ * before this call will then be durable.
+ *
+ * @param vdo  The vdo
+ *
+ * @return The flush mark
+ **/
+uint64_t __must_check get_vdo_flush_mark(struct vdo *vdo);
+
+/**
+ * Check whether a flush sent after a mark was taken has completed. Since
+ * flushes may complete out of order, this may report false for a while
+ * after such a flush has completed, but it will never report true early.
+ *
+ * @param vdo   The vdo
+ * @param mark  A mark from get_vdo_flush_mark()
+ *
+ * @return <code>true</code> if a flush sent after the mark has completed
+ **/
+bool __must_check vdo_flushed_since(struct vdo *vdo, uint64_t mark);
+
+/**
+ * Check whether completed writes to a vdo's backing device may still be
+ * lost on power failure, and so must be made durable with flushes. This
+ * follows the device's advertised write cache unless the table overrides
+ * it.
+ *
+ * @param vdo  The vdo
+ *
+ * @return <code>true</code> if metadata writes need flushes
+ **/
+bool __must_check vdo_has_volatile_write_cache(const struct vdo *vdo);
+
+/**
+ * Check whether a vdo's backing device accepts discards.
+ *
+ * @param vdo  The vdo
+ *
+ * @return <code>true</code> if discards may be sent to the backing device
+ **/
+bool __must_check vdo_backing_device_supports_discard(const struct vdo *vdo);
+
+/**
+ * Get the stripe width of a vdo's backing device, taken from the optimal I/O
+ * size it advertises.
+ *
+ * @param vdo  The vdo
+ *
+ * @return The number of blocks in a stripe, or 1 if the device advertises no
+ *         optimal I/O size which is a multiple of the block size
+ **/
+block_count_t __must_check get_vdo_stripe_blocks(const struct vdo *vdo);
+
 /**
  * Set whether compression is enabled in a vdo.
  *
@@ -142,6 +222,13 @@ get_thread_config(const struct vdo *vdo);
  **/
 thread_id_t get_callback_thread_id(void);
 
+/**
+ * Get the vdo thread on which a completion is currently running.
+ *
+ * @return the current vdo thread, or NULL if no such thread
+ **/
+struct vdo_thread *get_current_vdo_thread(void);
+
 /**
  * Get the configured maximum age of a dirty block map page.
  *
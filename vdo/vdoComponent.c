@@ -33,20 +33,59 @@
 #include "types.h"
 
 /**
- * The current version for the data encoded in the super block. This must
- * be changed any time there is a change to encoding of the component data
- * of any VDO component.
+ * The versions of the data encoded in the super block. These must be changed
+ * any time there is a change to encoding of the component data of any VDO
+ * component. Version 41.0 is still written for volumes which use the default
+ * hash algorithm so that they remain readable by older releases.
  **/
 static const struct version_number VDO_COMPONENT_DATA_41_0 = {
 	.major_version = 41,
 	.minor_version = 0,
 };
 
+static const struct version_number VDO_COMPONENT_DATA_41_1 = {
+	.major_version = 41,
+	.minor_version = 1,
+};
+
+/** The size of the encoding of each version of the component data */
+static const size_t VDO_COMPONENT_41_0_SIZE
+	= offsetof(struct vdo_component, hash_algorithm);
+static const size_t VDO_COMPONENT_41_1_SIZE = sizeof(struct vdo_component);
+
+static const char *HASH_ALGORITHM_NAMES[] = {
+	[VDO_HASH_MURMUR3_128] = "murmur3",
+	[VDO_HASH_SHA256] = "sha256",
+};
+
 /**********************************************************************/
-size_t get_vdo_component_encoded_size(void)
+const char *get_vdo_hash_algorithm_name(enum vdo_hash_algorithm algorithm)
+{
+	if (algorithm >= VDO_HASH_ALGORITHM_COUNT) {
+		return "unknown";
+	}
+
+	return HASH_ALGORITHM_NAMES[algorithm];
+}
+
+/**
+ * Check whether a vdo component must be encoded with version 41.1.
+ *
+ * @param component  The component to check
+ *
+ * @return <code>true</code> if the component uses a non-default hash
+ **/
+static inline bool needs_version_41_1(const struct vdo_component *component)
+{
+	return (component->hash_algorithm != VDO_HASH_MURMUR3_128);
+}
+
+/**********************************************************************/
+size_t get_vdo_component_encoded_size(const struct vdo_component *component)
 {
 	return (sizeof(struct version_number)
-		+ sizeof(struct vdo_component_41_0));
+		+ (needs_version_41_1(component) ? VDO_COMPONENT_41_1_SIZE
+		   : VDO_COMPONENT_41_0_SIZE));
 }
 
 /**
@@ -85,12 +124,15 @@ encode_vdo_config(const struct vdo_config *config, struct buffer *buffer)
 }
 
 /**********************************************************************/
-int encode_vdo_component(struct vdo_component_41_0 state,
-			 struct buffer *buffer)
+int encode_vdo_component(struct vdo_component state, struct buffer *buffer)
 {
 	size_t initial_length, encoded_size;
+	bool version_41_1 = needs_version_41_1(&state);
 
-	int result = encode_vdo_version_number(VDO_COMPONENT_DATA_41_0, buffer);
+	int result = encode_vdo_version_number((version_41_1
+						? VDO_COMPONENT_DATA_41_1
+						: VDO_COMPONENT_DATA_41_0),
+					       buffer);
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
@@ -122,8 +164,17 @@ int encode_vdo_component(struct vdo_component_41_0 state,
 		return result;
 	}
 
+	if (version_41_1) {
+		result = put_uint32_le_into_buffer(buffer,
+						   state.hash_algorithm);
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
+	}
+
 	encoded_size = content_length(buffer) - initial_length;
-	return ASSERT(encoded_size == sizeof(struct vdo_component_41_0),
+	return ASSERT(encoded_size == (version_41_1 ? VDO_COMPONENT_41_1_SIZE
+				       : VDO_COMPONENT_41_0_SIZE),
 		      "encoded VDO component size must match structure size");
 }
 
@@ -177,16 +228,19 @@ decode_vdo_config(struct buffer *buffer, struct vdo_config *config)
 }
 
 /**
- * Decode the version 41.0 component state for the vdo itself from a buffer.
+ * Decode the version 41.0 or 41.1 component state for the vdo itself from a
+ * buffer.
  *
- * @param buffer  A buffer positioned at the start of the encoding
- * @param state   The state structure to receive the decoded values
+ * @param buffer        A buffer positioned at the start of the encoding
+ * @param version_41_1  Whether the encoding includes the hash algorithm
+ * @param state         The state structure to receive the decoded values
  *
  * @return VDO_SUCCESS or an error
  **/
 static int __must_check
-decode_vdo_component_41_0(struct buffer *buffer,
-			  struct vdo_component_41_0 *state)
+decode_vdo_component_41(struct buffer *buffer,
+			bool version_41_1,
+			struct vdo_component *state)
 {
 	size_t decoded_size, initial_length = content_length(buffer);
 
@@ -195,6 +249,7 @@ decode_vdo_component_41_0(struct buffer *buffer,
 	struct vdo_config config;
 	nonce_t nonce;
 	enum vdo_state vdo_state;
+	enum vdo_hash_algorithm hash_algorithm = VDO_HASH_MURMUR3_128;
 
 	int result = get_uint32_le_from_buffer(buffer, &vdo_state);
 	if (result != VDO_SUCCESS) {
@@ -221,37 +276,56 @@ decode_vdo_component_41_0(struct buffer *buffer,
 		return result;
 	}
 
-	*state = (struct vdo_component_41_0) {
+	if (version_41_1) {
+		result = get_uint32_le_from_buffer(buffer, &hash_algorithm);
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
+
+		if (hash_algorithm >= VDO_HASH_ALGORITHM_COUNT) {
+			return log_error_strerror(VDO_UNSUPPORTED_VERSION,
+						  "unknown hash algorithm %u",
+						  hash_algorithm);
+		}
+	}
+
+	*state = (struct vdo_component) {
 		.state = vdo_state,
 		.complete_recoveries = complete_recoveries,
 		.read_only_recoveries = read_only_recoveries,
 		.config = config,
 		.nonce = nonce,
+		.hash_algorithm = hash_algorithm,
 	};
 
 	decoded_size = initial_length - content_length(buffer);
-	return ASSERT(decoded_size == sizeof(struct vdo_component_41_0),
+	return ASSERT(decoded_size == (version_41_1 ? VDO_COMPONENT_41_1_SIZE
+				       : VDO_COMPONENT_41_0_SIZE),
 		      "decoded VDO component size must match structure size");
 }
 
 /**********************************************************************/
 int decode_vdo_component(struct buffer *buffer,
-			 struct vdo_component_41_0 *component_ptr)
+			 struct vdo_component *component_ptr)
 {
-	struct vdo_component_41_0 component;
+	struct vdo_component component;
 	struct version_number version;
+	bool version_41_1;
 	int result = decode_vdo_version_number(buffer, &version);
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
 
-	result = validate_vdo_version(version, VDO_COMPONENT_DATA_41_0,
-				      "VDO component data");
-	if (result != VDO_SUCCESS) {
-		return result;
+	version_41_1 = are_same_vdo_version(version, VDO_COMPONENT_DATA_41_1);
+	if (!version_41_1) {
+		result = validate_vdo_version(version, VDO_COMPONENT_DATA_41_0,
+					      "VDO component data");
+		if (result != VDO_SUCCESS) {
+			return result;
+		}
 	}
 
-	result = decode_vdo_component_41_0(buffer, &component);
+	result = decode_vdo_component_41(buffer, version_41_1, &component);
 	if (result != VDO_SUCCESS) {
 		return result;
 	}
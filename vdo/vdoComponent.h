@@ -29,22 +29,27 @@
 
 /**
  * This is the structure that captures the vdo fields saved as a super block
- * component.
+ * component. Version 41.0 of the component ends with the nonce; version 41.1
+ * adds the hash algorithm.
  **/
-struct vdo_component_41_0 {
+struct vdo_component {
 	enum vdo_state state;
 	uint64_t complete_recoveries;
 	uint64_t read_only_recoveries;
 	struct vdo_config config;
 	nonce_t nonce;
+	enum vdo_hash_algorithm hash_algorithm;
 } __packed;
 
 /**
  * Get the size of the encoded state of the vdo itself.
  *
+ * @param component  The vdo component state to be encoded
+ *
  * @return the encoded size of the vdo's state
  **/
-size_t __must_check get_vdo_component_encoded_size(void);
+size_t __must_check
+get_vdo_component_encoded_size(const struct vdo_component *component);
 
 /**
  * Encode the component data for the vdo itself.
@@ -55,7 +60,7 @@ size_t __must_check get_vdo_component_encoded_size(void);
  * @return VDO_SUCCESS or an error
  **/
 int __must_check
-encode_vdo_component(struct vdo_component_41_0 state, struct buffer *buffer);
+encode_vdo_component(struct vdo_component state, struct buffer *buffer);
 
 /**
  * Decode the component data for the vdo itself from the component data buffer
@@ -69,7 +74,7 @@ encode_vdo_component(struct vdo_component_41_0 state, struct buffer *buffer);
  **/
 int __must_check
 decode_vdo_component(struct buffer *buffer,
-		     struct vdo_component_41_0 *component_ptr);
+		     struct vdo_component *component_ptr);
 
 /**
  * Validate constraints on a VDO config.
@@ -85,4 +90,14 @@ int __must_check validate_vdo_config(const struct vdo_config *config,
 				     block_count_t block_count,
 				     bool require_logical);
 
+/**
+ * Get the name of a chunk-name hash algorithm.
+ *
+ * @param algorithm  The hash algorithm
+ *
+ * @return The name of the algorithm as used in the device table
+ **/
+const char * __must_check
+get_vdo_hash_algorithm_name(enum vdo_hash_algorithm algorithm);
+
 #endif /* VDO_COMPONENT_H */
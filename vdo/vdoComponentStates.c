@@ -151,16 +151,17 @@ int validate_component_states(struct vdo_component_states *states,
 /**
  * Get the component data size of a vdo.
  *
- * @param layout  The layout of the vdo
+ * @param states  The component states of the vdo
  *
  * @return the component data size of the vdo
  **/
-static size_t __must_check get_component_data_size(struct fixed_layout *layout)
+static size_t __must_check
+get_component_data_size(const struct vdo_component_states *states)
 {
 	return (sizeof(release_version_number_t) +
 		sizeof(struct version_number) +
-		get_vdo_component_encoded_size() +
-		get_fixed_layout_encoded_size(layout) +
+		get_vdo_component_encoded_size(&states->vdo) +
+		get_fixed_layout_encoded_size(states->layout) +
 		get_recovery_journal_encoded_size() +
 		get_slab_depot_encoded_size() +
 		get_block_map_encoded_size());
@@ -212,7 +213,7 @@ int encode_component_states(struct buffer *buffer,
 		return result;
 	}
 
-	expected_size = get_component_data_size(states->layout);
+	expected_size = get_component_data_size(states);
 	ASSERT_LOG_ONLY((content_length(buffer) == expected_size),
 			"All super block component data was encoded");
 	return VDO_SUCCESS;
@@ -32,6 +32,7 @@
 #include "instanceNumber.h"
 #include "limiter.h"
 #include "poolSysfs.h"
+#include "qosClasses.h"
 #include "types.h"
 #include "vdoInternal.h"
 #include "volumeGeometry.h"
@@ -87,6 +88,10 @@ static int initialize_vdo_kobjects(struct vdo *vdo,
 /**********************************************************************/
 static int handle_initialization_failure(struct vdo *vdo, int result)
 {
+	uninitialize_limiter(&vdo->request_limiter);
+	uninitialize_limiter(&vdo->discard_limiter);
+	uninitialize_limiter(&vdo->write_limiter);
+	free_qos_classes(&vdo->qos_classes);
 	release_vdo_instance(vdo->instance);
 	FREE(vdo->layer);
 	return result;
@@ -108,8 +113,33 @@ int initialize_vdo(struct vdo *vdo,
 	vdo->allocations_allowed = true;
 	INIT_LIST_HEAD(&vdo->device_config_list);
 	initialize_vdo_admin_completion(vdo, &vdo->admin_completion);
-	initialize_limiter(&vdo->request_limiter, MAXIMUM_VDO_USER_VIOS);
-	initialize_limiter(&vdo->discard_limiter, MAXIMUM_VDO_USER_VIOS * 3 / 4);
+	result = initialize_limiter(&vdo->request_limiter,
+				    MAXIMUM_VDO_USER_VIOS);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate request limiter";
+		return handle_initialization_failure(vdo, result);
+	}
+
+	result = initialize_limiter(&vdo->discard_limiter,
+				    MAXIMUM_VDO_USER_VIOS * 3 / 4);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate discard limiter";
+		return handle_initialization_failure(vdo, result);
+	}
+
+	// Keep a quarter of the data_vios free for reads during write storms.
+	result = initialize_limiter(&vdo->write_limiter,
+				    MAXIMUM_VDO_USER_VIOS * 3 / 4);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate write limiter";
+		return handle_initialization_failure(vdo, result);
+	}
+
+	result = make_qos_classes(config, &vdo->qos_classes);
+	if (result != VDO_SUCCESS) {
+		*reason = "Cannot allocate QoS class limiters";
+		return handle_initialization_failure(vdo, result);
+	}
 
 	initialize_deadlock_queue(&vdo->deadlock_queue);
 
@@ -123,16 +153,19 @@ int initialize_vdo(struct vdo *vdo,
 	result = make_thread_config(config->thread_counts.logical_zones,
 				    config->thread_counts.physical_zones,
 				    config->thread_counts.hash_zones,
+				    config->thread_counts.packer_zones,
+				    config->thread_counts.zone_threads,
 				    &vdo->thread_config);
 	if (result != VDO_SUCCESS) {
 		*reason = "Cannot create thread configuration";
 		return handle_initialization_failure(vdo, result);
 	}
 
-	log_info("zones: %d logical, %d physical, %d hash; base threads: %d",
+	log_info("zones: %d logical, %d physical, %d hash, %d packer; base threads: %d",
 		 config->thread_counts.logical_zones,
 		 config->thread_counts.physical_zones,
 		 config->thread_counts.hash_zones,
+		 vdo->thread_config->packer_zone_count,
 		 vdo->thread_config->base_thread_count);
 
 	/*
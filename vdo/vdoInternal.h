@@ -49,6 +49,14 @@
 #include "vdoState.h"
 #include "volumeGeometry.h"
 
+enum {
+	/**
+	 * The most completions a thread defers for enqueueing together
+	 * before it enqueues them early
+	 **/
+	MAX_BATCHED_COMPLETIONS = 64,
+};
+
 /**
  * Error counters are atomic since updates can arrive concurrently from
  * arbitrary threads.
@@ -65,6 +73,14 @@ struct vdo_thread {
 	thread_id_t thread_id;
 	struct vdo_work_queue *request_queue;
 	struct registered_thread allocating_thread;
+	/** How deeply callbacks are nested by being run directly */
+	unsigned int callback_depth;
+	/** How deeply completion batches are nested on this thread */
+	unsigned int batch_depth;
+	/** The number of completions deferred by the current batch */
+	unsigned int batched_count;
+	/** The completions to enqueue when the current batch finishes */
+	struct vdo_completion *batched[MAX_BATCHED_COMPLETIONS];
 };
 
 struct vdo {
@@ -77,6 +93,12 @@ struct vdo {
 	/** Limit the number of requests that are being processed. */
 	struct limiter request_limiter;
 	struct limiter discard_limiter;
+	/** Limit the share of requests which may be writes. */
+	struct limiter write_limiter;
+	/** Limit the requests in progress in each QoS class. */
+	struct qos_classes *qos_classes;
+	/** Adjusts the request limit to the observed request latency. */
+	struct request_governor *request_governor;
 
 	/** Incoming bios we've had to buffer to avoid deadlock. */
 	struct deadlock_queue deadlock_queue;
@@ -126,13 +148,19 @@ struct vdo {
 	/* The slab depot */
 	struct slab_depot *depot;
 
-	/* The compressed-block packer */
-	struct packer *packer;
+	/* The compressed-block packers, one per packer zone */
+	struct packer_zones *packer_zones;
 	/* Whether incoming data should be compressed */
 	bool compressing;
+	/* Recently read compressed blocks */
+	struct read_cache *read_cache;
 
 	/* The handler for flush requests */
 	struct flusher *flusher;
+	/* The number of flushes sent to the backing device */
+	atomic64_t flushes_started;
+	/* The number of flushes to the backing device which have succeeded */
+	atomic64_t flushes_completed;
 
 	/* The state the vdo was in when loaded (primarily for unit tests) */
 	enum vdo_state load_state;
@@ -146,6 +174,18 @@ struct vdo {
 	/* The hash lock zones of this vdo */
 	struct hash_zone **hash_zones;
 
+	/* The zone map of the dedupe index, once has_index_zone_map is set */
+	struct uds_zone_map index_zone_map;
+
+	/* Whether the zone map of the dedupe index has been learned */
+	bool has_index_zone_map;
+
+	/*
+	 * The index query latency, in microseconds, past which a data_vio
+	 * writes its data while verifying its advice, or 0 to never do so
+	 */
+	unsigned int optimistic_verify_us;
+
 	/* The completion for administrative operations */
 	struct admin_completion admin_completion;
 
@@ -154,6 +194,11 @@ struct vdo {
 
 	/* Whether a close is required */
 	bool close_required;
+	/*
+	 * Whether the current suspend should skip saving the metadata,
+	 * either because it is a no-flush suspend or because it is only to
+	 * reload a compatible table
+	 */
 	bool no_flush_suspend;
 	bool allocations_allowed;
 
@@ -368,6 +413,17 @@ void assert_on_physical_zone_thread(const struct vdo *vdo,
 struct hash_zone * __must_check
 select_hash_zone(const struct vdo *vdo, const struct uds_chunk_name *name);
 
+/**
+ * Record the zone map of the dedupe index so that each chunk name will be
+ * assigned to a hash zone matching its index zone. Only the first map
+ * recorded is used, since moving names between hash zones again would only
+ * cost locality.
+ *
+ * @param vdo  The vdo
+ * @param map  The zone map of the dedupe index
+ **/
+void set_vdo_index_zone_map(struct vdo *vdo, const struct uds_zone_map *map);
+
 /**
  * Get the physical zone responsible for a given physical block number of a
  * data block in this vdo instance, or of the zero block (for which a NULL
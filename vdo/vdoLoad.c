@@ -32,6 +32,7 @@
 #include "header.h"
 #include "logicalZone.h"
 #include "physicalZone.h"
+#include "readCache.h"
 #include "readOnlyRebuild.h"
 #include "recoveryJournal.h"
 #include "releaseVersions.h"
@@ -40,6 +41,7 @@
 #include "superBlockCodec.h"
 #include "threadConfig.h"
 #include "types.h"
+#include "vdo.h"
 #include "vdoInternal.h"
 #include "vdoRecovery.h"
 
@@ -175,6 +177,38 @@ static void handle_scrubbing_error(struct vdo_completion *completion)
 	wait_for_read_only_mode(completion);
 }
 
+/**
+ * Check whether a load replays the recovery journal into the block map, in
+ * which case the block map cache can not be warmed until the replay is done.
+ *
+ * @param vdo  The vdo being loaded
+ *
+ * @return <code>true</code> if the load replays the journal
+ **/
+static bool replays_journal(const struct vdo *vdo)
+{
+	return ((vdo->load_state == VDO_DIRTY) ||
+		(vdo->load_state == VDO_REPLAYING));
+}
+
+/**
+ * Start reading the block map pages recorded as hot in the super block into
+ * the block map cache. The pages are read by the logical zones while the rest
+ * of the load proceeds.
+ *
+ * @param vdo  The vdo being loaded
+ **/
+static void start_warming_block_map(struct vdo *vdo)
+{
+	struct buffer *buffer
+		= get_super_block_codec(vdo->super_block)->spare_buffer;
+
+	initialize_block_map_from_journal(vdo->block_map,
+					  vdo->recovery_journal);
+	clear_buffer(buffer);
+	warm_block_map(vdo->block_map, buffer);
+}
+
 /**
  * This is the callback after the super block is written. It prepares the block
  * allocator to come online and start allocating. It is registered in
@@ -192,8 +226,14 @@ static void prepare_to_come_online(struct vdo_completion *completion)
 		load_type = RECOVERY_LOAD;
 	}
 
-	initialize_block_map_from_journal(vdo->block_map,
-					  vdo->recovery_journal);
+	if (replays_journal(vdo)) {
+		// Tree pages never move, so the hot set saved at the last
+		// clean shutdown is still good after a recovery.
+		start_warming_block_map(vdo);
+	} else {
+		initialize_block_map_from_journal(vdo->block_map,
+						  vdo->recovery_journal);
+	}
 
 	prepare_vdo_admin_sub_task(vdo, scrub_slabs, handle_scrubbing_error);
 	prepare_to_allocate(vdo->depot, load_type, completion);
@@ -253,6 +293,12 @@ static void load_callback(struct vdo_completion *completion)
 		return;
 	}
 
+	/*
+	 * Neither the depot load nor the super block save touches the block
+	 * map, so warm its cache now so that the page reads overlap them
+	 * rather than waiting for the allocators to be ready.
+	 */
+	start_warming_block_map(vdo);
 	prepare_vdo_admin_sub_task(vdo, make_dirty, continue_load_read_only);
 	load_slab_depot(vdo->depot,
 			(was_new(vdo) ? ADMIN_STATE_FORMATTING :
@@ -268,6 +314,36 @@ int perform_vdo_load(struct vdo *vdo)
 					   load_callback, load_callback);
 }
 
+/**
+ * Record the configured chunk-name hash algorithm in a newly formatted vdo, or
+ * check that it matches the algorithm recorded when the vdo was first
+ * loaded. Changing the hash of a populated vdo would orphan every entry in
+ * its dedupe index.
+ *
+ * @param vdo  The vdo being loaded
+ *
+ * @return VDO_SUCCESS or VDO_PARAMETER_MISMATCH
+ **/
+static int __must_check check_hash_algorithm(struct vdo *vdo)
+{
+	enum vdo_hash_algorithm configured
+		= vdo->device_config->hash_algorithm;
+
+	if (vdo->load_state == VDO_NEW) {
+		vdo->states.vdo.hash_algorithm = configured;
+		return VDO_SUCCESS;
+	}
+
+	if (vdo->states.vdo.hash_algorithm != configured) {
+		return log_error_strerror(VDO_PARAMETER_MISMATCH,
+					  "hash algorithm %s was configured, but the vdo was formatted with %s",
+					  get_vdo_hash_algorithm_name(configured),
+					  get_vdo_hash_algorithm_name(vdo->states.vdo.hash_algorithm));
+	}
+
+	return VDO_SUCCESS;
+}
+
 /**
  * Decode the VDO state from the super block and validate that it is correct.
  * On error from this method, the component states must be destroyed
@@ -293,6 +369,11 @@ static int __must_check decode_from_super_block(struct vdo *vdo)
 	set_vdo_state(vdo, vdo->states.vdo.state);
 	vdo->load_state = vdo->states.vdo.state;
 
+	result = check_hash_algorithm(vdo);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
 	block_count = get_vdo_physical_block_count(vdo);
 	result = validate_component_states(&vdo->states,
 					   vdo->geometry.nonce,
@@ -304,6 +385,31 @@ static int __must_check decode_from_super_block(struct vdo *vdo)
 	return decode_vdo_layout(vdo->states.layout, &vdo->layout);
 }
 
+/**
+ * Check that a separate journal device, if there is one, can hold the whole
+ * recovery journal.
+ *
+ * @param vdo  The vdo being loaded
+ *
+ * @return VDO_SUCCESS or VDO_BAD_CONFIGURATION
+ **/
+static int __must_check check_journal_device_size(struct vdo *vdo)
+{
+	block_count_t journal_size =
+		vdo->states.vdo.config.recovery_journal_size;
+	struct block_device *device = get_vdo_journal_device(vdo);
+
+	if ((device == NULL) ||
+	    ((i_size_read(device->bd_inode) / VDO_BLOCK_SIZE) >=
+	     journal_size)) {
+		return VDO_SUCCESS;
+	}
+
+	return log_error_strerror(VDO_BAD_CONFIGURATION,
+				  "journal device is smaller than the %llu block recovery journal",
+				  journal_size);
+}
+
 /**
  * Decode the component data portion of a super block and fill in the
  * corresponding portions of the vdo being loaded. This will also allocate the
@@ -333,6 +439,11 @@ static int __must_check decode_vdo(struct vdo *vdo)
 		return VDO_BAD_CONFIGURATION;
 	}
 
+	result = check_journal_device_size(vdo);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
 	result = make_read_only_notifier(in_read_only_mode(vdo),
 					 thread_config,
 					 vdo,
@@ -389,6 +500,11 @@ static int __must_check decode_vdo(struct vdo *vdo)
 		return result;
 	}
 
+	result = make_read_cache(&vdo->read_cache);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
 	result = ALLOCATE(thread_config->hash_zone_count,
 			  struct hash_zone *,
 			  __func__,
@@ -425,10 +541,10 @@ static int __must_check decode_vdo(struct vdo *vdo)
 		}
 	}
 
-	return make_packer(vdo,
-			   DEFAULT_PACKER_INPUT_BINS,
-			   DEFAULT_PACKER_OUTPUT_BINS,
-			   &vdo->packer);
+	return make_packer_zones(vdo,
+				 DEFAULT_PACKER_INPUT_BINS,
+				 DEFAULT_PACKER_OUTPUT_BINS,
+				 &vdo->packer_zones);
 }
 
 /**
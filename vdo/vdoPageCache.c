@@ -21,7 +21,11 @@
 
 #include "vdoPageCacheInternals.h"
 
+#include <linux/list_sort.h>
+#include <linux/mm.h>
 #include <linux/ratelimit.h>
+#include <linux/rcupdate.h>
+#include <linux/version.h>
 
 #include "errors.h"
 #include "logger.h"
@@ -29,12 +33,15 @@
 #include "permassert.h"
 
 #include "adminState.h"
+#include "blockMapPage.h"
 #include "constants.h"
+#include "kernelVDO.h"
 #include "numUtils.h"
 #include "readOnlyNotifier.h"
 #include "statusCodes.h"
 #include "types.h"
 #include "vdo.h"
+#include "vdoTrace.h"
 #include "vio.h"
 
 enum {
@@ -44,10 +51,80 @@ enum {
 
 /*
  * For adjusting VDO page cache statistic fields which are only mutated on the
- * logical zone thread. Prevents any compiler shenanigans from affecting other
- * threads reading those stats.
+ * logical zone thread. Each update is made in a write section of the cache's
+ * stats_sequence so that other threads can take a consistent snapshot of all
+ * the fields.
  */
-#define ADD_ONCE(value, delta) WRITE_ONCE(value, (value) + (delta))
+#define ADD_STAT(cache, field, delta)				\
+	do {							\
+		begin_stats_update(cache);			\
+		(cache)->stats.field += (delta);		\
+		end_stats_update(cache);			\
+	} while (0)
+
+#define SET_STAT(cache, field, value)				\
+	do {							\
+		begin_stats_update(cache);			\
+		(cache)->stats.field = (value);			\
+		end_stats_update(cache);			\
+	} while (0)
+
+/**
+ * Begin an update of a page cache's statistics. Preemption is disabled for
+ * the duration of the update so that a reader never spins waiting for a
+ * writer which has been scheduled out.
+ *
+ * @param cache  The cache whose statistics are being updated
+ **/
+static inline void begin_stats_update(struct vdo_page_cache *cache)
+{
+	preempt_disable();
+	write_seqcount_begin(&cache->stats_sequence);
+}
+
+/**
+ * Finish an update of a page cache's statistics.
+ *
+ * @param cache  The cache whose statistics were updated
+ **/
+static inline void end_stats_update(struct vdo_page_cache *cache)
+{
+	write_seqcount_end(&cache->stats_sequence);
+	preempt_enable();
+}
+
+enum {
+	/** The size of a compacted page slot */
+	COMPACT_PAGE_SIZE = 512,
+	/** The number of compacted page slots in a page buffer */
+	COMPACT_PAGES_PER_BLOCK = VDO_BLOCK_SIZE / COMPACT_PAGE_SIZE,
+};
+
+/**
+ * A clean page which has been evicted from the cache but is kept, as the runs
+ * of its entries, in a slot of a page buffer in the PS_COMPACT state.
+ **/
+struct compact_page {
+	/** the entry on the LRU list or on the list of free slots */
+	struct list_head entry;
+	/** the page buffer holding the slot */
+	struct page_info *block;
+	/** the pbn of the page, or NO_PAGE if the slot is free */
+	physical_block_number_t pbn;
+	/** the number of runs describing the entries of the page */
+	slot_number_t run_count;
+	/** the header of the page */
+	byte header[sizeof(struct block_map_page)];
+	/** the runs describing the entries of the page */
+	struct block_map_run runs[];
+};
+
+enum {
+	/** The number of runs which fit in a compacted page slot */
+	COMPACT_PAGE_MAXIMUM_RUNS =
+		((COMPACT_PAGE_SIZE - sizeof(struct compact_page))
+		 / sizeof(struct block_map_run)),
+};
 
 /**********************************************************************/
 static inline bool is_present(const struct page_info *info)
@@ -79,11 +156,17 @@ static inline bool is_valid(const struct page_info *info)
 	return is_present(info) || is_outgoing(info);
 }
 
+/**********************************************************************/
+static inline bool is_retiring(const struct page_info *info)
+{
+	return info->extent->retiring;
+}
+
 /**********************************************************************/
 static char *get_page_buffer(struct page_info *info)
 {
-	struct vdo_page_cache *cache = info->cache;
-	return &cache->pages[(info - cache->infos) * VDO_BLOCK_SIZE];
+	struct page_extent *extent = info->extent;
+	return &extent->pages[(info - extent->infos) * VDO_BLOCK_SIZE];
 }
 
 /**********************************************************************/
@@ -122,51 +205,173 @@ page_completion_from_waiter(struct waiter *waiter)
 }
 
 /**
- * Allocate components of the cache which require their own allocation. The
- * caller is responsible for all clean up on errors.
+ * Allocate zeroed memory for a page cache, on the NUMA node of the cache's
+ * thread if possible. The memory is physically contiguous when it can be, so
+ * that it is reached through the kernel's direct mapping, which is built from
+ * huge pages, rather than through 4KB vmalloc mappings which put pressure on
+ * the TLB once a cache spans many gigabytes.
  *
- * @param cache     The cache being constructed
+ * @param [in]  size        The number of bytes to allocate
+ * @param [in]  align       The required alignment of the memory
+ * @param [in]  node        The NUMA node to allocate on, or NUMA_NO_NODE
+ * @param [in]  what        What the memory is for (for logging)
+ * @param [out] contiguous  Set to whether the memory is physically contiguous
+ * @param [out] ptr         A pointer to hold the memory
  *
  * @return VDO_SUCCESS or an error code
  **/
-static int __must_check allocate_cache_components(struct vdo_page_cache *cache)
+static int __must_check allocate_cache_memory(size_t size,
+					      size_t align,
+					      int node,
+					      const char *what,
+					      bool *contiguous,
+					      void *ptr)
+{
+	unsigned int order = get_order(size);
+	unsigned long used = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	unsigned long i;
+	struct page *page = alloc_pages_node(node,
+					     (GFP_NOIO | __GFP_ZERO |
+					      __GFP_NOWARN | __GFP_NORETRY),
+					     order);
+	if (page == NULL) {
+		// Memory is too fragmented, so settle for vmalloc.
+		*contiguous = false;
+		return allocate_tagged_memory(size, align,
+					      MEMORY_TAG_VDO_PAGE_CACHE, what,
+					      ptr);
+	}
+
+	// Give back the pages past the end of the memory, as
+	// alloc_pages_exact() does.
+	split_page(page, order);
+	for (i = used; i < (1UL << order); i++) {
+		__free_page(page + i);
+	}
+
+	adjust_tagged_memory_bytes(MEMORY_TAG_VDO_PAGE_CACHE,
+				   used << PAGE_SHIFT);
+	*contiguous = true;
+	*((void **) ptr) = page_address(page);
+	return VDO_SUCCESS;
+}
+
+/**
+ * Free memory allocated by allocate_cache_memory().
+ *
+ * @param memory      The memory to free (may be NULL)
+ * @param size        The size of the memory
+ * @param contiguous  Whether the memory is physically contiguous
+ **/
+static void free_cache_memory(void *memory, size_t size, bool contiguous)
 {
-	uint64_t size = cache->page_count * (uint64_t) VDO_BLOCK_SIZE;
+	if (!contiguous) {
+		FREE_TAGGED(memory, MEMORY_TAG_VDO_PAGE_CACHE);
+		return;
+	}
 
-	int result = ALLOCATE(cache->page_count,
-			      struct page_info,
-			      "page infos",
-			      &cache->infos);
-	if (result != UDS_SUCCESS) {
-		return result;
+	free_pages_exact(memory, size);
+	adjust_tagged_memory_bytes(MEMORY_TAG_VDO_PAGE_CACHE,
+				   -((int64_t) PAGE_ALIGN(size)));
+}
+
+/**
+ * Get the size of a page extent with its page infos.
+ *
+ * @param page_count  The number of pages in the extent
+ *
+ * @return The size of the extent
+ **/
+static inline size_t get_page_extent_size(page_count_t page_count)
+{
+	return (sizeof(struct page_extent) +
+		(page_count * sizeof(struct page_info)));
+}
+
+/**
+ * Free a page extent and the vios of its pages.
+ *
+ * @param extent  The extent to free
+ **/
+static void free_page_extent(struct page_extent *extent)
+{
+	struct page_info *info;
+	for (info = extent->infos; info < extent->infos + extent->page_count;
+	     ++info) {
+		free_vio(&info->vio);
 	}
 
-	result = allocate_memory(size, VDO_BLOCK_SIZE, "cache pages",
-				 &cache->pages);
-	if (result != UDS_SUCCESS) {
-		return result;
+	if (extent->pages != NULL) {
+		free_cache_memory(extent->pages,
+				  extent->page_count * (size_t) VDO_BLOCK_SIZE,
+				  extent->pages_contiguous);
 	}
 
-	return make_int_map(cache->page_count, 0, &cache->page_map);
+	free_cache_memory(extent, get_page_extent_size(extent->page_count),
+			  extent->contiguous);
+}
+
+/**
+ * Free all the extents on a list.
+ *
+ * @param extents  The list of extents to free
+ **/
+static void free_page_extents(struct list_head *extents)
+{
+	struct page_extent *extent, *tmp;
+	list_for_each_entry_safe(extent, tmp, extents, entry) {
+		list_del(&extent->entry);
+		free_page_extent(extent);
+	}
 }
 
 /**
- * Initialize all page info structures and put them on the free list.
+ * Allocate a page extent with its page memory and page infos.
  *
- * @param cache  The cache to initialize
+ * @param [in]  cache       The cache which will own the extent
+ * @param [in]  page_count  The number of pages in the extent
+ * @param [out] extent_ptr  A pointer to hold the new extent
  *
- * @return VDO_SUCCESS or an error
+ * @return VDO_SUCCESS or an error code
  **/
-static int initialize_info(struct vdo_page_cache *cache)
+static int __must_check make_page_extent(struct vdo_page_cache *cache,
+					 page_count_t page_count,
+					 struct page_extent **extent_ptr)
 {
+	struct page_extent *extent;
 	struct page_info *info;
-	INIT_LIST_HEAD(&cache->free_list);
-	for (info = cache->infos; info < cache->infos + cache->page_count;
-	     ++info) {
-		int result;
+	bool contiguous;
+	int result = allocate_cache_memory(get_page_extent_size(page_count),
+					   __alignof__(struct page_extent),
+					   cache->node,
+					   "page cache extent",
+					   &contiguous,
+					   &extent);
+	if (result != UDS_SUCCESS) {
+		return result;
+	}
+
+	extent->contiguous = contiguous;
+	extent->page_count = page_count;
+	INIT_LIST_HEAD(&extent->entry);
+	result = allocate_cache_memory(page_count * (size_t) VDO_BLOCK_SIZE,
+				       VDO_BLOCK_SIZE, cache->node,
+				       "cache pages",
+				       &extent->pages_contiguous,
+				       &extent->pages);
+	if (result != UDS_SUCCESS) {
+		free_page_extent(extent);
+		return result;
+	}
+
+	for (info = extent->infos; info < extent->infos + page_count; ++info) {
 		info->cache = cache;
+		info->extent = extent;
 		info->state = PS_FREE;
 		info->pbn = NO_PAGE;
+		seqcount_init(&info->sequence);
+		INIT_LIST_HEAD(&info->state_entry);
+		INIT_LIST_HEAD(&info->lru_entry);
 
 		result = create_metadata_vio(cache->vdo,
 					     VIO_TYPE_BLOCK_MAP,
@@ -174,21 +379,77 @@ static int initialize_info(struct vdo_page_cache *cache)
 					     get_page_buffer(info),
 					     &info->vio);
 		if (result != VDO_SUCCESS) {
+			free_page_extent(extent);
 			return result;
 		}
 
 		// The thread ID should never change.
 		info->vio->completion.callback_thread_id =
 			cache->zone->thread_id;
+	}
 
-		INIT_LIST_HEAD(&info->state_entry);
-		list_add_tail(&info->state_entry, &cache->free_list);
-		INIT_LIST_HEAD(&info->lru_entry);
+	*extent_ptr = extent;
+	return VDO_SUCCESS;
+}
+
+/**
+ * Allocate enough extents to hold a number of pages and put them on the
+ * cache's list of pending extents.
+ *
+ * @param cache       The cache
+ * @param page_count  The number of pages to allocate
+ *
+ * @return VDO_SUCCESS or an error code
+ **/
+static int __must_check make_pending_extents(struct vdo_page_cache *cache,
+					     page_count_t page_count)
+{
+	while (page_count > 0) {
+		struct page_extent *extent;
+		page_count_t count = min_t(page_count_t, page_count,
+					   PAGE_EXTENT_SIZE);
+		int result = make_page_extent(cache, count, &extent);
+		if (result != VDO_SUCCESS) {
+			free_page_extents(&cache->pending_extents);
+			return result;
+		}
+
+		list_add_tail(&extent->entry, &cache->pending_extents);
+		page_count -= count;
 	}
 
 	return VDO_SUCCESS;
 }
 
+/**
+ * Move the pending extents into the cache and put their pages on the free
+ * list.
+ *
+ * @param cache  The cache
+ **/
+static void adopt_pending_extents(struct vdo_page_cache *cache)
+{
+	while (!list_empty(&cache->pending_extents)) {
+		struct page_info *info;
+		struct page_extent *extent =
+			list_first_entry(&cache->pending_extents,
+					 struct page_extent, entry);
+		list_move_tail(&extent->entry, &cache->extents);
+		for (info = extent->infos;
+		     info < extent->infos + extent->page_count;
+		     ++info) {
+			list_add_tail(&info->state_entry, &cache->free_list);
+		}
+
+		WRITE_ONCE(cache->page_count,
+			   cache->page_count + extent->page_count);
+		ADD_STAT(cache, free_pages, extent->page_count);
+		if (extent->pages_contiguous) {
+			ADD_STAT(cache, contiguous_pages, extent->page_count);
+		}
+	}
+}
+
 /**********************************************************************/
 static void write_dirty_pages_callback(struct list_head *entry, void *context);
 
@@ -217,24 +478,69 @@ int make_vdo_page_cache(struct vdo *vdo,
 	}
 
 	cache->vdo = vdo;
-	cache->page_count = page_count;
+	cache->node = get_vdo_thread_node(vdo, zone->thread_id);
 	cache->read_hook = read_hook;
 	cache->write_hook = write_hook;
 	cache->zone = zone;
-	cache->stats.free_pages = page_count;
+	initialize_vdo_completion(&cache->reaper, vdo,
+				  VDO_PAGE_CACHE_COMPLETION);
+	seqcount_init(&cache->stats_sequence);
+
+	// initialize empty circular queues
+	INIT_LIST_HEAD(&cache->extents);
+	INIT_LIST_HEAD(&cache->pending_extents);
+	INIT_LIST_HEAD(&cache->free_list);
+	INIT_LIST_HEAD(&cache->probation_list);
+	INIT_LIST_HEAD(&cache->protected_list);
+	INIT_LIST_HEAD(&cache->outgoing_list);
+
+	result = make_pending_extents(cache, page_count);
+	if (result != VDO_SUCCESS) {
+		free_vdo_page_cache(&cache);
+		return result;
+	}
+
+	adopt_pending_extents(cache);
+	cache->target_page_count = page_count;
+	cache->protected_limit = (page_count / 4) * 3;
+	cache->promotion_distance = max_t(uint64_t, page_count / 16, 1);
+
+	result = make_int_map(page_count, 0, &cache->page_map);
+	if (result != VDO_SUCCESS) {
+		free_vdo_page_cache(&cache);
+		return result;
+	}
 
-	result = allocate_cache_components(cache);
+	INIT_LIST_HEAD(&cache->compact_lru);
+	INIT_LIST_HEAD(&cache->compact_free_list);
+	result = make_int_map(0, 0, &cache->compact_map);
 	if (result != VDO_SUCCESS) {
 		free_vdo_page_cache(&cache);
 		return result;
 	}
 
-	result = initialize_info(cache);
+	result = ALLOCATE_TAGGED(COMPACT_PAGE_SIZE, char,
+				 MEMORY_TAG_VDO_PAGE_CACHE,
+				 "compact page buffer", &cache->compact_buffer);
+	if (result != UDS_SUCCESS) {
+		free_vdo_page_cache(&cache);
+		return result;
+	}
+
+	result = make_page_cache_simulator(page_count, &cache->simulator);
 	if (result != VDO_SUCCESS) {
 		free_vdo_page_cache(&cache);
 		return result;
 	}
 
+	cache->published_count = max_t(page_count_t, page_count, 1);
+	result = ALLOCATE(cache->published_count, struct page_info *,
+			  "published pages", &cache->published);
+	if (result != UDS_SUCCESS) {
+		free_vdo_page_cache(&cache);
+		return result;
+	}
+
 	result = make_dirty_lists(maximum_age, write_dirty_pages_callback,
 				  cache, &cache->dirty_lists);
 	if (result != VDO_SUCCESS) {
@@ -242,10 +548,6 @@ int make_vdo_page_cache(struct vdo *vdo,
 		return result;
 	}
 
-	// initialize empty circular queues
-	INIT_LIST_HEAD(&cache->lru_list);
-	INIT_LIST_HEAD(&cache->outgoing_list);
-
 	*cache_ptr = cache;
 	return VDO_SUCCESS;
 }
@@ -258,19 +560,15 @@ void free_vdo_page_cache(struct vdo_page_cache **cache_ptr)
 		return;
 	}
 
-	if (cache->infos != NULL) {
-		struct page_info *info;
-		for (info = cache->infos;
-		     info < cache->infos + cache->page_count;
-		     ++info) {
-			free_vio(&info->vio);
-		}
-	}
-
+	free_page_extents(&cache->extents);
+	free_page_extents(&cache->pending_extents);
 	free_dirty_lists(&cache->dirty_lists);
 	free_int_map(&cache->page_map);
-	FREE(cache->infos);
-	FREE(cache->pages);
+	free_int_map(&cache->compact_map);
+	FREE_TAGGED(cache->compact_buffer, MEMORY_TAG_VDO_PAGE_CACHE);
+	free_page_cache_simulator(&cache->simulator);
+	free_page_cache_simulator(&cache->pending_simulator);
+	FREE(cache->published);
 	FREE(cache);
 	*cache_ptr = NULL;
 }
@@ -324,7 +622,7 @@ static inline void assert_io_allowed(struct vdo_page_cache *cache)
  **/
 static void report_cache_pressure(struct vdo_page_cache *cache)
 {
-	ADD_ONCE(cache->stats.cache_pressure, 1);
+	ADD_STAT(cache, cache_pressure, 1);
 	if (cache->waiter_count > cache->page_count) {
 		if ((cache->pressure_report % LOG_INTERVAL) == 0) {
 			log_info("page cache pressure %u",
@@ -352,7 +650,8 @@ get_page_state_name(enum vdo_page_buffer_state state)
 {
 	int result;
 	static const char *state_names[] = {
-		"FREE", "INCOMING", "FAILED", "RESIDENT", "DIRTY", "OUTGOING"
+		"FREE", "INCOMING", "FAILED", "RESIDENT", "DIRTY", "OUTGOING",
+		"COMPACT"
 	};
 	STATIC_ASSERT(COUNT_OF(state_names) == PAGE_STATE_COUNT);
 
@@ -377,27 +676,27 @@ static void update_counter(struct page_info *info, int32_t delta)
 	struct block_map_statistics *stats = &info->cache->stats;
 	switch (info->state) {
 	case PS_FREE:
-		ADD_ONCE(stats->free_pages, delta);
+		stats->free_pages += delta;
 		return;
 
 	case PS_INCOMING:
-		ADD_ONCE(stats->incoming_pages, delta);
+		stats->incoming_pages += delta;
 		return;
 
 	case PS_OUTGOING:
-		ADD_ONCE(stats->outgoing_pages, delta);
+		stats->outgoing_pages += delta;
 		return;
 
 	case PS_FAILED:
-		ADD_ONCE(stats->failed_pages, delta);
+		stats->failed_pages += delta;
 		return;
 
 	case PS_RESIDENT:
-		ADD_ONCE(stats->clean_pages, delta);
+		stats->clean_pages += delta;
 		return;
 
 	case PS_DIRTY:
-		ADD_ONCE(stats->dirty_pages, delta);
+		stats->dirty_pages += delta;
 		return;
 
 	default:
@@ -405,15 +704,79 @@ static void update_counter(struct page_info *info, int32_t delta)
 	}
 }
 
+/**
+ * Demote the least recently used protected pages to probation until there are
+ * no more protected pages than the cache allows.
+ *
+ * @param cache  The cache
+ **/
+static void enforce_protected_limit(struct vdo_page_cache *cache)
+{
+	while (cache->protected_count > cache->protected_limit) {
+		// The demoted page gets a fresh probation period.
+		struct page_info *oldest =
+			page_info_from_lru_entry(cache->protected_list.next);
+		oldest->is_protected = false;
+		oldest->probation_stamp = cache->admissions;
+		cache->protected_count--;
+		list_move_tail(&oldest->lru_entry, &cache->probation_list);
+	}
+
+	SET_STAT(cache, protected_pages, cache->protected_count);
+}
+
+/**
+ * Protect a page which has been reused, demoting the least recently used
+ * protected page to probation if there are too many protected pages.
+ *
+ * @param info  The page to protect
+ **/
+static void protect_page(struct page_info *info)
+{
+	struct vdo_page_cache *cache = info->cache;
+
+	info->is_protected = true;
+	cache->protected_count++;
+	ADD_STAT(cache, promotions, 1);
+	list_move_tail(&info->lru_entry, &cache->protected_list);
+	enforce_protected_limit(cache);
+}
+
 /**
  * Update the lru information for an active page.
+ *
+ * The cache is a segmented LRU. A page starts out on probation and is only
+ * protected once it is used again after enough other pages have been
+ * admitted; the burst of references a page gets from a sequential sweep all
+ * arrive soon after it is loaded, so swept pages stay on probation and are
+ * evicted before the pages which are reused over time.
  **/
 static void update_lru(struct page_info *info)
 {
 	struct vdo_page_cache *cache = info->cache;
 
-	if (cache->lru_list.prev != &info->lru_entry) {
-		list_move_tail(&info->lru_entry, &cache->lru_list);
+	if (list_empty(&info->lru_entry)) {
+		info->probation_stamp = cache->admissions++;
+		list_add_tail(&info->lru_entry, &cache->probation_list);
+		return;
+	}
+
+	if (info->is_protected) {
+		if (cache->protected_list.prev != &info->lru_entry) {
+			list_move_tail(&info->lru_entry,
+				       &cache->protected_list);
+		}
+		return;
+	}
+
+	if ((cache->admissions - info->probation_stamp) >=
+	    cache->promotion_distance) {
+		protect_page(info);
+		return;
+	}
+
+	if (cache->probation_list.prev != &info->lru_entry) {
+		list_move_tail(&info->lru_entry, &cache->probation_list);
 	}
 }
 
@@ -431,9 +794,11 @@ static void set_info_state(struct page_info *info,
 		return;
 	}
 
+	begin_stats_update(info->cache);
 	update_counter(info, -1);
 	info->state = new_state;
 	update_counter(info, 1);
+	end_stats_update(info->cache);
 
 	switch (info->state) {
 	case PS_FREE:
@@ -453,6 +818,31 @@ static void set_info_state(struct page_info *info,
 	}
 }
 
+/**
+ * Remove a page from the published page table, if it is there, so that
+ * lockless readers will no longer find it.
+ *
+ * @param info  The page to unpublish
+ **/
+static void unpublish_page(struct page_info *info)
+{
+	struct vdo_page_cache *cache = info->cache;
+	struct page_info **slot;
+
+	if (!info->published) {
+		return;
+	}
+
+	slot = &cache->published[info->key % cache->published_count];
+	raw_write_seqcount_begin(&info->sequence);
+	if (*slot == info) {
+		WRITE_ONCE(*slot, NULL);
+	}
+
+	info->published = false;
+	raw_write_seqcount_end(&info->sequence);
+}
+
 /**
  * Set the pbn for an info, updating the map as needed.
  *
@@ -472,6 +862,7 @@ set_info_pbn(struct page_info *info, physical_block_number_t pbn)
 	}
 
 	if (info->pbn != NO_PAGE) {
+		unpublish_page(info);
 		int_map_remove(cache->page_map, info->pbn);
 	}
 
@@ -486,6 +877,61 @@ set_info_pbn(struct page_info *info, physical_block_number_t pbn)
 	return VDO_SUCCESS;
 }
 
+/**
+ * Free the extents which have been entirely retired. This callback is
+ * registered in park_page().
+ *
+ * @param completion  The cache's reaper
+ **/
+static void reap_retired_extents(struct vdo_completion *completion)
+{
+	struct page_extent *extent, *tmp;
+	struct vdo_page_cache *cache =
+		container_of(completion, struct vdo_page_cache, reaper);
+
+	// Retired pages were unpublished when they were reset, but a lockless
+	// reader may still be looking at one. Resizing is rare enough that
+	// this thread can afford to wait for them.
+	synchronize_rcu();
+	list_for_each_entry_safe(extent, tmp, &cache->extents, entry) {
+		if (extent->retiring &&
+		    (extent->parked_count == extent->page_count)) {
+			list_del(&extent->entry);
+			free_page_extent(extent);
+		}
+	}
+
+	// The last page found may have been in a freed extent.
+	cache->last_found = NULL;
+	cache->reaping = false;
+	check_for_drain_complete(cache->zone);
+}
+
+/**
+ * Take a free page of a retiring extent out of use. Once all the pages of the
+ * extent have been parked, the extent is freed from a fresh callback since
+ * the page being parked may belong to a vio whose callback is still running.
+ *
+ * @param info  The page to park, which must be free
+ **/
+static void park_page(struct page_info *info)
+{
+	struct vdo_page_cache *cache = info->cache;
+	struct page_extent *extent = info->extent;
+
+	list_del_init(&info->state_entry);
+	ADD_STAT(cache, free_pages, -1);
+	if ((++extent->parked_count < extent->page_count) || cache->reaping) {
+		return;
+	}
+
+	cache->reaping = true;
+	reset_vdo_completion(&cache->reaper);
+	cache->reaper.requeue = true;
+	launch_vdo_completion_callback(&cache->reaper, reap_retired_extents,
+				       cache->zone->thread_id);
+}
+
 /**
  * Reset page info to represent an unallocated page.
  **/
@@ -505,37 +951,242 @@ static int reset_page_info(struct page_info *info)
 	result = set_info_pbn(info, NO_PAGE);
 	set_info_state(info, PS_FREE);
 	list_del_init(&info->lru_entry);
+	if (info->is_protected) {
+		info->is_protected = false;
+		info->cache->protected_count--;
+		SET_STAT(info->cache,
+			 protected_pages,
+			 info->cache->protected_count);
+	}
+
+	if (is_retiring(info)) {
+		park_page(info);
+	}
 	return result;
 }
 
 /**
- * Find a free page.
- *
- * @param cache         the page cache
+ * Find a free page.
+ *
+ * @param cache         the page cache
+ *
+ * @return a pointer to the page info structure (if found), NULL otherwise
+ **/
+static struct page_info * __must_check
+find_free_page(struct vdo_page_cache *cache)
+{
+	struct page_info *info;
+	if (cache->free_list.next == &cache->free_list) {
+		return NULL;
+	}
+	info = page_info_from_state_entry(cache->free_list.next);
+	list_del_init(&info->state_entry);
+	return info;
+}
+
+/**********************************************************************/
+struct page_info *vpc_find_page(struct vdo_page_cache *cache,
+				physical_block_number_t pbn)
+{
+	if ((cache->last_found != NULL) && (cache->last_found->pbn == pbn)) {
+		return cache->last_found;
+	}
+	cache->last_found = int_map_get(cache->page_map, pbn);
+	return cache->last_found;
+}
+
+/**
+ * Get a compacted page slot of a page buffer.
+ *
+ * @param info  The page buffer, which must be in the PS_COMPACT state
+ * @param slot  The index of the slot in the buffer
+ *
+ * @return The slot
+ **/
+static struct compact_page *get_compact_page(struct page_info *info,
+					     unsigned int slot)
+{
+	return (struct compact_page *)
+		(get_page_buffer(info) + (slot * COMPACT_PAGE_SIZE));
+}
+
+/**
+ * Forget a compacted page, leaving its slot free.
+ *
+ * @param cache    The cache
+ * @param compact  The compacted page to forget
+ **/
+static void free_compact_page(struct vdo_page_cache *cache,
+			      struct compact_page *compact)
+{
+	int_map_remove(cache->compact_map, compact->pbn);
+	compact->pbn = NO_PAGE;
+	list_move_tail(&compact->entry, &cache->compact_free_list);
+	ADD_STAT(cache, compact_pages, -1);
+}
+
+/**
+ * Divide a free page buffer into slots for compacted pages.
+ *
+ * @param info  The page buffer, which must be free
+ **/
+static void make_compact_block(struct page_info *info)
+{
+	struct vdo_page_cache *cache = info->cache;
+	unsigned int slot;
+
+	set_info_state(info, PS_COMPACT);
+	for (slot = 0; slot < COMPACT_PAGES_PER_BLOCK; slot++) {
+		struct compact_page *compact = get_compact_page(info, slot);
+		compact->block = info;
+		compact->pbn = NO_PAGE;
+		list_add_tail(&compact->entry, &cache->compact_free_list);
+	}
+
+	cache->compact_block_count++;
+}
+
+/**
+ * Forget the compacted pages held in a page buffer and free the buffer.
+ *
+ * @param info  The page buffer, which must be in the PS_COMPACT state
+ **/
+static void release_compact_block(struct page_info *info)
+{
+	struct vdo_page_cache *cache = info->cache;
+	unsigned int slot;
+
+	for (slot = 0; slot < COMPACT_PAGES_PER_BLOCK; slot++) {
+		struct compact_page *compact = get_compact_page(info, slot);
+		if (compact->pbn != NO_PAGE) {
+			free_compact_page(cache, compact);
+		}
+
+		list_del(&compact->entry);
+	}
+
+	cache->compact_block_count--;
+	set_info_state(info, PS_FREE);
+	if (is_retiring(info)) {
+		park_page(info);
+	}
+}
+
+/**
+ * Free page buffers holding compacted pages, preferring those with unused
+ * slots, until no more than a given number of them remain.
+ *
+ * @param cache  The cache
+ * @param limit  The number of page buffers which may hold compacted pages
+ **/
+static void shrink_compact_blocks(struct vdo_page_cache *cache,
+				  page_count_t limit)
+{
+	while (cache->compact_block_count > limit) {
+		struct list_head *slots = (list_empty(&cache->compact_free_list)
+					   ? &cache->compact_lru
+					   : &cache->compact_free_list);
+		struct compact_page *compact =
+			list_first_entry(slots, struct compact_page, entry);
+		release_compact_block(compact->block);
+	}
+}
+
+/**
+ * Compact a clean page which is about to be evicted into the cache's
+ * compaction buffer, if its entries form few enough runs.
+ *
+ * @param info  The page being evicted
+ *
+ * @return true if the page was compacted
+ **/
+static bool compact_evicted_page(struct page_info *info)
+{
+	struct vdo_page_cache *cache = info->cache;
+	struct compact_page *compact =
+		(struct compact_page *) cache->compact_buffer;
+	const struct block_map_page *page =
+		(const struct block_map_page *) get_page_buffer(info);
+
+	if ((cache->compact_block_limit == 0) || cache->rebuilding ||
+	    (info->state != PS_RESIDENT)) {
+		return false;
+	}
+
+	compact->run_count =
+		encode_block_map_page_runs(page, compact->runs,
+					   COMPACT_PAGE_MAXIMUM_RUNS);
+	if (compact->run_count == 0) {
+		return false;
+	}
+
+	compact->pbn = info->pbn;
+	memcpy(compact->header, page, sizeof(compact->header));
+	return true;
+}
+
+/**
+ * Keep the page in the cache's compaction buffer in a compacted page slot.
+ * If there is no free slot, either the evicted page's own buffer is divided
+ * into slots, or the least recently used compacted page is forgotten.
+ *
+ * @param info  The evicted page, which must have been reset
+ *
+ * @return true if the evicted page's buffer was used to hold compacted pages
+ **/
+static bool keep_compacted_page(struct page_info *info)
+{
+	struct vdo_page_cache *cache = info->cache;
+	struct compact_page *compacted =
+		(struct compact_page *) cache->compact_buffer;
+	struct compact_page *compact;
+	bool used_buffer = false;
+	int result;
+
+	if (list_empty(&cache->compact_free_list)) {
+		if (cache->compact_block_count < cache->compact_block_limit) {
+			make_compact_block(info);
+			used_buffer = true;
+		} else if (!list_empty(&cache->compact_lru)) {
+			free_compact_page(cache,
+					  list_first_entry(&cache->compact_lru,
+							   struct compact_page,
+							   entry));
+		} else {
+			return false;
+		}
+	}
+
+	compact = list_first_entry(&cache->compact_free_list,
+				   struct compact_page, entry);
+	result = int_map_put(cache->compact_map, compacted->pbn, compact,
+			     true, NULL);
+	if (result != UDS_SUCCESS) {
+		return used_buffer;
+	}
+
+	compact->pbn = compacted->pbn;
+	compact->run_count = compacted->run_count;
+	memcpy(compact->header, compacted->header, sizeof(compact->header));
+	memcpy(compact->runs, compacted->runs,
+	       compact->run_count * sizeof(struct block_map_run));
+	list_move_tail(&compact->entry, &cache->compact_lru);
+	ADD_STAT(cache, compact_pages, 1);
+	return used_buffer;
+}
+
+/**
+ * Set the number of page buffers which may hold compacted pages from the
+ * size of the cache and the compacted share, freeing any buffers over the
+ * new limit.
  *
- * @return a pointer to the page info structure (if found), NULL otherwise
+ * @param cache  The cache
  **/
-static struct page_info * __must_check
-find_free_page(struct vdo_page_cache *cache)
-{
-	struct page_info *info;
-	if (cache->free_list.next == &cache->free_list) {
-		return NULL;
-	}
-	info = page_info_from_state_entry(cache->free_list.next);
-	list_del_init(&info->state_entry);
-	return info;
-}
-
-/**********************************************************************/
-struct page_info *vpc_find_page(struct vdo_page_cache *cache,
-				physical_block_number_t pbn)
+static void update_compact_block_limit(struct vdo_page_cache *cache)
 {
-	if ((cache->last_found != NULL) && (cache->last_found->pbn == pbn)) {
-		return cache->last_found;
-	}
-	cache->last_found = int_map_get(cache->page_map, pbn);
-	return cache->last_found;
+	cache->compact_block_limit =
+		((uint64_t) cache->page_count * cache->compact_share) / 100;
+	shrink_compact_blocks(cache, cache->compact_block_limit);
 }
 
 /**
@@ -548,18 +1199,29 @@ struct page_info *vpc_find_page(struct vdo_page_cache *cache,
  *         dirty or resident.
  *
  * @note Picks the least recently used from among the non-busy entries
- *       at the front of each of the lru ring.
+ *       at the front of the probation list, or of the protected list if
+ *       no probationary page is available. Pages which are leaving the
+ *       cache are never selected.
  *       Since whenever we mark a page busy we also put it to the end
- *       of the ring it is unlikely that the entries at the front
- *       are busy unless the queue is very short, but not impossible.
+ *       of its list it is unlikely that the entries at the front
+ *       are busy unless the list is very short, but not impossible.
  **/
 static struct page_info * __must_check
 select_lru_page(struct vdo_page_cache *cache)
 {
 	struct list_head *lru;
-	list_for_each(lru, &cache->lru_list) {
+	list_for_each(lru, &cache->probation_list) {
+		struct page_info *info = page_info_from_lru_entry(lru);
+		if ((info->busy == 0) && !is_in_flight(info) &&
+		    !is_retiring(info)) {
+			return info;
+		}
+	}
+
+	list_for_each(lru, &cache->protected_list) {
 		struct page_info *info = page_info_from_lru_entry(lru);
-		if ((info->busy == 0) && !is_in_flight(info)) {
+		if ((info->busy == 0) && !is_in_flight(info) &&
+		    !is_retiring(info)) {
 			return info;
 		}
 	}
@@ -568,33 +1230,15 @@ select_lru_page(struct vdo_page_cache *cache)
 }
 
 /**********************************************************************/
-struct block_map_statistics
-get_vdo_page_cache_statistics(const struct vdo_page_cache *cache)
-{
-	const struct block_map_statistics *stats = &cache->stats;
-	return (struct block_map_statistics) {
-		.dirty_pages = READ_ONCE(stats->dirty_pages),
-		.clean_pages = READ_ONCE(stats->clean_pages),
-		.free_pages = READ_ONCE(stats->free_pages),
-		.failed_pages = READ_ONCE(stats->failed_pages),
-		.incoming_pages = READ_ONCE(stats->incoming_pages),
-		.outgoing_pages = READ_ONCE(stats->outgoing_pages),
-
-		.cache_pressure = READ_ONCE(stats->cache_pressure),
-		.read_count = READ_ONCE(stats->read_count),
-		.write_count = READ_ONCE(stats->write_count),
-		.failed_reads = READ_ONCE(stats->failed_reads),
-		.failed_writes = READ_ONCE(stats->failed_writes),
-		.reclaimed = READ_ONCE(stats->reclaimed),
-		.read_outgoing = READ_ONCE(stats->read_outgoing),
-		.found_in_cache = READ_ONCE(stats->found_in_cache),
-		.discard_required = READ_ONCE(stats->discard_required),
-		.wait_for_page = READ_ONCE(stats->wait_for_page),
-		.fetch_required = READ_ONCE(stats->fetch_required),
-		.pages_loaded = READ_ONCE(stats->pages_loaded),
-		.pages_saved = READ_ONCE(stats->pages_saved),
-		.flush_count = READ_ONCE(stats->flush_count),
-	};
+void get_vdo_page_cache_statistics(const struct vdo_page_cache *cache,
+				   struct block_map_statistics *copy)
+{
+	unsigned int sequence;
+
+	do {
+		sequence = read_seqcount_begin(&cache->stats_sequence);
+		*copy = cache->stats;
+	} while (read_seqcount_retry(&cache->stats_sequence, sequence));
 }
 
 // ASYNCHRONOUS INTERFACE BEYOND THIS POINT
@@ -711,7 +1355,7 @@ static void set_persistent_error(struct vdo_page_cache *cache,
 				 const char *context,
 				 int result)
 {
-	struct page_info *info;
+	struct page_extent *extent;
 	// If we're already read-only, there's no need to log.
 	struct read_only_notifier *notifier = cache->zone->read_only_notifier;
 	if ((result != VDO_READ_ONLY) && !is_read_only(notifier)) {
@@ -726,9 +1370,13 @@ static void set_persistent_error(struct vdo_page_cache *cache,
 	distribute_error_over_queue(result, &cache->free_waiters);
 	cache->waiter_count = 0;
 
-	for (info = cache->infos; info < cache->infos + cache->page_count;
-	     ++info) {
-		distribute_error_over_queue(result, &info->waiting);
+	list_for_each_entry(extent, &cache->extents, entry) {
+		struct page_info *info;
+		for (info = extent->infos;
+		     info < extent->infos + extent->page_count;
+		     ++info) {
+			distribute_error_over_queue(result, &info->waiting);
+		}
 	}
 }
 
@@ -811,9 +1459,13 @@ validate_completed_page(struct vdo_completion *completion, bool writable)
 bool is_page_cache_active(struct vdo_page_cache *cache)
 {
 	return ((cache->outstanding_reads != 0) ||
-		(cache->outstanding_writes != 0));
+		(cache->outstanding_writes != 0) ||
+		cache->reaping);
 }
 
+/**********************************************************************/
+static void retire_page_if_idle(struct page_info *info);
+
 /**
  * vio callback used when a page has been loaded.
  *
@@ -826,8 +1478,10 @@ static void page_is_loaded(struct vdo_completion *completion)
 	struct vdo_page_cache *cache = info->cache;
 	assert_on_cache_thread(cache, __func__);
 
+	trace_vdo_page_loaded(cache, info->pbn);
 	set_info_state(info, PS_RESIDENT);
 	distribute_page_over_queue(info, &info->waiting);
+	retire_page_if_idle(info);
 
 	/*
 	 * Don't decrement until right before calling check_for_drain_complete()
@@ -851,7 +1505,7 @@ static void handle_load_error(struct vdo_completion *completion)
 	assert_on_cache_thread(cache, __func__);
 
 	enter_read_only_mode(cache->zone->read_only_notifier, result);
-	ADD_ONCE(cache->stats.failed_reads, 1);
+	ADD_STAT(cache, failed_reads, 1);
 	set_info_state(info, PS_FAILED);
 	distribute_error_over_queue(result, &info->waiting);
 	reset_page_info(info);
@@ -897,7 +1551,7 @@ static void handle_rebuild_read_error(struct vdo_completion *completion)
 
 	// We are doing a read-only rebuild, so treat this as a successful read
 	// of an uninitialized page.
-	ADD_ONCE(cache->stats.failed_reads, 1);
+	ADD_STAT(cache, failed_reads, 1);
 	memset(get_page_buffer(info), 0, VDO_BLOCK_SIZE);
 	reset_vdo_completion(completion);
 	if (cache->read_hook != NULL) {
@@ -907,6 +1561,36 @@ static void handle_rebuild_read_error(struct vdo_completion *completion)
 	}
 }
 
+/**
+ * Load a page by expanding a compacted copy of it. The load finishes from a
+ * fresh callback, just as a read would.
+ *
+ * @param info     The page info representing where to load the page
+ * @param compact  The compacted copy of the page
+ **/
+static void load_compacted_page(struct page_info *info,
+				struct compact_page *compact)
+{
+	struct vdo_page_cache *cache = info->cache;
+	struct block_map_page *page =
+		(struct block_map_page *) get_page_buffer(info);
+	struct vdo_completion *completion = vio_as_completion(info->vio);
+
+	memcpy(page, compact->header, sizeof(compact->header));
+	decode_block_map_page_runs(page, compact->runs, compact->run_count);
+	free_compact_page(cache, compact);
+	ADD_STAT(cache, compact_loads, 1);
+
+	prepare_vdo_completion(completion,
+			       (cache->read_hook != NULL) ?
+			       run_read_hook : page_is_loaded,
+			       handle_load_error,
+			       cache->zone->thread_id,
+			       info);
+	completion->requeue = true;
+	invoke_vdo_completion_callback(completion);
+}
+
 /**
  * Begin the process of loading a page.
  *
@@ -919,6 +1603,7 @@ static int __must_check
 launch_page_load(struct page_info *info, physical_block_number_t pbn)
 {
 	int result;
+	struct compact_page *compact;
 	struct vdo_page_cache *cache = info->cache;
 	assert_io_allowed(cache);
 
@@ -934,7 +1619,14 @@ launch_page_load(struct page_info *info, physical_block_number_t pbn)
 
 	set_info_state(info, PS_INCOMING);
 	cache->outstanding_reads++;
-	ADD_ONCE(cache->stats.pages_loaded, 1);
+	compact = int_map_get(cache->compact_map, pbn);
+	if (compact != NULL) {
+		load_compacted_page(info, compact);
+		return VDO_SUCCESS;
+	}
+
+	ADD_STAT(cache, pages_loaded, 1);
+	trace_vdo_page_load(cache, pbn);
 	launch_read_metadata_vio(info->vio,
 				 pbn,
 				 (cache->read_hook != NULL) ?
@@ -980,7 +1672,7 @@ static void save_pages(struct vdo_page_cache *cache)
 	info = page_info_from_state_entry(cache->outgoing_list.next);
 	cache->pages_in_flush = cache->pages_to_flush;
 	cache->pages_to_flush = 0;
-	ADD_ONCE(cache->stats.flush_count, 1);
+	ADD_STAT(cache, flush_count, 1);
 
 	vio = info->vio;
 
@@ -1035,6 +1727,46 @@ static void launch_page_save(struct page_info *info)
 	save_pages(info->cache);
 }
 
+/**
+ * Take a page of a retiring extent out of use if nothing is using it. A
+ * dirty page is saved first, and will be retired once the write finishes.
+ *
+ * @param info  The page to retire
+ **/
+static void retire_page_if_idle(struct page_info *info)
+{
+	if (!is_retiring(info) || (info->busy > 0) ||
+	    has_waiters(&info->waiting)) {
+		return;
+	}
+
+	switch (info->state) {
+	case PS_FREE:
+		park_page(info);
+		return;
+
+	case PS_RESIDENT:
+		reset_page_info(info);
+		return;
+
+	case PS_COMPACT:
+		release_compact_block(info);
+		return;
+
+	case PS_DIRTY:
+		// A page which can't be written now will expire normally.
+		if ((info->write_status == WRITE_STATUS_NORMAL) &&
+		    !is_vdo_state_quiescent(&info->cache->zone->state)) {
+			launch_page_save(info);
+		}
+		return;
+
+	default:
+		// The page will be retired when its I/O finishes.
+		return;
+	}
+}
+
 /**
  * Determine whether a given vdo_page_completion (as a waiter) is requesting a
  * given page number. Implements waiter_match.
@@ -1050,6 +1782,9 @@ static bool completion_needs_page(struct waiter *waiter, void *context)
 	return (page_completion_from_waiter(waiter)->pbn == *pbn);
 }
 
+/**********************************************************************/
+static void discard_page_if_needed(struct vdo_page_cache *cache);
+
 /**
  * Allocate a free page to the first completion in the waiting queue,
  * and any other completions that match it in page number.
@@ -1057,25 +1792,40 @@ static bool completion_needs_page(struct waiter *waiter, void *context)
 static void allocate_free_page(struct page_info *info)
 {
 	int result;
+	bool compacted;
 	struct waiter *oldest_waiter;
 	physical_block_number_t pbn;
 	struct vdo_page_cache *cache = info->cache;
 	assert_on_cache_thread(cache, __func__);
 
+	if (is_retiring(info)) {
+		// This page is leaving the cache, so find another one.
+		reset_page_info(info);
+		discard_page_if_needed(cache);
+		return;
+	}
+
 	if (!has_waiters(&cache->free_waiters)) {
 		if (cache->stats.cache_pressure > 0) {
 			log_info("page cache pressure relieved");
-			WRITE_ONCE(cache->stats.cache_pressure, 0);
+			SET_STAT(cache, cache_pressure, 0);
 		}
 		return;
 	}
 
+	compacted = compact_evicted_page(info);
 	result = reset_page_info(info);
 	if (result != VDO_SUCCESS) {
 		set_persistent_error(cache, "cannot reset page info", result);
 		return;
 	}
 
+	if (compacted && keep_compacted_page(info)) {
+		// This page now holds compacted pages, so find another one.
+		discard_page_if_needed(cache);
+		return;
+	}
+
 	oldest_waiter = get_first_waiter(&cache->free_waiters);
 	pbn = page_completion_from_waiter(oldest_waiter)->pbn;
 
@@ -1159,6 +1909,169 @@ static void discard_page_if_needed(struct vdo_page_cache *cache)
 	}
 }
 
+/**
+ * Hand any free pages to the requests waiting for a page.
+ *
+ * @param cache  The cache
+ **/
+static void allocate_free_pages(struct vdo_page_cache *cache)
+{
+	while (has_waiters(&cache->free_waiters)) {
+		struct page_info *info = find_free_page(cache);
+		if (info == NULL) {
+			break;
+		}
+
+		allocate_free_page(info);
+	}
+}
+
+/**********************************************************************/
+bool evict_vdo_page(struct vdo_page_cache *cache, physical_block_number_t pbn)
+{
+	struct compact_page *compact;
+	struct page_info *info;
+
+	assert_on_cache_thread(cache, __func__);
+	compact = int_map_get(cache->compact_map, pbn);
+	if (compact != NULL) {
+		free_compact_page(cache, compact);
+	}
+
+	info = vpc_find_page(cache, pbn);
+	if (info == NULL) {
+		return true;
+	}
+
+	if ((info->busy > 0) || has_waiters(&info->waiting) ||
+	    is_in_flight(info)) {
+		return false;
+	}
+
+	if (is_dirty(info)) {
+		if (info->write_status == WRITE_STATUS_NORMAL) {
+			launch_page_save(info);
+		}
+		return false;
+	}
+
+	if (reset_page_info(info) != VDO_SUCCESS) {
+		return false;
+	}
+
+	allocate_free_pages(cache);
+	return true;
+}
+
+/**********************************************************************/
+int prepare_to_resize_vdo_page_cache(struct vdo_page_cache *cache,
+				     page_count_t page_count)
+{
+	int result;
+
+	free_page_extents(&cache->pending_extents);
+	free_page_cache_simulator(&cache->pending_simulator);
+	cache->target_page_count = page_count;
+	result = make_page_cache_simulator(page_count,
+					   &cache->pending_simulator);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	if (page_count <= cache->page_count) {
+		return VDO_SUCCESS;
+	}
+
+	return make_pending_extents(cache, page_count - cache->page_count);
+}
+
+/**
+ * Start removing an extent from the cache. Its pages are taken out of use as
+ * soon as nothing is using them.
+ *
+ * @param cache   The cache
+ * @param extent  The extent to retire
+ **/
+static void retire_extent(struct vdo_page_cache *cache,
+			  struct page_extent *extent)
+{
+	struct page_info *info;
+
+	extent->retiring = true;
+	WRITE_ONCE(cache->page_count, cache->page_count - extent->page_count);
+	if (extent->pages_contiguous) {
+		ADD_STAT(cache, contiguous_pages, -extent->page_count);
+	}
+	for (info = extent->infos; info < extent->infos + extent->page_count;
+	     ++info) {
+		retire_page_if_idle(info);
+	}
+}
+
+/**********************************************************************/
+void resize_vdo_page_cache(struct vdo_page_cache *cache)
+{
+	struct page_extent *extent;
+	assert_on_cache_thread(cache, __func__);
+
+	adopt_pending_extents(cache);
+
+	// Retire the newest extents until the cache is no bigger than it must be.
+	list_for_each_entry_reverse(extent, &cache->extents, entry) {
+		if (extent->retiring) {
+			continue;
+		}
+
+		if ((cache->page_count - extent->page_count) <
+		    cache->target_page_count) {
+			break;
+		}
+
+		retire_extent(cache, extent);
+	}
+
+	cache->protected_limit = (cache->page_count / 4) * 3;
+	cache->promotion_distance =
+		max_t(uint64_t, cache->page_count / 16, 1);
+	enforce_protected_limit(cache);
+	update_compact_block_limit(cache);
+	if (cache->pending_simulator != NULL) {
+		free_page_cache_simulator(&cache->simulator);
+		cache->simulator = cache->pending_simulator;
+		cache->pending_simulator = NULL;
+	}
+
+	allocate_free_pages(cache);
+}
+
+/**********************************************************************/
+page_count_t get_vdo_page_cache_size(const struct vdo_page_cache *cache)
+{
+	return READ_ONCE(cache->page_count);
+}
+
+/**********************************************************************/
+void set_vdo_page_cache_writeback_pace(struct vdo_page_cache *cache,
+				       block_count_t pace)
+{
+	assert_on_cache_thread(cache, __func__);
+	set_dirty_lists_pace(cache->dirty_lists, pace);
+}
+
+/**********************************************************************/
+void set_vdo_page_cache_compact_share(struct vdo_page_cache *cache,
+				      unsigned int share)
+{
+	assert_on_cache_thread(cache, __func__);
+	if (share == cache->compact_share) {
+		return;
+	}
+
+	cache->compact_share = share;
+	update_compact_block_limit(cache);
+	allocate_free_pages(cache);
+}
+
 /**********************************************************************/
 void advance_vdo_page_cache_period(struct vdo_page_cache *cache,
 				   sequence_number_t period)
@@ -1208,7 +2121,7 @@ static void handle_page_write_error(struct vdo_completion *completion)
 	}
 
 	set_info_state(info, PS_DIRTY);
-	ADD_ONCE(cache->stats.failed_writes, 1);
+	ADD_STAT(cache, failed_writes, 1);
 	set_persistent_error(cache, "cannot write page", result);
 
 	if (!write_has_finished(info)) {
@@ -1246,6 +2159,7 @@ static void page_is_written_out(struct vdo_completion *completion)
 		}
 	}
 
+	trace_vdo_page_written(cache, info->pbn);
 	was_discard = write_has_finished(info);
 	reclaimed = (!was_discard || (info->busy > 0) ||
 		     has_waiters(&info->waiting));
@@ -1253,13 +2167,14 @@ static void page_is_written_out(struct vdo_completion *completion)
 	set_info_state(info, PS_RESIDENT);
 
 	reclamations = distribute_page_over_queue(info, &info->waiting);
-	ADD_ONCE(cache->stats.reclaimed, reclamations);
+	ADD_STAT(cache, reclaimed, reclamations);
 
 	if (was_discard) {
 		cache->discard_count--;
 	}
 
 	if (reclaimed) {
+		retire_page_if_idle(info);
 		discard_page_if_needed(cache);
 	} else {
 		allocate_free_page(info);
@@ -1268,16 +2183,46 @@ static void page_is_written_out(struct vdo_completion *completion)
 	check_for_drain_complete(cache->zone);
 }
 
+/**
+ * Compare the pbns of two pages on a list of outgoing pages. Implements the
+ * comparison function of list_sort().
+ **/
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,13,0)
+static int compare_page_pbns(void *context __always_unused,
+			     struct list_head *a,
+			     struct list_head *b)
+#else
+static int compare_page_pbns(void *context __always_unused,
+			     const struct list_head *a,
+			     const struct list_head *b)
+#endif
+{
+	physical_block_number_t pbn_a =
+		list_entry(a, struct page_info, state_entry)->pbn;
+	physical_block_number_t pbn_b =
+		list_entry(b, struct page_info, state_entry)->pbn;
+
+	if (pbn_a == pbn_b) {
+		return 0;
+	}
+
+	return ((pbn_a < pbn_b) ? -1 : 1);
+}
+
 /**
  * Write the batch of pages which were covered by the layer flush which just
  * completed. This callback is registered in save_pages().
  *
+ * The batch is written in pbn order so that the bio submitter can combine
+ * the writes of adjacent pages into larger requests.
+ *
  * @param flush_completion  The flush vio
  **/
 static void write_pages(struct vdo_completion *flush_completion)
 {
 	struct vdo_page_cache *cache =
 		((struct page_info *) flush_completion->parent)->cache;
+	LIST_HEAD(batch);
 
 	/*
 	 * We need to cache these two values on the stack since in the error
@@ -1289,7 +2234,12 @@ static void write_pages(struct vdo_completion *flush_completion)
 	page_count_t pages_in_flush = cache->pages_in_flush;
 	cache->pages_in_flush = 0;
 	while (pages_in_flush-- > 0) {
-		struct list_head *entry = cache->outgoing_list.next;
+		list_move_tail(cache->outgoing_list.next, &batch);
+	}
+
+	list_sort(NULL, &batch, compare_page_pbns);
+	while (!list_empty(&batch)) {
+		struct list_head *entry = batch.next;
 		struct page_info *info = page_info_from_state_entry(entry);
 		list_del_init(entry);
 		if (is_read_only(info->cache->zone->read_only_notifier)) {
@@ -1301,7 +2251,8 @@ static void write_pages(struct vdo_completion *flush_completion)
 			finish_vdo_completion(completion, VDO_READ_ONLY);
 			continue;
 		}
-		ADD_ONCE(info->cache->stats.pages_saved, 1);
+		ADD_STAT(info->cache, pages_saved, 1);
+		trace_vdo_page_write(info->cache, info->pbn);
 		launch_write_metadata_vio(info->vio,
 					  info->pbn,
 					  page_is_written_out,
@@ -1346,6 +2297,7 @@ void release_vdo_page_completion(struct vdo_completion *completion)
 			discard_info->write_status = WRITE_STATUS_NORMAL;
 			launch_page_save(discard_info);
 		}
+		retire_page_if_idle(discard_info);
 		// if there are excess requests for pages (that have not already
 		// started discards) we need to discard some page (which may be
 		// this one)
@@ -1374,6 +2326,33 @@ static void load_page_for_completion(struct page_info *info,
 	}
 }
 
+/**
+ * Run a get of a page through the simulator of caches of other sizes.
+ *
+ * @param cache  The cache
+ * @param pbn    The pbn of the page
+ **/
+static void simulate_get(struct vdo_page_cache *cache,
+			 physical_block_number_t pbn)
+{
+	unsigned int hits;
+	if (!simulate_page_cache_get(cache->simulator, pbn, &hits)) {
+		return;
+	}
+
+	begin_stats_update(cache);
+	cache->stats.simulated_gets++;
+	cache->stats.simulated_half_size_hits +=
+		((hits >> SIMULATED_HALF_SIZE) & 1);
+	cache->stats.simulated_same_size_hits +=
+		((hits >> SIMULATED_SAME_SIZE) & 1);
+	cache->stats.simulated_double_size_hits +=
+		((hits >> SIMULATED_DOUBLE_SIZE) & 1);
+	cache->stats.simulated_quadruple_size_hits +=
+		((hits >> SIMULATED_QUADRUPLE_SIZE) & 1);
+	end_stats_update(cache);
+}
+
 /**********************************************************************/
 void get_vdo_page(struct vdo_completion *completion)
 {
@@ -1391,11 +2370,12 @@ void get_vdo_page(struct vdo_completion *completion)
 	}
 
 	if (vdo_page_comp->writable) {
-		ADD_ONCE(cache->stats.write_count, 1);
+		ADD_STAT(cache, write_count, 1);
 	} else {
-		ADD_ONCE(cache->stats.read_count, 1);
+		ADD_STAT(cache, read_count, 1);
 	}
 
+	simulate_get(cache, vdo_page_comp->pbn);
 	info = vpc_find_page(cache, vdo_page_comp->pbn);
 	if (info != NULL) {
 		// The page is in the cache already.
@@ -1404,7 +2384,7 @@ void get_vdo_page(struct vdo_completion *completion)
 		    (is_outgoing(info) && vdo_page_comp->writable)) {
 			int result;
 			// The page is unusable until it has finished I/O.
-			ADD_ONCE(cache->stats.wait_for_page, 1);
+			ADD_STAT(cache, wait_for_page, 1);
 			result = enqueue_waiter(&info->waiting,
 						&vdo_page_comp->waiter);
 			if (result != VDO_SUCCESS) {
@@ -1417,9 +2397,12 @@ void get_vdo_page(struct vdo_completion *completion)
 
 		if (is_valid(info)) {
 			// The page is usable.
-			ADD_ONCE(cache->stats.found_in_cache, 1);
+			ADD_STAT(cache, found_in_cache, 1);
 			if (!is_present(info)) {
-				ADD_ONCE(cache->stats.read_outgoing, 1);
+				ADD_STAT(cache, read_outgoing, 1);
+			}
+			if (info->is_protected) {
+				ADD_STAT(cache, protected_hits, 1);
 			}
 			update_lru(info);
 			++info->busy;
@@ -1433,13 +2416,13 @@ void get_vdo_page(struct vdo_completion *completion)
 	// The page must be fetched.
 	info = find_free_page(cache);
 	if (info != NULL) {
-		ADD_ONCE(cache->stats.fetch_required, 1);
+		ADD_STAT(cache, fetch_required, 1);
 		load_page_for_completion(info, vdo_page_comp);
 		return;
 	}
 
 	// The page must wait for a page to be discarded.
-	ADD_ONCE(cache->stats.discard_required, 1);
+	ADD_STAT(cache, discard_required, 1);
 	discard_page_for_completion(vdo_page_comp);
 }
 
@@ -1464,6 +2447,88 @@ void mark_completed_vdo_page_dirty(struct vdo_completion *completion,
 			   new_dirty_period);
 }
 
+/**********************************************************************/
+void publish_vdo_page(struct vdo_completion *completion, page_number_t key)
+{
+	struct vdo_page_completion *vdo_page_comp =
+		as_vdo_page_completion(completion);
+	struct page_info *info = vdo_page_comp->info;
+	struct vdo_page_cache *cache = info->cache;
+	struct page_info **slot =
+		&cache->published[key % cache->published_count];
+
+	assert_on_cache_thread(cache, __func__);
+	if (!vdo_page_comp->ready || !is_valid(info) || is_retiring(info) ||
+	    (info->published && (info->key == key))) {
+		return;
+	}
+
+	unpublish_page(info);
+	if (*slot != NULL) {
+		unpublish_page(*slot);
+	}
+
+	raw_write_seqcount_begin(&info->sequence);
+	info->key = key;
+	info->published = true;
+	raw_write_seqcount_end(&info->sequence);
+	smp_store_release(slot, info);
+}
+
+/**********************************************************************/
+bool copy_from_published_vdo_page(struct vdo_page_cache *cache,
+				  page_number_t key,
+				  size_t offset,
+				  size_t size,
+				  void *buffer,
+				  struct vdo_page_snapshot *snapshot)
+{
+	struct page_info *info;
+	unsigned int sequence;
+	bool copied = false;
+
+	rcu_read_lock();
+	info = READ_ONCE(cache->published[key % cache->published_count]);
+	if (info != NULL) {
+		sequence = raw_read_seqcount(&info->sequence);
+		if (((sequence & 1) == 0) && READ_ONCE(info->published) &&
+		    (READ_ONCE(info->key) == key)) {
+			memcpy(buffer, get_page_buffer(info) + offset, size);
+			copied = !read_seqcount_retry(&info->sequence,
+						      sequence);
+		}
+	}
+	rcu_read_unlock();
+
+	if (copied) {
+		*snapshot = (struct vdo_page_snapshot) {
+			.info = info,
+			.sequence = sequence,
+		};
+	}
+
+	return copied;
+}
+
+/**********************************************************************/
+bool is_vdo_page_snapshot_current(struct vdo_page_cache *cache,
+				  page_number_t key,
+				  const struct vdo_page_snapshot *snapshot)
+{
+	struct page_info *info;
+	bool is_current;
+
+	// The info can only be examined while it is still in the table, since
+	// a retired page may be freed once it has been unpublished.
+	rcu_read_lock();
+	info = READ_ONCE(cache->published[key % cache->published_count]);
+	is_current = ((info == snapshot->info) &&
+		      !read_seqcount_retry(&info->sequence,
+					   snapshot->sequence));
+	rcu_read_unlock();
+	return is_current;
+}
+
 /**********************************************************************/
 void request_vdo_page_write(struct vdo_completion *completion)
 {
@@ -1526,20 +2591,77 @@ void drain_vdo_page_cache(struct vdo_page_cache *cache)
 /**********************************************************************/
 int invalidate_vdo_page_cache(struct vdo_page_cache *cache)
 {
-	struct page_info *info;
+	struct page_extent *extent;
 	assert_on_cache_thread(cache, __func__);
 
 	// Make sure we don't throw away any dirty pages.
-	for (info = cache->infos; info < cache->infos + cache->page_count;
-	     info++) {
-		int result = ASSERT(!is_dirty(info),
-				    "cache must have no dirty pages");
-		if (result != VDO_SUCCESS) {
-			return result;
+	list_for_each_entry(extent, &cache->extents, entry) {
+		struct page_info *info;
+		for (info = extent->infos;
+		     info < extent->infos + extent->page_count;
+		     info++) {
+			int result = ASSERT(!is_dirty(info),
+					    "cache must have no dirty pages");
+			if (result != VDO_SUCCESS) {
+				return result;
+			}
+
+			unpublish_page(info);
 		}
 	}
 
+	// Compacted copies of pages are as stale as the pages themselves.
+	shrink_compact_blocks(cache, 0);
+
 	// Reset the page map by re-allocating it.
 	free_int_map(&cache->page_map);
 	return make_int_map(cache->page_count, 0, &cache->page_map);
 }
+
+/**
+ * Record the published pages on one of the LRU lists of a cache, most
+ * recently used first.
+ *
+ * @param lru    the list to record from
+ * @param pages  the array to fill
+ * @param count  the number of pages already recorded
+ * @param limit  the maximum number of pages to record
+ *
+ * @return the number of pages recorded, including those already recorded
+ **/
+static page_count_t record_hot_pages(struct list_head *lru,
+				     struct block_map_hot_page *pages,
+				     page_count_t count,
+				     page_count_t limit)
+{
+	struct list_head *entry;
+	list_for_each_prev(entry, lru) {
+		struct page_info *info = page_info_from_lru_entry(entry);
+		if (count == limit) {
+			break;
+		}
+
+		// Only a published page knows which leaf page it is.
+		if (!info->published ||
+		    ((info->state != PS_RESIDENT) && !is_dirty(info))) {
+			continue;
+		}
+
+		pages[count++] = (struct block_map_hot_page) {
+			.page_number = info->key,
+			.pbn = info->pbn,
+		};
+	}
+
+	return count;
+}
+
+/**********************************************************************/
+page_count_t get_vdo_page_cache_hot_pages(struct vdo_page_cache *cache,
+					  struct block_map_hot_page *pages,
+					  page_count_t limit)
+{
+	page_count_t count = record_hot_pages(&cache->protected_list, pages, 0,
+					      limit);
+	return record_hot_pages(&cache->probation_list, pages, count, limit);
+}
@@ -23,6 +23,7 @@
 #define VDO_PAGE_CACHE_H
 
 #include "adminState.h"
+#include "blockMapFormat.h"
 #include "completion.h"
 #include "statistics.h"
 #include "types.h"
@@ -38,6 +39,17 @@ struct page_info;
  **/
 struct vdo_page_cache;
 
+/**
+ * The state needed to check whether data copied from a published page without
+ * the help of the cache's thread is still current.
+ **/
+struct vdo_page_snapshot {
+	/** The page from which the data was copied */
+	struct page_info *info;
+	/** The page's sequence number when the data was copied */
+	unsigned int sequence;
+};
+
 /**
  * Generation counter for page references.
  **/
@@ -140,6 +152,64 @@ void set_vdo_page_cache_rebuild_mode(struct vdo_page_cache *cache,
  **/
 bool __must_check is_page_cache_active(struct vdo_page_cache *cache);
 
+/**
+ * Prepare to change the number of pages in a page cache by allocating any
+ * pages the cache will need. This may be called from any thread, but must
+ * not run concurrently with a resize of the same cache.
+ *
+ * @param cache       The cache to resize
+ * @param page_count  The number of pages the cache should have
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check
+prepare_to_resize_vdo_page_cache(struct vdo_page_cache *cache,
+				 page_count_t page_count);
+
+/**
+ * Resize a page cache to the size given to
+ * prepare_to_resize_vdo_page_cache(). Added pages are usable immediately.
+ * Removed pages are retired as soon as nothing is using them; dirty pages
+ * are written out before they are retired. Must be called on the cache's
+ * thread.
+ *
+ * @param cache  The cache to resize
+ **/
+void resize_vdo_page_cache(struct vdo_page_cache *cache);
+
+/**
+ * Get the number of pages in a page cache, not counting pages which are
+ * being retired. This may be called from any thread.
+ *
+ * @param cache  The cache
+ *
+ * @return The number of pages in the cache
+ **/
+page_count_t __must_check
+get_vdo_page_cache_size(const struct vdo_page_cache *cache);
+
+/**
+ * Set how many dirty pages a page cache writes out ahead of their deadline
+ * each time its dirty period advances.
+ *
+ * @param cache  The cache
+ * @param pace   The number of pages, or 0 to write pages only when they
+ *               reach the maximum age
+ **/
+void set_vdo_page_cache_writeback_pace(struct vdo_page_cache *cache,
+				       block_count_t pace);
+
+/**
+ * Set how much of a page cache may be used to hold compacted copies of clean
+ * pages which have been evicted, so that they can be reloaded without I/O.
+ *
+ * @param cache  The cache
+ * @param share  The percentage of the cache's pages which may hold compacted
+ *               pages, or 0 to keep no compacted pages
+ **/
+void set_vdo_page_cache_compact_share(struct vdo_page_cache *cache,
+				      unsigned int share);
+
 /**
  * Advance the dirty period for a page cache.
  *
@@ -261,6 +331,56 @@ void mark_completed_vdo_page_dirty(struct vdo_completion *completion,
 				   sequence_number_t old_dirty_period,
 				   sequence_number_t new_dirty_period);
 
+/**
+ * Publish the page of a completed vdo_page_completion so that it may be read
+ * from other threads by copy_from_published_vdo_page() for as long as it
+ * remains in the cache. A page displaces any other page published under a
+ * key which hashes to the same table slot.
+ *
+ * @param completion  a VDO Page Completion whose callback has been called
+ * @param key         the key under which to publish the page
+ **/
+void publish_vdo_page(struct vdo_completion *completion, page_number_t key);
+
+/**
+ * Copy data from a published page without the help of the cache's thread.
+ * This may be called from any thread.
+ *
+ * @param [in]  cache     the page cache
+ * @param [in]  key       the key under which the page was published
+ * @param [in]  offset    the offset in the page of the data to copy
+ * @param [in]  size      the number of bytes to copy
+ * @param [out] buffer    the buffer to copy into
+ * @param [out] snapshot  the state to check later to find out whether the
+ *                        page has changed since the copy was made
+ *
+ * @return true if a consistent copy was made, false if no page is published
+ *         under the key or the page changed while being copied
+ **/
+bool __must_check
+copy_from_published_vdo_page(struct vdo_page_cache *cache,
+			     page_number_t key,
+			     size_t offset,
+			     size_t size,
+			     void *buffer,
+			     struct vdo_page_snapshot *snapshot);
+
+/**
+ * Check whether a page from which data was copied by
+ * copy_from_published_vdo_page() is still published and unchanged. This may
+ * be called from any thread.
+ *
+ * @param cache     the page cache
+ * @param key       the key under which the page was published
+ * @param snapshot  the snapshot taken when the data was copied
+ *
+ * @return true if the copied data is still current
+ **/
+bool __must_check
+is_vdo_page_snapshot_current(struct vdo_page_cache *cache,
+			     page_number_t key,
+			     const struct vdo_page_snapshot *snapshot);
+
 /**
  * Request that a VDO page be written out as soon as it is not busy.
  *
@@ -302,6 +422,20 @@ void *dereference_writable_vdo_page(struct vdo_completion *completion);
  **/
 void *get_vdo_page_completion_context(struct vdo_completion *completion);
 
+/**
+ * Remove a page and any compacted copy of it from the cache, writing the page
+ * out first if it is dirty. A page which is in use or being read or written
+ * is left alone.
+ *
+ * @param cache  The cache
+ * @param pbn    The absolute physical block number of the page
+ *
+ * @return true if the page is no longer cached, false if it must be checked
+ *         again later
+ **/
+bool __must_check evict_vdo_page(struct vdo_page_cache *cache,
+				 physical_block_number_t pbn);
+
 /**
  * Drain I/O for a page cache.
  *
@@ -319,16 +453,31 @@ void drain_vdo_page_cache(struct vdo_page_cache *cache);
  **/
 int __must_check invalidate_vdo_page_cache(struct vdo_page_cache *cache);
 
+/**
+ * Record the published pages of a quiescent cache, hottest first: the
+ * protected pages from most to least recently used, then the pages on
+ * probation likewise.
+ *
+ * @param cache  the cache
+ * @param pages  the array to fill
+ * @param limit  the maximum number of pages to record
+ *
+ * @return the number of pages recorded
+ **/
+page_count_t __must_check
+get_vdo_page_cache_hot_pages(struct vdo_page_cache *cache,
+			     struct block_map_hot_page *pages,
+			     page_count_t limit);
+
 // STATISTICS & TESTING
 
 /**
  * Get current cache statistics.
  *
- * @param cache  the page cache
- *
- * @return the statistics
+ * @param [in]  cache  the page cache
+ * @param [out] copy   The statistics
  **/
-struct block_map_statistics __must_check
-get_vdo_page_cache_statistics(const struct vdo_page_cache *cache);
+void get_vdo_page_cache_statistics(const struct vdo_page_cache *cache,
+				   struct block_map_statistics *copy);
 
 #endif // VDO_PAGE_CACHE_H
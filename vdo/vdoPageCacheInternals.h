@@ -25,16 +25,23 @@
 #include "vdoPageCache.h"
 
 #include <linux/list.h>
+#include <linux/seqlock.h>
 
 
 #include "blockMapInternals.h"
 #include "completion.h"
 #include "dirtyLists.h"
 #include "intMap.h"
+#include "pageCacheSimulator.h"
 #include "physicalLayer.h"
 
 enum {
 	MAX_PAGE_CONTEXT_SIZE = 8,
+	/**
+	 * The maximum number of pages in one page extent, which fill one 2MB
+	 * huge page
+	 */
+	PAGE_EXTENT_SIZE = 512,
 };
 
 static const physical_block_number_t NO_PAGE = 0xFFFFFFFFFFFFFFFF;
@@ -45,7 +52,9 @@ static const physical_block_number_t NO_PAGE = 0xFFFFFFFFFFFFFFFF;
 struct vdo_page_cache {
 	/** the VDO which owns this cache */
 	struct vdo *vdo;
-	/** number of pages in cache */
+	/** the NUMA node of the cache's thread, or NUMA_NO_NODE */
+	int node;
+	/** number of pages in cache, not counting retiring extents */
 	page_count_t page_count;
 	/** function to call on page read */
 	vdo_page_read_function *read_hook;
@@ -56,16 +65,39 @@ struct vdo_page_cache {
 	/** Whether the VDO is doing a read-only rebuild */
 	bool rebuilding;
 
-	/** array of page information entries */
-	struct page_info *infos;
-	/** raw memory for pages */
-	char *pages;
+	/** the extents holding the pages of the cache (oldest first) */
+	struct list_head extents;
+	/** extents allocated for the next resize but not yet in the cache */
+	struct list_head pending_extents;
+	/** the number of pages the cache should have after the next resize */
+	page_count_t target_page_count;
+	/** the completion which frees extents once they have been retired */
+	struct vdo_completion reaper;
+	/** whether the reaper has been launched */
+	bool reaping;
 	/** cache last found page info */
 	struct page_info *last_found;
 	/** map of page number to info */
 	struct int_map *page_map;
-	/** main LRU list (all infos) */
-	struct list_head lru_list;
+	/** pages published for lockless lookup, indexed by key */
+	struct page_info **published;
+	/** the number of slots in the published page table */
+	page_count_t published_count;
+	/** LRU list of pages which have not been reused since being loaded */
+	struct list_head probation_list;
+	/** LRU list of pages which have been reused */
+	struct list_head protected_list;
+	/** number of pages on the protected list */
+	page_count_t protected_count;
+	/** maximum number of pages on the protected list */
+	page_count_t protected_limit;
+	/** number of pages which have been put on the probation list */
+	uint64_t admissions;
+	/**
+	 * number of admissions which must follow a page's admission before
+	 * a reference to it counts as reuse
+	 **/
+	uint64_t promotion_distance;
 	/** dirty pages by period */
 	struct dirty_lists *dirty_lists;
 	/** free page list (oldest first) */
@@ -88,9 +120,31 @@ struct vdo_page_cache {
 	struct wait_queue free_waiters;
 	/**
 	 * Statistics are only updated on the logical zone thread, but are
-	 * accessed from other threads.
+	 * accessed from other threads. They get their own cache lines so that
+	 * readers do not disturb the zone thread's use of the rest of the
+	 * cache.
 	 **/
+	seqcount_t stats_sequence ____cacheline_aligned;
+	/** The statistics, updated under stats_sequence */
 	struct block_map_statistics stats;
+	/** the percentage of the pages which may hold compacted pages */
+	unsigned int compact_share ____cacheline_aligned;
+	/** the number of pages which may hold compacted pages */
+	page_count_t compact_block_limit;
+	/** the number of pages which hold compacted pages */
+	page_count_t compact_block_count;
+	/** map of page number to compacted page */
+	struct int_map *compact_map;
+	/** LRU list of compacted pages */
+	struct list_head compact_lru;
+	/** unused compacted page slots */
+	struct list_head compact_free_list;
+	/** space to compact a page before choosing a slot for it */
+	char *compact_buffer;
+	/** the simulator of caches of other sizes */
+	struct page_cache_simulator *simulator;
+	/** the simulator to use after the next resize, or NULL */
+	struct page_cache_simulator *pending_simulator;
 	/** counter for pressure reports */
 	uint32_t pressure_report;
 	/** the block map zone to which this cache belongs */
@@ -120,6 +174,8 @@ enum vdo_page_buffer_state {
 	PS_DIRTY,
 	/* this page is being written and should not be used */
 	PS_OUTGOING,
+	/* this page buffer holds compacted copies of evicted pages */
+	PS_COMPACT,
 	/* not a state */
 	PAGE_STATE_COUNT,
 } __packed;
@@ -141,6 +197,8 @@ struct page_info {
 	struct vio *vio;
 	/** back-link for references */
 	struct vdo_page_cache *cache;
+	/** the extent which holds the page */
+	struct page_extent *extent;
 	/** the pbn of the page */
 	physical_block_number_t pbn;
 	/** page is busy (temporarily locked) */
@@ -153,12 +211,45 @@ struct page_info {
 	struct wait_queue waiting;
 	/** state linked list entry */
 	struct list_head state_entry;
-	/** LRU entry */
+	/** LRU entry, on either the probation or the protected list */
 	struct list_head lru_entry;
+	/** whether the page is on the protected list */
+	bool is_protected;
+	/** the cache's admission count when the page was put on probation */
+	uint64_t probation_stamp;
+	/** bumped around each change to the page's publication */
+	seqcount_t sequence;
+	/** whether the page is in the published page table */
+	bool published;
+	/** the key under which the page is published */
+	page_number_t key;
 	/** Space for per-page client data */
 	byte context[MAX_PAGE_CONTEXT_SIZE];
 };
 
+/**
+ * A separately allocated group of pages, so that the cache can grow and
+ * shrink while it is in use.
+ **/
+struct page_extent {
+	/** the entry on the cache's list of extents */
+	struct list_head entry;
+	/** the number of pages in the extent */
+	page_count_t page_count;
+	/** the number of retired pages which are no longer in use */
+	page_count_t parked_count;
+	/** whether the extent is being removed from the cache */
+	bool retiring;
+	/** whether the extent itself is in physically contiguous memory */
+	bool contiguous;
+	/** whether the pages are in physically contiguous memory */
+	bool pages_contiguous;
+	/** raw memory for pages */
+	char *pages;
+	/** the page information entries */
+	struct page_info infos[];
+};
+
 /**********************************************************************/
 static inline bool is_dirty(const struct page_info *info)
 {
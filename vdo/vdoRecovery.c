@@ -172,52 +172,117 @@ make_missing_decref(struct recovery_completion *recovery,
 	return VDO_SUCCESS;
 }
 
+/**
+ * Get a sector of a block of the journal data.
+ *
+ * @param recovery  The recovery completion
+ * @param sequence  The sequence number of the block
+ * @param sector    The number of the sector in the block
+ *
+ * @return The sector
+ **/
+static struct packed_journal_sector *
+get_sector(const struct recovery_completion *recovery,
+	   sequence_number_t sequence,
+	   uint8_t sector)
+{
+	struct packed_journal_header *header =
+		get_journal_block_header(recovery->vdo->recovery_journal,
+					 recovery->journal_data,
+					 sequence);
+	return get_journal_block_sector(header, sector);
+}
+
+/**
+ * Check whether a block of the journal data is in the compact format.
+ *
+ * @param recovery  The recovery completion
+ * @param sequence  The sequence number of the block
+ *
+ * @return <code>true</code> if the block's entries are compacted
+ **/
+static bool is_compact_block(const struct recovery_completion *recovery,
+			     sequence_number_t sequence)
+{
+	struct packed_journal_header *header =
+		get_journal_block_header(recovery->vdo->recovery_journal,
+					 recovery->journal_data,
+					 sequence);
+	return (header->metadata_type == VDO_METADATA_COMPACT_RECOVERY_JOURNAL);
+}
+
+/**
+ * Get the number of entries in the sector of a full block at which a
+ * recovery point lies.
+ *
+ * @param recovery  The recovery completion
+ * @param point     The recovery point
+ *
+ * @return The number of entries in the point's sector
+ **/
+static journal_entry_count_t
+get_sector_entry_count(const struct recovery_completion *recovery,
+		       const struct recovery_point *point)
+{
+	if (is_compact_block(recovery, point->sequence_number)) {
+		return get_sector(recovery,
+				  point->sequence_number,
+				  point->sector_count)->entry_count;
+	}
+
+	return ((point->sector_count == (VDO_SECTORS_PER_BLOCK - 1))
+		? RECOVERY_JOURNAL_ENTRIES_PER_LAST_SECTOR
+		: RECOVERY_JOURNAL_ENTRIES_PER_SECTOR);
+}
+
 /**
  * Move the given recovery point forward by one entry.
  *
- * @param point  The recovery point to alter
+ * @param recovery  The recovery completion
+ * @param point     The recovery point to alter
  **/
-static void increment_recovery_point(struct recovery_point *point)
+static void increment_recovery_point(const struct recovery_completion *recovery,
+				     struct recovery_point *point)
 {
 	point->entry_count++;
-	if ((point->sector_count == (VDO_SECTORS_PER_BLOCK - 1)) &&
-	    (point->entry_count == RECOVERY_JOURNAL_ENTRIES_PER_LAST_SECTOR)) {
-		point->sequence_number++;
-		point->sector_count = 1;
-		point->entry_count = 0;
+	if (point->entry_count < get_sector_entry_count(recovery, point)) {
+		return;
 	}
 
-	if (point->entry_count == RECOVERY_JOURNAL_ENTRIES_PER_SECTOR) {
-		point->sector_count++;
-		point->entry_count = 0;
+	point->entry_count = 0;
+	if (point->sector_count == (VDO_SECTORS_PER_BLOCK - 1)) {
+		point->sequence_number++;
+		point->sector_count = 1;
 		return;
 	}
+
+	point->sector_count++;
 }
 
 /**
  * Move the given recovery point backwards by one entry.
  *
- * @param point  The recovery point to alter
+ * @param recovery  The recovery completion
+ * @param point     The recovery point to alter
  **/
-static void decrement_recovery_point(struct recovery_point *point)
+static void decrement_recovery_point(const struct recovery_completion *recovery,
+				     struct recovery_point *point)
 {
 	STATIC_ASSERT(RECOVERY_JOURNAL_ENTRIES_PER_LAST_SECTOR > 0);
 
-	if ((point->sector_count <= 1) && (point->entry_count == 0)) {
-		point->sequence_number--;
-		point->sector_count = VDO_SECTORS_PER_BLOCK - 1;
-		point->entry_count =
-			RECOVERY_JOURNAL_ENTRIES_PER_LAST_SECTOR - 1;
+	if (point->entry_count > 0) {
+		point->entry_count--;
 		return;
 	}
 
-	if (point->entry_count == 0) {
+	if (point->sector_count <= 1) {
+		point->sequence_number--;
+		point->sector_count = VDO_SECTORS_PER_BLOCK - 1;
+	} else {
 		point->sector_count--;
-		point->entry_count = RECOVERY_JOURNAL_ENTRIES_PER_SECTOR - 1;
-		return;
 	}
 
-	point->entry_count--;
+	point->entry_count = get_sector_entry_count(recovery, point) - 1;
 }
 
 /**
@@ -429,18 +494,35 @@ abort_recovery_on_error(int result, struct recovery_completion *recovery)
  * @return The unpacked contents of the matching recovery journal entry
  **/
 static struct recovery_journal_entry
-get_entry(const struct recovery_completion *recovery,
+get_entry(struct recovery_completion *recovery,
 	  const struct recovery_point *point)
 {
-	struct recovery_journal *journal = recovery->vdo->recovery_journal;
-	physical_block_number_t block_number =
-		get_recovery_journal_block_number(journal,
-						  point->sequence_number);
-	off_t sector_offset = (block_number * VDO_BLOCK_SIZE) +
-		(point->sector_count * VDO_SECTOR_SIZE);
 	struct packed_journal_sector *sector =
-		(struct packed_journal_sector *) &recovery->journal_data[sector_offset];
-	return unpack_recovery_journal_entry(&sector->entries[point->entry_count]);
+		get_sector(recovery, point->sequence_number,
+			   point->sector_count);
+	struct packed_compact_journal_sector *compact_sector =
+		(struct packed_compact_journal_sector *) sector;
+	struct recovery_journal_entry *entries = recovery->decoded_entries;
+	int result;
+
+	if (!is_compact_block(recovery, point->sequence_number)) {
+		return unpack_recovery_journal_entry(&sector->entries[point->entry_count]);
+	}
+
+	// Compact sectors are decoded whole, and entries are visited in
+	// order, so keep the last sector decoded.
+	if ((recovery->decoded_sequence_number != point->sequence_number) ||
+	    (recovery->decoded_sector != point->sector_count)) {
+		result = decode_compact_journal_sector(compact_sector,
+						       entries);
+		ASSERT_LOG_ONLY((result == VDO_SUCCESS),
+				"compact sector of block %llu was validated",
+				point->sequence_number);
+		recovery->decoded_sequence_number = point->sequence_number;
+		recovery->decoded_sector = point->sector_count;
+	}
+
+	return recovery->decoded_entries[point->entry_count];
 }
 
 /**
@@ -494,7 +576,7 @@ static int extract_journal_entries(struct recovery_completion *recovery)
 			recovery->entry_count++;
 		}
 
-		increment_recovery_point(&recovery_point);
+		increment_recovery_point(recovery, &recovery_point);
 	}
 
 	result = ASSERT((recovery->entry_count <= recovery->incref_count),
@@ -694,25 +776,33 @@ static int compute_usages(struct recovery_completion *recovery)
 			}
 		}
 
-		increment_recovery_point(&recovery_point);
+		increment_recovery_point(recovery, &recovery_point);
 	}
 
 	return VDO_SUCCESS;
 }
 
 /**
- * Advance the current recovery and journal points.
+ * Advance the current recovery and journal points. Since blocks of either
+ * format may be in the journal, the journal point follows the recovery point
+ * into each new block rather than counting off a fixed number of entries.
  *
- * @param recovery           The recovery_completion whose points are to be
- *                           advanced
- * @param entries_per_block  The number of entries in a recovery journal block
+ * @param recovery  The recovery_completion whose points are to be advanced
  **/
-static void advance_points(struct recovery_completion *recovery,
-			   journal_entry_count_t entries_per_block)
+static void advance_points(struct recovery_completion *recovery)
 {
-	increment_recovery_point(&recovery->next_recovery_point);
-	advance_vdo_journal_point(&recovery->next_journal_point,
-				  entries_per_block);
+	increment_recovery_point(recovery, &recovery->next_recovery_point);
+	if (recovery->next_recovery_point.sequence_number
+	    != recovery->next_journal_point.sequence_number) {
+		recovery->next_journal_point = (struct journal_point) {
+			.sequence_number =
+				recovery->next_recovery_point.sequence_number,
+			.entry_count = 0,
+		};
+		return;
+	}
+
+	recovery->next_journal_point.entry_count++;
 }
 
 /**
@@ -739,7 +829,7 @@ static void add_slab_journal_entries(struct vdo_completion *completion)
 	for (recovery_point = &recovery->next_recovery_point;
 	     before_recovery_point(recovery_point,
 				   &recovery->tail_recovery_point);
-	     advance_points(recovery, journal->entries_per_block)) {
+	     advance_points(recovery)) {
 		struct vdo_slab *slab;
 		struct recovery_journal_entry entry =
 			get_entry(recovery, recovery_point);
@@ -937,17 +1027,24 @@ find_missing_decrefs(struct recovery_completion *recovery)
 		.entry_count = 0,
 	};
 
+	struct packed_journal_header *packed_tail_header =
+		get_journal_block_header(recovery->vdo->recovery_journal,
+					 recovery->journal_data,
+					 recovery->tail);
+	struct recovery_block_header tail_header;
+
 	// Set up for the first fake journal point that will be used for a
-	// synthesized entry.
+	// synthesized entry. It must follow every entry the tail block could
+	// hold in its own format.
+	unpack_recovery_block_header(packed_tail_header, &tail_header);
 	recovery->next_synthesized_journal_point = (struct journal_point) {
 		.sequence_number = recovery->tail,
-		.entry_count =
-			recovery->vdo->recovery_journal->entries_per_block,
+		.entry_count = get_recovery_block_capacity(&tail_header),
 	};
 
 	recovery_point = recovery->tail_recovery_point;
 	while (before_recovery_point(&head_point, &recovery_point)) {
-		decrement_recovery_point(&recovery_point);
+		decrement_recovery_point(recovery, &recovery_point);
 		entry = get_entry(recovery, &recovery_point);
 
 		if (!is_increment_operation(entry.operation)) {
@@ -1148,6 +1245,35 @@ static void find_slab_journal_entries(struct vdo_completion *completion)
 	}
 }
 
+/**
+ * Check that a sector of a compact journal block decodes, leaving its
+ * entries decoded for the first entries to be read.
+ *
+ * @param recovery  The recovery completion
+ * @param sequence  The sequence number of the block
+ * @param sector    The number of the sector in the block
+ *
+ * @return <code>true</code> if the sector's entries are well-formed
+ **/
+static bool is_valid_compact_sector(struct recovery_completion *recovery,
+				    sequence_number_t sequence,
+				    uint8_t sector)
+{
+	struct recovery_journal_entry *entries = recovery->decoded_entries;
+	struct packed_compact_journal_sector *compact_sector =
+		(struct packed_compact_journal_sector *)
+		get_sector(recovery, sequence, sector);
+	int result = decode_compact_journal_sector(compact_sector, entries);
+	if (result != VDO_SUCCESS) {
+		recovery->decoded_sector = 0;
+		return false;
+	}
+
+	recovery->decoded_sequence_number = sequence;
+	recovery->decoded_sector = sector;
+	return true;
+}
+
 /**
  * Find the contiguous range of journal blocks.
  *
@@ -1167,6 +1293,7 @@ static bool find_contiguous_range(struct recovery_completion *recovery)
 		struct packed_journal_header *packed_header;
 		struct recovery_block_header header;
 		journal_entry_count_t block_entries;
+		bool compact, block_full;
 		uint8_t j;
 
 		recovery->tail = i;
@@ -1181,18 +1308,25 @@ static bool find_contiguous_range(struct recovery_completion *recovery)
 		unpack_recovery_block_header(packed_header, &header);
 
 		if (!is_exact_recovery_journal_block(journal, &header, i) ||
-		    (header.entry_count > journal->entries_per_block)) {
+		    (header.entry_count >
+		     get_recovery_block_capacity(&header))) {
 			// A bad block header was found so this must be the end
 			// of the journal.
 			break;
 		}
 
+		compact = is_compact_recovery_journal_block(&header);
+		block_full = (!compact &&
+			      (header.entry_count
+			       == RECOVERY_JOURNAL_ENTRIES_PER_BLOCK));
 		block_entries = header.entry_count;
 		// Examine each sector in turn to determine the last valid
 		// sector.
 		for (j = 1; j < VDO_SECTORS_PER_BLOCK; j++) {
 			struct packed_journal_sector *sector =
 				get_journal_block_sector(packed_header, j);
+			struct packed_compact_journal_sector *compact_sector =
+				(struct packed_compact_journal_sector *) sector;
 			journal_entry_count_t sector_entries =
 				min((journal_entry_count_t) sector->entry_count,
 				    block_entries);
@@ -1203,6 +1337,11 @@ static bool find_contiguous_range(struct recovery_completion *recovery)
 				break;
 			}
 
+			if (compact &&
+			    !is_valid_compact_sector(recovery, i, j)) {
+				break;
+			}
+
 			if (sector_entries > 0) {
 				found_entries = true;
 				recovery->tail_recovery_point.sector_count++;
@@ -1211,6 +1350,19 @@ static bool find_contiguous_range(struct recovery_completion *recovery)
 				block_entries -= sector_entries;
 			}
 
+			if (compact) {
+				if (!is_full_compact_journal_sector(compact_sector)) {
+					break;
+				}
+
+				block_full = (j == (VDO_SECTORS_PER_BLOCK - 1));
+				if (block_entries == 0) {
+					break;
+				}
+
+				continue;
+			}
+
 			// If this sector is short, the later sectors can't
 			// matter.
 			if ((sector_entries <
@@ -1222,8 +1374,7 @@ static bool find_contiguous_range(struct recovery_completion *recovery)
 
 		// If this block was not filled, or if it tore, no later block
 		// can matter.
-		if ((header.entry_count != journal->entries_per_block) ||
-		    (block_entries > 0)) {
+		if (!block_full || (block_entries > 0)) {
 			break;
 		}
 	}
@@ -1263,7 +1414,7 @@ static int count_increment_entries(struct recovery_completion *recovery)
 		if (is_increment_operation(entry.operation)) {
 			recovery->incref_count++;
 		}
-		increment_recovery_point(&recovery_point);
+		increment_recovery_point(recovery, &recovery_point);
 	}
 
 	return VDO_SUCCESS;
@@ -25,8 +25,10 @@
 #include "vdoRecovery.h"
 
 #include "blockMapRecovery.h"
+#include "compactJournalSector.h"
 #include "intMap.h"
 #include "journalPoint.h"
+#include "recoveryJournalEntry.h"
 #include "types.h"
 #include "waitQueue.h"
 
@@ -100,6 +102,15 @@ struct recovery_completion {
 	size_t incomplete_decref_count;
 	/** The fake journal point of the next missing decref */
 	struct journal_point next_synthesized_journal_point;
+
+	/** The block of the compact sector most recently decoded */
+	sequence_number_t decoded_sequence_number;
+	/** The compact sector most recently decoded, or 0 if none */
+	uint8_t decoded_sector;
+	/** The entries of the compact sector most recently decoded */
+	struct recovery_journal_entry
+		decoded_entries[COMPACT_JOURNAL_ENTRIES_PER_SECTOR];
+
 	/** The queue of missing decrefs */
 	struct wait_queue missing_decrefs[];
 };
@@ -219,8 +219,10 @@ static void check_may_grow_physical(struct vdo_completion *completion)
 		return;
 	}
 
-	// This check should only be done from a base code thread.
-	if (in_recovery_mode(vdo)) {
+	// This check should only be done from a base code thread. Slabs whose
+	// reference counts are still being loaded in the background must
+	// finish before the depot can grow, just as in recovery mode.
+	if (in_recovery_mode(vdo) || is_slab_depot_scrubbing(vdo->depot)) {
 		finish_vdo_completion(completion->parent, VDO_RETRY_AFTER_REBUILD);
 		return;
 	}
@@ -48,7 +48,9 @@ void free_resize_vdo_completion(struct vdo_completion **completion_ptr);
 
 /**
  * Grow the physical size of the vdo. This method may only be called when the
- * vdo has been suspended and must not be called from a base thread.
+ * vdo has been suspended and must not be called from a base thread. The
+ * metadata of the new slabs is not written here; it is written lazily as the
+ * new slabs are used.
  *
  * @param vdo                	The vdo to resize
  * @param new_physical_blocks	The new physical size in blocks
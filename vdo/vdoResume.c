@@ -67,9 +67,6 @@ get_thread_id_for_phase(struct admin_completion *admin_completion)
 	case RESUME_PHASE_JOURNAL:
 		return get_journal_zone_thread(thread_config);
 
-	case RESUME_PHASE_PACKER:
-		return get_packer_zone_thread(thread_config);
-
 	default:
 		return get_admin_thread(thread_config);
 	}
@@ -155,7 +152,8 @@ static void resume_callback(struct vdo_completion *completion)
 		return;
 
 	case RESUME_PHASE_PACKER:
-		resume_packer(vdo->packer, reset_vdo_admin_sub_task(completion));
+		resume_packer_zones(vdo->packer_zones,
+				    reset_vdo_admin_sub_task(completion));
 		return;
 
 	case RESUME_PHASE_END:
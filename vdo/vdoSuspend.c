@@ -31,6 +31,7 @@
 #include "recoveryJournal.h"
 #include "slabDepot.h"
 #include "slabSummary.h"
+#include "superBlockCodec.h"
 #include "threadConfig.h"
 #include "vdoInternal.h"
 
@@ -65,9 +66,6 @@ get_thread_id_for_phase(struct admin_completion *admin_completion)
 	const struct thread_config *thread_config =
 		get_thread_config(admin_completion->vdo);
 	switch (admin_completion->phase) {
-	case SUSPEND_PHASE_PACKER:
-		return get_packer_zone_thread(thread_config);
-
 	case SUSPEND_PHASE_JOURNAL:
 		return get_journal_zone_thread(thread_config);
 
@@ -76,6 +74,29 @@ get_thread_id_for_phase(struct admin_completion *admin_completion)
 	}
 }
 
+/**
+ * Record the hottest block map pages in the spare sectors of the super block
+ * so that the block map cache can be warmed when the VDO is next loaded. The
+ * hot set is only advisory, so failing to record it does not fail the
+ * suspend.
+ *
+ * @param vdo  The vdo being suspended
+ **/
+static void record_block_map_hot_set(struct vdo *vdo)
+{
+	struct buffer *buffer
+		= get_super_block_codec(vdo->super_block)->spare_buffer;
+	int result = reset_buffer_end(buffer, 0);
+	if (result == UDS_SUCCESS) {
+		result = save_block_map_hot_set(vdo->block_map, buffer);
+	}
+
+	if (result != VDO_SUCCESS) {
+		log_warning_strerror(result,
+				     "failed to record block map hot set");
+	}
+}
+
 /**
  * Update the VDO state and save the super block.
  *
@@ -104,6 +125,10 @@ static void write_super_block(struct vdo *vdo,
 		return;
 	}
 
+	if (get_vdo_state(vdo) == VDO_CLEAN) {
+		record_block_map_hot_set(vdo);
+	}
+
 	save_vdo_components(vdo, completion);
 }
 
@@ -160,7 +185,8 @@ static void suspend_callback(struct vdo_completion *completion)
 						  VDO_READ_ONLY);
 		}
 
-		drain_packer(vdo->packer, reset_vdo_admin_sub_task(completion));
+		drain_packer_zones(vdo->packer_zones,
+				   reset_vdo_admin_sub_task(completion));
 		return;
 
 	case SUSPEND_PHASE_LOGICAL_ZONES:
@@ -0,0 +1,203 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Static tracepoints for the data_vio read and write pipelines and the
+ * metadata I/O which they drive. Each event compiles to a static branch
+ * which is patched out while the event is disabled, so the callers need not
+ * guard them. The events take plain values rather than VDO structures so that
+ * this header has no dependencies on VDO internals other than the hash lock
+ * states. The data_vio (or lock) pointer identifies the request across
+ * events.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM vdo
+
+#if !defined(VDO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define VDO_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#include "hashLockInternals.h"
+
+DECLARE_EVENT_CLASS(vdo_data_vio_class,
+	TP_PROTO(const void *data_vio, uint64_t lbn, uint64_t pbn),
+	TP_ARGS(data_vio, lbn, pbn),
+	TP_STRUCT__entry(
+		__field(const void *, data_vio)
+		__field(uint64_t, lbn)
+		__field(uint64_t, pbn)
+	),
+	TP_fast_assign(
+		__entry->data_vio = data_vio;
+		__entry->lbn = lbn;
+		__entry->pbn = pbn;
+	),
+	TP_printk("data_vio=%p lbn=%llu pbn=%llu",
+		  __entry->data_vio,
+		  (unsigned long long) __entry->lbn,
+		  (unsigned long long) __entry->pbn)
+);
+
+#define DEFINE_DATA_VIO_EVENT(name)				\
+DEFINE_EVENT(vdo_data_vio_class, name,				\
+	TP_PROTO(const void *data_vio, uint64_t lbn, uint64_t pbn),	\
+	TP_ARGS(data_vio, lbn, pbn))
+
+DEFINE_DATA_VIO_EVENT(vdo_write_launch);
+DEFINE_DATA_VIO_EVENT(vdo_write_allocated);
+DEFINE_DATA_VIO_EVENT(vdo_write_data_written);
+DEFINE_DATA_VIO_EVENT(vdo_write_map_update);
+DEFINE_DATA_VIO_EVENT(vdo_write_acknowledge);
+DEFINE_DATA_VIO_EVENT(vdo_read_launch);
+DEFINE_DATA_VIO_EVENT(vdo_read_mapped);
+
+#define show_hash_lock_state(state)					\
+	__print_symbolic(state,						\
+			 { HASH_LOCK_INITIALIZING, "INITIALIZING" },	\
+			 { HASH_LOCK_QUERYING, "QUERYING" },		\
+			 { HASH_LOCK_WRITING, "WRITING" },		\
+			 { HASH_LOCK_UPDATING, "UPDATING" },		\
+			 { HASH_LOCK_LOCKING, "LOCKING" },		\
+			 { HASH_LOCK_VERIFYING, "VERIFYING" },		\
+			 { HASH_LOCK_DEDUPING, "DEDUPING" },		\
+			 { HASH_LOCK_UNLOCKING, "UNLOCKING" },		\
+			 { HASH_LOCK_BYPASSING, "BYPASSING" },		\
+			 { HASH_LOCK_DESTROYING, "DESTROYING" })
+
+TRACE_EVENT(vdo_hash_lock_state,
+	TP_PROTO(const void *lock, const void *agent, int old_state,
+		 int new_state),
+	TP_ARGS(lock, agent, old_state, new_state),
+	TP_STRUCT__entry(
+		__field(const void *, lock)
+		__field(const void *, agent)
+		__field(int, old_state)
+		__field(int, new_state)
+	),
+	TP_fast_assign(
+		__entry->lock = lock;
+		__entry->agent = agent;
+		__entry->old_state = old_state;
+		__entry->new_state = new_state;
+	),
+	TP_printk("lock=%p agent=%p %s -> %s",
+		  __entry->lock,
+		  __entry->agent,
+		  show_hash_lock_state(__entry->old_state),
+		  show_hash_lock_state(__entry->new_state))
+);
+
+TRACE_EVENT(vdo_packer_add,
+	TP_PROTO(const void *data_vio, uint64_t lbn, unsigned int size,
+		 unsigned int slots_used),
+	TP_ARGS(data_vio, lbn, size, slots_used),
+	TP_STRUCT__entry(
+		__field(const void *, data_vio)
+		__field(uint64_t, lbn)
+		__field(unsigned int, size)
+		__field(unsigned int, slots_used)
+	),
+	TP_fast_assign(
+		__entry->data_vio = data_vio;
+		__entry->lbn = lbn;
+		__entry->size = size;
+		__entry->slots_used = slots_used;
+	),
+	TP_printk("data_vio=%p lbn=%llu size=%u slots_used=%u",
+		  __entry->data_vio,
+		  (unsigned long long) __entry->lbn,
+		  __entry->size,
+		  __entry->slots_used)
+);
+
+TRACE_EVENT(vdo_packer_write,
+	TP_PROTO(uint64_t pbn, unsigned int slots_used, size_t space_used),
+	TP_ARGS(pbn, slots_used, space_used),
+	TP_STRUCT__entry(
+		__field(uint64_t, pbn)
+		__field(unsigned int, slots_used)
+		__field(size_t, space_used)
+	),
+	TP_fast_assign(
+		__entry->pbn = pbn;
+		__entry->slots_used = slots_used;
+		__entry->space_used = space_used;
+	),
+	TP_printk("pbn=%llu slots_used=%u space_used=%zu",
+		  (unsigned long long) __entry->pbn,
+		  __entry->slots_used,
+		  __entry->space_used)
+);
+
+TRACE_EVENT(vdo_journal_commit,
+	TP_PROTO(uint64_t sequence_number, unsigned int entries,
+		 uint64_t latency_ns),
+	TP_ARGS(sequence_number, entries, latency_ns),
+	TP_STRUCT__entry(
+		__field(uint64_t, sequence_number)
+		__field(unsigned int, entries)
+		__field(uint64_t, latency_ns)
+	),
+	TP_fast_assign(
+		__entry->sequence_number = sequence_number;
+		__entry->entries = entries;
+		__entry->latency_ns = latency_ns;
+	),
+	TP_printk("block=%llu entries=%u latency_ns=%llu",
+		  (unsigned long long) __entry->sequence_number,
+		  __entry->entries,
+		  (unsigned long long) __entry->latency_ns)
+);
+
+DECLARE_EVENT_CLASS(vdo_page_io_class,
+	TP_PROTO(const void *cache, uint64_t pbn),
+	TP_ARGS(cache, pbn),
+	TP_STRUCT__entry(
+		__field(const void *, cache)
+		__field(uint64_t, pbn)
+	),
+	TP_fast_assign(
+		__entry->cache = cache;
+		__entry->pbn = pbn;
+	),
+	TP_printk("cache=%p pbn=%llu",
+		  __entry->cache,
+		  (unsigned long long) __entry->pbn)
+);
+
+#define DEFINE_PAGE_IO_EVENT(name)				\
+DEFINE_EVENT(vdo_page_io_class, name,				\
+	TP_PROTO(const void *cache, uint64_t pbn),		\
+	TP_ARGS(cache, pbn))
+
+DEFINE_PAGE_IO_EVENT(vdo_page_load);
+DEFINE_PAGE_IO_EVENT(vdo_page_loaded);
+DEFINE_PAGE_IO_EVENT(vdo_page_write);
+DEFINE_PAGE_IO_EVENT(vdo_page_written);
+
+#endif // VDO_TRACE_H
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE vdoTrace
+
+#include <trace/define_trace.h>
@@ -24,54 +24,10 @@
 #include "logger.h"
 #include "permassert.h"
 
+#include "bio.h"
+#include "blockCompare.h"
 #include "dataKVIO.h"
-#include <asm/unaligned.h>
-
-/**
- * Compare blocks of memory for equality.
- *
- * This assumes the blocks are likely to be large; it's not well
- * optimized for comparing just a few bytes.  This is desirable
- * because the Linux kernel memcmp() routine on x86 is not well
- * optimized for large blocks, and the performance penalty turns out
- * to be significant if you're doing lots of 4KB comparisons.
- *
- * @param pointer_argument1  first data block
- * @param pointer_argument2  second data block
- * @param length             length of the data block
- *
- * @return true iff the two blocks are equal
- **/
-static bool __must_check
-memory_equal(void *pointer_argument1, void *pointer_argument2, size_t length)
-{
-	byte *pointer1 = pointer_argument1;
-	byte *pointer2 = pointer_argument2;
-
-	while (length >= sizeof(uint64_t)) {
-		/*
-		 * get_unaligned is just for paranoia. (1) On x86_64 it is
-		 * treated the same as an aligned access. (2) In this use case,
-		 * one or both of the inputs will almost(?) always be aligned.
-		 */
-		if (get_unaligned((u64 *) pointer1) !=
-		    get_unaligned((u64 *) pointer2)) {
-			return false;
-		}
-		pointer1 += sizeof(uint64_t);
-		pointer2 += sizeof(uint64_t);
-		length -= sizeof(uint64_t);
-	}
-	while (length > 0) {
-		if (*pointer1 != *pointer2) {
-			return false;
-		}
-		pointer1++;
-		pointer2++;
-		length--;
-	}
-	return true;
-}
+#include "ioSubmitter.h"
 
 /**
  * Verify the deduplication advice from the UDS index, and invoke a
@@ -92,9 +48,8 @@ static void verify_duplication_work(struct vdo_work_item *item)
 {
 	struct data_vio *data_vio = work_item_as_data_vio(item);
 
-	if (likely(memory_equal(data_vio->data_block,
-				data_vio->read_block.data,
-				VDO_BLOCK_SIZE))) {
+	if (likely(vdo_blocks_equal(data_vio->data_block,
+				    data_vio->read_block.data))) {
 		// Leave data_vio->is_duplicate set to true.
 	} else {
 		data_vio->is_duplicate = false;
@@ -127,6 +82,61 @@ static void verify_read_block_callback(struct vdo_completion *completion)
 				     CPU_Q_ACTION_COMPRESS_BLOCK);
 }
 
+/**
+ * Note the end of a speculative write, continuing the data_vio if the verify
+ * has already called back.
+ *
+ * @param data_vio  The data_vio being verified
+ **/
+static void finish_speculative_write(struct data_vio *data_vio)
+{
+	if (atomic_dec_and_test(&data_vio->verify_steps)) {
+		enqueue_data_vio_callback(data_vio);
+	}
+}
+
+/**
+ * Note the end of the write of a data_vio's data to its allocation made while
+ * verifying its advice. This is the bi_end_io of the speculative bio.
+ *
+ * @param bio  The speculative bio
+ **/
+static void speculative_write_bio_callback(struct bio *bio)
+{
+	struct data_vio *data_vio = vio_as_data_vio(bio->bi_private);
+
+	count_completed_bios(bio);
+	// If the write failed, the data will simply be written again should
+	// the advice prove stale.
+	data_vio->speculatively_written = (bio->bi_status == BLK_STS_OK);
+	finish_speculative_write(data_vio);
+}
+
+/**
+ * Write a data_vio's data to its allocation while its advice is verified, so
+ * that if the advice is stale, the write path need not wait for the write.
+ * The data is not put in the read cache, since the allocation is released
+ * if the advice proves valid.
+ *
+ * @param data_vio  The data_vio being verified
+ **/
+static void write_speculatively(struct data_vio *data_vio)
+{
+	struct bio *bio = data_vio->speculative_bio;
+	int result = reset_bio_with_buffer(bio,
+					   data_vio->data_block,
+					   data_vio_as_vio(data_vio),
+					   speculative_write_bio_callback,
+					   REQ_OP_WRITE,
+					   data_vio->new_mapped.pbn);
+	if (result != VDO_SUCCESS) {
+		finish_speculative_write(data_vio);
+		return;
+	}
+
+	vdo_submit_companion_bio(bio);
+}
+
 /**********************************************************************/
 void verify_duplication(struct data_vio *data_vio)
 {
@@ -139,6 +149,11 @@ void verify_duplication(struct data_vio *data_vio)
 	ASSERT_LOG_ONLY(!data_vio->is_zero_block,
 			"zeroed block should not have advice to verify");
 
+	if (data_vio->write_while_verifying) {
+		atomic_set(&data_vio->verify_steps, 2);
+		write_speculatively(data_vio);
+	}
+
 	vdo_read_block(data_vio,
 		       data_vio->duplicate.pbn,
 		       data_vio->duplicate.state,
@@ -149,6 +164,5 @@ void verify_duplication(struct data_vio *data_vio)
 /**********************************************************************/
 bool compare_data_vios(struct data_vio *first, struct data_vio *second)
 {
-	return memory_equal(first->data_block, second->data_block,
-			    VDO_BLOCK_SIZE);
+	return vdo_blocks_equal(first->data_block, second->data_block);
 }
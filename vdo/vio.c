@@ -235,3 +235,24 @@ void launch_metadata_vio(struct vio *vio,
 
 	submit_metadata_vio(vio);
 }
+
+/**********************************************************************/
+void launch_discard_vio(struct vio *vio,
+			physical_block_number_t physical,
+			block_count_t count,
+			vdo_action *callback,
+			vdo_action *error_handler)
+{
+	struct vdo_completion *completion = vio_as_completion(vio);
+
+	vio->operation = VIO_WRITE;
+	vio->physical = physical;
+	vio->callback = callback;
+	vio->error_handler = error_handler;
+
+	reset_vdo_completion(completion);
+	completion->callback = vio_done_callback;
+	completion->error_handler = handle_metadata_io_error;
+
+	submit_discard_vio(vio, count);
+}
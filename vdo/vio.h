@@ -34,6 +34,8 @@
  * A representation of a single block which may be passed between the VDO base
  * and the physical layer.
  **/
+struct bio_queue_data;
+
 struct vio {
 	/* The completion for this vio */
 	struct vdo_completion completion;
@@ -71,6 +73,14 @@ struct vio {
 	 * the work queue as separate work items.
 	 **/
 	struct bio_list bios_merged;
+
+	/**
+	 * The bio queue polling for the completion of this vio's bio, if it
+	 * was submitted for polling, and the end_io the bio had before then
+	 **/
+	struct bio_queue_data *poller;
+	bio_end_io_t *polled_end_io;
+
 	/** A slot for an arbitrary bit of data, for use by systemtap. */
 	long debug_slot;
 };
@@ -392,6 +402,21 @@ static inline void launch_flush(struct vio *vio,
 			    VIO_FLUSH_BEFORE);
 }
 
+/**
+ * Discard a run of blocks on the layer. The vio's data buffer is not used.
+ *
+ * @param vio            The vio with which to discard
+ * @param physical       The first block to discard
+ * @param count          The number of blocks to discard
+ * @param callback       The function to call when the discard is complete
+ * @param error_handler  The handler for discard errors
+ **/
+void launch_discard_vio(struct vio *vio,
+			physical_block_number_t physical,
+			block_count_t count,
+			vdo_action *callback,
+			vdo_action *error_handler);
+
 /**
  * Destroy a vio. The pointer to the vio will be nulled out.
  *
@@ -406,6 +431,14 @@ void destroy_vio(struct vio **vio_ptr);
  **/
 void submit_metadata_vio(struct vio *vio);
 
+/**
+ * Discard the run of blocks starting at a discard vio's physical block.
+ *
+ * @param vio    The vio to submit
+ * @param count  The number of blocks to discard
+ **/
+void submit_discard_vio(struct vio *vio, block_count_t count);
+
 /**
  * A function to write a single compressed block to the layer
  *
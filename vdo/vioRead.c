@@ -25,9 +25,72 @@
 
 #include "blockMap.h"
 #include "dataVIO.h"
+#include "logicalZone.h"
 #include "vdoInternal.h"
+#include "vdoTrace.h"
 #include "vioWrite.h"
 
+/**
+ * Check whether a data_vio waiting on the lock of a read-modify-write may
+ * have its partial write combined into that of the lock holder. Only plain
+ * partial writes qualify: discards may span several blocks, a FUA write must
+ * not be acknowledged on the strength of a write which may not be FUA, and a
+ * waiter which is removing the lock holder from the packer is still in use.
+ *
+ * @param data_vio  The waiting data_vio
+ *
+ * @return <code>true</code> if the partial write can be combined
+ **/
+static bool can_combine_partial_write(struct data_vio *data_vio)
+{
+	struct vio *vio = data_vio_as_vio(data_vio);
+
+	return (is_read_modify_write_vio(vio) &&
+		!vio_requires_flush_after(vio) &&
+		(data_vio->user_bio != NULL) &&
+		(data_vio->remaining_discard == 0) &&
+		(READ_ONCE(data_vio->compression.lock_holder) == NULL));
+}
+
+/**
+ * Merge the partial writes waiting for the lock of a read-modify-write into
+ * its block, so that a run of small writes to one block costs a single read
+ * and a single write. Waiters are combined in arrival order and only up to the
+ * first one which can't be, so a read or full write waiting behind them still
+ * observes every earlier write and no later one. The combined data_vios are
+ * acknowledged along with the lock holder. Discards and post-process dedupe
+ * rewrites don't absorb writes since they don't finish like a plain write.
+ *
+ * @param data_vio  The read-modify-write which holds the lock
+ **/
+static void combine_waiting_partial_writes(struct data_vio *data_vio)
+{
+	struct wait_queue *waiters = &data_vio->logical.waiters;
+
+	if ((data_vio->user_bio == NULL) ||
+	    (data_vio->remaining_discard != 0)) {
+		return;
+	}
+
+	while (has_waiters(waiters)) {
+		struct data_vio *waiter
+			= waiter_as_data_vio(get_first_waiter(waiters));
+		int result;
+
+		if (!can_combine_partial_write(waiter)) {
+			return;
+		}
+
+		dequeue_next_waiter(waiters);
+		apply_combined_partial_write(data_vio, waiter);
+		result = enqueue_data_vio(&data_vio->combined_writes, waiter);
+		if (result != VDO_SUCCESS) {
+			finish_data_vio(waiter, result);
+			return;
+		}
+	}
+}
+
 /**
  * Do the modify-write part of a read-modify-write cycle. This callback is
  * registered in read_block().
@@ -47,6 +110,7 @@ static void modify_for_partial_write(struct vdo_completion *completion)
 	}
 
 	apply_partial_write(data_vio);
+	combine_waiting_partial_writes(data_vio);
 	vio->operation = VIO_WRITE | (vio->operation & ~VIO_READ_WRITE_MASK);
 	data_vio->is_partial_write = true;
 	launch_write_data_vio(data_vio);
@@ -68,10 +132,22 @@ static void read_block(struct vdo_completion *completion)
 		return;
 	}
 
+	trace_vdo_read_mapped(data_vio,
+			      data_vio->logical.lbn,
+			      data_vio->mapped.pbn);
 	completion->callback =
 		(is_read_vio(vio) ? complete_data_vio
 				  : modify_for_partial_write);
 
+	// A post-process dedupe check has nothing to gain from a block which
+	// is unmapped, zero, or already compressed.
+	if (data_vio->is_rededupe &&
+	    ((data_vio->mapped.pbn == VDO_ZERO_BLOCK) ||
+	     is_compressed(data_vio->mapped.state))) {
+		complete_data_vio(completion);
+		return;
+	}
+
 	if (data_vio->mapped.pbn == VDO_ZERO_BLOCK) {
 		zero_data_vio(data_vio);
 		invoke_vdo_completion_callback(completion);
@@ -108,6 +184,15 @@ static void read_block_mapping(struct vdo_completion *completion)
 void launch_read_data_vio(struct data_vio *data_vio)
 {
 	assert_in_logical_zone(data_vio);
+	// A read-modify-write is noted when its write is launched.
+	if (is_read_data_vio(data_vio)) {
+		trace_vdo_read_launch(data_vio,
+				      data_vio->logical.lbn,
+				      VDO_ZERO_BLOCK);
+		note_logical_zone_access(data_vio->logical.zone,
+					 data_vio->logical.lbn);
+	}
+
 	data_vio->last_async_operation = FIND_BLOCK_MAP_SLOT;
 	// Go find the block map slot for the LBN mapping.
 	find_block_map_slot(data_vio,
@@ -136,5 +221,11 @@ static void release_logical_lock(struct vdo_completion *completion)
  **/
 void cleanup_read_data_vio(struct data_vio *data_vio)
 {
+	// A lockless read has no lock to release.
+	if (data_vio->is_lockless) {
+		vio_done_callback(data_vio_as_completion(data_vio));
+		return;
+	}
+
 	launch_logical_callback(data_vio, release_logical_lock);
 }
@@ -115,12 +115,15 @@
 #include "compressionState.h"
 #include "dataVIO.h"
 #include "hashLock.h"
+#include "logicalZone.h"
+#include "packer.h"
 #include "recoveryJournal.h"
 #include "referenceOperation.h"
 #include "slab.h"
 #include "slabDepot.h"
 #include "slabJournal.h"
 #include "vdoInternal.h"
+#include "vdoTrace.h"
 #include "vioRead.h"
 
 /**
@@ -147,6 +150,7 @@ enum read_only_action {
 static void perform_cleanup_stage(struct data_vio *data_vio,
 				  enum data_vio_cleanup_stage stage);
 static void write_block(struct data_vio *data_vio);
+static void acknowledge_write(struct data_vio *data_vio);
 
 /**
  * Release the PBN lock and/or the reference on the allocated block at the
@@ -190,6 +194,23 @@ static void clean_hash_lock(struct vdo_completion *completion)
 	perform_cleanup_stage(data_vio, VIO_RELEASE_LOGICAL);
 }
 
+/**
+ * Finish the partial writes which a read-modify-write absorbed in
+ * combine_waiting_partial_writes(). Since they have no state of their own
+ * beyond their requests, they are simply completed with the given result.
+ *
+ * @param data_vio  The read-modify-write which absorbed the writes
+ * @param result    The result with which to complete them
+ **/
+static void finish_combined_writes(struct data_vio *data_vio, int result)
+{
+	while (has_waiters(&data_vio->combined_writes)) {
+		struct waiter *waiter
+			= dequeue_next_waiter(&data_vio->combined_writes);
+		finish_data_vio(waiter_as_data_vio(waiter), result);
+	}
+}
+
 /**
  * Make some assertions about a data_vio which has finished cleaning up
  * and do its final callback.
@@ -203,6 +224,10 @@ static void finish_cleanup(struct data_vio *data_vio)
 			"complete data_vio has no allocation lock");
 	ASSERT_LOG_ONLY(data_vio->hash_lock == NULL,
 			"complete data_vio has no hash lock");
+	// Combined writes which were not acknowledged share the fate of the
+	// write which carried them.
+	finish_combined_writes(data_vio,
+			       data_vio_as_completion(data_vio)->result);
 	vio_done_callback(data_vio_as_completion(data_vio));
 }
 
@@ -341,6 +366,13 @@ static void finish_write_data_vio(struct vdo_completion *completion)
 static void abort_deduplication(struct data_vio *data_vio)
 {
 	if (!has_allocation(data_vio)) {
+		// A post-process dedupe check which found nothing to share
+		// leaves the block where it already is.
+		if (data_vio->is_rededupe) {
+			finish_data_vio(data_vio, VDO_SUCCESS);
+			return;
+		}
+
 		// There was no space to write this block and we failed to
 		// deduplicate or compress it.
 		finish_data_vio(data_vio, VDO_NO_SPACE);
@@ -352,6 +384,34 @@ static void abort_deduplication(struct data_vio *data_vio)
 	write_block(data_vio);
 }
 
+/**
+ * Acknowledge a FUA write as soon as it is durable. By the time its block map
+ * update begins, its data has been written and its recovery journal entries
+ * have been committed, so a crash would replay it. Neither the block map
+ * update nor the index update which may follow need to delay the
+ * acknowledgment. The write is continued with the given callback once it has
+ * been acknowledged.
+ *
+ * @param data_vio  The data_vio
+ * @param callback  The logical zone callback with which to continue
+ *
+ * @return <code>true</code> if the data_vio was acknowledged and will be
+ *         continued by the callback
+ **/
+static bool acknowledge_durable_fua_write(struct data_vio *data_vio,
+					  vdo_action *callback)
+{
+	if ((data_vio->user_bio == NULL) ||
+	    !vio_requires_flush_after(data_vio_as_vio(data_vio)) ||
+	    is_trim_data_vio(data_vio)) {
+		return false;
+	}
+
+	set_logical_callback(data_vio, callback);
+	acknowledge_write(data_vio);
+	return true;
+}
+
 /**
  * Update the block map now that we've added an entry in the recovery journal
  * for a block we have just shared. This is the callback registered in
@@ -363,7 +423,9 @@ static void update_block_map_for_dedupe(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
 	assert_in_logical_zone(data_vio);
-	if (abort_on_error(completion->result, data_vio, READ_ONLY)) {
+	if (abort_on_error(completion->result, data_vio, READ_ONLY) ||
+	    acknowledge_durable_fua_write(data_vio,
+					  update_block_map_for_dedupe)) {
 		return;
 	}
 
@@ -567,6 +629,7 @@ static void pack_compressed_data(struct vdo_completion *completion)
 	// XXX this is a callback, so there should probably be an error check
 	// here even if we think compression can't currently return one.
 
+	record_compression_candidate(data_vio);
 	if (!may_pack_data_vio(data_vio)) {
 		abort_deduplication(data_vio);
 		return;
@@ -583,6 +646,14 @@ void compress_data(struct data_vio *data_vio)
 {
 	ASSERT_LOG_ONLY(!data_vio->is_duplicate,
 			"compressing a non-duplicate block");
+	if (data_vio->speculatively_written) {
+		// The data is already in the allocation, so using it is
+		// quicker than compressing.
+		set_compression_done(data_vio);
+		abort_deduplication(data_vio);
+		return;
+	}
+
 	if (!may_compress_data_vio(data_vio)) {
 		abort_deduplication(data_vio);
 		return;
@@ -656,6 +727,14 @@ void share_block(struct vdo_completion *completion)
 	}
 
 	data_vio->new_mapped = data_vio->duplicate;
+	if (data_vio->is_rededupe &&
+	    (data_vio->duplicate.pbn == data_vio->mapped.pbn)) {
+		// The block is already mapped to the copy the hash lock is
+		// sharing, so there is no mapping to change.
+		launch_hash_zone_callback(data_vio, finish_write_data_vio);
+		return;
+	}
+
 	launch_journal_callback(data_vio,
 				add_recovery_journal_entry_for_dedupe);
 }
@@ -713,6 +792,7 @@ static void resolve_hash_zone(struct vdo_completion *completion)
 
 	ASSERT_LOG_ONLY(!data_vio->is_zero_block,
 			"zero blocks should not be hashed");
+	record_data_vio_milestone(data_vio, DATA_VIO_HASHED);
 
 	data_vio->hash_zone =
 		select_hash_zone(get_vdo_from_data_vio(data_vio),
@@ -739,6 +819,16 @@ static void prepare_for_dedupe(struct vdo_completion *completion)
 	ASSERT_LOG_ONLY(!data_vio->is_zero_block,
 			"must not prepare to dedupe zero blocks");
 
+	data_vio->dedupe_exempt = is_exempt_from_deduplication(data_vio);
+	if (data_vio->dedupe_exempt &&
+	    (data_vio->is_rededupe || !has_allocation(data_vio) ||
+	     !get_vdo_compressing(get_vdo_from_data_vio(data_vio)))) {
+		// The block will not be deduplicated, and can't be compressed,
+		// so there is no need for its chunk name.
+		abort_deduplication(data_vio);
+		return;
+	}
+
 	// Before we can dedupe, we need to know the chunk name, so the first
 	// step is to hash the block data.
 	data_vio->last_async_operation = HASH_DATA;
@@ -760,7 +850,9 @@ static void update_block_map_for_write(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
 	assert_in_logical_zone(data_vio);
-	if (abort_on_error(completion->result, data_vio, READ_ONLY)) {
+	if (abort_on_error(completion->result, data_vio, READ_ONLY) ||
+	    acknowledge_durable_fua_write(data_vio,
+					  update_block_map_for_write)) {
 		return;
 	}
 
@@ -773,6 +865,9 @@ static void update_block_map_for_write(struct vdo_completion *completion)
 		completion->callback = complete_data_vio;
 	}
 
+	trace_vdo_write_map_update(data_vio,
+				   data_vio->logical.lbn,
+				   data_vio->new_mapped.pbn);
 	data_vio->last_async_operation = PUT_MAPPED_BLOCK;
 	put_mapped_block(data_vio);
 }
@@ -848,7 +943,11 @@ static void acknowledge_write(struct data_vio *data_vio)
 {
 	ASSERT_LOG_ONLY(data_vio->has_flush_generation_lock,
 			"write VIO to be acknowledged has a flush generation lock");
+	trace_vdo_write_acknowledge(data_vio,
+				    data_vio->logical.lbn,
+				    data_vio->new_mapped.pbn);
 	data_vio->last_async_operation = ACKNOWLEDGE_WRITE;
+	finish_combined_writes(data_vio, VDO_SUCCESS);
 	acknowledge_data_vio(data_vio);
 }
 
@@ -898,6 +997,10 @@ static void finish_block_write(struct vdo_completion *completion)
 		set_logical_callback(data_vio,
 				     read_old_block_mapping_for_write);
 	} else {
+		record_data_vio_milestone(data_vio, DATA_VIO_WRITTEN);
+		trace_vdo_write_data_written(data_vio,
+					     data_vio->logical.lbn,
+					     data_vio->new_mapped.pbn);
 		set_allocated_zone_callback(data_vio, increment_for_write);
 	}
 
@@ -914,6 +1017,12 @@ static void finish_block_write(struct vdo_completion *completion)
 static void write_block(struct data_vio *data_vio)
 {
 	data_vio->last_async_operation = WRITE_DATA;
+	if (data_vio->speculatively_written) {
+		// The data was written while its stale advice was verified.
+		launch_journal_callback(data_vio, finish_block_write);
+		return;
+	}
+
 	set_journal_callback(data_vio, finish_block_write);
 	write_data_vio(data_vio);
 }
@@ -942,11 +1051,15 @@ continue_write_after_allocation(struct allocating_vio *allocating_vio)
 	}
 
 	WRITE_ONCE(data_vio->allocation_succeeded, true);
+	record_data_vio_milestone(data_vio, DATA_VIO_ALLOCATED);
 	data_vio->new_mapped = (struct zoned_pbn) {
 		.zone = allocating_vio->zone,
 		.pbn = allocating_vio->allocation,
 		.state = MAPPING_STATE_UNCOMPRESSED,
 	};
+	trace_vdo_write_allocated(data_vio,
+				  data_vio->logical.lbn,
+				  data_vio->new_mapped.pbn);
 
 	// XXX prepare_for_dedupe can run from any thread, so this is a place
 	// where running the callback on the kernel thread would save a thread
@@ -960,6 +1073,48 @@ continue_write_after_allocation(struct allocating_vio *allocating_vio)
 	acknowledge_write(data_vio);
 }
 
+/**
+ * Continue a trim now that the existing mapping of its block is known. A block
+ * which is already unmapped needs no journal entries, block map update, or
+ * reference count change, so the trim is done; otherwise it proceeds like a
+ * zero block write. This callback is registered in
+ * read_old_block_mapping_for_trim().
+ *
+ * @param completion  The trim data_vio
+ **/
+static void continue_trim_with_old_mapping(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+	assert_in_logical_zone(data_vio);
+	if (abort_on_error(completion->result, data_vio, NOT_READ_ONLY)) {
+		return;
+	}
+
+	if ((data_vio->mapped.state == MAPPING_STATE_UNMAPPED) &&
+	    !data_vio->has_invalid_mapping) {
+		finish_data_vio(data_vio, VDO_SUCCESS);
+		return;
+	}
+
+	data_vio->new_mapped.pbn = VDO_ZERO_BLOCK;
+	launch_journal_callback(data_vio, finish_block_write);
+}
+
+/**
+ * Get the current mapping of the block being trimmed. This callback is
+ * registered in continue_write_with_block_map_slot().
+ *
+ * @param completion  The trim data_vio
+ **/
+static void read_old_block_mapping_for_trim(struct vdo_completion *completion)
+{
+	struct data_vio *data_vio = as_data_vio(completion);
+	assert_in_logical_zone(data_vio);
+	set_logical_callback(data_vio, continue_trim_with_old_mapping);
+	data_vio->last_async_operation = GET_MAPPED_BLOCK_FOR_TRIM;
+	get_mapped_block(data_vio);
+}
+
 /**
  * Continue the write path for a VIO now that block map slot resolution is
  * complete. This callback is registered in launch_write_data_vio().
@@ -970,6 +1125,8 @@ static void
 continue_write_with_block_map_slot(struct vdo_completion *completion)
 {
 	struct data_vio *data_vio = as_data_vio(completion);
+	struct allocation_selector *selector;
+
 	// We don't care what thread we're on.
 	if (abort_on_error(completion->result, data_vio, NOT_READ_ONLY)) {
 		return;
@@ -990,7 +1147,15 @@ continue_write_with_block_map_slot(struct vdo_completion *completion)
 		return;
 	}
 
-	if (data_vio->is_zero_block || is_trim_data_vio(data_vio)) {
+	if (is_trim_data_vio(data_vio)) {
+		// Find out whether there is anything to trim before making
+		// any journal entries.
+		launch_logical_callback(data_vio,
+					read_old_block_mapping_for_trim);
+		return;
+	}
+
+	if (data_vio->is_zero_block) {
 		// We don't need to write any data, so skip allocation and just
 		// update the block map and reference counts (via the journal).
 		data_vio->new_mapped.pbn = VDO_ZERO_BLOCK;
@@ -998,9 +1163,19 @@ continue_write_with_block_map_slot(struct vdo_completion *completion)
 		return;
 	}
 
-	allocate_data_block(data_vio_as_allocating_vio(data_vio),
-			    get_allocation_selector(data_vio->logical.zone),
-			    VIO_WRITE_LOCK, continue_write_after_allocation);
+	if (data_vio->is_rededupe) {
+		// The data is already stored, so only a duplicate elsewhere
+		// could save any space.
+		prepare_for_dedupe(completion);
+		return;
+	}
+
+	selector = get_allocation_selector(data_vio->logical.zone);
+	allocate_data_block_for_lbn(data_vio_as_allocating_vio(data_vio),
+				    selector,
+				    data_vio->logical.lbn,
+				    VIO_WRITE_LOCK,
+				    continue_write_after_allocation);
 }
 
 /**********************************************************************/
@@ -1019,6 +1194,12 @@ void launch_write_data_vio(struct data_vio *data_vio)
 		return;
 	}
 
+	trace_vdo_write_launch(data_vio, data_vio->logical.lbn, VDO_ZERO_BLOCK);
+
+	// Sequential writes need their leaf pages just as reads do.
+	note_logical_zone_access(data_vio->logical.zone,
+				 data_vio->logical.lbn);
+
 	// Go find the block map slot for the LBN mapping.
 	data_vio->last_async_operation = FIND_BLOCK_MAP_SLOT;
 	find_block_map_slot(data_vio,
@@ -23,6 +23,7 @@
 
 #include "permassert.h"
 
+#include "completion.h"
 #include "statusCodes.h"
 
 /**********************************************************************/
@@ -82,13 +83,28 @@ void notify_all_waiters(struct wait_queue *queue, waiter_callback *callback,
 	// infinite loop if entries are returned to the queue by the callback
 	// function.
 	struct wait_queue waiters;
+	bool batch;
+
 	initialize_wait_queue(&waiters);
 	transfer_all_waiters(queue, &waiters);
 
+	/*
+	 * Waking many waiters usually sends many of them to the same few
+	 * threads, so hold their enqueues back and make one per thread.
+	 */
+	batch = (count_waiters(&waiters) > 1);
+	if (batch) {
+		start_vdo_completion_batch();
+	}
+
 	// Drain the copied queue, invoking the callback on every entry.
 	while (notify_next_waiter(&waiters, callback, context)) {
 		// All the work is done by the loop condition.
 	}
+
+	if (batch) {
+		finish_vdo_completion_batch();
+	}
 }
 
 /**********************************************************************/
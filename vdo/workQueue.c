@@ -21,10 +21,14 @@
 
 #include "workQueue.h"
 
+#include <linux/cpumask.h>
 #include <linux/kthread.h>
+#include <linux/mutex.h>
 #include <linux/percpu.h>
+#include <linux/sched/clock.h>
 
 #include "atomicDefs.h"
+#include "kernelLayer.h"
 #include "logger.h"
 #include "memoryAlloc.h"
 #include "numeric.h"
@@ -38,8 +42,26 @@
 #include "workQueueStats.h"
 #include "workQueueSysfs.h"
 
+enum {
+	/** The longest a worker thread will spin waiting for work, in ns */
+	MAX_SPIN_TIME = 50 * 1000,
+	/** The period over which the spin budget is enforced, in ns */
+	SPIN_BUDGET_PERIOD = 10 * 1000 * 1000,
+	/**
+	 * How often the lowest priority work is polled first, so that a
+	 * stream of higher priority work can't starve it
+	 */
+	FAIR_POLL_INTERVAL = 32,
+};
+
 static DEFINE_PER_CPU(unsigned int, service_queue_rotor);
 
+/** The CPUs to which each class of thread is bound; empty for any CPU */
+static struct cpumask thread_class_cpus[VDO_THREAD_CLASS_COUNT];
+static DEFINE_MUTEX(thread_class_cpus_mutex);
+
+unsigned int work_queue_spin_budget = 0;
+
 static void free_simple_work_queue(struct simple_work_queue *queue);
 static void finish_simple_work_queue(struct simple_work_queue *queue);
 
@@ -65,7 +87,28 @@ next_service_queue(struct round_robin_work_queue *queue)
 	 * with a load that light we won't care.
 	 */
 	unsigned int rotor = this_cpu_inc_return(service_queue_rotor);
-	unsigned int index = rotor % queue->num_service_queues;
+	unsigned int count = READ_ONCE(queue->active_service_queues);
+	unsigned int index = rotor % count;
+	unsigned int i;
+	int node;
+
+	if (!queue->numa_aware) {
+		return queue->service_queues[index];
+	}
+
+	/*
+	 * Prefer a service queue whose thread runs on the submitter's node,
+	 * so the work item and the data it references stay in local memory.
+	 * If no thread is on this node, fall back to plain round-robin.
+	 */
+	node = numa_node_id();
+	for (i = 0; i < count; i++) {
+		struct simple_work_queue *service_queue =
+			queue->service_queues[(index + i) % count];
+		if (service_queue->node == node) {
+			return service_queue;
+		}
+	}
 
 	return queue->service_queues[index];
 }
@@ -92,7 +135,8 @@ pick_simple_queue(struct vdo_work_queue *queue)
 
 /**
  * Scan the work queue's work item lists, and dequeue and return the next
- * waiting work item, if any.
+ * waiting work item, if any. The caller must be the only thread polling the
+ * queue.
  *
  * We scan the funnel queues from highest priority to lowest, once; there is
  * therefore a race condition where a high-priority work item can be enqueued
@@ -100,30 +144,146 @@ pick_simple_queue(struct vdo_work_queue *queue)
  * the high-priority item on the next call). If strict enforcement of
  * priorities becomes necessary, this function will need fixing.
  *
- * @param queue  the work queue
+ * Every FAIR_POLL_INTERVAL polls, the funnel queues are scanned from lowest
+ * priority to highest instead, so that no priority is starved.
+ *
+ * @param [in]  queue         the work queue
+ * @param [out] priority_ptr  A pointer to hold the priority of the item
  *
  * @return a work item pointer, or NULL
  **/
 static struct vdo_work_item *
-poll_for_work_item(struct simple_work_queue *queue)
+poll_priority_lists(struct simple_work_queue *queue,
+		    unsigned int *priority_ptr)
 {
-	struct vdo_work_item *item = NULL;
+	int count = READ_ONCE(queue->num_priority_lists);
 	int i;
 
-	for (i = READ_ONCE(queue->num_priority_lists) - 1; i >= 0; i--) {
+	if (++queue->polls_since_fair_poll >= FAIR_POLL_INTERVAL) {
+		queue->polls_since_fair_poll = 0;
+		for (i = 0; i < count; i++) {
+			struct funnel_queue_entry *link =
+				funnel_queue_poll(queue->priority_lists[i]);
+			if (link != NULL) {
+				*priority_ptr = i;
+				return container_of(link,
+						    struct vdo_work_item,
+						    work_queue_entry_link);
+			}
+		}
+
+		return NULL;
+	}
+
+	for (i = count - 1; i >= 0; i--) {
 		struct funnel_queue_entry *link =
 			funnel_queue_poll(queue->priority_lists[i]);
 		if (link != NULL) {
-			item = container_of(link,
+			*priority_ptr = i;
+			return container_of(link,
 					    struct vdo_work_item,
 					    work_queue_entry_link);
-			break;
 		}
 	}
 
+	return NULL;
+}
+
+/**
+ * Dequeue and return the next waiting work item of the current thread's own
+ * queue, if any.
+ *
+ * @param queue  the work queue
+ *
+ * @return a work item pointer, or NULL
+ **/
+static struct vdo_work_item *
+poll_for_work_item(struct simple_work_queue *queue)
+{
+	struct vdo_work_item *item;
+	unsigned int priority;
+
+	if (!queue->type->allow_stealing) {
+		return poll_priority_lists(queue, &priority);
+	}
+
+	// A sibling may be stealing, but only holds the lock for one poll.
+	spin_lock(&queue->poll_lock);
+	item = poll_priority_lists(queue, &priority);
+	spin_unlock(&queue->poll_lock);
 	return item;
 }
 
+/**
+ * Take a work item queued for a busy sibling of a round-robin work queue's
+ * service queue. The item is accounted as if it had been queued on the thief
+ * in the first place, keeping its original enqueue time.
+ *
+ * @param queue  the service queue which has run out of work
+ *
+ * @return a work item pointer, or NULL
+ **/
+static struct vdo_work_item *
+steal_work_item(struct simple_work_queue *queue)
+{
+	struct round_robin_work_queue *parent;
+	unsigned int count, start, i;
+
+	if (!queue->type->allow_stealing) {
+		return NULL;
+	}
+
+	parent = as_round_robin_work_queue(READ_ONCE(queue->parent_queue));
+	if (parent == NULL) {
+		return NULL;
+	}
+
+	// A parked service queue must not take on new work.
+	count = parent->num_service_queues;
+	for (i = READ_ONCE(parent->active_service_queues); i < count; i++) {
+		if (READ_ONCE(parent->service_queues[i]) == queue) {
+			return NULL;
+		}
+	}
+
+	start = this_cpu_inc_return(service_queue_rotor);
+	for (i = 0; i < count; i++) {
+		struct simple_work_queue *victim =
+			READ_ONCE(parent->service_queues[(start + i) % count]);
+		struct vdo_work_item *item;
+		uint64_t enqueue_time;
+		unsigned int priority;
+
+		// An idle sibling is about to take its own work.
+		if ((victim == NULL) || (victim == queue) ||
+		    (atomic_read(&victim->idle) == 1) ||
+		    (count_work_items_pending(&victim->stats.work_item_stats)
+		     == 0)) {
+			continue;
+		}
+
+		if (!spin_trylock(&victim->poll_lock)) {
+			continue;
+		}
+
+		item = poll_priority_lists(victim, &priority);
+		spin_unlock(&victim->poll_lock);
+		if (item == NULL) {
+			continue;
+		}
+
+		atomic64_dec(&victim->stats.work_item_stats
+			     .enqueued[item->stat_table_index]);
+		enqueue_time = item->enqueue_time;
+		update_stats_for_enqueue(&queue->stats, item, priority);
+		item->enqueue_time = enqueue_time;
+		item->my_queue = &queue->common;
+		return item;
+	}
+
+	return NULL;
+}
+
 /**
  * Add a work item into the queue, and inform the caller of any additional
  * processing necessary.
@@ -198,6 +358,31 @@ static void run_start_hook(struct simple_work_queue *queue)
 	}
 }
 
+/**
+ * Run any idle hook that may be defined for the work queue.
+ *
+ * @param queue  The work queue
+ **/
+static void run_idle_hook(struct simple_work_queue *queue)
+{
+	if (queue->type->idle != NULL) {
+		queue->type->idle(queue->private);
+	}
+}
+
+/**
+ * Run any poll hook that may be defined for the work queue.
+ *
+ * @param queue  The work queue
+ *
+ * @return <code>true</code> if the hook has polled I/O outstanding
+ **/
+static bool run_poll_hook(struct simple_work_queue *queue)
+{
+	return ((queue->type->poll != NULL) &&
+		queue->type->poll(queue->private));
+}
+
 /**
  * Run any finish hook that may be defined for the work queue.
  *
@@ -317,6 +502,117 @@ wait_for_next_work_item(struct simple_work_queue *queue)
 	return item;
 }
 
+/**
+ * Poll for work for a while instead of going to sleep, if new work has been
+ * arriving soon after the queue empties and the spin budget allows. Since
+ * the idle flag stays clear while spinning, a producer which enqueues work
+ * in that time skips the wakeup, and the work is picked up without paying
+ * for the wakeup and the rescheduling of this thread.
+ *
+ * @param queue  The work queue
+ * @param start  The time (ns) at which the queue was found to be empty
+ *
+ * @return a work item pointer, or NULL if none arrived
+ **/
+static struct vdo_work_item *
+spin_for_work_item(struct simple_work_queue *queue, uint64_t start)
+{
+	uint64_t budget = ((SPIN_BUDGET_PERIOD / 100)
+			   * READ_ONCE(work_queue_spin_budget));
+	struct vdo_work_item *item = NULL;
+	uint64_t limit, now;
+
+	if ((start - queue->spin_period_start) >= SPIN_BUDGET_PERIOD) {
+		queue->spin_period_start = start;
+		queue->spin_period_time = 0;
+	}
+
+	// Don't spin if work has not been arriving soon enough to be caught.
+	if ((queue->idle_gap > MAX_SPIN_TIME)
+	    || (queue->spin_period_time >= budget)) {
+		return NULL;
+	}
+
+	limit = min(max(2 * queue->idle_gap, (uint64_t) 1000),
+		    budget - queue->spin_period_time);
+	for (now = start; (now - start) < limit; now = ktime_get_ns()) {
+		item = poll_for_work_item(queue);
+		if ((item != NULL) || need_resched() || kthread_should_stop()) {
+			break;
+		}
+
+		cpu_relax();
+	}
+
+	queue->spin_period_time += now - start;
+	// These stats are read from other threads, but are only written by
+	// this thread.
+	WRITE_ONCE(queue->stats.spins, queue->stats.spins + 1);
+	WRITE_ONCE(queue->stats.spin_time,
+		   queue->stats.spin_time + (now - start));
+	if (item != NULL) {
+		WRITE_ONCE(queue->stats.spin_hits, queue->stats.spin_hits + 1);
+	}
+
+	return item;
+}
+
+/**
+ * Poll for both completions of the queue's polled I/O and new work, for as
+ * long as the queue has polled I/O outstanding. The idle flag stays clear
+ * while polling, so producers need not wake this thread.
+ *
+ * @param queue  The work queue
+ *
+ * @return the next work item, or NULL if no polled I/O remains outstanding
+ **/
+static struct vdo_work_item *
+poll_io_for_work_item(struct simple_work_queue *queue)
+{
+	while (run_poll_hook(queue)) {
+		struct vdo_work_item *item = poll_for_work_item(queue);
+
+		if (item != NULL) {
+			return item;
+		}
+
+		cond_resched();
+	}
+
+	return NULL;
+}
+
+/**
+ * Wait for work after the queue has been found empty, spinning first if
+ * spinning is enabled, and learn how soon work arrives.
+ *
+ * @param queue  The work queue
+ *
+ * @return the next work item, or NULL to indicate shutdown is requested
+ **/
+static struct vdo_work_item *wait_for_work(struct simple_work_queue *queue)
+{
+	struct vdo_work_item *item = NULL;
+	uint64_t idle_start, idle_gap;
+
+	if (READ_ONCE(work_queue_spin_budget) == 0) {
+		return wait_for_next_work_item(queue);
+	}
+
+	idle_start = ktime_get_ns();
+	item = spin_for_work_item(queue, idle_start);
+	if (item == NULL) {
+		item = wait_for_next_work_item(queue);
+	}
+
+	if (item != NULL) {
+		idle_gap = ktime_get_ns() - idle_start;
+		queue->idle_gap = ((7 * queue->idle_gap) + idle_gap) / 8;
+	}
+
+	return item;
+}
+
 /**
  * Execute a work item from a work queue, and do associated bookkeeping.
  *
@@ -327,8 +623,11 @@ static void process_work_item(struct simple_work_queue *queue,
 			      struct vdo_work_item *item)
 {
 	uint64_t dequeue_time = update_stats_for_dequeue(&queue->stats, item);
-	// Save the index, so we can use it after the work function.
+	// Save the index and action, so we can use them after the work
+	// function.
 	unsigned int index = item->stat_table_index;
+	unsigned int action = item->action;
+	uint64_t run_start;
 
 	if (ASSERT(item->my_queue == &queue->common,
 		   "item %px from queue %px marked as being in this queue (%px)",
@@ -336,10 +635,14 @@ static void process_work_item(struct simple_work_queue *queue,
 		item->my_queue = NULL;
 	}
 
+	run_start = local_clock();
 	item->work(item);
 	// We just surrendered control of the work item; no more access.
 	item = NULL;
 
+	add_action_time(queue->stats.action_times[action].run,
+			local_clock() - run_start);
+
 	update_work_item_stats_for_work_time(&queue->stats.work_item_stats,
 					     index,
 					     dequeue_time);
@@ -400,7 +703,16 @@ static void service_work_queue(struct simple_work_queue *queue)
 	while (true) {
 		struct vdo_work_item *item = poll_for_work_item(queue);
 		if (item == NULL) {
-			item = wait_for_next_work_item(queue);
+			item = steal_work_item(queue);
+		}
+
+		if (item == NULL) {
+			item = poll_io_for_work_item(queue);
+		}
+
+		if (item == NULL) {
+			run_idle_hook(queue);
+			item = wait_for_work(queue);
 		}
 
 		if (item == NULL) {
@@ -425,11 +737,11 @@ static void service_work_queue(struct simple_work_queue *queue)
 
 /**
  * Initialize per-thread data for a new worker thread and run the work queue.
- * Called in a new thread created by kthread_run().
+ * Called in a new thread created by kthread_create_on_node().
  *
  * @param ptr  A pointer to the vdo_work_queue to run.
  *
- * @return 0 (indicating success to kthread_run())
+ * @return 0 (indicating success to the kthread code)
  **/
 static int work_queue_runner(void *ptr)
 {
@@ -438,6 +750,10 @@ static int work_queue_runner(void *ptr)
 
 	kobject_get(&queue->common.kobj);
 
+	if (queue->type->thread_class != VDO_THREAD_CLASS_NONE) {
+		bind_to_vdo_thread_class_cpus(queue->type->thread_class);
+	}
+
 	queue->stats.start_time = queue->most_recent_wakeup = ktime_get_ns();
 
 	spin_lock_irqsave(&queue->lock, flags);
@@ -508,6 +824,8 @@ static bool queue_started(struct simple_work_queue *queue)
  * @param [in]  type               The work queue type defining the lifecycle
  *                                 functions, queue actions, priorities, and
  *                                 timeout behavior
+ * @param [in]  node               The NUMA node to bind the worker thread
+ *                                 to, or NUMA_NO_NODE
  * @param [out] queue_ptr          Where to store the queue handle
  *
  * @return VDO_SUCCESS or an error code
@@ -518,6 +836,7 @@ static int make_simple_work_queue(const char *thread_name_prefix,
 				  struct kernel_layer *owner,
 				  void *private,
 				  const struct vdo_work_queue_type *type,
+				  int node,
 				  struct simple_work_queue **queue_ptr)
 {
 	struct simple_work_queue *queue;
@@ -535,6 +854,7 @@ static int make_simple_work_queue(const char *thread_name_prefix,
 
 	queue->type = type;
 	queue->private = private;
+	queue->node = node;
 	queue->common.owner = owner;
 
 	for (i = 0; i < WORK_QUEUE_ACTION_COUNT; i++) {
@@ -578,6 +898,7 @@ static int make_simple_work_queue(const char *thread_name_prefix,
 	init_waitqueue_head(&queue->waiting_worker_threads);
 	init_waitqueue_head(&queue->start_waiters);
 	spin_lock_init(&queue->lock);
+	spin_lock_init(&queue->poll_lock);
 
 	kobject_init(&queue->common.kobj, &simple_work_queue_kobj_type);
 	result = kobject_add(&queue->common.kobj,
@@ -607,16 +928,23 @@ static int make_simple_work_queue(const char *thread_name_prefix,
 
 	queue->started = false;
 
-	thread = kthread_run(work_queue_runner,
-			     queue,
-			     "%s:%s",
-			     thread_name_prefix,
-			     queue->common.name);
+	thread = kthread_create_on_node(work_queue_runner,
+					queue,
+					node,
+					"%s:%s",
+					thread_name_prefix,
+					queue->common.name);
 	if (IS_ERR(thread)) {
 		free_simple_work_queue(queue);
 		return (int) PTR_ERR(thread);
 	}
 
+	if (node != NUMA_NO_NODE) {
+		set_cpus_allowed_ptr(thread, cpumask_of_node(node));
+	}
+
+	wake_up_process(thread);
+
 	queue->thread = thread;
 	WRITE_ONCE(queue->thread_id, thread->pid);
 
@@ -660,6 +988,7 @@ int make_work_queue(const char *thread_name_prefix,
 					        owner,
 					        context,
 					        type,
+					        get_next_vdo_thread_node(owner),
 					        &simple_queue);
 		if (result == VDO_SUCCESS) {
 			*queue_ptr = &simple_queue->common;
@@ -683,6 +1012,7 @@ int make_work_queue(const char *thread_name_prefix,
 	}
 
 	queue->num_service_queues = thread_count;
+	queue->active_service_queues = thread_count;
 	queue->common.round_robin_mode = true;
 	queue->common.owner = owner;
 
@@ -716,15 +1046,20 @@ int make_work_queue(const char *thread_name_prefix,
 						owner,
 						context,
 						type,
+						get_next_vdo_thread_node(owner),
 						&queue->service_queues[i]);
 		if (result != VDO_SUCCESS) {
 			queue->num_service_queues = i;
+			queue->active_service_queues = i;
 			// Destroy previously created subordinates.
 			finish_work_queue(*queue_ptr);
 			free_work_queue(queue_ptr);
 			return result;
 		}
 		queue->service_queues[i]->parent_queue = *queue_ptr;
+		if (queue->service_queues[i]->node != NUMA_NO_NODE) {
+			queue->numa_aware = true;
+		}
 	}
 
 	return VDO_SUCCESS;
@@ -910,8 +1245,170 @@ void enqueue_work_queue(struct vdo_work_queue *queue,
 	}
 }
 
+/**********************************************************************/
+void enqueue_work_queue_batch(struct vdo_work_queue *queue,
+			      struct vdo_work_item *items[],
+			      unsigned int count)
+{
+	struct simple_work_queue *simple_queue = pick_simple_queue(queue);
+	struct funnel_queue_entry *first[WORK_QUEUE_PRIORITY_COUNT] = { NULL };
+	struct funnel_queue_entry *last[WORK_QUEUE_PRIORITY_COUNT] = { NULL };
+	unsigned int i, priority;
+
+	for (i = 0; i < count; i++) {
+		struct vdo_work_item *item = items[i];
+		struct funnel_queue_entry *link = &item->work_queue_entry_link;
+
+		ASSERT_LOG_ONLY(item->my_queue == NULL,
+				"item %px to enqueue is not already queued (%px)",
+				item, item->my_queue);
+		if (ASSERT(item->action < WORK_QUEUE_ACTION_COUNT,
+			   "action is in range for queue") != VDO_SUCCESS) {
+			item->action = 0;
+		}
+
+		priority = READ_ONCE(simple_queue->priority_map[item->action]);
+		update_stats_for_enqueue(&simple_queue->stats, item, priority);
+		item->my_queue = &simple_queue->common;
+
+		// Chain the items of each priority in order.
+		if (first[priority] == NULL) {
+			first[priority] = link;
+		} else {
+			last[priority]->next = link;
+		}
+		last[priority] = link;
+	}
+
+	for (priority = 0; priority < WORK_QUEUE_PRIORITY_COUNT; priority++) {
+		if (first[priority] != NULL) {
+			funnel_queue_put_chain(simple_queue
+					       ->priority_lists[priority],
+					       first[priority],
+					       last[priority]);
+		}
+	}
+
+	// See enqueue_work_queue_item() for the wakeup protocol.
+	smp_mb();
+	if ((atomic_read(&simple_queue->idle) == 1) &&
+	    (atomic_cmpxchg(&simple_queue->idle, 1, 0) == 1)) {
+		wake_worker_thread(simple_queue);
+	}
+}
+
 // Misc
 
+/**********************************************************************/
+void count_work_queue_dispatch(struct vdo_work_queue *queue, bool direct)
+{
+	struct vdo_work_queue_stats *stats =
+		&as_simple_work_queue(queue)->stats;
+
+	// These stats are read from other threads, but are only written by
+	// the queue's own thread.
+	if (direct) {
+		WRITE_ONCE(stats->direct_dispatches,
+			   stats->direct_dispatches + 1);
+	} else {
+		WRITE_ONCE(stats->queued_dispatches,
+			   stats->queued_dispatches + 1);
+	}
+}
+
+/**********************************************************************/
+void set_work_queue_spin_budget(unsigned int value)
+{
+	WRITE_ONCE(work_queue_spin_budget,
+		   min(value, (unsigned int) MAX_WORK_QUEUE_SPIN_BUDGET));
+}
+
+/**********************************************************************/
+int set_vdo_thread_class_cpus(enum vdo_thread_class thread_class,
+			      const char *cpu_list)
+{
+	cpumask_var_t cpus;
+	int result;
+
+	if (!alloc_cpumask_var(&cpus, GFP_KERNEL)) {
+		return -ENOMEM;
+	}
+
+	result = cpulist_parse(cpu_list, cpus);
+	if (result == 0) {
+		mutex_lock(&thread_class_cpus_mutex);
+		cpumask_copy(&thread_class_cpus[thread_class], cpus);
+		mutex_unlock(&thread_class_cpus_mutex);
+	}
+
+	free_cpumask_var(cpus);
+	return result;
+}
+
+/**********************************************************************/
+int format_vdo_thread_class_cpus(enum vdo_thread_class thread_class,
+				 char *buffer)
+{
+	int length;
+
+	mutex_lock(&thread_class_cpus_mutex);
+	length = sprintf(buffer,
+			 "%*pbl\n",
+			 cpumask_pr_args(&thread_class_cpus[thread_class]));
+	mutex_unlock(&thread_class_cpus_mutex);
+	return length;
+}
+
+/**********************************************************************/
+void bind_to_vdo_thread_class_cpus(enum vdo_thread_class thread_class)
+{
+	int result = 0;
+
+	/*
+	 * A class mask replaces any NUMA node binding made when the thread
+	 * was created; the administrator has asked for these CPUs.
+	 */
+	mutex_lock(&thread_class_cpus_mutex);
+	if (!cpumask_empty(&thread_class_cpus[thread_class])) {
+		result = set_cpus_allowed_ptr(current,
+					      &thread_class_cpus[thread_class]);
+	}
+	mutex_unlock(&thread_class_cpus_mutex);
+
+	if (result != 0) {
+		uds_log_warning("cannot bind thread %s to its configured CPUs: %d",
+				current->comm,
+				result);
+	}
+}
+
+/**********************************************************************/
+int set_work_queue_thread_count(struct vdo_work_queue *queue,
+				unsigned int count)
+{
+	struct round_robin_work_queue *round_robin;
+
+	if (!queue->round_robin_mode) {
+		return ((count == 1) ? VDO_SUCCESS : -EINVAL);
+	}
+
+	round_robin = as_round_robin_work_queue(queue);
+	if ((count == 0) || (count > round_robin->num_service_queues)) {
+		return -EINVAL;
+	}
+
+	WRITE_ONCE(round_robin->active_service_queues, count);
+	return VDO_SUCCESS;
+}
+
+/**********************************************************************/
+unsigned int get_work_queue_thread_count(struct vdo_work_queue *queue)
+{
+	return (queue->round_robin_mode ?
+		READ_ONCE(as_round_robin_work_queue(queue)
+			  ->active_service_queues) :
+		1);
+}
 
 /**
  * Return the work queue pointer recorded at initialization time in
@@ -962,6 +1459,14 @@ struct vdo_work_queue *get_current_work_queue(void)
 	return (queue == NULL) ? NULL : &queue->common;
 }
 
+/**********************************************************************/
+int get_work_queue_node(struct vdo_work_queue *queue)
+{
+	return (queue->round_robin_mode ?
+			NUMA_NO_NODE :
+			as_simple_work_queue(queue)->node);
+}
+
 /**********************************************************************/
 struct kernel_layer *get_work_queue_owner(struct vdo_work_queue *queue)
 {
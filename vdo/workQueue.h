@@ -34,8 +34,16 @@ enum {
 	WORK_QUEUE_ACTION_COUNT = 8,
 	/** Number of priority values available */
 	WORK_QUEUE_PRIORITY_COUNT = 4,
+	/** The largest allowed work queue spin budget, in percent */
+	MAX_WORK_QUEUE_SPIN_BUDGET = 50,
 };
 
+/*
+ * The percentage of its time a worker thread may spend spinning for new work
+ * instead of sleeping; zero disables spinning.
+ */
+extern unsigned int work_queue_spin_budget;
+
 struct vdo_work_item {
 	/** Entry link for lock-free work queue */
 	struct funnel_queue_entry work_queue_entry_link;
@@ -110,6 +118,20 @@ struct vdo_work_queue_action {
 	unsigned int priority;
 };
 
+/**
+ * The kinds of worker thread whose CPU placement may be configured.
+ **/
+enum vdo_thread_class {
+	/** Threads which are left wherever the scheduler puts them */
+	VDO_THREAD_CLASS_NONE = 0,
+	VDO_THREAD_CLASS_ACK,
+	VDO_THREAD_CLASS_BIO,
+	VDO_THREAD_CLASS_CPU,
+	VDO_THREAD_CLASS_JOURNAL,
+	VDO_THREAD_CLASS_ZONE,
+	VDO_THREAD_CLASS_COUNT,
+};
+
 /**
  * Static attributes of a work queue that are fixed at compile time
  * for a given call site. (Attributes that may be computed at run time
@@ -122,6 +144,34 @@ struct vdo_work_queue_type {
 	/** A function to call in the new thread when shutting down */
 	void (*finish)(void *);
 
+	/**
+	 * A function to call in the thread each time the queue has been
+	 * drained, before waiting for more work
+	 **/
+	void (*idle)(void *);
+
+	/**
+	 * A function to call in the thread when the queue has been drained,
+	 * to reap completions of I/O it has submitted for polling; it
+	 * returns true while such I/O is outstanding, in which case the
+	 * thread keeps polling instead of sleeping
+	 **/
+	bool (*poll)(void *);
+
+	/**
+	 * Whether a thread of a multi-threaded queue which has run out of
+	 * work of its own may take work queued for its busy siblings; this
+	 * is only suitable if the queue's work may run on any of its threads
+	 **/
+	bool allow_stealing;
+
+	/**
+	 * The class whose CPU mask the queue's threads are bound to when
+	 * they start; a queue whose threads are of more than one class
+	 * should leave this unset and bind them in its start function
+	 **/
+	enum vdo_thread_class thread_class;
+
 	/** Table of actions for this work queue */
 	struct vdo_work_queue_action action_table[WORK_QUEUE_ACTION_COUNT];
 };
@@ -130,7 +180,8 @@ struct vdo_work_queue_type {
  * Create a work queue.
  *
  * If multiple threads are requested, work items will be distributed to them in
- * round-robin fashion.
+ * round-robin fashion. If the queue type allows stealing, a thread which runs
+ * out of work will also take work items queued for its busy siblings.
  *
  * @param [in]  thread_name_prefix  The per-device prefix to use in thread
  *                                  names
@@ -192,6 +243,20 @@ void setup_work_item(struct vdo_work_item *item,
 void enqueue_work_queue(struct vdo_work_queue *queue,
 			struct vdo_work_item *item);
 
+/**
+ * Add several work items to a work queue at once. The items all go to the
+ * same thread, and those of each priority are added to it with a single
+ * funnel queue operation, so a burst of work for one thread costs one
+ * exchange and at most one wakeup rather than one of each per item.
+ *
+ * @param queue  The queue handle
+ * @param items  The work items to be processed, in order
+ * @param count  The number of work items
+ **/
+void enqueue_work_queue_batch(struct vdo_work_queue *queue,
+			      struct vdo_work_item *items[],
+			      unsigned int count);
+
 /**
  * Shut down a work queue's worker thread.
  *
@@ -247,6 +312,80 @@ static inline bool are_work_item_actions_equal(struct vdo_work_item *item1,
 	return item1->action == item2->action;
 }
 
+/**
+ * Set the percentage of its time a worker thread may spend spinning for new
+ * work before sleeping. Values above MAX_WORK_QUEUE_SPIN_BUDGET are reduced
+ * to it.
+ *
+ * @param value  The budget in percent, or zero to disable spinning
+ **/
+void set_work_queue_spin_budget(unsigned int value);
+
+/**
+ * Set the CPUs to which threads of a class are bound when they start. Threads
+ * which are already running are not moved. An empty list lets the threads
+ * run on any CPU (or on their NUMA node, if the vdo is NUMA-aware).
+ *
+ * @param thread_class  The class of thread
+ * @param cpu_list      The CPUs, as a list such as "0-3,8"
+ *
+ * @return 0 or an error if the list can't be parsed
+ **/
+int __must_check set_vdo_thread_class_cpus(enum vdo_thread_class thread_class,
+					   const char *cpu_list);
+
+/**
+ * Format the CPUs to which threads of a class are bound as a list.
+ *
+ * @param thread_class  The class of thread
+ * @param buffer        The buffer to write to, at least a page long
+ *
+ * @return The number of characters written
+ **/
+int format_vdo_thread_class_cpus(enum vdo_thread_class thread_class,
+				 char *buffer);
+
+/**
+ * Bind the current thread to the CPUs set for a class of thread, if any.
+ *
+ * @param thread_class  The class of the current thread
+ **/
+void bind_to_vdo_thread_class_cpus(enum vdo_thread_class thread_class);
+
+/**
+ * Change the number of a work queue's threads which are given new work. The
+ * count may not exceed the number of threads the queue was made with. Threads
+ * beyond the count finish the work they already have and then sit idle until
+ * the count is raised again. This may be called from any thread.
+ *
+ * @param queue  The work queue
+ * @param count  The number of threads to use
+ *
+ * @return VDO_SUCCESS or -EINVAL if the count is out of range
+ **/
+int __must_check set_work_queue_thread_count(struct vdo_work_queue *queue,
+					     unsigned int count);
+
+/**
+ * Get the number of a work queue's threads which are given new work.
+ *
+ * @param queue  The work queue
+ *
+ * @return The number of threads in use
+ **/
+unsigned int __must_check
+get_work_queue_thread_count(struct vdo_work_queue *queue);
+
+/**
+ * Count a callback dispatched by the current thread, which must be the
+ * thread of the given work queue, as having been either run directly, saving
+ * a trip through a work queue, or enqueued.
+ *
+ * @param queue   The current thread's work queue
+ * @param direct  Whether the callback was run directly
+ **/
+void count_work_queue_dispatch(struct vdo_work_queue *queue, bool direct);
+
 /**
  * Returns the private data for the current thread's work queue.
  *
@@ -262,6 +401,16 @@ void *get_work_queue_private_data(void);
  **/
 struct vdo_work_queue *get_current_work_queue(void);
 
+/**
+ * Returns the NUMA node to which a work queue's thread is bound.
+ *
+ * @param queue  The work queue
+ *
+ * @return The node, or NUMA_NO_NODE if the queue is not a single thread
+ *         bound to a node
+ **/
+int get_work_queue_node(struct vdo_work_queue *queue);
+
 /**
  * Returns the kernel layer that owns the work queue.
  *
@@ -77,8 +77,15 @@ struct simple_work_queue {
 	uint8_t priority_map[WORK_QUEUE_ACTION_COUNT];
 	/** The funnel queues */
 	struct funnel_queue *priority_lists[WORK_QUEUE_PRIORITY_COUNT];
+	/**
+	 * Polls of the funnel queues since the lowest priority was last
+	 * polled first
+	 **/
+	unsigned int polls_since_fair_poll;
 	/** The kernel thread */
 	struct task_struct *thread;
+	/** The NUMA node the thread is bound to, or NUMA_NO_NODE */
+	int node;
 	/** Life cycle functions, etc */
 	const struct vdo_work_queue_type *type;
 	/** Opaque private data pointer, defined by higher level code */
@@ -92,6 +99,11 @@ struct simple_work_queue {
 	 * Lock protecting priority_map, num_priority_lists, started
 	 */
 	spinlock_t lock;
+	/**
+	 * Lock making polling of the funnel queues exclusive, when the
+	 * queue's type allows sibling threads to steal from it
+	 */
+	spinlock_t poll_lock;
 	/** Any worker threads (zero or one) waiting for new work to do */
 	wait_queue_head_t waiting_worker_threads;
 	/**
@@ -142,6 +154,15 @@ struct simple_work_queue {
 	struct vdo_work_queue_stats stats;
 	/** Last time (ns) the scheduler actually woke us up */
 	uint64_t most_recent_wakeup;
+	/**
+	 * Moving average (ns) of how long the queue stays empty before new
+	 * work arrives, which sets how long the worker thread spins
+	 */
+	uint64_t idle_gap;
+	/** Start time (ns) of the current spin budget period */
+	uint64_t spin_period_start;
+	/** Time (ns) spent spinning in the current spin budget period */
+	uint64_t spin_period_time;
 };
 
 struct round_robin_work_queue {
@@ -151,6 +172,13 @@ struct round_robin_work_queue {
 	struct simple_work_queue **service_queues;
 	/** Number of subordinate work queues */
 	unsigned int num_service_queues;
+	/**
+	 * Number of subordinate work queues given new work; the rest finish
+	 * what they have and then sit idle. This field is set from any thread.
+	 */
+	unsigned int active_service_queues;
+	/** Whether the subordinate threads are bound to NUMA nodes */
+	bool numa_aware;
 };
 
 static inline struct simple_work_queue *
@@ -152,3 +152,123 @@ ssize_t format_run_time_stats(const struct vdo_work_queue_stats *stats,
 	return sprintf(buffer, "%llu %llu %llu\n",
 		       lifetime, run_time, reschedule_time);
 }
+
+/**********************************************************************/
+ssize_t format_spin_stats(const struct vdo_work_queue_stats *stats,
+			  char *buffer)
+{
+	return sprintf(buffer, "%llu %llu %llu %llu\n",
+		       READ_ONCE(stats->spins),
+		       READ_ONCE(stats->spin_hits),
+		       READ_ONCE(stats->spin_time),
+		       READ_ONCE(stats->waits));
+}
+
+/**********************************************************************/
+ssize_t format_dispatch_stats(const struct vdo_work_queue_stats *stats,
+			      char *buffer)
+{
+	return sprintf(buffer, "%llu %llu\n",
+		       READ_ONCE(stats->direct_dispatches),
+		       READ_ONCE(stats->queued_dispatches));
+}
+
+/**
+ * Format the non-empty buckets of one action time histogram, summed across a
+ * set of queues.
+ *
+ * @param queues   The queues
+ * @param count    The number of queues
+ * @param code     The action code
+ * @param run      Whether to format the run times rather than the wait times
+ * @param buffer   The buffer to write to
+ * @param size     The space left in the buffer
+ *
+ * @return The number of characters written
+ **/
+static int format_action_buckets(struct simple_work_queue *const queues[],
+				 unsigned int count,
+				 unsigned int code,
+				 bool run,
+				 char *buffer,
+				 size_t size)
+{
+	int length = scnprintf(buffer, size, run ? " run" : " wait");
+	unsigned int bucket, i;
+
+	for (bucket = 0; bucket < ACTION_TIME_BUCKETS; bucket++) {
+		uint64_t total = 0;
+
+		for (i = 0; i < count; i++) {
+			const struct vdo_action_times *times =
+				&queues[i]->stats.action_times[code];
+			total += READ_ONCE(run ? times->run[bucket] :
+					   times->wait[bucket]);
+		}
+
+		if (total > 0) {
+			length += scnprintf(buffer + length,
+					    size - length,
+					    " %u:%llu",
+					    bucket,
+					    total);
+		}
+	}
+
+	return length;
+}
+
+/**********************************************************************/
+ssize_t format_action_times(struct simple_work_queue *const queues[],
+			    unsigned int count,
+			    char *buffer)
+{
+	const struct vdo_work_queue_type *type = queues[0]->type;
+	size_t length = 0;
+	unsigned int i;
+
+	for (i = 0; i < WORK_QUEUE_ACTION_COUNT; i++) {
+		const struct vdo_work_queue_action *action =
+			&type->action_table[i];
+		unsigned int code = action->code;
+		uint64_t total = 0;
+		unsigned int bucket, j;
+
+		if (action->name == NULL) {
+			break;
+		}
+
+		for (j = 0; j < count; j++) {
+			for (bucket = 0; bucket < ACTION_TIME_BUCKETS;
+			     bucket++) {
+				total += READ_ONCE(queues[j]->stats
+						   .action_times[code]
+						   .run[bucket]);
+			}
+		}
+
+		if (total == 0) {
+			continue;
+		}
+
+		length += scnprintf(buffer + length,
+				    PAGE_SIZE - length,
+				    "%s",
+				    action->name);
+		length += format_action_buckets(queues,
+						count,
+						code,
+						false,
+						buffer + length,
+						PAGE_SIZE - length);
+		length += format_action_buckets(queues,
+						count,
+						code,
+						true,
+						buffer + length,
+						PAGE_SIZE - length);
+		length += scnprintf(buffer + length, PAGE_SIZE - length, "\n");
+	}
+
+	return length;
+}
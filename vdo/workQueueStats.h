@@ -32,6 +32,23 @@
 // Defined in workQueueInternals.h after inclusion of workQueueStats.h.
 struct simple_work_queue;
 
+enum {
+	/** The number of power-of-two buckets in an action time histogram */
+	ACTION_TIME_BUCKETS = 32,
+};
+
+/*
+ * Histograms of how long the work items with one action code waited in the
+ * queue and how long their work functions ran. Bucket b counts times from
+ * 2^(b-1) up to 2^b nanoseconds; the last bucket also counts anything longer.
+ * They are updated only by the worker thread, without atomics, and are summed
+ * across the threads of a round-robin queue when read.
+ */
+struct vdo_action_times {
+	uint64_t wait[ACTION_TIME_BUCKETS];
+	uint64_t run[ACTION_TIME_BUCKETS];
+};
+
 /*
  * Tracking statistics.
  *
@@ -49,6 +66,18 @@ struct vdo_work_queue_stats {
 	struct vdo_work_item_stats work_item_stats;
 	// How often we go to sleep waiting for work
 	uint64_t waits;
+	// How often we spin waiting for work before going to sleep
+	uint64_t spins;
+	// How often spinning found work, saving a sleep and a wakeup
+	uint64_t spin_hits;
+	// Time spent spinning waiting for work (ns)
+	uint64_t spin_time;
+	// Callbacks this thread ran directly instead of enqueueing them
+	uint64_t direct_dispatches;
+	// Callbacks this thread enqueued, to itself or another thread
+	uint64_t queued_dispatches;
+	// Wait and run time histograms for each action code
+	struct vdo_action_times action_times[WORK_QUEUE_ACTION_COUNT];
 
 	// Run time data, for monitoring utilization levels.
 
@@ -106,6 +135,21 @@ initialize_work_queue_stats(struct vdo_work_queue_stats *stats,
  **/
 void cleanup_work_queue_stats(struct vdo_work_queue_stats *stats);
 
+/**
+ * Count a time in an action time histogram. This must only be called from the
+ * worker thread.
+ *
+ * @param buckets  The histogram buckets
+ * @param time     The time to count, in nanoseconds
+ **/
+static inline void add_action_time(uint64_t buckets[], uint64_t time)
+{
+	unsigned int bucket =
+		min_t(unsigned int, fls64(time), ACTION_TIME_BUCKETS - 1);
+
+	WRITE_ONCE(buckets[bucket], buckets[bucket] + 1);
+}
+
 /**
  * Update the work queue statistics tracking to note the enqueueing of
  * a work item.
@@ -139,6 +183,7 @@ update_stats_for_dequeue(struct vdo_work_queue_stats *stats,
 	uint64_t dequeue_time = ktime_get_ns();
 	uint64_t elapsed = dequeue_time - item->enqueue_time;
 	enter_histogram_sample(stats->queue_time_histogram, elapsed / 1000);
+	add_action_time(stats->action_times[item->action].wait, elapsed);
 	item->enqueue_time = 0;
 	return dequeue_time;
 }
@@ -163,4 +208,40 @@ void log_work_queue_stats(const struct simple_work_queue *queue);
 ssize_t format_run_time_stats(const struct vdo_work_queue_stats *stats,
 			      char *buffer);
 
+/**
+ * Format the spin count, spin hit count, spin time, and sleep count into a
+ * supplied buffer for reporting via sysfs.
+ *
+ * @param [in]  stats   The stats structure containing the spin info
+ * @param [out] buffer  The buffer in which to report the info
+ **/
+ssize_t format_spin_stats(const struct vdo_work_queue_stats *stats,
+			  char *buffer);
+
+/**
+ * Format the wait and run time histograms of each action of a set of work
+ * queues of the same type, summed across the queues, into a supplied buffer
+ * for reporting via sysfs. Each action with any samples gets a line of the
+ * form "name wait b:count ... run b:count ...", listing only the non-empty
+ * buckets.
+ *
+ * @param [in]  queues  The queues, such as the service queues of a
+ *                      round-robin queue
+ * @param [in]  count   The number of queues
+ * @param [out] buffer  The buffer in which to report the info, a page long
+ **/
+ssize_t format_action_times(struct simple_work_queue *const queues[],
+			    unsigned int count,
+			    char *buffer);
+
+/**
+ * Format the counts of callbacks run directly and of callbacks enqueued into
+ * a supplied buffer for reporting via sysfs.
+ *
+ * @param [in]  stats   The stats structure containing the dispatch counts
+ * @param [out] buffer  The buffer in which to report the info
+ **/
+ssize_t format_dispatch_stats(const struct vdo_work_queue_stats *stats,
+			      char *buffer);
+
 #endif // WORK_QUEUE_STATS_H
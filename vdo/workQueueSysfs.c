@@ -36,6 +36,34 @@ struct work_queue_attribute {
 			 size_t length);
 };
 
+/**********************************************************************/
+static ssize_t action_times_show(const struct vdo_work_queue *queue,
+				 char *buf)
+{
+	struct simple_work_queue *simple_queue;
+	const struct round_robin_work_queue *round_robin;
+
+	if (!queue->round_robin_mode) {
+		simple_queue = container_of(queue,
+					    struct simple_work_queue,
+					    common);
+		return format_action_times(&simple_queue, 1, buf);
+	}
+
+	round_robin = container_of(queue, struct round_robin_work_queue,
+				   common);
+	return format_action_times(round_robin->service_queues,
+				   round_robin->num_service_queues,
+				   buf);
+}
+
+/**********************************************************************/
+static ssize_t dispatch_show(const struct vdo_work_queue *queue, char *buf)
+{
+	return format_dispatch_stats(&as_const_simple_work_queue(queue)->stats,
+				     buf);
+}
+
 /**********************************************************************/
 static ssize_t name_show(const struct vdo_work_queue *queue, char *buf)
 {
@@ -50,6 +78,13 @@ static ssize_t pid_show(const struct vdo_work_queue *queue, char *buf)
 	return sprintf(buf, "%d\n", READ_ONCE(simple_queue->thread_id));
 }
 
+/**********************************************************************/
+static ssize_t spin_show(const struct vdo_work_queue *queue, char *buf)
+{
+	return format_spin_stats(&as_const_simple_work_queue(queue)->stats,
+				 buf);
+}
+
 /**********************************************************************/
 static ssize_t times_show(const struct vdo_work_queue *queue, char *buf)
 {
@@ -75,6 +110,24 @@ static ssize_t work_functions_show(const struct vdo_work_queue *queue,
 				      PAGE_SIZE);
 }
 
+/**********************************************************************/
+static struct work_queue_attribute action_times_attr = {
+	.attr = {
+			.name = "action_times",
+			.mode = 0444,
+		},
+	.show = action_times_show,
+};
+
+/**********************************************************************/
+static struct work_queue_attribute dispatch_attr = {
+	.attr = {
+			.name = "dispatch",
+			.mode = 0444,
+		},
+	.show = dispatch_show,
+};
+
 /**********************************************************************/
 static struct work_queue_attribute name_attr = {
 	.attr = {
@@ -93,6 +146,15 @@ static struct work_queue_attribute pid_attr = {
 	.show = pid_show,
 };
 
+/**********************************************************************/
+static struct work_queue_attribute spin_attr = {
+	.attr = {
+			.name = "spin",
+			.mode = 0444,
+		},
+	.show = spin_show,
+};
+
 /**********************************************************************/
 static struct work_queue_attribute times_attr = {
 	.attr = {
@@ -122,8 +184,11 @@ static struct work_queue_attribute work_functions_attr = {
 
 /**********************************************************************/
 static struct attribute *simple_work_queue_attrs[] = {
+	&action_times_attr.attr,
+	&dispatch_attr.attr,
 	&name_attr.attr,
 	&pid_attr.attr,
+	&spin_attr.attr,
 	&times_attr.attr,
 	&type_attr.attr,
 	&work_functions_attr.attr,
@@ -132,6 +197,7 @@ static struct attribute *simple_work_queue_attrs[] = {
 
 /**********************************************************************/
 static struct attribute *round_robin_work_queue_attrs[] = {
+	&action_times_attr.attr,
 	&name_attr.attr,
 	&type_attr.attr,
 	NULL,
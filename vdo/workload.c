@@ -0,0 +1,731 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+
+#include "workload.h"
+
+#include <linux/bio.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/wait.h>
+
+#include "logger.h"
+#include "memoryAlloc.h"
+
+#include "constants.h"
+#include "statusCodes.h"
+
+#include "kernelLayer.h"
+
+enum {
+	/** The largest request, in blocks */
+	MAXIMUM_WORKLOAD_REQUEST_BLOCKS = 16,
+	/** The most requests which may be in flight */
+	MAXIMUM_WORKLOAD_DEPTH = 1024,
+	/** The most distinct request sizes */
+	MAXIMUM_WORKLOAD_SIZES = 8,
+	/** The default span, if the logical space is larger */
+	DEFAULT_WORKLOAD_SPAN = 1 << 20,
+	/** The number of latency buckets between successive powers of two */
+	LATENCY_SUB_BUCKETS = 16,
+	/** The log of LATENCY_SUB_BUCKETS */
+	LATENCY_SUB_BUCKET_SHIFT = 4,
+	/** The number of latency buckets, enough for any 64 bit value */
+	LATENCY_BUCKETS = 64 * LATENCY_SUB_BUCKETS,
+};
+
+struct workload_parameters {
+	uint64_t operations;
+	unsigned int depth;
+	unsigned int read_percent;
+	unsigned int dedupe_percent;
+	unsigned int compress_percent;
+	unsigned int locality_percent;
+	block_count_t span;
+	unsigned int size_count;
+	unsigned int sizes[MAXIMUM_WORKLOAD_SIZES];
+	uint64_t seed;
+};
+
+struct workload_run;
+
+struct workload_request {
+	/** The run to which this request belongs */
+	struct workload_run *run;
+	/** The entry on the run's list of idle requests */
+	struct list_head entry;
+	/** The time the request was submitted, in ns */
+	uint64_t start_time;
+	/** The number of blocks in the request */
+	unsigned int block_count;
+	/** The pages holding the request's data, one per block */
+	struct page *pages[MAXIMUM_WORKLOAD_REQUEST_BLOCKS];
+};
+
+struct workload_run {
+	/** The layer being driven */
+	struct kernel_layer *layer;
+	/** The parameters of the run */
+	struct workload_parameters parameters;
+	/** The state of the random number generator */
+	uint64_t random;
+	/** The number of distinct blocks written so far */
+	uint64_t unique_blocks;
+	/** The block after the end of the previous request */
+	logical_block_number_t next_lbn;
+	/** Protects idle_requests */
+	spinlock_t lock;
+	/** The requests which are not in flight */
+	struct list_head idle_requests;
+	/** Waited on for an idle request */
+	wait_queue_head_t wait;
+	/** The number of requests which failed */
+	atomic64_t errors;
+	/** The number of blocks read and written */
+	atomic64_t blocks;
+	/** The largest latency seen, in us */
+	atomic64_t maximum_latency;
+	/** The latency histogram, in us */
+	atomic64_t latencies[LATENCY_BUCKETS];
+	/** The requests */
+	struct workload_request requests[];
+};
+
+/**
+ * Get the next value from a xorshift64* generator. The generator is private
+ * to the run so that a run is reproducible from its seed.
+ *
+ * @param state  The generator state, which must not be zero
+ *
+ * @return A pseudo-random value
+ **/
+static inline uint64_t next_random(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Choose a random value in a range.
+ *
+ * @param run    The run
+ * @param limit  The upper bound (exclusive) of the range, which must not be 0
+ *
+ * @return A value in [0, limit)
+ **/
+static inline uint64_t random_below(struct workload_run *run, uint64_t limit)
+{
+	uint64_t value;
+
+	div64_u64_rem(next_random(&run->random), limit, &value);
+	return value;
+}
+
+/**
+ * Check whether a random event with a given percentage chance happens.
+ *
+ * @param run      The run
+ * @param percent  The chance of the event
+ *
+ * @return true if the event happens
+ **/
+static inline bool random_chance(struct workload_run *run,
+				 unsigned int percent)
+{
+	return (random_below(run, 100) < percent);
+}
+
+/**
+ * Fill a block with the content identified by a number. Blocks with the same
+ * number are identical, and blocks with different numbers are not. The first
+ * part of the block is pseudo-random and the rest is a constant fill, so the
+ * block compresses away by the requested percentage.
+ *
+ * @param run         The run
+ * @param page        The page to fill
+ * @param content_id  The number of the content
+ **/
+static void fill_block(struct workload_run *run,
+		       struct page *page,
+		       uint64_t content_id)
+{
+	uint64_t *words = page_address(page);
+	unsigned int random_words =
+		(((VDO_BLOCK_SIZE / sizeof(uint64_t))
+		  * (100 - run->parameters.compress_percent)) / 100);
+	uint64_t state = ((content_id + 1) * 0x9E3779B97F4A7C15ULL)
+			 ^ run->parameters.seed;
+	unsigned int i;
+
+	// Always vary the first word so that the content id is unique even
+	// when the block is otherwise constant.
+	words[0] = content_id;
+	state = (state == 0) ? 1 : state;
+	for (i = 1; i < random_words; i++) {
+		words[i] = next_random(&state);
+	}
+
+	memset(&words[max(random_words, 1U)],
+	       (int) (content_id & 0xff),
+	       VDO_BLOCK_SIZE - (max(random_words, 1U) * sizeof(uint64_t)));
+}
+
+/**
+ * Choose the content of the next written block: either a copy of a block
+ * written earlier, or content which has not been written before.
+ *
+ * @param run  The run
+ *
+ * @return The number of the content
+ **/
+static uint64_t choose_content(struct workload_run *run)
+{
+	if ((run->unique_blocks > 0) &&
+	    random_chance(run, run->parameters.dedupe_percent)) {
+		return random_below(run, run->unique_blocks);
+	}
+
+	return run->unique_blocks++;
+}
+
+/**
+ * Get the histogram bucket for a latency. Each power of two is split into
+ * LATENCY_SUB_BUCKETS linear buckets, so each bucket is within about 6% of
+ * the latencies in it.
+ *
+ * @param latency  The latency, in us
+ *
+ * @return The bucket index
+ **/
+static unsigned int latency_bucket(uint64_t latency)
+{
+	unsigned int high_bit;
+
+	if (latency < LATENCY_SUB_BUCKETS) {
+		return latency;
+	}
+
+	high_bit = fls64(latency) - 1;
+	return (((high_bit - LATENCY_SUB_BUCKET_SHIFT + 1)
+		 * LATENCY_SUB_BUCKETS)
+		+ ((latency >> (high_bit - LATENCY_SUB_BUCKET_SHIFT))
+		   & (LATENCY_SUB_BUCKETS - 1)));
+}
+
+/**
+ * Get the smallest latency which falls into a histogram bucket.
+ *
+ * @param bucket  The bucket index
+ *
+ * @return The least latency in the bucket, in us
+ **/
+static uint64_t bucket_latency(unsigned int bucket)
+{
+	unsigned int high_bit;
+
+	if (bucket < LATENCY_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	high_bit = ((bucket / LATENCY_SUB_BUCKETS)
+		    + LATENCY_SUB_BUCKET_SHIFT - 1);
+	return ((uint64_t) (LATENCY_SUB_BUCKETS
+			    + (bucket % LATENCY_SUB_BUCKETS))
+		<< (high_bit - LATENCY_SUB_BUCKET_SHIFT));
+}
+
+/**
+ * Record the completion of a request and make the request available for
+ * reuse. This is the bi_end_io of the request bios, so it may run in
+ * interrupt context.
+ *
+ * @param bio  The completed bio
+ **/
+static void complete_workload_request(struct bio *bio)
+{
+	struct workload_request *request = bio->bi_private;
+	struct workload_run *run = request->run;
+	uint64_t latency = ((ktime_get_ns() - request->start_time)
+			    / NSEC_PER_USEC);
+	uint64_t maximum = atomic64_read(&run->maximum_latency);
+	unsigned long flags;
+
+	if (bio->bi_status != BLK_STS_OK) {
+		atomic64_inc(&run->errors);
+	}
+
+	atomic64_add(request->block_count, &run->blocks);
+	atomic64_inc(&run->latencies[latency_bucket(latency)]);
+	while (latency > maximum) {
+		uint64_t previous = atomic64_cmpxchg(&run->maximum_latency,
+						     maximum,
+						     latency);
+		if (previous == maximum) {
+			break;
+		}
+
+		maximum = previous;
+	}
+
+	bio_put(bio);
+
+	spin_lock_irqsave(&run->lock, flags);
+	list_add(&request->entry, &run->idle_requests);
+	spin_unlock_irqrestore(&run->lock, flags);
+	wake_up(&run->wait);
+}
+
+/**
+ * Take an idle request, if there is one.
+ *
+ * @param run          The run
+ * @param request_ptr  A pointer to hold the request
+ *
+ * @return true if a request was taken
+ **/
+static bool take_idle_request(struct workload_run *run,
+			      struct workload_request **request_ptr)
+{
+	bool found;
+
+	spin_lock_irq(&run->lock);
+	found = !list_empty(&run->idle_requests);
+	if (found) {
+		*request_ptr = list_first_entry(&run->idle_requests,
+						struct workload_request,
+						entry);
+		list_del_init(&(*request_ptr)->entry);
+	}
+	spin_unlock_irq(&run->lock);
+	return found;
+}
+
+/**
+ * Check whether every request of a run is idle.
+ *
+ * @param run  The run
+ *
+ * @return true if no request is in flight
+ **/
+static bool all_requests_idle(struct workload_run *run)
+{
+	unsigned int idle = 0;
+	struct list_head *entry;
+
+	spin_lock_irq(&run->lock);
+	list_for_each(entry, &run->idle_requests) {
+		idle++;
+	}
+	spin_unlock_irq(&run->lock);
+	return (idle == run->parameters.depth);
+}
+
+/**
+ * Choose, fill, and submit the next request of a run.
+ *
+ * @param run      The run
+ * @param request  An idle request to submit
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int submit_workload_request(struct workload_run *run,
+				   struct workload_request *request)
+{
+	struct workload_parameters *parameters = &run->parameters;
+	bool is_read = random_chance(run, parameters->read_percent);
+	unsigned int blocks =
+		parameters->sizes[random_below(run, parameters->size_count)];
+	logical_block_number_t lbn;
+	struct bio *bio;
+	unsigned int i;
+
+	if (random_chance(run, parameters->locality_percent)) {
+		lbn = run->next_lbn;
+	} else {
+		lbn = random_below(run, parameters->span);
+	}
+
+	if (lbn + blocks > parameters->span) {
+		lbn = 0;
+	}
+
+	run->next_lbn = lbn + blocks;
+
+	bio = bio_alloc(GFP_NOIO, blocks);
+	if (bio == NULL) {
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < blocks; i++) {
+		if (!is_read) {
+			fill_block(run, request->pages[i],
+				   choose_content(run));
+		}
+
+		bio_add_page(bio, request->pages[i], VDO_BLOCK_SIZE, 0);
+	}
+
+	bio->bi_opf = (is_read ? REQ_OP_READ : REQ_OP_WRITE);
+	bio->bi_iter.bi_sector = (run->layer->vdo.starting_sector_offset
+				  + block_to_sector(lbn));
+	bio->bi_private = request;
+	bio->bi_end_io = complete_workload_request;
+	request->block_count = blocks;
+	request->start_time = ktime_get_ns();
+
+	if (kvdo_map_bio(run->layer, bio) != DM_MAPIO_SUBMITTED) {
+		// The bio was failed without being completed.
+		bio->bi_status = BLK_STS_IOERR;
+		complete_workload_request(bio);
+	}
+
+	return VDO_SUCCESS;
+}
+
+/**
+ * Parse a list of request sizes.
+ *
+ * @param value       The comma separated list
+ * @param parameters  The parameters to update
+ *
+ * @return VDO_SUCCESS or -EINVAL
+ **/
+static int parse_sizes(char *value, struct workload_parameters *parameters)
+{
+	char *size;
+
+	parameters->size_count = 0;
+	while ((size = strsep(&value, ",")) != NULL) {
+		unsigned int blocks;
+
+		if ((parameters->size_count == MAXIMUM_WORKLOAD_SIZES) ||
+		    (kstrtouint(size, 10, &blocks) != 0) ||
+		    (blocks == 0) ||
+		    (blocks > MAXIMUM_WORKLOAD_REQUEST_BLOCKS)) {
+			return -EINVAL;
+		}
+
+		parameters->sizes[parameters->size_count++] = blocks;
+	}
+
+	return ((parameters->size_count > 0) ? VDO_SUCCESS : -EINVAL);
+}
+
+/**
+ * Parse one "key=value" workload argument.
+ *
+ * @param argument    The argument, which is modified
+ * @param parameters  The parameters to update
+ *
+ * @return VDO_SUCCESS or -EINVAL
+ **/
+static int parse_argument(char *argument,
+			  struct workload_parameters *parameters)
+{
+	char *value = argument;
+	char *key = strsep(&value, "=");
+	unsigned int *percent = NULL;
+	int result;
+
+	if (value == NULL) {
+		return -EINVAL;
+	}
+
+	if (strcmp(key, "ops") == 0) {
+		result = kstrtoull(value, 10, &parameters->operations);
+	} else if (strcmp(key, "depth") == 0) {
+		result = kstrtouint(value, 10, &parameters->depth);
+		if ((result == 0) &&
+		    ((parameters->depth == 0) ||
+		     (parameters->depth > MAXIMUM_WORKLOAD_DEPTH))) {
+			result = -EINVAL;
+		}
+	} else if (strcmp(key, "span") == 0) {
+		result = kstrtoull(value, 10, &parameters->span);
+	} else if (strcmp(key, "seed") == 0) {
+		result = kstrtoull(value, 10, &parameters->seed);
+	} else if (strcmp(key, "sizes") == 0) {
+		result = parse_sizes(value, parameters);
+	} else {
+		if (strcmp(key, "reads") == 0) {
+			percent = &parameters->read_percent;
+		} else if (strcmp(key, "dedupe") == 0) {
+			percent = &parameters->dedupe_percent;
+		} else if (strcmp(key, "compress") == 0) {
+			percent = &parameters->compress_percent;
+		} else if (strcmp(key, "locality") == 0) {
+			percent = &parameters->locality_percent;
+		} else {
+			return -EINVAL;
+		}
+
+		result = kstrtouint(value, 10, percent);
+		if ((result == 0) && (*percent > 100)) {
+			result = -EINVAL;
+		}
+	}
+
+	return ((result == 0) ? VDO_SUCCESS : -EINVAL);
+}
+
+/**
+ * Parse the workload arguments, starting from the defaults.
+ *
+ * @param layer       The layer to be driven
+ * @param argc        The number of arguments
+ * @param argv        The arguments
+ * @param parameters  The parameters to fill in
+ *
+ * @return VDO_SUCCESS or -EINVAL
+ **/
+static int parse_workload_parameters(struct kernel_layer *layer,
+				     unsigned int argc,
+				     char **argv,
+				     struct workload_parameters *parameters)
+{
+	block_count_t logical_blocks =
+		layer->vdo.states.vdo.config.logical_blocks;
+	unsigned int i;
+
+	*parameters = (struct workload_parameters) {
+		.operations = 100000,
+		.depth = 32,
+		.span = min_t(block_count_t, logical_blocks,
+			      DEFAULT_WORKLOAD_SPAN),
+		.size_count = 1,
+		.sizes = { 1 },
+		.seed = 1,
+	};
+
+	for (i = 0; i < argc; i++) {
+		if (parse_argument(argv[i], parameters) != VDO_SUCCESS) {
+			uds_log_warning("invalid workload argument '%s'",
+					argv[i]);
+			return -EINVAL;
+		}
+	}
+
+	if ((parameters->span < MAXIMUM_WORKLOAD_REQUEST_BLOCKS) ||
+	    (parameters->span > logical_blocks)) {
+		uds_log_warning("workload span %llu is not within the %llu logical blocks",
+				parameters->span, logical_blocks);
+		return -EINVAL;
+	}
+
+	return VDO_SUCCESS;
+}
+
+/**
+ * Free a run and the pages of its requests.
+ *
+ * @param run  The run to free
+ **/
+static void free_workload_run(struct workload_run *run)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < run->parameters.depth; i++) {
+		for (j = 0; j < MAXIMUM_WORKLOAD_REQUEST_BLOCKS; j++) {
+			if (run->requests[i].pages[j] != NULL) {
+				__free_page(run->requests[i].pages[j]);
+			}
+		}
+	}
+
+	FREE(run);
+}
+
+/**
+ * Make a run and the pages for its requests.
+ *
+ * @param layer       The layer to drive
+ * @param parameters  The parameters of the run
+ * @param run_ptr     A pointer to hold the run
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+static int make_workload_run(struct kernel_layer *layer,
+			     const struct workload_parameters *parameters,
+			     struct workload_run **run_ptr)
+{
+	struct workload_run *run;
+	unsigned int i, j;
+	int result = ALLOCATE_EXTENDED(struct workload_run,
+				       parameters->depth,
+				       struct workload_request,
+				       __func__,
+				       &run);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	run->layer = layer;
+	run->parameters = *parameters;
+	run->random = (parameters->seed == 0) ? 1 : parameters->seed;
+	spin_lock_init(&run->lock);
+	INIT_LIST_HEAD(&run->idle_requests);
+	init_waitqueue_head(&run->wait);
+	for (i = 0; i < parameters->depth; i++) {
+		struct workload_request *request = &run->requests[i];
+
+		request->run = run;
+		list_add_tail(&request->entry, &run->idle_requests);
+		for (j = 0; j < MAXIMUM_WORKLOAD_REQUEST_BLOCKS; j++) {
+			request->pages[j] = alloc_page(GFP_KERNEL);
+			if (request->pages[j] == NULL) {
+				free_workload_run(run);
+				return -ENOMEM;
+			}
+		}
+	}
+
+	*run_ptr = run;
+	return VDO_SUCCESS;
+}
+
+/**
+ * Find the latency at a percentile of a run's requests.
+ *
+ * @param run         The run
+ * @param operations  The number of requests which completed
+ * @param per_mille   The percentile, in tenths of a percent
+ *
+ * @return The least latency of the bucket holding the percentile, in us
+ **/
+static uint64_t get_latency_percentile(struct workload_run *run,
+				       uint64_t operations,
+				       unsigned int per_mille)
+{
+	uint64_t target = div_u64(operations * per_mille, 1000);
+	uint64_t seen = 0;
+	unsigned int bucket;
+
+	for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+		seen += atomic64_read(&run->latencies[bucket]);
+		if (seen > target) {
+			return bucket_latency(bucket);
+		}
+	}
+
+	return atomic64_read(&run->maximum_latency);
+}
+
+/**
+ * Write the report of a finished run.
+ *
+ * @param run         The run
+ * @param operations  The number of requests submitted
+ * @param elapsed     The duration of the run, in ns
+ * @param buffer      The buffer to hold the report
+ * @param length      The size of the buffer
+ **/
+static void report_workload_run(struct workload_run *run,
+				uint64_t operations,
+				uint64_t elapsed,
+				char *buffer,
+				unsigned int length)
+{
+	uint64_t blocks = atomic64_read(&run->blocks);
+	uint64_t elapsed_us = max_t(uint64_t, elapsed / NSEC_PER_USEC, 1);
+
+	scnprintf(buffer, length,
+		  "ops %llu blocks %llu errors %llu elapsed_us %llu iops %llu kib_per_sec %llu unique_blocks %llu latency_us p50 %llu p90 %llu p99 %llu p999 %llu max %llu\n",
+		  operations,
+		  blocks,
+		  (unsigned long long) atomic64_read(&run->errors),
+		  elapsed_us,
+		  div64_u64(operations * USEC_PER_SEC, elapsed_us),
+		  div64_u64(blocks * (VDO_BLOCK_SIZE / 1024) * USEC_PER_SEC,
+			    elapsed_us),
+		  run->unique_blocks,
+		  get_latency_percentile(run, operations, 500),
+		  get_latency_percentile(run, operations, 900),
+		  get_latency_percentile(run, operations, 990),
+		  get_latency_percentile(run, operations, 999),
+		  (unsigned long long) atomic64_read(&run->maximum_latency));
+}
+
+/**********************************************************************/
+int run_vdo_workload(struct kernel_layer *layer,
+		     unsigned int argc,
+		     char **argv,
+		     char *buffer,
+		     unsigned int length)
+{
+	struct workload_parameters parameters;
+	struct workload_run *run;
+	uint64_t submitted = 0;
+	uint64_t start;
+	int result;
+
+	if (get_kernel_layer_state(layer) != LAYER_RUNNING) {
+		uds_log_warning("cannot run a workload on a vdo which is not running");
+		return -EBUSY;
+	}
+
+	result = parse_workload_parameters(layer, argc, argv, &parameters);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	result = make_workload_run(layer, &parameters, &run);
+	if (result != VDO_SUCCESS) {
+		return result;
+	}
+
+	uds_log_info("starting workload: ops=%llu depth=%u reads=%u dedupe=%u compress=%u locality=%u span=%llu seed=%llu",
+		     parameters.operations, parameters.depth,
+		     parameters.read_percent, parameters.dedupe_percent,
+		     parameters.compress_percent, parameters.locality_percent,
+		     parameters.span, parameters.seed);
+	start = ktime_get_ns();
+	while (submitted < parameters.operations) {
+		struct workload_request *request;
+
+		if (get_kernel_layer_state(layer) != LAYER_RUNNING) {
+			uds_log_warning("vdo stopped running; ending workload early");
+			break;
+		}
+
+		wait_event(run->wait, take_idle_request(run, &request));
+		result = submit_workload_request(run, request);
+		if (result != VDO_SUCCESS) {
+			spin_lock_irq(&run->lock);
+			list_add(&request->entry, &run->idle_requests);
+			spin_unlock_irq(&run->lock);
+			break;
+		}
+
+		submitted++;
+	}
+
+	wait_event(run->wait, all_requests_idle(run));
+	report_workload_run(run, submitted, ktime_get_ns() - start, buffer,
+			    length);
+	uds_log_info("workload finished: %s", buffer);
+	free_workload_run(run);
+	return result;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright Red Hat
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA. 
+ */
+
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "kernelTypes.h"
+
+/**
+ * Drive a running vdo with a synthetic workload and report its throughput
+ * and latency. The workload is submitted through kvdo_map_bio() just as
+ * device-mapper would submit it, but its data is generated so that the
+ * fraction of duplicate blocks and the compressibility of each block are
+ * known exactly, and the whole run is reproducible from its seed.
+ *
+ * The arguments are "key=value" pairs, all optional:
+ *
+ *   ops=N         the number of requests to submit (default 100000)
+ *   depth=N       the number of requests in flight (default 32)
+ *   reads=P       the percentage of requests which are reads (default 0)
+ *   dedupe=P      the percentage of written blocks which duplicate an
+ *                 earlier written block (default 0)
+ *   compress=P    the percentage of each written block which compresses
+ *                 away (default 0)
+ *   locality=P    the percentage of requests which start where the
+ *                 previous one ended (default 0, fully random)
+ *   span=N        the number of logical blocks addressed (default the
+ *                 whole logical space, up to 2^20 blocks)
+ *   sizes=A,B,..  the request sizes in blocks, chosen uniformly
+ *                 (default 1)
+ *   seed=N        the seed for all random choices (default 1)
+ *
+ * The run blocks the caller until every request has completed. The device
+ * must not be suspended while a workload is running.
+ *
+ * @param layer   The layer to drive
+ * @param argc    The number of arguments
+ * @param argv    The arguments
+ * @param buffer  The buffer to hold the report
+ * @param length  The size of the buffer
+ *
+ * @return VDO_SUCCESS or an error
+ **/
+int __must_check run_vdo_workload(struct kernel_layer *layer,
+				  unsigned int argc,
+				  char **argv,
+				  char *buffer,
+				  unsigned int length);
+
+#endif // WORKLOAD_H